@@ -40,6 +40,7 @@ extern "C"
 #define cJSON_Object 6
 #define cJSON_2dFloatArray 7
 #define cJSON_VerFloat 8
+#define cJSON_Raw 9
 
 #define cJSON_IsReference 256
 
@@ -107,6 +108,8 @@ extern cJSON *cJSON_CreateDoubleArray(const double *numbers,int count, ngx_pool_
 extern cJSON *cJSON_CreateStringArray(const char **strings,int count, ngx_pool_t *pool);
 extern cJSON *cJSON_Create2dFloatArray(const float *num1, const float *num2, 
                                        int count, ngx_pool_t *pool);
+/* Already rendered JSON text, printed as it is. The text is not copied or freed. */
+extern cJSON *cJSON_CreateRawReference(const char *raw, ngx_pool_t *pool);
 
 /* Append item to the specified array/object. */
 extern void cJSON_AddItemToArray(cJSON *array, cJSON *item);
@@ -16,7 +16,9 @@
 #define __RP_BAZAAR_APP_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include "cJSON.h"
+#include "rp_signal_ring.h"
 
 /** Structure which describes parameters supported by the application.
  * Each application includes an parameters table which includes the following
@@ -53,6 +55,26 @@ typedef const char  *(*rp_app_desc_func)(void);
 typedef int          (*rp_set_params_func)(rp_app_params_t *p, int len);
 typedef int          (*rp_get_params_func)(rp_app_params_t **p);
 typedef int          (*rp_get_signals_func)(float ***s, int *sig_num, int *sig_len);
+/* Optional: rp_signal_ring_t *rp_get_signal_ring(void), see rp_signal_ring.h */
+/* Optional: JSON text of an image signal (e.g. a persistence histogram) into
+ * buf, returns its length or -1 if there is none or buf is too small. */
+typedef int          (*rp_get_signal_image_func)(char *buf, int len);
+/* Optional: JSON text of a small measurement table (e.g. spectrum peaks) into
+ * buf, same returns as rp_get_signal_image_func. */
+typedef int          (*rp_get_signal_table_func)(char *buf, int len);
+/* Optional pair, an application exporting both is kept resident when the user
+ * switches away (see rp_bazaar_app_park_module()):
+ *   rp_app_pause()  - stop threads and FPGA access, keep buffers and settings;
+ *                     exit may still follow instead of a resume.
+ *   rp_app_resume() - the app's FPGA image was loaded again, redo the hardware
+ *                     setup (rp_Init(), register mappings, settings) and restart.
+ */
+typedef int          (*rp_app_pause_func)(void);
+typedef int          (*rp_app_resume_func)(void);
+/* Optional: rp_app_clients(n) - n browsers are connected now (WebSocket or
+ * polling /data), called when the number changes. At 0 the application may
+ * stop acquiring until the next call. */
+typedef void         (*rp_app_clients_func)(int clients);
 
 /*WebSocket Server part*/
 typedef void		(*rp_ws_set_params_interval_func)(int);
@@ -64,6 +86,12 @@ typedef const char     *(*rp_ws_get_signals_func)(void);
 typedef int		(*rp_ws_set_params_func)(const char *_params);
 typedef int		(*rp_ws_set_signals_func)(const char *_signals);
 typedef void	(*rp_ws_gzip_func)(const char *_in, void* _data, size_t* _size);
+typedef uint64_t	(*rp_ws_update_params_func)(void);
+typedef uint64_t	(*rp_ws_update_signals_func)(void);
+typedef const void     *(*rp_ws_get_params_since_func)(uint64_t _since, size_t *_size);
+typedef const void     *(*rp_ws_get_signals_since_func)(uint64_t _since, size_t *_size);
+typedef const void     *(*rp_ws_get_signals_view_func)(uint64_t _since, int _points, double _start, double _stop, size_t *_size);
+typedef void	(*rp_ws_set_signals_notify_func)(void (*_notify)(void *_ctx), void *_ctx);
 
 typedef struct rp_bazaar_app_s {
     /* Initialization function - called when app. is loaded */
@@ -73,6 +101,11 @@ typedef struct rp_bazaar_app_s {
     /* Description function - provides short description of the application
      */
     rp_app_desc_func desc_func;
+    /* Optional, warm standby */
+    rp_app_pause_func  pause_func;
+    rp_app_resume_func resume_func;
+    /* Optional, connected client count */
+    rp_app_clients_func clients_func;
 
     /* Application ID (application's top directory name) */
     char            *id;
@@ -83,6 +116,12 @@ typedef struct rp_bazaar_app_s {
     rp_get_params_func       get_params_func;
     /* Retrieves last good signals from the application */
     rp_get_signals_func      get_signals_func;
+    /* Optional, signals read in place instead of get_signals_func() */
+    rp_get_signal_ring_func  get_signal_ring_func;
+    /* Optional, added to the signals as "image" */
+    rp_get_signal_image_func get_signal_image_func;
+    /* Optional, added to the signals as "table" */
+    rp_get_signal_table_func get_signal_table_func;
 
 	/*WebSocket Server part*/
 
@@ -98,6 +137,14 @@ typedef struct rp_bazaar_app_s {
 	rp_ws_set_params_interval_func ws_set_params_demo_func;
 	rp_ws_set_params_func verify_app_license_func;
 	rp_ws_gzip_func ws_gzip_func;
+	/* Optional, delta updates per client */
+	rp_ws_update_params_func ws_update_params_func;
+	rp_ws_update_signals_func ws_update_signals_func;
+	rp_ws_get_params_since_func ws_get_params_since_func;
+	rp_ws_get_signals_since_func ws_get_signals_since_func;
+	rp_ws_get_signals_view_func ws_get_signals_view_func;
+	/* Optional, signals pushed by the application */
+	rp_ws_set_signals_notify_func ws_set_signals_notify_func;
 
     /* Dynamic library handle */
     void            *handle;
@@ -133,10 +180,16 @@ int rp_bazaar_app_get_local_list(const char *dir, cJSON **json_root,
                                  ngx_pool_t *pool, int verbose);
 int rp_bazaar_app_load_module(const char *app_file, rp_bazaar_app_t *app);
 int rp_bazaar_app_unload_module(rp_bazaar_app_t *app);
+int rp_bazaar_app_park_module(rp_bazaar_app_t *app);
+int rp_bazaar_app_resume_module(const char *app_file, rp_bazaar_app_t *app);
 int rp_bazaar_get_mac(const char* nic, char *mac);
 int rp_bazaar_get_dna(unsigned long long *dna);
 int get_info(cJSON **info, const char *dir, const char *app_id, ngx_pool_t *pool);
 int get_fpga_path(const char *app_id, const char *dir, char **fpga_file);
 fpga_stat_t rp_bazaar_app_load_fpga(const char *fpga_file);
 
+void rp_bazaar_app_clients_attach(rp_app_clients_func func);
+void rp_bazaar_app_clients_ws(int clients);
+void rp_bazaar_app_clients_poll(void);
+
 #endif /*__RP_BAZAAR_APP_H*/
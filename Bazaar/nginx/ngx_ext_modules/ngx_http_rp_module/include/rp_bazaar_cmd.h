@@ -52,6 +52,9 @@ int rp_bazaar_start(ngx_http_request_t *r,
                     cJSON **json_root, int argc, char **argv);
 int rp_bazaar_stop(ngx_http_request_t *r, 
                    cJSON **json_root, int argc, char **argv);
+int rp_bazaar_status(ngx_http_request_t *r,
+                     cJSON **json_root, int argc, char **argv);
+int rp_bazaar_app_busy(void);
 
 
 int rp_bazaar_install(ngx_http_request_t *r);
@@ -0,0 +1,147 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Nginx module - Signal ring shared with the applications.
+ *
+ * The application worker publishes complete signal frames into the ring and
+ * the web server reads the newest frame in place, without a lock on either
+ * side. Every slot has a sequence counter which is odd while the slot is
+ * written; a reader that raced the writer sees the counter change and reads
+ * again. The writer only comes back to a slot after RP_SIGNAL_RING_SLOTS
+ * newer frames, so that is rare.
+ *
+ * Applications return their ring from the optional rp_get_signal_ring().
+ * Everything is in this header, the application and the web server do not
+ * link against each other.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_SIGNAL_RING_H
+#define __RP_SIGNAL_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RP_SIGNAL_RING_SLOTS 4
+
+typedef struct rp_signal_slot_s {
+    uint32_t seq;      /* odd while the slot is written */
+    int      index;    /* application defined, e.g. the last valid sample */
+    int      complete; /* 0 for a partial frame, see rp_get_signals() -2 */
+    float   *data;     /* sig_num signals of sig_len samples, one after the other */
+} rp_signal_slot_t;
+
+typedef struct rp_signal_ring_s {
+    int              sig_num;
+    int              sig_len;
+    uint32_t         frames;   /* published so far, the newest is in slot (frames - 1) % RP_SIGNAL_RING_SLOTS */
+    uint32_t         discarded; /* frames up to this one are stale, see rp_signal_ring_discard() */
+    rp_signal_slot_t slots[RP_SIGNAL_RING_SLOTS];
+    float           *mem;
+} rp_signal_ring_t;
+
+typedef rp_signal_ring_t *(*rp_get_signal_ring_func)(void);
+
+
+/*----------------------------------------------------------------------------*/
+static inline int rp_signal_ring_init(rp_signal_ring_t *ring, int sig_num, int sig_len)
+{
+    int i;
+
+    memset(ring, 0, sizeof(rp_signal_ring_t));
+    ring->mem = (float *)calloc((size_t)RP_SIGNAL_RING_SLOTS * sig_num * sig_len, sizeof(float));
+    if(ring->mem == NULL)
+        return -1;
+    ring->sig_num = sig_num;
+    ring->sig_len = sig_len;
+    for(i = 0; i < RP_SIGNAL_RING_SLOTS; i++)
+        ring->slots[i].data = ring->mem + (size_t)i * sig_num * sig_len;
+    return 0;
+}
+
+static inline void rp_signal_ring_free(rp_signal_ring_t *ring)
+{
+    free(ring->mem);
+    memset(ring, 0, sizeof(rp_signal_ring_t));
+}
+
+/*----------------------------------------------------------------------------*/
+/* Writer side, one thread only. The samples of signal i go to
+ * rp_signal_ring_write_begin() + i * sig_len.
+ */
+static inline float *rp_signal_ring_write_begin(rp_signal_ring_t *ring)
+{
+    rp_signal_slot_t *slot = &ring->slots[ring->frames % RP_SIGNAL_RING_SLOTS];
+
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return slot->data;
+}
+
+static inline void rp_signal_ring_write_end(rp_signal_ring_t *ring, int index, int complete)
+{
+    rp_signal_slot_t *slot = &ring->slots[ring->frames % RP_SIGNAL_RING_SLOTS];
+
+    slot->index = index;
+    slot->complete = complete;
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->frames, ring->frames + 1, __ATOMIC_RELEASE);
+}
+
+static inline void rp_signal_ring_write(rp_signal_ring_t *ring, float *const *source,
+                                        int index, int complete)
+{
+    float *data = rp_signal_ring_write_begin(ring);
+    int i;
+
+    for(i = 0; i < ring->sig_num; i++)
+        memcpy(data + (size_t)i * ring->sig_len, source[i], ring->sig_len * sizeof(float));
+    rp_signal_ring_write_end(ring, index, complete);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Reader side, any number of threads. Returns the slot of the newest frame
+ * or NULL if there is none yet. The frame is valid if rp_signal_ring_read_end()
+ * with the same seq returns 1 after the samples were used.
+ */
+static inline const rp_signal_slot_t *rp_signal_ring_read_begin(const rp_signal_ring_t *ring,
+                                                                uint32_t *frame, uint32_t *seq)
+{
+    uint32_t f = __atomic_load_n(&ring->frames, __ATOMIC_ACQUIRE);
+    const rp_signal_slot_t *slot;
+
+    *frame = f;
+    if(f == 0)
+        return NULL;
+    slot = &ring->slots[(f - 1) % RP_SIGNAL_RING_SLOTS];
+    *seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    return slot;
+}
+
+static inline int rp_signal_ring_read_end(const rp_signal_slot_t *slot, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return !(seq & 1) && __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+/* 1 if frame from rp_signal_ring_read_begin() is newer than last_frame,
+ * the last one the reader used, and was not discarded
+ */
+static inline int rp_signal_ring_is_new(const rp_signal_ring_t *ring, uint32_t frame, uint32_t last_frame)
+{
+    return frame != last_frame && frame != __atomic_load_n(&ring->discarded, __ATOMIC_ACQUIRE);
+}
+
+/* Marks the published frames stale, e.g. after a change of the settings */
+static inline void rp_signal_ring_discard(rp_signal_ring_t *ring)
+{
+    __atomic_store_n(&ring->discarded, __atomic_load_n(&ring->frames, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+#endif /* __RP_SIGNAL_RING_H */
@@ -379,6 +379,7 @@ static char *print_value(cJSON *item,int depth,int fmt, ngx_pool_t *pool)
         case cJSON_Array:	out=print_array(item,depth,fmt, pool);break;
         case cJSON_Object:	out=print_object(item,depth,fmt, pool);break;
         case cJSON_2dFloatArray: out=print_2dfloat_array(item, fmt, pool);break;
+        case cJSON_Raw:         out=cJSON_strdup(item->valuestring, pool);break;
 	}
 	return out;
 }
@@ -709,6 +710,16 @@ cJSON *cJSON_CreateFloatArray(const float *numbers,int count, ngx_pool_t *pool)
 cJSON *cJSON_CreateDoubleArray(const double *numbers,int count, ngx_pool_t *pool)	{int i;cJSON *n=0,*p=0,*a=cJSON_CreateArray(pool);for(i=0;a && i<count;i++){n=cJSON_CreateNumber(numbers[i], pool);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
 cJSON *cJSON_CreateStringArray(const char **strings,int count, ngx_pool_t *pool)	{int i;cJSON *n=0,*p=0,*a=cJSON_CreateArray(pool);for(i=0;a && i<count;i++){n=cJSON_CreateString(strings[i], pool);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
 
+cJSON *cJSON_CreateRawReference(const char *raw, ngx_pool_t *pool)
+{
+    cJSON *item = cJSON_New_Item(pool);
+    if(item) {
+        item->type = cJSON_Raw | cJSON_IsReference;
+        item->valuestring = (char *)raw;
+    }
+    return item;
+}
+
 cJSON *cJSON_Create2dFloatArray(const float *num1, const float *num2,
                                 int count, ngx_pool_t *pool)
 {
@@ -20,7 +20,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <dlfcn.h>
+#include <pthread.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
 
 #include "rp_bazaar_cmd.h"
 #include "rp_bazaar_app.h"
@@ -30,12 +37,18 @@
 const char *c_rp_app_init_str     = "rp_app_init";
 const char *c_rp_app_exit_str     = "rp_app_exit";
 const char *c_rp_app_desc_str     = "rp_app_desc";
+const char *c_rp_app_pause_str    = "rp_app_pause";
+const char *c_rp_app_resume_str   = "rp_app_resume";
+const char *c_rp_app_clients_str  = "rp_app_clients";
 const char *c_rp_params_desc_str  = "rp_params_desc";
 const char *c_rp_signals_desc_str = "rp_signals_desc";
 const char *c_rp_set_params_str   = "rp_set_params";
 const char *c_rp_get_params_str   = "rp_get_params";
 const char *c_rp_set_signals_str  = "rp_set_signals";
 const char *c_rp_get_signals_str  = "rp_get_signals";
+const char *c_rp_get_signal_ring_str = "rp_get_signal_ring";
+const char *c_rp_get_signal_image_str = "rp_get_signal_image";
+const char *c_rp_get_signal_table_str = "rp_get_signal_table";
 
 //start web socket function str
 
@@ -48,15 +61,28 @@ const char *c_ws_get_params_str   = "ws_get_params";
 const char *c_ws_set_signals_str  = "ws_set_signals";
 const char *c_ws_get_signals_str  = "ws_get_signals";
 const char* c_ws_gzip_str = "ws_gzip";
+const char* c_ws_update_params_str = "ws_update_params";
+const char* c_ws_update_signals_str = "ws_update_signals";
+const char* c_ws_get_params_since_str = "ws_get_params_since";
+const char* c_ws_get_signals_since_str = "ws_get_signals_since";
+const char* c_ws_get_signals_view_str = "ws_get_signals_view";
+const char* c_ws_set_signals_notify_str = "ws_set_signals_notify";
 // end web socket function str
 
-/** Get MAC address of a specific NIC via sysfs */
+/** Get MAC address of a specific NIC via sysfs, the last one read is kept */
 int rp_bazaar_get_mac(const char* nic, char *mac)
 {
+    static char cached_nic[PATH_MAX] = "";
+    static char cached_mac[18];
     FILE *fp;
     ssize_t read;
     const size_t len = 17;
 
+    if(!strcmp(cached_nic, nic)) {
+        memcpy(mac, cached_mac, sizeof(cached_mac));
+        return 0;
+    }
+
     fp = fopen(nic, "r");
     if(fp == NULL) {
         return -1;
@@ -71,17 +97,29 @@ int rp_bazaar_get_mac(const char* nic, char *mac)
 
     fclose(fp);
 
+    if(strlen(nic) < sizeof(cached_nic)) {
+        memcpy(cached_mac, mac, sizeof(cached_mac));
+        strcpy(cached_nic, nic);
+    }
+
     return 0;
 }
 
 
-/** Get DNA number */
+/** Get DNA number, it is read from the FPGA once */
 int rp_bazaar_get_dna(unsigned long long *dna)
 {
+    static unsigned long long cached_dna = 0;
     void *page_ptr;
     const long c_dna_fpga_base_size = 0x20;
     int fd = -1;
 
+    /* 0 and 1 are what the FPGA reads before the DNA is shifted in */
+    if(cached_dna > 1) {
+        *dna = cached_dna;
+        return 0;
+    }
+
     fd = open("/dev/uio/api", O_RDONLY | O_SYNC);
     if(fd < 0) {
         fprintf(stderr, "ERROR: failed open of UIO device: %s\n", strerror(errno));
@@ -109,6 +147,8 @@ int rp_bazaar_get_dna(unsigned long long *dna)
 
     close (fd);
 
+    cached_dna = *dna;
+
     return 0;
 }
 
@@ -139,19 +179,15 @@ inline int is_readable(const char *dir,
 }
 
 
-/* Returns 1 if app info is found within the "app_id"
- * application directory.
- * Returns 0 otherwise.
- *
- * If successful, info is parsed from info/desc.json.
+/* Returns the minified info/info.json of the "app_id" application
+ * directory, the caller frees it.
+ * Returns NULL if it cannot be read.
  */
-int get_info(cJSON **info, const char *dir, const char *app_id, ngx_pool_t *pool)
+static char *read_info(const char *dir, const char *app_id)
 {
     char *data = NULL;
-    cJSON *json = NULL;
     FILE *fp = NULL;
     size_t len, read;
-    int ret = 1;
     struct stat st;
 
     /* Read description JSON file */
@@ -164,8 +200,7 @@ int get_info(cJSON **info, const char *dir, const char *app_id, ngx_pool_t *pool
     fp = fopen(file, "r");
     if(fp == NULL) {
         fprintf(stderr, "Cannot open %s.\n", file);
-        ret = 0;
-        goto out;
+        return NULL;
     }
 
     stat(file, &st);
@@ -174,20 +209,44 @@ int get_info(cJSON **info, const char *dir, const char *app_id, ngx_pool_t *pool
     data = (char *)malloc(len+1);
     if(data == NULL) {
         fprintf(stderr, "Can not allocate memory: %s", strerror(errno));
-        ret = 0;
-        goto out;
+        fclose(fp);
+        return NULL;
     }
 
     read = fread(data, len, 1, fp);
+    fclose(fp);
     if(read != 1) {
         fprintf(stderr, "Cannot read from %s.\n", file);
-        ret = 0;
-        goto out;
+        free(data);
+        return NULL;
     }
+    data[len] = '\0';
 
     /* Get rid of comments */
     cJSON_Minify(data);
 
+    return data;
+}
+
+
+/* Returns 1 if app info is found within the "app_id"
+ * application directory.
+ * Returns 0 otherwise.
+ *
+ * If successful, info is parsed from info/info.json.
+ */
+int get_info(cJSON **info, const char *dir, const char *app_id, ngx_pool_t *pool)
+{
+    char *data = NULL;
+    cJSON *json = NULL;
+    int ret = 1;
+
+    data = read_info(dir, app_id);
+    if(data == NULL) {
+        ret = 0;
+        goto out;
+    }
+
     /* Parse relevant JSON content */
     json = cJSON_Parse(data, pool);
     if(json == NULL) {
@@ -204,7 +263,6 @@ int get_info(cJSON **info, const char *dir, const char *app_id, ngx_pool_t *pool
      * If not, the caller is responsible to delete it.
      */
     if (data)  free(data);
-    if (fp)    fclose(fp);
 
     return ret;
 }
@@ -298,25 +356,114 @@ int get_fpga_path(const char *app_id,
     return 0;
 }
 
-int rp_bazaar_app_get_local_list(const char *dir, cJSON **json_root,
-                                 ngx_pool_t *pool, int verbose)
+/* Applications found by the last scan of the apps directory. Checking an
+ * application loads its controller, so the scan is only repeated when
+ * inotify reports a change in the directory, an application directory or
+ * its info directory. Every nginx worker keeps its own catalogue.
+ */
+typedef struct rp_bazaar_app_entry_s {
+    char *app_id;
+    char *info;    /* minified info/info.json */
+    char *version; /* NULL if the info has none */
+} rp_bazaar_app_entry_t;
+
+static struct {
+    char                  *dir;
+    int                    valid;
+    int                    fd;  /* inotify, -1 without watches */
+    rp_bazaar_app_entry_t *apps;
+    size_t                 count;
+} app_cache = { NULL, 0, -1, NULL, 0 };
+
+static const uint32_t c_app_watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+    IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+
+static void app_cache_clear(void)
 {
-    static int once = 1;
-    if (once) {
-    	if(system("bazaar idgen 0"))
-            fprintf(stderr, "Problem with idfile generation");
-        once = 0;
+    size_t i;
+
+    for(i = 0; i < app_cache.count; i++) {
+        free(app_cache.apps[i].app_id);
+        free(app_cache.apps[i].info);
+        free(app_cache.apps[i].version);
     }
+    free(app_cache.apps);
+    app_cache.apps = NULL;
+    app_cache.count = 0;
+    app_cache.valid = 0;
+}
+
+/* Returns 1 if nothing changed since the last scan */
+static int app_cache_check(const char *dir)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t len;
+
+    if(!app_cache.valid || app_cache.fd < 0 || strcmp(app_cache.dir, dir))
+        return 0;
+
+    while((len = read(app_cache.fd, buf, sizeof(buf))) > 0)
+        changed = 1;
+    if(len < 0 && errno != EAGAIN)
+        changed = 1;
+
+    return !changed;
+}
+
+static void app_cache_watch(const char *dir, const char *app_id)
+{
+    char path [strlen(dir) + strlen(app_id) + strlen("/info") + 2];
+
+    if(app_cache.fd < 0)
+        return;
+
+    sprintf(path, "%s/%s", dir, app_id);
+    inotify_add_watch(app_cache.fd, path, c_app_watch_mask);
+    strcat(path, "/info");
+    inotify_add_watch(app_cache.fd, path, c_app_watch_mask);
+}
+
+static int app_cache_scan(const char *dir, ngx_pool_t *pool)
+{
     DIR *dp;
     struct dirent *ep;
+    size_t size = 0;
+
+    app_cache_clear();
+    free(app_cache.dir);
+    app_cache.dir = strdup(dir);
+    if(app_cache.dir == NULL)
+        return -1;
+
+    /* The watches are set up before the scan, a change while scanning
+     * is seen by the next request
+     */
+    if(app_cache.fd >= 0)
+        close(app_cache.fd);
+    app_cache.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(app_cache.fd < 0)
+        fprintf(stderr, "Cannot watch %s, apps are scanned on every request: %s\n",
+                dir, strerror(errno));
+    else if(inotify_add_watch(app_cache.fd, dir, c_app_watch_mask) < 0) {
+        close(app_cache.fd);
+        app_cache.fd = -1;
+    }
 
     if((dp = opendir(dir)) == NULL)
-        return rp_module_cmd_error(json_root, "Can not open apps directory",
-                                   strerror(errno), pool);
+        return -1;
 
     while((ep = readdir (dp))) {
         const char *app_id = ep->d_name;
         cJSON *info = NULL;
+        cJSON *j_ver;
+        char *data;
+        rp_bazaar_app_entry_t *entry;
+
+        if(!strcmp(app_id, ".") || !strcmp(app_id, ".."))
+            continue;
+        app_cache_watch(dir, app_id);
+
         /* check if structure is correct, we need:
          *  <app_id>/info/info.json
          *  <app_id>/info/icon.png
@@ -332,35 +479,79 @@ int rp_bazaar_app_get_local_list(const char *dir, cJSON **json_root,
             continue;
         if (!is_controller_ok(dir, app_id, "controllerhf.so"))
             continue;
-        if (!get_info(&info, dir, app_id, pool))
+        if ((data = read_info(dir, app_id)) == NULL)
             continue;
-        if (info == NULL)
+        if ((info = cJSON_Parse(data, pool)) == NULL) {
+            fprintf(stderr, "Error parsing JSON before [%s].\n", cJSON_GetErrorPtr());
+            free(data);
             continue;
+        }
+
+        if(app_cache.count == size) {
+            size_t new_size = size ? 2 * size : 16;
+            rp_bazaar_app_entry_t *apps = realloc(app_cache.apps, new_size * sizeof(*apps));
+            if(apps == NULL) {
+                cJSON_Delete(info, pool);
+                free(data);
+                continue;
+            }
+            app_cache.apps = apps;
+            size = new_size;
+        }
 
         /* We have an application */
+        entry = &app_cache.apps[app_cache.count++];
+        entry->app_id = strdup(app_id);
+        entry->info = data;
+        j_ver = cJSON_GetObjectItem(info, "version");
+        entry->version = j_ver != NULL && j_ver->valuestring != NULL ? strdup(j_ver->valuestring) : NULL;
+        cJSON_Delete(info, pool);
+    }
+
+    closedir(dp);
+    app_cache.valid = 1;
+    return 0;
+}
+
+int rp_bazaar_app_get_local_list(const char *dir, cJSON **json_root,
+                                 ngx_pool_t *pool, int verbose)
+{
+    static int once = 1;
+    if (once) {
+    	if(system("bazaar idgen 0"))
+            fprintf(stderr, "Problem with idfile generation");
+        once = 0;
+    }
+    size_t i;
+
+    if (!app_cache_check(dir) && app_cache_scan(dir, pool) < 0) {
+        app_cache_clear();
+        return rp_module_cmd_error(json_root, "Can not open apps directory",
+                                   strerror(errno), pool);
+    }
+
+    for (i = 0; i < app_cache.count; i++) {
+        const rp_bazaar_app_entry_t *entry = &app_cache.apps[i];
+
         if (verbose) {
             /* Attach whole info JSON */
+            cJSON *info = cJSON_Parse(entry->info, pool);
+            if (info == NULL)
+                continue;
             cJSON_AddItemToObject(info, "type", cJSON_CreateString("run", pool), pool);
-            cJSON_AddItemToObject(*json_root, app_id, info, pool);
+            cJSON_AddItemToObject(*json_root, entry->app_id, info, pool);
         } else {
             /* Include version only */
-            cJSON *j_ver = cJSON_GetObjectItem(info, "version");
-
-            if(j_ver == NULL) {
+            if(entry->version == NULL) {
                 fprintf(stderr, "Cannot get version from info JSON.\n");
-                cJSON_Delete(info, pool);
                 continue;
             }
 
-            cJSON_AddItemToObject(*json_root, app_id, cJSON_CreateString(j_ver->valuestring, pool), pool);
+            cJSON_AddItemToObject(*json_root, entry->app_id, cJSON_CreateString(entry->version, pool), pool);
             cJSON_AddItemToObject(*json_root, "type", cJSON_CreateString("run", pool), pool);
-            cJSON_Delete(j_ver, pool);
-            cJSON_Delete(info, pool);
         }
-        usleep(5);
     }
 
-    closedir(dp);
     return 0;
 }
 
@@ -389,6 +580,10 @@ int rp_bazaar_app_load_module(const char *app_file, rp_bazaar_app_t *app)
     if(!app->desc_func)
         return -4;
 
+    app->pause_func = dlsym(app->handle, c_rp_app_pause_str);
+    app->resume_func = dlsym(app->handle, c_rp_app_resume_str);
+    app->clients_func = dlsym(app->handle, c_rp_app_clients_str);
+
     app->set_params_func  = dlsym(app->handle, c_rp_set_params_str);
     if(!app->set_params_func)
         return -5;
@@ -401,6 +596,10 @@ int rp_bazaar_app_load_module(const char *app_file, rp_bazaar_app_t *app)
     if(!app->get_signals_func)
         return -7;
 
+    app->get_signal_ring_func = dlsym(app->handle, c_rp_get_signal_ring_str);
+    app->get_signal_image_func = dlsym(app->handle, c_rp_get_signal_image_str);
+    app->get_signal_table_func = dlsym(app->handle, c_rp_get_signal_table_str);
+
     // start web socket functionality
     app->ws_api_supported = 1;
     app->ws_set_params_interval_func = dlsym(app->handle, c_ws_set_params_interval_str);
@@ -466,6 +665,14 @@ int rp_bazaar_app_load_module(const char *app_file, rp_bazaar_app_t *app)
         fprintf(stderr, "Cannot resolve '%s' function.\n", c_ws_gzip_str);
     }
 
+    /* Applications built with an older SDK send every update to all clients */
+    app->ws_update_params_func = dlsym(app->handle, c_ws_update_params_str);
+    app->ws_update_signals_func = dlsym(app->handle, c_ws_update_signals_str);
+    app->ws_get_params_since_func = dlsym(app->handle, c_ws_get_params_since_str);
+    app->ws_get_signals_since_func = dlsym(app->handle, c_ws_get_signals_since_str);
+    app->ws_get_signals_view_func = dlsym(app->handle, c_ws_get_signals_view_str);
+    app->ws_set_signals_notify_func = dlsym(app->handle, c_ws_set_signals_notify_str);
+
     // end web socket functionality
 
     app->file_name = (char *)malloc(strlen(app_file)+1);
@@ -499,49 +706,333 @@ int rp_bazaar_app_unload_module(rp_bazaar_app_t *app)
     return 0;
 }
 
-/* Use xdevcfg to load the data - using 32k buffers */
+/*
+ * Warm standby. Applications with rp_app_pause()/rp_app_resume() stay loaded
+ * and initialized after the user leaves them, up to RP_BAZAAR_STANDBY_NUM of
+ * them, the least recently parked one is exited to make room. Parking and
+ * eviction only happen between two applications, so an exit never runs while
+ * another application uses the hardware.
+ */
+#define RP_BAZAAR_STANDBY_NUM 2
+
+static rp_bazaar_app_t standby[RP_BAZAAR_STANDBY_NUM];
+static unsigned standby_stamp[RP_BAZAAR_STANDBY_NUM];
+static unsigned standby_clock = 0;
+
+int rp_bazaar_app_park_module(rp_bazaar_app_t *app)
+{
+    int i, slot = 0;
+
+    if(!app->handle || !app->initialized || !app->pause_func || !app->resume_func) {
+        return rp_bazaar_app_unload_module(app);
+    }
+    stop_ws_server();
+    if(app->pause_func() < 0) {
+        fprintf(stderr, "Application pause failed, unloading it\n");
+        return rp_bazaar_app_unload_module(app);
+    }
+
+    for(i = 0; i < RP_BAZAAR_STANDBY_NUM; i++) {
+        if(!standby[i].handle) {
+            slot = i;
+            break;
+        }
+        if(standby_stamp[i] < standby_stamp[slot])
+            slot = i;
+    }
+    if(standby[slot].handle) {
+        fprintf(stderr, "Unloading standby application: '%s'\n", standby[slot].file_name);
+        rp_bazaar_app_unload_module(&standby[slot]);
+    }
+    standby[slot] = *app;
+    standby_stamp[slot] = ++standby_clock;
+    ngx_memset(app, 0, sizeof(rp_bazaar_app_t));
+    return 0;
+}
+
+/*
+ * Takes a parked instance of app_file into app, whose id is kept. Returns 1
+ * when the application was resumed, 0 when it has to be loaded. The same
+ * library must not be opened twice, so a parked instance that does not
+ * resume is exited.
+ */
+int rp_bazaar_app_resume_module(const char *app_file, rp_bazaar_app_t *app)
+{
+    int i;
+
+    for(i = 0; i < RP_BAZAAR_STANDBY_NUM; i++) {
+        rp_bazaar_app_t *s = &standby[i];
+        char *id = app->id;
+
+        if(!s->handle || strcmp(s->file_name, app_file))
+            continue;
+
+        if(s->id)
+            free(s->id);
+        *app = *s;
+        app->id = id;
+        ngx_memset(s, 0, sizeof(rp_bazaar_app_t));
+
+        if(app->resume_func() < 0) {
+            fprintf(stderr, "Application resume failed, loading it again\n");
+            app->id = NULL;
+            rp_bazaar_app_unload_module(app);
+            app->id = id;
+            return 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * FPGA loading. The last FPGA_CACHE_SIZE bitstreams are kept in memory, keyed
+ * by file identity and modification time, so switching back and forth between
+ * applications does not touch the SD card. The hash of the bitstream in the
+ * FPGA is kept in FPGA_LOADED_FILE (tmpfs, gone after a reboot); when it
+ * matches the requested one the FPGA is not programmed again. Anything else
+ * writing /dev/xdevcfg has to remove that file first.
+ */
+#define FPGA_CACHE_SIZE   3
+#define FPGA_LOADED_FILE  "/tmp/rp_fpga_loaded"
+
+typedef struct fpga_cache_s {
+    dev_t     dev;
+    ino_t     ino;
+    off_t     size;
+    time_t    mtime;
+    uint64_t  hash;
+    char     *data;
+    unsigned  used;       /* LRU stamp */
+} fpga_cache_t;
+
+static fpga_cache_t fpga_cache[FPGA_CACHE_SIZE];
+static unsigned fpga_cache_clock = 0;
+
+/* FNV-1a, 64 bit words */
+static uint64_t fpga_hash(const char *data, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    for (; i < size; i++) {
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+    return h ^ size;
+}
+
+static int fpga_loaded_hash(uint64_t *hash)
+{
+    FILE *f = fopen(FPGA_LOADED_FILE, "r");
+    int ok;
+    if (f == NULL)
+        return -1;
+    ok = fscanf(f, "%" SCNx64, hash) == 1;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static void fpga_set_loaded_hash(uint64_t hash)
+{
+    FILE *f = fopen(FPGA_LOADED_FILE, "w");
+    if (f == NULL)
+        return;
+    fprintf(f, "%016" PRIx64 "\n", hash);
+    fclose(f);
+}
+
+static fpga_cache_t *fpga_cache_find(const struct stat *st)
+{
+    int i;
+    for (i = 0; i < FPGA_CACHE_SIZE; i++) {
+        fpga_cache_t *c = &fpga_cache[i];
+        if (c->data && c->dev == st->st_dev && c->ino == st->st_ino &&
+            c->size == st->st_size && c->mtime == st->st_mtime)
+            return c;
+    }
+    return NULL;
+}
+
+static void fpga_cache_put(const struct stat *st, const char *data, uint64_t hash)
+{
+    fpga_cache_t *c = &fpga_cache[0];
+    int i;
+    for (i = 1; i < FPGA_CACHE_SIZE; i++) {
+        if (!c->data)
+            break;
+        if (!fpga_cache[i].data || fpga_cache[i].used < c->used)
+            c = &fpga_cache[i];
+    }
+    free(c->data);
+    c->data = malloc(st->st_size);
+    if (c->data == NULL)
+        return;
+    memcpy(c->data, data, st->st_size);
+    c->dev = st->st_dev;
+    c->ino = st->st_ino;
+    c->size = st->st_size;
+    c->mtime = st->st_mtime;
+    c->hash = hash;
+    c->used = ++fpga_cache_clock;
+}
+
+static int fpga_write_all(int fo, const char *data, size_t size)
+{
+    while (size) {
+        ssize_t w = write(fo, data, size);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += w;
+        size -= w;
+    }
+    return 0;
+}
+
 fpga_stat_t rp_bazaar_app_load_fpga(const char *fpga_file)
 {
     int fo, fi;
-    int fpga_size;
     struct stat st;
+    fpga_cache_t *c;
+    const char *data;
+    char *map = NULL;
+    uint64_t hash, loaded;
+    fpga_stat_t ret = FPGA_OK;
+
+    fi = open(fpga_file, O_RDONLY);
+    if(fi < 0 || fstat(fi, &st) < 0) {
+        fprintf(stderr, "rp_bazaar_app_load_fpga() failed to open FPGA file: %s\n",
+                strerror(errno));
+        if (fi >= 0)
+            close(fi);
+        return FPGA_FIND_ERR;
+    }
 
+    c = fpga_cache_find(&st);
+    if (c) {
+        c->used = ++fpga_cache_clock;
+        data = c->data;
+        hash = c->hash;
+    } else {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fi, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Unable to read FPGA file: %s\n",
+                strerror(errno));
+            close(fi);
+            return FPGA_READ_ERR;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        data = map;
+        hash = fpga_hash(data, st.st_size);
+    }
+    close(fi);
 
-    /* Get FPGA size */
-    stat(fpga_file, &st);
-    fpga_size = st.st_size;
-    char fi_buff[fpga_size];
+    if (fpga_loaded_hash(&loaded) == 0 && loaded == hash) {
+        fprintf(stderr, "FPGA already holds '%s', not reprogrammed\n", fpga_file);
+        goto done;
+    }
 
     fo = open("/dev/xdevcfg", O_WRONLY);
     if(fo < 0) {
         fprintf(stderr, "rp_bazaar_app_load_fpga() failed to open xdevcfg: %s\n",
                 strerror(errno));
-        return FPGA_READ_ERR;
+        ret = FPGA_READ_ERR;
+        goto done;
     }
 
-    fi = open(fpga_file, O_RDONLY);
-    if(fi < 0) {
-        fprintf(stderr, "rp_bazaar_app_load_fpga() failed to open FPGA file: %s\n",
-                strerror(errno));
-        return FPGA_FIND_ERR;
+    unlink(FPGA_LOADED_FILE);
+    if(fpga_write_all(fo, data, st.st_size) < 0){
+        fprintf(stderr, "Unable to write to /dev/xdevcfg: %s\n",
+            strerror(errno));
+        close(fo);
+        ret = FPGA_WRITE_ERR;
+        goto done;
     }
+    if (close(fo) == 0)
+        fpga_set_loaded_hash(hash);
 
-    /* Read FPGA file into fi_buff */
-    if(read(fi, &fi_buff, fpga_size) < 0){
-        fprintf(stderr, "Unable to read FPGA file: %s\n",
-            strerror(errno));
-        return FPGA_READ_ERR;
+done:
+    if (map) {
+        fpga_cache_put(&st, map, hash);
+        munmap(map, st.st_size);
     }
+    return ret;
+}
 
-    /* Write fi_buff into fo */
-    if(write(fo, &fi_buff, fpga_size) < 0){
-        fprintf(stderr, "Unable to write to /dev/xdevcfg: %s\n",
-            strerror(errno));
-        return FPGA_WRITE_ERR;
+/*
+ * Connected clients. WebSocket clients are counted by the ws_server, a client
+ * polling /data counts while its last request is less than
+ * RP_BAZAAR_CLIENT_IDLE_MS old. Changes of the total go to the attached
+ * rp_app_clients() of the running application, which may idle its workers
+ * while nobody watches. The idle time is longer than any held /data GET.
+ */
+#define RP_BAZAAR_CLIENT_IDLE_MS 5000
+
+static pthread_mutex_t     clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static rp_app_clients_func clients_func = NULL;
+static int                 clients_ws = 0;
+static int                 clients_poll = 0;
+static int                 clients_reported = -1;
+static ngx_event_t         clients_poll_ev;
+
+/* Called with clients_lock held */
+static void rp_bazaar_app_clients_report(void)
+{
+    int clients = clients_ws + clients_poll;
+
+    if(clients_func && clients != clients_reported) {
+        clients_reported = clients;
+        clients_func(clients);
     }
+}
 
-    close(fo);
-    close(fi);
+/* Loader thread, NULL before the running application is parked or unloaded */
+void rp_bazaar_app_clients_attach(rp_app_clients_func func)
+{
+    pthread_mutex_lock(&clients_lock);
+    clients_func = func;
+    clients_reported = -1;
+    rp_bazaar_app_clients_report();
+    pthread_mutex_unlock(&clients_lock);
+}
 
-    return FPGA_OK;
+/* ws_server thread, on every open and close */
+void rp_bazaar_app_clients_ws(int clients)
+{
+    pthread_mutex_lock(&clients_lock);
+    clients_ws = clients;
+    rp_bazaar_app_clients_report();
+    pthread_mutex_unlock(&clients_lock);
+}
+
+static void rp_bazaar_app_clients_idle(ngx_event_t *ev)
+{
+    pthread_mutex_lock(&clients_lock);
+    clients_poll = 0;
+    rp_bazaar_app_clients_report();
+    pthread_mutex_unlock(&clients_lock);
+}
+
+/* nginx thread, on every /data request */
+void rp_bazaar_app_clients_poll(void)
+{
+    if(clients_poll_ev.handler == NULL) {
+        clients_poll_ev.handler = rp_bazaar_app_clients_idle;
+        clients_poll_ev.log = rp_module_ctx.log;
+        clients_poll_ev.cancelable = 1;
+    }
+    ngx_add_timer(&clients_poll_ev, RP_BAZAAR_CLIENT_IDLE_MS);
+
+    if(!clients_poll) {
+        pthread_mutex_lock(&clients_lock);
+        clients_poll = 1;
+        rp_bazaar_app_clients_report();
+        pthread_mutex_unlock(&clients_lock);
+    }
 }
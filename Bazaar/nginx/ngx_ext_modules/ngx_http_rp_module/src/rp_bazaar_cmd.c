@@ -26,6 +26,7 @@
 #include <ws_server.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 /** The list of available Bazaar commands */
@@ -42,6 +43,9 @@ rp_module_cmd_t bazaar_cmds[] = {
     { "arg_stop", "",
       "Stops the currently running application.",
       &rp_bazaar_stop },
+    { "arg_status", "",
+      "Returns the application and whether it is starting, running or failed.",
+      &rp_bazaar_status },
     { "arg_install", "<app_name>",
       "Installs the application <app_name> from Bazaar.",
       NULL },
@@ -396,69 +400,71 @@ int rp_bazaar_apps(ngx_http_request_t *r,
 }
 
 /*----------------------------------------------------------------------------*/
-int rp_bazaar_start(ngx_http_request_t *r,
-                    cJSON **json_root, int argc, char **argv)
+/* Applications are started and stopped on a loader thread, loading the FPGA
+ * and initializing an application would otherwise hold up every request of
+ * the worker. A start request queues the job and answers AGAIN until it is
+ * done, the clients repeat it until they get OK or ERROR. The next start
+ * request for the application gets the result, later ones start it again.
+ * A job that is queued while another one runs replaces the one waiting.
+ */
+typedef enum {
+    eJobNone,
+    eJobStart,
+    eJobStop
+} job_e;
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  job_cond = PTHREAD_COND_INITIALIZER;
+static struct {
+    int         thread_started;
+    job_e       pending;
+    char       *pending_id;
+    char       *pending_dir;
+    job_e       running;
+    char       *app_id;       /* of the last start */
+    const char *state;        /* stopped, starting, running, failed, stopping */
+    char        reason[128];  /* why the last start failed */
+    int         unreported;   /* the last start was not answered yet */
+} job = { 0, eJobNone, NULL, NULL, eJobNone, NULL, "stopped", "", 0 };
+
+static int job_fail(const char *reason)
 {
-    char* url = strstr(argv[0], "?type=demo");
-    if (url)
-    {
-        *url = '\0';
-    }
-    else
-    {
-       url = strstr(argv[0], "?type=run");
-       if(url)
-            *url = '\0';
-    }
+    snprintf(job.reason, sizeof(job.reason), "%s", reason);
+    return -1;
+}
 
+/* Runs on the loader thread, returns 0 if the application is running */
+static int rp_bazaar_do_start(const char *dir, const char *app_id)
+{
     int unsigned len;
-    ngx_http_rp_loc_conf_t *lc =
-        ngx_http_get_module_loc_conf(r, ngx_http_rp_module);
-
-    if(argc != 1) {
-        return rp_module_cmd_error(json_root,
-                                "Incorrect number of arguments (should be 1)",
-                                   NULL, r->pool);
-    }
 
-    /* Check if application is already running and unload it if so. */
+    /* Check if application is already running and park or unload it if so. */
     if(rp_module_ctx.app.handle != NULL) {
-        if(rp_bazaar_app_unload_module(&rp_module_ctx.app)) {
-            return rp_module_cmd_error(json_root,
-                                       "Can not unload existing application.",
-                                       NULL, r->pool);
+        rp_bazaar_app_clients_attach(NULL);
+        if(rp_bazaar_app_park_module(&rp_module_ctx.app)) {
+            return job_fail("Can not unload existing application.");
         }
     }
 
     /* Application id string */
-    len = strlen(argv[0]) + 1;
+    len = strlen(app_id) + 1;
     rp_module_ctx.app.id = (char *)malloc(len);
     if(rp_module_ctx.app.id == NULL) {
-        return rp_module_cmd_error(json_root, "Can not allocate memory",
-                                   strerror(errno), r->pool);
+        return job_fail("Can not allocate memory");
     }
-    strcpy(rp_module_ctx.app.id, argv[0]);
+    strcpy(rp_module_ctx.app.id, app_id);
 
     /* Assemble the application and FPGA filename: <app_dir>/<app_id>/controllerhf.so */
-    len = strlen((char *)lc->bazaar_dir.data) + strlen(argv[0]) + strlen("/controllerhf.so") + 2;
+    len = strlen(dir) + strlen(app_id) + strlen("/controllerhf.so") + 2;
     char app_name[len];
-    sprintf(app_name, "%s/%s/controllerhf.so", lc->bazaar_dir.data, argv[0]);
+    sprintf(app_name, "%s/%s/controllerhf.so", dir, app_id);
     app_name[len-1]='\0';
 
-    /* Unload existing application before, new fpga load */
-    if(rp_module_ctx.app.handle != NULL){
-        if(rp_bazaar_app_unload_module(&rp_module_ctx.app)){
-            return rp_module_cmd_error(json_root,
-                                       "Cannot unload existing application.",
-                                       NULL, r->pool);
-        }
-    }
-
     /* Get FPGA config file in <app_dir>/<app_id>/fpga.conf */
     char *fpga_name = NULL;
     if (system("/opt/redpitaya/sbin/rmoverlay.sh"))
         fprintf(stderr, "Problem running /opt/redpitaya/sbin/rmoverlay.sh\n");
-    if(get_fpga_path((const char *)argv[0], (const char *)lc->bazaar_dir.data, &fpga_name) == 0) { // FIXME !!!
+    if(get_fpga_path(app_id, dir, &fpga_name) == 0) { // FIXME !!!
         /* Here we do not have application running anymore - load new FPGA */
         fprintf(stderr, "Loading specific FPGA from: '%s'\n", fpga_name);
         /* Try loading FPGA code
@@ -468,13 +474,13 @@ int rp_bazaar_start(ngx_http_request_t *r,
         switch (rp_bazaar_app_load_fpga(fpga_name)) {
             case FPGA_FIND_ERR:
                 if (fpga_name)  free(fpga_name);
-                return rp_module_cmd_error(json_root, "Cannot find fpga file.", NULL, r->pool);
+                return job_fail("Cannot find fpga file.");
             case FPGA_READ_ERR:
                 if (fpga_name)  free(fpga_name);
-                return rp_module_cmd_error(json_root, "Unable to read FPGA file.", NULL, r->pool);
+                return job_fail("Unable to read FPGA file.");
             case FPGA_WRITE_ERR:
                 if (fpga_name)  free(fpga_name);
-                return rp_module_cmd_error(json_root, "Unable to write FPGA file into memory.", NULL, r->pool);
+                return job_fail("Unable to write FPGA file into memory.");
             /* App is a new app and doesn't need custom fpga.bit */
             case FPGA_NOT_REQ:
                 if (fpga_name)  free(fpga_name);
@@ -482,38 +488,38 @@ int rp_bazaar_start(ngx_http_request_t *r,
             case FPGA_OK:
             {
                 if (fpga_name)  free(fpga_name);
-                len = strlen((char *)lc->bazaar_dir.data) + strlen(argv[0]) + strlen("/fpga.sh") + 2;
+                len = strlen(dir) + strlen(app_id) + strlen("/fpga.sh") + 2;
                 char dmaDrv[len];
-                sprintf(dmaDrv, "%s/%s/fpga.sh", lc->bazaar_dir.data, argv[0]);
+                sprintf(dmaDrv, "%s/%s/fpga.sh", dir, app_id);
                 if (system(dmaDrv))
                     fprintf(stderr, "Problem running %s\n", dmaDrv);
                 break;
             }
             default:
                 if (fpga_name)  free(fpga_name);
-                return rp_module_cmd_error(json_root, "Unknown error.", NULL, r->pool);
+                return job_fail("Unknown error.");
         }
     } else {
         fprintf(stderr, "Not loading specific FPGA, since no fpga.conf file was found.\n");
     }
 
-    /* Load new application. */
-    fprintf(stderr, "Loading application: '%s'\n", app_name);
-    if(rp_bazaar_app_load_module(&app_name[0], &rp_module_ctx.app) < 0) {
-        rp_bazaar_app_unload_module(&rp_module_ctx.app);
-        return rp_module_cmd_error(json_root, "Can not load application.",
-                                   NULL, r->pool);
-    }
+    /* Resume the application from standby or load it. */
+    if(rp_bazaar_app_resume_module(&app_name[0], &rp_module_ctx.app)) {
+        fprintf(stderr, "Application resumed: '%s'\n", app_name);
+    } else {
+        fprintf(stderr, "Loading application: '%s'\n", app_name);
+        if(rp_bazaar_app_load_module(&app_name[0], &rp_module_ctx.app) < 0) {
+            rp_bazaar_app_unload_module(&rp_module_ctx.app);
+            return job_fail("Can not load application.");
+        }
 
-    if(rp_module_ctx.app.init_func() < 0) {
-        rp_module_cmd_error(json_root,
-                            "Application init failed, aborting",
-                            NULL, r->pool);
-        rp_bazaar_app_unload_module(&rp_module_ctx.app);
-        return -1;
+        if(rp_module_ctx.app.init_func() < 0) {
+            rp_bazaar_app_unload_module(&rp_module_ctx.app);
+            return job_fail("Application init failed, aborting");
+        }
+        rp_module_ctx.app.initialized=1;
+        fprintf(stderr, "Application loaded succesfully!\n");
     }
-    rp_module_ctx.app.initialized=1;
-    fprintf(stderr, "Application loaded succesfully!\n");
 
     //start web socket server
     if(rp_module_ctx.app.ws_api_supported)
@@ -530,12 +536,148 @@ int rp_bazaar_start(ngx_http_request_t *r,
         params.get_signals_func = rp_module_ctx.app.ws_get_signals_func;
         params.set_signals_func = rp_module_ctx.app.ws_set_signals_func;
         params.gzip_func = rp_module_ctx.app.ws_gzip_func;
+        params.update_params_func = rp_module_ctx.app.ws_update_params_func;
+        params.update_signals_func = rp_module_ctx.app.ws_update_signals_func;
+        params.get_params_since_func = rp_module_ctx.app.ws_get_params_since_func;
+        params.get_signals_since_func = rp_module_ctx.app.ws_get_signals_since_func;
+        params.get_signals_view_func = rp_module_ctx.app.ws_get_signals_view_func;
+        params.set_signals_notify_func = rp_module_ctx.app.ws_set_signals_notify_func;
+        params.set_clients_func = rp_bazaar_app_clients_ws;
         fprintf(stderr, "Starting WS-server\n");
 
         start_ws_server(&params);
     }
+    rp_bazaar_app_clients_attach(rp_module_ctx.app.clients_func);
 
-    return rp_module_cmd_ok(json_root, r->pool);
+    return 0;
+}
+
+static void *rp_bazaar_loader(void *arg)
+{
+    pthread_mutex_lock(&job_lock);
+    while(1) {
+        while(job.pending == eJobNone)
+            pthread_cond_wait(&job_cond, &job_lock);
+
+        job_e type = job.pending;
+        char *app_id = job.pending_id;
+        char *dir = job.pending_dir;
+        job.pending = eJobNone;
+        job.pending_id = NULL;
+        job.pending_dir = NULL;
+        job.running = type;
+        pthread_mutex_unlock(&job_lock);
+
+        int rc = 0;
+        if(type == eJobStart) {
+            rc = rp_bazaar_do_start(dir, app_id);
+        } else if(rp_module_ctx.app.handle != NULL) {
+            /* Ignore requests to unload the application controller, if none is loaded. */
+            if(rp_bazaar_app_park_module(&rp_module_ctx.app) < 0)
+                fprintf(stderr, "Can not unload application.\n");
+        }
+
+        pthread_mutex_lock(&job_lock);
+        job.running = eJobNone;
+        if(type == eJobStart) {
+            job.state = rc ? "failed" : "running";
+            job.unreported = 1;
+            fprintf(stderr, "Application '%s' %s\n", app_id, job.state);
+        } else {
+            job.state = "stopped";
+        }
+        free(app_id);
+        free(dir);
+    }
+    return NULL;
+}
+
+/* Called with job_lock held */
+static int rp_bazaar_queue_job(job_e type, const char *dir, const char *app_id)
+{
+    if(!job.thread_started) {
+        pthread_t thread;
+        int rc = pthread_create(&thread, NULL, rp_bazaar_loader, NULL);
+        if(rc) {
+            fprintf(stderr, "Cannot start the application loader: %s\n", strerror(rc));
+            return -1;
+        }
+        pthread_detach(thread);
+        job.thread_started = 1;
+    }
+
+    free(job.pending_id);
+    free(job.pending_dir);
+    job.pending_id = app_id ? strdup(app_id) : NULL;
+    job.pending_dir = dir ? strdup(dir) : NULL;
+    job.pending = type;
+    if(type == eJobStart) {
+        free(job.app_id);
+        job.app_id = strdup(app_id);
+        job.state = "starting";
+        job.reason[0] = '\0';
+        job.unreported = 0;
+    } else {
+        job.state = "stopping";
+    }
+    pthread_cond_signal(&job_cond);
+    return 0;
+}
+
+/* The application must not be used by the requests while a job is queued or runs */
+int rp_bazaar_app_busy(void)
+{
+    pthread_mutex_lock(&job_lock);
+    int busy = job.pending != eJobNone || job.running != eJobNone;
+    pthread_mutex_unlock(&job_lock);
+    return busy;
+}
+
+/*----------------------------------------------------------------------------*/
+int rp_bazaar_start(ngx_http_request_t *r,
+                    cJSON **json_root, int argc, char **argv)
+{
+    char* url = strstr(argv[0], "?type=demo");
+    if (url)
+    {
+        *url = '\0';
+    }
+    else
+    {
+       url = strstr(argv[0], "?type=run");
+       if(url)
+            *url = '\0';
+    }
+
+    ngx_http_rp_loc_conf_t *lc =
+        ngx_http_get_module_loc_conf(r, ngx_http_rp_module);
+
+    if(argc != 1) {
+        return rp_module_cmd_error(json_root,
+                                "Incorrect number of arguments (should be 1)",
+                                   NULL, r->pool);
+    }
+
+    int ret;
+    pthread_mutex_lock(&job_lock);
+    int same = job.app_id != NULL && !strcmp(job.app_id, argv[0]);
+    if(same && (job.pending == eJobStart || job.running == eJobStart)) {
+        ret = rp_module_cmd_again(json_root, r->pool);
+    } else if(same && job.unreported && job.pending == eJobNone && job.running == eJobNone) {
+        job.unreported = 0;
+        if(!strcmp(job.state, "running"))
+            ret = rp_module_cmd_ok(json_root, r->pool);
+        else
+            ret = rp_module_cmd_error(json_root, job.reason, NULL, r->pool);
+    } else if(rp_bazaar_queue_job(eJobStart, (const char *)lc->bazaar_dir.data, argv[0]) < 0) {
+        ret = rp_module_cmd_error(json_root, "Can not start application loader.",
+                                  NULL, r->pool);
+    } else {
+        ret = rp_module_cmd_again(json_root, r->pool);
+    }
+    pthread_mutex_unlock(&job_lock);
+
+    return ret;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -548,14 +690,35 @@ int rp_bazaar_stop(ngx_http_request_t *r,
                                    NULL, r->pool);
     }*/
 
-    if(rp_module_ctx.app.handle == NULL) {
-        /* Ignore requests to unload the application controller, if none is loaded. */
-        return rp_module_cmd_ok(json_root, r->pool);
-    }
-    if(rp_bazaar_app_unload_module(&rp_module_ctx.app) < 0) {
-        return rp_module_cmd_error(json_root,
-                                   "Can not unload application.", NULL, r->pool);
+    int ret;
+    pthread_mutex_lock(&job_lock);
+    if(!strcmp(job.state, "stopped") && job.pending == eJobNone) {
+        ret = rp_module_cmd_ok(json_root, r->pool);
+    } else if(rp_bazaar_queue_job(eJobStop, NULL, NULL) < 0) {
+        ret = rp_module_cmd_error(json_root, "Can not unload application.",
+                                  NULL, r->pool);
+    } else {
+        ret = rp_module_cmd_ok(json_root, r->pool);
     }
+    pthread_mutex_unlock(&job_lock);
+
+    return ret;
+}
+
+/*----------------------------------------------------------------------------*/
+int rp_bazaar_status(ngx_http_request_t *r,
+                     cJSON **json_root, int argc, char **argv)
+{
+    pthread_mutex_lock(&job_lock);
+    cJSON_AddItemToObject(*json_root, "app",
+                          cJSON_CreateString(job.app_id ? job.app_id : "", r->pool),
+                          r->pool);
+    cJSON_AddItemToObject(*json_root, "state",
+                          cJSON_CreateString(job.state, r->pool), r->pool);
+    if(job.reason[0])
+        cJSON_AddItemToObject(*json_root, "reason",
+                              cJSON_CreateString(job.reason, r->pool), r->pool);
+    pthread_mutex_unlock(&job_lock);
 
     return rp_module_cmd_ok(json_root, r->pool);
 }
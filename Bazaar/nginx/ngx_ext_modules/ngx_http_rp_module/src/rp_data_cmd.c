@@ -17,13 +17,35 @@
 #include <ngx_http.h>
 #include <ngx_log.h>
 
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+
 #include "ngx_http_rp_module.h"
 #include "rp_data_cmd.h"
+#include "rp_bazaar_cmd.h"
 #include "cJSON.h"
 
+/* Samples per signal the applications can return */
+#define RP_DATA_SIG_LEN  2048
+/* Signals besides the time the applications can return, at least 2 are sent */
+#define RP_DATA_CH_MAX   3
+/* Longest text of one number, "%.04f" of a float above 1e38 */
+#define RP_DATA_NUM_MAX  48
+/* Longest a GET with ?wait=<ms> is held for new signals */
+#define RP_DATA_WAIT_MAX 2000
+/* How often a held GET checks for new signals, in ms */
+#define RP_DATA_POLL_MS  2
+/* Largest image signal text taken from get_signal_image_func() */
+#define RP_DATA_IMAGE_MAX (192 * 1024)
+/* Largest table text taken from get_signal_table_func() */
+#define RP_DATA_TABLE_MAX (8 * 1024)
+
 /* last good result container */
 static float **rp_signals = NULL;
 static int     rp_signals_dirty = 0;
+/* JSON text of the signals, allocated once for RP_DATA_SIG_LEN samples */
+static char   *rp_signals_text = NULL;
 
 #define TRACE(args...) fprintf(stderr, args)
 
@@ -37,6 +59,19 @@ typedef struct rp_data_ctx_s {
     int    finalize_on_post_handler;
 } rp_data_ctx_t;
 
+/* GET held until the application has new signals, see rp_data_wait() */
+typedef struct rp_data_poll_s {
+    ngx_http_request_t *r;
+    cJSON              *json_root;
+    ngx_event_t         ev;
+    ngx_msec_t          deadline;
+} rp_data_poll_t;
+
+static int rp_data_alloc_signals(void);
+static int rp_data_fetch_signals(int retries);
+static int rp_data_add_signals(ngx_http_request_t *r, cJSON **json_root, int ret_val);
+static ngx_int_t rp_data_wait(ngx_http_request_t *r, cJSON *json_root, ngx_msec_t wait);
+
 
 /*----------------------------------------------------------------------------*/
 /**
@@ -83,12 +118,14 @@ ngx_int_t rp_data_cmd_handler(ngx_http_request_t *r)
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    if(!rp_module_ctx.app.handle) {
+    /* The loader thread owns the application while it starts or stops it */
+    if(rp_bazaar_app_busy() || !rp_module_ctx.app.handle) {
         rp_error(r->connection->log, "Application not loaded");
         rp_module_cmd_error(&json_root, "Application not loaded", NULL, 
                             r->pool);
         return rp_module_send_response(r, &json_root);
     }
+    rp_bazaar_app_clients_poll();
 
     char *app_id = rp_module_ctx.app.id;
     if (!app_id) {
@@ -121,7 +158,24 @@ ngx_int_t rp_data_cmd_handler(ngx_http_request_t *r)
         return rc;
     }
 
+    /* Long poll: with ?wait=<ms> the answer is held until the application
+     * has new signals or the time is up, instead of the client polling
+     */
+    ngx_str_t wait_arg;
+    if(ngx_http_arg(r, (u_char *)"wait", 4, &wait_arg) == NGX_OK) {
+        ngx_int_t wait = ngx_atoi(wait_arg.data, wait_arg.len);
+        if(wait > 0 && rp_data_alloc_signals() == 0) {
+            ret_val = rp_data_fetch_signals(0);
+            if(ret_val == -1)
+                return rp_data_wait(r, json_root, ngx_min(wait, RP_DATA_WAIT_MAX));
+            ret_val = rp_data_add_signals(r, &json_root, ret_val);
+            goto send;
+        }
+    }
+
     ret_val = rp_data_get_signals(r, &json_root);
+
+send:
     rp_data_get_params(r, &json_root);
 
     if(ret_val == 0) {
@@ -275,6 +329,13 @@ void rp_data_post_read(ngx_http_request_t *r)
     }
     in_buffer[len] = '\0';
 
+    if(rp_bazaar_app_busy() || !rp_module_ctx.app.handle) {
+        rp_module_cmd_error(&ctx->json_root, "Application not loaded", NULL,
+                            r->pool);
+        rp_module_send_response(r, &ctx->json_root);
+        goto done;
+    }
+
     if(rp_data_set_params(r, &ctx->json_root, in_buffer) < 0) {
         rp_error(r->connection->log, "rp_data_set_params() failed");
         goto done;
@@ -367,12 +428,131 @@ int rp_data_parse_and_set_params(cJSON *params_root)
 }
 
 
+/*----------------------------------------------------------------------------*/
+/* The numbers are written straight to text, with the same output as the
+ * cJSON number printers. Only values outside the fixed point range take
+ * the sprintf() path.
+ */
+static char *rp_data_print_uint(char *p, uint64_t v)
+{
+    char digits[20];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while(v);
+    while(n)
+        *p++ = digits[--n];
+    return p;
+}
+
+/* Signal sample, as print_number_2d() */
+static char *rp_data_print_sample(char *p, double d)
+{
+    double a = fabs(d);
+    uint64_t v;
+
+    if(a < 1.0e9 && (a >= 1.0e-2 || a == 0)) {
+        /* rint() rounds halves to even like printf() */
+        v = (uint64_t)rint(a * 10000.0);
+        if(signbit(d))
+            *p++ = '-';
+        p = rp_data_print_uint(p, v / 10000);
+        *p++ = '.';
+        v %= 10000;
+        *p++ = '0' + v / 1000;
+        *p++ = '0' + v / 100 % 10;
+        *p++ = '0' + v / 10 % 10;
+        *p++ = '0' + v % 10;
+        return p;
+    }
+
+    if (fabs(floor(d)-d)<=DBL_EPSILON && fabs(d)<1.0e60)
+        return p + sprintf(p, "%.04f", d);
+    else if (fabs(d)<1.0e-2 || fabs(d)>1.0e9)
+        return p + sprintf(p, "%.04e", d);
+    return p + sprintf(p, "%.04f", d);
+}
+
+/* Parameter value, as print_number() of the float cJSON keeps */
+static char *rp_data_print_param(char *p, float value)
+{
+    double d = value;
+    int i = (int)value;
+
+    if (fabs(((double)i)-d)<=DBL_EPSILON && d<=INT_MAX && d>=INT_MIN) {
+        if(i < 0) {
+            *p++ = '-';
+            return rp_data_print_uint(p, -(int64_t)i);
+        }
+        return rp_data_print_uint(p, i);
+    }
+    if (fabs(floor(d)-d)<=DBL_EPSILON && fabs(d)<1.0e60)
+        return p + sprintf(p, "%.0f", d);
+    else if (fabs(d)<1.0e-3 || fabs(d)>1.0e9)
+        return p + sprintf(p, "%e", d);
+    return p + sprintf(p, "%f", d);
+}
+
+/* Quoted name, as print_string_ptr(). Needs up to 6 * strlen(name) + 2 bytes. */
+static char *rp_data_print_name(char *p, const char *name)
+{
+    static const char hex[] = "0123456789abcdef";
+    unsigned char c;
+
+    *p++ = '"';
+    while((c = *name++)) {
+        if(c > 31 && c != '"' && c != '\\') {
+            *p++ = c;
+            continue;
+        }
+        *p++ = '\\';
+        switch(c) {
+        case '\\': *p++ = '\\'; break;
+        case '"':  *p++ = '"';  break;
+        case '\b': *p++ = 'b';  break;
+        case '\f': *p++ = 'f';  break;
+        case '\n': *p++ = 'n';  break;
+        case '\r': *p++ = 'r';  break;
+        case '\t': *p++ = 't';  break;
+        default:
+            *p++ = 'u'; *p++ = '0'; *p++ = '0';
+            *p++ = hex[c >> 4]; *p++ = hex[c & 15];
+            break;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+/* {"data":[[x0,y0],[x1,y1],...]}, needs len * (2 * RP_DATA_NUM_MAX + 4) + 12 bytes */
+static char *rp_data_print_signal(char *p, const float *x, const float *y, int len)
+{
+    int i;
+
+    p = (char *)ngx_cpymem(p, "{\"data\":[", 9);
+    for(i = 0; i < len; i++) {
+        if(i)
+            *p++ = ',';
+        *p++ = '[';
+        p = rp_data_print_sample(p, x[i]);
+        *p++ = ',';
+        p = rp_data_print_sample(p, y[i]);
+        *p++ = ']';
+    }
+    return (char *)ngx_cpymem(p, "]}", 2);
+}
+
+
 /*----------------------------------------------------------------------------*/
 int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
 {
     rp_app_params_t *rp_params = NULL;
     int rp_params_cnt;
     cJSON *j_params, *data_root;
+    size_t text_len;
+    char *text, *p;
     int i;
     
     data_root = cJSON_GetObjectItem(*json_root, "datasets");
@@ -389,14 +569,28 @@ int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
                                    NULL, r->pool);
     }
 
-    cJSON_AddItemToObject(data_root, "params",
-                          j_params=cJSON_CreateObject(r->pool), r->pool);
-
-    for(i = 0; i < rp_params_cnt; i++) {
-        cJSON_AddItemToObject(j_params, rp_params[i].name,
-                              cJSON_CreateNumber(rp_params[i].value, r->pool), 
-                              r->pool);
+    /* The object is written as text, no node per parameter */
+    text_len = 3;
+    for(i = 0; i < rp_params_cnt; i++)
+        text_len += 6 * strlen(rp_params[i].name) + 2 + 1 + RP_DATA_NUM_MAX + 1;
+    text = ngx_palloc(r->pool, text_len);
+    if(text == NULL) {
+        j_params = NULL;
+    } else {
+        p = text;
+        *p++ = '{';
+        for(i = 0; i < rp_params_cnt; i++) {
+            if(i)
+                *p++ = ',';
+            p = rp_data_print_name(p, rp_params[i].name);
+            *p++ = ':';
+            p = rp_data_print_param(p, rp_params[i].value);
+        }
+        *p++ = '}';
+        *p = '\0';
+        j_params = cJSON_CreateRawReference(text, r->pool);
     }
+    cJSON_AddItemToObject(data_root, "params", j_params, r->pool);
 
     for(i = 0; i < rp_params_cnt; i++) {
         if(rp_params[i].name)
@@ -409,29 +603,131 @@ int rp_data_get_params(ngx_http_request_t *r, cJSON **json_root)
 }
 
 
+/* "g1":[{"data":[[t,ch1],...]},{"data":[[t,ch2],...]},...], written straight
+ * to text instead of a cJSON node per sample. sig holds the time and
+ * sig_num - 1 channels, NULL with len 0 writes empty ones.
+ */
+static void rp_data_print_signals(const float *const *sig, int sig_num, int len)
+{
+    char *p = rp_signals_text;
+    int i;
+
+    if(len < 0)
+        len = 0;
+    if(len > RP_DATA_SIG_LEN)
+        len = RP_DATA_SIG_LEN;
+    if(sig_num < 3)
+        sig_num = 3;
+    if(sig_num > RP_DATA_CH_MAX + 1)
+        sig_num = RP_DATA_CH_MAX + 1;
+
+    *p++ = '[';
+    for(i = 1; i < sig_num; i++) {
+        if(i > 1)
+            *p++ = ',';
+        p = rp_data_print_signal(p, sig ? sig[0] : NULL, sig ? sig[i] : NULL, len);
+    }
+    *p++ = ']';
+    *p = '\0';
+}
+
+
 /*----------------------------------------------------------------------------*/
-int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root)
+/* Formats the newest frame of the application ring in place, see
+ * rp_signal_ring.h. Same return values as get_signals_func().
+ */
+static uint32_t served_frame = 0;
+
+static int rp_data_get_ring_signals(rp_signal_ring_t *ring, int retries)
 {
-    int rp_sig_num, rp_sig_len, ret_val;
-    cJSON *data_root, *sig_root, *d1, *d2, *g1;
-    /* TODO: Make it configurable */
-    int retries = 200; /* Approx in [ms] */
+    const rp_signal_slot_t *slot;
+    uint32_t frame, seq;
+    int len;
+
+    for(;;) {
+        slot = rp_signal_ring_read_begin(ring, &frame, &seq);
+        if(slot == NULL || (!rp_signal_ring_is_new(ring, frame, served_frame) && retries > 0)) {
+            /* Nothing new yet */
+            if(retries-- <= 0)
+                break;
+            usleep(1000);
+            continue;
+        }
+
+        const float *sig[RP_DATA_CH_MAX + 1];
+        int i;
+
+        len = ring->sig_num < 3 ? 0 : ring->sig_len;
+        for(i = 0; i < RP_DATA_CH_MAX + 1; i++)
+            sig[i] = slot->data + (i < ring->sig_num ? i : 0) * len;
+        rp_data_print_signals(sig, ring->sig_num, len);
+        /* The writer came around to this slot, take the next frame */
+        if(!rp_signal_ring_read_end(slot, seq) && retries-- > 0)
+            continue;
+        break;
+    }
 
+    if(slot == NULL) {
+        rp_data_print_signals(NULL, 3, 0);
+        return -1;
+    }
+    if(!rp_signal_ring_is_new(ring, frame, served_frame))
+        return -1;
+    served_frame = frame;
+    return slot->complete ? 0 : -2;
+}
+
+
+/*----------------------------------------------------------------------------*/
+static int rp_data_alloc_signals(void)
+{
     if(rp_signals == NULL) {
         int i;
-        rp_signals = (float **)malloc(3 * sizeof(float *));
-        for(i = 0; i < 3; i++) {
-            rp_signals[i] = (float *)malloc(2048 * sizeof(float));
+        rp_signals = (float **)malloc((RP_DATA_CH_MAX + 1) * sizeof(float *));
+        for(i = 0; i < RP_DATA_CH_MAX + 1; i++) {
+            rp_signals[i] = (float *)malloc(RP_DATA_SIG_LEN * sizeof(float));
         }
     }
+    if(rp_signals_text == NULL) {
+        rp_signals_text = (char *)malloc(RP_DATA_CH_MAX * (RP_DATA_SIG_LEN * (2 * RP_DATA_NUM_MAX + 4) + 12) + 4);
+        if(rp_signals_text == NULL)
+            return -1;
+    }
+    return 0;
+}
 
-    data_root = cJSON_GetObjectItem(*json_root, "datasets");
-    if(data_root == NULL) {
-        return rp_module_cmd_error(json_root, 
-                                   "Can not find 'data'", NULL, 
-                                   r->pool);
+
+/*----------------------------------------------------------------------------*/
+/* 0 if the ring of the application has nothing new, the legacy
+ * get_signals_func() can only be asked
+ */
+static int rp_data_signals_maybe_new(void)
+{
+    if(rp_module_ctx.app.get_signal_ring_func) {
+        rp_signal_ring_t *ring = rp_module_ctx.app.get_signal_ring_func();
+        uint32_t frame, seq;
+        if(ring && ring->mem)
+            return rp_signal_ring_read_begin(ring, &frame, &seq) != NULL &&
+                   rp_signal_ring_is_new(ring, frame, served_frame);
+    }
+    return 1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Formats the signals of the application into rp_signals_text, waiting
+ * about retries ms for new ones. Same return values as get_signals_func().
+ */
+static int rp_data_fetch_signals(int retries)
+{
+    int rp_sig_num = 3, rp_sig_len, ret_val;
+
+    if(rp_module_ctx.app.get_signal_ring_func) {
+        rp_signal_ring_t *ring = rp_module_ctx.app.get_signal_ring_func();
+        if(ring && ring->mem)
+            return rp_data_get_ring_signals(ring, retries);
     }
-    
+
     ret_val =
         rp_module_ctx.app.get_signals_func((float ***)&rp_signals, &rp_sig_num, 
                                            &rp_sig_len);
@@ -450,31 +746,141 @@ int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root)
             usleep(1000);
         }
     }
-    ret_val = ret_val;
+    rp_data_print_signals((const float *const *)rp_signals, rp_sig_num, rp_sig_len);
+    return ret_val;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* Adds the JSON text of an optional application function as dataset name */
+static void rp_data_add_text(ngx_http_request_t *r, cJSON *data_root,
+                             const char *name, int (*func)(char *, int), int max)
+{
+    char *text;
+
+    if(func == NULL)
+        return;
+
+    text = ngx_palloc(r->pool, max);
+    if(text && func(text, max) > 0) {
+        cJSON_AddItemToObject(data_root, name,
+                              cJSON_CreateRawReference(text, r->pool),
+                              r->pool);
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+static int rp_data_add_signals(ngx_http_request_t *r, cJSON **json_root, int ret_val)
+{
+    cJSON *data_root;
+
+    data_root = cJSON_GetObjectItem(*json_root, "datasets");
+    if(data_root == NULL) {
+        return rp_module_cmd_error(json_root, 
+                                   "Can not find 'data'", NULL, 
+                                   r->pool);
+    }
+
     /* In case we are repeating the transmission */
     if((rp_signals_dirty == 0) && (ret_val == -1))
         ret_val = 0;
     rp_signals_dirty = 1;
 
     cJSON_AddItemToObject(data_root, "g1",
-                          g1=cJSON_CreateArray(r->pool), r->pool);
-
-    cJSON_AddItemToObject(g1, "g1", 
-                          sig_root=cJSON_CreateObject(r->pool), r->pool);
-    cJSON_AddItemToObject(sig_root, "data",
-                   d1=cJSON_Create2dFloatArray(&rp_signals[0][0], &rp_signals[1][0],
-                                               rp_sig_len, r->pool),
-                          r->pool);
-    cJSON_AddItemToObject(g1, "g1", 
-                          sig_root=cJSON_CreateObject(r->pool), r->pool);
-    cJSON_AddItemToObject(sig_root, "data",
-                   d2=cJSON_Create2dFloatArray(&rp_signals[0][0], &rp_signals[2][0],
-                                               rp_sig_len, r->pool),
+                          cJSON_CreateRawReference(rp_signals_text, r->pool),
                           r->pool);
 
+    rp_data_add_text(r, data_root, "image",
+                     rp_module_ctx.app.get_signal_image_func, RP_DATA_IMAGE_MAX);
+    rp_data_add_text(r, data_root, "table",
+                     rp_module_ctx.app.get_signal_table_func, RP_DATA_TABLE_MAX);
+
     return ret_val;
 }
 
+
+/*----------------------------------------------------------------------------*/
+int rp_data_get_signals(ngx_http_request_t *r, cJSON **json_root)
+{
+    /* TODO: Make it configurable */
+    int retries = 200; /* Approx in [ms] */
+
+    if(rp_data_alloc_signals() < 0) {
+        return rp_module_cmd_error(json_root, "Can not allocate signals",
+                                   NULL, r->pool);
+    }
+
+    return rp_data_add_signals(r, json_root, rp_data_fetch_signals(retries));
+}
+
+
+/*----------------------------------------------------------------------------*/
+/* The held request checks the application on a timer of the worker, other
+ * requests are served in between
+ */
+static void rp_data_poll_handler(ngx_event_t *ev)
+{
+    rp_data_poll_t *poll = ev->data;
+    ngx_http_request_t *r = poll->r;
+    int ret_val;
+
+    if(rp_bazaar_app_busy() || !rp_module_ctx.app.handle) {
+        rp_module_cmd_error(&poll->json_root, "Application not loaded", NULL,
+                            r->pool);
+        ngx_http_finalize_request(r, rp_module_send_response(r, &poll->json_root));
+        return;
+    }
+
+    int expired = (ngx_msec_int_t)(poll->deadline - ngx_current_msec) <= 0;
+    ret_val = expired || rp_data_signals_maybe_new() ? rp_data_fetch_signals(0) : -1;
+    if(ret_val == -1 && !expired) {
+        ngx_add_timer(ev, RP_DATA_POLL_MS);
+        return;
+    }
+
+    ret_val = rp_data_add_signals(r, &poll->json_root, ret_val);
+    rp_data_get_params(r, &poll->json_root);
+    if(ret_val == 0) {
+        rp_module_cmd_ok(&poll->json_root, r->pool);
+    } else {
+        rp_module_cmd_again(&poll->json_root, r->pool);
+    }
+    ngx_http_finalize_request(r, rp_module_send_response(r, &poll->json_root));
+}
+
+static void rp_data_poll_cleanup(void *data)
+{
+    rp_data_poll_t *poll = data;
+
+    if(poll->ev.timer_set)
+        ngx_del_timer(&poll->ev);
+}
+
+static ngx_int_t rp_data_wait(ngx_http_request_t *r, cJSON *json_root, ngx_msec_t wait)
+{
+    rp_data_poll_t *poll;
+    ngx_pool_cleanup_t *cln;
+
+    poll = ngx_pcalloc(r->pool, sizeof(rp_data_poll_t));
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if(poll == NULL || cln == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+    poll->r = r;
+    poll->json_root = json_root;
+    poll->deadline = ngx_current_msec + wait;
+    poll->ev.handler = rp_data_poll_handler;
+    poll->ev.data = poll;
+    poll->ev.log = r->connection->log;
+    cln->handler = rp_data_poll_cleanup;
+    cln->data = poll;
+
+    r->main->count++;
+    ngx_add_timer(&poll->ev, RP_DATA_POLL_MS);
+    return NGX_DONE;
+}
+
 /*----------------------------------------------------------------------------*/
 /**
  * @brief Clear Signal Dirty flag
@@ -0,0 +1,93 @@
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "DataManager.h"
+#include "CustomParameters.h"
+
+// Synthetic application module for ws_bench. It does not touch the hardware,
+// the signals are BENCH_POINTS samples of a moving sine with a little noise,
+// so every update changes them and gzip sees data like a real trace.
+// BENCH_LEVEL is added to the samples, a parameter write shows up in the
+// next frame.
+
+#define BENCH_MAX_SIGNALS 4
+#define BENCH_MAX_POINTS  (1024 * 1024)
+
+CIntParameter benchPoints("BENCH_POINTS", CBaseParameter::RW, 16384, 0, 1, BENCH_MAX_POINTS);
+CIntParameter benchSignals("BENCH_SIGNALS", CBaseParameter::RW, 2, 0, 1, BENCH_MAX_SIGNALS);
+CFloatParameter benchLevel("BENCH_LEVEL", CBaseParameter::RW, 0, 0, -1, 1);
+
+CFloatSignal benchSignal1("BENCH_SIG1", 0, 0.0f);
+CFloatSignal benchSignal2("BENCH_SIG2", 0, 0.0f);
+CFloatSignal benchSignal3("BENCH_SIG3", 0, 0.0f);
+CFloatSignal benchSignal4("BENCH_SIG4", 0, 0.0f);
+
+static CFloatSignal* s_signals[BENCH_MAX_SIGNALS] = { &benchSignal1, &benchSignal2, &benchSignal3, &benchSignal4 };
+static std::vector<float> s_period; // One period of the sine
+static std::vector<float> s_samples;
+static uint32_t s_noise = 1;
+static size_t s_shift = 0;
+
+extern "C" const char *rp_app_desc(void)
+{
+	return (const char *)"Synthetic signals for the web SDK benchmark.\n";
+}
+
+extern "C" int rp_app_init(void)
+{
+	return 0;
+}
+
+extern "C" int rp_app_exit(void)
+{
+	return 0;
+}
+
+void UpdateParams(void)
+{
+	if (benchPoints.IsNewValue())
+		benchPoints.Update();
+	if (benchSignals.IsNewValue())
+		benchSignals.Update();
+	if (benchLevel.IsNewValue())
+		benchLevel.Update();
+}
+
+void UpdateSignals(void)
+{
+	size_t points = benchPoints.Value();
+	if (s_period.size() != points) {
+		s_period.resize(points);
+		for (size_t i = 0; i < points; i++)
+			s_period[i] = 0.8f * sin(2 * M_PI * 10.0 * i / points);
+	}
+	s_samples.resize(points);
+
+	float level = benchLevel.Value();
+	for (int ch = 0; ch < BENCH_MAX_SIGNALS; ch++) {
+		CFloatSignal& signal = *s_signals[ch];
+		if (ch >= benchSignals.Value()) {
+			if (signal.GetSize() != 0)
+				signal.Resize(0);
+			continue;
+		}
+		size_t shift = (s_shift + ch * points / 8) % points;
+		for (size_t i = 0; i < points; i++) {
+			// A few LSB of noise, like an ADC trace
+			s_noise = s_noise * 1664525u + 1013904223u;
+			s_samples[i] = s_period[(i + shift) % points] + level + (int32_t)(s_noise >> 22) * (1.0f / 8192) - 0.0625f;
+		}
+		signal.Set(s_samples.data(), points);
+	}
+	s_shift += points / 64 + 1;
+}
+
+void PostUpdateSignals(void) {}
+
+void OnNewParams(void)
+{
+	UpdateParams();
+}
+
+void OnNewSignals(void) {}
@@ -0,0 +1,303 @@
+#include <dlfcn.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ws_server.h"
+
+// Drives an application module through the web SDK entry points the way the
+// websocket server does, without nginx and a browser. A parameter thread
+// writes BENCH_LEVEL with ws_set_params at one rate, the main thread runs
+// ws_update_signals and builds the signal frames for the clients at another.
+// Per signal tick it measures the application update, the serialization
+// with compression and the frame latency from the scheduled tick to the
+// frame being ready. The latency of a parameter write is measured until the
+// first frame built after it.
+//
+// Clients are emulated by their update points: with -e every client gets
+// its own frame like before the frames were shared, otherwise one frame is
+// built per tick and shared. -b asks for binary signal frames, -v for min/max
+// envelopes of the given number of points.
+
+typedef int (*rp_app_func)(void);
+
+struct Module
+{
+	void* handle;
+	rp_app_func init;
+	rp_app_func exit;
+	ws_set_params_func set_params;
+	ws_get_signals_func get_signals;
+	ws_update_params_func update_params;
+	ws_update_signals_func update_signals;
+	ws_get_signals_since_func get_signals_since;
+	ws_get_signals_view_func get_signals_view;
+};
+
+struct Options
+{
+	std::string module;
+	int points;
+	int signals;
+	double signal_rate; // Hz
+	double param_rate;  // Hz, 0 sends no parameters
+	double duration;    // s
+	int clients;
+	bool each;
+	bool binary;
+	int view_points;
+	bool json;
+
+	Options() : module("./bench_app.so"), points(16384), signals(2), signal_rate(20), param_rate(10),
+		duration(10), clients(1), each(false), binary(false), view_points(0), json(false) {}
+};
+
+static uint64_t NowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void SleepUntil(uint64_t _ns)
+{
+	struct timespec ts;
+	ts.tv_sec = _ns / 1000000000ULL;
+	ts.tv_nsec = _ns % 1000000000ULL;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+template <typename T> static T Symbol(void* _handle, const char* _name, bool _required)
+{
+	void* sym = dlsym(_handle, _name);
+	if (!sym && _required)
+		fprintf(stderr, "%s is missing in the module\n", _name);
+	return (T)sym;
+}
+
+static bool LoadModule(const std::string& _path, Module& _module)
+{
+	memset(&_module, 0, sizeof(_module));
+	_module.handle = dlopen(_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!_module.handle) {
+		fprintf(stderr, "Cannot load %s: %s\n", _path.c_str(), dlerror());
+		return false;
+	}
+	_module.init = Symbol<rp_app_func>(_module.handle, "rp_app_init", true);
+	_module.exit = Symbol<rp_app_func>(_module.handle, "rp_app_exit", true);
+	_module.set_params = Symbol<ws_set_params_func>(_module.handle, "ws_set_params", true);
+	_module.get_signals = Symbol<ws_get_signals_func>(_module.handle, "ws_get_signals", true);
+	_module.update_params = Symbol<ws_update_params_func>(_module.handle, "ws_update_params", true);
+	_module.update_signals = Symbol<ws_update_signals_func>(_module.handle, "ws_update_signals", true);
+	_module.get_signals_since = Symbol<ws_get_signals_since_func>(_module.handle, "ws_get_signals_since", true);
+	_module.get_signals_view = Symbol<ws_get_signals_view_func>(_module.handle, "ws_get_signals_view", false);
+	return _module.init && _module.exit && _module.set_params && _module.get_signals &&
+		_module.update_params && _module.update_signals && _module.get_signals_since;
+}
+
+// Microseconds at the fraction _p of the sorted samples
+static double Percentile(const std::vector<uint64_t>& _sorted, double _p)
+{
+	if (_sorted.empty())
+		return 0;
+	return _sorted[(size_t)(_p * (_sorted.size() - 1) + 0.5)] / 1000.0;
+}
+
+struct Series
+{
+	const char* name;
+	std::vector<uint64_t> ns;
+
+	void Print(bool _json, bool& _first)
+	{
+		std::sort(ns.begin(), ns.end());
+		double mean = 0;
+		for (size_t i = 0; i < ns.size(); i++)
+			mean += ns[i];
+		mean = ns.empty() ? 0 : mean / ns.size() / 1000.0;
+		double max = ns.empty() ? 0 : ns.back() / 1000.0;
+		if (_json)
+			printf("%s\"%s\":{\"count\":%zu,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}",
+				_first ? "" : ",", name, ns.size(), mean, Percentile(ns, 0.5), Percentile(ns, 0.99), max);
+		else
+			printf("%-15s %8zu %10.1f %10.1f %10.1f %10.1f\n", name, ns.size(), mean, Percentile(ns, 0.5), Percentile(ns, 0.99), max);
+		_first = false;
+	}
+};
+
+static void Usage(const char* _prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"\n"
+		"  -a path     Application module (default ./bench_app.so)\n"
+		"  -n points   Points per signal (default 16384)\n"
+		"  -s signals  Signals of bench_app, 1 to 4 (default 2)\n"
+		"  -r rate     Signal updates per second (default 20)\n"
+		"  -p rate     Parameter writes per second, 0 for none (default 10)\n"
+		"  -t seconds  Run time (default 10)\n"
+		"  -c clients  Emulated clients (default 1)\n"
+		"  -e          Build a frame for every client instead of sharing one\n"
+		"  -b          Binary signal frames instead of gzipped JSON\n"
+		"  -v points   Min/max envelopes of this many points\n"
+		"  -j          JSON output\n",
+		_prog);
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	int c;
+	while ((c = getopt(argc, argv, "a:n:s:r:p:t:c:ebv:jh")) != -1) {
+		switch (c) {
+			case 'a': opt.module = optarg; break;
+			case 'n': opt.points = atoi(optarg); break;
+			case 's': opt.signals = atoi(optarg); break;
+			case 'r': opt.signal_rate = atof(optarg); break;
+			case 'p': opt.param_rate = atof(optarg); break;
+			case 't': opt.duration = atof(optarg); break;
+			case 'c': opt.clients = atoi(optarg); break;
+			case 'e': opt.each = true; break;
+			case 'b': opt.binary = true; break;
+			case 'v': opt.view_points = atoi(optarg); break;
+			case 'j': opt.json = true; break;
+			default:
+				Usage(argv[0]);
+				return c == 'h' ? 0 : 1;
+		}
+	}
+	if (opt.points < 1 || opt.signal_rate <= 0 || opt.param_rate < 0 || opt.clients < 1) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	Module module;
+	if (!LoadModule(opt.module, module))
+		return 1;
+	if (opt.view_points > 0 && !module.get_signals_view) {
+		fprintf(stderr, "The module has no ws_get_signals_view, -v is not supported\n");
+		return 1;
+	}
+	module.init();
+
+	// Unknown names are skipped by the SDK, a real application ignores these
+	char setup[256];
+	snprintf(setup, sizeof(setup), "{\"BENCH_POINTS\":{\"value\":%d},\"BENCH_SIGNALS\":{\"value\":%d}%s}",
+		opt.points, opt.signals, opt.binary ? ",\"in_command\":{\"value\":\"binary_signals\"}" : "");
+	module.set_params(setup);
+	module.update_params();
+
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> param_pending(0); // Time of the oldest write not in a frame yet
+	Series param_set = { "param_set" };
+	std::thread params;
+	if (opt.param_rate > 0) {
+		params = std::thread([&]() {
+			uint64_t period = (uint64_t)(1e9 / opt.param_rate);
+			uint64_t next = NowNs();
+			for (int i = 0; !stop.load(); i++) {
+				SleepUntil(next);
+				next += period;
+				char msg[64];
+				snprintf(msg, sizeof(msg), "{\"BENCH_LEVEL\":{\"value\":%.3f}}", (i % 100) / 1000.0);
+				uint64_t start = NowNs();
+				module.set_params(msg);
+				module.update_params();
+				param_set.ns.push_back(NowNs() - start);
+				uint64_t none = 0;
+				param_pending.compare_exchange_strong(none, start);
+			}
+		});
+	}
+
+	Series update = { "update" };
+	Series build = { "build" };
+	Series frame_latency = { "frame_latency" };
+	Series param_latency = { "param_latency" };
+	uint64_t frame_bytes = 0;
+	uint64_t frames = 0;
+	uint64_t since = 0;
+
+	uint64_t period = (uint64_t)(1e9 / opt.signal_rate);
+	uint64_t start = NowNs();
+	uint64_t end = start + (uint64_t)(opt.duration * 1e9);
+	for (uint64_t tick = start; tick < end; tick += period) {
+		SleepUntil(tick);
+		uint64_t pending = param_pending.exchange(0);
+
+		uint64_t t0 = NowNs();
+		uint64_t seq = module.update_signals();
+		uint64_t t1 = NowNs();
+		// All clients got the previous frame, they share one update point
+		int builds = opt.each ? opt.clients : 1;
+		for (int i = 0; i < builds; i++) {
+			size_t size = 0;
+			const void* frame = opt.view_points > 0
+				? module.get_signals_view(since, opt.view_points, 0.0, 1.0, &size)
+				: module.get_signals_since(since, &size);
+			if (frame && size) {
+				frame_bytes += size * (opt.each ? 1 : opt.clients);
+				frames += opt.each ? 1 : opt.clients;
+			}
+		}
+		uint64_t t2 = NowNs();
+		since = seq;
+
+		update.ns.push_back(t1 - t0);
+		build.ns.push_back(t2 - t1);
+		frame_latency.ns.push_back(t2 - tick);
+		if (pending)
+			param_latency.ns.push_back(t2 - pending);
+	}
+	double seconds = (NowNs() - start) / 1e9;
+	stop = true;
+	if (params.joinable())
+		params.join();
+
+	// Size of the same signals as plain JSON, what the compression is measured against
+	size_t json_bytes = strlen(module.get_signals());
+	double mean_frame = frames ? (double)frame_bytes / frames : 0;
+	double mbps = frame_bytes / seconds / 1e6;
+
+	if (opt.json) {
+		printf("{\"module\":\"%s\",\"points\":%d,\"signals\":%d,\"clients\":%d,\"mode\":\"%s\",\"format\":\"%s\","
+			"\"view_points\":%d,\"signal_rate\":%.1f,\"param_rate\":%.1f,\"frames\":%llu,\"frame_bytes\":%.0f,"
+			"\"json_bytes\":%zu,\"ratio\":%.3f,\"mb_per_s\":%.3f,",
+			opt.module.c_str(), opt.points, opt.signals, opt.clients, opt.each ? "each" : "shared",
+			opt.binary ? "binary" : "json", opt.view_points, opt.signal_rate, opt.param_rate,
+			(unsigned long long)frames, mean_frame, json_bytes, json_bytes ? mean_frame / json_bytes : 0, mbps);
+		bool first = true;
+		update.Print(true, first);
+		build.Print(true, first);
+		frame_latency.Print(true, first);
+		param_set.Print(true, first);
+		param_latency.Print(true, first);
+		printf("}\n");
+	} else {
+		printf("%s: %d signals x %d points, %d clients (%s frames), %s%s, %.1f s\n",
+			opt.module.c_str(), opt.signals, opt.points, opt.clients, opt.each ? "own" : "shared",
+			opt.binary ? "binary" : "gzipped JSON", opt.view_points > 0 ? ", envelopes" : "", seconds);
+		printf("frames %llu, %.0f bytes per frame, plain JSON %zu bytes, ratio %.3f, %.3f MB/s\n",
+			(unsigned long long)frames, mean_frame, json_bytes, json_bytes ? mean_frame / json_bytes : 0, mbps);
+		printf("%-15s %8s %10s %10s %10s %10s\n", "", "count", "mean us", "p50 us", "p99 us", "max us");
+		bool first = true;
+		update.Print(false, first);
+		build.Print(false, first);
+		frame_latency.Print(false, first);
+		param_set.Print(false, first);
+		param_latency.Print(false, first);
+	}
+
+	module.exit();
+	dlclose(module.handle);
+	return 0;
+}
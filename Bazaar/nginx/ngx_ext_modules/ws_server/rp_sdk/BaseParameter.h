@@ -1,7 +1,21 @@
 #pragma once
 
+#include <stdint.h>
+#include <string>
+#include <chrono>
 #include <libjson.h>
 
+// Part of the signals a client displays
+struct SignalView
+{
+	int points; // min/max buckets, 0 for the whole signals
+	double start; // first sample as a fraction of the signal
+	double stop; // end of the samples as a fraction of the signal
+
+	SignalView(int _points = 0, double _start = 0, double _stop = 1)
+		: points(_points), start(_start), stop(_stop) {}
+};
+
 class CBaseParameter  //base class for parameter and signal
 {
 public:
@@ -17,14 +31,42 @@ public:
 		AccessModes
 	};
 
+	CBaseParameter() : m_Version(0), m_MinPeriod(0), m_MaxPeriod(0) {};
 	virtual ~CBaseParameter(){};
 	virtual const char* GetName() const = 0;
 	virtual void Update() = 0;		//apply change of value
 	virtual JSONNode GetJSONObject() = 0;	//get JSON-formatted string with parameters or signals
+	// Appends the value to the payload of a binary frame and describes it in _node,
+	// false if the value is only sent as JSON
+	virtual bool GetBinaryObject(JSONNode& _node, std::string& _data) { return false; };
+	// Describes the min/max envelope of the samples in _view, in binary if _data is given,
+	// false if the value is sent whole
+	virtual bool GetEnvelopeObject(JSONNode& _node, std::string* _data, const SignalView& _view) { return false; };
 	virtual void SetValueFromJSON(JSONNode _node) = 0;	// set the m_TmpValue->value from JSON object
 	virtual AccessMode GetAccessMode() const = 0;
 	virtual bool IsValueChanged() const = 0;
 	virtual bool IsNewValue() const = 0;
 	virtual void ClearNewValue() = 0;
 	virtual bool NeedSend(bool _no_need=false) const { return _no_need; };
+
+	// Update sequence number of the last change, set by CDataManager
+	uint64_t GetVersion() const { return m_Version; };
+	void SetVersion(uint64_t _version) { m_Version = _version; };
+
+	// Update period of a signal in milliseconds, 0 for every signal tick. A change
+	// waits until _min has passed since the signal was last sent, an unchanged
+	// signal is sent again once _max has passed.
+	void SetUpdatePeriod(int _min, int _max = 0) { m_MinPeriod = _min; m_MaxPeriod = _max; };
+	int GetMinPeriod() const { return m_MinPeriod; };
+	int GetMaxPeriod() const { return m_MaxPeriod; };
+
+	// Time the signal was last stamped for sending, set by CDataManager
+	std::chrono::steady_clock::time_point GetSentTime() const { return m_SentTime; };
+	void SetSentTime(std::chrono::steady_clock::time_point _time) { m_SentTime = _time; };
+
+private:
+	uint64_t m_Version;
+	int m_MinPeriod;
+	int m_MaxPeriod;
+	std::chrono::steady_clock::time_point m_SentTime;
 };
@@ -2,8 +2,21 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
+#include <vector>
 
 #include "Parameter.h"
+#include "envelope.h"
+
+// Element types of the binary signal frames, typed array names on the JS side
+template <typename Type> inline const char* GetBinaryTypeName() { return NULL; }
+template <> inline const char* GetBinaryTypeName<float>() { return "f32"; }
+template <> inline const char* GetBinaryTypeName<double>() { return "f64"; }
+template <> inline const char* GetBinaryTypeName<int>() { return "i32"; }
+template <> inline const char* GetBinaryTypeName<uint8_t>() { return "u8"; }
+
+// Payloads start on this boundary, so the client can map them without a copy
+#define SIGNAL_BINARY_ALIGN 8
 
 template <typename Type> class CDecoderParameter : public CParameter<Type, Type>
 {
@@ -145,11 +158,13 @@ template <typename Type> class CCustomSignal : public CParameter<Type, std::vect
 public:
 	CCustomSignal(std::string _name, int _size, Type _def_value)
 		:CParameter<Type, std::vector<Type> >(_name, CBaseParameter::RO, std::vector<Type>(_size, _def_value)),
-		m_Dirty(true){}
+		m_Dirty(true),
+		m_Binary(GetBinaryTypeName<Type>() != NULL) {}
 
 	CCustomSignal(std::string _name, CBaseParameter::AccessMode _access_mode, int _size, Type _def_value)
 		:CParameter<Type, std::vector<Type> >(_name, _access_mode, std::vector<Type>(_size, _def_value)),
-		m_Dirty(true) {}
+		m_Dirty(true),
+		m_Binary(GetBinaryTypeName<Type>() != NULL) {}
 
 	~CCustomSignal()
 	{
@@ -175,6 +190,68 @@ public:
 		return n;
 	}
 
+	bool GetBinaryObject(JSONNode& _node, std::string& _data)
+	{
+		const char* type = GetBinaryTypeName<Type>();
+		if (!m_Binary || type == NULL)
+			return false;
+
+		_data.resize((_data.size() + SIGNAL_BINARY_ALIGN - 1) & ~(size_t)(SIGNAL_BINARY_ALIGN - 1), '\0');
+		size_t offset = _data.size();
+		_data.append((const char*)this->m_Value.value.data(), this->m_Value.value.size() * sizeof(Type));
+
+		_node = JSONNode(JSON_NODE);
+		_node.set_name(this->m_Value.name);
+		_node.push_back(JSONNode("size", this->m_Value.value.size()));
+		_node.push_back(JSONNode("type", type));
+		_node.push_back(JSONNode("offset", offset));
+		return true;
+	}
+
+	bool GetEnvelopeObject(JSONNode& _node, std::string* _data, const SignalView& _view)
+	{
+		const char* type = GetBinaryTypeName<Type>();
+		size_t size = this->m_Value.value.size();
+		if (type == NULL || _view.points <= 0 || !(_view.start < _view.stop))
+			return false;
+		size_t first = _view.start <= 0 ? 0 : std::min(size, (size_t)(_view.start * size));
+		size_t last = _view.stop >= 1 ? size : std::max(first, (size_t)(_view.stop * size));
+		size_t points = _view.points;
+		// Not worth it for signals that are about as short as the envelope
+		if (last - first <= 2 * points)
+			return false;
+
+		std::vector<Type> envelope(2 * points);
+		SignalEnvelope<Type>(this->m_Value.value.data() + first, last - first, points, envelope.data());
+
+		_node = JSONNode(JSON_NODE);
+		_node.set_name(this->m_Value.name);
+		_node.push_back(JSONNode("size", envelope.size()));
+		_node.push_back(JSONNode("envelope", points));
+		_node.push_back(JSONNode("first", first));
+		_node.push_back(JSONNode("count", last - first));
+		_node.push_back(JSONNode("full_size", size));
+		if (_data && m_Binary) {
+			_data->resize((_data->size() + SIGNAL_BINARY_ALIGN - 1) & ~(size_t)(SIGNAL_BINARY_ALIGN - 1), '\0');
+			_node.push_back(JSONNode("type", type));
+			_node.push_back(JSONNode("offset", _data->size()));
+			_data->append((const char*)envelope.data(), envelope.size() * sizeof(Type));
+		} else {
+			JSONNode child(JSON_ARRAY);
+			child.set_name("value");
+			for (size_t i = 0; i < envelope.size(); i++)
+				child.push_back(JSONNode("", envelope[i]));
+			_node.push_back(child);
+		}
+		return true;
+	}
+
+	// Binary is the default for numeric signals, false keeps the JSON array
+	void SetBinary(bool _binary)
+	{
+		m_Binary = _binary;
+	}
+
 	const Type& operator [](int _index) const
 	{
 		return this->m_Value.value.at(_index);
@@ -230,6 +307,72 @@ public:
 	}
 private:
 	bool m_Dirty;
+	bool m_Binary;
+};
+
+// Signal the application fills in place instead of copying it in with Set().
+// The writer, any single thread and without the CDataManager lock, fills
+// Back() completely and hands it over with Publish(). The serializer takes
+// the newest published buffer when the signal is due and reads it while the
+// writer goes on, only vectors are swapped and no samples copied. Frames
+// published faster than the signal is sent replace each other.
+template <typename Type> class CSwapSignal : public CCustomSignal<Type>
+{
+public:
+	CSwapSignal(std::string _name, int _size, Type _def_value)
+		:CCustomSignal<Type>(_name, _size, _def_value),
+		m_BackIdx(0),
+		m_SpareIdx(2),
+		m_Ready(1)
+	{
+		for (auto& buffer : m_Buffers)
+			buffer.assign(_size, _def_value);
+	}
+
+	CSwapSignal(std::string _name, CBaseParameter::AccessMode _access_mode, int _size, Type _def_value)
+		:CCustomSignal<Type>(_name, _access_mode, _size, _def_value),
+		m_BackIdx(0),
+		m_SpareIdx(2),
+		m_Ready(1)
+	{
+		for (auto& buffer : m_Buffers)
+			buffer.assign(_size, _def_value);
+	}
+
+	// Writer side, holds a frame of any age, every sample has to be written
+	std::vector<Type>& Back()
+	{
+		return m_Buffers[m_BackIdx];
+	}
+
+	void Publish()
+	{
+		m_BackIdx = m_Ready.exchange(m_BackIdx | FRESH) & ~FRESH;
+	}
+
+	bool IsValueChanged() const
+	{
+		return CCustomSignal<Type>::IsValueChanged() || (m_Ready.load() & FRESH);
+	}
+
+	void Update()
+	{
+		if (m_Ready.load() & FRESH) {
+			// The stale front goes to the spare, which the writer may take next
+			int idx = m_Ready.exchange(m_SpareIdx) & ~FRESH;
+			this->m_Value.value.swap(m_Buffers[idx]);
+			m_SpareIdx = idx;
+		}
+		CCustomSignal<Type>::Update();
+	}
+
+private:
+	enum { FRESH = 4 };
+
+	std::vector<Type> m_Buffers[3];
+	int m_BackIdx;          // owned by the writer
+	int m_SpareIdx;         // owned by the serializer
+	std::atomic<int> m_Ready; // published index, FRESH until taken
 };
 
 //custom CIntParameter
@@ -323,6 +466,17 @@ public:
 		:CCustomSignal(_name, _access_mode, _size, _def_value){};
 };
 
+//custom CFloatSwapSignal
+class CFloatSwapSignal : public CSwapSignal<float>
+{
+public:
+	CFloatSwapSignal(std::string _name, int _size, float _def_value)
+		:CSwapSignal(_name, _size, _def_value){};
+
+	CFloatSwapSignal(std::string _name, CBaseParameter::AccessMode _access_mode, int _size, float _def_value)
+		:CSwapSignal(_name, _access_mode, _size, _def_value){};
+};
+
 extern CBooleanParameter IsDemoParam;		// special default parameter to check mode (demo or not)
 extern CStringParameter InCommandParam;		// special default parameter to receive a string command from WEB UI
 extern CStringParameter OutCommandParam;	// special default parameter to send a string command to WEB UI
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <cstring>
+#include <cstdint>
 #include <map>
+#include <algorithm>
 #include "DataManager.h"
 #include "CustomParameters.h"
 #include "misc.h"
@@ -40,6 +42,13 @@ CDataManager::CDataManager()
 	, m_param_interval(20)
 	, m_signal_interval(20)
 	, m_send_all_params(true)
+	, m_binary_signals(false)
+	, m_param_seq(0)
+	, m_signal_seq(0)
+	, m_param_change_seq(0)
+	, m_signal_change_seq(0)
+	, m_notify(NULL)
+	, m_notify_ctx(NULL)
 {
 }
 
@@ -53,6 +62,7 @@ void CDataManager::RegisterParam(CBaseParameter * _param)
 {
 	dbg_printf("RegisterParam: %s\n", _param->GetName());
 	m_params.push_back(_param);
+	m_param_index.insert(std::make_pair(std::string(_param->GetName()), _param));
 	dbg_printf("Registered params: %d\n", m_params.size());
 }
 
@@ -69,6 +79,17 @@ void CDataManager::UnRegisterParam(const char * _name)
 	{
 		if(strcmp((*it)->GetName(),_name)==0)
 		{
+			std::pair<std::unordered_multimap<std::string, CBaseParameter*>::iterator,
+				std::unordered_multimap<std::string, CBaseParameter*>::iterator> range = m_param_index.equal_range(_name);
+			for (std::unordered_multimap<std::string, CBaseParameter*>::iterator i = range.first; i != range.second; ++i)
+			{
+				if(i->second == *it)
+				{
+					m_param_index.erase(i);
+					break;
+				}
+			}
+			m_new_params.erase(std::remove(m_new_params.begin(), m_new_params.end(), *it), m_new_params.end());
 			m_params.erase(it);
 			dbg_printf("UnRegisterParam: %s\n", _name);
 			return;
@@ -103,81 +124,333 @@ void CDataManager::UpdateAllSignals()
         }
 }
 
-std::string CDataManager::GetParamsJson()
+inline bool CDataManager::IsNewer(const CBaseParameter& param, uint64_t _since) const
+{
+	return param.GetVersion() > _since
+			|| (_since == 0 && param.GetAccessMode() != CBaseParameter::AccessMode::WO);
+}
+
+// Signals with an update period are only stamped when it is their turn, the
+// others are not serialized in this tick
+inline bool CDataManager::IsSignalDue(const CBaseParameter& signal, std::chrono::steady_clock::time_point _now) const
+{
+	std::chrono::steady_clock::duration elapsed = _now - signal.GetSentTime();
+	if(NeedSend(signal))
+		return signal.GetMinPeriod() <= 0 || elapsed >= std::chrono::milliseconds(signal.GetMinPeriod());
+	return signal.GetMaxPeriod() > 0 && elapsed >= std::chrono::milliseconds(signal.GetMaxPeriod());
+}
+
+uint64_t CDataManager::UpdateParamsVersion()
 {
+	std::lock_guard<std::recursive_mutex> lock(m_lock);
 	UpdateParams();
+	m_param_seq++;
+	for(size_t i=0; i < m_params.size(); i++) {
+		if(NeedSend(*m_params[i])) {
+			m_params[i]->SetVersion(m_param_seq);
+			m_params[i]->NeedSend(true); // no need
+			m_param_change_seq = m_param_seq;
+		}
+	}
+	m_send_all_params = false;
+	return m_param_seq;
+}
+
+uint64_t CDataManager::UpdateSignalsVersion()
+{
+	std::lock_guard<std::recursive_mutex> lock(m_lock);
+	UpdateSignals();
+	m_signal_seq++;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	for(size_t i=0; i < m_signals.size(); i++) {
+		if(IsSignalDue(*m_signals[i], now)) {
+			m_signals[i]->SetVersion(m_signal_seq);
+			m_signals[i]->SetSentTime(now);
+			m_signals[i]->Update();
+			m_signal_change_seq = m_signal_seq;
+		}
+	}
+	PostUpdateSignals();
+	return m_signal_seq;
+}
+
+bool CDataManager::GetParamsJson(uint64_t _since, std::string& _json)
+{
 	JSONNode params(JSON_NODE);
 	params.set_name("parameters");
 	for(size_t i=0; i < m_params.size(); i++) {
-		if(NeedSend(*m_params[i])) {
+		if(IsNewer(*m_params[i], _since)) {
 			JSONNode n(JSON_NODE);
 			n = m_params[i]->GetJSONObject();
-			m_params[i]->NeedSend(true); // no need
 			params.push_back(n);
 		}
 	}
 
+	bool changed = !params.empty();
 	JSONNode data_node(JSON_NODE);
 	data_node.set_name("data");
 	data_node.push_back(params);
-	m_send_all_params = false;
-	return data_node.write();
+	_json = data_node.write();
+	return changed;
+}
+
+bool CDataManager::GetSignalsJson(uint64_t _since, std::string& _json, const SignalView& _view)
+{
+	JSONNode signals(JSON_NODE);
+	signals.set_name("signals");
+	for(size_t i=0; i < m_signals.size(); i++) {
+		if(IsNewer(*m_signals[i], _since)) {
+			JSONNode n(JSON_NODE);
+			if(!m_signals[i]->GetEnvelopeObject(n, NULL, _view))
+				n = m_signals[i]->GetJSONObject();
+			signals.push_back(n);
+		}
+	}
+
+	bool changed = !signals.empty();
+	JSONNode data_node(JSON_NODE);
+	data_node.set_name("data");
+	data_node.push_back(signals);
+	_json = data_node.write();
+	return changed;
+}
+
+std::string CDataManager::GetParamsJson()
+{
+	std::lock_guard<std::recursive_mutex> lock(m_lock);
+	std::string json;
+	GetParamsJson(UpdateParamsVersion() - 1, json);
+	return json;
 }
 
 std::string CDataManager::GetSignalsJson()
 {
-	UpdateSignals();
+	std::lock_guard<std::recursive_mutex> lock(m_lock);
+	std::string json;
+	GetSignalsJson(UpdateSignalsVersion() - 1, json);
+	return json;
+}
+
+// Binary signal frame, all numbers little endian:
+//   "RPSB", uint32 header length, JSON header, zero padding, payload
+// The header has the layout of GetSignalsJson(), binary signals carry
+// "size", "type" and the "offset" of their samples from the payload start
+// instead of "value". The payload starts on SIGNAL_BINARY_ALIGN bytes.
+// Envelopes add "envelope" buckets, the "first" sample, the sample "count"
+// and the "full_size" of the signal, the values are min, max per bucket.
+bool CDataManager::GetSignalsBinary(uint64_t _since, std::string& _frame, const SignalView& _view)
+{
+	if(!m_binary_signals)
+		return false;
+
 	JSONNode signals(JSON_NODE);
 	signals.set_name("signals");
+	std::string payload;
 	for(size_t i=0; i < m_signals.size(); i++) {
-		if(NeedSend(*m_signals[i])) {
+		if(IsNewer(*m_signals[i], _since)) {
 			JSONNode n(JSON_NODE);
-			n = m_signals[i]->GetJSONObject();
+			if(!m_signals[i]->GetEnvelopeObject(n, &payload, _view) && !m_signals[i]->GetBinaryObject(n, payload))
+				n = m_signals[i]->GetJSONObject();
 			signals.push_back(n);
-			m_signals[i]->Update();
 		}
 	}
+	if(signals.empty())
+		return false;
 
 	JSONNode data_node(JSON_NODE);
 	data_node.set_name("data");
 	data_node.push_back(signals);
-	PostUpdateSignals();
-	return data_node.write();
+	std::string header = data_node.write();
+
+	uint32_t header_size = header.size();
+	uint8_t size_le[4] = { (uint8_t)header_size, (uint8_t)(header_size >> 8), (uint8_t)(header_size >> 16), (uint8_t)(header_size >> 24) };
+	size_t start = (8 + header.size() + SIGNAL_BINARY_ALIGN - 1) & ~(size_t)(SIGNAL_BINARY_ALIGN - 1);
+	_frame.clear();
+	_frame.reserve(start + payload.size());
+	_frame.append("RPSB", 4);
+	_frame.append((const char*)size_le, 4);
+	_frame.append(header);
+	_frame.resize(start, '\0');
+	_frame.append(payload);
+	return true;
+}
+
+bool CDataManager::GetParamsFrame(uint64_t _since, std::string& _frame)
+{
+	std::string json;
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_lock);
+		// Clients that are up to date cost no serialization
+		if(_since != 0 && _since >= m_param_change_seq)
+			return false;
+		if(!GetParamsJson(_since, json))
+			return false;
+	}
+	// The values are not touched while compressing
+	static CGzip gzip;
+	gzip.Compress(json, _frame);
+	return true;
+}
+
+bool CDataManager::GetSignalsFrame(uint64_t _since, std::string& _frame, const SignalView& _view)
+{
+	std::string json;
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_lock);
+		if(_since != 0 && _since >= m_signal_change_seq)
+			return false;
+		// Binary frames are not compressed, the samples do not gzip well enough to pay for it
+		if(GetSignalsBinary(_since, _frame, _view))
+			return true;
+		if(!GetSignalsJson(_since, json, _view))
+			return false;
+	}
+	static CGzip gzip;
+	gzip.Compress(json, _frame);
+	return true;
+}
+
+// Scanner for the parameter messages, {"NAME":{"value":...},...}. It only
+// finds where the members start and end, unknown names are skipped without
+// building any nodes.
+static size_t SkipSpace(const std::string& _s, size_t _i)
+{
+	while(_i < _s.size() && (_s[_i] == ' ' || _s[_i] == '\t' || _s[_i] == '\n' || _s[_i] == '\r'))
+		_i++;
+	return _i;
+}
+
+// _i at the opening quote, returns the position after the closing one or npos
+static size_t SkipString(const std::string& _s, size_t _i)
+{
+	for(_i++; _i < _s.size(); _i++) {
+		if(_s[_i] == '\\')
+			_i++;
+		else if(_s[_i] == '"')
+			return _i + 1;
+	}
+	return std::string::npos;
+}
+
+// Returns the position after the value at _i or npos
+static size_t SkipValue(const std::string& _s, size_t _i)
+{
+	int depth = 0;
+	while(_i < _s.size()) {
+		char c = _s[_i];
+		if(c == '"') {
+			_i = SkipString(_s, _i);
+			if(_i == std::string::npos)
+				return _i;
+			if(depth == 0)
+				return _i;
+			continue;
+		}
+		if(c == '{' || c == '[')
+			depth++;
+		else if(c == '}' || c == ']') {
+			if(depth == 0)
+				return _i;
+			if(--depth == 0)
+				return _i + 1;
+		}
+		else if(c == ',' && depth == 0)
+			return _i;
+		_i++;
+	}
+	return depth == 0 ? _i : std::string::npos;
+}
+
+void CDataManager::SetParamFromJSON(const std::string& _name, JSONNode& _node)
+{
+	std::pair<std::unordered_multimap<std::string, CBaseParameter*>::iterator,
+		std::unordered_multimap<std::string, CBaseParameter*>::iterator> range = m_param_index.equal_range(_name);
+	for (std::unordered_multimap<std::string, CBaseParameter*>::iterator i = range.first; i != range.second; ++i)
+	{
+		if (i->second->GetAccessMode() != CBaseParameter::AccessMode::RO)
+		{
+			i->second->SetValueFromJSON(_node);
+			m_new_params.push_back(i->second);
+		}
+	}
+}
+
+// Only the values of registered parameters are parsed, returns false for
+// input the scanner does not understand, nothing has been set then
+bool CDataManager::SetParamsFast(const std::string& _params)
+{
+	std::vector<std::pair<std::string, std::string> > members;
+	size_t i = SkipSpace(_params, 0);
+	if(i >= _params.size() || _params[i] != '{')
+		return false;
+	i = SkipSpace(_params, i + 1);
+	while(i < _params.size() && _params[i] != '}') {
+		if(_params[i] != '"')
+			return false;
+		size_t name_end = SkipString(_params, i);
+		if(name_end == std::string::npos)
+			return false;
+		std::string name = _params.substr(i + 1, name_end - i - 2);
+		// Escaped names are left to libjson
+		if(name.find('\\') != std::string::npos)
+			return false;
+		i = SkipSpace(_params, name_end);
+		if(i >= _params.size() || _params[i] != ':')
+			return false;
+		size_t value_start = SkipSpace(_params, i + 1);
+		size_t value_end = SkipValue(_params, value_start);
+		if(value_end == std::string::npos || value_end == value_start)
+			return false;
+		if(_params[value_start] == '{' && m_param_index.count(name))
+			members.push_back(std::make_pair(name, _params.substr(value_start, value_end - value_start)));
+		i = SkipSpace(_params, value_end);
+		if(i < _params.size() && _params[i] == ',')
+			i = SkipSpace(_params, i + 1);
+	}
+	if(i >= _params.size())
+		return false;
+
+	for(size_t j=0; j < members.size(); ++j) {
+		JSONNode m = libjson::parse(members[j].second);
+		m.set_name(members[j].first);
+		SetParamFromJSON(members[j].first, m);
+	}
+	return true;
 }
 
 void CDataManager::OnNewParams(std::string _params)
 {
-	JSONNode n(JSON_NODE);
-	n = libjson::parse(_params);
-	JSONNode m(JSON_NODE);
+	std::lock_guard<std::recursive_mutex> lock(m_lock);
 
-	for (size_t i=0; i < m_params.size(); ++i)
-		m_params[i]->ClearNewValue();
+	// Only the parameters set by the previous message can hold a new value
+	for (size_t i=0; i < m_new_params.size(); ++i)
+		m_new_params[i]->ClearNewValue();
+	m_new_params.clear();
 
-	for (size_t i=0; i < n.size(); ++i)
+	if(!SetParamsFast(_params))
 	{
-		m = n.at(i);
-		std::string name = m.name();
+		JSONNode n(JSON_NODE);
+		n = libjson::parse(_params);
+		JSONNode m(JSON_NODE);
 
-		for (size_t j=0; j < m_params.size(); ++j)
+		for (size_t i=0; i < n.size(); ++i)
 		{
-			if (m_params[j]->GetAccessMode() != CBaseParameter::AccessMode::RO)
-			{
-				std::string param_name = m_params[j]->GetName();
-				if (name == param_name)
-					m_params[j]->SetValueFromJSON(m);
-			}
+			m = n.at(i);
+			SetParamFromJSON(m.name(), m);
 		}
 	}
 
-	if(InCommandParam.IsNewValue())
+	if(InCommandParam.IsNewValue()) {
 		m_send_all_params |= InCommandParam.NewValue() == "send_all_params";
+		m_binary_signals |= InCommandParam.NewValue() == "binary_signals";
+	}
 
 	::OnNewParams();
 }
 
 void CDataManager::OnNewSignals(std::string _signals)
 {
+	std::lock_guard<std::recursive_mutex> lock(m_lock);
 	dbg_printf("OnNewSignals\n");
 	JSONNode n(JSON_NODE);
 	n = libjson::parse(_signals);
@@ -228,6 +501,20 @@ void CDataManager::SendAllParams()
 	m_send_all_params = true;
 }
 
+void CDataManager::NotifySignalsReady()
+{
+	std::lock_guard<std::mutex> lock(m_notify_mutex);
+	if(m_notify)
+		m_notify(m_notify_ctx);
+}
+
+void CDataManager::SetSignalsNotify(void (*_notify)(void*), void* _ctx)
+{
+	std::lock_guard<std::mutex> lock(m_notify_mutex);
+	m_notify = _notify;
+	m_notify_ctx = _ctx;
+}
+
 // DEPRECATED
 std::map<std::string, bool> CDataManager::GetFeatures(const std::string& app_id)
 {
@@ -289,6 +576,59 @@ extern "C" const char* ws_get_signals(void)
 	return res.c_str();
 }
 
+extern "C" uint64_t ws_update_params(void)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	return man ? man->UpdateParamsVersion() : 0;
+}
+
+extern "C" uint64_t ws_update_signals(void)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	return man ? man->UpdateSignalsVersion() : 0;
+}
+
+extern "C" const void * ws_get_params_since(uint64_t _since, size_t *_size)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	static std::string res = "";
+	*_size = 0;
+	if(!man || !man->GetParamsFrame(_since, res))
+		return NULL;
+	*_size = res.size();
+	return res.data();
+}
+
+extern "C" const void* ws_get_signals_since(uint64_t _since, size_t *_size)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	static std::string res = "";
+	*_size = 0;
+	if(!man || !man->GetSignalsFrame(_since, res))
+		return NULL;
+	*_size = res.size();
+	return res.data();
+}
+
+// Called once per distinct client view, the server shares the frame between the clients
+extern "C" const void* ws_get_signals_view(uint64_t _since, int _points, double _start, double _stop, size_t *_size)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	static std::string res = "";
+	*_size = 0;
+	if(!man || !man->GetSignalsFrame(_since, res, SignalView(_points, _start, _stop)))
+		return NULL;
+	*_size = res.size();
+	return res.data();
+}
+
+extern "C" void ws_set_signals_notify(void (*_notify)(void*), void *_ctx)
+{
+	CDataManager * man = CDataManager::GetInstance();
+	if(man)
+		man->SetSignalsNotify(_notify, _ctx);
+}
+
 extern "C" void ws_set_params_interval(int _interval)
 {
 	CDataManager * man = CDataManager::GetInstance();
@@ -334,8 +674,9 @@ extern "C" int ws_get_signals_interval(void)
 
 extern "C" void ws_gzip(const char* _in, void* _out, size_t* _size)
 {
+	static CGzip gzip;
 	std::string out;
-	Gziping(_in, out);
+	gzip.Compress(_in, out);
 	memcpy(_out, out.data(), out.size());
 	*_size = out.size();
 }
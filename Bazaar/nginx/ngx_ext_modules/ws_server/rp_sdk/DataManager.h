@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <mutex>
 #include "BaseParameter.h"
 
 struct Data {
@@ -17,12 +19,27 @@ private:
 	CDataManager& operator=( CDataManager& );
 
 	inline bool NeedSend(const CBaseParameter& param) const;
+	inline bool IsNewer(const CBaseParameter& param, uint64_t _since) const;
+	inline bool IsSignalDue(const CBaseParameter& signal, std::chrono::steady_clock::time_point _now) const;
+	bool SetParamsFast(const std::string& _params);
+	void SetParamFromJSON(const std::string& _name, JSONNode& _node);
 
 	std::vector<CBaseParameter*> m_params;
 	std::vector<CBaseParameter*> m_signals;
+	std::unordered_multimap<std::string, CBaseParameter*> m_param_index; //parameters by name
+	std::vector<CBaseParameter*> m_new_params; //parameters set by the last message
 	int m_param_interval; //parameters send time interval in milliseconds
-	int m_signal_interval; //signals send time interval in milliseconds
+	int m_signal_interval; //signals send time interval in milliseconds, signals can have their own periods on top
 	bool m_send_all_params;
+	bool m_binary_signals; //client decodes binary signal frames
+	uint64_t m_param_seq; //number of the last parameters update
+	uint64_t m_signal_seq; //number of the last signals update
+	uint64_t m_param_change_seq; //number of the last parameters update that changed a value
+	uint64_t m_signal_change_seq; //number of the last signals update that changed a value
+	std::recursive_mutex m_lock; //serializes the user callbacks and the serialization, the server builds signals on its own thread
+	std::mutex m_notify_mutex;
+	void (*m_notify)(void*); //signals push callback of the websocket server
+	void* m_notify_ctx;
 
 public:
 	static CDataManager* GetInstance();
@@ -37,6 +54,19 @@ public:
 	std::string GetParamsJson(); //get all parameters in JSON-formatted string
 	std::string GetSignalsJson(); //get all signals in JSON-formatted string
 
+	// Delta updates: Update*() runs the user callback once per interval and stamps the changed
+	// values with the returned sequence number, Get*() serializes what changed after _since for
+	// one client, everything for _since = 0. They return false if there is nothing to send.
+	uint64_t UpdateParamsVersion();
+	uint64_t UpdateSignalsVersion();
+	bool GetParamsJson(uint64_t _since, std::string& _json);
+	// With _view.points set the signals longer than the view go as min/max envelopes
+	bool GetSignalsJson(uint64_t _since, std::string& _json, const SignalView& _view = SignalView());
+	bool GetSignalsBinary(uint64_t _since, std::string& _frame, const SignalView& _view = SignalView()); //binary frame, also false if the client did not ask for it
+	// Ready to send websocket frames, gzipped JSON or binary signals
+	bool GetParamsFrame(uint64_t _since, std::string& _frame);
+	bool GetSignalsFrame(uint64_t _since, std::string& _frame, const SignalView& _view = SignalView());
+
 	void OnNewParams(std::string _params); //is involved when new data received from server, data is JSON-formatted string
 	void OnNewSignals(std::string _signals); //is involved when new data received from server, data is JSON-formatted string
 
@@ -48,6 +78,12 @@ public:
 
 	void SendAllParams();
 
+	// Signals push: the server sends the signals as soon as the application reports a
+	// complete frame instead of on its timer, at most once per signal interval. Safe to
+	// call from any thread, the first call switches the server from the timer to push.
+	void NotifySignalsReady();
+	void SetSignalsNotify(void (*_notify)(void*), void* _ctx);
+
 	// DEPRECATED
 	std::map<std::string, bool> GetFeatures(const std::string& app_id);
 };
@@ -68,6 +104,12 @@ extern "C" int ws_get_params_interval(void);
 extern "C" int ws_get_signals_interval(void);
 extern "C" const char * ws_get_params(void);
 extern "C" const char * ws_get_signals(void);
+extern "C" uint64_t ws_update_params(void);
+extern "C" uint64_t ws_update_signals(void);
+extern "C" const void * ws_get_params_since(uint64_t _since, size_t *_size);
+extern "C" const void * ws_get_signals_since(uint64_t _since, size_t *_size);
+extern "C" const void * ws_get_signals_view(uint64_t _since, int _points, double _start, double _stop, size_t *_size);
+extern "C" void ws_set_signals_notify(void (*_notify)(void*), void *_ctx);
 extern "C" int ws_set_params(const char *_params);
 extern "C" int ws_set_signals(const char *_signals);
 extern "C" void ws_gzip(const char* _in, void* _out, size_t* size_);
@@ -0,0 +1,42 @@
+#include "envelope.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ENVELOPE_USE_NEON
+#endif
+
+template <>
+void SignalEnvelope<float>(const float* _in, size_t _size, size_t _points, float* _out)
+{
+	for(size_t b = 0; b < _points; b++) {
+		size_t i = b * _size / _points;
+		size_t last = (b + 1) * _size / _points;
+		float lo = _in[i];
+		float hi = _in[i];
+#ifdef ENVELOPE_USE_NEON
+		if(last - i >= 8) {
+			float32x4_t vlo = vld1q_f32(_in + i);
+			float32x4_t vhi = vlo;
+			for(i += 4; i + 4 <= last; i += 4) {
+				float32x4_t v = vld1q_f32(_in + i);
+				vlo = vminq_f32(vlo, v);
+				vhi = vmaxq_f32(vhi, v);
+			}
+			float32x2_t l = vpmin_f32(vget_low_f32(vlo), vget_high_f32(vlo));
+			float32x2_t h = vpmax_f32(vget_low_f32(vhi), vget_high_f32(vhi));
+			l = vpmin_f32(l, l);
+			h = vpmax_f32(h, h);
+			lo = vget_lane_f32(l, 0);
+			hi = vget_lane_f32(h, 0);
+		}
+#endif
+		for(; i < last; i++) {
+			if(_in[i] < lo)
+				lo = _in[i];
+			if(_in[i] > hi)
+				hi = _in[i];
+		}
+		_out[2 * b] = lo;
+		_out[2 * b + 1] = hi;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+
+// Min/max envelope of a signal for displays narrower than the signal.
+// Bucket b covers the samples b * _size / _points to (b + 1) * _size / _points,
+// _out receives min and max of every bucket, 2 * _points values.
+template <typename Type>
+inline void SignalEnvelope(const Type* _in, size_t _size, size_t _points, Type* _out)
+{
+	for(size_t b = 0; b < _points; b++) {
+		size_t first = b * _size / _points;
+		size_t last = (b + 1) * _size / _points;
+		Type lo = _in[first];
+		Type hi = _in[first];
+		for(size_t i = first + 1; i < last; i++) {
+			if(_in[i] < lo)
+				lo = _in[i];
+			if(_in[i] > hi)
+				hi = _in[i];
+		}
+		_out[2 * b] = lo;
+		_out[2 * b + 1] = hi;
+	}
+}
+
+// NEON version on the Cortex-A9
+template <>
+void SignalEnvelope<float>(const float* _in, size_t _size, size_t _points, float* _out);
@@ -0,0 +1,48 @@
+#include <string.h>
+#include "gziping.h"
+
+CGzip::CGzip(int _level)
+	: m_ready(false)
+	, m_level(_level)
+	, m_current(_level)
+	, m_skip(0)
+{
+	memset(&m_stream, 0, sizeof(m_stream));
+	// 16 + MAX_WBITS writes the gzip header and trailer instead of zlib ones
+	m_ready = deflateInit2(&m_stream, m_level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+CGzip::~CGzip()
+{
+	if(m_ready)
+		deflateEnd(&m_stream);
+}
+
+void CGzip::Compress(const std::string& _in, std::string& _out)
+{
+	_out.clear();
+	if(!m_ready)
+		return;
+
+	deflateReset(&m_stream);
+	int level = m_skip > 0 ? 0 : m_level;
+	if(level != m_current && deflateParams(&m_stream, level, Z_DEFAULT_STRATEGY) == Z_OK)
+		m_current = level;
+
+	_out.resize(deflateBound(&m_stream, _in.size()));
+	m_stream.next_in = (Bytef*)_in.data();
+	m_stream.avail_in = _in.size();
+	m_stream.next_out = (Bytef*)&_out[0];
+	m_stream.avail_out = _out.size();
+	if(deflate(&m_stream, Z_FINISH) != Z_STREAM_END)
+	{
+		_out.clear();
+		return;
+	}
+	_out.resize(m_stream.total_out);
+
+	if(m_skip > 0)
+		m_skip--;
+	else if(_out.size() > _in.size() * GZIP_POOR_RATIO)
+		m_skip = GZIP_SKIP_FRAMES;
+}
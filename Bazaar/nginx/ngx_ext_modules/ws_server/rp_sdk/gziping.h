@@ -1,16 +1,31 @@
 #pragma once
 #include <string>
-#include "crypto++/gzip.h"
+#include <zlib.h>
 
-using namespace CryptoPP;
+// Frames that shrink less than this are sent with stored blocks
+#define GZIP_POOR_RATIO 0.75
+// Stored frames before the encoder tries to compress again
+#define GZIP_SKIP_FRAMES 32
 
-void Gziping(const std::string& in, std::string& out)
+// gzip encoder for the websocket frames. The z_stream is set up once and
+// reset for every frame, so the window and hash tables are not allocated
+// per frame. When the measured ratio is poor the encoder falls back to
+// level 0 for a while, the output stays a gzip stream for pako.inflate().
+class CGzip
 {
-	/*
-	Gzip zipper(new StringSink(out));
-	zipper.Put((byte*)in.data(), in.size());
-	zipper.MessageEnd();
-	*/
+public:
+	CGzip(int _level = 1);
+	~CGzip();
 
-	StringSource ss(in, true, new Gzip(new StringSink(out), 1));
-}
+	void Compress(const std::string& _in, std::string& _out);
+
+private:
+	CGzip(const CGzip&);
+	CGzip& operator=(const CGzip&);
+
+	z_stream m_stream;
+	bool m_ready;
+	int m_level; // level of the compressed frames
+	int m_current; // level of the stream
+	int m_skip; // stored frames left
+};
@@ -13,20 +13,37 @@
 #include <future>
 
 #include <math.h>
+#include <algorithm>
+#include <sys/stat.h>
 
 using websocketpp::lib::thread;
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 using websocketpp::lib::bind;
 
+// Threads running the io_service, one per core up to this
+#define WS_IO_THREADS_MAX 4
+// A connection with more than this queued is not sent signal frames until it catches up
+#define WS_SIGNAL_MAX_BUFFERED (512 * 1024)
+
 rp_websocket_server::rp_websocket_server()
     : m_params(NULL)
+    , m_signals_push(false)
+    , m_push_pending(false)
+    , m_build_requested(false)
+    , m_build_stop(false)
+    , m_assets_size(0)
     , m_OnClosed(false)
 {
 }
 
 rp_websocket_server::rp_websocket_server(struct server_parameters* params)
     : m_params(params)
+    , m_signals_push(false)
+    , m_push_pending(false)
+    , m_build_requested(false)
+    , m_build_stop(false)
+    , m_assets_size(0)
 {
     // set up access channels to only log interesting things
     m_endpoint.clear_access_channels(websocketpp::log::alevel::all);
@@ -35,6 +52,7 @@ rp_websocket_server::rp_websocket_server(struct server_parameters* params)
 
     // Initialize the Asio transport policy
     m_endpoint.init_asio();
+    m_strand.reset(new boost::asio::io_service::strand(m_endpoint.get_io_service()));
 
     // Bind the handlers we are using
     using websocketpp::lib::placeholders::_1;
@@ -74,7 +92,18 @@ void rp_websocket_server::run(std::string docroot, uint16_t port) {
 	// m_endpoint.listen(port);
 	// Start the server accept loop
 	m_endpoint.start_accept();
-	// Start the ASIO io_service run loop
+	// Start the ASIO io_service run loop on a thread per core, the HTTP requests
+	// and the frames of the connections are handled in parallel
+	unsigned threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), (unsigned) WS_IO_THREADS_MAX);
+	for (unsigned i = 1; i < threads; ++i)
+		m_io_threads.push_back(thread(bind(&rp_websocket_server::run_io, this)));
+	run_io();
+	for (size_t i = 0; i < m_io_threads.size(); ++i)
+		m_io_threads[i].join();
+	m_io_threads.clear();
+}
+
+void rp_websocket_server::run_io() {
 	try {
 		m_endpoint.run();
 	} catch (websocketpp::exception const & e) {
@@ -83,19 +112,26 @@ void rp_websocket_server::run(std::string docroot, uint16_t port) {
 	}
 }
 
+void rp_websocket_server::start_timers() {
+	set_signal_timer();
+	set_param_timer();
+}
+
 void rp_websocket_server::set_signal_timer() {
 
 	if(m_signal_timer!=NULL)
 		m_signal_timer->cancel();
+	if(m_signals_push)
+		return;
 	int interval = m_params->get_signals_interval_func != 0 ? m_params->get_signals_interval_func() : m_params->signal_interval;
 	// fprintf(stderr, "set_signal_timer interval %d\n", interval);
 	m_signal_timer = m_endpoint.set_timer(
 		interval,
-		websocketpp::lib::bind(
+		m_strand->wrap(websocketpp::lib::bind(
 			&rp_websocket_server::on_signal_timer,
 			this,
 			websocketpp::lib::placeholders::_1
-		)
+		))
 	);
 }
 
@@ -107,11 +143,11 @@ void rp_websocket_server::set_param_timer() {
 	// fprintf(stderr, "set_param_timer interval %d\n", interval);
 	m_param_timer = m_endpoint.set_timer(
 		interval,
-		websocketpp::lib::bind(
+		m_strand->wrap(websocketpp::lib::bind(
 			&rp_websocket_server::on_param_timer,
 			this,
 			websocketpp::lib::placeholders::_1
-		)
+		))
 	);
 }
 
@@ -123,7 +159,72 @@ void rp_websocket_server::on_signal_timer(websocketpp::lib::error_code const & e
 		return;
 	}
 
-	con_list::iterator it;
+	send_signals();
+	// set timer for next check
+	set_signal_timer();
+}
+
+// Called on the application thread that finished a frame, the work is
+// handed to the server strand
+void rp_websocket_server::notify_signals(void* ctx) {
+
+	rp_websocket_server* self = static_cast<rp_websocket_server*>(ctx);
+	self->m_strand->post(bind(&rp_websocket_server::on_signals_ready, self));
+}
+
+void rp_websocket_server::on_signals_ready() {
+
+	if (!m_signals_push) {
+		m_signals_push = true;
+		if (m_signal_timer != NULL)
+			m_signal_timer->cancel();
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app, "signals push mode");
+	}
+
+	// Frames that come faster than the signal interval are merged into the next push
+	if (m_push_pending)
+		return;
+
+	int interval = m_params->get_signals_interval_func != 0 ? m_params->get_signals_interval_func() : m_params->signal_interval;
+	std::chrono::steady_clock::time_point next = m_last_signals + std::chrono::milliseconds(interval);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now >= next) {
+		send_signals();
+		return;
+	}
+
+	m_push_pending = true;
+	m_push_timer = m_endpoint.set_timer(
+		std::chrono::duration_cast<std::chrono::milliseconds>(next - now).count() + 1,
+		m_strand->wrap(websocketpp::lib::bind(
+			&rp_websocket_server::on_push_timer,
+			this,
+			websocketpp::lib::placeholders::_1
+		))
+	);
+}
+
+void rp_websocket_server::on_push_timer(websocketpp::lib::error_code const & ec) {
+
+	m_push_pending = false;
+	if (ec)
+		return;
+	send_signals();
+}
+
+void rp_websocket_server::send_signals() {
+
+	m_last_signals = std::chrono::steady_clock::now();
+
+	if (m_signal_thread.joinable()) {
+		std::set<update_point> points = client_points(true);
+		std::lock_guard<std::mutex> lock(m_build_mutex);
+		m_build_points.insert(points.begin(), points.end());
+		m_build_requested = true;
+		m_build_cond.notify_one();
+		return;
+	}
+
 	const char* signals = m_params->get_signals_func();
 
 //	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "on_signal_timer");
@@ -139,13 +240,8 @@ void rp_websocket_server::on_signal_timer(websocketpp::lib::error_code const & e
 	size_t size;
 	m_params->gzip_func(js.c_str(), buf, &size);
 
-	if (size) {
-		for (it = m_connections.begin(); it != m_connections.end(); ++it) {
-			m_endpoint.send(*it, buf, size, websocketpp::frame::opcode::binary);
-		}
-	}
-	// set timer for next check
-	set_signal_timer();
+	if (size)
+		broadcast(buf, size, true);
 }
 
 void rp_websocket_server::on_param_timer(websocketpp::lib::error_code const & ec) {
@@ -156,7 +252,12 @@ void rp_websocket_server::on_param_timer(websocketpp::lib::error_code const & ec
 		return;
 	}
 
-	con_list::iterator it;
+	if (m_params->update_params_func && m_params->get_params_since_func) {
+		deliver_updates(build_updates(m_params->update_params_func(), client_points(false), false), false);
+		set_param_timer();
+		return;
+	}
+
 	const char* params = m_params->get_params_func();
 //	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "on_param_timer");
 	static int once = 1;
@@ -171,23 +272,191 @@ void rp_websocket_server::on_param_timer(websocketpp::lib::error_code const & ec
 	size_t size;
 	m_params->gzip_func(js.c_str(), buf, &size);
 
-	if (size) {
-		for (it = m_connections.begin(); it != m_connections.end(); ++it) {
-			m_endpoint.send(*it, buf, size, websocketpp::frame::opcode::binary);
-		}
-	}
+	if (size)
+		broadcast(buf, size, false);
 	// set timer for next check
 	set_param_timer();
 }
 
+// Wraps the message once, every connection queues the same refcounted
+// buffer instead of a copy of its own
+static rp_websocket_server::server::message_ptr make_message(const void* data, size_t size) {
+
+	rp_websocket_server::server::message_ptr msg = websocketpp::lib::make_shared<rp_websocket_server::message_type>(
+		rp_websocket_server::message_type::con_msg_man_ptr(), websocketpp::frame::opcode::binary, size);
+	msg->append_payload(data, size);
+	return msg;
+}
+
+void rp_websocket_server::broadcast(const void* data, size_t size, bool signals) {
+
+	rp_websocket_server::server::message_ptr msg = make_message(data, size);
+	for (con_list::iterator it = m_connections.begin(); it != m_connections.end(); ++it) {
+		if (signals && client_behind(it->first, it->second))
+			continue;
+		websocketpp::lib::error_code ec;
+		m_endpoint.send(it->first, msg, ec);
+	}
+}
+
+// A slow client is skipped instead of having the frames pile up in its send
+// buffer. Its sequence stays where it was, so the frame it gets once it
+// caught up has everything since and is the latest.
+bool rp_websocket_server::client_behind(connection_hdl hdl, client_state& client) {
+
+	websocketpp::lib::error_code ec;
+	server::connection_ptr con = m_endpoint.get_con_from_hdl(hdl, ec);
+	bool behind = !ec && con->get_buffered_amount() > WS_SIGNAL_MAX_BUFFERED;
+	if (behind)
+		++client.dropped;
+	if (behind != client.behind) {
+		client.behind = behind;
+		std::stringstream ss;
+		ss << "ws server connection " << (behind ? "behind" : "caught up") << ", " << client.dropped << " signal frames dropped";
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app, ss.str());
+	}
+	return behind;
+}
+
+// Clients at the same point and viewport share one frame, normally that is all of them
+rp_websocket_server::update_point rp_websocket_server::client_point(const client_state& client, bool signals) {
+
+	if (!signals)
+		return update_point(client.param_seq, 0, 0.0, 1.0);
+	return update_point(client.signal_seq, client.view_points, client.view_start, client.view_stop);
+}
+
+std::set<rp_websocket_server::update_point> rp_websocket_server::client_points(bool signals) const {
+
+	std::set<update_point> points;
+	for (con_list::const_iterator it = m_connections.begin(); it != m_connections.end(); ++it)
+		points.insert(client_point(it->second, signals));
+	return points;
+}
+
+rp_websocket_server::update_frames_ptr rp_websocket_server::build_updates(uint64_t seq, const std::set<update_point>& points, bool signals) {
+
+	update_frames_ptr updates = std::make_shared<update_frames>();
+	updates->seq = seq;
+	for (std::set<update_point>::const_iterator p = points.begin(); p != points.end(); ++p) {
+		size_t size = 0;
+		const void* frame;
+		if (!signals)
+			frame = m_params->get_params_since_func(std::get<0>(*p), &size);
+		else if (m_params->get_signals_view_func)
+			frame = m_params->get_signals_view_func(std::get<0>(*p), std::get<1>(*p), std::get<2>(*p), std::get<3>(*p), &size);
+		else
+			frame = m_params->get_signals_since_func(std::get<0>(*p), &size);
+		updates->frames[*p] = frame && size ? make_message(frame, size) : server::message_ptr();
+	}
+	return updates;
+}
+
+// Every client gets what changed since the last frame it was sent, the
+// send of a client that fails is repeated from the same point next time.
+// Clients that moved to another point while the frames were built wait
+// for the next update.
+void rp_websocket_server::deliver_updates(update_frames_ptr updates, bool signals) {
+
+	for (con_list::iterator it = m_connections.begin(); it != m_connections.end(); ++it) {
+		std::map<update_point, server::message_ptr>::const_iterator f = updates->frames.find(client_point(it->second, signals));
+		if (f == updates->frames.end())
+			continue;
+		if (signals && f->second && client_behind(it->first, it->second))
+			continue;
+		if (f->second) {
+			websocketpp::lib::error_code ec;
+			m_endpoint.send(it->first, f->second, ec);
+			if (ec)
+				continue;
+		}
+		(signals ? it->second.signal_seq : it->second.param_seq) = updates->seq;
+	}
+}
+
+// The application callbacks and the serialization run here, so a slow
+// frame does not hold up parameter messages on the io threads. The SDK
+// serializes them against the parameter callbacks.
+void rp_websocket_server::signal_worker() {
+
+	std::unique_lock<std::mutex> lock(m_build_mutex);
+	while (true) {
+		m_build_cond.wait(lock, [this]{ return m_build_requested || m_build_stop; });
+		if (m_build_stop)
+			return;
+		std::set<update_point> points;
+		points.swap(m_build_points);
+		m_build_requested = false;
+		lock.unlock();
+
+		update_frames_ptr updates = build_updates(m_params->update_signals_func(), points, true);
+		m_strand->post(bind(&rp_websocket_server::deliver_signals, this, updates));
+
+		lock.lock();
+	}
+}
+
+void rp_websocket_server::deliver_signals(update_frames_ptr updates) {
+
+	deliver_updates(updates, true);
+}
+
+// Files above the limit are read for every request, the cache stays under the total
+#define HTTP_ASSET_MAX_FILE  (4 * 1024 * 1024)
+#define HTTP_ASSET_MAX_TOTAL (16 * 1024 * 1024)
+
+// The file is read outside the lock, a request holds on to its asset while
+// another thread replaces or evicts it
+rp_websocket_server::http_asset_ptr rp_websocket_server::get_asset(const std::string& filename) {
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		return http_asset_ptr();
+
+	{
+		std::lock_guard<std::mutex> lock(m_assets_mutex);
+		std::map<std::string, http_asset_ptr>::iterator it = m_assets.find(filename);
+		if (it != m_assets.end() && it->second->mtime == st.st_mtime && it->second->size == st.st_size)
+			return it->second;
+	}
+
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		return http_asset_ptr();
+
+	std::shared_ptr<http_asset> asset = std::make_shared<http_asset>();
+	asset->mtime = st.st_mtime;
+	asset->size = st.st_size;
+	std::stringstream etag;
+	etag << '"' << std::hex << (unsigned long) st.st_mtime << '-' << (unsigned long) st.st_size << '"';
+	asset->etag = etag.str();
+	asset->body.resize(st.st_size);
+	file.read(&asset->body[0], st.st_size);
+	asset->body.resize(file.gcount());
+
+	if (asset->body.size() > HTTP_ASSET_MAX_FILE)
+		return asset;
+
+	std::lock_guard<std::mutex> lock(m_assets_mutex);
+	std::map<std::string, http_asset_ptr>::iterator it = m_assets.find(filename);
+	if (it != m_assets.end()) {
+		m_assets_size -= it->second->body.size();
+		m_assets.erase(it);
+	}
+	while (!m_assets.empty() && m_assets_size + asset->body.size() > HTTP_ASSET_MAX_TOTAL) {
+		m_assets_size -= m_assets.begin()->second->body.size();
+		m_assets.erase(m_assets.begin());
+	}
+	m_assets_size += asset->body.size();
+	m_assets[filename] = asset;
+	return asset;
+}
+
 void rp_websocket_server::on_http(connection_hdl hdl) {
 
 	// Upgrade our connection handle to a full connection_ptr
 	server::connection_ptr con = m_endpoint.get_con_from_hdl(hdl);
 
-	std::ifstream file;
 	std::string filename = con->get_uri()->get_resource();
-	std::string response;
 
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app,
 		"http request1: "+filename);
@@ -201,8 +470,17 @@ void rp_websocket_server::on_http(connection_hdl hdl) {
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app,
 		"http request2: "+filename);
 
-	file.open(filename.c_str(), std::ios::in);
-	if (!file) {
+	// A precompressed <file>.gz next to the file is sent as is to clients taking gzip
+	http_asset_ptr asset;
+	bool gzip = false;
+	if (con->get_request_header("Accept-Encoding").find("gzip") != std::string::npos) {
+		asset = get_asset(filename + ".gz");
+		gzip = asset != NULL;
+	}
+	if (!asset)
+		asset = get_asset(filename);
+
+	if (!asset) {
 		// 404 error
 		std::stringstream ss;
 
@@ -217,26 +495,55 @@ void rp_websocket_server::on_http(connection_hdl hdl) {
 		return;
 	}
 
-	file.seekg(0, std::ios::end);
-	response.reserve(file.tellg());
-	file.seekg(0, std::ios::beg);
+	// Applications are updated in place, so browsers revalidate every time
+	con->append_header("ETag", asset->etag);
+	con->append_header("Cache-Control", "no-cache");
+	con->append_header("Vary", "Accept-Encoding");
+	if (gzip)
+		con->append_header("Content-Encoding", "gzip");
 
-	response.assign((std::istreambuf_iterator<char>(file)),
-					std::istreambuf_iterator<char>());
+	if (con->get_request_header("If-None-Match").find(asset->etag) != std::string::npos) {
+		con->set_status(websocketpp::http::status_code::not_modified);
+		return;
+	}
 
-	con->set_body(response);
+	con->set_body(asset->body);
 	con->set_status(websocketpp::http::status_code::ok);
 }
 
+// The connection handlers run on the strand of the connection, the
+// connection list is changed on the server strand
 void rp_websocket_server::on_open(connection_hdl hdl)
 {
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "ws server on connection");
-	m_connections.insert(hdl);
+	m_strand->dispatch(bind(&rp_websocket_server::add_connection, this, hdl));
+}
+
+void rp_websocket_server::add_connection(connection_hdl hdl)
+{
+	m_connections[hdl] = client_state();
+	if (m_params->set_clients_func)
+		m_params->set_clients_func(m_connections.size());
+	// Without the timer the new page would wait for the next frame of the application
+	if (m_signals_push)
+		on_signals_ready();
 }
 
 void rp_websocket_server::on_close(connection_hdl hdl) {
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "ws server connection closed");
+	m_strand->dispatch(bind(&rp_websocket_server::remove_connection, this, hdl));
+}
+
+void rp_websocket_server::remove_connection(connection_hdl hdl) {
+	con_list::iterator it = m_connections.find(hdl);
+	if (it != m_connections.end() && it->second.dropped) {
+		std::stringstream ss;
+		ss << "ws server connection dropped " << it->second.dropped << " signal frames";
+		m_endpoint.get_alog().write(websocketpp::log::alevel::app, ss.str());
+	}
 	m_connections.erase(hdl);
+	if (m_params->set_clients_func)
+		m_params->set_clients_func(m_connections.size());
 
 	if (!m_OnClosed) {
 		exit(-1);
@@ -254,19 +561,50 @@ void rp_websocket_server::on_message(connection_hdl hdl, server::message_ptr msg
 	JSONNode child = n.at(0);
 	std::string name = child.name();
 
-	std::string data = child.write();
-	const char * data_str = data.c_str();
+	// The message is parsed on the io thread of the connection, what it
+	// changes is applied on the server strand
+	if(name == "viewport")
+	{
+		// {"viewport":{"points":N,"start":0,"stop":1}}, the signals of this client are sent as
+		// min/max envelopes of N buckets over that part of the samples, 0 points for the whole signals
+		JSONNode::iterator i;
+		int points = (i = child.find("points")) != child.end() ? std::max(0, (int)i->as_int()) : 0;
+		double start = (i = child.find("start")) != child.end() ? i->as_float() : 0.0;
+		double stop = (i = child.find("stop")) != child.end() ? i->as_float() : 1.0;
+		m_strand->post(bind(&rp_websocket_server::set_viewport, this, hdl, points, start, stop));
+	}
+	else if(name == "parameters" || name == "signals")
+	{
+		m_strand->post(bind(&rp_websocket_server::apply_message, this, name, child.write()));
+	}
+
+}
+
+void rp_websocket_server::set_viewport(connection_hdl hdl, int points, double start, double stop) {
+
+	con_list::iterator it = m_connections.find(hdl);
+	if (it != m_connections.end()) {
+		client_state& client = it->second;
+		client.view_points = points;
+		client.view_start = start;
+		client.view_stop = stop;
+		// The next frame is a full one at the new resolution
+		client.signal_seq = 0;
+	}
+}
+
+void rp_websocket_server::apply_message(const std::string& name, const std::string& data) {
+
 	if(name == "parameters")
 	{
 		set_param_timer();
-		m_params->set_params_func(data_str);
+		m_params->set_params_func(data.c_str());
 	}
-	else if(name == "signals")
+	else
 	{
 		set_signal_timer();
-		m_params->set_signals_func(data_str);
+		m_params->set_signals_func(data.c_str());
 	}
-
 }
 
 rp_websocket_server* rp_websocket_server::create(struct server_parameters* params) {
@@ -277,8 +615,12 @@ void rp_websocket_server::start(std::string docroot, uint16_t port)
 {
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "start ws_server");
 	m_thread = thread(bind(&rp_websocket_server::run,this, docroot,  port));
-	set_signal_timer();
-	set_param_timer();
+	// The legacy SDK has no lock around its callbacks, its signals stay on the server strand
+	if (m_params->update_signals_func && m_params->get_signals_since_func)
+		m_signal_thread = thread(bind(&rp_websocket_server::signal_worker, this));
+	m_strand->post(bind(&rp_websocket_server::start_timers, this));
+	if (m_params->set_signals_notify_func)
+		m_params->set_signals_notify_func(&rp_websocket_server::notify_signals, this);
 }
 
 void rp_websocket_server::join()
@@ -293,15 +635,21 @@ void rp_websocket_server::stop()
 	m_OnClosed = true;
 
 	m_endpoint.get_alog().write(websocketpp::log::alevel::app, "stop ws_server");
+	if (m_params->set_signals_notify_func)
+		m_params->set_signals_notify_func(NULL, NULL);
 
 	m_endpoint.stop_listening();
 	m_endpoint.stop();
-	m_param_timer->cancel();
-	m_signal_timer->cancel();
+	if (m_param_timer)
+		m_param_timer->cancel();
+	if (m_signal_timer)
+		m_signal_timer->cancel();
+	if (m_push_timer)
+		m_push_timer->cancel();
 	con_list::iterator it;
 
 	for (it = m_connections.begin(); it != m_connections.end(); ++it) {
-		connection_hdl hdl = *it;
+		connection_hdl hdl = it->first;
 
 		try{
               		m_endpoint.close(hdl, websocketpp::close::status::normal, "shutdown");
@@ -313,6 +661,16 @@ void rp_websocket_server::stop()
 
 	}
 	m_connections.clear();
+	if (m_params->set_clients_func)
+		m_params->set_clients_func(0);
+	if (m_signal_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_build_mutex);
+			m_build_stop = true;
+			m_build_cond.notify_one();
+		}
+		m_signal_thread.join();
+	}
 	join();
 	m_out.close();
 }
@@ -4,7 +4,15 @@
 #include <websocketpp/common/thread.hpp>
 //#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
 #include <set>
+#include <map>
 #include <fstream>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <sys/types.h>
 
 #include "libjson/_internal/Source/JSONNode.h"
 #include "ws_server.h"
@@ -18,6 +26,7 @@ public:
     typedef websocketpp::connection_hdl connection_hdl;
     typedef websocketpp::server<websocketpp::config::asio> server;
     typedef websocketpp::lib::lock_guard<websocketpp::lib::mutex> scoped_lock;
+    typedef websocketpp::config::asio::message_type message_type;
 
     rp_websocket_server();
     rp_websocket_server(struct server_parameters* params);
@@ -26,6 +35,7 @@ public:
     static rp_websocket_server* create(struct server_parameters* params);
 
     void run(std::string docroot, uint16_t port);
+    void run_io();
 
     void start(std::string docroot, uint16_t port);
     void join();
@@ -33,8 +43,13 @@ public:
 
     void set_signal_timer();
     void set_param_timer();
+    void start_timers();
 
     void on_signal_timer(websocketpp::lib::error_code const & ec);
+    void on_signals_ready();
+    void on_push_timer(websocketpp::lib::error_code const & ec);
+    void send_signals();
+    void broadcast(const void* data, size_t size, bool signals);
     void on_param_timer(websocketpp::lib::error_code const & ec);
     void on_http(connection_hdl hdl);
     void on_open(connection_hdl hdl);
@@ -42,15 +57,78 @@ public:
     void on_message(connection_hdl hdl, server::message_ptr msg);
 
 private:
-    typedef std::set<connection_hdl,std::owner_less<connection_hdl>> con_list;
+    // Last update sequence sent to a client, 0 until it got the full state
+    struct client_state {
+        uint64_t signal_seq;
+        uint64_t param_seq;
+        int view_points; // signal viewport, 0 for the whole signals
+        double view_start;
+        double view_stop;
+        uint64_t dropped; // signal frames skipped while the connection was behind
+        bool behind;
+        client_state() : signal_seq(0), param_seq(0), view_points(0), view_start(0), view_stop(1), dropped(0), behind(false) {}
+    };
+    typedef std::map<connection_hdl,client_state,std::owner_less<connection_hdl>> con_list;
+
+    // Sequence sent and viewport points, view_start and view_stop of a client
+    typedef std::tuple<uint64_t, int, double, double> update_point;
+
+    // Frames of one update for every point the clients are at, a null message if nothing is new there
+    struct update_frames {
+        uint64_t seq;
+        std::map<update_point, server::message_ptr> frames;
+    };
+    typedef std::shared_ptr<update_frames> update_frames_ptr;
+
+    bool client_behind(connection_hdl hdl, client_state& client);
+    static update_point client_point(const client_state& client, bool signals);
+    std::set<update_point> client_points(bool signals) const;
+    update_frames_ptr build_updates(uint64_t seq, const std::set<update_point>& points, bool signals);
+    void deliver_updates(update_frames_ptr updates, bool signals);
+    void signal_worker();
+    void deliver_signals(update_frames_ptr updates);
+    static void notify_signals(void* ctx);
+    void add_connection(connection_hdl hdl);
+    void remove_connection(connection_hdl hdl);
+    void set_viewport(connection_hdl hdl, int points, double start, double stop);
+    void apply_message(const std::string& name, const std::string& data);
+
+    // Static file of the docroot held in memory, reloaded when it changes on disk
+    struct http_asset {
+        time_t mtime;
+        off_t size;
+        std::string etag;
+        std::string body;
+    };
+    typedef std::shared_ptr<const http_asset> http_asset_ptr;
+    http_asset_ptr get_asset(const std::string& filename);
 
     struct server_parameters* m_params;
     server m_endpoint;
     con_list m_connections;
     server::timer_ptr m_signal_timer;
     server::timer_ptr m_param_timer;
+    server::timer_ptr m_push_timer;
+    bool m_signals_push; // the application reports its frames, the signal timer is off
+    bool m_push_pending; // m_push_timer holds back a push to keep the signal interval
+    std::chrono::steady_clock::time_point m_last_signals;
     websocketpp::lib::thread m_thread;
+    // Further threads running the io_service next to m_thread
+    std::vector<websocketpp::lib::thread> m_io_threads;
+    // The connection list, the timers and the updates are only used on this strand,
+    // the connections themselves run on their own strands on any of the io threads
+    std::unique_ptr<boost::asio::io_service::strand> m_strand;
+    // Signal frames are built here, off the io thread, one request at a time
+    websocketpp::lib::thread m_signal_thread;
+    std::mutex m_build_mutex;
+    std::condition_variable m_build_cond;
+    std::set<update_point> m_build_points; // requested, merged while a build runs
+    bool m_build_requested;
+    bool m_build_stop;
     std::string m_docroot;
+    std::mutex m_assets_mutex; // HTTP requests are served on any io thread
+    std::map<std::string, http_asset_ptr> m_assets;
+    size_t m_assets_size;
 	std::ofstream m_out;
 	volatile bool m_OnClosed;
 };
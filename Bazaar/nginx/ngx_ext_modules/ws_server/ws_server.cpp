@@ -28,6 +28,12 @@ void start_ws_server(const struct server_parameters * _params)
 		loaded_params->get_signals_func = _params->get_signals_func;
 		loaded_params->set_signals_func = _params->set_signals_func;
 		loaded_params->gzip_func = _params->gzip_func;
+		loaded_params->update_params_func = _params->update_params_func;
+		loaded_params->update_signals_func = _params->update_signals_func;
+		loaded_params->get_params_since_func = _params->get_params_since_func;
+		loaded_params->get_signals_since_func = _params->get_signals_since_func;
+		loaded_params->get_signals_view_func = _params->get_signals_view_func;
+		loaded_params->set_signals_notify_func = _params->set_signals_notify_func;
 	}
 	if(_params != 0 && _params->port != 0)
 		loaded_params->port = _params->port;
@@ -1,4 +1,6 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -12,6 +14,14 @@ typedef const char     *(*ws_get_signals_func)(void);
 typedef int		(*ws_set_params_func)(const char *_params);
 typedef int		(*ws_set_signals_func)(const char *_signals);
 typedef void	(*ws_gzip_func)(const char *_in, void* _out, size_t* _size);
+typedef uint64_t	(*ws_update_params_func)(void);
+typedef uint64_t	(*ws_update_signals_func)(void);
+typedef const void     *(*ws_get_params_since_func)(uint64_t _since, size_t *_size);
+typedef const void     *(*ws_get_signals_since_func)(uint64_t _since, size_t *_size);
+typedef const void     *(*ws_get_signals_view_func)(uint64_t _since, int _points, double _start, double _stop, size_t *_size);
+typedef void	(*ws_signals_notify_func)(void *_ctx);
+typedef void	(*ws_set_signals_notify_func)(ws_signals_notify_func _notify, void *_ctx);
+typedef void	(*ws_set_clients_func)(int _clients);
 
 // The following struct can be used to define specific parameters
 struct server_parameters {
@@ -24,6 +34,16 @@ struct server_parameters {
 	ws_set_params_func set_params_func;
 	ws_set_signals_func set_signals_func;
 	ws_gzip_func gzip_func;
+	// Delta updates per client, optional, NULL for applications built without them
+	ws_update_params_func update_params_func;
+	ws_update_signals_func update_signals_func;
+	ws_get_params_since_func get_params_since_func;
+	ws_get_signals_since_func get_signals_since_func;
+	ws_get_signals_view_func get_signals_view_func;
+	// Signals push, optional, NULL for applications built without it
+	ws_set_signals_notify_func set_signals_notify_func;
+	// Open connections after every change, optional
+	ws_set_clients_func set_clients_func;
 	int signal_interval; // in ms
 	int param_interval; // in ms
 	int port;
@@ -19,7 +19,7 @@ int main (int argc, char **argv) {
     led += RP_LED0;
 
     // Initialization of API
-    if (rp_Init() != RP_OK) {
+    if (rp_InitEx(RP_INIT_HK) != RP_OK) {
         fprintf(stderr, "Red Pitaya API init failed!\n");
         return EXIT_FAILURE;
     }
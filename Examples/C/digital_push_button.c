@@ -7,7 +7,7 @@ int main (int argc, char **argv) {
     rp_pinState_t state;
 
     // Initialization of API
-    if (rp_Init() != RP_OK) {
+    if (rp_InitEx(RP_INIT_HK) != RP_OK) {
         fprintf(stderr, "Red Pitaya API init failed!\n");
         return EXIT_FAILURE;
     }
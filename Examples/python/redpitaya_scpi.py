@@ -1,10 +1,35 @@
 """SCPI access to Red Pitaya."""
 
 import socket
+import struct
 
 __author__ = "Luka Golinar, Iztok Jeras"
 __copyright__ = "Copyright 2015, Red Pitaya"
 
+PACK_FRAME = 64
+
+def unpack(data):
+    """Decode a PACK block: uint32 sample count, then per frame of up to
+    PACK_FRAME samples a bit width and the zigzag coded differences to the
+    previous sample packed in that many bits, all little endian.
+    """
+    count, = struct.unpack_from('<I', data)
+    samples = []
+    pos = 4
+    prev = 0
+    while len(samples) < count:
+        n = min(PACK_FRAME, count - len(samples))
+        width = data[pos]
+        nbytes = (n * width + 7) // 8
+        bits = int.from_bytes(data[pos + 1:pos + 1 + nbytes], 'little')
+        pos += 1 + nbytes
+        mask = (1 << width) - 1
+        for j in range(n):
+            zz = (bits >> (j * width)) & mask
+            prev = (prev + ((zz >> 1) ^ -(zz & 1))) & 0xffff
+            samples.append(prev - 0x10000 if prev & 0x8000 else prev)
+    return samples
+
 class scpi (object):
     """SCPI class used to access Red Pitaya over an IP network."""
     delimiter = '\r\n'
@@ -70,6 +95,31 @@ class scpi (object):
             str += (self._socket.recv(1))
         return str
 
+    def _rx_bytes(self, count):
+        """Receive exactly count bytes."""
+        data = b''
+        while len(data) < count:
+            chunk = self._socket.recv(count - len(data))
+            if not chunk:
+                raise ConnectionError('SCPI >> connection closed')
+            data += chunk
+        return data
+
+    def rx_block(self):
+        """Receive a definite length block and return its data as bytes."""
+        if self._rx_bytes(1) != b'#':
+            return None
+        digits = int(self._rx_bytes(1))
+        data = self._rx_bytes(int(self._rx_bytes(digits)))
+        self._rx_bytes(len(self.delimiter))
+        return data
+
+    def rx_packed(self):
+        """Receive a block of raw counts sent with 'ACQ:DATA:FORMAT PACK'
+        and return the samples as a list of int.
+        """
+        return unpack(self.rx_block())
+
     def tx_txt(self, msg):
         """Send text string ending and append delimiter."""
         return self._socket.send((msg + self.delimiter).encode('utf-8'))
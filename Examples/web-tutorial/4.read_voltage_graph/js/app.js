@@ -65,6 +65,7 @@
             APP.ws.onopen = function() {
                 $('#hello_message').text("Hello, Red Pitaya!");
                 console.log('Socket opened');
+                RPSignals.enable(APP.ws);
             };
 
             APP.ws.onclose = function() {
@@ -87,10 +88,15 @@
                 APP.processing = true;
 
                 try {
-                    var data = new Uint8Array(ev.data);
-                    var inflate = pako.inflate(data);
-                    var text = String.fromCharCode.apply(null, new Uint8Array(inflate));
-                    var receive = JSON.parse(text);
+                    var receive;
+                    if (RPSignals.isBinary(ev.data)) {
+                        receive = RPSignals.decode(ev.data);
+                    } else {
+                        var data = new Uint8Array(ev.data);
+                        var inflate = pako.inflate(data);
+                        var text = String.fromCharCode.apply(null, new Uint8Array(inflate));
+                        receive = JSON.parse(text);
+                    }
 
                     if (receive.parameters) {
                         
@@ -77,11 +77,13 @@ install -v -m 664 -o root -D $OVERLAY/etc/systemd/system/redpitaya_nginx.service
 install -v -m 664 -o root -D $OVERLAY/etc/systemd/system/sockproc.service            $ROOT_DIR/etc/systemd/system/sockproc.service
 install -v -m 664 -o root -D $OVERLAY/etc/systemd/system/redpitaya_scpi.service      $ROOT_DIR/etc/systemd/system/redpitaya_scpi.service
 install -v -m 664 -o root -D $OVERLAY/etc/systemd/system/scpi.service                $ROOT_DIR/etc/systemd/system/scpi.service
+install -v -m 664 -o root -D $OVERLAY/etc/systemd/system/redpitaya_telemetry.service $ROOT_DIR/etc/systemd/system/redpitaya_telemetry.service
 install -v -m 664 -o root -D $OVERLAY/etc/sysconfig/redpitaya                        $ROOT_DIR/etc/sysconfig/redpitaya
 
 chroot $ROOT_DIR <<- EOF_CHROOT
 systemctl enable redpitaya_nginx
 systemctl enable sockproc
+systemctl enable redpitaya_telemetry
 #systemctl enable redpitaya_scpi
 EOF_CHROOT
 
@@ -11,6 +11,8 @@ OVERLAY=$1
 rmdir $OVERLAYS/*
 
 # first load the fpga, then the overlay
+# (the web server skips reprogramming while its marker of the loaded bitstream exists)
+rm -f /tmp/rp_fpga_loaded
 cat $FPGAS/$OVERLAY/fpga.bit > /dev/xdevcfg
 mkdir $OVERLAYS/$OVERLAY
 cat $FPGAS/$OVERLAY/fpga.dtbo > $OVERLAYS/$OVERLAY/dtbo
@@ -30,10 +30,13 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <sys/param.h>
+#include <time.h>
 
 #include "main_osc.h"
 #include "fpga_osc.h"
 #include "fpga_awg.h"
+#include "redpitaya/rp.h"
+#include "redpitaya/rp_dsp.h"
 #include "redpitaya/version.h"
 
 #define M_PI 3.14159265358979323846
@@ -72,6 +75,11 @@ float t_params[PARAMS_NUM] = { 0, 1e6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 #define DEC_MAX 6 // Max decimation index
 static int g_dec[DEC_MAX] = { 1,  8,  64,  1024,  8192,  65536 };
 
+/** Settling detection */
+#define SETTLE_BLOCKS 5          // Blocks per capture, 2 periods each
+#define SETTLE_TOL_DEFAULT 0.01  // Relative change of U2/U1 between blocks
+#define SETTLE_TIMEOUT_DEFAULT 2 // Seconds, at least two captures are always made
+
 /** Forward declarations */
 void synthesize_signal(double ampl, double freq, signal_e type, double endfreq,
                        int32_t *data,
@@ -88,6 +96,18 @@ int bode_data_analysis(float **s ,
                        float *Phase,
                        double w_out,
                        int f);
+int block_response(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double complex *H);
+double settle_wait(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double tol,
+                   double timeout,
+                   const struct timespec *start);
                        
 /** Print usage information */
 void usage() {
@@ -101,7 +121,9 @@ void usage() {
                        "[count/steps] "
                        "[start freq] "
                        "[stop freq] "
-                       "[scale type]\n"
+                       "[scale type] "
+                       "[settle tol] "
+                       "[settle timeout]\n"
             "\n"
             "\tchannel            Channel to generate signal on [1 / 2].\n"
             "\tamplitude          Signal amplitude in V [0 - 1, which means max 2Vpp].\n"
@@ -112,8 +134,11 @@ void usage() {
             "\tstart freq         Lower frequency limit in Hz [3 - 62.5e6].\n"
             "\tstop freq          Upper frequency limit in Hz [3 - 62.5e6].\n"
             "\tscale type         0 - linear, 1 - logarithmic.\n"
+            "\tsettle tol         Optional, relative change of the response between\n"
+            "\t                   successive blocks that counts as settled [default 0.01].\n"
+            "\tsettle timeout     Optional, longest wait for settling in s [default 2].\n"
             "\n"
-            "Output:\tfrequency [Hz], phase [deg], amplitude [dB]\n";
+            "Output:\tfrequency [Hz], phase [deg], amplitude [dB], settle time [ms]\n";
 
     fprintf(stderr, format, VERSION_STR, __TIMESTAMP__, g_argv0);
 }
@@ -291,6 +316,20 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    /// Settling tolerance and timeout
+    double settle_tol = argc > 9 ? strtod(argv[9], NULL) : SETTLE_TOL_DEFAULT;
+    if ( !(settle_tol > 0) ) {
+        fprintf(stderr, "Invalid settle tolerance!\n\n");
+        usage();
+        return -1;
+    }
+    double settle_timeout = argc > 10 ? strtod(argv[10], NULL) : SETTLE_TIMEOUT_DEFAULT;
+    if ( settle_timeout < 0 ) {
+        fprintf(stderr, "Invalid settle timeout!\n\n");
+        usage();
+        return -1;
+    }
+
     /** Parameters initialization and calculation */
     double frequency_step;
     double a,b,c;
@@ -337,6 +376,7 @@ int main(int argc, char *argv[]) {
     float *measured_data_amplitude  = (float *)malloc((2) * sizeof(float) );
     float *measured_data_phase      = (float *)malloc((2) * sizeof(float) );
     float *frequency                = (float *)malloc((steps + 1) * sizeof(float) );
+    float *settle_output            = (float *)malloc((steps + 1) * sizeof(float) );
     
     /* Initialization of Oscilloscope application */
     if(rp_app_init() < 0) {
@@ -356,7 +396,7 @@ int main(int argc, char *argv[]) {
         system(command);
 
         /* We must also create all the files for storing the data */
-        for(b_number = 0; b_number < 3; b_number++){
+        for(b_number = 0; b_number < 4; b_number++){
 
             switch(b_number){
                 case 0:
@@ -368,6 +408,9 @@ int main(int argc, char *argv[]) {
                 case 2:
                     strcpy(command, "touch /tmp/bode_data/data_phase");
                     break;
+                case 3:
+                    strcpy(command, "touch /tmp/bode_data/data_settle");
+                    break;
             }
             /* Execute the command */
             system(command);
@@ -381,6 +424,7 @@ int main(int argc, char *argv[]) {
     FILE *file_frequency = fopen("/tmp/bode_data/data_frequency", "w");
     FILE *file_amplitude = fopen("/tmp/bode_data/data_amplitude", "w");
     FILE *file_phase = fopen("/tmp/bode_data/data_phase", "w");
+    FILE *file_settle = fopen("/tmp/bode_data/data_settle", "w");
 
     /// Showtime.
     for ( fr = 0; fr < steps; fr++ ) {
@@ -441,44 +485,51 @@ int main(int argc, char *argv[]) {
         * measuring proces begins. First results are inaccurate otherwise.
         */
         awg_param_t params;
+        struct timespec t_write;
         /// Prepare data buffer (calculate from input arguments)
         synthesize_signal(ampl, frequency[fr], type, endfreq, data, &params);
         /// Write the data to the FPGA and set FPGA AWG state machine
         write_data_fpga(ch, data, &params);
-        usleep(1000);
-
+        clock_gettime(CLOCK_MONOTONIC, &t_write);
+
+        /* decimation changes depending on frequency */
+        if      (frequency[fr] >= 160000){      f=0;    }
+        else if (frequency[fr] >= 20000) {      f=1;    }    
+        else if (frequency[fr] >= 2500)  {      f=2;    }    
+        else if (frequency[fr] >= 160)   {      f=3;    }    
+        else if (frequency[fr] >= 20)    {      f=4;    }     
+        else if (frequency[fr] >= 2.5)   {      f=5;    }
+
+        /* setting decimtion */
+        if (f != DEC_MAX) {
+            t_params[TIME_RANGE_PARAM] = f;
+        } else {
+            fprintf(stderr, "Invalid decimation DEC\n");
+            usage();
+            return -1;
+        }
+        
+        /* calculating num of samples */
+        size = round( ( min_periodes * 125e6 ) / ( frequency[fr] * g_dec[f] ) );
 
-        for ( i1 = 0; i1 < averaging_num; i1++ ) {
+        /* Filter parameters for signal Acqusition */
+        t_params[EQUAL_FILT_PARAM] = equal;
+        t_params[SHAPE_FILT_PARAM] = shaping;
 
-            /* decimation changes depending on frequency */
-            if      (frequency[fr] >= 160000){      f=0;    }
-            else if (frequency[fr] >= 20000) {      f=1;    }    
-            else if (frequency[fr] >= 2500)  {      f=2;    }    
-            else if (frequency[fr] >= 160)   {      f=3;    }    
-            else if (frequency[fr] >= 20)    {      f=4;    }     
-            else if (frequency[fr] >= 2.5)   {      f=5;    }
-
-            /* setting decimtion */
-            if (f != DEC_MAX) {
-                t_params[TIME_RANGE_PARAM] = f;
-            } else {
-                fprintf(stderr, "Invalid decimation DEC\n");
-                usage();
-                return -1;
-            }
-            
-            /* calculating num of samples */
-            size = round( ( min_periodes * 125e6 ) / ( frequency[fr] * g_dec[f] ) );
+        /* Setting of parameters in Oscilloscope main module for signal Acqusition */
+        if(rp_set_params((float *)&t_params, PARAMS_NUM) < 0) {
+            fprintf(stderr, "rp_set_params() failed!\n");
+            return -1;
+        }
 
-            /* Filter parameters for signal Acqusition */
-            t_params[EQUAL_FILT_PARAM] = equal;
-            t_params[SHAPE_FILT_PARAM] = shaping;
+        /* Measure as soon as the DUT has settled instead of after a fixed delay */
+        double settle_time = settle_wait( s, size, w_out, f, settle_tol, settle_timeout, &t_write );
+        if (settle_time < 0) {
+            printf("error waiting for settling @ settle_wait\n");
+            return -1;
+        }
 
-            /* Setting of parameters in Oscilloscope main module for signal Acqusition */
-            if(rp_set_params((float *)&t_params, PARAMS_NUM) < 0) {
-                fprintf(stderr, "rp_set_params() failed!\n");
-                return -1;
-            }
+        for ( i1 = 0; i1 < averaging_num; i1++ ) {
 
             /* ADC Data acqusition - saved to s */
             if (acquire_data( s, size ) < 0) {
@@ -504,6 +555,7 @@ int main(int argc, char *argv[]) {
         if (transientEffectFlag == 0) {
             Amplitude_output[fr] = measured_data_amplitude[ 1 ];
             Phase_output[fr] = measured_data_phase[ 1 ];
+            settle_output[fr] = settle_time * 1e3;
 
             //printf("%.2f    %.5f    %.5f\n", frequency[fr], measured_data_phase[ 1 ], measured_data_amplitude[ 1 ]);
 
@@ -511,6 +563,7 @@ int main(int argc, char *argv[]) {
             fprintf(file_frequency, "%.5f\n", frequency[fr]);
             fprintf(file_amplitude, "%.5f\n", measured_data_amplitude[1]);
             fprintf(file_phase, "%.5f\n", measured_data_phase[1]);
+            fprintf(file_settle, "%.3f\n", settle_output[fr]);
         }
 
         
@@ -521,6 +574,7 @@ int main(int argc, char *argv[]) {
     fclose(file_frequency);
     fclose(file_phase);
     fclose(file_amplitude);
+    fclose(file_settle);
     
     /* Setting amplitude to 0V - turning off the output. */
     awg_param_t params;
@@ -532,7 +586,7 @@ int main(int argc, char *argv[]) {
 
     for (int po = 0; po < steps; ++po)
     {
-        printf("%.2f    %.5f    %.5f\n", frequency[po],Phase_output[po], Amplitude_output[ po ]);
+        printf("%.2f    %.5f    %.5f    %.3f\n", frequency[po],Phase_output[po], Amplitude_output[ po ], settle_output[ po ]);
     }
     /** All's well that ends well. */
     return 1;
@@ -725,7 +779,6 @@ int acquire_data(float **s ,uint32_t size) {
     int retries = 150000;
     int j, sig_num, sig_len;
     int ret_val;
-    usleep(50000);
     while(retries >= 0) {
         if((ret_val = rp_get_signals(&s, &sig_num, &sig_len)) >= 0) {
             /* Signals acquired in s[][]:
@@ -768,16 +821,10 @@ int bode_data_analysis(float **s ,
                        int f) {
     int i2, i3;
     float **U_acq = create_2D_table_size(SIGNALS_NUM, SIGNAL_LENGTH);
-    /* Signals multiplied by the reference signal (sin) */
-    float *U1_sampled_X = (float *) malloc( size * sizeof( float ) );
-    float *U1_sampled_Y = (float *) malloc( size * sizeof( float ) );
-    float *U2_sampled_X = (float *) malloc( size * sizeof( float ) );
-    float *U2_sampled_Y = (float *) malloc( size * sizeof( float ) );
-    /* Signals return by trapezoidal method in complex */
-    float *X_component_lock_in_1 = (float *) malloc( size * sizeof( float ) );
-    float *X_component_lock_in_2 = (float *) malloc( size * sizeof( float ) );
-    float *Y_component_lock_in_1 = (float *) malloc( size * sizeof( float ) );
-    float *Y_component_lock_in_2 = (float *) malloc( size * sizeof( float ) );
+    /* Both inputs demodulated at the excitation frequency */
+    const float *U_in[2];
+    rp_dsp_cpx_t U_lock_in[2];
+    double f_out;
     /* Voltage, current and their phases calculated */
     float U1_amp;
     float Phase_U1_amp;
@@ -804,32 +851,22 @@ int bode_data_analysis(float **s ,
         }
     }
 
-    /* Acquired signals must be multiplied by the reference signals, used for lock in metod */
-    float ang;
-    for( i2 = 0; i2 < size; i2++) {
-        ang = (i2 * T * w_out);
-        //printf("ang(%d) = %f \n", (i2+1), ang);
-        U1_sampled_X[i2] = U_acq[1][i2] * sin( ang );
-        U1_sampled_Y[i2] = U_acq[1][i2] * sin( ang+ (M_PI/2) );
-
-        U2_sampled_X[i2] = U_acq[2][i2] * sin( ang );
-        U2_sampled_Y[i2] = U_acq[2][i2] * sin( ang +(M_PI/2) );
+    /* Lock in, both inputs against one reference at w_out */
+    U_in[0] = U_acq[1];
+    U_in[1] = U_acq[2];
+    f_out = w_out * T / (2 * M_PI);
+    if(rp_DspDemod(2, size, U_in, 1, &f_out, U_lock_in) != RP_OK) {
+        fprintf(stderr, "bode_data_analysis: rp_DspDemod failed\n");
+        return -1;
     }
 
-    /* Trapezoidal method for calculating the approximation of an integral */
-    X_component_lock_in_1[1] = trapz( U1_sampled_X, (float)T, size );
-    Y_component_lock_in_1[1] = trapz( U1_sampled_Y, (float)T, size );
-
-    X_component_lock_in_2[1] = trapz( U2_sampled_X, (float)T, size );
-    Y_component_lock_in_2[1] = trapz( U2_sampled_Y, (float)T, size );
-    
     /* Calculating voltage amplitude and phase */
-    U1_amp = (float)2 * (sqrtf( powf( X_component_lock_in_1[ 1 ] , (float)2 ) + powf( Y_component_lock_in_1[ 1 ] , (float)2 )));
-    Phase_U1_amp = atan2f( Y_component_lock_in_1[ 1 ], X_component_lock_in_1[ 1 ] );
+    U1_amp = hypot(U_lock_in[0].r, U_lock_in[0].i);
+    Phase_U1_amp = atan2(U_lock_in[0].i, U_lock_in[0].r);
 
     /* Calculating current amplitude and phase */
-    U2_amp = (float)2 * (sqrtf( powf( X_component_lock_in_2[ 1 ], (float)2 ) + powf( Y_component_lock_in_2[ 1 ] , (float)2 ) ) );
-    Phase_U2_amp = atan2f( Y_component_lock_in_2[1], X_component_lock_in_2[1] );
+    U2_amp = hypot(U_lock_in[1].r, U_lock_in[1].i);
+    Phase_U2_amp = atan2(U_lock_in[1].i, U_lock_in[1].r);
     
     Phase_internal = Phase_U2_amp - Phase_U1_amp ;
 
@@ -851,3 +888,101 @@ int bode_data_analysis(float **s ,
 
     return 1;
 }
+
+/**
+ * Response U2/U1 of consecutive blocks of a capture.
+ *
+ * The capture is split into SETTLE_BLOCKS blocks and every block is
+ * demodulated on its own after removing its mean. The ratio cancels the
+ * phase of the block start.
+ *
+ * @param s      Pointer where data is read from.
+ * @param size   Size of data.
+ * @param w_out  Angular velocity (2*pi*freq).
+ * @param f      Decimation selector index.
+ * @param H      Returned response of every block.
+ */
+int block_response(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double complex *H) {
+    static float U_block[2][SIGNAL_LENGTH / SETTLE_BLOCKS];
+    const int len = size / SETTLE_BLOCKS;
+    double f_out = w_out * ( g_dec[f] / 125e6 ) / (2 * M_PI);
+    rp_dsp_cpx_t U_lock_in[2];
+    const float *U_in[2] = { U_block[0], U_block[1] };
+    float mean[2];
+    int b, c, i;
+
+    for (b = 0; b < SETTLE_BLOCKS; b++) {
+        for (c = 0; c < 2; c++) {
+            const float *x = s[c + 1] + b * len;
+            mean[c] = 0;
+            for (i = 0; i < len; i++)
+                mean[c] += x[i];
+            mean[c] /= len;
+            for (i = 0; i < len; i++)
+                U_block[c][i] = x[i] - mean[c];
+        }
+        if(rp_DspDemod(2, len, U_in, 1, &f_out, U_lock_in) != RP_OK) {
+            fprintf(stderr, "block_response: rp_DspDemod failed\n");
+            return -1;
+        }
+        H[b] = (U_lock_in[1].r + U_lock_in[1].i * I) / (U_lock_in[0].r + U_lock_in[0].i * I);
+    }
+    return 1;
+}
+
+/**
+ * Waits until the DUT has settled after a frequency change.
+ *
+ * Captures are taken back to back. The DUT counts as settled once the
+ * response changes by less than tol between all blocks of a capture and
+ * against the last block of the previous capture, so transients longer
+ * than one capture are caught as well. A capture that started before the
+ * generator update fails the same test.
+ *
+ * @param s        Memory where the captures are saved.
+ * @param size     Size of data.
+ * @param w_out    Angular velocity (2*pi*freq).
+ * @param f        Decimation selector index.
+ * @param tol      Relative change that counts as settled.
+ * @param timeout  Longest wait in seconds, at least two captures are made.
+ * @param start    Time of the generator update.
+ * @return Seconds from start to the end of the settled capture, negative on error.
+ */
+double settle_wait(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double tol,
+                   double timeout,
+                   const struct timespec *start) {
+    double complex H[SETTLE_BLOCKS];
+    double complex H_last = 0;
+    struct timespec now;
+    double elapsed;
+    int b, captures = 0, settled;
+
+    do {
+        if (acquire_data(s, size) < 0 ||
+            block_response(s, size, w_out, f, H) < 0) {
+            return -1;
+        }
+        settled = captures > 0 && cabs(H[0] - H_last) <= tol * cabs(H[0]);
+        for (b = 1; b < SETTLE_BLOCKS; b++)
+            settled = settled && cabs(H[b] - H[b - 1]) <= tol * cabs(H[b]);
+        H_last = H[SETTLE_BLOCKS - 1];
+        captures++;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+        if (!settled && captures >= 2 && elapsed > timeout) {
+            fprintf(stderr, "Not settled at %.2f Hz after %.3f s\n", w_out / (2 * M_PI), elapsed);
+            break;
+        }
+    } while (!settled);
+
+    return elapsed;
+}
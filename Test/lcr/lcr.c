@@ -30,10 +30,13 @@
 #include <getopt.h>
 #include <complex.h>
 #include <sys/param.h>
+#include <time.h>
 
 #include "main_osc.h"
 #include "fpga_osc.h"
 #include "fpga_awg.h"
+#include "redpitaya/rp.h"
+#include "redpitaya/rp_dsp.h"
 #include "redpitaya/version.h"
 
 #define M_PI 3.14159265358979323846
@@ -79,6 +82,11 @@ float t_params[PARAMS_NUM] = { 0, 1e6, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 #define DEC_MAX 6 // Max decimation index
 static int g_dec[DEC_MAX] = { 1,  8,  64,  1024,  8192,  65536 };
 
+/** Settling detection */
+#define SETTLE_BLOCKS 4          // Blocks per capture
+#define SETTLE_TOL_DEFAULT 0.01  // Relative change of U2/U1 between blocks
+#define SETTLE_TIMEOUT_DEFAULT 2 // Seconds, at least two captures are always made
+
 /** Forward declarations */
 void synthesize_signal(double ampl, double offset, double freq, signal_e type, double endfreq,
                        int32_t *data,
@@ -96,6 +104,37 @@ int LCR_data_analysis(float **s,
                       double w_out,
                       int f);
 
+int LCR_multisine_analysis(float **s,
+                           uint32_t size,
+                           double R_shunt,
+                           int tones,
+                           const double *f_out,
+                           float complex *Z,
+                           int f);
+int multisine_sweep(uint32_t ch,
+                    double ampl,
+                    double DC_bias,
+                    double R_shunt,
+                    unsigned int averaging_num,
+                    const float *request,
+                    float *Frequency,
+                    int steps,
+                    float complex *Z);
+int dec_index(double freq);
+int block_response(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double complex *H);
+double settle_wait(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double tol,
+                   double timeout,
+                   const struct timespec *start);
+double shunt_impedance(double R_shunt, double w_out, float *P_correction);
+
 int i2c_set_shunt (int k);
 
 /** Print usage information */
@@ -116,7 +155,9 @@ void usage() {
                        "[start freq] "
                        "[stop freq] "
                        "[scale type] "
-                       "[wait]\n"
+                       "[wait] "
+                       "[settle tol] "
+                       "[settle timeout]\n"
             "\n"
             "\tchannel            Output channel                   [1 / 2   ].\n"
             "\tamplitude          Output signal amplitude in Volts [0 - 0.4 ].\n"
@@ -128,13 +169,21 @@ void usage() {
             "\tz_ref real         Reference impedance, real part [set to 0 -> not yet included].\n"
             "\tz_ref imag         Reference impedance, [set to 0 -> not yet included].\n"
             "\tcount/steps        Number of measurements [min 2 for frequency sweep].\n"
-            "\tsweep mode         0 - measurement sweep, 1 - frequency sweep.\n"
+            "\tsweep mode         0 - measurement sweep, 1 - frequency sweep,\n"
+            "\t                   2 - frequency sweep with multi-sine excitation.\n"
+            "\t                   Multi-sine measures all frequencies of one decimation range\n"
+            "\t                   in one capture, they are moved to the nearest tone of the\n"
+            "\t                   capture length and the shunt is not auto ranged.\n"
             "\tstart freq         Lower frequency limit in Hz [1 - 62.5e6].\n"
             "\tstop freq          Upper frequency limit in Hz [1 - 62.5e6].\n"
             "\tscale type         0 - linear, 1 - logarithmic.\n"
             "\twait               Wait for user before performing each step [0 / 1].\n"
+            "\tsettle tol         Optional, relative change of the response between\n"
+            "\t                   successive blocks that counts as settled [default 0.01].\n"
+            "\tsettle timeout     Optional, longest wait for settling in s [default 2].\n"
+            "\t                   Multi-sine waits a fixed period instead and reports 0.\n"
             "\n"
-            "Output:\tFrequency [Hz], |Z| [Ohm], P [deg], Ls [H], Cs [F], Rs [Ohm], Lp [H], Cp [F], Rp [Ohm], Q, D, Xs [H], Gp [S], Bp [S], |Y| [S], -P [deg]\n";
+            "Output:\tFrequency [Hz], |Z| [Ohm], P [deg], Ls [H], Cs [F], Rs [Ohm], Lp [H], Cp [F], Rp [Ohm], Q, D, Xs [H], Gp [S], Bp [S], |Y| [S], -P [deg], settle time [ms]\n";
 
     fprintf(stderr, format, VERSION_STR, __TIMESTAMP__, g_argv0);
 }
@@ -308,14 +357,14 @@ int main(int argc, char *argv[]) {
         usage();
         return -1;
     }
-    /// Sweep mode (0 = measurement, 1 = frequency)
+    /// Sweep mode (0 = measurement, 1 = frequency, 2 = frequency with multi-sine)
     unsigned int sweep_function = strtod(argv[10], NULL);
-    if ( (sweep_function < 0) || (sweep_function > 1) ) {
+    if ( sweep_function > 2 ) {
         fprintf(stderr, "Invalid sweep mode!\n\n");
         usage();
         return -1;
     }
-    if ( sweep_function == 1 && steps == 1) {
+    if ( sweep_function >= 1 && steps == 1) {
         fprintf(stderr, "Invalid count/steps value!\n\n");
         usage();
         return -1;
@@ -335,7 +384,7 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    if ( (end_frequency < start_frequency) && (sweep_function == 1) ) {
+    if ( (end_frequency < start_frequency) && (sweep_function >= 1) ) {
         fprintf(stderr, "End frequency has to be greater than the start frequency!\n\n");
         usage();
         return -1;
@@ -359,6 +408,20 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    /// Settling tolerance and timeout
+    double settle_tol = argc > 15 ? strtod(argv[15], NULL) : SETTLE_TOL_DEFAULT;
+    if ( !(settle_tol > 0) ) {
+        fprintf(stderr, "Invalid settle tolerance!\n\n");
+        usage();
+        return -1;
+    }
+    double settle_timeout = argc > 16 ? strtod(argv[16], NULL) : SETTLE_TIMEOUT_DEFAULT;
+    if ( settle_timeout < 0 ) {
+        fprintf(stderr, "Invalid settle timeout!\n\n");
+        usage();
+        return -1;
+    }
+
     /** Parameters initialization and calculation */
     double complex Z_load_ref = Z_load_ref_real + Z_load_ref_imag*I;
     double frequency_steps_number, frequency_step, a, b, c;// a,b and c used for logaritmic scale functionality
@@ -386,6 +449,8 @@ int main(int argc, char *argv[]) {
     int stepsTE = 10; // number of steps for transient effect(TE) elimination
     int TE_step_counter;
     int progress_int = 0;
+    double settle_time = 0;
+    struct timespec t_write;
     //char command[70];
     // if user sets less than 10 steps than stepsTE is decresed
     // for transient efect to be eliminated only 10 steps of measurements is eliminated
@@ -536,6 +601,12 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    float *Settle = (float *)calloc(end_results_dimension + 1, sizeof(float) );
+    if (Settle == NULL){
+        fprintf(stderr,"error allocating memory for Settle\n");
+        return -1;
+    }
+
     float *R_s = (float *)malloc((end_results_dimension + 1) * sizeof(float) );
     if (R_s == NULL){
         fprintf(stderr,"error allocating memory for R_s\n");
@@ -642,11 +713,38 @@ int main(int argc, char *argv[]) {
     * there are 4 sorts of measurement purposes , 3 pof them reprisent calibration sequence
     * [h=0] - calibration open connections, [h=1] - calibration short circuited, [h=2] calibration load, [h=3] actual measurment
     */
+    /// Multi-sine sweep, the requested frequencies before they are moved onto the tones
+    float *Frequency_request = NULL;
+    if ( sweep_function == 2 ) {
+        Frequency_request = (float *)malloc( end_results_dimension * sizeof(float) );
+        if (Frequency_request == NULL){
+            fprintf(stderr,"error allocating memory for Frequency_request\n");
+            return -1;
+        }
+        for ( fr = 0; fr < frequency_steps_number; fr++ ) {
+            if ( scale_type ) {
+                Frequency_request[ fr ] = powf( 10, ( c * (float)fr ) + a );
+            }
+            else {
+                Frequency_request[ fr ] = start_frequency + ( frequency_step * fr );
+            }
+        }
+    }
+
     //FILE *progress_file = fopen("/tmp/lcr_data/progress.txt", "w");
     for (h = 0; h <= 3 ; h++) {
         if (!calib_function) {
             h = 3;
         }
+        /* Multi-sine, every decimation range is one excitation and one capture per average */
+        if ( sweep_function == 2 ) {
+            float complex *Z_dest = h == 0 ? Z_short : h == 1 ? Z_open : h == 2 ? Z_load : Z_measure;
+            if ( multisine_sweep( ch, ampl, DC_bias, R_shunt, averaging_num, Frequency_request, Frequency, steps, Z_dest ) < 0 ) {
+                printf("error multi-sine sweep multisine_sweep\n");
+                return -1;
+            }
+            continue;
+        }
         /*
         * for floop dedicated to run through the frequency range defined by user
         * the loop also includes the start and end frequency
@@ -699,9 +797,42 @@ int main(int argc, char *argv[]) {
             awg_param_t params;
             /* Prepare data buffer (calculate from input arguments) */
             synthesize_signal( ampl, DC_bias, Frequency[fr], type, endfreq, data, &params );
-            usleep(100000);
             /* Write the data to the FPGA and set FPGA AWG state machine */
             write_data_fpga( ch, data, &params );
+            clock_gettime(CLOCK_MONOTONIC, &t_write);
+
+            /* decimation changes depending on frequency */
+            f = dec_index( Frequency[ fr ] );
+
+            /* setting decimtion */
+            if (f != DEC_MAX) {
+                t_params[TIME_RANGE_PARAM] = f;
+            } else {
+                fprintf(stderr, "Invalid decimation DEC\n");
+                usage();
+                return -1;
+            }
+
+            /* calculating num of samples */
+            size = round( ( min_periodes * 125e6 ) / ( Frequency[ fr ] * g_dec[ f ] ) );
+            if (size > (1<<14)) size = 1<<14;
+
+            /* Filter parameters for signal Acqusition */
+            t_params[EQUAL_FILT_PARAM] = equal;
+            t_params[SHAPE_FILT_PARAM] = shaping;
+
+            /* Setting of parameters in Oscilloscope main module for signal Acqusition */
+            if(rp_set_params((float *)&t_params, PARAMS_NUM) < 0) {
+                fprintf(stderr, "rp_set_params() failed!\n");
+                return -1;
+            }
+
+            /* Measure as soon as the DUT has settled instead of after a fixed delay */
+            settle_time = settle_wait( s, size, w_out, f, settle_tol, settle_timeout, &t_write );
+            if (settle_time < 0) {
+                printf("error waiting for settling @ settle_wait\n");
+                return -1;
+            }
 
             /* TODO calibration sequence parameters adjustments
             // if measurement sweep selected, only one calibration measurement is made
@@ -760,37 +891,6 @@ int main(int argc, char *argv[]) {
                 do {
                     for ( i1 = 0; i1 < averaging_num; i1++ ) {
 
-                        /* decimation changes depending on frequency */
-                        if      (Frequency[ fr ] >= 65000) {      f = 0;    }
-                        else if (Frequency[ fr ] >= 8000)  {      f = 1;    }
-                        else if (Frequency[ fr ] >= 1000)  {      f = 2;    }
-                        else if (Frequency[ fr ] >= 60)    {      f = 3;    }
-                        else if (Frequency[ fr ] >= 8)     {      f = 4;    }
-                        else if (Frequency[ fr ] >= 1)     {      f = 5;    }
-
-                        /* setting decimtion */
-                        if (f != DEC_MAX) {
-                            t_params[TIME_RANGE_PARAM] = f;
-                        } else {
-                            fprintf(stderr, "Invalid decimation DEC\n");
-                            usage();
-                            return -1;
-                        }
-
-                        /* calculating num of samples */
-                        size = round( ( min_periodes * 125e6 ) / ( Frequency[ fr ] * g_dec[ f ] ) );
-                        if (size > (1<<14)) size = 1<<14;
-
-                        /* Filter parameters for signal Acqusition */
-                        t_params[EQUAL_FILT_PARAM] = equal;
-                        t_params[SHAPE_FILT_PARAM] = shaping;
-
-                        /* Setting of parameters in Oscilloscope main module for signal Acqusition */
-                        if(rp_set_params((float *)&t_params, PARAMS_NUM) < 0) {
-                            fprintf(stderr, "rp_set_params() failed!\n");
-                            return -1;
-                        }
-
                         /* Data acqusition function, data saved to s */
                         if (acquire_data(s, size) < 0) {
                             printf("error acquiring data @ acquire_data\n");
@@ -848,6 +948,13 @@ int main(int argc, char *argv[]) {
                             // set new shunt value
                             i2c_set_shunt(R_shunt_k);
                             R_shunt = R_shunt_tbl[R_shunt_k];
+                            /* the relay switch is a step for the DUT as well */
+                            clock_gettime(CLOCK_MONOTONIC, &t_write);
+                            settle_time = settle_wait( s, size, w_out, f, settle_tol, settle_timeout, &t_write );
+                            if (settle_time < 0) {
+                                printf("error waiting for settling @ settle_wait\n");
+                                return -1;
+                            }
                         }
                     }
                 } while (repeat);
@@ -890,6 +997,7 @@ int main(int argc, char *argv[]) {
                 Z_load[ dimension_step ]  =  Calib_data_load[ 0 ][ 1 ] + Calib_data_load[ 0 ][ 2 ] *I;
 
                 Z_measure[dimension_step] = Calib_data_measure[i][1] + Calib_data_measure[i][2] *I;
+                Settle[ dimension_step ] = settle_time * 1e3;
 
             } // measurement sweep loop ends here
 
@@ -924,7 +1032,7 @@ int main(int argc, char *argv[]) {
         system(command);
 
         /* We loop X (Where X is the number of data we want to have) times and create a file for each data type */
-        for(f_number = 0; f_number < 16; f_number++){
+        for(f_number = 0; f_number < 17; f_number++){
             switch(f_number){
                 case  0:  strcpy(command, "touch /tmp/lcr_data/data_frequency");  break;
                 case  1:  strcpy(command, "touch /tmp/lcr_data/data_amplitude");  break;
@@ -942,6 +1050,7 @@ int main(int argc, char *argv[]) {
                 case 13:  strcpy(command, "touch /tmp/lcr_data/data_D");          break;
                 case 14:  strcpy(command, "touch /tmp/lcr_data/data_Y_abs");      break;
                 case 15:  strcpy(command, "touch /tmp/lcr_data/data_phaseY");     break;
+                case 16:  strcpy(command, "touch /tmp/lcr_data/data_settle");     break;
             }
         }
         /* We change the mode to write and add permission. */
@@ -969,6 +1078,7 @@ int main(int argc, char *argv[]) {
     FILE *file_R_p       = fopen("/tmp/lcr_data/data_R_p", "w");
     FILE *file_Q         = fopen("/tmp/lcr_data/data_Q", "w");
     FILE *file_D         = fopen("/tmp/lcr_data/data_D", "w");
+    FILE *file_settle    = fopen("/tmp/lcr_data/data_settle", "w");
 
     /** Combining all the data and printing it to stdout
      * depending on calibration argument output data is calculated
@@ -1023,7 +1133,7 @@ int main(int argc, char *argv[]) {
 
         /// Output
         /*printf(" %.1f    %.3f    %.1f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f    %.10f\n",*/
-         printf(" %.1f    %.3e    %.2f    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.2f\n",  
+         printf(" %.1f    %.3e    %.2f    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.3e    %.2f    %.3f\n",  
         
         /*"Output:\tFrequency [Hz], |Z| [Ohm], P [deg], Ls [H], Cs [F], Rs [Ohm], Lp [H], Cp [F], Rp [Ohm], Q, D, Xs [H], Gp [S], Bp [S], |Y| [S], -P [deg]\n";*/   
          
@@ -1042,7 +1152,8 @@ int main(int argc, char *argv[]) {
             G_p[ i ],
             B_p[ i ],           
             Y_abs[ i ],
-            PhaseY[ i ]
+            PhaseY[ i ],
+            Settle[ i ]
             );
 
 
@@ -1075,6 +1186,7 @@ int main(int argc, char *argv[]) {
 
         fprintf(file_Y_abs, "%.15f\n", Y_abs[i]);
         fprintf(file_PhaseY, "%.15f\n", PhaseY[i]);
+        fprintf(file_settle, "%.3f\n", Settle[i]);
 
         /*Dummy data*/
         
@@ -1129,6 +1241,7 @@ int main(int argc, char *argv[]) {
     
     fclose(file_Y_abs);
     fclose(file_PhaseY);
+    fclose(file_settle);
     
     
     
@@ -1322,7 +1435,6 @@ int acquire_data(float **s ,
     int retries = 150000;
     int j, sig_num, sig_len;
     int ret_val;
-    usleep(50000);
     while(retries >= 0) {
         if((ret_val = rp_get_signals(&s, &sig_num, &sig_len)) >= 0) {
             /* Signals acquired in s[][]:
@@ -1372,16 +1484,10 @@ int LCR_data_analysis(float **s,
     /* Used for storing the Voltage and current on the load */
     float *U_dut = create_table_size( SIGNAL_LENGTH );
     float *I_dut = create_table_size( SIGNAL_LENGTH );
-    /* Signals multiplied by the reference signal (sin) */
-    float *U_dut_sampled_X = (float *) malloc( size * sizeof( float ) );
-    float *U_dut_sampled_Y = (float *) malloc( size * sizeof( float ) );
-    float *I_dut_sampled_X = (float *) malloc( size * sizeof( float ) );
-    float *I_dut_sampled_Y = (float *) malloc( size * sizeof( float ) );
-    /* Signals return by trapezoidal method in complex */
-    float *X_component_lock_in_1 = (float *) malloc( size * sizeof( float ) );
-    float *X_component_lock_in_2 = (float *) malloc( size * sizeof( float ) );
-    float *Y_component_lock_in_1 = (float *) malloc( size * sizeof( float ) );
-    float *Y_component_lock_in_2 = (float *) malloc( size * sizeof( float ) );
+    /* Voltage and current demodulated at the excitation frequency */
+    const float *UI_dut[2];
+    rp_dsp_cpx_t UI_lock_in[2];
+    double f_out;
     /* Voltage, current and their phases calculated */
     float U_dut_amp;
     float Phase_U_dut_amp;
@@ -1423,59 +1529,32 @@ int LCR_data_analysis(float **s,
         float mean_buff_in2=sum_buff_in2/size;
 
       // MANUAL CORRECTION
-      double C_cable=460E-12;
-      float P_correction=atan(-w_out*C_cable*R_shunt);
-   
-  
-      if        (R_shunt==1300000.0)     {  R_shunt=R_shunt*1.0;  C_cable=465E-12;  }
-
-      else if   (R_shunt==100000.0)      {  R_shunt=R_shunt*1.0;  C_cable=390E-12;  }
-
-      else if   (R_shunt==10000.0)       {  R_shunt=R_shunt*1.0;  C_cable=350E-12;  }
-  
-      else if   (R_shunt==1000.0)        {  R_shunt=R_shunt*1.0;  C_cable=160E-12;  }
-
-      else if   (R_shunt==100.0)         {  R_shunt=R_shunt*1.0;  C_cable=100E-12;  }
-
-      else if   (R_shunt==10.0)          {  R_shunt=R_shunt*1.15;  C_cable=100E-12;  }
-       /////// 
-
-   
-
+      float P_correction;
+      double Z_shunt = shunt_impedance(R_shunt, w_out, &P_correction);
 
     /* Voltage and current on the load can be calculated from gathered data */
     for (i2 = 0; i2 < size; i2++) {
         U_dut[ i2 ] = (((U_acq[ 1 ][ i2 ])- mean_buff_in1) - ((U_acq[ 2 ][ i2 ])- mean_buff_in2)); // potencial difference gives the voltage
         // Curent trough the load is the same as trough thr R_shunt. ohm's law is used to calculate the current
-        I_dut[ i2 ] = (((U_acq[ 2 ][ i2 ])- mean_buff_in2) / ((R_shunt*(1.0/(w_out*C_cable)))/(R_shunt+(1.0/(w_out*C_cable)))));
+        I_dut[ i2 ] = (((U_acq[ 2 ][ i2 ])- mean_buff_in2) / Z_shunt);
     }
 
-    /* Acquired signals must be multiplied by the reference signals, used for lock in metod */
-    float ang;
-    for( i2 = 0; i2 < size; i2++) {
-        ang = (i2 * T * w_out);
-        //printf("ang(%d) = %f \n", (i2+1), ang);
-        U_dut_sampled_X[ i2 ] = U_dut[ i2 ] * sin( ang );
-        U_dut_sampled_Y[ i2 ] = U_dut[ i2 ] * sin( ang+ ( M_PI/2 ) );
-
-        I_dut_sampled_X[ i2 ] = I_dut[ i2 ] * sin( ang );
-        I_dut_sampled_Y[ i2 ] = I_dut[ i2 ] * sin( ang +( M_PI/2 ) );
+    /* Lock in, voltage and current against one reference at w_out */
+    UI_dut[0] = U_dut;
+    UI_dut[1] = I_dut;
+    f_out = w_out * T / (2 * M_PI);
+    if(rp_DspDemod(2, size, UI_dut, 1, &f_out, UI_lock_in) != RP_OK) {
+        fprintf(stderr, "LCR_data_analysis: rp_DspDemod failed\n");
+        return -1;
     }
 
-    /* Trapezoidal method for calculating the approximation of an integral */
-    X_component_lock_in_1[ 1 ] = trapz( U_dut_sampled_X, (float)T, size );
-    Y_component_lock_in_1[ 1 ] = trapz( U_dut_sampled_Y, (float)T, size );
-
-    X_component_lock_in_2[ 1 ] = trapz( I_dut_sampled_X, (float)T, size );
-    Y_component_lock_in_2[ 1 ] = trapz( I_dut_sampled_Y, (float)T, size );
-
     /* Calculating voltage amplitude and phase */
-    U_dut_amp = (float)2 * (sqrtf( powf( X_component_lock_in_1[ 1 ] , (float)2 ) + powf( Y_component_lock_in_1[ 1 ] , (float)2 )));
-    Phase_U_dut_amp = atan2f( Y_component_lock_in_1[ 1 ], X_component_lock_in_1[ 1 ] );
+    U_dut_amp = hypot(UI_lock_in[0].r, UI_lock_in[0].i);
+    Phase_U_dut_amp = atan2(UI_lock_in[0].i, UI_lock_in[0].r);
 
     /* Calculating current amplitude and phase */
-    I_dut_amp = (float)2 * (sqrtf( powf( X_component_lock_in_2[ 1 ], (float)2 ) + powf( Y_component_lock_in_2[ 1 ] , (float)2 ) ) );
-    Phase_I_dut_amp = atan2f( Y_component_lock_in_2[1], X_component_lock_in_2[1] );
+    I_dut_amp = hypot(UI_lock_in[1].r, UI_lock_in[1].i);
+    Phase_I_dut_amp = atan2(UI_lock_in[1].i, UI_lock_in[1].r);
 
     /* Asigning impedance  values (complex value) */
     Phase_Z_rad =  Phase_U_dut_amp - Phase_I_dut_amp;
@@ -1498,6 +1577,281 @@ int LCR_data_analysis(float **s,
     return 1;
 }
 
+/**
+ * Shunt model of the manual correction. The shunt is read in parallel with
+ * the cable capacitance of its range.
+ *
+ * @param R_shunt       Shunt resistor value in Ohms.
+ * @param w_out         Angular velocity (2*pi*freq).
+ * @param P_correction  Returned phase correction in radians.
+ * @return Magnitude of the shunt impedance in Ohms.
+ */
+double shunt_impedance(double R_shunt, double w_out, float *P_correction) {
+    double C_cable=460E-12;
+    *P_correction=atan(-w_out*C_cable*R_shunt);
+
+    if        (R_shunt==1300000.0)     {  R_shunt=R_shunt*1.0;  C_cable=465E-12;  }
+    else if   (R_shunt==100000.0)      {  R_shunt=R_shunt*1.0;  C_cable=390E-12;  }
+    else if   (R_shunt==10000.0)       {  R_shunt=R_shunt*1.0;  C_cable=350E-12;  }
+    else if   (R_shunt==1000.0)        {  R_shunt=R_shunt*1.0;  C_cable=160E-12;  }
+    else if   (R_shunt==100.0)         {  R_shunt=R_shunt*1.0;  C_cable=100E-12;  }
+    else if   (R_shunt==10.0)          {  R_shunt=R_shunt*1.15;  C_cable=100E-12;  }
+
+    return (R_shunt*(1.0/(w_out*C_cable)))/(R_shunt+(1.0/(w_out*C_cable)));
+}
+
+/**
+ * Decimation index for a measurement frequency, so the capture holds
+ * at least 8 periods.
+ *
+ * @param freq  Frequency in Hz.
+ */
+int dec_index(double freq) {
+    if      (freq >= 65000) return 0;
+    else if (freq >= 8000)  return 1;
+    else if (freq >= 1000)  return 2;
+    else if (freq >= 60)    return 3;
+    else if (freq >= 8)     return 4;
+    return 5;
+}
+
+/**
+ * Multi-sine analysis of one capture. The capture is one period of the
+ * excitation, every tone sits on a whole number of periods and is
+ * demodulated without leakage from the others.
+ *
+ * @param s        Pointer where data is read from.
+ * @param size     Size of data, one excitation period.
+ * @param R_shunt  Shunt resistor value in Ohms.
+ * @param tones    Number of tones.
+ * @param f_out    Tone frequencies in cycles per sample.
+ * @param Z        Pointer where to write the impedance of every tone.
+ * @param f        Decimation selector index.
+ */
+int LCR_multisine_analysis(float **s,
+                           uint32_t size,
+                           double R_shunt,
+                           int tones,
+                           const double *f_out,
+                           float complex *Z,
+                           int f) {
+    int i2, k;
+    float *U_dut = create_table_size( size );
+    float *U_shunt = create_table_size( size );
+    rp_dsp_cpx_t *UI_lock_in = (rp_dsp_cpx_t *)malloc( 2 * tones * sizeof(rp_dsp_cpx_t) );
+    const float *UI_dut[2];
+    double mean_in1 = 0, mean_in2 = 0;
+    int ret = 1;
+
+    if (U_dut == NULL || U_shunt == NULL || UI_lock_in == NULL) {
+        fprintf(stderr, "LCR_multisine_analysis: out of memory\n");
+        ret = -1;
+        goto out;
+    }
+
+    /* Transform signals from  AD - 14 bit to voltage [ ( s / 2^14 ) * 2 ] */
+    for (i2 = 0; i2 < size; i2++) {
+        U_dut[ i2 ] = ( s[ 1 ][ i2 ] * 2.0f ) / 16384.0f;
+        U_shunt[ i2 ] = ( s[ 2 ][ i2 ] * 2.0f ) / 16384.0f;
+        mean_in1 += U_dut[ i2 ];
+        mean_in2 += U_shunt[ i2 ];
+    }
+    mean_in1 /= size;
+    mean_in2 /= size;
+    for (i2 = 0; i2 < size; i2++) {
+        U_shunt[ i2 ] -= mean_in2;
+        U_dut[ i2 ] = ( U_dut[ i2 ] - mean_in1 ) - U_shunt[ i2 ];
+    }
+
+    /* All tones of both signals in one pass, the current follows per tone from the shunt voltage */
+    UI_dut[0] = U_dut;
+    UI_dut[1] = U_shunt;
+    if(rp_DspDemod(2, size, UI_dut, tones, f_out, UI_lock_in) != RP_OK) {
+        fprintf(stderr, "LCR_multisine_analysis: rp_DspDemod failed\n");
+        ret = -1;
+        goto out;
+    }
+
+    for (k = 0; k < tones; k++) {
+        double w_out = 2 * M_PI * f_out[ k ] * c_osc_fpga_smpl_freq / g_dec[ f ];
+        float P_correction;
+        double Z_shunt = shunt_impedance(R_shunt, w_out, &P_correction);
+        double U_amp = hypot(UI_lock_in[k].r, UI_lock_in[k].i);
+        double I_amp = hypot(UI_lock_in[tones + k].r, UI_lock_in[tones + k].i) / Z_shunt;
+        double Phase_Z_rad = atan2(UI_lock_in[k].i, UI_lock_in[k].r) - atan2(UI_lock_in[tones + k].i, UI_lock_in[tones + k].r);
+
+        /* Phase has to be limited between 180 and -180 deg. */
+        if (Phase_Z_rad <= (-M_PI)) {
+            Phase_Z_rad += 2*M_PI;
+        }
+        else if (Phase_Z_rad >= M_PI) {
+            Phase_Z_rad -= 2*M_PI;
+        }
+        Phase_Z_rad += P_correction;
+
+        Z[ k ] = ( U_amp / I_amp ) * ( cos( Phase_Z_rad ) + sin( Phase_Z_rad ) * I ); // R + jX
+    }
+
+out:
+    free(U_dut);
+    free(U_shunt);
+    free(UI_lock_in);
+    return ret;
+}
+
+/**
+ * Frequency sweep with multi-sine excitation.
+ *
+ * The frequencies are grouped by their decimation range. Every group is
+ * one AWG table holding all its tones, with Schroeder phases to keep the
+ * crest factor low, and the capture is exactly one table period. The tone
+ * spacing is then the inverse of the capture length and each requested
+ * frequency is moved to the nearest free tone. Instead of a generator
+ * update, settling and a capture per frequency, there is one per group.
+ *
+ * @param ch             Channel number [0, 1].
+ * @param ampl           Peak amplitude of the sum of tones [V].
+ * @param DC_bias        DC component [V].
+ * @param R_shunt        Shunt resistor value in Ohms.
+ * @param averaging_num  Captures averaged per group.
+ * @param request        Requested frequencies.
+ * @param Frequency      Returned tone frequencies.
+ * @param steps          Number of frequencies.
+ * @param Z              Pointer where to write the impedance at every frequency.
+ */
+int multisine_sweep(uint32_t ch,
+                    double ampl,
+                    double DC_bias,
+                    double R_shunt,
+                    unsigned int averaging_num,
+                    const float *request,
+                    float *Frequency,
+                    int steps,
+                    float complex *Z) {
+    const uint32_t size = SIGNAL_LENGTH;
+    float **s = create_2D_table_size(SIGNALS_NUM, SIGNAL_LENGTH);
+    int *index = (int *)malloc( steps * sizeof(int) );
+    int *bin = (int *)malloc( steps * sizeof(int) );
+    double *f_out = (double *)malloc( steps * sizeof(double) );
+    float complex *Z_tone = (float complex *)malloc( steps * sizeof(float complex) );
+    float complex *Z_sum = (float complex *)malloc( steps * sizeof(float complex) );
+    rp_dsp_cpx_t *spectrum = (rp_dsp_cpx_t *)calloc( n / 2 + 1, sizeof(rp_dsp_cpx_t) );
+    double *table = (double *)malloc( n * sizeof(double) );
+    int i, j, f, tones, done = 0;
+    int ret = 1;
+
+    if (s == NULL || index == NULL || bin == NULL || f_out == NULL || Z_tone == NULL ||
+        Z_sum == NULL || spectrum == NULL || table == NULL) {
+        fprintf(stderr, "multisine_sweep: out of memory\n");
+        ret = -1;
+        goto out;
+    }
+
+    for (f = 0; f < DEC_MAX; f++) {
+        /* Tone spacing, the capture is one period of the AWG table */
+        const double f_0 = c_osc_fpga_smpl_freq / g_dec[ f ] / size;
+
+        tones = 0;
+        for (i = 0; i < steps; i++) {
+            if (dec_index( request[ i ] ) != f)
+                continue;
+            /* Nearest tone below a quarter of the sample rate that is not taken yet */
+            int k = (int)round( request[ i ] / f_0 );
+            int d;
+            k = MAX( 1, MIN( k, (int)size / 4 ) );
+            for (d = 0; d < (int)size / 4; d++) {
+                for (j = 0; j < tones && bin[ j ] != k + d; j++);
+                if (j == tones && k + d <= (int)size / 4) { k += d; break; }
+                for (j = 0; j < tones && bin[ j ] != k - d; j++);
+                if (j == tones && k - d >= 1) { k -= d; break; }
+            }
+            index[ tones ] = i;
+            bin[ tones ] = k;
+            f_out[ tones ] = (double)k / size;
+            Frequency[ i ] = k * f_0;
+            tones++;
+        }
+        if (tones == 0)
+            continue;
+
+        /* Sum of tones through one inverse FFT, Schroeder phases -pi*t*(t-1)/K */
+        memset(spectrum, 0, ( n / 2 + 1 ) * sizeof(rp_dsp_cpx_t));
+        for (j = 0; j < tones; j++) {
+            double phi = -M_PI * j * ( j - 1 ) / tones;
+            spectrum[ bin[ j ] ].r = cos( phi );
+            spectrum[ bin[ j ] ].i = sin( phi );
+        }
+        if (rp_DspFftRealInv(n, spectrum, table) != RP_OK) {
+            fprintf(stderr, "multisine_sweep: rp_DspFftRealInv failed\n");
+            ret = -1;
+            goto out;
+        }
+        double peak = 0;
+        for (j = 0; j < n; j++)
+            peak = MAX( peak, fabs( table[ j ] ) );
+
+        /* The peak of the sum is the requested amplitude, 1 V ==> 4000 DAC counts */
+        awg_param_t params;
+        double amp = MIN( ampl * 4000.0, 8191 );
+        params.offsgain = ( (int)( DC_bias * (double)(1<<13) ) << 16 ) + 0x1fff;
+        params.step = round( 65536 * f_0 / c_awg_smpl_freq * n );
+        params.wrap = round( 65536 * n - 1 );
+        for (j = 0; j < n; j++) {
+            data[ j ] = round( amp * table[ j ] / peak );
+            if (data[ j ] < 0)
+                data[ j ] += (1 << 14);
+        }
+        write_data_fpga( ch, data, &params );
+
+        /* One table period lets the DUT settle on every tone */
+        usleep( MAX( 100000, (useconds_t)( 1e6 / f_0 ) ) );
+
+        t_params[ TIME_RANGE_PARAM ] = f;
+        t_params[ EQUAL_FILT_PARAM ] = 0;
+        t_params[ SHAPE_FILT_PARAM ] = 0;
+        if (rp_set_params((float *)&t_params, PARAMS_NUM) < 0) {
+            fprintf(stderr, "rp_set_params() failed!\n");
+            ret = -1;
+            goto out;
+        }
+
+        memset(Z_sum, 0, tones * sizeof(float complex));
+        for (i = 0; i < averaging_num; i++) {
+            if (acquire_data(s, size) < 0 ||
+                LCR_multisine_analysis(s, size, R_shunt, tones, f_out, Z_tone, f) < 0) {
+                ret = -1;
+                goto out;
+            }
+            for (j = 0; j < tones; j++)
+                Z_sum[ j ] += Z_tone[ j ];
+        }
+        for (j = 0; j < tones; j++)
+            Z[ index[ j ] ] = Z_sum[ j ] / averaging_num;
+
+        done += tones;
+        FILE *progress_file = fopen("/tmp/progress", "w");
+        if (progress_file != NULL) {
+            fprintf(progress_file, "%d \n", 100 * done / steps);
+            fclose(progress_file);
+        }
+    }
+
+out:
+    if (s != NULL) {
+        for (i = 0; i < SIGNALS_NUM; i++)
+            free(s[ i ]);
+        free(s);
+    }
+    free(index);
+    free(bin);
+    free(f_out);
+    free(Z_tone);
+    free(Z_sum);
+    free(spectrum);
+    free(table);
+    return ret;
+}
+
 /* user wait defined for user inquiry regarding measurement sweep
  * its functionality is not used and will be avaliable in the future if needed
  * it lets the user know to connect the wires correctly and inquires for input
@@ -1587,3 +1941,100 @@ int i2c_set_shunt (int k) {
     return 0;
 }
 
+/**
+ * Response U2/U1 of consecutive blocks of a capture.
+ *
+ * The capture is split into SETTLE_BLOCKS blocks and every block is
+ * demodulated on its own after removing its mean. The ratio cancels the
+ * phase of the block start.
+ *
+ * @param s      Pointer where data is read from.
+ * @param size   Size of data.
+ * @param w_out  Angular velocity (2*pi*freq).
+ * @param f      Decimation selector index.
+ * @param H      Returned response of every block.
+ */
+int block_response(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double complex *H) {
+    static float U_block[2][SIGNAL_LENGTH / SETTLE_BLOCKS];
+    const int len = size / SETTLE_BLOCKS;
+    double f_out = w_out * ( g_dec[f] / 125e6 ) / (2 * M_PI);
+    rp_dsp_cpx_t U_lock_in[2];
+    const float *U_in[2] = { U_block[0], U_block[1] };
+    float mean[2];
+    int b, c, i;
+
+    for (b = 0; b < SETTLE_BLOCKS; b++) {
+        for (c = 0; c < 2; c++) {
+            const float *x = s[c + 1] + b * len;
+            mean[c] = 0;
+            for (i = 0; i < len; i++)
+                mean[c] += x[i];
+            mean[c] /= len;
+            for (i = 0; i < len; i++)
+                U_block[c][i] = x[i] - mean[c];
+        }
+        if(rp_DspDemod(2, len, U_in, 1, &f_out, U_lock_in) != RP_OK) {
+            fprintf(stderr, "block_response: rp_DspDemod failed\n");
+            return -1;
+        }
+        H[b] = (U_lock_in[1].r + U_lock_in[1].i * I) / (U_lock_in[0].r + U_lock_in[0].i * I);
+    }
+    return 1;
+}
+
+/**
+ * Waits until the DUT has settled after a frequency change.
+ *
+ * Captures are taken back to back. The DUT counts as settled once the
+ * response changes by less than tol between all blocks of a capture and
+ * against the last block of the previous capture, so transients longer
+ * than one capture are caught as well. A capture that started before the
+ * generator update fails the same test.
+ *
+ * @param s        Memory where the captures are saved.
+ * @param size     Size of data.
+ * @param w_out    Angular velocity (2*pi*freq).
+ * @param f        Decimation selector index.
+ * @param tol      Relative change that counts as settled.
+ * @param timeout  Longest wait in seconds, at least two captures are made.
+ * @param start    Time of the generator update.
+ * @return Seconds from start to the end of the settled capture, negative on error.
+ */
+double settle_wait(float **s,
+                   uint32_t size,
+                   double w_out,
+                   int f,
+                   double tol,
+                   double timeout,
+                   const struct timespec *start) {
+    double complex H[SETTLE_BLOCKS];
+    double complex H_last = 0;
+    struct timespec now;
+    double elapsed;
+    int b, captures = 0, settled;
+
+    do {
+        if (acquire_data(s, size) < 0 ||
+            block_response(s, size, w_out, f, H) < 0) {
+            return -1;
+        }
+        settled = captures > 0 && cabs(H[0] - H_last) <= tol * cabs(H[0]);
+        for (b = 1; b < SETTLE_BLOCKS; b++)
+            settled = settled && cabs(H[b] - H[b - 1]) <= tol * cabs(H[b]);
+        H_last = H[SETTLE_BLOCKS - 1];
+        captures++;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+        if (!settled && captures >= 2 && elapsed > timeout) {
+            fprintf(stderr, "Not settled at %.2f Hz after %.3f s\n", w_out / (2 * M_PI), elapsed);
+            break;
+        }
+    } while (!settled);
+
+    return elapsed;
+}
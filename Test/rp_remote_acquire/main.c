@@ -72,6 +72,8 @@ static option_fields_t g_options =
 	.scope_hv = 0,
 	.scope_shaping = 1,
 	.use_rpad = 0,
+	.direct = 0,
+	.write_behind = 0,
 	.bitstream = NULL,
 };
 
@@ -55,6 +55,8 @@ static struct option g_long_options[] =
 	{"scope-no-equalizer", no_argument,       NULL, 'e'},
 	{"scope-no-shaping",   no_argument,       NULL, 's'},
 	{"use-rpad",           no_argument,       NULL, 'x'},
+	{"direct",             no_argument,       NULL, 'z'},
+	{"write-behind",       required_argument, NULL, 'w'},
 	{"load-bitstream",     optional_argument, NULL, 'l'},
 	{NULL, 0, NULL, 0}
 };
@@ -70,7 +72,7 @@ int handle_options(int argc, char *argv[], option_fields_t *options)
 	if (argc <= 1)
 		return -1;
 
-	while ((ch = getopt_long(argc, argv, "a:p:q:m:uk:f:g:rhc:d:esxl::", g_long_options, NULL)) != -1)
+	while ((ch = getopt_long(argc, argv, "a:p:q:m:uk:f:g:rhc:d:esxzw:l::", g_long_options, NULL)) != -1)
 	{
 		// check to see if a single character or long option came through
 		switch (ch)
@@ -138,6 +140,12 @@ int handle_options(int argc, char *argv[], option_fields_t *options)
 		case 'x': // use rpad kernel module
 			options->use_rpad = 1;
 			break;
+		case 'z': // send directly from the scope buffer
+			options->direct = 1;
+			break;
+		case 'w': // O_DIRECT file sink with write-behind queue depth
+			options->write_behind = atoi(optarg);
+			break;
 		case 'l': // load ddrdump bitstream
 			if (optarg != NULL && strlen(optarg) > 0)
 				options->bitstream = optarg;
@@ -180,12 +188,27 @@ int check_options(option_fields_t *options)
 		return 1;
 	}
 
+	if (options->direct && options->scope_chn == 2) {
+		fprintf(stderr,"Direct sending is only supported for a single channel\n");
+		return 1;
+	}
+
+	if (options->write_behind < 0 || options->write_behind > 64) {
+		fprintf(stderr,"Write-behind depth must be 0..64 blocks\n");
+		return 1;
+	}
+
+	if (options->write_behind && (options->mode != file || options->scope_chn == 2)) {
+		fprintf(stderr,"Write-behind requires file mode and a single channel\n");
+		return 1;
+	}
+
 	return 0;
 }
 
 void usage(const char *name)
 {
-	printf("Usage: \033[1m%s [-mapqukfgrhcdes]\033[0m\n", name);
+	printf("Usage: \033[1m%s [-mapqukfgrhcdesxzwl]\033[0m\n", name);
 	printf("\033[1m-m  --mode <(1|client)|(2|server)|(3|file)>\033[0m\n"
 	       "\toperating mode (default client)\n"
 	       "\033[1m-a  --address <ip_address>\033[0m\n"
@@ -219,6 +242,15 @@ void usage(const char *name)
 		   "\033[1m-x  --use-rpad\033[0m\n"
 		   "\tuse rpad kernel module for scope access (default use /dev/mem and\n"
 		   "\tassume that the top 32MB of RAM are reserved for the scope)\n"
+		   "\033[1m-z  --direct\033[0m\n"
+		   "\tsend large spans straight from the scope buffer with sendmsg/writev\n"
+		   "\tinstead of copying 32kB chunks to a temporary buffer, sleep while no\n"
+		   "\tdata is ready and with -r report the sustained rate every second\n"
+		   "\t(single channel only, default off)\n"
+		   "\033[1m-w  --write-behind <depth>\033[0m\n"
+		   "\tin file mode stage samples in <depth> aligned 1MB blocks and write\n"
+		   "\tthem with O_DIRECT from a separate thread, bypassing the page cache\n"
+		   "\t(single channel only, 1..64, default 0 = off)\n"
 		   "\033[1m-l  --load-bitstream [<bitstream>]\033[0m\n"
 		   "\tload specified bitstream into the FPGA during startup (default do\n"
 		   "\tnothing, default filename ./ddrdump.bit)\n"
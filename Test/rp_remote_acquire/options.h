@@ -53,6 +53,8 @@ struct option_fields_
 	int scope_equalizer;
 	int scope_shaping;
 	int use_rpad;
+	int direct;
+	int write_behind;
 	char *bitstream;
 };
 typedef struct option_fields_ option_fields_t;
@@ -27,6 +27,7 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE /* O_DIRECT */
 #include <stddef.h>
 #include <stdio.h>
 #include <sys/socket.h>
@@ -55,6 +56,8 @@
  ******************************************************************************/
 #define BLOCK_SIZE  16384
 #define BUFFER_SIZE 16 * BLOCK_SIZE
+#define WB_BLOCK_SIZE (1024 * 1024)
+#define WB_ALIGN      4096
 
 #define min(x, y) (((x) < (y)) ? (x) : (y))
 /* note: the circular buffer macros may evaluate each of their arguments once, more
@@ -124,6 +127,25 @@ struct queue {
 	FILE            *file_fd;
 };
 
+/*
+ * write-behind file sink. the acquisition loop fills the WB_BLOCK_SIZE blocks of
+ * a page aligned (cacheable) staging ring, the writer thread writes every full
+ * block with O_DIRECT. filled and written count blocks since the start, their
+ * difference is the number of blocks queued for the writer.
+ */
+struct wb_sink {
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+	pthread_t       writer;
+	int             fd;
+	unsigned int    depth;
+	uint8_t         *buf;
+	unsigned int    filled;
+	unsigned int    written;
+	int             stop;
+	int             error;
+};
+
 /******************************************************************************
  * static function prototypes
  ******************************************************************************/
@@ -136,12 +158,23 @@ static u_int64_t transfer_readwrite(struct scope_parameter *param,
 static u_int64_t transfer_buf_mmap(struct scope_parameter *param,
                                    option_fields_t *options,
                                    struct handles *handles);
+static u_int64_t transfer_buf_mmap_direct(struct scope_parameter *param,
+                                          option_fields_t *options,
+                                          struct handles *handles);
+static u_int64_t transfer_buf_mmap_wb(struct scope_parameter *param,
+                                      option_fields_t *options,
+                                      struct handles *handles);
 static u_int64_t transfer_buf_mmap_dual(struct scope_parameter *param,
                                         option_fields_t *options,
                                         struct queue *a, struct queue *b);
 static void *send_worker(void *data);
+static void *wb_writer(void *data);
+static int write_full(int fd, const uint8_t *buf, size_t len);
+static void report_sustained(struct timeval *last_report, u_int64_t *reported,
+                             u_int64_t transferred);
 static int send_buffer(int sock_fd, option_fields_t *options, const char *buf,
                        size_t len);
+static int send_iov(struct handles *handles, struct iovec *iov, int iovcnt);
 
 /******************************************************************************
  * static variables
@@ -375,6 +408,10 @@ int transfer_data(struct scope_parameter *param, option_fields_t *options, struc
 		transferred = transfer_readwrite(param, options, handles);
 	else if (options->scope_chn == 2)
 		transferred = transfer_buf_mmap_dual(param, options, &queue_a, &queue_b);
+	else if (options->write_behind)
+		transferred = transfer_buf_mmap_wb(param, options, handles);
+	else if (options->direct)
+		transferred = transfer_buf_mmap_direct(param, options, handles);
 	else
 		transferred = transfer_buf_mmap(param, options, handles);
 
@@ -575,6 +612,235 @@ static u_int64_t transfer_buf_mmap(struct scope_parameter *param,
 	return transferred;
 }
 
+/*
+ * transfers samples to socket or file straight from the mmap'ed scope buffer.
+ * everything between the last sent position and the current dma pointer (up to
+ * max_span bytes) is handed to the kernel in a single sendmsg()/writev() call, a
+ * span crossing the end of the scope buffer is passed as two iovecs. while no
+ * data is ready the loop sleeps, doubling the sleep time up to IDLE_MAX_US.
+ */
+static u_int64_t transfer_buf_mmap_direct(struct scope_parameter *param,
+                                          option_fields_t *options,
+                                          struct handles *handles)
+{
+	const size_t MAX_SPAN = 512 * 1024;
+	const size_t UDP_SPAN = 8 * 4096; /* one datagram, as in transfer_buf_mmap */
+	const unsigned int IDLE_MIN_US = 10;
+	const unsigned int IDLE_MAX_US = 1000;
+	u_int64_t transferred = 0ULL;
+	u_int64_t reported = 0ULL;
+	u_int64_t size = 1024ULL * options->kbytes_to_transfer;
+	unsigned long pos;
+	size_t len;
+	size_t max_span;
+	unsigned long curr;
+	unsigned long *curr_addr;
+	unsigned long base;
+	void *mapped_base;
+	size_t buf_size;
+	unsigned int idle_us = IDLE_MIN_US;
+	struct iovec iov[2];
+	int iovcnt;
+	struct timeval last_report;
+	int report_rate = options->report_rate;
+
+	curr_addr = param->mapped_io + (options->scope_chn ? 0x118 : 0x114);
+	base = *(unsigned long *)(param->mapped_io +
+	                          (options->scope_chn ? 0x10c : 0x104));
+	mapped_base = options->scope_chn ? param->mapped_buf_b
+	                                 : param->mapped_buf_a;
+	buf_size = options->scope_chn ? param->buf_b_size : param->buf_a_size;
+
+	max_span = (handles->sock >= 0 && !options->tcp) ? UDP_SPAN : MAX_SPAN;
+	/* stay well behind the dma writer */
+	max_span = min(max_span, buf_size / 4);
+
+	if (report_rate && gettimeofday(&last_report, NULL))
+		report_rate = 0;
+
+	pos = 0;
+	while (!interrupted && (!size || transferred < size)) {
+		curr = *curr_addr - base;
+
+		len = CIRCULAR_DIST(pos, curr, buf_size);
+		if (len == 0) {
+			usleep(idle_us);
+			if (idle_us < IDLE_MAX_US)
+				idle_us = min(2 * idle_us, IDLE_MAX_US);
+			continue;
+		}
+		idle_us = IDLE_MIN_US;
+
+		len = min(len, max_span);
+		if (size)
+			len = min(len, size - transferred);
+
+		iov[0].iov_base = mapped_base + pos;
+		if (pos + len <= buf_size) {
+			iov[0].iov_len = len;
+			iovcnt = 1;
+		} else {
+			iov[0].iov_len = buf_size - pos;
+			iov[1].iov_base = mapped_base;
+			iov[1].iov_len = len - iov[0].iov_len;
+			iovcnt = 2;
+		}
+
+		if (send_iov(handles, iov, iovcnt) < 0) {
+			if (!interrupted)
+				fprintf(stderr, "%s write failed, %s\n",
+				        handles->sock >= 0 ? "socket" : "file",
+				        strerror(errno));
+			break;
+		}
+
+		pos = CIRCULAR_ADD(pos, len, buf_size);
+		transferred += len;
+
+		if (report_rate)
+			report_sustained(&last_report, &reported, transferred);
+	}
+
+	return transferred;
+}
+
+/*
+ * transfers samples to file via the write-behind sink. samples are copied from
+ * the non-cacheable mmap'ed scope buffer into the staging ring, full blocks are
+ * written by wb_writer() with O_DIRECT while the next ones are being filled, so
+ * the file data does not pass through the page cache. the last, partial block
+ * is written through the page cache after O_DIRECT has been switched off again.
+ */
+static u_int64_t transfer_buf_mmap_wb(struct scope_parameter *param,
+                                      option_fields_t *options,
+                                      struct handles *handles)
+{
+	const unsigned int IDLE_MIN_US = 10;
+	const unsigned int IDLE_MAX_US = 1000;
+	u_int64_t transferred = 0ULL;
+	u_int64_t reported = 0ULL;
+	u_int64_t size = 1024ULL * options->kbytes_to_transfer;
+	unsigned long pos;
+	size_t len;
+	size_t fill = 0;
+	unsigned long curr;
+	unsigned long *curr_addr;
+	unsigned long base;
+	void *mapped_base;
+	size_t buf_size;
+	unsigned int idle_us = IDLE_MIN_US;
+	struct timeval last_report;
+	int report_rate = options->report_rate;
+	struct wb_sink sink = {
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.depth = options->write_behind,
+		.filled = 0,
+		.written = 0,
+		.stop = 0,
+		.error = 0,
+	};
+	int fd_flags;
+	int rc;
+
+	curr_addr = param->mapped_io + (options->scope_chn ? 0x118 : 0x114);
+	base = *(unsigned long *)(param->mapped_io +
+	                          (options->scope_chn ? 0x10c : 0x104));
+	mapped_base = options->scope_chn ? param->mapped_buf_b
+	                                 : param->mapped_buf_a;
+	buf_size = options->scope_chn ? param->buf_b_size : param->buf_a_size;
+
+	rc = posix_memalign((void **)&sink.buf, WB_ALIGN, sink.depth * WB_BLOCK_SIZE);
+	if (rc) {
+		fprintf(stderr, "no memory for write-behind buffer, %s\n", strerror(rc));
+		return 0ULL;
+	}
+
+	fflush(handles->file);
+	sink.fd = fileno(handles->file);
+	fd_flags = fcntl(sink.fd, F_GETFL);
+	if (fd_flags < 0 || fcntl(sink.fd, F_SETFL, fd_flags | O_DIRECT) < 0)
+		fprintf(stderr, "O_DIRECT not available (non-fatal), %s\n", strerror(errno));
+
+	rc = pthread_create(&sink.writer, NULL, wb_writer, &sink);
+	if (rc != 0) {
+		fprintf(stderr, "start writer failed, %s\n", strerror(rc));
+		goto out_free;
+	}
+
+	if (report_rate && gettimeofday(&last_report, NULL))
+		report_rate = 0;
+
+	pos = 0;
+	while (!interrupted && (!size || transferred < size)) {
+		curr = *curr_addr - base;
+
+		len = CIRCULAR_DIST(pos, curr, buf_size);
+		if (len == 0) {
+			usleep(idle_us);
+			if (idle_us < IDLE_MAX_US)
+				idle_us = min(2 * idle_us, IDLE_MAX_US);
+			continue;
+		}
+		idle_us = IDLE_MIN_US;
+
+		len = min(len, WB_BLOCK_SIZE - fill);
+		if (size)
+			len = min(len, size - transferred);
+
+		/* starting a new block - wait until the writer has freed one */
+		if (fill == 0) {
+			pthread_mutex_lock(&sink.mutex);
+			while (sink.filled - sink.written == sink.depth && !sink.error)
+				pthread_cond_wait(&sink.cond, &sink.mutex);
+			rc = sink.error;
+			pthread_mutex_unlock(&sink.mutex);
+			if (rc)
+				break;
+		}
+
+		/* only this thread advances sink.filled */
+		CIRCULARSRC_MEMCPY(sink.buf + (sink.filled % sink.depth) * WB_BLOCK_SIZE + fill,
+		                   mapped_base, pos, buf_size, len);
+		pos = CIRCULAR_ADD(pos, len, buf_size);
+		fill += len;
+		transferred += len;
+
+		if (fill == WB_BLOCK_SIZE) {
+			pthread_mutex_lock(&sink.mutex);
+			sink.filled++;
+			pthread_cond_broadcast(&sink.cond);
+			pthread_mutex_unlock(&sink.mutex);
+			fill = 0;
+		}
+
+		if (report_rate)
+			report_sustained(&last_report, &reported, transferred);
+	}
+
+	/* let the writer drain the queued blocks and stop */
+	pthread_mutex_lock(&sink.mutex);
+	sink.stop = 1;
+	pthread_cond_broadcast(&sink.cond);
+	pthread_mutex_unlock(&sink.mutex);
+	pthread_join(sink.writer, NULL);
+
+	if (sink.error)
+		fprintf(stderr, "file write failed, %s\n", strerror(sink.error));
+
+	/* O_DIRECT needs block sized writes - finish through the page cache */
+	if (fd_flags >= 0)
+		fcntl(sink.fd, F_SETFL, fd_flags);
+	if (fill && !sink.error &&
+	    write_full(sink.fd, sink.buf + (sink.filled % sink.depth) * WB_BLOCK_SIZE, fill) < 0)
+		fprintf(stderr, "file write failed, %s\n", strerror(errno));
+
+out_free:
+	free(sink.buf);
+
+	return transferred;
+}
+
 /*
  * reads samples from dma ram and puts them on the channel queues if enough free
  * space is available on the queue (measured by the difference between
@@ -730,3 +996,124 @@ static int send_buffer(int sock_fd, option_fields_t *options, const char *buf, s
 
 	return retval;
 }
+
+/*
+ * writes the complete iovec array to the socket (sendmsg) or to the file
+ * (writev on the underlying descriptor, the FILE is not used for buffering in
+ * this mode). partial writes advance the iovecs and are retried.
+ */
+static int send_iov(struct handles *handles, struct iovec *iov, int iovcnt)
+{
+	struct msghdr msg;
+	ssize_t sent;
+
+	while (iovcnt > 0) {
+		if (handles->sock >= 0) {
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = iovcnt;
+			sent = sendmsg(handles->sock, &msg, MSG_NOSIGNAL);
+		} else {
+			sent = writev(fileno(handles->file), iov, iovcnt);
+		}
+		if (interrupted)
+			return -1;
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		while (iovcnt > 0 && (size_t)sent >= iov->iov_len) {
+			sent -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base += sent;
+			iov->iov_len -= sent;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * writes the full blocks queued on a struct wb_sink. on stop the remaining
+ * queued blocks are written before the thread exits, on a write error the
+ * error is recorded and the acquisition loop is woken up.
+ */
+static void *wb_writer(void *data)
+{
+	struct wb_sink *s = (struct wb_sink *)data;
+	unsigned int idx;
+	int rc;
+
+	pthread_mutex_lock(&s->mutex);
+	while (1) {
+		while (s->written == s->filled && !s->stop)
+			pthread_cond_wait(&s->cond, &s->mutex);
+		if (s->written == s->filled)
+			break;
+		idx = s->written % s->depth;
+		pthread_mutex_unlock(&s->mutex);
+
+		rc = write_full(s->fd, s->buf + idx * WB_BLOCK_SIZE, WB_BLOCK_SIZE);
+
+		pthread_mutex_lock(&s->mutex);
+		if (rc < 0) {
+			s->error = errno;
+			pthread_cond_broadcast(&s->cond);
+			break;
+		}
+		s->written++;
+		pthread_cond_broadcast(&s->cond);
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	return NULL;
+}
+
+static int write_full(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, buf, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+/*
+ * prints the rate since the last report once a second has passed
+ */
+static void report_sustained(struct timeval *last_report, u_int64_t *reported,
+                             u_int64_t transferred)
+{
+	struct timeval now;
+	unsigned long elapsed;
+
+	if (gettimeofday(&now, NULL))
+		return;
+
+	elapsed = 1000UL * (now.tv_sec - last_report->tv_sec)
+	        + (unsigned long)now.tv_usec / 1000UL
+	        - (unsigned long)last_report->tv_usec / 1000UL;
+	if (elapsed < 1000UL)
+		return;
+
+	printf("sustained %.2fMB/s\n",
+	       (double)(1000ULL * (transferred - *reported)) /
+	       (1024ULL * 1024ULL * elapsed));
+	fflush(stdout);
+	*reported = transferred;
+	*last_report = now;
+}
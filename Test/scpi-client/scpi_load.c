@@ -0,0 +1,555 @@
+/**
+ * $Id: $
+ *
+ * @brief SCPI server load generator. Drives a mix of commands over several
+ *        connections and reports the latency percentiles and throughput.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Every connection runs in its own thread and sends one operation at a
+ * time, picked at random by the weights of the mix, and waits for its
+ * complete answer. Commands without an answer are followed by *OPC?, so
+ * the latency covers their execution too. Operations:
+ *
+ *   set     SOUR1:FREQ:FIX and SOUR1:VOLT                  + *OPC?
+ *   ascii   ACQ:SOUR1:DATA? in ASCII
+ *   bin     ACQ:SOUR1:DATA? in BIN, a definite length block
+ *   arb     SOUR1:TRAC:DATA:DATA with 16384 floats as text + *OPC?
+ *   arbraw  SOUR1:TRAC:DATA:RAW with a 32768 byte block    + *OPC?
+ *
+ * The report lists per operation the count, errors, latency percentiles in
+ * microseconds and MB/s of the bytes sent and received. -j prints one JSON
+ * object per line instead.
+ */
+
+#define DEFAULT_PORT        5000
+#define DEFAULT_CONNECTIONS 1
+#define DEFAULT_DURATION    10
+#define RECV_TIMEOUT_S      10
+#define ARB_LENGTH          16384
+#define READ_CHUNK          65536
+
+enum {
+    OP_SET,
+    OP_ASCII,
+    OP_BIN,
+    OP_ARB,
+    OP_ARBRAW,
+    OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = { "set", "ascii", "bin", "arb", "arbraw" };
+
+typedef struct {
+    uint64_t *latency_ns;
+    size_t    count;
+    size_t    capacity;
+    uint64_t  errors;
+    uint64_t  bytes;
+} op_stats_t;
+
+typedef struct {
+    int        index;
+    int        fd;
+    unsigned   seed;
+    char      *rx;       // Buffered receive data, rx_pos to rx_len not consumed yet
+    size_t     rx_len;
+    size_t     rx_pos;
+    op_stats_t stats[OP_COUNT];
+} worker_t;
+
+static struct sockaddr_in server;
+static int       weights[OP_COUNT] = { 4, 1, 4, 1, 0 };
+static int       weight_sum;
+static double    duration = DEFAULT_DURATION;
+static uint64_t  requests;   // Per connection, 0 runs for the duration
+static uint64_t  deadline_ns;
+
+static char     *arb_text;
+static size_t    arb_text_len;
+static char     *arb_raw;
+static size_t    arb_raw_len;
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmpU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool sendAll(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool sendStr(int fd, const char *str)
+{
+    return sendAll(fd, str, strlen(str));
+}
+
+static bool fill(worker_t *w)
+{
+    if (w->rx_pos == w->rx_len) {
+        w->rx_pos = w->rx_len = 0;
+    }
+    ssize_t n = recv(w->fd, w->rx + w->rx_len, READ_CHUNK - w->rx_len, 0);
+    if (n <= 0) {
+        return false;
+    }
+    w->rx_len += n;
+    return true;
+}
+
+/**
+ * Consumes received data up to and including the next '\n'. Returns the
+ * number of bytes consumed, 0 on an error.
+ */
+static size_t readLine(worker_t *w, char *line, size_t size)
+{
+    size_t total = 0;
+    for (;;) {
+        while (w->rx_pos < w->rx_len) {
+            char c = w->rx[w->rx_pos++];
+            if (line != NULL && total + 1 < size) {
+                line[total] = c;
+                line[total + 1] = 0;
+            }
+            total++;
+            if (c == '\n') {
+                return total;
+            }
+        }
+        if (!fill(w)) {
+            return 0;
+        }
+    }
+}
+
+static bool readBytes(worker_t *w, size_t len)
+{
+    while (len > 0) {
+        if (w->rx_pos == w->rx_len && !fill(w)) {
+            return false;
+        }
+        size_t n = w->rx_len - w->rx_pos;
+        if (n > len) {
+            n = len;
+        }
+        w->rx_pos += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool readByte(worker_t *w, char *c)
+{
+    if (w->rx_pos == w->rx_len && !fill(w)) {
+        return false;
+    }
+    *c = w->rx[w->rx_pos++];
+    return true;
+}
+
+/**
+ * Reads a #<n><length><data> block and the line end after it. Returns the
+ * bytes consumed, 0 on an error.
+ */
+static size_t readBlock(worker_t *w)
+{
+    char c;
+    if (!readByte(w, &c) || c != '#' || !readByte(w, &c) || c < '1' || c > '9') {
+        return 0;
+    }
+    int digits = c - '0';
+    size_t len = 0;
+    for (int i = 0; i < digits; ++i) {
+        if (!readByte(w, &c) || c < '0' || c > '9') {
+            return 0;
+        }
+        len = len * 10 + (c - '0');
+    }
+    if (!readBytes(w, len)) {
+        return 0;
+    }
+    size_t tail = readLine(w, NULL, 0);
+    if (tail == 0) {
+        return 0;
+    }
+    return 2 + digits + len + tail;
+}
+
+static bool readOpc(worker_t *w, uint64_t *bytes)
+{
+    char line[16];
+    size_t n = readLine(w, line, sizeof(line));
+    *bytes += n;
+    return n > 0 && line[0] == '1';
+}
+
+/**
+ * Runs one operation. Returns false on a connection or protocol error,
+ * bytes is what went over the socket in both directions.
+ */
+static bool runOp(worker_t *w, int op, uint64_t *bytes)
+{
+    char cmd[128];
+    size_t n;
+    *bytes = 0;
+    switch (op) {
+        case OP_SET:
+            snprintf(cmd, sizeof(cmd), "SOUR1:FREQ:FIX %d\r\nSOUR1:VOLT %.3f\r\n*OPC?\r\n",
+                     1000 + (int)(rand_r(&w->seed) % 1000), 0.1 + (rand_r(&w->seed) % 800) / 1000.0);
+            *bytes += strlen(cmd);
+            return sendStr(w->fd, cmd) && readOpc(w, bytes);
+
+        case OP_ASCII:
+            strcpy(cmd, "ACQ:DATA:FORMAT ASCII\r\nACQ:SOUR1:DATA?\r\n");
+            *bytes += strlen(cmd);
+            if (!sendStr(w->fd, cmd)) {
+                return false;
+            }
+            n = readLine(w, NULL, 0);
+            *bytes += n;
+            return n > 0;
+
+        case OP_BIN:
+            strcpy(cmd, "ACQ:DATA:FORMAT BIN\r\nACQ:SOUR1:DATA?\r\n");
+            *bytes += strlen(cmd);
+            if (!sendStr(w->fd, cmd)) {
+                return false;
+            }
+            n = readBlock(w);
+            *bytes += n;
+            return n > 0;
+
+        case OP_ARB:
+            *bytes += arb_text_len;
+            return sendAll(w->fd, arb_text, arb_text_len) && readOpc(w, bytes);
+
+        case OP_ARBRAW:
+            *bytes += arb_raw_len;
+            return sendAll(w->fd, arb_raw, arb_raw_len) && readOpc(w, bytes);
+    }
+    return false;
+}
+
+static void record(op_stats_t *s, uint64_t latency, uint64_t bytes)
+{
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity ? s->capacity * 2 : 1024;
+        uint64_t *p = realloc(s->latency_ns, capacity * sizeof(uint64_t));
+        if (p == NULL) {
+            return;
+        }
+        s->latency_ns = p;
+        s->capacity = capacity;
+    }
+    s->latency_ns[s->count++] = latency;
+    s->bytes += bytes;
+}
+
+static int pickOp(worker_t *w)
+{
+    int r = rand_r(&w->seed) % weight_sum;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (r < weights[op]) {
+            return op;
+        }
+        r -= weights[op];
+    }
+    return OP_SET;
+}
+
+static int connectServer()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval tv = { .tv_sec = RECV_TIMEOUT_S, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *workerThread(void *arg)
+{
+    worker_t *w = arg;
+    uint64_t done = 0;
+    while (requests ? done < requests : nowNs() < deadline_ns) {
+        int op = pickOp(w);
+        uint64_t bytes;
+        uint64_t start = nowNs();
+        bool ok = runOp(w, op, &bytes);
+        uint64_t latency = nowNs() - start;
+        done++;
+        if (!ok) {
+            // The stream is out of step after an error, start over on a new connection
+            w->stats[op].errors++;
+            close(w->fd);
+            w->rx_pos = w->rx_len = 0;
+            w->fd = connectServer();
+            if (w->fd < 0) {
+                fprintf(stderr, "Connection %d: reconnect failed\n", w->index);
+                break;
+            }
+            continue;
+        }
+        record(&w->stats[op], latency, bytes);
+    }
+    return NULL;
+}
+
+static double percentileUs(const uint64_t *sorted, size_t count, double p)
+{
+    if (count == 0) {
+        return 0;
+    }
+    size_t i = (size_t)(p * (count - 1) + 0.5);
+    return sorted[i] / 1000.0;
+}
+
+static void report(const char *name, op_stats_t *s, double seconds, int connections, bool json)
+{
+    qsort(s->latency_ns, s->count, sizeof(uint64_t), cmpU64);
+    double sum = 0;
+    for (size_t i = 0; i < s->count; ++i) {
+        sum += s->latency_ns[i];
+    }
+    double mean = s->count ? sum / s->count / 1000.0 : 0;
+    double mbps = s->bytes / seconds / 1e6;
+    double rate = s->count / seconds;
+    double p50 = percentileUs(s->latency_ns, s->count, 0.50);
+    double p90 = percentileUs(s->latency_ns, s->count, 0.90);
+    double p99 = percentileUs(s->latency_ns, s->count, 0.99);
+    double max = s->count ? s->latency_ns[s->count - 1] / 1000.0 : 0;
+    if (json) {
+        printf("{\"op\":\"%s\",\"connections\":%d,\"count\":%zu,\"errors\":%llu,\"ops_per_s\":%.1f,"
+               "\"mean_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,\"mb_per_s\":%.3f}\n",
+               name, connections, s->count, (unsigned long long)s->errors, rate, mean, p50, p90, p99, max, mbps);
+    } else {
+        printf("%-7s %9zu %7llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %9.3f\n",
+               name, s->count, (unsigned long long)s->errors, rate, mean, p50, p90, p99, max, mbps);
+    }
+}
+
+static void buildArbCommands()
+{
+    // SOUR1:TRAC:DATA:DATA v0,v1,...\r\n*OPC?\r\n
+    arb_text = malloc(64 + ARB_LENGTH * 10);
+    size_t len = sprintf(arb_text, "SOUR1:TRAC:DATA:DATA ");
+    for (int i = 0; i < ARB_LENGTH; ++i) {
+        len += sprintf(arb_text + len, i ? ",%.4f" : "%.4f", sin(2 * M_PI * i / ARB_LENGTH));
+    }
+    len += sprintf(arb_text + len, "\r\n*OPC?\r\n");
+    arb_text_len = len;
+
+    // SOUR1:TRAC:DATA:RAW #532768<bytes>\r\n*OPC?\r\n
+    size_t block = ARB_LENGTH * sizeof(int16_t);
+    arb_raw = malloc(64 + block);
+    len = sprintf(arb_raw, "SOUR1:TRAC:DATA:RAW #%d%zu", (int)snprintf(NULL, 0, "%zu", block), block);
+    for (int i = 0; i < ARB_LENGTH; ++i) {
+        int16_t v = (int16_t)(4000 * sin(2 * M_PI * i / ARB_LENGTH));
+        memcpy(arb_raw + len + i * sizeof(int16_t), &v, sizeof(v));
+    }
+    len += block;
+    len += sprintf(arb_raw + len, "\r\n*OPC?\r\n");
+    arb_raw_len = len;
+}
+
+static bool parseMix(char *mix)
+{
+    for (int op = 0; op < OP_COUNT; ++op) {
+        weights[op] = 0;
+    }
+    for (char *tok = strtok(mix, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        if (eq == NULL) {
+            return false;
+        }
+        *eq = 0;
+        int op;
+        for (op = 0; op < OP_COUNT; ++op) {
+            if (strcmp(tok, op_names[op]) == 0) {
+                break;
+            }
+        }
+        if (op == OP_COUNT) {
+            return false;
+        }
+        weights[op] = atoi(eq + 1);
+    }
+    return true;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <ip of server>\n"
+        "\n"
+        "  -p port     Server port (default %d)\n"
+        "  -c number   Concurrent connections (default %d)\n"
+        "  -t seconds  Run time (default %d)\n"
+        "  -n number   Operations per connection instead of a run time\n"
+        "  -m mix      Weights of the operations, e.g. set=4,ascii=1,bin=4,arb=1,arbraw=0\n"
+        "  -j          One JSON object per operation instead of the table\n",
+        prog, DEFAULT_PORT, DEFAULT_CONNECTIONS, DEFAULT_DURATION);
+}
+
+int main(int argc, char *argv[])
+{
+    int port = DEFAULT_PORT;
+    int connections = DEFAULT_CONNECTIONS;
+    bool json = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:t:n:m:jh")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'c': connections = atoi(optarg); break;
+            case 't': duration = atof(optarg); break;
+            case 'n': requests = strtoull(optarg, NULL, 10); break;
+            case 'm':
+                if (!parseMix(optarg)) {
+                    fprintf(stderr, "Invalid mix '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'j': json = true; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    weight_sum = 0;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        weight_sum += weights[op] > 0 ? weights[op] : 0;
+    }
+    if (optind != argc - 1 || connections < 1 || weight_sum == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    if (inet_pton(AF_INET, argv[optind], &server.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid server address %s\n", argv[optind]);
+        return 1;
+    }
+
+    buildArbCommands();
+
+    worker_t *workers = calloc(connections, sizeof(worker_t));
+    for (int i = 0; i < connections; ++i) {
+        workers[i].index = i;
+        workers[i].seed = 12345 + i;
+        workers[i].rx = malloc(READ_CHUNK);
+        workers[i].fd = connectServer();
+        if (workers[i].fd < 0) {
+            fprintf(stderr, "Connection %d failed: %s\n", i, strerror(errno));
+            return 1;
+        }
+    }
+
+    // The data queries read whatever is in the buffer, a running acquisition is enough
+    worker_t *first = &workers[0];
+    uint64_t bytes = 0;
+    if (!sendStr(first->fd, "ACQ:RST\r\nACQ:DEC 64\r\nACQ:START\r\nACQ:TRIG NOW\r\n*OPC?\r\n") || !readOpc(first, &bytes)) {
+        fprintf(stderr, "Setup of the acquisition failed\n");
+        return 1;
+    }
+
+    pthread_t *threads = calloc(connections, sizeof(pthread_t));
+    uint64_t start = nowNs();
+    deadline_ns = start + (uint64_t)(duration * 1e9);
+    for (int i = 0; i < connections; ++i) {
+        pthread_create(&threads[i], NULL, workerThread, &workers[i]);
+    }
+    for (int i = 0; i < connections; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+
+    // Merge the connections per operation, then all operations
+    op_stats_t total = { 0 };
+    if (!json) {
+        printf("%d connections, %.1f s\n", connections, seconds);
+        printf("%-7s %9s %7s %10s %10s %10s %10s %10s %10s %9s\n",
+               "op", "count", "errors", "ops/s", "mean us", "p50 us", "p90 us", "p99 us", "max us", "MB/s");
+    }
+    for (int op = 0; op < OP_COUNT; ++op) {
+        op_stats_t merged = { 0 };
+        for (int i = 0; i < connections; ++i) {
+            op_stats_t *s = &workers[i].stats[op];
+            for (size_t k = 0; k < s->count; ++k) {
+                record(&merged, s->latency_ns[k], 0);
+                record(&total, s->latency_ns[k], 0);
+            }
+            merged.bytes += s->bytes;
+            merged.errors += s->errors;
+            total.bytes += s->bytes;
+            total.errors += s->errors;
+        }
+        if (weights[op] > 0) {
+            report(op_names[op], &merged, seconds, connections, json);
+        }
+        free(merged.latency_ns);
+    }
+    report("all", &total, seconds, connections, json);
+
+    for (int i = 0; i < connections; ++i) {
+        close(workers[i].fd);
+    }
+    return total.errors ? 2 : 0;
+}
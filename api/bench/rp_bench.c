@@ -0,0 +1,349 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library librp microbenchmarks.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "redpitaya/rp.h"
+#include "redpitaya/rp_dsp.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Times the hot paths of librp on the board: the ADC readouts, the delay
+ * from a trigger to its data in user memory, the arbitrary waveform upload,
+ * single register accesses, the amplitude FFT and the sine fit. Every
+ * benchmark runs a few untimed warm up iterations, then times each
+ * iteration on its own.
+ *
+ * One JSON object per line goes to stdout, so results of different boards
+ * and builds can be collected and compared by scripts:
+ *
+ *   {"model":"Z10","bench":"acq_get_data_raw","samples":16384,"batch":1,
+ *    "iterations":200,"min_ns":..,"median_ns":..,"mean_ns":..,"p99_ns":..,
+ *    "ns_per_sample":..}
+ *
+ * The times are per call. ns_per_sample is the median divided by the
+ * samples a call handles, both channels count for the two channel calls.
+ */
+
+#ifndef RP_MODEL
+#define RP_MODEL "unknown"
+#endif
+
+#define WARMUP_ITERATIONS   5
+#define DEFAULT_ITERATIONS  200
+// Register calls are timed in batches, a single one is close to the clock resolution
+#define REG_BATCH           1000
+#define LATENCY_SAMPLES     1024
+#define TRIGGER_TIMEOUT_MS  1000
+
+static int16_t  raw1[ADC_BUFFER_SIZE];
+static float    volts1[ADC_BUFFER_SIZE];
+static float    volts2[ADC_BUFFER_SIZE];
+static float    wave[ADC_BUFFER_SIZE];
+static double   fft_in[ADC_BUFFER_SIZE];
+static double   fft_out[ADC_BUFFER_SIZE / 2];
+static double   fft_out2[ADC_BUFFER_SIZE / 2];
+
+static uint32_t read_size = ADC_BUFFER_SIZE;
+static int      fft_len = ADC_BUFFER_SIZE;
+static uint32_t led_state;
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmpU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Runs fn batch times per iteration and prints the statistics per call.
+ * A benchmark that has untimed parts sets the time it measured itself in
+ * its argument, otherwise the whole call counts.
+ * Returns the result of the first failing call, RP_OK otherwise.
+ */
+static int measure(const char *name, uint32_t samples, uint32_t batch, int iterations, int (*fn)(uint64_t *))
+{
+    uint64_t *times = malloc(sizeof(uint64_t) * iterations);
+    if (times == NULL) {
+        return RP_EAM;
+    }
+    int status = RP_OK;
+    uint64_t own = 0;
+    for (int i = 0; i < WARMUP_ITERATIONS && status == RP_OK; ++i) {
+        status = fn(&own);
+    }
+    for (int i = 0; i < iterations && status == RP_OK; ++i) {
+        uint64_t own_sum = 0;
+        uint64_t start = nowNs();
+        for (uint32_t b = 0; b < batch && status == RP_OK; ++b) {
+            own = 0;
+            status = fn(&own);
+            own_sum += own;
+        }
+        times[i] = own_sum ? own_sum : nowNs() - start;
+    }
+    if (status != RP_OK) {
+        fprintf(stderr, "%s: failed with %s\n", name, rp_GetError(status));
+        free(times);
+        return status;
+    }
+
+    qsort(times, iterations, sizeof(uint64_t), cmpU64);
+    double sum = 0;
+    for (int i = 0; i < iterations; ++i) {
+        sum += times[i];
+    }
+    double median = (double)times[iterations / 2] / batch;
+    printf("{\"model\":\"%s\",\"bench\":\"%s\",\"samples\":%u,\"batch\":%u,\"iterations\":%d,"
+           "\"min_ns\":%.1f,\"median_ns\":%.1f,\"mean_ns\":%.1f,\"p99_ns\":%.1f,\"ns_per_sample\":%.4f}\n",
+           RP_MODEL, name, samples, batch, iterations,
+           (double)times[0] / batch, median, sum / iterations / batch,
+           (double)times[(iterations * 99) / 100] / batch,
+           samples ? median / samples : 0.0);
+    fflush(stdout);
+    free(times);
+    return RP_OK;
+}
+
+static int benchGetDataRaw(uint64_t *elapsed)
+{
+    uint32_t size = read_size;
+    return rp_AcqGetDataRaw(RP_CH_1, 0, &size, raw1);
+}
+
+static int benchGetDataV(uint64_t *elapsed)
+{
+    uint32_t size = read_size;
+    return rp_AcqGetDataV(RP_CH_1, 0, &size, volts1);
+}
+
+static int benchGetDataV2(uint64_t *elapsed)
+{
+    uint32_t size = read_size;
+    return rp_AcqGetDataV2(0, &size, volts1, volts2);
+}
+
+/**
+ * From arming the software trigger until LATENCY_SAMPLES around it are
+ * converted. The trigger delay keeps the post trigger part short, so the
+ * time is dominated by the trigger path and not by filling the buffer.
+ */
+static int benchTriggerLatency(uint64_t *elapsed)
+{
+    rp_AcqStart();
+    // Untimed, the pre trigger part has to be in memory first
+    usleep(1000);
+    uint64_t start = nowNs();
+    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
+    int status = rp_AcqWaitTrigger(TRIGGER_TIMEOUT_MS);
+    if (status != RP_OK) {
+        return status;
+    }
+    rp_acq_trig_src_t source = RP_TRIG_SRC_NOW;
+    while (rp_AcqGetTriggerSrc(&source) == RP_OK && source != RP_TRIG_SRC_DISABLED) {
+        if (nowNs() - start > (uint64_t)TRIGGER_TIMEOUT_MS * 1000000ULL) {
+            return RP_ETIM;
+        }
+    }
+    uint32_t trig_pos;
+    rp_AcqGetWritePointerAtTrig(&trig_pos);
+    uint32_t size = LATENCY_SAMPLES;
+    status = rp_AcqGetDataRaw(RP_CH_1, trig_pos + ADC_BUFFER_SIZE - LATENCY_SAMPLES / 2, &size, raw1);
+    *elapsed = nowNs() - start;
+    rp_AcqStop();
+    return status;
+}
+
+static int benchGenArbWaveform(uint64_t *elapsed)
+{
+    return rp_GenArbWaveform(RP_CH_1, wave, ADC_BUFFER_SIZE);
+}
+
+static int benchRegRead(uint64_t *elapsed)
+{
+    uint32_t id;
+    return rp_IdGetID(&id);
+}
+
+static int benchRegWrite(uint64_t *elapsed)
+{
+    return rp_LEDSetState(led_state);
+}
+
+static int benchFftAbs(uint64_t *elapsed)
+{
+    return rp_DspFftAbs(fft_len, fft_in, fft_out, fft_len / 2);
+}
+
+static int benchFftAbs2(uint64_t *elapsed)
+{
+    return rp_DspFftAbs2(fft_len, fft_in, fft_in, fft_out, fft_out2, fft_len / 2);
+}
+
+static int benchSineFit(uint64_t *elapsed)
+{
+    rp_dsp_sine_t fit;
+    // wave holds one cycle, the start is 0.2 cycles off so the frequency is corrected
+    return rp_DspSineFit(ADC_BUFFER_SIZE, wave, 1.2 / ADC_BUFFER_SIZE, 8, &fit);
+}
+
+static int benchXcorr(uint64_t *elapsed)
+{
+    rp_dsp_xcorr_t xc;
+    // Length and lags of the scope delay measurement
+    return rp_DspXcorr(ADC_BUFFER_SIZE, wave, wave, ADC_BUFFER_SIZE / 2, &xc);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-n iterations] [-b name]...\n"
+        "\n"
+        "  -n  Timed iterations per benchmark (default %d)\n"
+        "  -b  Runs only the benchmarks whose name contains the text, may be repeated\n"
+        "\n"
+        "Benchmarks: acq_get_data_raw, acq_get_data_v, acq_get_data_v2, acq_trigger_latency,\n"
+        "            gen_arb_waveform, reg_read, reg_write, fft_abs_1024, fft_abs_16384,\n"
+        "            fft_abs2_16384, sine_fit_16384, xcorr_16384\n",
+        prog, DEFAULT_ITERATIONS);
+}
+
+#define MAX_FILTERS 16
+
+static const char *filters[MAX_FILTERS];
+static int filter_count;
+
+static int selected(const char *name)
+{
+    if (filter_count == 0) {
+        return 1;
+    }
+    for (int i = 0; i < filter_count; ++i) {
+        if (strstr(name, filters[i]) != NULL) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'b':
+                if (filter_count < MAX_FILTERS) {
+                    filters[filter_count++] = optarg;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (rp_Init() != RP_OK) {
+        fprintf(stderr, "Red Pitaya API init failed!\n");
+        return 1;
+    }
+
+    for (int i = 0; i < ADC_BUFFER_SIZE; ++i) {
+        wave[i] = sinf(2 * M_PI * i / ADC_BUFFER_SIZE);
+        fft_in[i] = sin(2 * M_PI * 100.5 * i / ADC_BUFFER_SIZE);
+    }
+
+    int failed = 0;
+
+    // The readouts convert whatever is in the buffer, a running acquisition is enough
+    rp_AcqReset();
+    rp_AcqSetDecimation(RP_DEC_1);
+    rp_AcqStart();
+    if (selected("acq_get_data_raw")) {
+        failed |= measure("acq_get_data_raw", read_size, 1, iterations, benchGetDataRaw) != RP_OK;
+    }
+    if (selected("acq_get_data_v")) {
+        failed |= measure("acq_get_data_v", read_size, 1, iterations, benchGetDataV) != RP_OK;
+    }
+    if (selected("acq_get_data_v2")) {
+        failed |= measure("acq_get_data_v2", read_size * 2, 1, iterations, benchGetDataV2) != RP_OK;
+    }
+    rp_AcqStop();
+
+    if (selected("acq_trigger_latency")) {
+        rp_AcqReset();
+        rp_AcqSetDecimation(RP_DEC_1);
+        rp_AcqSetTriggerDelay(LATENCY_SAMPLES / 2 - ADC_BUFFER_SIZE / 2);
+        failed |= measure("acq_trigger_latency", LATENCY_SAMPLES, 1, iterations, benchTriggerLatency) != RP_OK;
+        rp_AcqReset();
+    }
+
+    if (selected("gen_arb_waveform")) {
+        failed |= measure("gen_arb_waveform", ADC_BUFFER_SIZE, 1, iterations, benchGenArbWaveform) != RP_OK;
+        rp_GenReset();
+    }
+
+    if (selected("reg_read")) {
+        failed |= measure("reg_read", 0, REG_BATCH, iterations, benchRegRead) != RP_OK;
+    }
+    if (selected("reg_write")) {
+        // Writes back the current LED state, nothing visible changes
+        rp_LEDGetState(&led_state);
+        failed |= measure("reg_write", 0, REG_BATCH, iterations, benchRegWrite) != RP_OK;
+    }
+
+    if (selected("fft_abs_1024")) {
+        fft_len = 1024;
+        failed |= measure("fft_abs_1024", fft_len, 1, iterations, benchFftAbs) != RP_OK;
+    }
+    if (selected("fft_abs_16384")) {
+        fft_len = ADC_BUFFER_SIZE;
+        failed |= measure("fft_abs_16384", fft_len, 1, iterations, benchFftAbs) != RP_OK;
+    }
+    if (selected("fft_abs2_16384")) {
+        fft_len = ADC_BUFFER_SIZE;
+        failed |= measure("fft_abs2_16384", 2 * fft_len, 1, iterations, benchFftAbs2) != RP_OK;
+    }
+    if (selected("sine_fit_16384")) {
+        failed |= measure("sine_fit_16384", ADC_BUFFER_SIZE, 1, iterations, benchSineFit) != RP_OK;
+    }
+    if (selected("xcorr_16384")) {
+        failed |= measure("xcorr_16384", 2 * ADC_BUFFER_SIZE, 1, iterations, benchXcorr) != RP_OK;
+    }
+    rp_DspRelease();
+
+    rp_Release();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,683 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya end-to-end latency benchmark over the generator loopback.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "redpitaya/rp.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * OUT1 plays one burst of a square wave on a software trigger, the rising
+ * edge comes back on IN1 through the digital loop (rp_EnableDigitalLoop())
+ * or, with -c, through a cable from OUT1 to IN1. Every path is timed from
+ * the generator trigger until the edge is in the hands of its consumer:
+ *
+ *   librp   rp_GenTrigger() until rp_AcqGetDataV() returned the samples
+ *           around the CH1 trigger the edge raised.
+ *   scpi    SOUR1:TRIG:IMM sent to the SCPI server until the reply of
+ *           ACQ:SOUR1:DATA:STA:N? with the edge is read, all on one socket.
+ *   stream  rp_GenTrigger() until the pack with the edge is read from the
+ *           streaming server. stream_sample times the same packs from the
+ *           edge sample, stamped by the pack trailer, so the DMA, the copy
+ *           and the network are seen without the trigger path.
+ *
+ * The streaming server has to run already, with CH1 enabled, 8 or 16 bit
+ * samples and no compression. None of the web applications sends ADC data
+ * over the websocket, the frame path of the web SDK is timed by ws_bench of
+ * the websocket server.
+ *
+ * One JSON object per path goes to stdout, like rp_bench:
+ *
+ *   {"model":"Z10","bench":"loop_librp","loop":"digital","iterations":100,
+ *    "failed":0,"min_us":..,"median_us":..,"mean_us":..,"p90_us":..,
+ *    "p99_us":..,"max_us":..,"hist_us":[..]}
+ *
+ * hist_us holds the log2 distribution, entry n counts the latencies below
+ * 2^n us. Iterations whose edge did not show up in time count as failed.
+ */
+
+#ifndef RP_MODEL
+#define RP_MODEL "unknown"
+#endif
+
+#define DEFAULT_ITERATIONS  100
+#define DEFAULT_AMPLITUDE   0.5f
+#define LATENCY_SAMPLES     1024
+#define TRIGGER_TIMEOUT_MS  1000
+// One cycle of 1 kHz, the output is high for the first 0.5 ms
+#define BURST_FREQ          1000
+// Untimed pause after a burst, the output is back at 0 V
+#define BURST_SETTLE_US     5000
+#define HIST_BUCKETS        32
+
+#define SCPI_PORT           5000
+#define SCPI_REPLY_SIZE     (LATENCY_SAMPLES * 16)
+
+#define STREAM_PORT         8900
+// Layout of the streaming packs, see AsioNet.h of the streaming manager
+#define STREAM_ID_PACK      "STREAMpackIDv2.0"
+#define STREAM_ID_PREFIX    "STREAMpackIDv2."
+#define STREAM_HEADER_SIZE  64
+#define STREAM_TRAILER_SIZE 16
+#define STREAM_MAX_PACK     (16 * 1024 * 1024)
+#define STREAM_TIME_VALID   0x1u
+#define STREAM_PAYLOAD_MASK 0x00FF0000u
+#define STREAM_ADC_PERIOD_NS 8
+
+static float    amplitude = DEFAULT_AMPLITUDE;
+static float    full_scale = 1.0f;
+static int      cable;
+static const char *scpi_host = "127.0.0.1";
+static int      scpi_port = SCPI_PORT;
+static const char *stream_host = "127.0.0.1";
+static int      stream_port = STREAM_PORT;
+
+static float    volts1[LATENCY_SAMPLES];
+static char     reply[SCPI_REPLY_SIZE];
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int64_t realtimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmpU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Prints the distribution of count latencies in ns, sorts times.
+ */
+static void report(const char *name, uint64_t *times, int count, int failed)
+{
+    uint64_t hist[HIST_BUCKETS] = {0};
+    int buckets = 0;
+    double sum = 0;
+
+    qsort(times, count, sizeof(uint64_t), cmpU64);
+    for (int i = 0; i < count; ++i) {
+        uint64_t us = times[i] / 1000;
+        int b = 0;
+        while (b < HIST_BUCKETS - 1 && us >= (1ULL << b)) {
+            ++b;
+        }
+        hist[b]++;
+        if (b + 1 > buckets) {
+            buckets = b + 1;
+        }
+        sum += times[i];
+    }
+
+    printf("{\"model\":\"%s\",\"bench\":\"%s\",\"loop\":\"%s\",\"iterations\":%d,\"failed\":%d",
+           RP_MODEL, name, cable ? "cable" : "digital", count + failed, failed);
+    if (count > 0) {
+        printf(",\"min_us\":%.1f,\"median_us\":%.1f,\"mean_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f",
+               times[0] / 1000.0, times[count / 2] / 1000.0, sum / count / 1000.0,
+               times[(count * 90) / 100] / 1000.0, times[(count * 99) / 100] / 1000.0,
+               times[count - 1] / 1000.0);
+    }
+    printf(",\"hist_us\":[");
+    for (int b = 0; b < buckets; ++b) {
+        printf("%s%llu", b ? "," : "", (unsigned long long)hist[b]);
+    }
+    printf("]}\n");
+    fflush(stdout);
+}
+
+/**
+ * OUT1 waits for rp_GenTrigger() with one burst. EXT_PE arms it again,
+ * nothing drives the external trigger input.
+ */
+static int genSetup()
+{
+    int status = RP_OK;
+    status |= rp_GenWaveform(RP_CH_1, RP_WAVEFORM_SQUARE);
+    status |= rp_GenFreq(RP_CH_1, BURST_FREQ);
+    status |= rp_GenAmp(RP_CH_1, amplitude);
+    status |= rp_GenOffset(RP_CH_1, 0);
+    status |= rp_GenMode(RP_CH_1, RP_GEN_MODE_BURST);
+    status |= rp_GenBurstCount(RP_CH_1, 1);
+    status |= rp_GenBurstRepetitions(RP_CH_1, 1);
+    status |= rp_GenTriggerSource(RP_CH_1, RP_GEN_TRIG_SRC_EXT_PE);
+    status |= rp_GenOutEnable(RP_CH_1);
+    return status == RP_OK ? RP_OK : RP_EOOR;
+}
+
+static void genRearm()
+{
+    usleep(BURST_SETTLE_US);
+    rp_GenTriggerSource(RP_CH_1, RP_GEN_TRIG_SRC_EXT_PE);
+}
+
+/**
+ * From the generator trigger until the samples around the acquisition
+ * trigger are converted, the trigger delay keeps the post trigger part
+ * short like acq_trigger_latency of rp_bench.
+ */
+static int loopLibrp(uint64_t *elapsed)
+{
+    rp_AcqStart();
+    // Untimed, the pre trigger part has to be in memory first
+    usleep(1000);
+    rp_AcqSetTriggerSrc(RP_TRIG_SRC_CHA_PE);
+    uint64_t start = nowNs();
+    rp_GenTrigger(RP_CH_1);
+    int status = rp_AcqWaitTrigger(TRIGGER_TIMEOUT_MS);
+    if (status != RP_OK) {
+        rp_AcqStop();
+        return status;
+    }
+    rp_acq_trig_src_t source = RP_TRIG_SRC_CHA_PE;
+    while (rp_AcqGetTriggerSrc(&source) == RP_OK && source != RP_TRIG_SRC_DISABLED) {
+        if (nowNs() - start > (uint64_t)TRIGGER_TIMEOUT_MS * 1000000ULL) {
+            rp_AcqStop();
+            return RP_ETIM;
+        }
+    }
+    uint32_t trig_pos;
+    rp_AcqGetWritePointerAtTrig(&trig_pos);
+    uint32_t size = LATENCY_SAMPLES;
+    status = rp_AcqGetDataV(RP_CH_1, trig_pos + ADC_BUFFER_SIZE - LATENCY_SAMPLES / 2, &size, volts1);
+    *elapsed = nowNs() - start;
+    rp_AcqStop();
+    if (status != RP_OK) {
+        return status;
+    }
+    // The acquisition may have triggered on noise, the edge has to be in the data
+    for (uint32_t i = LATENCY_SAMPLES / 2; i < size; ++i) {
+        if (volts1[i] > amplitude / 2) {
+            return RP_OK;
+        }
+    }
+    return RP_ETIM;
+}
+
+static int runLibrp(int iterations, uint64_t *times)
+{
+    int count = 0;
+    int failed = 0;
+
+    rp_AcqReset();
+    rp_AcqSetDecimation(RP_DEC_1);
+    rp_AcqSetTriggerLevel(RP_CH_1, amplitude / 2);
+    rp_AcqSetTriggerDelay(LATENCY_SAMPLES / 2 - ADC_BUFFER_SIZE / 2);
+    if (genSetup() != RP_OK) {
+        fprintf(stderr, "loop_librp: generator setup failed\n");
+        return 1;
+    }
+    genRearm();
+    for (int i = 0; i < iterations; ++i) {
+        uint64_t elapsed = 0;
+        int status = loopLibrp(&elapsed);
+        if (status == RP_OK) {
+            times[count++] = elapsed;
+        } else {
+            failed++;
+        }
+        genRearm();
+    }
+    rp_AcqReset();
+    rp_GenOutDisable(RP_CH_1);
+    report("loop_librp", times, count, failed);
+    return failed;
+}
+
+static int tcpConnect(const char *host, int port)
+{
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    char service[16];
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+        return -1;
+    }
+    for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd != -1) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static int readFull(int fd, void *buf, size_t size)
+{
+    uint8_t *p = buf;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int scpiSend(int fd, const char *cmd)
+{
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%s\r\n", cmd);
+    return send(fd, line, len, 0) == len ? 0 : -1;
+}
+
+/**
+ * Sends a query and reads its reply line into reply, without the line end.
+ */
+static int scpiQuery(int fd, const char *cmd)
+{
+    size_t len = 0;
+    if (scpiSend(fd, cmd) != 0) {
+        return -1;
+    }
+    while (len < sizeof(reply) - 1) {
+        ssize_t n = recv(fd, reply + len, sizeof(reply) - 1 - len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        len += n;
+        if (reply[len - 1] == '\n') {
+            while (len > 0 && (reply[len - 1] == '\n' || reply[len - 1] == '\r')) {
+                len--;
+            }
+            reply[len] = '\0';
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Like loopLibrp(), every step goes through the SCPI server.
+ */
+static int loopScpi(int fd, uint64_t *elapsed)
+{
+    char cmd[64];
+
+    scpiSend(fd, "ACQ:START");
+    usleep(1000);
+    scpiSend(fd, "ACQ:TRIG CH1_PE");
+    // The commands above have no reply, a query makes sure they are done
+    if (scpiQuery(fd, "ACQ:TRIG:STAT?") != 0) {
+        return -1;
+    }
+    uint64_t start = nowNs();
+    scpiSend(fd, "SOUR1:TRIG:IMM");
+    do {
+        if (scpiQuery(fd, "ACQ:TRIG:STAT?") != 0) {
+            return -1;
+        }
+        if (nowNs() - start > (uint64_t)TRIGGER_TIMEOUT_MS * 1000000ULL) {
+            scpiSend(fd, "ACQ:STOP");
+            return -1;
+        }
+    } while (strcmp(reply, "TD") != 0);
+    if (scpiQuery(fd, "ACQ:TPOS?") != 0) {
+        return -1;
+    }
+    uint32_t trig_pos = strtoul(reply, NULL, 10);
+    snprintf(cmd, sizeof(cmd), "ACQ:SOUR1:DATA:STA:N? %u,%u",
+             (trig_pos + ADC_BUFFER_SIZE - LATENCY_SAMPLES / 2) % ADC_BUFFER_SIZE, LATENCY_SAMPLES);
+    if (scpiQuery(fd, cmd) != 0) {
+        return -1;
+    }
+    *elapsed = nowNs() - start;
+    scpiSend(fd, "ACQ:STOP");
+
+    // {v0,v1,...} in volts, the edge follows the trigger in the second half
+    char *p = reply;
+    for (int i = 0; *p != '\0' && *p != '}'; ++i) {
+        char *end;
+        float value = strtof(p + 1, &end);
+        if (end == p + 1) {
+            break;
+        }
+        if (i >= LATENCY_SAMPLES / 2 && value > amplitude / 2) {
+            return 0;
+        }
+        p = end;
+    }
+    return -1;
+}
+
+static int runScpi(int iterations, uint64_t *times)
+{
+    char cmd[64];
+    int count = 0;
+    int failed = 0;
+
+    int fd = tcpConnect(scpi_host, scpi_port);
+    if (fd == -1) {
+        fprintf(stderr, "loop_scpi: can not connect to %s:%d\n", scpi_host, scpi_port);
+        return 1;
+    }
+    if (!cable) {
+        scpiSend(fd, "RP:DIG");
+    }
+    scpiSend(fd, "ACQ:RST");
+    scpiSend(fd, "ACQ:DEC 1");
+    scpiSend(fd, "ACQ:DATA:UNITS VOLTS");
+    snprintf(cmd, sizeof(cmd), "ACQ:TRIG:LEV %f", amplitude / 2);
+    scpiSend(fd, cmd);
+    snprintf(cmd, sizeof(cmd), "ACQ:TRIG:DLY %d", LATENCY_SAMPLES / 2 - ADC_BUFFER_SIZE / 2);
+    scpiSend(fd, cmd);
+    scpiSend(fd, "SOUR1:FUNC SQUARE");
+    snprintf(cmd, sizeof(cmd), "SOUR1:FREQ:FIX %d", BURST_FREQ);
+    scpiSend(fd, cmd);
+    snprintf(cmd, sizeof(cmd), "SOUR1:VOLT %f", amplitude);
+    scpiSend(fd, cmd);
+    scpiSend(fd, "SOUR1:VOLT:OFFS 0");
+    scpiSend(fd, "SOUR1:BURS:STAT BURST");
+    scpiSend(fd, "SOUR1:BURS:NCYC 1");
+    scpiSend(fd, "SOUR1:BURS:NOR 1");
+    scpiSend(fd, "SOUR1:TRIG:SOUR EXT_PE");
+    scpiSend(fd, "OUTPUT1:STATE ON");
+
+    for (int i = 0; i < iterations; ++i) {
+        uint64_t elapsed = 0;
+        usleep(BURST_SETTLE_US);
+        scpiSend(fd, "SOUR1:TRIG:SOUR EXT_PE");
+        if (loopScpi(fd, &elapsed) == 0) {
+            times[count++] = elapsed;
+        } else {
+            failed++;
+        }
+    }
+    scpiSend(fd, "OUTPUT1:STATE OFF");
+    scpiSend(fd, "ACQ:RST");
+    close(fd);
+    report("loop_scpi", times, count, failed);
+    return failed;
+}
+
+/**
+ * Reads one pack into pack and finds the first CH1 sample above threshold,
+ * -1 if there is none. Returns -1 on a broken connection or an unsupported
+ * pack, 0 otherwise.
+ */
+static int streamPack(int fd, uint8_t *pack, int *edge, uint64_t *sample_time)
+{
+    uint32_t header[STREAM_HEADER_SIZE / 4];
+
+    *edge = -1;
+    if (readFull(fd, header, sizeof(header)) != 0) {
+        return -1;
+    }
+    if (memcmp(header, STREAM_ID_PREFIX, strlen(STREAM_ID_PREFIX)) != 0) {
+        fprintf(stderr, "loop_stream: lost the pack boundaries\n");
+        return -1;
+    }
+    uint32_t size = header[9];
+    uint32_t size_ch1 = header[10];
+    uint32_t resolution = header[12];
+    if (size < STREAM_HEADER_SIZE + STREAM_TRAILER_SIZE || size > STREAM_MAX_PACK) {
+        fprintf(stderr, "loop_stream: bad pack size %u\n", size);
+        return -1;
+    }
+    if (readFull(fd, pack, size - STREAM_HEADER_SIZE) != 0) {
+        return -1;
+    }
+    if (memcmp(header, STREAM_ID_PACK, 16) != 0 || (resolution != 8 && resolution != 16) ||
+        (header[13] & STREAM_PAYLOAD_MASK) != 0) {
+        fprintf(stderr, "loop_stream: needs 8 or 16 bit samples without compression\n");
+        return -1;
+    }
+
+    // Raw ADC counts, full_scale volts are the most positive count
+    uint32_t samples = size_ch1 * 8 / resolution;
+    int32_t threshold = (int32_t)(amplitude / 2 / full_scale * (resolution == 8 ? 128 : 32768));
+    for (uint32_t i = 0; i < samples; ++i) {
+        int32_t value = resolution == 8 ? ((const int8_t *)pack)[i] : ((const int16_t *)pack)[i];
+        if (value > threshold) {
+            *edge = i;
+            break;
+        }
+    }
+
+    // The trailer has the wall clock time of the first sample
+    *sample_time = 0;
+    if (*edge >= 0) {
+        const uint8_t *trailer = pack + size - STREAM_HEADER_SIZE - STREAM_TRAILER_SIZE;
+        int64_t time;
+        uint32_t flags;
+        memcpy(&time, trailer, sizeof(time));
+        memcpy(&flags, trailer + 12, sizeof(flags));
+        if (flags & STREAM_TIME_VALID) {
+            *sample_time = time + (int64_t)*edge * header[8] * STREAM_ADC_PERIOD_NS;
+        }
+    }
+    return 0;
+}
+
+/**
+ * The generator is triggered between two packs, the stream is read all the
+ * time so the server does not drop data. A new trigger waits for a pack
+ * without the edge after the burst.
+ */
+static int runStream(int iterations, uint64_t *times, uint64_t *sample_times)
+{
+    int count = 0;
+    int sample_count = 0;
+    int failed = 0;
+    int status = 0;
+
+    uint8_t *pack = malloc(STREAM_MAX_PACK);
+    if (pack == NULL) {
+        return 1;
+    }
+    if (genSetup() != RP_OK) {
+        fprintf(stderr, "loop_stream: generator setup failed\n");
+        free(pack);
+        return 1;
+    }
+    int fd = tcpConnect(stream_host, stream_port);
+    if (fd == -1) {
+        fprintf(stderr, "loop_stream: can not connect to %s:%d\n", stream_host, stream_port);
+        free(pack);
+        return 1;
+    }
+
+    int armed = 0;
+    uint64_t start = 0;
+    uint64_t settled = nowNs() + BURST_SETTLE_US * 1000ULL;
+    while (count + failed < iterations) {
+        int edge;
+        uint64_t sample_time;
+        if (streamPack(fd, pack, &edge, &sample_time) != 0) {
+            status = 1;
+            break;
+        }
+        uint64_t now = nowNs();
+        int64_t received = realtimeNs();
+        if (armed) {
+            if (edge >= 0) {
+                times[count++] = now - start;
+                if (sample_time != 0 && received > (int64_t)sample_time) {
+                    sample_times[sample_count++] = received - sample_time;
+                }
+            } else if (now - start > (uint64_t)TRIGGER_TIMEOUT_MS * 1000000ULL) {
+                failed++;
+            } else {
+                continue;
+            }
+            armed = 0;
+            settled = now + BURST_SETTLE_US * 1000ULL;
+            rp_GenTriggerSource(RP_CH_1, RP_GEN_TRIG_SRC_EXT_PE);
+        } else if (edge < 0 && now >= settled) {
+            armed = 1;
+            start = nowNs();
+            rp_GenTrigger(RP_CH_1);
+        }
+    }
+    close(fd);
+    free(pack);
+    rp_GenOutDisable(RP_CH_1);
+    if (status != 0) {
+        fprintf(stderr, "loop_stream: connection to %s:%d lost\n", stream_host, stream_port);
+        return 1;
+    }
+    report("loop_stream", times, count, failed);
+    report("loop_stream_sample", sample_times, sample_count, count - sample_count);
+    return failed;
+}
+
+static void parseHost(char *arg, const char **host, int *port)
+{
+    char *colon = strrchr(arg, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+        *port = atoi(colon + 1);
+    }
+    *host = arg;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-n iterations] [-p path]... [-c] [-a volts] [-f volts]\n"
+        "          [-s host[:port]] [-t host[:port]]\n"
+        "\n"
+        "  -n  Triggers per path (default %d)\n"
+        "  -p  Path to time: librp, scpi or stream, may be repeated (default librp)\n"
+        "  -c  A cable connects OUT1 to IN1, the digital loop stays off\n"
+        "  -a  Amplitude of the burst in V (default %.1f)\n"
+        "  -f  Full scale of IN1 in V for the raw stream samples (default 1.0, 20.0 for HV)\n"
+        "  -s  SCPI server (default 127.0.0.1:%d)\n"
+        "  -t  Streaming server (default 127.0.0.1:%d)\n",
+        prog, DEFAULT_ITERATIONS, DEFAULT_AMPLITUDE, SCPI_PORT, STREAM_PORT);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = DEFAULT_ITERATIONS;
+    int librp = 0, scpi = 0, stream = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:ca:f:s:t:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'p':
+                if (strcmp(optarg, "librp") == 0) {
+                    librp = 1;
+                } else if (strcmp(optarg, "scpi") == 0) {
+                    scpi = 1;
+                } else if (strcmp(optarg, "stream") == 0) {
+                    stream = 1;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                cable = 1;
+                break;
+            case 'a':
+                amplitude = atof(optarg);
+                break;
+            case 'f':
+                full_scale = atof(optarg);
+                break;
+            case 's':
+                parseHost(optarg, &scpi_host, &scpi_port);
+                break;
+            case 't':
+                parseHost(optarg, &stream_host, &stream_port);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (iterations < 1 || amplitude <= 0 || full_scale <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!librp && !scpi && !stream) {
+        librp = 1;
+    }
+
+    uint64_t *times = malloc(sizeof(uint64_t) * iterations);
+    uint64_t *sample_times = malloc(sizeof(uint64_t) * iterations);
+    if (times == NULL || sample_times == NULL) {
+        return 1;
+    }
+
+    // Nothing is reset, a running SCPI or streaming server keeps its state
+    if ((librp || stream) && rp_InitEx(0) != RP_OK) {
+        fprintf(stderr, "Red Pitaya API init failed!\n");
+        return 1;
+    }
+    if ((librp || stream) && !cable) {
+        rp_EnableDigitalLoop(true);
+    }
+
+    int failed = 0;
+    if (librp) {
+        failed |= runLibrp(iterations, times) != 0;
+    }
+    if (scpi) {
+        failed |= runScpi(iterations, times) != 0;
+    }
+    if (stream) {
+        failed |= runStream(iterations, times, sample_times) != 0;
+    }
+
+    if (librp || stream) {
+        if (!cable) {
+            rp_EnableDigitalLoop(false);
+        }
+        rp_Release();
+    }
+    free(times);
+    free(sample_times);
+    return failed ? 1 : 0;
+}
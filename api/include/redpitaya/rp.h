@@ -49,6 +49,8 @@ extern "C" {
 #endif
 
 #define ADC_BUFFER_SIZE             (16*1024)
+/** Most records rp_AcqCaptureAverage() takes, their full scale sum still fits 32 bits */
+#define ACQ_AVERAGE_MAX_RECORDS     (0x7FFFFFFF >> (ADC_BITS - 1))
 
 /** @name Error codes
  *  Various error codes returned by the API.
@@ -105,11 +107,39 @@ extern "C" {
 #define RP_EMNC   23
 /** Command not supported */
 #define RP_NOTS   24
+/** Timeout */
+#define RP_ETIM   25
+/** Failed to allocate memory */
+#define RP_EAM    26
 
 #define SPECTR_OUT_SIG_LEN (2*1024)
 
 ///@}
 
+/** @name rp_InitEx() flags
+ */
+///@{
+
+/** Acquisition (oscilloscope) registers */
+#define RP_INIT_ACQ    (1 << 0)
+/** Generator registers */
+#define RP_INIT_GEN    (1 << 1)
+/** Housekeeping: LEDs, GPIO, digital loop, analog outputs */
+#define RP_INIT_HK     (1 << 2)
+/** Calibration parameters, read with acquisition and generator anyway */
+#define RP_INIT_CALIB  (1 << 3)
+#define RP_INIT_ALL    (RP_INIT_ACQ | RP_INIT_GEN | RP_INIT_HK | RP_INIT_CALIB)
+/** Reset the subsystems initialized by the call to their defaults, as rp_Init() does */
+#define RP_INIT_RESET  (1 << 8)
+/**
+ * Keep the generator settings and waveforms in a segment shared by all processes that
+ * give this flag, so they see the same state and do not write a buffer again that another
+ * one already wrote. Must be given before the generator is initialized.
+ */
+#define RP_INIT_SHARED (1 << 9)
+
+///@}
+
 /**
  * Type representing digital input output pins.
  */
@@ -254,6 +284,14 @@ typedef enum {
     RP_TRIG_STATE_WAITING,   //!< Trigger is set up and waiting (to be triggered)
 } rp_acq_trig_state_t;
 
+/**
+ * Type representing how rp_AcqGetDataVBinned() reduces the samples of a bin.
+ */
+typedef enum {
+    RP_ACQ_BIN_MEAN,   //!< Mean of the bin samples
+    RP_ACQ_BIN_MINMAX, //!< Minimum and maximum of the bin samples (envelope)
+} rp_acq_bin_mode_t;
+
 
 /**
  * Calibration parameters, stored in the EEPROM device
@@ -274,6 +312,168 @@ typedef struct {
     int32_t  fe_ch2_hi_offs; //!< Front end DC offset, channel B
 } rp_calib_params_t;
 
+/**
+ * Gains and calibration of both channels, prepared for converting counts to Volts.
+ * Filled by rp_AcqPrepareReadout(). A snapshot taken before a gain or calibration
+ * change is refreshed on its next use.
+ */
+typedef struct {
+    int32_t  dc_offs[2];       //!< Calibrated DC offset in counts, per channel
+    float    scale[2];         //!< Volts per calibrated count, per channel
+    uint32_t gain_generation;  //!< Internal, gain settings the snapshot was taken from
+    uint32_t calib_generation; //!< Internal, calibration the snapshot was taken from
+} rp_acq_readout_t;
+
+/**
+ * A point in CLOCK_REALTIME, see rp_AcqGetWritePointerAtTrigTime().
+ */
+typedef struct {
+    int64_t  sec;          //!< Seconds since the epoch
+    uint32_t nsec;
+    uint32_t error_ns;     //!< Half width of the interval the time lies in, without the error of the clock itself
+} rp_timestamp_t;
+
+/**
+ * State of the clock the time stamps are taken from, see rp_GetTimeBase().
+ */
+typedef struct {
+    bool     synchronized; //!< CLOCK_REALTIME is disciplined by NTP or PTP (phc2sys), the kernel does not flag it unsynchronized
+    bool     ptp;          //!< The network interface has a PTP hardware clock
+    uint32_t est_error_ns; //!< Estimated error of CLOCK_REALTIME, as reported by the disciplining daemon
+    uint32_t max_error_ns; //!< Maximum error of CLOCK_REALTIME
+} rp_time_base_t;
+
+/**
+ * One record of a segmented acquisition, see rp_AcqCaptureRecords().
+ */
+typedef struct {
+    uint32_t trigger_pos;  //!< ADC buffer position of the trigger
+    uint32_t start_pos;    //!< ADC buffer position of the first record sample
+    uint64_t time_ns;      //!< CLOCK_MONOTONIC time at which the record was complete
+    bool     overwritten;  //!< The ADC wrapped over the record before it was copied
+} rp_acq_record_t;
+
+/**
+ * How the frequencies of a sweep are laid out, see rp_GenSweep().
+ */
+typedef enum {
+    RP_SWEEP_LINEAR, //!< Equally spaced from start_freq to stop_freq
+    RP_SWEEP_LOG,    //!< Logarithmically spaced from start_freq to stop_freq
+    RP_SWEEP_LIST    //!< Taken from the freqs list
+} rp_sweep_mode_t;
+
+/**
+ * A generator frequency sweep, see rp_GenSweep().
+ */
+typedef struct {
+    rp_channel_t      channel;       //!< Generator channel that is swept
+    rp_sweep_mode_t   mode;
+    uint32_t          points;        //!< Number of steps
+    float             start_freq;    //!< First frequency [Hz], linear and log modes
+    float             stop_freq;     //!< Last frequency [Hz], linear and log modes
+    const float*      freqs;         //!< Frequencies [Hz], points long, list mode
+    const float*      amps;          //!< Amplitudes [V], points long, NULL keeps the amplitude
+    const rp_acq_decimation_t* decimations; //!< Decimation of each record, points long, NULL keeps it
+    uint32_t          dwell_us;      //!< Settling time after each step [us]
+    uint32_t          dwell_periods; //!< Settling time in signal periods, the longer of the two is used
+    rp_acq_trig_src_t trigger;       //!< Record trigger, RP_TRIG_SRC_AWG_PE aligns records to the generator
+} rp_sweep_t;
+
+/**
+ * One step of a sweep with its record.
+ */
+typedef struct {
+    float             frequency;     //!< Generator frequency [Hz]
+    float             amplitude;     //!< Generator amplitude [V]
+    rp_acq_record_t   record;
+} rp_sweep_point_t;
+
+/**
+ * Read-only view of one channel's ADC buffer in the FPGA, see rp_AcqGetRawBufferView().
+ */
+typedef struct {
+    const volatile uint32_t* data; //!< ADC_BUFFER_SIZE words, sample in the low ADC_BITS bits, uncalibrated
+    uint32_t size;                 //!< Number of samples in the buffer
+    uint32_t write_pos;            //!< Write pointer when the view was taken
+    uint32_t trigger_pos;          //!< Write pointer at the last trigger when the view was taken
+} rp_acq_raw_view_t;
+
+/**
+ * One sample of the housekeeping telemetry, see rp_TelemetryRead().
+ */
+typedef struct {
+    uint64_t count;            //!< Samples taken since the service started
+    uint64_t time_ns;          //!< CLOCK_MONOTONIC time of the sample
+    float    temp;             //!< Zynq die temperature [deg C]
+    float    vcc_int;          //!< FPGA internal supply [V]
+    float    vcc_aux;          //!< FPGA auxiliary supply [V]
+    float    vcc_bram;         //!< FPGA block RAM supply [V]
+    float    ain[4];           //!< Slow analog inputs AI0..AI3 [V]
+    bool     alarms;           //!< The board has DAC temperature alarms, the two fields below are valid
+    bool     runtime_alarm[2]; //!< DAC overheat now, per channel, see rp_GetRuntimeTempAlarm()
+    bool     latch_alarm[2];   //!< DAC overheated since the latch was reset, see rp_GetLatchTempAlarm()
+} rp_telemetry_t;
+
+/**
+ * Register accesses of one librp function, see rp_RegStatsGet().
+ */
+typedef struct {
+    const char* function;  //!< Name of the librp function, internal ones included
+    uint64_t    reads;     //!< Register reads
+    uint64_t    writes;    //!< Register writes, a read-modify-write counts once
+    uint64_t    time_ns;   //!< Time spent in the accesses, the clock reads included
+} rp_reg_stats_t;
+
+/**
+ * One entry of rp_GenSequence(), a segment of the sequence table played count
+ * times. Lengths are in samples of the sequence sample rate.
+ */
+typedef struct {
+    uint32_t start;     //!< First sample of the segment in the table
+    uint32_t length;    //!< Samples of the segment
+    uint32_t count;     //!< Times the segment is played
+    uint32_t period;    //!< Samples from the start of one play to the next, the gap holds 0 V; 0 for length
+    float    amplitude; //!< Scale of the segment, -1 ... 1, negative inverts it
+} rp_gen_seq_entry_t;
+
+/** SPI mode bits of rp_SpiSetMode(), the values of linux/spi/spidev.h */
+#define RP_SPI_CPHA      0x01 //!< Sample on the second clock edge
+#define RP_SPI_CPOL      0x02 //!< Clock idles high
+#define RP_SPI_CS_HIGH   0x04 //!< Chip select is active high
+#define RP_SPI_LSB_FIRST 0x08 //!< Least significant bit first
+#define RP_SPI_3WIRE     0x10 //!< Shared data line
+#define RP_SPI_LOOP      0x20 //!< Loop back in the controller
+#define RP_SPI_NO_CS     0x40 //!< No chip select
+
+/**
+ * One transfer of rp_SpiTransfer(). Descriptors are plain data, an array of
+ * them can be set up once and sent any number of times.
+ */
+typedef struct {
+    const void* tx;        //!< Bytes sent, NULL sends zeros
+    void*       rx;        //!< Bytes received, NULL drops them
+    uint32_t    len;       //!< Length in bytes, at most rp_SpiGetMaxMessage()
+    uint32_t    speed_hz;  //!< Clock of this transfer, 0 for the one of rp_SpiSetSpeed()
+    uint16_t    delay_us;  //!< Wait after the transfer, before the chip select changes
+    bool        cs_change; //!< Deselect the chip between this and the next transfer
+} rp_spi_xfer_t;
+
+/**
+ * One message of rp_I2cTransfer(), consecutive messages are joined with a
+ * repeated start.
+ */
+typedef struct {
+    uint8_t  addr; //!< 7 bit device address
+    bool     read; //!< Read into data, otherwise write data
+    uint8_t* data; //!< Bytes of the message
+    uint16_t len;  //!< Length in bytes
+} rp_i2c_msg_t;
+
+/** A register and its value for rp_I2cWriteRegList() */
+typedef struct {
+    uint8_t reg;
+    uint8_t value;
+} rp_i2c_reg_t;
 
 /** @name General
  */
@@ -282,11 +482,26 @@ typedef struct {
 
 /**
  * Initializes the library. It must be called first, before any other library method.
+ * After that the library may be used from several threads of a process. Acquisition,
+ * generator and housekeeping each have their own lock, concurrent data reads and getters
+ * do not block each other. The locks do not reach across processes.
  * @return If the function is successful, the return value is RP_OK.
  * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
  */
 int rp_Init();
 
+/**
+ * Initializes the library like rp_Init(), but only the subsystems given in flags, and
+ * without touching their state unless RP_INIT_RESET is given. The other subsystems are
+ * mapped on their first use, also without a reset. Tools that only need LEDs or GPIO
+ * start quickly this way and leave a running acquisition or generation alone.
+ * rp_Init() is rp_InitEx(RP_INIT_ALL | RP_INIT_RESET).
+ * @param flags RP_INIT_* flags, 0 to map everything on demand.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_InitEx(uint32_t flags);
+
 int rp_CalibInit();
 
 /**
@@ -355,6 +570,16 @@ rp_calib_params_t rp_GetCalibrationSettings();
 */
 int rp_CalibrateFrontEndOffset(rp_channel_t channel, rp_pinState_t gain, rp_calib_params_t* out_params) ;
 
+/**
+* Calibrates the offsets of both input channels from one acquisition. Both inputs must be grounded to calibrate properly.
+* Calibration data is written to EPROM and repopulated so that rp_GetCalibrationSettings works properly.
+* @param gain Gain setting (jumper position) to calibrate
+* @param out_params If not NULL, receives the new offsets instead of the EPROM
+* @return If the function is successful, the return value is RP_OK.
+* If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+*/
+int rp_CalibrateFrontEndOffsets(rp_pinState_t gain, rp_calib_params_t* out_params);
+
 /**
 * Calibrates input channel low voltage scale. Jumpers must be set to LV.
 * This input channel must be connected to stable positive source.
@@ -518,6 +743,53 @@ int rp_DpinSetDirection(rp_dpin_t pin, rp_pinDirection_t direction);
  */
 int rp_DpinGetDirection(rp_dpin_t pin, rp_pinDirection_t* direction);
 
+/**
+ * Gets the state of all digital pins with one register read per bank.
+ * @param state  Bit n holds the state of the pin with rp_dpin_t value n, LED0 in bit 0 to DIO7_N in bit 23.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_DpinGetStateAll(uint32_t* state);
+
+/**
+ * Gets the state of the digital pins selected by mask, only the banks with a selected pin are read.
+ * @param mask   Pins to get, bit n is the pin with rp_dpin_t value n.
+ * @param state  States of the selected pins in the same bit order, the other bits are 0.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_DpinGetStateMask(uint32_t mask, uint32_t* state);
+
+/**
+ * Sets the state of all digital pins selected by mask with one register write per bank.
+ * Nothing is written when any of the selected pins is set to the input direction. The directions
+ * are not read from the registers but kept by the direction setters of this process.
+ * @param mask   Pins to set, bit n is the pin with rp_dpin_t value n.
+ * @param state  New states of the selected pins, in the same bit order.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_DpinSetStateMask(uint32_t mask, uint32_t state);
+
+/**
+ * Gets the direction of all digital pins, LEDs always read as outputs. Also refreshes the directions
+ * the state setters check, after another process changed them.
+ * @param direction  Bit n is set when the pin with rp_dpin_t value n is an output.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_DpinGetDirectionAll(uint32_t* direction);
+
+/**
+ * Sets the direction of all digital pins selected by mask with one register write per bank.
+ * LEDs can only be selected as outputs.
+ * @param mask       Pins to set, bit n is the pin with rp_dpin_t value n.
+ * @param direction  Bit n is set to make the selected pin n an output.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_DpinSetDirectionMask(uint32_t mask, uint32_t direction);
+
 ///@}
 
 
@@ -576,6 +848,14 @@ int rp_ApinSetValueRaw(rp_apin_t pin, uint32_t value);
  */
 int rp_ApinGetRange(rp_apin_t pin, float* min_val,  float* max_val);
 
+/**
+ * Gets value in volts of all analog pins at once.
+ * @param values  Array of RP_AIN3 + 1 values in rp_apin_t order, outputs first.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_ApinGetValueAll(float* values);
+
 
 /** @name Analog Inputs
  */
@@ -597,6 +877,39 @@ int rp_AIpinGetValue(int unsigned pin, float* value);
  */
 int rp_AIpinGetValueRaw(int unsigned pin, uint32_t* value);
 
+/**
+ * Starts sampling all four analog inputs into the kernel IIO buffer of the
+ * XADC. While it runs, rp_AIpinGetValue() and rp_AIpinGetValueRaw() return the
+ * last values read from the buffer.
+ * @param rate         scans (all four inputs) per second
+ * @param length       buffer length in scans
+ * @param actual_rate  rate the XADC was set to, can be NULL
+ * @return       RP_OK - successful, RP_EUF - no buffered mode, use the single reads
+ */
+int rp_AIbufferStart(float rate, uint32_t length, float* actual_rate);
+
+/**
+ * Stops the buffered sampling, single reads go to the XADC again.
+ * @return       RP_OK - successful, RP_E* - failure
+ */
+int rp_AIbufferStop();
+
+/**
+ * Reads the scans collected since the last call.
+ * @param raw         max_scans * 4 raw 12 bit values, AI0..AI3 per scan
+ * @param max_scans   room in raw
+ * @param scans       number of scans read
+ * @param timeout_ms  wait for the first scan
+ * @return       RP_OK - successful, RP_ETIM - no scan in time, RP_E* - failure
+ */
+int rp_AIbufferReadRaw(uint16_t* raw, uint32_t max_scans, uint32_t* scans, uint32_t timeout_ms);
+
+/**
+ * Same as rp_AIbufferReadRaw() with the values in volts.
+ * @param values      max_scans * 4 values, AI0..AI3 per scan
+ */
+int rp_AIbufferRead(float* values, uint32_t max_scans, uint32_t* scans, uint32_t timeout_ms);
+
 
 /** @name Analog Outputs
  */
@@ -765,6 +1078,33 @@ int rp_AcqGetTriggerSrc(rp_acq_trig_src_t* source);
  */
 int rp_AcqGetTriggerState(rp_acq_trig_state_t* state);
 
+/**
+ * Blocks until the trigger has happened, instead of spinning on rp_AcqGetTriggerState().
+ * The interrupt of the api UIO device is used when the FPGA image provides one, otherwise
+ * the trigger state is polled with an adaptive sleep bounded by the buffer fill time.
+ * A trigger source that the FPGA cleared after rp_AcqSetTriggerSrc() also counts as triggered.
+ * @param timeout_ms Time limit, 0 only checks the current state.
+ * @return RP_OK once triggered, RP_ETIM if the time limit expired first.
+ */
+int rp_AcqWaitTrigger(uint32_t timeout_ms);
+
+/**
+ * Returns a descriptor that becomes readable (POLLIN) on the next acquisition interrupt, for
+ * use in a poll/select loop. After it became readable call rp_AcqWaitTrigger(0), which consumes
+ * the interrupt, arms the next one and tells whether the trigger happened.
+ * @param fd Returns the descriptor, or -1 if there is no interrupt.
+ * @return RP_OK, or RP_NOTS if the loaded FPGA image has no interrupt; use rp_AcqWaitTrigger() then.
+ */
+int rp_AcqGetTriggerFd(int* fd);
+
+/**
+ * Reads the state of CLOCK_REALTIME, which the trigger times are taken from. NTP or PTP
+ * (ptp4l with phc2sys) keep it synchronized; without them the times are only relative.
+ * @param base State of the clock
+ * @return RP_OK, or RP_NOTS if the kernel does not report it.
+ */
+int rp_GetTimeBase(rp_time_base_t* base);
+
 /**
  * Sets the number of decimated data after trigger written into memory.
  * @param decimated_data_num Number of decimated data. It must not be higher than the ADC buffer size.
@@ -885,6 +1225,21 @@ int rp_AcqGetWritePointer(uint32_t* pos);
  */
 int rp_AcqGetWritePointerAtTrig(uint32_t* pos);
 
+/**
+ * Returns position of ADC write pointer at the trigger, and the time of the trigger.
+ * The FPGA has no time stamp register, the trigger is placed in CLOCK_REALTIME from the
+ * write pointer. While the samples after the trigger are still written, the time is
+ * exact to the register read, a few hundred ns. Once the writer stopped, it is only known
+ * to lie between the last time the trigger was seen armed and the time it was seen
+ * triggered; rp_AcqWaitTrigger() keeps that interval short. The time is taken on the
+ * first call after the trigger and kept until the trigger source is set again.
+ * See rp_GetTimeBase() for the state of the clock itself.
+ * @param pos Write pointer position
+ * @param time Time of the trigger
+ * @return RP_OK, or RP_EOOR if the acquisition has not triggered since the trigger source was set.
+ */
+int rp_AcqGetWritePointerAtTrigTime(uint32_t* pos, rp_timestamp_t* time);
+
 /**
  * Starts the acquire. Signals coming from the input channels are acquired and written into memory.
  * @return If the function is successful, the return value is RP_OK.
@@ -951,6 +1306,19 @@ int rp_AcqGetDataPosV(rp_channel_t channel, uint32_t start_pos, uint32_t end_pos
  */
 int rp_AcqGetDataRaw(rp_channel_t channel,  uint32_t pos, uint32_t* size, int16_t* buffer);
 
+/**
+ * Returns the mapped ADC buffer of a channel for processing in place, without the copy of rp_AcqGetDataRaw().
+ * The buffer is a ring of view->size samples that the FPGA keeps writing while the acquisition runs;
+ * samples older than write_pos may be overwritten while they are read. Each word holds a two's complement
+ * sample in its low ADC_BITS bits, before calibration. rp_AcqPrepareReadout() gives the matching DC offset and scale.
+ * The pointer stays valid until rp_Release().
+ * @param channel Channel A or B.
+ * @param view Returns the buffer and a snapshot of the write and trigger pointers.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_AcqGetRawBufferView(rp_channel_t channel, rp_acq_raw_view_t* view);
+
 /**
  * Returns the ADC buffer in raw units from specified position and desired size.
  * Output buffer must be at least 'size' long.
@@ -1010,6 +1378,86 @@ int rp_AcqGetDataV(rp_channel_t channel, uint32_t pos, uint32_t* size, float* bu
  */
 int rp_AcqGetDataV2(uint32_t pos, uint32_t* size, float* buffer1, float* buffer2);
 
+/**
+ * Takes a snapshot of the gains and calibration of both channels for rp_AcqGetDataVPrepared().
+ * @param readout The snapshot to fill.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_AcqPrepareReadout(rp_acq_readout_t* readout);
+
+/**
+ * Returns the ADC buffer of both channels in Volt units, like rp_AcqGetDataV2(), using a prepared snapshot.
+ * The snapshot is refreshed first if the gain or calibration changed since it was taken.
+ * Output buffers must be at least 'size' long.
+ * @param readout Snapshot filled by rp_AcqPrepareReadout().
+ * @param pos Starting position of the ADC buffer to retrieve
+ * @param size Length of the ADC buffer to retrieve. Returns length of filled buffer. In case of too small buffer, required size is returned.
+ * @param buffer1 The output buffer for channel 1, NULL skips the channel.
+ * @param buffer2 The output buffer for channel 2, NULL skips the channel.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_AcqGetDataVPrepared(rp_acq_readout_t* readout, uint32_t pos, uint32_t* size, float* buffer1, float* buffer2);
+
+/**
+ * Returns the ADC buffer in Volt units reduced to a number of bins, e.g. the width of a display.
+ * Bin i holds the samples from i * size / bins up to (i + 1) * size / bins, so the bins
+ * differ by at most one sample in length. The min/max envelope keeps short glitches visible.
+ * @param channel Channel A or B for which we want to retrieve the ADC buffer.
+ * @param pos Starting position of the ADC buffer to retrieve.
+ * @param size Number of samples to reduce, at most ADC_BUFFER_SIZE.
+ * @param mode RP_ACQ_BIN_MEAN or RP_ACQ_BIN_MINMAX.
+ * @param bins Number of bins, between 1 and size.
+ * @param buffer1 At least 'bins' long, gets the means, or the minimums for RP_ACQ_BIN_MINMAX.
+ * @param buffer2 At least 'bins' long, gets the maximums for RP_ACQ_BIN_MINMAX; unused with RP_ACQ_BIN_MEAN.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_AcqGetDataVBinned(rp_channel_t channel, uint32_t pos, uint32_t size, rp_acq_bin_mode_t mode, uint32_t bins, float* buffer1, float* buffer2);
+
+/**
+ * Captures several short records back to back, re-arming the trigger in between.
+ * The ADC keeps writing (arm keep) during the whole capture and the trigger is re-armed
+ * as soon as a record is complete, before the record is copied, so the dead time between
+ * records is a register round trip instead of a full start/poll/read cycle.
+ * The trigger source set with rp_AcqSetTriggerSrc() is used. The trigger delay and the
+ * arm keep setting are restored and the acquisition is stopped when the function returns.
+ * Samples are written in calibrated counts, like rp_AcqGetDataRaw().
+ * @param records Number of records to capture.
+ * @param record_size Samples per record, at most half of the ADC buffer.
+ * @param pre_trigger Samples of each record before its trigger, less than record_size.
+ * @param buffer1 Channel 1 output, records * record_size long. NULL skips the channel.
+ * @param buffer2 Channel 2 output, records * record_size long. NULL skips the channel.
+ * @param info Per-record trigger position and state, records long.
+ * @param timeout_ms Time limit for the whole capture.
+ * @param captured Returns the number of records captured, also on timeout.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ * RP_ETIM is returned if the time limit expired before all records were captured.
+ */
+int rp_AcqCaptureRecords(uint32_t records, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* info, uint32_t timeout_ms, uint32_t* captured);
+
+/**
+ * Coherent average of triggered records. Captures like rp_AcqCaptureRecords(), but
+ * every record is added to 32-bit sums aligned on its trigger position as soon as it
+ * is copied, and only the averaged record is returned. Uncorrelated noise drops with
+ * the square root of the number of records.
+ * Records the ADC overwrote before they were copied are left out of the average.
+ * @param records Number of triggers to capture, at most ACQ_AVERAGE_MAX_RECORDS.
+ * @param record_size Samples per record, at most half of the ADC buffer.
+ * @param pre_trigger Samples of each record before its trigger, less than record_size.
+ * @param buffer1 Channel 1 average in Volts, record_size long. NULL skips the channel.
+ * @param buffer2 Channel 2 average in Volts, record_size long. NULL skips the channel.
+ * @param timeout_ms Time limit for the whole capture.
+ * @param averaged Returns the number of records in the average, also on timeout.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ * RP_ETIM is returned if the time limit expired, the buffers then hold the average of the
+ * records captured so far.
+ */
+int rp_AcqCaptureAverage(uint32_t records, uint32_t record_size, uint32_t pre_trigger, float* buffer1, float* buffer2, uint32_t timeout_ms, uint32_t* averaged);
+
 /**
  * Returns the ADC buffer in Volt units from the oldest sample to the newest one.
  * Output buffer must be at least 'size' long.
@@ -1173,6 +1621,34 @@ int rp_GenGetWaveform(rp_channel_t channel, rp_waveform_t *type);
 */
 int rp_GenArbWaveform(rp_channel_t channel, float *waveform, uint32_t length);
 
+/**
+* Sets user defined waveform given in DAC counts.
+* The samples are 14 bit signed values (-8192 ... 8191) that are written to the DAC table as
+* they are, without the float validation and conversion of rp_GenArbWaveform().
+* rp_GenGetArbWaveform() returns them scaled back to the normalized float range.
+* @param channel Channel A or B for witch we want to set waveform.
+* @param waveform Waveform in DAC counts.
+* @param length Length of waveform.
+* @return If the function is successful, the return value is RP_OK.
+* If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+*/
+int rp_GenArbWaveformRaw(rp_channel_t channel, const int16_t *waveform, uint32_t length);
+
+/**
+* Replaces the user defined waveform of a channel while it keeps playing.
+* The FPGA has a single table per channel, so the samples are rewritten in playback order
+* right behind the read pointer, and only those that change. The new waveform is in place
+* one period later without stopping the output; while the upload is slower than one period
+* the output passes through the old and new shapes at one point per period.
+* If the channel does not play an arbitrary waveform of the same length, this acts like rp_GenArbWaveform().
+* @param channel Channel A or B for witch we want to set waveform.
+* @param waveform Use defined wave form, where min is -1V an max is 1V.
+* @param length Length of waveform.
+* @return If the function is successful, the return value is RP_OK.
+* If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+*/
+int rp_GenArbWaveformUpdate(rp_channel_t channel, float *waveform, uint32_t length);
+
 /**
 * Gets user defined waveform.
 * @param channel Channel A or B for witch we want to get waveform.
@@ -1183,6 +1659,26 @@ int rp_GenArbWaveform(rp_channel_t channel, float *waveform, uint32_t length);
 */
 int rp_GenGetArbWaveform(rp_channel_t channel, float *waveform, uint32_t *length);
 
+/**
+* Loads a sequence of bursts of different segments, counts, periods and amplitudes that
+* plays back-to-back without gaps and without the CPU. The entries are rendered once into
+* the DAC table, which the FPGA then plays at sample_rate, so every segment starts on its
+* sample. In RP_GEN_MODE_BURST with a burst count of 1 each trigger plays the sequence once,
+* burst repetitions and period repeat it, in continuous mode it loops. The channel is set to
+* the arbitrary waveform, rp_GenAmp() and rp_GenOffset() apply to the whole sequence.
+* @param channel Channel A or B.
+* @param table Segments the entries refer to, where min is -1V an max is 1V.
+* @param table_length Length of the table.
+* @param entries Bursts in playing order.
+* @param count Number of entries.
+* @param sample_rate Samples per second of the table and the entries, at most DAC_FREQUENCY.
+* @return If the function is successful, the return value is RP_OK. RP_EOOR if a segment is
+* outside the table, a period is shorter than its segment, the sequence is longer than the
+* DAC table (16384 samples) or the rate is out of range, RP_ENN if a sample is out of -1 ... 1.
+*/
+int rp_GenSequence(rp_channel_t channel, const float *table, uint32_t table_length,
+                   const rp_gen_seq_entry_t *entries, uint32_t count, float sample_rate);
+
 /**
 * Sets duty cycle of PWM signal.
 * @param channel Channel A or B for witch we want to set duty cycle.
@@ -1300,6 +1796,49 @@ int rp_GenGetTriggerSource(rp_channel_t channel, rp_trig_src_t *src);
 */
 int rp_GenTrigger(uint32_t channel);
 
+/**
+ * Runs a frequency sweep of one generator channel and captures one record per step.
+ * Each step writes amplitude, frequency and decimation in one register batch, waits the
+ * settling time against an absolute deadline and takes its record with the segmented
+ * capture of rp_AcqCaptureRecords(), so the sweep runs without per-point round trips
+ * through the caller. The generator has to be enabled and the acquisition configured
+ * (gain, trigger level) beforehand; the trigger source is disabled when the function returns.
+ * @param sweep Sweep description.
+ * @param record_size Samples per record, at most half of the ADC buffer.
+ * @param pre_trigger Samples of each record before its trigger, less than record_size.
+ * @param buffer1 Channel 1 output, points * record_size long, in calibrated counts. NULL skips the channel.
+ * @param buffer2 Channel 2 output, points * record_size long, in calibrated counts. NULL skips the channel.
+ * @param points Per-step frequency, amplitude and record info, sweep->points long.
+ * @param timeout_ms Time limit for the whole sweep.
+ * @param done Returns the number of steps completed, also on error.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ * RP_ETIM is returned if the time limit expired before the sweep was complete.
+ */
+int rp_GenSweep(const rp_sweep_t* sweep, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_sweep_point_t* points, uint32_t timeout_ms, uint32_t* done);
+
+/**
+ * Plays one burst of a generator channel and captures the response in one record.
+ * The channel is stopped, the acquisition is armed on RP_TRIG_SRC_AWG_PE and the
+ * burst is started only then, so the stimulus starts at sample pre_trigger of the
+ * record plus a constant FPGA pipeline delay on every call, with no sleeps or
+ * repeated captures. The burst is the one set with rp_GenBurstCount() and rp_GenBurstRepetitions();
+ * the channel is left in burst mode. The generator has to be enabled and the
+ * acquisition configured (decimation, gain) beforehand; the trigger source is
+ * disabled when the function returns.
+ * @param channel Generator channel.
+ * @param record_size Samples of the record, at most half of the ADC buffer.
+ * @param pre_trigger Samples of the record before the burst starts, less than record_size.
+ * @param buffer1 Channel 1 output, record_size long, in calibrated counts. NULL skips the channel.
+ * @param buffer2 Channel 2 output, record_size long, in calibrated counts. NULL skips the channel.
+ * @param record Returns the position and time of the record.
+ * @param timeout_ms Time limit for the capture.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ * RP_ETIM is returned if the record was not complete within the time limit.
+ */
+int rp_GenAcqRun(rp_channel_t channel, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* record, uint32_t timeout_ms);
+
 /**
 * Sets the DAC protection mode from overheating. Only works with Redpitaya 250-12 otherwise returns RP_NOTS
 * @param channel Channel A or B for witch we want to set protection.
@@ -1345,9 +1884,262 @@ int rp_GetLatchTempAlarm(rp_channel_t channel, bool *status);
 */
 int rp_GetRuntimeTempAlarm(rp_channel_t channel, bool *status);
 
+///@}
+
+/** @name Telemetry
+ */
+///@{
+
+/**
+ * Takes one telemetry sample from the hardware and publishes it in the shared
+ * memory page that rp_TelemetryRead() reads. Meant for the telemetry service
+ * (rp_telemetryd), which calls it at a fixed rate; one process should publish.
+ * @return If the function is successful, the return value is RP_OK.
+ * If the function is unsuccessful, the return value is any of RP_E* values that indicate an error.
+ */
+int rp_TelemetryUpdate();
+
+/**
+ * Copies the latest published telemetry sample. Does not take any lock nor touch
+ * the hardware, it does not need rp_Init(), so any number of processes may poll it.
+ * Compare time_ns with CLOCK_MONOTONIC to see how old the sample is.
+ * @param telemetry Latest sample.
+ * @return RP_OK, RP_EOMD if the service has not published yet, or RP_ETIM if
+ * the publisher stopped in the middle of an update.
+ */
+int rp_TelemetryRead(rp_telemetry_t *telemetry);
+
+///@}
+
+/** @name Register access statistics
+ * Counted only by a library built with REG_STATS=1, the two clock reads per
+ * access cost about as much as an uncached register access.
+ */
+///@{
+
+/**
+ * Copies the register access counters, one entry per librp function that
+ * touched the FPGA registers since the start or rp_RegStatsReset().
+ * @param stats Array of *count entries.
+ * @param count Size of stats, returns the number of functions.
+ * @return RP_OK, RP_BTS if there were more functions than entries, the first
+ * *count are filled then, or RP_NOTS if the library counts nothing.
+ */
+int rp_RegStatsGet(rp_reg_stats_t* stats, uint32_t* count);
+
+/**
+ * Zeroes the register access counters.
+ * @return RP_OK, or RP_NOTS if the library counts nothing.
+ */
+int rp_RegStatsReset();
+
+///@}
+
+/** @name SPI
+ */
+///@{
+
+/**
+ * Opens the SPI bus of the extension connector. It does not need rp_Init().
+ * @param device spidev device, NULL for /dev/spidev1.0.
+ * @return RP_OK, or RP_EFOB if the device can not be opened.
+ */
+int rp_SpiInit(const char *device);
+
+/**
+ * Closes the SPI bus.
+ * @return RP_OK, or RP_EFCB if closing failed.
+ */
+int rp_SpiRelease();
+
+/**
+ * Sets the clock polarity and phase and the other RP_SPI_* mode bits.
+ * @param mode RP_SPI_* bits combined with |.
+ * @return RP_OK, RP_EFOB if the bus is not open, or RP_EABA if the controller refused the mode.
+ */
+int rp_SpiSetMode(uint32_t mode);
+
+/**
+ * Gets the RP_SPI_* mode bits.
+ * @param mode Current mode bits.
+ * @return RP_OK, RP_EFOB if the bus is not open, or RP_EABA if reading failed.
+ */
+int rp_SpiGetMode(uint32_t *mode);
+
+/**
+ * Sets the default clock of the transfers.
+ * @param speed_hz Clock [Hz].
+ * @return RP_OK, RP_EFOB if the bus is not open, or RP_EABA if the controller refused it.
+ */
+int rp_SpiSetSpeed(uint32_t speed_hz);
+
+/**
+ * Gets the default clock of the transfers.
+ * @param speed_hz Clock [Hz].
+ * @return RP_OK, RP_EFOB if the bus is not open, or RP_EABA if reading failed.
+ */
+int rp_SpiGetSpeed(uint32_t *speed_hz);
+
+/**
+ * Sets the word length, 8 by default.
+ * @param bits Bits per word.
+ * @return RP_OK, RP_EFOB if the bus is not open, or RP_EABA if the controller refused it.
+ */
+int rp_SpiSetBitsPerWord(uint8_t bits);
+
+/**
+ * Gets the word length.
+ * @param bits Bits per word.
+ * @return RP_OK, RP_EFOB if the bus is not open, or RP_EABA if reading failed.
+ */
+int rp_SpiGetBitsPerWord(uint8_t *bits);
+
+/**
+ * Gets how many bytes one kernel message takes, the bufsiz parameter of the
+ * spidev driver (4096 by default). Transfers longer than this are refused.
+ * @param bytes Bytes of one message.
+ * @return RP_OK.
+ */
+int rp_SpiGetMaxMessage(uint32_t *bytes);
+
+/**
+ * Runs the transfers in order with as few system calls as the driver allows,
+ * instead of one read(), write() or ioctl() per transaction. Transfers are
+ * packed into one SPI_IOC_MESSAGE() until the next would exceed
+ * rp_SpiGetMaxMessage() bytes or 256 transfers. Between two such messages the
+ * chip stays selected unless cs_change asks otherwise, which the kernel treats
+ * as a hint the controller may ignore. Queue a register read as a command
+ * transfer followed by a reply transfer without cs_change.
+ * @param xfers Transfers, they are not modified and can be reused.
+ * @param count Number of transfers.
+ * @return RP_OK, RP_EFOB if the bus is not open, RP_EOOR if a transfer is longer than
+ * rp_SpiGetMaxMessage() (nothing is sent then), or RP_EFWB if the transfer failed.
+ */
+int rp_SpiTransfer(const rp_spi_xfer_t *xfers, uint32_t count);
+
+///@}
+
+/** @name I2C
+ */
+///@{
+
+/**
+ * Opens the I2C bus of the extension connector. It does not need rp_Init().
+ * Devices with 8 bit register addresses are accessed with the rp_I2c*Reg*()
+ * functions, anything else with rp_I2cTransfer().
+ * @param device i2c-dev device, NULL for /dev/i2c-0.
+ * @return RP_OK, or RP_EFOB if the device can not be opened.
+ */
+int rp_I2cInit(const char *device);
+
+/**
+ * Closes the I2C bus and drops all register caches.
+ * @return RP_OK, or RP_EFCB if closing failed.
+ */
+int rp_I2cRelease();
+
+/**
+ * Runs the messages with one I2C_RDWR per 42 messages (the kernel limit)
+ * instead of one read() or write() each. Register caches are not updated,
+ * use rp_I2cInvalidateCache() after writing cached registers this way.
+ * @param msgs Messages, data of the read ones is filled.
+ * @param count Number of messages.
+ * @return RP_OK, RP_EFOB if the bus is not open, RP_EFRB or RP_EFWB if a transfer failed.
+ */
+int rp_I2cTransfer(const rp_i2c_msg_t *msgs, uint32_t count);
+
+/**
+ * Reads consecutive registers in one burst: the register address, a repeated
+ * start and len bytes. When all of them are valid in the cache of the device,
+ * the bus is not accessed.
+ * @param addr 7 bit device address.
+ * @param reg First register.
+ * @param data Register values.
+ * @param len Number of registers, reg + len at most 256.
+ * @return RP_OK, RP_EOOR for an address out of range, RP_EFOB if the bus is not open,
+ * or RP_EFRB if the transfer failed.
+ */
+int rp_I2cReadRegs(uint8_t addr, uint8_t reg, uint8_t *data, uint32_t len);
+
+/**
+ * Writes consecutive registers in one message, for devices that increment the
+ * register address. The cache of the device is written through.
+ * @param addr 7 bit device address.
+ * @param reg First register.
+ * @param data Register values.
+ * @param len Number of registers, reg + len at most 256.
+ * @return RP_OK, RP_EOOR for an address out of range, RP_EFOB if the bus is not open,
+ * or RP_EFWB if the transfer failed.
+ */
+int rp_I2cWriteRegs(uint8_t addr, uint8_t reg, const uint8_t *data, uint32_t len);
+
+/**
+ * Writes a configuration of single registers, in order, with one I2C_RDWR per
+ * 42 registers. Cached registers that already hold the value are skipped, so
+ * applying a configuration again only writes what changed.
+ * @param addr 7 bit device address.
+ * @param regs Registers and values.
+ * @param count Number of registers.
+ * @return RP_OK, RP_EOOR for an address out of range, RP_EFOB if the bus is not open,
+ * or RP_EFWB if the transfer failed.
+ */
+int rp_I2cWriteRegList(uint8_t addr, const rp_i2c_reg_t *regs, uint32_t count);
+
+/**
+ * Sets the registers of a device that are cached. Only configuration registers
+ * that just the host changes belong there, never status or data registers.
+ * Values are filled by the reads and writes through this API.
+ * @param addr 7 bit device address.
+ * @param first First cached register.
+ * @param count Number of cached registers, 0 disables the cache of the device.
+ * @return RP_OK, RP_EOOR for a range out of 0 - 255, or RP_EAM if allocation failed.
+ */
+int rp_I2cSetCache(uint8_t addr, uint8_t first, uint32_t count);
+
+/**
+ * Forgets the cached values of a device, after a reset of the device or
+ * writes that bypassed the cache.
+ * @param addr 7 bit device address.
+ * @return RP_OK, or RP_EOOR for an address out of range.
+ */
+int rp_I2cInvalidateCache(uint8_t addr);
+
+///@}
+
 
 float rp_CmnCnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off);
 
+/**
+ * Converts a buffer of raw ADC/DAC counts to volts, the array form of rp_CmnCnvCntToV().
+ * Uses NEON where available and takes no lock; a large buffer can be split between
+ * threads by the caller.
+ * @param field_len Number of bits of a count, 2 - 31.
+ * @param cnts Raw counts, the bits above field_len are ignored.
+ * @param size Number of counts.
+ * @param adc_max_v Full scale voltage of the field [V].
+ * @param calibScale Calibration gain, in the EEPROM full scale format.
+ * @param calib_dc_off Calibration offset [counts].
+ * @param user_dc_off User offset [V].
+ * @param buffer Output, size long [V].
+ * @return RP_OK, RP_UIA for a NULL buffer or RP_EOOR for field_len out of range.
+ */
+int rp_CmnCnvCntsToV(uint32_t field_len, const uint32_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off, float* buffer);
+
+/**
+ * Converts a buffer of calibrated counts, as returned by rp_AcqGetDataRaw() and
+ * rp_AcqCaptureRecords(), to volts. The calibration offset is already removed from them.
+ * Uses NEON where available and takes no lock.
+ * @param field_len Number of bits of a count, 2 - 16.
+ * @param cnts Calibrated counts.
+ * @param size Number of counts.
+ * @param adc_max_v Full scale voltage of the field [V].
+ * @param calibScale Calibration gain, in the EEPROM full scale format.
+ * @param user_dc_off User offset [V].
+ * @param buffer Output, size long [V].
+ * @return RP_OK, RP_UIA for a NULL buffer or RP_EOOR for field_len out of range.
+ */
+int rp_CmnCnvCalibCntsToV(uint32_t field_len, const int16_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, float user_dc_off, float* buffer);
+
 #ifdef __cplusplus
 }
 #endif
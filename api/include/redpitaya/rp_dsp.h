@@ -0,0 +1,322 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya shared DSP helpers.
+ *
+ * One FFT implementation for librp and the applications. Plans and window
+ * tables are cached by length, so the twiddles are computed once per process
+ * instead of in every application init, and work buffers are cache line
+ * aligned.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_DSP_H
+#define __RP_DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Alignment of the buffers returned by rp_DspAlloc() */
+#define RP_DSP_ALIGN 64
+
+/** Window functions, all symmetric with a peak of 1 */
+typedef enum {
+    RP_DSP_WIN_RECT,            //!< No window
+    RP_DSP_WIN_HANN,            //!< 0.5 * (1 - cos)
+    RP_DSP_WIN_BLACKMAN_HARRIS, //!< 4 term, -92 dB side lobes
+    RP_DSP_WIN_FLAT_TOP,        //!< 5 term, tone amplitude flat to 0.02 dB across a bin
+    RP_DSP_WIN_KAISER,          //!< Kaiser-Bessel, shape set by beta
+    RP_DSP_WIN_COUNT
+} rp_dsp_win_t;
+
+/** One complex FFT bin, same layout as kiss_fft_cpx */
+typedef struct {
+    double r;
+    double i;
+} rp_dsp_cpx_t;
+
+/** Measurements of one raw ADC record, see rp_DspMeasure() */
+typedef struct {
+    int    min;
+    int    max;
+    double mean;
+    double rms;        //!< Square root of the mean square, the mean included
+    int    edges;      //!< Rising transitions through the hysteresis band
+    int    first_edge; //!< Samples from start to the first edge
+    int    last_edge;  //!< Samples from start to the last edge
+    double period;     //!< Mean samples per period from the first to the last edge, 0 with less than 2 edges
+    double thr_low;    //!< Hysteresis band the edges are counted with, 20 % of max - min around the middle
+    double thr_high;
+} rp_dsp_meas_t;
+
+/** Sine wave fitted by rp_DspSineFit(), in[n] ~ amp * cos(2*pi*freq*n + phase) + offset */
+typedef struct {
+    double freq;       //!< Cycles per sample
+    double amp;
+    double phase;      //!< [rad] at in[0]
+    double offset;
+    double rms_err;    //!< RMS of the residual
+    int    iterations; //!< Frequency corrections done
+} rp_dsp_sine_t;
+
+/** Delay between two signals measured by rp_DspXcorr() */
+typedef struct {
+    double delay;  //!< Samples in2 lags in1, negative if it leads, interpolated between samples
+    double coeff;  //!< Normalized correlation at the delay, up to 1; 0 if a signal is constant
+    double phase;  //!< [deg] of in2 relative to in1 at freq, -180 to 180, negative if in2 lags
+    double freq;   //!< Cycles per sample of the strongest bin of the cross spectrum
+} rp_dsp_xcorr_t;
+
+/** @name Shared DSP
+ * The functions return RP_OK (0) on success or one of the RP_E* values
+ * from rp.h. Calls are serialized on one lock, so they are safe to use
+ * from several threads.
+ */
+///@{
+
+/**
+ * Forward FFT of a real signal.
+ * @param len Number of input samples, must be even.
+ * @param in len input samples.
+ * @param out Receives the len/2 + 1 bins from DC to Nyquist, not scaled.
+ * @return RP_OK, RP_EOOR if len is not valid or RP_EAM if the plan can not be allocated.
+ */
+int rp_DspFftReal(int len, const double *in, rp_dsp_cpx_t *out);
+
+/**
+ * Forward FFT of two real signals of the same length, done as one complex
+ * transform with in1 as the real and in2 as the imaginary part instead of
+ * two rp_DspFftReal() calls.
+ * @param len Number of samples per signal, must be even.
+ * @param in1 len samples of the first signal.
+ * @param in2 len samples of the second signal.
+ * @param out1 Receives the len/2 + 1 bins of in1, not scaled.
+ * @param out2 Receives the len/2 + 1 bins of in2.
+ * @return RP_OK, RP_EOOR if len is not valid or RP_EAM if the plan can not be allocated.
+ */
+int rp_DspFftReal2(int len, const double *in1, const double *in2, rp_dsp_cpx_t *out1, rp_dsp_cpx_t *out2);
+
+/**
+ * Inverse FFT to a real signal.
+ * @param len Number of output samples, must be even.
+ * @param in The len/2 + 1 bins from DC to Nyquist.
+ * @param out Receives len samples, scaled by len like kiss_fftri().
+ * @return RP_OK, RP_EOOR if len is not valid or RP_EAM if the plan can not be allocated.
+ */
+int rp_DspFftRealInv(int len, const rp_dsp_cpx_t *in, double *out);
+
+/**
+ * Amplitudes |X[k]| of a real signal. Power of two lengths use the single
+ * precision transform, the others kiss_fft.
+ * @param len Number of input samples, must be even.
+ * @param in len input samples.
+ * @param out Receives the amplitudes of bins 0 to out_len - 1.
+ * @param out_len Number of bins, at most len/2.
+ * @return RP_OK, RP_EOOR if len or out_len is not valid or RP_EAM if the plan can not be allocated.
+ */
+int rp_DspFftAbs(int len, const double *in, double *out, int out_len);
+
+/**
+ * Amplitudes of the windowed signal, see rp_DspFftAbs(). The window is
+ * applied while the samples are loaded into the transform, in is left
+ * unchanged.
+ * @param type Window function.
+ * @param beta Kaiser shape parameter, ignored by the other windows.
+ * @param amp Scale of the window table.
+ * @param len Number of input samples, must be even.
+ * @param in len input samples.
+ * @param out Receives the amplitudes of bins 0 to out_len - 1.
+ * @param out_len Number of bins, at most len/2.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the plan can not be allocated.
+ */
+int rp_DspFftAbsWindow(rp_dsp_win_t type, double beta, double amp, int len, const double *in, double *out, int out_len);
+
+/**
+ * Same as rp_DspFftAbsWindow() with the window amp * (1 - cos(2*pi*n / (len - 1))).
+ */
+int rp_DspFftAbsHann(int len, double amp, const double *in, double *out, int out_len);
+
+/**
+ * Amplitudes of two real signals of the same length, see rp_DspFftAbs().
+ * Both go through one complex transform of len points instead of two real
+ * transforms, which saves the split pass of each.
+ * @param len Number of samples per signal, must be even.
+ * @param in1 len samples of the first signal.
+ * @param in2 len samples of the second signal.
+ * @param out1 Receives the amplitudes of in1, bins 0 to out_len - 1.
+ * @param out2 Receives the amplitudes of in2.
+ * @param out_len Number of bins, at most len/2.
+ * @return RP_OK, RP_EOOR if len or out_len is not valid or RP_EAM if the plan can not be allocated.
+ */
+int rp_DspFftAbs2(int len, const double *in1, const double *in2, double *out1, double *out2, int out_len);
+
+/**
+ * Windowed amplitudes of two signals, see rp_DspFftAbsWindow() and rp_DspFftAbs2().
+ */
+int rp_DspFftAbsWindow2(rp_dsp_win_t type, double beta, double amp, int len, const double *in1, const double *in2,
+                        double *out1, double *out2, int out_len);
+
+/**
+ * Zoom FFT, amplitudes of a narrow band around f0. The signal is mixed down
+ * by f0, low pass filtered and decimated by dec, windowed and transformed
+ * as a complex signal zero padded to out_len. Tone amplitudes read the same
+ * as in rp_DspFftAbsWindow() of the full record.
+ * @param type Window function, applied to the len/dec decimated samples.
+ * @param beta Kaiser shape parameter, ignored by the other windows.
+ * @param amp Scale of the window table.
+ * @param len Number of input samples.
+ * @param in len input samples.
+ * @param f0 Center frequency in cycles per sample, 0 to 0.5.
+ * @param dec Decimation, the band is 1/dec of the sample rate wide.
+ * @param out Receives out_len amplitudes from f0 - 0.5/dec to f0 + 0.5/dec, f0 at out_len/2.
+ * @param out_len Number of bins, at least len/dec.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the buffers can not be allocated.
+ */
+int rp_DspZoomFftAbs(rp_dsp_win_t type, double beta, double amp, int len, const double *in,
+                     double f0, int dec, double *out, int out_len);
+
+/**
+ * Multiplies the signal with amp times the window. Tables are computed once
+ * per type, beta, amp and length and then reused.
+ * @param type Window function.
+ * @param beta Kaiser shape parameter, ignored by the other windows.
+ * @param amp Scale of the window table.
+ * @param len Number of samples, at least 2.
+ * @param in len input samples.
+ * @param out Receives the windowed samples, may be the same as in.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the table can not be allocated.
+ */
+int rp_DspWindowApply(rp_dsp_win_t type, double beta, double amp, int len, const double *in, double *out);
+
+/**
+ * Applies the Hann window amp * (1 - cos(2*pi*n / (len - 1))).
+ * @param len Number of samples, at least 2.
+ * @param amp Window amplitude.
+ * @param in len input samples.
+ * @param out Receives the windowed samples, may be the same as in.
+ * @return RP_OK, RP_EOOR if len is not valid or RP_EAM if the table can not be allocated.
+ */
+int rp_DspWindowHann(int len, double amp, const double *in, double *out);
+
+/**
+ * Correction factors of a window with a peak of 1. A tone of amplitude A in
+ * the middle of a bin reads A * coherent_gain, broadband noise power reads
+ * enbw times the power of the unwindowed noise per bin. The RMS
+ * normalization, used to keep noise levels, is 1 / (coherent_gain * sqrt(enbw)).
+ * @param type Window function.
+ * @param beta Kaiser shape parameter, ignored by the other windows.
+ * @param len Window length, at least 2.
+ * @param coherent_gain Receives sum(w) / len, may be NULL.
+ * @param enbw Receives len * sum(w^2) / sum(w)^2 in bins, may be NULL.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the table can not be allocated.
+ */
+int rp_DspWindowGain(rp_dsp_win_t type, double beta, int len, double *coherent_gain, double *enbw);
+
+/**
+ * Quadrature demodulation, a single bin DFT of every channel at every
+ * frequency: out[c * bins + b] = 2/len * sum x_c[n] * exp(-j*2*pi*freq[b]*n).
+ * A cosine A * cos(2*pi*f*n + phi) over a whole number of periods reads
+ * A * exp(j*phi). The reference oscillators are computed by recurrence once
+ * per block and shared by all channels, the products are accumulated in
+ * single precision per block and in double across blocks.
+ * @param channels Number of input signals, at least 1.
+ * @param len Number of samples of every signal, at least 1.
+ * @param in channels pointers to len samples.
+ * @param bins Number of frequencies, at least 1.
+ * @param freq Frequencies in cycles per sample.
+ * @param out Receives channels * bins values.
+ * @return RP_OK or RP_EOOR if an argument is not valid.
+ */
+int rp_DspDemod(int channels, int len, const float *const *in, int bins, const double *freq, rp_dsp_cpx_t *out);
+
+/**
+ * Measures a raw ADC record in one pass: min, max, mean, RMS and the rising
+ * edges through a hysteresis band for the period. The record may be a ring
+ * buffer, it is read from in[start] to the end and on from in[0].
+ * The band follows from min and max, which are only known at the end, so the
+ * edges are counted against the band of prev, the result of the previous
+ * record of the same signal. If prev is NULL or its band is off by more than
+ * 1/8 of the new band, the edges are counted again in a second pass.
+ * @param in len raw samples, two's complement in the low bits.
+ * @param len Number of samples, at least 1.
+ * @param start Index of the first sample, 0 to len - 1.
+ * @param bits ADC resolution, 2 to 16, the bits above are ignored.
+ * @param prev Result of the previous record or NULL, may be the same as meas.
+ * @param meas Receives the results.
+ * @return RP_OK or RP_EOOR if an argument is not valid.
+ */
+int rp_DspMeasure(const int32_t *in, int len, int start, int bits, const rp_dsp_meas_t *prev, rp_dsp_meas_t *meas);
+
+/**
+ * Least squares sine fit of IEEE Std 1057. With iterations 0 only amplitude,
+ * phase and offset are fitted at freq (three parameter fit). Otherwise the
+ * frequency is corrected too (four parameter fit), up to iterations times or
+ * until the correction is below 1e-6 cycles over the record. freq must be
+ * within about one cycle over the record of the signal, e.g. from the edges of
+ * rp_DspMeasure(). The normal equations are accumulated in single precision
+ * per block and in double across blocks, the time is counted from the middle
+ * of the record to keep them well conditioned.
+ * @param len Number of samples, at least 4.
+ * @param in len samples.
+ * @param freq Start frequency in cycles per sample, 0 to 0.5.
+ * @param iterations Largest number of frequency corrections, 0 or more.
+ * @param fit Receives the result.
+ * @return RP_OK or RP_EOOR if an argument is not valid or the fit leaves the
+ *         frequencies between 0 and 0.5.
+ */
+int rp_DspSineFit(int len, const float *in, double freq, int iterations, rp_dsp_sine_t *fit);
+
+/**
+ * Delay and phase between two signals from their cross-correlation. The means
+ * are removed, both signals go zero padded through one complex transform, the
+ * correlation comes back from the cross spectrum through the real inverse
+ * transform. The delay is the lag of the largest positive correlation within
+ * max_lag, refined between samples by a parabola through it and its two
+ * neighbours. A periodic signal correlates once per period, its delay is only
+ * known within a period. The phase is taken at the strongest bin of the cross
+ * spectrum, for a sine it is its phase difference.
+ * @param len Number of samples of every signal, at least 4.
+ * @param in1 len samples of the reference signal.
+ * @param in2 len samples of the delayed signal.
+ * @param max_lag Largest delay searched in samples, 1 to len - 2. The correlation
+ *        at a lag l is summed over the len - |l| samples that overlap.
+ * @param res Receives the result.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the plans can not be allocated.
+ */
+int rp_DspXcorr(int len, const float *in1, const float *in2, int max_lag, rp_dsp_xcorr_t *res);
+
+/**
+ * Allocates a work buffer aligned to RP_DSP_ALIGN bytes.
+ * @param size Size in bytes.
+ * @return The buffer or NULL, release it with rp_DspFree().
+ */
+void *rp_DspAlloc(size_t size);
+
+/**
+ * Releases a buffer from rp_DspAlloc(), NULL is ignored.
+ */
+void rp_DspFree(void *ptr);
+
+/**
+ * Frees all cached plans and window tables. They are rebuilt on the next use.
+ */
+void rp_DspRelease(void);
+
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__RP_DSP_H
@@ -0,0 +1,159 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya streaming filters.
+ *
+ * Polyphase FIR resamplers, CIC decimators and interpolators and biquad
+ * cascades for post acquisition processing. Every filter keeps its state
+ * between calls, so a long signal can be passed in blocks of any size and
+ * gives the same output as one call. A filter object is not locked, use
+ * one per thread or channel.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_FILTER_H
+#define __RP_FILTER_H
+
+#include <stdint.h>
+
+#include "redpitaya/rp_dsp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rp_filter_fir_s rp_filter_fir_t;
+typedef struct rp_filter_cic_s rp_filter_cic_t;
+typedef struct rp_filter_iir_s rp_filter_iir_t;
+
+/** Biquad responses of rp_FilterBiquadDesign() */
+typedef enum {
+    RP_FILTER_LOWPASS,
+    RP_FILTER_HIGHPASS,
+    RP_FILTER_BANDPASS,   //!< 0 dB at f0
+    RP_FILTER_NOTCH
+} rp_filter_type_t;
+
+/** @name Filters
+ * The functions return RP_OK (0) on success or one of the RP_E* values
+ * from rp.h. Frequencies are in cycles per sample of the filter input.
+ */
+///@{
+
+/**
+ * Windowed sinc low pass.
+ * @param taps Receives num_taps coefficients.
+ * @param num_taps Filter length, at least 2.
+ * @param cutoff Cut off frequency, 0 to 0.5.
+ * @param gain DC gain, use the interpolation factor for an interpolator.
+ * @param win Window function.
+ * @param beta Kaiser shape parameter, ignored by the other windows.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the window can not be allocated.
+ */
+int rp_FilterFirDesign(float *taps, int num_taps, double cutoff, double gain, rp_dsp_win_t win, double beta);
+
+/**
+ * Creates a polyphase FIR resampler by interp / dec. The taps are the
+ * prototype filter at interp times the input rate, only the phases that
+ * reach an output are computed.
+ * @param fir Receives the filter, release it with rp_FilterFirDestroy().
+ * @param taps num_taps coefficients, copied.
+ * @param num_taps Filter length, at least 1.
+ * @param interp Interpolation factor, at least 1.
+ * @param dec Decimation factor, at least 1.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the filter can not be allocated.
+ */
+int rp_FilterFirCreate(rp_filter_fir_t **fir, const float *taps, int num_taps, int interp, int dec);
+
+/**
+ * Filters the next block of the signal.
+ * @param fir Filter.
+ * @param in in_len input samples.
+ * @param in_len Number of input samples.
+ * @param out Receives the output samples.
+ * @param out_max Size of out, at least rp_FilterFirOutLen(fir, in_len).
+ * @param out_len Receives the number of output samples.
+ * @return RP_OK or RP_EOOR if out is too small.
+ */
+int rp_FilterFirProcess(rp_filter_fir_t *fir, const float *in, int in_len, float *out, int out_max, int *out_len);
+
+/**
+ * Largest number of outputs rp_FilterFirProcess() gives for in_len inputs.
+ */
+int rp_FilterFirOutLen(const rp_filter_fir_t *fir, int in_len);
+
+/**
+ * Clears the delay line, the next input is the start of a new signal.
+ */
+void rp_FilterFirReset(rp_filter_fir_t *fir);
+void rp_FilterFirDestroy(rp_filter_fir_t *fir);
+
+/**
+ * Creates a CIC decimator or interpolator. The integrators run in 64 bit
+ * wrapping arithmetic, so the output is exact for any input of up to 32
+ * bits. The output is scaled to a DC gain of 1.
+ * @param cic Receives the filter, release it with rp_FilterCicDestroy().
+ * @param stages Number of integrator and comb stages, 1 to 6.
+ * @param rate Decimation or interpolation factor, at least 1.
+ * @param diff_delay Comb differential delay, 1 or 2.
+ * @param interpolate 0 for a decimator, 1 for an interpolator.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the filter can not be allocated.
+ */
+int rp_FilterCicCreate(rp_filter_cic_t **cic, int stages, int rate, int diff_delay, int interpolate);
+
+/**
+ * Filters the next block of the signal, for example ADC counts.
+ * @param cic Filter.
+ * @param in in_len input samples.
+ * @param in_len Number of input samples.
+ * @param out Receives in_len / rate outputs of a decimator, at most one more
+ *        when the previous block did not end on a multiple of rate, or
+ *        in_len * rate outputs of an interpolator.
+ * @param out_max Size of out.
+ * @param out_len Receives the number of output samples.
+ * @return RP_OK or RP_EOOR if out is too small.
+ */
+int rp_FilterCicProcess(rp_filter_cic_t *cic, const int32_t *in, int in_len, float *out, int out_max, int *out_len);
+void rp_FilterCicReset(rp_filter_cic_t *cic);
+void rp_FilterCicDestroy(rp_filter_cic_t *cic);
+
+/**
+ * Biquad coefficients after the RBJ audio EQ cookbook.
+ * @param type Response.
+ * @param f0 Corner or center frequency, 0 to 0.5.
+ * @param q Quality factor, 0.7071 for a Butterworth low or high pass.
+ * @param coeffs Receives b0, b1, b2, a1, a2 with a0 normalized to 1.
+ * @return RP_OK or RP_EOOR if an argument is not valid.
+ */
+int rp_FilterBiquadDesign(rp_filter_type_t type, double f0, double q, float *coeffs);
+
+/**
+ * Creates a cascade of biquad sections in transposed direct form II.
+ * @param iir Receives the filter, release it with rp_FilterIirDestroy().
+ * @param coeffs 5 coefficients per section as from rp_FilterBiquadDesign(), copied.
+ * @param sections Number of sections, at least 1.
+ * @return RP_OK, RP_EOOR if an argument is not valid or RP_EAM if the filter can not be allocated.
+ */
+int rp_FilterIirCreate(rp_filter_iir_t **iir, const float *coeffs, int sections);
+
+/**
+ * Filters the next len samples, out may be the same as in.
+ */
+int rp_FilterIirProcess(rp_filter_iir_t *iir, const float *in, float *out, int len);
+void rp_FilterIirReset(rp_filter_iir_t *iir);
+void rp_FilterIirDestroy(rp_filter_iir_t *iir);
+
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__RP_FILTER_H
@@ -16,6 +16,14 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ACQ_USE_NEON
+#endif
 
 #include "common.h"
 #include "calib.h"
@@ -42,6 +50,16 @@ static const uint64_t ADC_SAMPLE_PERIOD = ADC_SAMPLE_PERIOD_DEF;
 static rp_pinState_t gain_ch_a = RP_LOW;
 static rp_pinState_t gain_ch_b = RP_LOW;
 
+/* @brief Counts gain changes, starts at 1 so a zeroed readout snapshot is never current */
+static uint32_t gain_generation = 1;
+
+/* @brief Last value written to the arm keep bit, the register is not read back */
+static bool arm_keep = false;
+
+/* @brief Readout snapshot used by acq_GetDataV() and acq_GetDataV2(), readers refresh it under readout_lock */
+static rp_acq_readout_t readout_cache;
+static pthread_mutex_t readout_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* @brief Determines whether TriggerDelay was set in time or sample units */
 static bool triggerDelayInNs = false;
 
@@ -122,6 +140,7 @@ static int setEqFilters(rp_channel_t channel)
 /*----------------------------------------------------------------------------*/
 
 int acq_SetArmKeep(bool enable) {
+    arm_keep = enable;
     return osc_SetArmKeep(enable);
 }
 
@@ -166,6 +185,7 @@ int acq_SetGain(rp_channel_t channel, rp_pinState_t state)
         status = setEqFilters(channel);
     }
 
+    gain_generation++;
     return status;
 }
 
@@ -332,9 +352,71 @@ int acq_GetAveraging(bool* enable)
     return osc_GetAveraging(enable);
 }
 
+/*
+ * Trigger time. The FPGA has no time stamp register, the trigger is placed in
+ * CLOCK_REALTIME from the write pointer. While the ADC still writes the
+ * samples after the trigger, it lies the samples written since the trigger
+ * before the read of the pointer. Once the writer stopped, it is only known
+ * to be after the last time the trigger was seen armed and at least the
+ * samples after the trigger before it was seen triggered.
+ */
+static pthread_mutex_t trig_time_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t trig_armed_ns;     // CLOCK_REALTIME the trigger was last seen armed
+static bool trig_time_valid;
+static rp_timestamp_t trig_time;
+
+static void trigArmed(int64_t now_ns)
+{
+    pthread_mutex_lock(&trig_time_lock);
+    trig_armed_ns = now_ns;
+    trig_time_valid = false;
+    pthread_mutex_unlock(&trig_time_lock);
+}
+
+static void stampTrigger()
+{
+    pthread_mutex_lock(&trig_time_lock);
+    if (!trig_time_valid) {
+        uint32_t trig_pos = 0;
+        uint32_t delay = 0;
+        uint32_t decimation = 1;
+        uint32_t pos = 0;
+        osc_GetWritePointerAtTrig(&trig_pos);
+        osc_GetTriggerDelay(&delay);
+        acq_GetDecimationFactor(&decimation);
+        int64_t before = cmn_RealtimeNs();
+        osc_GetWritePointer(&pos);
+        int64_t after = cmn_RealtimeNs();
+        int64_t period = (int64_t)ADC_SAMPLE_PERIOD * decimation;
+        uint32_t written = acq_GetNormalizedDataPos(pos + ADC_BUFFER_SIZE - trig_pos);
+        int64_t first;
+        int64_t last;
+        // With a delay of a buffer or more the samples written since the trigger are ambiguous
+        if (delay < ADC_BUFFER_SIZE && written < delay) {
+            first = before - (int64_t)(written + 1) * period;
+            last = after - (int64_t)written * period;
+        } else {
+            first = trig_armed_ns;
+            last = after - (int64_t)delay * period;
+            if (last < first) {
+                last = after;
+            }
+        }
+        int64_t mid = first + (last - first) / 2;
+        trig_time.sec = mid / 1000000000LL;
+        trig_time.nsec = (uint32_t)(mid % 1000000000LL);
+        trig_time.error_ns = (uint32_t)MIN((uint64_t)(last - first + 1) / 2, UINT32_MAX);
+        trig_time_valid = true;
+    }
+    pthread_mutex_unlock(&trig_time_lock);
+}
+
 int acq_SetTriggerSrc(rp_acq_trig_src_t source)
 {
     last_trig_src = source;
+    if (source != RP_TRIG_SRC_DISABLED) {
+        trigArmed(cmn_RealtimeNs());
+    }
     return osc_SetTriggerSource(source);
 }
 
@@ -586,13 +668,91 @@ uint32_t acq_GetNormalizedDataPos(uint32_t pos)
     return (pos % ADC_BUFFER_SIZE);
 }
 
+/* Sign extension shift and limits of cmn_CalibCnts() for ADC_BITS wide counts */
+#define ADC_SIGN_SHIFT  (32 - ADC_BITS)
+#define ADC_CALIB_MIN   (-(1 << (ADC_BITS - 1)))
+#define ADC_CALIB_MAX   (1 << (ADC_BITS - 1))
+
+/**
+ * Normalizes pos and returns the length of the first contiguous span of a
+ * size samples long read. The rest, if any, starts at the buffer beginning.
+ */
+static uint32_t getFirstSpan(uint32_t *pos, uint32_t size)
+{
+    *pos = acq_GetNormalizedDataPos(*pos);
+    return MIN(size, ADC_BUFFER_SIZE - *pos);
+}
+
+/**
+ * Volts per calibrated count, the scaling of cmn_CnvCntToV() folded into one factor
+ */
+static inline int32_t calibCnts(uint32_t cnts, int32_t dc_offs)
+{
+    int32_t m = ((int32_t)((cnts & ADC_BITS_MASK) << ADC_SIGN_SHIFT)) >> ADC_SIGN_SHIFT;
+    m -= dc_offs;
+    return MAX(ADC_CALIB_MIN, MIN(m, ADC_CALIB_MAX));
+}
+
+/*
+ * The span converters read the uncached buffer with plain word loads, which
+ * go out as bursts, instead of one volatile access per sample. Every call
+ * reads each word once, so dropping volatile here is safe.
+ */
+static void cnvSpanToCalibCnts(const volatile uint32_t* raw, uint32_t size, int16_t* buffer, int32_t dc_offs)
+{
+    const uint32_t* src = (const uint32_t*)raw;
+    uint32_t i = 0;
+#ifdef ACQ_USE_NEON
+    const uint32x4_t mask = vdupq_n_u32(ADC_BITS_MASK);
+    const int32x4_t offs = vdupq_n_s32(dc_offs);
+    const int32x4_t lo = vdupq_n_s32(ADC_CALIB_MIN);
+    const int32x4_t hi = vdupq_n_s32(ADC_CALIB_MAX);
+    for (; i + 8 <= size; i += 8) {
+        int32x4_t m1 = vreinterpretq_s32_u32(vshlq_n_u32(vandq_u32(vld1q_u32(src + i), mask), ADC_SIGN_SHIFT));
+        int32x4_t m2 = vreinterpretq_s32_u32(vshlq_n_u32(vandq_u32(vld1q_u32(src + i + 4), mask), ADC_SIGN_SHIFT));
+        m1 = vminq_s32(vmaxq_s32(vsubq_s32(vshrq_n_s32(m1, ADC_SIGN_SHIFT), offs), lo), hi);
+        m2 = vminq_s32(vmaxq_s32(vsubq_s32(vshrq_n_s32(m2, ADC_SIGN_SHIFT), offs), lo), hi);
+        vst1q_s16(buffer + i, vcombine_s16(vmovn_s32(m1), vmovn_s32(m2)));
+    }
+#endif
+    for (; i < size; ++i) {
+        buffer[i] = calibCnts(src[i], dc_offs);
+    }
+}
+
+static void cnvSpanToV(const volatile uint32_t* raw, uint32_t size, float* buffer, int32_t dc_offs, float scale)
+{
+    const uint32_t* src = (const uint32_t*)raw;
+    uint32_t i = 0;
+#ifdef ACQ_USE_NEON
+    const uint32x4_t mask = vdupq_n_u32(ADC_BITS_MASK);
+    const int32x4_t offs = vdupq_n_s32(dc_offs);
+    const int32x4_t lo = vdupq_n_s32(ADC_CALIB_MIN);
+    const int32x4_t hi = vdupq_n_s32(ADC_CALIB_MAX);
+    for (; i + 4 <= size; i += 4) {
+        int32x4_t m = vreinterpretq_s32_u32(vshlq_n_u32(vandq_u32(vld1q_u32(src + i), mask), ADC_SIGN_SHIFT));
+        m = vminq_s32(vmaxq_s32(vsubq_s32(vshrq_n_s32(m, ADC_SIGN_SHIFT), offs), lo), hi);
+        vst1q_f32(buffer + i, vmulq_n_f32(vcvtq_f32_s32(m), scale));
+    }
+#endif
+    for (; i < size; ++i) {
+        buffer[i] = (float)calibCnts(src[i], dc_offs) * scale;
+    }
+}
+
+static void copySpanMasked(const volatile uint32_t* raw, uint32_t size, uint16_t* buffer)
+{
+    const uint32_t* src = (const uint32_t*)raw;
+    for (uint32_t i = 0; i < size; ++i) {
+        buffer[i] = src[i] & ADC_BITS_MASK;
+    }
+}
+
 int acq_GetDataRaw(rp_channel_t channel, uint32_t pos, uint32_t* size, int16_t* buffer)
 {
 
     *size = MIN(*size, ADC_BUFFER_SIZE);
 
-    uint32_t cnts;
-
     const volatile uint32_t* raw_buffer = getRawBuffer(channel);
 
     rp_pinState_t gain;
@@ -601,16 +761,30 @@ int acq_GetDataRaw(rp_channel_t channel, uint32_t pos, uint32_t* size, int16_t*
     rp_calib_params_t calib = calib_GetParams();
     int32_t dc_offs = GET_OFFSET(channel, gain, calib);
 
-    for (uint32_t i = 0; i < (*size); ++i) {
-        cnts = (raw_buffer[(pos + i) % ADC_BUFFER_SIZE]) & ADC_BITS_MASK;
-
-        buffer[i] = cmn_CalibCnts(ADC_BITS, cnts, dc_offs);
-    }
+    uint32_t first = getFirstSpan(&pos, *size);
+    cnvSpanToCalibCnts(raw_buffer + pos, first, buffer, dc_offs);
+    cnvSpanToCalibCnts(raw_buffer, *size - first, buffer + first, dc_offs);
 
     return RP_OK;
 }
 
 
+int acq_GetRawBufferView(rp_channel_t channel, rp_acq_raw_view_t* view)
+{
+    if (view == NULL || (channel != RP_CH_1 && channel != RP_CH_2)) {
+        return RP_EPN;
+    }
+    const volatile uint32_t* raw_buffer = getRawBuffer(channel);
+    if (raw_buffer == NULL) {
+        return RP_EPN;
+    }
+    view->data = raw_buffer;
+    view->size = ADC_BUFFER_SIZE;
+    osc_GetWritePointer(&view->write_pos);
+    osc_GetWritePointerAtTrig(&view->trigger_pos);
+    return RP_OK;
+}
+
 int acq_GetDataRawV2(uint32_t pos, uint32_t* size, uint16_t* buffer, uint16_t* buffer2)
 {
 
@@ -618,10 +792,11 @@ int acq_GetDataRawV2(uint32_t pos, uint32_t* size, uint16_t* buffer, uint16_t* b
     const volatile uint32_t* raw_buffer = getRawBuffer(RP_CH_1);
     const volatile uint32_t* raw_buffer2 = getRawBuffer(RP_CH_2);
     
-    for (uint32_t i = 0; i < (*size); ++i) {
-        buffer[i] =  (raw_buffer[(pos + i) % ADC_BUFFER_SIZE]) & ADC_BITS_MASK;
-        buffer2[i] = (raw_buffer2[(pos + i) % ADC_BUFFER_SIZE]) & ADC_BITS_MASK;
-    }
+    uint32_t first = getFirstSpan(&pos, *size);
+    copySpanMasked(raw_buffer + pos, first, buffer);
+    copySpanMasked(raw_buffer, *size - first, buffer + first);
+    copySpanMasked(raw_buffer2 + pos, first, buffer2);
+    copySpanMasked(raw_buffer2, *size - first, buffer2 + first);
 
     return RP_OK;
 }
@@ -668,71 +843,496 @@ int acq_GetLatestDataRaw(rp_channel_t channel, uint32_t* size, int16_t* buffer)
     return acq_GetDataRaw(channel, pos, size, buffer);
 }
 
+/**
+ * Returns a current copy of the shared readout snapshot. Data readers run
+ * concurrently, so only the copy is used outside the lock.
+ */
+static rp_acq_readout_t getReadoutCache()
+{
+    pthread_mutex_lock(&readout_lock);
+    if (readout_cache.gain_generation != gain_generation || readout_cache.calib_generation != calib_GetGeneration()) {
+        acq_PrepareReadout(&readout_cache);
+    }
+    rp_acq_readout_t readout = readout_cache;
+    pthread_mutex_unlock(&readout_lock);
+    return readout;
+}
+
 int acq_GetDataV(rp_channel_t channel,  uint32_t pos, uint32_t* size, float* buffer)
 {
-    *size = MIN(*size, ADC_BUFFER_SIZE);
+    rp_acq_readout_t readout = getReadoutCache();
+    if (channel == RP_CH_1) {
+        return acq_GetDataVPrepared(&readout, pos, size, buffer, NULL);
+    }
+    else {
+        return acq_GetDataVPrepared(&readout, pos, size, NULL, buffer);
+    }
+}
 
-    float gainV;
-    rp_pinState_t gain;
-    acq_GetGainV(channel, &gainV);
-    acq_GetGain(channel, &gain);
+int acq_GetDataV2(uint32_t pos, uint32_t* size, float* buffer1, float* buffer2)
+{
+    rp_acq_readout_t readout = getReadoutCache();
+    return acq_GetDataVPrepared(&readout, pos, size, buffer1, buffer2);
+}
 
-    rp_calib_params_t calib = calib_GetParams();
-    int32_t dc_offs = GET_OFFSET(channel, gain, calib);
-    uint32_t calibScale = calib_GetFrontEndScale(channel, gain);
+int acq_PrepareReadout(rp_acq_readout_t* readout)
+{
+    if (readout == NULL) {
+        return RP_UIA;
+    }
 
-    const volatile uint32_t* raw_buffer = getRawBuffer(channel);
+    for (int i = 0; i < 2; ++i) {
+        rp_channel_t channel = i == 0 ? RP_CH_1 : RP_CH_2;
+        rp_pinState_t gain;
+        acq_GetGain(channel, &gain);
+        calib_GetConversion(channel, gain, &readout->scale[i], &readout->dc_offs[i]);
+    }
+    readout->gain_generation = gain_generation;
+    readout->calib_generation = calib_GetGeneration();
+    return RP_OK;
+}
 
-    uint32_t cnts;
-    for (uint32_t i = 0; i < (*size); ++i) {
-        cnts = raw_buffer[(pos + i) % ADC_BUFFER_SIZE];
-        buffer[i] = cmn_CnvCntToV(ADC_BITS, cnts & ADC_BITS_MASK, gainV, calibScale, dc_offs, 0.0);
+int acq_GetDataVPrepared(rp_acq_readout_t* readout, uint32_t pos, uint32_t* size, float* buffer1, float* buffer2)
+{
+    if (readout == NULL) {
+        return RP_UIA;
+    }
+
+    // A gain or calibration change since the snapshot was taken refreshes it
+    if (readout->gain_generation != gain_generation || readout->calib_generation != calib_GetGeneration()) {
+        acq_PrepareReadout(readout);
+    }
+
+    *size = MIN(*size, ADC_BUFFER_SIZE);
+
+    uint32_t first = getFirstSpan(&pos, *size);
+    if (buffer1) {
+        const volatile uint32_t* raw_buffer = getRawBuffer(RP_CH_1);
+        cnvSpanToV(raw_buffer + pos, first, buffer1, readout->dc_offs[0], readout->scale[0]);
+        cnvSpanToV(raw_buffer, *size - first, buffer1 + first, readout->dc_offs[0], readout->scale[0]);
+    }
+    if (buffer2) {
+        const volatile uint32_t* raw_buffer = getRawBuffer(RP_CH_2);
+        cnvSpanToV(raw_buffer + pos, first, buffer2, readout->dc_offs[1], readout->scale[1]);
+        cnvSpanToV(raw_buffer, *size - first, buffer2 + first, readout->dc_offs[1], readout->scale[1]);
     }
 
     return RP_OK;
 }
 
-int acq_GetDataV2(uint32_t pos, uint32_t* size, float* buffer1, float* buffer2)
+/*
+ * Calibrated count statistics of a span. Calibration is monotonic, so the span
+ * extremes are those of the calibrated counts; the sum needs every sample clamped.
+ */
+static void binSpan(const volatile uint32_t* raw, uint32_t size, int32_t dc_offs, int32_t* min, int32_t* max, int64_t* sum)
 {
-    *size = MIN(*size, ADC_BUFFER_SIZE);
+    const uint32_t* src = (const uint32_t*)raw;
+    uint32_t i = 0;
+    int32_t mn = *min;
+    int32_t mx = *max;
+    int64_t total = 0;
+#ifdef ACQ_USE_NEON
+    if (size >= 4) {
+        const uint32x4_t mask = vdupq_n_u32(ADC_BITS_MASK);
+        const int32x4_t offs = vdupq_n_s32(dc_offs);
+        const int32x4_t lo = vdupq_n_s32(ADC_CALIB_MIN);
+        const int32x4_t hi = vdupq_n_s32(ADC_CALIB_MAX);
+        int32x4_t vmn = vdupq_n_s32(mn);
+        int32x4_t vmx = vdupq_n_s32(mx);
+        int64x2_t vsum = vdupq_n_s64(0);
+        for (; i + 4 <= size; i += 4) {
+            int32x4_t m = vreinterpretq_s32_u32(vshlq_n_u32(vandq_u32(vld1q_u32(src + i), mask), ADC_SIGN_SHIFT));
+            m = vminq_s32(vmaxq_s32(vsubq_s32(vshrq_n_s32(m, ADC_SIGN_SHIFT), offs), lo), hi);
+            vmn = vminq_s32(vmn, m);
+            vmx = vmaxq_s32(vmx, m);
+            vsum = vpadalq_s32(vsum, m);
+        }
+        int32x2_t pmn = vpmin_s32(vget_low_s32(vmn), vget_high_s32(vmn));
+        int32x2_t pmx = vpmax_s32(vget_low_s32(vmx), vget_high_s32(vmx));
+        mn = vget_lane_s32(vpmin_s32(pmn, pmn), 0);
+        mx = vget_lane_s32(vpmax_s32(pmx, pmx), 0);
+        total = vgetq_lane_s64(vsum, 0) + vgetq_lane_s64(vsum, 1);
+    }
+#endif
+    for (; i < size; ++i) {
+        int32_t m = calibCnts(src[i], dc_offs);
+        mn = MIN(mn, m);
+        mx = MAX(mx, m);
+        total += m;
+    }
+    *min = mn;
+    *max = mx;
+    *sum += total;
+}
 
-    float gainV1, gainV2;
-    rp_pinState_t gain1, gain2;
-    acq_GetGainV(RP_CH_1, &gainV1);
-    acq_GetGain(RP_CH_1, &gain1);
-    acq_GetGainV(RP_CH_2, &gainV2);
-    acq_GetGain(RP_CH_2, &gain2);
+int acq_GetDataVBinned(rp_channel_t channel, uint32_t pos, uint32_t size, rp_acq_bin_mode_t mode, uint32_t bins, float* buffer1, float* buffer2)
+{
+    if (channel != RP_CH_1 && channel != RP_CH_2) {
+        return RP_EPN;
+    }
+    if (size > ADC_BUFFER_SIZE || bins == 0 || bins > size) {
+        return RP_EOOR;
+    }
+    if (buffer1 == NULL || (mode == RP_ACQ_BIN_MINMAX && buffer2 == NULL)) {
+        return RP_UIA;
+    }
+    if (mode != RP_ACQ_BIN_MEAN && mode != RP_ACQ_BIN_MINMAX) {
+        return RP_EOOR;
+    }
 
-    rp_calib_params_t calib = calib_GetParams();
-    int32_t dc_offs1 = gain1 == RP_HIGH ? calib.fe_ch1_hi_offs : calib.fe_ch1_lo_offs;
-    uint32_t calibScale1 = calib_GetFrontEndScale(RP_CH_1, gain1);
+    rp_acq_readout_t readout = getReadoutCache();
+    int ch = channel == RP_CH_1 ? 0 : 1;
+    int32_t dc_offs = readout.dc_offs[ch];
+    float scale = readout.scale[ch];
+
+    const volatile uint32_t* raw_buffer = getRawBuffer(channel);
+    pos = acq_GetNormalizedDataPos(pos);
+
+    uint32_t start = 0;
+    for (uint32_t bin = 0; bin < bins; ++bin) {
+        uint32_t end = (uint32_t)(((uint64_t)(bin + 1) * size) / bins);
+        uint32_t bin_pos = pos + start;
+        if (bin_pos >= ADC_BUFFER_SIZE) {
+            bin_pos -= ADC_BUFFER_SIZE;
+        }
+        int32_t mn = ADC_CALIB_MAX;
+        int32_t mx = ADC_CALIB_MIN;
+        int64_t sum = 0;
+        uint32_t first = getFirstSpan(&bin_pos, end - start);
+        binSpan(raw_buffer + bin_pos, first, dc_offs, &mn, &mx, &sum);
+        binSpan(raw_buffer, end - start - first, dc_offs, &mn, &mx, &sum);
+
+        if (mode == RP_ACQ_BIN_MEAN) {
+            buffer1[bin] = (float)((double)sum / (double)(end - start)) * scale;
+        }
+        else {
+            // A negative calibration scale turns the count extremes around
+            buffer1[bin] = (float)(scale >= 0 ? mn : mx) * scale;
+            buffer2[bin] = (float)(scale >= 0 ? mx : mn) * scale;
+        }
+        start = end;
+    }
+    return RP_OK;
+}
+
+static uint64_t getMonotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Record loop of the segmented acquisition. Record i is written to the
+ * buffers at i * stride, then handed to done_fn() with its state. armed_fn(),
+ * if any, runs once right after the first arm, so a trigger it causes is
+ * caught. The caller has checked the arguments.
+ */
+typedef void (*record_done_t)(void* ctx, uint32_t index, const rp_acq_record_t* record);
 
-    int32_t dc_offs2 = gain2 == RP_HIGH ? calib.fe_ch2_hi_offs : calib.fe_ch2_lo_offs;
-    uint32_t calibScale2 = calib_GetFrontEndScale(RP_CH_2, gain2);
+static int captureRecords(uint32_t records, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, size_t stride,
+                          uint32_t timeout_ms, record_done_t done_fn, void* ctx, acq_armed_t armed_fn, void* armed_ctx, uint32_t* captured)
+{
+    rp_acq_readout_t readout = getReadoutCache();
 
     const volatile uint32_t* raw_buffer1 = getRawBuffer(RP_CH_1);
     const volatile uint32_t* raw_buffer2 = getRawBuffer(RP_CH_2);
+    uint32_t old_delay;
+    osc_GetTriggerDelay(&old_delay);
 
-    uint32_t cnts1[*size];
-    uint32_t cnts2[*size];
-    uint32_t* ptr1 = cnts1;
-    uint32_t* ptr2 = cnts2;
+    // The trigger source clears itself once the post trigger samples are written
+    osc_SetTriggerSource(RP_TRIG_SRC_DISABLED);
+    osc_SetArmKeep(true);
+    osc_SetTriggerDelay(record_size - pre_trigger);
+    osc_WriteDataIntoMemory(true);
 
-    for (uint32_t i = 0; i < (*size); ++i) {
-        *ptr1++ = raw_buffer1[pos];
-        *ptr2++ = raw_buffer2[pos];
-        pos = (pos + 1) % ADC_BUFFER_SIZE;
+    uint64_t deadline = getMonotonicNs() + (uint64_t)timeout_ms * 1000000ULL;
+    int status = RP_OK;
+    uint32_t done = 0;
+
+    // The first record needs its pre trigger samples in memory before the trigger is armed
+    uint32_t pre_count = 0;
+    while (osc_GetPreTriggerCounter(&pre_count) == RP_OK && pre_count < pre_trigger) {
+        if (getMonotonicNs() > deadline) {
+            status = RP_ETIM;
+            break;
+        }
     }
 
-    ptr1 = cnts1;
-    ptr2 = cnts2;
+    if (status == RP_OK) {
+        osc_SetTriggerSource(last_trig_src);
+        if (armed_fn) {
+            armed_fn(armed_ctx);
+        }
+    }
 
-    for (uint32_t i = 0; i < (*size); ++i) {
-        *buffer1++ = cmn_CnvCntToV(ADC_BITS, *ptr1++ & ADC_BITS_MASK, gainV1, calibScale1, dc_offs1, 0.0);
-        *buffer2++ = cmn_CnvCntToV(ADC_BITS, *ptr2++ & ADC_BITS_MASK, gainV2, calibScale2, dc_offs2, 0.0);
+    while (status == RP_OK && done < records) {
+        uint32_t source;
+        osc_GetTriggerSource(&source);
+        if (source != RP_TRIG_SRC_DISABLED) {
+            if (getMonotonicNs() > deadline) {
+                status = RP_ETIM;
+            }
+            continue;
+        }
+
+        uint32_t trig_pos;
+        osc_GetWritePointerAtTrig(&trig_pos);
+        // Re-arm before copying, the next trigger is caught while this record is read out
+        if (done + 1 < records) {
+            osc_SetTriggerSource(last_trig_src);
+        }
+
+        rp_acq_record_t record;
+        uint32_t pos = trig_pos + ADC_BUFFER_SIZE - pre_trigger;
+        uint32_t first = getFirstSpan(&pos, record_size);
+        record.trigger_pos = trig_pos;
+        record.start_pos = pos;
+        record.time_ns = getMonotonicNs();
+
+        if (buffer1) {
+            int16_t* out = buffer1 + (size_t)done * stride;
+            cnvSpanToCalibCnts(raw_buffer1 + pos, first, out, readout.dc_offs[0]);
+            cnvSpanToCalibCnts(raw_buffer1, record_size - first, out + first, readout.dc_offs[0]);
+        }
+        if (buffer2) {
+            int16_t* out = buffer2 + (size_t)done * stride;
+            cnvSpanToCalibCnts(raw_buffer2 + pos, first, out, readout.dc_offs[1]);
+            cnvSpanToCalibCnts(raw_buffer2, record_size - first, out + first, readout.dc_offs[1]);
+        }
+
+        // Catches a writer that passed the record start, not one that went around more than once
+        uint32_t write_pos;
+        osc_GetWritePointer(&write_pos);
+        record.overwritten = acq_GetNormalizedDataPos(write_pos + ADC_BUFFER_SIZE - pos) < record_size;
+        done_fn(ctx, done, &record);
+        done++;
     }
 
-    return RP_OK;
+    osc_SetTriggerSource(RP_TRIG_SRC_DISABLED);
+    osc_WriteDataIntoMemory(false);
+    osc_SetTriggerDelay(old_delay);
+    osc_SetArmKeep(arm_keep);
+
+    if (captured) {
+        *captured = done;
+    }
+    return status;
+}
+
+static bool checkRecords(uint32_t record_size, uint32_t pre_trigger)
+{
+    // The ADC keeps writing while a record is copied, the other half of the buffer is its head start
+    return record_size > 0 && record_size <= ADC_BUFFER_SIZE / 2 && pre_trigger < record_size &&
+           last_trig_src != RP_TRIG_SRC_DISABLED;
+}
+
+static void storeRecord(void* ctx, uint32_t index, const rp_acq_record_t* record)
+{
+    ((rp_acq_record_t*)ctx)[index] = *record;
+}
+
+int acq_CaptureRecords(uint32_t records, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* info, uint32_t timeout_ms, uint32_t* captured)
+{
+    if (captured) {
+        *captured = 0;
+    }
+    if (records == 0 || info == NULL || (buffer1 == NULL && buffer2 == NULL)) {
+        return RP_UIA;
+    }
+    if (!checkRecords(record_size, pre_trigger)) {
+        return RP_EOOR;
+    }
+    return captureRecords(records, record_size, pre_trigger, buffer1, buffer2, record_size, timeout_ms, storeRecord, info, NULL, NULL, captured);
+}
+
+int acq_CaptureArmed(uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* info, uint32_t timeout_ms, acq_armed_t armed_fn, void* ctx)
+{
+    if (info == NULL || (buffer1 == NULL && buffer2 == NULL)) {
+        return RP_UIA;
+    }
+    if (!checkRecords(record_size, pre_trigger)) {
+        return RP_EOOR;
+    }
+    return captureRecords(1, record_size, pre_trigger, buffer1, buffer2, record_size, timeout_ms, storeRecord, info, armed_fn, ctx, NULL);
+}
+
+typedef struct {
+    uint32_t size;
+    const int16_t* record[2];
+    int32_t* sum[2];
+    uint32_t averaged;
+} average_t;
+
+/* sum[i] += record[i], the sum of ACQ_AVERAGE_MAX_RECORDS full scale records still fits */
+static void addSpan(const int16_t* record, uint32_t size, int32_t* sum)
+{
+    uint32_t i = 0;
+#ifdef ACQ_USE_NEON
+    for (; i + 8 <= size; i += 8) {
+        int16x8_t r = vld1q_s16(record + i);
+        vst1q_s32(sum + i, vaddw_s16(vld1q_s32(sum + i), vget_low_s16(r)));
+        vst1q_s32(sum + i + 4, vaddw_s16(vld1q_s32(sum + i + 4), vget_high_s16(r)));
+    }
+#endif
+    for (; i < size; ++i) {
+        sum[i] += record[i];
+    }
+}
+
+static void addRecord(void* ctx, uint32_t index, const rp_acq_record_t* record)
+{
+    average_t* avg = ctx;
+    // Part of it is from the next pass of the writer, it would smear the average
+    if (record->overwritten) {
+        return;
+    }
+    for (int ch = 0; ch < 2; ++ch) {
+        if (avg->sum[ch]) {
+            addSpan(avg->record[ch], avg->size, avg->sum[ch]);
+        }
+    }
+    avg->averaged++;
+}
+
+int acq_CaptureAverage(uint32_t records, uint32_t record_size, uint32_t pre_trigger, float* buffer1, float* buffer2, uint32_t timeout_ms, uint32_t* averaged)
+{
+    if (averaged) {
+        *averaged = 0;
+    }
+    if (records == 0 || (buffer1 == NULL && buffer2 == NULL)) {
+        return RP_UIA;
+    }
+    if (records > ACQ_AVERAGE_MAX_RECORDS || !checkRecords(record_size, pre_trigger)) {
+        return RP_EOOR;
+    }
+
+    // One record at a time is copied and added, only the sums grow with the record size
+    float* out[2] = { buffer1, buffer2 };
+    int16_t* record[2] = { NULL, NULL };
+    average_t avg = { .size = record_size };
+    bool failed = false;
+    for (int ch = 0; ch < 2; ++ch) {
+        if (out[ch]) {
+            record[ch] = malloc(record_size * sizeof(int16_t));
+            avg.sum[ch] = calloc(record_size, sizeof(int32_t));
+            failed |= record[ch] == NULL || avg.sum[ch] == NULL;
+        }
+        avg.record[ch] = record[ch];
+    }
+
+    int status = RP_EAM;
+    if (!failed) {
+        status = captureRecords(records, record_size, pre_trigger, record[0], record[1], 0, timeout_ms, addRecord, &avg, NULL, NULL, NULL);
+        rp_acq_readout_t readout = getReadoutCache();
+        for (int ch = 0; ch < 2; ++ch) {
+            if (out[ch]) {
+                float scale = avg.averaged ? readout.scale[ch] / avg.averaged : 0;
+                for (uint32_t i = 0; i < record_size; ++i) {
+                    out[ch][i] = avg.sum[ch][i] * scale;
+                }
+            }
+        }
+    }
+
+    for (int ch = 0; ch < 2; ++ch) {
+        free(record[ch]);
+        free(avg.sum[ch]);
+    }
+    if (averaged) {
+        *averaged = avg.averaged;
+    }
+    return status;
+}
+
+/*
+ * Without an interrupt the trigger is polled with a sleep that doubles from
+ * TRIG_POLL_MIN_US up to an eighth of the buffer fill time, capped at
+ * TRIG_POLL_MAX_US, so the trigger is seen long before its data is overwritten.
+ * Interrupt waits are cut in slices, so an image whose interrupt is not the
+ * trigger still sees it within one slice.
+ */
+#define TRIG_POLL_MIN_US    5
+#define TRIG_POLL_MAX_US    2000
+#define TRIG_IRQ_SLICE_MS   10
+
+static bool isTriggered()
+{
+    bool state = false;
+    osc_GetTriggerState(&state);
+    if (state) {
+        return true;
+    }
+    // The FPGA also clears the source once the trigger delay has elapsed
+    uint32_t source;
+    osc_GetTriggerSource(&source);
+    return last_trig_src != RP_TRIG_SRC_DISABLED && source == RP_TRIG_SRC_DISABLED;
+}
+
+int acq_WaitTrigger(uint32_t timeout_ms)
+{
+    uint64_t deadline = getMonotonicNs() + (uint64_t)timeout_ms * 1000000ULL;
+
+    uint32_t decimation = 1;
+    acq_GetDecimationFactor(&decimation);
+    uint64_t poll_max_us = (uint64_t)ADC_BUFFER_SIZE * decimation * ADC_SAMPLE_PERIOD / 1000 / 8;
+    poll_max_us = MAX(TRIG_POLL_MIN_US, MIN(poll_max_us, TRIG_POLL_MAX_US));
+    uint64_t sleep_us = TRIG_POLL_MIN_US;
+
+    while (true) {
+        // Drop an interrupt that was already delivered and arm the next one before looking at the state
+        if (cmn_IrqGetFd() >= 0) {
+            cmn_IrqWait(0);
+        }
+        bool irq = cmn_IrqEnable() == RP_OK;
+
+        int64_t checked = cmn_RealtimeNs();
+        if (isTriggered()) {
+            // Stamped right away, while the samples after the trigger are still written
+            stampTrigger();
+            return RP_OK;
+        }
+        trigArmed(checked);
+        uint64_t now = getMonotonicNs();
+        if (now >= deadline) {
+            return RP_ETIM;
+        }
+        uint64_t left_us = (deadline - now + 999) / 1000;
+
+        if (irq) {
+            int slice_ms = (int)MIN((left_us + 999) / 1000, TRIG_IRQ_SLICE_MS);
+            if (cmn_IrqWait(slice_ms) != RP_NOTS) {
+                continue;
+            }
+        }
+        usleep(MIN(sleep_us, left_us));
+        sleep_us = MIN(sleep_us * 2, poll_max_us);
+    }
+}
+
+int acq_GetWritePointerAtTrigTime(uint32_t* pos, rp_timestamp_t* time)
+{
+    if (pos == NULL || time == NULL) {
+        return RP_UIA;
+    }
+    if (!isTriggered()) {
+        return RP_EOOR;
+    }
+    stampTrigger();
+    pthread_mutex_lock(&trig_time_lock);
+    *time = trig_time;
+    pthread_mutex_unlock(&trig_time_lock);
+    return osc_GetWritePointerAtTrig(pos);
+}
+
+int acq_GetTriggerFd(int* fd)
+{
+    if (fd == NULL) {
+        return RP_UIA;
+    }
+    int status = cmn_IrqEnable();
+    *fd = status == RP_OK ? cmn_IrqGetFd() : -1;
+    return status;
 }
 
 int acq_GetDataPosV(rp_channel_t channel,  uint32_t start_pos, uint32_t end_pos, float* buffer, uint32_t *buffer_size)
@@ -781,6 +1381,10 @@ int acq_GetBufferSize(uint32_t *size) {
  * @return
  */
 int acq_SetDefault() {
+    // Nothing triggers while the rest is rewritten in one batch
+    acq_SetTriggerSrc(RP_TRIG_SRC_DISABLED);
+
+    cmn_BatchBegin();
     acq_SetChannelThreshold(RP_CH_1, 0.0);
     acq_SetChannelThreshold(RP_CH_2, 0.0);
     acq_SetChannelThresholdHyst(RP_CH_1, 0.0);
@@ -791,9 +1395,9 @@ int acq_SetDefault() {
     acq_SetDecimation(RP_DEC_1);
     acq_SetSamplingRate(RP_SMP_125M);
     acq_SetAveraging(true);
-    acq_SetTriggerSrc(RP_TRIG_SRC_DISABLED);
     acq_SetTriggerDelay(0, false);
     acq_SetTriggerDelayNs(0, false);
+    cmn_BatchCommit();
 
     return RP_OK;
 }
@@ -71,11 +71,22 @@ uint32_t acq_GetNormalizedDataPos(uint32_t pos);
 int acq_GetDataPosRaw(rp_channel_t channel, uint32_t start_pos, uint32_t end_pos, int16_t* buffer, uint32_t *buffer_size);
 int acq_GetDataPosV(rp_channel_t channel, uint32_t start_pos, uint32_t end_pos, float* buffer, uint32_t *buffer_size);
 int acq_GetDataRaw(rp_channel_t channel, uint32_t pos, uint32_t* size, int16_t* buffer);
+int acq_GetRawBufferView(rp_channel_t channel, rp_acq_raw_view_t* view);
 int acq_GetDataRawV2(uint32_t pos, uint32_t* size, uint16_t* buffer, uint16_t* buffer2);
 int acq_GetOldestDataRaw(rp_channel_t channel, uint32_t* size, int16_t* buffer);
 int acq_GetLatestDataRaw(rp_channel_t channel, uint32_t* size, int16_t* buffer);
 int acq_GetDataV(rp_channel_t channel, uint32_t pos, uint32_t* size, float* buffer);
 int acq_GetDataV2(uint32_t pos, uint32_t* size, float* buffer1, float* buffer2);
+int acq_PrepareReadout(rp_acq_readout_t* readout);
+int acq_GetDataVPrepared(rp_acq_readout_t* readout, uint32_t pos, uint32_t* size, float* buffer1, float* buffer2);
+int acq_GetDataVBinned(rp_channel_t channel, uint32_t pos, uint32_t size, rp_acq_bin_mode_t mode, uint32_t bins, float* buffer1, float* buffer2);
+int acq_CaptureRecords(uint32_t records, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* info, uint32_t timeout_ms, uint32_t* captured);
+typedef void (*acq_armed_t)(void* ctx);
+int acq_CaptureArmed(uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* info, uint32_t timeout_ms, acq_armed_t armed_fn, void* ctx);
+int acq_CaptureAverage(uint32_t records, uint32_t record_size, uint32_t pre_trigger, float* buffer1, float* buffer2, uint32_t timeout_ms, uint32_t* averaged);
+int acq_WaitTrigger(uint32_t timeout_ms);
+int acq_GetTriggerFd(int* fd);
+int acq_GetWritePointerAtTrigTime(uint32_t* pos, rp_timestamp_t* time);
 int acq_GetOldestDataV(rp_channel_t channel, uint32_t* size, float* buffer);
 int acq_GetLatestDataV(rp_channel_t channel, uint32_t* size, float* buffer);
 
@@ -0,0 +1,246 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library buffered slow analog inputs implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+
+#include "redpitaya/rp.h"
+#include "ai_buffer.h"
+
+/*
+ * The XADC sequencer converts the enabled channels one after the other and its
+ * end of sequence interrupt drives the "samplerate" trigger, so the kernel puts
+ * one scan of all four inputs into the IIO buffer per sequence. The buffer is
+ * the ring, read() hands out whole scans and poll() waits for them.
+ */
+
+const char* const ai_channels[AI_PIN_NUM] = {
+    "in_voltage11_vaux8",
+    "in_voltage9_vaux0",
+    "in_voltage10_vaux1",
+    "in_voltage12_vaux9"
+};
+
+static int      ai_fd = -1;
+static unsigned ai_offset[AI_PIN_NUM]; ///< position of the pin in a scan [16 bit words]
+static unsigned ai_shift[AI_PIN_NUM];
+static uint16_t ai_mask[AI_PIN_NUM];
+static uint32_t ai_latest[AI_PIN_NUM];
+static bool     ai_have_latest = false;
+
+static int writeAttr(const char* name, const char* value)
+{
+    char path[256];
+    snprintf(path, sizeof(path), AI_XADC_DIR "/%s", name);
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        return RP_EOMD;
+    }
+    int ok = fputs(value, fp) >= 0;
+    ok = (fclose(fp) == 0) && ok;
+    return ok ? RP_OK : RP_EIPV;
+}
+
+static int readAttr(const char* name, char* value, size_t size)
+{
+    char path[256];
+    snprintf(path, sizeof(path), AI_XADC_DIR "/%s", name);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return RP_EOMD;
+    }
+    char* r = fgets(value, size, fp);
+    fclose(fp);
+    if (r == NULL) {
+        return RP_EIPV;
+    }
+    value[strcspn(value, "\n")] = 0;
+    return RP_OK;
+}
+
+/** Layout of a channel in the scan from scan_elements, e.g. "le:u12/16>>4" */
+static int readScanType(unsigned pin, unsigned* index)
+{
+    char name[64];
+    char value[64];
+    char endian, sign;
+    unsigned bits, storage, shift = 0;
+
+    snprintf(name, sizeof(name), "scan_elements/%s_index", ai_channels[pin]);
+    if (readAttr(name, value, sizeof(value)) != RP_OK) {
+        return RP_EUF;
+    }
+    *index = (unsigned) strtoul(value, NULL, 10);
+    snprintf(name, sizeof(name), "scan_elements/%s_type", ai_channels[pin]);
+    if (readAttr(name, value, sizeof(value)) != RP_OK ||
+        sscanf(value, "%ce:%c%u/%u>>%u", &endian, &sign, &bits, &storage, &shift) < 4 ||
+        storage != 16 || bits > 16) {
+        return RP_EUF;
+    }
+    ai_shift[pin] = shift;
+    ai_mask[pin] = (uint16_t) ((1u << bits) - 1);
+    return RP_OK;
+}
+
+/** The trigger the XADC driver registers for its sequencer, "<name><id>-samplerate" */
+static int setTrigger()
+{
+    char name[32];
+    char trigger[64];
+    if (readAttr("name", name, sizeof(name)) != RP_OK) {
+        return RP_EUF;
+    }
+    snprintf(trigger, sizeof(trigger), "%s" AI_XADC_ID "-samplerate", name);
+    return writeAttr("trigger/current_trigger", trigger);
+}
+
+int ai_BufferStart(float rate, uint32_t length, float* actual_rate)
+{
+    char value[32];
+    unsigned index[AI_PIN_NUM];
+
+    if (rate <= 0 || length < 2) {
+        return RP_EOOR;
+    }
+    if (ai_fd >= 0) {
+        ai_BufferStop();
+    }
+    writeAttr("buffer/enable", "0");
+    for (unsigned pin = 0; pin < AI_PIN_NUM; pin++) {
+        char name[64];
+        snprintf(name, sizeof(name), "scan_elements/%s_en", ai_channels[pin]);
+        if (writeAttr(name, "1") != RP_OK || readScanType(pin, &index[pin]) != RP_OK) {
+            return RP_EUF;
+        }
+    }
+    writeAttr("scan_elements/in_timestamp_en", "0");
+    // the enabled channels are stored by their scan index
+    for (unsigned pin = 0; pin < AI_PIN_NUM; pin++) {
+        ai_offset[pin] = 0;
+        for (unsigned other = 0; other < AI_PIN_NUM; other++) {
+            if (index[other] < index[pin]) {
+                ai_offset[pin]++;
+            }
+        }
+    }
+
+    // one sequence converts all four inputs
+    snprintf(value, sizeof(value), "%u", (unsigned) (rate * AI_PIN_NUM + 0.5f));
+    if (writeAttr("sampling_frequency", value) != RP_OK || setTrigger() != RP_OK) {
+        return RP_EUF;
+    }
+    if (actual_rate && readAttr("sampling_frequency", value, sizeof(value)) == RP_OK) {
+        *actual_rate = strtof(value, NULL) / AI_PIN_NUM;
+    }
+    snprintf(value, sizeof(value), "%u", length);
+    writeAttr("buffer/length", value);
+
+    ai_fd = open(AI_XADC_DEV, O_RDONLY | O_NONBLOCK);
+    if (ai_fd < 0) {
+        return RP_EOMD;
+    }
+    if (writeAttr("buffer/enable", "1") != RP_OK) {
+        close(ai_fd);
+        ai_fd = -1;
+        return RP_EUF;
+    }
+    ai_have_latest = false;
+    return RP_OK;
+}
+
+int ai_BufferStop()
+{
+    if (ai_fd < 0) {
+        return RP_OK;
+    }
+    writeAttr("buffer/enable", "0");
+    close(ai_fd);
+    ai_fd = -1;
+    ai_have_latest = false;
+    return RP_OK;
+}
+
+bool ai_BufferRunning()
+{
+    return ai_fd >= 0;
+}
+
+/**
+ * Copies up to max_scans scans, AI_PIN_NUM raw values each in pin order.
+ * Waits up to timeout_ms for the first one, then takes what is buffered.
+ */
+int ai_BufferRead(uint16_t* raw, uint32_t max_scans, uint32_t* scans, uint32_t timeout_ms)
+{
+    uint16_t block[256 * AI_PIN_NUM];
+    uint32_t n = 0;
+
+    *scans = 0;
+    if (ai_fd < 0) {
+        return RP_EUF;
+    }
+    while (n < max_scans) {
+        uint32_t want = max_scans - n;
+        if (want > sizeof(block) / sizeof(block[0]) / AI_PIN_NUM) {
+            want = sizeof(block) / sizeof(block[0]) / AI_PIN_NUM;
+        }
+        ssize_t r = read(ai_fd, block, want * AI_PIN_NUM * sizeof(uint16_t));
+        if (r < 0 && errno == EAGAIN) {
+            if (n > 0) {
+                break;
+            }
+            struct pollfd pfd = { .fd = ai_fd, .events = POLLIN };
+            int p = poll(&pfd, 1, timeout_ms);
+            if (p == 0) {
+                return RP_ETIM;
+            }
+            if (p < 0 && errno != EINTR) {
+                return RP_EFRB;
+            }
+            continue;
+        }
+        if (r <= 0) {
+            return RP_EFRB;
+        }
+        uint32_t got = r / (AI_PIN_NUM * sizeof(uint16_t));
+        for (uint32_t s = 0; s < got; s++) {
+            for (unsigned pin = 0; pin < AI_PIN_NUM; pin++) {
+                uint16_t v = (block[s * AI_PIN_NUM + ai_offset[pin]] >> ai_shift[pin]) & ai_mask[pin];
+                raw[(n + s) * AI_PIN_NUM + pin] = v;
+                ai_latest[pin] = v;
+            }
+        }
+        ai_have_latest = got > 0 || ai_have_latest;
+        n += got;
+    }
+    *scans = n;
+    return RP_OK;
+}
+
+/** Last value the buffer delivered, for single reads while it is running */
+int ai_BufferLatest(unsigned pin, uint32_t* value)
+{
+    if (pin >= AI_PIN_NUM) {
+        return RP_EPN;
+    }
+    if (!ai_have_latest) {
+        return RP_EUF;
+    }
+    *value = ai_latest[pin];
+    return RP_OK;
+}
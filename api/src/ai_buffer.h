@@ -0,0 +1,36 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library buffered slow analog inputs interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef SRC_AI_BUFFER_H_
+#define SRC_AI_BUFFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AI_PIN_NUM 4
+
+#define AI_XADC_ID   "1"
+#define AI_XADC_DIR  "/sys/devices/soc0/amba_pl/83c00000.xadc_wiz/iio:device" AI_XADC_ID
+#define AI_XADC_DEV  "/dev/iio:device" AI_XADC_ID
+
+/** Channel names of AI0..AI3 */
+extern const char* const ai_channels[AI_PIN_NUM];
+
+int ai_BufferStart(float rate, uint32_t length, float* actual_rate);
+int ai_BufferStop();
+bool ai_BufferRunning();
+int ai_BufferRead(uint16_t* raw, uint32_t max_scans, uint32_t* scans, uint32_t timeout_ms);
+int ai_BufferLatest(unsigned pin, uint32_t* value);
+
+#endif /* SRC_AI_BUFFER_H_ */
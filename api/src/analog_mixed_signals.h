@@ -39,8 +39,7 @@ static const uint32_t ANALOG_OUT_MAX_VAL_INTEGER = 156;
 static volatile analog_mixed_signals_control_t *ams = NULL;
 
 static int ams_Init() {
-    cmn_Map(ANALOG_MIXED_SIGNALS_BASE_SIZE, ANALOG_MIXED_SIGNALS_BASE_ADDR, (void**)&ams);
-    return RP_OK;
+    return cmn_Map(ANALOG_MIXED_SIGNALS_BASE_SIZE, ANALOG_MIXED_SIGNALS_BASE_ADDR, (void**)&ams);
 }
 
 static int ams_Release() {
@@ -13,7 +13,15 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include "redpitaya/rp.h"
 #include "common.h"
 #include "generate.h"
@@ -22,6 +30,9 @@
 #define CALIB_MAGIC 0xAABBCCDD
 
 int calib_ReadParams(rp_calib_params_t *calib_params);
+static int calib_ReadEeprom(rp_calib_params_t *calib_params);
+static int calib_Acquire(rp_pinState_t gain);
+static double calib_TrimmedMean(rp_channel_t channel);
 
 static const char eeprom_device[]="/sys/bus/i2c/devices/0-0050/eeprom";
 static const int  eeprom_calib_off=0x0008;
@@ -29,9 +40,128 @@ static const int  eeprom_calib_off=0x0008;
 // Cached parameter values.
 static rp_calib_params_t calib, failsafa_params;
 
+// Counts changes of the cached values. Starts at 1 so a zeroed snapshot is never current.
+static uint32_t calib_generation = 1;
+
+// Volts per calibrated count and DC offset, [channel][gain], follow calib
+static float   conv_scale[2][2];
+static int32_t conv_offs[2][2];
+
+// Guards calib, calib_generation and the conversion table, readouts on other threads read them concurrently
+static pthread_rwlock_t calib_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*
+ * Parsed parameters shared by all processes, so the EEPROM is read once per
+ * boot (/dev/shm is a tmpfs). seq is odd while a writer updates the region,
+ * writers also hold flock() on it. A zero valid field means no copy yet.
+ */
+#define CALIB_SHM_NAME "/rp_calib"
+
+typedef struct {
+    volatile uint32_t seq;
+    volatile uint32_t valid;
+    rp_calib_params_t params;
+} calib_shm_t;
+
+static calib_shm_t* calib_shm = NULL;
+static int calib_shm_fd = -1;
+static pthread_mutex_t calib_shm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static calib_shm_t* shmMap()
+{
+    pthread_mutex_lock(&calib_shm_lock);
+    if (calib_shm == NULL) {
+        struct stat st;
+        int fd = shm_open(CALIB_SHM_NAME, O_RDWR | O_CREAT, 0666);
+        if (fd >= 0) {
+            fchmod(fd, 0666); // past the umask, any process may refresh it
+        }
+        if (fd >= 0 && fstat(fd, &st) == 0 &&
+            (st.st_size >= (off_t)sizeof(calib_shm_t) || ftruncate(fd, sizeof(calib_shm_t)) == 0)) {
+            void* map = mmap(NULL, sizeof(calib_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED) {
+                calib_shm = (calib_shm_t*) map;
+                calib_shm_fd = fd;
+                fd = -1;
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    pthread_mutex_unlock(&calib_shm_lock);
+    return calib_shm;
+}
+
+static bool shmLoad(rp_calib_params_t* params)
+{
+    calib_shm_t* shm = shmMap();
+    uint32_t seq;
+    bool valid;
+
+    if (shm == NULL) {
+        return false;
+    }
+    do {
+        while ((seq = shm->seq) & 1) {
+            sched_yield();
+        }
+        __sync_synchronize();
+        valid = shm->valid != 0;
+        memcpy(params, &shm->params, sizeof(*params));
+        __sync_synchronize();
+    } while (shm->seq != seq);
+    return valid;
+}
+
+static void shmStore(const rp_calib_params_t* params)
+{
+    calib_shm_t* shm = shmMap();
+    if (shm == NULL) {
+        return;
+    }
+    flock(calib_shm_fd, LOCK_EX);
+    shm->seq++;
+    __sync_synchronize();
+    if (params) {
+        memcpy(&shm->params, params, sizeof(*params));
+    }
+    shm->valid = params != NULL;
+    __sync_synchronize();
+    shm->seq++;
+    flock(calib_shm_fd, LOCK_UN);
+}
+
+static void updateConversion()
+{
+    for (int ch = 0; ch < 2; ++ch) {
+        for (int g = 0; g < 2; ++g) {
+            rp_pinState_t gain = g == 0 ? RP_LOW : RP_HIGH;
+            float gainV = gain == RP_LOW ? 1.0 : 20.0;
+            uint32_t fs = ch == 0 ? (gain == RP_HIGH ? calib.fe_ch1_fs_g_hi : calib.fe_ch1_fs_g_lo)
+                                  : (gain == RP_HIGH ? calib.fe_ch2_fs_g_hi : calib.fe_ch2_fs_g_lo);
+            double scale = (double)gainV / (double)(1 << (ADC_BITS - 1));
+            conv_scale[ch][g] = scale * (double)cmn_CalibFullScaleToVoltage(fs) / ((double)FULL_SCALE_NORM / (double)gainV);
+            conv_offs[ch][g] = ch == 0 ? (gain == RP_HIGH ? calib.fe_ch1_hi_offs : calib.fe_ch1_lo_offs)
+                                       : (gain == RP_HIGH ? calib.fe_ch2_hi_offs : calib.fe_ch2_lo_offs);
+        }
+    }
+}
+
+static void setCachedParams(const rp_calib_params_t* params)
+{
+    pthread_rwlock_wrlock(&calib_lock);
+    calib = *params;
+    updateConversion();
+    calib_generation++;
+    pthread_rwlock_unlock(&calib_lock);
+}
+
 int calib_Init()
 {
-    calib_ReadParams(&calib);
+    rp_calib_params_t params;
+    calib_ReadParams(&params);
+    setCachedParams(&params);
     return RP_OK;
 }
 
@@ -46,7 +176,36 @@ int calib_Release()
  */
 rp_calib_params_t calib_GetParams()
 {
-    return calib;
+    pthread_rwlock_rdlock(&calib_lock);
+    rp_calib_params_t params = calib;
+    pthread_rwlock_unlock(&calib_lock);
+    return params;
+}
+
+/**
+ * Conversion of counts to Volts for a channel and gain, taken from the table
+ * built when the parameters are cached. For the readout kernels.
+ */
+int calib_GetConversion(rp_channel_t channel, rp_pinState_t gain, float* scale, int32_t* dc_offs)
+{
+    int ch = channel == RP_CH_1 ? 0 : 1;
+    int g = gain == RP_HIGH ? 1 : 0;
+    pthread_rwlock_rdlock(&calib_lock);
+    *scale = conv_scale[ch][g];
+    *dc_offs = conv_offs[ch][g];
+    pthread_rwlock_unlock(&calib_lock);
+    return RP_OK;
+}
+
+/**
+ * Returns a value that changes whenever the cached parameters change
+ */
+uint32_t calib_GetGeneration()
+{
+    pthread_rwlock_rdlock(&calib_lock);
+    uint32_t generation = calib_generation;
+    pthread_rwlock_unlock(&calib_lock);
+    return generation;
 }
 
 /**
@@ -55,7 +214,8 @@ rp_calib_params_t calib_GetParams()
  * Function reads calibration parameters from EEPROM device and stores them to the
  * specified buffer. Communication to the EEPROM device is taken place through
  * appropriate system driver accessed through the file system device
- * /sys/bus/i2c/devices/0-0050/eeprom.
+ * /sys/bus/i2c/devices/0-0050/eeprom. The first read after boot is kept in
+ * shared memory, later reads in any process come from there.
  *
  * @param[out]   calib_params  Pointer to destination buffer.
  * @retval       0 Success
@@ -63,6 +223,23 @@ rp_calib_params_t calib_GetParams()
  *
  */
 int calib_ReadParams(rp_calib_params_t *calib_params)
+{
+    /* sanity check */
+    if(calib_params == NULL) {
+        return RP_UIA;
+    }
+    if (shmLoad(calib_params)) {
+        return 0;
+    }
+    int ret = calib_ReadEeprom(calib_params);
+    if (ret == 0) {
+        shmStore(calib_params);
+    }
+    return ret;
+}
+
+/* The EEPROM read behind calib_ReadParams() */
+static int calib_ReadEeprom(rp_calib_params_t *calib_params)
 {
     FILE   *fp;
     size_t  size;
@@ -127,6 +304,9 @@ int calib_WriteParams(rp_calib_params_t calib_params) {
     FILE   *fp;
     size_t  size;
 
+    /* nobody may take the old copy while the EEPROM changes */
+    shmStore(NULL);
+
     /* open EEPROM device */
     fp = fopen(eeprom_device, "w+");
     if(fp == NULL) {
@@ -146,12 +326,15 @@ int calib_WriteParams(rp_calib_params_t calib_params) {
         fclose(fp);
         return RP_RCA;
     }
-    fclose(fp);
+    if (fclose(fp) == 0) {
+        shmStore(&calib_params);
+    }
 
     return RP_OK;
 }
 
 void calib_SetToZero() {
+    pthread_rwlock_wrlock(&calib_lock);
     calib.be_ch1_dc_offs = 0;
     calib.be_ch2_dc_offs = 0;
     calib.fe_ch1_lo_offs = 0;
@@ -165,14 +348,18 @@ void calib_SetToZero() {
     calib.fe_ch1_fs_g_hi = cmn_CalibFullScaleFromVoltage(1);
     calib.fe_ch2_fs_g_lo = cmn_CalibFullScaleFromVoltage(20);
     calib.fe_ch2_fs_g_hi = cmn_CalibFullScaleFromVoltage(1);
+    updateConversion();
+    calib_generation++;
+    pthread_rwlock_unlock(&calib_lock);
 }
 
 uint32_t calib_GetFrontEndScale(rp_channel_t channel, rp_pinState_t gain) {
+    rp_calib_params_t params = calib_GetParams();
     if (gain == RP_HIGH) {
-        return (channel == RP_CH_1 ? calib.fe_ch1_fs_g_hi : calib.fe_ch2_fs_g_hi);
+        return (channel == RP_CH_1 ? params.fe_ch1_fs_g_hi : params.fe_ch2_fs_g_hi);
     }
     else {
-        return (channel == RP_CH_1 ? calib.fe_ch1_fs_g_lo : calib.fe_ch2_fs_g_lo);
+        return (channel == RP_CH_1 ? params.fe_ch1_fs_g_lo : params.fe_ch2_fs_g_lo);
     }
 }
 
@@ -192,7 +379,7 @@ int calib_SetFrontEndOffset(rp_channel_t channel, rp_pinState_t gain, rp_calib_p
             params.fe_ch2_hi_offs = 0)
 	}
     /* Acquire uses this calibration parameters - reset them */
-    calib = params;
+    setCachedParams(&params);
 
 	if (gain == RP_LOW) {
 		CHANNEL_ACTION(channel,
@@ -222,6 +409,57 @@ int calib_SetFrontEndOffset(rp_channel_t channel, rp_pinState_t gain, rp_calib_p
     return calib_Init();
 }
 
+/**
+ * Offsets of both inputs from one acquisition, both have to be grounded
+ */
+int calib_SetFrontEndOffsets(rp_pinState_t gain, rp_calib_params_t* out_params) {
+    rp_calib_params_t params;
+    calib_ReadParams(&params);
+	failsafa_params = params;
+
+    /* Reset current calibration parameters*/
+    if (gain == RP_LOW) {
+        params.fe_ch1_lo_offs = 0;
+        params.fe_ch2_lo_offs = 0;
+    } else {
+        params.fe_ch1_hi_offs = 0;
+        params.fe_ch2_hi_offs = 0;
+    }
+    /* Acquire uses this calibration parameters - reset them */
+    setCachedParams(&params);
+
+    int status = calib_Acquire(gain);
+    if (status != RP_OK) {
+        setCachedParams(&failsafa_params);
+        return status;
+    }
+    int32_t offs1 = lround(calib_TrimmedMean(RP_CH_1));
+    int32_t offs2 = lround(calib_TrimmedMean(RP_CH_2));
+    fprintf(stderr, "\ncalib_SetFrontEndOffsets: ch1 = %d, ch2 = %d\n", offs1, offs2);
+
+    if (gain == RP_LOW) {
+        params.fe_ch1_lo_offs = offs1;
+        params.fe_ch2_lo_offs = offs2;
+    } else {
+        params.fe_ch1_hi_offs = offs1;
+        params.fe_ch2_hi_offs = offs2;
+    }
+
+    /* Set new local parameter */
+    if  (out_params) {
+        if (gain == RP_LOW) {
+            out_params->fe_ch1_lo_offs = params.fe_ch1_lo_offs;
+            out_params->fe_ch2_lo_offs = params.fe_ch2_lo_offs;
+        } else {
+            out_params->fe_ch1_hi_offs = params.fe_ch1_hi_offs;
+            out_params->fe_ch2_hi_offs = params.fe_ch2_hi_offs;
+        }
+    }
+    else
+        calib_WriteParams(params);
+    return calib_Init();
+}
+
 int calib_SetFrontEndScaleLV(rp_channel_t channel, float referentialVoltage, rp_calib_params_t* out_params) {
     rp_calib_params_t params;
     calib_ReadParams(&params);
@@ -232,7 +470,7 @@ int calib_SetFrontEndScaleLV(rp_channel_t channel, float referentialVoltage, rp_
             params.fe_ch1_fs_g_lo = cmn_CalibFullScaleFromVoltage(20),
             params.fe_ch2_fs_g_lo = cmn_CalibFullScaleFromVoltage(20))
     /* Acquire uses this calibration parameters - reset them */
-    calib = params;
+    setCachedParams(&params);
 
     /* Calculate real max adc voltage */
     float value = calib_GetDataMedianFloat(channel, RP_LOW);
@@ -264,7 +502,7 @@ int calib_SetFrontEndScaleHV(rp_channel_t channel, float referentialVoltage, rp_
             params.fe_ch1_fs_g_hi = cmn_CalibFullScaleFromVoltage(1),
             params.fe_ch2_fs_g_hi = cmn_CalibFullScaleFromVoltage(1))
     /* Acquire uses this calibration parameters - reset them */
-    calib = params;
+    setCachedParams(&params);
 
     /* Calculate real max adc voltage */
     float value = calib_GetDataMedianFloat(channel, RP_HIGH);
@@ -296,7 +534,7 @@ int calib_SetBackEndOffset(rp_channel_t channel) {
             params.be_ch1_dc_offs = 0,
             params.be_ch2_dc_offs = 0)
     /* Generate uses this calibration parameters - reset them */
-    calib = params;
+    setCachedParams(&params);
 
     /* Generate zero signal */
     rp_GenReset();
@@ -324,7 +562,7 @@ int calib_SetBackEndScale(rp_channel_t channel) {
             params.be_ch1_fs = cmn_CalibFullScaleFromVoltage(1),
             params.be_ch2_fs = cmn_CalibFullScaleFromVoltage(1))
     /* Generate uses this calibration parameters - reset them */
-    calib = params;
+    setCachedParams(&params);
 
     /* Generate constant signal signal */
     rp_GenReset();
@@ -381,7 +619,7 @@ int calib_CalibrateBackEnd(rp_channel_t channel, rp_calib_params_t* out_params)
             params.be_ch2_dc_offs = 0)
 
     /* Generate uses this calibration parameters - reset them */
-    calib = params;
+    setCachedParams(&params);
 
     float value1, value2;
     getGenAmp(channel, CONSTANT_SIGNAL_AMPLITUDE, &value1, &value2);
@@ -422,78 +660,160 @@ int calib_CalibrateBackEnd(rp_channel_t channel, rp_calib_params_t* out_params)
 
 int calib_Reset() {
     calib_SetToZero();
-    calib_WriteParams(calib);
+    calib_WriteParams(calib_GetParams());
     return calib_Init();
 }
 
-int32_t calib_GetDataMedian(rp_channel_t channel, rp_pinState_t gain) {
-    /* Acquire data */
-    rp_AcqReset();
-    rp_AcqSetGain(channel, gain);
-    rp_AcqSetDecimation(RP_DEC_64);
-    rp_AcqStart();
-    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
-    usleep(1000000);
-    rp_AcqStop();
+/*
+ * Measurements average CALIB_BUFFERS full buffers of both channels. Each
+ * buffer is read as soon as the FPGA wrote it, the only fixed wait is the
+ * settling of the relays and the generator output after a change.
+ */
+#define CALIB_BUFFERS       8
+#define CALIB_SETTLE_US     50000
+#define CALIB_TIMEOUT_NS    1000000000ULL
+// Share of the samples dropped at each end of the trimmed mean, and the tails cut off for the min/max
+#define CALIB_TRIM          0.1
+#define CALIB_TAIL          0.001
+// One bin per calibrated count, ADC_CALIB_MIN to ADC_CALIB_MAX of the readout
+#define CALIB_HIST_ZERO     (1 << (ADC_BITS - 1))
+#define CALIB_HIST_SIZE     ((1 << ADC_BITS) + 1)
+
+static uint32_t calib_hist[2][CALIB_HIST_SIZE];
+static uint64_t calib_hist_count;
+static int16_t  calib_data[2][ADC_BUFFER_SIZE];
+
+static uint64_t calib_NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-    int16_t data[BUFFER_LENGTH];
-    uint32_t bufferSize = (uint32_t) BUFFER_LENGTH;
-    rp_AcqGetDataRaw(channel, 0, &bufferSize, data);
+/**
+ * Fills the histograms of both channels with CALIB_BUFFERS buffers of
+ * calibrated counts. The trigger fires at once and a full buffer follows
+ * it, the FPGA clears the trigger source when the last sample is written.
+ */
+static int calib_Acquire(rp_pinState_t gain)
+{
+    memset(calib_hist, 0, sizeof(calib_hist));
+    calib_hist_count = 0;
 
-    long long avg = 0;
-    for(int i = 0; i < BUFFER_LENGTH; ++i)
-        avg += data[i];
+    rp_AcqReset();
+    rp_AcqSetGain(RP_CH_1, gain);
+    rp_AcqSetGain(RP_CH_2, gain);
+    rp_AcqSetDecimation(RP_DEC_64);
+    rp_AcqSetTriggerDelay(ADC_BUFFER_SIZE / 2);
+    usleep(CALIB_SETTLE_US);
+
+    int status = RP_OK;
+    for (int b = 0; b < CALIB_BUFFERS && status == RP_OK; ++b) {
+        rp_AcqStart();
+        rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
+        uint64_t deadline = calib_NowNs() + CALIB_TIMEOUT_NS;
+        rp_acq_trig_src_t source = RP_TRIG_SRC_NOW;
+        while (rp_AcqGetTriggerSrc(&source) == RP_OK && source != RP_TRIG_SRC_DISABLED) {
+            if (calib_NowNs() > deadline) {
+                status = RP_ETIM;
+                break;
+            }
+            // A buffer takes ADC_BUFFER_SIZE * 64 ADC clocks, about 8 ms
+            usleep(1000);
+        }
+        rp_AcqStop();
+        if (status != RP_OK) {
+            break;
+        }
+
+        for (int ch = 0; ch < 2; ++ch) {
+            uint32_t size = ADC_BUFFER_SIZE;
+            rp_AcqGetDataRaw(ch == 0 ? RP_CH_1 : RP_CH_2, 0, &size, calib_data[ch]);
+            for (uint32_t i = 0; i < size; ++i) {
+                calib_hist[ch][calib_data[ch][i] + CALIB_HIST_ZERO]++;
+            }
+        }
+        calib_hist_count += ADC_BUFFER_SIZE;
+    }
 
-    avg /= BUFFER_LENGTH;
-    fprintf(stderr, "\ncalib_GetDataMedian: avg = %d\n", (int32_t)avg);
-    return avg;
+    if (calib_hist_count == 0) {
+        fprintf(stderr, "\ncalib_Acquire: no buffer was filled\n");
+        return status;
+    }
+    if (status != RP_OK) {
+        fprintf(stderr, "\ncalib_Acquire: timeout, %u buffers acquired\n", (uint32_t)(calib_hist_count / ADC_BUFFER_SIZE));
+    }
+    return RP_OK;
 }
 
-float calib_GetDataMedianFloat(rp_channel_t channel, rp_pinState_t gain) {
-    rp_AcqReset();
-    rp_AcqSetGain(channel, gain);
-    rp_AcqSetDecimation(RP_DEC_64);
-    rp_AcqStart();
-    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
-    usleep(1000000);
-    int BUF_SIZE = BUFFER_LENGTH;
+/**
+ * Mean of the counts without the CALIB_TRIM lowest and highest samples,
+ * spikes and clipped samples do not pull it like a plain average.
+ */
+static double calib_TrimmedMean(rp_channel_t channel)
+{
+    const uint32_t* hist = calib_hist[channel == RP_CH_1 ? 0 : 1];
+    uint64_t lo = (uint64_t)(calib_hist_count * CALIB_TRIM);
+    uint64_t hi = calib_hist_count - lo;
+    uint64_t cum = 0;
+    double sum = 0;
+    for (int i = 0; i < CALIB_HIST_SIZE && cum < hi; ++i) {
+        uint64_t first = MAX(cum, lo);
+        uint64_t last = MIN(cum + hist[i], hi);
+        if (last > first) {
+            sum += (double)(last - first) * (i - CALIB_HIST_ZERO);
+        }
+        cum += hist[i];
+    }
+    return hi > lo ? sum / (double)(hi - lo) : 0;
+}
 
-    rp_AcqStop();
+/**
+ * Count below which the fraction p of the samples lies
+ */
+static int32_t calib_Percentile(rp_channel_t channel, double p)
+{
+    const uint32_t* hist = calib_hist[channel == RP_CH_1 ? 0 : 1];
+    uint64_t target = (uint64_t)(calib_hist_count * p);
+    uint64_t cum = 0;
+    for (int i = 0; i < CALIB_HIST_SIZE; ++i) {
+        cum += hist[i];
+        if (cum > target) {
+            return i - CALIB_HIST_ZERO;
+        }
+    }
+    return CALIB_HIST_SIZE - 1 - CALIB_HIST_ZERO;
+}
 
-    float data[BUF_SIZE];
-    uint32_t bufferSize = (uint32_t) BUF_SIZE;
-    rp_AcqGetDataV(channel, 0, &bufferSize, data);
+static float calib_CntsToV(rp_channel_t channel, rp_pinState_t gain, double cnts)
+{
+    float scale;
+    int32_t dc_offs;
+    calib_GetConversion(channel, gain, &scale, &dc_offs);
+    return cnts * scale;
+}
 
-    double avg = 0;
-    for(int i = 0; i < BUFFER_LENGTH; ++i)
-        avg += data[i];
+int32_t calib_GetDataMedian(rp_channel_t channel, rp_pinState_t gain) {
+    calib_Acquire(gain);
+    int32_t avg = lround(calib_TrimmedMean(channel));
+    fprintf(stderr, "\ncalib_GetDataMedian: avg = %d\n", avg);
+    return avg;
+}
 
-    avg /= BUFFER_LENGTH;
-    fprintf(stderr, "\ncalib_GetDataMedianFloat: avg = %f\n", (float)avg);
+float calib_GetDataMedianFloat(rp_channel_t channel, rp_pinState_t gain) {
+    calib_Acquire(gain);
+    float avg = calib_CntsToV(channel, gain, calib_TrimmedMean(channel));
+    fprintf(stderr, "\ncalib_GetDataMedianFloat: avg = %f\n", avg);
     return avg;
 }
 
 int calib_GetDataMinMaxFloat(rp_channel_t channel, rp_pinState_t gain, float* min, float* max) {
-    rp_AcqReset();
-    rp_AcqSetGain(channel, gain);
-    rp_AcqSetDecimation(RP_DEC_64);
-    rp_AcqStart();
-    rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
-    usleep(1000000);
-    int BUF_SIZE = BUFFER_LENGTH;
-
-    rp_AcqStop();
-
-    float data[BUF_SIZE];
-    uint32_t bufferSize = (uint32_t) BUF_SIZE;
-    rp_AcqGetDataV(channel, 0, &bufferSize, data);
-
-    float _min = data[0];
-    float _max = data[0];
-    for(int i = 1; i < BUFFER_LENGTH; ++i) {
-        _min = (_min > data[i]) ? data[i] : _min;
-        _max = (_max < data[i]) ? data[i] : _max;
+    int status = calib_Acquire(gain);
+    if (status != RP_OK) {
+        return status;
     }
+    float _min = calib_CntsToV(channel, gain, calib_Percentile(channel, CALIB_TAIL));
+    float _max = calib_CntsToV(channel, gain, calib_Percentile(channel, 1 - CALIB_TAIL));
 
     fprintf(stderr, "\ncalib_GetDataMinMaxFloat: min = %f, max = %f\n", _min, _max);
     *min = _min;
@@ -504,7 +824,7 @@ int calib_GetDataMinMaxFloat(rp_channel_t channel, rp_pinState_t gain, float* mi
 int calib_setCachedParams() {
 	fprintf(stderr, "write FAILSAFE PARAMS\n");
     calib_WriteParams(failsafa_params);
-    calib = failsafa_params;
+    setCachedParams(&failsafa_params);
 
     return 0;
 }
@@ -25,11 +25,14 @@ int calib_Init();
 int calib_Release();
 
 rp_calib_params_t calib_GetParams();
+uint32_t calib_GetGeneration();
+int calib_GetConversion(rp_channel_t channel, rp_pinState_t gain, float* scale, int32_t* dc_offs);
 int calib_WriteParams(rp_calib_params_t calib_params);
 void calib_SetToZero();
 
 uint32_t calib_GetFrontEndScale(rp_channel_t channel, rp_pinState_t gain);
 int calib_SetFrontEndOffset(rp_channel_t channel, rp_pinState_t gain, rp_calib_params_t* out_params);
+int calib_SetFrontEndOffsets(rp_pinState_t gain, rp_calib_params_t* out_params);
 int calib_SetFrontEndScaleLV(rp_channel_t channel, float referentialVoltage, rp_calib_params_t* out_params);
 int calib_SetFrontEndScaleHV(rp_channel_t channel, float referentialVoltage, rp_calib_params_t* out_params);
 
@@ -12,16 +12,76 @@
  * for more details on the language used herein.
  */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/timex.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <math.h>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CMN_USE_NEON
+#endif
+
+#define COMMON_C_
 #include "common.h"
 
 static int fd = 0;
 
+// Interrupt listener on the api UIO device, opened on first use
+static int irq_fd = -1;
+static bool irq_unsupported = false;
+// Guards opening and closing irq_fd, waiting threads share the descriptor
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Write-through copies of configuration registers. Reads of a registered field
+ * are served from RAM, writes go to the FPGA and the copy. Status registers
+ * (write pointers, trigger state) are never registered and keep reading the
+ * hardware. Fields hash into an open addressed table on their word address.
+ */
+#define SHADOW_SLOTS 128
+
+typedef struct {
+    volatile uint32_t* field;
+    uint32_t           value;
+} shadow_reg_t;
+
+static shadow_reg_t shadow[SHADOW_SLOTS];
+
+static shadow_reg_t* shadowFind(volatile uint32_t* field)
+{
+    size_t slot = ((uintptr_t)field >> 2) & (SHADOW_SLOTS - 1);
+    for (size_t n = 0; n < SHADOW_SLOTS; ++n, slot = (slot + 1) & (SHADOW_SLOTS - 1)) {
+        if (shadow[slot].field == field) {
+            return &shadow[slot];
+        }
+        if (shadow[slot].field == NULL) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static int shadowInsert(volatile uint32_t* field, uint32_t value)
+{
+    size_t slot = ((uintptr_t)field >> 2) & (SHADOW_SLOTS - 1);
+    for (size_t n = 0; n < SHADOW_SLOTS; ++n, slot = (slot + 1) & (SHADOW_SLOTS - 1)) {
+        if (shadow[slot].field == NULL || shadow[slot].field == field) {
+            shadow[slot].field = field;
+            shadow[slot].value = value;
+            return RP_OK;
+        }
+    }
+    return RP_EOOR;
+}
+
 int cmn_Init()
 {
     if (!fd) {
@@ -34,8 +94,16 @@ int cmn_Init()
 
 int cmn_Release()
 {
+    if (irq_fd >= 0) {
+        close(irq_fd);
+        irq_fd = -1;
+    }
+    irq_unsupported = false;
+
     if (fd) {
-        if(close(fd) < 0) {
+        int ret = close(fd);
+        fd = 0;
+        if(ret < 0) {
             return RP_ECMD;
         }
     }
@@ -53,7 +121,7 @@ int cmn_Map(size_t size, size_t offset, void** mapped)
 
     *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
 
-    if(mapped == (void *) -1) {
+    if(*mapped == MAP_FAILED) {
         return RP_EMMD;
     }
 
@@ -74,6 +142,7 @@ int cmn_Unmap(size_t size, void** mapped)
         return RP_EUMD;
     }
 
+    cmn_ShadowRemove(*mapped, size);
     if(munmap(*mapped, size) < 0){
         return RP_EUMD;
     }
@@ -81,14 +150,227 @@ int cmn_Unmap(size_t size, void** mapped)
     return RP_OK;
 }
 
+/**
+ * Enables the interrupt of the api UIO device. Images without an interrupt
+ * line refuse the enable write, after that every call returns RP_NOTS.
+ */
+int cmn_IrqEnable()
+{
+    int status = RP_OK;
+    pthread_mutex_lock(&irq_lock);
+    if (irq_unsupported) {
+        status = RP_NOTS;
+    }
+    else {
+        // Non-blocking, so a thread that lost the interrupt to another one does not hang in read()
+        if (irq_fd < 0) {
+            irq_fd = open("/dev/uio/api", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+        }
+        int32_t enable = 1;
+        if (irq_fd < 0 || write(irq_fd, &enable, sizeof(enable)) != sizeof(enable)) {
+            if (irq_fd >= 0) {
+                close(irq_fd);
+                irq_fd = -1;
+            }
+            irq_unsupported = true;
+            status = RP_NOTS;
+        }
+    }
+    pthread_mutex_unlock(&irq_lock);
+    return status;
+}
+
+/**
+ * Waits up to timeout_ms for an interrupt and consumes it.
+ * @retval RP_OK An interrupt arrived
+ * @retval RP_ETIM No interrupt within timeout_ms
+ * @retval RP_NOTS The device has no interrupt
+ */
+int cmn_IrqWait(int timeout_ms)
+{
+    if (irq_fd < 0) {
+        return RP_NOTS;
+    }
+    struct pollfd pfd = { .fd = irq_fd, .events = POLLIN, .revents = 0 };
+    int res = poll(&pfd, 1, timeout_ms);
+    if (res == 0 || (res < 0 && errno == EINTR)) {
+        return RP_ETIM;
+    }
+    if (res < 0 || (pfd.revents & (POLLERR | POLLNVAL))) {
+        pthread_mutex_lock(&irq_lock);
+        if (irq_fd == pfd.fd) {
+            close(irq_fd);
+            irq_fd = -1;
+        }
+        irq_unsupported = true;
+        pthread_mutex_unlock(&irq_lock);
+        return RP_NOTS;
+    }
+    uint32_t count;
+    if (read(irq_fd, &count, sizeof(count)) != sizeof(count)) {
+        return RP_ETIM;
+    }
+    return RP_OK;
+}
+
+int cmn_IrqGetFd()
+{
+    return irq_fd;
+}
+
+int64_t cmn_RealtimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * adjtimex() with no mode bits only reads the kernel clock state, the
+ * errors are in microseconds.
+ */
+int cmn_GetTimeBase(rp_time_base_t* base)
+{
+    if (base == NULL) {
+        return RP_UIA;
+    }
+    struct timex tx;
+    memset(&tx, 0, sizeof(tx));
+    int state = adjtimex(&tx);
+    if (state < 0) {
+        return RP_NOTS;
+    }
+    base->synchronized = state != TIME_ERROR && !(tx.status & STA_UNSYNC);
+    base->ptp = access("/dev/ptp0", F_OK) == 0;
+    base->est_error_ns = (uint32_t)MIN((uint64_t)MAX(tx.esterror, 0) * 1000, UINT32_MAX);
+    base->max_error_ns = (uint32_t)MIN((uint64_t)MAX(tx.maxerror, 0) * 1000, UINT32_MAX);
+    return RP_OK;
+}
+
+/**
+ * Registers a configuration register for the shadow copy, its current value is read once.
+ * Only registers that the FPGA never changes on its own may be registered.
+ */
+int cmn_ShadowAdd(volatile uint32_t* field)
+{
+    return shadowInsert(field, *field);
+}
+
+/**
+ * Drops the registers of a mapping that goes away
+ */
+void cmn_ShadowRemove(void* base, size_t size)
+{
+    shadow_reg_t kept[SHADOW_SLOTS];
+    size_t count = 0;
+    for (size_t i = 0; i < SHADOW_SLOTS; ++i) {
+        char* addr = (char*)shadow[i].field;
+        if (shadow[i].field != NULL && (addr < (char*)base || addr >= (char*)base + size)) {
+            kept[count++] = shadow[i];
+        }
+    }
+    memset(shadow, 0, sizeof(shadow));
+    for (size_t i = 0; i < count; ++i) {
+        shadowInsert(kept[i].field, kept[i].value);
+    }
+}
+
+/**
+ * Re-reads every registered register, for when something else wrote the FPGA
+ */
+void cmn_ShadowReload()
+{
+    for (size_t i = 0; i < SHADOW_SLOTS; ++i) {
+        if (shadow[i].field != NULL) {
+            shadow[i].value = *shadow[i].field;
+        }
+    }
+}
+
+/*
+ * Writes to shadowed registers between cmn_BatchBegin() and cmn_BatchCommit()
+ * are coalesced per register and written back to back at the commit. Any other
+ * register write flushes the queue first, so writes keep their order relative
+ * to control and status registers. Batches are per thread and may nest.
+ */
+#define BATCH_MAX 64
+
+static __thread shadow_reg_t batch[BATCH_MAX];
+static __thread int batch_count = 0;
+static __thread int batch_depth = 0;
+
+static void batchFlush()
+{
+    for (int i = 0; i < batch_count; ++i) {
+        SET_VALUE(*batch[i].field, batch[i].value);
+        shadow_reg_t* reg = shadowFind(batch[i].field);
+        if (reg) {
+            reg->value = batch[i].value;
+        }
+    }
+    batch_count = 0;
+}
+
+static uint32_t readField(volatile uint32_t* field)
+{
+    for (int i = 0; i < batch_count; ++i) {
+        if (batch[i].field == field) {
+            return batch[i].value;
+        }
+    }
+    shadow_reg_t* reg = shadowFind(field);
+    return reg ? reg->value : *field;
+}
+
+static void writeField(volatile uint32_t* field, uint32_t value)
+{
+    shadow_reg_t* reg = shadowFind(field);
+    if (batch_depth > 0 && reg) {
+        for (int i = 0; i < batch_count; ++i) {
+            if (batch[i].field == field) {
+                batch[i].value = value;
+                return;
+            }
+        }
+        if (batch_count == BATCH_MAX) {
+            batchFlush();
+        }
+        batch[batch_count].field = field;
+        batch[batch_count].value = value;
+        batch_count++;
+        return;
+    }
+    batchFlush();
+    SET_VALUE(*field, value);
+    if (reg) {
+        reg->value = value;
+    }
+}
+
+int cmn_BatchBegin()
+{
+    batch_depth++;
+    return RP_OK;
+}
+
+int cmn_BatchCommit()
+{
+    if (batch_depth == 0) {
+        return RP_EOOR;
+    }
+    if (--batch_depth == 0) {
+        batchFlush();
+    }
+    return RP_OK;
+}
+
 int cmn_SetShiftedValue(volatile uint32_t* field, uint32_t value, uint32_t mask, uint32_t bitsToSetShift)
 {
     VALIDATE_BITS(value, mask);
-    uint32_t currentValue;
-    cmn_GetValue(field, &currentValue, 0xffffffff);
+    uint32_t currentValue = readField(field);
     currentValue &=  ~(mask << bitsToSetShift); // Clear all bits at specified location
     currentValue +=  (value << bitsToSetShift); // Set value at specified location
-    SET_VALUE(*field, currentValue);
+    writeField(field, currentValue);
     return RP_OK;
 }
 
@@ -99,7 +381,7 @@ int cmn_SetValue(volatile uint32_t* field, uint32_t value, uint32_t mask)
 
 int cmn_GetShiftedValue(volatile uint32_t* field, uint32_t* value, uint32_t mask, uint32_t bitsToSetShift)
 {
-    *value = (*field >> bitsToSetShift) & mask;
+    *value = (readField(field) >> bitsToSetShift) & mask;
     return RP_OK;
 }
 
@@ -111,14 +393,18 @@ int cmn_GetValue(volatile uint32_t* field, uint32_t* value, uint32_t mask)
 int cmn_SetBits(volatile uint32_t* field, uint32_t bits, uint32_t mask)
 {
     VALIDATE_BITS(bits, mask);
-    SET_BITS(*field, bits);
+    uint32_t currentValue = readField(field);
+    SET_BITS(currentValue, bits);
+    writeField(field, currentValue);
     return RP_OK;
 }
 
 int cmn_UnsetBits(volatile uint32_t* field, uint32_t bits, uint32_t mask)
 {
     VALIDATE_BITS(bits, mask);
-    UNSET_BITS(*field, bits);
+    uint32_t currentValue = readField(field);
+    UNSET_BITS(currentValue, bits);
+    writeField(field, currentValue);
     return RP_OK;
 }
 
@@ -129,6 +415,96 @@ int cmn_AreBitsSet(volatile uint32_t field, uint32_t bits, uint32_t mask, bool*
     return RP_OK;
 }
 
+/*
+ * Register access statistics, one slot per function that accesses registers.
+ * Slots hash on the address of the function name and are taken with a compare
+ * and swap, the counters are added atomically, so any thread may count without
+ * a lock. Without RP_REG_STATS nothing is counted.
+ */
+#ifdef RP_REG_STATS
+#define REG_STATS_SLOTS 256
+
+typedef struct {
+    const char* func;
+    uint64_t    reads;
+    uint64_t    writes;
+    uint64_t    time_ns;
+} reg_stats_slot_t;
+
+static reg_stats_slot_t reg_stats[REG_STATS_SLOTS];
+
+int64_t cmn_RegStatsNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void cmn_RegStatsAdd(const char* func, bool write, int64_t start_ns)
+{
+    int64_t elapsed = cmn_RegStatsNow() - start_ns;
+    size_t slot = ((uintptr_t)func >> 2) & (REG_STATS_SLOTS - 1);
+    for (size_t n = 0; n < REG_STATS_SLOTS; ++n, slot = (slot + 1) & (REG_STATS_SLOTS - 1)) {
+        const char* expected = NULL;
+        if (__atomic_load_n(&reg_stats[slot].func, __ATOMIC_ACQUIRE) == func
+            || __atomic_compare_exchange_n(&reg_stats[slot].func, &expected, func, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+            || expected == func) {
+            __atomic_fetch_add(write ? &reg_stats[slot].writes : &reg_stats[slot].reads, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&reg_stats[slot].time_ns, (uint64_t)elapsed, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    // Table full, the access goes uncounted
+}
+#endif
+
+/**
+ * Copies the counters of up to *count functions to stats and returns the number
+ * of functions in *count, RP_BTS if that is more than fitted.
+ */
+int cmn_RegStatsGet(rp_reg_stats_t* stats, uint32_t* count)
+{
+#ifdef RP_REG_STATS
+    uint32_t found = 0;
+    for (size_t i = 0; i < REG_STATS_SLOTS; ++i) {
+        const char* func = __atomic_load_n(&reg_stats[i].func, __ATOMIC_ACQUIRE);
+        if (func == NULL) {
+            continue;
+        }
+        if (found < *count) {
+            stats[found].function = func;
+            stats[found].reads = __atomic_load_n(&reg_stats[i].reads, __ATOMIC_RELAXED);
+            stats[found].writes = __atomic_load_n(&reg_stats[i].writes, __ATOMIC_RELAXED);
+            stats[found].time_ns = __atomic_load_n(&reg_stats[i].time_ns, __ATOMIC_RELAXED);
+        }
+        found++;
+    }
+    int ret = found > *count ? RP_BTS : RP_OK;
+    *count = found;
+    return ret;
+#else
+    *count = 0;
+    return RP_NOTS;
+#endif
+}
+
+/**
+ * Zeroes the counters, the functions keep their slots
+ */
+int cmn_RegStatsReset()
+{
+#ifdef RP_REG_STATS
+    for (size_t i = 0; i < REG_STATS_SLOTS; ++i) {
+        __atomic_store_n(&reg_stats[i].reads, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&reg_stats[i].writes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&reg_stats[i].time_ns, 0, __ATOMIC_RELAXED);
+    }
+    return RP_OK;
+#else
+    return RP_NOTS;
+#endif
+}
+
 /* 32 bit integer comparator */
 int intcmp(const void *v1, const void *v2)
 {
@@ -275,6 +651,72 @@ float cmn_CnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32_t
 float rp_cmn_CnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off) {
 	return cmn_CnvCntToV(field_len, cnts, adc_max_v, calibScale, calib_dc_off, user_dc_off);
 }
+
+/*
+ * The array converters fold cmn_CnvCalibCntToV() into volts = counts * gain + offset,
+ * computed in single precision. Counts are sign extended from field_len bits with
+ * a shift pair, like cmn_CalibCnts() does for counts within the field.
+ */
+static void cnvGain(uint32_t field_len, float adc_max_v, uint32_t calibScale, float user_dc_off, float* gain, float* offset)
+{
+    double scale = (double)cmn_CalibFullScaleToVoltage(calibScale) / ((double)FULL_SCALE_NORM / (double)adc_max_v);
+    *gain = (float)((double)adc_max_v / (double)(1 << (field_len - 1)) * scale);
+    *offset = (float)((double)user_dc_off * scale);
+}
+
+int cmn_CnvCntsToV(uint32_t field_len, const uint32_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off, float* buffer)
+{
+    if (field_len < 2 || field_len > 31) {
+        return RP_EOOR;
+    }
+    float gain, offset;
+    cnvGain(field_len, adc_max_v, calibScale, user_dc_off, &gain, &offset);
+    const int shift = 32 - field_len;
+    const int32_t lo = -(1 << (field_len - 1));
+    const int32_t hi = 1 << (field_len - 1);
+    uint32_t i = 0;
+#ifdef CMN_USE_NEON
+    const int32x4_t up = vdupq_n_s32(shift);
+    const int32x4_t down = vdupq_n_s32(-shift);
+    const int32x4_t offs = vdupq_n_s32(calib_dc_off);
+    const int32x4_t vlo = vdupq_n_s32(lo);
+    const int32x4_t vhi = vdupq_n_s32(hi);
+    const float32x4_t voffset = vdupq_n_f32(offset);
+    for (; i + 4 <= size; i += 4) {
+        int32x4_t m = vshlq_s32(vshlq_s32(vreinterpretq_s32_u32(vld1q_u32(cnts + i)), up), down);
+        m = vminq_s32(vmaxq_s32(vsubq_s32(m, offs), vlo), vhi);
+        vst1q_f32(buffer + i, vmlaq_n_f32(voffset, vcvtq_f32_s32(m), gain));
+    }
+#endif
+    for (; i < size; ++i) {
+        int32_t m = ((int32_t)(cnts[i] << shift) >> shift) - calib_dc_off;
+        m = m < lo ? lo : (m > hi ? hi : m);
+        buffer[i] = (float)m * gain + offset;
+    }
+    return RP_OK;
+}
+
+int cmn_CnvCalibCntsToV(uint32_t field_len, const int16_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, float user_dc_off, float* buffer)
+{
+    if (field_len < 2 || field_len > 16) {
+        return RP_EOOR;
+    }
+    float gain, offset;
+    cnvGain(field_len, adc_max_v, calibScale, user_dc_off, &gain, &offset);
+    uint32_t i = 0;
+#ifdef CMN_USE_NEON
+    const float32x4_t voffset = vdupq_n_f32(offset);
+    for (; i + 8 <= size; i += 8) {
+        int16x8_t m = vld1q_s16(cnts + i);
+        vst1q_f32(buffer + i, vmlaq_n_f32(voffset, vcvtq_f32_s32(vmovl_s16(vget_low_s16(m))), gain));
+        vst1q_f32(buffer + i + 4, vmlaq_n_f32(voffset, vcvtq_f32_s32(vmovl_s16(vget_high_s16(m))), gain));
+    }
+#endif
+    for (; i < size; ++i) {
+        buffer[i] = (float)cnts[i] * gain + offset;
+    }
+    return RP_OK;
+}
 /**
  * @brief Converts voltage in [V] to ADC/DAC/Buffer counts
  *
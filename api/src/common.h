@@ -41,8 +41,10 @@ else { \
 }
 
 // unmasked IO read/write (p - pointer, v - value)
+#ifndef RP_REG_STATS
 #define ioread32(p) (*(volatile uint32_t *)(p))
 #define iowrite32(v,p) (*(volatile uint32_t *)(p) = (v))
+#endif
 
 #define SET_BITS(x,b) ((x) |= (b))
 #define UNSET_BITS(x,b) ((x) &= ~(b))
@@ -66,6 +68,19 @@ int cmn_Release();
 int cmn_Map(size_t size, size_t offset, void** mapped);
 int cmn_Unmap(size_t size, void** mapped);
 
+int cmn_IrqEnable();
+int cmn_IrqWait(int timeout_ms);
+int cmn_IrqGetFd();
+
+int64_t cmn_RealtimeNs();
+int cmn_GetTimeBase(rp_time_base_t* base);
+
+int cmn_ShadowAdd(volatile uint32_t* field);
+void cmn_ShadowRemove(void* base, size_t size);
+void cmn_ShadowReload();
+int cmn_BatchBegin();
+int cmn_BatchCommit();
+
 int cmn_SetBits(volatile uint32_t* field, uint32_t bits, uint32_t mask);
 int cmn_UnsetBits(volatile uint32_t* field, uint32_t bits, uint32_t mask);
 int cmn_SetValue(volatile uint32_t* field, uint32_t value, uint32_t mask);
@@ -74,6 +89,56 @@ int cmn_GetValue(volatile uint32_t* field, uint32_t* value, uint32_t mask);
 int cmn_GetShiftedValue(volatile uint32_t* field, uint32_t* value, uint32_t mask, uint32_t bitsToSetShift);
 int cmn_AreBitsSet(volatile uint32_t field, uint32_t bits, uint32_t mask, bool* result);
 
+int cmn_RegStatsGet(rp_reg_stats_t* stats, uint32_t* count);
+int cmn_RegStatsReset();
+
+/*
+ * With RP_REG_STATS (make REG_STATS=1) every register access through the
+ * macros and accessors above is counted and timed against the function it is
+ * written in, see rp_RegStatsGet(). Without it they stay plain loads, stores
+ * and calls.
+ */
+#ifdef RP_REG_STATS
+int64_t cmn_RegStatsNow();
+void cmn_RegStatsAdd(const char* func, bool write, int64_t start_ns);
+
+static inline uint32_t cmn_RegStatsRead(const char* func, volatile uint32_t* p)
+{
+    int64_t start = cmn_RegStatsNow();
+    uint32_t value = *p;
+    cmn_RegStatsAdd(func, false, start);
+    return value;
+}
+
+static inline uint32_t cmn_RegStatsWrite(const char* func, uint32_t v, volatile uint32_t* p)
+{
+    int64_t start = cmn_RegStatsNow();
+    *p = v;
+    cmn_RegStatsAdd(func, true, start);
+    return v;
+}
+
+#define ioread32(p) cmn_RegStatsRead(__func__, (volatile uint32_t *)(p))
+#define iowrite32(v,p) cmn_RegStatsWrite(__func__, (v), (volatile uint32_t *)(p))
+
+#define CMN_REG_STATS_CALL(write, call) ({ \
+        int64_t stats_start_ = cmn_RegStatsNow(); \
+        int stats_ret_ = (call); \
+        cmn_RegStatsAdd(__func__, (write), stats_start_); \
+        stats_ret_; \
+})
+
+// common.c defines the accessors and does not see these
+#ifndef COMMON_C_
+#define cmn_SetBits(...) CMN_REG_STATS_CALL(true, cmn_SetBits(__VA_ARGS__))
+#define cmn_UnsetBits(...) CMN_REG_STATS_CALL(true, cmn_UnsetBits(__VA_ARGS__))
+#define cmn_SetValue(...) CMN_REG_STATS_CALL(true, cmn_SetValue(__VA_ARGS__))
+#define cmn_SetShiftedValue(...) CMN_REG_STATS_CALL(true, cmn_SetShiftedValue(__VA_ARGS__))
+#define cmn_GetValue(...) CMN_REG_STATS_CALL(false, cmn_GetValue(__VA_ARGS__))
+#define cmn_GetShiftedValue(...) CMN_REG_STATS_CALL(false, cmn_GetShiftedValue(__VA_ARGS__))
+#endif
+#endif
+
 int intcmp(const void *a, const void *b);
 int int16cmp(const void *aa, const void *bb);
 int floatCmp(const void *a, const void *b);
@@ -84,6 +149,8 @@ uint32_t cmn_CalibFullScaleFromVoltage(float voltageScale);
 int32_t cmn_CalibCnts(uint32_t field_len, uint32_t cnts, int calib_dc_off);
 float cmn_CnvCalibCntToV(uint32_t field_len, int32_t calib_cnts, float adc_max_v, float calibScale, float user_dc_off);
 float cmn_CnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off);
+int cmn_CnvCntsToV(uint32_t field_len, const uint32_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off, float* buffer);
+int cmn_CnvCalibCntsToV(uint32_t field_len, const int16_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, float user_dc_off, float* buffer);
 uint32_t cmn_CnvVToCnt(uint32_t field_len, float voltage, float adc_max_v, bool calibFS_LO, uint32_t calib_scale, int calib_dc_off, float user_dc_off);
 
 float rp_cmn_CalibFullScaleToVoltage(uint32_t fullScaleGain);
@@ -0,0 +1,1007 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya shared DSP helpers.
+ *
+ * Plans and window tables live in small caches with least recently used
+ * replacement, so applications that change the length on every measurement
+ * do not grow without bound. The plans keep their own scratch buffers, so
+ * every transform runs under dsp_lock.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DSP_USE_NEON
+#endif
+
+#include "redpitaya/rp.h"
+#include "redpitaya/rp_dsp.h"
+#include "kiss_fftr.h"
+#include "spec_fft.h"
+
+_Static_assert(sizeof(rp_dsp_cpx_t) == sizeof(kiss_fft_cpx), "rp_dsp_cpx_t must match kiss_fft_cpx");
+
+#define DSP_CACHE_SIZE 8
+
+typedef enum {
+    DSP_PLAN_FWD,   // kiss_fftr_cfg, forward
+    DSP_PLAN_INV,   // kiss_fftr_cfg, inverse
+    DSP_PLAN_ABS,   // spec_fft_t
+    DSP_PLAN_CPX    // kiss_fft_cfg, complex forward
+} dsp_plan_kind_t;
+
+typedef struct {
+    dsp_plan_kind_t kind;
+    int             len;
+    void           *plan;
+    uint32_t        used;   // Tick of the last use, 0 for a free slot
+} dsp_plan_t;
+
+typedef struct {
+    rp_dsp_win_t type;
+    double       beta;
+    double       amp;
+    int          len;
+    float       *table;   // amp * w[n]
+    double       cg;      // Coherent gain of w[n]
+    double       enbw;    // Equivalent noise bandwidth of w[n] in bins
+    uint32_t     used;
+} dsp_window_t;
+
+static pthread_mutex_t dsp_lock = PTHREAD_MUTEX_INITIALIZER;
+static dsp_plan_t      plans[DSP_CACHE_SIZE];
+static dsp_window_t    windows[DSP_CACHE_SIZE];
+static uint32_t        tick = 0;
+
+/* Bins and windowed samples of the kiss fallback of fftAbs(), mixed
+ * samples and bins of rp_DspZoomFftAbs() */
+static void           *scratch = NULL;
+static size_t          scratch_size = 0;
+
+/* Decimation filter of rp_DspZoomFftAbs() for zoom_dec */
+static float          *zoom_fir = NULL;
+static int             zoom_fir_len = 0;
+static int             zoom_dec = 0;
+
+static void planFree(dsp_plan_t *p)
+{
+    if (p->kind == DSP_PLAN_ABS)
+        spec_fft_free(p->plan);
+    else
+        free(p->plan);
+    p->plan = NULL;
+    p->used = 0;
+}
+
+static void *planGet(dsp_plan_kind_t kind, int len)
+{
+    dsp_plan_t *slot = &plans[0];
+
+    if (++tick == 0)
+        tick = 1;
+    for (int i = 0; i < DSP_CACHE_SIZE; i++) {
+        if (plans[i].used && plans[i].kind == kind && plans[i].len == len) {
+            plans[i].used = tick;
+            return plans[i].plan;
+        }
+        if (plans[i].used < slot->used)
+            slot = &plans[i];
+    }
+
+    if (slot->used)
+        planFree(slot);
+    if (kind == DSP_PLAN_ABS)
+        slot->plan = spec_fft_alloc(len);
+    else if (kind == DSP_PLAN_CPX)
+        slot->plan = kiss_fft_alloc(len, 0, NULL, NULL);
+    else
+        slot->plan = kiss_fftr_alloc(len, kind == DSP_PLAN_INV, NULL, NULL);
+    if (slot->plan == NULL)
+        return NULL;
+    slot->kind = kind;
+    slot->len = len;
+    slot->used = tick;
+    return slot->plan;
+}
+
+/* Zero order modified Bessel function of the first kind */
+static double besselI0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/* Symmetric window, w[0] = w[len - 1] */
+static double windowValue(rp_dsp_win_t type, double beta, int n, int len)
+{
+    double x = 2 * M_PI * n / (double)(len - 1);
+
+    switch (type) {
+        case RP_DSP_WIN_HANN:
+            return 0.5 * (1 - cos(x));
+        case RP_DSP_WIN_BLACKMAN_HARRIS:
+            return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+        case RP_DSP_WIN_FLAT_TOP:
+            return 0.21557895 - 0.41663158 * cos(x) + 0.277263158 * cos(2 * x)
+                 - 0.083578947 * cos(3 * x) + 0.006947368 * cos(4 * x);
+        case RP_DSP_WIN_KAISER: {
+            double r = 2.0 * n / (double)(len - 1) - 1;
+            return besselI0(beta * sqrt(1 - r * r)) / besselI0(beta);
+        }
+        default:
+            return 1;
+    }
+}
+
+static dsp_window_t *windowGet(rp_dsp_win_t type, double beta, double amp, int len)
+{
+    dsp_window_t *slot = &windows[0];
+
+    if (type != RP_DSP_WIN_KAISER)
+        beta = 0;
+    if (++tick == 0)
+        tick = 1;
+    for (int i = 0; i < DSP_CACHE_SIZE; i++) {
+        dsp_window_t *w = &windows[i];
+        if (w->used && w->type == type && w->beta == beta && w->amp == amp && w->len == len) {
+            w->used = tick;
+            return w;
+        }
+        if (w->used < slot->used)
+            slot = w;
+    }
+
+    rp_DspFree(slot->table);
+    slot->used = 0;
+    slot->table = rp_DspAlloc(len * sizeof(float));
+    if (slot->table == NULL)
+        return NULL;
+    double sum = 0, sum2 = 0;
+    for (int i = 0; i < len; i++) {
+        double w = windowValue(type, beta, i, len);
+        slot->table[i] = amp * w;
+        sum += w;
+        sum2 += w * w;
+    }
+    slot->type = type;
+    slot->beta = beta;
+    slot->amp = amp;
+    slot->len = len;
+    slot->cg = sum / len;
+    slot->enbw = len * sum2 / (sum * sum);
+    slot->used = tick;
+    return slot;
+}
+
+static void *scratchGet(size_t size)
+{
+    if (size > scratch_size) {
+        rp_DspFree(scratch);
+        scratch = rp_DspAlloc(size);
+        scratch_size = scratch ? size : 0;
+    }
+    return scratch;
+}
+
+static bool usesFloatFft(int len)
+{
+#ifdef SPECTR_FFT_KISS
+    return false;
+#else
+    return len >= 8 && (len & (len - 1)) == 0;
+#endif
+}
+
+/* Called with dsp_lock held. Both signals go into one complex transform,
+ * in1 as the real and in2 as the imaginary part. Returns the len bins Z of
+ * it in the scratch buffer, X1[k] = (Z[k] + Z*[-k]) / 2 and
+ * X2[k] = (Z[k] - Z*[-k]) / 2i by the symmetry of real spectra. */
+static kiss_fft_cpx *kissPair(int len, const float *win, const double *in1, const double *in2)
+{
+    kiss_fft_cfg cfg = planGet(DSP_PLAN_CPX, len);
+    kiss_fft_cpx *z = scratchGet(2 * len * sizeof(kiss_fft_cpx));
+    if (cfg == NULL || z == NULL)
+        return NULL;
+    kiss_fft_cpx *x = z + len;
+    for (int i = 0; i < len; i++) {
+        double w = win ? win[i] : 1.0;
+        z[i].r = in1[i] * w;
+        z[i].i = in2[i] * w;
+    }
+    kiss_fft(cfg, z, x);
+    return x;
+}
+
+int rp_DspFftReal(int len, const double *in, rp_dsp_cpx_t *out)
+{
+    if (len < 2 || len & 1)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    kiss_fftr_cfg cfg = planGet(DSP_PLAN_FWD, len);
+    if (cfg)
+        kiss_fftr(cfg, in, (kiss_fft_cpx *)out);
+    pthread_mutex_unlock(&dsp_lock);
+    return cfg ? RP_OK : RP_EAM;
+}
+
+int rp_DspFftReal2(int len, const double *in1, const double *in2, rp_dsp_cpx_t *out1, rp_dsp_cpx_t *out2)
+{
+    if (len < 2 || len & 1)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    kiss_fft_cpx *x = kissPair(len, NULL, in1, in2);
+    if (x) {
+        for (int k = 0; k <= len / 2; k++) {
+            kiss_fft_cpx *n = &x[(len - k) % len];
+            out1[k].r = 0.5 * (x[k].r + n->r);
+            out1[k].i = 0.5 * (x[k].i - n->i);
+            out2[k].r = 0.5 * (x[k].i + n->i);
+            out2[k].i = -0.5 * (x[k].r - n->r);
+        }
+    }
+    pthread_mutex_unlock(&dsp_lock);
+    return x ? RP_OK : RP_EAM;
+}
+
+int rp_DspFftRealInv(int len, const rp_dsp_cpx_t *in, double *out)
+{
+    if (len < 2 || len & 1)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    kiss_fftr_cfg cfg = planGet(DSP_PLAN_INV, len);
+    if (cfg)
+        kiss_fftri(cfg, (const kiss_fft_cpx *)in, out);
+    pthread_mutex_unlock(&dsp_lock);
+    return cfg ? RP_OK : RP_EAM;
+}
+
+/* Called with dsp_lock held */
+static int fftAbs(int len, const float *win, const double *in, double *out, int out_len)
+{
+    if (usesFloatFft(len)) {
+        spec_fft_t *plan = planGet(DSP_PLAN_ABS, len);
+        if (plan == NULL)
+            return RP_EAM;
+        spec_fft_abs(plan, in, win, out, out_len);
+        return RP_OK;
+    }
+
+    kiss_fftr_cfg cfg = planGet(DSP_PLAN_FWD, len);
+    size_t bins = (len / 2 + 1) * sizeof(rp_dsp_cpx_t);
+    rp_dsp_cpx_t *x = scratchGet(bins + (win ? len * sizeof(double) : 0));
+    if (cfg == NULL || x == NULL)
+        return RP_EAM;
+    if (win) {
+        double *w = (double *)((char *)x + bins);
+        for (int i = 0; i < len; i++)
+            w[i] = in[i] * win[i];
+        in = w;
+    }
+    kiss_fftr(cfg, in, (kiss_fft_cpx *)x);
+    for (int i = 0; i < out_len; i++)
+        out[i] = sqrt(x[i].r * x[i].r + x[i].i * x[i].i);
+    return RP_OK;
+}
+
+/* Called with dsp_lock held */
+static int fftAbs2(int len, const float *win, const double *in1, const double *in2,
+                   double *out1, double *out2, int out_len)
+{
+    if (usesFloatFft(len)) {
+        spec_fft_t *plan = planGet(DSP_PLAN_ABS, 2 * len);
+        if (plan == NULL)
+            return RP_EAM;
+        spec_fft_abs2(plan, in1, in2, win, out1, out2, out_len);
+        return RP_OK;
+    }
+
+    kiss_fft_cpx *x = kissPair(len, win, in1, in2);
+    if (x == NULL)
+        return RP_EAM;
+    for (int k = 0; k < out_len; k++) {
+        kiss_fft_cpx *n = &x[(len - k) % len];
+        double x1r = 0.5 * (x[k].r + n->r), x1i = 0.5 * (x[k].i - n->i);
+        double x2r = 0.5 * (x[k].i + n->i), x2i = -0.5 * (x[k].r - n->r);
+        out1[k] = sqrt(x1r * x1r + x1i * x1i);
+        out2[k] = sqrt(x2r * x2r + x2i * x2i);
+    }
+    return RP_OK;
+}
+
+int rp_DspFftAbs(int len, const double *in, double *out, int out_len)
+{
+    if (len < 2 || len & 1 || out_len < 0 || out_len > len / 2)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    int ret = fftAbs(len, NULL, in, out, out_len);
+    pthread_mutex_unlock(&dsp_lock);
+    return ret;
+}
+
+int rp_DspFftAbsWindow(rp_dsp_win_t type, double beta, double amp, int len, const double *in, double *out, int out_len)
+{
+    if (len < 2 || len & 1 || out_len < 0 || out_len > len / 2 || type >= RP_DSP_WIN_COUNT)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    dsp_window_t *w = windowGet(type, beta, amp, len);
+    int ret = w ? fftAbs(len, w->table, in, out, out_len) : RP_EAM;
+    pthread_mutex_unlock(&dsp_lock);
+    return ret;
+}
+
+int rp_DspFftAbsHann(int len, double amp, const double *in, double *out, int out_len)
+{
+    return rp_DspFftAbsWindow(RP_DSP_WIN_HANN, 0, 2 * amp, len, in, out, out_len);
+}
+
+int rp_DspFftAbs2(int len, const double *in1, const double *in2, double *out1, double *out2, int out_len)
+{
+    if (len < 2 || len & 1 || out_len < 0 || out_len > len / 2)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    int ret = fftAbs2(len, NULL, in1, in2, out1, out2, out_len);
+    pthread_mutex_unlock(&dsp_lock);
+    return ret;
+}
+
+int rp_DspFftAbsWindow2(rp_dsp_win_t type, double beta, double amp, int len, const double *in1, const double *in2,
+                        double *out1, double *out2, int out_len)
+{
+    if (len < 2 || len & 1 || out_len < 0 || out_len > len / 2 || type >= RP_DSP_WIN_COUNT)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    dsp_window_t *w = windowGet(type, beta, amp, len);
+    int ret = w ? fftAbs2(len, w->table, in1, in2, out1, out2, out_len) : RP_EAM;
+    pthread_mutex_unlock(&dsp_lock);
+    return ret;
+}
+
+int rp_DspWindowApply(rp_dsp_win_t type, double beta, double amp, int len, const double *in, double *out)
+{
+    if (len < 2 || type >= RP_DSP_WIN_COUNT)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    dsp_window_t *w = windowGet(type, beta, amp, len);
+    if (w) {
+        for (int i = 0; i < len; i++)
+            out[i] = in[i] * w->table[i];
+    }
+    pthread_mutex_unlock(&dsp_lock);
+    return w ? RP_OK : RP_EAM;
+}
+
+int rp_DspWindowHann(int len, double amp, const double *in, double *out)
+{
+    return rp_DspWindowApply(RP_DSP_WIN_HANN, 0, 2 * amp, len, in, out);
+}
+
+int rp_DspWindowGain(rp_dsp_win_t type, double beta, int len, double *coherent_gain, double *enbw)
+{
+    if (len < 2 || type >= RP_DSP_WIN_COUNT)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    dsp_window_t *w = windowGet(type, beta, 1, len);
+    if (w) {
+        if (coherent_gain)
+            *coherent_gain = w->cg;
+        if (enbw)
+            *enbw = w->enbw;
+    }
+    pthread_mutex_unlock(&dsp_lock);
+    return w ? RP_OK : RP_EAM;
+}
+
+/* Low pass for decimation by dec, Blackman windowed sinc with the cut off
+ * at the edge of the decimated band and unity gain at DC */
+static float *zoomFir(int dec)
+{
+    if (dec == zoom_dec)
+        return zoom_fir;
+
+    int taps = 16 * dec + 1;
+    rp_DspFree(zoom_fir);
+    zoom_dec = 0;
+    zoom_fir = rp_DspAlloc(taps * sizeof(float));
+    if (zoom_fir == NULL)
+        return NULL;
+
+    double sum = 0;
+    double h[taps];
+    for (int i = 0; i < taps; i++) {
+        double t = i - (taps - 1) / 2.0;
+        double x = 2 * M_PI * i / (taps - 1);
+        double sinc = t == 0 ? 1 : sin(M_PI * t / dec) / (M_PI * t / dec);
+        h[i] = sinc * (0.42 - 0.5 * cos(x) + 0.08 * cos(2 * x));
+        sum += h[i];
+    }
+    for (int i = 0; i < taps; i++)
+        zoom_fir[i] = h[i] / sum;
+    zoom_fir_len = taps;
+    zoom_dec = dec;
+    return zoom_fir;
+}
+
+/* Dot products of h with the mixed I and Q samples */
+static void zoomDot(const float *h, const float *is, const float *qs, int n, float *si, float *sq)
+{
+    float i_sum = 0, q_sum = 0;
+    int k = 0;
+#ifdef DSP_USE_NEON
+    float32x4_t i_acc = vdupq_n_f32(0);
+    float32x4_t q_acc = vdupq_n_f32(0);
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t hv = vld1q_f32(h + k);
+        i_acc = vmlaq_f32(i_acc, hv, vld1q_f32(is + k));
+        q_acc = vmlaq_f32(q_acc, hv, vld1q_f32(qs + k));
+    }
+    float32x2_t i2 = vadd_f32(vget_low_f32(i_acc), vget_high_f32(i_acc));
+    float32x2_t q2 = vadd_f32(vget_low_f32(q_acc), vget_high_f32(q_acc));
+    i_sum = vget_lane_f32(vpadd_f32(i2, i2), 0);
+    q_sum = vget_lane_f32(vpadd_f32(q2, q2), 0);
+#endif
+    for (; k < n; k++) {
+        i_sum += h[k] * is[k];
+        q_sum += h[k] * qs[k];
+    }
+    *si = i_sum;
+    *sq = q_sum;
+}
+
+int rp_DspZoomFftAbs(rp_dsp_win_t type, double beta, double amp, int len, const double *in,
+                     double f0, int dec, double *out, int out_len)
+{
+    int n_dec = dec > 0 ? len / dec : 0;
+
+    if (type >= RP_DSP_WIN_COUNT || dec < 1 || n_dec < 2 || out_len < n_dec ||
+        f0 < 0 || f0 > 0.5)
+        return RP_EOOR;
+
+    pthread_mutex_lock(&dsp_lock);
+    int ret = RP_EAM;
+    float *h = zoomFir(dec);
+    dsp_window_t *w = windowGet(type, beta, amp, n_dec);
+    kiss_fft_cfg cfg = planGet(DSP_PLAN_CPX, out_len);
+    size_t mixed = 2 * len * sizeof(float);
+    float *is = scratchGet(mixed + 2 * out_len * sizeof(kiss_fft_cpx));
+    if (h == NULL || w == NULL || cfg == NULL || is == NULL)
+        goto unlock;
+
+    float *qs = is + len;
+    kiss_fft_cpx *x = (kiss_fft_cpx *)((char *)is + mixed);
+    kiss_fft_cpx *y = x + out_len;
+
+    /* Mix down by f0, the oscillator is a rotation renormalized every block */
+    double c = 1, s = 0;
+    double dc = cos(2 * M_PI * f0), ds = -sin(2 * M_PI * f0);
+    for (int n = 0; n < len; n++) {
+        is[n] = (float)(in[n] * c);
+        qs[n] = (float)(in[n] * s);
+        double t = c * dc - s * ds;
+        s = c * ds + s * dc;
+        c = t;
+        if ((n & 255) == 255) {
+            double g = 1.0 / sqrt(c * c + s * s);
+            c *= g;
+            s *= g;
+        }
+    }
+
+    /* Filter, decimate and window. The mixed tone has the amplitude of its
+     * positive frequency bin, scaling by dec makes up for the shorter record
+     * so it reads the same as in rp_DspFftAbsWindow() */
+    int half = zoom_fir_len / 2;
+    for (int m = 0; m < n_dec; m++) {
+        int first = m * dec + dec / 2 - half;
+        int t0 = first < 0 ? -first : 0;
+        int t1 = first + zoom_fir_len > len ? len - first : zoom_fir_len;
+        float si, sq;
+        zoomDot(h + t0, is + first + t0, qs + first + t0, t1 - t0, &si, &sq);
+        x[m].r = si * w->table[m] * dec;
+        x[m].i = sq * w->table[m] * dec;
+    }
+    for (int m = n_dec; m < out_len; m++)
+        x[m].r = x[m].i = 0;
+
+    /* Zero padded to out_len, f0 ends up in the middle */
+    kiss_fft(cfg, x, y);
+    for (int k = 0; k < out_len; k++) {
+        kiss_fft_cpx *b = &y[(k + out_len - out_len / 2) % out_len];
+        out[k] = sqrt(b->r * b->r + b->i * b->i);
+    }
+    ret = RP_OK;
+
+unlock:
+    pthread_mutex_unlock(&dsp_lock);
+    return ret;
+}
+
+#define DEMOD_BLOCK 256
+
+/* sum x[n] * c[n] and sum x[n] * s[n] over one block */
+static void demodDot(const float *x, const float *c, const float *s, int n, float *re, float *im)
+{
+    float re_sum = 0, im_sum = 0;
+    int k = 0;
+#ifdef DSP_USE_NEON
+    float32x4_t re_acc = vdupq_n_f32(0);
+    float32x4_t im_acc = vdupq_n_f32(0);
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t xv = vld1q_f32(x + k);
+        re_acc = vmlaq_f32(re_acc, xv, vld1q_f32(c + k));
+        im_acc = vmlaq_f32(im_acc, xv, vld1q_f32(s + k));
+    }
+    float32x2_t re2 = vadd_f32(vget_low_f32(re_acc), vget_high_f32(re_acc));
+    float32x2_t im2 = vadd_f32(vget_low_f32(im_acc), vget_high_f32(im_acc));
+    re_sum = vget_lane_f32(vpadd_f32(re2, re2), 0);
+    im_sum = vget_lane_f32(vpadd_f32(im2, im2), 0);
+#endif
+    for (; k < n; k++) {
+        re_sum += x[k] * c[k];
+        im_sum += x[k] * s[k];
+    }
+    *re = re_sum;
+    *im = im_sum;
+}
+
+int rp_DspDemod(int channels, int len, const float *const *in, int bins, const double *freq, rp_dsp_cpx_t *out)
+{
+    float c[DEMOD_BLOCK], s[DEMOD_BLOCK];
+
+    if (channels < 1 || len < 1 || bins < 1 || in == NULL || freq == NULL || out == NULL)
+        return RP_EOOR;
+
+    for (int i = 0; i < channels * bins; i++)
+        out[i].r = out[i].i = 0;
+
+    for (int b = 0; b < bins; b++) {
+        double w = 2 * M_PI * freq[b];
+        double dc = cos(w), ds = -sin(w);
+
+        for (int n0 = 0; n0 < len; n0 += DEMOD_BLOCK) {
+            int n = len - n0 < DEMOD_BLOCK ? len - n0 : DEMOD_BLOCK;
+
+            /* exp(-j*w*n) from an exact start, so the error does not grow with len */
+            double oc = cos(w * n0), os = -sin(w * n0);
+            for (int k = 0; k < n; k++) {
+                c[k] = (float)oc;
+                s[k] = (float)os;
+                double t = oc * dc - os * ds;
+                os = oc * ds + os * dc;
+                oc = t;
+            }
+            for (int ch = 0; ch < channels; ch++) {
+                float re, im;
+                demodDot(in[ch] + n0, c, s, n, &re, &im);
+                out[ch * bins + b].r += re;
+                out[ch * bins + b].i += im;
+            }
+        }
+    }
+
+    for (int i = 0; i < channels * bins; i++) {
+        out[i].r *= 2.0 / len;
+        out[i].i *= 2.0 / len;
+    }
+    return RP_OK;
+}
+
+#define SINE_BLOCK 256
+#define SINE_COLS  4
+
+/* sum a[n] * b[n] over one block */
+static float sineDot(const float *a, const float *b, int n)
+{
+    float sum = 0;
+    int k = 0;
+#ifdef DSP_USE_NEON
+    float32x4_t acc = vdupq_n_f32(0);
+    for (; k + 4 <= n; k += 4)
+        acc = vmlaq_f32(acc, vld1q_f32(a + k), vld1q_f32(b + k));
+    float32x2_t acc2 = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(acc2, acc2), 0);
+#endif
+    for (; k < n; k++)
+        sum += a[k] * b[k];
+    return sum;
+}
+
+/* Gauss-Jordan elimination with partial pivoting, as rsolv() of the
+ * GPIanalyser test, x receives the solution of a * x = b */
+static int sineSolve(double a[SINE_COLS][SINE_COLS], double *b, int n)
+{
+    for (int j = 0; j < n; j++) {
+        int p = j;
+        for (int k = j + 1; k < n; k++)
+            if (fabs(a[k][j]) > fabs(a[p][j]))
+                p = k;
+        if (a[p][j] == 0)
+            return -1;
+        for (int k = 0; k < n; k++) {
+            double t = a[j][k]; a[j][k] = a[p][k]; a[p][k] = t;
+        }
+        double t = b[j]; b[j] = b[p]; b[p] = t;
+
+        double y = 1 / a[j][j];
+        for (int k = 0; k < n; k++)
+            a[j][k] *= y;
+        b[j] *= y;
+        for (int i = 0; i < n; i++) {
+            if (i == j)
+                continue;
+            y = a[i][j];
+            for (int k = 0; k < n; k++)
+                a[i][k] -= y * a[j][k];
+            b[i] -= y * b[j];
+        }
+    }
+    return 0;
+}
+
+/* One least squares step at w rad per sample, the time m counted from mid.
+ * The columns are cos(w*m), sin(w*m), 1 and with cols 4 the derivative by w
+ * of x[0] * cos(w*m) + x[1] * sin(w*m). x receives the parameters, sse the
+ * sum of the squared residuals. */
+static int sineStep(int len, const float *in, double w, int cols, double *x, double *sse)
+{
+    static const float ones[SINE_BLOCK] = { [0 ... SINE_BLOCK - 1] = 1 };
+    float col[SINE_COLS][SINE_BLOCK];
+    double ata[SINE_COLS][SINE_COLS] = { { 0 } };
+    double aty[SINE_COLS] = { 0 };
+    double yy = 0;
+    double mid = (len - 1) / 2.0;
+    double dc = cos(w), ds = sin(w);
+    float a0 = x[0], b0 = x[1];
+    const float *c[SINE_COLS] = { col[0], col[1], ones, col[3] };
+
+    for (int n0 = 0; n0 < len; n0 += SINE_BLOCK) {
+        int n = len - n0 < SINE_BLOCK ? len - n0 : SINE_BLOCK;
+        const float *y = in + n0;
+
+        /* cos and sin from an exact start, so the error does not grow with len */
+        double oc = cos(w * (n0 - mid)), os = sin(w * (n0 - mid));
+        for (int k = 0; k < n; k++) {
+            col[0][k] = (float)oc;
+            col[1][k] = (float)os;
+            double t = oc * dc - os * ds;
+            os = oc * ds + os * dc;
+            oc = t;
+        }
+        if (cols == SINE_COLS) {
+            for (int k = 0; k < n; k++) {
+                float m = (float)(n0 + k - mid);
+                col[3][k] = m * (b0 * col[0][k] - a0 * col[1][k]);
+            }
+        }
+
+        for (int i = 0; i < cols; i++) {
+            for (int j = i; j < cols; j++)
+                ata[i][j] += sineDot(c[i], c[j], n);
+            aty[i] += sineDot(c[i], y, n);
+        }
+        yy += sineDot(y, y, n);
+    }
+
+    for (int i = 0; i < cols; i++)
+        for (int j = 0; j < i; j++)
+            ata[i][j] = ata[j][i];
+
+    double b[SINE_COLS];
+    for (int i = 0; i < cols; i++)
+        b[i] = aty[i];
+    if (sineSolve(ata, b, cols) < 0)
+        return -1;
+
+    /* residual of the normal equations, y'y - x'A'y */
+    *sse = yy;
+    for (int i = 0; i < cols; i++) {
+        x[i] = b[i];
+        *sse -= b[i] * aty[i];
+    }
+    return 0;
+}
+
+int rp_DspSineFit(int len, const float *in, double freq, int iterations, rp_dsp_sine_t *fit)
+{
+    double x[SINE_COLS] = { 0 };
+    double w = 2 * M_PI * freq;
+    double sse;
+    int it = 0;
+
+    if (len < 4 || in == NULL || fit == NULL || freq <= 0 || freq >= 0.5 || iterations < 0)
+        return RP_EOOR;
+
+    if (sineStep(len, in, w, 3, x, &sse) < 0)
+        return RP_EOOR;
+    while (it < iterations) {
+        if (sineStep(len, in, w, SINE_COLS, x, &sse) < 0)
+            return RP_EOOR;
+        w += x[3];
+        it++;
+        if (w <= 0 || w >= M_PI)
+            return RP_EOOR;
+        if (fabs(x[3]) * len < 2 * M_PI * 1e-6)
+            break;
+    }
+    /* amplitude, phase and offset of the final frequency */
+    if (it > 0 && sineStep(len, in, w, 3, x, &sse) < 0)
+        return RP_EOOR;
+
+    double mid = (len - 1) / 2.0;
+    fit->freq = w / (2 * M_PI);
+    fit->amp = sqrt(x[0] * x[0] + x[1] * x[1]);
+    fit->phase = remainder(atan2(-x[1], x[0]) - w * mid, 2 * M_PI);
+    fit->offset = x[2];
+    fit->rms_err = sqrt(sse > 0 ? sse / len : 0);
+    fit->iterations = it;
+    return RP_OK;
+}
+
+int rp_DspXcorr(int len, const float *in1, const float *in2, int max_lag, rp_dsp_xcorr_t *res)
+{
+    if (len < 4 || in1 == NULL || in2 == NULL || res == NULL || max_lag < 1 || max_lag > len - 2)
+        return RP_EOOR;
+
+    /* Zero padded so the lags up to max_lag + 1 do not wrap around, a power
+     * of two keeps kiss_fft on radix 4 */
+    int n = 4;
+    while (n < len + max_lag + 2)
+        n <<= 1;
+
+    double m1 = 0, m2 = 0, e1 = 0, e2 = 0;
+    for (int i = 0; i < len; i++) {
+        m1 += in1[i];
+        m2 += in2[i];
+    }
+    m1 /= len;
+    m2 /= len;
+
+    pthread_mutex_lock(&dsp_lock);
+    kiss_fft_cfg fwd = planGet(DSP_PLAN_CPX, n);
+    kiss_fftr_cfg inv = planGet(DSP_PLAN_INV, n);
+    kiss_fft_cpx *z = scratchGet(2 * n * sizeof(kiss_fft_cpx) + n * sizeof(double));
+    if (fwd == NULL || inv == NULL || z == NULL) {
+        pthread_mutex_unlock(&dsp_lock);
+        return RP_EAM;
+    }
+    kiss_fft_cpx *x = z + n;
+    double *r = (double *)(x + n);
+
+    /* Both signals in one complex transform, see kissPair() */
+    for (int i = 0; i < len; i++) {
+        z[i].r = in1[i] - m1;
+        z[i].i = in2[i] - m2;
+        e1 += z[i].r * z[i].r;
+        e2 += z[i].i * z[i].i;
+    }
+    for (int i = len; i < n; i++)
+        z[i].r = z[i].i = 0;
+    kiss_fft(fwd, z, x);
+
+    /* Cross spectrum conj(X1) * X2 of bins 0 to n/2 into z, the strongest
+     * bin above DC gives the phase */
+    int peak_bin = 0;
+    double peak_pow = -1;
+    for (int k = 0; k <= n / 2; k++) {
+        kiss_fft_cpx *m = &x[(n - k) & (n - 1)];
+        double x1r = 0.5 * (x[k].r + m->r), x1i = 0.5 * (x[k].i - m->i);
+        double x2r = 0.5 * (x[k].i + m->i), x2i = -0.5 * (x[k].r - m->r);
+        z[k].r = x1r * x2r + x1i * x2i;
+        z[k].i = x1r * x2i - x1i * x2r;
+        double power = z[k].r * z[k].r + z[k].i * z[k].i;
+        if (k > 0 && power > peak_pow) {
+            peak_pow = power;
+            peak_bin = k;
+        }
+    }
+    res->freq = (double)peak_bin / n;
+    res->phase = atan2(z[peak_bin].i, z[peak_bin].r) * 180 / M_PI;
+
+    /* r[l] = n * sum in1[i] * in2[i + l], negative lags at the end */
+    kiss_fftri(inv, z, r);
+    int lag = 0;
+    for (int l = -max_lag; l <= max_lag; l++) {
+        if (r[l & (n - 1)] > r[lag & (n - 1)])
+            lag = l;
+    }
+    /* Parabola through the peak and its neighbours */
+    double y0 = r[(lag - 1) & (n - 1)], y1 = r[lag & (n - 1)], y2 = r[(lag + 1) & (n - 1)];
+    double den = y0 - 2 * y1 + y2;
+    double frac = den < 0 ? 0.5 * (y0 - y2) / den : 0;
+    pthread_mutex_unlock(&dsp_lock);
+
+    if (frac > 0.5)
+        frac = 0.5;
+    else if (frac < -0.5)
+        frac = -0.5;
+    res->delay = lag + frac;
+    res->coeff = e1 > 0 && e2 > 0 ? (y1 - 0.25 * (y0 - y2) * frac) / (n * sqrt(e1 * e2)) : 0;
+    return RP_OK;
+}
+
+typedef struct {
+    int lo;     /* a sample below lo arms the edge detector */
+    int hi;     /* an armed sample at or above hi is an edge */
+    int armed;
+    int edges;
+    int first;
+    int last;
+} dsp_edges_t;
+
+static inline void measEdge(dsp_edges_t *e, int x, int ix)
+{
+    if (!e->armed) {
+        e->armed = x < e->lo;
+    } else if (x >= e->hi) {
+        e->armed = 0;
+        if (e->edges++ == 0)
+            e->first = ix;
+        e->last = ix;
+    }
+}
+
+static void measBand(int min, int max, double *lo, double *hi)
+{
+    double cen = (min + max) / 2.0;
+    *lo = cen + 0.2 * (min - cen);
+    *hi = cen + 0.2 * (max - cen);
+}
+
+static void measEdgesInit(dsp_edges_t *e, double lo, double hi)
+{
+    /* integer samples: x < t is x < ceil(t) and x >= t is x >= ceil(t) */
+    e->lo = (int)ceil(lo);
+    e->hi = (int)ceil(hi);
+    e->armed = e->edges = e->first = e->last = 0;
+}
+
+/* Statistics and edges of n samples, ix is the position of p[0] in the record */
+static void measSegment(const int32_t *p, int n, int ix, int sh, dsp_edges_t *e,
+                        int *min, int *max, int64_t *sum, int64_t *sum2)
+{
+    int k = 0;
+#ifdef DSP_USE_NEON
+    int32x4_t vmin = vdupq_n_s32(*min), vmax = vdupq_n_s32(*max);
+    int64x2_t vsum = vdupq_n_s64(0), vsum2 = vdupq_n_s64(0);
+    int32x4_t vshl = vdupq_n_s32(sh), vshr = vdupq_n_s32(-sh);
+    int32x4_t vlo = vdupq_n_s32(e->lo), vhi = vdupq_n_s32(e->hi);
+    for (; k + 4 <= n; k += 4) {
+        int32x4_t x = vshlq_s32(vshlq_s32(vld1q_s32(p + k), vshl), vshr);
+        vmin = vminq_s32(vmin, x);
+        vmax = vmaxq_s32(vmax, x);
+        vsum = vpadalq_s32(vsum, x);
+        vsum2 = vpadalq_s32(vsum2, vmulq_s32(x, x));
+        /* the detector only changes on a sample below lo when idle or at
+         * or above hi when armed, most vectors have none */
+        uint32x4_t hit = e->armed ? vcgeq_s32(x, vhi) : vcltq_s32(x, vlo);
+        uint32x2_t any = vorr_u32(vget_low_u32(hit), vget_high_u32(hit));
+        if (vget_lane_u32(vpmax_u32(any, any), 0)) {
+            int32_t xs[4];
+            vst1q_s32(xs, x);
+            for (int l = 0; l < 4; l++)
+                measEdge(e, xs[l], ix + k + l);
+        }
+    }
+    int32x2_t min2 = vpmin_s32(vget_low_s32(vmin), vget_high_s32(vmin));
+    int32x2_t max2 = vpmax_s32(vget_low_s32(vmax), vget_high_s32(vmax));
+    *min = vget_lane_s32(vpmin_s32(min2, min2), 0);
+    *max = vget_lane_s32(vpmax_s32(max2, max2), 0);
+    *sum += vgetq_lane_s64(vsum, 0) + vgetq_lane_s64(vsum, 1);
+    *sum2 += vgetq_lane_s64(vsum2, 0) + vgetq_lane_s64(vsum2, 1);
+#endif
+    for (; k < n; k++) {
+        int x = (int32_t)((uint32_t)p[k] << sh) >> sh;
+        if (x < *min)
+            *min = x;
+        if (x > *max)
+            *max = x;
+        *sum += x;
+        *sum2 += x * x;
+        measEdge(e, x, ix + k);
+    }
+}
+
+static void measEdges(const int32_t *p, int n, int ix, int sh, dsp_edges_t *e)
+{
+    for (int k = 0; k < n; k++)
+        measEdge(e, (int32_t)((uint32_t)p[k] << sh) >> sh, ix + k);
+}
+
+int rp_DspMeasure(const int32_t *in, int len, int start, int bits, const rp_dsp_meas_t *prev, rp_dsp_meas_t *meas)
+{
+    int sh = 32 - bits;
+    int min = INT32_MAX, max = INT32_MIN;
+    int64_t sum = 0, sum2 = 0;
+    double lo, hi;
+    dsp_edges_t e;
+
+    if (in == NULL || meas == NULL || len < 1 || start < 0 || start >= len || bits < 2 || bits > 16)
+        return RP_EOOR;
+
+    /* without a previous band the detector never arms in the first pass */
+    if (prev != NULL && prev->thr_high > prev->thr_low)
+        measEdgesInit(&e, prev->thr_low, prev->thr_high);
+    else
+        measEdgesInit(&e, INT32_MIN, INT32_MAX);
+    int prev_lo = e.lo, prev_hi = e.hi;
+
+    measSegment(in + start, len - start, 0, sh, &e, &min, &max, &sum, &sum2);
+    measSegment(in, start, len - start, sh, &e, &min, &max, &sum, &sum2);
+
+    measBand(min, max, &lo, &hi);
+    double tol = (hi - lo) / 8;
+    if (fabs(prev_lo - lo) > tol || fabs(prev_hi - hi) > tol) {
+        measEdgesInit(&e, lo, hi);
+        measEdges(in + start, len - start, 0, sh, &e);
+        measEdges(in, start, len - start, sh, &e);
+    }
+
+    meas->min = min;
+    meas->max = max;
+    meas->mean = (double)sum / len;
+    meas->rms = sqrt((double)sum2 / len);
+    meas->edges = e.edges;
+    meas->first_edge = e.first;
+    meas->last_edge = e.last;
+    meas->period = e.edges >= 2 ? (double)(e.last - e.first) / (e.edges - 1) : 0;
+    meas->thr_low = lo;
+    meas->thr_high = hi;
+    return RP_OK;
+}
+
+void *rp_DspAlloc(size_t size)
+{
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, RP_DSP_ALIGN, size ? size : RP_DSP_ALIGN))
+        return NULL;
+    return ptr;
+}
+
+void rp_DspFree(void *ptr)
+{
+    free(ptr);
+}
+
+void rp_DspRelease(void)
+{
+    pthread_mutex_lock(&dsp_lock);
+    for (int i = 0; i < DSP_CACHE_SIZE; i++) {
+        if (plans[i].used)
+            planFree(&plans[i]);
+        rp_DspFree(windows[i].table);
+        windows[i].table = NULL;
+        windows[i].used = 0;
+    }
+    rp_DspFree(scratch);
+    scratch = NULL;
+    scratch_size = 0;
+    rp_DspFree(zoom_fir);
+    zoom_fir = NULL;
+    zoom_dec = 0;
+    pthread_mutex_unlock(&dsp_lock);
+}
@@ -0,0 +1,377 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya streaming filters.
+ *
+ * The FIR keeps one sub filter per interpolation phase with the taps in
+ * reverse order, so every output is a single forward dot product over the
+ * delay line, four taps at a time on NEON. Input is taken in blocks of
+ * FIR_BLOCK samples behind the last num_taps/interp - 1 samples of the
+ * previous block.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FILTER_USE_NEON
+#endif
+
+#include "redpitaya/rp.h"
+#include "redpitaya/rp_dsp.h"
+#include "redpitaya/rp_filter.h"
+
+#define FIR_BLOCK     1024
+#define CIC_MAX_STAGES 6
+
+struct rp_filter_fir_s {
+    int    interp;
+    int    dec;
+    int    phase_len;   // Taps of one phase
+    float *phases;      // interp * phase_len reversed taps
+    float *line;        // phase_len - 1 old samples followed by a block
+    int    pos;         // Next output in interpolated samples after line[phase_len - 1]
+};
+
+struct rp_filter_cic_s {
+    int      stages;
+    int      rate;
+    int      delay;
+    int      interpolate;
+    int      count;     // Decimator: inputs since the last output
+    double   scale;
+    uint64_t integ[CIC_MAX_STAGES];
+    uint64_t comb[CIC_MAX_STAGES][2];
+};
+
+struct rp_filter_iir_s {
+    int    sections;
+    float *coeffs;      // b0, b1, b2, a1, a2 per section
+    float *state;       // s1, s2 per section
+};
+
+int rp_FilterFirDesign(float *taps, int num_taps, double cutoff, double gain, rp_dsp_win_t win, double beta)
+{
+    if (taps == NULL || num_taps < 2 || cutoff <= 0 || cutoff > 0.5 || win >= RP_DSP_WIN_COUNT)
+        return RP_EOOR;
+
+    double *h = malloc(num_taps * sizeof(double));
+    if (h == NULL)
+        return RP_EAM;
+
+    for (int i = 0; i < num_taps; i++) {
+        double t = i - (num_taps - 1) / 2.0;
+        h[i] = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+    }
+    int ret = rp_DspWindowApply(win, beta, 1, num_taps, h, h);
+    if (ret == RP_OK) {
+        double sum = 0;
+        for (int i = 0; i < num_taps; i++)
+            sum += h[i];
+        for (int i = 0; i < num_taps; i++)
+            taps[i] = h[i] * gain / sum;
+    }
+    free(h);
+    return ret;
+}
+
+int rp_FilterFirCreate(rp_filter_fir_t **fir, const float *taps, int num_taps, int interp, int dec)
+{
+    if (fir == NULL || taps == NULL || num_taps < 1 || interp < 1 || dec < 1)
+        return RP_EOOR;
+
+    rp_filter_fir_t *f = calloc(1, sizeof(rp_filter_fir_t));
+    if (f == NULL)
+        return RP_EAM;
+
+    f->interp = interp;
+    f->dec = dec;
+    f->phase_len = (num_taps + interp - 1) / interp;
+    f->phases = rp_DspAlloc(interp * f->phase_len * sizeof(float));
+    f->line = rp_DspAlloc((f->phase_len - 1 + FIR_BLOCK) * sizeof(float));
+    if (f->phases == NULL || f->line == NULL) {
+        rp_FilterFirDestroy(f);
+        return RP_EAM;
+    }
+
+    /* Phase p holds taps p, p + interp, ..., the last one against the oldest sample */
+    for (int p = 0; p < interp; p++) {
+        for (int k = 0; k < f->phase_len; k++) {
+            int n = p + k * interp;
+            f->phases[p * f->phase_len + f->phase_len - 1 - k] = n < num_taps ? taps[n] : 0;
+        }
+    }
+    rp_FilterFirReset(f);
+    *fir = f;
+    return RP_OK;
+}
+
+void rp_FilterFirReset(rp_filter_fir_t *fir)
+{
+    memset(fir->line, 0, (fir->phase_len - 1) * sizeof(float));
+    fir->pos = 0;
+}
+
+void rp_FilterFirDestroy(rp_filter_fir_t *fir)
+{
+    if (fir == NULL)
+        return;
+    rp_DspFree(fir->phases);
+    rp_DspFree(fir->line);
+    free(fir);
+}
+
+int rp_FilterFirOutLen(const rp_filter_fir_t *fir, int in_len)
+{
+    int64_t span = (int64_t)in_len * fir->interp - fir->pos;
+    return span > 0 ? (int)((span + fir->dec - 1) / fir->dec) : 0;
+}
+
+static float firDot(const float *h, const float *x, int n)
+{
+    float sum = 0;
+    int k = 0;
+#ifdef FILTER_USE_NEON
+    float32x4_t acc = vdupq_n_f32(0);
+    for (; k + 4 <= n; k += 4)
+        acc = vmlaq_f32(acc, vld1q_f32(h + k), vld1q_f32(x + k));
+    float32x2_t s2 = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(s2, s2), 0);
+#endif
+    for (; k < n; k++)
+        sum += h[k] * x[k];
+    return sum;
+}
+
+int rp_FilterFirProcess(rp_filter_fir_t *fir, const float *in, int in_len, float *out, int out_max, int *out_len)
+{
+    const int hist = fir->phase_len - 1;
+    int n_out = 0;
+
+    if (in_len < 0 || rp_FilterFirOutLen(fir, in_len) > out_max)
+        return RP_EOOR;
+
+    while (in_len > 0) {
+        int block = in_len < FIR_BLOCK ? in_len : FIR_BLOCK;
+        int64_t end = (int64_t)block * fir->interp;
+
+        memcpy(fir->line + hist, in, block * sizeof(float));
+        for (; fir->pos < end; fir->pos += fir->dec) {
+            int n = fir->pos / fir->interp;
+            int p = fir->pos % fir->interp;
+            out[n_out++] = firDot(fir->phases + p * fir->phase_len, fir->line + n, fir->phase_len);
+        }
+        fir->pos -= end;
+        memmove(fir->line, fir->line + block, hist * sizeof(float));
+        in += block;
+        in_len -= block;
+    }
+
+    if (out_len)
+        *out_len = n_out;
+    return RP_OK;
+}
+
+int rp_FilterCicCreate(rp_filter_cic_t **cic, int stages, int rate, int diff_delay, int interpolate)
+{
+    if (cic == NULL || stages < 1 || stages > CIC_MAX_STAGES || rate < 1 ||
+        diff_delay < 1 || diff_delay > 2)
+        return RP_EOOR;
+
+    rp_filter_cic_t *c = calloc(1, sizeof(rp_filter_cic_t));
+    if (c == NULL)
+        return RP_EAM;
+
+    c->stages = stages;
+    c->rate = rate;
+    c->delay = diff_delay;
+    c->interpolate = interpolate != 0;
+    /* DC gain (R*D)^N, the zero stuffing of the interpolator takes out one R */
+    c->scale = 1.0 / pow((double)rate * diff_delay, stages);
+    if (c->interpolate)
+        c->scale *= rate;
+    *cic = c;
+    return RP_OK;
+}
+
+void rp_FilterCicReset(rp_filter_cic_t *cic)
+{
+    memset(cic->integ, 0, sizeof(cic->integ));
+    memset(cic->comb, 0, sizeof(cic->comb));
+    cic->count = 0;
+}
+
+void rp_FilterCicDestroy(rp_filter_cic_t *cic)
+{
+    free(cic);
+}
+
+/* Comb stages at the low rate, y[n] = x[n] - x[n - delay] */
+static uint64_t cicCombs(rp_filter_cic_t *cic, uint64_t v)
+{
+    for (int s = 0; s < cic->stages; s++) {
+        uint64_t old = cic->comb[s][cic->delay - 1];
+        cic->comb[s][1] = cic->comb[s][0];
+        cic->comb[s][0] = v;
+        v -= old;
+    }
+    return v;
+}
+
+/* Integrator stages at the high rate */
+static uint64_t cicIntegrators(rp_filter_cic_t *cic, uint64_t v)
+{
+    for (int s = 0; s < cic->stages; s++) {
+        cic->integ[s] += v;
+        v = cic->integ[s];
+    }
+    return v;
+}
+
+int rp_FilterCicProcess(rp_filter_cic_t *cic, const int32_t *in, int in_len, float *out, int out_max, int *out_len)
+{
+    int n_out = 0;
+
+    if (in_len < 0)
+        return RP_EOOR;
+
+    if (cic->interpolate) {
+        if ((int64_t)in_len * cic->rate > out_max)
+            return RP_EOOR;
+        for (int i = 0; i < in_len; i++) {
+            uint64_t v = cicCombs(cic, (uint64_t)(int64_t)in[i]);
+            for (int r = 0; r < cic->rate; r++)
+                out[n_out++] = (float)((int64_t)cicIntegrators(cic, r == 0 ? v : 0) * cic->scale);
+        }
+    } else {
+        if ((cic->count + in_len) / cic->rate > out_max)
+            return RP_EOOR;
+        for (int i = 0; i < in_len; i++) {
+            uint64_t v = cicIntegrators(cic, (uint64_t)(int64_t)in[i]);
+            if (++cic->count == cic->rate) {
+                cic->count = 0;
+                out[n_out++] = (float)((int64_t)cicCombs(cic, v) * cic->scale);
+            }
+        }
+    }
+
+    if (out_len)
+        *out_len = n_out;
+    return RP_OK;
+}
+
+int rp_FilterBiquadDesign(rp_filter_type_t type, double f0, double q, float *coeffs)
+{
+    if (coeffs == NULL || f0 <= 0 || f0 >= 0.5 || q <= 0)
+        return RP_EOOR;
+
+    double w0 = 2 * M_PI * f0;
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2 * q);
+    double b0, b1, b2;
+
+    switch (type) {
+        case RP_FILTER_LOWPASS:
+            b0 = b2 = (1 - cw) / 2;
+            b1 = 1 - cw;
+            break;
+        case RP_FILTER_HIGHPASS:
+            b0 = b2 = (1 + cw) / 2;
+            b1 = -(1 + cw);
+            break;
+        case RP_FILTER_BANDPASS:
+            b0 = alpha;
+            b1 = 0;
+            b2 = -alpha;
+            break;
+        case RP_FILTER_NOTCH:
+            b0 = b2 = 1;
+            b1 = -2 * cw;
+            break;
+        default:
+            return RP_EOOR;
+    }
+
+    double a0 = 1 + alpha;
+    coeffs[0] = b0 / a0;
+    coeffs[1] = b1 / a0;
+    coeffs[2] = b2 / a0;
+    coeffs[3] = -2 * cw / a0;
+    coeffs[4] = (1 - alpha) / a0;
+    return RP_OK;
+}
+
+int rp_FilterIirCreate(rp_filter_iir_t **iir, const float *coeffs, int sections)
+{
+    if (iir == NULL || coeffs == NULL || sections < 1)
+        return RP_EOOR;
+
+    rp_filter_iir_t *f = calloc(1, sizeof(rp_filter_iir_t));
+    if (f == NULL)
+        return RP_EAM;
+
+    f->sections = sections;
+    f->coeffs = malloc(5 * sections * sizeof(float));
+    f->state = calloc(2 * sections, sizeof(float));
+    if (f->coeffs == NULL || f->state == NULL) {
+        rp_FilterIirDestroy(f);
+        return RP_EAM;
+    }
+    memcpy(f->coeffs, coeffs, 5 * sections * sizeof(float));
+    *iir = f;
+    return RP_OK;
+}
+
+int rp_FilterIirProcess(rp_filter_iir_t *iir, const float *in, float *out, int len)
+{
+    if (len < 0)
+        return RP_EOOR;
+
+    if (in != out)
+        memcpy(out, in, len * sizeof(float));
+
+    /* One section over the whole block at a time keeps its coefficients
+     * and state in registers */
+    for (int s = 0; s < iir->sections; s++) {
+        const float *c = iir->coeffs + 5 * s;
+        const float b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+        float s1 = iir->state[2 * s];
+        float s2 = iir->state[2 * s + 1];
+
+        for (int i = 0; i < len; i++) {
+            float x = out[i];
+            float y = b0 * x + s1;
+            s1 = b1 * x - a1 * y + s2;
+            s2 = b2 * x - a2 * y;
+            out[i] = y;
+        }
+        iir->state[2 * s] = s1;
+        iir->state[2 * s + 1] = s2;
+    }
+    return RP_OK;
+}
+
+void rp_FilterIirReset(rp_filter_iir_t *iir)
+{
+    memset(iir->state, 0, 2 * iir->sections * sizeof(float));
+}
+
+void rp_FilterIirDestroy(rp_filter_iir_t *iir)
+{
+    if (iir == NULL)
+        return;
+    free(iir->coeffs);
+    free(iir->state);
+    free(iir);
+}
@@ -13,34 +13,181 @@
 */
 
 #include <float.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "math.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define GEN_USE_NEON
+#endif
+
 #include "common.h"
 #include "generate.h"
 #include "gen_handler.h"
 
-// global variables
-// TODO: should be organized into a system status structure
-float         chA_amplitude            = 1, chB_amplitude            = 1;
-float         chA_offset               = 0, chB_offset               = 0;
-float         chA_dutyCycle            = 0, chB_dutyCycle            = 0;
-float         chA_frequency               , chB_frequency               ;
-float         chA_phase                = 0, chB_phase                = 0;
-int           chA_burstCount           = 1, chB_burstCount           = 1;
-int           chA_burstRepetition      = 1, chB_burstRepetition      = 1;
-uint32_t      chA_burstPeriod          = 0, chB_burstPeriod          = 0;
-rp_waveform_t chA_waveform                , chB_waveform                ;
-uint32_t      chA_size     = BUFFER_LENGTH, chB_size     = BUFFER_LENGTH;
-uint32_t      chA_arb_size = BUFFER_LENGTH, chB_arb_size = BUFFER_LENGTH;
-
-bool          chA_EnableTempProtection = 0, chB_EnableTempProtection = 0;
-bool          chA_LatchTempAlarm       = 0, chB_LatchTempAlarm       = 0;
-
-float chA_arbitraryData[BUFFER_LENGTH];
-float chB_arbitraryData[BUFFER_LENGTH];
+/*
+ * What the DAC buffer of a channel holds. Amplitude, offset and frequency are
+ * hardware registers, so the table is only synthesized and written again when
+ * its shape changes. Duty cycle only shapes PWM, the edge length only square.
+ */
+typedef struct {
+    bool          valid;
+    rp_waveform_t waveform;
+    float         dutyCycle;
+    int           squareTrans;
+    uint32_t      size;
+    uint32_t      phase;
+    uint32_t      arbGeneration;
+} synthesis_key_t;
+
+/*
+ * Generator settings that are not read back from the registers. They are
+ * private to the process unless rp_InitEx(RP_INIT_SHARED) put them into a
+ * shared memory segment, then all processes asking for it see the same
+ * waveforms, and a buffer one of them wrote is not synthesized again by the
+ * others. The segment has a robust process-shared mutex, held around every
+ * generator call (gen_StateLock()). /dev/shm is a tmpfs, the segment lives
+ * until the next boot.
+ */
+#define GEN_STATE_SHM_NAME "/rp_gen_state"
+
+typedef struct {
+    uint32_t        magic;
+    uint32_t        generation; // counts writes, the table copies of other processes are stale then
+    pthread_mutex_t lock;
+
+    float         chA_amplitude,            chB_amplitude;
+    float         chA_offset,               chB_offset;
+    float         chA_dutyCycle,            chB_dutyCycle;
+    float         chA_frequency,            chB_frequency;
+    float         chA_phase,                chB_phase;
+    int           chA_burstCount,           chB_burstCount;
+    int           chA_burstRepetition,      chB_burstRepetition;
+    uint32_t      chA_burstPeriod,          chB_burstPeriod;
+    rp_waveform_t chA_waveform,             chB_waveform;
+    uint32_t      chA_size,                 chB_size;
+    uint32_t      chA_arb_size,             chB_arb_size;
+
+    bool          chA_EnableTempProtection, chB_EnableTempProtection;
+    bool          chA_LatchTempAlarm,       chB_LatchTempAlarm;
+
+    float chA_arbitraryData[BUFFER_LENGTH];
+    float chB_arbitraryData[BUFFER_LENGTH];
+
+    // Waveforms uploaded as DAC counts are kept as counts and written as they are
+    int16_t chA_arbitraryCnts[BUFFER_LENGTH];
+    int16_t chB_arbitraryCnts[BUFFER_LENGTH];
+    bool    chA_arb_cnts, chB_arb_cnts;
+
+    synthesis_key_t written_key[2];
+    uint32_t arb_generation[2];
+} gen_state_t;
+
+#define GEN_STATE_MAGIC (0x52504753u ^ (uint32_t) sizeof(gen_state_t))
+
+static gen_state_t local_state = {
+    .chA_amplitude       = 1,             .chB_amplitude       = 1,
+    .chA_burstCount      = 1,             .chB_burstCount      = 1,
+    .chA_burstRepetition = 1,             .chB_burstRepetition = 1,
+    .chA_size            = BUFFER_LENGTH, .chB_size            = BUFFER_LENGTH,
+    .chA_arb_size        = BUFFER_LENGTH, .chB_arb_size        = BUFFER_LENGTH,
+};
+static gen_state_t *gs = &local_state;
+static uint32_t seen_generation;
+
+int gen_StateAttach(bool shared) {
+    if (!shared || gs != &local_state) {
+        return RP_OK;
+    }
+    int fd = shm_open(GEN_STATE_SHM_NAME, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return RP_EOMD;
+    }
+    fchmod(fd, 0666); // past the umask, any process may attach
+    flock(fd, LOCK_EX);
+
+    struct stat st;
+    gen_state_t *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+        (st.st_size >= (off_t)sizeof(gen_state_t) || ftruncate(fd, sizeof(gen_state_t)) == 0)) {
+        map = mmap(NULL, sizeof(gen_state_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map != MAP_FAILED && map->magic != GEN_STATE_MAGIC) {
+        // first user since boot, or a library with another layout
+        pthread_mutexattr_t attr;
+        memcpy(map, &local_state, sizeof(gen_state_t));
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&map->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        map->generation = 1;
+        __atomic_store_n(&map->magic, GEN_STATE_MAGIC, __ATOMIC_RELEASE);
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return RP_EMMD;
+    }
+    gs = map;
+    seen_generation = 0;
+    return RP_OK;
+}
+
+int gen_StateDetach() {
+    if (gs != &local_state) {
+        munmap(gs, sizeof(gen_state_t));
+        gs = &local_state;
+    }
+    return RP_OK;
+}
+
+/** Takes the shared state, if any. The registers may have been written by another process meanwhile. */
+void gen_StateLock() {
+    if (gs == &local_state) {
+        return;
+    }
+    if (pthread_mutex_lock(&gs->lock) == EOWNERDEAD) {
+        // the holder died halfway, write the buffers again
+        gs->written_key[0].valid = false;
+        gs->written_key[1].valid = false;
+        gs->generation++;
+        pthread_mutex_consistent(&gs->lock);
+    }
+    if (gs->generation != seen_generation) {
+        generate_InvalidateTables();
+        cmn_ShadowReload();
+        seen_generation = gs->generation;
+    }
+}
+
+void gen_StateUnlock(bool changed) {
+    if (gs == &local_state) {
+        return;
+    }
+    if (changed) {
+        seen_generation = ++gs->generation;
+    }
+    pthread_mutex_unlock(&gs->lock);
+}
 
 int gen_SetDefaultValues() {
     gen_Disable(RP_CH_1);
     gen_Disable(RP_CH_2);
+
+    // A reset rewrites the buffers even if they look current
+    gs->written_key[0].valid = false;
+    gs->written_key[1].valid = false;
+
+    // The outputs are off, the channel settings are written in one batch
+    cmn_BatchBegin();
     gen_setFrequency(RP_CH_1, 1000);
     gen_setFrequency(RP_CH_2, 1000);
     gen_setBurstRepetitions(RP_CH_1, 1);
@@ -65,6 +212,7 @@ int gen_SetDefaultValues() {
     gen_setTriggerSource(RP_CH_2, RP_GEN_TRIG_SRC_INTERNAL);
     gen_setPhase(RP_CH_1, 0.0);
     gen_setPhase(RP_CH_2, 0.0);
+    cmn_BatchCommit();
     return RP_OK;
 }
 
@@ -90,13 +238,13 @@ int gen_checkAmplitudeAndOffset(float amplitude, float offset) {
 int gen_setAmplitude(rp_channel_t channel, float amplitude) {
     float offset;
     CHANNEL_ACTION(channel,
-            offset = chA_offset,
-            offset = chB_offset)
+            offset = gs->chA_offset,
+            offset = gs->chB_offset)
     gen_checkAmplitudeAndOffset(amplitude, offset);
 
     CHANNEL_ACTION(channel,
-            chA_amplitude = amplitude,
-            chB_amplitude = amplitude)
+            gs->chA_amplitude = amplitude,
+            gs->chB_amplitude = amplitude)
     return generate_setAmplitude(channel, amplitude);
 }
 
@@ -107,13 +255,13 @@ int gen_getAmplitude(rp_channel_t channel, float *amplitude) {
 int gen_setOffset(rp_channel_t channel, float offset) {
     float amplitude;
     CHANNEL_ACTION(channel,
-            amplitude = chA_amplitude,
-            amplitude = chB_amplitude)
+            amplitude = gs->chA_amplitude,
+            amplitude = gs->chB_amplitude)
     gen_checkAmplitudeAndOffset(amplitude, offset);
 
     CHANNEL_ACTION(channel,
-            chA_offset = offset,
-            chB_offset = offset)
+            gs->chA_offset = offset,
+            gs->chB_offset = offset)
     return generate_setDCOffset(channel, offset);
 }
 
@@ -127,12 +275,12 @@ int gen_setFrequency(rp_channel_t channel, float frequency) {
     }
 
     if (channel == RP_CH_1) {
-        chA_frequency = frequency;
-        gen_setBurstPeriod(channel, chA_burstPeriod);
+        gs->chA_frequency = frequency;
+        gen_setBurstPeriod(channel, gs->chA_burstPeriod);
     }
     else if (channel == RP_CH_2) {
-        chB_frequency = frequency;
-        gen_setBurstPeriod(channel, chB_burstPeriod);
+        gs->chB_frequency = frequency;
+        gen_setBurstPeriod(channel, gs->chB_burstPeriod);
     }
     else {
         return RP_EPN;
@@ -155,8 +303,8 @@ int gen_setPhase(rp_channel_t channel, float phase) {
         phase += 360;
     }
     CHANNEL_ACTION(channel,
-            chA_phase = phase,
-            chB_phase = phase)
+            gs->chA_phase = phase,
+            gs->chB_phase = phase)
 
     synthesize_signal(channel);
     return gen_Synchronise();
@@ -164,36 +312,38 @@ int gen_setPhase(rp_channel_t channel, float phase) {
 
 int gen_getPhase(rp_channel_t channel, float *phase) {
     CHANNEL_ACTION(channel,
-            *phase = chA_phase,
-            *phase = chB_phase)
+            *phase = gs->chA_phase,
+            *phase = gs->chB_phase)
     return RP_OK;
 }
 
 int gen_setWaveform(rp_channel_t channel, rp_waveform_t type) {
     CHANNEL_ACTION(channel,
-            chA_waveform = type,
-            chB_waveform = type)
+            gs->chA_waveform = type,
+            gs->chB_waveform = type)
     if (type == RP_WAVEFORM_ARBITRARY) {
         CHANNEL_ACTION(channel,
-                chA_size = chA_arb_size,
-                chB_size = chB_arb_size)
+                gs->chA_size = gs->chA_arb_size,
+                gs->chB_size = gs->chB_arb_size)
     }
     else{
         CHANNEL_ACTION(channel,
-                chA_size = BUFFER_LENGTH,
-                chB_size = BUFFER_LENGTH)
+                gs->chA_size = BUFFER_LENGTH,
+                gs->chB_size = BUFFER_LENGTH)
     }
     return synthesize_signal(channel);
 }
 
 int gen_getWaveform(rp_channel_t channel, rp_waveform_t *type) {
     CHANNEL_ACTION(channel,
-            *type = chA_waveform,
-            *type = chB_waveform)
+            *type = gs->chA_waveform,
+            *type = gs->chB_waveform)
     return RP_OK;
 }
 
-int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
+static int synthesize(rp_channel_t channel, bool in_place);
+
+static int storeArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
     // Check if data is normalized
     float min = FLT_MAX, max = -FLT_MAX; // initial values
     int i;
@@ -210,24 +360,101 @@ int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
     // Save data
     float *pointer;
     CHANNEL_ACTION(channel,
-            pointer = chA_arbitraryData,
-            pointer = chB_arbitraryData)
+            pointer = gs->chA_arbitraryData,
+            pointer = gs->chB_arbitraryData)
     for(i = 0; i < length; i++) {
         pointer[i] = data[i];
     }
     for(i = length; i < BUFFER_LENGTH; i++) { // clear the rest of the buffer
         pointer[i] = 0;
     }
+    CHANNEL_ACTION(channel,
+            gs->chA_arb_cnts = false,
+            gs->chB_arb_cnts = false)
+    gs->arb_generation[channel == RP_CH_1 ? 0 : 1]++;
+    return RP_OK;
+}
+
+static void cntsMinMax(const int16_t *data, uint32_t length, int16_t *min, int16_t *max) {
+    int16_t lo = INT16_MAX, hi = INT16_MIN;
+    uint32_t i = 0;
+#ifdef GEN_USE_NEON
+    if (length >= 8) {
+        int16x8_t vlo = vdupq_n_s16(INT16_MAX);
+        int16x8_t vhi = vdupq_n_s16(INT16_MIN);
+        for (; i + 8 <= length; i += 8) {
+            int16x8_t v = vld1q_s16(data + i);
+            vlo = vminq_s16(vlo, v);
+            vhi = vmaxq_s16(vhi, v);
+        }
+        int16x4_t plo = vpmin_s16(vget_low_s16(vlo), vget_high_s16(vlo));
+        int16x4_t phi = vpmax_s16(vget_low_s16(vhi), vget_high_s16(vhi));
+        plo = vpmin_s16(plo, plo);
+        phi = vpmax_s16(phi, phi);
+        plo = vpmin_s16(plo, plo);
+        phi = vpmax_s16(phi, phi);
+        lo = vget_lane_s16(plo, 0);
+        hi = vget_lane_s16(phi, 0);
+    }
+#endif
+    for (; i < length; i++) {
+        if (data[i] < lo)
+            lo = data[i];
+        if (data[i] > hi)
+            hi = data[i];
+    }
+    *min = lo;
+    *max = hi;
+}
+
+static int storeArbWaveformCnts(rp_channel_t channel, const int16_t *data, uint32_t length) {
+    if (length > BUFFER_LENGTH) {
+        return RP_EOOR;
+    }
+    int16_t min, max;
+    cntsMinMax(data, length, &min, &max);
+    if (length > 0 && (min < ARBITRARY_CNT_MIN || max > ARBITRARY_CNT_MAX)) {
+        return RP_ENN;
+    }
+
+    int16_t *pointer;
+    CHANNEL_ACTION(channel,
+            pointer = gs->chA_arbitraryCnts,
+            pointer = gs->chB_arbitraryCnts)
+    memcpy(pointer, data, length * sizeof(int16_t));
+    memset(pointer + length, 0, (BUFFER_LENGTH - length) * sizeof(int16_t));
+    CHANNEL_ACTION(channel,
+            gs->chA_arb_cnts = true,
+            gs->chB_arb_cnts = true)
+    gs->arb_generation[channel == RP_CH_1 ? 0 : 1]++;
+    return RP_OK;
+}
+
+/** The normalized view of a table uploaded as counts, in the scale of the float upload */
+static void cntsToFloat(const int16_t *cnts, float *data, uint32_t length) {
+    const float scale = 2.f * AMPLITUDE_MAX / (float) (1 << DATA_BIT_LENGTH);
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = cnts[i] * scale;
+    }
+}
+
+int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
+    int status = storeArbWaveform(channel, data, length);
+    if (status != RP_OK) {
+        return status;
+    }
 
     if (channel == RP_CH_1) {
-        chA_arb_size = length;
-        if(chA_waveform==RP_WAVEFORM_ARBITRARY){
+        gs->chA_arb_size = length;
+        if(gs->chA_waveform==RP_WAVEFORM_ARBITRARY){
+            gs->chA_size = length;
         	return synthesize_signal(channel);
         }
     }
     else if (channel == RP_CH_2) {
-    	chB_arb_size = length;
-        if(chB_waveform==RP_WAVEFORM_ARBITRARY){
+    	gs->chB_arb_size = length;
+        if(gs->chB_waveform==RP_WAVEFORM_ARBITRARY){
+            gs->chB_size = length;
         	return synthesize_signal(channel);
         }
     }
@@ -238,20 +465,111 @@ int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
     return RP_OK;
 }
 
+int gen_setArbWaveformRaw(rp_channel_t channel, const int16_t *data, uint32_t length) {
+    int status = storeArbWaveformCnts(channel, data, length);
+    if (status != RP_OK) {
+        return status;
+    }
+
+    rp_waveform_t waveform;
+    CHANNEL_ACTION(channel,
+            gs->chA_arb_size = length; waveform = gs->chA_waveform,
+            gs->chB_arb_size = length; waveform = gs->chB_waveform)
+    if (waveform == RP_WAVEFORM_ARBITRARY) {
+        CHANNEL_ACTION(channel,
+                gs->chA_size = length,
+                gs->chB_size = length)
+        return synthesize_signal(channel);
+    }
+    return RP_OK;
+}
+
+int gen_updateArbWaveform(rp_channel_t channel, float *data, uint32_t length) {
+    rp_waveform_t waveform;
+    uint32_t size;
+    CHANNEL_ACTION(channel,
+            waveform = gs->chA_waveform; size = gs->chA_size,
+            waveform = gs->chB_waveform; size = gs->chB_size)
+    // Only a playing table of the same length can be replaced in place
+    if (waveform != RP_WAVEFORM_ARBITRARY || size != length) {
+        return gen_setArbWaveform(channel, data, length);
+    }
+
+    int status = storeArbWaveform(channel, data, length);
+    if (status != RP_OK) {
+        return status;
+    }
+    return synthesize(channel, true);
+}
+
+/*
+ * The FPGA plays one table per channel with one burst setting, so the
+ * sequence is rendered into the table. An arbitrary table of any length plays
+ * at frequency * BUFFER_LENGTH samples per second.
+ */
+int gen_setSequence(rp_channel_t channel, const float *table, uint32_t table_length,
+                    const rp_gen_seq_entry_t *entries, uint32_t count, float sample_rate) {
+    static float sequence[BUFFER_LENGTH];
+    uint32_t length = 0;
+
+    if (!(sample_rate > 0 && sample_rate <= DAC_FREQUENCY)) {
+        return RP_EOOR;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const rp_gen_seq_entry_t *e = &entries[i];
+        uint32_t period = e->period ? e->period : e->length;
+        if (e->start > table_length || e->length > table_length - e->start || period < e->length ||
+            (period == 0 && e->count > 0) ||
+            e->amplitude < -1 || e->amplitude > 1) {
+            return RP_EOOR;
+        }
+        for (uint32_t n = 0; n < e->count; n++) {
+            if (period > BUFFER_LENGTH - length) {
+                return RP_EOOR;
+            }
+            for (uint32_t j = 0; j < e->length; j++) {
+                sequence[length + j] = table[e->start + j] * e->amplitude;
+            }
+            memset(&sequence[length + e->length], 0, (period - e->length) * sizeof(float));
+            length += period;
+        }
+    }
+    if (length == 0) {
+        return RP_EOOR;
+    }
+
+    // stored first, so the table is written once
+    int status = gen_setArbWaveform(channel, sequence, length);
+    if (status == RP_OK) {
+        status = gen_setWaveform(channel, RP_WAVEFORM_ARBITRARY);
+    }
+    if (status == RP_OK) {
+        status = gen_setFrequency(channel, sample_rate / BUFFER_LENGTH);
+    }
+    return status;
+}
+
 int gen_getArbWaveform(rp_channel_t channel, float *data, uint32_t *length) {
     // If this data was not set, then this method will return incorrect data
     float *pointer;
+    bool cnts;
     if (channel == RP_CH_1) {
-        *length = chA_arb_size;
-        pointer = chA_arbitraryData;
+        *length = gs->chA_arb_size;
+        pointer = gs->chA_arbitraryData;
+        cnts = gs->chA_arb_cnts;
     }
     else if (channel == RP_CH_2) {
-        *length = chB_arb_size;
-        pointer = chB_arbitraryData;
+        *length = gs->chB_arb_size;
+        pointer = gs->chB_arbitraryData;
+        cnts = gs->chB_arb_cnts;
     }
     else {
         return RP_EPN;
     }
+    if (cnts) {
+        cntsToFloat(channel == RP_CH_1 ? gs->chA_arbitraryCnts : gs->chB_arbitraryCnts, data, *length);
+        return RP_OK;
+    }
     for (int i = 0; i < *length; ++i) {
         data[i] = pointer[i];
     }
@@ -263,15 +581,15 @@ int gen_setDutyCycle(rp_channel_t channel, float ratio) {
         return RP_EOOR;
     }
     CHANNEL_ACTION(channel,
-            chA_dutyCycle = ratio,
-            chB_dutyCycle = ratio)
+            gs->chA_dutyCycle = ratio,
+            gs->chB_dutyCycle = ratio)
     return synthesize_signal(channel);
 }
 
 int gen_getDutyCycle(rp_channel_t channel, float *ratio) {
     CHANNEL_ACTION(channel,
-            *ratio = chA_dutyCycle,
-            *ratio = chB_dutyCycle)
+            *ratio = gs->chA_dutyCycle,
+            *ratio = gs->chB_dutyCycle)
     return RP_OK;
 }
 
@@ -284,9 +602,9 @@ int gen_setGenMode(rp_channel_t channel, rp_gen_mode_t mode) {
         return triggerIfInternal(channel);
     }
     else if (mode == RP_GEN_MODE_BURST) {
-        gen_setBurstCount(channel, channel == RP_CH_1 ? chA_burstCount : chB_burstCount);
-        gen_setBurstRepetitions(channel, channel == RP_CH_1 ? chA_burstRepetition : chB_burstRepetition);
-        gen_setBurstPeriod(channel, channel == RP_CH_1 ? chA_burstPeriod : chB_burstPeriod);
+        gen_setBurstCount(channel, channel == RP_CH_1 ? gs->chA_burstCount : gs->chB_burstCount);
+        gen_setBurstRepetitions(channel, channel == RP_CH_1 ? gs->chA_burstRepetition : gs->chB_burstRepetition);
+        gen_setBurstPeriod(channel, channel == RP_CH_1 ? gs->chA_burstPeriod : gs->chB_burstPeriod);
         return RP_OK;
     }
     else if (mode == RP_GEN_MODE_STREAM) {
@@ -314,8 +632,8 @@ int gen_setBurstCount(rp_channel_t channel, int num) {
         return RP_EOOR;
     }
     CHANNEL_ACTION(channel,
-            chA_burstCount = num,
-            chB_burstCount = num)
+            gs->chA_burstCount = num,
+            gs->chB_burstCount = num)
     if (num == -1) {    // -1 represents infinity. In FPGA value 0 represents infinity
         num = 0;
     }
@@ -334,8 +652,8 @@ int gen_setBurstRepetitions(rp_channel_t channel, int repetitions) {
         return RP_EOOR;
     }
     CHANNEL_ACTION(channel,
-            chA_burstRepetition = repetitions,
-            chB_burstRepetition = repetitions)
+            gs->chA_burstRepetition = repetitions,
+            gs->chB_burstRepetition = repetitions)
     if (repetitions == -1) {
         repetitions = 0;
     }
@@ -358,10 +676,10 @@ int gen_setBurstPeriod(rp_channel_t channel, uint32_t period) {
     }
     int burstCount;
     CHANNEL_ACTION(channel,
-            burstCount = chA_burstCount,
-            burstCount = chB_burstCount)
+            burstCount = gs->chA_burstCount,
+            burstCount = gs->chB_burstCount)
     // period = signal_time * burst_count + delay_time
-    int delay = (int) (period - (1 / (channel == RP_CH_1 ? chA_frequency : chB_frequency) * MICRO) * burstCount);
+    int delay = (int) (period - (1 / (channel == RP_CH_1 ? gs->chA_frequency : gs->chB_frequency) * MICRO) * burstCount);
     if (delay <= 0) {
         // if delay is 0, then FPGA generates continuous signal
         delay = 1;
@@ -369,8 +687,8 @@ int gen_setBurstPeriod(rp_channel_t channel, uint32_t period) {
     generate_setBurstDelay(channel, (uint32_t) delay);
 
     CHANNEL_ACTION(channel,
-                   chA_burstPeriod = period,
-                   chB_burstPeriod = period)
+                   gs->chA_burstPeriod = period,
+                   gs->chB_burstPeriod = period)
 
     // trigger channel if internal trigger source
     return triggerIfInternal(channel);
@@ -449,30 +767,49 @@ int gen_Synchronise() {
     return generate_Synchronise();
 }
 
-int synthesize_signal(rp_channel_t channel) {
+/**
+ * Synthesizes the table of a channel and writes it, unless the DAC already holds it.
+ * in_place rewrites a playing table sample by sample behind the read pointer.
+ */
+static int synthesize(rp_channel_t channel, bool in_place) {
     float data[BUFFER_LENGTH];
     rp_waveform_t waveform;
     float dutyCycle, frequency;
     uint32_t size, phase;
 
     if (channel == RP_CH_1) {
-        waveform = chA_waveform;
-        dutyCycle = chA_dutyCycle;
-        frequency = chA_frequency;
-        size = chA_size;
-        phase = (uint32_t) (chA_phase * BUFFER_LENGTH / 360.0);
+        waveform = gs->chA_waveform;
+        dutyCycle = gs->chA_dutyCycle;
+        frequency = gs->chA_frequency;
+        size = gs->chA_size;
+        phase = (uint32_t) (gs->chA_phase * BUFFER_LENGTH / 360.0);
     }
     else if (channel == RP_CH_2) {
-        waveform = chB_waveform;
-        dutyCycle = chB_dutyCycle;
-        frequency = chB_frequency;
-    	size = chB_size;
-        phase = (uint32_t) (chB_phase * BUFFER_LENGTH / 360.0);
+        waveform = gs->chB_waveform;
+        dutyCycle = gs->chB_dutyCycle;
+        frequency = gs->chB_frequency;
+    	size = gs->chB_size;
+        phase = (uint32_t) (gs->chB_phase * BUFFER_LENGTH / 360.0);
     }
     else{
         return RP_EPN;
     }
 
+    // Zeroed first, the padding takes part in the comparison
+    synthesis_key_t key;
+    memset(&key, 0, sizeof(key));
+    key.valid         = true;
+    key.waveform      = waveform;
+    key.dutyCycle     = waveform == RP_WAVEFORM_PWM ? dutyCycle : 0;
+    key.squareTrans   = waveform == RP_WAVEFORM_SQUARE ? synthesis_squareTrans(frequency) : 0;
+    key.size          = waveform == RP_WAVEFORM_ARBITRARY ? size : BUFFER_LENGTH;
+    key.phase         = phase;
+    key.arbGeneration = waveform == RP_WAVEFORM_ARBITRARY ? gs->arb_generation[channel == RP_CH_1 ? 0 : 1] : 0;
+    synthesis_key_t *written = &gs->written_key[channel == RP_CH_1 ? 0 : 1];
+    if (memcmp(written, &key, sizeof(key)) == 0) {
+        return RP_OK;
+    }
+
     switch (waveform) {
         case RP_WAVEFORM_SINE     : synthesis_sin      (data);                 break;
         case RP_WAVEFORM_TRIANGLE : synthesis_triangle (data);                 break;
@@ -481,10 +818,32 @@ int synthesize_signal(rp_channel_t channel) {
         case RP_WAVEFORM_RAMP_DOWN: synthesis_rampDown (data);                 break;
         case RP_WAVEFORM_DC       : synthesis_DC       (data);                 break;
         case RP_WAVEFORM_PWM      : synthesis_PWM      (dutyCycle, data);      break;
-        case RP_WAVEFORM_ARBITRARY: synthesis_arbitrary(channel, data, &size); break;
+        case RP_WAVEFORM_ARBITRARY:
+            if (channel == RP_CH_1 ? gs->chA_arb_cnts : gs->chB_arb_cnts) {
+                // Counts skip the float table and the conversion
+                const int16_t *cnts = channel == RP_CH_1 ? gs->chA_arbitraryCnts : gs->chB_arbitraryCnts;
+                size = channel == RP_CH_1 ? gs->chA_arb_size : gs->chB_arb_size;
+                int status = in_place ? generate_updateDataRaw(channel, cnts, phase, size)
+                                      : generate_writeDataRaw(channel, cnts, phase, size);
+                if (status == RP_OK) {
+                    *written = key;
+                }
+                return status;
+            }
+            synthesis_arbitrary(channel, data, &size);
+            break;
         default:                    return RP_EIPV;
     }
-    return generate_writeData(channel, data, phase, size);
+    int status = in_place ? generate_updateData(channel, data, phase, size)
+                          : generate_writeData(channel, data, phase, size);
+    if (status == RP_OK) {
+        *written = key;
+    }
+    return status;
+}
+
+int synthesize_signal(rp_channel_t channel) {
+    return synthesize(channel, false);
 }
 
 int synthesis_sin(float *data_out) {
@@ -541,18 +900,23 @@ int synthesis_PWM(float ratio, float *data_out) {
 int synthesis_arbitrary(rp_channel_t channel, float *data_out, uint32_t * size) {
     float *pointer;
     CHANNEL_ACTION(channel,
-            pointer = chA_arbitraryData,
-            pointer = chB_arbitraryData)
-    for (int unsigned i = 0; i < BUFFER_LENGTH; i++) {
-        data_out[i] = pointer[i];
+            pointer = gs->chA_arbitraryData,
+            pointer = gs->chB_arbitraryData)
+    if (channel == RP_CH_1 ? gs->chA_arb_cnts : gs->chB_arb_cnts) {
+        cntsToFloat(channel == RP_CH_1 ? gs->chA_arbitraryCnts : gs->chB_arbitraryCnts, data_out, BUFFER_LENGTH);
+    }
+    else {
+        for (int unsigned i = 0; i < BUFFER_LENGTH; i++) {
+            data_out[i] = pointer[i];
+        }
     }
     CHANNEL_ACTION(channel,
-            *size = chA_arb_size,
-            *size = chB_arb_size)
+            *size = gs->chA_arb_size,
+            *size = gs->chB_arb_size)
     return RP_OK;
 }
 
-int synthesis_square(float frequency, float *data_out) {
+int synthesis_squareTrans(float frequency) {
     // Various locally used constants - HW specific parameters
     const int trans0 = 30;
     const int trans1 = 300;
@@ -560,6 +924,11 @@ int synthesis_square(float frequency, float *data_out) {
     int trans = (int) (frequency / 1e6 * trans1); // 300 samples at 1 MHz
 
     if (trans <= 10)  trans = trans0;
+    return trans;
+}
+
+int synthesis_square(float frequency, float *data_out) {
+    int trans = synthesis_squareTrans(frequency);
 
     for(int unsigned i = 0; i < BUFFER_LENGTH; i++) {
         if      ((0 <= i                      ) && (i <  BUFFER_LENGTH/2 - trans))  data_out[i] =  1.0f;
@@ -583,8 +952,8 @@ int triggerIfInternal(rp_channel_t channel) {
 
 int gen_setEnableTempProtection(rp_channel_t channel, bool enable) {
     CHANNEL_ACTION(channel,
-            chA_EnableTempProtection = enable,
-            chB_EnableTempProtection = enable)
+            gs->chA_EnableTempProtection = enable,
+            gs->chB_EnableTempProtection = enable)
     return generate_setEnableTempProtection(channel, enable);
 }
 
@@ -594,8 +963,8 @@ int gen_getEnableTempProtection(rp_channel_t channel, bool *enable) {
 
 int gen_setLatchTempAlarm(rp_channel_t channel, bool status) {
     CHANNEL_ACTION(channel,
-            chA_LatchTempAlarm = status,
-            chB_LatchTempAlarm = status)
+            gs->chA_LatchTempAlarm = status,
+            gs->chB_LatchTempAlarm = status)
     return generate_setLatchTempAlarm(channel, status);
 }
 
@@ -18,6 +18,11 @@
 
 #include "redpitaya/rp.h"
 
+int gen_StateAttach(bool shared);
+int gen_StateDetach();
+void gen_StateLock();
+void gen_StateUnlock(bool changed);
+
 int gen_SetDefaultValues();
 int gen_Disable(rp_channel_t chanel);
 int gen_Enable(rp_channel_t chanel);
@@ -33,6 +38,10 @@ int gen_getPhase(rp_channel_t channel, float *phase);
 int gen_setWaveform(rp_channel_t channel, rp_waveform_t type);
 int gen_getWaveform(rp_channel_t channel, rp_waveform_t *type);
 int gen_setArbWaveform(rp_channel_t channel, float *data, uint32_t length);
+int gen_setArbWaveformRaw(rp_channel_t channel, const int16_t *data, uint32_t length);
+int gen_updateArbWaveform(rp_channel_t channel, float *data, uint32_t length);
+int gen_setSequence(rp_channel_t channel, const float *table, uint32_t table_length,
+                    const rp_gen_seq_entry_t *entries, uint32_t count, float sample_rate);
 int gen_getArbWaveform(rp_channel_t channel, float *data, uint32_t *length);
 int gen_setDutyCycle(rp_channel_t channel, float ratio);
 int gen_getDutyCycle(rp_channel_t channel, float *ratio);
@@ -60,6 +69,7 @@ int synthesize_signal(rp_channel_t channel);
 int synthesis_sin(float *data_out);
 int synthesis_triangle(float *data_out);
 int synthesis_arbitrary(rp_channel_t channel, float *data_out, uint32_t * size);
+int synthesis_squareTrans(float frequency);
 int synthesis_square(float frequency, float *data_out);
 int synthesis_rampUp(float *data_out);
 int synthesis_rampDown(float *data_out);
@@ -25,15 +25,51 @@ static volatile generate_control_t *generate = NULL;
 static volatile int32_t *data_chA = NULL;
 static volatile int32_t *data_chB = NULL;
 
+// Copies of what the DAC tables hold, so an update only writes the samples that change
+static int32_t table_chA[BUFFER_LENGTH];
+static int32_t table_chB[BUFFER_LENGTH];
+static bool table_chA_valid = false;
+static bool table_chB_valid = false;
+
+
+// amplitudeScale and amplitudeOffset share the first word of the channel properties
+#define AMPLITUDE_SCALE_SHIFT   0
+#define AMPLITUDE_OFFSET_SHIFT  16
+#define AMPLITUDE_MASK          0x3FFF
+
+static volatile uint32_t* getAmplitudeWord(volatile ch_properties_t *ch_properties) {
+    return (volatile uint32_t *) ch_properties;
+}
 
 int generate_Init() {
-    cmn_Map(GENERATE_BASE_SIZE, GENERATE_BASE_ADDR, (void **) &generate);
+    int status = cmn_Map(GENERATE_BASE_SIZE, GENERATE_BASE_ADDR, (void **) &generate);
     data_chA = (int32_t *) ((char *) generate + (CHA_DATA_OFFSET));
     data_chB = (int32_t *) ((char *) generate + (CHB_DATA_OFFSET));
+    if (status != RP_OK) {
+        return status;
+    }
+
+    // Channel properties the FPGA never changes, the control word has self clearing bits
+    volatile ch_properties_t *props[2] = { &generate->properties_chA, &generate->properties_chB };
+    for (int i = 0; i < 2; ++i) {
+        cmn_ShadowAdd(getAmplitudeWord(props[i]));
+        cmn_ShadowAdd(&props[i]->counterWrap);
+        cmn_ShadowAdd(&props[i]->counterStep);
+        cmn_ShadowAdd(&props[i]->cyclesInOneBurst);
+        cmn_ShadowAdd(&props[i]->burstRepetitions);
+        cmn_ShadowAdd(&props[i]->delayBetweenBurstRepetitions);
+    }
     return RP_OK;
 }
 
+/** The registers were written by someone else, updateTable() must not diff against the copies */
+void generate_InvalidateTables() {
+    table_chA_valid = false;
+    table_chB_valid = false;
+}
+
 int generate_Release() {
+    generate_InvalidateTables();
     cmn_Unmap(GENERATE_BASE_SIZE, (void **) &generate);
     data_chA = NULL;
     data_chB = NULL;
@@ -154,8 +190,8 @@ int generate_setAmplitude(rp_channel_t channel, float amplitude) {
     uint32_t amp_max = channel == RP_CH_1 ? calib.be_ch1_fs: calib.be_ch2_fs;
 
     getChannelPropertiesAddress(&ch_properties, channel);
-    ch_properties->amplitudeScale = cmn_CnvVToCnt(DATA_BIT_LENGTH, amplitude, AMPLITUDE_MAX, false, amp_max, 0, 0.0);
-    return RP_OK;
+    uint32_t cnt = cmn_CnvVToCnt(DATA_BIT_LENGTH, amplitude, AMPLITUDE_MAX, false, amp_max, 0, 0.0);
+    return cmn_SetShiftedValue(getAmplitudeWord(ch_properties), cnt & AMPLITUDE_MASK, AMPLITUDE_MASK, AMPLITUDE_SCALE_SHIFT);
 }
 
 int generate_getAmplitude(rp_channel_t channel, float *amplitude) {
@@ -165,7 +201,9 @@ int generate_getAmplitude(rp_channel_t channel, float *amplitude) {
     uint32_t amp_max = channel == RP_CH_1 ? calib.be_ch1_fs: calib.be_ch2_fs;
 
     getChannelPropertiesAddress(&ch_properties, channel);
-    *amplitude = cmn_CnvCntToV(DATA_BIT_LENGTH, ch_properties->amplitudeScale, AMPLITUDE_MAX, amp_max, 0, 0.0);
+    uint32_t cnt;
+    cmn_GetShiftedValue(getAmplitudeWord(ch_properties), &cnt, AMPLITUDE_MASK, AMPLITUDE_SCALE_SHIFT);
+    *amplitude = cmn_CnvCntToV(DATA_BIT_LENGTH, cnt, AMPLITUDE_MAX, amp_max, 0, 0.0);
     return RP_OK;
 }
 
@@ -177,8 +215,8 @@ int generate_setDCOffset(rp_channel_t channel, float offset) {
     uint32_t amp_max = channel == RP_CH_1 ? calib.be_ch1_fs: calib.be_ch2_fs;
 
     getChannelPropertiesAddress(&ch_properties, channel);
-    ch_properties->amplitudeOffset = cmn_CnvVToCnt(DATA_BIT_LENGTH, offset, (float) (OFFSET_MAX/2.f), false, amp_max, dc_offs, 0);
-    return RP_OK;
+    uint32_t cnt = cmn_CnvVToCnt(DATA_BIT_LENGTH, offset, (float) (OFFSET_MAX/2.f), false, amp_max, dc_offs, 0);
+    return cmn_SetShiftedValue(getAmplitudeWord(ch_properties), cnt & AMPLITUDE_MASK, AMPLITUDE_MASK, AMPLITUDE_OFFSET_SHIFT);
 }
 
 int generate_getDCOffset(rp_channel_t channel, float *offset) {
@@ -189,14 +227,16 @@ int generate_getDCOffset(rp_channel_t channel, float *offset) {
     uint32_t amp_max = channel == RP_CH_1 ? calib.be_ch1_fs: calib.be_ch2_fs;
 
     getChannelPropertiesAddress(&ch_properties, channel);
-    *offset = cmn_CnvCntToV(DATA_BIT_LENGTH, ch_properties->amplitudeOffset, (float) (OFFSET_MAX/2.f), amp_max, dc_offs, 0);
+    uint32_t cnt;
+    cmn_GetShiftedValue(getAmplitudeWord(ch_properties), &cnt, AMPLITUDE_MASK, AMPLITUDE_OFFSET_SHIFT);
+    *offset = cmn_CnvCntToV(DATA_BIT_LENGTH, cnt, (float) (OFFSET_MAX/2.f), amp_max, dc_offs, 0);
     return RP_OK;
 }
 
 int generate_setFrequency(rp_channel_t channel, float frequency) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    ch_properties->counterStep = (uint32_t) round(65536 * frequency / DAC_FREQUENCY * BUFFER_LENGTH);
+    cmn_SetValue(&ch_properties->counterStep, (uint32_t) round(65536 * frequency / DAC_FREQUENCY * BUFFER_LENGTH), 0xFFFFFFFF);
     channel == RP_CH_1 ? (generate->ASM_WrapPointer = 1) : (generate->BSM_WrapPointer = 1);
     return RP_OK;
 }
@@ -204,14 +244,16 @@ int generate_setFrequency(rp_channel_t channel, float frequency) {
 int generate_getFrequency(rp_channel_t channel, float *frequency) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    *frequency = (float) round((ch_properties->counterStep * DAC_FREQUENCY) / (65536 * BUFFER_LENGTH));
+    uint32_t step;
+    cmn_GetValue(&ch_properties->counterStep, &step, 0xFFFFFFFF);
+    *frequency = (float) round((step * DAC_FREQUENCY) / (65536 * BUFFER_LENGTH));
     return RP_OK;
 }
 
 int generate_setWrapCounter(rp_channel_t channel, uint32_t size) {
     CHANNEL_ACTION(channel,
-            generate->properties_chA.counterWrap = 65536 * size - 1,
-            generate->properties_chB.counterWrap = 65536 * size - 1)
+            cmn_SetValue(&generate->properties_chA.counterWrap, 65536 * size - 1, 0xFFFFFFFF),
+            cmn_SetValue(&generate->properties_chB.counterWrap, 65536 * size - 1, 0xFFFFFFFF))
     return RP_OK;
 }
 
@@ -246,43 +288,37 @@ int generate_getGatedBurst(rp_channel_t channel, uint32_t *value) {
 int generate_setBurstCount(rp_channel_t channel, uint32_t num) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    ch_properties->cyclesInOneBurst = num;
-    return RP_OK;
+    return cmn_SetValue(&ch_properties->cyclesInOneBurst, num, 0xFFFFFFFF);
 }
 
 int generate_getBurstCount(rp_channel_t channel, uint32_t *num) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    *num = ch_properties->cyclesInOneBurst;
-    return RP_OK;
+    return cmn_GetValue(&ch_properties->cyclesInOneBurst, num, 0xFFFFFFFF);
 }
 
 int generate_setBurstRepetitions(rp_channel_t channel, uint32_t repetitions) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    ch_properties->burstRepetitions = repetitions;
-    return RP_OK;
+    return cmn_SetValue(&ch_properties->burstRepetitions, repetitions, 0xFFFFFFFF);
 }
 
 int generate_getBurstRepetitions(rp_channel_t channel, uint32_t *repetitions) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    *repetitions = ch_properties->burstRepetitions;
-    return RP_OK;
+    return cmn_GetValue(&ch_properties->burstRepetitions, repetitions, 0xFFFFFFFF);
 }
 
 int generate_setBurstDelay(rp_channel_t channel, uint32_t delay) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    ch_properties->delayBetweenBurstRepetitions = delay;
-    return RP_OK;
+    return cmn_SetValue(&ch_properties->delayBetweenBurstRepetitions, delay, 0xFFFFFFFF);
 }
 
 int generate_getBurstDelay(rp_channel_t channel, uint32_t *delay) {
     volatile ch_properties_t *ch_properties;
     getChannelPropertiesAddress(&ch_properties, channel);
-    *delay = ch_properties->delayBetweenBurstRepetitions;
-    return RP_OK;
+    return cmn_GetValue(&ch_properties->delayBetweenBurstRepetitions, delay, 0xFFFFFFFF);
 }
 
 int generate_simultaneousTrigger() {
@@ -298,22 +334,105 @@ int generate_Synchronise() {
     return RP_OK;
 }
 
-int generate_writeData(rp_channel_t channel, float *data, uint32_t start, uint32_t length) {
+int generate_ResetChannel(rp_channel_t channel) {
+    // Stops the channel, it starts over on its next trigger
+    CHANNEL_ACTION(channel,
+            generate->ASM_reset = 1,
+            generate->BSM_reset = 1)
+    CHANNEL_ACTION(channel,
+            generate->ASM_reset = 0,
+            generate->BSM_reset = 0)
+    return RP_OK;
+}
+
+/*
+ * Tables come either as normalized floats or as DAC counts. Counts are only
+ * masked to the field, floats go through the count conversion.
+ */
+static inline int32_t sampleCnt(const float *data, const int16_t *counts, uint32_t i) {
+    if (counts) {
+        return counts[i] & ((1 << DATA_BIT_LENGTH) - 1);
+    }
+    return cmn_CnvVToCnt(DATA_BIT_LENGTH, data[i], AMPLITUDE_MAX, false, 0, 0, 0.0);
+}
+
+static int writeTable(rp_channel_t channel, const float *data, const int16_t *counts, uint32_t start, uint32_t length) {
     volatile int32_t *dataOut;
+    int32_t *table;
     CHANNEL_ACTION(channel,
-            dataOut = data_chA,
-            dataOut = data_chB)
+            dataOut = data_chA; table = table_chA,
+            dataOut = data_chB; table = table_chB)
 
     volatile ch_properties_t *properties;
     getChannelPropertiesAddress(&properties, channel);
     generate_setWrapCounter(channel, length);
 
-    //rp_calib_params_t calib = calib_GetParams();
-    int dc_offs = 0;//channel == RP_CH_1 ? calib.be_ch1_dc_offs: calib.be_ch2_dc_offs;
-    uint32_t amp_max = 0; //channel == RP_CH_1 ? calib.be_ch1_fs: calib.be_ch2_fs;
-
     for(int i = start; i < start+BUFFER_LENGTH; i++) {
-        dataOut[i % BUFFER_LENGTH] = cmn_CnvVToCnt(DATA_BIT_LENGTH, data[i-start], AMPLITUDE_MAX, false, amp_max, dc_offs, 0.0);
+        table[i % BUFFER_LENGTH] = sampleCnt(data, counts, i-start);
+        dataOut[i % BUFFER_LENGTH] = table[i % BUFFER_LENGTH];
+    }
+    CHANNEL_ACTION(channel,
+            table_chA_valid = true,
+            table_chB_valid = true)
+    return RP_OK;
+}
+
+int generate_getReadPointer(rp_channel_t channel, uint32_t *pos) {
+    volatile ch_properties_t *ch_properties;
+    getChannelPropertiesAddress(&ch_properties, channel);
+    *pos = ch_properties->buffReadPointer;
+    return RP_OK;
+}
+
+/**
+ * Replaces the table of a playing channel without stopping it. Samples are
+ * written in playback order starting at the read pointer, so each one changes
+ * right after it was played and the new waveform is in place one period later.
+ * Samples that already hold the new value are not written. The wrap length
+ * stays as it is, so the length must match the playing table.
+ */
+static int updateTable(rp_channel_t channel, const float *data, const int16_t *counts, uint32_t start, uint32_t length) {
+    volatile int32_t *dataOut;
+    int32_t *table;
+    bool valid;
+    CHANNEL_ACTION(channel,
+            dataOut = data_chA; table = table_chA; valid = table_chA_valid,
+            dataOut = data_chB; table = table_chB; valid = table_chB_valid)
+    if (!valid || length == 0 || length > BUFFER_LENGTH) {
+        return writeTable(channel, data, counts, start, length);
+    }
+
+    uint32_t read_ptr;
+    generate_getReadPointer(channel, &read_ptr);
+    if (read_ptr >= length) {
+        read_ptr = 0;
+    }
+
+    // The played part from the read pointer around to it, then the unplayed rest
+    for (uint32_t n = 0; n < BUFFER_LENGTH; n++) {
+        uint32_t idx = n < length ? (read_ptr + n) % length : n;
+        uint32_t i = (idx + BUFFER_LENGTH - start % BUFFER_LENGTH) % BUFFER_LENGTH;
+        int32_t cnt = sampleCnt(data, counts, i);
+        if (table[idx] != cnt) {
+            table[idx] = cnt;
+            dataOut[idx] = cnt;
+        }
     }
     return RP_OK;
 }
+
+int generate_writeData(rp_channel_t channel, float *data, uint32_t start, uint32_t length) {
+    return writeTable(channel, data, NULL, start, length);
+}
+
+int generate_writeDataRaw(rp_channel_t channel, const int16_t *data, uint32_t start, uint32_t length) {
+    return writeTable(channel, NULL, data, start, length);
+}
+
+int generate_updateData(rp_channel_t channel, float *data, uint32_t start, uint32_t length) {
+    return updateTable(channel, data, NULL, start, length);
+}
+
+int generate_updateDataRaw(rp_channel_t channel, const int16_t *data, uint32_t start, uint32_t length) {
+    return updateTable(channel, NULL, data, start, length);
+}
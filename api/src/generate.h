@@ -45,6 +45,8 @@
 #define CHA_DATA_OFFSET         0x10000
 #define CHB_DATA_OFFSET         0x20000
 #define DATA_BIT_LENGTH         14
+#define ARBITRARY_CNT_MIN       (-(1 << (DATA_BIT_LENGTH - 1)))
+#define ARBITRARY_CNT_MAX       ((1 << (DATA_BIT_LENGTH - 1)) - 1)
 #define MICRO                   1e6
 
 // Base Generate address
@@ -100,6 +102,7 @@ typedef struct generate_control_s {
 
 int generate_Init();
 int generate_Release();
+void generate_InvalidateTables();
 
 int generate_setOutputDisable(rp_channel_t channel, bool disable);
 int generate_getOutputEnabled(rp_channel_t channel, bool *disabled);
@@ -130,7 +133,12 @@ int generate_getRuntimeTempAlarm(rp_channel_t channel, bool *state);
 
 int generate_simultaneousTrigger();
 int generate_Synchronise();
+int generate_ResetChannel(rp_channel_t channel);
 
 int generate_writeData(rp_channel_t channel, float *data, uint32_t start, uint32_t length);
+int generate_updateData(rp_channel_t channel, float *data, uint32_t start, uint32_t length);
+int generate_writeDataRaw(rp_channel_t channel, const int16_t *data, uint32_t start, uint32_t length);
+int generate_updateDataRaw(rp_channel_t channel, const int16_t *data, uint32_t start, uint32_t length);
+int generate_getReadPointer(rp_channel_t channel, uint32_t *pos);
 
 #endif //__GENERATE_H
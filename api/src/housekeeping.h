@@ -56,8 +56,7 @@ int hk_EnableDigitalLoop(bool enable);
 static volatile housekeeping_control_t *hk = NULL;
 
 static int hk_Init() {
-    cmn_Map(HOUSEKEEPING_BASE_SIZE, HOUSEKEEPING_BASE_ADDR, (void**)&hk);
-    return RP_OK;
+    return cmn_Map(HOUSEKEEPING_BASE_SIZE, HOUSEKEEPING_BASE_ADDR, (void**)&hk);
 }
 
 static int hk_Release() {
@@ -0,0 +1,252 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library I2C module implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "i2c.h"
+
+/*
+ * Write-through copy of the configuration registers of one device. Only
+ * registers first .. first + count - 1 are kept, status registers that the
+ * device changes by itself must stay outside of the range.
+ */
+typedef struct {
+    uint8_t  first;
+    uint32_t count;
+    uint8_t  value[256];
+    uint8_t  valid[256 / 8];
+} i2c_cache_t;
+
+static int i2c_fd = -1;
+static i2c_cache_t* i2c_cache[I2C_ADDR_NUM];
+
+// Guards the descriptor and the caches
+static pthread_mutex_t i2c_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool cached(const i2c_cache_t* cache, uint32_t reg)
+{
+    return cache != NULL && reg >= cache->first && reg < cache->first + cache->count;
+}
+
+static bool isValid(const i2c_cache_t* cache, uint32_t reg)
+{
+    return cached(cache, reg) && (cache->valid[reg / 8] & (1 << (reg % 8)));
+}
+
+static void store(i2c_cache_t* cache, uint32_t reg, const uint8_t* data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++, reg++) {
+        if (cached(cache, reg)) {
+            cache->value[reg] = data[i];
+            cache->valid[reg / 8] |= 1 << (reg % 8);
+        }
+    }
+}
+
+/* One I2C_RDWR, the messages are joined with repeated starts */
+static int rdwr(struct i2c_msg* msgs, uint32_t count, int error)
+{
+    struct i2c_rdwr_ioctl_data data = { .msgs = msgs, .nmsgs = count };
+    if (i2c_fd < 0) {
+        return RP_EFOB;
+    }
+    return ioctl(i2c_fd, I2C_RDWR, &data) < 0 ? error : RP_OK;
+}
+
+int i2c_Init(const char* device)
+{
+    pthread_mutex_lock(&i2c_lock);
+    if (i2c_fd >= 0) {
+        close(i2c_fd);
+    }
+    i2c_fd = open(device != NULL ? device : I2C_DEFAULT_DEVICE, O_RDWR | O_CLOEXEC);
+    // another bus, the devices behind it are others
+    for (int i = 0; i < I2C_ADDR_NUM; i++) {
+        if (i2c_cache[i] != NULL) {
+            memset(i2c_cache[i]->valid, 0, sizeof(i2c_cache[i]->valid));
+        }
+    }
+    int ret = i2c_fd < 0 ? RP_EFOB : RP_OK;
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+int i2c_Release()
+{
+    pthread_mutex_lock(&i2c_lock);
+    int ret = RP_OK;
+    if (i2c_fd >= 0 && close(i2c_fd) != 0) {
+        ret = RP_EFCB;
+    }
+    i2c_fd = -1;
+    for (int i = 0; i < I2C_ADDR_NUM; i++) {
+        free(i2c_cache[i]);
+        i2c_cache[i] = NULL;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+int i2c_Transfer(const rp_i2c_msg_t* msgs, uint32_t count)
+{
+    struct i2c_msg batch[I2C_MAX_MESSAGES];
+    int ret = RP_OK;
+
+    pthread_mutex_lock(&i2c_lock);
+    for (uint32_t i = 0; ret == RP_OK && i < count; ) {
+        uint32_t n = 0;
+        bool read = false;
+        for (; i < count && n < I2C_MAX_MESSAGES; i++, n++) {
+            batch[n].addr = msgs[i].addr;
+            batch[n].flags = msgs[i].read ? I2C_M_RD : 0;
+            batch[n].len = msgs[i].len;
+            batch[n].buf = msgs[i].data;
+            read |= msgs[i].read;
+        }
+        ret = rdwr(batch, n, read ? RP_EFRB : RP_EFWB);
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+int i2c_ReadRegs(uint8_t addr, uint8_t reg, uint8_t* data, uint32_t len)
+{
+    if (addr >= I2C_ADDR_NUM || reg + len > 256) {
+        return RP_EOOR;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    i2c_cache_t* cache = i2c_cache[addr];
+    uint32_t hit = 0;
+    while (hit < len && isValid(cache, reg + hit)) {
+        hit++;
+    }
+    int ret = RP_OK;
+    if (hit == len) {
+        memcpy(data, &cache->value[reg], len);
+    } else {
+        // register address, then the burst after a repeated start
+        struct i2c_msg msgs[2] = {
+            { .addr = addr, .flags = 0,        .len = 1,   .buf = &reg },
+            { .addr = addr, .flags = I2C_M_RD, .len = len, .buf = data },
+        };
+        ret = rdwr(msgs, 2, RP_EFRB);
+        if (ret == RP_OK) {
+            store(cache, reg, data, len);
+        }
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+int i2c_WriteRegs(uint8_t addr, uint8_t reg, const uint8_t* data, uint32_t len)
+{
+    uint8_t buf[257];
+
+    if (addr >= I2C_ADDR_NUM || reg + len > 256) {
+        return RP_EOOR;
+    }
+    buf[0] = reg;
+    memcpy(&buf[1], data, len);
+    struct i2c_msg msg = { .addr = addr, .flags = 0, .len = len + 1, .buf = buf };
+
+    pthread_mutex_lock(&i2c_lock);
+    int ret = rdwr(&msg, 1, RP_EFWB);
+    if (ret == RP_OK) {
+        store(i2c_cache[addr], reg, data, len);
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+int i2c_WriteRegList(uint8_t addr, const rp_i2c_reg_t* regs, uint32_t count)
+{
+    struct i2c_msg batch[I2C_MAX_MESSAGES];
+    uint8_t buf[I2C_MAX_MESSAGES][2];
+    int ret = RP_OK;
+
+    if (addr >= I2C_ADDR_NUM) {
+        return RP_EOOR;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    i2c_cache_t* cache = i2c_cache[addr];
+    for (uint32_t i = 0; ret == RP_OK && i < count; ) {
+        uint32_t first = i;
+        uint32_t n = 0;
+        for (; i < count && n < I2C_MAX_MESSAGES; i++) {
+            // a cached register that already holds the value is not written again
+            if (isValid(cache, regs[i].reg) && cache->value[regs[i].reg] == regs[i].value) {
+                continue;
+            }
+            buf[n][0] = regs[i].reg;
+            buf[n][1] = regs[i].value;
+            batch[n] = (struct i2c_msg) { .addr = addr, .flags = 0, .len = 2, .buf = buf[n] };
+            n++;
+        }
+        if (n > 0) {
+            ret = rdwr(batch, n, RP_EFWB);
+        }
+        for (; ret == RP_OK && first < i; first++) {
+            store(cache, regs[first].reg, &regs[first].value, 1);
+        }
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+int i2c_SetCache(uint8_t addr, uint8_t first, uint32_t count)
+{
+    if (addr >= I2C_ADDR_NUM || first + count > 256) {
+        return RP_EOOR;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    int ret = RP_OK;
+    if (count == 0) {
+        free(i2c_cache[addr]);
+        i2c_cache[addr] = NULL;
+    } else if (i2c_cache[addr] == NULL && (i2c_cache[addr] = calloc(1, sizeof(i2c_cache_t))) == NULL) {
+        ret = RP_EAM;
+    }
+    if (count > 0 && ret == RP_OK) {
+        // registers that stay in the range keep their values
+        i2c_cache_t* cache = i2c_cache[addr];
+        for (uint32_t reg = 0; reg < 256; reg++) {
+            if (reg < first || reg >= first + count) {
+                cache->valid[reg / 8] &= ~(1 << (reg % 8));
+            }
+        }
+        cache->first = first;
+        cache->count = count;
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return ret;
+}
+
+int i2c_InvalidateCache(uint8_t addr)
+{
+    if (addr >= I2C_ADDR_NUM) {
+        return RP_EOOR;
+    }
+    pthread_mutex_lock(&i2c_lock);
+    if (i2c_cache[addr] != NULL) {
+        memset(i2c_cache[addr]->valid, 0, sizeof(i2c_cache[addr]->valid));
+    }
+    pthread_mutex_unlock(&i2c_lock);
+    return RP_OK;
+}
@@ -0,0 +1,39 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library I2C module interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef SRC_I2C_H_
+#define SRC_I2C_H_
+
+#include <stdint.h>
+#include "redpitaya/rp.h"
+
+/** Bus of the extension connector */
+#define I2C_DEFAULT_DEVICE "/dev/i2c-0"
+
+/** Messages one I2C_RDWR takes, I2C_RDWR_IOCTL_MAX_MSGS of linux/i2c-dev.h */
+#define I2C_MAX_MESSAGES   42
+
+/** 7 bit device addresses */
+#define I2C_ADDR_NUM       128
+
+int i2c_Init(const char* device);
+int i2c_Release();
+int i2c_Transfer(const rp_i2c_msg_t* msgs, uint32_t count);
+int i2c_ReadRegs(uint8_t addr, uint8_t reg, uint8_t* data, uint32_t len);
+int i2c_WriteRegs(uint8_t addr, uint8_t reg, const uint8_t* data, uint32_t len);
+int i2c_WriteRegList(uint8_t addr, const rp_i2c_reg_t* regs, uint32_t count);
+int i2c_SetCache(uint8_t addr, uint8_t first, uint32_t count);
+int i2c_InvalidateCache(uint8_t addr);
+
+#endif /* SRC_I2C_H_ */
@@ -31,9 +31,29 @@ static volatile uint32_t *osc_chb = NULL;
 
 int osc_Init()
 {
-    cmn_Map(OSC_BASE_SIZE, OSC_BASE_ADDR, (void**)&osc_reg);
+    int status = cmn_Map(OSC_BASE_SIZE, OSC_BASE_ADDR, (void**)&osc_reg);
     osc_cha = (uint32_t*)((char*)osc_reg + OSC_CHA_OFFSET);
     osc_chb = (uint32_t*)((char*)osc_reg + OSC_CHB_OFFSET);
+    if (status != RP_OK) {
+        return status;
+    }
+
+    // Configuration only, conf and trig_source are changed by the FPGA
+    cmn_ShadowAdd(&osc_reg->cha_thr);
+    cmn_ShadowAdd(&osc_reg->chb_thr);
+    cmn_ShadowAdd(&osc_reg->trigger_delay);
+    cmn_ShadowAdd(&osc_reg->data_dec);
+    cmn_ShadowAdd(&osc_reg->cha_hystersis);
+    cmn_ShadowAdd(&osc_reg->chb_hystersis);
+    cmn_ShadowAdd(&osc_reg->other);
+    cmn_ShadowAdd(&osc_reg->cha_filt_aa);
+    cmn_ShadowAdd(&osc_reg->cha_filt_bb);
+    cmn_ShadowAdd(&osc_reg->cha_filt_kk);
+    cmn_ShadowAdd(&osc_reg->cha_filt_pp);
+    cmn_ShadowAdd(&osc_reg->chb_filt_aa);
+    cmn_ShadowAdd(&osc_reg->chb_filt_bb);
+    cmn_ShadowAdd(&osc_reg->chb_filt_kk);
+    cmn_ShadowAdd(&osc_reg->chb_filt_pp);
     return RP_OK;
 }
 
@@ -72,7 +92,9 @@ int osc_SetAveraging(bool enable)
 
 int osc_GetAveraging(bool* enable)
 {
-    return cmn_AreBitsSet(osc_reg->other, 0x1, DATA_AVG_MASK, enable);
+    uint32_t other;
+    cmn_GetValue(&osc_reg->other, &other, 0xffffffff);
+    return cmn_AreBitsSet(other, 0x1, DATA_AVG_MASK, enable);
 }
 
 /**
@@ -14,6 +14,9 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "redpitaya/version.h"
 #include "common.h"
@@ -24,46 +27,235 @@
 #include "calib.h"
 #include "generate.h"
 #include "gen_handler.h"
+#include "sweep.h"
+#include "ai_buffer.h"
+#include "telemetry.h"
+#include "spi.h"
+#include "i2c.h"
 
 static char version[50];
 
+/*
+ * Every subsystem has its own lock, so a generator setting does not wait for an
+ * acquisition readout. Getters and data reads share the lock, settings and
+ * anything with a read-modify-write of the registers take it exclusively.
+ * No call holds more than one of them, except rp_Init(), rp_Release() and
+ * rp_GenSweep() and rp_GenAcqRun() which take them in the order acq, gen, hk.
+ */
+static pthread_rwlock_t acq_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_rwlock_t gen_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t  hk_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  ai_lock  = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * RP_INIT_* bits of the mapped subsystems. A subsystem rp_InitEx() did not map
+ * is mapped by its first call, which must not hold any of the locks. The bits
+ * are read without a lock and only change with all of them held.
+ */
+static uint32_t ready_mask = 0;
+static bool share_gen = false;
+
+/*
+ * Directions of all digital pins in rp_dpin_t bit order, LEDs always set. Read
+ * when the housekeeping is mapped and kept by the direction setters, so the
+ * state setters do not read the direction registers. A direction changed by
+ * another process is only seen after rp_DpinGetDirectionAll(). Under hk_lock.
+ */
+static uint32_t dpin_direction = 0;
+
+#define READY_acq_lock RP_INIT_ACQ
+#define READY_gen_lock RP_INIT_GEN
+
+#define READ_LOCKED(lock, call) ({ \
+    __typeof__(call) _ret = ready(READY_##lock); \
+    if (_ret == RP_OK) { \
+        pthread_rwlock_rdlock(&lock); \
+        stateLock(READY_##lock); \
+        _ret = (call); \
+        stateUnlock(READY_##lock, false); \
+        pthread_rwlock_unlock(&lock); \
+    } \
+    _ret; })
+
+#define WRITE_LOCKED(lock, call) ({ \
+    __typeof__(call) _ret = ready(READY_##lock); \
+    if (_ret == RP_OK) { \
+        pthread_rwlock_wrlock(&lock); \
+        stateLock(READY_##lock); \
+        _ret = (call); \
+        stateUnlock(READY_##lock, true); \
+        pthread_rwlock_unlock(&lock); \
+    } \
+    _ret; })
+
+/* The generator state may be shared with other processes, which have their own gen_lock */
+static inline void stateLock(uint32_t subsystem)
+{
+    if (subsystem == RP_INIT_GEN) {
+        gen_StateLock();
+    }
+}
+
+static inline void stateUnlock(uint32_t subsystem, bool changed)
+{
+    if (subsystem == RP_INIT_GEN) {
+        gen_StateUnlock(changed);
+    }
+}
+
+#define REQUIRE(flags) do { \
+    int _ret = ready(flags); \
+    if (_ret != RP_OK) \
+        return _ret; \
+    } while (0)
+
+static void lockAll()
+{
+    pthread_rwlock_wrlock(&acq_lock);
+    pthread_rwlock_wrlock(&gen_lock);
+    pthread_mutex_lock(&hk_lock);
+}
+
+static void unlockAll()
+{
+    pthread_mutex_unlock(&hk_lock);
+    pthread_rwlock_unlock(&gen_lock);
+    pthread_rwlock_unlock(&acq_lock);
+}
+
+static uint32_t dpinReadDirection()
+{
+    return (LED_CONTROL_MASK << RP_LED0)
+         | ((ioread32(&hk->ex_cd_p) & EX_CD_P_MASK) << RP_DIO0_P)
+         | ((ioread32(&hk->ex_cd_n) & EX_CD_N_MASK) << RP_DIO0_N);
+}
+
+/** Maps the subsystems in flags that are not yet, all locks held */
+static int initLocked(uint32_t flags)
+{
+    int ret;
+
+    // acquisition and generator convert with the calibration
+    if (flags & (RP_INIT_ACQ | RP_INIT_GEN)) {
+        flags |= RP_INIT_CALIB;
+    }
+    flags &= RP_INIT_ALL & ~ready_mask;
+    if (!flags) {
+        return RP_OK;
+    }
+    if ((ret = cmn_Init()) != RP_OK) {
+        return ret;
+    }
+    if (flags & RP_INIT_CALIB) {
+        calib_Init();
+        __atomic_or_fetch(&ready_mask, RP_INIT_CALIB, __ATOMIC_RELEASE);
+    }
+    if (flags & RP_INIT_HK) {
+        if ((ret = hk_Init()) != RP_OK || (ret = ams_Init()) != RP_OK) {
+            hk_Release();
+            return ret;
+        }
+        dpin_direction = dpinReadDirection();
+        __atomic_or_fetch(&ready_mask, RP_INIT_HK, __ATOMIC_RELEASE);
+    }
+    if (flags & RP_INIT_GEN) {
+        if ((ret = generate_Init()) != RP_OK) {
+            return ret;
+        }
+        if ((ret = gen_StateAttach(share_gen)) != RP_OK) {
+            generate_Release();
+            return ret;
+        }
+        __atomic_or_fetch(&ready_mask, RP_INIT_GEN, __ATOMIC_RELEASE);
+    }
+    if (flags & RP_INIT_ACQ) {
+        if ((ret = osc_Init()) != RP_OK) {
+            return ret;
+        }
+        __atomic_or_fetch(&ready_mask, RP_INIT_ACQ, __ATOMIC_RELEASE);
+    }
+    return RP_OK;
+}
+
+static int ready(uint32_t flags)
+{
+    if ((__atomic_load_n(&ready_mask, __ATOMIC_ACQUIRE) & flags) == flags) {
+        return RP_OK;
+    }
+    lockAll();
+    int ret = initLocked(flags);
+    unlockAll();
+    return ret;
+}
+
 /**
  * Global methods
  */
 
 int rp_Init()
 {
-    cmn_Init();
+    return rp_InitEx(RP_INIT_ALL | RP_INIT_RESET);
+}
 
-    calib_Init();
-    hk_Init();
-    ams_Init();
-    generate_Init();
-    osc_Init();
-    // TODO: Place other module initializations here
+int rp_InitEx(uint32_t flags)
+{
+    if (flags & RP_INIT_SHARED) {
+        share_gen = true;
+    }
+    int ret = ready(flags & RP_INIT_ALL);
+    if (ret != RP_OK) {
+        return ret;
+    }
 
     // Set default configuration per handler
-    rp_Reset();
-
+    if (flags & RP_INIT_RESET) {
+        if (flags & RP_INIT_HK) {
+            rp_DpinReset();
+            rp_AOpinReset();
+        }
+        if (flags & RP_INIT_GEN) {
+            rp_GenReset();
+        }
+        if (flags & RP_INIT_ACQ) {
+            rp_AcqReset();
+        }
+    }
     return RP_OK;
 }
 
 int rp_CalibInit()
 {
+    lockAll();
     calib_Init();
-
+    __atomic_or_fetch(&ready_mask, RP_INIT_CALIB, __ATOMIC_RELEASE);
+    unlockAll();
     return RP_OK;
 }
 
 int rp_Release()
 {
-    osc_Release();
-    generate_Release();
-    ams_Release();
-    hk_Release();
-    calib_Release();
+    rp_AIbufferStop();
+    telemetry_Release();
+    lockAll();
+    uint32_t mask = ready_mask;
+    if (mask & RP_INIT_ACQ) {
+        osc_Release();
+    }
+    if (mask & RP_INIT_GEN) {
+        gen_StateDetach();
+        generate_Release();
+    }
+    if (mask & RP_INIT_HK) {
+        ams_Release();
+        hk_Release();
+    }
+    if (mask & RP_INIT_CALIB) {
+        calib_Release();
+    }
     cmn_Release();
     // TODO: Place other module releasing here (in reverse order)
+    __atomic_store_n(&ready_mask, 0, __ATOMIC_RELEASE);
+    unlockAll();
     return RP_OK;
 }
 
@@ -108,6 +300,8 @@ const char* rp_GetError(int errorCode) {
         case RP_EABA:  return "Failed to acquire bus access";
         case RP_EFRB:  return "Failed to read from the bus";
         case RP_EFWB:  return "Failed to write to the bus";
+        case RP_ETIM:  return "Timeout";
+        case RP_EAM:   return "Failed to allocate memory";
         default:       return "Unknown error";
     }
 }
@@ -118,6 +312,7 @@ const char* rp_GetError(int errorCode) {
 
 rp_calib_params_t rp_GetCalibrationSettings()
 {
+    ready(RP_INIT_CALIB);
     return calib_GetParams();
 }
 
@@ -125,6 +320,10 @@ int rp_CalibrateFrontEndOffset(rp_channel_t channel, rp_pinState_t gain, rp_cali
     return calib_SetFrontEndOffset(channel, gain, out_params);
 }
 
+int rp_CalibrateFrontEndOffsets(rp_pinState_t gain, rp_calib_params_t* out_params) {
+    return calib_SetFrontEndOffsets(gain, out_params);
+}
+
 int rp_CalibrateFrontEndScaleLV(rp_channel_t channel, float referentialVoltage, rp_calib_params_t* out_params) {
     return calib_SetFrontEndScaleLV(channel, referentialVoltage, out_params);
 }
@@ -162,11 +361,13 @@ int rp_CalibrationWriteParams(rp_calib_params_t calib_params) {
  */
 
 int rp_IdGetID(uint32_t *id) {
+    REQUIRE(RP_INIT_HK);
     *id = ioread32(&hk->id);
     return RP_OK;
 }
 
 int rp_IdGetDNA(uint64_t *dna) {
+    REQUIRE(RP_INIT_HK);
     *dna = ((uint64_t) ioread32(&hk->dna_hi) << 32)
          | ((uint64_t) ioread32(&hk->dna_lo) <<  0);
     return RP_OK;
@@ -177,11 +378,13 @@ int rp_IdGetDNA(uint64_t *dna) {
  */
 
 int rp_LEDSetState(uint32_t state) {
+    REQUIRE(RP_INIT_HK);
     iowrite32(state, &hk->led_control);
     return RP_OK;
 }
 
 int rp_LEDGetState(uint32_t *state) {
+    REQUIRE(RP_INIT_HK);
     *state = ioread32(&hk->led_control);
     return RP_OK;
 }
@@ -191,41 +394,57 @@ int rp_LEDGetState(uint32_t *state) {
  */
 
 int rp_GPIOnSetDirection(uint32_t direction) {
+    REQUIRE(RP_INIT_HK);
+    pthread_mutex_lock(&hk_lock);
     iowrite32(direction, &hk->ex_cd_n);
+    dpin_direction = (dpin_direction & ~(EX_CD_N_MASK << RP_DIO0_N))
+                   | ((direction & EX_CD_N_MASK) << RP_DIO0_N);
+    pthread_mutex_unlock(&hk_lock);
     return RP_OK;
 }
 
 int rp_GPIOnGetDirection(uint32_t *direction) {
+    REQUIRE(RP_INIT_HK);
     *direction = ioread32(&hk->ex_cd_n);
     return RP_OK;
 }
 
 int rp_GPIOnSetState(uint32_t state) {
+    REQUIRE(RP_INIT_HK);
     iowrite32(state, &hk->ex_co_n);
     return RP_OK;
 }
 
 int rp_GPIOnGetState(uint32_t *state) {
+    REQUIRE(RP_INIT_HK);
     *state = ioread32(&hk->ex_ci_n);
     return RP_OK;
 }
 
 int rp_GPIOpSetDirection(uint32_t direction) {
+    REQUIRE(RP_INIT_HK);
+    pthread_mutex_lock(&hk_lock);
     iowrite32(direction, &hk->ex_cd_p);
+    dpin_direction = (dpin_direction & ~(EX_CD_P_MASK << RP_DIO0_P))
+                   | ((direction & EX_CD_P_MASK) << RP_DIO0_P);
+    pthread_mutex_unlock(&hk_lock);
     return RP_OK;
 }
 
 int rp_GPIOpGetDirection(uint32_t *direction) {
+    REQUIRE(RP_INIT_HK);
     *direction = ioread32(&hk->ex_cd_p);
     return RP_OK;
 }
 
 int rp_GPIOpSetState(uint32_t state) {
+    REQUIRE(RP_INIT_HK);
     iowrite32(state, &hk->ex_co_p);
     return RP_OK;
 }
 
 int rp_GPIOpGetState(uint32_t *state) {
+    REQUIRE(RP_INIT_HK);
     *state = ioread32(&hk->ex_ci_p);
     return RP_OK;
 }
@@ -235,36 +454,44 @@ int rp_GPIOpGetState(uint32_t *state) {
  */
 
 int rp_DpinReset() {
+    REQUIRE(RP_INIT_HK);
+    pthread_mutex_lock(&hk_lock);
     iowrite32(0, &hk->ex_cd_p);
     iowrite32(0, &hk->ex_cd_n);
     iowrite32(0, &hk->ex_co_p);
     iowrite32(0, &hk->ex_co_n);
     iowrite32(0, &hk->led_control);
     iowrite32(0, &hk->digital_loop);
+    dpin_direction = LED_CONTROL_MASK << RP_LED0;
+    pthread_mutex_unlock(&hk_lock);
     return RP_OK;
 }
 
 int rp_DpinSetDirection(rp_dpin_t pin, rp_pinDirection_t direction) {
+    REQUIRE(RP_INIT_HK);
     uint32_t tmp;
     if (pin < RP_DIO0_P) {
         // LEDS
         if (direction == RP_OUT)  return RP_OK;
         else                      return RP_ELID;
-    } else if (pin < RP_DIO0_N) {
+    }
+    pthread_mutex_lock(&hk_lock);
+    if (pin < RP_DIO0_N) {
         // DIO_P
-        pin -= RP_DIO0_P;
         tmp = ioread32(&hk->ex_cd_p);
-        iowrite32((tmp & ~(1 << pin)) | ((direction << pin) & (1 << pin)), &hk->ex_cd_p);
+        iowrite32((tmp & ~(1 << (pin - RP_DIO0_P))) | ((direction & 0x1) << (pin - RP_DIO0_P)), &hk->ex_cd_p);
     } else {
         // DIO_N
-        pin -= RP_DIO0_N;
         tmp = ioread32(&hk->ex_cd_n);
-        iowrite32((tmp & ~(1 << pin)) | ((direction << pin) & (1 << pin)), &hk->ex_cd_n);
+        iowrite32((tmp & ~(1 << (pin - RP_DIO0_N))) | ((direction & 0x1) << (pin - RP_DIO0_N)), &hk->ex_cd_n);
     }
+    dpin_direction = (dpin_direction & ~(1 << pin)) | ((direction & 0x1) << pin);
+    pthread_mutex_unlock(&hk_lock);
     return RP_OK;
 }
 
 int rp_DpinGetDirection(rp_dpin_t pin, rp_pinDirection_t* direction) {
+    REQUIRE(RP_INIT_HK);
     if (pin < RP_DIO0_P) {
         // LEDS
         *direction = RP_OUT;
@@ -281,10 +508,11 @@ int rp_DpinGetDirection(rp_dpin_t pin, rp_pinDirection_t* direction) {
 }
 
 int rp_DpinSetState(rp_dpin_t pin, rp_pinState_t state) {
+    REQUIRE(RP_INIT_HK);
     uint32_t tmp;
-    rp_pinDirection_t direction;
-    rp_DpinGetDirection(pin, &direction);
-    if (!direction) {
+    pthread_mutex_lock(&hk_lock);
+    if (!((dpin_direction >> pin) & 0x1)) {
+        pthread_mutex_unlock(&hk_lock);
         return RP_EWIP;
     }
     if (pin < RP_DIO0_P) {
@@ -302,10 +530,12 @@ int rp_DpinSetState(rp_dpin_t pin, rp_pinState_t state) {
         tmp = ioread32(&hk->ex_co_n);
         iowrite32((tmp & ~(1 << pin)) | ((state << pin) & (1 << pin)), &hk->ex_co_n);
     }
+    pthread_mutex_unlock(&hk_lock);
     return RP_OK;
 }
 
 int rp_DpinGetState(rp_dpin_t pin, rp_pinState_t* state) {
+    REQUIRE(RP_INIT_HK);
     if (pin < RP_DIO0_P) {
         // LEDS
         *state = (ioread32(&hk->led_control) >> pin) & 0x1;
@@ -321,12 +551,88 @@ int rp_DpinGetState(rp_dpin_t pin, rp_pinState_t* state) {
     return RP_OK;
 }
 
+int rp_DpinGetStateAll(uint32_t* state) {
+    REQUIRE(RP_INIT_HK);
+    *state = ((ioread32(&hk->led_control) & LED_CONTROL_MASK) << RP_LED0)
+           | ((ioread32(&hk->ex_ci_p)     & EX_CI_P_MASK)     << RP_DIO0_P)
+           | ((ioread32(&hk->ex_ci_n)     & EX_CI_N_MASK)     << RP_DIO0_N);
+    return RP_OK;
+}
+
+int rp_DpinGetStateMask(uint32_t mask, uint32_t* state) {
+    REQUIRE(RP_INIT_HK);
+    if (mask >> (RP_DIO7_N + 1)) {
+        return RP_EPN;
+    }
+    *state = 0;
+    if ((mask >> RP_LED0) & LED_CONTROL_MASK) {
+        *state |= (ioread32(&hk->led_control) & LED_CONTROL_MASK) << RP_LED0;
+    }
+    if ((mask >> RP_DIO0_P) & EX_CI_P_MASK) {
+        *state |= (ioread32(&hk->ex_ci_p) & EX_CI_P_MASK) << RP_DIO0_P;
+    }
+    if ((mask >> RP_DIO0_N) & EX_CI_N_MASK) {
+        *state |= (ioread32(&hk->ex_ci_n) & EX_CI_N_MASK) << RP_DIO0_N;
+    }
+    *state &= mask;
+    return RP_OK;
+}
+
+int rp_DpinGetDirectionAll(uint32_t* direction) {
+    REQUIRE(RP_INIT_HK);
+    pthread_mutex_lock(&hk_lock);
+    dpin_direction = dpinReadDirection();
+    *direction = dpin_direction;
+    pthread_mutex_unlock(&hk_lock);
+    return RP_OK;
+}
+
+static void dpinUpdateBank(volatile uint32_t *reg, uint32_t mask, uint32_t state) {
+    if (mask) {
+        iowrite32((ioread32(reg) & ~mask) | (state & mask), reg);
+    }
+}
+
+int rp_DpinSetStateMask(uint32_t mask, uint32_t state) {
+    REQUIRE(RP_INIT_HK);
+    if (mask >> (RP_DIO7_N + 1)) {
+        return RP_EPN;
+    }
+    pthread_mutex_lock(&hk_lock);
+    if (mask & ~dpin_direction) {
+        pthread_mutex_unlock(&hk_lock);
+        return RP_EWIP;
+    }
+    dpinUpdateBank(&hk->led_control, (mask >> RP_LED0)   & LED_CONTROL_MASK, state >> RP_LED0);
+    dpinUpdateBank(&hk->ex_co_p,     (mask >> RP_DIO0_P) & EX_CO_P_MASK,     state >> RP_DIO0_P);
+    dpinUpdateBank(&hk->ex_co_n,     (mask >> RP_DIO0_N) & EX_CO_N_MASK,     state >> RP_DIO0_N);
+    pthread_mutex_unlock(&hk_lock);
+    return RP_OK;
+}
+
+int rp_DpinSetDirectionMask(uint32_t mask, uint32_t direction) {
+    REQUIRE(RP_INIT_HK);
+    if (mask >> (RP_DIO7_N + 1)) {
+        return RP_EPN;
+    }
+    if (mask & ~direction & (LED_CONTROL_MASK << RP_LED0)) {
+        return RP_ELID;
+    }
+    pthread_mutex_lock(&hk_lock);
+    dpinUpdateBank(&hk->ex_cd_p, (mask >> RP_DIO0_P) & EX_CD_P_MASK, direction >> RP_DIO0_P);
+    dpinUpdateBank(&hk->ex_cd_n, (mask >> RP_DIO0_N) & EX_CD_N_MASK, direction >> RP_DIO0_N);
+    dpin_direction = (dpin_direction & ~mask) | (direction & mask);
+    pthread_mutex_unlock(&hk_lock);
+    return RP_OK;
+}
+
 
 /**
  * Digital loop
  */
 
 int rp_EnableDigitalLoop(bool enable) {
+    REQUIRE(RP_INIT_HK);
     iowrite32((uint32_t) enable, &hk->digital_loop);
     return RP_OK;
 }
@@ -397,12 +703,34 @@ int rp_ApinGetRange(rp_apin_t pin, float* min_val, float* max_val) {
     return RP_OK;
 }
 
+int rp_ApinGetValueAll(float* values) {
+    for (int unsigned pin = 0; pin < 4; pin++) {
+        rp_AOpinGetValue(pin, &values[RP_AOUT0 + pin]);
+    }
+    for (int unsigned pin = 0; pin < 4; pin++) {
+        int result = rp_AIpinGetValue(pin, &values[RP_AIN0 + pin]);
+        if (result != RP_OK) {
+            return result;
+        }
+    }
+    return RP_OK;
+}
+
 
 /**
  * Analog Inputs
  */
 
 int rp_AIpinGetValueRaw(int unsigned pin, uint32_t* value) {
+    // the driver refuses single conversions while the buffer runs
+    pthread_mutex_lock(&ai_lock);
+    if (ai_BufferRunning()) {
+        int ret = ai_BufferLatest(pin, value);
+        pthread_mutex_unlock(&ai_lock);
+        return ret;
+    }
+    pthread_mutex_unlock(&ai_lock);
+
     FILE *fp;
     switch (pin) {
         case 0:  fp = fopen ("/sys/devices/soc0/amba_pl/83c00000.xadc_wiz/iio:device1/in_voltage11_vaux8_raw", "r");  break;
@@ -424,6 +752,38 @@ int rp_AIpinGetValue(int unsigned pin, float* value) {
     return result;
 }
 
+int rp_AIbufferStart(float rate, uint32_t length, float* actual_rate) {
+    pthread_mutex_lock(&ai_lock);
+    int ret = ai_BufferStart(rate, length, actual_rate);
+    pthread_mutex_unlock(&ai_lock);
+    return ret;
+}
+
+int rp_AIbufferStop() {
+    pthread_mutex_lock(&ai_lock);
+    int ret = ai_BufferStop();
+    pthread_mutex_unlock(&ai_lock);
+    return ret;
+}
+
+int rp_AIbufferReadRaw(uint16_t* raw, uint32_t max_scans, uint32_t* scans, uint32_t timeout_ms) {
+    pthread_mutex_lock(&ai_lock);
+    int ret = ai_BufferRead(raw, max_scans, scans, timeout_ms);
+    pthread_mutex_unlock(&ai_lock);
+    return ret;
+}
+
+int rp_AIbufferRead(float* values, uint32_t max_scans, uint32_t* scans, uint32_t timeout_ms) {
+    // the raw values go to the upper half of the caller's buffer and are
+    // expanded front to back, so no scratch buffer is needed
+    uint16_t* raw = (uint16_t*) (values + max_scans * AI_PIN_NUM) - max_scans * AI_PIN_NUM;
+    int ret = rp_AIbufferReadRaw(raw, max_scans, scans, timeout_ms);
+    for (uint32_t i = 0; ret == RP_OK && i < *scans * AI_PIN_NUM; i++) {
+        values[i] = (((float)raw[i] / ANALOG_IN_MAX_VAL_INTEGER) * (ANALOG_IN_MAX_VAL - ANALOG_IN_MIN_VAL)) + ANALOG_IN_MIN_VAL;
+    }
+    return ret;
+}
+
 
 /**
  * Analog Outputs
@@ -437,6 +797,7 @@ int rp_AOpinReset() {
 }
 
 int rp_AOpinSetValueRaw(int unsigned pin, uint32_t value) {
+    REQUIRE(RP_INIT_HK);
     if (pin >= 4) {
         return RP_EPN;
     }
@@ -453,6 +814,7 @@ int rp_AOpinSetValue(int unsigned pin, float value) {
 }
 
 int rp_AOpinGetValueRaw(int unsigned pin, uint32_t* value) {
+    REQUIRE(RP_INIT_HK);
     if (pin >= 4) {
         return RP_EPN;
     }
@@ -480,145 +842,150 @@ int rp_AOpinGetRange(int unsigned pin, float* min_val,  float* max_val) {
 
 int rp_AcqSetArmKeep(bool enable)
 {
-    return acq_SetArmKeep(enable);
+    return WRITE_LOCKED(acq_lock, acq_SetArmKeep(enable));
 }
 
 int rp_AcqSetDecimation(rp_acq_decimation_t decimation)
 {
-    return acq_SetDecimation(decimation);
+    return WRITE_LOCKED(acq_lock, acq_SetDecimation(decimation));
 }
 
 int rp_AcqGetDecimation(rp_acq_decimation_t* decimation)
 {
-    return acq_GetDecimation(decimation);
+    return READ_LOCKED(acq_lock, acq_GetDecimation(decimation));
 }
 
 int rp_AcqGetDecimationFactor(uint32_t* decimation)
 {
-    return acq_GetDecimationFactor(decimation);
+    return READ_LOCKED(acq_lock, acq_GetDecimationFactor(decimation));
 }
 
 int rp_AcqSetSamplingRate(rp_acq_sampling_rate_t sampling_rate)
 {
-    return acq_SetSamplingRate(sampling_rate);
+    return WRITE_LOCKED(acq_lock, acq_SetSamplingRate(sampling_rate));
 }
 
 int rp_AcqGetSamplingRate(rp_acq_sampling_rate_t* sampling_rate)
 {
-    return acq_GetSamplingRate(sampling_rate);
+    return READ_LOCKED(acq_lock, acq_GetSamplingRate(sampling_rate));
 }
 
 int rp_AcqGetSamplingRateHz(float* sampling_rate)
 {
-    return acq_GetSamplingRateHz(sampling_rate);
+    return READ_LOCKED(acq_lock, acq_GetSamplingRateHz(sampling_rate));
 }
 
 int rp_AcqSetAveraging(bool enabled)
 {
-    return acq_SetAveraging(enabled);
+    return WRITE_LOCKED(acq_lock, acq_SetAveraging(enabled));
 }
 
 int rp_AcqGetAveraging(bool *enabled)
 {
-    return acq_GetAveraging(enabled);
+    return READ_LOCKED(acq_lock, acq_GetAveraging(enabled));
 }
 
 int rp_AcqSetTriggerSrc(rp_acq_trig_src_t source)
 {
-    return acq_SetTriggerSrc(source);
+    return WRITE_LOCKED(acq_lock, acq_SetTriggerSrc(source));
 }
 
 int rp_AcqGetTriggerSrc(rp_acq_trig_src_t* source)
 {
-    return acq_GetTriggerSrc(source);
+    return READ_LOCKED(acq_lock, acq_GetTriggerSrc(source));
 }
 
 int rp_AcqGetTriggerState(rp_acq_trig_state_t* state)
 {
-    return acq_GetTriggerState(state);
+    return READ_LOCKED(acq_lock, acq_GetTriggerState(state));
 }
 
 int rp_AcqSetTriggerDelay(int32_t decimated_data_num)
 {
-    return acq_SetTriggerDelay(decimated_data_num, false);
+    return WRITE_LOCKED(acq_lock, acq_SetTriggerDelay(decimated_data_num, false));
 }
 
 int rp_AcqGetTriggerDelay(int32_t* decimated_data_num)
 {
-    return acq_GetTriggerDelay(decimated_data_num);
+    return READ_LOCKED(acq_lock, acq_GetTriggerDelay(decimated_data_num));
 }
 
 int rp_AcqSetTriggerDelayNs(int64_t time_ns)
 {
-    return acq_SetTriggerDelayNs(time_ns, false);
+    return WRITE_LOCKED(acq_lock, acq_SetTriggerDelayNs(time_ns, false));
 }
 
 int rp_AcqGetTriggerDelayNs(int64_t* time_ns)
 {
-    return acq_GetTriggerDelayNs(time_ns);
+    return READ_LOCKED(acq_lock, acq_GetTriggerDelayNs(time_ns));
 }
 
 int rp_AcqGetPreTriggerCounter(uint32_t* value) {
-    return acq_GetPreTriggerCounter(value);
+    return READ_LOCKED(acq_lock, acq_GetPreTriggerCounter(value));
 }
 
 int rp_AcqGetGain(rp_channel_t channel, rp_pinState_t* state)
 {
-    return acq_GetGain(channel, state);
+    return READ_LOCKED(acq_lock, acq_GetGain(channel, state));
 }
 
 int rp_AcqGetGainV(rp_channel_t channel, float* voltage)
 {
-    return acq_GetGainV(channel, voltage);
+    return READ_LOCKED(acq_lock, acq_GetGainV(channel, voltage));
 }
 
 int rp_AcqSetGain(rp_channel_t channel, rp_pinState_t state)
 {
-    return acq_SetGain(channel, state);
+    return WRITE_LOCKED(acq_lock, acq_SetGain(channel, state));
 }
 
 int rp_AcqGetTriggerLevel(float* voltage)
 {
-    return acq_GetTriggerLevel(voltage);
+    return READ_LOCKED(acq_lock, acq_GetTriggerLevel(voltage));
 }
 
 int rp_AcqSetTriggerLevel(rp_channel_t channel, float voltage)
 {
-    return acq_SetTriggerLevel(channel, voltage);
+    return WRITE_LOCKED(acq_lock, acq_SetTriggerLevel(channel, voltage));
 }
 
 int rp_AcqGetTriggerHyst(float* voltage)
 {
-    return acq_GetTriggerHyst(voltage);
+    return READ_LOCKED(acq_lock, acq_GetTriggerHyst(voltage));
 }
 
 int rp_AcqSetTriggerHyst(float voltage)
 {
-    return acq_SetTriggerHyst(voltage);
+    return WRITE_LOCKED(acq_lock, acq_SetTriggerHyst(voltage));
 }
 
 int rp_AcqGetWritePointer(uint32_t* pos)
 {
-    return acq_GetWritePointer(pos);
+    return READ_LOCKED(acq_lock, acq_GetWritePointer(pos));
 }
 
 int rp_AcqGetWritePointerAtTrig(uint32_t* pos)
 {
-    return acq_GetWritePointerAtTrig(pos);
+    return READ_LOCKED(acq_lock, acq_GetWritePointerAtTrig(pos));
+}
+
+int rp_AcqGetWritePointerAtTrigTime(uint32_t* pos, rp_timestamp_t* time)
+{
+    return READ_LOCKED(acq_lock, acq_GetWritePointerAtTrigTime(pos, time));
 }
 
 int rp_AcqStart()
 {
-    return acq_Start();
+    return WRITE_LOCKED(acq_lock, acq_Start());
 }
 
 int rp_AcqStop()
 {
-    return acq_Stop();
+    return WRITE_LOCKED(acq_lock, acq_Stop());
 }
 int rp_AcqReset()
 {
-    return acq_Reset();
+    return WRITE_LOCKED(acq_lock, acq_Reset());
 }
 
 uint32_t rp_AcqGetNormalizedDataPos(uint32_t pos)
@@ -628,56 +995,101 @@ uint32_t rp_AcqGetNormalizedDataPos(uint32_t pos)
 
 int rp_AcqGetDataPosRaw(rp_channel_t channel, uint32_t start_pos, uint32_t end_pos, int16_t* buffer, uint32_t* buffer_size)
 {
-    return acq_GetDataPosRaw(channel, start_pos, end_pos, buffer, buffer_size);
+    return READ_LOCKED(acq_lock, acq_GetDataPosRaw(channel, start_pos, end_pos, buffer, buffer_size));
 }
 
 int rp_AcqGetDataPosV(rp_channel_t channel, uint32_t start_pos, uint32_t end_pos, float* buffer, uint32_t* buffer_size)
 {
-    return acq_GetDataPosV(channel, start_pos, end_pos, buffer, buffer_size);
+    return READ_LOCKED(acq_lock, acq_GetDataPosV(channel, start_pos, end_pos, buffer, buffer_size));
 }
 
 int rp_AcqGetDataRaw(rp_channel_t channel,  uint32_t pos, uint32_t* size, int16_t* buffer)
 {
-    return acq_GetDataRaw(channel, pos, size, buffer);
+    return READ_LOCKED(acq_lock, acq_GetDataRaw(channel, pos, size, buffer));
+}
+
+int rp_AcqGetRawBufferView(rp_channel_t channel, rp_acq_raw_view_t* view)
+{
+    return READ_LOCKED(acq_lock, acq_GetRawBufferView(channel, view));
 }
 
 int rp_AcqGetDataRawV2(uint32_t pos, uint32_t* size, uint16_t* buffer, uint16_t* buffer2)
 {
-    return acq_GetDataRawV2(pos, size, buffer, buffer2);
+    return READ_LOCKED(acq_lock, acq_GetDataRawV2(pos, size, buffer, buffer2));
 }
 
 int rp_AcqGetOldestDataRaw(rp_channel_t channel, uint32_t* size, int16_t* buffer)
 {
-    return acq_GetOldestDataRaw(channel, size, buffer);
+    return READ_LOCKED(acq_lock, acq_GetOldestDataRaw(channel, size, buffer));
 }
 
 int rp_AcqGetLatestDataRaw(rp_channel_t channel, uint32_t* size, int16_t* buffer)
 {
-    return acq_GetLatestDataRaw(channel, size, buffer);
+    return READ_LOCKED(acq_lock, acq_GetLatestDataRaw(channel, size, buffer));
 }
 
 int rp_AcqGetDataV(rp_channel_t channel, uint32_t pos, uint32_t* size, float* buffer)
 {
-    return acq_GetDataV(channel, pos, size, buffer);
+    return READ_LOCKED(acq_lock, acq_GetDataV(channel, pos, size, buffer));
 }
 
 int rp_AcqGetDataV2(uint32_t pos, uint32_t* size, float* buffer1, float* buffer2)
 {
-    return acq_GetDataV2(pos, size, buffer1, buffer2);
+    return READ_LOCKED(acq_lock, acq_GetDataV2(pos, size, buffer1, buffer2));
+}
+
+int rp_AcqPrepareReadout(rp_acq_readout_t* readout)
+{
+    return READ_LOCKED(acq_lock, acq_PrepareReadout(readout));
+}
+
+int rp_AcqGetDataVPrepared(rp_acq_readout_t* readout, uint32_t pos, uint32_t* size, float* buffer1, float* buffer2)
+{
+    return READ_LOCKED(acq_lock, acq_GetDataVPrepared(readout, pos, size, buffer1, buffer2));
+}
+
+int rp_AcqGetDataVBinned(rp_channel_t channel, uint32_t pos, uint32_t size, rp_acq_bin_mode_t mode, uint32_t bins, float* buffer1, float* buffer2)
+{
+    return READ_LOCKED(acq_lock, acq_GetDataVBinned(channel, pos, size, mode, bins, buffer1, buffer2));
+}
+
+int rp_AcqCaptureRecords(uint32_t records, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* info, uint32_t timeout_ms, uint32_t* captured)
+{
+    return WRITE_LOCKED(acq_lock, acq_CaptureRecords(records, record_size, pre_trigger, buffer1, buffer2, info, timeout_ms, captured));
+}
+
+int rp_AcqCaptureAverage(uint32_t records, uint32_t record_size, uint32_t pre_trigger, float* buffer1, float* buffer2, uint32_t timeout_ms, uint32_t* averaged)
+{
+    return WRITE_LOCKED(acq_lock, acq_CaptureAverage(records, record_size, pre_trigger, buffer1, buffer2, timeout_ms, averaged));
+}
+
+int rp_AcqWaitTrigger(uint32_t timeout_ms)
+{
+    return acq_WaitTrigger(timeout_ms);
+}
+
+int rp_AcqGetTriggerFd(int* fd)
+{
+    return acq_GetTriggerFd(fd);
+}
+
+int rp_GetTimeBase(rp_time_base_t* base)
+{
+    return cmn_GetTimeBase(base);
 }
 
 int rp_AcqGetOldestDataV(rp_channel_t channel, uint32_t* size, float* buffer)
 {
-    return acq_GetOldestDataV(channel, size, buffer);
+    return READ_LOCKED(acq_lock, acq_GetOldestDataV(channel, size, buffer));
 }
 
 int rp_AcqGetLatestDataV(rp_channel_t channel, uint32_t* size, float* buffer)
 {
-    return acq_GetLatestDataV(channel, size, buffer);
+    return READ_LOCKED(acq_lock, acq_GetLatestDataV(channel, size, buffer));
 }
 
 int rp_AcqGetBufSize(uint32_t *size) {
-    return acq_GetBufferSize(size);
+    return READ_LOCKED(acq_lock, acq_GetBufferSize(size));
 }
 
 /**
@@ -685,119 +1097,305 @@ int rp_AcqGetBufSize(uint32_t *size) {
 */
 
 int rp_GenReset() {
-    return gen_SetDefaultValues();
+    return WRITE_LOCKED(gen_lock, gen_SetDefaultValues());
 }
 
 int rp_GenOutDisable(rp_channel_t channel) {
-    return gen_Disable(channel);
+    return WRITE_LOCKED(gen_lock, gen_Disable(channel));
 }
 
 int rp_GenOutEnable(rp_channel_t channel) {
-    return gen_Enable(channel);
+    return WRITE_LOCKED(gen_lock, gen_Enable(channel));
 }
 
 int rp_GenOutIsEnabled(rp_channel_t channel, bool *value) {
-    return gen_IsEnable(channel, value);
+    return READ_LOCKED(gen_lock, gen_IsEnable(channel, value));
 }
 
 int rp_GenAmp(rp_channel_t channel, float amplitude) {
-    return gen_setAmplitude(channel, amplitude);
+    return WRITE_LOCKED(gen_lock, gen_setAmplitude(channel, amplitude));
 }
 
 int rp_GenGetAmp(rp_channel_t channel, float *amplitude) {
-    return gen_getAmplitude(channel, amplitude);
+    return READ_LOCKED(gen_lock, gen_getAmplitude(channel, amplitude));
 }
 
 int rp_GenOffset(rp_channel_t channel, float offset) {
-    return gen_setOffset(channel, offset);
+    return WRITE_LOCKED(gen_lock, gen_setOffset(channel, offset));
 }
 
 int rp_GenGetOffset(rp_channel_t channel, float *offset) {
-    return gen_getOffset(channel, offset);
+    return READ_LOCKED(gen_lock, gen_getOffset(channel, offset));
 }
 
 int rp_GenFreq(rp_channel_t channel, float frequency) {
-    return gen_setFrequency(channel, frequency);
+    return WRITE_LOCKED(gen_lock, gen_setFrequency(channel, frequency));
 }
 
 int rp_GenGetFreq(rp_channel_t channel, float *frequency) {
-    return gen_getFrequency(channel, frequency);
+    return READ_LOCKED(gen_lock, gen_getFrequency(channel, frequency));
 }
 
 int rp_GenPhase(rp_channel_t channel, float phase) {
-    return gen_setPhase(channel, phase);
+    return WRITE_LOCKED(gen_lock, gen_setPhase(channel, phase));
 }
 
 int rp_GenGetPhase(rp_channel_t channel, float *phase) {
-    return gen_getPhase(channel, phase);
+    return READ_LOCKED(gen_lock, gen_getPhase(channel, phase));
 }
 
 int rp_GenWaveform(rp_channel_t channel, rp_waveform_t type) {
-    return gen_setWaveform(channel, type);
+    return WRITE_LOCKED(gen_lock, gen_setWaveform(channel, type));
 }
 
 int rp_GenGetWaveform(rp_channel_t channel, rp_waveform_t *type) {
-    return gen_getWaveform(channel, type);
+    return READ_LOCKED(gen_lock, gen_getWaveform(channel, type));
 }
 
 int rp_GenArbWaveform(rp_channel_t channel, float *waveform, uint32_t length) {
-    return gen_setArbWaveform(channel, waveform, length);
+    return WRITE_LOCKED(gen_lock, gen_setArbWaveform(channel, waveform, length));
+}
+
+int rp_GenArbWaveformRaw(rp_channel_t channel, const int16_t *waveform, uint32_t length) {
+    return WRITE_LOCKED(gen_lock, gen_setArbWaveformRaw(channel, waveform, length));
+}
+
+int rp_GenArbWaveformUpdate(rp_channel_t channel, float *waveform, uint32_t length) {
+    return WRITE_LOCKED(gen_lock, gen_updateArbWaveform(channel, waveform, length));
 }
 
 int rp_GenGetArbWaveform(rp_channel_t channel, float *waveform, uint32_t *length) {
-    return gen_getArbWaveform(channel, waveform, length);
+    return READ_LOCKED(gen_lock, gen_getArbWaveform(channel, waveform, length));
+}
+
+int rp_GenSequence(rp_channel_t channel, const float *table, uint32_t table_length,
+                   const rp_gen_seq_entry_t *entries, uint32_t count, float sample_rate) {
+    return WRITE_LOCKED(gen_lock, gen_setSequence(channel, table, table_length, entries, count, sample_rate));
 }
 
 int rp_GenDutyCycle(rp_channel_t channel, float ratio) {
-    return gen_setDutyCycle(channel, ratio);
+    return WRITE_LOCKED(gen_lock, gen_setDutyCycle(channel, ratio));
 }
 
 int rp_GenGetDutyCycle(rp_channel_t channel, float *ratio) {
-    return gen_getDutyCycle(channel, ratio);
+    return READ_LOCKED(gen_lock, gen_getDutyCycle(channel, ratio));
 }
 
 int rp_GenMode(rp_channel_t channel, rp_gen_mode_t mode) {
-    return gen_setGenMode(channel, mode);
+    return WRITE_LOCKED(gen_lock, gen_setGenMode(channel, mode));
 }
 
 int rp_GenGetMode(rp_channel_t channel, rp_gen_mode_t *mode) {
-    return gen_getGenMode(channel, mode);
+    return READ_LOCKED(gen_lock, gen_getGenMode(channel, mode));
 }
 
 int rp_GenBurstCount(rp_channel_t channel, int num) {
-    return gen_setBurstCount(channel, num);
+    return WRITE_LOCKED(gen_lock, gen_setBurstCount(channel, num));
 }
 
 int rp_GenGetBurstCount(rp_channel_t channel, int *num) {
-    return gen_getBurstCount(channel, num);
+    return READ_LOCKED(gen_lock, gen_getBurstCount(channel, num));
 }
 
 int rp_GenBurstRepetitions(rp_channel_t channel, int repetitions) {
-    return gen_setBurstRepetitions(channel, repetitions);
+    return WRITE_LOCKED(gen_lock, gen_setBurstRepetitions(channel, repetitions));
 }
 
 int rp_GenGetBurstRepetitions(rp_channel_t channel, int *repetitions) {
-    return gen_getBurstRepetitions(channel, repetitions);
+    return READ_LOCKED(gen_lock, gen_getBurstRepetitions(channel, repetitions));
 }
 
 int rp_GenBurstPeriod(rp_channel_t channel, uint32_t period) {
-    return gen_setBurstPeriod(channel, period);
+    return WRITE_LOCKED(gen_lock, gen_setBurstPeriod(channel, period));
 }
 
 int rp_GenGetBurstPeriod(rp_channel_t channel, uint32_t *period) {
-    return gen_getBurstPeriod(channel, period);
+    return READ_LOCKED(gen_lock, gen_getBurstPeriod(channel, period));
 }
 
 int rp_GenTriggerSource(rp_channel_t channel, rp_trig_src_t src) {
-    return gen_setTriggerSource(channel, src);
+    return WRITE_LOCKED(gen_lock, gen_setTriggerSource(channel, src));
 }
 
 int rp_GenGetTriggerSource(rp_channel_t channel, rp_trig_src_t *src) {
-    return gen_getTriggerSource(channel, src);
+    return READ_LOCKED(gen_lock, gen_getTriggerSource(channel, src));
 }
 
 int rp_GenTrigger(uint32_t channel) {
-    return gen_Trigger(channel);
+    return WRITE_LOCKED(gen_lock, gen_Trigger(channel));
+}
+
+int rp_GenSweep(const rp_sweep_t* sweep, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_sweep_point_t* points, uint32_t timeout_ms, uint32_t* done) {
+    REQUIRE(RP_INIT_ACQ | RP_INIT_GEN);
+    pthread_rwlock_wrlock(&acq_lock);
+    pthread_rwlock_wrlock(&gen_lock);
+    gen_StateLock();
+    int ret = sweep_Run(sweep, record_size, pre_trigger, buffer1, buffer2, points, timeout_ms, done);
+    gen_StateUnlock(true);
+    pthread_rwlock_unlock(&gen_lock);
+    pthread_rwlock_unlock(&acq_lock);
+    return ret;
+}
+
+int rp_GenAcqRun(rp_channel_t channel, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* record, uint32_t timeout_ms) {
+    REQUIRE(RP_INIT_ACQ | RP_INIT_GEN);
+    pthread_rwlock_wrlock(&acq_lock);
+    pthread_rwlock_wrlock(&gen_lock);
+    gen_StateLock();
+    int ret = sweep_GenAcqRun(channel, record_size, pre_trigger, buffer1, buffer2, record, timeout_ms);
+    gen_StateUnlock(true);
+    pthread_rwlock_unlock(&gen_lock);
+    pthread_rwlock_unlock(&acq_lock);
+    return ret;
+}
+
+int rp_SetEnableTempProtection(rp_channel_t channel, bool enable) {
+    return WRITE_LOCKED(gen_lock, gen_setEnableTempProtection(channel, enable));
+}
+
+int rp_GetEnableTempProtection(rp_channel_t channel, bool *enable) {
+    return READ_LOCKED(gen_lock, gen_getEnableTempProtection(channel, enable));
+}
+
+int rp_SetLatchTempAlarm(rp_channel_t channel, bool status) {
+    return WRITE_LOCKED(gen_lock, gen_setLatchTempAlarm(channel, status));
+}
+
+int rp_GetLatchTempAlarm(rp_channel_t channel, bool *status) {
+    return READ_LOCKED(gen_lock, gen_getLatchTempAlarm(channel, status));
+}
+
+int rp_GetRuntimeTempAlarm(rp_channel_t channel, bool *status) {
+    return READ_LOCKED(gen_lock, gen_getRuntimeTempAlarm(channel, status));
+}
+
+
+/**
+ * Telemetry
+ */
+
+/* RP_NOTS on boards without the DAC temperature alarms */
+static int telemetryAlarms(rp_telemetry_t *t) {
+    int ret = RP_OK;
+    for (int ch = 0; ret == RP_OK && ch < 2; ch++) {
+        rp_channel_t channel = ch == 0 ? RP_CH_1 : RP_CH_2;
+        if ((ret = gen_getRuntimeTempAlarm(channel, &t->runtime_alarm[ch])) == RP_OK) {
+            ret = gen_getLatchTempAlarm(channel, &t->latch_alarm[ch]);
+        }
+    }
+    return ret;
+}
+
+int rp_TelemetryUpdate() {
+    REQUIRE(RP_INIT_HK | RP_INIT_GEN);
+    rp_telemetry_t t;
+    struct timespec now;
+    int ret;
+
+    memset(&t, 0, sizeof(t));
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    t.time_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if ((ret = telemetry_ReadXadc(&t)) != RP_OK) {
+        return ret;
+    }
+    for (int unsigned pin = 0; pin < AI_PIN_NUM; pin++) {
+        if ((ret = rp_AIpinGetValue(pin, &t.ain[pin])) != RP_OK) {
+            return ret;
+        }
+    }
+    t.alarms = READ_LOCKED(gen_lock, telemetryAlarms(&t)) == RP_OK;
+    if (!t.alarms) {
+        memset(t.runtime_alarm, 0, sizeof(t.runtime_alarm));
+        memset(t.latch_alarm, 0, sizeof(t.latch_alarm));
+    }
+    return telemetry_Publish(&t);
+}
+
+int rp_TelemetryRead(rp_telemetry_t *telemetry) {
+    return telemetry_Read(telemetry);
+}
+
+int rp_RegStatsGet(rp_reg_stats_t* stats, uint32_t* count) {
+    if (count == NULL || (stats == NULL && *count > 0)) {
+        return RP_UIA;
+    }
+    return cmn_RegStatsGet(stats, count);
+}
+
+int rp_RegStatsReset() {
+    return cmn_RegStatsReset();
+}
+
+int rp_SpiInit(const char *device) {
+    return spi_Init(device);
+}
+
+int rp_SpiRelease() {
+    return spi_Release();
+}
+
+int rp_SpiSetMode(uint32_t mode) {
+    return spi_SetMode(mode);
+}
+
+int rp_SpiGetMode(uint32_t *mode) {
+    return spi_GetMode(mode);
+}
+
+int rp_SpiSetSpeed(uint32_t speed_hz) {
+    return spi_SetSpeed(speed_hz);
+}
+
+int rp_SpiGetSpeed(uint32_t *speed_hz) {
+    return spi_GetSpeed(speed_hz);
+}
+
+int rp_SpiSetBitsPerWord(uint8_t bits) {
+    return spi_SetBitsPerWord(bits);
+}
+
+int rp_SpiGetBitsPerWord(uint8_t *bits) {
+    return spi_GetBitsPerWord(bits);
+}
+
+int rp_SpiGetMaxMessage(uint32_t *bytes) {
+    return spi_GetMaxMessage(bytes);
+}
+
+int rp_SpiTransfer(const rp_spi_xfer_t *xfers, uint32_t count) {
+    return spi_Transfer(xfers, count);
+}
+
+int rp_I2cInit(const char *device) {
+    return i2c_Init(device);
+}
+
+int rp_I2cRelease() {
+    return i2c_Release();
+}
+
+int rp_I2cTransfer(const rp_i2c_msg_t *msgs, uint32_t count) {
+    return i2c_Transfer(msgs, count);
+}
+
+int rp_I2cReadRegs(uint8_t addr, uint8_t reg, uint8_t *data, uint32_t len) {
+    return i2c_ReadRegs(addr, reg, data, len);
+}
+
+int rp_I2cWriteRegs(uint8_t addr, uint8_t reg, const uint8_t *data, uint32_t len) {
+    return i2c_WriteRegs(addr, reg, data, len);
+}
+
+int rp_I2cWriteRegList(uint8_t addr, const rp_i2c_reg_t *regs, uint32_t count) {
+    return i2c_WriteRegList(addr, regs, count);
+}
+
+int rp_I2cSetCache(uint8_t addr, uint8_t first, uint32_t count) {
+    return i2c_SetCache(addr, first, count);
+}
+
+int rp_I2cInvalidateCache(uint8_t addr) {
+    return i2c_InvalidateCache(addr);
 }
 
 float rp_CmnCnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off)
@@ -805,3 +1403,19 @@ float rp_CmnCnvCntToV(uint32_t field_len, uint32_t cnts, float adc_max_v, uint32
 	return cmn_CnvCntToV(field_len, cnts, adc_max_v, calibScale, calib_dc_off, user_dc_off);
 }
 
+int rp_CmnCnvCntsToV(uint32_t field_len, const uint32_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, int calib_dc_off, float user_dc_off, float* buffer)
+{
+    if (cnts == NULL || buffer == NULL) {
+        return RP_UIA;
+    }
+    return cmn_CnvCntsToV(field_len, cnts, size, adc_max_v, calibScale, calib_dc_off, user_dc_off, buffer);
+}
+
+int rp_CmnCnvCalibCntsToV(uint32_t field_len, const int16_t* cnts, uint32_t size, float adc_max_v, uint32_t calibScale, float user_dc_off, float* buffer)
+{
+    if (cnts == NULL || buffer == NULL) {
+        return RP_UIA;
+    }
+    return cmn_CnvCalibCntsToV(field_len, cnts, size, adc_max_v, calibScale, user_dc_off, buffer);
+}
+
@@ -23,19 +23,13 @@
 #include "spec_dsp.h"
 //#include "spectrometerApp.h"
 #include "spec_fpga.h"
-#include "kiss_fftr.h"
+#include "redpitaya/rp_dsp.h"
 
 extern float g_spectr_fpga_adc_max_v;
 extern const int c_spectr_fpga_adc_bits;
 
 /* length of output signals: floor(SPECTR_FPGA_SIG_LEN/2) */
 
-/* Internal structures used in DSP  */
-double                *rp_hann_window   = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out1 = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out2 = NULL;
-kiss_fftr_cfg         rp_kiss_fft_cfg  = NULL;
-
 /* constants - calibration dependant */
 /* Power calc. impedance*/
 const double c_imp = 50;
@@ -85,30 +79,11 @@ int rp_spectr_prepare_freq_vector(float **freq_out, double f_s, float freq_range
 
 int rp_spectr_hann_init()
 {
-    int i;
-
-    rp_spectr_hann_clean(rp_hann_window);
-
-    rp_hann_window = (double *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(double));
-    if(rp_hann_window == NULL) {
-        fprintf(stderr, "rp_spectr_hann_create() can not allocate mem");
-        return -1;
-    }
-    
-    for(i = 0; i < SPECTR_FPGA_SIG_LEN; i++) {
-        rp_hann_window[i] = RP_SPECTR_HANN_AMP * 
-            (1 - cos(2*M_PI*i / (double)(SPECTR_FPGA_SIG_LEN-1)));
-    }
-
     return 0;
 }
 
 int rp_spectr_hann_clean()
 {
-    if(rp_hann_window) {
-        free(rp_hann_window);
-        rp_hann_window = NULL;
-    }
     return 0;
 }
 
@@ -116,77 +91,39 @@ int rp_spectr_hann_clean()
 int rp_spectr_hann_filter(double *cha_in, double *chb_in,
                           double **cha_out, double **chb_out)
 {
-    int i;
-    double *cha_o = *cha_out;
-    double *chb_o = *chb_out;
-
     if(!cha_in || !chb_in || !*cha_out || !*chb_out)
         return -1;
-    for(i = 0; i < SPECTR_FPGA_SIG_LEN; i++) {
-        cha_o[i] = cha_in[i] * rp_hann_window[i];
-        chb_o[i] = chb_in[i] * rp_hann_window[i];
-    }
 
+    if(rp_DspWindowHann(SPECTR_FPGA_SIG_LEN, RP_SPECTR_HANN_AMP, cha_in, *cha_out) != RP_OK ||
+       rp_DspWindowHann(SPECTR_FPGA_SIG_LEN, RP_SPECTR_HANN_AMP, chb_in, *chb_out) != RP_OK) {
+        fprintf(stderr, "rp_spectr_hann_filter() can not allocate mem");
+        return -1;
+    }
     return 0;
 }
 
 int rp_spectr_fft_init()
 {
-    if(rp_kiss_fft_out1 || rp_kiss_fft_out2 || rp_kiss_fft_cfg) {
-        rp_spectr_fft_clean();
-    }
-
-    rp_kiss_fft_out1 = 
-        (kiss_fft_cpx *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-    rp_kiss_fft_out2 =
-        (kiss_fft_cpx *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-
-    rp_kiss_fft_cfg = kiss_fftr_alloc(SPECTR_FPGA_SIG_LEN, 0, NULL, NULL);
-
     return 0;
 }
 
 int rp_spectr_fft_clean()
 {
-    kiss_fft_cleanup();
-    if(rp_kiss_fft_out1) {
-        free(rp_kiss_fft_out1);
-        rp_kiss_fft_out1 = NULL;
-    }
-    if(rp_kiss_fft_out2) {
-        free(rp_kiss_fft_out2);
-        rp_kiss_fft_out2 = NULL;
-    }
-    if(rp_kiss_fft_cfg) {
-        free(rp_kiss_fft_cfg);
-        rp_kiss_fft_cfg = NULL;
-    }
+    rp_DspRelease();
     return 0;
 }
 
 int rp_spectr_fft(double *cha_in, double *chb_in, 
                   double **cha_out, double **chb_out)
 {
-    double *cha_o = *cha_out;
-    double *chb_o = *chb_out;
-    int i;
     if(!cha_in || !chb_in || !*cha_out || !*chb_out)
         return -1;
 
-    if(!rp_kiss_fft_out1 || !rp_kiss_fft_out2 || !rp_kiss_fft_cfg) {
-        fprintf(stderr, "rp_spect_fft not initialized");
+    // FFT limited to fs/2, specter of amplitudes
+    if(rp_DspFftAbs2(SPECTR_FPGA_SIG_LEN, cha_in, chb_in, *cha_out, *chb_out, c_dsp_sig_len) != RP_OK) {
+        fprintf(stderr, "rp_spectr_fft() can not allocate mem");
         return -1;
     }
-
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)cha_in, rp_kiss_fft_out1);
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)chb_in, rp_kiss_fft_out2);
-
-    for(i = 0; i < c_dsp_sig_len; i++) {                     // FFT limited to fs/2, specter of amplitudes
-        cha_o[i] = sqrt(pow(rp_kiss_fft_out1[i].r, 2) + 
-                        pow(rp_kiss_fft_out1[i].i, 2));
-        chb_o[i] = sqrt(pow(rp_kiss_fft_out2[i].r, 2) + 
-                        pow(rp_kiss_fft_out2[i].i, 2));
-    }
     return 0;
 }
 
@@ -0,0 +1,227 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya single precision real FFT.
+ *
+ * A real transform of length N is done as a complex radix-2 transform of
+ * length N/2 over the even/odd sample pairs followed by a split pass. Data
+ * is kept as separate real and imaginary arrays so the butterflies of one
+ * stage run four at a time on NEON; the Cortex-A9 has no SIMD for doubles.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SPEC_FFT_USE_NEON
+#endif
+
+#include "spec_fft.h"
+
+struct spec_fft_s {
+    int       len;
+    int       half;       // Length of the complex transform
+    uint32_t *rev;        // Bit reversed index of every complex sample
+    float    *tw_re;      // Stage twiddles, stage of span h starts at h - 1
+    float    *tw_im;
+    float    *split_re;   // exp(-2*pi*i*k/len) of the split pass
+    float    *split_im;
+    float    *re;         // Work buffers
+    float    *im;
+};
+
+spec_fft_t *spec_fft_alloc(int len)
+{
+    int bits = 0;
+    if(len < 8 || (len & (len - 1)))
+        return NULL;
+    while((2 << bits) < len)
+        bits++;
+
+    spec_fft_t *plan = calloc(1, sizeof(spec_fft_t));
+    if(plan == NULL)
+        return NULL;
+
+    int half = len / 2;
+    plan->len      = len;
+    plan->half     = half;
+    plan->rev      = malloc(half * sizeof(uint32_t));
+    plan->tw_re    = malloc(half * sizeof(float));
+    plan->tw_im    = malloc(half * sizeof(float));
+    plan->split_re = malloc(half * sizeof(float));
+    plan->split_im = malloc(half * sizeof(float));
+    plan->re       = malloc(half * sizeof(float));
+    plan->im       = malloc(half * sizeof(float));
+    if(!plan->rev || !plan->tw_re || !plan->tw_im || !plan->split_re ||
+       !plan->split_im || !plan->re || !plan->im) {
+        spec_fft_free(plan);
+        return NULL;
+    }
+
+    for(int k = 0; k < half; k++) {
+        uint32_t r = 0;
+        for(int b = 0; b < bits; b++)
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        plan->rev[k] = r;
+        plan->split_re[k] = cos(-2 * M_PI * k / len);
+        plan->split_im[k] = sin(-2 * M_PI * k / len);
+    }
+    for(int h = 1; h < half; h <<= 1) {
+        for(int j = 0; j < h; j++) {
+            plan->tw_re[h - 1 + j] = cos(-M_PI * j / h);
+            plan->tw_im[h - 1 + j] = sin(-M_PI * j / h);
+        }
+    }
+    return plan;
+}
+
+void spec_fft_free(spec_fft_t *plan)
+{
+    if(plan == NULL)
+        return;
+    free(plan->rev);
+    free(plan->tw_re);
+    free(plan->tw_im);
+    free(plan->split_re);
+    free(plan->split_im);
+    free(plan->re);
+    free(plan->im);
+    free(plan);
+}
+
+static void butterflies(float *re, float *im, const float *wre, const float *wim,
+                        int a, int b, int count)
+{
+    int j = 0;
+#ifdef SPEC_FFT_USE_NEON
+    for(; j + 4 <= count; j += 4) {
+        float32x4_t wr = vld1q_f32(wre + j);
+        float32x4_t wi = vld1q_f32(wim + j);
+        float32x4_t ar = vld1q_f32(re + a + j);
+        float32x4_t ai = vld1q_f32(im + a + j);
+        float32x4_t br = vld1q_f32(re + b + j);
+        float32x4_t bi = vld1q_f32(im + b + j);
+        float32x4_t tr = vmlsq_f32(vmulq_f32(wr, br), wi, bi);
+        float32x4_t ti = vmlaq_f32(vmulq_f32(wr, bi), wi, br);
+        vst1q_f32(re + b + j, vsubq_f32(ar, tr));
+        vst1q_f32(im + b + j, vsubq_f32(ai, ti));
+        vst1q_f32(re + a + j, vaddq_f32(ar, tr));
+        vst1q_f32(im + a + j, vaddq_f32(ai, ti));
+    }
+#endif
+    for(; j < count; j++) {
+        float tr = wre[j] * re[b + j] - wim[j] * im[b + j];
+        float ti = wre[j] * im[b + j] + wim[j] * re[b + j];
+        re[b + j] = re[a + j] - tr;
+        im[b + j] = im[a + j] - ti;
+        re[a + j] += tr;
+        im[a + j] += ti;
+    }
+}
+
+/* In place complex transform of the bit reversed half length signal in re, im */
+static void transform(spec_fft_t *plan)
+{
+    const int half = plan->half;
+    float *re = plan->re;
+    float *im = plan->im;
+
+    /* The first two stages have the twiddles 1 and -i only, done as one radix-4 pass */
+    for(int a = 0; a < half; a += 4) {
+        float s0r = re[a]     + re[a + 1], s0i = im[a]     + im[a + 1];
+        float d0r = re[a]     - re[a + 1], d0i = im[a]     - im[a + 1];
+        float s1r = re[a + 2] + re[a + 3], s1i = im[a + 2] + im[a + 3];
+        float d1r = re[a + 2] - re[a + 3], d1i = im[a + 2] - im[a + 3];
+        re[a]     = s0r + s1r;  im[a]     = s0i + s1i;
+        re[a + 2] = s0r - s1r;  im[a + 2] = s0i - s1i;
+        re[a + 1] = d0r + d1i;  im[a + 1] = d0i - d1r;
+        re[a + 3] = d0r - d1i;  im[a + 3] = d0i + d1r;
+    }
+    for(int h = 4; h < half; h <<= 1) {
+        for(int g = 0; g < half; g += 2 * h)
+            butterflies(re, im, plan->tw_re + h - 1, plan->tw_im + h - 1, g, g + h, h);
+    }
+}
+
+void spec_fft_abs(spec_fft_t *plan, const double *in, const float *win, double *out, int out_len)
+{
+    const int half = plan->half;
+    float *re = plan->re;
+    float *im = plan->im;
+
+    /* Even samples are the real, odd ones the imaginary part */
+    if(win) {
+        for(int k = 0; k < half; k++) {
+            re[plan->rev[k]] = (float)in[2 * k] * win[2 * k];
+            im[plan->rev[k]] = (float)in[2 * k + 1] * win[2 * k + 1];
+        }
+    } else {
+        for(int k = 0; k < half; k++) {
+            re[plan->rev[k]] = (float)in[2 * k];
+            im[plan->rev[k]] = (float)in[2 * k + 1];
+        }
+    }
+
+    transform(plan);
+
+    /* Split the half length transform Z into X[k] = E[k] + W^k O[k] */
+    if(out_len > half)
+        out_len = half;
+    for(int k = 0; k < out_len; k++) {
+        int n = (half - k) & (half - 1);
+        float er = 0.5f * (re[k] + re[n]);
+        float ei = 0.5f * (im[k] - im[n]);
+        float odr = 0.5f * (im[k] + im[n]);
+        float odi = -0.5f * (re[k] - re[n]);
+        float xr = er + plan->split_re[k] * odr - plan->split_im[k] * odi;
+        float xi = ei + plan->split_re[k] * odi + plan->split_im[k] * odr;
+        out[k] = sqrtf(xr * xr + xi * xi);
+    }
+}
+
+void spec_fft_abs2(spec_fft_t *plan, const double *in1, const double *in2, const float *win,
+                   double *out1, double *out2, int out_len)
+{
+    const int half = plan->half;
+    float *re = plan->re;
+    float *im = plan->im;
+
+    /* One signal is the real, the other the imaginary part */
+    if(win) {
+        for(int k = 0; k < half; k++) {
+            re[plan->rev[k]] = (float)in1[k] * win[k];
+            im[plan->rev[k]] = (float)in2[k] * win[k];
+        }
+    } else {
+        for(int k = 0; k < half; k++) {
+            re[plan->rev[k]] = (float)in1[k];
+            im[plan->rev[k]] = (float)in2[k];
+        }
+    }
+
+    transform(plan);
+
+    /* Z = X1 + i X2 with X1, X2 hermitian: X1[k] = (Z[k] + Z*[-k]) / 2,
+     * X2[k] = (Z[k] - Z*[-k]) / 2i. No twiddles, unlike the split pass. */
+    if(out_len > half / 2)
+        out_len = half / 2;
+    for(int k = 0; k < out_len; k++) {
+        int n = (half - k) & (half - 1);
+        float x1r = 0.5f * (re[k] + re[n]);
+        float x1i = 0.5f * (im[k] - im[n]);
+        float x2r = 0.5f * (im[k] + im[n]);
+        float x2i = -0.5f * (re[k] - re[n]);
+        out1[k] = sqrtf(x1r * x1r + x1i * x1i);
+        out2[k] = sqrtf(x2r * x2r + x2i * x2i);
+    }
+}
@@ -0,0 +1,34 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya single precision real FFT.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __SPEC_FFT_H
+#define __SPEC_FFT_H
+
+typedef struct spec_fft_s spec_fft_t;
+
+/* Plan for a real transform of len samples, len is a power of two >= 8 */
+spec_fft_t *spec_fft_alloc(int len);
+void spec_fft_free(spec_fft_t *plan);
+
+/* Amplitudes |X[k]| of the first out_len bins, out_len <= len/2. A non NULL
+ * win is multiplied into the samples while they are loaded. */
+void spec_fft_abs(spec_fft_t *plan, const double *in, const float *win, double *out, int out_len);
+
+/* Amplitudes of two real signals of len/2 samples each, transformed together
+ * as the real and imaginary part of the complex transform of a len plan.
+ * out_len <= len/4, win has len/2 entries. */
+void spec_fft_abs2(spec_fft_t *plan, const double *in1, const double *in2, const float *win,
+                   double *out1, double *out2, int out_len);
+
+#endif //__SPEC_FFT_H
@@ -0,0 +1,183 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library SPI module implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include "spi.h"
+
+static int spi_fd = -1;
+static uint32_t spi_bufsiz = SPI_BUFSIZ_DEFAULT;
+
+/*
+ * Kernel descriptors of the message being sent. Kept between calls, so a
+ * transfer does not allocate anything.
+ */
+static struct spi_ioc_transfer spi_msg[SPI_MAX_MESSAGE];
+
+// Guards the descriptor, the settings and spi_msg
+static pthread_mutex_t spi_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t readBufsiz()
+{
+    unsigned int value = 0;
+    FILE* fp = fopen(SPI_BUFSIZ_PARAM, "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%u", &value) != 1) {
+            value = 0;
+        }
+        fclose(fp);
+    }
+    return value > 0 ? value : SPI_BUFSIZ_DEFAULT;
+}
+
+int spi_Init(const char* device)
+{
+    pthread_mutex_lock(&spi_lock);
+    if (spi_fd >= 0) {
+        close(spi_fd);
+    }
+    spi_fd = open(device != NULL ? device : SPI_DEFAULT_DEVICE, O_RDWR | O_CLOEXEC);
+    spi_bufsiz = readBufsiz();
+    int ret = spi_fd < 0 ? RP_EFOB : RP_OK;
+    pthread_mutex_unlock(&spi_lock);
+    return ret;
+}
+
+int spi_Release()
+{
+    pthread_mutex_lock(&spi_lock);
+    int ret = RP_OK;
+    if (spi_fd >= 0 && close(spi_fd) != 0) {
+        ret = RP_EFCB;
+    }
+    spi_fd = -1;
+    pthread_mutex_unlock(&spi_lock);
+    return ret;
+}
+
+/* Runs one settings ioctl on the open bus */
+static int setting(unsigned long request, void* value)
+{
+    pthread_mutex_lock(&spi_lock);
+    int ret = spi_fd < 0 ? RP_EFOB : ioctl(spi_fd, request, value) < 0 ? RP_EABA : RP_OK;
+    pthread_mutex_unlock(&spi_lock);
+    return ret;
+}
+
+int spi_SetMode(uint32_t mode)
+{
+    // the 8 bit request keeps working on kernels without SPI_IOC_WR_MODE32
+    if (mode <= 0xff) {
+        uint8_t mode8 = mode;
+        return setting(SPI_IOC_WR_MODE, &mode8);
+    }
+    return setting(SPI_IOC_WR_MODE32, &mode);
+}
+
+int spi_GetMode(uint32_t* mode)
+{
+    uint8_t mode8;
+    int ret = setting(SPI_IOC_RD_MODE32, mode);
+    if (ret != RP_OK && (ret = setting(SPI_IOC_RD_MODE, &mode8)) == RP_OK) {
+        *mode = mode8;
+    }
+    return ret;
+}
+
+int spi_SetSpeed(uint32_t speed_hz)
+{
+    return setting(SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz);
+}
+
+int spi_GetSpeed(uint32_t* speed_hz)
+{
+    return setting(SPI_IOC_RD_MAX_SPEED_HZ, speed_hz);
+}
+
+int spi_SetBitsPerWord(uint8_t bits)
+{
+    return setting(SPI_IOC_WR_BITS_PER_WORD, &bits);
+}
+
+int spi_GetBitsPerWord(uint8_t* bits)
+{
+    return setting(SPI_IOC_RD_BITS_PER_WORD, bits);
+}
+
+int spi_GetMaxMessage(uint32_t* bytes)
+{
+    pthread_mutex_lock(&spi_lock);
+    *bytes = spi_bufsiz;
+    pthread_mutex_unlock(&spi_lock);
+    return RP_OK;
+}
+
+/*
+ * Sends the transfers with as few SPI_IOC_MESSAGE() ioctls as the driver
+ * takes: a message ends only where the next transfer would overflow the
+ * spidev buffer or the descriptor table. The chip stays selected across such
+ * a split unless the transfer asked for cs_change, where the kernel takes
+ * cs_change on the last transfer of a message as "keep it selected".
+ */
+int spi_Transfer(const rp_spi_xfer_t* xfers, uint32_t count)
+{
+    int ret = RP_OK;
+
+    pthread_mutex_lock(&spi_lock);
+    if (spi_fd < 0) {
+        pthread_mutex_unlock(&spi_lock);
+        return RP_EFOB;
+    }
+    // nothing is sent when one transfer can never fit
+    for (uint32_t i = 0; i < count; i++) {
+        if (xfers[i].len > spi_bufsiz) {
+            pthread_mutex_unlock(&spi_lock);
+            return RP_EOOR;
+        }
+    }
+    uint32_t i = 0;
+    while (ret == RP_OK && i < count) {
+        uint32_t n = 0;
+        uint32_t bytes = 0;
+        for (; i < count && n < SPI_MAX_MESSAGE; i++, n++) {
+            const rp_spi_xfer_t* x = &xfers[i];
+            if (bytes + x->len > spi_bufsiz) {
+                break;
+            }
+            bytes += x->len;
+            struct spi_ioc_transfer* t = &spi_msg[n];
+            memset(t, 0, sizeof(*t));
+            t->tx_buf = (uintptr_t) x->tx;
+            t->rx_buf = (uintptr_t) x->rx;
+            t->len = x->len;
+            t->speed_hz = x->speed_hz;
+            t->delay_usecs = x->delay_us;
+            t->cs_change = x->cs_change;
+        }
+        if (i < count) {
+            // a deselect asked for at the end becomes a "keep selected" hint
+            spi_msg[n - 1].cs_change = !spi_msg[n - 1].cs_change;
+        }
+        if (ioctl(spi_fd, SPI_IOC_MESSAGE(n), spi_msg) < 0) {
+            ret = RP_EFWB;
+        }
+    }
+    pthread_mutex_unlock(&spi_lock);
+    return ret;
+}
@@ -0,0 +1,42 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library SPI module interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef SRC_SPI_H_
+#define SRC_SPI_H_
+
+#include <stdint.h>
+#include "redpitaya/rp.h"
+
+/** spidev of the extension connector */
+#define SPI_DEFAULT_DEVICE "/dev/spidev1.0"
+
+/** Transfer buffer of the spidev driver, the bytes of one message must fit in it */
+#define SPI_BUFSIZ_PARAM   "/sys/module/spidev/parameters/bufsiz"
+#define SPI_BUFSIZ_DEFAULT 4096
+
+/** Transfers per SPI_IOC_MESSAGE(), the 14 bit ioctl size field would take 511 */
+#define SPI_MAX_MESSAGE    256
+
+int spi_Init(const char* device);
+int spi_Release();
+int spi_SetMode(uint32_t mode);
+int spi_GetMode(uint32_t* mode);
+int spi_SetSpeed(uint32_t speed_hz);
+int spi_GetSpeed(uint32_t* speed_hz);
+int spi_SetBitsPerWord(uint8_t bits);
+int spi_GetBitsPerWord(uint8_t* bits);
+int spi_GetMaxMessage(uint32_t* bytes);
+int spi_Transfer(const rp_spi_xfer_t* xfers, uint32_t count);
+
+#endif /* SRC_SPI_H_ */
@@ -0,0 +1,203 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library frequency sweep implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+
+#include "common.h"
+#include "acq_handler.h"
+#include "generate.h"
+#include "gen_handler.h"
+#include "sweep.h"
+
+static uint64_t getMonotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t deadline_ns)
+{
+    struct timespec ts;
+    ts.tv_sec = deadline_ns / 1000000000ULL;
+    ts.tv_nsec = deadline_ns % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static float pointFrequency(const rp_sweep_t* sweep, uint32_t i)
+{
+    if (sweep->mode == RP_SWEEP_LIST) {
+        return sweep->freqs[i];
+    }
+    if (sweep->points == 1) {
+        return sweep->start_freq;
+    }
+    double t = (double)i / (sweep->points - 1);
+    if (sweep->mode == RP_SWEEP_LOG) {
+        return (float)(sweep->start_freq * pow((double)sweep->stop_freq / sweep->start_freq, t));
+    }
+    return (float)(sweep->start_freq + (sweep->stop_freq - sweep->start_freq) * t);
+}
+
+static int checkSweep(const rp_sweep_t* sweep)
+{
+    if (sweep->channel != RP_CH_1 && sweep->channel != RP_CH_2) {
+        return RP_EPN;
+    }
+    if (sweep->points == 0 || sweep->trigger == RP_TRIG_SRC_DISABLED) {
+        return RP_EOOR;
+    }
+    switch (sweep->mode) {
+        case RP_SWEEP_LIST:
+            if (sweep->freqs == NULL) {
+                return RP_UIA;
+            }
+            for (uint32_t i = 0; i < sweep->points; ++i) {
+                if (sweep->freqs[i] < FREQUENCY_MIN || sweep->freqs[i] > FREQUENCY_MAX) {
+                    return RP_EOOR;
+                }
+            }
+            return RP_OK;
+        case RP_SWEEP_LOG:
+            if (sweep->start_freq <= 0 || sweep->stop_freq <= 0) {
+                return RP_EOOR;
+            }
+            // fall through
+        case RP_SWEEP_LINEAR:
+            if (sweep->start_freq < FREQUENCY_MIN || sweep->start_freq > FREQUENCY_MAX
+             || sweep->stop_freq < FREQUENCY_MIN || sweep->stop_freq > FREQUENCY_MAX) {
+                return RP_EOOR;
+            }
+            return RP_OK;
+        default:
+            return RP_EOOR;
+    }
+}
+
+/*
+ * Every step is written in one register batch, then the settling time runs
+ * against an absolute deadline, so a point costs its dwell plus one record and
+ * not a worst-case sleep. The record itself is taken by the segmented capture,
+ * which arms as soon as the pre trigger samples are in memory.
+ */
+int sweep_Run(const rp_sweep_t* sweep, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_sweep_point_t* points, uint32_t timeout_ms, uint32_t* done)
+{
+    if (done) {
+        *done = 0;
+    }
+    if (sweep == NULL || points == NULL || (buffer1 == NULL && buffer2 == NULL)) {
+        return RP_UIA;
+    }
+    int status = checkSweep(sweep);
+    if (status != RP_OK) {
+        return status;
+    }
+
+    uint64_t deadline = getMonotonicNs() + (uint64_t)timeout_ms * 1000000ULL;
+    acq_SetTriggerSrc(sweep->trigger);
+
+    uint32_t i;
+    for (i = 0; i < sweep->points; ++i) {
+        rp_sweep_point_t* point = &points[i];
+        point->frequency = pointFrequency(sweep, i);
+
+        cmn_BatchBegin();
+        if (sweep->amps) {
+            status = gen_setAmplitude(sweep->channel, sweep->amps[i]);
+        }
+        if (status == RP_OK) {
+            status = gen_setFrequency(sweep->channel, point->frequency);
+        }
+        if (status == RP_OK && sweep->decimations) {
+            status = acq_SetDecimation(sweep->decimations[i]);
+        }
+        cmn_BatchCommit();
+        if (status != RP_OK) {
+            break;
+        }
+        gen_getAmplitude(sweep->channel, &point->amplitude);
+
+        uint64_t dwell = (uint64_t)sweep->dwell_us * 1000ULL;
+        if (sweep->dwell_periods > 0 && point->frequency > 0) {
+            uint64_t periods = (uint64_t)(sweep->dwell_periods * 1e9 / point->frequency);
+            if (periods > dwell) {
+                dwell = periods;
+            }
+        }
+        uint64_t now = getMonotonicNs();
+        if (now + dwell > deadline) {
+            status = RP_ETIM;
+            break;
+        }
+        sleepUntil(now + dwell);
+
+        now = getMonotonicNs();
+        uint32_t left_ms = now < deadline ? (uint32_t)((deadline - now) / 1000000ULL) : 0;
+        size_t offset = (size_t)i * record_size;
+        status = acq_CaptureRecords(1, record_size, pre_trigger,
+                                    buffer1 ? buffer1 + offset : NULL,
+                                    buffer2 ? buffer2 + offset : NULL,
+                                    &point->record, left_ms, NULL);
+        if (status != RP_OK) {
+            break;
+        }
+    }
+
+    if (done) {
+        *done = i;
+    }
+    return status;
+}
+
+typedef struct {
+    rp_channel_t channel;
+    int status;
+} fire_t;
+
+static void fireGenerator(void* ctx)
+{
+    fire_t* fire = (fire_t*)ctx;
+    fire->status = gen_Trigger(fire->channel);
+}
+
+/*
+ * The generator waits in reset until the acquisition is armed on its trigger,
+ * then starts its burst. The record is aligned to the generator trigger by the
+ * FPGA, the time the trigger is written at does not move the stimulus in it.
+ */
+int sweep_GenAcqRun(rp_channel_t channel, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* record, uint32_t timeout_ms)
+{
+    if (channel != RP_CH_1 && channel != RP_CH_2) {
+        return RP_EPN;
+    }
+    if (record == NULL || (buffer1 == NULL && buffer2 == NULL)) {
+        return RP_UIA;
+    }
+
+    // No trigger source, the burst settings do not restart it
+    generate_setTriggerSource(channel, 0);
+    int status = gen_setGenMode(channel, RP_GEN_MODE_BURST);
+    if (status != RP_OK) {
+        return status;
+    }
+    generate_ResetChannel(channel);
+
+    fire_t fire = { channel, RP_OK };
+    acq_SetTriggerSrc(RP_TRIG_SRC_AWG_PE);
+    status = acq_CaptureArmed(record_size, pre_trigger, buffer1, buffer2, record, timeout_ms, fireGenerator, &fire);
+    return status != RP_OK ? status : fire.status;
+}
@@ -0,0 +1,24 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library frequency sweep interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef SRC_SWEEP_H_
+#define SRC_SWEEP_H_
+
+#include <stdint.h>
+#include "redpitaya/rp.h"
+
+int sweep_Run(const rp_sweep_t* sweep, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_sweep_point_t* points, uint32_t timeout_ms, uint32_t* done);
+int sweep_GenAcqRun(rp_channel_t channel, uint32_t record_size, uint32_t pre_trigger, int16_t* buffer1, int16_t* buffer2, rp_acq_record_t* record, uint32_t timeout_ms);
+
+#endif /* SRC_SWEEP_H_ */
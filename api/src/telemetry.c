@@ -0,0 +1,224 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library telemetry module implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "redpitaya/rp.h"
+#include "ai_buffer.h"
+#include "telemetry.h"
+
+/*
+ * The service samples the housekeeping into one page, readers copy it without
+ * any lock or system call. seq is odd while the publisher updates the sample,
+ * a reader retries when it changed during its copy. size is written last on
+ * the first publish, so a reader never takes a page of another layout.
+ */
+typedef struct {
+    volatile uint32_t seq;
+    volatile uint32_t size;
+    rp_telemetry_t    data;
+} telemetry_shm_t;
+
+/* A reader gives up on a publisher that died in the middle of an update */
+#define TELEMETRY_READ_TRIES 1000
+
+/* XADC channels of rp_telemetry_t: temp, vcc_int, vcc_aux, vcc_bram */
+#define XADC_NUM 4
+
+static const char* const xadc_names[XADC_NUM] = {
+    "in_temp0", "in_voltage0_vccint", "in_voltage1_vccaux", "in_voltage2_vccbram"
+};
+
+// Raw value files stay open, each sample is one pread() per channel
+static int    xadc_fd[XADC_NUM] = { -1, -1, -1, -1 };
+static double xadc_scale[XADC_NUM];
+static double xadc_offset[XADC_NUM];
+
+static telemetry_shm_t* pub_shm = NULL;
+static uint64_t pub_count = 0;
+static telemetry_shm_t* read_shm = NULL; // mapped once per process
+
+// Guards the files, the maps and pub_count
+static pthread_mutex_t telemetry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int readAttr(const char* name, const char* attr, double* value)
+{
+    char path[256];
+    snprintf(path, sizeof(path), AI_XADC_DIR "/%s_%s", name, attr);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return RP_EOED;
+    }
+    int ret = fscanf(fp, "%lf", value) == 1 ? RP_OK : RP_EOED;
+    fclose(fp);
+    return ret;
+}
+
+static int xadcOpen()
+{
+    for (int i = 0; i < XADC_NUM; i++) {
+        char path[256];
+        if (xadc_fd[i] >= 0) {
+            continue;
+        }
+        // only the temperature has an offset
+        xadc_offset[i] = 0;
+        if (readAttr(xadc_names[i], "scale", &xadc_scale[i]) != RP_OK ||
+            (i == 0 && readAttr(xadc_names[i], "offset", &xadc_offset[i]) != RP_OK)) {
+            return RP_EOED;
+        }
+        snprintf(path, sizeof(path), AI_XADC_DIR "/%s_raw", xadc_names[i]);
+        if ((xadc_fd[i] = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+            return RP_EOED;
+        }
+    }
+    return RP_OK;
+}
+
+static int xadcRead(int i, float* value)
+{
+    char buf[32];
+    ssize_t n = pread(xadc_fd[i], buf, sizeof(buf) - 1, 0);
+    if (n <= 0) {
+        return RP_EOED;
+    }
+    buf[n] = '\0';
+    // [m deg C] and [mV]
+    *value = (strtol(buf, NULL, 10) + xadc_offset[i]) * xadc_scale[i] / 1000.0;
+    return RP_OK;
+}
+
+int telemetry_ReadXadc(rp_telemetry_t* telemetry)
+{
+    float* values[XADC_NUM] = {
+        &telemetry->temp, &telemetry->vcc_int, &telemetry->vcc_aux, &telemetry->vcc_bram
+    };
+    int ret;
+
+    pthread_mutex_lock(&telemetry_lock);
+    ret = xadcOpen();
+    for (int i = 0; ret == RP_OK && i < XADC_NUM; i++) {
+        ret = xadcRead(i, values[i]);
+    }
+    pthread_mutex_unlock(&telemetry_lock);
+    return ret;
+}
+
+static telemetry_shm_t* shmMap(bool publish)
+{
+    int fd = publish ? shm_open(TELEMETRY_SHM_NAME, O_RDWR | O_CREAT, 0644)
+                     : shm_open(TELEMETRY_SHM_NAME, O_RDONLY, 0);
+    void* map = MAP_FAILED;
+    struct stat st;
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (publish) {
+        fchmod(fd, 0644); // past the umask, any process may read it
+    }
+    if (fstat(fd, &st) == 0) {
+        if (publish && st.st_size < (off_t)sizeof(telemetry_shm_t) && ftruncate(fd, sizeof(telemetry_shm_t)) == 0) {
+            st.st_size = sizeof(telemetry_shm_t);
+        }
+        if (st.st_size >= (off_t)sizeof(telemetry_shm_t)) {
+            map = mmap(NULL, sizeof(telemetry_shm_t), publish ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        }
+    }
+    close(fd);
+    return map == MAP_FAILED ? NULL : (telemetry_shm_t*) map;
+}
+
+int telemetry_Publish(rp_telemetry_t* telemetry)
+{
+    pthread_mutex_lock(&telemetry_lock);
+    if (pub_shm == NULL && (pub_shm = shmMap(true)) == NULL) {
+        pthread_mutex_unlock(&telemetry_lock);
+        return RP_EOMD;
+    }
+    telemetry->count = ++pub_count;
+
+    telemetry_shm_t* shm = pub_shm;
+    shm->seq |= 1; // even if a previous publisher died in an update
+    __sync_synchronize();
+    memcpy(&shm->data, telemetry, sizeof(*telemetry));
+    __sync_synchronize();
+    shm->seq++;
+    if (shm->size != sizeof(rp_telemetry_t)) {
+        __sync_synchronize();
+        shm->size = sizeof(rp_telemetry_t);
+    }
+    pthread_mutex_unlock(&telemetry_lock);
+    return RP_OK;
+}
+
+int telemetry_Read(rp_telemetry_t* telemetry)
+{
+    telemetry_shm_t* shm = __atomic_load_n(&read_shm, __ATOMIC_ACQUIRE);
+
+    if (shm == NULL) {
+        // the service may start later, a missing page is not remembered
+        pthread_mutex_lock(&telemetry_lock);
+        if (read_shm == NULL) {
+            __atomic_store_n(&read_shm, shmMap(false), __ATOMIC_RELEASE);
+        }
+        shm = read_shm;
+        pthread_mutex_unlock(&telemetry_lock);
+        if (shm == NULL) {
+            return RP_EOMD;
+        }
+    }
+    if (shm->size != sizeof(rp_telemetry_t)) {
+        return RP_EOMD;
+    }
+
+    for (int tries = 0; tries < TELEMETRY_READ_TRIES; tries++) {
+        uint32_t seq = shm->seq;
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        __sync_synchronize();
+        memcpy(telemetry, &shm->data, sizeof(*telemetry));
+        __sync_synchronize();
+        if (shm->seq == seq) {
+            return RP_OK;
+        }
+    }
+    return RP_ETIM;
+}
+
+void telemetry_Release()
+{
+    pthread_mutex_lock(&telemetry_lock);
+    for (int i = 0; i < XADC_NUM; i++) {
+        if (xadc_fd[i] >= 0) {
+            close(xadc_fd[i]);
+            xadc_fd[i] = -1;
+        }
+    }
+    if (pub_shm != NULL) {
+        munmap(pub_shm, sizeof(telemetry_shm_t));
+        pub_shm = NULL;
+    }
+    // read_shm stays, readers do not need rp_Init() and take no lock
+    pthread_mutex_unlock(&telemetry_lock);
+}
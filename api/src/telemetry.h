@@ -0,0 +1,28 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library telemetry module interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef SRC_TELEMETRY_H_
+#define SRC_TELEMETRY_H_
+
+#include "redpitaya/rp.h"
+
+/** Shared memory page the samples are published in (/dev/shm is a tmpfs) */
+#define TELEMETRY_SHM_NAME "/rp_telemetry"
+
+int telemetry_ReadXadc(rp_telemetry_t* telemetry);
+int telemetry_Publish(rp_telemetry_t* telemetry);
+int telemetry_Read(rp_telemetry_t* telemetry);
+void telemetry_Release();
+
+#endif /* SRC_TELEMETRY_H_ */
@@ -0,0 +1,122 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya housekeeping telemetry service.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "redpitaya/rp.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * Samples the Zynq temperature and supplies, the slow analog inputs and the
+ * DAC temperature alarms at a fixed rate with rp_TelemetryUpdate(). Apps and
+ * scripts read the latest sample with rp_TelemetryRead() instead of polling
+ * the hardware themselves, so readers add no bus or sysfs traffic.
+ *
+ *   rp_telemetryd [-r rate]   run the service, rate in Hz (default 10)
+ *   rp_telemetryd -p          print the latest sample as one JSON line
+ *
+ * The state of the generator and the acquisition is left alone.
+ */
+
+#define DEFAULT_RATE 10.0
+#define MAX_RATE     1000.0
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int sig)
+{
+    running = 0;
+}
+
+static int print()
+{
+    rp_telemetry_t t;
+    struct timespec now;
+    int ret = rp_TelemetryRead(&t);
+
+    if (ret != RP_OK) {
+        fprintf(stderr, "rp_TelemetryRead: %s\n", rp_GetError(ret));
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double age = ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - t.time_ns) * 1e-9;
+    printf("{\"count\":%llu,\"age_s\":%.3f,\"temp\":%.2f,\"vcc_int\":%.3f,\"vcc_aux\":%.3f,\"vcc_bram\":%.3f,"
+           "\"ain\":[%.3f,%.3f,%.3f,%.3f]",
+           (unsigned long long) t.count, age, t.temp, t.vcc_int, t.vcc_aux, t.vcc_bram,
+           t.ain[0], t.ain[1], t.ain[2], t.ain[3]);
+    if (t.alarms) {
+        printf(",\"runtime_alarm\":[%d,%d],\"latch_alarm\":[%d,%d]",
+               t.runtime_alarm[0], t.runtime_alarm[1], t.latch_alarm[0], t.latch_alarm[1]);
+    }
+    printf("}\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    double rate = DEFAULT_RATE;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:ph")) != -1) {
+        switch (opt) {
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'p':
+            return print();
+        default:
+            fprintf(stderr, "Usage: %s [-r rate] | -p\n", argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (rate <= 0 || rate > MAX_RATE) {
+        fprintf(stderr, "Rate out of range (0, %g] Hz\n", MAX_RATE);
+        return EXIT_FAILURE;
+    }
+
+    int ret = rp_InitEx(RP_INIT_HK | RP_INIT_GEN);
+    if (ret != RP_OK) {
+        fprintf(stderr, "rp_InitEx: %s\n", rp_GetError(ret));
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // absolute deadlines, so the rate does not drift with the sampling time
+    uint64_t period_ns = (uint64_t)(1e9 / rate);
+    struct timespec next;
+    int errors = 0;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (running) {
+        ret = rp_TelemetryUpdate();
+        if (ret != RP_OK && errors++ == 0) {
+            fprintf(stderr, "rp_TelemetryUpdate: %s\n", rp_GetError(ret));
+        } else if (ret == RP_OK) {
+            errors = 0;
+        }
+        uint64_t ns = next.tv_nsec + period_ns;
+        next.tv_sec += ns / 1000000000ULL;
+        next.tv_nsec = ns % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    rp_Release();
+    return EXIT_SUCCESS;
+}
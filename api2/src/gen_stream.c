@@ -0,0 +1,140 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library streaming generator module implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "rpdma.h"
+#include "rp_dma.h"
+#include "gen_stream.h"
+
+int rp_GenStreamOpen(const char *dev, rp_gen_stream_t *stream, uint32_t sgmnt_cnt, size_t sgmnt_size, double rate) {
+    if (sgmnt_cnt < 2 || sgmnt_size == 0 || sgmnt_size > TX_SGMNT_SIZE || sgmnt_size % sizeof(int16_t) || rate <= 0) {
+        return RP_EOOR;
+    }
+    memset(stream, 0, sizeof(*stream));
+    stream->dma.dma_dev = (char*) malloc((strlen(dev)+1) * sizeof(char));
+    strncpy(stream->dma.dma_dev, dev, strlen(dev)+1);
+    stream->dma.dma_fd = open(stream->dma.dma_dev, O_RDWR);
+    if (stream->dma.dma_fd < 1) {
+        printf("Unable to open device file");
+        free(stream->dma.dma_dev);
+        stream->dma.dma_dev = NULL;
+        return RP_EOED;
+    }
+    stream->dma.dma_size = sgmnt_cnt * sgmnt_size;
+    stream->sgmnt_cnt = sgmnt_cnt;
+    stream->sgmnt_size = sgmnt_size;
+    stream->rate = rate;
+    rp_SetTxSgmntC(&stream->dma, sgmnt_cnt);
+    rp_SetTxSgmntS(&stream->dma, sgmnt_size);
+    return RP_OK;
+}
+
+int rp_GenStreamClose(rp_gen_stream_t *stream) {
+    if (stream->running) {
+        rp_GenStreamStop(stream);
+    }
+    if (rp_DmaClose(&stream->dma) != RP_OK) {
+        return RP_ECMD;
+    }
+    return RP_OK;
+}
+
+/** Samples the DAC has played since start, from the wall clock */
+static uint64_t playedSamples(rp_gen_stream_t *stream) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - stream->start.tv_sec) + (now.tv_nsec - stream->start.tv_nsec) * 1e-9;
+    return (uint64_t) (elapsed * stream->rate);
+}
+
+/**
+ * The ring keeps looping when the writer falls behind, so old segments are
+ * played again. The writer then continues where playback is now, the
+ * skipped samples are counted as lost.
+ */
+static void checkUnderrun(rp_gen_stream_t *stream) {
+    int status;
+    uint64_t played = playedSamples(stream);
+    if (played > stream->written) {
+        stream->underruns++;
+        stream->lost_samples += played - stream->written;
+        stream->written = played;
+    } else if (rp_DmaStatus(&stream->dma, &status) == RP_OK && status == STATUS_ERROR) {
+        stream->underruns++;
+    }
+}
+
+/**
+ * Samples written before start prefill the ring and count as written, so
+ * playback has that much margin.
+ */
+int rp_GenStreamStart(rp_gen_stream_t *stream) {
+    if (stream->running) {
+        return RP_OK;
+    }
+    stream->underruns = 0;
+    stream->lost_samples = 0;
+    rp_DmaCtrl(&stream->dma, RP_DMA_CYCLIC_TX);
+    clock_gettime(CLOCK_MONOTONIC, &stream->start);
+    stream->running = true;
+    return RP_OK;
+}
+
+int rp_GenStreamStop(rp_gen_stream_t *stream) {
+    rp_DmaCtrl(&stream->dma, RP_DMA_STOP_TX);
+    stream->running = false;
+    stream->written = 0;
+    return RP_OK;
+}
+
+/**
+ * Hands samples to the ring one segment at a time. The driver blocks while
+ * all segments are still waiting to be played, which paces the caller.
+ */
+int rp_GenStreamWrite(rp_gen_stream_t *stream, const int16_t *samples, size_t count) {
+    size_t sgmnt_samples = stream->sgmnt_size / sizeof(int16_t);
+    while (count > 0) {
+        size_t n = count < sgmnt_samples ? count : sgmnt_samples;
+        if (stream->running) {
+            checkUnderrun(stream);
+        }
+        int s = rp_DmaWrite(&stream->dma, samples, n * sizeof(int16_t));
+        if (s < 0) {
+            return RP_EFWB;
+        }
+        n = s / sizeof(int16_t);
+        if (n == 0) {
+            return RP_EFWB;
+        }
+        stream->written += n;
+        samples += n;
+        count -= n;
+    }
+    return RP_OK;
+}
+
+int rp_GenStreamGetUnderruns(rp_gen_stream_t *stream, uint64_t *underruns, uint64_t *lost_samples) {
+    if (stream->running) {
+        checkUnderrun(stream);
+    }
+    *underruns = stream->underruns;
+    *lost_samples = stream->lost_samples;
+    return RP_OK;
+}
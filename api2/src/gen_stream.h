@@ -0,0 +1,50 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library streaming generator module interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+// Plays sample sequences of any length from the DMA TX ring. The application
+// keeps writing segments ahead of playback, the driver loops the ring.
+
+#ifndef __GEN_STREAM_H
+#define __GEN_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "common.h"
+
+#define RP_GEN_STREAM_SGMNT_CNT  8
+#define RP_GEN_STREAM_SGMNT_SIZE (256*1024)
+
+typedef struct {
+    rp_handle_uio_t dma;
+    size_t          sgmnt_size;   ///< segment size [bytes]
+    uint32_t        sgmnt_cnt;    ///< segments in the TX ring
+    double          rate;         ///< playback rate [samples/s]
+    bool            running;
+    struct timespec start;
+    uint64_t        written;      ///< samples handed to the ring, incl. prefill and skipped ones
+    uint64_t        underruns;    ///< times playback caught up with the writer
+    uint64_t        lost_samples; ///< samples replayed from stale segments
+} rp_gen_stream_t;
+
+int rp_GenStreamOpen(const char *dev, rp_gen_stream_t *stream, uint32_t sgmnt_cnt, size_t sgmnt_size, double rate);
+int rp_GenStreamClose(rp_gen_stream_t *stream);
+int rp_GenStreamStart(rp_gen_stream_t *stream);
+int rp_GenStreamStop(rp_gen_stream_t *stream);
+int rp_GenStreamWrite(rp_gen_stream_t *stream, const int16_t *samples, size_t count);
+int rp_GenStreamGetUnderruns(rp_gen_stream_t *stream, uint64_t *underruns, uint64_t *lost_samples);
+
+#endif // __GEN_STREAM_H
@@ -132,6 +132,15 @@ int rp_LaAcqStopAcq(rp_handle_uio_t *handle) {
     return rp_LaAcqSetControl(handle,RP_CTL_STO_MASK);
 }
 
+/** Start & stop without touching the DMA, for a cyclic RX run by the caller */
+int rp_LaAcqRunCapture(rp_handle_uio_t *handle) {
+    return rp_LaAcqSetControl(handle,RP_CTL_STA_MASK);
+}
+
+int rp_LaAcqStopCapture(rp_handle_uio_t *handle) {
+    return rp_LaAcqSetControl(handle,RP_CTL_STO_MASK);
+}
+
 int rp_LaAcqTriggerAcq(rp_handle_uio_t *handle) {
     return rp_LaAcqSetControl(handle,RP_CTL_SWT_MASK);
 }
@@ -103,6 +103,8 @@ int rp_LaAcqDefaultSettings(rp_handle_uio_t *handle);
 int rp_LaAcqReset(rp_handle_uio_t *handle);
 int rp_LaAcqRunAcq(rp_handle_uio_t *handle);
 int rp_LaAcqStopAcq(rp_handle_uio_t *handle);
+int rp_LaAcqRunCapture(rp_handle_uio_t *handle);
+int rp_LaAcqStopCapture(rp_handle_uio_t *handle);
 int rp_LaAcqTriggerAcq(rp_handle_uio_t *handle);
 int rp_LaAcqAcqIsStopped(rp_handle_uio_t *handle, bool * status);
 int rp_LaAcqGlobalTrigSet(rp_handle_uio_t *handle, uint32_t mask);
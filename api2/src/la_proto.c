@@ -0,0 +1,258 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library logic analyzer protocol decoders implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "redpitaya/rp2.h"
+#include "la_proto.h"
+
+#define LA_BIT(v, line) (((v) >> (line)) & 1)
+
+static inline size_t la_proto_frame(rp_la_frame_t *f, uint8_t type, uint64_t start, uint64_t length,
+                                    uint32_t data, uint16_t bits, uint8_t flags) {
+    f->start = start;
+    f->length = (uint32_t) length;
+    f->data = data;
+    f->type = type;
+    f->flags = flags;
+    f->bits = bits;
+    return 1;
+}
+
+static void la_proto_init(rp_la_proto_t *dec, uint8_t type) {
+    memset(dec, 0, sizeof(*dec));
+    dec->type = type;
+    dec->first = true;
+}
+
+int rp_LaProtoUartInit(rp_la_proto_t *dec, const rp_la_uart_cfg_t *cfg) {
+    if (dec == NULL || cfg == NULL || cfg->line >= RP_LA_RLE_LINES || cfg->samples_per_bit < 2 ||
+        cfg->data_bits < 5 || cfg->data_bits > 9 || cfg->stop_bits < 1 || cfg->stop_bits > 2) {
+        return RP_EOOR;
+    }
+    la_proto_init(dec, RP_LA_FRAME_UART);
+    dec->cfg.uart = *cfg;
+    return RP_OK;
+}
+
+int rp_LaProtoSpiInit(rp_la_proto_t *dec, const rp_la_spi_cfg_t *cfg) {
+    if (dec == NULL || cfg == NULL || cfg->sclk >= RP_LA_RLE_LINES || cfg->mosi >= RP_LA_RLE_LINES ||
+        cfg->miso >= RP_LA_RLE_LINES || cfg->cs >= RP_LA_RLE_LINES || cfg->cs < -1 ||
+        cfg->word_bits < 1 || cfg->word_bits > 16) {
+        return RP_EOOR;
+    }
+    la_proto_init(dec, RP_LA_FRAME_SPI);
+    dec->cfg.spi = *cfg;
+    return RP_OK;
+}
+
+int rp_LaProtoI2cInit(rp_la_proto_t *dec, const rp_la_i2c_cfg_t *cfg) {
+    if (dec == NULL || cfg == NULL || cfg->scl >= RP_LA_RLE_LINES || cfg->sda >= RP_LA_RLE_LINES ||
+        cfg->scl == cfg->sda) {
+        return RP_EOOR;
+    }
+    la_proto_init(dec, RP_LA_FRAME_I2C_ADDR);
+    dec->cfg.i2c = *cfg;
+    return RP_OK;
+}
+
+/**
+ * UART: a falling edge at a run boundary starts a frame, the bits are taken at
+ * their centres t0 + (n + 0.5) * samples_per_bit from the run covering them.
+ * A start bit that is high again at its centre is treated as a glitch.
+ */
+static size_t la_proto_uart(rp_la_proto_t *dec, uint8_t v, uint32_t len, rp_la_frame_t *f) {
+    const rp_la_uart_cfg_t *c = &dec->cfg.uart;
+    uint32_t parity_bit = c->parity != RP_LA_PARITY_NONE ? 1 : 0;
+    uint32_t total = 1 + c->data_bits + parity_bit + c->stop_bits;
+    uint32_t level = LA_BIT(v, c->line) ^ (c->inverted ? 1 : 0);
+    double end = (double)(dec->pos + len);
+
+    if (dec->state == 0) {
+        uint32_t prev = LA_BIT(dec->prev, c->line) ^ (c->inverted ? 1 : 0);
+        if (dec->first || prev == 0 || level == 1) {
+            return 0;
+        }
+        dec->state = 1;
+        dec->t0 = (double)dec->pos;
+        dec->bit = 0;
+        dec->data = 0;
+        dec->flags = 0;
+    }
+
+    while (dec->t0 + (dec->bit + 0.5) * c->samples_per_bit < end) {
+        uint32_t k = dec->bit++;
+        if (k == 0) {
+            if (level) {
+                dec->state = 0;
+                return 0;
+            }
+        } else if (k <= c->data_bits) {
+            dec->data |= level << (k - 1);
+        } else if (parity_bit && k == c->data_bits + 1u) {
+            uint32_t ones = __builtin_popcount(dec->data) + level;
+            if ((c->parity == RP_LA_PARITY_ODD) != (ones & 1)) {
+                dec->flags |= RP_LA_FLAG_PARITY_ERR;
+            }
+        } else if (!level) {
+            dec->flags |= RP_LA_FLAG_FRAMING_ERR;
+        }
+        if (dec->bit == total) {
+            dec->state = 0;
+            return la_proto_frame(f, RP_LA_FRAME_UART, (uint64_t)dec->t0,
+                                  llround(total * c->samples_per_bit),
+                                  dec->data, c->data_bits, dec->flags);
+        }
+    }
+    return 0;
+}
+
+/**
+ * SPI: data lines are taken on the sampling edge of SCLK (leading edge for
+ * CPHA 0, trailing for CPHA 1). With a chip select the word alignment restarts
+ * on every select and a partial word is reported on deselect.
+ */
+static size_t la_proto_spi(rp_la_proto_t *dec, uint8_t v, rp_la_frame_t *f) {
+    const rp_la_spi_cfg_t *c = &dec->cfg.spi;
+    size_t n = 0;
+    bool selected = true;
+
+    if (c->cs >= 0) {
+        uint32_t cs_prev = LA_BIT(dec->prev, c->cs);
+        uint32_t cs_now = LA_BIT(v, c->cs);
+        if (!cs_prev && cs_now && dec->bit) {
+            n += la_proto_frame(f + n, RP_LA_FRAME_SPI, dec->start, dec->pos - dec->start,
+                                dec->data | (dec->data2 << 16), dec->bit, RP_LA_FLAG_INCOMPLETE);
+        }
+        if (cs_prev != cs_now) {
+            dec->bit = 0;
+        }
+        selected = !cs_now;
+    }
+
+    if (selected && LA_BIT(dec->prev, c->sclk) != LA_BIT(v, c->sclk)) {
+        bool leading = LA_BIT(dec->prev, c->sclk) == c->cpol;
+        if (leading != (c->cpha != 0)) {
+            uint32_t mosi = LA_BIT(v, c->mosi);
+            uint32_t miso = LA_BIT(v, c->miso);
+            if (dec->bit == 0) {
+                dec->start = dec->pos;
+                dec->data = 0;
+                dec->data2 = 0;
+            }
+            if (c->msb_first) {
+                dec->data = (dec->data << 1) | mosi;
+                dec->data2 = (dec->data2 << 1) | miso;
+            } else {
+                dec->data |= mosi << dec->bit;
+                dec->data2 |= miso << dec->bit;
+            }
+            if (++dec->bit == c->word_bits) {
+                n += la_proto_frame(f + n, RP_LA_FRAME_SPI, dec->start, dec->pos - dec->start + 1,
+                                    dec->data | (dec->data2 << 16), c->word_bits, 0);
+                dec->bit = 0;
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * I2C: SDA changing while SCL stays high is a START (falling) or STOP (rising),
+ * bits are taken on the rising SCL edge, the ninth bit is the acknowledge.
+ * state 0 idle, 1 address byte, 2 data bytes.
+ */
+static size_t la_proto_i2c(rp_la_proto_t *dec, uint8_t v, rp_la_frame_t *f) {
+    const rp_la_i2c_cfg_t *c = &dec->cfg.i2c;
+    uint32_t scl_prev = LA_BIT(dec->prev, c->scl);
+    uint32_t scl_now = LA_BIT(v, c->scl);
+    uint32_t sda_prev = LA_BIT(dec->prev, c->sda);
+    uint32_t sda_now = LA_BIT(v, c->sda);
+
+    if (scl_prev && scl_now && sda_prev != sda_now) {
+        if (!sda_now) {
+            dec->flags = dec->state ? RP_LA_FLAG_RESTART : 0;
+            dec->state = 1;
+            dec->bit = 0;
+            return 0;
+        }
+        if (dec->state) {
+            dec->state = 0;
+            return la_proto_frame(f, RP_LA_FRAME_I2C_STOP, dec->pos, 1, 0, 0, 0);
+        }
+        return 0;
+    }
+
+    if (dec->state && !scl_prev && scl_now) {
+        if (dec->bit < 8) {
+            if (dec->bit == 0) {
+                dec->start = dec->pos;
+                dec->data = 0;
+            }
+            dec->data = (dec->data << 1) | sda_now;
+            dec->bit++;
+        } else {
+            uint8_t type = dec->state == 1 ? RP_LA_FRAME_I2C_ADDR : RP_LA_FRAME_I2C_DATA;
+            uint8_t flags = dec->flags | (sda_now ? RP_LA_FLAG_NACK : 0);
+            dec->state = 2;
+            dec->bit = 0;
+            dec->flags = 0;
+            return la_proto_frame(f, type, dec->start, dec->pos - dec->start + 1, dec->data, 8, flags);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Feeds records to the decoder. Stops early when fewer than
+ * RP_LA_PROTO_RECORD_FRAMES frames are left, *consumed tells where to resume.
+ */
+int rp_LaProtoDecode(rp_la_proto_t *dec, const uint16_t *records, size_t count, size_t *consumed,
+                     rp_la_frame_t *frames, size_t max_frames, size_t *produced) {
+    size_t i;
+    size_t n = 0;
+
+    if (dec == NULL || (records == NULL && count) || (frames == NULL && max_frames)) {
+        return RP_EOOR;
+    }
+    for (i = 0; i < count && max_frames - n >= RP_LA_PROTO_RECORD_FRAMES; i++) {
+        uint8_t  v = RP_LA_RLE_DATA(records[i]);
+        uint32_t len = RP_LA_RLE_LEN(records[i]);
+
+        if (!dec->first) {
+            switch (dec->type) {
+            case RP_LA_FRAME_UART:
+                n += la_proto_uart(dec, v, len, frames + n);
+                break;
+            case RP_LA_FRAME_SPI:
+                n += la_proto_spi(dec, v, frames + n);
+                break;
+            default:
+                n += la_proto_i2c(dec, v, frames + n);
+                break;
+            }
+        }
+        dec->first = false;
+        dec->prev = v;
+        dec->pos += len;
+    }
+    if (consumed) {
+        *consumed = i;
+    }
+    if (produced) {
+        *produced = n;
+    }
+    return RP_OK;
+}
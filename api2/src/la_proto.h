@@ -0,0 +1,113 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library logic analyzer protocol decoders interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+// UART, SPI and I2C decoders working on the RLE records of the logic analyzer.
+// A decoder only looks at run boundaries and bit sampling points, captures are
+// never expanded to one value per sample. Records can be passed in any number
+// of calls, the decoder keeps its state and the absolute sample position, so
+// only the decoded frames need to leave the board.
+
+#ifndef __LA_PROTO_H
+#define __LA_PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "la_rle.h"
+
+/** Frame types */
+#define RP_LA_FRAME_UART      1
+#define RP_LA_FRAME_SPI       2 ///< data: MOSI word in [15:0], MISO word in [31:16]
+#define RP_LA_FRAME_I2C_ADDR  3 ///< data: address byte incl. R/W bit
+#define RP_LA_FRAME_I2C_DATA  4
+#define RP_LA_FRAME_I2C_STOP  5
+
+/** Frame flags */
+#define RP_LA_FLAG_PARITY_ERR  (1<<0) ///< UART parity mismatch
+#define RP_LA_FLAG_FRAMING_ERR (1<<1) ///< UART stop bit low
+#define RP_LA_FLAG_NACK        (1<<2) ///< I2C byte not acknowledged
+#define RP_LA_FLAG_RESTART     (1<<3) ///< I2C address after a repeated start
+#define RP_LA_FLAG_INCOMPLETE  (1<<4) ///< SPI word cut short by chip select
+
+/** Frames a single record can complete at most, all decoders act on one edge */
+#define RP_LA_PROTO_RECORD_FRAMES 1
+
+typedef struct {
+    uint64_t start;    ///< sample index of the first bit / edge
+    uint32_t length;   ///< frame length in samples
+    uint32_t data;
+    uint8_t  type;     ///< RP_LA_FRAME_*
+    uint8_t  flags;    ///< RP_LA_FLAG_*
+    uint16_t bits;     ///< number of valid data bits
+} rp_la_frame_t;
+
+typedef enum {
+    RP_LA_PARITY_NONE = 0,
+    RP_LA_PARITY_ODD,
+    RP_LA_PARITY_EVEN
+} rp_la_parity_t;
+
+typedef struct {
+    uint8_t        line;            ///< digital line 0..7
+    double         samples_per_bit; ///< acquisition rate / baud rate, >= 2
+    uint8_t        data_bits;       ///< 5..9, LSB first
+    rp_la_parity_t parity;
+    uint8_t        stop_bits;       ///< 1 or 2
+    bool           inverted;        ///< idle low line
+} rp_la_uart_cfg_t;
+
+typedef struct {
+    uint8_t sclk;
+    uint8_t mosi;
+    uint8_t miso;
+    int8_t  cs;        ///< active low chip select line, -1 if not used
+    uint8_t cpol;
+    uint8_t cpha;
+    uint8_t word_bits; ///< 1..16
+    bool    msb_first;
+} rp_la_spi_cfg_t;
+
+typedef struct {
+    uint8_t scl;
+    uint8_t sda;
+} rp_la_i2c_cfg_t;
+
+typedef struct {
+    uint8_t  type;   ///< RP_LA_FRAME_UART, RP_LA_FRAME_SPI or RP_LA_FRAME_I2C_ADDR
+    union {
+        rp_la_uart_cfg_t uart;
+        rp_la_spi_cfg_t  spi;
+        rp_la_i2c_cfg_t  i2c;
+    } cfg;
+    uint64_t pos;    ///< absolute index of the next sample
+    bool     first;  ///< no record seen yet
+    uint8_t  prev;   ///< line states of the previous record
+    // frame in progress
+    int      state;
+    uint64_t start;
+    double   t0;
+    uint32_t bit;
+    uint32_t data;
+    uint32_t data2;
+    uint8_t  flags;
+} rp_la_proto_t;
+
+int rp_LaProtoUartInit(rp_la_proto_t *dec, const rp_la_uart_cfg_t *cfg);
+int rp_LaProtoSpiInit(rp_la_proto_t *dec, const rp_la_spi_cfg_t *cfg);
+int rp_LaProtoI2cInit(rp_la_proto_t *dec, const rp_la_i2c_cfg_t *cfg);
+int rp_LaProtoDecode(rp_la_proto_t *dec, const uint16_t *records, size_t count, size_t *consumed,
+                     rp_la_frame_t *frames, size_t max_frames, size_t *produced);
+
+#endif // __LA_PROTO_H
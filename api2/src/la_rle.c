@@ -0,0 +1,224 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library logic analyzer RLE decoder implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LA_RLE_USE_NEON
+#endif
+
+#include "redpitaya/rp2.h"
+#include "la_rle.h"
+
+#define LA_RLE_SPLAT 16
+
+// Stores LA_RLE_SPLAT copies of the value, the caller guarantees the room.
+static inline void la_rle_splat(uint8_t *dst, uint8_t value) {
+#ifdef LA_RLE_USE_NEON
+    vst1q_u8(dst, vdupq_n_u8(value));
+#else
+    uint64_t v = value * 0x0101010101010101ULL;
+    memcpy(dst, &v, sizeof(v));
+    memcpy(dst + sizeof(v), &v, sizeof(v));
+#endif
+}
+
+// Sets bits [from, from + n) of a bit plane, bit 0 of byte 0 is the first sample.
+static void la_rle_set_bits(uint8_t *plane, size_t from, size_t n) {
+    size_t to = from + n;
+    size_t b0 = from >> 3;
+    size_t b1 = to >> 3;
+    uint8_t head = (uint8_t)(0xff << (from & 7));
+    uint8_t tail = (uint8_t)((1u << (to & 7)) - 1);
+
+    if (b0 == b1) {
+        plane[b0] |= head & tail;
+        return;
+    }
+    plane[b0] |= head;
+    if (b1 > b0 + 1) {
+        memset(plane + b0 + 1, 0xff, b1 - b0 - 1);
+    }
+    if (tail) {
+        plane[b1] |= tail;
+    }
+}
+
+// Returns the record holding sample 'first', *start is its first sample. The
+// index narrows the walk to at most index_step records.
+static size_t la_rle_seek(const rp_la_rle_t *rle, uint64_t first, uint64_t *start) {
+    size_t lo = 0;
+    size_t hi = rle->index_len;
+    size_t rec;
+    uint64_t pos;
+
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (rle->index[mid] <= first) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    rec = lo * rle->index_step;
+    pos = rle->index[lo];
+    while (rec < rle->count && pos + RP_LA_RLE_LEN(rle->records[rec]) <= first) {
+        pos += RP_LA_RLE_LEN(rle->records[rec]);
+        rec++;
+    }
+    *start = pos;
+    return rec;
+}
+
+int rp_LaRleOpen(rp_la_rle_t *rle, const uint16_t *records, size_t count, uint32_t index_step) {
+    size_t i;
+    uint64_t samples = 0;
+
+    if (rle == NULL || (records == NULL && count)) {
+        return RP_EOOR;
+    }
+    memset(rle, 0, sizeof(*rle));
+    rle->records = records;
+    rle->count = count;
+    rle->index_step = index_step ? index_step : RP_LA_RLE_INDEX_STEP;
+    rle->index_len = count / rle->index_step + 1;
+    rle->index = (uint64_t *) malloc(rle->index_len * sizeof(uint64_t));
+    if (rle->index == NULL) {
+        return RP_EOOR;
+    }
+    for (i = 0; i < count; i++) {
+        if (i % rle->index_step == 0) {
+            rle->index[i / rle->index_step] = samples;
+        }
+        samples += RP_LA_RLE_LEN(records[i]);
+    }
+    // entry past the last record when count is a multiple of the step
+    if (count % rle->index_step == 0) {
+        rle->index[rle->index_len - 1] = samples;
+    }
+    rle->samples = samples;
+    return RP_OK;
+}
+
+int rp_LaRleClose(rp_la_rle_t *rle) {
+    if (rle == NULL) {
+        return RP_EOOR;
+    }
+    free(rle->index);
+    memset(rle, 0, sizeof(*rle));
+    return RP_OK;
+}
+
+uint64_t rp_LaRleSamples(const rp_la_rle_t *rle) {
+    return rle ? rle->samples : 0;
+}
+
+/**
+ * Expands samples [first, first + count) into one byte per sample.
+ * Runs are at most 256 samples and short ones dominate, a run that fits is
+ * written with a single 16 byte store. The bytes past the run are overwritten
+ * by the following runs, so the over-store is only used while 16 bytes of
+ * the window are left.
+ */
+int rp_LaRleDecodeBytes(const rp_la_rle_t *rle, uint64_t first, size_t count, uint8_t *out) {
+    uint64_t start;
+    size_t rec;
+    size_t skip;
+    size_t pos = 0;
+
+    if (rle == NULL || out == NULL || first + count > rle->samples) {
+        return RP_EOOR;
+    }
+    if (count == 0) {
+        return RP_OK;
+    }
+    rec = la_rle_seek(rle, first, &start);
+    skip = first - start;
+    while (pos < count) {
+        uint16_t r = rle->records[rec++];
+        uint8_t  v = RP_LA_RLE_DATA(r);
+        size_t   n = RP_LA_RLE_LEN(r) - skip;
+
+        skip = 0;
+        if (n > count - pos) {
+            n = count - pos;
+        }
+        if (n <= LA_RLE_SPLAT && count - pos >= LA_RLE_SPLAT) {
+            la_rle_splat(out + pos, v);
+        } else {
+            memset(out + pos, v, n);
+        }
+        pos += n;
+    }
+    return RP_OK;
+}
+
+/**
+ * Expands samples [first, first + count) into RP_LA_RLE_LINES bit planes, plane
+ * n starts at planes + n * stride and needs (count + 7) / 8 bytes. Instead of
+ * touching every plane for every run, a line is only written when it falls
+ * (or at the end of the window) with all the samples it was high for.
+ */
+int rp_LaRleDecodePlanes(const rp_la_rle_t *rle, uint64_t first, size_t count, uint8_t *planes, size_t stride) {
+    uint64_t start;
+    size_t rec;
+    size_t skip;
+    size_t pos = 0;
+    size_t since[RP_LA_RLE_LINES];
+    size_t plane_len = (count + 7) / 8;
+    uint8_t state = 0;
+    unsigned line;
+
+    if (rle == NULL || planes == NULL || stride < plane_len || first + count > rle->samples) {
+        return RP_EOOR;
+    }
+    for (line = 0; line < RP_LA_RLE_LINES; line++) {
+        memset(planes + line * stride, 0, plane_len);
+    }
+    if (count == 0) {
+        return RP_OK;
+    }
+    rec = la_rle_seek(rle, first, &start);
+    skip = first - start;
+    while (pos < count) {
+        uint16_t r = rle->records[rec++];
+        uint8_t  v = RP_LA_RLE_DATA(r);
+        size_t   n = RP_LA_RLE_LEN(r) - skip;
+        unsigned changed = state ^ v;
+
+        skip = 0;
+        if (n > count - pos) {
+            n = count - pos;
+        }
+        while (changed) {
+            line = __builtin_ctz(changed);
+            changed &= changed - 1;
+            if (v & (1u << line)) {
+                since[line] = pos;
+            } else {
+                la_rle_set_bits(planes + line * stride, since[line], pos - since[line]);
+            }
+        }
+        state = v;
+        pos += n;
+    }
+    while (state) {
+        line = __builtin_ctz(state);
+        state &= state - 1;
+        la_rle_set_bits(planes + line * stride, since[line], count - since[line]);
+    }
+    return RP_OK;
+}
@@ -0,0 +1,49 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library logic analyzer RLE decoder interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+// Expands the RLE records of the logic analyzer (rp_LaAcqEnableRLE()) into one
+// byte per sample or into one bit plane per digital line. A sparse index of the
+// cumulative run lengths lets a time window be decoded without expanding the
+// records before it. The module only depends on libc, host tools can build
+// la_rle.c together with rp2.h to decode captures off-board.
+
+#ifndef __LA_RLE_H
+#define __LA_RLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** RLE record: bits [15:8] run length - 1, bits [7:0] state of the 8 lines */
+#define RP_LA_RLE_LEN(r)   ((uint32_t)(((uint16_t)(r)) >> 8) + 1)
+#define RP_LA_RLE_DATA(r)  ((uint8_t)(r))
+
+#define RP_LA_RLE_LINES       8
+#define RP_LA_RLE_INDEX_STEP  256 ///< default records per index entry
+
+typedef struct {
+    const uint16_t *records;    ///< records in acquisition order, not copied
+    size_t          count;      ///< number of records
+    uint32_t        index_step; ///< records per index entry
+    uint64_t       *index;      ///< samples before record n*index_step
+    size_t          index_len;
+    uint64_t        samples;    ///< total number of decoded samples
+} rp_la_rle_t;
+
+int rp_LaRleOpen(rp_la_rle_t *rle, const uint16_t *records, size_t count, uint32_t index_step);
+int rp_LaRleClose(rp_la_rle_t *rle);
+uint64_t rp_LaRleSamples(const rp_la_rle_t *rle);
+int rp_LaRleDecodeBytes(const rp_la_rle_t *rle, uint64_t first, size_t count, uint8_t *out);
+int rp_LaRleDecodePlanes(const rp_la_rle_t *rle, uint64_t first, size_t count, uint8_t *planes, size_t stride);
+
+#endif // __LA_RLE_H
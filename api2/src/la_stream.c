@@ -0,0 +1,132 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library logic analyzer streaming module implementation
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "la_acq.h"
+#include "la_rle.h"
+#include "rp_dma.h"
+#include "la_stream.h"
+
+int rp_LaStreamOpen(rp_handle_uio_t *la, rp_la_stream_t *stream, uint32_t sgmnt_cnt, size_t sgmnt_size) {
+    if (sgmnt_size % sizeof(uint16_t)) {
+        return RP_EOOR;
+    }
+    memset(stream, 0, sizeof(*stream));
+    stream->la = la;
+    return rp_DmaRxOpen(la, &stream->rx, sgmnt_cnt, sgmnt_size);
+}
+
+int rp_LaStreamClose(rp_la_stream_t *stream) {
+    if (stream->running) {
+        rp_LaStreamStop(stream);
+    }
+    return rp_DmaRxClose(&stream->rx);
+}
+
+/**
+ * Captures from the start on, the trigger settings are not used. The
+ * decimation and polarity set before apply.
+ */
+int rp_LaStreamStart(rp_la_stream_t *stream, bool rle) {
+    int status;
+
+    if (stream->running) {
+        return RP_OK;
+    }
+    rp_LaAcqStopCapture(stream->la);
+    rp_LaAcqSetConfig(stream->la, RP_LA_ACQ_CFG_CONT_MASK | RP_LA_ACQ_CFG_AUTO_MASK);
+    if (rle) {
+        rp_LaAcqEnableRLE(stream->la);
+    } else {
+        rp_LaAcqDisableRLE(stream->la);
+    }
+    stream->rle = rle;
+    stream->samples = 0;
+
+    status = rp_DmaRxStart(&stream->rx);
+    if (status != RP_OK) {
+        return status;
+    }
+    rp_LaAcqRunCapture(stream->la);
+    stream->running = true;
+    return RP_OK;
+}
+
+/** The segment being filled when stopped is not delivered */
+int rp_LaStreamStop(rp_la_stream_t *stream) {
+    if (!stream->running) {
+        return RP_OK;
+    }
+    rp_LaAcqStopCapture(stream->la);
+    rp_DmaRxStop(&stream->rx);
+    rp_LaAcqSetConfig(stream->la, 0);
+    stream->running = false;
+    return RP_OK;
+}
+
+/** Becomes readable (POLLIN) whenever a segment completed */
+int rp_LaStreamFd(rp_la_stream_t *stream) {
+    return rp_DmaRxFd(&stream->rx);
+}
+
+/**
+ * Non-blocking, see rp_DmaRxGet(). At most sgmnt_cnt - 1 segments can be held,
+ * the capture overwrites the oldest one when the application holds more.
+ */
+int rp_LaStreamGet(rp_la_stream_t *stream, rp_la_stream_sgmnt_t *sgmnts, size_t max, size_t *count) {
+    rp_dma_sgmnt_t dma[RP_DMA_MAX_SGMNT_CNT];
+    size_t n;
+
+    if (max > RP_DMA_MAX_SGMNT_CNT) {
+        max = RP_DMA_MAX_SGMNT_CNT;
+    }
+    int status = rp_DmaRxGet(&stream->rx, dma, max, &n);
+    for (size_t i = 0; i < n; i++) {
+        rp_la_stream_sgmnt_t *s = &sgmnts[i];
+        s->seq = dma[i].seq;
+        s->lost = dma[i].overflow;
+        s->rle = stream->rle;
+        s->data = (const uint16_t *) dma[i].data;
+        s->count = dma[i].size / sizeof(uint16_t);
+        s->samples = rp_LaStreamCountSamples(s->data, s->count, s->rle);
+        s->first = stream->samples;
+        stream->samples += s->samples;
+    }
+    *count = n;
+    return status;
+}
+
+/** Hands back all delivered segments up to and including seq */
+int rp_LaStreamRelease(rp_la_stream_t *stream, uint64_t seq) {
+    return rp_DmaRxRelease(&stream->rx, seq);
+}
+
+/** Segments dropped since start */
+int rp_LaStreamGetLost(rp_la_stream_t *stream, uint64_t *sgmnts) {
+    return rp_DmaRxGetOverflows(&stream->rx, sgmnts);
+}
+
+/** Samples held by count words of raw samples or RLE records */
+uint64_t rp_LaStreamCountSamples(const uint16_t *data, size_t count, bool rle) {
+    if (!rle) {
+        return count;
+    }
+    uint64_t samples = 0;
+    for (size_t i = 0; i < count; i++) {
+        samples += RP_LA_RLE_LEN(data[i]);
+    }
+    return samples;
+}
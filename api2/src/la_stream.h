@@ -0,0 +1,64 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya library logic analyzer streaming module interface
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+// Captures the digital lines without a length limit. The acquisition runs in
+// continuous mode into the cyclic DMA RX ring, the application takes completed
+// segments of raw samples or RLE records (rp_LaAcqEnableRLE()) in place and
+// hands them back. Segments the application does not keep up with are dropped
+// and reported, the capture itself keeps running.
+
+#ifndef __LA_STREAM_H
+#define __LA_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common.h"
+#include "rp_dma.h"
+
+#define RP_LA_STREAM_SGMNT_CNT  8
+#define RP_LA_STREAM_SGMNT_SIZE (256*1024)
+
+/** Completed segment, valid until released */
+typedef struct {
+    uint64_t        seq;     ///< for rp_LaStreamRelease()
+    uint64_t        first;   ///< samples delivered before this segment, dropped ones not included
+    uint64_t        samples; ///< samples in the segment, run lengths summed with RLE
+    bool            lost;    ///< segments were dropped right before this one
+    bool            rle;     ///< data holds RLE records, see la_rle.h
+    const uint16_t *data;    ///< raw samples or RLE records
+    size_t          count;   ///< number of 16 bit words in data
+} rp_la_stream_sgmnt_t;
+
+typedef struct {
+    rp_handle_uio_t *la;      ///< handle of rp_LaAcqOpen(), its DMA device is used
+    rp_dma_rx_t      rx;
+    bool             rle;
+    bool             running;
+    uint64_t         samples; ///< samples delivered since start
+} rp_la_stream_t;
+
+int rp_LaStreamOpen(rp_handle_uio_t *la, rp_la_stream_t *stream, uint32_t sgmnt_cnt, size_t sgmnt_size);
+int rp_LaStreamClose(rp_la_stream_t *stream);
+int rp_LaStreamStart(rp_la_stream_t *stream, bool rle);
+int rp_LaStreamStop(rp_la_stream_t *stream);
+int rp_LaStreamFd(rp_la_stream_t *stream);
+int rp_LaStreamGet(rp_la_stream_t *stream, rp_la_stream_sgmnt_t *sgmnts, size_t max, size_t *count);
+int rp_LaStreamRelease(rp_la_stream_t *stream, uint64_t seq);
+int rp_LaStreamGetLost(rp_la_stream_t *stream, uint64_t *sgmnts);
+
+uint64_t rp_LaStreamCountSamples(const uint16_t *data, size_t count, bool rle);
+
+#endif // __LA_STREAM_H
@@ -12,6 +12,7 @@
 #include "common.h"
 
 #include "la_acq.h"
+#include "la_stream.h"
 
 /** SIGNAL ACQUISTION  */
 
@@ -28,6 +29,12 @@ rp_acq_data_t acq_data;
 
 bool g_acq_running=false;
 
+/** Streaming mode, the ring is opened on the first rp_RunStreaming() */
+static rp_la_stream_t la_stream;
+static bool la_stream_open=false;
+static uint32_t la_stream_pos=0;     ///< next write index in the data buffer
+static uint64_t la_stream_limit=0;   ///< samples to autostop after, 0 runs until rp_Stop()
+
 /**
  * Open device
  */
@@ -44,6 +51,10 @@ RP_STATUS rp_OpenUnit(void) {
  */
 RP_STATUS rp_CloseUnit(void) {
     int r=RP_API_OK;
+    if(la_stream_open){
+        rp_LaStreamClose(&la_stream);
+        la_stream_open=false;
+    }
     if(rp_LaAcqClose(&la_acq_handle)!=RP_API_OK){
         r=-1;
     }
@@ -407,8 +418,44 @@ RP_STATUS rp_RunStreaming(uint32_t * sampleInterval,
                         RP_RATIO_MODE downSampleRatioMode,
                         uint32_t overviewBufferSize)
 {
+    static const double unit_ns[]={1e-6, 1e-3, 1, 1e3, 1e6, 1e9};
 
-    // configure FPGA to start block mode
+    if(sampleInterval==NULL){
+        return RP_NULL_PARAMETER;
+    }
+    if(sampleIntervalTimeUnits<RP_FS || sampleIntervalTimeUnits>RP_S){
+        return RP_INVALID_PARAMETER;
+    }
+    if(acq_data.buf==NULL || acq_data.buf_size==0){
+        return RP_INVALID_PARAMETER;
+    }
+
+    // sample rate = 125Msps/(dec+1)
+    double interval=*sampleInterval*unit_ns[sampleIntervalTimeUnits];
+    double dec=round(interval/c_max_dig_sampling_rate_time_interval_ns)-1;
+    if(dec<0){
+        dec=0;
+    }
+    rp_la_decimation_regset_t d;
+    d.dec=(uint32_t)dec;
+    rp_LaAcqSetDecimation(&la_acq_handle, d);
+    *sampleInterval=(uint32_t)round((d.dec+1)*c_max_dig_sampling_rate_time_interval_ns/unit_ns[sampleIntervalTimeUnits]);
+
+    if(!la_stream_open){
+        if(rp_LaStreamOpen(&la_acq_handle, &la_stream, RP_LA_STREAM_SGMNT_CNT, RP_LA_STREAM_SGMNT_SIZE)!=RP_OK){
+            return RP_STREAMING_FAILED;
+        }
+        la_stream_open=true;
+    }
+
+    bool rle;
+    rp_LaAcqIsRLE(&la_acq_handle, &rle);
+    la_stream_pos=0;
+    la_stream_limit=autoStop ? (uint64_t)maxPreTriggerSamples+maxPostTriggerSamples : 0;
+    if(rp_LaStreamStart(&la_stream, rle)!=RP_OK){
+        return RP_STREAMING_FAILED;
+    }
+    g_acq_running=true;
     return RP_API_OK;
 };
 
@@ -642,30 +689,49 @@ RP_STATUS rp_GetValuesAsync(
 RP_STATUS rp_GetStreamingLatestValues(rpStreamingReady rpReady,
                                      void * pParameter)
 {
-    // block read
-    int32_t noOfSamples;
-    uint32_t startIndex;
-    int16_t overflow;
-    uint32_t triggerAt;
-    int16_t triggered;
-    int16_t autoStop;
-
-    noOfSamples=0;
-    startIndex=0;
-    overflow=0;
-    triggerAt=0;
-    triggered=0;
-    autoStop=0;
+    rp_la_stream_sgmnt_t sgmnts[RP_LA_STREAM_SGMNT_CNT];
+    size_t count;
 
-    // acquisition is completed -> callback
-    (*rpReady)(noOfSamples,
-               startIndex,
-               overflow,
-               triggerAt,
-               triggered,
-               autoStop,
-               pParameter);
+    if(!la_stream_open || !la_stream.running){
+        return RP_NO_SAMPLES_AVAILABLE;
+    }
+    if(rp_LaStreamGet(&la_stream, sgmnts, RP_LA_STREAM_SGMNT_CNT, &count)!=RP_OK){
+        return RP_STREAMING_FAILED;
+    }
+    if(count==0){
+        return RP_BUSY;
+    }
 
+    // each segment goes to the data buffer in place of the overview buffer,
+    // in chunks that fit before its end; with RLE the buffer gets records
+    for(size_t i=0; i<count; i++){
+        const rp_la_stream_sgmnt_t *s=&sgmnts[i];
+        int16_t overflow=s->lost ? 1 : 0;
+        int16_t autoStop=la_stream_limit && s->first+s->samples>=la_stream_limit;
+        size_t done=0;
+
+        while(done<s->count){
+            size_t n=s->count-done;
+            if(n>acq_data.buf_size-la_stream_pos){
+                n=acq_data.buf_size-la_stream_pos;
+            }
+            memcpy(&acq_data.buf[la_stream_pos], s->data+done, n*sizeof(uint16_t));
+            done+=n;
+            (*rpReady)(n, la_stream_pos, overflow, 0, 0, autoStop && done==s->count, pParameter);
+            overflow=0;
+            la_stream_pos=(la_stream_pos+n)%acq_data.buf_size;
+        }
+        if(autoStop){
+            count=i+1;
+            break;
+        }
+    }
+    rp_LaStreamRelease(&la_stream, sgmnts[count-1].seq);
+
+    if(la_stream_limit && la_stream.samples>=la_stream_limit){
+        rp_LaStreamStop(&la_stream);
+        g_acq_running=false;
+    }
     return RP_API_OK;
 }
 
@@ -675,6 +741,11 @@ RP_STATUS rp_GetStreamingLatestValues(rpStreamingReady rpReady,
  * Always call this function after the end of a capture to ensure that the scope is ready for the next capture.
  */
 RP_STATUS rp_Stop(void){
+	if(la_stream_open && la_stream.running){
+		rp_LaStreamStop(&la_stream);
+		g_acq_running=false;
+		return RP_API_OK;
+	}
 	return rp_SoftwareTrigger();
 	//return rp_LaAcqStopAcq(&la_acq_handle);
 }
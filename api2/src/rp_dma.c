@@ -2,7 +2,10 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -45,6 +48,12 @@ int rp_DmaCtrl(rp_handle_uio_t *handle, RP_DMA_CTRL ctrl) {
         case RP_DMA_STOP_RX:
             ioctl(handle->dma_fd, STOP_RX, 0);
         break;
+        case RP_DMA_CYCLIC_TX:
+            ioctl(handle->dma_fd, CYCLIC_TX, 0);
+        break;
+        case RP_DMA_STOP_TX:
+            ioctl(handle->dma_fd, STOP_TX, 0);
+        break;
         default:
             return RP_EOOR;
     }
@@ -61,6 +70,16 @@ int rp_SetSgmntS(rp_handle_uio_t *handle, unsigned long no) {
     return RP_OK;
 }
 
+int rp_SetTxSgmntC(rp_handle_uio_t *handle, unsigned long no) {
+    ioctl(handle->dma_fd, SET_TX_SGMNT_CNT, no);
+    return RP_OK;
+}
+
+int rp_SetTxSgmntS(rp_handle_uio_t *handle, unsigned long no) {
+    ioctl(handle->dma_fd, SET_TX_SGMNT_SIZE, no);
+    return RP_OK;
+}
+
 int rp_DmaRead(rp_handle_uio_t *handle) {
     int s = read(handle->dma_fd, NULL, 1);
     if (s<0) {
@@ -70,6 +89,26 @@ int rp_DmaRead(rp_handle_uio_t *handle) {
     return RP_OK;
 }
 
+// Blocks until the driver has room for the data in the TX ring
+int rp_DmaWrite(rp_handle_uio_t *handle, const void *buf, size_t size) {
+    ssize_t s = write(handle->dma_fd, buf, size);
+    if (s<0) {
+      printf("write error\n");
+      return -1;
+    }
+    return (int)s;
+}
+
+// One of the STATUS_* values from rpdma.h
+int rp_DmaStatus(rp_handle_uio_t *handle, int *status) {
+    int s = ioctl(handle->dma_fd, STATUS, 0);
+    if (s<0) {
+      return -1;
+    }
+    *status = s;
+    return RP_OK;
+}
+
 int rp_DmaClose(rp_handle_uio_t *handle) {
     if(handle->dma_fd){
         if(close(handle->dma_fd)==-1){
@@ -79,3 +118,300 @@ int rp_DmaClose(rp_handle_uio_t *handle) {
     free(handle->dma_dev);
     return RP_OK;
 }
+
+// Big endian cells of a device tree property, at most two 32 bit cells used.
+static uint64_t rp_DmaDtCells(const uint8_t *p, int cells) {
+    uint64_t v = 0;
+    int i;
+    for (i = 0; i < cells * 4; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static int rp_DmaDtReadCells(const char *path, int *cells) {
+    uint8_t b[4];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    if (fread(b, 1, sizeof(b), f) == sizeof(b)) {
+        *cells = (int) rp_DmaDtCells(b, 1);
+    }
+    fclose(f);
+    return 0;
+}
+
+/**
+ * Size of the memory reserved for the RX ring, the reg property of the labuf
+ * node under reserved-memory in the live device tree. Falls back to the
+ * RX_SGMNT_CNT * RX_SGMNT_SIZE build default when the node is not there.
+ */
+int rp_DmaGetReserved(size_t *size) {
+    char path[512];
+    uint8_t reg[16];
+    int addr_cells = 1;
+    int size_cells = 1;
+    struct dirent *e;
+    DIR *dir;
+    FILE *f;
+    size_t n = 0;
+
+    *size = (size_t) RX_SGMNT_CNT * RX_SGMNT_SIZE;
+    dir = opendir(RP_DMA_RESERVED_DT);
+    if (dir == NULL) {
+        return RP_OK;
+    }
+    rp_DmaDtReadCells(RP_DMA_RESERVED_DT "/#address-cells", &addr_cells);
+    rp_DmaDtReadCells(RP_DMA_RESERVED_DT "/#size-cells", &size_cells);
+    while ((e = readdir(dir)) != NULL) {
+        if (strncmp(e->d_name, "labuf@", 6) == 0) {
+            snprintf(path, sizeof(path), RP_DMA_RESERVED_DT "/%s/reg", e->d_name);
+            break;
+        }
+    }
+    closedir(dir);
+    if (e == NULL || addr_cells < 1 || addr_cells > 2 || size_cells < 1 || size_cells > 2) {
+        return RP_OK;
+    }
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        return RP_OK;
+    }
+    n = fread(reg, 1, sizeof(reg), f);
+    fclose(f);
+    if (n >= (size_t)(addr_cells + size_cells) * 4) {
+        *size = (size_t) rp_DmaDtCells(reg + addr_cells * 4, size_cells);
+    }
+    return RP_OK;
+}
+
+/** Checks a ring against the driver limits and the reserved memory */
+int rp_DmaCheckGeometry(uint32_t sgmnt_cnt, size_t sgmnt_size) {
+    size_t reserved;
+
+    if (sgmnt_cnt < RP_DMA_MIN_SGMNT_CNT || sgmnt_cnt > RP_DMA_MAX_SGMNT_CNT ||
+        sgmnt_size == 0 || sgmnt_size > RX_SGMNT_SIZE || sgmnt_size % RP_DMA_SGMNT_ALIGN) {
+        return RP_EOOR;
+    }
+    rp_DmaGetReserved(&reserved);
+    if ((uint64_t) sgmnt_cnt * sgmnt_size > reserved) {
+        return RP_EOOR;
+    }
+    return RP_OK;
+}
+
+/**
+ * Picks a ring for a data rate [bytes/s]. A segment is what the application
+ * waits for, so its size follows the latency [s]. The rest of the reserved
+ * memory becomes more segments, which only adds slack for a slow consumer.
+ * latency <= 0 asks for throughput: the largest segments, fewest interrupts.
+ */
+int rp_DmaChooseGeometry(double rate, double latency, uint32_t *sgmnt_cnt, size_t *sgmnt_size) {
+    size_t reserved;
+    size_t size = RX_SGMNT_SIZE;
+    size_t cnt;
+
+    if (rate <= 0) {
+        return RP_EOOR;
+    }
+    rp_DmaGetReserved(&reserved);
+    if (latency > 0 && rate * latency < size) {
+        size = (size_t)(rate * latency);
+    }
+    // at least two segments have to fit
+    if (size > reserved / RP_DMA_MIN_SGMNT_CNT) {
+        size = reserved / RP_DMA_MIN_SGMNT_CNT;
+    }
+    size -= size % RP_DMA_SGMNT_ALIGN;
+    if (size < RP_DMA_SGMNT_ALIGN) {
+        size = RP_DMA_SGMNT_ALIGN;
+    }
+    cnt = reserved / size;
+    if (cnt > RP_DMA_MAX_SGMNT_CNT) {
+        cnt = RP_DMA_MAX_SGMNT_CNT;
+    }
+    if (rp_DmaCheckGeometry((uint32_t) cnt, size) != RP_OK) {
+        return RP_EOOR;
+    }
+    *sgmnt_cnt = (uint32_t) cnt;
+    *sgmnt_size = size;
+    return RP_OK;
+}
+
+int rp_DmaSetGeometry(rp_handle_uio_t *handle, uint32_t sgmnt_cnt, size_t sgmnt_size) {
+    if (rp_DmaCheckGeometry(sgmnt_cnt, sgmnt_size) != RP_OK) {
+        return RP_EOOR;
+    }
+    rp_SetSgmntC(handle, sgmnt_cnt);
+    rp_SetSgmntS(handle, sgmnt_size);
+    handle->dma_size = (size_t) sgmnt_cnt * sgmnt_size;
+    return RP_OK;
+}
+
+int rp_DmaRxOpen(rp_handle_uio_t *handle, rp_dma_rx_t *rx, uint32_t sgmnt_cnt, size_t sgmnt_size) {
+    if (rp_DmaSetGeometry(handle, sgmnt_cnt, sgmnt_size) != RP_OK) {
+        return RP_EOOR;
+    }
+    memset(rx, 0, sizeof(*rx));
+    rx->handle = handle;
+    rx->sgmnt_cnt = sgmnt_cnt;
+    rx->sgmnt_size = sgmnt_size;
+    rx->map = (uint8_t *) mmap(NULL, handle->dma_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle->dma_fd, 0);
+    if (rx->map == MAP_FAILED) {
+        printf("Failed to mmap\n");
+        rx->map = NULL;
+        return RP_EMMD;
+    }
+    rx->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (rx->event_fd < 0) {
+        munmap(rx->map, handle->dma_size);
+        rx->map = NULL;
+        return RP_EOED;
+    }
+    pthread_mutex_init(&rx->lock, NULL);
+    return RP_OK;
+}
+
+int rp_DmaRxClose(rp_dma_rx_t *rx) {
+    if (rx->running) {
+        rp_DmaRxStop(rx);
+    }
+    if (rx->map) {
+        munmap(rx->map, rx->handle->dma_size);
+        rx->map = NULL;
+    }
+    if (rx->event_fd >= 0) {
+        close(rx->event_fd);
+        rx->event_fd = -1;
+    }
+    pthread_mutex_destroy(&rx->lock);
+    return RP_OK;
+}
+
+/**
+ * The driver read returns once per completed segment. One segment is always
+ * being filled, so when the application holds all the others the oldest one
+ * is being overwritten: it is dropped and the next delivered segment carries
+ * the overflow flag.
+ */
+static void *rp_DmaRxThread(void *arg) {
+    rp_dma_rx_t *rx = (rp_dma_rx_t *) arg;
+    const uint64_t one = 1;
+    char dummy;
+
+    while (1) {
+        if (read(rx->handle->dma_fd, &dummy, 1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            pthread_mutex_lock(&rx->lock);
+            rx->error = true;
+            pthread_mutex_unlock(&rx->lock);
+        } else {
+            pthread_mutex_lock(&rx->lock);
+            rx->completed++;
+            if (rx->completed - rx->released > rx->sgmnt_cnt - 1) {
+                uint64_t lost = rx->completed - rx->released - (rx->sgmnt_cnt - 1);
+                rx->released += lost;
+                rx->overflows += lost;
+                rx->overflow = true;
+                if (rx->delivered < rx->released) {
+                    rx->delivered = rx->released;
+                }
+            }
+            pthread_mutex_unlock(&rx->lock);
+        }
+        if (write(rx->event_fd, &one, sizeof(one)) < 0) {
+            // counter saturated, the reader is woken up anyway
+        }
+        if (rx->error) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int rp_DmaRxStart(rp_dma_rx_t *rx) {
+    if (rx->running || rx->map == NULL) {
+        return RP_EOOR;
+    }
+    rx->completed = rx->delivered = rx->released = rx->overflows = 0;
+    rx->overflow = false;
+    rx->error = false;
+    rp_DmaCtrl(rx->handle, RP_DMA_CYCLIC);
+    if (pthread_create(&rx->thread, NULL, rp_DmaRxThread, rx) != 0) {
+        rp_DmaCtrl(rx->handle, RP_DMA_STOP_RX);
+        return RP_EOOR;
+    }
+    rx->running = true;
+    return RP_OK;
+}
+
+int rp_DmaRxStop(rp_dma_rx_t *rx) {
+    if (!rx->running) {
+        return RP_OK;
+    }
+    // the thread may sit in the driver read, which is a cancellation point
+    pthread_cancel(rx->thread);
+    pthread_join(rx->thread, NULL);
+    rp_DmaCtrl(rx->handle, RP_DMA_STOP_RX);
+    rx->running = false;
+    return RP_OK;
+}
+
+/** Becomes readable (POLLIN) whenever a segment completed or the driver failed */
+int rp_DmaRxFd(rp_dma_rx_t *rx) {
+    return rx->event_fd;
+}
+
+/**
+ * Non-blocking. Returns up to max completed segments not returned before, in
+ * order. They stay valid until released, at most sgmnt_cnt - 1 can be held.
+ */
+int rp_DmaRxGet(rp_dma_rx_t *rx, rp_dma_sgmnt_t *sgmnts, size_t max, size_t *count) {
+    uint64_t events;
+    size_t n = 0;
+    int ret = RP_OK;
+
+    if (read(rx->event_fd, &events, sizeof(events)) < 0) {
+        // nothing signalled since the last call
+    }
+    pthread_mutex_lock(&rx->lock);
+    while (n < max && rx->delivered < rx->completed) {
+        rp_dma_sgmnt_t *s = &sgmnts[n++];
+        s->seq = rx->delivered++;
+        s->index = (uint32_t)(s->seq % rx->sgmnt_cnt);
+        s->overflow = rx->overflow;
+        s->data = rx->map + s->index * rx->sgmnt_size;
+        s->size = rx->sgmnt_size;
+        rx->overflow = false;
+    }
+    if (n == 0 && rx->error) {
+        ret = RP_ECMD;
+    }
+    pthread_mutex_unlock(&rx->lock);
+    *count = n;
+    return ret;
+}
+
+/** Hands back all delivered segments up to and including seq */
+int rp_DmaRxRelease(rp_dma_rx_t *rx, uint64_t seq) {
+    int ret = RP_OK;
+
+    pthread_mutex_lock(&rx->lock);
+    if (seq >= rx->delivered) {
+        ret = RP_EOOR;
+    } else if (seq >= rx->released) {
+        rx->released = seq + 1;
+    }
+    pthread_mutex_unlock(&rx->lock);
+    return ret;
+}
+
+int rp_DmaRxGetOverflows(rp_dma_rx_t *rx, uint64_t *overflows) {
+    pthread_mutex_lock(&rx->lock);
+    *overflows = rx->overflows;
+    pthread_mutex_unlock(&rx->lock);
+    return RP_OK;
+}
@@ -17,18 +17,77 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
 
 typedef enum {
     RP_DMA_SINGLE,
     RP_DMA_CYCLIC,
-    RP_DMA_STOP_RX
+    RP_DMA_STOP_RX,
+    RP_DMA_CYCLIC_TX,
+    RP_DMA_STOP_TX
 } RP_DMA_CTRL;
 
+#define RP_DMA_RESERVED_DT   "/proc/device-tree/reserved-memory"
+#define RP_DMA_MIN_SGMNT_CNT 2
+#define RP_DMA_MAX_SGMNT_CNT 256
+#define RP_DMA_SGMNT_ALIGN   4096
+
+/** Completed RX segment, valid until released */
+typedef struct {
+    uint32_t    index;    ///< segment in the ring
+    uint64_t    seq;      ///< segments completed before this one since start
+    bool        overflow; ///< older segments were overwritten before they were released
+    const void *data;
+    size_t      size;
+} rp_dma_sgmnt_t;
+
+/**
+ * Asynchronous cyclic RX. A thread waits for the driver segment by segment and
+ * signals an eventfd, the application polls it, takes completed segments with
+ * rp_DmaRxGet() and hands them back with rp_DmaRxRelease(). While one segment is
+ * being filled the others stay readable in place.
+ */
+typedef struct {
+    rp_handle_uio_t *handle;
+    uint8_t         *map;
+    uint32_t         sgmnt_cnt;
+    size_t           sgmnt_size;
+    int              event_fd;
+    pthread_t        thread;
+    pthread_mutex_t  lock;
+    bool             running;
+    bool             error;      ///< driver read failed, the thread has stopped
+    uint64_t         completed;  ///< segments completed by the driver
+    uint64_t         delivered;  ///< segments returned by rp_DmaRxGet()
+    uint64_t         released;   ///< segments handed back by the application
+    uint64_t         overflows;  ///< segments lost to the DMA catching up
+    bool             overflow;   ///< flag for the next delivered segment
+} rp_dma_rx_t;
+
 int rp_DmaOpen(const char *dev, rp_handle_uio_t *handle);
 int rp_DmaCtrl(rp_handle_uio_t *handle, RP_DMA_CTRL ctrl);
 int rp_SetSgmntC(rp_handle_uio_t *handle, unsigned long no);
 int rp_SetSgmntS(rp_handle_uio_t *handle, unsigned long no);
+int rp_SetTxSgmntC(rp_handle_uio_t *handle, unsigned long no);
+int rp_SetTxSgmntS(rp_handle_uio_t *handle, unsigned long no);
 int rp_DmaRead(rp_handle_uio_t *handle);
+int rp_DmaWrite(rp_handle_uio_t *handle, const void *buf, size_t size);
+int rp_DmaStatus(rp_handle_uio_t *handle, int *status);
 int rp_DmaClose(rp_handle_uio_t *handle);
 
+int rp_DmaGetReserved(size_t *size);
+int rp_DmaCheckGeometry(uint32_t sgmnt_cnt, size_t sgmnt_size);
+int rp_DmaChooseGeometry(double rate, double latency, uint32_t *sgmnt_cnt, size_t *sgmnt_size);
+int rp_DmaSetGeometry(rp_handle_uio_t *handle, uint32_t sgmnt_cnt, size_t sgmnt_size);
+
+int rp_DmaRxOpen(rp_handle_uio_t *handle, rp_dma_rx_t *rx, uint32_t sgmnt_cnt, size_t sgmnt_size);
+int rp_DmaRxClose(rp_dma_rx_t *rx);
+int rp_DmaRxStart(rp_dma_rx_t *rx);
+int rp_DmaRxStop(rp_dma_rx_t *rx);
+int rp_DmaRxFd(rp_dma_rx_t *rx);
+int rp_DmaRxGet(rp_dma_rx_t *rx, rp_dma_sgmnt_t *sgmnts, size_t max, size_t *count);
+int rp_DmaRxRelease(rp_dma_rx_t *rx, uint64_t seq);
+int rp_DmaRxGetOverflows(rp_dma_rx_t *rx, uint64_t *overflows);
+
 #endif // _RP_DMA_H_
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include "redpitaya/rp2.h"
+#include "la_acq.h"
+#include "la_stream.h"
+
+// usage: test_la_stream [seconds] [file|-] [rle]
+// Streams the digital lines for the given time, segments are written to the
+// file as they come ('-' for stdout, e.g. to pipe into nc).
+
+int main (int argc, char **argv) {
+    rp_handle_uio_t handle;
+    rp_la_stream_t stream;
+    rp_la_stream_sgmnt_t sgmnts[RP_LA_STREAM_SGMNT_CNT];
+    double seconds = argc > 1 ? atof(argv[1]) : 10;
+    const char *name = argc > 2 ? argv[2] : NULL;
+    bool rle = argc > 3 && strcmp(argv[3], "rle") == 0;
+    FILE *out = NULL;
+    int status;
+
+    if (name != NULL) {
+        out = strcmp(name, "-") == 0 ? stdout : fopen(name, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "Unable to open %s\n", name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    status = rp_LaAcqOpen("/dev/uio/la", &handle);
+    if (status != RP_OK) {
+        fprintf(stderr, "Red Pitaya API init failed!\n");
+        return EXIT_FAILURE;
+    }
+    status = rp_LaStreamOpen(&handle, &stream, RP_LA_STREAM_SGMNT_CNT, RP_LA_STREAM_SGMNT_SIZE);
+    if (status != RP_OK) {
+        fprintf(stderr, "Stream open failed: %d\n", status);
+        rp_LaAcqClose(&handle);
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start, now;
+    struct pollfd pfd = { .fd = rp_LaStreamFd(&stream), .events = POLLIN };
+    uint64_t sgmnts_total = 0, lost = 0;
+
+    rp_LaStreamStart(&stream, rle);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        size_t count;
+        if (poll(&pfd, 1, 100) < 0) {
+            break;
+        }
+        if (rp_LaStreamGet(&stream, sgmnts, RP_LA_STREAM_SGMNT_CNT, &count) != RP_OK) {
+            fprintf(stderr, "DMA read failed\n");
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (sgmnts[i].lost) {
+                fprintf(stderr, "segments lost before %llu\n", (unsigned long long) sgmnts[i].seq);
+            }
+            if (out != NULL) {
+                fwrite(sgmnts[i].data, sizeof(uint16_t), sgmnts[i].count, out);
+            }
+        }
+        if (count > 0) {
+            rp_LaStreamRelease(&stream, sgmnts[count-1].seq);
+            sgmnts_total += count;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9 < seconds);
+    rp_LaStreamStop(&stream);
+
+    rp_LaStreamGetLost(&stream, &lost);
+    fprintf(stderr, "segments: %llu, samples: %llu, lost segments: %llu\n",
+            (unsigned long long) sgmnts_total,
+            (unsigned long long) stream.samples,
+            (unsigned long long) lost);
+
+    if (out != NULL && out != stdout) {
+        fclose(out);
+    }
+    rp_LaStreamClose(&stream);
+    rp_LaAcqClose(&handle);
+    return lost ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+/*
+ *  Logic analyzer protocol decoder unit tests, these run without the hardware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CUnit/Basic.h"
+
+#include "redpitaya/rp2.h"
+#include "la_proto.h"
+#include "ut_main.h"
+
+#define UT_PROTO_SAMPLES 200000
+
+static uint8_t  *wave;
+static size_t    wave_len;
+static uint16_t *records;
+static size_t    records_len;
+
+int suite_la_proto_init(void){
+    wave = malloc(UT_PROTO_SAMPLES);
+    records = malloc(UT_PROTO_SAMPLES * sizeof(uint16_t));
+    return (wave == NULL || records == NULL) ? -1 : 0;
+}
+
+int suite_la_proto_cleanup(void){
+    free(wave);
+    free(records);
+    return 0;
+}
+
+static void ut_hold(uint8_t v, size_t n){
+    while (n-- && wave_len < UT_PROTO_SAMPLES)
+        wave[wave_len++] = v;
+}
+
+/** Encodes the synthesized wave the way the logic analyzer does */
+static void ut_encode(void){
+    size_t i = 0;
+    records_len = 0;
+    while (i < wave_len) {
+        size_t n = 1;
+        while (i + n < wave_len && n < 256 && wave[i + n] == wave[i])
+            n++;
+        records[records_len++] = (uint16_t)(((n - 1) << 8) | wave[i]);
+        i += n;
+    }
+}
+
+/** Decodes in chunks of 7 records into a small frame buffer */
+static size_t ut_decode(rp_la_proto_t *dec, rp_la_frame_t *frames, size_t max){
+    size_t pos = 0, n = 0;
+    while (pos < records_len && max - n >= RP_LA_PROTO_RECORD_FRAMES) {
+        size_t consumed, produced;
+        size_t chunk = records_len - pos < 7 ? records_len - pos : 7;
+        size_t room = max - n < 3 ? max - n : 3;
+        CU_ASSERT_EQUAL(rp_LaProtoDecode(dec, records + pos, chunk, &consumed,
+                                         frames + n, room, &produced), RP_OK);
+        CU_ASSERT(consumed > 0);
+        pos += consumed;
+        n += produced;
+    }
+    return n;
+}
+
+void la_proto_uart_test(void){
+    rp_la_uart_cfg_t cfg = { .line = 3, .samples_per_bit = 10.4, .data_bits = 8,
+                             .parity = RP_LA_PARITY_EVEN, .stop_bits = 1, .inverted = false };
+    const uint8_t bytes[] = { 0x55, 0x00, 0xa7, 0xff };
+    rp_la_proto_t dec;
+    rp_la_frame_t frames[8];
+    double t = 0;
+    size_t i, n;
+    int b;
+
+    wave_len = 0;
+    ut_hold(1 << 3, 50);
+    t = 50;
+    for (i = 0; i < sizeof(bytes); i++) {
+        uint32_t bits[12];
+        uint32_t ones = __builtin_popcount(bytes[i]);
+        int nb = 0;
+        bits[nb++] = 0;
+        for (b = 0; b < 8; b++)
+            bits[nb++] = (bytes[i] >> b) & 1;
+        bits[nb++] = (i == 2) ? !(ones & 1) : (ones & 1);   // bad parity on the third byte
+        bits[nb++] = (i == 3) ? 0 : 1;                      // framing error on the last one
+        for (b = 0; b < nb; b++) {
+            double end = t + cfg.samples_per_bit;
+            ut_hold(bits[b] << 3 | (b & 1), (size_t)end - wave_len);
+            t = end;
+        }
+        ut_hold(1 << 3, 37);
+        t = wave_len;
+    }
+    ut_encode();
+
+    CU_ASSERT_EQUAL(rp_LaProtoUartInit(&dec, &cfg), RP_OK);
+    n = ut_decode(&dec, frames, 8);
+    CU_ASSERT_EQUAL_FATAL(n, sizeof(bytes));
+    for (i = 0; i < n; i++) {
+        CU_ASSERT_EQUAL(frames[i].type, RP_LA_FRAME_UART);
+        CU_ASSERT_EQUAL(frames[i].data, bytes[i]);
+        CU_ASSERT_EQUAL(frames[i].bits, 8);
+    }
+    CU_ASSERT_EQUAL(frames[0].start, 50);
+    CU_ASSERT_EQUAL(frames[0].flags, 0);
+    CU_ASSERT_EQUAL(frames[1].flags, 0);
+    CU_ASSERT_EQUAL(frames[2].flags, RP_LA_FLAG_PARITY_ERR);
+    CU_ASSERT_EQUAL(frames[3].flags, RP_LA_FLAG_FRAMING_ERR);
+
+    cfg.samples_per_bit = 1.5;
+    CU_ASSERT_EQUAL(rp_LaProtoUartInit(&dec, &cfg), RP_EOOR);
+}
+
+void la_proto_spi_test(void){
+    // sclk 0, mosi 1, miso 2, cs 3, mode 0
+    rp_la_spi_cfg_t cfg = { .sclk = 0, .mosi = 1, .miso = 2, .cs = 3,
+                            .cpol = 0, .cpha = 0, .word_bits = 8, .msb_first = true };
+    const uint8_t mosi[] = { 0x3c, 0x81 };
+    const uint8_t miso[] = { 0xf0, 0x0f };
+    rp_la_proto_t dec;
+    rp_la_frame_t frames[8];
+    size_t i, n;
+    int b;
+
+    wave_len = 0;
+    ut_hold(1 << 3, 20);
+    ut_hold(0, 5);
+    for (i = 0; i < 2; i++) {
+        for (b = 7; b >= 0; b--) {
+            uint8_t d = ((mosi[i] >> b) & 1) << 1 | ((miso[i] >> b) & 1) << 2;
+            ut_hold(d, 4);
+            ut_hold(d | 1, 4);
+        }
+        ut_hold(0, 4);
+    }
+    // three bits, then deselect
+    for (b = 0; b < 3; b++) {
+        ut_hold(1 << 1, 4);
+        ut_hold(1 << 1 | 1, 4);
+    }
+    ut_hold(1 << 3, 20);
+    ut_encode();
+
+    CU_ASSERT_EQUAL(rp_LaProtoSpiInit(&dec, &cfg), RP_OK);
+    n = ut_decode(&dec, frames, 8);
+    CU_ASSERT_EQUAL_FATAL(n, 3);
+    for (i = 0; i < 2; i++) {
+        CU_ASSERT_EQUAL(frames[i].type, RP_LA_FRAME_SPI);
+        CU_ASSERT_EQUAL(frames[i].data, mosi[i] | (uint32_t)miso[i] << 16);
+        CU_ASSERT_EQUAL(frames[i].flags, 0);
+    }
+    CU_ASSERT_EQUAL(frames[0].start, 29);
+    CU_ASSERT_EQUAL(frames[2].bits, 3);
+    CU_ASSERT_EQUAL(frames[2].data, 0x7);
+    CU_ASSERT_EQUAL(frames[2].flags, RP_LA_FLAG_INCOMPLETE);
+}
+
+static void ut_i2c_byte(uint8_t byte, int ack){
+    int b;
+    for (b = 8; b >= 0; b--) {
+        uint8_t sda = b ? (byte >> (b - 1)) & 1 : !ack;
+        ut_hold(sda << 1, 5);
+        ut_hold(sda << 1 | 1, 5);
+    }
+    ut_hold(0, 2);
+}
+
+void la_proto_i2c_test(void){
+    // scl 0, sda 1
+    rp_la_i2c_cfg_t cfg = { .scl = 0, .sda = 1 };
+    rp_la_proto_t dec;
+    rp_la_frame_t frames[8];
+    size_t n;
+
+    wave_len = 0;
+    ut_hold(3, 20);
+    ut_hold(1, 5);          // start
+    ut_hold(0, 2);
+    ut_i2c_byte(0xa0, 1);
+    ut_i2c_byte(0x12, 1);
+    ut_hold(2, 3);          // repeated start
+    ut_hold(3, 3);
+    ut_hold(1, 3);
+    ut_hold(0, 2);
+    ut_i2c_byte(0xa1, 1);
+    ut_i2c_byte(0x34, 0);
+    ut_hold(1, 3);          // stop
+    ut_hold(3, 20);
+    ut_encode();
+
+    CU_ASSERT_EQUAL(rp_LaProtoI2cInit(&dec, &cfg), RP_OK);
+    n = ut_decode(&dec, frames, 8);
+    CU_ASSERT_EQUAL_FATAL(n, 5);
+    CU_ASSERT_EQUAL(frames[0].type, RP_LA_FRAME_I2C_ADDR);
+    CU_ASSERT_EQUAL(frames[0].data, 0xa0);
+    CU_ASSERT_EQUAL(frames[0].flags, 0);
+    CU_ASSERT_EQUAL(frames[1].type, RP_LA_FRAME_I2C_DATA);
+    CU_ASSERT_EQUAL(frames[1].data, 0x12);
+    CU_ASSERT_EQUAL(frames[2].type, RP_LA_FRAME_I2C_ADDR);
+    CU_ASSERT_EQUAL(frames[2].data, 0xa1);
+    CU_ASSERT_EQUAL(frames[2].flags, RP_LA_FLAG_RESTART);
+    CU_ASSERT_EQUAL(frames[3].data, 0x34);
+    CU_ASSERT_EQUAL(frames[3].flags, RP_LA_FLAG_NACK);
+    CU_ASSERT_EQUAL(frames[4].type, RP_LA_FRAME_I2C_STOP);
+}
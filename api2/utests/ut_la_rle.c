@@ -0,0 +1,100 @@
+/*
+ *  Logic analyzer RLE decoder unit tests, these run without the hardware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CUnit/Basic.h"
+
+#include "redpitaya/rp2.h"
+#include "la_rle.h"
+#include "ut_main.h"
+
+#define UT_RLE_RECORDS 4000
+
+static uint16_t *records;
+static uint8_t  *expanded;
+static uint64_t  samples;
+
+/** Random records, mostly short runs, and their sample-by-sample expansion */
+int suite_la_rle_init(void){
+    size_t i, p = 0;
+    uint32_t k;
+
+    srand(1);
+    records = malloc(UT_RLE_RECORDS * sizeof(uint16_t));
+    expanded = malloc(UT_RLE_RECORDS * 256);
+    if (records == NULL || expanded == NULL)
+        return -1;
+    for (i = 0; i < UT_RLE_RECORDS; i++) {
+        int len = (rand() % 4 == 0) ? rand() % 256 : rand() % 4;
+        records[i] = (uint16_t)((len << 8) | (rand() & 0xff));
+        for (k = 0; k < RP_LA_RLE_LEN(records[i]); k++)
+            expanded[p++] = RP_LA_RLE_DATA(records[i]);
+    }
+    samples = p;
+    return 0;
+}
+
+int suite_la_rle_cleanup(void){
+    free(records);
+    free(expanded);
+    return 0;
+}
+
+void la_rle_bytes_test(void){
+    rp_la_rle_t rle;
+    uint8_t *out = malloc(samples + 1);
+    int w;
+
+    CU_ASSERT_FATAL(out != NULL);
+    CU_ASSERT_EQUAL_FATAL(rp_LaRleOpen(&rle, records, UT_RLE_RECORDS, 64), RP_OK);
+    CU_ASSERT_EQUAL(rp_LaRleSamples(&rle), samples);
+
+    // whole capture
+    CU_ASSERT_EQUAL(rp_LaRleDecodeBytes(&rle, 0, samples, out), RP_OK);
+    CU_ASSERT(memcmp(out, expanded, samples) == 0);
+
+    // windows starting inside runs, nothing written past the window
+    for (w = 0; w < 100; w++) {
+        uint64_t first = rand() % samples;
+        size_t count = rand() % (samples - first + 1);
+        memset(out, 0xaa, samples + 1);
+        CU_ASSERT_EQUAL(rp_LaRleDecodeBytes(&rle, first, count, out), RP_OK);
+        CU_ASSERT(memcmp(out, expanded + first, count) == 0);
+        CU_ASSERT_EQUAL(out[count], 0xaa);
+    }
+
+    CU_ASSERT_EQUAL(rp_LaRleDecodeBytes(&rle, samples, 1, out), RP_EOOR);
+    CU_ASSERT_EQUAL(rp_LaRleClose(&rle), RP_OK);
+    free(out);
+}
+
+void la_rle_planes_test(void){
+    rp_la_rle_t rle;
+    size_t stride = (samples + 7) / 8;
+    uint8_t *planes = malloc(RP_LA_RLE_LINES * stride);
+    int w, line;
+    size_t i;
+
+    CU_ASSERT_FATAL(planes != NULL);
+    CU_ASSERT_EQUAL_FATAL(rp_LaRleOpen(&rle, records, UT_RLE_RECORDS, 0), RP_OK);
+
+    for (w = 0; w < 50; w++) {
+        uint64_t first = rand() % samples;
+        size_t count = rand() % (samples - first + 1);
+        int ok = 1;
+        CU_ASSERT_EQUAL(rp_LaRleDecodePlanes(&rle, first, count, planes, stride), RP_OK);
+        for (i = 0; i < count && ok; i++)
+            for (line = 0; line < RP_LA_RLE_LINES; line++)
+                if (((planes[line * stride + i / 8] >> (i % 8)) & 1) != ((expanded[first + i] >> line) & 1))
+                    ok = 0;
+        CU_ASSERT(ok);
+    }
+
+    CU_ASSERT_EQUAL(rp_LaRleDecodePlanes(&rle, 0, samples, planes, stride - 1), RP_EOOR);
+    CU_ASSERT_EQUAL(rp_LaRleClose(&rle), RP_OK);
+    free(planes);
+}
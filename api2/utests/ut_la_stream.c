@@ -0,0 +1,33 @@
+/*
+ *  Logic analyzer streaming unit tests, these run without the hardware.
+ */
+
+#include <stdio.h>
+
+#include "CUnit/Basic.h"
+
+#include "redpitaya/rp2.h"
+#include "la_rle.h"
+#include "la_stream.h"
+#include "ut_main.h"
+
+int suite_la_stream_init(void){
+    return 0;
+}
+
+int suite_la_stream_cleanup(void){
+    return 0;
+}
+
+void la_stream_count_test(void){
+    const uint16_t words[] = { 0x0001, 0xff02, 0x0203, 0x00ff };
+
+    // raw samples, one per word
+    CU_ASSERT_EQUAL(rp_LaStreamCountSamples(words, 4, false), 4);
+    CU_ASSERT_EQUAL(rp_LaStreamCountSamples(words, 0, false), 0);
+
+    // RLE records, run length - 1 in the upper byte
+    CU_ASSERT_EQUAL(rp_LaStreamCountSamples(words, 4, true), 1 + 256 + 3 + 1);
+    CU_ASSERT_EQUAL(rp_LaStreamCountSamples(words + 1, 1, true), RP_LA_RLE_LEN(words[1]));
+    CU_ASSERT_EQUAL(rp_LaStreamCountSamples(words, 0, true), 0);
+}
@@ -32,6 +32,27 @@ CU_TestInfo sig_gen_test_array[] = {
   CU_TEST_INFO_NULL,
 };
 
+/** la rle decoder test */
+CU_TestInfo la_rle_test_array[] = {
+  { "la_rle_bytes_test", la_rle_bytes_test},
+  { "la_rle_planes_test", la_rle_planes_test},
+  CU_TEST_INFO_NULL,
+};
+
+/** la protocol decoder test */
+CU_TestInfo la_proto_test_array[] = {
+  { "la_proto_uart_test", la_proto_uart_test},
+  { "la_proto_spi_test", la_proto_spi_test},
+  { "la_proto_i2c_test", la_proto_i2c_test},
+  CU_TEST_INFO_NULL,
+};
+
+/** la streaming test */
+CU_TestInfo la_stream_test_array[] = {
+  { "la_stream_count_test", la_stream_count_test},
+  CU_TEST_INFO_NULL,
+};
+
 // add new tests here
 
 /** suite table */
@@ -39,6 +60,9 @@ CU_SuiteInfo suites[] = {
 //  { "SuiteExampleTest", init_example_suite, clean_example_suite, example_test_array},
   { "suite_la_acq_test", suite_la_acq_init, suite_la_acq_cleanup, la_acq_test_array},
 //  { "suite_sig_gen_test", suite_sig_gen_init, suite_sig_gen_cleanup, sig_gen_test_array},
+  { "suite_la_rle_test", suite_la_rle_init, suite_la_rle_cleanup, la_rle_test_array},
+  { "suite_la_proto_test", suite_la_proto_init, suite_la_proto_cleanup, la_proto_test_array},
+  { "suite_la_stream_test", suite_la_stream_init, suite_la_stream_cleanup, la_stream_test_array},
   // add new suite here
   CU_SUITE_INFO_NULL,
 };
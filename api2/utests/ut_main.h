@@ -24,6 +24,21 @@ int suite_sig_gen_init(void);
 int suite_sig_gen_cleanup(void);
 void sig_gen_test(void);
 
+int suite_la_rle_init(void);
+int suite_la_rle_cleanup(void);
+void la_rle_bytes_test(void);
+void la_rle_planes_test(void);
+
+int suite_la_proto_init(void);
+int suite_la_proto_cleanup(void);
+void la_proto_uart_test(void);
+void la_proto_spi_test(void);
+void la_proto_i2c_test(void);
+
+int suite_la_stream_init(void);
+int suite_la_stream_cleanup(void);
+void la_stream_count_test(void);
+
 
 #endif // __UT_MAIN_H
 
@@ -0,0 +1,251 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Worker control shared by the applications.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "rp_app_ctrl.h"
+#include "rp_app_fpga.h"
+
+
+/*----------------------------------------------------------------------------*/
+static void rp_app_ctrl_deadline(struct timespec *ts, long timeout_us)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    if(timeout_us > 0) {
+        ts->tv_sec  += timeout_us / 1000000;
+        ts->tv_nsec += (timeout_us % 1000000) * 1000;
+        if(ts->tv_nsec >= 1000000000) {
+            ts->tv_sec++;
+            ts->tv_nsec -= 1000000000;
+        }
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_ctrl_init(rp_app_ctrl_t *ctrl, int state, int params_num)
+{
+    pthread_condattr_t attr;
+
+    if(rp_app_params_init(&ctrl->params, params_num) < 0)
+        return -1;
+    ctrl->params_gen = 0;
+
+    pthread_mutex_init(&ctrl->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ctrl->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    /* Without the eventfd the waits fall back to plain sleeps */
+    ctrl->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ctrl->state = state;
+    ctrl->clients = 1;
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_ctrl_exit(rp_app_ctrl_t *ctrl)
+{
+    if(ctrl->wake_fd >= 0) {
+        close(ctrl->wake_fd);
+        ctrl->wake_fd = -1;
+    }
+    pthread_cond_destroy(&ctrl->cond);
+    pthread_mutex_destroy(&ctrl->mutex);
+    rp_app_params_free(&ctrl->params);
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_ctrl_wake(rp_app_ctrl_t *ctrl)
+{
+    uint64_t one = 1;
+
+    pthread_cond_broadcast(&ctrl->cond);
+    if(ctrl->wake_fd >= 0 &&
+       write(ctrl->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+        /* Counter saturated, the worker is woken anyway */
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_ctrl_set_state(rp_app_ctrl_t *ctrl, int state)
+{
+    pthread_mutex_lock(&ctrl->mutex);
+    ctrl->state = state;
+    rp_app_ctrl_wake(ctrl);
+    pthread_mutex_unlock(&ctrl->mutex);
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_ctrl_get_state(rp_app_ctrl_t *ctrl)
+{
+    int state;
+
+    pthread_mutex_lock(&ctrl->mutex);
+    state = ctrl->state;
+    pthread_mutex_unlock(&ctrl->mutex);
+    return state;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_ctrl_set_clients(rp_app_ctrl_t *ctrl, int clients)
+{
+    pthread_mutex_lock(&ctrl->mutex);
+    ctrl->clients = clients;
+    if(clients > 0)
+        rp_app_ctrl_wake(ctrl);
+    pthread_mutex_unlock(&ctrl->mutex);
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_ctrl_wait_clients(rp_app_ctrl_t *ctrl, int old_state)
+{
+    int slept = 0;
+
+    pthread_mutex_lock(&ctrl->mutex);
+    while(ctrl->clients <= 0 && ctrl->state == old_state) {
+        pthread_cond_wait(&ctrl->cond, &ctrl->mutex);
+        slept = 1;
+    }
+    pthread_mutex_unlock(&ctrl->mutex);
+    return slept;
+}
+
+
+/*----------------------------------------------------------------------------*/
+float *rp_app_ctrl_params_begin(rp_app_ctrl_t *ctrl)
+{
+    return rp_app_params_write_begin(&ctrl->params);
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_ctrl_params_end(rp_app_ctrl_t *ctrl, int fpga_update)
+{
+    rp_app_params_write_end(&ctrl->params, fpga_update);
+
+    /* Under the mutex, so a worker about to wait on the condition sees it */
+    pthread_mutex_lock(&ctrl->mutex);
+    rp_app_ctrl_wake(ctrl);
+    pthread_mutex_unlock(&ctrl->mutex);
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_ctrl_params_get(rp_app_ctrl_t *ctrl, float *values, int *fpga_update)
+{
+    return rp_app_params_read(&ctrl->params, &ctrl->params_gen, values, fpga_update);
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_ctrl_sleep(rp_app_ctrl_t *ctrl, int old_state, long timeout_us)
+{
+    struct timespec ts;
+    int changed;
+
+    rp_app_ctrl_deadline(&ts, timeout_us);
+
+    pthread_mutex_lock(&ctrl->mutex);
+    while(!(changed = (ctrl->state != old_state) ||
+                      rp_app_ctrl_params_changed(ctrl))) {
+        if(timeout_us < 0) {
+            pthread_cond_wait(&ctrl->cond, &ctrl->mutex);
+        } else if(timeout_us == 0 ||
+                  pthread_cond_timedwait(&ctrl->cond, &ctrl->mutex, &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctrl->mutex);
+    return changed;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_ctrl_wait_event(rp_app_ctrl_t *ctrl, int irq_fd, long timeout_us)
+{
+    struct pollfd fds[2];
+    struct timespec ts;
+    uint64_t count;
+    int n = 0;
+
+    if(ctrl->wake_fd < 0) {
+        usleep(timeout_us);
+        return;
+    }
+
+    fds[n].fd = ctrl->wake_fd;
+    fds[n].events = POLLIN;
+    fds[n++].revents = 0;
+    if(irq_fd >= 0) {
+        fds[n].fd = irq_fd;
+        fds[n].events = POLLIN;
+        fds[n++].revents = 0;
+    }
+    ts.tv_sec  = timeout_us / 1000000;
+    ts.tv_nsec = (timeout_us % 1000000) * 1000;
+
+    if(ppoll(fds, n, &ts, NULL) <= 0)
+        return;
+    if((fds[0].revents & POLLIN) &&
+       read(ctrl->wake_fd, &count, sizeof(count)) != sizeof(count)) {
+        /* Already consumed */
+    }
+    if(n > 1 && (fds[1].revents & POLLIN))
+        rp_app_fpga_irq_ack();
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_ctrl_wait_ready(rp_app_ctrl_t *ctrl, int old_state,
+                           rp_app_ready_func ready, void *arg, long timeout_us)
+{
+    struct timespec end, now;
+    long poll_us = RP_APP_POLL_MIN_US;
+
+    rp_app_ctrl_deadline(&end, timeout_us);
+
+    while(1) {
+        /* Arm the interrupt before looking at the status, so none is missed */
+        int irq_fd = rp_app_fpga_irq_enable();
+
+        if(rp_app_ctrl_sleep(ctrl, old_state, 0))
+            return -1;
+        if(ready(arg))
+            return 0;
+        if(timeout_us >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if((now.tv_sec > end.tv_sec) ||
+               ((now.tv_sec == end.tv_sec) && (now.tv_nsec >= end.tv_nsec)))
+                return 1;
+        }
+        if(irq_fd >= 0) {
+            rp_app_ctrl_wait_event(ctrl, irq_fd, RP_APP_IRQ_SLICE_US);
+        } else {
+            rp_app_ctrl_wait_event(ctrl, -1, poll_us);
+            poll_us = poll_us * 2 < RP_APP_POLL_MAX_US ? poll_us * 2 : RP_APP_POLL_MAX_US;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Worker control shared by the applications.
+ *
+ * The web server thread changes the worker state and hands over new
+ * parameters through the snapshot of rp_app_params.h, the worker thread
+ * sleeps and waits for the FPGA trigger until one of them changes. Every change wakes the worker at once, through
+ * the condition for plain sleeps and through an eventfd for the waits that
+ * also poll() the FPGA interrupt.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_APP_CTRL_H
+#define __RP_APP_CTRL_H
+
+#include <pthread.h>
+
+#include "rp_app_params.h"
+
+/* Trigger wait without an FPGA interrupt: the poll interval doubles from
+ * RP_APP_POLL_MIN_US up to RP_APP_POLL_MAX_US. With the interrupt the wait
+ * is cut in RP_APP_IRQ_SLICE_US slices, for conditions the interrupt does
+ * not cover.
+ */
+#define RP_APP_POLL_MIN_US   5
+#define RP_APP_POLL_MAX_US   1000
+#define RP_APP_IRQ_SLICE_US  10000
+
+typedef struct rp_app_ctrl_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;      /* signalled with mutex held on every change */
+    int             wake_fd;   /* same changes for poll() */
+    int             state;     /* application defined worker state */
+    rp_app_params_buf_t params;
+    uint32_t        params_gen; /* generation last read by the worker */
+    int             clients;   /* connected browsers, see rp_app_ctrl_set_clients() */
+} rp_app_ctrl_t;
+
+/* Returns nonzero once the awaited event, e.g. the trigger, happened */
+typedef int (*rp_app_ready_func)(void *arg);
+
+int  rp_app_ctrl_init(rp_app_ctrl_t *ctrl, int state, int params_num);
+void rp_app_ctrl_exit(rp_app_ctrl_t *ctrl);
+
+/* Wakes the worker out of its sleeps, called with ctrl->mutex held */
+void rp_app_ctrl_wake(rp_app_ctrl_t *ctrl);
+void rp_app_ctrl_set_state(rp_app_ctrl_t *ctrl, int state);
+int  rp_app_ctrl_get_state(rp_app_ctrl_t *ctrl);
+
+/* Number of connected clients from the web server's rp_app_clients(). Until
+ * the first call a client is assumed, so a web server without the count
+ * never idles the worker.
+ */
+void rp_app_ctrl_set_clients(rp_app_ctrl_t *ctrl, int clients);
+
+/* Worker side: while no client is connected and the state stays old_state,
+ * sleeps without acquiring. Returns 1 if it slept, the caller starts its
+ * loop over, 0 at once with a client.
+ */
+int  rp_app_ctrl_wait_clients(rp_app_ctrl_t *ctrl, int old_state);
+
+/* Hands new parameter values to the worker, any thread. The params_num
+ * values go to rp_app_ctrl_params_begin(), rp_app_ctrl_params_end()
+ * publishes them and wakes the worker.
+ */
+float *rp_app_ctrl_params_begin(rp_app_ctrl_t *ctrl);
+void   rp_app_ctrl_params_end(rp_app_ctrl_t *ctrl, int fpga_update);
+
+/* Worker side: copies the values if new ones were published since the last
+ * call and returns 1, see rp_app_params_read(), or returns 0.
+ */
+int    rp_app_ctrl_params_get(rp_app_ctrl_t *ctrl, float *values, int *fpga_update);
+
+/* Worker side: nonzero if rp_app_ctrl_params_get() would return new values */
+static inline int rp_app_ctrl_params_changed(const rp_app_ctrl_t *ctrl)
+{
+    return rp_app_params_gen(&ctrl->params) != ctrl->params_gen;
+}
+
+/* Sleeps up to timeout_us, or without a limit for a negative timeout, and
+ * returns 1 early once the state is not old_state any more or new
+ * parameters arrived, 0 otherwise. A zero timeout only checks.
+ */
+int  rp_app_ctrl_sleep(rp_app_ctrl_t *ctrl, int old_state, long timeout_us);
+
+/* Waits up to timeout_us for the FPGA interrupt, if irq_fd is one, or for a
+ * change. Both are consumed, the caller checks what happened.
+ */
+void rp_app_ctrl_wait_event(rp_app_ctrl_t *ctrl, int irq_fd, long timeout_us);
+
+/* Waits until ready(arg) returns nonzero, on the FPGA interrupt if the
+ * image has one and with the adaptive poll otherwise. Returns 0 when
+ * ready, 1 after timeout_us (negative for no limit) and -1 on a change of
+ * the state or the parameters.
+ */
+int  rp_app_ctrl_wait_ready(rp_app_ctrl_t *ctrl, int old_state,
+                            rp_app_ready_func ready, void *arg, long timeout_us);
+
+#endif /* __RP_APP_CTRL_H */
@@ -0,0 +1,116 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Shared access to the FPGA.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "rp_app_fpga.h"
+
+/* UIO device of the FPGA interrupt, only used from the worker thread */
+static int g_rp_app_irq_fd = -1;
+static int g_rp_app_irq_unsupported = 0;
+
+
+/*----------------------------------------------------------------------------*/
+void *rp_app_fpga_map(unsigned long base, size_t size)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    unsigned long page_addr = base & ~((unsigned long)page_size - 1);
+    size_t page_off = base - page_addr;
+    void *page_ptr;
+    int fd;
+
+    fd = open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC);
+    if(fd < 0) {
+        fprintf(stderr, "open(/dev/mem) failed: %s\n", strerror(errno));
+        return NULL;
+    }
+    page_ptr = mmap(NULL, size + page_off, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, page_addr);
+    /* The mapping stays valid without the descriptor */
+    close(fd);
+    if(page_ptr == MAP_FAILED) {
+        fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
+        return NULL;
+    }
+    return (uint8_t *)page_ptr + page_off;
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_fpga_unmap(void *ptr, size_t size)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t page_off;
+
+    if(ptr == NULL)
+        return 0;
+    page_off = (uintptr_t)ptr & ((uintptr_t)page_size - 1);
+    if(munmap((uint8_t *)ptr - page_off, size + page_off) < 0) {
+        fprintf(stderr, "munmap() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_fpga_irq_enable(void)
+{
+    int32_t enable = 1;
+
+    if(g_rp_app_irq_unsupported)
+        return -1;
+
+    if(g_rp_app_irq_fd < 0) {
+        g_rp_app_irq_fd = open("/dev/uio/api", O_RDWR | O_CLOEXEC);
+        if(g_rp_app_irq_fd < 0) {
+            g_rp_app_irq_unsupported = 1;
+            return -1;
+        }
+    }
+    if(write(g_rp_app_irq_fd, &enable, sizeof(enable)) != sizeof(enable)) {
+        close(g_rp_app_irq_fd);
+        g_rp_app_irq_fd = -1;
+        g_rp_app_irq_unsupported = 1;
+        return -1;
+    }
+    return g_rp_app_irq_fd;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_fpga_irq_ack(void)
+{
+    int32_t count;
+
+    if(g_rp_app_irq_fd >= 0 &&
+       read(g_rp_app_irq_fd, &count, sizeof(count)) != sizeof(count)) {
+        /* Nothing pending, the next enable arms it again */
+    }
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_fpga_irq_close(void)
+{
+    if(g_rp_app_irq_fd >= 0) {
+        close(g_rp_app_irq_fd);
+        g_rp_app_irq_fd = -1;
+    }
+    g_rp_app_irq_unsupported = 0;
+}
@@ -0,0 +1,40 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Shared access to the FPGA.
+ *
+ * The FPGA register blocks are mapped from /dev/mem, the interrupt comes
+ * from the same UIO device librp uses for rp_AcqWaitTrigger(). Every
+ * application links these instead of its own copies.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_APP_FPGA_H
+#define __RP_APP_FPGA_H
+
+#include <stddef.h>
+
+/* Maps size bytes of the FPGA at the physical address base, which does not
+ * need to be page aligned. Returns the pointer to base or NULL, an error
+ * message is printed on standard error device.
+ */
+void *rp_app_fpga_map(unsigned long base, size_t size);
+/* Unmaps a block from rp_app_fpga_map(), NULL is ignored */
+int rp_app_fpga_unmap(void *ptr, size_t size);
+
+/* Arms the next FPGA interrupt. Returns a descriptor that becomes readable
+ * (POLLIN) on the interrupt or -1 if the FPGA image has none, then poll the
+ * status instead. After the first refusal the device is not touched again.
+ */
+int rp_app_fpga_irq_enable(void);
+/* Consumes the interrupt after its descriptor became readable */
+void rp_app_fpga_irq_ack(void);
+/* Closes the interrupt device, the next enable tries again */
+void rp_app_fpga_irq_close(void);
+
+#endif /* __RP_APP_FPGA_H */
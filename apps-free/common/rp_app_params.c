@@ -0,0 +1,91 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Parameter snapshot shared with the worker.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "rp_app_params.h"
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_params_init(rp_app_params_buf_t *buf, int num)
+{
+    memset(buf, 0, sizeof(rp_app_params_buf_t));
+    buf->values = (float *)calloc(num, sizeof(float));
+    if(buf->values == NULL)
+        return -1;
+    buf->num = num;
+    pthread_mutex_init(&buf->wr_mutex, NULL);
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_params_free(rp_app_params_buf_t *buf)
+{
+    if(buf->values == NULL)
+        return;
+    pthread_mutex_destroy(&buf->wr_mutex);
+    free(buf->values);
+    memset(buf, 0, sizeof(rp_app_params_buf_t));
+}
+
+
+/*----------------------------------------------------------------------------*/
+float *rp_app_params_write_begin(rp_app_params_buf_t *buf)
+{
+    pthread_mutex_lock(&buf->wr_mutex);
+    __atomic_store_n(&buf->seq, buf->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return buf->values;
+}
+
+
+/*----------------------------------------------------------------------------*/
+uint32_t rp_app_params_write_end(rp_app_params_buf_t *buf, int fpga_update)
+{
+    uint32_t gen = buf->gen + 1;
+
+    if(fpga_update)
+        __atomic_store_n(&buf->fpga_gen, gen, __ATOMIC_RELAXED);
+    /* The generation goes out first, a reader that sees it waits for the values */
+    __atomic_store_n(&buf->gen, gen, __ATOMIC_RELAXED);
+    __atomic_store_n(&buf->seq, buf->seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&buf->wr_mutex);
+    return gen;
+}
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_params_read(const rp_app_params_buf_t *buf, uint32_t *gen,
+                       float *values, int *fpga_update)
+{
+    uint32_t seq, new_gen, fpga_gen;
+
+    if(rp_app_params_gen(buf) == *gen)
+        return 0;
+
+    do {
+        while((seq = __atomic_load_n(&buf->seq, __ATOMIC_ACQUIRE)) & 1)
+            sched_yield();
+        new_gen  = __atomic_load_n(&buf->gen, __ATOMIC_RELAXED);
+        fpga_gen = __atomic_load_n(&buf->fpga_gen, __ATOMIC_RELAXED);
+        memcpy(values, buf->values, buf->num * sizeof(float));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while(__atomic_load_n(&buf->seq, __ATOMIC_RELAXED) != seq);
+
+    /* fpga_gen is newer than the last read, with wrap around */
+    *fpga_update = (int32_t)(fpga_gen - *gen) > 0;
+    *gen = new_gen;
+    return 1;
+}
@@ -0,0 +1,58 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Parameter snapshot shared with the worker.
+ *
+ * The web server thread publishes new parameter values, the worker copies
+ * them out without a lock. The buffer has a sequence counter which is odd
+ * while the values are written; a worker that raced the writer sees the
+ * counter change and copies again. Every publication also advances the
+ * generation, so the worker only copies when it changed since its last
+ * read. Writers are serialized among themselves on their own mutex, which
+ * the worker never takes to read.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_APP_PARAMS_H
+#define __RP_APP_PARAMS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+typedef struct rp_app_params_buf_s {
+    pthread_mutex_t wr_mutex; /* writers only */
+    uint32_t        seq;      /* odd while the values are written */
+    uint32_t        gen;      /* publications so far */
+    uint32_t        fpga_gen; /* last publication which asked for an FPGA update */
+    int             num;
+    float          *values;
+} rp_app_params_buf_t;
+
+int  rp_app_params_init(rp_app_params_buf_t *buf, int num);
+void rp_app_params_free(rp_app_params_buf_t *buf);
+
+/* Writer side, any thread. The num values go to rp_app_params_write_begin(),
+ * rp_app_params_write_end() publishes them and returns the new generation.
+ */
+float   *rp_app_params_write_begin(rp_app_params_buf_t *buf);
+uint32_t rp_app_params_write_end(rp_app_params_buf_t *buf, int fpga_update);
+
+/* Generation of the newest values, compare against the one of the last read */
+static inline uint32_t rp_app_params_gen(const rp_app_params_buf_t *buf)
+{
+    return __atomic_load_n(&buf->gen, __ATOMIC_ACQUIRE);
+}
+
+/* Reader side, one thread. Returns 0 if nothing was published since
+ * generation *gen. Otherwise copies the num values, updates *gen, sets
+ * *fpga_update if any of the publications since asked for it and returns 1.
+ */
+int rp_app_params_read(const rp_app_params_buf_t *buf, uint32_t *gen,
+                       float *values, int *fpga_update);
+
+#endif /* __RP_APP_PARAMS_H */
@@ -0,0 +1,116 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Memory pool for signal and DSP buffers.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rp_app_pool.h"
+
+
+/*----------------------------------------------------------------------------*/
+int rp_app_pool_init(rp_app_pool_t *pool, size_t size, int flags)
+{
+    void *base = MAP_FAILED;
+
+    memset(pool, 0, sizeof(rp_app_pool_t));
+    if(size == 0)
+        size = RP_APP_POOL_ALIGN;
+
+#ifdef MAP_HUGETLB
+    if(flags & RP_APP_POOL_HUGE) {
+        size_t huge_size = (size + RP_APP_POOL_HUGE_PAGE - 1) &
+            ~(size_t)(RP_APP_POOL_HUGE_PAGE - 1);
+
+        base = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(base != MAP_FAILED) {
+            size = huge_size;
+            pool->huge = 1;
+        }
+    }
+#endif
+    /* No huge pages reserved, the kernel may still back it transparently */
+    if(base == MAP_FAILED) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == MAP_FAILED) {
+            fprintf(stderr, "rp_app_pool_init() can not map %zu bytes\n", size);
+            return -1;
+        }
+#ifdef MADV_HUGEPAGE
+        if(flags & RP_APP_POOL_HUGE)
+            madvise(base, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    pool->base = (uint8_t *)base;
+    pool->size = size;
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_pool_free(rp_app_pool_t *pool)
+{
+    if(pool->base)
+        munmap(pool->base, pool->size);
+    memset(pool, 0, sizeof(rp_app_pool_t));
+}
+
+
+/*----------------------------------------------------------------------------*/
+void *rp_app_pool_alloc(rp_app_pool_t *pool, size_t size)
+{
+    size_t bytes = RP_APP_POOL_BYTES(size);
+    void *ptr;
+
+    if(pool->base == NULL || bytes > pool->size - pool->used) {
+        fprintf(stderr, "rp_app_pool_alloc() pool full, %zu of %zu bytes used\n",
+                pool->used, pool->size);
+        return NULL;
+    }
+    ptr = pool->base + pool->used;
+    pool->used += bytes;
+    /* Released buffers keep their old contents */
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+
+/*----------------------------------------------------------------------------*/
+float **rp_app_pool_signals(rp_app_pool_t *pool, int num, int len)
+{
+    size_t mark = rp_app_pool_mark(pool);
+    float **s;
+    int i;
+
+    s = (float **)rp_app_pool_alloc(pool, num * sizeof(float *));
+    if(s == NULL)
+        return NULL;
+    for(i = 0; i < num; i++) {
+        s[i] = (float *)rp_app_pool_alloc(pool, len * sizeof(float));
+        if(s[i] == NULL) {
+            rp_app_pool_release(pool, mark);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+
+/*----------------------------------------------------------------------------*/
+void rp_app_pool_release(rp_app_pool_t *pool, size_t mark)
+{
+    if(mark < pool->used)
+        pool->used = mark;
+}
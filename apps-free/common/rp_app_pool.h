@@ -0,0 +1,72 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya applications - Memory pool for signal and DSP buffers.
+ *
+ * A pool is one mapping set up when the worker starts, sized for the most
+ * the application ever needs. Buffers are cut from it in order, each
+ * aligned to RP_APP_POOL_ALIGN bytes for the NEON kernels, and are never
+ * freed one by one. Buffers that follow the parameters are allocated last
+ * and go back with rp_app_pool_release() to a mark taken before them, so a
+ * parameter change reuses the same memory instead of the heap. Pages the
+ * pool never reaches are not touched, a generous size costs address space
+ * only, except on huge pages which are reserved at once.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RP_APP_POOL_H
+#define __RP_APP_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Alignment of every buffer, one cache line */
+#define RP_APP_POOL_ALIGN     64
+/* Size of a huge page, the pool is rounded up to it with RP_APP_POOL_HUGE */
+#define RP_APP_POOL_HUGE_PAGE (2 * 1024 * 1024)
+
+/* rp_app_pool_init() flags */
+#define RP_APP_POOL_HUGE      1 /* huge pages if the kernel has free ones */
+
+/* Pool bytes a buffer of size bytes takes, to add up the pool size */
+#define RP_APP_POOL_BYTES(size) \
+    (((size_t)(size) + RP_APP_POOL_ALIGN - 1) & ~(size_t)(RP_APP_POOL_ALIGN - 1))
+
+/* Pool bytes of rp_app_pool_signals() */
+#define RP_APP_POOL_SIGNALS_BYTES(num, len) \
+    (RP_APP_POOL_BYTES((size_t)(num) * sizeof(float *)) + \
+     (size_t)(num) * RP_APP_POOL_BYTES((size_t)(len) * sizeof(float)))
+
+typedef struct rp_app_pool_s {
+    uint8_t *base;
+    size_t   size;  /* mapped bytes */
+    size_t   used;
+    int      huge;  /* 1 if the mapping is on huge pages */
+} rp_app_pool_t;
+
+int  rp_app_pool_init(rp_app_pool_t *pool, size_t size, int flags);
+void rp_app_pool_free(rp_app_pool_t *pool);
+
+/* Zeroed buffer of size bytes or NULL once the pool is full */
+void *rp_app_pool_alloc(rp_app_pool_t *pool, size_t size);
+
+/* Signal set of num signals of len samples: the table and the signals
+ * follow each other in the pool. NULL once the pool is full.
+ */
+float **rp_app_pool_signals(rp_app_pool_t *pool, int num, int len);
+
+/* Position to go back to with rp_app_pool_release() */
+static inline size_t rp_app_pool_mark(const rp_app_pool_t *pool)
+{
+    return pool->used;
+}
+
+/* Gives back every buffer allocated since mark was taken */
+void rp_app_pool_release(rp_app_pool_t *pool, size_t mark);
+
+#endif /* __RP_APP_POOL_H */
@@ -22,17 +22,15 @@
 #include "main.h"
 #include "fpga.h"
 #include "dsp.h"
-#include "kiss_fftr.h"
+#include "redpitaya/rp_dsp.h"
 
 
 /* length of output signals: floor(SPECTR_FPGA_SIG_LEN/2) */
 const int c_dsp_sig_len = SPECTR_FPGA_SIG_LEN / 2;
 
 /* Internal structures used in DSP  */
-double               *rp_hann_window   = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out1 = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out2 = NULL;
-kiss_fftr_cfg         rp_kiss_fft_cfg  = NULL;
+rp_dsp_cpx_t         *rp_fft_out1      = NULL;
+rp_dsp_cpx_t         *rp_fft_out2      = NULL;
 
 /* constants - calibration dependant */
 /* Power calc. impedance*/
@@ -96,20 +94,22 @@ int rp_resp_calc(double *cha_in, double *chb_in, int k1, double scale, int kstp,
     if(!cha_in || !chb_in ||  !*cha_out ||  !*chb_out )
         return -1;
 
-    if(!rp_kiss_fft_out1 || !rp_kiss_fft_out2 || !rp_kiss_fft_cfg) {
+    if(!rp_fft_out1 || !rp_fft_out2) {
         fprintf(stderr, "rp_spect_fft not initialized");
         return -1;
     }
 
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)cha_in, rp_kiss_fft_out1);
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)chb_in, rp_kiss_fft_out2);
+    if(rp_DspFftReal2(SPECTR_FPGA_SIG_LEN, cha_in, chb_in, rp_fft_out1, rp_fft_out2) != 0) {
+        fprintf(stderr, "rp_resp_calc() can not allocate mem");
+        return -1;
+    }
 
     for(i = 0; i < II; i++) {
 
-        cha_o[k1 + i] = sqrt(pow(rp_kiss_fft_out1[(k1 + i) * kstp].r, 2) +
-                pow(rp_kiss_fft_out1[(k1 + i) * kstp].i, 2)) * scale;
-        chb_o[k1 + i] = sqrt(pow(rp_kiss_fft_out2[(k1 + i) * kstp].r, 2) +
-                pow(rp_kiss_fft_out2[(k1 + i) * kstp].i, 2)) * scale;
+        cha_o[k1 + i] = sqrt(pow(rp_fft_out1[(k1 + i) * kstp].r, 2) +
+                pow(rp_fft_out1[(k1 + i) * kstp].i, 2)) * scale;
+        chb_o[k1 + i] = sqrt(pow(rp_fft_out2[(k1 + i) * kstp].r, 2) +
+                pow(rp_fft_out2[(k1 + i) * kstp].i, 2)) * scale;
 
         /* Saturate to -200 dB */
         const double c_min_response = 1e-10;
@@ -125,16 +125,17 @@ int rp_resp_calc(double *cha_in, double *chb_in, int k1, double scale, int kstp,
 
 int rp_spectr_fft_init()
 {
-    if(rp_kiss_fft_out1 || rp_kiss_fft_out2 || rp_kiss_fft_cfg) {
+    if(rp_fft_out1 || rp_fft_out2) {
         rp_spectr_fft_clean();
     }
 
-    rp_kiss_fft_out1 = 
-        (kiss_fft_cpx *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-    rp_kiss_fft_out2 =
-        (kiss_fft_cpx *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-
-    rp_kiss_fft_cfg = kiss_fftr_alloc(SPECTR_FPGA_SIG_LEN, 0, NULL, NULL);
+    rp_fft_out1 = rp_DspAlloc(SPECTR_FPGA_SIG_LEN * sizeof(rp_dsp_cpx_t));
+    rp_fft_out2 = rp_DspAlloc(SPECTR_FPGA_SIG_LEN * sizeof(rp_dsp_cpx_t));
+    if(!rp_fft_out1 || !rp_fft_out2) {
+        fprintf(stderr, "rp_spectr_fft_init() can not allocate mem");
+        rp_spectr_fft_clean();
+        return -1;
+    }
 
     return 0;
 }
@@ -142,19 +143,11 @@ int rp_spectr_fft_init()
 
 int rp_spectr_fft_clean()
 {
-    kiss_fft_cleanup();
-    if(rp_kiss_fft_out1) {
-        free(rp_kiss_fft_out1);
-        rp_kiss_fft_out1 = NULL;
-    }
-    if(rp_kiss_fft_out2) {
-        free(rp_kiss_fft_out2);
-        rp_kiss_fft_out2 = NULL;
-    }
-    if(rp_kiss_fft_cfg) {
-        free(rp_kiss_fft_cfg);
-        rp_kiss_fft_cfg = NULL;
-    }
+    rp_DspFree(rp_fft_out1);
+    rp_fft_out1 = NULL;
+    rp_DspFree(rp_fft_out2);
+    rp_fft_out2 = NULL;
+    rp_DspRelease();
     return 0;
 }
 
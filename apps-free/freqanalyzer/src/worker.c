@@ -34,6 +34,20 @@ int32_t ch1_data[NN*BUFFS] ;
 
 double scale[BUFFS];
 
+/** Synthesized excitation tables, kept per (ampl, kstart, kstep, II) */
+typedef struct {
+    int      ampl, kstart, kstep, II;
+    double   scale;
+    int32_t *data;
+} synth_cache_t;
+
+static synth_cache_t synth_cache[BUFFS];
+static int           synth_cache_len = 0;
+
+/** One period of cos() on the NN point AWG grid */
+static double synth_cos[NN];
+static int    synth_cos_ready = 0;
+
 /** AWG FPGA parameters */
 typedef struct {
     int32_t  offsgain;   ///< AWG offset & gain.
@@ -49,6 +63,10 @@ void synthesize_fra_sig(int ampl,  int kstart, int kstep, int II,
 void write_data_fpga(uint32_t ch, int enable, int trigger,
                     const int32_t *data, int buffoffs, const awg_param_t *awg, int step);
 
+void *rp_resp_thread_fn(void *args);
+void rp_resp_submit(int jj);
+void rp_resp_wait(void);
+
 
 
 
@@ -76,6 +94,20 @@ const int kstp=16;  //Should be set to (16k/2)/(II*JJ) in order to get to fs/2 a
 double *rp_cha_in = NULL;
 double *rp_chb_in = NULL;
 
+/* rp_resp_calc() runs on a second thread on the previous capture from
+ * rp_cha/chb_calc while the worker loads the next excitation pattern and
+ * acquires into rp_cha/chb_in. A capture is passed on by swapping pointers.
+ */
+double *rp_cha_calc = NULL;
+double *rp_chb_calc = NULL;
+pthread_t          rp_resp_thread;
+int                rp_resp_thread_run = 0;
+pthread_mutex_t    rp_resp_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t     rp_resp_cond  = PTHREAD_COND_INITIALIZER;
+int                rp_resp_job   = 0; /* 1 while a capture is being processed */
+int                rp_resp_quit  = 0;
+int                rp_resp_job_jj = 0;
+
 double *rp_cha_resp = NULL;
 double *rp_chb_resp = NULL;
 
@@ -117,6 +149,8 @@ int rp_spectr_worker_init(void)
 
     rp_cha_in = (double *)malloc(sizeof(double) * SPECTR_FPGA_SIG_LEN);
     rp_chb_in = (double *)malloc(sizeof(double) * SPECTR_FPGA_SIG_LEN);
+    rp_cha_calc = (double *)malloc(sizeof(double) * SPECTR_FPGA_SIG_LEN);
+    rp_chb_calc = (double *)malloc(sizeof(double) * SPECTR_FPGA_SIG_LEN);
 
     rp_cha_resp = (double *)malloc(sizeof(double) * SPECTR_OUT_SIG_LEN);
     rp_chb_resp = (double *)malloc(sizeof(double) * SPECTR_OUT_SIG_LEN);
@@ -124,7 +158,8 @@ int rp_spectr_worker_init(void)
     rp_cha_resp_cal = (double *)malloc(sizeof(double) * SPECTR_OUT_SIG_LEN);
     rp_chb_resp_cal = (double *)malloc(sizeof(double) * SPECTR_OUT_SIG_LEN);
 
-    if(!rp_cha_resp ||  !rp_chb_resp || !rp_cha_resp_cal || !rp_chb_resp_cal || !rp_cha_in || !rp_chb_in) {
+    if(!rp_cha_resp ||  !rp_chb_resp || !rp_cha_resp_cal || !rp_chb_resp_cal || !rp_cha_in || !rp_chb_in ||
+       !rp_cha_calc || !rp_chb_calc) {
         rp_spectr_worker_clean();
         return -1;
     }
@@ -140,6 +175,11 @@ int rp_spectr_worker_init(void)
     }
     spectr_fpga_get_sig_ptr(&rp_fpga_cha_signal, &rp_fpga_chb_signal);
 
+    /* Without the thread the worker calculates the responses itself */
+    rp_resp_job = 0;
+    rp_resp_quit = 0;
+    rp_resp_thread_run = (pthread_create(&rp_resp_thread, NULL, rp_resp_thread_fn, NULL) == 0);
+
     rp_spectr_thread_handler = (pthread_t *)malloc(sizeof(pthread_t));
     if(rp_spectr_thread_handler == NULL) {
         rp_cleanup_signals(&rp_spectr_signals);
@@ -165,6 +205,15 @@ int rp_spectr_worker_init(void)
 
 int rp_spectr_worker_clean(void)
 {
+    if(rp_resp_thread_run) {
+        pthread_mutex_lock(&rp_resp_mutex);
+        rp_resp_quit = 1;
+        pthread_cond_broadcast(&rp_resp_cond);
+        pthread_mutex_unlock(&rp_resp_mutex);
+        pthread_join(rp_resp_thread, NULL);
+        rp_resp_thread_run = 0;
+    }
+
     spectr_fpga_exit();
 
     rp_cleanup_signals(&rp_spectr_signals);
@@ -180,6 +229,14 @@ int rp_spectr_worker_clean(void)
         free(rp_chb_in);
         rp_chb_in = NULL;
     }
+    if(rp_cha_calc) {
+        free(rp_cha_calc);
+        rp_cha_calc = NULL;
+    }
+    if(rp_chb_calc) {
+        free(rp_chb_calc);
+        rp_chb_calc = NULL;
+    }
 
     if(rp_cha_resp) {
         free(rp_cha_resp);
@@ -427,8 +484,9 @@ void *rp_spectr_worker_thread(void *args)
         /* retrieve data and process it*/
         spectr_fpga_get_signal(&rp_cha_in, &rp_chb_in);
 
-        /* Calculate response at frequency components for each excitation pattern*/
-        rp_resp_calc(&rp_cha_in[0], &rp_chb_in[0], jj_state*II, scale[jj_state], kstp, II, (double **)&rp_cha_resp, (double **)&rp_chb_resp);
+        /* Calculate response at frequency components for each excitation pattern,
+         * this runs while the next pattern is loaded and acquired */
+        rp_resp_submit(jj_state);
 
         // Continue acquiring and processing until all the pattern sequence completed
         if (jj_state < JJ) {
@@ -436,6 +494,7 @@ void *rp_spectr_worker_thread(void *args)
         } else {
             // Response characterization completed
             jj_state = 0;
+            rp_resp_wait();
 
             /* Perform calibration at startup or parameter update.
              * TODO: add a GUI Calibration button for individual channels
@@ -483,13 +542,69 @@ void *rp_spectr_worker_thread(void *args)
 }
 
 
+void *rp_resp_thread_fn(void *args)
+{
+    pthread_mutex_lock(&rp_resp_mutex);
+    while(1) {
+        while(!rp_resp_job && !rp_resp_quit)
+            pthread_cond_wait(&rp_resp_cond, &rp_resp_mutex);
+        if(rp_resp_quit)
+            break;
+        pthread_mutex_unlock(&rp_resp_mutex);
+
+        rp_resp_calc(&rp_cha_calc[0], &rp_chb_calc[0], rp_resp_job_jj*II, scale[rp_resp_job_jj], kstp, II, (double **)&rp_cha_resp, (double **)&rp_chb_resp);
+
+        pthread_mutex_lock(&rp_resp_mutex);
+        rp_resp_job = 0;
+        pthread_cond_broadcast(&rp_resp_cond);
+    }
+    pthread_mutex_unlock(&rp_resp_mutex);
+    return NULL;
+}
+
+/* Hands the capture in rp_cha/chb_in to the response thread */
+void rp_resp_submit(int jj)
+{
+    double *tmp;
+
+    if(!rp_resp_thread_run) {
+        rp_resp_calc(&rp_cha_in[0], &rp_chb_in[0], jj*II, scale[jj], kstp, II, (double **)&rp_cha_resp, (double **)&rp_chb_resp);
+        return;
+    }
+
+    pthread_mutex_lock(&rp_resp_mutex);
+    while(rp_resp_job)
+        pthread_cond_wait(&rp_resp_cond, &rp_resp_mutex);
+    tmp = rp_cha_calc;
+    rp_cha_calc = rp_cha_in;
+    rp_cha_in = tmp;
+    tmp = rp_chb_calc;
+    rp_chb_calc = rp_chb_in;
+    rp_chb_in = tmp;
+    rp_resp_job_jj = jj;
+    rp_resp_job = 1;
+    pthread_cond_broadcast(&rp_resp_cond);
+    pthread_mutex_unlock(&rp_resp_mutex);
+}
+
+/* Waits until the last submitted capture is in rp_cha/chb_resp */
+void rp_resp_wait(void)
+{
+    pthread_mutex_lock(&rp_resp_mutex);
+    while(rp_resp_job)
+        pthread_cond_wait(&rp_resp_cond, &rp_resp_mutex);
+    pthread_mutex_unlock(&rp_resp_mutex);
+}
+
+
 void synthesize_fra_sig(int ampl,  int kstart, int kstep, int II,
                        int32_t *data, int buffoffs, double *scale,
                        awg_param_t *awg)
 {
-    uint32_t ix, jx;
+    uint32_t ix, jx, ph, k;
     double ddata[NN];
     double maxabs = 0;
+    synth_cache_t *c;
 
     // Various locally used constants - HW specific parameters
     const int dcoffs = -155;
@@ -498,23 +613,35 @@ void synthesize_fra_sig(int ampl,  int kstart, int kstep, int II,
     awg->step = round(65536 * 1);
     awg->wrap = round(65536 * NN-1);
 
-    // Fill data[] with appropriate buffer samples
-    for (jx = 0; jx < II; jx++) {
-        for (ix = 0; ix < NN; ix++) {
-            if (jx == 0) {
-                ddata[ix] = cos(2 * M_PI * (double)ix / (double)NN *
-                        (double)(kstart + kstep * jx));
-            } else {
-                ddata[ix] = ddata[ix] + cos(2 * M_PI * (double)ix / (double)NN *
-                        (double)(kstart + kstep * jx));
-            }
+    // Same tones as an earlier call, reuse the table
+    for (jx = 0; jx < synth_cache_len; jx++) {
+        c = &synth_cache[jx];
+        if (c->ampl == ampl && c->kstart == kstart && c->kstep == kstep && c->II == II) {
+            memcpy(&data[buffoffs], c->data, NN * sizeof(int32_t));
+            *scale = c->scale;
+            return;
         }
     }
 
+    if (!synth_cos_ready) {
+        for (ix = 0; ix < NN; ix++)
+            synth_cos[ix] = cos(2 * M_PI * (double)ix / (double)NN);
+        synth_cos_ready = 1;
+    }
+
+    // Fill data[] with appropriate buffer samples, every tone is a whole
+    // number of periods so its phase steps through synth_cos[] exactly
+    memset(ddata, 0, sizeof(ddata));
+    for (jx = 0; jx < II; jx++) {
+        k = (uint32_t)(kstart + kstep * jx) % NN;
+        for (ix = 0, ph = 0; ix < NN; ix++, ph = (ph + k) & (NN - 1))
+            ddata[ix] += synth_cos[ph];
+    }
+
 	// Checking maximum
 	for (ix = 0; ix < NN; ix++) {
-		if (abs(ddata[ix]) > maxabs)
-			maxabs = abs(ddata[ix]);
+		if (fabs(ddata[ix]) > maxabs)
+			maxabs = fabs(ddata[ix]);
 	}
 
 	*scale = maxabs;
@@ -528,6 +655,19 @@ void synthesize_fra_sig(int ampl,  int kstart, int kstep, int II,
 			data[ix+buffoffs] = round(ddata[ix] * ((double)ampl) / maxabs);
 	}
 
+    if (synth_cache_len < BUFFS) {
+        c = &synth_cache[synth_cache_len];
+        c->data = (int32_t *)malloc(NN * sizeof(int32_t));
+        if (c->data) {
+            memcpy(c->data, &data[buffoffs], NN * sizeof(int32_t));
+            c->ampl = ampl;
+            c->kstart = kstart;
+            c->kstep = kstep;
+            c->II = II;
+            c->scale = maxabs;
+            synth_cache_len++;
+        }
+    }
 }
 
 
@@ -152,6 +152,7 @@ static rp_app_params_t rp_main_params[PARAMS_NUM+1] = {
        *    0 - negative
        *    1 - positive 
        *    2 - Other ( Change the max value for more states )
+       *    3 - Frequency sweep with multi-sine excitation
        *  - Setting max value to 2 for general purposes. Can be changed accordingly. 
        *  - Read only value set to 0, as the flag_button value can be changed from Javascript 
        *    code in index.html as well as from the C controller code. */
@@ -323,8 +323,8 @@ void *rp_osc_worker_thread(void *args)
         float measure_option = rp_get_params_lcr(0);
         /* Set max command lenght */
         char command[100];
-        /* Frequency sweep */
-        if(measure_option == 1){
+        /* Frequency sweep, 3 with multi-sine excitation */
+        if(measure_option == 1 || measure_option == 3){
 
 
             float lcr_steps = rp_get_params_lcr(1);
@@ -383,7 +383,7 @@ void *rp_osc_worker_thread(void *args)
             strcat(command, im);
             strcat(command, " ");
             strcat(command, steps);
-            strcat(command, " 1 ");
+            strcat(command, measure_option == 3 ? " 2 " : " 1 ");
 
             strcat(command, sF);
             strcat(command, " ");
@@ -24,7 +24,7 @@
 #include "main.h"
 #include "fpga_lti.h"
 #include "dsp.h"
-#include "kiss_fftr.h"
+#include "redpitaya/rp_dsp.h"
 #include "complex.h"
 
 
@@ -35,12 +35,6 @@ extern const int c_lti_fpga_adc_bits;
 /* length of output signals: floor(LTI_FPGA_SIG_LEN/2) */
 const int c_dsp_sig_len = LTI_FPGA_SIG_LEN>>1;
 
-/* Internal structures used in DSP  */
-double                *rp_hann_window   = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out1 = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out2 = NULL;
-kiss_fftr_cfg         rp_kiss_fft_cfg  = NULL;
-
 /* constants - calibration dependant */
 /* Power calc. impedance*/
 const double c_imp = 50;
@@ -90,30 +84,11 @@ int rp_lti_prepare_freq_vector(float **freq_out, double f_s, float freq_range)
 
 int rp_lti_hann_init()
 {
-    int i;
-
-    rp_lti_hann_clean(rp_hann_window);
-
-    rp_hann_window = (double *)malloc(LTI_FPGA_SIG_LEN * sizeof(double));
-    if(rp_hann_window == NULL) {
-        fprintf(stderr, "rp_lti_hann_create() can not allocate mem");
-        return -1;
-    }
-    
-    for(i = 0; i < LTI_FPGA_SIG_LEN; i++) {
-        rp_hann_window[i] = RP_LTI_HANN_AMP * 
-            (1 - cos(2*M_PI*i / (double)(LTI_FPGA_SIG_LEN-1)));
-    }
-
     return 0;
 }
 
 int rp_lti_hann_clean()
 {
-    if(rp_hann_window) {
-        free(rp_hann_window);
-        rp_hann_window = NULL;
-    }
     return 0;
 }
 
@@ -121,77 +96,39 @@ int rp_lti_hann_clean()
 int rp_lti_hann_filter(double *cha_in, double *chb_in,
                           double **cha_out, double **chb_out)
 {
-    int i;
-    double *cha_o = *cha_out;
-    double *chb_o = *chb_out;
-
     if(!cha_in || !chb_in || !*cha_out || !*chb_out)
         return -1;
-    for(i = 0; i < LTI_FPGA_SIG_LEN; i++) {
-        cha_o[i] = cha_in[i] * rp_hann_window[i];
-        chb_o[i] = chb_in[i] * rp_hann_window[i];
-    }
 
+    if(rp_DspWindowHann(LTI_FPGA_SIG_LEN, RP_LTI_HANN_AMP, cha_in, *cha_out) != 0 ||
+       rp_DspWindowHann(LTI_FPGA_SIG_LEN, RP_LTI_HANN_AMP, chb_in, *chb_out) != 0) {
+        fprintf(stderr, "rp_lti_hann_filter() can not allocate mem");
+        return -1;
+    }
     return 0;
 }
 
 int rp_lti_fft_init()
 {
-    if(rp_kiss_fft_out1 || rp_kiss_fft_out2 || rp_kiss_fft_cfg) {
-        rp_lti_fft_clean();
-    }
-
-    rp_kiss_fft_out1 = 
-        (kiss_fft_cpx *)malloc(LTI_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-    rp_kiss_fft_out2 =
-        (kiss_fft_cpx *)malloc(LTI_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-
-    rp_kiss_fft_cfg = kiss_fftr_alloc(LTI_FPGA_SIG_LEN, 0, NULL, NULL);
-
     return 0;
 }
 
 int rp_lti_fft_clean()
 {
-    kiss_fft_cleanup();
-    if(rp_kiss_fft_out1) {
-        free(rp_kiss_fft_out1);
-        rp_kiss_fft_out1 = NULL;
-    }
-    if(rp_kiss_fft_out2) {
-        free(rp_kiss_fft_out2);
-        rp_kiss_fft_out2 = NULL;
-    }
-    if(rp_kiss_fft_cfg) {
-        free(rp_kiss_fft_cfg);
-        rp_kiss_fft_cfg = NULL;
-    }
+    rp_DspRelease();
     return 0;
 }
 
 int rp_lti_fft(double *cha_in, double *chb_in, 
                   double **cha_out, double **chb_out)
 {
-    double *cha_o = *cha_out;
-    double *chb_o = *chb_out;
-    int i;
     if(!cha_in || !chb_in || !*cha_out || !*chb_out)
         return -1;
 
-    if(!rp_kiss_fft_out1 || !rp_kiss_fft_out2 || !rp_kiss_fft_cfg) {
-        fprintf(stderr, "rp_lti_fft not initialized");
+    // FFT limited to fs/2, specter of amplitudes
+    if(rp_DspFftAbs2(LTI_FPGA_SIG_LEN, cha_in, chb_in, *cha_out, *chb_out, c_dsp_sig_len) != 0) {
+        fprintf(stderr, "rp_lti_fft() can not allocate mem");
         return -1;
     }
-
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)cha_in, rp_kiss_fft_out1);
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)chb_in, rp_kiss_fft_out2);
-
-    for(i = 0; i < c_dsp_sig_len; i++) {                     // FFT limited to fs/2, specter of amplitudes
-        cha_o[i] = sqrt(pow(rp_kiss_fft_out1[i].r, 2) + 
-                        pow(rp_kiss_fft_out1[i].i, 2));
-        chb_o[i] = sqrt(pow(rp_kiss_fft_out2[i].r, 2) + 
-                        pow(rp_kiss_fft_out2[i].i, 2));
-    }
     return 0;
 }
 
@@ -19,11 +19,17 @@
 #include <math.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LTI_USE_NEON
+#endif
+
 #include "fpga_lti.h"
 
 
@@ -307,6 +313,118 @@ int lti_fpga_get_signal(double **cha_signal, double **chb_signal)
     return 0;
 }
 
+/**	
+**                      +--------------+      FIR             IIR                                                  
+**  INPUT               |              |                                                            OUTPUT             
+**+----------+---------->   x b0 (p0)  +----->(+)------------>(+)---------------------------------+--------->
+**           |          |              |       ^               ^                                  |          
+**           |          +--------------+       |               |                                  |          
+**           |                                 |               |                                  |          
+**           |                                 |               |                                  |    
+**    +------v------+                          |               |                           +------v------+   
+**    |             |                          |               |                           |             |   
+**    |     s0      |                          |               |                           |     s64     |   
+**    |             |                          |               |                           |             |   
+**    +------+------+                          |               |                           +------+------+                 
+**           |          +--------------+       |               |        +----------------+        |          
+**           |          |              |       |               |        |                |        |          
+**           +---------->   x b1 (p1)  +----->(+)             (+)<------+  x -a1 (-p65)  <--------+          
+**           |          |              |       ^               ^        |                |        |          
+**           |          +--------------+       |               |        +----------------+        |          
+**    +------v------+                          |               |                           +------v------+   
+**    |             |                          |               |                           |             |   
+**    |     s1      |                          |               |                           |     s65     |   
+**    |             |                          |               |                           |             |   
+**    +------+------+                          |               |                           +------+------+   
+**           |                                 |               |                                  |          
+**           |          +--------------+       |               |        +----------------+        |          
+**           |          |              |       |               |        |                |        |          
+**           +---------->   x b2 (p2)  +----->(+)             (+)<------+  x -a2 (-p66)  <--------+          
+**           |          |              |       ^               ^        |                |        |          
+**           |          +--------------+       |               |        +----------------+        |          
+**           v                                 +               +                                  v          
+**
+** The filter runs in single precision on blocks of LTI_DSP_BLOCK samples.
+** x and y below hold order-1 history samples followed by the block, the
+** FIR part is vectorised across samples and only the IIR recursion is
+** sequential. Both kernels are inlined with the order as a constant for
+** LTI_DSP_ORDER so the coefficient loops unroll.
+**                                                                                                           */
+
+static inline __attribute__((always_inline))
+void lti_dsp_fir(const float *b, int order, const float *x, float *w, int n)
+{
+    int i, k;
+#ifdef LTI_USE_NEON
+    for(i = 0; i + 4 <= n; i += 4) {
+        float32x4_t acc = vmulq_n_f32(vld1q_f32(x + order - 1 + i), b[0]);
+        for(k = 1; k < order; k++)
+            acc = vmlaq_n_f32(acc, vld1q_f32(x + order - 1 + i - k), b[k]);
+        vst1q_f32(w + i, acc);
+    }
+#else
+    i = 0;
+#endif
+    for(; i < n; i++) {
+        float acc = b[0] * x[order - 1 + i];
+        for(k = 1; k < order; k++)
+            acc += b[k] * x[order - 1 + i - k];
+        w[i] = acc;
+    }
+}
+
+static inline __attribute__((always_inline))
+void lti_dsp_iir(const float *a, int order, const float *w, float *y, int n)
+{
+    int i, k;
+    for(i = 0; i < n; i++) {
+        float acc = w[i];
+        for(k = 1; k < order; k++)
+            acc -= a[k] * y[order - 1 + i - k];
+        y[order - 1 + i] = acc;
+    }
+}
+
+/* Raw 14 bit two's complement samples to float */
+static void lti_dsp_s14_to_float(const int32_t *in, float *out, int n)
+{
+    int i = 0;
+#ifdef LTI_USE_NEON
+    for(; i + 4 <= n; i += 4) {
+        int32x4_t v = vshrq_n_s32(vshlq_n_s32(vld1q_s32(in + i), 18), 18);
+        vst1q_f32(out + i, vcvtq_f32_s32(v));
+    }
+#endif
+    for(; i < n; i++)
+        out[i] = (float)((int32_t)((uint32_t)in[i] << 18) >> 18);
+}
+
+/* Float to saturated, rounded 14 bit two's complement DAC samples */
+static void lti_dsp_float_to_s14(const float *in, int32_t *out, int n)
+{
+    int i = 0;
+#ifdef LTI_USE_NEON
+    const float32x4_t mx = vdupq_n_f32((float)((1<<13)-1));
+    const float32x4_t mn = vdupq_n_f32((float)(-(1<<13)));
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float32x4_t nhalf = vdupq_n_f32(-0.5f);
+    const int32x4_t mask = vdupq_n_s32((1<<14)-1);
+    for(; i + 4 <= n; i += 4) {
+        float32x4_t v = vmaxq_f32(vminq_f32(vld1q_f32(in + i), mx), mn);
+        v = vaddq_f32(v, vbslq_f32(vcltq_f32(v, vdupq_n_f32(0)), nhalf, half));
+        vst1q_s32(out + i, vandq_s32(vcvtq_s32_f32(v), mask));
+    }
+#endif
+    for(; i < n; i++) {
+        float v = in[i];
+        if(v > (float)((1<<13)-1))
+            v = (float)((1<<13)-1);
+        if(v < (float)(-(1<<13)))
+            v = (float)(-(1<<13));
+        out[i] = (int32_t)lroundf(v) & ((1<<14)-1);
+    }
+}
+
 int lti_fpga_online_dsp(double **ch1_data, double **ch2_data, int gen_delay,  
 			   double **state_a, double **state_b, double **dsp_par_a, 
 			   double **dsp_par_b, int dsp_loc_ptr, int **awg_a_ptr, 
@@ -322,9 +440,13 @@ int lti_fpga_online_dsp(double **ch1_data, double **ch2_data, int gen_delay,
 
     double *cha_dsp_par = *dsp_par_a; // DSP parameters array
     
-    double fir,iir,curr_in; // DSP variables    
     int order;   
-    int dsp_ix;
+    int dsp_ix, n, i;
+
+    /* Single precision copies of the parameters and states */
+    float b[64], a[64];
+    float x[63 + LTI_DSP_BLOCK], y[63 + LTI_DSP_BLOCK], w[LTI_DSP_BLOCK];
+    int32_t raw[LTI_DSP_BLOCK];
      
     int *cha_awg=*awg_a_ptr;       
     //int *chb_awg=*awg_b_ptr;     DSP enabled on channel 1 only
@@ -335,14 +457,27 @@ int lti_fpga_online_dsp(double **ch1_data, double **ch2_data, int gen_delay,
         fprintf(stderr, "lti_fpga_get_signal() not initialized\n");
         return -1;
     }  
+    if(order < 1 || order > 64) {
+        fprintf(stderr, "lti_fpga_online_dsp() invalid order %d\n", order);
+        return -1;
+    }
+
+    // Coefficients: b at p0.., a at p65.. (a0 = 1, p64 holds the order)
+    // States: x[n-1-k] at s(k), y[n-1-k] at s(64+k)
+    for (dsp_ix=0; dsp_ix<order; dsp_ix++)
+    {
+      b[dsp_ix]=cha_dsp_par[dsp_ix];
+      a[dsp_ix]=dsp_ix ? cha_dsp_par[64+dsp_ix] : 1;
+    }
+    for (dsp_ix=0; dsp_ix<(order-1); dsp_ix++)
+    {
+      x[order-2-dsp_ix]=cha_state[dsp_ix];
+      y[order-2-dsp_ix]=cha_state[64+dsp_ix];
+    }
      
      // Check current input write pointer (the buffer is running ("live" mode) ) 
       lti_fpga_get_wr_ptr(&curr_ptr, NULL);
     
-    
-   // Process the samples behind write pointer   
-     
-      
       // Resolve buffer wrapping  
       if ((curr_ptr)<dsp_loc_ptr)
       {
@@ -350,10 +485,8 @@ int lti_fpga_online_dsp(double **ch1_data, double **ch2_data, int gen_delay,
       }
       //Now dsp_loc_ptr <= curr_ptr 
       
-   
-      
       //(loc. to be processed from dsp_loc_ptr to curr_ptr-1)  
-      for(in_idx= dsp_loc_ptr, out_idx=0; in_idx<(curr_ptr-1); in_idx++, out_idx++) {
+      for(in_idx= dsp_loc_ptr, out_idx=0; in_idx<(curr_ptr-1); in_idx+=n, out_idx+=n) {
 	
 	// Resolve buffer wrapping
 	in_loc = in_idx % LTI_FPGA_SIG_LEN;
@@ -361,105 +494,57 @@ int lti_fpga_online_dsp(double **ch1_data, double **ch2_data, int gen_delay,
 	// Calculates output buffer location corresponting to current DSP input buffer location	
 	// The buffers are started simultaneously 
 	out_loc= (in_idx+gen_delay) % LTI_FPGA_SIG_LEN;
-	
-	
-	
-	// ADD DSP CODE HERE	
-	
-	// IIR FILTER implementation
-	
-	
-/**	
-**                      +--------------+      FIR             IIR                                                  
-**  INPUT               |              |                                                            OUTPUT             
-**+----------+---------->   x b0 (p0)  +----->(+)------------>(+)---------------------------------+--------->
-**           |          |              |       ^               ^                                  |          
-**           |          +--------------+       |               |                                  |          
-**           |                                 |               |                                  |          
-**           |                                 |               |                                  |    
-**    +------v------+                          |               |                           +------v------+   
-**    |             |                          |               |                           |             |   
-**    |     s0      |                          |               |                           |     s64     |   
-**    |             |                          |               |                           |             |   
-**    +------+------+                          |               |                           +------+------+                 
-**           |          +--------------+       |               |        +----------------+        |          
-**           |          |              |       |               |        |                |        |          
-**           +---------->   x b1 (p1)  +----->(+)             (+)<------+  x -a1 (-p65)  <--------+          
-**           |          |              |       ^               ^        |                |        |          
-**           |          +--------------+       |               |        +----------------+        |          
-**    +------v------+                          |               |                           +------v------+   
-**    |             |                          |               |                           |             |   
-**    |     s1      |                          |               |                           |     s65     |   
-**    |             |                          |               |                           |             |   
-**    +------+------+                          |               |                           +------+------+   
-**           |                                 |               |                                  |          
-**           |          +--------------+       |               |        +----------------+        |          
-**           |          |              |       |               |        |                |        |          
-**           +---------->   x b2 (p2)  +----->(+)             (+)<------+  x -a2 (-p66)  <--------+          
-**           |          |              |       ^               ^        |                |        |          
-**           |          +--------------+       |               |        +----------------+        |          
-**           v                                 +               +                                  v          
-**                                                                                                           */
 
-// MAC (MultiplyAndAccumulate) 
-	
-	// Retrieve input signal
-	curr_in=conv_s14_to_double(g_lti_fpga_cha_mem[in_loc]);
-	
-	//First FIR coefficient (b0)
-	fir=curr_in*cha_dsp_par[0];
-	//Initialize IIR
-	iir=0;
-	
-	// For every FIR and IIR coeff.
-	for (dsp_ix=0; dsp_ix<(order-1); dsp_ix++)
+	// Block length, input and output must not wrap inside the block
+	n = (curr_ptr-1) - in_idx;
+	n = MIN(n, LTI_DSP_BLOCK);
+	n = MIN(n, LTI_FPGA_SIG_LEN - in_loc);
+	n = MIN(n, LTI_FPGA_SIG_LEN - out_loc);
+
+	// Retrieve input signal, pass it on for GUI visualization purposes
+	for (i=0; i<n; i++)
 	{
-	  // Accumulate delayed FIR input times FIR coeffs. (starting from s0*b1 (at loc 1))
-	  fir+=cha_state[dsp_ix]*cha_dsp_par[dsp_ix+1];
-	  // Accumulate delayes IIR output state times IIR coeffs. (starting from s64*(-a1) (at loc p65), a0 is by definition =1, (at loc. p64 is stored filter order))
-	  iir+=cha_state[64+dsp_ix]*(-cha_dsp_par[64+dsp_ix+1]);
-	   
-	  //fprintf(fp3, "  dsp_ix: %d (in_idx: %d) fir: %4.4f iir: %4.4f ParFIR: %4.4f ParIIR: %4.4f  stat_fir: %4.4f  stat_iir: %4.4f\n", dsp_ix, in_idx, fir, iir, cha_dsp_par[dsp_ix+1], (-cha_dsp_par[64+dsp_ix+1]), cha_state[dsp_ix], cha_state[64+dsp_ix] );   
-	 
+	  raw[i] = g_lti_fpga_cha_mem[in_loc+i];
+	  cha_in[out_idx+i] = raw[i];
+	  chb_in[out_idx+i] = g_lti_fpga_chb_mem[in_loc+i];
 	}
-	//add also FIR term
-	iir+=fir;
-	
-	// Propagating states for next iteration: from last register in the chain to the first
-	
-	for (dsp_ix=(order-1); dsp_ix>0 ;dsp_ix--)
+	lti_dsp_s14_to_float(raw, x+order-1, n);
+
+	// IIR FILTER implementation
+	if (order == LTI_DSP_ORDER)
 	{
-	  // FIR states
-	  cha_state[dsp_ix]=cha_state[dsp_ix-1];
-	  // IIR states
-	  cha_state[64+dsp_ix]=cha_state[64+dsp_ix-1];
+	  lti_dsp_fir(b, LTI_DSP_ORDER, x, w, n);
+	  lti_dsp_iir(a, LTI_DSP_ORDER, w, y, n);
+	}
+	else
+	{
+	  lti_dsp_fir(b, order, x, w, n);
+	  lti_dsp_iir(a, order, w, y, n);
 	}
-	//Updating first registers
-	cha_state[0]=curr_in;
-	cha_state[64]=iir;
-	
-	// First IIR register corresponds to output to be applied to DAC
-	cha_awg[out_loc] = conv_double_to_s14(cha_state[64]);
-	
-	
-	//IIR implementation ends
-	
-	
 
-	// Signal acquisition: pass processed samples for GUI visualization purposes
-	cha_in[out_idx] = g_lti_fpga_cha_mem[in_loc];
-        chb_in[out_idx] = g_lti_fpga_chb_mem[in_loc];
-	
+	// Output to be applied to DAC
+	lti_dsp_float_to_s14(y+order-1, raw, n);
+	for (i=0; i<n; i++)
+	  cha_awg[out_loc+i] = raw[i];
+
+	// Keep the last order-1 samples as history for the next block
+	memmove(x, x+n, (order-1)*sizeof(float));
+	memmove(y, y+n, (order-1)*sizeof(float));
       }
+
+      // Store states for the next call
+      for (dsp_ix=0; dsp_ix<(order-1); dsp_ix++)
+      {
+	cha_state[dsp_ix]=x[order-2-dsp_ix];
+	cha_state[64+dsp_ix]=y[order-2-dsp_ix];
+      }
+
       // return next DSP cycle pointer
       dsp_ptr=(curr_ptr-1) % LTI_FPGA_SIG_LEN;;
       
       //Thid pointer can be used to calculate elapsed DSP time
       //lti_fpga_get_wr_ptr(&curr_ptr, NULL);
  
-      
-      
-      
   return dsp_ptr;
 }
 
@@ -47,6 +47,10 @@ typedef struct hk_fpga_reg_mem_s {
 #define LTI_FPGA_SIG_LEN   (16*1024)
 #define LTI_DSP_STATES     128
 #define LTI_DSP_PARAMS     128
+/* IIR coefficient count the online DSP is specialised for (b0..b5, a1..a5) */
+#define LTI_DSP_ORDER      6
+/* Samples converted and filtered per block */
+#define LTI_DSP_BLOCK      256
 
 
 #define LTI_FPGA_CONF_ARM_BIT  1
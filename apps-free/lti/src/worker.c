@@ -413,7 +413,7 @@ void *rp_lti_worker_thread(void *args)
 	rp_dsp_par_a[4]=curr_params[LTI_B4].value;
 	rp_dsp_par_a[5]=curr_params[LTI_B5].value;
 
-	rp_dsp_par_a[64]=6;         // order (a0 is implicitly = 1)
+	rp_dsp_par_a[64]=LTI_DSP_ORDER; // order (a0 is implicitly = 1)
 	rp_dsp_par_a[65]=curr_params[LTI_A1].value; 
 	rp_dsp_par_a[66]=curr_params[LTI_A2].value; 
 	rp_dsp_par_a[67]=curr_params[LTI_A3].value; 
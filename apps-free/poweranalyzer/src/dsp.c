@@ -24,7 +24,7 @@
 #include "main.h"
 #include "fpga.h"
 #include "dsp.h"
-#include "kiss_fftr.h"
+#include "redpitaya/rp_dsp.h"
 
 extern float g_pwr_fpga_adc_max_v;
 extern const int c_pwr_fpga_adc_bits;
@@ -33,113 +33,94 @@ extern const int c_pwr_fpga_adc_bits;
 const int c_dsp_sig_len = PWR_FPGA_SIG_LEN>>1;
 const int pwr_dft_harmonic_num = 100;
 
-/* Internal structures used in DSP  */
-double            *rp_hann_window  = NULL;
-kiss_fft_cpx      *rp_kiss_fft_out = NULL;
-kiss_fftr_cfg      rp_kiss_fft_cfg = NULL;
-double            *rp_dft_out_re_U = NULL;
-double            *rp_dft_out_im_U = NULL;
-double            *rp_dft_out_re_I = NULL;
-double            *rp_dft_out_im_I = NULL; 
+/* Internal structures used in DSP, the bins of U and I of rp_pwr_fft2()
+ * follow each other */
+rp_dsp_cpx_t      *rp_fft_out      = NULL;
+int                rp_fft_out_len  = 0;
+int                rp_fft_len      = 0;
 
-const double PI2 = 2 * M_PI;
+/* Harmonics: frequencies in cycles per sample, single precision inputs
+ * for rp_DspDemod() and the bins of U and I
+ */
+double            *rp_dft_freq     = NULL;
+float             *rp_dft_in_U     = NULL;
+float             *rp_dft_in_I     = NULL;
+rp_dsp_cpx_t      *rp_dft_out_U    = NULL;
+rp_dsp_cpx_t      *rp_dft_out_I    = NULL;
+
+/* The I harmonics are computed on a second thread while the caller of
+ * rp_pwr_dft() computes the U ones, so both cores share the work
+ */
+pthread_t          rp_dft_thread;
+int                rp_dft_thread_run = 0;
+pthread_mutex_t    rp_dft_mutex    = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t     rp_dft_cond     = PTHREAD_COND_INITIALIZER;
+int                rp_dft_job      = 0; /* 1 while the I harmonics are pending */
+int                rp_dft_quit     = 0;
+const double      *rp_dft_job_in   = NULL;
+int                rp_dft_job_len  = 0;
 
 
 int rp_pwr_hann_init(int length)
 {
-    int i;
-
-    rp_pwr_hann_clean();
-
-    rp_hann_window = (double *)malloc(length * sizeof(double));
-    if(rp_hann_window == NULL) {
-        fprintf(stderr, "rp_pwr_hann_create() can not allocate mem");
-        return -1;
-    }
-    
-    for(i = 0; i < length; i++) {
-        rp_hann_window[i] = RP_PWR_HANN_AMP * 
-            (1 - cos(PI2 * i / (double)(length-1)));
-    }
-
     return 0;
 }
 
 int rp_pwr_hann_clean()
 {
-    if(rp_hann_window) {
-        free(rp_hann_window);
-        rp_hann_window = NULL;
-    }
     return 0;
 }
 
 
 int rp_pwr_hann_filter(double *ch_in, double *ch_out, int length)
 {
-    int i;
-    
     if(!ch_in || !ch_out)
         return -1;
-    for(i = 0; i < length; i++) {
-        ch_out[i] = ch_in[i] * rp_hann_window[i];
-    }
 
+    if(rp_DspWindowHann(length, RP_PWR_HANN_AMP, ch_in, ch_out) != 0) {
+        fprintf(stderr, "rp_pwr_hann_filter() can not allocate mem");
+        return -1;
+    }
     return 0;
 }
 
 int rp_pwr_fft_init(int length)
 {
-    if(rp_kiss_fft_out || rp_kiss_fft_cfg) {
-        rp_pwr_fft_clean();
+    /* The plan for every length is cached by librp, only the output grows */
+    if(length > rp_fft_out_len) {
+        rp_DspFree(rp_fft_out);
+        rp_fft_out = rp_DspAlloc(2 * length * sizeof(rp_dsp_cpx_t));
+        rp_fft_out_len = rp_fft_out ? length : 0;
     }
+    rp_fft_len = rp_fft_out ? length : 0;
 
-    rp_kiss_fft_out = 
-        (kiss_fft_cpx *)malloc(length * sizeof(kiss_fft_cpx));
-    
-    rp_kiss_fft_cfg = kiss_fftr_alloc(length, 0, NULL, NULL);
-
-    return 0;
+    return rp_fft_out ? 0 : -1;
 }
 
 int rp_pwr_fft_clean()
 {
-    kiss_fft_cleanup();
-    if(rp_kiss_fft_out) {
-        free(rp_kiss_fft_out);
-        rp_kiss_fft_out = NULL;
-    }
-
-    if(rp_kiss_fft_cfg) {
-        free(rp_kiss_fft_cfg);
-        rp_kiss_fft_cfg = NULL;
-    }
+    rp_DspFree(rp_fft_out);
+    rp_fft_out = NULL;
+    rp_fft_out_len = 0;
+    rp_fft_len = 0;
+    rp_DspRelease();
     return 0;
 }
 
-int rp_pwr_fft(double *ch_in, double *max_amp_bin_1,
-               double *max_amp_bin_2, double *max_amp_bin_3, 
-               double *arg_max_bin, int *max_bin_num, int half_length)
+/* Largest bin below half_length with its neighbours and phase */
+static void rp_pwr_fft_peak(const rp_dsp_cpx_t *bins, double *max_amp_bin_1,
+                            double *max_amp_bin_2, double *max_amp_bin_3,
+                            double *arg_max_bin, int *max_bin_num, int half_length)
 {
     int i;
     double bin_amp = 0;
     double bin_max_amp = 0;
     int bin_num = 0;
-    
-    if(!ch_in)
-        return -1;
-
-    if(!rp_kiss_fft_out || !rp_kiss_fft_cfg) {
-        fprintf(stderr, "rp_pwr_fft not initialized");
-        return -1;
-    }
-
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)ch_in, rp_kiss_fft_out);
 
     for(i = 0; i < half_length; i++) {                     // FFT limited to fs/2, specter of amplitudes        
       
-        bin_amp = sqrt(pow(rp_kiss_fft_out[i].r, 2) + 
-                        pow(rp_kiss_fft_out[i].i, 2));
+        bin_amp = sqrt(pow(bins[i].r, 2) + 
+                        pow(bins[i].i, 2));
                         
         if(bin_amp > bin_max_amp){
             bin_max_amp = bin_amp;
@@ -156,63 +137,158 @@ int rp_pwr_fft(double *ch_in, double *max_amp_bin_1,
     
     } else if(bin_num == 1) {
      *max_amp_bin_1 = bin_max_amp;
-     *max_amp_bin_2 = sqrt(pow(rp_kiss_fft_out[bin_num + 1].r, 2) + 
-                          pow(rp_kiss_fft_out[bin_num + 1].i, 2));
+     *max_amp_bin_2 = sqrt(pow(bins[bin_num + 1].r, 2) + 
+                          pow(bins[bin_num + 1].i, 2));
      *max_amp_bin_3 = 0;
      *max_bin_num = bin_num;
-     *arg_max_bin = atan2(rp_kiss_fft_out[bin_num].i, rp_kiss_fft_out[bin_num].r);
+     *arg_max_bin = atan2(bins[bin_num].i, bins[bin_num].r);
      
     } else {
-     *max_amp_bin_1 = sqrt(pow(rp_kiss_fft_out[bin_num - 1].r, 2) + 
-                         pow(rp_kiss_fft_out[bin_num - 1].i, 2));
+     *max_amp_bin_1 = sqrt(pow(bins[bin_num - 1].r, 2) + 
+                         pow(bins[bin_num - 1].i, 2));
                        
      *max_amp_bin_2 = bin_max_amp;                   
                         
-     *max_amp_bin_3 = sqrt(pow(rp_kiss_fft_out[bin_num + 1].r, 2) + 
-                          pow(rp_kiss_fft_out[bin_num + 1].i, 2));
+     *max_amp_bin_3 = sqrt(pow(bins[bin_num + 1].r, 2) + 
+                          pow(bins[bin_num + 1].i, 2));
                         
-     *arg_max_bin = atan2(rp_kiss_fft_out[bin_num].i, rp_kiss_fft_out[bin_num].r);
+     *arg_max_bin = atan2(bins[bin_num].i, bins[bin_num].r);
     
      *max_bin_num = bin_num; 
     }
-      
+}
+
+int rp_pwr_fft(double *ch_in, double *max_amp_bin_1,
+               double *max_amp_bin_2, double *max_amp_bin_3, 
+               double *arg_max_bin, int *max_bin_num, int half_length)
+{
+    if(!ch_in)
+        return -1;
+
+    if(!rp_fft_out || !rp_fft_len) {
+        fprintf(stderr, "rp_pwr_fft not initialized");
+        return -1;
+    }
+
+    if(rp_DspFftReal(rp_fft_len, ch_in, rp_fft_out) != 0) {
+        fprintf(stderr, "rp_pwr_fft() can not allocate mem");
+        return -1;
+    }
+
+    rp_pwr_fft_peak(rp_fft_out, max_amp_bin_1, max_amp_bin_2, max_amp_bin_3,
+                    arg_max_bin, max_bin_num, half_length);
     return 0;
 }
 
+int rp_pwr_fft2(double *cha_in, double *chb_in,
+                double *max_amp_U1, double *max_amp_U2, double *max_amp_U3,
+                double *arg_max_U, int *max_bin_U,
+                double *max_amp_I1, double *max_amp_I2, double *max_amp_I3,
+                double *arg_max_I, int *max_bin_I, int half_length)
+{
+    if(!cha_in || !chb_in)
+        return -1;
+
+    if(!rp_fft_out || !rp_fft_len) {
+        fprintf(stderr, "rp_pwr_fft2 not initialized");
+        return -1;
+    }
+
+    /* U and I in one complex transform */
+    if(rp_DspFftReal2(rp_fft_len, cha_in, chb_in, rp_fft_out, rp_fft_out + rp_fft_len) != 0) {
+        fprintf(stderr, "rp_pwr_fft2() can not allocate mem");
+        return -1;
+    }
+
+    rp_pwr_fft_peak(rp_fft_out, max_amp_U1, max_amp_U2, max_amp_U3,
+                    arg_max_U, max_bin_U, half_length);
+    rp_pwr_fft_peak(rp_fft_out + rp_fft_len, max_amp_I1, max_amp_I2, max_amp_I3,
+                    arg_max_I, max_bin_I, half_length);
+    return 0;
+}
+
+static void rp_pwr_dft_channel(const double *in, float *in_f, int length, rp_dsp_cpx_t *out)
+{
+    int n;
+
+    for(n = 0; n < length; n++)
+        in_f[n] = (float)in[n];
+    rp_DspDemod(1, length, (const float *const *)&in_f, pwr_dft_harmonic_num, rp_dft_freq, out);
+}
+
+static void *rp_pwr_dft_thread(void *args)
+{
+    pthread_mutex_lock(&rp_dft_mutex);
+    while(1) {
+        while(!rp_dft_job && !rp_dft_quit)
+            pthread_cond_wait(&rp_dft_cond, &rp_dft_mutex);
+        if(rp_dft_quit)
+            break;
+        pthread_mutex_unlock(&rp_dft_mutex);
+
+        rp_pwr_dft_channel(rp_dft_job_in, rp_dft_in_I, rp_dft_job_len, rp_dft_out_I);
+
+        pthread_mutex_lock(&rp_dft_mutex);
+        rp_dft_job = 0;
+        pthread_cond_broadcast(&rp_dft_cond);
+    }
+    pthread_mutex_unlock(&rp_dft_mutex);
+    return NULL;
+}
+
 int rp_pwr_dft_init()
 {
-    if(rp_dft_out_re_U || rp_dft_out_im_U || rp_dft_out_re_I || rp_dft_out_im_I) {
+    if(rp_dft_freq || rp_dft_in_U || rp_dft_in_I || rp_dft_out_U || rp_dft_out_I) {
         rp_pwr_dft_clean();
     }
 
-    rp_dft_out_re_U = (double *)malloc(sizeof(double) * pwr_dft_harmonic_num);
-    rp_dft_out_im_U = (double *)malloc(sizeof(double) * pwr_dft_harmonic_num);
-    rp_dft_out_re_I = (double *)malloc(sizeof(double) * pwr_dft_harmonic_num);
-    rp_dft_out_im_I = (double *)malloc(sizeof(double) * pwr_dft_harmonic_num);
-    
+    rp_dft_freq  = (double *)malloc(sizeof(double) * pwr_dft_harmonic_num);
+    rp_dft_in_U  = (float *)rp_DspAlloc(sizeof(float) * PWR_FPGA_SIG_LEN);
+    rp_dft_in_I  = (float *)rp_DspAlloc(sizeof(float) * PWR_FPGA_SIG_LEN);
+    rp_dft_out_U = (rp_dsp_cpx_t *)malloc(sizeof(rp_dsp_cpx_t) * pwr_dft_harmonic_num);
+    rp_dft_out_I = (rp_dsp_cpx_t *)malloc(sizeof(rp_dsp_cpx_t) * pwr_dft_harmonic_num);
+    if(!rp_dft_freq || !rp_dft_in_U || !rp_dft_in_I || !rp_dft_out_U || !rp_dft_out_I) {
+        rp_pwr_dft_clean();
+        return -1;
+    }
+
+    /* Without the thread both channels are computed by the caller */
+    rp_dft_job = 0;
+    rp_dft_quit = 0;
+    rp_dft_thread_run = (pthread_create(&rp_dft_thread, NULL, rp_pwr_dft_thread, NULL) == 0);
+
     return 0;
 }
 
 int rp_pwr_dft_clean()
 {
-    if(rp_dft_out_re_U) {
-        free(rp_dft_out_re_U);
-        rp_dft_out_re_U = NULL;
+    if(rp_dft_thread_run) {
+        pthread_mutex_lock(&rp_dft_mutex);
+        rp_dft_quit = 1;
+        pthread_cond_broadcast(&rp_dft_cond);
+        pthread_mutex_unlock(&rp_dft_mutex);
+        pthread_join(rp_dft_thread, NULL);
+        rp_dft_thread_run = 0;
     }
-    
-    if(rp_dft_out_im_U) {
-        free(rp_dft_out_im_U);
-        rp_dft_out_im_U = NULL;
+
+    if(rp_dft_freq) {
+        free(rp_dft_freq);
+        rp_dft_freq = NULL;
     }
-       
-    if(rp_dft_out_re_I) {
-        free(rp_dft_out_re_I);
-        rp_dft_out_re_I = NULL;
+
+    rp_DspFree(rp_dft_in_U);
+    rp_dft_in_U = NULL;
+    rp_DspFree(rp_dft_in_I);
+    rp_dft_in_I = NULL;
+
+    if(rp_dft_out_U) {
+        free(rp_dft_out_U);
+        rp_dft_out_U = NULL;
     }
-    
-    if(rp_dft_out_im_I) {
-        free(rp_dft_out_im_I);
-        rp_dft_out_im_I = NULL;
+
+    if(rp_dft_out_I) {
+        free(rp_dft_out_I);
+        rp_dft_out_I = NULL;
     }
     
     return 0;
@@ -222,56 +298,46 @@ int rp_pwr_dft(double *cha_in, double *chb_in, int length, float rel_freq,
                double *amp_U, double *amp_I, double *fi_U, double *fi_I)
 {
     int k;
-    int n;
-    double K;
-    double angle = 0;
-    double sum_re_U = 0;
-    double sum_im_U = 0;
-    double sum_re_I = 0;
-    double sum_im_I = 0; 
-         
-    if(!cha_in || !chb_in ||  !*amp_U ||  !*amp_I || !*fi_U || !*fi_I)
+
+    if(!cha_in || !chb_in || !amp_U || !amp_I || !fi_U || !fi_I ||
+       (length < 1) || (length > PWR_FPGA_SIG_LEN))
          return -1;
 
-    if(!rp_dft_out_re_U || !rp_dft_out_im_U || !rp_dft_out_re_I || !rp_dft_out_im_I) {
+    if(!rp_dft_freq || !rp_dft_out_U || !rp_dft_out_I) {
          fprintf(stderr, "rp_pwr_dft not initialized");
          return -1;
     }
 
-    for(k = 0; k < pwr_dft_harmonic_num; k++ ) {
-     
-        sum_re_U = 0;
-        sum_im_U = 0;
-        sum_re_I = 0;
-        sum_im_I = 0; 
-         
-         K = (k + 1) * PI2 * rel_freq / length;	
-
-         for(n = 0; n < length; n++) { 
-             
-             angle = n * K;
-             
-             sum_re_U += cha_in[n] * cos(angle);
-             sum_im_U += -cha_in[n] * sin(angle);
-             sum_re_I += chb_in[n] * cos(angle);
-             sum_im_I += -chb_in[n] * sin(angle);
-         }
-
-         rp_dft_out_re_U[k] = sum_re_U;
-         rp_dft_out_im_U[k] = sum_im_U;
-         rp_dft_out_re_I[k] = sum_re_I;
-         rp_dft_out_im_I[k] = sum_im_I;
-
-         amp_U[k] = sqrt(pow(rp_dft_out_re_U[k], 2) + 
-                         pow(rp_dft_out_im_U[k], 2)) *
-                    2 / length;
-         amp_I[k] = sqrt(pow(rp_dft_out_re_I[k], 2) + 
-                         pow(rp_dft_out_im_I[k], 2)) *
-                    2 / length;
-         fi_U[k] = atan2(rp_dft_out_im_U[k], rp_dft_out_re_U[k]);
-         fi_I[k] = atan2(rp_dft_out_im_I[k], rp_dft_out_re_I[k]);
-
-        }
+    /* Harmonic k + 1 of rel_freq periods per record */
+    for(k = 0; k < pwr_dft_harmonic_num; k++)
+        rp_dft_freq[k] = (k + 1) * (double)rel_freq / length;
+
+    if(rp_dft_thread_run) {
+        pthread_mutex_lock(&rp_dft_mutex);
+        rp_dft_job_in = chb_in;
+        rp_dft_job_len = length;
+        rp_dft_job = 1;
+        pthread_cond_broadcast(&rp_dft_cond);
+        pthread_mutex_unlock(&rp_dft_mutex);
+
+        rp_pwr_dft_channel(cha_in, rp_dft_in_U, length, rp_dft_out_U);
+
+        pthread_mutex_lock(&rp_dft_mutex);
+        while(rp_dft_job)
+            pthread_cond_wait(&rp_dft_cond, &rp_dft_mutex);
+        pthread_mutex_unlock(&rp_dft_mutex);
+    } else {
+        rp_pwr_dft_channel(cha_in, rp_dft_in_U, length, rp_dft_out_U);
+        rp_pwr_dft_channel(chb_in, rp_dft_in_I, length, rp_dft_out_I);
+    }
+
+    /* rp_DspDemod() already scales by 2 / length */
+    for(k = 0; k < pwr_dft_harmonic_num; k++) {
+        amp_U[k] = sqrt(pow(rp_dft_out_U[k].r, 2) + pow(rp_dft_out_U[k].i, 2));
+        amp_I[k] = sqrt(pow(rp_dft_out_I[k].r, 2) + pow(rp_dft_out_I[k].i, 2));
+        fi_U[k] = atan2(rp_dft_out_U[k].i, rp_dft_out_U[k].r);
+        fi_I[k] = atan2(rp_dft_out_I[k].i, rp_dft_out_I[k].r);
+    }
      
      return 0;
 }     
@@ -33,6 +33,13 @@ int rp_pwr_fft_clean(void);
 int rp_pwr_fft(double *ch_in, double *max_amp_bin_1,
                double *max_amp_bin_2, double *max_amp_bin_3, 
                double *arg_max_bin, int *max_bin_num, int half_length);
+
+/* rp_pwr_fft() of U and I in one transform */
+int rp_pwr_fft2(double *cha_in, double *chb_in,
+                double *max_amp_U1, double *max_amp_U2, double *max_amp_U3,
+                double *arg_max_U, int *max_bin_U,
+                double *max_amp_I1, double *max_amp_I2, double *max_amp_I3,
+                double *arg_max_I, int *max_bin_I, int half_length);
                
 int rp_pwr_dft_init(void);
 int rp_pwr_dft_clean(void);
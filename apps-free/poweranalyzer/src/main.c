@@ -431,6 +431,11 @@ int rp_app_exit(void)
     return 0;
 }
 
+void rp_app_clients(int clients)
+{
+    rp_pwr_worker_set_clients(clients);
+}
+
 int time_range_to_time_unit(int range)
 {
     int unit = 2;
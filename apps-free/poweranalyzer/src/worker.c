@@ -20,6 +20,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
 
 #include "worker.h"
 #include "fpga.h"
@@ -35,7 +36,11 @@ extern const int pwr_dft_harmonic_num;
 extern const int c_dsp_sig_len;
 
 pthread_mutex_t       rp_pwr_ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled with rp_pwr_ctrl_mutex held on a new state or client count */
+pthread_cond_t        rp_pwr_ctrl_cond = PTHREAD_COND_INITIALIZER;
 rp_pwr_worker_state_t rp_pwr_ctrl;
+/* Connected browsers, one is assumed until the web server tells */
+int                   rp_pwr_clients = 1;
 rp_app_params_t       *rp_pwr_params = NULL;
 int                   rp_pwr_params_dirty;
 int                   rp_pwr_dsp_params_dirty;
@@ -47,9 +52,18 @@ int                   rp_pwr_signals_dirty = 0;
 int                   rp_pwr_sig_last_idx = 0;
 float               **rp_tmp_signals; /* used for calculation, only from worker */
 
+/* Capture hand over: the worker fills rp_cha/chb_buffer while the DSP
+ * thread processes the previous capture from rp_cha/chb_dsp_buffer. A
+ * complete capture is passed on by swapping the pointers, so the next one
+ * is acquired while the last one is analysed.
+ */
 pthread_mutex_t   rp_pwr_dsp_sig_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t    rp_pwr_dsp_sig_cond;
 int               rp_pwr_dsp_sig_ready = 0;
 
+/* DSP thread: checks the worker state at least this often while it waits */
+#define RP_PWR_DSP_WAIT_US 10000
+
 /* Signals directly pointing at the FPGA mem space */
 int                  *rp_fpga_cha_signal, *rp_fpga_chb_signal;
 
@@ -57,6 +71,11 @@ int                  *rp_fpga_cha_signal, *rp_fpga_chb_signal;
 /* Size = PWR_FPGA_SIG_LEN  */
 int *rp_cha_buffer = NULL;
 int *rp_chb_buffer = NULL;
+int *rp_cha_dsp_buffer = NULL;
+int *rp_chb_dsp_buffer = NULL;
+
+/* last measurement of each channel for rp_DspMeasure(), only used from worker */
+rp_dsp_meas_t rp_pwr_meas_last[2];
 double *rp_cha_in = NULL;
 double *rp_chb_in = NULL;
 double *rp_ch_hann = NULL;
@@ -115,8 +134,10 @@ int rp_pwr_worker_init(rp_app_params_t *params, int params_len,
 		return -1;
 	}
 	
-	rp_cha_buffer = (int *)malloc(sizeof(int) * PWR_FPGA_SIG_LEN);
-    rp_chb_buffer = (int *)malloc(sizeof(int) * PWR_FPGA_SIG_LEN);
+	rp_cha_buffer = (int *)calloc(PWR_FPGA_SIG_LEN, sizeof(int));
+    rp_chb_buffer = (int *)calloc(PWR_FPGA_SIG_LEN, sizeof(int));
+    rp_cha_dsp_buffer = (int *)calloc(PWR_FPGA_SIG_LEN, sizeof(int));
+    rp_chb_dsp_buffer = (int *)calloc(PWR_FPGA_SIG_LEN, sizeof(int));
     rp_cha_in = (double *)malloc(sizeof(double) * PWR_FPGA_SIG_LEN);
     rp_chb_in = (double *)malloc(sizeof(double) * PWR_FPGA_SIG_LEN);
     rp_ch_hann = (double *)malloc(sizeof(double) * PWR_FPGA_SIG_LEN);
@@ -135,6 +156,7 @@ int rp_pwr_worker_init(rp_app_params_t *params, int params_len,
     harmonics = (rp_pwr_harm_t *)malloc(sizeof(rp_pwr_harm_t) * 40);
      
     if(!rp_cha_buffer || !rp_chb_buffer ||
+       !rp_cha_dsp_buffer || !rp_chb_dsp_buffer ||
        !rp_cha_in || !rp_chb_in || !rp_ch_hann || !rp_cha_in_trunc || 
        !rp_chb_in_trunc || !rp_cha_hann_trunc || !rp_chb_hann_trunc ||
        !rp_dft_o_amp_U || !rp_dft_o_amp_I || 
@@ -148,6 +170,13 @@ int rp_pwr_worker_init(rp_app_params_t *params, int params_len,
         return -1;
     }
 
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&rp_pwr_dsp_sig_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    rp_pwr_dsp_sig_ready = 0;
+
     rp_calib_params = calib_params;
 
     pwr_fpga_get_sig_ptr(&rp_fpga_cha_signal, &rp_fpga_chb_signal);
@@ -198,6 +227,14 @@ int rp_pwr_worker_clean(void)
         free(rp_chb_buffer);
         rp_chb_buffer = NULL;
     }
+    if(rp_cha_dsp_buffer) {
+        free(rp_cha_dsp_buffer);
+        rp_cha_dsp_buffer = NULL;
+    }
+    if(rp_chb_dsp_buffer) {
+        free(rp_chb_dsp_buffer);
+        rp_chb_dsp_buffer = NULL;
+    }
     if(rp_cha_in) {
         free(rp_cha_in);
         rp_cha_in = NULL;
@@ -276,6 +313,7 @@ int rp_pwr_worker_exit(void)
     house_release();
     pwr_fpga_exit();
     rp_pwr_worker_clean();
+    pthread_cond_destroy(&rp_pwr_dsp_sig_cond);
 
     rp_clean_params(rp_pwr_params);
 
@@ -290,11 +328,22 @@ int rp_pwr_worker_change_state(rp_pwr_worker_state_t new_state)
         return -1;
     pthread_mutex_lock(&rp_pwr_ctrl_mutex);
     rp_pwr_ctrl = new_state;
+    pthread_cond_broadcast(&rp_pwr_ctrl_cond);
     pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
     return 0;
 }
 
 
+/*----------------------------------------------------------------------------------*/
+void rp_pwr_worker_set_clients(int clients)
+{
+    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
+    rp_pwr_clients = clients;
+    pthread_cond_broadcast(&rp_pwr_ctrl_cond);
+    pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_pwr_worker_get_state(rp_pwr_worker_state_t *state)
 {
@@ -379,12 +428,23 @@ int rp_pwr_copy_buffer(double *cha, double *chb, int calib_dc_off_a, int calib_d
     int m_a = 0;
     int m_b = 0;
 
+    int *buf_a, *buf_b;
+
+    /* Take the finished capture and hand the processed one back to the worker */
     pthread_mutex_lock(&rp_pwr_dsp_sig_mutex); 
+    buf_a = rp_cha_buffer;
+    buf_b = rp_chb_buffer;
+    rp_cha_buffer = rp_cha_dsp_buffer;
+    rp_chb_buffer = rp_chb_dsp_buffer;
+    rp_cha_dsp_buffer = buf_a;
+    rp_chb_dsp_buffer = buf_b;
+    rp_pwr_dsp_sig_ready = 0;
+    pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
      
     for(idx = 0; idx < PWR_FPGA_SIG_LEN; idx++) {
  
-        cnts_a = rp_cha_buffer[idx];
-        cnts_b = rp_chb_buffer[idx];
+        cnts_a = buf_a[idx];
+        cnts_b = buf_b[idx];
         
          /* check sign */
         if(cnts_a & (1<<(c_pwr_fpga_adc_bits-1))) {
@@ -414,16 +474,33 @@ int rp_pwr_copy_buffer(double *cha, double *chb, int calib_dc_off_a, int calib_d
         
         /*here we assign the buffer offset values, 
          *if it doesn get overwritten, we get zeros in the output*/
-        rp_cha_buffer[idx] = -calib_dc_off_a;
-        rp_chb_buffer[idx] = -calib_dc_off_b;
+        buf_a[idx] = -calib_dc_off_a;
+        buf_b[idx] = -calib_dc_off_b;
          
     }
-    
-    pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
             
     return 0;
 }
 
+/*----------------------------------------------------------------------------------*/
+/* The worker owns rp_cha/chb_buffer between these two calls, the DSP thread
+ * does not swap them while no capture is ready
+ */
+void rp_pwr_capture_begin(void)
+{
+    pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
+    rp_pwr_dsp_sig_ready = 0;
+    pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
+}
+
+void rp_pwr_capture_end(void)
+{
+    pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
+    rp_pwr_dsp_sig_ready = 1;
+    pthread_cond_signal(&rp_pwr_dsp_sig_cond);
+    pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
+}
+
 /*----------------------------------------------------------------------------------*/
 int rp_pwr_set_ch_meas_data(rp_pwr_ch_meas_res_t u_meas, rp_pwr_ch_meas_res_t i_meas)
 {
@@ -487,9 +564,7 @@ void *rp_pwr_worker_thread(void *args)
         pthread_mutex_lock(&rp_pwr_ctrl_mutex);
         state = rp_pwr_ctrl;
         if(rp_pwr_params_dirty) {
-			pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
-	        rp_pwr_dsp_sig_ready = 0;
-            pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
+			rp_pwr_capture_begin();
             rp_copy_params(rp_pwr_params, (rp_app_params_t **)&curr_params);
             fpga_update = rp_pwr_params_fpga_update;
 
@@ -575,15 +650,24 @@ void *rp_pwr_worker_thread(void *args)
             fpga_update = 0;
         }
 
+        /* Nobody looks, nothing is acquired until a browser connects */
+        pthread_mutex_lock(&rp_pwr_ctrl_mutex);
+        if(rp_pwr_clients <= 0 && rp_pwr_ctrl == state) {
+            while(rp_pwr_clients <= 0 && rp_pwr_ctrl == state)
+                pthread_cond_wait(&rp_pwr_ctrl_cond, &rp_pwr_ctrl_mutex);
+            pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+            time_vect_update = 1;
+            continue;
+        }
+        pthread_mutex_unlock(&rp_pwr_ctrl_mutex);
+
         if(state == rp_pwr_idle_state) {
             usleep(10000);
             continue;
         }
 
         if(time_vect_update) {
-			pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
-	        rp_pwr_dsp_sig_ready = 0;
-            pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
+			rp_pwr_capture_begin();
 			
             float unit_factor = 
                 rp_pwr_get_time_unit_factor(curr_params[TIME_UNIT_PARAM].value);
@@ -776,9 +860,7 @@ void *rp_pwr_worker_thread(void *args)
             if(long_acq_idx >= SIGNAL_LENGTH-1) {
                 long_acq_idx = 0;
                 
-                pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
-	            rp_pwr_dsp_sig_ready = 1;
-                pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
+                rp_pwr_capture_end();
 
                 pwr_fpga_get_wr_ptr(NULL, &long_acq_init_trig_ptr);
 
@@ -803,9 +885,11 @@ void *rp_pwr_worker_thread(void *args)
         
         /* copy the results to the user buffer - if we are finished or not */
         if(!long_acq || long_acq_idx == 0) {
-            /* Finish the measurement */
-            rp_pwr_meas_avg_amp(&chu_meas, PWR_FPGA_SIG_LEN);
-            rp_pwr_meas_avg_amp(&chi_meas, PWR_FPGA_SIG_LEN);
+            /* Finish the measurement, rp_pwr_decimate() did it already */
+            if(long_acq) {
+                rp_pwr_meas_avg_amp(&chu_meas, PWR_FPGA_SIG_LEN);
+                rp_pwr_meas_avg_amp(&chi_meas, PWR_FPGA_SIG_LEN);
+            }
             
             rp_pwr_meas_convert(&chu_meas, ch1_max_adc_v, 
                                 rp_calib_params->fe_ch1_dc_offs, volt_probe_att);
@@ -914,19 +998,12 @@ int rp_pwr_decimate(float **cha_signal, int *in_cha_signal,
      *  - avg, amp - performed after the loop
      *  - freq, period - performed in the next decimation loop
      */
-    for(out_idx=0; out_idx < PWR_FPGA_SIG_LEN; out_idx++) {
-		pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
-		rp_pwr_dsp_sig_ready = 0;
-		rp_cha_buffer[out_idx] = in_cha_signal[out_idx];
-		rp_chb_buffer[out_idx] = in_chb_signal[out_idx];
-		pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
-        rp_pwr_meas_min_max(ch1_meas, in_cha_signal[out_idx]);
-        rp_pwr_meas_min_max(ch2_meas, in_chb_signal[out_idx]);
-    }
-    
-    pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
-	rp_pwr_dsp_sig_ready = 1;
-    pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
+    rp_pwr_capture_begin();
+    memcpy(rp_cha_buffer, in_cha_signal, PWR_FPGA_SIG_LEN * sizeof(int));
+    memcpy(rp_chb_buffer, in_chb_signal, PWR_FPGA_SIG_LEN * sizeof(int));
+    rp_pwr_meas_signal(ch1_meas, &rp_pwr_meas_last[0], rp_cha_buffer);
+    rp_pwr_meas_signal(ch2_meas, &rp_pwr_meas_last[1], rp_chb_buffer);
+    rp_pwr_capture_end();
 
     
 
@@ -984,14 +1061,12 @@ int rp_pwr_decimate_partial(float **cha_out_signal, int *cha_in_signal,
     /* check if we have reached currently acquired signals in FPGA */
     pwr_fpga_get_wr_ptr(&curr_ptr, NULL);
 
+    rp_pwr_capture_begin();
     for(; in_idx < curr_ptr; in_idx++) {
         if(in_idx >= PWR_FPGA_SIG_LEN)
             in_idx = in_idx % PWR_FPGA_SIG_LEN;
-        pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
-		rp_pwr_dsp_sig_ready = 0;
 		rp_cha_buffer[in_idx] = cha_in_signal[in_idx];
 		rp_chb_buffer[in_idx] = chb_in_signal[in_idx];
-		pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
         rp_pwr_meas_min_max(ch1_meas, cha_in_signal[in_idx]);
         rp_pwr_meas_min_max(ch2_meas, chb_in_signal[in_idx]);
     }
@@ -1508,8 +1583,17 @@ void *rp_pwr_dsp_thread(void *args)
 		}
 		
         while(1) {
-			
+			struct timespec ts;
+
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ts.tv_nsec += RP_PWR_DSP_WAIT_US * 1000;
+			if(ts.tv_nsec >= 1000000000) {
+			    ts.tv_sec++;
+			    ts.tv_nsec -= 1000000000;
+			}
 			pthread_mutex_lock(&rp_pwr_dsp_sig_mutex);
+			if(!rp_pwr_dsp_sig_ready)
+			    pthread_cond_timedwait(&rp_pwr_dsp_sig_cond, &rp_pwr_dsp_sig_mutex, &ts);
 			sig_ready = rp_pwr_dsp_sig_ready;
 			pthread_mutex_unlock(&rp_pwr_dsp_sig_mutex);
 			
@@ -1527,8 +1611,6 @@ void *rp_pwr_dsp_thread(void *args)
                (state == rp_pwr_auto_set_state) || rp_pwr_dsp_params_dirty) {
                 break;
             }
-		    usleep(70);
-		    
 	    }
 	    
 	    pthread_mutex_lock(&rp_pwr_ctrl_mutex);
@@ -1614,11 +1696,11 @@ void *rp_pwr_dsp_thread(void *args)
             break;
             }
  
-            rp_pwr_fft(&rp_cha_hann_trunc[0], &bin_max_ampU1, &bin_max_ampU2, 
-                       &bin_max_ampU3, &bin_max_argU, &bin_max_numU, n_x_half);
-
-            rp_pwr_fft(&rp_chb_hann_trunc[0], &bin_max_ampI1, &bin_max_ampI2, 
-                       &bin_max_ampI3, &bin_max_argI, &bin_max_numI, n_x_half);
+            rp_pwr_fft2(&rp_cha_hann_trunc[0], &rp_chb_hann_trunc[0],
+                        &bin_max_ampU1, &bin_max_ampU2, &bin_max_ampU3,
+                        &bin_max_argU, &bin_max_numU,
+                        &bin_max_ampI1, &bin_max_ampI2, &bin_max_ampI3,
+                        &bin_max_argI, &bin_max_numI, n_x_half);
                        
             pthread_mutex_lock(&rp_pwr_ctrl_mutex);
             state = rp_pwr_ctrl;
@@ -1922,6 +2004,24 @@ int rp_pwr_meas_min_max(rp_pwr_ch_meas_res_t *ch_meas, int sig_data)
 }
 
 
+/*----------------------------------------------------------------------------------*/
+int rp_pwr_meas_signal(rp_pwr_ch_meas_res_t *ch_meas, rp_dsp_meas_t *last, int *sig_data)
+{
+    if(rp_DspMeasure((const int32_t *)sig_data, PWR_FPGA_SIG_LEN, 0,
+                     c_pwr_fpga_adc_bits, last, last) != 0) {
+        rp_pwr_ch_meas_clear(ch_meas);
+        return -1;
+    }
+
+    ch_meas->min = last->min;
+    ch_meas->max = last->max;
+    ch_meas->amp = last->max - last->min;
+    ch_meas->avg = last->mean;
+
+    return 0;
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_pwr_meas_avg_amp(rp_pwr_ch_meas_res_t *ch_meas, int avg_len)
 {
@@ -17,6 +17,7 @@
 
 #include "main.h"
 #include "calib.h"
+#include "redpitaya/rp_dsp.h"
 
 #define SQRT2 sqrt(2)
 #define M_PI 3.14159265358979323846
@@ -38,6 +39,8 @@ int rp_pwr_worker_clean(void);
 int rp_pwr_worker_exit(void);
 int rp_pwr_worker_change_state(rp_pwr_worker_state_t new_state);
 int rp_pwr_worker_get_state(rp_pwr_worker_state_t *state);
+/* Without clients the worker stops acquiring */
+void rp_pwr_worker_set_clients(int clients);
 int rp_pwr_worker_update_params(rp_app_params_t *params, int fpga_update);
 
 /* removes 'dirty' flags */
@@ -53,6 +56,9 @@ int rp_pwr_get_signals(float ***signals, int *sig_idx);
 int rp_pwr_set_signals(float **source, int index);
 int rp_pwr_copy_buffer(double *cha, double *chb, 
                        int calib_dc_off_a, int calib_dc_off_b);
+/* Worker side of the capture hand over to the DSP thread */
+void rp_pwr_capture_begin(void);
+void rp_pwr_capture_end(void);
 /* Fills the output measuremenet data with last measurements
  */
 int rp_pwr_set_ch_meas_data(rp_pwr_ch_meas_res_t u_meas, 
@@ -117,6 +123,9 @@ int rp_pwr_meas_clear(rp_pwr_meas_res_t *pwr_meas);
 int rp_pwr_harmonics_clear(rp_pwr_harm_t *harm_meas);
 /* helper function - calculates min, max and accumulates average value */
 int rp_pwr_meas_min_max(rp_pwr_ch_meas_res_t *ch_meas, int sig_data);
+/* helper function - min, max, amplitude and average of a whole buffer in one
+ * pass, last keeps the state between frames */
+int rp_pwr_meas_signal(rp_pwr_ch_meas_res_t *ch_meas, rp_dsp_meas_t *last, int *sig_data);
 /* helper function - calculates average and amplitude */
 int rp_pwr_meas_avg_amp(rp_pwr_ch_meas_res_t *ch_meas, int avg_len);
 /* helper function - calculates period and frequency */
@@ -24,6 +24,7 @@
 #include <fcntl.h>
 
 #include "fpga_awg.h"
+#include "rp_app_fpga.h"
 
 /** 
  * GENERAL DESCRIPTION:
@@ -64,9 +65,6 @@ uint32_t  *g_awg_cha_mem = NULL;
   */
 uint32_t  *g_awg_chb_mem = NULL;
 
-/** The memory file descriptor used to mmap() the FPGA space */
-int g_awg_fd = -1;
-
 /* Constants */
 /** DAC frequency (125 Mspmpls (non-decimated)) */
 const double c_awg_smpl_freq = 125e6;
@@ -77,8 +75,8 @@ const int c_awg_fpga_dac_bits = 14;
 /**
  * @brief Internal function used to clean up memory.
  *
- * This function un-maps FPGA register and signal buffers, closes memory file
- * descriptor and cleans all memory allocated by this module.
+ * This function un-maps FPGA register and signal buffers and cleans all
+ * memory allocated by this module.
  *
  * @retval 0 Success
  * @retval -1 Failure, error is printed to standard error output.
@@ -87,20 +85,14 @@ int __awg_cleanup_mem(void)
 {
     /* If registry structure is NULL we do not need to un-map and clean up */
     if(g_awg_reg) {
-        if(munmap(g_awg_reg, AWG_BASE_SIZE) < 0) {
-            fprintf(stderr, "munmap() failed: %s\n", strerror(errno));
+        if(rp_app_fpga_unmap(g_awg_reg, AWG_BASE_SIZE) < 0)
             return -1;
-        }
         g_awg_reg = NULL;
         if(g_awg_cha_mem)
             g_awg_cha_mem = NULL;
         if(g_awg_chb_mem)
             g_awg_chb_mem = NULL;
     }
-    if(g_awg_fd >= 0) {
-        close(g_awg_fd);
-        g_awg_fd = -1;
-    }
     return 0;
 }
 
@@ -119,38 +111,15 @@ int __awg_cleanup_mem(void)
  */
 int fpga_awg_init(void)
 {
-    /* Page variables used to calculate correct mapping addresses */
-    void *page_ptr;
-    long page_addr, page_off, page_size = sysconf(_SC_PAGESIZE);
-
     /* If module was already initialized, clean all internals */
     if(__awg_cleanup_mem() < 0)
         return -1;
 
-    /* Open /dev/mem to access directly system memory */
-    g_awg_fd = open("/dev/mem", O_RDWR | O_SYNC);
-    if(g_awg_fd < 0) {
-        fprintf(stderr, "open(/dev/mem) failed: %s\n", strerror(errno));
+    /* Map FPGA memory space */
+    g_awg_reg = rp_app_fpga_map(AWG_BASE_ADDR, AWG_BASE_SIZE);
+    if(g_awg_reg == NULL)
         return -1;
-    }
-
-    /* Calculate correct page address and offset from AWG_BASE_ADDR and
-     * AWG_BASE_SIZE 
-     */
-    page_addr = AWG_BASE_ADDR & (~(page_size-1));
-    page_off  = AWG_BASE_ADDR - page_addr;
-
-    /* Map FPGA memory space to page_ptr. */
-    page_ptr = mmap(NULL, AWG_BASE_SIZE, PROT_READ | PROT_WRITE,
-                          MAP_SHARED, g_awg_fd, page_addr);
-    if((void *)page_ptr == MAP_FAILED) {
-        fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
-         __awg_cleanup_mem();
-        return -1;
-    }
 
-    /* Set FPGA AWG module pointers to correct values. */
-    g_awg_reg = page_ptr + page_off;
     g_awg_cha_mem = (uint32_t *)g_awg_reg + 
         (AWG_CHA_OFFSET / sizeof(uint32_t));
     g_awg_chb_mem = (uint32_t *)g_awg_reg + 
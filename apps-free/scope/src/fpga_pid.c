@@ -22,6 +22,7 @@
 #include <fcntl.h>
 
 #include "fpga_pid.h"
+#include "rp_app_fpga.h"
 
 /** 
  * GENERAL DESCRIPTION:
@@ -40,16 +41,13 @@
 /** The FPGA register structure (defined in fpga_pid.h) */
 pid_reg_t *g_pid_reg     = NULL;
 
-/** The memory file descriptor used to mmap() the FPGA space */
-int g_pid_fd = -1;
-
 
 /*----------------------------------------------------------------------------*/
 /**
  * @brief Internal function used to clean up memory.
  *
- * This function un-maps FPGA registers, closes memory file
- * descriptor and cleans all memory allocated by this module.
+ * This function un-maps FPGA registers and cleans all
+ * memory allocated by this module.
  *
  * @retval 0 Success
  * @retval -1 Failure, error is printed to standard error output.
@@ -58,17 +56,11 @@ int __pid_cleanup_mem(void)
 {
     /* If registry structure is NULL we do not need to un-map and clean up */
     if(g_pid_reg) {
-        if(munmap(g_pid_reg, PID_BASE_SIZE) < 0) {
-            fprintf(stderr, "munmap() failed: %s\n", strerror(errno));
+        if(rp_app_fpga_unmap(g_pid_reg, PID_BASE_SIZE) < 0)
             return -1;
-        }
         g_pid_reg = NULL;
     }
 
-    if(g_pid_fd >= 0) {
-        close(g_pid_fd);
-        g_pid_fd = -1;
-    }
     return 0;
 }
 
@@ -105,38 +97,15 @@ void reset_pids(void)
  */
 int fpga_pid_init(void)
 {
-    /* Page variables used to calculate correct mapping addresses */
-    void *page_ptr;
-    long page_addr, page_off, page_size = sysconf(_SC_PAGESIZE);
-
     /* If module was already initialized, clean all internals */
     if(__pid_cleanup_mem() < 0)
         return -1;
 
-    /* Open /dev/mem to access directly system memory */
-    g_pid_fd = open("/dev/mem", O_RDWR | O_SYNC);
-    if(g_pid_fd < 0) {
-        fprintf(stderr, "open(/dev/mem) failed: %s\n", strerror(errno));
+    /* Map FPGA memory space */
+    g_pid_reg = rp_app_fpga_map(PID_BASE_ADDR, PID_BASE_SIZE);
+    if(g_pid_reg == NULL)
         return -1;
-    }
-
-    /* Calculate correct page address and offset from PID_BASE_ADDR and
-     * PID_BASE_SIZE
-     */
-    page_addr = PID_BASE_ADDR & (~(page_size-1));
-    page_off  = PID_BASE_ADDR - page_addr;
-
-    /* Map FPGA memory space to page_ptr. */
-    page_ptr = mmap(NULL, PID_BASE_SIZE, PROT_READ | PROT_WRITE,
-                          MAP_SHARED, g_pid_fd, page_addr);
-    if((void *)page_ptr == MAP_FAILED) {
-        fprintf(stderr, "mmap() failed: %s\n", strerror(errno));
-         __pid_cleanup_mem();
-        return -1;
-    }
 
-    /* Set FPGA PID module pointers to correct values. */
-    g_pid_reg = page_ptr + page_off;
 
     /* Reset all controllers */
     reset_pids();
@@ -0,0 +1,132 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope frame history.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fpga.h"
+#include "history.h"
+#include "rp_app_pool.h"
+
+/* One frame of the pool, samples keep the 14 bit ADC codes */
+typedef struct rp_osc_hist_frame_s {
+    rp_osc_hist_meta_t meta;
+    uint16_t           cha[OSC_FPGA_SIG_LEN];
+    uint16_t           chb[OSC_FPGA_SIG_LEN];
+} rp_osc_hist_frame_t;
+
+/* RP_OSC_HIST_MAX frames of address space, mapped with the first frame,
+ * a new depth reuses it */
+static rp_app_pool_t        hist_mem;
+static rp_osc_hist_frame_t *hist_pool = NULL;
+static int                  hist_depth = 0;
+static int                  hist_frames = 0;
+static int                  hist_next = 0; /* slot the next capture goes to */
+
+/* Expanded frame of rp_osc_hist_load() */
+static int                  hist_cha[OSC_FPGA_SIG_LEN];
+static int                  hist_chb[OSC_FPGA_SIG_LEN];
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_hist_resize(int depth)
+{
+    if(depth < 0)
+        depth = 0;
+    if(depth > RP_OSC_HIST_MAX)
+        depth = RP_OSC_HIST_MAX;
+
+    hist_frames = 0;
+    hist_next = 0;
+    if(depth == hist_depth)
+        return 0;
+
+    hist_pool = NULL;
+    hist_depth = 0;
+    if(depth == 0) {
+        rp_app_pool_free(&hist_mem);
+        return 0;
+    }
+
+    if(hist_mem.base == NULL &&
+       rp_app_pool_init(&hist_mem, RP_APP_POOL_BYTES(RP_OSC_HIST_MAX *
+                                                     sizeof(rp_osc_hist_frame_t)), 0) < 0)
+        return -1;
+    rp_app_pool_release(&hist_mem, 0);
+    hist_pool = (rp_osc_hist_frame_t *)rp_app_pool_alloc(&hist_mem,
+                                                         depth * sizeof(rp_osc_hist_frame_t));
+    if(hist_pool == NULL) {
+        fprintf(stderr, "rp_osc_hist_resize(): no memory for %d frames\n", depth);
+        return -1;
+    }
+    hist_depth = depth;
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_hist_depth(void)
+{
+    return hist_depth;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_hist_frames(void)
+{
+    return hist_frames;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_hist_store(const int *cha_signal, const int *chb_signal,
+                       const rp_osc_hist_meta_t *meta)
+{
+    rp_osc_hist_frame_t *f;
+    int i;
+
+    if(hist_depth == 0)
+        return;
+
+    f = &hist_pool[hist_next];
+    f->meta = *meta;
+    for(i = 0; i < OSC_FPGA_SIG_LEN; i++) {
+        f->cha[i] = cha_signal[i];
+        f->chb[i] = chb_signal[i];
+    }
+
+    hist_next = (hist_next + 1) % hist_depth;
+    if(hist_frames < hist_depth)
+        hist_frames++;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+const rp_osc_hist_meta_t *rp_osc_hist_load(int back, int **cha_signal, int **chb_signal)
+{
+    rp_osc_hist_frame_t *f;
+    int i;
+
+    if(back < 1 || back > hist_frames)
+        return NULL;
+
+    f = &hist_pool[(hist_next - back + hist_depth) % hist_depth];
+    for(i = 0; i < OSC_FPGA_SIG_LEN; i++) {
+        hist_cha[i] = f->cha[i];
+        hist_chb[i] = f->chb[i];
+    }
+    *cha_signal = hist_cha;
+    *chb_signal = hist_chb;
+    return &f->meta;
+}
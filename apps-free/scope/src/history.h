@@ -0,0 +1,55 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope frame history.
+ *
+ * The worker keeps the raw FPGA buffers of the last captures with the
+ * settings they were taken with, so an old frame can be shown and
+ * decimated again without a new acquisition. The memory for all frames is
+ * taken at once when the depth is set. Only used from the worker.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+#include <time.h>
+
+/* Largest depth, one frame takes 64 kB */
+#define RP_OSC_HIST_MAX 128
+
+typedef struct rp_osc_hist_meta_s {
+    struct timespec time;     /* CLOCK_REALTIME of the capture */
+    int   trig_ptr;           /* trigger write pointer in the buffers */
+    int   dec_factor;
+    float ch1_max_adc_v;
+    float ch2_max_adc_v;
+    float ch1_user_dc_off;
+    float ch2_user_dc_off;
+    float t_start;            /* window in time_unit units */
+    float t_stop;
+    int   time_unit;
+} rp_osc_hist_meta_t;
+
+/* Drops all frames and takes the memory for depth frames, 0 frees it */
+int  rp_osc_hist_resize(int depth);
+int  rp_osc_hist_depth(void);
+/* Frames held, up to the depth */
+int  rp_osc_hist_frames(void);
+
+/* Copies the FPGA buffers of a capture as the newest frame */
+void rp_osc_hist_store(const int *cha_signal, const int *chb_signal,
+                       const rp_osc_hist_meta_t *meta);
+
+/* Frame back captures before the newest (1 is the newest) expanded to
+ * buffers like the FPGA ones, valid until the next call. Returns NULL if
+ * there is no such frame.
+ */
+const rp_osc_hist_meta_t *rp_osc_hist_load(int back, int **cha_signal, int **chb_signal);
+
+#endif /* __HISTORY_H */
@@ -28,6 +28,10 @@
 #include "calib.h"
 #include "generate.h"
 #include "pid.h"
+#include "persist.h"
+#include "mask.h"
+#include "history.h"
+#include "math_ch.h"
 
 /* Describe app. parameters with some info/limitations */
 pthread_mutex_t rp_main_params_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -293,6 +297,74 @@ static rp_app_params_t rp_main_params[PARAMS_NUM+1] = {
     { /* pid_NN_kd - PID NN derivative gain   Kd in [ADC] counts. */
         "pid_22_kd",  0, 1, 0, -8192, 8191 },
 
+    { /* persist_mode - Accumulates the frames in a histogram:
+       *    0 - off
+       *    1 - persistence
+       *    2 - eye diagram, folded on persist_period */
+        "persist_mode", 0, 0, 0, 0, 2 },
+    { /* persist_period - Eye diagram period in xmin/xmax units */
+        "persist_period", 0, 0, 0, 0, +10000000 },
+    { /* persist_reset - Clears the histogram:
+       *    0 - ignore
+       *    1 - clear     */
+        "persist_reset", 0, 0, 0, 0, 1 },
+
+    { /* mask_mode - Compares the frames to the learned mask:
+       *    0 - off
+       *    1 - count passed and failed frames
+       *    2 - count, show failing frames only
+       *    3 - count, stop on the first failing frame */
+        "mask_mode", 0, 0, 0, 0, 3 },
+    { /* mask_channels - Channels tested:
+       *    1 - ChA
+       *    2 - ChB
+       *    3 - both    */
+        "mask_channels", 3, 0, 0, 1, 3 },
+    { /* mask_tolerance - Mask distance from the learned frame in [V] */
+        "mask_tolerance", 0.1, 0, 0, 0, 100 },
+    { /* mask_learn - Next frame becomes the mask:
+       *    0 - ignore
+       *    1 - learn     */
+        "mask_learn", 0, 0, 0, 0, 1 },
+    { /* mask_reset - Clears the counters:
+       *    0 - ignore
+       *    1 - clear     */
+        "mask_reset", 0, 0, 0, 0, 1 },
+    {  "mask_pass", 0, 0, 1, 0, 1e12 },
+    {  "mask_fail", 0, 0, 1, 0, 1e12 },
+
+    { /* hist_depth - Captures kept for replay, 0 - off */
+        "hist_depth", 0, 0, 0, 0, RP_OSC_HIST_MAX },
+    { /* hist_view - Shows a kept capture instead of acquiring:
+       *    0 - live
+       *    N - N-th capture back, 1 is the newest */
+        "hist_view", 0, 0, 0, 0, RP_OSC_HIST_MAX },
+    {  "hist_frames", 0, 0, 1, 0, RP_OSC_HIST_MAX },
+    {  "hist_age", 0, 0, 1, 0, 1e12 },
+
+    { /* math_mode - Math channel, computed before the decimation:
+       *    0 - off
+       *    1 - A + B
+       *    2 - A - B
+       *    3 - A * B
+       *    4 - integral of math_source
+       *    5 - derivative of math_source
+       *    6 - amplitude spectrum of math_source in [dBV] */
+        "math_mode", 0, 0, 0, 0, 6 },
+    { /* math_source - Channel of the single channel modes:
+       *    0 - ChA
+       *    1 - ChB     */
+        "math_source", 0, 0, 0, 0, 1 },
+    { /* math_fft_df - Spectrum step per point in [Hz] */
+        "math_fft_df", 0, 0, 1, 0, 1e12 },
+
+    { /* meas_delay - Delay of ChB to ChA in [s] from their cross-correlation,
+       *    negative if ChB leads, 0 without a common signal */
+        "meas_delay", 0, 0, 1, -1e9, 1e9 },
+    { /* meas_phase - Phase of ChB to ChA at their strongest common frequency
+       *    in [deg], -180 to 180 */
+        "meas_phase", 0, 0, 1, -180, 180 },
+
     { /* Must be last! */
         NULL, 0.0, -1, -1, 0.0, 0.0 }     
 };
@@ -353,6 +425,11 @@ int rp_app_exit(void)
     return 0;
 }
 
+void rp_app_clients(int clients)
+{
+    rp_osc_worker_set_clients(clients);
+}
+
 int time_range_to_time_unit(int range)
 {
     int unit = 2;
@@ -615,6 +692,10 @@ int rp_set_params(rp_app_params_t *p, int len)
     int params_change = 0;
     int awg_params_change = 0;
     int pid_params_change = 0;
+    int persist_params_change = 0;
+    int mask_params_change = 0;
+    int hist_params_change = 0;
+    int math_params_change = 0;
     
     TRACE("%s()\n", __FUNCTION__);
 
@@ -655,8 +736,16 @@ int rp_set_params(rp_app_params_t *p, int len)
                 params_change = 1;
             if ( (p_idx >= PARAMS_AWG_PARAMS) && (p_idx < PARAMS_PID_PARAMS) )
                 awg_params_change = 1;
-            if(p_idx >= PARAMS_PID_PARAMS)
+            if((p_idx >= PARAMS_PID_PARAMS) && (p_idx < PARAMS_PERSIST_PARAMS))
                 pid_params_change = 1;
+            if((p_idx >= PARAMS_PERSIST_PARAMS) && (p_idx < PARAMS_MASK_PARAMS))
+                persist_params_change = 1;
+            if((p_idx >= PARAMS_MASK_PARAMS) && (p_idx < PARAMS_HIST_PARAMS))
+                mask_params_change = 1;
+            if((p_idx >= PARAMS_HIST_PARAMS) && (p_idx < PARAMS_MATH_PARAMS))
+                hist_params_change = 1;
+            if(p_idx >= PARAMS_MATH_PARAMS)
+                math_params_change = 1;
             if(rp_main_params[p_idx].fpga_update)
                 fpga_update = 1;
         }
@@ -722,7 +811,7 @@ int rp_set_params(rp_app_params_t *p, int len)
             /* AUTO_FLAG_PARAM is cleared when Auto-set algorithm finishes */
             
             /* Wait for auto-set algorithm to finish or timeout */
-            int timeout = 10000000; // [us]
+            int timeout = 2 * RP_OSC_AUTO_SET_MAX_US; // [us]
             const int step = 50000; // [us]
             rp_osc_worker_state_t state;
             while (timeout > 0) {
@@ -877,6 +966,35 @@ int rp_set_params(rp_app_params_t *p, int len)
         }
     }
 
+    if(persist_params_change) {
+        rp_osc_persist_set(rp_main_params[PERSIST_MODE].value,
+                           rp_main_params[PERSIST_PERIOD].value);
+        if(rp_main_params[PERSIST_RESET].value == 1) {
+            rp_main_params[PERSIST_RESET].value = 0;
+            rp_osc_persist_reset();
+        }
+    }
+
+    if(mask_params_change) {
+        rp_osc_mask_set(rp_main_params[MASK_MODE].value,
+                        rp_main_params[MASK_CHANNELS].value,
+                        rp_main_params[MASK_TOLERANCE].value);
+        if(rp_main_params[MASK_LEARN].value == 1) {
+            rp_main_params[MASK_LEARN].value = 0;
+            rp_osc_mask_learn();
+        }
+        if(rp_main_params[MASK_RESET].value == 1) {
+            rp_main_params[MASK_RESET].value = 0;
+            rp_osc_mask_reset();
+        }
+    }
+
+    /* The worker owns the history and the math channel, it gets their
+     * settings with the others */
+    if(hist_params_change || math_params_change) {
+        rp_osc_worker_update_params((rp_app_params_t *)&rp_main_params[0], 0);
+    }
+
     return 0;
 }
 
@@ -942,46 +1060,14 @@ int rp_get_signals(float ***s, int *sig_num, int *sig_len)
     return 0;
 }
 
-int rp_create_signals(float ***a_signals)
+struct rp_signal_ring_s *rp_get_signal_ring(void)
 {
-    int i;
-    float **s;
-
-    s = (float **)malloc(SIGNALS_NUM * sizeof(float *));
-    if(s == NULL) {
-        return -1;
-    }
-    for(i = 0; i < SIGNALS_NUM; i++)
-        s[i] = NULL;
-
-    for(i = 0; i < SIGNALS_NUM; i++) {
-        s[i] = (float *)malloc(SIGNAL_LENGTH * sizeof(float));
-        if(s[i] == NULL) {
-            rp_cleanup_signals(a_signals);
-            return -1;
-        }
-        memset(&s[i][0], 0, SIGNAL_LENGTH * sizeof(float));
-    }
-    *a_signals = s;
-
-    return 0;
+    return rp_osc_get_signal_ring();
 }
 
-void rp_cleanup_signals(float ***a_signals)
+int rp_get_signal_image(char *buf, int len)
 {
-    int i;
-    float **s = *a_signals;
-
-    if(s) {
-        for(i = 0; i < SIGNALS_NUM; i++) {
-            if(s[i]) {
-                free(s[i]);
-                s[i] = NULL;
-            }
-        }
-        free(s);
-        *a_signals = NULL;
-    }
+    return rp_osc_persist_image(buf, len);
 }
 
 /*----------------------------------------------------------------------------------*/
@@ -1126,6 +1212,35 @@ int rp_update_meas_data(rp_osc_meas_res_t ch1_meas, rp_osc_meas_res_t ch2_meas)
     rp_main_params[MEAS_FREQ_CH2].value = ch2_meas.freq;
     rp_main_params[MEAS_PER_CH2].value = ch2_meas.period;
 
+    rp_main_params[MEAS_DELAY].value = ch2_meas.delay;
+    rp_main_params[MEAS_PHASE].value = ch2_meas.phase;
+
+    pthread_mutex_unlock(&rp_main_params_mutex);
+    return 0;
+}
+
+int rp_update_mask_data(uint32_t pass, uint32_t fail)
+{
+    pthread_mutex_lock(&rp_main_params_mutex);
+    rp_main_params[MASK_PASS].value = pass;
+    rp_main_params[MASK_FAIL].value = fail;
+    pthread_mutex_unlock(&rp_main_params_mutex);
+    return 0;
+}
+
+int rp_update_hist_data(int frames, float age)
+{
+    pthread_mutex_lock(&rp_main_params_mutex);
+    rp_main_params[HIST_FRAMES].value = frames;
+    rp_main_params[HIST_AGE].value = age;
+    pthread_mutex_unlock(&rp_main_params_mutex);
+    return 0;
+}
+
+int rp_update_math_data(float fft_df)
+{
+    pthread_mutex_lock(&rp_main_params_mutex);
+    rp_main_params[MATH_FFT_DF].value = fft_df;
     pthread_mutex_unlock(&rp_main_params_mutex);
     return 0;
 }
@@ -15,6 +15,8 @@
 #ifndef __MAIN_H
 #define __MAIN_H
 
+#include <stdint.h>
+
 #ifdef DEBUG
 #  define TRACE(args...) fprintf(stderr, args)
 #else
@@ -41,11 +43,13 @@ typedef struct rp_osc_meas_res_s {
     float avg;
     float freq;
     float period;
+    float delay;  /* CH2 only, to CH1 in [s] */
+    float phase;  /* CH2 only, to CH1 in [deg] */
 } rp_osc_meas_res_t;
 
 /* Parameters indexes - these defines should be in the same order as 
  * rp_app_params_t structure defined in main.c */
-#define PARAMS_NUM        81
+#define PARAMS_NUM        100
 #define MIN_GUI_PARAM     0
 #define MAX_GUI_PARAM     1
 #define TRIG_MODE_PARAM   2
@@ -129,6 +133,25 @@ typedef struct rp_osc_meas_res_s {
 #define PID_22_KP         78
 #define PID_22_KI         79
 #define PID_22_KD         80
+#define PERSIST_MODE      81
+#define PERSIST_PERIOD    82
+#define PERSIST_RESET     83
+#define MASK_MODE         84
+#define MASK_CHANNELS     85
+#define MASK_TOLERANCE    86
+#define MASK_LEARN        87
+#define MASK_RESET        88
+#define MASK_PASS         89
+#define MASK_FAIL         90
+#define HIST_DEPTH        91
+#define HIST_VIEW         92
+#define HIST_FRAMES       93
+#define HIST_AGE          94
+#define MATH_MODE         95
+#define MATH_SOURCE       96
+#define MATH_FFT_DF       97
+#define MEAS_DELAY        98
+#define MEAS_PHASE        99
 
 /* Defines from which parameters on are AWG parameters (used in set_param() to
  * trigger update only on needed part - either Oscilloscope, AWG or PID */
@@ -139,9 +162,21 @@ typedef struct rp_osc_meas_res_s {
 #define PARAMS_PID_PARAMS 57
 #define PARAMS_PER_PID     6
 
+/* Defines from which parameters on are persistence parameters, see persist.h */
+#define PARAMS_PERSIST_PARAMS 81
+
+/* Defines from which parameters on are mask test parameters, see mask.h */
+#define PARAMS_MASK_PARAMS 84
+
+/* Defines from which parameters on are frame history parameters, see history.h */
+#define PARAMS_HIST_PARAMS 91
+
+/* Defines from which parameters on are math channel parameters, see math_ch.h */
+#define PARAMS_MATH_PARAMS 95
+
 /* Output signals */
 #define SIGNAL_LENGTH (1024) /* Must be 2^n! */
-#define SIGNALS_NUM   3
+#define SIGNALS_NUM   4 /* time, ch1, ch2, math */
 
 
 /* module entry points */
@@ -150,11 +185,12 @@ int rp_app_exit(void);
 int rp_set_params(rp_app_params_t *p, int len);
 int rp_get_params(rp_app_params_t **p);
 int rp_get_signals(float ***s, int *sig_num, int *sig_len);
+/* Optional entry point, signals without the copy of rp_get_signals() */
+struct rp_signal_ring_s *rp_get_signal_ring(void);
+/* Optional entry point, persistence histogram as JSON text, see persist.h */
+int rp_get_signal_image(char *buf, int len);
 
 /* Internal helper functions */
-int  rp_create_signals(float ***a_signals);
-void rp_cleanup_signals(float ***a_signals);
-
 /* copies parameters from src to dst - if dst does not exists, it creates it */
 int rp_copy_params(rp_app_params_t *src, rp_app_params_t **dst);
 
@@ -175,6 +211,12 @@ void transform_from_iface_units(rp_app_params_t *p);
  * in the application 
  */
 int rp_update_meas_data(rp_osc_meas_res_t ch1_meas, rp_osc_meas_res_t ch2_meas);
+/* same for the mask test counters */
+int rp_update_mask_data(uint32_t pass, uint32_t fail);
+/* same for the frame history, age of the shown frame in [s] */
+int rp_update_hist_data(int frames, float age);
+/* same for the math channel, spectrum step in [Hz] */
+int rp_update_math_data(float fft_df);
 
 /* Waveform generator frequency limiter. */
 float rp_gen_limit_freq(float freq, float gen_type);
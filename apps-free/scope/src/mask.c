@@ -0,0 +1,168 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope mask test.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "main.h"
+#include "mask.h"
+
+/* The web server changes the settings, the worker tests the frames */
+static pthread_mutex_t mask_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int      mask_mode = rp_osc_mask_off;
+static int      mask_channels = 3;
+static float    mask_tolerance = 0;
+static int      mask_learn = 0;
+static int      mask_valid = 0;
+static uint32_t mask_pass = 0;
+static uint32_t mask_fail = 0;
+
+/* Learned frame and the envelope made of it */
+static float    mask_ref[2][SIGNAL_LENGTH];
+static float    mask_lo[2][SIGNAL_LENGTH];
+static float    mask_hi[2][SIGNAL_LENGTH];
+
+
+/*----------------------------------------------------------------------------------*/
+/* Envelope of the learned frame, the neighbouring points are included so
+ * a trigger jitter below one display point does not fail */
+static void rp_osc_mask_envelope(void)
+{
+    int ch, i;
+
+    for(ch = 0; ch < 2; ch++) {
+        const float *r = mask_ref[ch];
+        for(i = 0; i < SIGNAL_LENGTH; i++) {
+            float lo = r[i], hi = r[i];
+            if(i > 0) {
+                lo = r[i-1] < lo ? r[i-1] : lo;
+                hi = r[i-1] > hi ? r[i-1] : hi;
+            }
+            if(i < SIGNAL_LENGTH-1) {
+                lo = r[i+1] < lo ? r[i+1] : lo;
+                hi = r[i+1] > hi ? r[i+1] : hi;
+            }
+            mask_lo[ch][i] = lo - mask_tolerance;
+            mask_hi[ch][i] = hi + mask_tolerance;
+        }
+    }
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_mask_set(int mode, int channels, float tolerance)
+{
+    if(mode < rp_osc_mask_off || mode >= rp_osc_mask_nonexisting)
+        mode = rp_osc_mask_off;
+
+    pthread_mutex_lock(&mask_mutex);
+    mask_mode = mode;
+    mask_channels = channels & 3;
+    if(tolerance != mask_tolerance) {
+        mask_tolerance = tolerance;
+        if(mask_valid)
+            rp_osc_mask_envelope();
+    }
+    pthread_mutex_unlock(&mask_mutex);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_mask_get_mode(void)
+{
+    int mode;
+
+    pthread_mutex_lock(&mask_mutex);
+    mode = mask_mode;
+    pthread_mutex_unlock(&mask_mutex);
+    return mode;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_mask_learn(void)
+{
+    pthread_mutex_lock(&mask_mutex);
+    mask_learn = 1;
+    pthread_mutex_unlock(&mask_mutex);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_mask_reset(void)
+{
+    pthread_mutex_lock(&mask_mutex);
+    mask_pass = 0;
+    mask_fail = 0;
+    pthread_mutex_unlock(&mask_mutex);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Non zero if any point is outside of the envelope, no branches in the
+ * loop so it vectorizes */
+static int rp_osc_mask_outside(const float *sig, const float *lo, const float *hi)
+{
+    int out = 0;
+    int i;
+
+    for(i = 0; i < SIGNAL_LENGTH; i++)
+        out |= (sig[i] < lo[i]) | (sig[i] > hi[i]);
+    return out;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_mask_test(float **signals)
+{
+    int ret = RP_OSC_MASK_NONE;
+    int ch, fail = 0;
+
+    pthread_mutex_lock(&mask_mutex);
+    if(mask_learn) {
+        for(ch = 0; ch < 2; ch++)
+            memcpy(mask_ref[ch], signals[ch+1], sizeof(float) * SIGNAL_LENGTH);
+        rp_osc_mask_envelope();
+        mask_learn = 0;
+        mask_valid = 1;
+        mask_pass = 0;
+        mask_fail = 0;
+    }
+
+    if(mask_mode != rp_osc_mask_off && mask_valid) {
+        for(ch = 0; ch < 2; ch++) {
+            if(mask_channels & (1 << ch))
+                fail |= rp_osc_mask_outside(signals[ch+1], mask_lo[ch], mask_hi[ch]);
+        }
+        if(fail) {
+            mask_fail++;
+            ret = RP_OSC_MASK_FAIL;
+        } else {
+            mask_pass++;
+            ret = RP_OSC_MASK_PASS;
+        }
+    }
+    pthread_mutex_unlock(&mask_mutex);
+
+    return ret;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_mask_get_counters(uint32_t *pass, uint32_t *fail)
+{
+    pthread_mutex_lock(&mask_mutex);
+    *pass = mask_pass;
+    *fail = mask_fail;
+    pthread_mutex_unlock(&mask_mutex);
+}
@@ -0,0 +1,48 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope mask test.
+ *
+ * A learned frame widened by a tolerance is the mask, a min/max envelope
+ * per display point. Every complete frame of the worker is compared to it
+ * and counted as passed or failed, so go/no-go tests need only the
+ * counters and the failing frames.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __MASK_H
+#define __MASK_H
+
+#include <stdint.h>
+
+typedef enum rp_osc_mask_mode_e {
+    rp_osc_mask_off = 0,
+    rp_osc_mask_count,     /* count, publish every frame */
+    rp_osc_mask_fail_only, /* count, publish failing frames only */
+    rp_osc_mask_stop,      /* count, go to idle with the first failing frame */
+    rp_osc_mask_nonexisting /* must be last */
+} rp_osc_mask_mode_t;
+
+/* Result of rp_osc_mask_test() */
+#define RP_OSC_MASK_NONE  -1 /* off or nothing learned yet */
+#define RP_OSC_MASK_PASS   0
+#define RP_OSC_MASK_FAIL   1
+
+/* channels - bit 0 ch1, bit 1 ch2; tolerance in [V] */
+void rp_osc_mask_set(int mode, int channels, float tolerance);
+int  rp_osc_mask_get_mode(void);
+/* The next complete frame becomes the mask */
+void rp_osc_mask_learn(void);
+/* Clears the counters */
+void rp_osc_mask_reset(void);
+
+/* Compares a complete frame (time, ch1, ch2 in [V]) and counts it */
+int  rp_osc_mask_test(float **signals);
+void rp_osc_mask_get_counters(uint32_t *pass, uint32_t *fail);
+
+#endif /* __MASK_H */
@@ -0,0 +1,175 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope math channel.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "main.h"
+#include "fpga.h"
+#include "math_ch.h"
+#include "redpitaya/rp_dsp.h"
+
+/* Raw window of both channels in [V], the result goes to the first */
+static float  math_a[OSC_FPGA_SIG_LEN];
+static float  math_b[OSC_FPGA_SIG_LEN];
+/* Spectrum of the source */
+static double math_fft_in[OSC_FPGA_SIG_LEN];
+static double math_fft_out[OSC_FPGA_SIG_LEN / 2];
+
+
+/*----------------------------------------------------------------------------------*/
+/* n samples from start on in [V], same conversion as osc_fpga_cnv_cnt_to_v()
+ * without branches so the loop vectorizes */
+static void rp_osc_math_volts(float *out, const rp_osc_math_ch_t *ch, int start, int n)
+{
+    const int half = 1 << (c_osc_fpga_adc_bits - 1);
+    const int mask = (1 << c_osc_fpga_adc_bits) - 1;
+    const float scale = ch->max_adc_v / half;
+    int i;
+
+    for(i = 0; i < n; i++) {
+        int m = ch->raw[(start + i) & (OSC_FPGA_SIG_LEN - 1)] & mask;
+        m = (m ^ half) - half;
+        m += ch->calib_dc_off;
+        m = m < -half ? -half : m;
+        m = m > half ? half : m;
+        out[i] = m * scale + ch->user_dc_off;
+    }
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Amplitude spectrum of n samples of sig, the largest of the bins of each
+ * output point in [dBV] */
+static int rp_osc_math_spectrum(const float *sig, int n, float *out)
+{
+    int bins = n / 2;
+    int i, k;
+
+    for(i = 0; i < n; i++)
+        math_fft_in[i] = sig[i];
+    if(rp_DspFftAbsHann(n, 0.5, math_fft_in, math_fft_out, bins) != 0)
+        return -1;
+
+    for(k = 0; k < SIGNAL_LENGTH; k++) {
+        int j0 = (long)k * bins / SIGNAL_LENGTH;
+        int j1 = (long)(k + 1) * bins / SIGNAL_LENGTH;
+        double amp = 0;
+
+        if(j1 <= j0)
+            j1 = j0 + 1;
+        for(i = j0; i < j1; i++)
+            amp = math_fft_out[i] > amp ? math_fft_out[i] : amp;
+        /* Hann window of peak 1: a tone of amplitude A reads A * n / 4 */
+        amp *= 4.0 / n;
+        out[k] = 20 * log10(amp > 1e-9 ? amp : 1e-9);
+    }
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_math_frame(int mode, int source, const rp_osc_math_ch_t *ch,
+                      int wr_ptr_trig, int dec_factor, float t_start, float t_stop,
+                      float *out, float *fft_df)
+{
+    float smpl_period = c_osc_fpga_smpl_period * dec_factor;
+    int t_start_idx, t_stop_idx, t_step, start, n, i, k;
+    float *r = math_a;
+
+    if(mode <= rp_osc_math_off || mode >= rp_osc_math_nonexisting)
+        goto fail;
+
+    /* Same window and step as rp_osc_decimate() */
+    if(t_stop <= t_start) {
+        t_start = 0;
+        t_stop = (OSC_FPGA_SIG_LEN-1) * smpl_period;
+    }
+    t_start_idx = round(t_start / smpl_period);
+    t_stop_idx  = round(t_stop / smpl_period);
+    if((((t_stop_idx-t_start_idx)/(float)(SIGNAL_LENGTH-1))) < 1)
+        t_step = 1;
+    else
+        t_step = round((t_stop_idx-t_start_idx)/(float)(SIGNAL_LENGTH-1));
+    if(t_step > OSC_FPGA_SIG_LEN / SIGNAL_LENGTH)
+        t_step = OSC_FPGA_SIG_LEN / SIGNAL_LENGTH;
+    n = SIGNAL_LENGTH * t_step;
+
+    start = (wr_ptr_trig + t_start_idx - 3) % OSC_FPGA_SIG_LEN;
+    if(start < 0)
+        start += OSC_FPGA_SIG_LEN;
+
+    switch(mode) {
+    case rp_osc_math_add:
+    case rp_osc_math_sub:
+    case rp_osc_math_mul:
+        rp_osc_math_volts(math_a, &ch[0], start, n);
+        rp_osc_math_volts(math_b, &ch[1], start, n);
+        if(mode == rp_osc_math_add) {
+            for(i = 0; i < n; i++)
+                math_a[i] += math_b[i];
+        } else if(mode == rp_osc_math_sub) {
+            for(i = 0; i < n; i++)
+                math_a[i] -= math_b[i];
+        } else {
+            for(i = 0; i < n; i++)
+                math_a[i] *= math_b[i];
+        }
+        break;
+    default:
+        rp_osc_math_volts(math_a, &ch[source ? 1 : 0], start, n);
+        break;
+    }
+
+    if(mode == rp_osc_math_fft) {
+        if(rp_osc_math_spectrum(r, n, out) < 0)
+            goto fail;
+        *fft_df = (1.0 / smpl_period) / n * (n / 2) / SIGNAL_LENGTH;
+        return 0;
+    }
+
+    /* Mean of the raw samples of each point, the integral and derivative
+     * of the means */
+    {
+        float inv = 1.0 / t_step;
+        double acc = 0;
+        float prev = 0;
+
+        for(k = 0; k < SIGNAL_LENGTH; k++) {
+            const float *s = &r[k * t_step];
+            float sum = 0;
+            for(i = 0; i < t_step; i++)
+                sum += s[i];
+
+            switch(mode) {
+            case rp_osc_math_integrate:
+                acc += sum * smpl_period;
+                out[k] = acc;
+                break;
+            case rp_osc_math_derivative:
+                out[k] = k ? (sum * inv - prev) / (t_step * smpl_period) : 0;
+                prev = sum * inv;
+                break;
+            default:
+                out[k] = sum * inv;
+                break;
+            }
+        }
+        if(mode == rp_osc_math_derivative)
+            out[0] = out[1];
+    }
+    return 0;
+
+fail:
+    memset(out, 0, SIGNAL_LENGTH * sizeof(float));
+    return -1;
+}
@@ -0,0 +1,50 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope math channel.
+ *
+ * The math signal is computed from the raw samples of the displayed
+ * window, before the decimation, and then reduced to SIGNAL_LENGTH points
+ * like the channels. Only used from the worker.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __MATH_CH_H
+#define __MATH_CH_H
+
+typedef enum rp_osc_math_mode_e {
+    rp_osc_math_off = 0,
+    rp_osc_math_add,        /* A + B [V] */
+    rp_osc_math_sub,        /* A - B [V] */
+    rp_osc_math_mul,        /* A * B [V^2] */
+    rp_osc_math_integrate,  /* integral of the source from the window start [Vs] */
+    rp_osc_math_derivative, /* derivative of the source [V/s] */
+    rp_osc_math_fft,        /* amplitude spectrum of the source [dBV] */
+    rp_osc_math_nonexisting /* must be last */
+} rp_osc_math_mode_t;
+
+/* One channel of the FPGA buffers and its conversion to [V] */
+typedef struct rp_osc_math_ch_s {
+    const int *raw;
+    float      max_adc_v;
+    int        calib_dc_off;
+    float      user_dc_off;
+} rp_osc_math_ch_t;
+
+/* Computes the math signal of the window t_start..t_stop [s] after the
+ * trigger into out[SIGNAL_LENGTH]. source selects the channel (0 - A,
+ * 1 - B) of the single channel modes. The time domain modes average the
+ * raw samples of each output point. The spectrum goes from DC over the
+ * whole output, *fft_df is set to the frequency step per point [Hz].
+ * Returns 0, or -1 with out cleared if the mode is off or fails.
+ */
+int rp_osc_math_frame(int mode, int source, const rp_osc_math_ch_t *ch,
+                      int wr_ptr_trig, int dec_factor, float t_start, float t_stop,
+                      float *out, float *fft_df);
+
+#endif /* __MATH_CH_H */
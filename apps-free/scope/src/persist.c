@@ -0,0 +1,225 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope persistence (and eye diagram) histogram.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "main.h"
+#include "persist.h"
+
+/* The worker adds frames, the web server reads the image */
+static pthread_mutex_t persist_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int      persist_mode = rp_osc_persist_off;
+static float    persist_period = 0;
+static uint32_t persist_frames = 0;
+static uint16_t persist_hist[2][PERSIST_HEIGHT][PERSIST_WIDTH];
+
+/* Bins of one frame, only used from worker */
+static uint16_t persist_col[SIGNAL_LENGTH];
+static uint16_t persist_row[2][SIGNAL_LENGTH];
+
+/* Encoded channel, only used with persist_mutex held */
+static uint8_t  persist_rle[PERSIST_WIDTH * PERSIST_HEIGHT * 3 / 2 + 2];
+
+static const char persist_b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+/*----------------------------------------------------------------------------------*/
+static void rp_osc_persist_clear(void)
+{
+    memset(persist_hist, 0, sizeof(persist_hist));
+    persist_frames = 0;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_persist_set(int mode, float period)
+{
+    if(mode < rp_osc_persist_off || mode >= rp_osc_persist_nonexisting)
+        mode = rp_osc_persist_off;
+
+    pthread_mutex_lock(&persist_mutex);
+    if(mode != persist_mode || period != persist_period) {
+        persist_mode = mode;
+        persist_period = period;
+        rp_osc_persist_clear();
+    }
+    pthread_mutex_unlock(&persist_mutex);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_persist_reset(void)
+{
+    pthread_mutex_lock(&persist_mutex);
+    rp_osc_persist_clear();
+    pthread_mutex_unlock(&persist_mutex);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Amplitude rows of one channel, no branches so the loop vectorizes */
+static void rp_osc_persist_rows(uint16_t *row, const float *sig, float range)
+{
+    float scale = PERSIST_HEIGHT / (2 * range);
+    int i;
+
+    for(i = 0; i < SIGNAL_LENGTH; i++) {
+        float r = (sig[i] + range) * scale;
+        r = r < 0 ? 0 : r;
+        r = r > PERSIST_HEIGHT-1 ? PERSIST_HEIGHT-1 : r;
+        row[i] = (uint16_t)r;
+    }
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_osc_persist_add(float **signals, float ch1_range, float ch2_range)
+{
+    int mode, ch, i;
+    float period;
+
+    pthread_mutex_lock(&persist_mutex);
+    mode = persist_mode;
+    period = persist_period;
+    pthread_mutex_unlock(&persist_mutex);
+
+    if(mode == rp_osc_persist_off || ch1_range <= 0 || ch2_range <= 0)
+        return;
+    if(mode == rp_osc_persist_eye && period <= 0)
+        return;
+
+    /* Bins are found outside of the lock, the scatter below is the only
+     * part the web server has to wait for. NEON has no scatter, so the
+     * increments stay scalar.
+     */
+    if(mode == rp_osc_persist_eye) {
+        float inv = 1.0 / period;
+        for(i = 0; i < SIGNAL_LENGTH; i++) {
+            float p = signals[0][i] * inv;
+            int c = (int)((p - floorf(p)) * PERSIST_WIDTH);
+            persist_col[i] = c < PERSIST_WIDTH ? c : PERSIST_WIDTH-1;
+        }
+    } else {
+        for(i = 0; i < SIGNAL_LENGTH; i++)
+            persist_col[i] = i / (SIGNAL_LENGTH / PERSIST_WIDTH);
+    }
+    rp_osc_persist_rows(persist_row[0], signals[1], ch1_range);
+    rp_osc_persist_rows(persist_row[1], signals[2], ch2_range);
+
+    pthread_mutex_lock(&persist_mutex);
+    /* Settings changed while the bins were found */
+    if(mode != persist_mode || period != persist_period) {
+        pthread_mutex_unlock(&persist_mutex);
+        return;
+    }
+    for(ch = 0; ch < 2; ch++) {
+        for(i = 0; i < SIGNAL_LENGTH; i++) {
+            uint16_t *h = &persist_hist[ch][persist_row[ch][i]][persist_col[i]];
+            if(*h != UINT16_MAX)
+                (*h)++;
+        }
+    }
+    persist_frames++;
+    pthread_mutex_unlock(&persist_mutex);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Log intensity with zero runs, returns the length in persist_rle */
+static int rp_osc_persist_encode(const uint16_t *hist)
+{
+    uint16_t max = 0;
+    float scale;
+    int i, n = 0;
+
+    for(i = 0; i < PERSIST_WIDTH * PERSIST_HEIGHT; i++)
+        max = hist[i] > max ? hist[i] : max;
+    scale = max > 1 ? 254 / logf(max) : 0;
+
+    for(i = 0; i < PERSIST_WIDTH * PERSIST_HEIGHT; ) {
+        if(hist[i] == 0) {
+            int run = 0;
+            while(i < PERSIST_WIDTH * PERSIST_HEIGHT && hist[i] == 0 && run < 255) {
+                run++;
+                i++;
+            }
+            persist_rle[n++] = 0;
+            persist_rle[n++] = run;
+        } else {
+            persist_rle[n++] = 1 + (int)(logf(hist[i]) * scale);
+            i++;
+        }
+    }
+    return n;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+static int rp_osc_persist_base64(char *out, int len, const uint8_t *in, int in_len)
+{
+    int i, n = 0;
+
+    if(len < (in_len + 2) / 3 * 4)
+        return -1;
+
+    for(i = 0; i < in_len; i += 3) {
+        uint32_t v = in[i] << 16;
+        if(i+1 < in_len)
+            v |= in[i+1] << 8;
+        if(i+2 < in_len)
+            v |= in[i+2];
+        out[n++] = persist_b64[(v >> 18) & 0x3f];
+        out[n++] = persist_b64[(v >> 12) & 0x3f];
+        out[n++] = (i+1 < in_len) ? persist_b64[(v >> 6) & 0x3f] : '=';
+        out[n++] = (i+2 < in_len) ? persist_b64[v & 0x3f] : '=';
+    }
+    return n;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_persist_image(char *buf, int len)
+{
+    int ch, n, ret;
+
+    pthread_mutex_lock(&persist_mutex);
+    if(persist_mode == rp_osc_persist_off) {
+        pthread_mutex_unlock(&persist_mutex);
+        return -1;
+    }
+
+    n = snprintf(buf, len, "{\"mode\":%d,\"frames\":%u,\"width\":%d,\"height\":%d",
+                 persist_mode, persist_frames, PERSIST_WIDTH, PERSIST_HEIGHT);
+    for(ch = 0; ch < 2 && n < len; ch++) {
+        n += snprintf(buf + n, len - n, ",\"ch%d\":\"", ch+1);
+        if(n >= len)
+            break;
+        ret = rp_osc_persist_base64(buf + n, len - n,
+                                    persist_rle, rp_osc_persist_encode(&persist_hist[ch][0][0]));
+        if(ret < 0) {
+            n = len;
+            break;
+        }
+        n += ret;
+        n += snprintf(buf + n, len - n, "\"");
+    }
+    if(n < len)
+        n += snprintf(buf + n, len - n, "}");
+    pthread_mutex_unlock(&persist_mutex);
+
+    return n < len ? n : -1;
+}
@@ -0,0 +1,55 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Oscilloscope persistence (and eye diagram) histogram.
+ *
+ * Every complete frame of the worker is added to a time x amplitude
+ * histogram per channel, so the density of many triggers can be shown
+ * without sending every frame to the browser. In the eye mode the time is
+ * folded on a user period, starting at the trigger.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __PERSIST_H
+#define __PERSIST_H
+
+/* Histogram size, SIGNAL_LENGTH must be a multiple of PERSIST_WIDTH */
+#define PERSIST_WIDTH   256
+#define PERSIST_HEIGHT  128
+
+/* Worst case of rp_osc_persist_image(), both channels */
+#define PERSIST_IMAGE_MAX (2 * ((PERSIST_WIDTH * PERSIST_HEIGHT * 3 / 2 + 2) / 3 + 1) * 4 + 256)
+
+typedef enum rp_osc_persist_mode_e {
+    rp_osc_persist_off = 0,
+    rp_osc_persist_on,   /* columns are the display time */
+    rp_osc_persist_eye,  /* columns are the phase in the eye period */
+    rp_osc_persist_nonexisting /* must be last */
+} rp_osc_persist_mode_t;
+
+/* Changing the mode or period clears the histogram, period is in the units
+ * of the time vector (xmin/xmax) */
+void rp_osc_persist_set(int mode, float period);
+void rp_osc_persist_reset(void);
+
+/* Adds a complete frame, signals as published: time, ch1, ch2 in [V].
+ * Amplitude rows span -range .. +range of each channel, values outside
+ * go to the edge rows.
+ */
+void rp_osc_persist_add(float **signals, float ch1_range, float ch2_range);
+
+/* Writes the histograms as JSON text to buf:
+ *   {"mode":1,"frames":N,"width":W,"height":H,"ch1":"..","ch2":".."}
+ * Channels are base64 of the rows from the lowest amplitude up, one byte
+ * per cell with the logarithm of the count scaled to 1..255 of the largest
+ * count. Runs of empty cells are a 0 byte followed by the run length.
+ * Returns the length without the NUL, -1 if off or buf is too small.
+ */
+int rp_osc_persist_image(char *buf, int len);
+
+#endif /* __PERSIST_H */
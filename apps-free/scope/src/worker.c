@@ -12,6 +12,7 @@
  * for more details on the language used herein.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <pthread.h>
 #include <errno.h>
@@ -20,28 +21,45 @@
 #include <math.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
 
 #include "worker.h"
 #include "fpga.h"
+#include "persist.h"
+#include "mask.h"
+#include "history.h"
+#include "math_ch.h"
+#include "rp_app_pool.h"
 
 pthread_t *rp_osc_thread_handler = NULL;
 void *rp_osc_worker_thread(void *args);
 
-pthread_mutex_t       rp_osc_ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
-rp_osc_worker_state_t rp_osc_ctrl;
+/* Long acquisitions are read out every RP_OSC_LONG_ACQ_PART display points,
+ * but not more often than every RP_OSC_LONG_ACQ_MIN_US and at least every
+ * RP_OSC_LONG_ACQ_MAX_US.
+ */
+#define RP_OSC_LONG_ACQ_PART    16
+#define RP_OSC_LONG_ACQ_MIN_US  20000
+#define RP_OSC_LONG_ACQ_MAX_US  200000
+
+/* Worker state and parameter hand over, see rp_app_ctrl.h */
+rp_app_ctrl_t         rp_osc_app;
+/* Parameter names, the worker copies them once; the values go through rp_osc_app */
 rp_app_params_t       *rp_osc_params = NULL;
-int                   rp_osc_params_dirty;
-int                   rp_osc_params_fpga_update;
 
-pthread_mutex_t       rp_osc_sig_mutex = PTHREAD_MUTEX_INITIALIZER;
-float               **rp_osc_signals;
-int                   rp_osc_signals_dirty = 0;
-int                   rp_osc_sig_last_idx = 0;
+/* Finished signals, read without a lock by rp_osc_get_signals() and the web server */
+rp_signal_ring_t      rp_osc_signal_ring;
+uint32_t              rp_osc_sig_read_frame = 0; /* last frame copied by rp_osc_get_signals() */
 float               **rp_tmp_signals; /* used for calculation, only from worker */
+rp_app_pool_t         rp_osc_pool;    /* holds rp_tmp_signals */
 
 /* Signals directly pointing at the FPGA mem space */
 int                  *rp_fpga_cha_signal, *rp_fpga_chb_signal;
 
+/* last measurement of each channel, its hysteresis band is reused for the
+ * edges of the next frame, only used from worker */
+rp_dsp_meas_t         rp_osc_meas_last[2];
+
 /* Calibration parameters read from EEPROM */
 rp_calib_params_t *rp_calib_params = NULL;
 
@@ -52,25 +70,27 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
 {
     int ret_val;
 
-    rp_osc_ctrl               = rp_osc_idle_state;
-    rp_osc_params_dirty       = 0;
-    rp_osc_params_fpga_update = 0;
+    if(rp_app_ctrl_init(&rp_osc_app, rp_osc_idle_state, PARAMS_NUM) < 0)
+        return -1;
 
     rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
 
-    rp_cleanup_signals(&rp_osc_signals);
-    if(rp_create_signals(&rp_osc_signals) < 0)
+    rp_signal_ring_free(&rp_osc_signal_ring);
+    if(rp_signal_ring_init(&rp_osc_signal_ring, SIGNALS_NUM, SIGNAL_LENGTH) < 0)
         return -1;
+    rp_osc_sig_read_frame = 0;
 
-    rp_cleanup_signals(&rp_tmp_signals);
-    if(rp_create_signals(&rp_tmp_signals) < 0) {
-        rp_cleanup_signals(&rp_osc_signals);
+    rp_app_pool_free(&rp_osc_pool);
+    if(rp_app_pool_init(&rp_osc_pool,
+                        RP_APP_POOL_SIGNALS_BYTES(SIGNALS_NUM, SIGNAL_LENGTH), 0) < 0) {
+        rp_signal_ring_free(&rp_osc_signal_ring);
         return -1;
     }
+    rp_tmp_signals = rp_app_pool_signals(&rp_osc_pool, SIGNALS_NUM, SIGNAL_LENGTH);
 
     if(osc_fpga_init() < 0) {
-        rp_cleanup_signals(&rp_osc_signals);
-        rp_cleanup_signals(&rp_tmp_signals);
+        rp_signal_ring_free(&rp_osc_signal_ring);
+        rp_app_pool_free(&rp_osc_pool);
         return -1;
     }
 
@@ -80,8 +100,8 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
 
     rp_osc_thread_handler = (pthread_t *)malloc(sizeof(pthread_t));
     if(rp_osc_thread_handler == NULL) {
-        rp_cleanup_signals(&rp_osc_signals);
-        rp_cleanup_signals(&rp_tmp_signals);
+        rp_signal_ring_free(&rp_osc_signal_ring);
+        rp_app_pool_free(&rp_osc_pool);
         return -1;
     }
     ret_val = 
@@ -89,8 +109,8 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
     if(ret_val != 0) {
         osc_fpga_exit();
 
-        rp_cleanup_signals(&rp_osc_signals);
-        rp_cleanup_signals(&rp_tmp_signals);
+        rp_signal_ring_free(&rp_osc_signal_ring);
+        rp_app_pool_free(&rp_osc_pool);
         fprintf(stderr, "pthread_create() failed: %s\n", 
                 strerror(errno));
         return -1;
@@ -117,23 +137,46 @@ int rp_osc_worker_exit(void)
     }
     osc_fpga_exit();
 
-    rp_cleanup_signals(&rp_osc_signals);
-    rp_cleanup_signals(&rp_tmp_signals);
+    rp_signal_ring_free(&rp_osc_signal_ring);
+    rp_app_pool_free(&rp_osc_pool);
+    rp_osc_hist_resize(0);
 
     rp_clean_params(rp_osc_params);
 
+    rp_app_ctrl_exit(&rp_osc_app);
+
     return 0;
 }
 
 
+/*----------------------------------------------------------------------------------*/
+/* Trigger condition of the acquisition loop for rp_app_ctrl_wait_ready() */
+typedef struct rp_osc_trig_wait_s {
+    int long_acq;
+    int init_trig_ptr;
+} rp_osc_trig_wait_t;
+
+static int rp_osc_worker_triggered(void *arg)
+{
+    const rp_osc_trig_wait_t *wait = (const rp_osc_trig_wait_t *)arg;
+    int trig_ptr, curr_ptr;
+
+    /* for non-long acquisition wait for trigger */
+    if(!wait->long_acq)
+        return osc_fpga_triggered();
+
+    /* FPGA wrote new trigger pointer - which means new trigger happened */
+    osc_fpga_get_wr_ptr(&curr_ptr, &trig_ptr);
+    return (wait->init_trig_ptr != trig_ptr) || osc_fpga_triggered();
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_osc_worker_change_state(rp_osc_worker_state_t new_state)
 {
     if(new_state >= rp_osc_nonexisting_state)
         return -1;
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    rp_osc_ctrl = new_state;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    rp_app_ctrl_set_state(&rp_osc_app, new_state);
     return 0;
 }
 
@@ -141,24 +184,27 @@ int rp_osc_worker_change_state(rp_osc_worker_state_t new_state)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_worker_get_state(rp_osc_worker_state_t *state)
 {
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    *state = rp_osc_ctrl;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    *state = rp_app_ctrl_get_state(&rp_osc_app);
     return 0;
 }
 
 
+/*----------------------------------------------------------------------------------*/
+void rp_osc_worker_set_clients(int clients)
+{
+    rp_app_ctrl_set_clients(&rp_osc_app, clients);
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update)
 {
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    rp_copy_params(params, (rp_app_params_t **)&rp_osc_params);
-    rp_osc_params_dirty       = 1;
-    rp_osc_params_fpga_update = fpga_update;
-    rp_osc_params[PARAMS_NUM].name = NULL;
-    rp_osc_params[PARAMS_NUM].value = -1;
+    float *values = rp_app_ctrl_params_begin(&rp_osc_app);
+    int i;
 
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+    for(i = 0; i < PARAMS_NUM; i++)
+        values[i] = params[i].value;
+    rp_app_ctrl_params_end(&rp_osc_app, fpga_update);
     return 0;
 }
 
@@ -166,9 +212,7 @@ int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_clean_signals(void)
 {
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-    rp_osc_signals_dirty = 0;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
+    rp_signal_ring_discard(&rp_osc_signal_ring);
     return 0;
 }
 
@@ -177,21 +221,24 @@ int rp_osc_clean_signals(void)
 int rp_osc_get_signals(float ***signals, int *sig_idx)
 {
     float **s = *signals;
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-    if(rp_osc_signals_dirty == 0) {
-        *sig_idx = rp_osc_sig_last_idx;
-        pthread_mutex_unlock(&rp_osc_sig_mutex);
-        return -1;
-    }
-
-    memcpy(&s[0][0], &rp_osc_signals[0][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[1][0], &rp_osc_signals[1][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&s[2][0], &rp_osc_signals[2][0], sizeof(float)*SIGNAL_LENGTH);
-
-    *sig_idx = rp_osc_sig_last_idx;
-
-    rp_osc_signals_dirty = 0;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
+    const rp_signal_slot_t *slot;
+    uint32_t frame, seq;
+    int i;
+
+    do {
+        slot = rp_signal_ring_read_begin(&rp_osc_signal_ring, &frame, &seq);
+        if(slot == NULL) {
+            *sig_idx = 0;
+            return -1;
+        }
+        *sig_idx = slot->index;
+        if(!rp_signal_ring_is_new(&rp_osc_signal_ring, frame, rp_osc_sig_read_frame))
+            return -1;
+        for(i = 0; i < SIGNALS_NUM; i++)
+            memcpy(&s[i][0], slot->data + i * SIGNAL_LENGTH, sizeof(float)*SIGNAL_LENGTH);
+    } while(!rp_signal_ring_read_end(slot, seq));
+
+    rp_osc_sig_read_frame = frame;
     return 0;
 }
 
@@ -199,17 +246,15 @@ int rp_osc_get_signals(float ***signals, int *sig_idx)
 /*----------------------------------------------------------------------------------*/
 int rp_osc_set_signals(float **source, int index)
 {
-    pthread_mutex_lock(&rp_osc_sig_mutex);
-
-    memcpy(&rp_osc_signals[0][0], &source[0][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[1][0], &source[1][0], sizeof(float)*SIGNAL_LENGTH);
-    memcpy(&rp_osc_signals[2][0], &source[2][0], sizeof(float)*SIGNAL_LENGTH);
-    rp_osc_sig_last_idx = index;
+    rp_signal_ring_write(&rp_osc_signal_ring, source, index, index == SIGNAL_LENGTH-1);
+    return 0;
+}
 
-    rp_osc_signals_dirty = 1;
-    pthread_mutex_unlock(&rp_osc_sig_mutex);
 
-    return 0;
+/*----------------------------------------------------------------------------------*/
+rp_signal_ring_t *rp_osc_get_signal_ring(void)
+{
+    return &rp_osc_signal_ring;
 }
 
 
@@ -221,16 +266,97 @@ int rp_osc_set_meas_data(rp_osc_meas_res_t ch1_meas, rp_osc_meas_res_t ch2_meas)
 }
 
 
+/*----------------------------------------------------------------------------------*/
+/* Math signal of a capture into rp_tmp_signals[3] */
+static void rp_osc_worker_math(rp_app_params_t *params, int *cha, int *chb,
+                               int wr_ptr_trig, int dec_factor, float t_start, float t_stop,
+                               float ch1_max_adc_v, float ch2_max_adc_v,
+                               float ch1_user_dc_off, float ch2_user_dc_off)
+{
+    rp_osc_math_ch_t ch[2] = {
+        { cha, ch1_max_adc_v, rp_calib_params->fe_ch1_dc_offs, ch1_user_dc_off },
+        { chb, ch2_max_adc_v, rp_calib_params->fe_ch2_dc_offs, ch2_user_dc_off }
+    };
+    float fft_df = 0;
+
+    if(rp_osc_math_frame(params[MATH_MODE].value, params[MATH_SOURCE].value, ch,
+                         wr_ptr_trig, dec_factor, t_start, t_stop,
+                         rp_tmp_signals[3], &fft_df) == 0 &&
+       params[MATH_MODE].value == rp_osc_math_fft) {
+        rp_update_math_data(fft_df);
+    }
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Decimates a kept capture again and publishes it like a new one. With the
+ * time base it was taken with, the current window is used, so it can be
+ * zoomed and moved; otherwise its own window.
+ */
+static void rp_osc_worker_replay(rp_app_params_t *params, int back, int dec_factor)
+{
+    const rp_osc_hist_meta_t *meta;
+    rp_osc_meas_res_t ch1_meas, ch2_meas;
+    rp_dsp_meas_t meas_last[2];
+    struct timespec now;
+    int *cha, *chb;
+    float t_start, t_stop;
+    int time_unit;
+
+    meta = rp_osc_hist_load(back, &cha, &chb);
+    if(meta == NULL) {
+        rp_update_hist_data(rp_osc_hist_frames(), 0);
+        return;
+    }
+
+    if(meta->dec_factor == dec_factor) {
+        t_start   = params[MIN_GUI_PARAM].value;
+        t_stop    = params[MAX_GUI_PARAM].value;
+        time_unit = params[TIME_UNIT_PARAM].value;
+    } else {
+        t_start   = meta->t_start;
+        t_stop    = meta->t_stop;
+        time_unit = meta->time_unit;
+    }
+
+    memset(meas_last, 0, sizeof(meas_last));
+    rp_osc_meas_clear(&ch1_meas);
+    rp_osc_meas_clear(&ch2_meas);
+    rp_osc_decimate_frame((float **)&rp_tmp_signals[1], cha,
+                          (float **)&rp_tmp_signals[2], chb,
+                          (float **)&rp_tmp_signals[0], meta->dec_factor, meta->trig_ptr,
+                          t_start, t_stop, time_unit, &ch1_meas, &ch2_meas, meas_last,
+                          meta->ch1_max_adc_v, meta->ch2_max_adc_v,
+                          meta->ch1_user_dc_off, meta->ch2_user_dc_off);
+    rp_osc_worker_math(params, cha, chb, meta->trig_ptr, meta->dec_factor, t_start, t_stop,
+                       meta->ch1_max_adc_v, meta->ch2_max_adc_v,
+                       meta->ch1_user_dc_off, meta->ch2_user_dc_off);
+    rp_osc_meas_convert(&ch1_meas, meta->ch1_max_adc_v, rp_calib_params->fe_ch1_dc_offs);
+    rp_osc_meas_convert(&ch2_meas, meta->ch2_max_adc_v, rp_calib_params->fe_ch2_dc_offs);
+    rp_osc_set_meas_data(ch1_meas, ch2_meas);
+    rp_osc_set_signals(rp_tmp_signals, SIGNAL_LENGTH-1);
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    rp_update_hist_data(rp_osc_hist_frames(),
+                        (now.tv_sec - meta->time.tv_sec) +
+                        (now.tv_nsec - meta->time.tv_nsec) * 1e-9);
+}
+
+
 /*----------------------------------------------------------------------------------*/
 void *rp_osc_worker_thread(void *args)
 {
     rp_osc_worker_state_t old_state, state;
     rp_app_params_t      *curr_params = NULL;
+    float                 curr_values[PARAMS_NUM];
     int                   fpga_update = 0;
     int                   dec_factor = 0;
     int                   time_vect_update = 0;
+            /* Long acquisitions have no math channel, and off is zero */
+            memset(rp_tmp_signals[3], 0, SIGNAL_LENGTH * sizeof(float));
     uint32_t              trig_source = 0;
     int                   params_dirty = 0;
+    int                   mask;
 
     /* Long acquisition special function */
     int long_acq = 0; /* long_acq if acq_time > 1 [s] */
@@ -244,23 +370,35 @@ void *rp_osc_worker_thread(void *args)
     float ch1_max_adc_v = 1, ch2_max_adc_v = 1;
     float max_adc_norm = osc_fpga_calc_adc_max_v(rp_calib_params->fe_ch1_fs_g_hi, 0);
 
-    pthread_mutex_lock(&rp_osc_ctrl_mutex);
-    old_state = state = rp_osc_ctrl;
-    pthread_mutex_unlock(&rp_osc_ctrl_mutex);
-
+    old_state = state = rp_app_ctrl_get_state(&rp_osc_app);
+    if(rp_copy_params(rp_osc_params, &curr_params) < 0) {
+        rp_clean_params(curr_params);
+        return 0;
+    }
 
     while(1) {
         /* update states - we save also old state to see if we need to reset
          * FPGA 
          */
         old_state = state;
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        if(rp_osc_params_dirty) {
-            rp_copy_params(rp_osc_params, (rp_app_params_t **)&curr_params);
-            fpga_update = rp_osc_params_fpga_update;
+        state = rp_app_ctrl_get_state(&rp_osc_app);
+        /* Copies only if the web server published new values, never waits for it */
+        if(rp_app_ctrl_params_get(&rp_osc_app, curr_values, &fpga_update)) {
+            int i;
 
-            rp_osc_params_dirty = 0;
+            /* Frames taken with other settings do not belong to the histogram */
+            for(i = 0; i < PARAMS_AWG_PARAMS; i++) {
+                if(curr_params[i].value != curr_values[i]) {
+                    rp_osc_persist_reset();
+                    break;
+                }
+            }
+            for(i = 0; i < PARAMS_NUM; i++)
+                curr_params[i].value = curr_values[i];
+            if((int)curr_params[HIST_DEPTH].value != rp_osc_hist_depth()) {
+                rp_osc_hist_resize(curr_params[HIST_DEPTH].value);
+                rp_update_hist_data(0, 0);
+            }
             dec_factor = 
                 osc_fpga_cnv_time_range_to_dec(curr_params[TIME_RANGE_PARAM].value);
             time_vect_update = 1;
@@ -277,7 +415,6 @@ void *rp_osc_worker_thread(void *args)
             ch2_max_adc_v =
                     osc_fpga_calc_adc_max_v(fe_fsg2, (int)curr_params[PRB_ATT_CH2].value);
         }
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
 
         /* request to stop worker thread, we will shut down */
         if(state == rp_osc_quit_state) {
@@ -336,8 +473,23 @@ void *rp_osc_worker_thread(void *args)
             fpga_update = 0;
         }
 
+        /* Nobody looks, nothing is acquired until a browser connects */
+        if(rp_app_ctrl_wait_clients(&rp_osc_app, state)) {
+            time_vect_update = 1;
+            continue;
+        }
+
+        /* A kept capture is shown, the acquisition waits until live again */
+        if(curr_params[HIST_VIEW].value > 0) {
+            rp_osc_worker_replay(curr_params, curr_params[HIST_VIEW].value, dec_factor);
+            rp_app_ctrl_sleep(&rp_osc_app, state, -1);
+            time_vect_update = 1;
+            continue;
+        }
+
         if(state == rp_osc_idle_state) {
-            usleep(10000);
+            /* Nothing to do until the client changes something */
+            rp_app_ctrl_sleep(&rp_osc_app, state, -1);
             continue;
         }
 
@@ -354,6 +506,8 @@ void *rp_osc_worker_thread(void *args)
                                        curr_params[TIME_UNIT_PARAM].value);
 
             time_vect_update = 0;
+            /* Long acquisitions have no math channel, and off is zero */
+            memset(rp_tmp_signals[3], 0, SIGNAL_LENGTH * sizeof(float));
 
             /* check if we have long acquisition - if yes the algorithm 
              * (wait for pre-defined time and return partial signal) */
@@ -386,12 +540,12 @@ void *rp_osc_worker_thread(void *args)
                 /* time delay is always in seconds - convert to [us] and
                 * sleep 
                 */
-                usleep(round(-1 * time_delay * 1e6));
+                rp_app_ctrl_sleep(&rp_osc_app, state, round(-1 * time_delay * 1e6));
             } else {
                 if(curr_params[TIME_RANGE_PARAM].value > 4)
-                    usleep(5000);
+                    rp_app_ctrl_sleep(&rp_osc_app, state, 5000);
                 else
-                    usleep(1);
+                    rp_app_ctrl_sleep(&rp_osc_app, state, 1);
             }
 
             /* Start the trigger */
@@ -399,9 +553,7 @@ void *rp_osc_worker_thread(void *args)
         }
 
         /* start working */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        old_state = state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        old_state = state = rp_app_ctrl_get_state(&rp_osc_app);
         if((state == rp_osc_idle_state) || (state == rp_osc_abort_state)) {
             continue;
         } else if(state == rp_osc_quit_state) {
@@ -409,31 +561,14 @@ void *rp_osc_worker_thread(void *args)
         }
 
         if(long_acq_idx == 0) {
-            /* polling until data is ready */
-            while(1) {
-                pthread_mutex_lock(&rp_osc_ctrl_mutex);
-                state = rp_osc_ctrl;
-                params_dirty = rp_osc_params_dirty;
-                pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+            /* wait until data is ready */
+            rp_osc_trig_wait_t wait = { long_acq, long_acq_init_trig_ptr };
+
+            if(rp_app_ctrl_wait_ready(&rp_osc_app, old_state, rp_osc_worker_triggered,
+                                      &wait, -1) < 0) {
                 /* change in state, abort polling */
-                if((state != old_state) || params_dirty) {
-                    break;
-                }
-                
-                if(!long_acq && osc_fpga_triggered()) {
-                    /* for non-long acquisition wait for trigger */
-                    break;
-                } else if(long_acq) {
-                    int trig_ptr, curr_ptr;
-                    osc_fpga_get_wr_ptr(&curr_ptr, &trig_ptr);
-                    if((long_acq_init_trig_ptr != trig_ptr) || osc_fpga_triggered()) {
-                        /* FPGA wrote new trigger pointer - which means
-                         * new trigger happened 
-                         */
-                        break;
-                    }
-                }
-                usleep(1000);
+                state = rp_app_ctrl_get_state(&rp_osc_app);
+                params_dirty = rp_app_ctrl_params_changed(&rp_osc_app);
             }
         }
 
@@ -446,8 +581,7 @@ void *rp_osc_worker_thread(void *args)
             * data
             */
             
-            /* TODO: Make it programmable - Sleep for 200 [ms] */
-            const int long_acq_part_delay = 1000 * 200; 
+            long long_acq_part_delay;
             if(long_acq_idx == 0) {
                 /* Trigger - so let's arrange all the needed pointers & stuff */
                 int wr_ptr_curr, wr_ptr_trig;
@@ -482,15 +616,19 @@ void *rp_osc_worker_thread(void *args)
                 rp_osc_meas_clear(&ch2_meas);
             }
              
-            /* we are after trigger - so let's wait a while to collect some 
-            * samples */
-            usleep(long_acq_part_delay); /* Sleep for 200 [ms] */
+            /* we are after trigger - so let's wait until the next
+             * RP_OSC_LONG_ACQ_PART display points are written */
+            long_acq_part_delay = RP_OSC_LONG_ACQ_PART * long_acq_step *
+                c_osc_fpga_smpl_period * dec_factor * 1e6;
+            if(long_acq_part_delay < RP_OSC_LONG_ACQ_MIN_US)
+                long_acq_part_delay = RP_OSC_LONG_ACQ_MIN_US;
+            if(long_acq_part_delay > RP_OSC_LONG_ACQ_MAX_US)
+                long_acq_part_delay = RP_OSC_LONG_ACQ_MAX_US;
+            rp_app_ctrl_sleep(&rp_osc_app, state, long_acq_part_delay);
         }
 
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        params_dirty = rp_osc_params_dirty;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        state = rp_app_ctrl_get_state(&rp_osc_app);
+        params_dirty = rp_app_ctrl_params_changed(&rp_osc_app);
 
         if((state != old_state) || params_dirty)
             continue;
@@ -508,6 +646,18 @@ void *rp_osc_worker_thread(void *args)
                             &ch1_meas, &ch2_meas, ch1_max_adc_v, ch2_max_adc_v,
                             curr_params[GEN_DC_OFFS_1].value,
                             curr_params[GEN_DC_OFFS_2].value);
+            if(curr_params[MATH_MODE].value != rp_osc_math_off) {
+                int wr_ptr_trig;
+
+                osc_fpga_get_wr_ptr(NULL, &wr_ptr_trig);
+                rp_osc_worker_math(curr_params, &rp_fpga_cha_signal[0], &rp_fpga_chb_signal[0],
+                                   wr_ptr_trig, dec_factor,
+                                   curr_params[MIN_GUI_PARAM].value,
+                                   curr_params[MAX_GUI_PARAM].value,
+                                   ch1_max_adc_v, ch2_max_adc_v,
+                                   curr_params[GEN_DC_OFFS_1].value,
+                                   curr_params[GEN_DC_OFFS_2].value);
+            }
         } else {
             long_acq_idx = rp_osc_decimate_partial((float **)&rp_tmp_signals[1], 
                                              &rp_fpga_cha_signal[0], 
@@ -539,9 +689,7 @@ void *rp_osc_worker_thread(void *args)
         }
 
         /* check again for change of state */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        state = rp_app_ctrl_get_state(&rp_osc_app);
 
         /* We have acquisition - if we are in single put state machine
          * to idle */
@@ -553,23 +701,58 @@ void *rp_osc_worker_thread(void *args)
        
         
         /* copy the results to the user buffer - if we are finished or not */
+        mask = RP_OSC_MASK_NONE;
         if(!long_acq || long_acq_idx == 0) {
-            /* Finish the measurement */
-            rp_osc_meas_avg_amp(&ch1_meas, OSC_FPGA_SIG_LEN);
-            rp_osc_meas_avg_amp(&ch2_meas, OSC_FPGA_SIG_LEN);
-            
-            rp_osc_meas_period(&ch1_meas, &ch2_meas, &rp_fpga_cha_signal[0], 
-                               &rp_fpga_chb_signal[0], dec_factor);
+            /* Finish the measurement, rp_osc_decimate() did it all already */
+            if(long_acq) {
+                rp_osc_meas_avg_amp(&ch1_meas, OSC_FPGA_SIG_LEN);
+                rp_osc_meas_avg_amp(&ch2_meas, OSC_FPGA_SIG_LEN);
+
+                rp_osc_meas_period(&ch1_meas, &ch2_meas, &rp_fpga_cha_signal[0], 
+                                   &rp_fpga_chb_signal[0], dec_factor);
+            }
             rp_osc_meas_convert(&ch1_meas, ch1_max_adc_v, rp_calib_params->fe_ch1_dc_offs);
             rp_osc_meas_convert(&ch2_meas, ch2_max_adc_v, rp_calib_params->fe_ch2_dc_offs);
             
             rp_osc_set_meas_data(ch1_meas, ch2_meas);
-            rp_osc_set_signals(rp_tmp_signals, SIGNAL_LENGTH-1);
+
+            /* Long acquisitions are written while they are read, not kept */
+            if(!long_acq && rp_osc_hist_depth() > 0) {
+                rp_osc_hist_meta_t meta;
+
+                clock_gettime(CLOCK_REALTIME, &meta.time);
+                osc_fpga_get_wr_ptr(NULL, &meta.trig_ptr);
+                meta.dec_factor      = dec_factor;
+                meta.ch1_max_adc_v   = ch1_max_adc_v;
+                meta.ch2_max_adc_v   = ch2_max_adc_v;
+                meta.ch1_user_dc_off = curr_params[GEN_DC_OFFS_1].value;
+                meta.ch2_user_dc_off = curr_params[GEN_DC_OFFS_2].value;
+                meta.t_start         = curr_params[MIN_GUI_PARAM].value;
+                meta.t_stop          = curr_params[MAX_GUI_PARAM].value;
+                meta.time_unit       = curr_params[TIME_UNIT_PARAM].value;
+                rp_osc_hist_store(&rp_fpga_cha_signal[0], &rp_fpga_chb_signal[0], &meta);
+                rp_update_hist_data(rp_osc_hist_frames(), 0);
+            }
+
+            mask = rp_osc_mask_test(rp_tmp_signals);
+            if(mask != RP_OSC_MASK_NONE) {
+                uint32_t pass, fail;
+                rp_osc_mask_get_counters(&pass, &fail);
+                rp_update_mask_data(pass, fail);
+            }
+            /* Only failing frames go over the network if asked so */
+            if((mask != RP_OSC_MASK_PASS) || (rp_osc_mask_get_mode() != rp_osc_mask_fail_only))
+                rp_osc_set_signals(rp_tmp_signals, SIGNAL_LENGTH-1);
+            if((mask == RP_OSC_MASK_FAIL) && (rp_osc_mask_get_mode() == rp_osc_mask_stop))
+                rp_osc_worker_change_state(rp_osc_idle_state);
+            rp_osc_persist_add(rp_tmp_signals, ch1_max_adc_v, ch2_max_adc_v);
         } else {
             rp_osc_set_signals(rp_tmp_signals, long_acq_idx);
         }
-        /* do not loop too fast */
-        usleep(10000);
+        /* do not loop too fast, but follow changes right away; the mask
+         * test counts every trigger */
+        if(mask == RP_OSC_MASK_NONE)
+            rp_app_ctrl_sleep(&rp_osc_app, state, 10000);
     }
 
     rp_clean_params(curr_params);
@@ -616,13 +799,33 @@ int rp_osc_decimate(float **cha_signal, int *in_cha_signal,
                     rp_osc_meas_res_t *ch1_meas, rp_osc_meas_res_t *ch2_meas,
                     float ch1_max_adc_v, float ch2_max_adc_v,
                     float ch1_user_dc_off, float ch2_user_dc_off)
+{
+    int wr_ptr_curr, wr_ptr_trig;
+
+    osc_fpga_get_wr_ptr(&wr_ptr_curr, &wr_ptr_trig);
+    return rp_osc_decimate_frame(cha_signal, in_cha_signal, chb_signal, in_chb_signal,
+                                 time_signal, dec_factor, wr_ptr_trig,
+                                 t_start, t_stop, time_unit, ch1_meas, ch2_meas,
+                                 &rp_osc_meas_last[0], ch1_max_adc_v, ch2_max_adc_v,
+                                 ch1_user_dc_off, ch2_user_dc_off);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_decimate_frame(float **cha_signal, int *in_cha_signal,
+                          float **chb_signal, int *in_chb_signal,
+                          float **time_signal, int dec_factor, int wr_ptr_trig,
+                          float t_start, float t_stop, int time_unit,
+                          rp_osc_meas_res_t *ch1_meas, rp_osc_meas_res_t *ch2_meas,
+                          rp_dsp_meas_t *meas_last,
+                          float ch1_max_adc_v, float ch2_max_adc_v,
+                          float ch1_user_dc_off, float ch2_user_dc_off)
 {
     int t_start_idx, t_stop_idx;
     float smpl_period = c_osc_fpga_smpl_period * dec_factor;
     int   t_unit_factor = rp_osc_get_time_unit_factor(time_unit);
     int t_step;
     int in_idx, out_idx, t_idx;
-    int wr_ptr_curr, wr_ptr_trig;
 
     float *cha_s = *cha_signal;
     float *chb_s = *chb_signal;
@@ -646,7 +849,6 @@ int rp_osc_decimate(float **cha_signal, int *in_cha_signal,
          */
         t_step = round((t_stop_idx-t_start_idx)/(float)(SIGNAL_LENGTH-1));
     }
-    osc_fpga_get_wr_ptr(&wr_ptr_curr, &wr_ptr_trig);
     in_idx = wr_ptr_trig + t_start_idx - 3;
 
     if(in_idx < 0) 
@@ -654,15 +856,11 @@ int rp_osc_decimate(float **cha_signal, int *in_cha_signal,
     if(in_idx >= OSC_FPGA_SIG_LEN)
         in_idx = in_idx % OSC_FPGA_SIG_LEN;
 
-    /* First perform measurements on non-decimated signal:
-     *  - min, max - performed in the loop
-     *  - avg, amp - performed after the loop
-     *  - freq, period - performed in the next decimation loop
-     */
-    for(out_idx=0; out_idx < OSC_FPGA_SIG_LEN; out_idx++) {
-        rp_osc_meas_min_max(ch1_meas, in_cha_signal[out_idx]);
-        rp_osc_meas_min_max(ch2_meas, in_chb_signal[out_idx]);
-    }
+    /* First perform all measurements on non-decimated signal, one pass
+     * over the FPGA buffer per channel */
+    rp_osc_meas_signal(ch1_meas, &meas_last[0], in_cha_signal, wr_ptr_trig, dec_factor);
+    rp_osc_meas_signal(ch2_meas, &meas_last[1], in_chb_signal, wr_ptr_trig, dec_factor);
+    rp_osc_meas_delay(ch1_meas, ch2_meas, in_cha_signal, in_chb_signal, wr_ptr_trig, dec_factor);
 
     for(out_idx=0, t_idx=0; out_idx < SIGNAL_LENGTH; 
         out_idx++, in_idx+=t_step, t_idx+=t_step) {
@@ -795,6 +993,77 @@ int rp_osc_get_time_unit_factor(int time_unit)
 }
 
 
+/*----------------------------------------------------------------------------------*/
+/* One auto-set capture with the software trigger, both channels are
+ * measured in one pass. Returns 0, 1 if the capture did not finish within
+ * timeout_us or -1 on a change of the state or the parameters.
+ */
+static int rp_osc_auto_capture(rp_osc_worker_state_t old_state, int time_range, int en_avg_at_dec,
+                               float ch1_max_adc_v, float ch2_max_adc_v,
+                               int ch1_probe_att, int ch2_probe_att, int ch1_gain, int ch2_gain,
+                               long timeout_us, rp_dsp_meas_t *meas)
+{
+    rp_osc_trig_wait_t wait = { 0, 0 };
+    int wr_ptr_curr, wr_ptr_trig;
+    int ret;
+
+    osc_fpga_reset();
+    osc_fpga_update_params(1, 0, 0, 0, 0, time_range, ch1_max_adc_v, ch2_max_adc_v,
+                           rp_calib_params->fe_ch1_dc_offs,
+                           0,
+                           rp_calib_params->fe_ch2_dc_offs,
+                           0,
+                           ch1_probe_att, ch2_probe_att, ch1_gain, ch2_gain, en_avg_at_dec);
+
+    /* ARM & Trigger */
+    osc_fpga_arm_trigger();
+    osc_fpga_set_trigger(1);
+
+    /* Wait for the buffer to fill after the trigger */
+    ret = rp_app_ctrl_wait_ready(&rp_osc_app, old_state, rp_osc_worker_triggered,
+                                 &wait, timeout_us);
+    if(ret > 0)
+        TRACE("AUTO: capture at time range %d timed out\n", time_range);
+    if(ret != 0)
+        return ret;
+
+    osc_fpga_get_wr_ptr(&wr_ptr_curr, &wr_ptr_trig);
+    wr_ptr_trig %= OSC_FPGA_SIG_LEN;
+    rp_DspMeasure((const int32_t *)rp_fpga_cha_signal, OSC_FPGA_SIG_LEN, wr_ptr_trig,
+                  c_osc_fpga_adc_bits, NULL, &meas[0]);
+    rp_DspMeasure((const int32_t *)rp_fpga_chb_signal, OSC_FPGA_SIG_LEN, wr_ptr_trig,
+                  c_osc_fpga_adc_bits, NULL, &meas[1]);
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Length of a capture at time_range in seconds */
+static float rp_osc_auto_span(int time_range)
+{
+    return (float)OSC_FPGA_SIG_LEN / c_osc_fpga_smpl_freq *
+        osc_fpga_cnv_time_range_to_dec(time_range);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Period in seconds of a capture at time_range, 0 if it has less than two
+ * edges, too little signal for them or only fits less than three times.
+ */
+static float rp_osc_auto_period(const rp_dsp_meas_t *meas, int time_range)
+{
+    const float c_meas_freq_thr = 100;
+    float period;
+
+    if((meas->edges < 2) || ((meas->thr_high - meas->thr_low) < c_meas_freq_thr))
+        return 0;
+    period = meas->period / c_osc_fpga_smpl_freq * osc_fpga_cnv_time_range_to_dec(time_range);
+    if(period * 3 >= rp_osc_auto_span(time_range))
+        return 0;
+    return period;
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_osc_auto_set(rp_app_params_t *orig_params, 
                     float ch1_max_adc_v, float ch2_max_adc_v,
@@ -802,121 +1071,76 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
                     int ch1_probe_att, int ch2_probe_att, int ch1_gain, int ch2_gain, int en_avg_at_dec)
 {
     const int c_noise_thr = 500; /* noise threshold */
-    rp_osc_worker_state_t old_state, state;
-    int params_dirty;
-    /* Min/maxes from both channel */
-    int max_cha = INT_MIN;
-    int max_chb = INT_MIN;
-    int min_cha = INT_MAX;
-    int min_chb = INT_MAX;
-    /* Y axis deltas, 0 - ChA, 1 - Chb */
-    int dy[2]     = { 0, 0 };
-    int old_dy[2] = { 0, 0 };
-
-    /* Channel to be used for auto-algorithm:
-     * 0 - Channel A 
-     * 1 - Channel B 
+    /* Coarse to fine: the fine capture resolves fast signals and their true
+     * peaks, the coarse one averages over the decimation so fast signals
+     * can not alias into a false period, the slow one is only taken if the
+     * coarse one found a signal but no period.
      */
-    int channel; 
-    int smpl_cnt;
-    int iter;
-    int time_range = 0;
-
-    for (iter=0; iter < 10; iter++) {
-        /* 10 auto-trigger acquisitions */
-        pthread_mutex_lock(&rp_osc_ctrl_mutex);
-        old_state = state = rp_osc_ctrl;
-        pthread_mutex_unlock(&rp_osc_ctrl_mutex);
-
-        osc_fpga_reset();
-        osc_fpga_update_params(1, 0, 0, 0, 0, time_range, ch1_max_adc_v, ch2_max_adc_v,
-                   rp_calib_params->fe_ch1_dc_offs,
-                   0,
-                   rp_calib_params->fe_ch2_dc_offs,
-                   0,
-                   ch1_probe_att, ch2_probe_att, ch1_gain, ch2_gain, 0);
-
-        /* ARM & Trigger */
-        osc_fpga_arm_trigger();
-        osc_fpga_set_trigger(1);
-
-        /* Wait for trigger to finish */
-        while(1) {
-            pthread_mutex_lock(&rp_osc_ctrl_mutex);
-            state = rp_osc_ctrl;
-            params_dirty = rp_osc_params_dirty;
-            pthread_mutex_unlock(&rp_osc_ctrl_mutex);
-            /* change in state, abort polling */
-            if((state != old_state) || params_dirty) {
-                return -1;
-            }
-            if(osc_fpga_triggered()) {
-                break;
-            }
-            usleep(500);
-        }
-
-        /* Get the signals - available at rp_fpga_chX_signal vectors */
-        for(smpl_cnt = 0; smpl_cnt < OSC_FPGA_SIG_LEN; smpl_cnt++) {
-            int cha_smpl = rp_fpga_cha_signal[smpl_cnt];
-            int chb_smpl = rp_fpga_chb_signal[smpl_cnt];
-
-            // TWO'S COMPLEMENT
-            if(cha_smpl & (1<<(c_osc_fpga_adc_bits-1)))
-                cha_smpl = -1 * ((cha_smpl ^ ((1<<c_osc_fpga_adc_bits)-1))+1);
-            if(chb_smpl & (1<<(c_osc_fpga_adc_bits-1)))
-                chb_smpl = -1 * ((chb_smpl ^ ((1<<c_osc_fpga_adc_bits)-1))+1);
-
-            cha_smpl = cha_smpl + rp_calib_params->fe_ch1_dc_offs;
-            chb_smpl = chb_smpl + rp_calib_params->fe_ch2_dc_offs;
-
-            /* Get min/maxes */
-            max_cha = (max_cha < cha_smpl) ? cha_smpl : max_cha;
-            min_cha = (min_cha > cha_smpl) ? cha_smpl : min_cha;
-            max_chb = (max_chb < chb_smpl) ? chb_smpl : max_chb;
-            min_chb = (min_chb > chb_smpl) ? chb_smpl : min_chb;
-        }
+    const int c_fine_range   = 0; /* 131 us */
+    const int c_coarse_range = 3; /* 134 ms */
+    const int c_slow_range   = 4; /* 1.07 s */
+    const long c_capture_margin_us = 50000;
+
+    rp_osc_worker_state_t old_state;
+    struct timespec start, now;
+    rp_dsp_meas_t meas[2];
+    /* Raw min/maxes of both channels over all captures */
+    int max_ch[2] = { INT_MIN, INT_MIN };
+    int min_ch[2] = { INT_MAX, INT_MAX };
+    int calib_dc_off[2] = { rp_calib_params->fe_ch1_dc_offs, rp_calib_params->fe_ch2_dc_offs };
+    int dy[2];
+    int captures[3] = { c_fine_range, c_coarse_range, c_slow_range };
+    int channel = 0;
+    int time_range = -1;
+    float period = 0;
+    int i, c;
+
+    old_state = rp_app_ctrl_get_state(&rp_osc_app);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(c = 0; c < 3; c++) {
+        long used_us, timeout_us;
+        int ret;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        used_us = (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+        timeout_us = rp_osc_auto_span(captures[c]) * 1e6 + c_capture_margin_us;
+        if(used_us + timeout_us > RP_OSC_AUTO_SET_MAX_US)
+            break;
 
-        dy[0] = max_cha - min_cha;
-        dy[1] = max_chb - min_chb;
+        ret = rp_osc_auto_capture(old_state, captures[c], c != 0,
+                                  ch1_max_adc_v, ch2_max_adc_v,
+                                  ch1_probe_att, ch2_probe_att, ch1_gain, ch2_gain,
+                                  timeout_us, meas);
+        if(ret < 0)
+            return -1;
+        if(ret > 0)
+            break;
 
-        /* Calculate ratios of last amplitude increase for both channels */
-        const float c_inc_thr = 1.1;
-        float ratio[2] = { 1e6, 1e6 };
-        int i;
         for(i = 0; i < 2; i++) {
-            if (old_dy[i] != 0) {
-                ratio[i] = (float)dy[i] / (float)old_dy[i];
-            }
-        }
-        old_dy[0] = dy[0];
-        old_dy[1] = dy[1];
-
-        /* Signal amplitude found & stable? */
-        if ( ((ratio[0] < c_inc_thr) && (dy[0] > c_noise_thr)) ||
-             ((ratio[1] < c_inc_thr) && (dy[1] > c_noise_thr)) ) {
-            /* This is meant for optimizing the time it takes for AUTO to complete,
-             * and is a compromise between the speed and robustness of the AUTO
-             * algorithm.
-             * Since it is fast enough, it is safer to search for amplitude through
-             * all the iterations instead of bailing out sooner.
-             */
-            //break;
+            max_ch[i] = (max_ch[i] < meas[i].max) ? meas[i].max : max_ch[i];
+            min_ch[i] = (min_ch[i] > meas[i].min) ? meas[i].min : min_ch[i];
+            dy[i] = max_ch[i] - min_ch[i];
         }
+        /* Select the channel with the larger amplitude so far */
+        channel = (dy[0] > dy[1]) ? 0 : 1;
+        if(dy[channel] < c_noise_thr)
+            break;
 
-        /* Still searching? - Increase time range up to 130 ms (D = 1024). */
-        if ((iter % 3) == 2) {
-            time_range++;
-            if (time_range > 3) {
-                time_range = 3;
-            }
-        }
+        period = rp_osc_auto_period(&meas[channel], captures[c]);
+        TRACE("AUTO: time range %d, channel %d, period = %.9f\n", captures[c], channel, period);
+        if(period > 0)
+            break;
     }
 
-    /* Check the Y axis amplitude on both channels and select the channel with 
-     * the larger one.
-     */
-    channel = (dy[0] > dy[1]) ? 0 : 1;
+    if(c == 0) {
+        /* Not even the fine capture, nothing to set */
+        return -1;
+    }
+
+    for(i = 0; i < 2; i++)
+        dy[i] = max_ch[i] - min_ch[i];
 
     if(dy[channel] < c_noise_thr) {
         /* No signal detected, set the parameters to:
@@ -938,8 +1162,10 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
         orig_params[TIME_UNIT_PARAM].value  = 0;
         orig_params[TRIG_DLY_PARAM].value   = 0;
 
-        min_y = (min_cha < min_chb) ? min_cha : min_chb;
-        max_y = (max_cha > max_chb) ? max_cha : max_chb;
+        min_y = (min_ch[0] + calib_dc_off[0] < min_ch[1] + calib_dc_off[1]) ?
+            min_ch[0] + calib_dc_off[0] : min_ch[1] + calib_dc_off[1];
+        max_y = (max_ch[0] + calib_dc_off[0] > max_ch[1] + calib_dc_off[1]) ?
+            max_ch[0] + calib_dc_off[0] : max_ch[1] + calib_dc_off[1];
 
         ave_y = (min_y + max_y) >> 1;
         min_y = (min_y - ave_y) * 2 + ave_y;
@@ -951,163 +1177,76 @@ int rp_osc_auto_set(rp_app_params_t *orig_params,
         // For POST response ...
         transform_to_iface_units(orig_params);
         return 0;
+    }
 
-    } else {
-
-        /* Signal above threshold - loop from lower to higher decimation */
-        int min_y, max_y;
-        int trig_src_ch;               /* Trigger level in samples, smpls_2 introduced for histeresis */
-        int trig_level;
-        float trig_level_v;            /* Trigger level in [V] */
-        int time_range;                /* decimation from 0 to 5 */
-        float max_adc_v;
-        int calib_dc_off;
-
-       int wr_ptr_curr, wr_ptr_trig;
-
-        if(channel == 0) {
-            min_y = min_cha;
-            max_y = max_cha;
-            trig_src_ch = 0;
-            max_adc_v = ch1_max_adc_v;
-            calib_dc_off = rp_calib_params->fe_ch1_dc_offs;
-        } else {
-            min_y = min_chb;
-            max_y = max_chb;
-            trig_src_ch = 1;
-            max_adc_v = ch2_max_adc_v;
-            calib_dc_off = rp_calib_params->fe_ch2_dc_offs;            
+    /* Jump straight to the shortest time range the period fits three times */
+    if(period > 0) {
+        for(time_range = 0; time_range < 4; time_range++) {
+            if(period * 3 < rp_osc_auto_span(time_range))
+                break;
         }
-        trig_level = (max_y + min_y) >> 1;
-        TRACE("AUTO: trig level: %d\n", trig_level);
-        TRACE("AUTO: min,max: %d  %d\n", min_y, max_y);
-
-        trig_level_v = (((trig_level + calib_dc_off) * max_adc_v)/
-                        (float)(1<<(c_osc_fpga_adc_bits-1))) ;
+    }
 
-        int loc_max = INT_MIN;
-        int loc_min = INT_MAX;
+    {
+        int min_y, max_y, ave_y, amp_y;
+        int time_unit = 2;
+        float t_unit_factor = 1; /* to convert to seconds */
+
+        if(time_range < 0)
+            time_range = 5;
+
+        /* pick correct which time unit is selected */
+        if((time_range == 0) || (time_range == 1)) {
+            time_unit     = 0;
+            t_unit_factor = 1e6;
+        } else if((time_range == 2) || (time_range == 3)) {
+            time_unit     = 1;
+            t_unit_factor = 1e3;
+        }
 
-        /* Loop over time ranges and search for the best suiting one (Last range removed: too slow) */
-        for(time_range = 0; time_range < 5; time_range++) {
-            float period = 0;
-            int trig_source = osc_fpga_cnv_trig_source(0, trig_src_ch, 0);
-            int *sig_data;
+        orig_params[TRIG_MODE_PARAM].value  = 1; /* 'normal' */
+        orig_params[TIME_RANGE_PARAM].value = time_range;
+        orig_params[TRIG_SRC_PARAM].value   = channel;
+        orig_params[TRIG_LEVEL_PARAM].value = ((float)(max_ch[channel] + min_ch[channel]))/2 /
+                                (float)(1<<(c_osc_fpga_adc_bits-1));
 
-            osc_fpga_reset();
-            osc_fpga_update_params(0, trig_src_ch, 0, 0, trig_level_v, time_range,
-                                   ch1_max_adc_v, ch2_max_adc_v,
-                                   rp_calib_params->fe_ch1_dc_offs,
-                                   0,
-                                   rp_calib_params->fe_ch2_dc_offs,
-                                   0, 
-                                   ch1_probe_att, ch2_probe_att, ch1_gain, ch2_gain, en_avg_at_dec);
-
-            /* ARM & Trigger */
-            osc_fpga_arm_trigger();
-            osc_fpga_set_trigger(trig_source);
-
-            /* Wait for trigger */
-            /* Wait for trigger to finish */
-            while(1) {
-                pthread_mutex_lock(&rp_osc_ctrl_mutex);
-                state = rp_osc_ctrl;
-                params_dirty = rp_osc_params_dirty;
-                pthread_mutex_unlock(&rp_osc_ctrl_mutex);
+        orig_params[MIN_GUI_PARAM].value    = 0;
+        orig_params[TRIG_DLY_PARAM].value   = 0;
 
-                /* change in state, abort polling */
-                if((state != old_state) || params_dirty) {
-                    return -1;
-                }
-                if(osc_fpga_triggered()) {
-                    break;
-                }    
-                usleep(500);
+        if (period > 0) {
+            /* Period detected */
+            const float c_min_t_span = 1e-7;
+            if (period < c_min_t_span / 1.5) {
+                period = c_min_t_span / 1.5;
             }
+            orig_params[MAX_GUI_PARAM].value =  period * 1.5 * t_unit_factor;
+        } else {
+            /* Period not detected, which means it is longer than ~300 ms */
+            TRACE("AUTO: Signal period cannot be determined.\n");
+            /* Stretch to max 1/4 range. All slow signals should be still visible there */
+            orig_params[MAX_GUI_PARAM].value = 2.0;
+        }
 
-            // Checking where acquisition starts
-            osc_fpga_get_wr_ptr(&wr_ptr_curr, &wr_ptr_trig);
-
-            /* We have a signal in rp_fpga_chX_signal */
-            sig_data = (channel == 0) ? rp_fpga_cha_signal : rp_fpga_chb_signal;
-            int dec_factor = osc_fpga_cnv_time_range_to_dec(time_range);
-
-            rp_osc_meas_res_t meas;
-            rp_osc_meas_clear(&meas);
-            meas.min = min_y;
-            meas.max = max_y;
-
-            meas_period(&meas, sig_data, wr_ptr_trig, dec_factor, &loc_min, &loc_max);
-            period = meas.period;
-            TRACE("AUTO: period = %.6f\n", period);
-
-            /* We have a winner - calculate the new parameters */
-            if ((period > 0) || (time_range >= 4))
-            {
-                int ave_y, amp_y;
-                int time_unit = 2;
-                float t_unit_factor = 1; /* to convert to seconds */
-
-                /* pick correct which time unit is selected */
-                if((time_range == 0) || (time_range == 1)) {
-                    time_unit     = 0;
-                    t_unit_factor = 1e6;
-                } else if((time_range == 2) || (time_range == 3)) {
-                    time_unit     = 1;
-                    t_unit_factor = 1e3;
-                }
-                
-                orig_params[TRIG_MODE_PARAM].value  = 1; /* 'normal' */
-                orig_params[TIME_RANGE_PARAM].value = time_range;
-                orig_params[TRIG_SRC_PARAM].value   = trig_src_ch;
-                orig_params[TRIG_LEVEL_PARAM].value = ((float)(loc_max + loc_min))/2 /
-                                        (float)(1<<(c_osc_fpga_adc_bits-1));
-
-                orig_params[MIN_GUI_PARAM].value    = 0;
-                orig_params[TRIG_DLY_PARAM].value   = 0;
-
-                if (period > 0) {
-                    /* Period detected */
-                    const float c_min_t_span = 1e-7;
-                    if (period < c_min_t_span / 1.5) {
-                        period = c_min_t_span / 1.5;
-                    }
-                    orig_params[MAX_GUI_PARAM].value =  period * 1.5 * t_unit_factor;
-                } else {
-                    /* Period not detected, which means it is longer than ~300 ms */
-                    TRACE("AUTO: Signal period cannot be determined.\n");
-                    /* Stretch to max 1/4 range. All slow signals should be still visible there */
-                    orig_params[MAX_GUI_PARAM].value = 2.0;
-                    orig_params[TIME_RANGE_PARAM].value = 5;
-                }
-
-                orig_params[TIME_UNIT_PARAM].value  = time_unit;
-                orig_params[AUTO_FLAG_PARAM].value  = 0;
-
-                min_y = (min_cha < min_chb) ? min_cha : min_chb;
-                max_y = (max_cha > max_chb) ? max_cha : max_chb;
-
-                if (loc_max > max_y)
-                    max_y = loc_max;
+        orig_params[TIME_UNIT_PARAM].value  = time_unit;
+        orig_params[AUTO_FLAG_PARAM].value  = 0;
 
-                if (loc_min <  min_y)
-                    min_y = loc_min;
+        min_y = (min_ch[0] + calib_dc_off[0] < min_ch[1] + calib_dc_off[1]) ?
+            min_ch[0] + calib_dc_off[0] : min_ch[1] + calib_dc_off[1];
+        max_y = (max_ch[0] + calib_dc_off[0] > max_ch[1] + calib_dc_off[1]) ?
+            max_ch[0] + calib_dc_off[0] : max_ch[1] + calib_dc_off[1];
 
-                ave_y = (min_y + max_y) >> 1;
-                amp_y = ((max_y - min_y) >> 1) * 1.2;
-                min_y = ave_y - amp_y;
-                max_y = ave_y + amp_y;
+        ave_y = (min_y + max_y) >> 1;
+        amp_y = ((max_y - min_y) >> 1) * 1.2;
+        min_y = ave_y - amp_y;
+        max_y = ave_y + amp_y;
 
-                orig_params[MIN_Y_NORM].value = min_y / (float)(1 << (c_osc_fpga_adc_bits - 1));
-                orig_params[MAX_Y_NORM].value = max_y / (float)(1 << (c_osc_fpga_adc_bits - 1));
+        orig_params[MIN_Y_NORM].value = min_y / (float)(1 << (c_osc_fpga_adc_bits - 1));
+        orig_params[MAX_Y_NORM].value = max_y / (float)(1 << (c_osc_fpga_adc_bits - 1));
 
-                // For POST response ...
-                transform_to_iface_units(orig_params);
-                return 0;
-            }
-        }
+        // For POST response ...
+        transform_to_iface_units(orig_params);
+        return 0;
     }
-    return -1;
 }
 
 
@@ -1120,6 +1259,8 @@ int rp_osc_meas_clear(rp_osc_meas_res_t *ch_meas)
     ch_meas->avg = 0;
     ch_meas->freq = 0;
     ch_meas->period = 0;
+    ch_meas->delay = 0;
+    ch_meas->phase = 0;
 
     return 0;
 }
@@ -1256,6 +1397,112 @@ int meas_period(rp_osc_meas_res_t *meas, int *in_signal, int wr_ptr_trig, int de
 }
 
 
+/*----------------------------------------------------------------------------------*/
+/* Frequency of a sine fit to the buffer from the trigger on in cycles per
+ * sample, 0 if the fit does not confirm the edge estimate freq */
+static double rp_osc_meas_fit_freq(const int *in_signal, int wr_ptr_trig, double freq)
+{
+    /* Largest frequency corrections, the edge estimate is within a fraction
+     * of a cycle over the buffer so the fit converges in a few */
+    const int    c_fit_iter = 6;
+    /* Largest relative difference between the fit and the edge estimate */
+    const double c_fit_tol = 0.01;
+    static float fit_in[OSC_FPGA_SIG_LEN];
+    const int half = 1 << (c_osc_fpga_adc_bits - 1);
+    const int mask = (1 << c_osc_fpga_adc_bits) - 1;
+    rp_dsp_sine_t fit;
+    int i;
+
+    for(i = 0; i < OSC_FPGA_SIG_LEN; i++) {
+        int m = in_signal[(wr_ptr_trig + i) & (OSC_FPGA_SIG_LEN - 1)] & mask;
+        fit_in[i] = (m ^ half) - half;
+    }
+    if(rp_DspSineFit(OSC_FPGA_SIG_LEN, fit_in, freq, c_fit_iter, &fit) != 0)
+        return 0;
+    if(fabs(fit.freq - freq) > c_fit_tol * freq)
+        return 0;
+    return fit.freq;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_meas_signal(rp_osc_meas_res_t *meas, rp_dsp_meas_t *last, int *in_signal,
+                       int wr_ptr_trig, int dec_factor)
+{
+    const float c_meas_freq_thr = 100;
+    const float c_min_period = 19.6e-9; // 51 MHz
+    double fit_freq;
+
+    float acq_dur=(float)(OSC_FPGA_SIG_LEN)/((float) c_osc_fpga_smpl_freq) * (float) dec_factor;
+
+    if(rp_DspMeasure((const int32_t *)in_signal, OSC_FPGA_SIG_LEN, wr_ptr_trig % OSC_FPGA_SIG_LEN,
+                     c_osc_fpga_adc_bits, last, last) != 0) {
+        rp_osc_meas_clear(meas);
+        return -1;
+    }
+
+    meas->min = last->min;
+    meas->max = last->max;
+    meas->amp = last->max - last->min;
+    meas->avg = last->mean;
+    meas->period = last->period / (float)c_osc_fpga_smpl_freq * dec_factor;
+
+    /* same limits as meas_period() */
+    if( ((last->thr_high - last->thr_low) < c_meas_freq_thr) ||
+         (meas->period * 3 >= acq_dur)    ||
+         (meas->period < c_min_period) )
+    {
+        meas->period = 0;
+        meas->freq   = 0;
+    } else {
+        /* The edges only give whole samples, a sine fit of the buffer
+         * refines the period to a small part of a sample */
+        fit_freq = rp_osc_meas_fit_freq(in_signal, wr_ptr_trig, 1.0 / last->period);
+        if(fit_freq > 0)
+            meas->period = 1.0 / fit_freq / (float)c_osc_fpga_smpl_freq * dec_factor;
+        meas->freq = 1.0 / meas->period;
+    }
+
+    return 0;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_meas_delay(rp_osc_meas_res_t *ch1_meas, rp_osc_meas_res_t *ch2_meas,
+                      int *in_cha_signal, int *in_chb_signal, int wr_ptr_trig, int dec_factor)
+{
+    const float c_meas_amp_thr = 100;
+    /* Below it the channels do not share a signal */
+    const double c_min_coeff = 0.5;
+    static float xc_in[2][OSC_FPGA_SIG_LEN];
+    const int half = 1 << (c_osc_fpga_adc_bits - 1);
+    const int mask = (1 << c_osc_fpga_adc_bits) - 1;
+    rp_dsp_xcorr_t xc;
+    int i;
+
+    ch2_meas->delay = 0;
+    ch2_meas->phase = 0;
+    /* amp is still in ADC counts */
+    if((ch1_meas->amp < c_meas_amp_thr) || (ch2_meas->amp < c_meas_amp_thr))
+        return 0;
+
+    for(i = 0; i < OSC_FPGA_SIG_LEN; i++) {
+        int ix = (wr_ptr_trig + i) & (OSC_FPGA_SIG_LEN - 1);
+        xc_in[0][i] = ((in_cha_signal[ix] & mask) ^ half) - half;
+        xc_in[1][i] = ((in_chb_signal[ix] & mask) ^ half) - half;
+    }
+    /* Delays up to half the buffer, so at least half of it overlaps */
+    if(rp_DspXcorr(OSC_FPGA_SIG_LEN, xc_in[0], xc_in[1], OSC_FPGA_SIG_LEN / 2, &xc) != 0)
+        return -1;
+    if(xc.coeff < c_min_coeff)
+        return 0;
+
+    ch2_meas->delay = xc.delay / (float)c_osc_fpga_smpl_freq * dec_factor;
+    ch2_meas->phase = xc.phase;
+    return 0;
+}
+
+
 /*----------------------------------------------------------------------------------*/
 inline float rp_osc_meas_cnv_cnt(float data, float adc_max_v)
 {
@@ -17,6 +17,9 @@
 
 #include "main.h"
 #include "calib.h"
+#include "rp_signal_ring.h"
+#include "redpitaya/rp_dsp.h"
+#include "rp_app_ctrl.h"
 
 typedef enum rp_osc_worker_state_e {
     rp_osc_idle_state = 0, /* do nothing */
@@ -34,6 +37,8 @@ int rp_osc_worker_init(rp_app_params_t *params, int params_len,
 int rp_osc_worker_exit(void);
 int rp_osc_worker_change_state(rp_osc_worker_state_t new_state);
 int rp_osc_worker_get_state(rp_osc_worker_state_t *state);
+/* Without clients the worker stops acquiring */
+void rp_osc_worker_set_clients(int clients);
 int rp_osc_worker_update_params(rp_app_params_t *params, int fpga_update);
 
 /* removes 'dirty' flags */
@@ -47,6 +52,8 @@ int rp_osc_get_signals(float ***signals, int *sig_idx);
  * and marks it dirty 
  */
 int rp_osc_set_signals(float **source, int index);
+/* Ring the signals are published to, the web server reads it in place */
+rp_signal_ring_t *rp_osc_get_signal_ring(void);
 /* Fills the output measuremenet data with last measurements
  */
 int rp_osc_set_meas_data(rp_osc_meas_res_t ch1_meas, rp_osc_meas_res_t ch2_meas);
@@ -72,6 +79,17 @@ int rp_osc_decimate(float **cha_signal, int *in_cha_signal,
                     float ch1_max_adc_v, float ch2_max_adc_v,
                     float ch1_user_dc_off, float ch2_user_dc_off);
 
+/* Same with the trigger pointer of a recorded frame, meas_last[2] is the
+ * measurement state of both channels */
+int rp_osc_decimate_frame(float **cha_signal, int *in_cha_signal,
+                          float **chb_signal, int *in_chb_signal,
+                          float **time_signal, int dec_factor, int wr_ptr_trig,
+                          float t_start, float t_stop, int time_unit,
+                          rp_osc_meas_res_t *ch1_meas, rp_osc_meas_res_t *ch2_meas,
+                          rp_dsp_meas_t *meas_last,
+                          float ch1_max_adc_v, float ch2_max_adc_v,
+                          float ch1_user_dc_off, float ch2_user_dc_off);
+
 int rp_osc_decimate_partial(float **cha_out_signal, int *cha_in_signal, 
                             float **chb_out_signal, int *chb_in_signal,
                             float **time_out_signal, int *next_wr_ptr, 
@@ -82,7 +100,8 @@ int rp_osc_decimate_partial(float **cha_out_signal, int *cha_in_signal,
                             float ch1_max_adc_v, float ch2_max_adc_v,
                             float ch1_user_dc_off, float ch2_user_dc_off);
 
-/* Auto-set algorithm */
+/* Auto-set algorithm, finishes within RP_OSC_AUTO_SET_MAX_US */
+#define RP_OSC_AUTO_SET_MAX_US 1500000
 int rp_osc_auto_set(rp_app_params_t *orig_params, 
                     float ch1_max_adc_v, float ch2_max_adc_v,
                     float ch1_user_dc_off, float ch2_user_dc_off,
@@ -102,6 +121,14 @@ int rp_osc_meas_period(rp_osc_meas_res_t *ch1_meas, rp_osc_meas_res_t *ch2_meas,
                        int *in_cha_signal, int *in_chb_signal, int dec_factor);
 int meas_period(rp_osc_meas_res_t *meas, int *in_signal, int wr_ptr_trig, int dec_factor,
                 int *min, int *max);
+/* helper function - min, max, amplitude, average, period and frequency of
+ * a whole FPGA buffer in one pass, last keeps the state between frames */
+int rp_osc_meas_signal(rp_osc_meas_res_t *meas, rp_dsp_meas_t *last, int *in_signal,
+                       int wr_ptr_trig, int dec_factor);
+/* helper function - delay and phase of CH2 to CH1 from the cross-correlation
+ * of the whole FPGA buffers into ch2_meas, needs the amplitudes in counts */
+int rp_osc_meas_delay(rp_osc_meas_res_t *ch1_meas, rp_osc_meas_res_t *ch2_meas,
+                      int *in_cha_signal, int *in_chb_signal, int wr_ptr_trig, int dec_factor);
 /* helper function - convert CNT to V for meas. data (min, max, amp, avg) */
 int rp_osc_meas_convert(rp_osc_meas_res_t *ch_meas, float adc_max_v, int32_t cal_dc_offs);
 
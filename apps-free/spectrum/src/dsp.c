@@ -19,12 +19,13 @@
 #include <unistd.h>
 #include <math.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "dsp.h"
 #include "main.h"
 #include "fpga.h"
 #include "dsp.h"
-#include "kiss_fftr.h"
+#include "redpitaya/rp_dsp.h"
 
 extern float g_spectr_fpga_adc_max_v;
 extern const int c_spectr_fpga_adc_bits;
@@ -32,18 +33,40 @@ extern const int c_spectr_fpga_adc_bits;
 /* length of output signals: floor(SPECTR_FPGA_SIG_LEN/2) */
 const int c_dsp_sig_len = SPECTR_FPGA_SIG_LEN>>1;
 
-/* Internal structures used in DSP  */
-double                *rp_hann_window   = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out1 = NULL;
-kiss_fft_cpx         *rp_kiss_fft_out2 = NULL;
-kiss_fftr_cfg         rp_kiss_fft_cfg  = NULL;
-
 /* constants - calibration dependant */
 /* Power calc. impedance*/
 const double c_imp = 50;
 /* Const - [W] -> [mW] */
 const double c_w2mw = 1000;
 
+/* Zoom band, only changed from the worker thread. A zoom of 1 is the full
+ * span from DC to freq_smpl/2, otherwise 1/zoom of it around the center. */
+static float spectr_zoom_center = 0;   /* [Hz] */
+static int   spectr_zoom        = 1;
+
+/* Lowest frequency and width of the displayed band [Hz] */
+static void spectr_zoom_band(float freq_smpl, float *f_lo, float *span)
+{
+    *span = freq_smpl / 2 / spectr_zoom;
+    *f_lo = spectr_zoom_center - *span / 2;
+    if(*f_lo > freq_smpl / 2 - *span)
+        *f_lo = freq_smpl / 2 - *span;
+    if(*f_lo < 0)
+        *f_lo = 0;
+}
+
+int rp_spectr_zoom_set(float center, int zoom)
+{
+    if((zoom < 1) || (zoom > RP_SPECTR_ZOOM_MAX) || (zoom & (zoom - 1)) ||
+       (center < 0)) {
+        fprintf(stderr, "rp_spectr_zoom_set() wrong zoom\n");
+        return -1;
+    }
+    spectr_zoom_center = center;
+    spectr_zoom        = zoom;
+    return 0;
+}
+
 int rp_spectr_prepare_freq_vector(float **freq_out, double f_s, float freq_range)
 {
     int i,j,step;
@@ -51,6 +74,7 @@ int rp_spectr_prepare_freq_vector(float **freq_out, double f_s, float freq_range
     float freq_smpl = f_s / (float)spectr_fpga_cnv_freq_range_to_dec(freq_range);
     /* Divider to get to the right units - [MHz], [kHz] or [Hz] */
     float unit_div = 1e6;
+    float f_lo, span;
 
     if(!f) {
         fprintf(stderr, "rp_spectr_prepare_freq_vector() not initialized\n");
@@ -76,6 +100,13 @@ int rp_spectr_prepare_freq_vector(float **freq_out, double f_s, float freq_range
     if(step < 1)
         step = 1;
 
+    if(spectr_zoom > 1) {
+        spectr_zoom_band(freq_smpl, &f_lo, &span);
+        for(i = 0, j = 0; i < SPECTR_OUT_SIG_LEN; i++, j+=step)
+            f[i] = (f_lo + (float)j / (float)c_dsp_sig_len * span) / unit_div;
+        return 0;
+    }
+
     for(i = 0, j = 0; i < SPECTR_OUT_SIG_LEN; i++, j+=step) {
         /* We use full FPGA signal length range for this calculation, eventhough
          * the output vector is smaller. */
@@ -87,30 +118,11 @@ int rp_spectr_prepare_freq_vector(float **freq_out, double f_s, float freq_range
 
 int rp_spectr_hann_init()
 {
-    int i;
-
-    rp_spectr_hann_clean(rp_hann_window);
-
-    rp_hann_window = (double *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(double));
-    if(rp_hann_window == NULL) {
-        fprintf(stderr, "rp_spectr_hann_create() can not allocate mem");
-        return -1;
-    }
-    
-    for(i = 0; i < SPECTR_FPGA_SIG_LEN; i++) {
-        rp_hann_window[i] = RP_SPECTR_HANN_AMP * 
-            (1 - cos(2*M_PI*i / (double)(SPECTR_FPGA_SIG_LEN-1)));
-    }
-
     return 0;
 }
 
 int rp_spectr_hann_clean()
 {
-    if(rp_hann_window) {
-        free(rp_hann_window);
-        rp_hann_window = NULL;
-    }
     return 0;
 }
 
@@ -118,77 +130,39 @@ int rp_spectr_hann_clean()
 int rp_spectr_hann_filter(double *cha_in, double *chb_in,
                           double **cha_out, double **chb_out)
 {
-    int i;
-    double *cha_o = *cha_out;
-    double *chb_o = *chb_out;
-
     if(!cha_in || !chb_in || !*cha_out || !*chb_out)
         return -1;
-    for(i = 0; i < SPECTR_FPGA_SIG_LEN; i++) {
-        cha_o[i] = cha_in[i] * rp_hann_window[i];
-        chb_o[i] = chb_in[i] * rp_hann_window[i];
-    }
 
+    if(rp_DspWindowHann(SPECTR_FPGA_SIG_LEN, RP_SPECTR_HANN_AMP, cha_in, *cha_out) != 0 ||
+       rp_DspWindowHann(SPECTR_FPGA_SIG_LEN, RP_SPECTR_HANN_AMP, chb_in, *chb_out) != 0) {
+        fprintf(stderr, "rp_spectr_hann_filter() can not allocate mem");
+        return -1;
+    }
     return 0;
 }
 
 int rp_spectr_fft_init()
 {
-    if(rp_kiss_fft_out1 || rp_kiss_fft_out2 || rp_kiss_fft_cfg) {
-        rp_spectr_fft_clean();
-    }
-
-    rp_kiss_fft_out1 = 
-        (kiss_fft_cpx *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-    rp_kiss_fft_out2 =
-        (kiss_fft_cpx *)malloc(SPECTR_FPGA_SIG_LEN * sizeof(kiss_fft_cpx));
-
-    rp_kiss_fft_cfg = kiss_fftr_alloc(SPECTR_FPGA_SIG_LEN, 0, NULL, NULL);
-
     return 0;
 }
 
 int rp_spectr_fft_clean()
 {
-    kiss_fft_cleanup();
-    if(rp_kiss_fft_out1) {
-        free(rp_kiss_fft_out1);
-        rp_kiss_fft_out1 = NULL;
-    }
-    if(rp_kiss_fft_out2) {
-        free(rp_kiss_fft_out2);
-        rp_kiss_fft_out2 = NULL;
-    }
-    if(rp_kiss_fft_cfg) {
-        free(rp_kiss_fft_cfg);
-        rp_kiss_fft_cfg = NULL;
-    }
+    rp_DspRelease();
     return 0;
 }
 
 int rp_spectr_fft(double *cha_in, double *chb_in, 
                   double **cha_out, double **chb_out)
 {
-    double *cha_o = *cha_out;
-    double *chb_o = *chb_out;
-    int i;
     if(!cha_in || !chb_in || !*cha_out || !*chb_out)
         return -1;
 
-    if(!rp_kiss_fft_out1 || !rp_kiss_fft_out2 || !rp_kiss_fft_cfg) {
-        fprintf(stderr, "rp_spect_fft not initialized");
+    // FFT limited to fs/2, specter of amplitudes
+    if(rp_DspFftAbs2(SPECTR_FPGA_SIG_LEN, cha_in, chb_in, *cha_out, *chb_out, c_dsp_sig_len) != 0) {
+        fprintf(stderr, "rp_spectr_fft() can not allocate mem");
         return -1;
     }
-
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)cha_in, rp_kiss_fft_out1);
-    kiss_fftr(rp_kiss_fft_cfg, (kiss_fft_scalar *)chb_in, rp_kiss_fft_out2);
-
-    for(i = 0; i < c_dsp_sig_len; i++) {                     // FFT limited to fs/2, specter of amplitudes
-        cha_o[i] = sqrt(pow(rp_kiss_fft_out1[i].r, 2) + 
-                        pow(rp_kiss_fft_out1[i].i, 2));
-        chb_o[i] = sqrt(pow(rp_kiss_fft_out2[i].r, 2) + 
-                        pow(rp_kiss_fft_out2[i].i, 2));
-    }
     return 0;
 }
 
@@ -238,6 +212,55 @@ int rp_spectr_decimate(double *cha_in, double *chb_in,
     return 0;
 }
 
+/* Output units of freq_range, [MHz], [kHz] or [Hz] */
+static int spectr_unit_div(float freq_range, float *unit_div)
+{
+    switch(spectr_fpga_cnv_freq_range_to_unit(freq_range)) {
+    case 2:
+        *unit_div = 1e6;
+        return 0;
+    case 1:
+        *unit_div = 1e3;
+        return 0;
+    case 0:
+        *unit_div = 1;
+        return 0;
+    default:
+        fprintf(stderr, "rp_spectr_prepare_freq_vector() wrong freq_range\n");
+        return -1;
+    }
+}
+
+/* Peak power [dBm] summed over the bins next to the maximum at max_idx */
+static double spectr_peak_power(const float *sig, int max_idx)
+{
+    const int c_pwr_int_cnts = 3; // Number of bins on the left and right side of the max
+    float pwr = 0;
+    int i;
+
+    for(i = max_idx - c_pwr_int_cnts; i <= max_idx + c_pwr_int_cnts; i++) {
+        if((i >= 0) && (i < SPECTR_OUT_SIG_LEN))
+            pwr += pow(10.0, sig[i] / 10.0);
+    }
+    if(pwr <= 1.0e-10)
+        return -200.0;
+    return 10.0 * log10(pwr);
+}
+
+/* 10*log10(x) for a normal x > 0, within 0.001 dB. The exponent comes from
+ * the float bits, log2 of the mantissa from a cubic fit on [1, 2). */
+static inline float spectr_fast_dB(float x)
+{
+    union { float f; uint32_t i; } v = { x };
+    float e = (float)((int)(v.i >> 23) - 127);
+    float t;
+
+    v.i = (v.i & 0x007fffff) | 0x3f800000;
+    t = v.f - 1.0f;
+    return 3.0103f * (e + t * (1.4386380f + t * (-0.6777433f +
+                      t * (0.3218797f + t * -0.0828607f))));
+}
+
 int rp_spectr_cnv_to_dBm(float *cha_in, float *chb_in,
                          float **cha_out, float **chb_out,
                          float *peak_power_cha, float *peak_freq_cha,
@@ -260,20 +283,8 @@ int rp_spectr_cnv_to_dBm(float *cha_in, float *chb_in,
     if(!cha_in || !chb_in || !*cha_out || !*chb_out)
         return -1;
 
-    switch(spectr_fpga_cnv_freq_range_to_unit(freq_range)) {
-    case 2:
-        unit_div = 1e6;
-        break;
-    case 1:
-        unit_div = 1e3;
-        break;
-    case 0:
-        unit_div = 1;
-        break;
-    default:
-        fprintf(stderr, "rp_spectr_prepare_freq_vector() wrong freq_range\n");
+    if(spectr_unit_div(freq_range, &unit_div) < 0)
         return -1;
-    }
 
     for(i = 0; i < SPECTR_OUT_SIG_LEN; i++) {
 
@@ -321,41 +332,10 @@ int rp_spectr_cnv_to_dBm(float *cha_in, float *chb_in,
         }
     }
 
-	// Power correction (summing contributions of contiguous bins)
-	const int c_pwr_int_cnts=3; // Number of bins on the left and right side of the max
-	float cha_pwr=0;
-	float chb_pwr=0;
-	int ii;
-	int ixxa,ixxb;
-        for(ii = 0; ii < (c_pwr_int_cnts*2+1); ii++) {
-	  
-	  ixxa=max_pw_idx_cha+ii-c_pwr_int_cnts;
-	  ixxb=max_pw_idx_chb+ii-c_pwr_int_cnts;
-	  
-	if ((ixxa>=0) && (ixxa<SPECTR_OUT_SIG_LEN)) 
-	 {
-	   cha_pwr+=pow(10.0,cha_o[ixxa]/10.0);
-	 }
-	if ((ixxb>=0) && (ixxb<SPECTR_OUT_SIG_LEN)) 
-	 {
-	   chb_pwr+=pow(10.0,chb_o[ixxb]/10.0);
-	 }	 
-	
-	
-	}
-       
-       if (cha_pwr<=1.0e-10)
-        max_pw_cha  = -200.0;
-       else
-        max_pw_cha     = 10.0 * log10(cha_pwr);
-       
-       if (chb_pwr<=1.0e-10)
-	max_pw_chb  = -200.0;
-       else
-        max_pw_chb     = 10.0 * log10(chb_pwr);
-       
-
-       
+    /* Power correction (summing contributions of contiguous bins) */
+    max_pw_cha = spectr_peak_power(cha_o, max_pw_idx_cha);
+    max_pw_chb = spectr_peak_power(chb_o, max_pw_idx_chb);
+
     *peak_power_cha = max_pw_cha;
     *peak_freq_cha = ((float)max_pw_idx_cha / (float)SPECTR_OUT_SIG_LEN * 
                       freq_smpl  / 2) / unit_div;
@@ -366,3 +346,353 @@ int rp_spectr_cnv_to_dBm(float *cha_in, float *chb_in,
     return 0;
 }
 
+/* Window of the spectrum path, only changed from the worker thread. The
+ * tables are RMS normalized so the noise floor does not move with the
+ * window type, the Hann default matches RP_SPECTR_HANN_AMP. */
+static rp_dsp_win_t spectr_win          = RP_DSP_WIN_HANN;
+static double       spectr_win_amp      = 2 * RP_SPECTR_HANN_AMP;
+static double       spectr_win_amp_seg  = 2 * RP_SPECTR_HANN_AMP;
+static double       spectr_win_enbw     = 1.5;  /* [bins] */
+
+static int spectr_win_rms_amp(rp_dsp_win_t type, int len, double *amp, double *enbw)
+{
+    double cg;
+
+    if(rp_DspWindowGain(type, RP_SPECTR_KAISER_BETA, len, &cg, enbw) != 0)
+        return -1;
+    *amp = 1.0 / (cg * sqrt(*enbw));
+    return 0;
+}
+
+int rp_spectr_window_set(rp_dsp_win_t type)
+{
+    double amp, amp_seg, enbw, enbw_seg;
+
+    if(type == spectr_win)
+        return 0;
+    if(spectr_win_rms_amp(type, SPECTR_FPGA_SIG_LEN, &amp, &enbw) < 0 ||
+       spectr_win_rms_amp(type, RP_SPECTR_WELCH_LEN, &amp_seg, &enbw_seg) < 0) {
+        fprintf(stderr, "rp_spectr_window_set() wrong window type\n");
+        return -1;
+    }
+    spectr_win         = type;
+    spectr_win_amp     = amp;
+    spectr_win_amp_seg = amp_seg;
+    spectr_win_enbw    = enbw;
+    return 0;
+}
+
+/* Frame accumulation, only used from the worker thread */
+static rp_spectr_avg_mode_t avg_mode   = rp_spectr_avg_off;
+static int                  avg_count  = 1;
+static int                  avg_frames = 0;     /* Frames in the average */
+static int                  avg_pos    = 0;     /* Ring slot of the next frame */
+static float               *avg_ring   = NULL;  /* avg_count frames of both channels [mW] */
+static double              *avg_sum    = NULL;  /* Sum of the ring per bin */
+static float               *avg_acc    = NULL;  /* Exponential average or maximum */
+static float               *avg_welch  = NULL;  /* Welch power of the current frame */
+static double              *avg_seg    = NULL;  /* Amplitudes of one Welch segment, both channels */
+static rp_app_pool_t       *avg_pool   = NULL;  /* The buffers start at avg_mark */
+static size_t               avg_mark   = 0;
+
+int rp_spectr_avg_init(rp_app_pool_t *pool)
+{
+    rp_spectr_avg_clean();
+    avg_pool = pool;
+    avg_mark = rp_app_pool_mark(pool);
+    return 0;
+}
+
+int rp_spectr_avg_clean(void)
+{
+    if(avg_pool)
+        rp_app_pool_release(avg_pool, avg_mark);
+    avg_ring = avg_acc = avg_welch = NULL;
+    avg_sum = avg_seg = NULL;
+    avg_mode = rp_spectr_avg_off;
+    avg_count = 1;
+    avg_frames = avg_pos = 0;
+    return 0;
+}
+
+void rp_spectr_avg_reset(void)
+{
+    avg_frames = 0;
+    avg_pos = 0;
+    if(avg_sum)
+        memset(avg_sum, 0, 2 * SPECTR_OUT_SIG_LEN * sizeof(double));
+}
+
+int rp_spectr_avg_set(rp_spectr_avg_mode_t mode, int count)
+{
+    const int bins = 2 * SPECTR_OUT_SIG_LEN;
+
+    if(mode >= rp_spectr_avg_nonexisting)
+        return -1;
+    if(count < 1)
+        count = 1;
+    if(count > RP_SPECTR_AVG_MAX_COUNT)
+        count = RP_SPECTR_AVG_MAX_COUNT;
+
+    if(mode == avg_mode && count == avg_count) {
+        rp_spectr_avg_reset();
+        return 0;
+    }
+
+    rp_spectr_avg_clean();
+    if(mode == rp_spectr_avg_off)
+        return 0;
+    if(avg_pool == NULL) {
+        fprintf(stderr, "rp_spectr_avg_set() not initialized\n");
+        return -1;
+    }
+
+    if((mode == rp_spectr_avg_linear) || (mode == rp_spectr_avg_welch)) {
+        avg_ring = rp_app_pool_alloc(avg_pool, count * bins * sizeof(float));
+        avg_sum  = rp_app_pool_alloc(avg_pool, bins * sizeof(double));
+    } else {
+        avg_acc  = rp_app_pool_alloc(avg_pool, bins * sizeof(float));
+    }
+    if(mode == rp_spectr_avg_welch) {
+        avg_welch = rp_app_pool_alloc(avg_pool, bins * sizeof(float));
+        avg_seg   = rp_app_pool_alloc(avg_pool, 2 * SPECTR_OUT_SIG_LEN * sizeof(double));
+    }
+    if(((mode == rp_spectr_avg_linear || mode == rp_spectr_avg_welch) &&
+        (!avg_ring || !avg_sum)) ||
+       ((mode == rp_spectr_avg_exp || mode == rp_spectr_avg_max_hold) && !avg_acc) ||
+       ((mode == rp_spectr_avg_welch) && (!avg_welch || !avg_seg))) {
+        fprintf(stderr, "rp_spectr_avg_set() can not allocate mem\n");
+        rp_spectr_avg_clean();
+        return -1;
+    }
+
+    avg_mode  = mode;
+    avg_count = count;
+    rp_spectr_avg_reset();
+    return 0;
+}
+
+/* Welch power [mW] of both channels, SPECTR_OUT_SIG_LEN bins each */
+static int spectr_welch(double *cha_in, double *chb_in, float scale)
+{
+    const int c_hop = RP_SPECTR_WELCH_LEN / 2;
+    const int c_segs = (SPECTR_FPGA_SIG_LEN - RP_SPECTR_WELCH_LEN) / c_hop + 1;
+    double *seg_b = avg_seg + SPECTR_OUT_SIG_LEN;
+    float *pw_a = avg_welch;
+    float *pw_b = avg_welch + SPECTR_OUT_SIG_LEN;
+    int seg, i;
+
+    /* The frame scale is for SPECTR_FPGA_SIG_LEN, |X|^2 of a segment
+     * with the same normalized window is smaller by (len/seg len)^2 */
+    scale *= (float)SPECTR_FPGA_SIG_LEN / RP_SPECTR_WELCH_LEN *
+        SPECTR_FPGA_SIG_LEN / RP_SPECTR_WELCH_LEN / c_segs;
+
+    memset(avg_welch, 0, 2 * SPECTR_OUT_SIG_LEN * sizeof(float));
+    for(seg = 0; seg < c_segs; seg++) {
+        /* Both channels of a segment in one transform */
+        if(rp_DspFftAbsWindow2(spectr_win, RP_SPECTR_KAISER_BETA,
+                               spectr_win_amp_seg, RP_SPECTR_WELCH_LEN,
+                               cha_in + seg * c_hop, chb_in + seg * c_hop,
+                               avg_seg, seg_b, SPECTR_OUT_SIG_LEN) != 0)
+            return -1;
+        for(i = 0; i < SPECTR_OUT_SIG_LEN; i++) {
+            pw_a[i] += (float)(avg_seg[i] * avg_seg[i]);
+            pw_b[i] += (float)(seg_b[i] * seg_b[i]);
+        }
+    }
+    for(i = 0; i < 2 * SPECTR_OUT_SIG_LEN; i++)
+        avg_welch[i] *= scale;
+    return 0;
+}
+
+/* Accumulates the power p of bin i ([0, 2*SPECTR_OUT_SIG_LEN)) and returns
+ * the value to display */
+static inline float spectr_avg_update(int i, float p)
+{
+    int n;
+
+    switch(avg_mode) {
+    case rp_spectr_avg_linear:
+    case rp_spectr_avg_welch: {
+        float *slot = &avg_ring[avg_pos * 2 * SPECTR_OUT_SIG_LEN + i];
+        n = avg_frames < avg_count ? avg_frames + 1 : avg_count;
+        avg_sum[i] += p - (avg_frames < avg_count ? 0 : *slot);
+        *slot = p;
+        return avg_sum[i] / n;
+    }
+    case rp_spectr_avg_exp:
+        /* Plain mean until count frames are in, so it settles quickly */
+        n = avg_frames < avg_count ? avg_frames + 1 : avg_count;
+        if(avg_frames == 0)
+            avg_acc[i] = p;
+        else
+            avg_acc[i] += (p - avg_acc[i]) / n;
+        return avg_acc[i];
+    case rp_spectr_avg_max_hold:
+        if((avg_frames == 0) || (p > avg_acc[i]))
+            avg_acc[i] = p;
+        return avg_acc[i];
+    default:
+        return p;
+    }
+}
+
+static void spectr_avg_next_frame(void)
+{
+    if(avg_mode == rp_spectr_avg_off)
+        return;
+    if(avg_frames < avg_count)
+        avg_frames++;
+    if(++avg_pos >= avg_count)
+        avg_pos = 0;
+}
+
+int rp_spectr_analyze(double *cha_in, double *chb_in,
+                      double **cha_fft, double **chb_fft,
+                      float **cha_out, float **chb_out,
+                      float *peak_power_cha, float *peak_freq_cha,
+                      float *peak_power_chb, float *peak_freq_chb,
+                      float freq_range)
+{
+    int i, j, k, step;
+    double *cha_f = *cha_fft;
+    double *chb_f = *chb_fft;
+    float *cha_o = *cha_out;
+    float *chb_o = *chb_out;
+    float max_pw_cha = -1e5;
+    float max_pw_chb = -1e5;
+    int max_pw_idx_cha = 0;
+    int max_pw_idx_chb = 0;
+    float freq_smpl = c_spectr_fpga_smpl_freq / 
+        (float)spectr_fpga_cnv_freq_range_to_dec(freq_range);
+    float unit_div = 1e6;
+    float f_lo = 0;
+    float span = freq_smpl / 2;
+    const int zoom = spectr_zoom > 1;
+    /* Welch segments are only used for the full span */
+    const int welch = (avg_mode == rp_spectr_avg_welch) && !zoom;
+
+    if(!cha_in || !chb_in || !cha_f || !chb_f || !cha_o || !chb_o)
+        return -1;
+
+    if(spectr_unit_div(freq_range, &unit_div) < 0)
+        return -1;
+
+    if(zoom) {
+        /* c_dsp_sig_len bins across the band, the signal is down converted
+         * and decimated by 2*zoom before the transform */
+        const int c_dec = 2 * spectr_zoom;
+        double f0;
+
+        spectr_zoom_band(freq_smpl, &f_lo, &span);
+        f0 = (f_lo + span / 2) / freq_smpl;
+        if(rp_DspZoomFftAbs(spectr_win, RP_SPECTR_KAISER_BETA, spectr_win_amp,
+                            SPECTR_FPGA_SIG_LEN, cha_in, f0, c_dec,
+                            cha_f, c_dsp_sig_len) != 0 ||
+           rp_DspZoomFftAbs(spectr_win, RP_SPECTR_KAISER_BETA, spectr_win_amp,
+                            SPECTR_FPGA_SIG_LEN, chb_in, f0, c_dec,
+                            chb_f, c_dsp_sig_len) != 0) {
+            fprintf(stderr, "rp_spectr_analyze() can not allocate mem");
+            return -1;
+        }
+    } else if(rp_DspFftAbsWindow2(spectr_win, RP_SPECTR_KAISER_BETA, spectr_win_amp,
+                                  SPECTR_FPGA_SIG_LEN, cha_in, chb_in, cha_f, chb_f,
+                                  c_dsp_sig_len) != 0) {
+        /* Window on load, amplitudes are kept for the waterfall */
+        fprintf(stderr, "rp_spectr_analyze() can not allocate mem");
+        return -1;
+    }
+
+    step = (int)round((float)c_dsp_sig_len / (float)SPECTR_OUT_SIG_LEN);
+    if(step < 1)
+        step = 1;
+    if(step * (SPECTR_OUT_SIG_LEN - 1) >= c_dsp_sig_len) {
+        fprintf(stderr, "rp_spectr_analyze() index too high\n");
+        return -1;
+    }
+
+    /* Counts -> V, V^2 / c_imp -> W, x 2 for the unilateral spectral density
+     * representation, W -> mW, all folded into one factor on |X|^2 */
+    const double c2v = g_spectr_fpga_adc_max_v/(float)((int)(1<<(c_spectr_fpga_adc_bits-1)));
+    const float scale = c2v * c2v / c_imp / (double)SPECTR_FPGA_SIG_LEN /
+        (double)SPECTR_FPGA_SIG_LEN * 2 * c_w2mw;
+    const float c_min_pw = 1.0e-12;  /* [mW], avoids -Inf from log10(0.0) */
+    const float c_dc_noise = -80.0;  /* [dBm] */
+    const int   c_dc_span  =  2;     /* [output samples] */
+
+    if(welch && (spectr_welch(cha_in, chb_in, scale) < 0)) {
+        fprintf(stderr, "rp_spectr_analyze() can not allocate mem");
+        return -1;
+    }
+
+    for(i = 0, j = 0; i < SPECTR_OUT_SIG_LEN; i++, j += step) {
+        float cha_p = 0;
+        float chb_p = 0;
+
+        if(welch) {
+            cha_p = avg_welch[i];
+            chb_p = avg_welch[SPECTR_OUT_SIG_LEN + i];
+        } else if(zoom) {
+            /* The zoom bins are interpolated, a sum would count a tone
+             * several times, the maximum keeps its level */
+            for(k = j; k < j + step && k < c_dsp_sig_len; k++) {
+                float a = (float)(cha_f[k] * cha_f[k]);
+                float b = (float)(chb_f[k] * chb_f[k]);
+                if(a > cha_p)
+                    cha_p = a;
+                if(b > chb_p)
+                    chb_p = b;
+            }
+            cha_p *= scale;
+            chb_p *= scale;
+        } else {
+            /* Summing the power associated to each FFT bin */
+            for(k = j; k < j + step && k < c_dsp_sig_len; k++) {
+                cha_p += (float)(cha_f[k] * cha_f[k]);
+                chb_p += (float)(chb_f[k] * chb_f[k]);
+            }
+            cha_p *= scale;
+            chb_p *= scale;
+        }
+        cha_p = spectr_avg_update(i, cha_p);
+        chb_p = spectr_avg_update(SPECTR_OUT_SIG_LEN + i, chb_p);
+
+        cha_o[i] = cha_p > c_min_pw ? spectr_fast_dB(cha_p) : -120.0f;
+        chb_o[i] = chb_p > c_min_pw ? spectr_fast_dB(chb_p) : -120.0f;
+
+        /* Issue #3369: Remove DC component */
+        if((i < c_dc_span) && !zoom) {
+            cha_o[i] = c_dc_noise;
+            chb_o[i] = c_dc_noise;
+        }
+
+        /* Find peaks */
+        if(cha_o[i] > max_pw_cha) {
+            max_pw_cha     = cha_o[i];
+            max_pw_idx_cha = i;
+        }
+        if(chb_o[i] > max_pw_chb) {
+            max_pw_chb     = chb_o[i];
+            max_pw_idx_chb = i;
+        }
+    }
+
+    spectr_avg_next_frame();
+
+    if(zoom) {
+        /* The interpolated maximum has no scalloping loss, only the RMS
+         * normalization of the window is taken out */
+        const float c_enbw_dB = 10 * log10(spectr_win_enbw);
+        *peak_power_cha = max_pw_cha + c_enbw_dB;
+        *peak_power_chb = max_pw_chb + c_enbw_dB;
+    } else {
+        *peak_power_cha = spectr_peak_power(cha_o, max_pw_idx_cha);
+        *peak_power_chb = spectr_peak_power(chb_o, max_pw_idx_chb);
+    }
+    *peak_freq_cha = (f_lo + (float)max_pw_idx_cha / (float)SPECTR_OUT_SIG_LEN *
+                      span) / unit_div;
+    *peak_freq_chb = (f_lo + (float)max_pw_idx_chb / (float)SPECTR_OUT_SIG_LEN *
+                      span) / unit_div;
+
+    return 0;
+}
@@ -15,6 +15,9 @@
 #ifndef __DSP_H
 #define __DSP_H
 
+#include "redpitaya/rp_dsp.h"
+#include "rp_app_pool.h"
+
 extern const int c_dsp_sig_len;
 
 extern const double c_c2v;
@@ -61,4 +64,62 @@ int rp_spectr_cnv_to_dBm(float *cha_in, float *chb_in,
                          float *peak_power_chb, float *peak_freq_chb,
                          float freq_range);
 
+/* Window of rp_spectr_analyze(), RMS normalized. The tables and gains are
+ * cached by librp, so switching only costs the first frame. */
+#define RP_SPECTR_KAISER_BETA 8.6
+int rp_spectr_window_set(rp_dsp_win_t type);
+
+/* Accumulation of successive frames, applied to the linear power of every
+ * output bin before it is converted to dBm by rp_spectr_analyze() */
+typedef enum rp_spectr_avg_mode_e {
+    rp_spectr_avg_off = 0,   /* Every frame on its own */
+    rp_spectr_avg_linear,    /* Mean of the last count frames */
+    rp_spectr_avg_exp,       /* Exponential average with weight 1/count */
+    rp_spectr_avg_max_hold,  /* Maximum since the last reset */
+    rp_spectr_avg_welch,     /* Welch PSD from 50% overlapping segments of
+                              * every capture, mean of the last count frames */
+    rp_spectr_avg_nonexisting /* must be last */
+} rp_spectr_avg_mode_t;
+
+#define RP_SPECTR_AVG_MAX_COUNT 100
+/* Welch segment length, one FFT bin per output sample */
+#define RP_SPECTR_WELCH_LEN     (2*SPECTR_OUT_SIG_LEN)
+
+/* Pool bytes of the accumulation at the largest count */
+#define RP_SPECTR_AVG_POOL_BYTES \
+    (RP_APP_POOL_BYTES(RP_SPECTR_AVG_MAX_COUNT * 2 * SPECTR_OUT_SIG_LEN * sizeof(float)) + \
+     2 * RP_APP_POOL_BYTES(2 * SPECTR_OUT_SIG_LEN * sizeof(double)) + \
+     RP_APP_POOL_BYTES(2 * SPECTR_OUT_SIG_LEN * sizeof(float)))
+
+/* The accumulation buffers are cut from the end of pool, nothing else may
+ * be allocated from it afterwards */
+int rp_spectr_avg_init(rp_app_pool_t *pool);
+/* Sets the mode and count and restarts the accumulation, a changed mode
+ * or count lays the buffers out again */
+int rp_spectr_avg_set(rp_spectr_avg_mode_t mode, int count);
+/* Restarts the accumulation without changing the mode */
+void rp_spectr_avg_reset(void);
+int rp_spectr_avg_clean(void);
+
+/* Zoom into 1/zoom of the span around center [Hz], zoom is a power of two,
+ * 1 is the full span. The band is clamped to DC and freq_smpl/2, the
+ * capture is down converted and decimated by librp before the transform,
+ * so the band gets all c_dsp_sig_len bins. */
+#define RP_SPECTR_ZOOM_MAX 64
+int rp_spectr_zoom_set(float center, int zoom);
+
+/* The four steps above in one pass: Hann window applied while loading the
+ * FFT, amplitudes stored to cha_fft/chb_fft (c_dsp_sig_len, used by the
+ * waterfall), decimated power converted to dBm (SPECTR_OUT_SIG_LEN) with a
+ * fast log10 and peak search. The frame is accumulated according to
+ * rp_spectr_avg_set() before the conversion. With a zoom set the band of
+ * rp_spectr_zoom_set() is analyzed instead, Welch averages like linear.
+ */
+int rp_spectr_analyze(double *cha_in, double *chb_in,
+                      double **cha_fft, double **chb_fft,
+                      float **cha_out, float **chb_out,
+                      float *peak_power_cha, float *peak_freq_cha,
+                      float *peak_power_chb, float *peak_freq_chb,
+                      float freq_range);
+
 #endif //__DSP_H
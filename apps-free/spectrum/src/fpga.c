@@ -300,6 +300,19 @@ int spectr_fpga_get_signal(double **cha_signal, double **chb_signal)
     return 0;
 }
 
+int spectr_fpga_copy_signal(int start, int len, int16_t *cha_signal, int16_t *chb_signal)
+{
+    int in_idx, out_idx;
+
+    for(in_idx = start % SPECTR_FPGA_SIG_LEN, out_idx = 0; out_idx < len;
+        in_idx = (in_idx + 1) % SPECTR_FPGA_SIG_LEN, out_idx++) {
+        /* s.13 in the 14 LSBs, sign extended by the shift pair */
+        cha_signal[out_idx] = (int16_t)(g_spectr_fpga_cha_mem[in_idx] << 2) >> 2;
+        chb_signal[out_idx] = (int16_t)(g_spectr_fpga_chb_mem[in_idx] << 2) >> 2;
+    }
+    return 0;
+}
+
 int spectr_fpga_get_wr_ptr(int *wr_ptr_curr, int *wr_ptr_trig)
 {
     if(wr_ptr_curr)
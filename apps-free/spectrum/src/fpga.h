@@ -206,6 +206,10 @@ int spectr_fpga_get_sig_ptr(int **cha_signal, int **chb_signal);
 /* Copies the last acquisition (trig wr. ptr -> curr. wr. ptr) */
 int spectr_fpga_get_signal(double **cha_signal, double **chb_signal);
 
+/* Copies len samples of both channels from buffer position start on, the
+ * position wraps at SPECTR_FPGA_SIG_LEN */
+int spectr_fpga_copy_signal(int start, int len, int16_t *cha_signal, int16_t *chb_signal);
+
 /* Returns signal pointers from the FPGA */
 int spectr_fpga_get_wr_ptr(int *wr_ptr_curr, int *wr_ptr_trig);
 
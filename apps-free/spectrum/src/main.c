@@ -25,6 +25,9 @@
 #include "version.h"
 #include "worker.h"
 #include "fpga.h"
+#include "dsp.h"
+#include "waterfall.h"
+#include "peaks.h"
 
 /* Describe app. parameters with some info/limitations */
 static rp_app_params_t rp_main_params[PARAMS_NUM+1] = {
@@ -63,6 +66,44 @@ static rp_app_params_t rp_main_params[PARAMS_NUM+1] = {
 		   *    0 - disable
 		   *    1 - enable */
 		"en_avg_at_dec", 1, 0, 1,      0,         1 },
+    { /* avg_mode - frame accumulation (rp_spectr_avg_mode_t):
+       *    0 - off
+       *    1 - linear average of avg_count frames
+       *    2 - exponential average, weight 1/avg_count
+       *    3 - max hold
+       *    4 - Welch PSD, average of avg_count frames */
+        "avg_mode", 0, 0, 0,         0,         4 },
+    { /* avg_count - frames in the average */
+        "avg_count", 10, 0, 0,       1, RP_SPECTR_AVG_MAX_COUNT },
+    { /* window (rp_dsp_win_t):
+       *    0 - rectangular
+       *    1 - Hann
+       *    2 - Blackman-Harris
+       *    3 - flat top
+       *    4 - Kaiser, beta RP_SPECTR_KAISER_BETA */
+        "window", 1, 0, 0,           0,         4 },
+    { /* zoom_center - center of the zoomed band [Hz] */
+        "zoom_center", 0, 0, 0,      0,    62.5e6 },
+    { /* zoom - 1 for the full span, 2 to RP_SPECTR_ZOOM_MAX (power of
+       *        two) for 1/zoom of the span around zoom_center */
+        "zoom", 1, 0, 0,             1, RP_SPECTR_ZOOM_MAX },
+    { /* wf_line - waterfall lines in the stream file (read only) */
+        "wf_line", 0, 0, 1,          0, RP_SPECTR_WF_LINE_WRAP },
+    { /* wf_snapshot - a changed value stores the waterfall JPEG files,
+       *               w_idx is their index */
+        "wf_snapshot", 0, 0, 0,      0, 1e6 },
+    { /* peaks_num - peaks of each channel in the peak table, 0 for none */
+        "peaks_num", 0, 0, 0,        0, RP_SPECTR_PEAKS_MAX },
+    { /* peaks_thr - peaks below this level are left out [dBm] */
+        "peaks_thr", -80, 0, 0,   -200,       100 },
+    { /* rt_mode - real-time analysis of the continuous signal
+       *           (rp_spectr_rt_mode_t):
+       *    0 - off, one triggered capture per frame
+       *    1 - frames overlap by 50%
+       *    2 - frames overlap by 75% */
+        "rt_mode", 0, 1, 0,          0,         2 },
+    { /* rt_gaps - samples the real-time mode did not analyze (read only) */
+        "rt_gaps", 0, 0, 1,          0,      1e12 },
     { /* Must be last! */
         NULL, 0.0, -1, -1, 0.0, 0.0 }
 };
@@ -99,6 +140,11 @@ int rp_app_exit(void)
     return 0;
 }
 
+void rp_app_clients(int clients)
+{
+    rp_spectr_worker_set_clients(clients);
+}
+
 int rp_set_params(rp_app_params_t *p, int len)
 {
     int i;
@@ -224,6 +270,8 @@ int rp_get_signals(float ***s, int *sig_num, int *sig_len)
     }
 
     rp_main_params[JPG_FILE_IDX_PARAM].value     = (float)result.jpg_idx;
+    rp_main_params[WF_LINE_PARAM].value          = (float)result.wf_line;
+    rp_main_params[RT_GAPS_PARAM].value          = (float)result.rt_gaps;
     rp_main_params[PEAK_PW_CHA_PARAM].value      = (float)result.peak_pw_cha;
     rp_main_params[PEAK_PW_FREQ_CHA_PARAM].value = (float)result.peak_pw_freq_cha;
     rp_main_params[PEAK_PW_CHB_PARAM].value      = (float)result.peak_pw_chb;
@@ -233,44 +281,7 @@ int rp_get_signals(float ***s, int *sig_num, int *sig_len)
     return 0;
 }
 
-int rp_create_signals(float ***a_signals)
+int rp_get_signal_table(char *buf, int len)
 {
-    int i;
-    float **s;
-
-    s = (float **)malloc(SPECTR_OUT_SIG_NUM * sizeof(float *));
-    if(s == NULL) {
-        return -1;
-    }
-    for(i = 0; i < SPECTR_OUT_SIG_NUM; i++)
-        s[i] = NULL;
-
-    for(i = 0; i < SPECTR_OUT_SIG_NUM; i++) {
-        s[i] = (float *)malloc(SPECTR_OUT_SIG_LEN * sizeof(float));
-        if(s[i] == NULL) {
-            rp_cleanup_signals(a_signals);
-            return -1;
-        }
-        memset(&s[i][0], 0, SPECTR_OUT_SIG_LEN * sizeof(float));
-    }
-    *a_signals = s;
-
-    return 0;
-}
-
-void rp_cleanup_signals(float ***a_signals)
-{
-    int i;
-    float **s = *a_signals;
-
-    if(s) {
-        for(i = 0; i < SPECTR_OUT_SIG_NUM; i++) {
-            if(s[i]) {
-                free(s[i]);
-                s[i] = NULL;
-            }
-        }
-        free(s);
-        *a_signals = NULL;
-    }
+    return rp_spectr_peaks_table(buf, len);
 }
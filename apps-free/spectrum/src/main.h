@@ -27,7 +27,7 @@ typedef struct rp_app_params_s {
 
 /* Parameters indexes - these defines should be in the same order as
  * rp_app_params_t structure defined in main.c */
-#define PARAMS_NUM             12
+#define PARAMS_NUM             23
 #define MIN_GUI_PARAM          0
 #define MAX_GUI_PARAM          1
 #define FREQ_RANGE_PARAM       2
@@ -40,6 +40,17 @@ typedef struct rp_app_params_s {
 #define PEAK_UNIT_CHB_PARAM    9
 #define JPG_FILE_IDX_PARAM     10
 #define EN_AVG_AT_DEC   		11
+#define AVG_MODE_PARAM         12
+#define AVG_COUNT_PARAM        13
+#define WINDOW_PARAM           14
+#define ZOOM_CENTER_PARAM      15
+#define ZOOM_PARAM             16
+#define WF_LINE_PARAM          17
+#define WF_SNAPSHOT_PARAM      18
+#define PEAKS_NUM_PARAM        19
+#define PEAKS_THR_PARAM        20
+#define RT_MODE_PARAM          21
+#define RT_GAPS_PARAM          22
 
 /* Output signals */
 #define SPECTR_OUT_SIG_LEN (2*1024)
@@ -50,9 +61,6 @@ int rp_app_exit(void);
 int rp_set_params(rp_app_params_t *p, int len);
 int rp_get_params(rp_app_params_t **p);
 int rp_get_signals(float ***s, int *sig_num, int *sig_len);
-
-/* Internal helper functions */
-int  rp_create_signals(float ***a_signals);
-void rp_cleanup_signals(float ***a_signals);
+int rp_get_signal_table(char *buf, int len);
 
 #endif /*  __MAIN_H */
@@ -0,0 +1,173 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Spectrum Analyzer peak table.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "peaks.h"
+
+/* Harmonic within this part of the fundamental */
+#define RP_SPECTR_PEAKS_HARM_TOL 0.02
+
+/* Tables of both channels, written by the worker and read by the web server */
+static pthread_mutex_t  peaks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int              peaks_on = 0;
+static rp_spectr_peak_t peaks[2][RP_SPECTR_PEAKS_MAX];
+static int              peaks_cnt[2] = { 0, 0 };
+static unsigned         peaks_next_id = 1;
+
+
+/*----------------------------------------------------------------------------------*/
+/* Strongest num local maxima of s above threshold, strongest first */
+static int rp_spectr_peaks_find(const float *freq, const float *s, int len, int num,
+                                float threshold, rp_spectr_peak_t *out)
+{
+    int cnt = 0;
+    int i, j;
+
+    for(i = 1; i < len - 1; i++) {
+        float a = s[i-1], b = s[i], c = s[i+1];
+        float d, den;
+
+        if(b <= threshold || b <= a || b < c)
+            continue;
+        if(cnt == num && b <= out[cnt-1].power)
+            continue;
+
+        /* Vertex of the parabola through the three bins */
+        den = a - 2 * b + c;
+        d = den < 0 ? 0.5 * (a - c) / den : 0;
+
+        j = cnt < num ? cnt++ : num - 1;
+        for(; j > 0 && out[j-1].power < b; j--)
+            out[j] = out[j-1];
+        out[j].freq  = freq[i] + d * (freq[i+1] - freq[i]);
+        out[j].power = b - 0.25 * (a - c) * d;
+        out[j].id    = 0;
+        out[j].age   = 0;
+        out[j].harm  = 0;
+    }
+    return cnt;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+/* Ids of the nearest peaks of the previous frame, new ids for the others,
+ * harmonics of the strongest one */
+static void rp_spectr_peaks_track(const rp_spectr_peak_t *prev, int prev_cnt,
+                                  rp_spectr_peak_t *cur, int cnt, float tol)
+{
+    int taken[RP_SPECTR_PEAKS_MAX];
+    int i, j;
+
+    memset(taken, 0, sizeof(taken));
+    for(i = 0; i < cnt; i++) {
+        int best = -1;
+        float best_d = tol;
+
+        for(j = 0; j < prev_cnt; j++) {
+            float d = fabsf(cur[i].freq - prev[j].freq);
+            if(!taken[j] && d <= best_d) {
+                best = j;
+                best_d = d;
+            }
+        }
+        if(best >= 0) {
+            taken[best] = 1;
+            cur[i].id  = prev[best].id;
+            cur[i].age = prev[best].age + 1;
+        } else {
+            cur[i].id  = peaks_next_id++;
+            cur[i].age = 1;
+        }
+    }
+
+    if(cnt > 0 && cur[0].freq > 0) {
+        float f0 = cur[0].freq;
+        for(i = 0; i < cnt; i++) {
+            float h = roundf(cur[i].freq / f0);
+            if(h >= 1 && fabsf(cur[i].freq - h * f0) <= RP_SPECTR_PEAKS_HARM_TOL * f0)
+                cur[i].harm = h;
+        }
+    }
+}
+
+
+/*----------------------------------------------------------------------------------*/
+void rp_spectr_peaks_update(const float *freq, const float *cha, const float *chb,
+                            int len, int num, float threshold)
+{
+    rp_spectr_peak_t cur[2][RP_SPECTR_PEAKS_MAX];
+    int cnt[2] = { 0, 0 };
+    float tol;
+    int ch;
+
+    if(num > RP_SPECTR_PEAKS_MAX)
+        num = RP_SPECTR_PEAKS_MAX;
+    if(num <= 0 || len < 3) {
+        pthread_mutex_lock(&peaks_mutex);
+        peaks_on = 0;
+        peaks_cnt[0] = peaks_cnt[1] = 0;
+        pthread_mutex_unlock(&peaks_mutex);
+        return;
+    }
+
+    tol = RP_SPECTR_PEAKS_TRACK_BINS * (freq[1] - freq[0]);
+    cnt[0] = rp_spectr_peaks_find(freq, cha, len, num, threshold, cur[0]);
+    cnt[1] = rp_spectr_peaks_find(freq, chb, len, num, threshold, cur[1]);
+
+    /* The previous tables are only written here, no lock to read them */
+    for(ch = 0; ch < 2; ch++)
+        rp_spectr_peaks_track(peaks[ch], peaks_cnt[ch], cur[ch], cnt[ch], tol);
+
+    pthread_mutex_lock(&peaks_mutex);
+    for(ch = 0; ch < 2; ch++) {
+        memcpy(peaks[ch], cur[ch], cnt[ch] * sizeof(rp_spectr_peak_t));
+        peaks_cnt[ch] = cnt[ch];
+    }
+    peaks_on = 1;
+    pthread_mutex_unlock(&peaks_mutex);
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_spectr_peaks_table(char *buf, int len)
+{
+    static const char *names[2] = { "cha", "chb" };
+    int ch, i, n = 0;
+
+    pthread_mutex_lock(&peaks_mutex);
+    if(!peaks_on) {
+        pthread_mutex_unlock(&peaks_mutex);
+        return -1;
+    }
+
+    n += snprintf(buf + n, len - n, "{");
+    for(ch = 0; ch < 2 && n < len; ch++) {
+        n += snprintf(buf + n, len - n, "%s\"%s\":[", ch ? "," : "", names[ch]);
+        for(i = 0; i < peaks_cnt[ch] && n < len; i++) {
+            const rp_spectr_peak_t *p = &peaks[ch][i];
+            n += snprintf(buf + n, len - n,
+                          "%s{\"id\":%u,\"age\":%u,\"f\":%.6g,\"p\":%.2f,\"h\":%d}",
+                          i ? "," : "", p->id, p->age, p->freq, p->power, p->harm);
+        }
+        if(n < len)
+            n += snprintf(buf + n, len - n, "]");
+    }
+    if(n < len)
+        n += snprintf(buf + n, len - n, "}");
+    pthread_mutex_unlock(&peaks_mutex);
+
+    return n < len ? n : -1;
+}
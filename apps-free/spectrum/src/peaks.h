@@ -0,0 +1,48 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Spectrum Analyzer peak table.
+ *
+ * The strongest peaks of each output spectrum are found in the worker,
+ * refined by a parabola through the three bins around each, and matched
+ * to the peaks of the previous frame so they keep their id. Harmonics of
+ * the strongest peak are marked. Clients read the small table instead of
+ * searching the full traces.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __PEAKS_H
+#define __PEAKS_H
+
+#define RP_SPECTR_PEAKS_MAX 16
+/* Peaks of two frames this many bins apart are the same one */
+#define RP_SPECTR_PEAKS_TRACK_BINS 2
+
+typedef struct rp_spectr_peak_s {
+    unsigned id;    /* same for the frames the peak is tracked over */
+    unsigned age;   /* frames it was tracked over */
+    float    freq;  /* in the units of the frequency vector */
+    float    power; /* [dBm] */
+    int      harm;  /* multiple of the strongest peak, 0 if none */
+} rp_spectr_peak_t;
+
+/* Finds up to num peaks above threshold [dBm] of both channels, len
+ * samples of the frequency vector and the spectra. num 0 clears the
+ * table. Only called from the worker.
+ */
+void rp_spectr_peaks_update(const float *freq, const float *cha, const float *chb,
+                            int len, int num, float threshold);
+
+/* Writes the table as JSON text to buf:
+ *   {"cha":[{"id":1,"age":5,"f":1.5,"p":-20.1,"h":1},..],"chb":[..]}
+ * strongest first. Returns the length without the NUL, -1 if there is no
+ * table or buf is too small.
+ */
+int rp_spectr_peaks_table(char *buf, int len);
+
+#endif /* __PEAKS_H */
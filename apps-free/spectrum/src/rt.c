@@ -0,0 +1,236 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Spectrum Analyzer real-time capture.
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fpga.h"
+#include "rt.h"
+
+/* Reader poll period [us], an eighth of the FPGA buffer within these bounds */
+#define RT_POLL_MIN_US 100
+#define RT_POLL_MAX_US 10000
+/* The FPGA may have overwritten the samples not yet read past this many */
+#define RT_LAP_LEN     (SPECTR_FPGA_SIG_LEN - SPECTR_FPGA_SIG_LEN/4)
+
+/* Sample positions count from the start, ring index is position modulo
+ * RP_SPECTR_RT_RING_LEN. Everything below is guarded by rt_mutex. */
+static int16_t   *rt_ring_cha = NULL;
+static int16_t   *rt_ring_chb = NULL;
+static uint64_t   rt_written  = 0;  /* samples put into the ring */
+static uint64_t   rt_next     = 0;  /* first sample of the next frame */
+static uint64_t   rt_covered  = 0;  /* end of the last frame */
+static uint64_t   rt_lost     = 0;
+static int        rt_hop      = SPECTR_FPGA_SIG_LEN;
+static int        rt_running  = 0;
+static float      rt_freq_smpl = 0;
+
+static pthread_t       rt_thread;
+static pthread_mutex_t rt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  rt_cond  = PTHREAD_COND_INITIALIZER;
+
+/* Reader chunk, only used by the reader thread */
+static int16_t rt_chunk_cha[SPECTR_FPGA_SIG_LEN];
+static int16_t rt_chunk_chb[SPECTR_FPGA_SIG_LEN];
+
+static uint64_t rt_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Drops everything not analyzed yet, the samples before and after a break
+ * in the signal must not end up in the same frame */
+static void rt_break(uint64_t lost)
+{
+    if(rt_written > rt_covered)
+        lost += rt_written - rt_covered;
+    rt_lost += lost;
+    rt_next = rt_covered = rt_written;
+}
+
+static void *rt_reader_thread(void *args)
+{
+    int rd_ptr, wr_ptr;
+    int poll_us = (int)(SPECTR_FPGA_SIG_LEN / 8 / rt_freq_smpl * 1e6);
+    uint64_t last_us = rt_now_us();
+
+    if(poll_us < RT_POLL_MIN_US)
+        poll_us = RT_POLL_MIN_US;
+    if(poll_us > RT_POLL_MAX_US)
+        poll_us = RT_POLL_MAX_US;
+
+    spectr_fpga_get_wr_ptr(&rd_ptr, NULL);
+    rd_ptr &= SPECTR_FPGA_SIG_LEN - 1;
+
+    while(1) {
+        uint64_t now_us;
+        double elapsed;
+        int len, i;
+
+        usleep(poll_us);
+
+        spectr_fpga_get_wr_ptr(&wr_ptr, NULL);
+        wr_ptr &= SPECTR_FPGA_SIG_LEN - 1;
+        now_us = rt_now_us();
+        /* The pointer wraps, the clock tells whether the writer went
+         * around or came close to the samples not read yet */
+        elapsed = (now_us - last_us) * 1e-6 * rt_freq_smpl;
+        len = (wr_ptr - rd_ptr) & (SPECTR_FPGA_SIG_LEN - 1);
+        if(elapsed < RT_LAP_LEN)
+            spectr_fpga_copy_signal(rd_ptr, len, rt_chunk_cha, rt_chunk_chb);
+
+        pthread_mutex_lock(&rt_mutex);
+        if(!rt_running) {
+            pthread_mutex_unlock(&rt_mutex);
+            break;
+        }
+        if(elapsed >= RT_LAP_LEN) {
+            rt_break((uint64_t)elapsed);
+        } else {
+            for(i = 0; i < len; i++) {
+                int idx = (rt_written + i) % RP_SPECTR_RT_RING_LEN;
+                rt_ring_cha[idx] = rt_chunk_cha[i];
+                rt_ring_chb[idx] = rt_chunk_chb[i];
+            }
+            rt_written += len;
+        }
+        pthread_cond_signal(&rt_cond);
+        pthread_mutex_unlock(&rt_mutex);
+
+        rd_ptr = wr_ptr;
+        last_us = now_us;
+    }
+    return 0;
+}
+
+int rp_spectr_rt_init(rp_app_pool_t *pool)
+{
+    rp_spectr_rt_stop();
+    rt_ring_cha = (int16_t *)rp_app_pool_alloc(pool, RP_SPECTR_RT_RING_LEN * sizeof(int16_t));
+    rt_ring_chb = (int16_t *)rp_app_pool_alloc(pool, RP_SPECTR_RT_RING_LEN * sizeof(int16_t));
+    if(!rt_ring_cha || !rt_ring_chb) {
+        fprintf(stderr, "rp_spectr_rt_init() can not allocate mem\n");
+        rt_ring_cha = rt_ring_chb = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int rp_spectr_rt_start(rp_spectr_rt_mode_t mode, float freq_smpl)
+{
+    int ret_val;
+
+    rp_spectr_rt_stop();
+    if((mode == rp_spectr_rt_off) || (mode >= rp_spectr_rt_nonexisting))
+        return mode == rp_spectr_rt_off ? 0 : -1;
+
+    if(!rt_ring_cha || !rt_ring_chb) {
+        fprintf(stderr, "rp_spectr_rt_start() not initialized\n");
+        return -1;
+    }
+
+    rt_written = rt_next = rt_covered = rt_lost = 0;
+    rt_hop = mode == rp_spectr_rt_overlap_75 ? SPECTR_FPGA_SIG_LEN/4 :
+        SPECTR_FPGA_SIG_LEN/2;
+    rt_freq_smpl = freq_smpl;
+    rt_running = 1;
+
+    /* No trigger source, the FPGA writes until the next reset */
+    spectr_fpga_arm_trigger();
+    spectr_fpga_set_trigger(0);
+
+    ret_val = pthread_create(&rt_thread, NULL, rt_reader_thread, NULL);
+    if(ret_val != 0) {
+        fprintf(stderr, "pthread_create() failed: %s\n", strerror(ret_val));
+        rt_running = 0;
+        rp_spectr_rt_stop();
+        return -1;
+    }
+    return 0;
+}
+
+int rp_spectr_rt_stop(void)
+{
+    int running;
+
+    pthread_mutex_lock(&rt_mutex);
+    running = rt_running;
+    rt_running = 0;
+    pthread_cond_broadcast(&rt_cond);
+    pthread_mutex_unlock(&rt_mutex);
+    if(running)
+        pthread_join(rt_thread, NULL);
+    return 0;
+}
+
+int rp_spectr_rt_get_frame(double *cha_out, double *chb_out, int timeout_ms)
+{
+    struct timespec ts;
+    int i;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec  += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if(ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&rt_mutex);
+    while(rt_running && (rt_written < rt_next + SPECTR_FPGA_SIG_LEN)) {
+        if(pthread_cond_timedwait(&rt_cond, &rt_mutex, &ts) == ETIMEDOUT)
+            break;
+    }
+    if(!rt_running) {
+        pthread_mutex_unlock(&rt_mutex);
+        return -1;
+    }
+    if(rt_written < rt_next + SPECTR_FPGA_SIG_LEN) {
+        pthread_mutex_unlock(&rt_mutex);
+        return 1;
+    }
+
+    /* Behind by more than the ring, go on with the newest frame */
+    if(rt_written - rt_next > RP_SPECTR_RT_RING_LEN) {
+        uint64_t next = rt_written - SPECTR_FPGA_SIG_LEN;
+        if(next > rt_covered)
+            rt_lost += next - rt_covered;
+        rt_next = next;
+    }
+
+    for(i = 0; i < SPECTR_FPGA_SIG_LEN; i++) {
+        int idx = (rt_next + i) % RP_SPECTR_RT_RING_LEN;
+        cha_out[i] = rt_ring_cha[idx];
+        chb_out[i] = rt_ring_chb[idx];
+    }
+    rt_covered = rt_next + SPECTR_FPGA_SIG_LEN;
+    rt_next += rt_hop;
+    pthread_mutex_unlock(&rt_mutex);
+    return 0;
+}
+
+uint64_t rp_spectr_rt_gaps(void)
+{
+    uint64_t lost;
+
+    pthread_mutex_lock(&rt_mutex);
+    lost = rt_lost;
+    pthread_mutex_unlock(&rt_mutex);
+    return lost;
+}
@@ -0,0 +1,60 @@
+/**
+ * $Id$
+ *
+ * @brief Red Pitaya Spectrum Analyzer real-time capture.
+ *
+ * In the real-time mode the FPGA writes the ADC buffer without a trigger.
+ * A reader thread copies every new sample to a ring and the worker takes
+ * frames of SPECTR_FPGA_SIG_LEN samples from it that overlap by 50 or 75%,
+ * so the two run on both cores and no part of the signal is left out.
+ * Coverage is complete (100% probability of intercept for a signal of at
+ * least one frame) as long as the worker analyzes a frame in less than the
+ * hop time, hop / sampling frequency: 33 ms for the 61 kHz range at 75%
+ * overlap, 2 ms for the 976 kHz range. Faster ranges drop frames, every
+ * lost sample is counted in rp_spectr_rt_gaps().
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#ifndef __RT_H
+#define __RT_H
+
+#include <stdint.h>
+
+#include "fpga.h"
+#include "rp_app_pool.h"
+
+typedef enum rp_spectr_rt_mode_e {
+    rp_spectr_rt_off = 0,     /* Triggered captures, one per frame */
+    rp_spectr_rt_overlap_50,  /* Real-time, frames overlap by half */
+    rp_spectr_rt_overlap_75,  /* Real-time, frames overlap by three quarters */
+    rp_spectr_rt_nonexisting  /* must be last */
+} rp_spectr_rt_mode_t;
+
+/* Ring of the reader thread, a frame may lag this far behind the ADC */
+#define RP_SPECTR_RT_RING_LEN (8*SPECTR_FPGA_SIG_LEN)
+
+/* Pool bytes of rp_spectr_rt_init() */
+#define RP_SPECTR_RT_POOL_BYTES \
+    (2 * RP_APP_POOL_BYTES(RP_SPECTR_RT_RING_LEN * sizeof(int16_t)))
+
+/* Takes the ring from pool once, it is kept over every start and stop */
+int rp_spectr_rt_init(rp_app_pool_t *pool);
+/* Arms the FPGA for continuous writing and starts the reader thread. The
+ * FPGA parameters (decimation) are set before, freq_smpl is the sampling
+ * frequency after decimation [Hz]. Restarts a running capture. */
+int rp_spectr_rt_start(rp_spectr_rt_mode_t mode, float freq_smpl);
+/* Stops the reader thread, the FPGA is left armed */
+int rp_spectr_rt_stop(void);
+/* Waits up to timeout_ms for the next frame and copies it, SPECTR_FPGA_SIG_LEN
+ * samples of each channel. Returns 0 with a frame, 1 on timeout, -1 if not
+ * started. */
+int rp_spectr_rt_get_frame(double *cha_out, double *chb_out, int timeout_ms);
+/* Samples not analyzed since the start, lost to the FPGA buffer or the ring */
+uint64_t rp_spectr_rt_gaps(void);
+
+#endif /* __RT_H */
@@ -18,6 +18,8 @@
 #include <math.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 
 #include "jpeglib.h"
 
@@ -63,7 +65,13 @@ int  rp_wf_cont_map_idx = -1;
 JSAMPLE *rp_wf_cha_wat = NULL;
 JSAMPLE *rp_wf_chb_wat = NULL;
 
-int rp_spectr_wf_init(void)
+/* Newest line of both channels as colormap indices, size 2 * g_spectr_wf_col,
+ * and the stream file it is written to */
+uint8_t *rp_wf_line = NULL;
+int      rp_wf_line_cnt = 0;
+int      rp_wf_line_fd = -1;
+
+int rp_spectr_wf_init(rp_app_pool_t *pool)
 {
     int i;
 
@@ -76,7 +84,7 @@ int rp_spectr_wf_init(void)
 
     g_qq = (double)RP_SPECTR_WF_MAP_MAX - g_mm * RP_SPECTR_WF_SPEC_MAX;
 
-    rp_wf_avg_filter = (float *)malloc(RP_SPECTR_WF_AVG_FILT * sizeof(float));
+    rp_wf_avg_filter = (float *)rp_app_pool_alloc(pool, RP_SPECTR_WF_AVG_FILT * sizeof(float));
     if(!rp_wf_avg_filter) {
         fprintf(stderr, "rp_spectr_wf_init() can not allocate memory\n");
         return -1;
@@ -87,8 +95,8 @@ int rp_spectr_wf_init(void)
 
     g_conv_len = c_dsp_sig_len + RP_SPECTR_WF_AVG_FILT - 1;
 
-    rp_wf_cha_cnv = (double *)malloc(g_conv_len * sizeof(double));
-    rp_wf_chb_cnv = (double *)malloc(g_conv_len * sizeof(double));
+    rp_wf_cha_cnv = (double *)rp_app_pool_alloc(pool, g_conv_len * sizeof(double));
+    rp_wf_chb_cnv = (double *)rp_app_pool_alloc(pool, g_conv_len * sizeof(double));
 
     if(!rp_wf_cha_cnv || !rp_wf_chb_cnv) {
         fprintf(stderr, "rp_spectr_wf_init() can not allocate memory\n");
@@ -101,18 +109,18 @@ int rp_spectr_wf_init(void)
 
     g_spectr_wf_col = round((g_conv_len-c_skip_after_conv) / g_dec_wat_step);
 
-    rp_wf_cha_dec_map = (int *)malloc(g_spectr_wf_col * sizeof(int));
-    rp_wf_chb_dec_map = (int *)malloc(g_spectr_wf_col * sizeof(int));
+    rp_wf_cha_dec_map = (int *)rp_app_pool_alloc(pool, g_spectr_wf_col * sizeof(int));
+    rp_wf_chb_dec_map = (int *)rp_app_pool_alloc(pool, g_spectr_wf_col * sizeof(int));
     if(!rp_wf_cha_dec_map || !rp_wf_chb_dec_map) {
         fprintf(stderr, "rp_spectr_wf_init() can not allocate memory\n");
         rp_spectr_wf_clean();
         return -1;
     }
 
-    rp_wf_cha_cont_map = (int *)malloc(RP_SPECTR_WF_LIN * g_spectr_wf_col
-                                       * sizeof(int));
-    rp_wf_chb_cont_map = (int *)malloc(RP_SPECTR_WF_LIN * g_spectr_wf_col
-                                       * sizeof(int));
+    rp_wf_cha_cont_map = (int *)rp_app_pool_alloc(pool, RP_SPECTR_WF_LIN * g_spectr_wf_col
+                                                  * sizeof(int));
+    rp_wf_chb_cont_map = (int *)rp_app_pool_alloc(pool, RP_SPECTR_WF_LIN * g_spectr_wf_col
+                                                  * sizeof(int));
     if(!rp_wf_cha_cont_map || !rp_wf_chb_cont_map) {
         fprintf(stderr, "rp_spectr_wf_init() can not allocate memory\n");
         rp_spectr_wf_clean();
@@ -123,55 +131,39 @@ int rp_spectr_wf_init(void)
     /* Initialize the rp_wf_cha_wat & chb_wat structures which will be used
      * to build a picture - x3 is for R,G,B
      */
-    rp_wf_cha_wat = (JSAMPLE *)malloc(RP_SPECTR_WF_LIN * g_spectr_wf_col *
-                                      3 * sizeof(JSAMPLE));
-    rp_wf_chb_wat = (JSAMPLE *)malloc(RP_SPECTR_WF_LIN * g_spectr_wf_col *
-                                      3 * sizeof(JSAMPLE));
+    rp_wf_cha_wat = (JSAMPLE *)rp_app_pool_alloc(pool, RP_SPECTR_WF_LIN * g_spectr_wf_col *
+                                                 3 * sizeof(JSAMPLE));
+    rp_wf_chb_wat = (JSAMPLE *)rp_app_pool_alloc(pool, RP_SPECTR_WF_LIN * g_spectr_wf_col *
+                                                 3 * sizeof(JSAMPLE));
     if(!rp_wf_cha_wat || !rp_wf_chb_wat) {
         fprintf(stderr, "rp_spectr_wf_init() can not allocate memory\n");
         return -1;
     }
 
+    rp_wf_line = (uint8_t *)rp_app_pool_alloc(pool, 2 * g_spectr_wf_col * sizeof(uint8_t));
+    if(!rp_wf_line) {
+        fprintf(stderr, "rp_spectr_wf_init() can not allocate memory\n");
+        return -1;
+    }
+
     return 0;
 }
 
 int rp_spectr_wf_clean(void)
 {
-    if(rp_wf_avg_filter) {
-        free(rp_wf_avg_filter);
-        rp_wf_avg_filter = NULL;
-    }
-    if(rp_wf_cha_cnv) {
-        free(rp_wf_cha_cnv);
-        rp_wf_cha_cnv = NULL;
-    }
-    if(rp_wf_chb_cnv) {
-        free(rp_wf_chb_cnv);
-        rp_wf_chb_cnv = NULL;
-    }
-    if(rp_wf_cha_dec_map) {
-        free(rp_wf_cha_dec_map);
-        rp_wf_cha_dec_map = NULL;
-    }
-    if(rp_wf_chb_dec_map) {
-        free(rp_wf_chb_dec_map);
-        rp_wf_chb_dec_map = NULL;
-    }
-    if(rp_wf_cha_cont_map) {
-        free(rp_wf_cha_cont_map);
-        rp_wf_cha_cont_map = NULL;
-    }
-    if(rp_wf_chb_cont_map) {
-        free(rp_wf_chb_cont_map);
-        rp_wf_chb_cont_map = NULL;
-    }
-    if(rp_wf_cha_wat) {
-        free(rp_wf_cha_wat);
-        rp_wf_cha_wat = NULL;
-    }
-    if(rp_wf_chb_wat) {
-        free(rp_wf_chb_wat);
-        rp_wf_chb_wat = NULL;
+    rp_wf_avg_filter = NULL;
+    rp_wf_cha_cnv = NULL;
+    rp_wf_chb_cnv = NULL;
+    rp_wf_cha_dec_map = NULL;
+    rp_wf_chb_dec_map = NULL;
+    rp_wf_cha_cont_map = NULL;
+    rp_wf_chb_cont_map = NULL;
+    rp_wf_cha_wat = NULL;
+    rp_wf_chb_wat = NULL;
+    rp_wf_line = NULL;
+    if(rp_wf_line_fd >= 0) {
+        close(rp_wf_line_fd);
+        rp_wf_line_fd = -1;
     }
     return 0;
 }
@@ -188,6 +180,7 @@ int rp_spectr_wf_clean_map(void)
     memset(rp_wf_chb_cont_map, 0, 
            RP_SPECTR_WF_LIN * g_spectr_wf_col * sizeof(int));
     rp_wf_cont_map_idx = RP_SPECTR_WF_LIN - 1; /* start with the last line */
+    rp_wf_line_cnt = 0;
 
     return 0;
 }
@@ -258,6 +251,62 @@ int rp_spectr_wf_save_jpeg(const char *wf_cha_file, const char *wf_chb_file)
     return 0;
 }
 
+int rp_spectr_wf_save_line(const char *wf_file)
+{
+    const int c_line_size = 2 * g_spectr_wf_col;
+    int newest, i;
+
+    if(!rp_wf_cha_cont_map || !rp_wf_chb_cont_map || !rp_wf_line) {
+        fprintf(stderr, "rp_spectr_wf_save_line(): not initialized\n");
+        return -1;
+    }
+    if(rp_wf_line_cnt == 0)
+        return 0;
+
+    if(rp_wf_line_fd < 0) {
+        rp_wf_line_fd = open(wf_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(rp_wf_line_fd < 0) {
+            fprintf(stderr, "rp_spectr_wf_save_line() can not open file "
+                    "(%s): %s\n", wf_file, strerror(errno));
+            return -1;
+        }
+        /* All slots exist from the start, the client derives the number
+         * of columns from the file size */
+        if(ftruncate(rp_wf_line_fd, RP_SPECTR_WF_LIN * c_line_size) < 0) {
+            fprintf(stderr, "rp_spectr_wf_save_line() can not resize file "
+                    "(%s): %s\n", wf_file, strerror(errno));
+            close(rp_wf_line_fd);
+            rp_wf_line_fd = -1;
+            return -1;
+        }
+    }
+
+    /* rp_spectr_wf_add_to_map() has already moved to the next line */
+    newest = (rp_wf_cont_map_idx + 1) % RP_SPECTR_WF_LIN * g_spectr_wf_col;
+    for(i = 0; i < g_spectr_wf_col; i++) {
+        int cha_v = rp_wf_cha_cont_map[newest + i];
+        int chb_v = rp_wf_chb_cont_map[newest + i];
+        rp_wf_line[i] = cha_v < RP_SPECTR_WF_MAP_MAX ? cha_v : RP_SPECTR_WF_MAP_MAX - 1;
+        rp_wf_line[g_spectr_wf_col + i] =
+            chb_v < RP_SPECTR_WF_MAP_MAX ? chb_v : RP_SPECTR_WF_MAP_MAX - 1;
+    }
+
+    if(pwrite(rp_wf_line_fd, rp_wf_line, c_line_size,
+              (off_t)((rp_wf_line_cnt - 1) % RP_SPECTR_WF_LIN) * c_line_size)
+       != c_line_size) {
+        fprintf(stderr, "rp_spectr_wf_save_line() can not write file "
+                "(%s): %s\n", wf_file, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int rp_spectr_wf_get_line_cnt(void)
+{
+    return rp_wf_line_cnt;
+}
+
 /* Signal lengths:
  *  - input: c_dsp_sig_len
  *  - avg. filter: RP_SPECTR_WF_AVG_FILT
@@ -354,6 +403,8 @@ int rp_spectr_wf_add_to_map(int *cha_in, int *chb_in)
      */
     if(--rp_wf_cont_map_idx < 0)
         rp_wf_cont_map_idx = RP_SPECTR_WF_LIN - 1;
+    if(++rp_wf_line_cnt > RP_SPECTR_WF_LINE_WRAP)
+        rp_wf_line_cnt = 1;
 
     return 0;
 }
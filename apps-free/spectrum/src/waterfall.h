@@ -26,9 +26,21 @@
 #define RP_SPECTR_WF_MAP_NOI  20
 
 #include "jpeglib.h"
+#include "fpga.h"
+#include "rp_app_pool.h"
+
+/* Pool bytes of rp_spectr_wf_init(), the FFT has SPECTR_FPGA_SIG_LEN/2 bins */
+#define RP_SPECTR_WF_POOL_BYTES \
+    (RP_APP_POOL_BYTES(RP_SPECTR_WF_AVG_FILT * sizeof(float)) + \
+     2 * RP_APP_POOL_BYTES((SPECTR_FPGA_SIG_LEN/2 + RP_SPECTR_WF_AVG_FILT - 1) * sizeof(double)) + \
+     2 * RP_APP_POOL_BYTES(RP_SPECTR_WF_COL * sizeof(int)) + \
+     2 * RP_APP_POOL_BYTES(RP_SPECTR_WF_LIN * RP_SPECTR_WF_COL * sizeof(int)) + \
+     2 * RP_APP_POOL_BYTES(RP_SPECTR_WF_LIN * RP_SPECTR_WF_COL * 3 * sizeof(JSAMPLE)) + \
+     RP_APP_POOL_BYTES(2 * RP_SPECTR_WF_COL * sizeof(uint8_t)))
 
 /*** Main Warerfall module calls ****/
-int rp_spectr_wf_init(void);
+/* The buffers are taken from pool, rp_spectr_wf_clean() only forgets them */
+int rp_spectr_wf_init(rp_app_pool_t *pool);
 int rp_spectr_wf_clean(void);
 
 /* Reset the main map structure */
@@ -43,6 +55,18 @@ int rp_spectr_wf_calc(double *cha_in, double *chb_in);
 /* Build the waterfall diagram out of the collected acquisitions and stores it */
 int rp_spectr_wf_save_jpeg(const char *wf_file1, const char *wf_file2);
 
+/* Line stream for the client: wf_file holds RP_SPECTR_WF_LIN slots of
+ * 2 * columns bytes, line n (from 1) is stored to slot (n - 1) % RP_SPECTR_WF_LIN
+ * as colormap indices of channel A followed by channel B. Only the newest
+ * line is written, the client reads the slots of the lines it has not
+ * drawn yet and applies rp_wf_colmap itself. */
+int rp_spectr_wf_save_line(const char *wf_file);
+
+/* Lines added since the last rp_spectr_wf_clean_map(), wraps to 1 after
+ * RP_SPECTR_WF_LINE_WRAP (a multiple of RP_SPECTR_WF_LIN) */
+#define RP_SPECTR_WF_LINE_WRAP 1000000
+int rp_spectr_wf_get_line_cnt(void);
+
 /*** Internal steps used in the processing ***/
 /* Convolution:
  * Input length = c_dsp_sig_len 
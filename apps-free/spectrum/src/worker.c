@@ -27,6 +27,9 @@
 #include "fpga.h"
 #include "dsp.h"
 #include "waterfall.h"
+#include "peaks.h"
+#include "rt.h"
+#include "rp_app_pool.h"
 
 /* JPG outputs: c_jpg_file_path+[1|2]+_+jpg_cnt(3 digits)+c_jpg_file_suf */
 const char c_jpg_dir_path[]="/tmp/ram";
@@ -34,7 +37,11 @@ const char c_jpg_file_name[]="wat";
 const char c_jpg_file_path[]="/tmp/ram/wat";
 const char c_jpg_file_suf[]=".jpg";
 const int  c_jpg_max_file  = 63;
+/* Waterfall line stream, see rp_spectr_wf_save_line() */
+const char c_wf_line_file[]="/tmp/ram/wat.bin";
 const int  c_save_jpg_cnt  = 10; /* Repetition how often the JPG is stored */
+/* Real-time frames are all analyzed, the result is published at this period [us] */
+const int  c_rt_publish_us = 40000;
 char      *jpg_fname_cha = NULL;
 char      *jpg_fname_chb = NULL;
 
@@ -57,9 +64,22 @@ double *rp_chb_fft = NULL;
 /* Output 3 x SPECTR_OUT_SIG signals - used internally for calculation */
 float               **rp_tmp_signals = NULL;
 
+/* Signal and DSP buffers of the worker, the averaging comes last as it
+ * follows the parameters */
+#define RP_SPECTR_POOL_BYTES \
+    (2 * RP_APP_POOL_SIGNALS_BYTES(SPECTR_OUT_SIG_NUM, SPECTR_OUT_SIG_LEN) + \
+     2 * RP_APP_POOL_BYTES(SPECTR_FPGA_SIG_LEN * sizeof(double)) + \
+     2 * RP_APP_POOL_BYTES(SPECTR_FPGA_SIG_LEN/2 * sizeof(double)) + \
+     RP_SPECTR_WF_POOL_BYTES + RP_SPECTR_RT_POOL_BYTES + RP_SPECTR_AVG_POOL_BYTES)
+rp_app_pool_t         rp_spectr_pool;
+
 /* Parameters & signals communicating with 'external world' */
 pthread_mutex_t       rp_spectr_ctrl_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled with rp_spectr_ctrl_mutex held on a new state or client count */
+pthread_cond_t        rp_spectr_ctrl_cond = PTHREAD_COND_INITIALIZER;
 rp_spectr_worker_state_t rp_spectr_ctrl;
+/* Connected browsers, one is assumed until the web server tells */
+int                   rp_spectr_clients = 1;
 rp_app_params_t       rp_spectr_params[PARAMS_NUM];
 int                   rp_spectr_params_dirty;
 int                   rp_spectr_params_fpga_update;
@@ -79,22 +99,20 @@ int rp_spectr_worker_init(void)
 
     rp_spectr_clean_tmpdir(c_jpg_dir_path);
 
-    rp_cleanup_signals(&rp_spectr_signals);
-    if(rp_create_signals(&rp_spectr_signals) < 0)
-        return -1;
-
-    rp_cleanup_signals(&rp_tmp_signals);
-
-    if(rp_create_signals(&rp_tmp_signals) < 0) {
-        rp_cleanup_signals(&rp_spectr_signals);
+    rp_app_pool_free(&rp_spectr_pool);
+    if(rp_app_pool_init(&rp_spectr_pool, RP_SPECTR_POOL_BYTES, RP_APP_POOL_HUGE) < 0)
         return -1;
-    }
 
-    rp_cha_in = (double *)malloc(sizeof(double) * SPECTR_FPGA_SIG_LEN);
-    rp_chb_in = (double *)malloc(sizeof(double) * SPECTR_FPGA_SIG_LEN);
-    rp_cha_fft = (double *)malloc(sizeof(double) * c_dsp_sig_len);
-    rp_chb_fft = (double *)malloc(sizeof(double) * c_dsp_sig_len);
-    if(!rp_cha_in || !rp_chb_in || !rp_cha_fft || !rp_chb_fft) {
+    rp_spectr_signals = rp_app_pool_signals(&rp_spectr_pool, SPECTR_OUT_SIG_NUM,
+                                            SPECTR_OUT_SIG_LEN);
+    rp_tmp_signals = rp_app_pool_signals(&rp_spectr_pool, SPECTR_OUT_SIG_NUM,
+                                         SPECTR_OUT_SIG_LEN);
+    rp_cha_in = (double *)rp_app_pool_alloc(&rp_spectr_pool, sizeof(double) * SPECTR_FPGA_SIG_LEN);
+    rp_chb_in = (double *)rp_app_pool_alloc(&rp_spectr_pool, sizeof(double) * SPECTR_FPGA_SIG_LEN);
+    rp_cha_fft = (double *)rp_app_pool_alloc(&rp_spectr_pool, sizeof(double) * c_dsp_sig_len);
+    rp_chb_fft = (double *)rp_app_pool_alloc(&rp_spectr_pool, sizeof(double) * c_dsp_sig_len);
+    if(!rp_spectr_signals || !rp_tmp_signals ||
+       !rp_cha_in || !rp_chb_in || !rp_cha_fft || !rp_chb_fft) {
         rp_spectr_worker_clean();
         return -1;
     }
@@ -123,17 +141,24 @@ int rp_spectr_worker_init(void)
         return -1;
     }
 
-    if(rp_spectr_wf_init() < 0) {
+    if(rp_spectr_wf_init(&rp_spectr_pool) < 0) {
+        rp_spectr_worker_clean();
+        return -1;
+    }
+
+    if(rp_spectr_rt_init(&rp_spectr_pool) < 0) {
         rp_spectr_worker_clean();
         return -1;
     }
 
+    /* Last, see rp_spectr_avg_init() */
+    rp_spectr_avg_init(&rp_spectr_pool);
+
     spectr_fpga_get_sig_ptr(&rp_fpga_cha_signal, &rp_fpga_chb_signal);
 
     rp_spectr_thread_handler = (pthread_t *)malloc(sizeof(pthread_t));
     if(rp_spectr_thread_handler == NULL) {
-        rp_cleanup_signals(&rp_spectr_signals);
-        rp_cleanup_signals(&rp_tmp_signals);
+        rp_spectr_worker_clean();
         return -1;
     }
 
@@ -141,10 +166,7 @@ int rp_spectr_worker_init(void)
         pthread_create(rp_spectr_thread_handler, NULL, 
                        rp_spectr_worker_thread, NULL);
     if(ret_val != 0) {
-        spectr_fpga_exit();
-
-        rp_cleanup_signals(&rp_spectr_signals);
-        rp_cleanup_signals(&rp_tmp_signals);
+        rp_spectr_worker_clean();
         fprintf(stderr, "pthread_create() failed: %s\n", 
                 strerror(errno));
         return -1;
@@ -156,10 +178,10 @@ int rp_spectr_worker_init(void)
 int rp_spectr_worker_clean(void)
 {
     spectr_fpga_exit();
-    rp_cleanup_signals(&rp_spectr_signals);
-    rp_cleanup_signals(&rp_tmp_signals);
     rp_spectr_hann_clean();
     rp_spectr_fft_clean();
+    rp_spectr_rt_stop();
+    rp_spectr_avg_clean();
     rp_spectr_wf_clean();
 
     if(jpg_fname_cha) {
@@ -170,22 +192,14 @@ int rp_spectr_worker_clean(void)
         free(jpg_fname_chb);
         jpg_fname_chb = NULL;
     }
-    if(rp_cha_in) {
-        free(rp_cha_in);
-        rp_cha_in = NULL;
-    }
-    if(rp_chb_in) {
-        free(rp_chb_in);
-        rp_chb_in = NULL;
-    }
-    if(rp_cha_fft) {
-        free(rp_cha_fft);
-        rp_cha_fft = NULL;
-    }
-    if(rp_chb_fft) {
-        free(rp_chb_fft);
-        rp_chb_fft = NULL;
-    }
+    pthread_mutex_lock(&rp_spectr_sig_mutex);
+    rp_spectr_signals = NULL;
+    rp_spectr_signals_dirty = 0;
+    pthread_mutex_unlock(&rp_spectr_sig_mutex);
+    rp_tmp_signals = NULL;
+    rp_cha_in = rp_chb_in = NULL;
+    rp_cha_fft = rp_chb_fft = NULL;
+    rp_app_pool_free(&rp_spectr_pool);
 
     return 0;
 }
@@ -215,10 +229,19 @@ int rp_spectr_worker_change_state(rp_spectr_worker_state_t new_state)
         return -1;
     pthread_mutex_lock(&rp_spectr_ctrl_mutex);
     rp_spectr_ctrl = new_state;
+    pthread_cond_broadcast(&rp_spectr_ctrl_cond);
     pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
     return 0;
 }
 
+void rp_spectr_worker_set_clients(int clients)
+{
+    pthread_mutex_lock(&rp_spectr_ctrl_mutex);
+    rp_spectr_clients = clients;
+    pthread_cond_broadcast(&rp_spectr_ctrl_cond);
+    pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+}
+
 int rp_spectr_worker_update_params(rp_app_params_t *params, int fpga_update)
 {
     pthread_mutex_lock(&rp_spectr_ctrl_mutex);
@@ -306,6 +329,8 @@ int rp_spectr_get_signals(float ***signals, rp_spectr_worker_res_t *result)
     result->peak_pw_freq_cha = rp_spectr_result.peak_pw_freq_cha;
     result->peak_pw_chb      = rp_spectr_result.peak_pw_chb;
     result->peak_pw_freq_chb = rp_spectr_result.peak_pw_freq_chb;
+    result->wf_line          = rp_spectr_result.wf_line;
+    result->rt_gaps          = rp_spectr_result.rt_gaps;
 
     pthread_mutex_unlock(&rp_spectr_sig_mutex);
     return 0;
@@ -325,6 +350,8 @@ int rp_spectr_set_signals(float **source, rp_spectr_worker_res_t result)
     rp_spectr_result.peak_pw_freq_cha = result.peak_pw_freq_cha;
     rp_spectr_result.peak_pw_chb      = result.peak_pw_chb;
     rp_spectr_result.peak_pw_freq_chb = result.peak_pw_freq_chb;
+    rp_spectr_result.wf_line          = result.wf_line;
+    rp_spectr_result.rt_gaps          = result.rt_gaps;
 
     pthread_mutex_unlock(&rp_spectr_sig_mutex);
 
@@ -337,10 +364,13 @@ void *rp_spectr_worker_thread(void *args)
     rp_app_params_t          curr_params[PARAMS_NUM];
     int                      fpga_update = 1;
     int                      params_dirty = 1;
-    int                      loop_cnt = 0; /* each N save jpeg */
+    int                      avg_update = 0;
     int                      jpg_fn_cnt = 0;
-    /* depends on freq_range - do not save too much or too less */
-    int                      jpg_write_div = 10;
+    /* JPEG snapshots are only written on request, when wf_snapshot changes */
+    int                      jpg_snapshot = 0;
+    int                      jpg_snapshot_done = 0;
+    rp_spectr_rt_mode_t      rt_mode = rp_spectr_rt_off;
+    struct timespec          rt_published = { 0, 0 };
     rp_spectr_worker_res_t   tmp_result;
 
     pthread_mutex_lock(&rp_spectr_ctrl_mutex);
@@ -357,17 +387,50 @@ void *rp_spectr_worker_thread(void *args)
         if(rp_spectr_params_dirty) {
             memcpy(&curr_params, &rp_spectr_params, 
                    sizeof(rp_app_params_t)*PARAMS_NUM);
-            fpga_update = rp_spectr_params_fpga_update;
+            fpga_update |= rp_spectr_params_fpga_update;
             rp_spectr_params_dirty = 0;
+            avg_update = 1;
+            jpg_snapshot = (int)curr_params[WF_SNAPSHOT_PARAM].value;
         }
         pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
 
+        /* New settings restart the accumulated frames */
+        if(avg_update) {
+            if(rp_spectr_window_set((int)curr_params[WINDOW_PARAM].value) < 0)
+                fprintf(stderr, "rp_spectr_window_set() failed, window unchanged\n");
+            if(rp_spectr_zoom_set(curr_params[ZOOM_CENTER_PARAM].value,
+                                  (int)curr_params[ZOOM_PARAM].value) < 0)
+                fprintf(stderr, "rp_spectr_zoom_set() failed, zoom unchanged\n");
+            if(rp_spectr_avg_set((int)curr_params[AVG_MODE_PARAM].value,
+                                 (int)curr_params[AVG_COUNT_PARAM].value) < 0)
+                fprintf(stderr, "rp_spectr_avg_set() failed, averaging off\n");
+            avg_update = 0;
+        }
+
         /* request to stop worker thread, we will shut down */
         if(state == rp_spectr_quit_state) {
+            rp_spectr_rt_stop();
             return 0;
         }
 
+        /* Nobody looks, the acquisition and the reader thread stop until a
+         * browser connects, then the FPGA is set up again */
+        pthread_mutex_lock(&rp_spectr_ctrl_mutex);
+        if(rp_spectr_clients <= 0 && rp_spectr_ctrl == state) {
+            pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+            rp_spectr_rt_stop();
+            pthread_mutex_lock(&rp_spectr_ctrl_mutex);
+            while(rp_spectr_clients <= 0 && rp_spectr_ctrl == state)
+                pthread_cond_wait(&rp_spectr_ctrl_cond, &rp_spectr_ctrl_mutex);
+            pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+            fpga_update = 1;
+            continue;
+        }
+        pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+
         if(fpga_update) {
+            /* The reader thread must not see the reset */
+            rp_spectr_rt_stop();
             spectr_fpga_reset();
             if(spectr_fpga_update_params(0, 0, 0, 0, 0, 
                                (int)curr_params[FREQ_RANGE_PARAM].value,
@@ -375,22 +438,16 @@ void *rp_spectr_worker_thread(void *args)
                 rp_spectr_worker_change_state(rp_spectr_auto_state);
             }
 
+            rt_mode = (rp_spectr_rt_mode_t)curr_params[RT_MODE_PARAM].value;
+            if(rp_spectr_rt_start(rt_mode, c_spectr_fpga_smpl_freq /
+                   spectr_fpga_cnv_freq_range_to_dec(
+                       (int)curr_params[FREQ_RANGE_PARAM].value)) < 0) {
+                fprintf(stderr, "rp_spectr_rt_start() failed, triggered frames\n");
+                rt_mode = rp_spectr_rt_off;
+            }
+
             fpga_update = 0;
             rp_spectr_wf_clean_map();
-            switch((int)curr_params[FREQ_RANGE_PARAM].value) {
-            case 0:
-            case 1:
-                jpg_write_div = 10;
-                break;
-            case 2:
-            case 3:
-                jpg_write_div = 5;
-                break;
-            case 4:
-            case 5:
-                jpg_write_div = 0;
-                break;
-            }
         }
 
         if(state == rp_spectr_idle_state) {
@@ -398,75 +455,92 @@ void *rp_spectr_worker_thread(void *args)
             continue;
         }
 
-        /* Start the writting machine */
-        spectr_fpga_arm_trigger();
+        if(rt_mode != rp_spectr_rt_off) {
+            /* Frames come from the reader thread, back to the state check
+             * when none is ready */
+            if(rp_spectr_rt_get_frame(rp_cha_in, rp_chb_in, 100) != 0)
+                continue;
+        } else {
+            /* Start the writting machine */
+            spectr_fpga_arm_trigger();
         
-        usleep(10);
-
-        spectr_fpga_set_trigger(1);
+            usleep(10);
 
-        /* start working */
-        pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-        old_state = state = rp_spectr_ctrl;
-        pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
-        if((state == rp_spectr_idle_state) || (state == rp_spectr_abort_state)) {
-            continue;
-        } else if(state == rp_spectr_quit_state) {
-            break;
-        }
+            spectr_fpga_set_trigger(1);
 
-        /* polling until data is ready */
-        while(1) {
+            /* start working */
             pthread_mutex_lock(&rp_spectr_ctrl_mutex);
-            state = rp_spectr_ctrl;
-            params_dirty = rp_spectr_params_dirty;
+            old_state = state = rp_spectr_ctrl;
             pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
-            /* change in state, abort polling */
-            if((state != old_state) || params_dirty) {
+            if((state == rp_spectr_idle_state) || (state == rp_spectr_abort_state)) {
+                continue;
+            } else if(state == rp_spectr_quit_state) {
                 break;
             }
+
+            /* polling until data is ready */
+            while(1) {
+                pthread_mutex_lock(&rp_spectr_ctrl_mutex);
+                state = rp_spectr_ctrl;
+                params_dirty = rp_spectr_params_dirty;
+                pthread_mutex_unlock(&rp_spectr_ctrl_mutex);
+                /* change in state, abort polling */
+                if((state != old_state) || params_dirty) {
+                    break;
+                }
                 
-            if(spectr_fpga_triggered()) {
-                break;
+                if(spectr_fpga_triggered()) {
+                    break;
+                }
             }
-        }
 
-        if((state != old_state) || params_dirty) {
-            params_dirty = 0;
-            continue;
-        }
+            if((state != old_state) || params_dirty) {
+                params_dirty = 0;
+                continue;
+            }
 
-        /* retrieve data and process it*/
-        spectr_fpga_get_signal(&rp_cha_in, &rp_chb_in);
+            /* retrieve data and process it*/
+            spectr_fpga_get_signal(&rp_cha_in, &rp_chb_in);
+        }
 
         rp_spectr_prepare_freq_vector(&rp_tmp_signals[0], 
                                       c_spectr_fpga_smpl_freq,
                                       curr_params[FREQ_RANGE_PARAM].value);
 
-        rp_spectr_hann_filter(&rp_cha_in[0], &rp_chb_in[0],
-                              &rp_cha_in, &rp_chb_in);
-        
-        rp_spectr_fft(&rp_cha_in[0], &rp_chb_in[0], 
-                      (double **)&rp_cha_fft, (double **)&rp_chb_fft);
-        
-        rp_spectr_decimate(&rp_cha_fft[0], &rp_chb_fft[0], 
-                           (float **)&rp_tmp_signals[1], 
-                           (float **)&rp_tmp_signals[2],
-                           c_dsp_sig_len, SPECTR_OUT_SIG_LEN);
-        
-        rp_spectr_cnv_to_dBm(&rp_tmp_signals[1][0], &rp_tmp_signals[2][0], 
-                             (float **)&rp_tmp_signals[1], 
-                             (float **)&rp_tmp_signals[2], 
-                             &tmp_result.peak_pw_cha, 
-                             &tmp_result.peak_pw_freq_cha,
-                             &tmp_result.peak_pw_chb, 
-                             &tmp_result.peak_pw_freq_chb,
-                             curr_params[FREQ_RANGE_PARAM].value);
+        rp_spectr_analyze(&rp_cha_in[0], &rp_chb_in[0],
+                          (double **)&rp_cha_fft, (double **)&rp_chb_fft,
+                          (float **)&rp_tmp_signals[1],
+                          (float **)&rp_tmp_signals[2],
+                          &tmp_result.peak_pw_cha,
+                          &tmp_result.peak_pw_freq_cha,
+                          &tmp_result.peak_pw_chb,
+                          &tmp_result.peak_pw_freq_chb,
+                          curr_params[FREQ_RANGE_PARAM].value);
+
+        /* Every real-time frame goes into the averaging, only some are shown */
+        if(rt_mode != rp_spectr_rt_off) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if((now.tv_sec - rt_published.tv_sec) * 1000000 +
+               (now.tv_nsec - rt_published.tv_nsec) / 1000 < c_rt_publish_us)
+                continue;
+            rt_published = now;
+        }
+
+        rp_spectr_peaks_update(rp_tmp_signals[0], rp_tmp_signals[1],
+                               rp_tmp_signals[2], SPECTR_OUT_SIG_LEN,
+                               (int)curr_params[PEAKS_NUM_PARAM].value,
+                               curr_params[PEAKS_THR_PARAM].value);
 
         /* Calculate the map used for Waterfall diagram  */
         rp_spectr_wf_calc(&rp_cha_fft[0], &rp_chb_fft[0]);
 
-        if((jpg_write_div == 0) || (loop_cnt++%jpg_write_div == 0)) {
+        /* Newest waterfall line goes to the stream every frame, the full
+         * image is only encoded for a requested snapshot */
+        rp_spectr_wf_save_line(c_wf_line_file);
+
+        if(jpg_snapshot != jpg_snapshot_done) {
+            jpg_snapshot_done = jpg_snapshot;
             jpg_fn_cnt++;
             if(jpg_fn_cnt > c_jpg_max_file) 
                 jpg_fn_cnt = 0;
@@ -476,19 +550,17 @@ void *rp_spectr_worker_thread(void *args)
             sprintf(jpg_fname_chb, "%s%01d_%03d%s", c_jpg_file_path, 
                     2, jpg_fn_cnt, c_jpg_file_suf);
             rp_spectr_wf_save_jpeg(jpg_fname_cha, jpg_fname_chb);
-
-            /* Report index back to the user */
-        } else if(loop_cnt > 1e6) {
-            loop_cnt = 0;
         }
 
-
         /* Copy the result to the output part - and also the index of
          * last JPEG file index */
         tmp_result.jpg_idx = jpg_fn_cnt;
+        tmp_result.wf_line = rp_spectr_wf_get_line_cnt();
+        tmp_result.rt_gaps = rp_spectr_rt_gaps();
         rp_spectr_set_signals(rp_tmp_signals, tmp_result);
 
-        usleep(10000);
+        if(rt_mode == rp_spectr_rt_off)
+            usleep(10000);
     }
 
     return 0;
@@ -15,6 +15,8 @@
 #ifndef __WORKER_H
 #define __WORKER_H
 
+#include <stdint.h>
+
 #include "main.h"
 
 typedef enum rp_spectr_worker_state_e {
@@ -25,19 +27,24 @@ typedef enum rp_spectr_worker_state_e {
     rp_spectr_nonexisting_state /* must be last */
 } rp_spectr_worker_state_t;
 
-/* Worker results (not signal but calculated peaks and jpeg index */
+/* Worker results (not signal but calculated peaks, jpeg index, the
+ * number of waterfall lines and the samples the real-time mode lost) */
 typedef struct rp_spectr_worker_res_s {
     int   jpg_idx;
+    int   wf_line;
     float peak_pw_cha;
     float peak_pw_freq_cha;
     float peak_pw_chb;
     float peak_pw_freq_chb;
+    uint64_t rt_gaps;
 } rp_spectr_worker_res_t;
 
 int rp_spectr_worker_init(void);
 int rp_spectr_worker_clean(void);
 int rp_spectr_worker_exit(void);
 int rp_spectr_worker_change_state(rp_spectr_worker_state_t new_state);
+/* Without clients the worker stops acquiring */
+void rp_spectr_worker_set_clients(int clients);
 int rp_spectr_worker_update_params(rp_app_params_t *params, int fpga_update);
 
 /* removes 'dirty' flags */
@@ -5,6 +5,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <math.h>
+#include <time.h>
 #include <pthread.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
@@ -17,6 +18,7 @@ volatile float *rx_data;
 int sock_thread = -1;
 uint32_t rate_thread = 5;
 uint32_t size_thread = 6000;
+uint32_t batch_thread = 1;
 
 void *read_handler(void *arg);
 
@@ -31,7 +33,8 @@ int main(int argc, char *argv[])
   volatile int16_t *tx_level[2];
   volatile uint8_t *rst, *gpio;
   struct sockaddr_in addr;
-  uint32_t command, freq, rate, size, i;
+  uint32_t command, freq, rate, size, batch, total, step, i, j;
+  uint32_t *table, *repeat;
   int32_t value, corr;
   int64_t start, stop;
   int yes = 1;
@@ -67,6 +70,7 @@ int main(int argc, char *argv[])
   stop = 60000000;
   size = 6000;
   rate = 5;
+  batch = 1;
   corr = 0;
 
   *rst &= ~3;
@@ -174,6 +178,7 @@ int main(int argc, char *argv[])
           *rst |= 2;
           rate_thread = rate;
           size_thread = size;
+          batch_thread = batch;
           sock_thread = sock_client;
           if(pthread_create(&thread, &attr, read_handler, NULL) < 0)
           {
@@ -195,6 +200,65 @@ int main(int argc, char *argv[])
           *rst |= 4;
           sock_thread = -1;
           break;
+        case 12:
+          /* set number of points per reply */
+          if(value < 1 || value > 1024) continue;
+          batch = value;
+          break;
+        case 13:
+          /* sweep table, value points of frequency and repeats follow */
+          if(value < 1 || value > 32768) continue;
+          table = malloc(value * 8);
+          repeat = malloc(value * 4);
+          if(table == NULL || repeat == NULL)
+          {
+            perror("malloc");
+            return EXIT_FAILURE;
+          }
+          if(recv(sock_client, (char *)table, value * 8, MSG_WAITALL) <= 0)
+          {
+            free(table);
+            free(repeat);
+            continue;
+          }
+          /* every repeat is one more pass of rate samples at the same frequency */
+          total = 0;
+          for(i = 0; i < value; ++i)
+          {
+            if(table[2 * i] > 62500000 || table[2 * i + 1] < 1) break;
+            repeat[i] = table[2 * i + 1];
+            total += repeat[i] < 32768 ? repeat[i] : 32768;
+          }
+          if(i < value || total > 32768)
+          {
+            free(table);
+            free(repeat);
+            continue;
+          }
+          *rst &= ~3;
+          *rst |= 4;
+          *rst &= ~4;
+          *rst |= 2;
+          rate_thread = rate;
+          size_thread = value;
+          batch_thread = batch;
+          sock_thread = sock_client;
+          if(pthread_create(&thread, &attr, read_handler, repeat) < 0)
+          {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+          }
+          pthread_detach(thread);
+          for(i = 0; i < value; ++i)
+          {
+            freq = table[2 * i];
+            freq *= (1.0 + 1.0e-9 * corr);
+            step = (uint32_t)floor(freq / 125.0e6 * (1<<30) + 0.5);
+            for(j = 0; j < repeat[i]; ++j) *rx_freq = step;
+          }
+          free(table);
+          *rst |= 1;
+          break;
       }
     }
 
@@ -210,55 +274,115 @@ int main(int argc, char *argv[])
   return EXIT_SUCCESS;
 }
 
+static int64_t time_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 void *read_handler(void *arg)
 {
-  uint32_t i, j, cntr;
+  uint32_t i, j, k, n, p, r, cntr, total, wait;
   uint32_t rate = rate_thread;
   uint32_t size = size_thread;
-  float buffer[4];
+  uint32_t batch = batch_thread;
+  uint32_t *repeat = arg;
+  float *buffer, *point, *skip;
+  int64_t sent;
+
+  /* the spare point at the end takes the discarded entries */
+  buffer = malloc((batch + 1) * 16);
+  if(buffer == NULL)
+  {
+    free(repeat);
+    return NULL;
+  }
+  skip = buffer + 4 * batch;
+
+  /* a sweep table dwells repeat[p] passes on point p */
+  total = 0;
+  for(p = 0; p < size; ++p)
+  {
+    total += repeat ? repeat[p] : 1;
+  }
+  total *= rate + 5;
 
   i = 0;
+  k = 0;
+  p = 0;
+  r = 0;
   cntr = 0;
-  while(cntr < size * (rate + 5))
+  wait = 50;
+  sent = time_us();
+  while(cntr < total)
   {
     if(sock_thread < 0) break;
 
-    if(*rx_cntr < 4)
+    /* poll faster while the data is flowing, back off up to 1 ms while idle */
+    n = *rx_cntr / 4;
+    if(n == 0)
     {
-      usleep(1000);
+      usleep(wait);
+      if(wait < 1000) wait *= 2;
       continue;
     }
+    wait = 50;
+
+    if(n > total - cntr) n = total - cntr;
 
-    if(i < 5)
+    /* drain everything the FIFO holds in one burst */
+    while(n--)
     {
-      for(j = 0; j < 4; ++j)
+      point = buffer + 4 * k;
+
+      if(i < 5)
       {
-        buffer[j] = *rx_data;
+        for(j = 0; j < 4; ++j)
+        {
+          skip[j] = *rx_data;
+        }
+        if(r == 0) memset(point, 0, 16);
       }
-      memset(buffer, 0, 16);
-    }
-    else
-    {
-      for(j = 0; j < 4; ++j)
+      else
       {
-        buffer[j] += *rx_data;
+        for(j = 0; j < 4; ++j)
+        {
+          point[j] += *rx_data;
+        }
       }
-    }
 
-    ++i;
-    ++cntr;
+      ++i;
+      ++cntr;
 
-    if(i < rate + 5) continue;
+      if(i < rate + 5) continue;
 
-    i = 0;
+      i = 0;
 
-    for(j = 0; j < 4; ++j)
-    {
-      buffer[j] /= rate;
+      if(repeat && ++r < repeat[p]) continue;
+
+      for(j = 0; j < 4; ++j)
+      {
+        point[j] /= repeat ? rate * r : rate;
+      }
+
+      r = 0;
+      ++p;
+      ++k;
+      if(k == batch) break;
     }
 
-    if(send(sock_thread, buffer, 16, MSG_NOSIGNAL) < 0) break;
+    /* one send per batch, partial batches go out after 20 ms to keep the plot moving */
+    if(k == batch || (k > 0 && (cntr == total || time_us() - sent > 20000)))
+    {
+      if(send(sock_thread, buffer, 16 * k, MSG_NOSIGNAL) < 0) break;
+      k = 0;
+      sent = time_us();
+    }
   }
 
+  free(buffer);
+  free(repeat);
+
   return NULL;
 }
@@ -313,6 +313,27 @@ static rp_app_params_t rp_main_params[PARAMS_NUM+1] = {
     { /* pid_NN_kd - PID NN derivative gain   Kd in [ADC] counts. */
         "pid_22_kd",  0, 1, 0, -8192, 8191 },
 
+    /*************************************************/
+    /* Continuous-field mode parameters from here on */
+    /*************************************************/
+
+    { /* cont_mode - Continuous-field mode:
+       *    0 - triggered acquisition (normal oscilloscope operation)
+       *    1 - free-running acquisition with running RMS & peak field */
+        "cont_mode", 0, 1, 0, 0, 1 },
+    { /* cont_rate - Continuous-field mode output (publish) rate in [Hz] */
+        "cont_rate", 10, 0, 0, 1, 100 },
+    { /* cont_tau - Time constant of the running RMS & peak filter in [s] */
+        "cont_tau", 0.1, 0, 0, 0.001, 10 },
+    { /* cont_rms_ch1 - Running RMS field on channel 1 */
+        "cont_rms_ch1", 0, 0, 1, -1e6, 1e6 },
+    { /* cont_peak_ch1 - Running peak field on channel 1 */
+        "cont_peak_ch1", 0, 0, 1, -1e6, 1e6 },
+    { /* cont_rms_ch2 - Running RMS field on channel 2 */
+        "cont_rms_ch2", 0, 0, 1, -1e6, 1e6 },
+    { /* cont_peak_ch2 - Running peak field on channel 2 */
+        "cont_peak_ch2", 0, 0, 1, -1e6, 1e6 },
+
     { /* Must be last! */
         NULL, 0.0, -1, -1, 0.0, 0.0 }     
 };
@@ -671,11 +692,11 @@ int rp_set_params(rp_app_params_t *p, int len)
             continue;
 
         if(rp_main_params[p_idx].value != p[i].value) {
-            if(p_idx < PARAMS_AWG_PARAMS) 
+            if((p_idx < PARAMS_AWG_PARAMS) || (p_idx >= PARAMS_CONT_PARAMS))
                 params_change = 1;
             if ( (p_idx >= PARAMS_AWG_PARAMS) && (p_idx < PARAMS_PID_PARAMS) )
                 awg_params_change = 1;
-            if(p_idx >= PARAMS_PID_PARAMS)
+            if((p_idx >= PARAMS_PID_PARAMS) && (p_idx < PARAMS_CONT_PARAMS))
                 pid_params_change = 1;
             if(rp_main_params[p_idx].fpga_update)
                 fpga_update = 1;
@@ -1153,44 +1174,42 @@ int rp_update_meas_data(rp_osc_meas_res_t ch1_meas, rp_osc_meas_res_t ch2_meas,
     rp_main_params[MEAS_PER_CH2].value = ch2_meas.period;
 
     float amplitude = ch2_meas.amp;
+    int led_level = 7;
 
+    if ( amplitude > 0.1){
+        led_level = 1;
+    }
+    else if ( amplitude > 0.3){
+        led_level = 2;
+    }
+    else if ( amplitude > 0.5){
+        led_level = 3;
+    }
+    else if ( amplitude > 0.7){
+        led_level = 4;
+    }
+    else if ( amplitude > 0.8){
+        led_level = 5;
+    }
+    else if ( amplitude > 0.9){
+        led_level = 6;
+    }
 
-        power_led(1, tesla_fd); // tur on leds
-
-        if ( amplitude > 0.1){
-          power_led(1, tesla_fd); // tur on leds
-
-        }
-        else if ( amplitude > 0.3){
-
-          power_led(2, tesla_fd); // tur on leds
-        }
-        else if ( amplitude > 0.5){
-
-          power_led(3, tesla_fd); // tur on leds
-        }
-        else if ( amplitude > 0.7){
-
-          power_led(4, tesla_fd); // tur on leds
-        }
-        else if ( amplitude > 0.8){
-
-          power_led(5, tesla_fd); // tur on leds
-        }
-        else if ( amplitude > 0.9){
-
-          power_led(6, tesla_fd); // tur on leds
-        }
-        else if ( amplitude > 1){
-
-          power_led(7, tesla_fd); // tur on leds
-        }
-        else{
-           power_led(7, tesla_fd); // tur on leds
-      }
-
+    pthread_mutex_unlock(&rp_main_params_mutex);
 
+    /* LED register is touched outside of the parameters lock and only when
+     * the level changes (see power_led()) */
+    power_led(led_level, tesla_fd); // tur on leds
+    return 0;
+}
 
+int rp_update_cont_data(float rms_ch1, float peak_ch1, float rms_ch2, float peak_ch2)
+{
+    pthread_mutex_lock(&rp_main_params_mutex);
+    rp_main_params[CONT_RMS_CH1].value  = rms_ch1;
+    rp_main_params[CONT_PEAK_CH1].value = peak_ch1;
+    rp_main_params[CONT_RMS_CH2].value  = rms_ch2;
+    rp_main_params[CONT_PEAK_CH2].value = peak_ch2;
     pthread_mutex_unlock(&rp_main_params_mutex);
     return 0;
 }
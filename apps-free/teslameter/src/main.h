@@ -45,7 +45,7 @@ typedef struct rp_osc_meas_res_s {
 
 /* Parameters indexes - these defines should be in the same order as 
  * rp_app_params_t structure defined in main.c */
-#define PARAMS_NUM        85
+#define PARAMS_NUM        92
 #define MIN_GUI_PARAM     0
 #define MAX_GUI_PARAM     1
 #define TRIG_MODE_PARAM   2
@@ -133,6 +133,14 @@ typedef struct rp_osc_meas_res_s {
 #define PID_22_KP         82
 #define PID_22_KI         83
 #define PID_22_KD         84
+/* Continuous-field mode parameters */
+#define CONT_MODE_PARAM   85
+#define CONT_RATE_PARAM   86
+#define CONT_TAU_PARAM    87
+#define CONT_RMS_CH1      88
+#define CONT_PEAK_CH1     89
+#define CONT_RMS_CH2      90
+#define CONT_PEAK_CH2     91
 
 /* Defines from which parameters on are AWG parameters (used in set_param() to
  * trigger update only on needed part - either Oscilloscope, AWG or PID */
@@ -143,6 +151,10 @@ typedef struct rp_osc_meas_res_s {
 #define PARAMS_PID_PARAMS 59
 #define PARAMS_PER_PID     6 // sem pustil ceprav mislim da je +2 = 8
 
+/* Defines from which parameters on are continuous-field mode parameters (they
+ * are handled by the Oscilloscope worker, same as parameters before AWG) */
+#define PARAMS_CONT_PARAMS 85
+
 /* Output signals */
 #define SIGNAL_LENGTH (1024) /* Must be 2^n! */
 #define SIGNALS_NUM   3
@@ -180,6 +192,11 @@ void transform_from_iface_units(rp_app_params_t *p);
  */
 int rp_update_meas_data(rp_osc_meas_res_t ch1_meas, rp_osc_meas_res_t ch2_meas, int tesla_fd);
 
+/* sets the continuous-field mode results (RMS & peak field per channel) to
+ * the read-only output parameters
+ */
+int rp_update_cont_data(float rms_ch1, float peak_ch1, float rms_ch2, float peak_ch2);
+
 /* Waveform generator frequency limiter. */
 float rp_gen_limit_freq(float freq, float gen_type);
 
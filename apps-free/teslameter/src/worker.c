@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
  #include <math.h>
 #include "worker.h"
 #include "fpga.h"
@@ -61,8 +63,15 @@ led_control_t *led_struct;
 
 
 
+/* Last level written to the LED register, the (uncached) register write is
+ * skipped when the level does not change */
+static int led_level = -1;
+
 void power_led(int l, int fd){
+    if(!led_struct || (l == led_level))
+        return;
     led_struct->led_control = pow(2, l);
+    led_level = l;
 }
 
 
@@ -110,6 +119,7 @@ void destruct_hw_monitor(int tesla_fd){
          }
          led_struct = NULL;
      }
+     led_level = -1;
 }
 
 
@@ -331,6 +341,12 @@ void *rp_osc_worker_thread(void *args)
     int long_acq_step = 0;
     int long_acq_init_trig_ptr;
 
+    /* Continuous-field mode */
+    int cont_restart = 1;
+    int cont_rd_ptr = 0;
+    struct timespec cont_next_pub;
+    rp_osc_cont_filt_t cont_ch1, cont_ch2;
+
     rp_osc_meas_res_t ch1_meas, ch2_meas;
     float ch1_max_adc_v = 1, ch2_max_adc_v = 1;
     float max_adc_norm = osc_fpga_calc_adc_max_v(rp_calib_params->fe_ch1_fs_g_hi, 0);
@@ -364,6 +380,7 @@ void *rp_osc_worker_thread(void *args)
             fpga_update = rp_osc_params_fpga_update;
 
             rp_osc_params_dirty = 0;
+            cont_restart = 1;
             dec_factor = 
                 osc_fpga_cnv_time_range_to_dec(curr_params[TIME_RANGE_PARAM].value);
             time_vect_update = 1;
@@ -443,6 +460,82 @@ void *rp_osc_worker_thread(void *args)
 
         if(state == rp_osc_idle_state) {
             usleep(10000);
+            cont_restart = 1;
+            continue;
+        }
+
+        if(curr_params[CONT_MODE_PARAM].value == 1) {
+            /* Continuous-field mode - the FPGA is armed without a trigger 
+             * source so the ADC buffer keeps running, each pass feeds the new
+             * samples behind the write pointer into the running RMS & peak
+             * filters and the results are published at CONT_RATE_PARAM.
+             */
+            float smpl_period = c_osc_fpga_smpl_period * dec_factor;
+            float a1, b1, a2, b2;
+            int wr_ptr_curr, len, skip = 0;
+            struct timespec now;
+
+            if(cont_restart) {
+                osc_fpga_set_trigger(0);
+                osc_fpga_arm_trigger();
+                osc_fpga_get_wr_ptr(&cont_rd_ptr, NULL);
+                memset(&cont_ch1, 0, sizeof(cont_ch1));
+                memset(&cont_ch2, 0, sizeof(cont_ch2));
+                clock_gettime(CLOCK_MONOTONIC, &cont_next_pub);
+                cont_restart = 0;
+            }
+
+            osc_fpga_get_wr_ptr(&wr_ptr_curr, NULL);
+            len = wr_ptr_curr - cont_rd_ptr;
+            if(len < 0)
+                len += OSC_FPGA_SIG_LEN;
+            /* We are too slow for the sampling rate - keep only the newest 
+             * half of the buffer, the part behind it is being overwritten */
+            if(len > OSC_FPGA_SIG_LEN/2) {
+                skip = len - OSC_FPGA_SIG_LEN/2;
+                len = OSC_FPGA_SIG_LEN/2;
+                cont_rd_ptr = (cont_rd_ptr + skip) % OSC_FPGA_SIG_LEN;
+            }
+
+            rp_osc_cont_field_coef(ch1_max_adc_v, rp_calib_params->fe_ch1_dc_offs,
+                                   curr_params[GEN_DC_OFFS_1].value,
+                                   curr_params[SCALE_TESLA_CH1].value,
+                                   curr_params[GAIN_CH1].value, &a1, &b1);
+            rp_osc_cont_field_coef(ch2_max_adc_v, rp_calib_params->fe_ch2_dc_offs,
+                                   curr_params[GEN_DC_OFFS_2].value,
+                                   curr_params[SCALE_TESLA_CH2].value,
+                                   curr_params[GAIN_CH2].value, &a2, &b2);
+            if(len > 0) {
+                rp_osc_cont_filter(&cont_ch1, &rp_fpga_cha_signal[0], cont_rd_ptr,
+                                   len, skip, smpl_period,
+                                   curr_params[CONT_TAU_PARAM].value, a1, b1);
+                rp_osc_cont_filter(&cont_ch2, &rp_fpga_chb_signal[0], cont_rd_ptr,
+                                   len, skip, smpl_period,
+                                   curr_params[CONT_TAU_PARAM].value, a2, b2);
+                cont_rd_ptr = (cont_rd_ptr + len) % OSC_FPGA_SIG_LEN;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if((now.tv_sec > cont_next_pub.tv_sec) ||
+               ((now.tv_sec == cont_next_pub.tv_sec) &&
+                (now.tv_nsec >= cont_next_pub.tv_nsec))) {
+                long period_ns = 1e9 / curr_params[CONT_RATE_PARAM].value;
+
+                rp_update_cont_data(sqrt(cont_ch1.mean_sq), cont_ch1.peak,
+                                    sqrt(cont_ch2.mean_sq), cont_ch2.peak);
+
+                cont_next_pub.tv_nsec += period_ns;
+                while(cont_next_pub.tv_nsec >= 1000000000L) {
+                    cont_next_pub.tv_nsec -= 1000000000L;
+                    cont_next_pub.tv_sec++;
+                }
+                /* do not try to catch up on missed publish slots */
+                if((now.tv_sec > cont_next_pub.tv_sec) ||
+                   ((now.tv_sec == cont_next_pub.tv_sec) &&
+                    (now.tv_nsec >= cont_next_pub.tv_nsec)))
+                    cont_next_pub = now;
+            }
+            usleep(1000);
             continue;
         }
 
@@ -1469,6 +1562,75 @@ inline float rp_osc_meas_cnv_cnt(float data, float adc_max_v)
 }
 
 
+/*----------------------------------------------------------------------------------*/
+void rp_osc_cont_field_coef(float adc_max_v, int calib_dc_off, float user_dc_off,
+                            float scale_tesla, int gain, float *a, float *b)
+{
+    /* Same scaling as in rp_osc_decimate() - field = (cnt * a + b) */
+    float gain_factor = 1;
+    float cnt_to_v = adc_max_v / (float)(1<<(c_osc_fpga_adc_bits-1));
+
+    if(gain == 2)
+        gain_factor = 100;
+    else if(gain == 1)
+        gain_factor = 10;
+
+    *a = cnt_to_v * scale_tesla * gain_factor;
+    *b = (calib_dc_off * cnt_to_v + user_dc_off) * scale_tesla * gain_factor;
+}
+
+
+/*----------------------------------------------------------------------------------*/
+int rp_osc_cont_filter(rp_osc_cont_filt_t *filt, int *in_signal, int rd_ptr,
+                       int len, int skip, float smpl_period, float tau,
+                       float a, float b)
+{
+    /* Block statistics are collected in ADC counts and converted to the field
+     * once per block - the per-sample work is only a few integer operations.
+     */
+    int64_t sum = 0, sum_sq = 0;
+    int min = INT_MAX, max = INT_MIN;
+    double mean, mean_sq, peak, alpha;
+    int i, idx = rd_ptr;
+
+    if(len <= 0)
+        return 0;
+
+    for(i = 0; i < len; i++) {
+        int s_data = rp_osc_adc_sign(in_signal[idx]);
+
+        sum    += s_data;
+        sum_sq += s_data * s_data;
+        if(s_data < min)
+            min = s_data;
+        if(s_data > max)
+            max = s_data;
+        if(++idx == OSC_FPGA_SIG_LEN)
+            idx = 0;
+    }
+
+    mean    = (double)sum / len;
+    mean_sq = (double)a * a * ((double)sum_sq / len) + 2.0 * a * b * mean +
+        (double)b * b;
+    peak    = fmax(fabs(a * min + b), fabs(a * max + b));
+
+    if(!filt->valid) {
+        filt->mean_sq = mean_sq;
+        filt->peak    = peak;
+        filt->valid   = 1;
+        return 0;
+    }
+
+    /* Exponential running RMS and decaying peak-hold, the weight follows the
+     * stream time covered by this block (including skipped samples) */
+    alpha = 1.0 - exp(-(len + skip) * smpl_period / tau);
+    filt->mean_sq += alpha * (mean_sq - filt->mean_sq);
+    filt->peak = fmax(peak, filt->peak * (1.0 - alpha));
+
+    return 0;
+}
+
+
 /*----------------------------------------------------------------------------------*/
 int rp_osc_meas_convert(rp_osc_meas_res_t *ch_meas, float adc_max_v, int32_t cal_dc_offs)
 {
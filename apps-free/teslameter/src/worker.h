@@ -29,6 +29,13 @@ typedef enum rp_osc_worker_state_e {
     rp_osc_nonexisting_state /* must be last */
 } rp_osc_worker_state_t;
 
+/* Continuous-field mode running filter state (field units) */
+typedef struct rp_osc_cont_filt_s {
+    double mean_sq; /* running mean square */
+    double peak;    /* decaying peak of |field| */
+    int    valid;   /* filter was initialized with the first block */
+} rp_osc_cont_filt_t;
+
 int rp_osc_worker_init(rp_app_params_t *params, int params_len,
                        rp_calib_params_t *calib_params);
 int rp_osc_worker_exit(void);
@@ -115,6 +122,13 @@ int meas_period(rp_osc_meas_res_t *meas, int *in_signal, int wr_ptr_trig, int de
 /* helper function - convert CNT to V for meas. data (min, max, amp, avg) */
 int rp_osc_meas_convert(rp_osc_meas_res_t *ch_meas, float adc_max_v, int32_t cal_dc_offs);
 
+/* Continuous-field mode - ADC counts to field coefficients & running filter */
+void rp_osc_cont_field_coef(float adc_max_v, int calib_dc_off, float user_dc_off,
+                            float scale_tesla, int gain, float *a, float *b);
+int rp_osc_cont_filter(rp_osc_cont_filt_t *filt, int *in_signal, int rd_ptr,
+                       int len, int skip, float smpl_period, float tau,
+                       float a, float b);
+
 //leds teslameter
 void power_led(int l, int fd);
 int hw_monitor();
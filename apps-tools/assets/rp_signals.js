@@ -0,0 +1,87 @@
+/*
+ * Red Pitaya binary signal frames
+ *
+ * Decodes the frames of ws_get_signals_binary():
+ *   "RPSB", uint32 header length, JSON header, padding, payload
+ * all little endian. Binary signals in the header have "size", "type" and
+ * the "offset" of their samples from the payload start, they are replaced
+ * by { size, value } with a typed array view of the frame, so the result
+ * reads like the JSON signals. Other frames are left to pako.
+ *
+ * With a viewport the signals longer than it arrive as min/max envelopes,
+ * "envelope" buckets over "count" samples from "first" of "full_size",
+ * value holds min, max of every bucket.
+ *
+ * Usage:
+ *   ws.onopen:    RPSignals.enable(ws);
+ *   ws.onmessage: var receive = RPSignals.isBinary(ev.data)
+ *                     ? RPSignals.decode(ev.data)
+ *                     : JSON.parse(String.fromCharCode.apply(null, pako.inflate(new Uint8Array(ev.data))));
+ *   on resize:    RPSignals.setViewport(ws, plot.width(), 0, 1);
+ */
+
+(function(RPSignals, undefined) {
+
+    var MAGIC = [0x52, 0x50, 0x53, 0x42]; // "RPSB"
+    var ALIGN = 8;
+
+    var TYPES = {
+        'f32': Float32Array,
+        'f64': Float64Array,
+        'i32': Int32Array,
+        'u8': Uint8Array
+    };
+
+    // Asks the application to send binary signal frames to this page
+    RPSignals.enable = function(ws) {
+        ws.send(JSON.stringify({ parameters: { in_command: { value: 'binary_signals' } } }));
+    };
+
+    // Displayed points and the part of the signals from start to stop, 0 to 1.
+    // Zero points gets the whole signals again.
+    RPSignals.setViewport = function(ws, points, start, stop) {
+        ws.send(JSON.stringify({ viewport: { points: points, start: start, stop: stop } }));
+    };
+
+    RPSignals.isBinary = function(buffer) {
+        if (buffer.byteLength < 8)
+            return false;
+        var head = new Uint8Array(buffer, 0, 4);
+        for (var i = 0; i < 4; i++)
+            if (head[i] != MAGIC[i])
+                return false;
+        return true;
+    };
+
+    RPSignals.decode = function(buffer) {
+        var header_size = new DataView(buffer).getUint32(4, true);
+        var header = new Uint8Array(buffer, 8, header_size);
+        var text = '';
+        // Chunks keep fromCharCode below the argument limit
+        for (var i = 0; i < header.length; i += 8192)
+            text += String.fromCharCode.apply(null, header.subarray(i, i + 8192));
+        var receive = JSON.parse(text);
+
+        var start = Math.ceil((8 + header_size) / ALIGN) * ALIGN;
+        var signals = receive.signals || {};
+        for (var name in signals) {
+            var sig = signals[name];
+            var type = TYPES[sig.type];
+            if (sig.value !== undefined || type === undefined)
+                continue;
+            var view = {
+                size: sig.size,
+                value: new type(buffer, start + sig.offset, sig.size)
+            };
+            if (sig.envelope !== undefined) {
+                view.envelope = sig.envelope;
+                view.first = sig.first;
+                view.count = sig.count;
+                view.full_size = sig.full_size;
+            }
+            signals[name] = view;
+        }
+        return receive;
+    };
+
+}(window.RPSignals = window.RPSignals || {}));
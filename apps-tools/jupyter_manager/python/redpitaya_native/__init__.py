@@ -0,0 +1,23 @@
+"""Zero-copy access to Red Pitaya buffers.
+
+The extension modules export the memory of librp, librp2 and the streaming
+client through the buffer protocol, numpy.asarray() of the objects they
+return is an array over that memory without a copy:
+
+    from redpitaya_native import acq
+    acq.init()
+    view = acq.raw_view(acq.CH_1)
+    words = numpy.asarray(view)              # uint32, sample in the low ADC bits
+    volts = numpy.empty(acq.BUFFER_SIZE, numpy.float32)
+    if acq.wait_trigger(1000):               # the GIL is released while waiting
+        acq.read_volts(acq.CH_1, 0, volts)   # fills volts in place
+
+    from redpitaya_native import dma
+    with dma.Rx('/dev/amba_pl:rprx@2', 8, 256 * 1024) as rx:
+        rx.start()
+        for segment in rx.get(timeout=1.0):
+            with segment:
+                process(numpy.asarray(segment))
+
+Only the modules that were built can be imported, see setup.py.
+"""
@@ -0,0 +1,49 @@
+#
+# Red Pitaya native Python bindings build script. On the board run:
+# 'python3 setup.py build_ext --inplace' or 'make python' in jupyter_manager
+#
+# RP_MODULES selects the extensions, e.g. RP_MODULES=acq,dma when the
+# streaming client library is not built. MODEL is the board model of librp.
+#
+
+import os
+from setuptools import setup, Extension
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..', '..'))
+API = os.path.join(ROOT, 'api')
+API2 = os.path.join(ROOT, 'api2')
+STREAM = os.path.join(ROOT, 'apps-tools', 'streaming_manager', 'src', 'server')
+
+MODEL = os.environ.get('MODEL', 'Z10')
+MODULES = os.environ.get('RP_MODULES', 'acq,dma,stream').split(',')
+CFLAGS = ['-std=gnu99', '-Wall']
+
+extensions = {
+    'acq': Extension('redpitaya_native.acq',
+                     sources=['src/rpn_acq.c'],
+                     define_macros=[(MODEL, None)],
+                     include_dirs=[os.path.join(API, 'include')],
+                     library_dirs=[os.path.join(API, 'lib')],
+                     libraries=['rp'],
+                     extra_compile_args=CFLAGS),
+    'dma': Extension('redpitaya_native.dma',
+                     sources=['src/rpn_dma.c'],
+                     include_dirs=[os.path.join(API2, 'include'),
+                                   os.path.join(API2, 'include', 'redpitaya'),
+                                   os.path.join(API2, 'src')],
+                     library_dirs=[os.path.join(API2, 'lib')],
+                     libraries=['rp2', 'pthread'],
+                     extra_compile_args=CFLAGS),
+    'stream': Extension('redpitaya_native.stream',
+                        sources=['src/rpn_stream.c'],
+                        include_dirs=[os.path.join(STREAM, 'include', 'rpsa', 'client', 'core')],
+                        library_dirs=[os.path.join(STREAM, 'bin')],
+                        libraries=['rpsarecv', 'pthread'],
+                        extra_compile_args=CFLAGS),
+}
+
+setup(name='redpitaya_native',
+      version='0.1',
+      description='Zero-copy NumPy access to Red Pitaya acquisition, DMA and streaming buffers',
+      packages=['redpitaya_native'],
+      ext_modules=[extensions[m] for m in MODULES if m in extensions])
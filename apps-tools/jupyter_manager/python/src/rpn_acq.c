@@ -0,0 +1,351 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya native Python bindings, oscilloscope acquisition.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+
+#include "redpitaya/rp.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * redpitaya_native.acq exposes the ADC buffers of librp to Python without
+ * copies. raw_view() returns an object with the buffer protocol over the
+ * mapped FPGA buffer, numpy.asarray() of it is a uint32 array of the words
+ * the FPGA writes. read_raw() and read_volts() fill an existing writable
+ * buffer (a numpy array, bytearray, array.array) in place, so a loop
+ * allocates nothing per acquisition.
+ *
+ * The GIL is released while librp reads the buffer and while waiting for the
+ * trigger, other Python threads keep running. librp has its own locks.
+ *
+ * The mapping stays valid until release(), which refuses to run while a
+ * view is still exported.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    rp_acq_raw_view_t view;
+    int channel;
+    Py_ssize_t shape[1];
+} RawView;
+
+static int initialized;
+// Buffers exported from raw views, release() would unmap them
+static Py_ssize_t exports;
+
+static PyObject *rpError(const char *func, int status)
+{
+    PyErr_Format(PyExc_OSError, "%s: %s (%d)", func, rp_GetError(status), status);
+    return NULL;
+}
+
+static int checkInit(void)
+{
+    if (!initialized) {
+        PyErr_SetString(PyExc_RuntimeError, "librp is not initialized, call init() first");
+        return -1;
+    }
+    return 0;
+}
+
+static int checkChannel(int channel)
+{
+    if (channel != RP_CH_1 && channel != RP_CH_2) {
+        PyErr_Format(PyExc_ValueError, "channel %d is not 0 or 1", channel);
+        return -1;
+    }
+    return 0;
+}
+
+static int RawView_getbuffer(RawView *self, Py_buffer *view, int flags)
+{
+    if (!initialized) {
+        PyErr_SetString(PyExc_BufferError, "librp was released, the view is no longer mapped");
+        return -1;
+    }
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "the ADC buffer is read-only");
+        return -1;
+    }
+    // The FPGA writes the memory, the reader sees the words as they are in this moment
+    if (PyBuffer_FillInfo(view, (PyObject *)self, (void *)self->view.data,
+                          (Py_ssize_t)self->view.size * sizeof(uint32_t), 1, flags) < 0) {
+        return -1;
+    }
+    if (flags & PyBUF_FORMAT) {
+        view->format = "I";
+    }
+    view->itemsize = sizeof(uint32_t);
+    if (flags & PyBUF_ND) {
+        view->ndim = 1;
+        self->shape[0] = self->view.size;
+        view->shape = self->shape;
+    }
+    exports++;
+    return 0;
+}
+
+static void RawView_releasebuffer(RawView *self, Py_buffer *view)
+{
+    exports--;
+}
+
+static PyBufferProcs RawView_as_buffer = {
+    (getbufferproc)RawView_getbuffer,
+    (releasebufferproc)RawView_releasebuffer,
+};
+
+static PyObject *RawView_refresh(RawView *self, PyObject *unused)
+{
+    if (checkInit() < 0) {
+        return NULL;
+    }
+    int status = rp_AcqGetRawBufferView(self->channel, &self->view);
+    if (status != RP_OK) {
+        return rpError("rp_AcqGetRawBufferView", status);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef RawView_methods[] = {
+    {"refresh", (PyCFunction)RawView_refresh, METH_NOARGS,
+     "Takes a new snapshot of write_pos and trigger_pos, the buffer itself is always current."},
+    {NULL}
+};
+
+static PyObject *RawView_get_size(RawView *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->view.size);
+}
+
+static PyObject *RawView_get_write_pos(RawView *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->view.write_pos);
+}
+
+static PyObject *RawView_get_trigger_pos(RawView *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->view.trigger_pos);
+}
+
+static PyObject *RawView_get_channel(RawView *self, void *closure)
+{
+    return PyLong_FromLong(self->channel);
+}
+
+static PyGetSetDef RawView_getset[] = {
+    {"size", (getter)RawView_get_size, NULL, "Samples in the ring", NULL},
+    {"write_pos", (getter)RawView_get_write_pos, NULL, "Write pointer at the last refresh", NULL},
+    {"trigger_pos", (getter)RawView_get_trigger_pos, NULL, "Write pointer at the trigger, at the last refresh", NULL},
+    {"channel", (getter)RawView_get_channel, NULL, "Channel of the buffer", NULL},
+    {NULL}
+};
+
+static PyTypeObject RawViewType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "redpitaya_native.acq.RawView",
+    .tp_basicsize = sizeof(RawView),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Read-only ADC ring of one channel, uint32 words with the sample in the low ADC bits",
+    .tp_as_buffer = &RawView_as_buffer,
+    .tp_methods = RawView_methods,
+    .tp_getset = RawView_getset,
+};
+
+static PyObject *acq_init(PyObject *module, PyObject *unused)
+{
+    if (!initialized) {
+        int status = rp_Init();
+        if (status != RP_OK) {
+            return rpError("rp_Init", status);
+        }
+        initialized = 1;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *acq_release(PyObject *module, PyObject *unused)
+{
+    if (exports > 0) {
+        PyErr_Format(PyExc_BufferError, "%zd buffers of the ADC are still in use", exports);
+        return NULL;
+    }
+    if (initialized) {
+        initialized = 0;
+        int status = rp_Release();
+        if (status != RP_OK) {
+            return rpError("rp_Release", status);
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *acq_raw_view(PyObject *module, PyObject *args)
+{
+    int channel;
+    if (!PyArg_ParseTuple(args, "i", &channel) || checkInit() < 0 || checkChannel(channel) < 0) {
+        return NULL;
+    }
+    RawView *self = PyObject_New(RawView, &RawViewType);
+    if (self == NULL) {
+        return NULL;
+    }
+    self->channel = channel;
+    int status = rp_AcqGetRawBufferView(channel, &self->view);
+    if (status != RP_OK) {
+        Py_DECREF(self);
+        return rpError("rp_AcqGetRawBufferView", status);
+    }
+    return (PyObject *)self;
+}
+
+/**
+ * Common part of read_raw() and read_volts(): the output has to be a
+ * contiguous writable buffer of the element type. Returns the samples
+ * read, fewer than the buffer holds if the ADC buffer is shorter.
+ */
+static PyObject *acqRead(PyObject *args, char format, size_t itemsize, int volts)
+{
+    int channel;
+    unsigned int pos;
+    PyObject *obj;
+    Py_buffer out;
+    if (!PyArg_ParseTuple(args, "iIO", &channel, &pos, &obj) || checkInit() < 0 || checkChannel(channel) < 0) {
+        return NULL;
+    }
+    if (PyObject_GetBuffer(obj, &out, PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0) {
+        return NULL;
+    }
+    // Native byte order only, spelled "f", "@f", "=f" or on this board "<f"
+    const char *f = out.format;
+    if (*f == '@' || *f == '=' || (PY_LITTLE_ENDIAN && *f == '<')) {
+        f++;
+    }
+    if (out.itemsize != (Py_ssize_t)itemsize || f[0] != format || f[1] != 0) {
+        PyErr_Format(PyExc_TypeError, "the output buffer must hold '%c' items", format);
+        PyBuffer_Release(&out);
+        return NULL;
+    }
+    uint32_t size = (uint32_t)(out.len / itemsize);
+    if (size > ADC_BUFFER_SIZE) {
+        size = ADC_BUFFER_SIZE;
+    }
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    if (volts) {
+        status = rp_AcqGetDataV(channel, pos, &size, (float *)out.buf);
+    } else {
+        status = rp_AcqGetDataRaw(channel, pos, &size, (int16_t *)out.buf);
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&out);
+    if (status != RP_OK) {
+        return rpError(volts ? "rp_AcqGetDataV" : "rp_AcqGetDataRaw", status);
+    }
+    return PyLong_FromUnsignedLong(size);
+}
+
+static PyObject *acq_read_raw(PyObject *module, PyObject *args)
+{
+    return acqRead(args, 'h', sizeof(int16_t), 0);
+}
+
+static PyObject *acq_read_volts(PyObject *module, PyObject *args)
+{
+    return acqRead(args, 'f', sizeof(float), 1);
+}
+
+static PyObject *acq_wait_trigger(PyObject *module, PyObject *args)
+{
+    unsigned int timeout_ms;
+    if (!PyArg_ParseTuple(args, "I", &timeout_ms) || checkInit() < 0) {
+        return NULL;
+    }
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = rp_AcqWaitTrigger(timeout_ms);
+    Py_END_ALLOW_THREADS
+    if (status == RP_ETIM) {
+        Py_RETURN_FALSE;
+    }
+    if (status != RP_OK) {
+        return rpError("rp_AcqWaitTrigger", status);
+    }
+    Py_RETURN_TRUE;
+}
+
+static PyObject *acq_trigger_fd(PyObject *module, PyObject *unused)
+{
+    if (checkInit() < 0) {
+        return NULL;
+    }
+    int fd = -1;
+    int status = rp_AcqGetTriggerFd(&fd);
+    if (status == RP_NOTS) {
+        Py_RETURN_NONE;
+    }
+    if (status != RP_OK) {
+        return rpError("rp_AcqGetTriggerFd", status);
+    }
+    return PyLong_FromLong(fd);
+}
+
+static PyMethodDef acq_methods[] = {
+    {"init", acq_init, METH_NOARGS, "Initializes librp, rp_Init()."},
+    {"release", acq_release, METH_NOARGS, "Releases librp, fails while ADC buffers are exported."},
+    {"raw_view", acq_raw_view, METH_VARARGS,
+     "raw_view(channel) -> RawView over the ADC ring of the channel, without a copy."},
+    {"read_raw", acq_read_raw, METH_VARARGS,
+     "read_raw(channel, pos, out) -> samples; calibrated int16 counts from pos into the writable buffer out."},
+    {"read_volts", acq_read_volts, METH_VARARGS,
+     "read_volts(channel, pos, out) -> samples; float32 volts from pos into the writable buffer out."},
+    {"wait_trigger", acq_wait_trigger, METH_VARARGS,
+     "wait_trigger(timeout_ms) -> bool; blocks without the GIL until the trigger or the time limit."},
+    {"trigger_fd", acq_trigger_fd, METH_NOARGS,
+     "Descriptor for select/poll that becomes readable on the acquisition interrupt, None without one. "
+     "Call wait_trigger(0) once it is readable."},
+    {NULL}
+};
+
+static struct PyModuleDef acq_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "redpitaya_native.acq",
+    .m_doc = "Zero-copy access to the oscilloscope buffers of librp.",
+    .m_size = -1,
+    .m_methods = acq_methods,
+};
+
+PyMODINIT_FUNC PyInit_acq(void)
+{
+    if (PyType_Ready(&RawViewType) < 0) {
+        return NULL;
+    }
+    PyObject *m = PyModule_Create(&acq_module);
+    if (m == NULL) {
+        return NULL;
+    }
+    Py_INCREF(&RawViewType);
+    if (PyModule_AddObject(m, "RawView", (PyObject *)&RawViewType) < 0 ||
+        PyModule_AddIntConstant(m, "CH_1", RP_CH_1) < 0 ||
+        PyModule_AddIntConstant(m, "CH_2", RP_CH_2) < 0 ||
+        PyModule_AddIntConstant(m, "BUFFER_SIZE", ADC_BUFFER_SIZE) < 0) {
+        Py_DECREF(&RawViewType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
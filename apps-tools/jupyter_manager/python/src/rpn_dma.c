@@ -0,0 +1,576 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya native Python bindings, DMA receive ring of librp2.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "redpitaya/rp2.h"
+#include "rp_dma.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * redpitaya_native.dma wraps the asynchronous RX ring of rp_dma. Rx.get()
+ * waits for completed segments with the GIL released and returns Segment
+ * objects. A segment has the buffer protocol over its part of the mapped
+ * DMA memory, numpy.asarray() of it is an array of the item format given
+ * to Rx, by default int16.
+ *
+ * The ring takes segments back in order with rp_DmaRxRelease(). Python may
+ * release them in any order, a segment released early is remembered and
+ * handed back together with the older ones. A segment is released by
+ * release(), at the end of a with block or when it is garbage collected.
+ * release() refuses while numpy arrays or memoryviews of it are alive,
+ * once released the memory belongs to the DMA again. start() counts the
+ * segments from 0 again, segments of the previous run become void.
+ */
+
+// struct module item formats that may describe the samples
+static const struct {
+    const char *format;
+    Py_ssize_t  itemsize;
+} formats[] = {
+    {"b", 1}, {"B", 1}, {"h", 2}, {"H", 2}, {"i", 4}, {"I", 4}, {"f", 4}, {"q", 8}, {"Q", 8}, {"d", 8},
+};
+
+typedef struct {
+    PyObject_HEAD
+    rp_handle_uio_t handle;
+    rp_dma_rx_t rx;
+    bool handle_open;
+    bool rx_open;
+    const char *format;
+    Py_ssize_t itemsize;
+    uint64_t generation;             ///< starts of the ring, the DMA counts segments from 0 again
+    uint64_t next_release;           ///< oldest delivered segment not handed back to the ring
+    uint64_t delivered;              ///< segments returned by get()
+    uint8_t released[RP_DMA_MAX_SGMNT_CNT]; ///< released out of order, by ring index
+    Py_ssize_t exports;              ///< buffers of segments alive
+} Rx;
+
+typedef struct {
+    PyObject_HEAD
+    Rx *rx;
+    uint64_t generation;
+    rp_dma_sgmnt_t sgmnt;
+    bool released;
+    Py_ssize_t exports;
+    Py_ssize_t shape[1];
+} Segment;
+
+static PyTypeObject SegmentType;
+
+static PyObject *dmaError(const char *func, int status)
+{
+    PyErr_Format(PyExc_OSError, "%s failed (%d)", func, status);
+    return NULL;
+}
+
+static int checkOpen(Rx *self)
+{
+    if (!self->rx_open) {
+        PyErr_SetString(PyExc_ValueError, "the DMA ring is closed");
+        return -1;
+    }
+    return 0;
+}
+
+static bool segmentValid(Segment *self)
+{
+    return !self->released && self->rx->rx_open && self->generation == self->rx->generation;
+}
+
+/** Marks the segment released and hands back what is now contiguous */
+static int rxRelease(Rx *self, const rp_dma_sgmnt_t *sgmnt)
+{
+    if (sgmnt->seq < self->next_release) {
+        return RP_OK;
+    }
+    self->released[sgmnt->seq % self->rx.sgmnt_cnt] = 1;
+    uint64_t next = self->next_release;
+    while (next < self->delivered && self->released[next % self->rx.sgmnt_cnt]) {
+        self->released[next % self->rx.sgmnt_cnt] = 0;
+        next++;
+    }
+    if (next == self->next_release) {
+        return RP_OK;
+    }
+    self->next_release = next;
+    return rp_DmaRxRelease(&self->rx, next - 1);
+}
+
+static void rxClose(Rx *self)
+{
+    if (self->rx_open) {
+        rp_DmaRxClose(&self->rx);
+        self->rx_open = false;
+    }
+    if (self->handle_open) {
+        rp_DmaClose(&self->handle);
+        self->handle_open = false;
+    }
+}
+
+/* Segment */
+
+static int segmentRelease(Segment *self)
+{
+    if (self->exports > 0) {
+        PyErr_Format(PyExc_BufferError, "%zd buffers of the segment are still in use", self->exports);
+        return -1;
+    }
+    if (segmentValid(self)) {
+        self->released = true;
+        int status = rxRelease(self->rx, &self->sgmnt);
+        if (status != RP_OK) {
+            dmaError("rp_DmaRxRelease", status);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void Segment_dealloc(Segment *self)
+{
+    // No buffer can be alive, each one holds a reference to the segment
+    if (segmentValid(self)) {
+        rxRelease(self->rx, &self->sgmnt);
+    }
+    Py_DECREF(self->rx);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int Segment_getbuffer(Segment *self, Py_buffer *view, int flags)
+{
+    if (!segmentValid(self)) {
+        PyErr_SetString(PyExc_BufferError, "the segment was released or the ring restarted");
+        return -1;
+    }
+    // Writable, numpy may process the samples in place before the release
+    if (PyBuffer_FillInfo(view, (PyObject *)self, (void *)self->sgmnt.data, self->sgmnt.size, 0, flags) < 0) {
+        return -1;
+    }
+    if (flags & PyBUF_FORMAT) {
+        view->format = (char *)self->rx->format;
+    }
+    view->itemsize = self->rx->itemsize;
+    if (flags & PyBUF_ND) {
+        view->ndim = 1;
+        self->shape[0] = self->sgmnt.size / self->rx->itemsize;
+        view->shape = self->shape;
+    }
+    self->exports++;
+    self->rx->exports++;
+    return 0;
+}
+
+static void Segment_releasebuffer(Segment *self, Py_buffer *view)
+{
+    self->exports--;
+    self->rx->exports--;
+}
+
+static PyBufferProcs Segment_as_buffer = {
+    (getbufferproc)Segment_getbuffer,
+    (releasebufferproc)Segment_releasebuffer,
+};
+
+static PyObject *Segment_release(Segment *self, PyObject *unused)
+{
+    if (segmentRelease(self) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *Segment_enter(Segment *self, PyObject *unused)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *Segment_exit(Segment *self, PyObject *args)
+{
+    if (segmentRelease(self) < 0) {
+        return NULL;
+    }
+    Py_RETURN_FALSE;
+}
+
+static PyMethodDef Segment_methods[] = {
+    {"release", (PyCFunction)Segment_release, METH_NOARGS,
+     "Hands the segment back to the DMA, fails while buffers of it are alive."},
+    {"__enter__", (PyCFunction)Segment_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Segment_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyObject *Segment_get_seq(Segment *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(self->sgmnt.seq);
+}
+
+static PyObject *Segment_get_index(Segment *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->sgmnt.index);
+}
+
+static PyObject *Segment_get_overflow(Segment *self, void *closure)
+{
+    return PyBool_FromLong(self->sgmnt.overflow);
+}
+
+static PyObject *Segment_get_released(Segment *self, void *closure)
+{
+    return PyBool_FromLong(!segmentValid(self));
+}
+
+static PyGetSetDef Segment_getset[] = {
+    {"seq", (getter)Segment_get_seq, NULL, "Segments completed before this one since the start", NULL},
+    {"index", (getter)Segment_get_index, NULL, "Segment in the ring", NULL},
+    {"overflow", (getter)Segment_get_overflow, NULL, "Older segments were lost before this one", NULL},
+    {"released", (getter)Segment_get_released, NULL, "The segment was handed back or the ring restarted", NULL},
+    {NULL}
+};
+
+static PyTypeObject SegmentType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "redpitaya_native.dma.Segment",
+    .tp_basicsize = sizeof(Segment),
+    .tp_dealloc = (destructor)Segment_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Completed DMA segment, the mapped memory through the buffer protocol until released",
+    .tp_as_buffer = &Segment_as_buffer,
+    .tp_methods = Segment_methods,
+    .tp_getset = Segment_getset,
+};
+
+/* Rx */
+
+static PyObject *Rx_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"device", "sgmnt_cnt", "sgmnt_size", "format", NULL};
+    const char *device;
+    unsigned int sgmnt_cnt;
+    Py_ssize_t sgmnt_size;
+    const char *format = "h";
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "sIn|s", kwlist, &device, &sgmnt_cnt, &sgmnt_size, &format)) {
+        return NULL;
+    }
+    Rx *self = (Rx *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        if (strcmp(formats[i].format, format) == 0) {
+            self->format = formats[i].format;
+            self->itemsize = formats[i].itemsize;
+        }
+    }
+    if (self->format == NULL) {
+        PyErr_Format(PyExc_ValueError, "unsupported item format '%s'", format);
+        Py_DECREF(self);
+        return NULL;
+    }
+    if (sgmnt_size <= 0 || sgmnt_size % self->itemsize != 0) {
+        PyErr_SetString(PyExc_ValueError, "the segment size is not a multiple of the item size");
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    int status = rp_DmaCheckGeometry(sgmnt_cnt, sgmnt_size);
+    if (status != RP_OK) {
+        PyErr_Format(PyExc_ValueError, "%u segments of %zd bytes do not fit the DMA memory", sgmnt_cnt, sgmnt_size);
+        Py_DECREF(self);
+        return NULL;
+    }
+    status = rp_DmaOpen(device, &self->handle);
+    if (status != RP_OK) {
+        free(self->handle.dma_dev);
+        Py_DECREF(self);
+        PyErr_Format(PyExc_OSError, "cannot open the DMA device %s", device);
+        return NULL;
+    }
+    self->handle_open = true;
+    status = rp_DmaRxOpen(&self->handle, &self->rx, sgmnt_cnt, sgmnt_size);
+    if (status != RP_OK) {
+        rxClose(self);
+        Py_DECREF(self);
+        return dmaError("rp_DmaRxOpen", status);
+    }
+    self->rx_open = true;
+    return (PyObject *)self;
+}
+
+static void Rx_dealloc(Rx *self)
+{
+    // Segments hold a reference, none is left here
+    rxClose(self);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *Rx_start(Rx *self, PyObject *unused)
+{
+    if (checkOpen(self) < 0) {
+        return NULL;
+    }
+    if (self->exports > 0) {
+        PyErr_Format(PyExc_BufferError, "%zd buffers of the ring are still in use", self->exports);
+        return NULL;
+    }
+    int status = rp_DmaRxStart(&self->rx);
+    if (status != RP_OK) {
+        return dmaError("rp_DmaRxStart", status);
+    }
+    // Segments of the last run are void, the ring counts from 0 again
+    self->generation++;
+    self->next_release = 0;
+    self->delivered = 0;
+    memset(self->released, 0, sizeof(self->released));
+    Py_RETURN_NONE;
+}
+
+static PyObject *Rx_stop(Rx *self, PyObject *unused)
+{
+    if (checkOpen(self) < 0) {
+        return NULL;
+    }
+    int status = rp_DmaRxStop(&self->rx);
+    if (status != RP_OK) {
+        return dmaError("rp_DmaRxStop", status);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *Rx_close(Rx *self, PyObject *unused)
+{
+    if (self->exports > 0) {
+        PyErr_Format(PyExc_BufferError, "%zd buffers of the ring are still in use", self->exports);
+        return NULL;
+    }
+    rxClose(self);
+    Py_RETURN_NONE;
+}
+
+/**
+ * Waits on the eventfd of the ring without the GIL. timeout is in seconds,
+ * None waits until a segment completes. An empty list means the time ran out.
+ */
+static PyObject *Rx_get(Rx *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"timeout", "max", NULL};
+    PyObject *timeout_obj = Py_None;
+    Py_ssize_t max = RP_DMA_MAX_SGMNT_CNT;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|On", kwlist, &timeout_obj, &max) || checkOpen(self) < 0) {
+        return NULL;
+    }
+    int timeout_ms = -1;
+    if (timeout_obj != Py_None) {
+        double timeout = PyFloat_AsDouble(timeout_obj);
+        if (timeout == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        timeout_ms = timeout > 0 ? (int)(timeout * 1000 + 0.5) : 0;
+    }
+    if (max < 1 || max > RP_DMA_MAX_SGMNT_CNT) {
+        max = RP_DMA_MAX_SGMNT_CNT;
+    }
+
+    rp_dma_sgmnt_t sgmnts[RP_DMA_MAX_SGMNT_CNT];
+    size_t count = 0;
+    int status = RP_OK;
+    int ret = 0;
+    Py_BEGIN_ALLOW_THREADS
+    struct pollfd pfd = { .fd = rp_DmaRxFd(&self->rx), .events = POLLIN };
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR && timeout_ms < 0);
+    if (ret >= 0) {
+        // Also with a timeout, segments may be waiting whose event was read before
+        status = rp_DmaRxGet(&self->rx, sgmnts, max, &count);
+    }
+    Py_END_ALLOW_THREADS
+    if (ret < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    if (status != RP_OK) {
+        return dmaError("rp_DmaRxGet", status);
+    }
+
+    PyObject *list = PyList_New(count);
+    if (list == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Segment *sgmnt = PyObject_New(Segment, &SegmentType);
+        if (sgmnt == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        Py_INCREF(self);
+        sgmnt->rx = self;
+        sgmnt->generation = self->generation;
+        sgmnt->sgmnt = sgmnts[i];
+        sgmnt->released = false;
+        sgmnt->exports = 0;
+        self->delivered = sgmnts[i].seq + 1;
+        PyList_SET_ITEM(list, i, (PyObject *)sgmnt);
+    }
+    return list;
+}
+
+static PyObject *Rx_fileno(Rx *self, PyObject *unused)
+{
+    if (checkOpen(self) < 0) {
+        return NULL;
+    }
+    return PyLong_FromLong(rp_DmaRxFd(&self->rx));
+}
+
+static PyObject *Rx_enter(Rx *self, PyObject *unused)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *Rx_exit(Rx *self, PyObject *args)
+{
+    PyObject *ret = Rx_close(self, NULL);
+    if (ret == NULL) {
+        return NULL;
+    }
+    Py_DECREF(ret);
+    Py_RETURN_FALSE;
+}
+
+static PyMethodDef Rx_methods[] = {
+    {"start", (PyCFunction)Rx_start, METH_NOARGS, "Starts the cyclic DMA and its receive thread."},
+    {"stop", (PyCFunction)Rx_stop, METH_NOARGS, "Stops the DMA, the segments taken stay readable until released."},
+    {"close", (PyCFunction)Rx_close, METH_NOARGS, "Unmaps the ring, fails while buffers of segments are alive."},
+    {"get", (PyCFunction)Rx_get, METH_VARARGS | METH_KEYWORDS,
+     "get(timeout=None, max=256) -> [Segment]; waits without the GIL for completed segments."},
+    {"fileno", (PyCFunction)Rx_fileno, METH_NOARGS,
+     "Descriptor for select/poll/asyncio, readable when segments completed. Then call get(0)."},
+    {"__enter__", (PyCFunction)Rx_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Rx_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyObject *Rx_get_overflows(Rx *self, void *closure)
+{
+    if (checkOpen(self) < 0) {
+        return NULL;
+    }
+    uint64_t overflows = 0;
+    rp_DmaRxGetOverflows(&self->rx, &overflows);
+    return PyLong_FromUnsignedLongLong(overflows);
+}
+
+static PyObject *Rx_get_sgmnt_cnt(Rx *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->rx.sgmnt_cnt);
+}
+
+static PyObject *Rx_get_sgmnt_size(Rx *self, void *closure)
+{
+    return PyLong_FromSize_t(self->rx.sgmnt_size);
+}
+
+static PyGetSetDef Rx_getset[] = {
+    {"overflows", (getter)Rx_get_overflows, NULL, "Segments lost to the DMA catching up", NULL},
+    {"sgmnt_cnt", (getter)Rx_get_sgmnt_cnt, NULL, "Segments in the ring", NULL},
+    {"sgmnt_size", (getter)Rx_get_sgmnt_size, NULL, "Bytes per segment", NULL},
+    {NULL}
+};
+
+static PyTypeObject RxType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "redpitaya_native.dma.Rx",
+    .tp_basicsize = sizeof(Rx),
+    .tp_dealloc = (destructor)Rx_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Rx(device, sgmnt_cnt, sgmnt_size, format='h'), cyclic DMA receive ring",
+    .tp_methods = Rx_methods,
+    .tp_getset = Rx_getset,
+    .tp_new = Rx_new,
+};
+
+/* Module */
+
+static PyObject *dma_reserved(PyObject *module, PyObject *unused)
+{
+    size_t size = 0;
+    int status = rp_DmaGetReserved(&size);
+    if (status != RP_OK) {
+        return dmaError("rp_DmaGetReserved", status);
+    }
+    return PyLong_FromSize_t(size);
+}
+
+static PyObject *dma_choose_geometry(PyObject *module, PyObject *args)
+{
+    double rate;
+    double latency;
+    if (!PyArg_ParseTuple(args, "dd", &rate, &latency)) {
+        return NULL;
+    }
+    uint32_t sgmnt_cnt;
+    size_t sgmnt_size;
+    int status = rp_DmaChooseGeometry(rate, latency, &sgmnt_cnt, &sgmnt_size);
+    if (status != RP_OK) {
+        return dmaError("rp_DmaChooseGeometry", status);
+    }
+    return Py_BuildValue("(In)", sgmnt_cnt, (Py_ssize_t)sgmnt_size);
+}
+
+static PyMethodDef dma_methods[] = {
+    {"reserved", dma_reserved, METH_NOARGS, "Bytes of memory reserved for the DMA."},
+    {"choose_geometry", dma_choose_geometry, METH_VARARGS,
+     "choose_geometry(rate, latency) -> (sgmnt_cnt, sgmnt_size) for bytes per second and seconds per segment."},
+    {NULL}
+};
+
+static struct PyModuleDef dma_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "redpitaya_native.dma",
+    .m_doc = "Zero-copy access to the DMA receive ring of librp2.",
+    .m_size = -1,
+    .m_methods = dma_methods,
+};
+
+PyMODINIT_FUNC PyInit_dma(void)
+{
+    if (PyType_Ready(&RxType) < 0 || PyType_Ready(&SegmentType) < 0) {
+        return NULL;
+    }
+    PyObject *m = PyModule_Create(&dma_module);
+    if (m == NULL) {
+        return NULL;
+    }
+    Py_INCREF(&RxType);
+    Py_INCREF(&SegmentType);
+    if (PyModule_AddObject(m, "Rx", (PyObject *)&RxType) < 0 ||
+        PyModule_AddObject(m, "Segment", (PyObject *)&SegmentType) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
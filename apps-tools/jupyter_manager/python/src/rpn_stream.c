@@ -0,0 +1,611 @@
+/**
+ * $Id: $
+ *
+ * @brief Red Pitaya native Python bindings, streaming client receiver.
+ *
+ * @Author Red Pitaya
+ *
+ * (c) Red Pitaya  http://www.redpitaya.com
+ *
+ * This part of code is written in C programming language.
+ * Please visit http://en.wikipedia.org/wiki/C_(programming_language)
+ * for more details on the language used herein.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "rpsa_receiver.h"
+
+/**
+ * GENERAL DESCRIPTION:
+ *
+ * redpitaya_native.stream wraps the receiver library of the streaming
+ * client (librpsarecv). Receiver.get() waits for the next pack with the GIL
+ * released and returns a Pack whose channels are views into the receive
+ * ring: pack.channel(1) has the buffer protocol, numpy.asarray() of it is an
+ * int8, int16 or float32 array of the samples as they arrived.
+ *
+ * A pack from the receiver is only valid inside its callback, so the
+ * callback hands it over to Python and waits until the Pack is released
+ * (release(), the end of a with block or garbage collection). Meanwhile the
+ * receiver does not read further, the data queues in its ring and the
+ * socket. Packed 12/14 bit and compressed channels have no array layout in
+ * place, decode() expands them into a writable buffer instead.
+ */
+
+enum { SLOT_EMPTY, SLOT_FULL, SLOT_TAKEN };
+
+typedef struct {
+    PyObject_HEAD
+    rpsa_receiver_t *receiver;
+    bool running;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int state;                       ///< SLOT_*, the pack handed over by the callback
+    bool stopping;                   ///< makes a waiting callback return
+    rpsa_pack_t pack;
+    uint64_t generation;             ///< handovers, a Pack of an older one is void
+    Py_ssize_t exports;              ///< buffers of the taken pack alive
+} Receiver;
+
+typedef struct {
+    PyObject_HEAD
+    Receiver *receiver;
+    uint64_t generation;
+    rpsa_pack_t pack;
+    bool released;
+} Pack;
+
+typedef struct {
+    PyObject_HEAD
+    Pack *pack;
+    int channel;
+    Py_ssize_t shape[1];
+} Channel;
+
+static PyTypeObject PackType;
+static PyTypeObject ChannelType;
+
+/** Runs on the receiver thread, must not touch Python objects */
+static void receiverCallback(const rpsa_pack_t *pack, void *user)
+{
+    Receiver *self = (Receiver *)user;
+    pthread_mutex_lock(&self->lock);
+    if (!self->stopping) {
+        self->pack = *pack;
+        self->state = SLOT_FULL;
+        pthread_cond_broadcast(&self->cond);
+        while (self->state != SLOT_EMPTY && !self->stopping) {
+            pthread_cond_wait(&self->cond, &self->lock);
+        }
+    }
+    pthread_mutex_unlock(&self->lock);
+}
+
+static int checkReceiver(Receiver *self)
+{
+    if (self->receiver == NULL) {
+        PyErr_SetString(PyExc_ValueError, "the receiver is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/** Bytes per sample in place and after rpsa_decode_channel() */
+static size_t sampleSize(uint32_t resolution)
+{
+    return resolution == 8 ? 1 : resolution == 32 ? 4 : 2;
+}
+
+static bool packValid(Pack *self)
+{
+    return !self->released && self->receiver->running && self->generation == self->receiver->generation;
+}
+
+/** Lets the callback return, the receiver goes on with the next pack */
+static void packRelease(Pack *self)
+{
+    Receiver *receiver = self->receiver;
+    self->released = true;
+    pthread_mutex_lock(&receiver->lock);
+    if (receiver->state == SLOT_TAKEN) {
+        receiver->state = SLOT_EMPTY;
+        pthread_cond_broadcast(&receiver->cond);
+    }
+    pthread_mutex_unlock(&receiver->lock);
+}
+
+static void receiverStop(Receiver *self)
+{
+    if (!self->running) {
+        return;
+    }
+    pthread_mutex_lock(&self->lock);
+    self->stopping = true;
+    pthread_cond_broadcast(&self->cond);
+    pthread_mutex_unlock(&self->lock);
+    rpsa_receiver_stop(self->receiver);
+    self->running = false;
+    self->state = SLOT_EMPTY;
+    self->generation++;
+}
+
+/* Channel */
+
+static void Channel_dealloc(Channel *self)
+{
+    Py_DECREF(self->pack);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int Channel_getbuffer(Channel *self, Py_buffer *view, int flags)
+{
+    const rpsa_pack_t *pack = &self->pack->pack;
+    if (!packValid(self->pack)) {
+        PyErr_SetString(PyExc_BufferError, "the pack was released");
+        return -1;
+    }
+    if (pack->compressed || pack->resolution == 12 || pack->resolution == 14) {
+        PyErr_SetString(PyExc_BufferError, "the channel is packed or compressed, use Pack.decode()");
+        return -1;
+    }
+    const uint8_t *data = self->channel == 1 ? pack->ch1 : pack->ch2;
+    size_t size = self->channel == 1 ? pack->size_ch1 : pack->size_ch2;
+    // The receive ring is not ours to change
+    if (PyBuffer_FillInfo(view, (PyObject *)self, (void *)data, size, 1, flags) < 0) {
+        return -1;
+    }
+    const char *format = pack->resolution == 8 ? "b" : pack->resolution == 32 ? "f" : "h";
+    view->itemsize = sampleSize(pack->resolution);
+    if (flags & PyBUF_FORMAT) {
+        view->format = (char *)format;
+    }
+    if (flags & PyBUF_ND) {
+        view->ndim = 1;
+        self->shape[0] = size / view->itemsize;
+        view->shape = self->shape;
+    }
+    self->pack->receiver->exports++;
+    return 0;
+}
+
+static void Channel_releasebuffer(Channel *self, Py_buffer *view)
+{
+    self->pack->receiver->exports--;
+}
+
+static PyBufferProcs Channel_as_buffer = {
+    (getbufferproc)Channel_getbuffer,
+    (releasebufferproc)Channel_releasebuffer,
+};
+
+static PyTypeObject ChannelType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "redpitaya_native.stream.Channel",
+    .tp_basicsize = sizeof(Channel),
+    .tp_dealloc = (destructor)Channel_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Samples of one channel in the receive ring, valid while the pack is",
+    .tp_as_buffer = &Channel_as_buffer,
+};
+
+/* Pack */
+
+static void Pack_dealloc(Pack *self)
+{
+    // Channels hold a reference, none of their buffers is alive here
+    if (packValid(self)) {
+        packRelease(self);
+    }
+    Py_DECREF(self->receiver);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int packCheck(Pack *self, int channel)
+{
+    if (!packValid(self)) {
+        PyErr_SetString(PyExc_ValueError, "the pack was released");
+        return -1;
+    }
+    if (channel != 1 && channel != 2) {
+        PyErr_Format(PyExc_ValueError, "channel %d is not 1 or 2", channel);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *Pack_channel(Pack *self, PyObject *args)
+{
+    int channel;
+    if (!PyArg_ParseTuple(args, "i", &channel) || packCheck(self, channel) < 0) {
+        return NULL;
+    }
+    if ((channel == 1 ? self->pack.ch1 : self->pack.ch2) == NULL) {
+        Py_RETURN_NONE;
+    }
+    Channel *view = PyObject_New(Channel, &ChannelType);
+    if (view == NULL) {
+        return NULL;
+    }
+    Py_INCREF(self);
+    view->pack = self;
+    view->channel = channel;
+    return (PyObject *)view;
+}
+
+/**
+ * Expands a channel with rpsa_decode_channel() into a contiguous writable
+ * buffer, 8 bit samples as int8, float samples as float32 and the others as
+ * int16. Returns the samples written.
+ */
+static PyObject *Pack_decode(Pack *self, PyObject *args)
+{
+    int channel;
+    PyObject *obj;
+    Py_buffer out;
+    if (!PyArg_ParseTuple(args, "iO", &channel, &obj) || packCheck(self, channel) < 0) {
+        return NULL;
+    }
+    if (PyObject_GetBuffer(obj, &out, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0) {
+        return NULL;
+    }
+    size_t size;
+    Py_BEGIN_ALLOW_THREADS
+    size = rpsa_decode_channel(&self->pack, channel, out.buf, out.len);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&out);
+    if (size == 0 && (channel == 1 ? self->pack.size_ch1 : self->pack.size_ch2) != 0) {
+        PyErr_SetString(PyExc_ValueError, "the output buffer is too small for the channel");
+        return NULL;
+    }
+    return PyLong_FromSize_t(size / sampleSize(self->pack.resolution));
+}
+
+static PyObject *Pack_release(Pack *self, PyObject *unused)
+{
+    if (self->receiver->exports > 0 && packValid(self)) {
+        PyErr_Format(PyExc_BufferError, "%zd buffers of the pack are still in use", self->receiver->exports);
+        return NULL;
+    }
+    if (packValid(self)) {
+        packRelease(self);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *Pack_enter(Pack *self, PyObject *unused)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *Pack_exit(Pack *self, PyObject *args)
+{
+    PyObject *ret = Pack_release(self, NULL);
+    if (ret == NULL) {
+        return NULL;
+    }
+    Py_DECREF(ret);
+    Py_RETURN_FALSE;
+}
+
+static PyMethodDef Pack_methods[] = {
+    {"channel", (PyCFunction)Pack_channel, METH_VARARGS,
+     "channel(n) -> Channel view of channel 1 or 2 in the receive ring, None if the pack has no such channel."},
+    {"decode", (PyCFunction)Pack_decode, METH_VARARGS,
+     "decode(n, out) -> samples; expands a packed or compressed channel into the writable buffer out."},
+    {"release", (PyCFunction)Pack_release, METH_NOARGS,
+     "Lets the receiver go on, fails while buffers of the channels are alive."},
+    {"__enter__", (PyCFunction)Pack_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Pack_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+#define PACK_U64_GETTER(field)                                        \
+    static PyObject *Pack_get_##field(Pack *self, void *closure)      \
+    {                                                                 \
+        return PyLong_FromUnsignedLongLong(self->pack.field);         \
+    }
+
+PACK_U64_GETTER(id)
+PACK_U64_GETTER(lost_rate)
+PACK_U64_GETTER(sample_id)
+PACK_U64_GETTER(osc_rate)
+PACK_U64_GETTER(resolution)
+PACK_U64_GETTER(compressed)
+PACK_U64_GETTER(samples)
+
+static PyGetSetDef Pack_getset[] = {
+    {"id", (getter)Pack_get_id, NULL, "Pack number", NULL},
+    {"lost_rate", (getter)Pack_get_lost_rate, NULL, "DMA segments lost on the board before this pack", NULL},
+    {"sample_id", (getter)Pack_get_sample_id, NULL, "Absolute index of the first sample", NULL},
+    {"osc_rate", (getter)Pack_get_osc_rate, NULL, "Sample rate", NULL},
+    {"resolution", (getter)Pack_get_resolution, NULL, "8, 12, 14 or 16 bits, 32 for float samples", NULL},
+    {"compressed", (getter)Pack_get_compressed, NULL, "The channels are compressed", NULL},
+    {"samples", (getter)Pack_get_samples, NULL, "Samples per channel", NULL},
+    {NULL}
+};
+
+static PyTypeObject PackType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "redpitaya_native.stream.Pack",
+    .tp_basicsize = sizeof(Pack),
+    .tp_dealloc = (destructor)Pack_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Stream pack held by Python, the receiver waits until it is released",
+    .tp_methods = Pack_methods,
+    .tp_getset = Pack_getset,
+};
+
+/* Receiver */
+
+static PyObject *Receiver_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"host", "port", "protocol", "ring_size", "capture", NULL};
+    const char *host;
+    const char *port;
+    const char *protocol = "tcp";
+    Py_ssize_t ring_size = 0;
+    const char *capture = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ss|snz", kwlist, &host, &port, &protocol, &ring_size, &capture)) {
+        return NULL;
+    }
+    int proto;
+    if (strcmp(protocol, "tcp") == 0) {
+        proto = RPSA_PROTOCOL_TCP;
+    } else if (strcmp(protocol, "udp") == 0) {
+        proto = RPSA_PROTOCOL_UDP;
+    } else {
+        PyErr_Format(PyExc_ValueError, "protocol '%s' is not tcp or udp", protocol);
+        return NULL;
+    }
+    Receiver *self = (Receiver *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->cond, NULL);
+    self->receiver = rpsa_receiver_create(host, port, proto, ring_size < 0 ? 0 : ring_size);
+    if (self->receiver == NULL) {
+        Py_DECREF(self);
+        PyErr_SetString(PyExc_ValueError, "cannot create a receiver with these arguments");
+        return NULL;
+    }
+    if (capture != NULL && rpsa_receiver_set_capture_file(self->receiver, capture) != 0) {
+        Py_DECREF(self);
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, capture);
+    }
+    rpsa_receiver_set_callback(self->receiver, receiverCallback, self);
+    return (PyObject *)self;
+}
+
+static void Receiver_dealloc(Receiver *self)
+{
+    // Packs hold a reference, none is left here
+    if (self->receiver != NULL) {
+        receiverStop(self);
+        rpsa_receiver_destroy(self->receiver);
+    }
+    pthread_cond_destroy(&self->cond);
+    pthread_mutex_destroy(&self->lock);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *Receiver_start(Receiver *self, PyObject *unused)
+{
+    if (checkReceiver(self) < 0) {
+        return NULL;
+    }
+    if (self->running) {
+        Py_RETURN_NONE;
+    }
+    self->stopping = false;
+    self->state = SLOT_EMPTY;
+    if (rpsa_receiver_start(self->receiver) != 0) {
+        PyErr_SetString(PyExc_ConnectionError, "cannot connect to the streaming server");
+        return NULL;
+    }
+    self->running = true;
+    Py_RETURN_NONE;
+}
+
+static PyObject *Receiver_stop(Receiver *self, PyObject *unused)
+{
+    if (checkReceiver(self) < 0) {
+        return NULL;
+    }
+    if (self->exports > 0) {
+        PyErr_Format(PyExc_BufferError, "%zd buffers of the current pack are still in use", self->exports);
+        return NULL;
+    }
+    // Joins the receiver thread, which may be reading the socket
+    Py_BEGIN_ALLOW_THREADS
+    receiverStop(self);
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
+static PyObject *Receiver_close(Receiver *self, PyObject *unused)
+{
+    if (self->receiver == NULL) {
+        Py_RETURN_NONE;
+    }
+    PyObject *ret = Receiver_stop(self, NULL);
+    if (ret == NULL) {
+        return NULL;
+    }
+    Py_DECREF(ret);
+    rpsa_receiver_destroy(self->receiver);
+    self->receiver = NULL;
+    Py_RETURN_NONE;
+}
+
+/**
+ * Waits without the GIL for the callback to hand over a pack. timeout is in
+ * seconds, None waits until a pack arrives, on a timeout get() returns None.
+ */
+static PyObject *Receiver_get(Receiver *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"timeout", NULL};
+    PyObject *timeout_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &timeout_obj) || checkReceiver(self) < 0) {
+        return NULL;
+    }
+    if (!self->running) {
+        PyErr_SetString(PyExc_ValueError, "the receiver is not started");
+        return NULL;
+    }
+    struct timespec deadline;
+    bool forever = timeout_obj == Py_None;
+    if (!forever) {
+        double timeout = PyFloat_AsDouble(timeout_obj);
+        if (timeout == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (timeout < 0) {
+            timeout = 0;
+        }
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)timeout;
+        deadline.tv_nsec += (long)((timeout - (time_t)timeout) * 1e9);
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    int state;
+    rpsa_pack_t pack;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->lock);
+    // A taken pack blocks the callback, waiting for the next one would never end
+    while (self->state == SLOT_EMPTY && !self->stopping) {
+        if (forever) {
+            pthread_cond_wait(&self->cond, &self->lock);
+        } else if (pthread_cond_timedwait(&self->cond, &self->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    state = self->state;
+    if (state == SLOT_FULL) {
+        self->state = SLOT_TAKEN;
+        pack = self->pack;
+    }
+    pthread_mutex_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+
+    if (state == SLOT_TAKEN) {
+        PyErr_SetString(PyExc_RuntimeError, "the previous pack is not released yet");
+        return NULL;
+    }
+    if (state != SLOT_FULL) {
+        Py_RETURN_NONE;
+    }
+    Pack *obj = PyObject_New(Pack, &PackType);
+    if (obj == NULL) {
+        pthread_mutex_lock(&self->lock);
+        self->state = SLOT_EMPTY;
+        pthread_cond_broadcast(&self->cond);
+        pthread_mutex_unlock(&self->lock);
+        return NULL;
+    }
+    Py_INCREF(self);
+    obj->receiver = self;
+    obj->generation = ++self->generation;
+    obj->pack = pack;
+    obj->released = false;
+    return (PyObject *)obj;
+}
+
+static PyObject *Receiver_stats(Receiver *self, PyObject *unused)
+{
+    if (checkReceiver(self) < 0) {
+        return NULL;
+    }
+    rpsa_receiver_stats_t stats;
+    rpsa_receiver_get_stats(self->receiver, &stats);
+    return Py_BuildValue("{sKsKsKsKsKsK}",
+                         "bytes", (unsigned long long)stats.bytes,
+                         "packs", (unsigned long long)stats.packs,
+                         "lost_packs", (unsigned long long)stats.lost_packs,
+                         "gap_samples", (unsigned long long)stats.gap_samples,
+                         "broken", (unsigned long long)stats.broken,
+                         "written", (unsigned long long)stats.written);
+}
+
+static PyObject *Receiver_enter(Receiver *self, PyObject *unused)
+{
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *Receiver_exit(Receiver *self, PyObject *args)
+{
+    PyObject *ret = Receiver_close(self, NULL);
+    if (ret == NULL) {
+        return NULL;
+    }
+    Py_DECREF(ret);
+    Py_RETURN_FALSE;
+}
+
+static PyMethodDef Receiver_methods[] = {
+    {"start", (PyCFunction)Receiver_start, METH_NOARGS, "Connects and starts the receiver thread."},
+    {"stop", (PyCFunction)Receiver_stop, METH_NOARGS, "Stops the receiver, packs taken before become void."},
+    {"close", (PyCFunction)Receiver_close, METH_NOARGS, "Stops and destroys the receiver."},
+    {"get", (PyCFunction)Receiver_get, METH_VARARGS | METH_KEYWORDS,
+     "get(timeout=None) -> Pack or None; waits without the GIL for the next pack."},
+    {"stats", (PyCFunction)Receiver_stats, METH_NOARGS, "Counters of the receiver as a dict."},
+    {"__enter__", (PyCFunction)Receiver_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Receiver_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyTypeObject ReceiverType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "redpitaya_native.stream.Receiver",
+    .tp_basicsize = sizeof(Receiver),
+    .tp_dealloc = (destructor)Receiver_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Receiver(host, port, protocol='tcp', ring_size=0, capture=None), stream of one board",
+    .tp_methods = Receiver_methods,
+    .tp_new = Receiver_new,
+};
+
+/* Module */
+
+static struct PyModuleDef stream_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "redpitaya_native.stream",
+    .m_doc = "Zero-copy access to the packs of the streaming client receiver.",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_stream(void)
+{
+    if (PyType_Ready(&ReceiverType) < 0 || PyType_Ready(&PackType) < 0 || PyType_Ready(&ChannelType) < 0) {
+        return NULL;
+    }
+    PyObject *m = PyModule_Create(&stream_module);
+    if (m == NULL) {
+        return NULL;
+    }
+    Py_INCREF(&ReceiverType);
+    Py_INCREF(&PackType);
+    Py_INCREF(&ChannelType);
+    if (PyModule_AddObject(m, "Receiver", (PyObject *)&ReceiverType) < 0 ||
+        PyModule_AddObject(m, "Pack", (PyObject *)&PackType) < 0 ||
+        PyModule_AddObject(m, "Channel", (PyObject *)&ChannelType) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -67,6 +67,11 @@ var protocolChange = function(event) {
     SM.sendParameters();
 }
 
+var compressionChange = function(event) {
+    SM.parametersCache["SS_COMPRESSION"] = { value: $("#SS_COMPRESSION option:selected").val() };
+    SM.sendParameters();
+}
+
 var channelChange = function(event) {
     SM.parametersCache["SS_CHANNEL"] = { value: $("#SS_CHANNEL option:selected").val() };
     SM.sendParameters();
@@ -131,6 +136,7 @@ changeCallbacks["SS_IP_ADDR"] = ipAddressChange;
 changeCallbacks["SS_USE_NET"] = sendByNetChange;
 changeCallbacks["SS_USE_FILE"] = sendToFileChange;
 changeCallbacks["SS_PROTOCOL"] = protocolChange;
+changeCallbacks["SS_COMPRESSION"] = compressionChange;
 changeCallbacks["SS_CHANNEL"] = channelChange;
 changeCallbacks["SS_RESOLUTION"] = resolutionChange;
 changeCallbacks["SS_FORMAT"] = formatСhange;
@@ -1,15 +1,16 @@
 (function(SM, $, undefined) {
-    SM.max_rate_1ch = [125e6,125e6];
-    SM.max_rate_2chs = [125e6,125e6];
+    SM.max_rate_1ch = [125e6,125e6,125e6];
+    SM.max_rate_2chs = [125e6,125e6,125e6];
 
-    SM.max_SD_rate_1ch = [125e6,125e6];
-    SM.max_SD_rate_2chs = [125e6,125e6];
+    SM.max_SD_rate_1ch = [125e6,125e6,125e6];
+    SM.max_SD_rate_2chs = [125e6,125e6,125e6];
 
-    SM.max_rate_devider_1ch = [2.0, 4.0];
-    SM.max_rate_devider_2chs = [4.0, 8.0];
+    // Packed samples keep the 16-bit limits, files are always written as 16-bit
+    SM.max_rate_devider_1ch = [2.0, 4.0, 4.0];
+    SM.max_rate_devider_2chs = [4.0, 8.0, 8.0];
 
-    SM.max_SD_rate_devider_1ch = [12.0 , 24.0];
-    SM.max_SD_rate_devider_2chs = [24.0 , 48.0];
+    SM.max_SD_rate_devider_1ch = [12.0 , 24.0, 24.0];
+    SM.max_SD_rate_devider_2chs = [24.0 , 48.0, 48.0];
     
 
     SM.updateMaxLimits = function(model) {
@@ -19,11 +20,11 @@
                     SM.rp_model = model.value;
                     var max_possible_rate = 125e6;
                     SM.ss_full_rate =  max_possible_rate;
-                    SM.max_rate_1ch      = [max_possible_rate / SM.max_rate_devider_1ch[0] , max_possible_rate /SM.max_rate_devider_1ch[1]];
-                    SM.max_rate_2chs     = [max_possible_rate / SM.max_rate_devider_2chs[0] , max_possible_rate / SM.max_rate_devider_2chs[1]];
+                    SM.max_rate_1ch      = [max_possible_rate / SM.max_rate_devider_1ch[0] , max_possible_rate / SM.max_rate_devider_1ch[1] , max_possible_rate / SM.max_rate_devider_1ch[2]];
+                    SM.max_rate_2chs     = [max_possible_rate / SM.max_rate_devider_2chs[0] , max_possible_rate / SM.max_rate_devider_2chs[1] , max_possible_rate / SM.max_rate_devider_2chs[2]];
                     
-                    SM.max_SD_rate_1ch   = [max_possible_rate / SM.max_SD_rate_devider_1ch[0] , max_possible_rate /SM.max_SD_rate_devider_1ch[1]];
-                    SM.max_SD_rate_2chs  = [max_possible_rate / SM.max_SD_rate_devider_2chs[0] , max_possible_rate / SM.max_SD_rate_devider_2chs[1]];
+                    SM.max_SD_rate_1ch   = [max_possible_rate / SM.max_SD_rate_devider_1ch[0] , max_possible_rate / SM.max_SD_rate_devider_1ch[1] , max_possible_rate / SM.max_SD_rate_devider_1ch[2]];
+                    SM.max_SD_rate_2chs  = [max_possible_rate / SM.max_SD_rate_devider_2chs[0] , max_possible_rate / SM.max_SD_rate_devider_2chs[1] , max_possible_rate / SM.max_SD_rate_devider_2chs[2]];
                     $("#SS_RATE").val(max_possible_rate);
                 }
 
@@ -31,11 +32,11 @@
                     SM.rp_model = model.value;
                     var max_possible_rate = 122.88e6;
                     SM.ss_full_rate =  max_possible_rate;
-                    SM.max_rate_1ch      = [max_possible_rate / SM.max_rate_devider_1ch[0] , max_possible_rate /SM.max_rate_devider_1ch[1]];
-                    SM.max_rate_2chs     = [max_possible_rate / SM.max_rate_devider_2chs[0] , max_possible_rate / SM.max_rate_devider_2chs[1]];
+                    SM.max_rate_1ch      = [max_possible_rate / SM.max_rate_devider_1ch[0] , max_possible_rate / SM.max_rate_devider_1ch[1] , max_possible_rate / SM.max_rate_devider_1ch[2]];
+                    SM.max_rate_2chs     = [max_possible_rate / SM.max_rate_devider_2chs[0] , max_possible_rate / SM.max_rate_devider_2chs[1] , max_possible_rate / SM.max_rate_devider_2chs[2]];
                     
-                    SM.max_SD_rate_1ch   = [max_possible_rate / SM.max_SD_rate_devider_1ch[0] , max_possible_rate /SM.max_SD_rate_devider_1ch[1]];
-                    SM.max_SD_rate_2chs  = [max_possible_rate / SM.max_SD_rate_devider_2chs[0] , max_possible_rate / SM.max_SD_rate_devider_2chs[1]];
+                    SM.max_SD_rate_1ch   = [max_possible_rate / SM.max_SD_rate_devider_1ch[0] , max_possible_rate / SM.max_SD_rate_devider_1ch[1] , max_possible_rate / SM.max_SD_rate_devider_1ch[2]];
+                    SM.max_SD_rate_2chs  = [max_possible_rate / SM.max_SD_rate_devider_2chs[0] , max_possible_rate / SM.max_SD_rate_devider_2chs[1] , max_possible_rate / SM.max_SD_rate_devider_2chs[2]];
                     $("#SS_RATE").val(max_possible_rate);
                 }
                 
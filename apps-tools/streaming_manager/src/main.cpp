@@ -12,6 +12,7 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <ctime>
+#include <chrono>
 
 #include <vector>
 #include <algorithm>
@@ -19,8 +20,10 @@
 #include <mutex>
 
 #include "redpitaya/version.h"
+#include "redpitaya/rp.h"
 #include "StreamingApplication.h"
 #include "StreamingManager.h"
+#include "EventRing.h"
 
 //extern "C" {
 //    #include "rpApp.h"
@@ -30,18 +33,20 @@
 #ifdef Z10
 #define RP_MODEL "Z10"
 #define MAX_FREQ 125e6
+#define ADC_PACKED_BITS 14
 #endif
 
 #ifdef Z20
 #define RP_MODEL "Z20"
 #define MAX_FREQ 122.880e6
+#define ADC_PACKED_BITS 12
 #endif
 
 void StartServer();
 void StopServer(int x);
 void StopNonBlocking(int x);
 
-static std::mutex mut;
+static std::mutex mut; // Guards s_app and s_manger against the stat poller
 static pthread_mutex_t mutex;
 
 #define SS_TCP		1
@@ -53,7 +58,11 @@ static pthread_mutex_t mutex;
 
 #define SS_8BIT		1
 #define SS_16BIT	2
-//#define DEBUG_MODE
+#define SS_PACKED	3
+
+// Phase accumulator range of the generator, its frequency step is MAX_FREQ / range
+#define GEN_DDS_RANGE (65536.0 * 16384.0)
+#define TRACE_PATH "/tmp/stream_trace.bin"
 
 
 //Parameters
@@ -62,29 +71,159 @@ CBooleanParameter 	ss_start(			"SS_START", 	        CBaseParameter::RW, false,0)
 
 
 CBooleanParameter 	ss_use_localfile(	"SS_USE_FILE", 	        CBaseParameter::RW, false,0);
+// Network streaming also writes the file of SS_FORMAT as a local copy
+CBooleanParameter 	ss_file_copy(		"SS_FILE_COPY", 	    CBaseParameter::RW, false,0);
 CIntParameter		ss_port(  			"SS_PORT_NUMBER", 		CBaseParameter::RW, 8900,0,	1,65535);
 CStringParameter    ss_ip_addr(			"SS_IP_ADDR",			CBaseParameter::RW, "",0);
 CIntParameter		ss_protocol(  		"SS_PROTOCOL", 			CBaseParameter::RW, 1 ,0,	1,2);
+CIntParameter		ss_udp_mtu(  		"SS_UDP_MTU", 			CBaseParameter::RW, 1500 ,0,	576,9000);
+// TCP sends without copying into the socket buffer, where the kernel supports MSG_ZEROCOPY
+CBooleanParameter	ss_tcp_zerocopy(	"SS_TCP_ZEROCOPY", 		CBaseParameter::RW, false,0);
+// Lowers the data rate step by step while the link loses data: compression, 8-bit, decimation
+CBooleanParameter	ss_adapt(			"SS_ADAPT", 			CBaseParameter::RW, false,0);
+CIntParameter		ss_ring_depth(  	"SS_RING_DEPTH", 		CBaseParameter::RW, BUFFER_RING_DEFAULT_DEPTH ,0,	1,64);
+// u-dma-buf device the DMA writes to through the cache, e.g. "udmabuf0". Empty uses the uncached reserved memory.
+CStringParameter	ss_dma_buf(			"SS_DMA_BUF",			CBaseParameter::RW, "",0);
+// Thread layout, cpu -1 is not pinned and priority 0 is not real-time
+CIntParameter		ss_osc_cpu(  		"SS_OSC_CPU", 			CBaseParameter::RW, -1 ,0,	-1,3);
+CIntParameter		ss_osc_prio(  		"SS_OSC_PRIO", 			CBaseParameter::RW, 0 ,0,	0,99);
+CIntParameter		ss_net_cpu(  		"SS_NET_CPU", 			CBaseParameter::RW, -1 ,0,	-1,3);
+CIntParameter		ss_net_prio(  		"SS_NET_PRIO", 			CBaseParameter::RW, 0 ,0,	0,99);
+CIntParameter		ss_file_cpu(  		"SS_FILE_CPU", 			CBaseParameter::RW, -1 ,0,	-1,3);
+CIntParameter		ss_file_prio(  		"SS_FILE_PRIO", 		CBaseParameter::RW, 0 ,0,	0,99);
+// File write-behind depth in 4 MB windows, 0 leaves the writeback to the page cache
+CIntParameter		ss_file_depth(  	"SS_FILE_DEPTH", 		CBaseParameter::RW, FILE_WRITE_BEHIND_DEFAULT_DEPTH ,0,	0,FILE_WRITE_BEHIND_MAX_DEPTH);
+// Upper TDMS segment size in KiB, 0 writes a segment per buffer
+CIntParameter		ss_file_segment(  	"SS_FILE_SEGMENT", 		CBaseParameter::RW, FILE_TDMS_SEGMENT_DEFAULT_KB ,0,	0,FILE_TDMS_SEGMENT_MAX_KB);
+// TDMS layout, interleaved two channel data and the .tdms_index written along with the file
+CBooleanParameter	ss_file_interleaved("SS_FILE_INTERLEAVED", 	CBaseParameter::RW, false,0);
+CBooleanParameter	ss_file_index(		"SS_FILE_INDEX", 		CBaseParameter::RW, true,0);
+// File rotation, a new file every SS_FILE_ROTATE_MB MiB or SS_FILE_ROTATE_SEC seconds, 0 is off
+CIntParameter		ss_file_rotate_mb(	"SS_FILE_ROTATE_MB", 	CBaseParameter::RW, 0 ,0,	0,1024 * 1024);
+CIntParameter		ss_file_rotate_sec(	"SS_FILE_ROTATE_SEC", 	CBaseParameter::RW, 0 ,0,	0,7 * 24 * 3600);
+// Memory the file write queue may hold in MiB, 0 is half of the physical memory
+CIntParameter		ss_file_budget_mb(	"SS_FILE_BUDGET_MB", 	CBaseParameter::RW, 0 ,0,	0,64 * 1024);
+// Pre-trigger capture for file streaming, SS_PRETRIG_SEC 0 writes from the start
+CFloatParameter		ss_pretrig_sec(  	"SS_PRETRIG_SEC", 		CBaseParameter::RW, 0 ,0,	0,60);
+// SS_TRIG_SOURCE 0 software, 1 IN1, 2 IN2, 3 either. SS_TRIG_MODE 0 edge, 1 level, 2 window, 3 pulse width.
+// SS_POSTTRIG_SEC gates the capture, only the data around every trigger is recorded
+CIntParameter		ss_trig_source(  	"SS_TRIG_SOURCE", 		CBaseParameter::RW, 0 ,0,	0,3);
+CIntParameter		ss_trig_mode(  		"SS_TRIG_MODE", 		CBaseParameter::RW, 0 ,0,	0,3);
+CIntParameter		ss_trig_level(  	"SS_TRIG_LEVEL", 		CBaseParameter::RW, 0 ,0,	-32768,32767);
+CIntParameter		ss_trig_edge(  		"SS_TRIG_EDGE", 		CBaseParameter::RW, 0 ,0,	0,1);
+CIntParameter		ss_trig_hyst(  		"SS_TRIG_HYST", 		CBaseParameter::RW, 0 ,0,	0,32767);
+CIntParameter		ss_trig_low(  		"SS_TRIG_LOW", 			CBaseParameter::RW, 0 ,0,	-32768,32767);
+CIntParameter		ss_trig_high(  		"SS_TRIG_HIGH", 		CBaseParameter::RW, 0 ,0,	-32768,32767);
+CIntParameter		ss_trig_width_min(	"SS_TRIG_WIDTH_MIN", 	CBaseParameter::RW, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_trig_width_max(	"SS_TRIG_WIDTH_MAX", 	CBaseParameter::RW, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_trig_holdoff(	"SS_TRIG_HOLDOFF", 		CBaseParameter::RW, 0 ,0,	0,INT_MAX);
+CFloatParameter		ss_posttrig_sec(  	"SS_POSTTRIG_SEC", 		CBaseParameter::RW, 0 ,0,	0,3600);
+CIntParameter		ss_stat_triggers(	"SS_STAT_TRIGGERS", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CFloatParameter		ss_trig_sample(		"SS_TRIG_SAMPLE", 		CBaseParameter::RO, 0 ,0,	0,1e18);
+CBooleanParameter	ss_trig_force(		"SS_TRIG_FORCE", 		CBaseParameter::RW, false,0);
+CIntParameter		ss_trig_state( 		"SS_TRIG_STATE", 		CBaseParameter::RO, 0 ,0,	0,2);
+// Multi-board streaming, SS_BOARD_ID goes into every pack. With SS_SYNC the network
+// stream starts at the first trigger and the sample ids count from it, boards with a
+// shared clock and trigger line up in the client aggregator.
+CIntParameter		ss_board_id(		"SS_BOARD_ID", 			CBaseParameter::RW, 0 ,0,	0,PACK_BOARD_MASK);
+CBooleanParameter	ss_sync(			"SS_SYNC", 				CBaseParameter::RW, false,0);
+// Binary event trace of the pipeline, SS_TRACE_DUMP writes it to TRACE_PATH
+CBooleanParameter	ss_trace(			"SS_TRACE", 			CBaseParameter::RW, true,0);
+CBooleanParameter	ss_trace_dump(		"SS_TRACE_DUMP", 		CBaseParameter::RW, false,0);
+// Lock-in, the reference follows the generator settings of the excitation
+CBooleanParameter	ss_lockin(			"SS_LOCKIN", 			CBaseParameter::RW, false,0);
+CIntParameter		ss_lockin_input(	"SS_LOCKIN_INPUT", 		CBaseParameter::RW, 1 ,0,	1,2);
+CFloatParameter		ss_lockin_freq(		"SS_LOCKIN_FREQ", 		CBaseParameter::RW, 1000 ,0,	0,MAX_FREQ / 2);
+CFloatParameter		ss_lockin_phase(	"SS_LOCKIN_PHASE", 		CBaseParameter::RW, 0 ,0,	-360,360);
+CFloatParameter		ss_lockin_tc(		"SS_LOCKIN_TC", 		CBaseParameter::RW, 0.01 ,0,	1e-6,1000);
+CIntParameter		ss_lockin_order(	"SS_LOCKIN_ORDER", 		CBaseParameter::RW, 2 ,0,	1,LOCKIN_MAX_ORDER);
+CIntParameter		ss_lockin_dec(		"SS_LOCKIN_DEC", 		CBaseParameter::RW, 1024 ,0,	2,1 << 24);
+CIntParameter		ss_lockin_output(	"SS_LOCKIN_OUTPUT", 	CBaseParameter::RW, 0 ,0,	0,1);
+// Averaged power spectra of the acquired inputs instead of the samples.
+// Window: 0 - rectangular, 1 - Hann, 2 - Blackman-Harris, 3 - flat top
+CBooleanParameter	ss_spectrum(		"SS_SPECTRUM", 			CBaseParameter::RW, false,0);
+CIntParameter		ss_spectrum_fft(	"SS_SPECTRUM_FFT", 		CBaseParameter::RW, 4096 ,0,	SPECTRUM_MIN_FFT,SPECTRUM_MAX_FFT);
+CIntParameter		ss_spectrum_window(	"SS_SPECTRUM_WINDOW", 	CBaseParameter::RW, 1 ,0,	0,3);
+CFloatParameter		ss_spectrum_rate(	"SS_SPECTRUM_RATE", 	CBaseParameter::RW, 10 ,0,	0.01,1000);
+// Complex baseband of one input around SS_DDC_FREQ, I and Q take the two channels
+CBooleanParameter	ss_ddc(				"SS_DDC", 				CBaseParameter::RW, false,0);
+CIntParameter		ss_ddc_input(		"SS_DDC_INPUT", 		CBaseParameter::RW, 1 ,0,	1,2);
+CFloatParameter		ss_ddc_freq(		"SS_DDC_FREQ", 			CBaseParameter::RW, 10e6 ,0,	0,MAX_FREQ / 2);
+CIntParameter		ss_ddc_dec(			"SS_DDC_DEC", 			CBaseParameter::RW, 64 ,0,	2,DDC_MAX_DECIMATION);
+CIntParameter		ss_ddc_taps(		"SS_DDC_TAPS", 			CBaseParameter::RW, 8 ,0,	1,64);
+CFloatParameter		ss_ddc_cutoff(		"SS_DDC_CUTOFF", 		CBaseParameter::RW, 0.8 ,0,	0.01,1);
+// Calibrated float samples in volts instead of ADC counts
+CBooleanParameter	ss_volts(			"SS_VOLTS", 			CBaseParameter::RW, false,0);
+// Software low pass and decimation after the FPGA decimation of SS_RATE
+CBooleanParameter	ss_dec(				"SS_DEC", 				CBaseParameter::RW, false,0);
+CIntParameter		ss_dec_factor(		"SS_DEC_FACTOR", 		CBaseParameter::RW, 8 ,0,	2,DECIMATOR_MAX_FACTOR);
+CIntParameter		ss_dec_filter(		"SS_DEC_FILTER", 		CBaseParameter::RW, 1 ,0,	0,2);
+CIntParameter		ss_dec_taps(		"SS_DEC_TAPS", 			CBaseParameter::RW, 16 ,0,	1,DECIMATOR_MAX_TAPS);
+CFloatParameter		ss_dec_cutoff(		"SS_DEC_CUTOFF", 		CBaseParameter::RW, 0.8 ,0,	0.01,1);
+// Gapless power meter, U on IN1 and I on IN2
+CBooleanParameter	ss_power(			"SS_POWER", 			CBaseParameter::RW, false,0);
+CIntParameter		ss_power_freq(		"SS_POWER_FREQ", 		CBaseParameter::RW, 50 ,0,	50,60);
+CFloatParameter		ss_power_u_scale(	"SS_POWER_U_SCALE", 	CBaseParameter::RW, 1 ,0,	1e-6,1e6);
+CFloatParameter		ss_power_i_scale(	"SS_POWER_I_SCALE", 	CBaseParameter::RW, 1 ,0,	1e-6,1e6);
+CIntParameter		ss_power_aggregate(	"SS_POWER_AGGREGATE", 	CBaseParameter::RW, POWER_AGGREGATE ,0,	1,3000);
 CIntParameter		ss_channels(  		"SS_CHANNEL", 			CBaseParameter::RW, 1 ,0,	1,3);
-CIntParameter		ss_resolution(  	"SS_RESOLUTION", 		CBaseParameter::RW, 1 ,0,	1,2);
+CIntParameter		ss_resolution(  	"SS_RESOLUTION", 		CBaseParameter::RW, 1 ,0,	1,3);
+CIntParameter		ss_compression(  	"SS_COMPRESSION", 		CBaseParameter::RW, 0 ,0,	0,1);
 CIntParameter		ss_rate(  			"SS_RATE", 				CBaseParameter::RW, 1 ,0,	1,65536);
-CIntParameter		ss_format( 			"SS_FORMAT", 			CBaseParameter::RW, 0 ,0,	0,1);
+// 0 - wav, 1 - tdms, 2 - raw
+CIntParameter		ss_format( 			"SS_FORMAT", 			CBaseParameter::RW, 0 ,0,	0,2);
 CIntParameter		ss_status( 			"SS_STATUS", 			CBaseParameter::RWSA, 1 ,0,	0,100);
 CIntParameter		ss_acd_max(			"SS_ACD_MAX", 			CBaseParameter::RW, MAX_FREQ ,0,	0, MAX_FREQ);
 CStringParameter 	redpitaya_model(	"RP_MODEL_STR", 		CBaseParameter::ROSA, RP_MODEL, 10);
 
+// Pipeline counters, refreshed once per parameter interval while the server runs
+CIntParameter		ss_stat_segments(	"SS_STAT_SEGMENTS", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_stat_overflows(	"SS_STAT_OVERFLOWS", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_stat_lost(		"SS_STAT_LOST", 		CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_stat_ring_peak(	"SS_STAT_RING_PEAK", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_stat_queue_peak(	"SS_STAT_QUEUE_PEAK", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_stat_dropped(	"SS_STAT_DROPPED", 		CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+// Part of the dropped packs, held back because a TCP client had no credit left
+CIntParameter		ss_stat_throttled(	"SS_STAT_THROTTLED", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CFloatParameter		ss_stat_queue_mb(	"SS_STAT_QUEUE_MB", 	CBaseParameter::RO, 0 ,0,	0,1e6);
+CIntParameter		ss_stat_queue_full(	"SS_STAT_QUEUE_FULL", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CFloatParameter		ss_stat_sent_mb(	"SS_STAT_SENT_MB", 		CBaseParameter::RO, 0 ,0,	0,1e12);
+CFloatParameter		ss_stat_rate_mb(	"SS_STAT_RATE_MB", 		CBaseParameter::RO, 0 ,0,	0,1e6);
+// The file on its own, with SS_FILE_COPY the counters above are the network
+CFloatParameter		ss_stat_file_mb(	"SS_STAT_FILE_MB", 		CBaseParameter::RO, 0 ,0,	0,1e12);
+CFloatParameter		ss_stat_file_lost_mb("SS_STAT_FILE_LOST_MB", CBaseParameter::RO, 0 ,0,	0,1e12);
+// What the adaptive rate control has settled on
+CIntParameter		ss_adapt_rate(		"SS_ADAPT_RATE", 		CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_adapt_resolution("SS_ADAPT_RESOLUTION", 	CBaseParameter::RO, 0 ,0,	0,32);
+CBooleanParameter	ss_adapt_compression("SS_ADAPT_COMPRESSION", CBaseParameter::RO, false,0);
+CIntParameter		ss_stat_send_p50(	"SS_STAT_SEND_P50", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_stat_send_p99(	"SS_STAT_SEND_P99", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CIntParameter		ss_stat_total_p99(	"SS_STAT_TOTAL_P99", 	CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+
+// Power results, refreshed with the counters when a new aggregate is out
+CIntParameter		ss_power_seq(		"SS_POWER_SEQ", 		CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CBooleanParameter	ss_power_synced(	"SS_POWER_SYNCED", 		CBaseParameter::RO, false,0);
+CIntParameter		ss_power_lost(		"SS_POWER_LOST", 		CBaseParameter::RO, 0 ,0,	0,INT_MAX);
+CFloatParameter		ss_power_f(			"SS_POWER_F", 			CBaseParameter::RO, 0 ,0,	0,1e3);
+CFloatParameter		ss_power_urms(		"SS_POWER_URMS", 		CBaseParameter::RO, 0 ,0,	0,1e9);
+CFloatParameter		ss_power_irms(		"SS_POWER_IRMS", 		CBaseParameter::RO, 0 ,0,	0,1e9);
+CFloatParameter		ss_power_p(			"SS_POWER_P", 			CBaseParameter::RO, 0 ,0,	-1e18,1e18);
+CFloatParameter		ss_power_q(			"SS_POWER_Q", 			CBaseParameter::RO, 0 ,0,	-1e18,1e18);
+CFloatParameter		ss_power_s(			"SS_POWER_S", 			CBaseParameter::RO, 0 ,0,	0,1e18);
+CFloatParameter		ss_power_pf(		"SS_POWER_PF", 			CBaseParameter::RO, 0 ,0,	-1,1);
+CFloatParameter		ss_power_thd_u(		"SS_POWER_THD_U", 		CBaseParameter::RO, 0 ,0,	0,1e6);
+CFloatParameter		ss_power_thd_i(		"SS_POWER_THD_I", 		CBaseParameter::RO, 0 ,0,	0,1e6);
+CFloatParameter		ss_power_wh(		"SS_POWER_WH", 			CBaseParameter::RO, 0 ,0,	-1e18,1e18);
+CFloatParameter		ss_power_varh(		"SS_POWER_VARH", 		CBaseParameter::RO, 0 ,0,	-1e18,1e18);
+CFloatSignal		ss_power_harm_u(	"SS_POWER_HARM_U", 		POWER_HARMONICS, 0.0f);
+CFloatSignal		ss_power_harm_i(	"SS_POWER_HARM_I", 		POWER_HARMONICS, 0.0f);
+
 CStreamingManager::Ptr s_manger;
 CStreamingApplication  *s_app;
 
 
 void PrintLogInFile(const char *message){
-#ifdef DEBUG_MODE
-	std::time_t result = std::time(nullptr);
-	std::fstream fs;
-  	fs.open ("/tmp/debug.log", std::fstream::in | std::fstream::out | std::fstream::app);
-	fs << std::asctime(std::localtime(&result)) << " : " << message << "\n";
-	fs.close();
-#endif
+	CEventRing::Message(CEventRing::MESSAGE, message);
 }
 
 //Application description
@@ -103,6 +242,9 @@ int rp_app_init(void)
 
 	ss_status.SendValue(0);
 	ss_acd_max.SendValue(MAX_FREQ);
+	// The rest is mapped on demand and keeps its state, the streaming FPGA owns the ADC
+	if (rp_InitEx(RP_INIT_CALIB) != RP_OK)
+		fprintf(stderr, "Error: rp_InitEx() failed, no calibration\n");
 	try {
 		CStreamingManager::MakeEmptyDir(FILE_PATH);
 	}catch (std::exception& e)
@@ -118,6 +260,7 @@ int rp_app_init(void)
 int rp_app_exit(void)
 {
 	StopServer(0);
+	rp_Release();
 	fprintf(stderr, "Unloading stream server version %s-%s.\n", VERSION_STR, REVISION_STR);
 	PrintLogInFile("Unloading stream server version");
 
@@ -142,10 +285,89 @@ int rp_get_signals(float ***s, int *sig_num, int *sig_len)
     return 0;
 }
 
+static int ClampStat(uint64_t _value){
+	return _value > INT_MAX ? INT_MAX : (int)_value;
+}
+
+void UpdateStats(){
+	static auto last = std::chrono::steady_clock::now();
+	static uint64_t last_bytes = 0;
+	auto now = std::chrono::steady_clock::now();
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last).count();
+	if (elapsed < CDataManager::GetInstance()->GetParamInterval())
+		return;
+	last = now;
+
+	std::lock_guard<std::mutex> lock(mut);
+	if (s_app == nullptr || s_manger == nullptr){
+		last_bytes = 0;
+		ss_trig_state.SendValue(0);
+		return;
+	}
+	// 1 - the pre-trigger window is filling, 2 - writing
+	ss_trig_state.SendValue(s_app->isTriggered() ? 2 : 1);
+	const StreamingStatsT &stats = s_app->getStats();
+	uint64_t bytes = s_manger->getSentBytes();
+	// A restarted server counts from zero again
+	uint64_t delta = bytes >= last_bytes ? bytes - last_bytes : bytes;
+	last_bytes = bytes;
+
+	ss_stat_segments.SendValue(ClampStat(stats.segments));
+	ss_stat_overflows.SendValue(ClampStat(stats.overflows));
+	ss_stat_lost.SendValue(ClampStat(stats.lostSegments));
+	ss_stat_ring_peak.SendValue(ClampStat(stats.ringPeak));
+	ss_stat_triggers.SendValue(ClampStat(stats.triggers));
+	ss_trig_sample.SendValue(stats.lastTrigger);
+	ss_stat_queue_peak.SendValue(ClampStat(s_manger->getQueuePeak()));
+	ss_stat_dropped.SendValue(ClampStat(s_manger->getDroppedPacks()));
+	ss_stat_throttled.SendValue(ClampStat(s_manger->getThrottledPacks()));
+	ss_stat_queue_mb.SendValue(s_manger->getQueuePeakBytes() / (1024.0 * 1024.0));
+	ss_stat_queue_full.SendValue(ClampStat(s_manger->getQueueOverflows()));
+	ss_stat_sent_mb.SendValue(bytes / (1024.0 * 1024.0));
+	ss_stat_rate_mb.SendValue(delta / (1024.0 * 1024.0) * 1000.0 / elapsed);
+	ss_stat_file_mb.SendValue(s_manger->getFileBytes() / (1024.0 * 1024.0));
+	ss_stat_file_lost_mb.SendValue(s_manger->getFileDroppedBytes() / (1024.0 * 1024.0));
+	const AdaptiveStateT &adapt = s_app->getAdaptiveState();
+	ss_adapt_rate.SendValue(adapt.rate);
+	ss_adapt_resolution.SendValue(adapt.resolution);
+	ss_adapt_compression.SendValue(adapt.compression);
+	ss_stat_send_p50.SendValue(ClampStat(stats.send.percentile(0.5)));
+	ss_stat_send_p99.SendValue(ClampStat(stats.send.percentile(0.99)));
+	ss_stat_total_p99.SendValue(ClampStat(stats.total.percentile(0.99)));
+
+	PowerResultT power;
+	if (s_app->getPowerResult(power) && power.sequence != (uint64_t)ss_power_seq.Value()){
+		ss_power_seq.SendValue(ClampStat(power.sequence));
+		ss_power_synced.SendValue(power.synced);
+		ss_power_lost.SendValue(ClampStat(power.lostWindows));
+		ss_power_f.SendValue(power.frequency);
+		ss_power_urms.SendValue(power.urms);
+		ss_power_irms.SendValue(power.irms);
+		ss_power_p.SendValue(power.p);
+		ss_power_q.SendValue(power.q);
+		ss_power_s.SendValue(power.s);
+		ss_power_pf.SendValue(power.pf);
+		ss_power_thd_u.SendValue(power.thdU);
+		ss_power_thd_i.SendValue(power.thdI);
+		ss_power_wh.SendValue(power.energyP);
+		ss_power_varh.SendValue(power.energyQ);
+		for (int h = 0; h < POWER_HARMONICS; h++){
+			ss_power_harm_u[h] = power.harmU[h];
+			ss_power_harm_i[h] = power.harmI[h];
+		}
+	}
+}
+
 //Update signals
 void UpdateSignals(void)
 {
-
+	try{
+		UpdateStats();
+	}catch (std::exception& e)
+	{
+		fprintf(stderr, "Error: UpdateSignals() %s\n",e.what());
+		PrintLogInFile(e.what());
+	}
 }
 
 
@@ -174,19 +396,377 @@ void UpdateParams(void)
 		ss_protocol.Update();
 	}
 
+	if (ss_udp_mtu.IsNewValue())
+	{
+		ss_udp_mtu.Update();
+	}
+
+	if (ss_tcp_zerocopy.IsNewValue())
+	{
+		ss_tcp_zerocopy.Update();
+	}
+
+	if (ss_adapt.IsNewValue())
+	{
+		ss_adapt.Update();
+	}
+
+	if (ss_ring_depth.IsNewValue())
+	{
+		ss_ring_depth.Update();
+	}
+
+	if (ss_dma_buf.IsNewValue())
+	{
+		ss_dma_buf.Update();
+	}
+
+	if (ss_osc_cpu.IsNewValue())
+	{
+		ss_osc_cpu.Update();
+	}
+
+	if (ss_osc_prio.IsNewValue())
+	{
+		ss_osc_prio.Update();
+	}
+
+	if (ss_net_cpu.IsNewValue())
+	{
+		ss_net_cpu.Update();
+	}
+
+	if (ss_net_prio.IsNewValue())
+	{
+		ss_net_prio.Update();
+	}
+
+	if (ss_file_cpu.IsNewValue())
+	{
+		ss_file_cpu.Update();
+	}
+
+	if (ss_file_prio.IsNewValue())
+	{
+		ss_file_prio.Update();
+	}
+
+	if (ss_file_depth.IsNewValue())
+	{
+		ss_file_depth.Update();
+	}
+
+	if (ss_file_segment.IsNewValue())
+	{
+		ss_file_segment.Update();
+	}
+
+	if (ss_file_copy.IsNewValue())
+	{
+		ss_file_copy.Update();
+	}
+
+	if (ss_file_interleaved.IsNewValue())
+	{
+		ss_file_interleaved.Update();
+	}
+
+	if (ss_file_index.IsNewValue())
+	{
+		ss_file_index.Update();
+	}
+
+	if (ss_file_rotate_mb.IsNewValue())
+	{
+		ss_file_rotate_mb.Update();
+	}
+
+	if (ss_file_rotate_sec.IsNewValue())
+	{
+		ss_file_rotate_sec.Update();
+	}
+
+	if (ss_file_budget_mb.IsNewValue())
+	{
+		ss_file_budget_mb.Update();
+	}
+
+	if (ss_pretrig_sec.IsNewValue())
+	{
+		ss_pretrig_sec.Update();
+	}
+
+	if (ss_trig_source.IsNewValue())
+	{
+		ss_trig_source.Update();
+	}
+
+	if (ss_trig_mode.IsNewValue())
+	{
+		ss_trig_mode.Update();
+	}
+
+	if (ss_trig_level.IsNewValue())
+	{
+		ss_trig_level.Update();
+	}
+
+	if (ss_trig_edge.IsNewValue())
+	{
+		ss_trig_edge.Update();
+	}
+
+	if (ss_trig_hyst.IsNewValue())
+	{
+		ss_trig_hyst.Update();
+	}
+
+	if (ss_trig_low.IsNewValue())
+	{
+		ss_trig_low.Update();
+	}
+
+	if (ss_trig_high.IsNewValue())
+	{
+		ss_trig_high.Update();
+	}
+
+	if (ss_trig_width_min.IsNewValue())
+	{
+		ss_trig_width_min.Update();
+	}
+
+	if (ss_trig_width_max.IsNewValue())
+	{
+		ss_trig_width_max.Update();
+	}
+
+	if (ss_trig_holdoff.IsNewValue())
+	{
+		ss_trig_holdoff.Update();
+	}
+
+	if (ss_posttrig_sec.IsNewValue())
+	{
+		ss_posttrig_sec.Update();
+	}
+
+	if (ss_board_id.IsNewValue())
+	{
+		ss_board_id.Update();
+	}
+
+	if (ss_sync.IsNewValue())
+	{
+		ss_sync.Update();
+	}
+
+	if (ss_trig_force.IsNewValue())
+	{
+		ss_trig_force.Update();
+		if (ss_trig_force.Value()){
+			std::lock_guard<std::mutex> lock(mut);
+			if (s_app != nullptr)
+				s_app->trigger();
+			ss_trig_force.SendValue(false);
+		}
+	}
+
+	if (ss_trace.IsNewValue())
+	{
+		ss_trace.Update();
+		CEventRing::SetEnabled(ss_trace.Value());
+	}
+
+	if (ss_trace_dump.IsNewValue())
+	{
+		ss_trace_dump.Update();
+		if (ss_trace_dump.Value()){
+			if (!CEventRing::DumpToFile(TRACE_PATH))
+				fprintf(stderr, "Error: can't write %s\n", TRACE_PATH);
+			ss_trace_dump.SendValue(false);
+		}
+	}
+
+	if (ss_lockin.IsNewValue())
+	{
+		ss_lockin.Update();
+	}
+
+	if (ss_lockin_input.IsNewValue())
+	{
+		ss_lockin_input.Update();
+	}
+
+	if (ss_lockin_freq.IsNewValue())
+	{
+		ss_lockin_freq.Update();
+	}
+
+	if (ss_lockin_phase.IsNewValue())
+	{
+		ss_lockin_phase.Update();
+	}
+
+	if (ss_lockin_tc.IsNewValue())
+	{
+		ss_lockin_tc.Update();
+	}
+
+	if (ss_lockin_order.IsNewValue())
+	{
+		ss_lockin_order.Update();
+	}
+
+	if (ss_lockin_dec.IsNewValue())
+	{
+		ss_lockin_dec.Update();
+	}
+
+	if (ss_lockin_output.IsNewValue())
+	{
+		ss_lockin_output.Update();
+	}
+
+	if (ss_spectrum.IsNewValue())
+	{
+		ss_spectrum.Update();
+	}
+
+	if (ss_spectrum_fft.IsNewValue())
+	{
+		ss_spectrum_fft.Update();
+	}
+
+	if (ss_spectrum_window.IsNewValue())
+	{
+		ss_spectrum_window.Update();
+	}
+
+	if (ss_spectrum_rate.IsNewValue())
+	{
+		ss_spectrum_rate.Update();
+	}
+
+	if (ss_ddc.IsNewValue())
+	{
+		ss_ddc.Update();
+	}
+
+	if (ss_ddc_input.IsNewValue())
+	{
+		ss_ddc_input.Update();
+	}
+
+	if (ss_ddc_freq.IsNewValue())
+	{
+		ss_ddc_freq.Update();
+	}
+
+	if (ss_ddc_dec.IsNewValue())
+	{
+		ss_ddc_dec.Update();
+	}
+
+	if (ss_ddc_taps.IsNewValue())
+	{
+		ss_ddc_taps.Update();
+	}
+
+	if (ss_ddc_cutoff.IsNewValue())
+	{
+		ss_ddc_cutoff.Update();
+	}
+
+	if (ss_volts.IsNewValue())
+	{
+		ss_volts.Update();
+	}
+
+	if (ss_dec.IsNewValue())
+	{
+		ss_dec.Update();
+	}
+
+	if (ss_dec_factor.IsNewValue())
+	{
+		ss_dec_factor.Update();
+	}
+
+	if (ss_dec_filter.IsNewValue())
+	{
+		ss_dec_filter.Update();
+	}
+
+	if (ss_dec_taps.IsNewValue())
+	{
+		ss_dec_taps.Update();
+	}
+
+	if (ss_dec_cutoff.IsNewValue())
+	{
+		ss_dec_cutoff.Update();
+	}
+
+	if (ss_power.IsNewValue())
+	{
+		ss_power.Update();
+	}
+
+	if (ss_power_freq.IsNewValue())
+	{
+		ss_power_freq.Update();
+	}
+
+	if (ss_power_u_scale.IsNewValue())
+	{
+		ss_power_u_scale.Update();
+	}
+
+	if (ss_power_i_scale.IsNewValue())
+	{
+		ss_power_i_scale.Update();
+	}
+
+	if (ss_power_aggregate.IsNewValue())
+	{
+		ss_power_aggregate.Update();
+	}
+
+	bool reconfigure = false;
 	if (ss_channels.IsNewValue())
 	{
 		ss_channels.Update();
+		reconfigure = true;
 	}
 
 	if (ss_resolution.IsNewValue())
 	{
 		ss_resolution.Update();
+		reconfigure = true;
+	}
+
+	if (ss_compression.IsNewValue())
+	{
+		ss_compression.Update();
 	}
 
 	if (ss_rate.IsNewValue())
 	{
 		ss_rate.Update();
+		reconfigure = true;
+	}
+
+	// A running plain stream takes them between two buffers, the socket and
+	// the file stay open. Otherwise they apply with the next start.
+	if (reconfigure)
+	{
+		int resolution_val = (ss_resolution.Value() == SS_8BIT ? 8 : 16);
+		if (ss_resolution.Value() == SS_PACKED && ss_use_localfile.Value() == false && ss_file_copy.Value() == false)
+			resolution_val = ADC_PACKED_BITS;
+		std::lock_guard<std::mutex> lock(mut);
+		if (s_app != nullptr && !s_app->reconfigure(ss_rate.Value(), ss_channels.Value(), resolution_val))
+			PrintLogInFile("Reconfiguration refused, applies with the next start");
 	}
 
 	if (ss_format.IsNewValue())
@@ -237,12 +817,85 @@ void StartServer(){
 	try{
 
 	auto resolution = ss_resolution.Value();
+	auto compression = ss_compression.Value();
 	auto format = ss_format.Value();
 	auto sock_port = ss_port.Value();
 	auto use_file = ss_use_localfile.Value();
 	auto protocol = ss_protocol.Value();
+	auto udp_mtu = ss_udp_mtu.Value();
+	auto ring_depth = ss_ring_depth.Value();
+	ThreadSchedT osc_sched(ss_osc_cpu.Value(), ss_osc_prio.Value());
+	ThreadSchedT net_sched(ss_net_cpu.Value(), ss_net_prio.Value());
+	ThreadSchedT file_sched(ss_file_cpu.Value(), ss_file_prio.Value());
+	TriggerT trig_condition((TriggerT::Mode)ss_trig_mode.Value(),
+							TriggerT::ANY,
+							ss_trig_edge.Value() == 0,
+							ss_trig_level.Value());
+	trig_condition.hysteresis = ss_trig_hyst.Value();
+	trig_condition.low = MIN(ss_trig_low.Value(), ss_trig_high.Value());
+	trig_condition.high = MAX(ss_trig_low.Value(), ss_trig_high.Value());
+	trig_condition.minWidth = ss_trig_width_min.Value();
+	trig_condition.maxWidth = ss_trig_width_max.Value();
+	trig_condition.holdoff = ss_trig_holdoff.Value();
+	PreTriggerT pre_trigger(ss_pretrig_sec.Value(),
+							(PreTriggerT::Source)ss_trig_source.Value(),
+							trig_condition,
+							ss_posttrig_sec.Value());
 	auto channel = ss_channels.Value();
 	auto rate = ss_rate.Value();
+	// rp_GenFreq() rounds to the DDS step, the reference must not drift against it
+	double lockin_freq = round(ss_lockin_freq.Value() * GEN_DDS_RANGE / MAX_FREQ) * MAX_FREQ / GEN_DDS_RANGE;
+	LockInT lock_in(ss_lockin.Value(),
+					ss_lockin_input.Value(),
+					lockin_freq,
+					ss_lockin_phase.Value(),
+					ss_lockin_tc.Value(),
+					ss_lockin_order.Value(),
+					ss_lockin_dec.Value(),
+					ss_lockin_output.Value() == 1);
+	// Only the demodulated input is acquired
+	if (lock_in.enable)
+		channel = lock_in.channel;
+	SpectrumT spectrum(ss_spectrum.Value() && !lock_in.enable,
+					   ss_spectrum_fft.Value(),
+					   (SpectrumT::Window)ss_spectrum_window.Value(),
+					   ss_spectrum_rate.Value());
+	DdcT ddc(ss_ddc.Value() && !lock_in.enable && !spectrum.enable,
+			 ss_ddc_input.Value(),
+			 ss_ddc_freq.Value(),
+			 ss_ddc_dec.Value(),
+			 ss_ddc_taps.Value(),
+			 ss_ddc_cutoff.Value());
+	if (ddc.enable)
+		channel = ddc.channel;
+	// Spectra and IQ replace the samples, the other converters see none
+	bool derived = lock_in.enable || spectrum.enable || ddc.enable;
+	// Snapshot of the gains and calibration of the inputs, used for the whole run
+	CalibrationT calibration;
+	rp_acq_readout_t readout;
+	if (rp_AcqPrepareReadout(&readout) == RP_OK){
+		// The DMA words hold the ADC counts left aligned
+		const double word = 1 << (16 - ADC_PACKED_BITS);
+		for (int i = 0; i < 2; i++){
+			calibration.scale[i] = readout.scale[i] / word;
+			calibration.offset[i] = readout.dc_offs[i] * word;
+		}
+		calibration.valid = true;
+	}
+	bool volts = ss_volts.Value() && !derived && calibration.valid;
+	DecimatorT decimator(ss_dec.Value() && !derived,
+						 ss_dec_factor.Value(),
+						 (DecimatorT::Filter)ss_dec_filter.Value(),
+						 ss_dec_taps.Value(),
+						 ss_dec_cutoff.Value());
+	PowerMeterT power(ss_power.Value() && !lock_in.enable,
+					  ss_power_freq.Value(),
+					  ss_power_u_scale.Value(),
+					  ss_power_i_scale.Value(),
+					  ss_power_aggregate.Value());
+	// U and I are both needed, the stream carries them as well
+	if (power.enable)
+		channel = SS_BOTH;
 	auto ip_addr_host = ss_ip_addr.Value();
 
 	std::vector<UioT> uioList = GetUioList();
@@ -265,32 +918,77 @@ void StartServer(){
 		if (uio.nodeName == "rp_oscilloscope")
 		{
 			// TODO start server;
-			osc = COscilloscope::Create(uio, (channel ==1 || channel == 3) , (channel ==2 || channel == 3) , rate);
+			osc = COscilloscope::Create(uio, (channel ==1 || channel == 3) , (channel ==2 || channel == 3) , rate, ss_dma_buf.Value());
 			break;
 		}
 	}
 
-	CStreamingManager::Ptr s_manger = nullptr;
+	std::lock_guard<std::mutex> lock(mut);
+	s_manger = nullptr;
+	auto file_type = (format == 0 ? Stream_FileType::WAV_TYPE : format == 2 ? Stream_FileType::RAW_TYPE : Stream_FileType::TDMS_TYPE);
+	// The local copy does not stop the network stream when the writer fails
+	bool file_copy = ss_file_copy.Value() && use_file == false;
 	if (use_file == false) {
-		s_manger = CStreamingManager::Create(
-				ip_addr_host,
-				std::to_string(sock_port).c_str(),
-				protocol == 1 ? asionet::Protocol::TCP : asionet::Protocol::UDP);
+		auto net_protocol = protocol == 1 ? asionet::Protocol::TCP : asionet::Protocol::UDP;
+		if (file_copy)
+			s_manger = CStreamingManager::Create(file_type, FILE_PATH, ip_addr_host, std::to_string(sock_port).c_str(), net_protocol);
+		else
+			s_manger = CStreamingManager::Create(ip_addr_host, std::to_string(sock_port).c_str(), net_protocol);
+		s_manger->setCompression(compression == 1 ? DELTA_COMPRESSION : NONE_COMPRESSION);
+		s_manger->setMTU(udp_mtu);
+		s_manger->setNetThreadSched(net_sched);
+		s_manger->setZeroCopy(ss_tcp_zerocopy.Value());
 	}else{
-		s_manger = CStreamingManager::Create((format == 0 ? Stream_FileType::WAV_TYPE: Stream_FileType::TDMS_TYPE) , FILE_PATH);
+		s_manger = CStreamingManager::Create(file_type , FILE_PATH);
 		s_manger->notifyStop = [](int status)
 							{
 								StopNonBlocking(2);
 							};
 	}
+	if (use_file || file_copy){
+		s_manger->setFileThreadSched(file_sched);
+		s_manger->setFileWriteBehind(ss_file_depth.Value());
+		s_manger->setFileTDMSSegment(ss_file_segment.Value());
+		s_manger->setFileTDMSInterleaved(ss_file_interleaved.Value());
+		s_manger->setFileTDMSIndex(ss_file_index.Value());
+		s_manger->setFileRotation(ss_file_rotate_mb.Value(), ss_file_rotate_sec.Value());
+		s_manger->setFileMemoryBudget(ss_file_budget_mb.Value());
+		s_manger->setFileCalibration(calibration, volts);
+	}
 
 
 	if (s_app!= nullptr){
 		s_app->stop();
 		delete s_app;
 	}
-	int resolution_val = (resolution == 1 ? 8 : 16);
+	int resolution_val = (resolution == SS_8BIT ? 8 : 16);
+	// Packed samples only go over the network, the client expands them before writing files
+	if (resolution == SS_PACKED && use_file == false && file_copy == false)
+		resolution_val = ADC_PACKED_BITS;
+	if (lock_in.enable)
+		resolution_val = LOCKIN_RESOLUTION;
+	if (spectrum.enable)
+		resolution_val = SPECTRUM_RESOLUTION;
+	if (ddc.enable)
+		resolution_val = DDC_RESOLUTION;
+	if (volts)
+		resolution_val = VOLTS_RESOLUTION;
 	s_app = new CStreamingApplication(s_manger, osc, resolution_val, rate, channel);
+	s_app->setBufferRingDepth(ring_depth);
+	s_app->setOscThreadSched(osc_sched);
+	// The synchronized network stream waits for the trigger like a capture
+	bool sync = ss_sync.Value() && use_file == false;
+	if (use_file || sync)
+		s_app->setPreTrigger(pre_trigger);
+	s_app->setSync(sync);
+	asionet::CAsioNet::SetBoardId(ss_board_id.Value());
+	s_app->setLockIn(lock_in);
+	s_app->setSpectrum(spectrum);
+	s_app->setDdc(ddc);
+	s_app->setVolts(volts, calibration);
+	s_app->setDecimator(decimator);
+	s_app->setPowerMeter(power);
+	s_app->setAdaptive(ss_adapt.Value());
 	ss_status.SendValue(1);
 	PrintLogInFile("ss_status.SendValue(1)");
     s_app->runNonBlock();
@@ -315,12 +1013,14 @@ void StopNonBlocking(int x){
 
 void StopServer(int x){
 	try{
+		std::lock_guard<std::mutex> lock(mut);
 		if (s_app!= nullptr)
 		{
 			s_app->stop();
 			delete s_app;
 			s_app = nullptr;
 		}
+		s_manger = nullptr;
 		ss_status.SendValue(x);
 	}catch (std::exception& e)
 	{
@@ -94,7 +94,7 @@ void UsingArgs(char const* progName){
     std::cout << "\t-h IP_ADDRESS:[port] (default value 8900)\n";
     std::cout << "\t-p Protocol (TCP or UDP required value)\n";
     std::cout << "\t-f Path to the directory where to save files\n";
-    std::cout << "\t-t Type of file (tdms or wav required value)\n";
+    std::cout << "\t-t Type of file (tdms, wav or raw required value)\n";
 
 
 }
@@ -132,16 +132,17 @@ void reciveData(std::error_code error,uint8_t *buff,size_t _size){
      size_t   size_ch2 = 0;
      uint64_t id = 0;
      uint64_t lostRate = 0;
+     uint64_t sampleId = 0;
      uint32_t oscRate = 0;
      uint32_t resolution = 0;
-     asionet::CAsioNet::ExtractPack(buff,_size, id, lostRate,oscRate, resolution, ch1, size_ch1, ch2 , size_ch2);
+     asionet::CAsioNet::ExtractPack(buff,_size, id, lostRate, sampleId, oscRate, resolution, ch1, size_ch1, ch2 , size_ch2);
 
-     g_packCounter_ch1 += size_ch1 / (resolution == 16 ? 2 : 1);
-     g_packCounter_ch2 += size_ch2 / (resolution == 16 ? 2 : 1);
+     g_packCounter_ch1 += size_ch1 / SAMPLE_SIZE(resolution);
+     g_packCounter_ch2 += size_ch2 / SAMPLE_SIZE(resolution);
      g_lostRate += lostRate;
 
 
-     g_manger->passBuffers(lostRate, oscRate, ch1 , size_ch1 ,  ch2 , size_ch2 , resolution, id);
+     g_manger->passBuffers(lostRate, oscRate, ch1 , size_ch1 ,  ch2 , size_ch2 , resolution, id, sampleId);
 
 
 //     std::cout << id << " ; " <<  _size  <<  " ; " << resolution << " ; " << size_ch1 << " ; " << size_ch2 << "\n";
@@ -157,7 +158,9 @@ void reciveData(std::error_code error,uint8_t *buff,size_t _size){
      if ((value.count() - g_timeBegin) >= 5000) {
 
          std::cout << time_point_to_string(timeNow) << " bandwidth: " << g_BytesCount / (1024 * 1024 * 5) << " MiB/s;\nData count ch1:\t" << g_packCounter_ch1
-                 << " ch2:\t" << g_packCounter_ch2 <<  " Lost: \t"<< g_lostRate << "\n\n";
+                 << " ch2:\t" << g_packCounter_ch2 <<  " Lost: \t"<< g_lostRate
+                 << " Lost packs: \t" << g_asionet->GetLostPacks()
+                 << " Gap samples: \t" << g_manger->getGapSamples() << "\n\n";
          g_BytesCount = 0;
          g_lostRate = 0;
          g_timeBegin = value.count();
@@ -229,8 +232,8 @@ int main(int argc, char* argv[])
 
 
 
-        g_manger = CStreamingManager::Create((strcmp(type_file,"wav") == 0 ?
-                                              Stream_FileType::WAV_TYPE : Stream_FileType::TDMS_TYPE)  , filepath);
+        g_manger = CStreamingManager::Create((strcmp(type_file,"wav") == 0 ? Stream_FileType::WAV_TYPE :
+                                              strcmp(type_file,"raw") == 0 ? Stream_FileType::RAW_TYPE : Stream_FileType::TDMS_TYPE)  , filepath);
 
         g_manger->run();
 
@@ -242,6 +245,9 @@ int main(int argc, char* argv[])
                                            sigHandler(0);
                                        });
         g_asionet->addCallReceived(reciveData);
+        // The packs go straight into the file queue, its free room is what the server may send
+        if (protocol_val == asionet::Protocol::TCP)
+            g_asionet->SetCreditSource([]() { return g_manger->getFileFreeBytes(); });
         g_asionet->Start();
         while(g_manger->isFileThreadWork() &&  !g_terminate){
 #ifdef _WIN32
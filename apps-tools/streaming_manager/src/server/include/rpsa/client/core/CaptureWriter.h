@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CAPTURE_BLOCK_SIZE  (4 * 1024 * 1024)
+#define CAPTURE_BLOCK_COUNT 8
+// O_DIRECT wants the buffer, the offset and the size on this boundary
+#define CAPTURE_BLOCK_ALIGN 4096
+
+//!
+//! \brief Appends data to a file in large aligned blocks.
+//!
+//! write() only copies into the current block, full blocks are written by
+//! a background thread. The page cache is bypassed with O_DIRECT where the
+//! file system allows it. When every block is in flight write() waits, so
+//! a slow disk pushes back on the receiver instead of growing memory.
+//!
+class CCaptureWriter
+{
+public:
+    using Ptr = std::shared_ptr<CCaptureWriter>;
+
+    static Ptr Create(const std::string &_path);
+    CCaptureWriter(const std::string &_path);
+    ~CCaptureWriter();
+
+    bool     open();
+    bool     write(const void *_data, size_t _size);
+    // Writes the last partial block and trims the padding
+    void     close();
+    uint64_t writtenBytes() const { return m_written; }
+    bool     hasError() const { return m_error; }
+
+private:
+    CCaptureWriter(const CCaptureWriter &) = delete;
+    CCaptureWriter(CCaptureWriter &&) = delete;
+
+    struct Block {
+        uint8_t *data;
+        size_t   size;
+    };
+
+    void  task();
+    bool  writeBlock(const Block &_block);
+    Block acquireBlock();
+
+    std::string        m_path;
+    int                m_fd;
+    bool               m_direct;
+    std::vector<uint8_t*> m_memory;
+    std::deque<Block>  m_free;
+    std::deque<Block>  m_full;
+    Block              m_current;
+    std::mutex         m_mutex;
+    std::condition_variable m_cond;
+    std::thread        m_thread;
+    bool               m_run;
+    std::atomic<bool>  m_error;
+    std::atomic<uint64_t> m_written;
+};
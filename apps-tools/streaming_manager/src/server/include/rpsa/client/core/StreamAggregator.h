@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rpsa/client/core/rpsa_receiver.h"
+#include "rpsa/client/core/StreamReceiver.h"
+#include "rpsa/client/core/CaptureWriter.h"
+
+// Samples per board channel in one TDMS segment
+#define AGGREGATOR_DEFAULT_BLOCK   65536
+// Samples the boards furthest ahead may wait for a stalled one before it is filled with zeros
+#define AGGREGATOR_DEFAULT_MAX_LAG (8 * 1024 * 1024)
+
+//!
+//! \brief Lines up the streams of several boards and writes them to one TDMS file.
+//!
+//! Every board gets its own CStreamReceiver. The packs are decoded and
+//! queued per board under their sample id, a block is written once every
+//! board has it. Boards streaming with SS_SYNC count their sample ids from
+//! the shared first trigger, so the ids of the same instant are equal on
+//! all of them. Boards without it are lined up at their first pack, which
+//! is only as good as the network latency.
+//!
+//! Samples missing on a board are written as zeros and the segment gets a
+//! "gap_samples" property on the channels of that board. A board that falls
+//! more than the lag limit behind the others is filled with zeros as well,
+//! so one stalled board does not stop the file; what it sends for that
+//! time later is dropped as late. The lag between the boards and its drift
+//! against the samples written are kept per board, a board that is not on
+//! the shared clock drifts.
+//!
+//! The group "Aggregate" has a channel board<N>_ch1 / board<N>_ch2 per
+//! board N and channel, in the order the boards were added. The channels
+//! carry the board id from the packs and the host.
+//!
+class CStreamAggregator
+{
+public:
+    using Ptr = std::shared_ptr<CStreamAggregator>;
+
+    static Ptr Create(const std::string &_path, size_t _blockSamples = AGGREGATOR_DEFAULT_BLOCK, uint64_t _maxLag = AGGREGATOR_DEFAULT_MAX_LAG);
+    CStreamAggregator(const std::string &_path, size_t _blockSamples, uint64_t _maxLag);
+    ~CStreamAggregator();
+
+    // Set before start(), returns the index of the board
+    int  addBoard(const std::string &_host, const std::string &_port, int _protocol, size_t _ringSize = RECEIVER_DEFAULT_RING_SIZE);
+
+    bool start();
+    // Writes what all boards have and closes the file
+    void stop();
+    size_t boards() const { return m_boards.size(); }
+    void getStats(rpsa_aggregator_stats_t &_stats);
+    bool getBoardStats(size_t _board, rpsa_aggregator_board_stats_t &_stats);
+
+private:
+    CStreamAggregator(const CStreamAggregator &) = delete;
+    CStreamAggregator(CStreamAggregator &&) = delete;
+
+    // Decoded samples from _first on, a run without data is a gap of zeros
+    struct Run {
+        uint64_t first;
+        uint64_t count;
+        size_t   offset; // Samples already written
+        std::vector<uint8_t> data[2];
+    };
+
+    struct Board {
+        std::string         host;
+        CStreamReceiver::Ptr receiver;
+        bool                started;
+        bool                channel[2];
+        uint64_t            offset;   // Subtracted from the sample ids of the board
+        uint64_t            end;      // Aligned id after the newest queued sample
+        uint64_t            received; // Same, without the zeros filled in for it
+        uint64_t            base;     // received when the file started
+        uint64_t            gapInBlock;
+        std::deque<Run>     runs;
+        std::vector<std::vector<uint8_t>> spare;
+        rpsa_aggregator_board_stats_t stats;
+    };
+
+    void handlePack(size_t _board, const rpsa_pack_t &_pack);
+    void queueZeros(Board &_board, uint64_t _count);
+    void trimBefore(Board &_board, uint64_t _id);
+    void emit(bool _flush);
+    void copyBlock(Board &_board, uint64_t _samples);
+    bool writeSegment(uint64_t _samples);
+
+    std::string         m_path;
+    size_t              m_blockSamples;
+    uint64_t            m_maxLag;
+    std::vector<std::unique_ptr<Board>> m_boards;
+    std::mutex          m_mutex;
+    CCaptureWriter::Ptr m_file;
+
+    bool                m_formatValid;
+    uint32_t            m_oscRate;
+    uint32_t            m_resolution;
+    size_t              m_sampleSize;
+    bool                m_running;     // Every board sent its first pack
+    uint64_t            m_next;        // Aligned id of the next sample written
+    uint64_t            m_lastCount;   // Samples per channel in the last segment with metadata
+    std::vector<uint8_t> m_frame;
+    std::vector<uint8_t> m_segment;
+    rpsa_aggregator_stats_t m_stats;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <asio.hpp>
+
+#include "rpsa/client/core/rpsa_receiver.h"
+#include "rpsa/client/core/CaptureWriter.h"
+
+#define RECEIVER_DEFAULT_RING_SIZE (32 * 1024 * 1024)
+// A TCP read always has room for at least this much, and no pack is larger
+#define RECEIVER_MAX_PACK_SIZE     (1024 * 1024)
+#define RECEIVER_UDP_SOCKET_BUFFER (16 * 1024 * 1024)
+
+//!
+//! \brief Receives the stream of one board and parses packs in place.
+//!
+//! TCP reads land straight in a large receive ring and every complete pack
+//! there is handed out as a view, nothing is copied or allocated per pack.
+//! Only the unfinished tail of the ring moves back to the front when the
+//! end is reached. UDP datagrams are parsed where they were received.
+//!
+class CStreamReceiver
+{
+public:
+    using Ptr = std::shared_ptr<CStreamReceiver>;
+    //! The view is valid only during the call, it runs on the receiver thread
+    typedef std::function<void(const rpsa_pack_t &_pack)> PackHandler;
+
+    static Ptr Create(const std::string &_host, const std::string &_port, int _protocol, size_t _ringSize = RECEIVER_DEFAULT_RING_SIZE);
+    CStreamReceiver(const std::string &_host, const std::string &_port, int _protocol, size_t _ringSize);
+    ~CStreamReceiver();
+
+    // Set before start()
+    void setHandler(PackHandler _handler);
+    bool setCaptureFile(const std::string &_path);
+
+    bool start();
+    void stop();
+    void getStats(rpsa_receiver_stats_t &_stats) const;
+
+    static size_t parsePack(const uint8_t *_buffer, size_t _size, rpsa_pack_t &_pack);
+    static size_t decodeChannel(const rpsa_pack_t &_pack, int _channel, void *_dst, size_t _capacity);
+
+private:
+    CStreamReceiver(const CStreamReceiver &) = delete;
+    CStreamReceiver(CStreamReceiver &&) = delete;
+
+    void startRead();
+    void handleTcpRead(const asio::error_code &_error, size_t _size);
+    void handleUdpRead(const asio::error_code &_error, size_t _size);
+    void handlePack(const rpsa_pack_t &_pack);
+
+    std::string        m_host;
+    std::string        m_port;
+    int                m_protocol;
+    asio::io_service   m_ios;
+    asio::ip::tcp::socket m_tcp;
+    asio::ip::udp::socket m_udp;
+    asio::ip::udp::endpoint m_udpEndpoint;
+    std::thread        m_thread;
+
+    uint8_t           *m_memory;
+    uint8_t           *m_ring;
+    size_t             m_ringSize;
+    size_t             m_readPos;  // First byte not parsed yet
+    size_t             m_writePos; // End of the received data
+
+    PackHandler        m_handler;
+    CCaptureWriter::Ptr m_capture;
+
+    bool               m_first;
+    uint64_t           m_nextId;
+    uint64_t           m_nextSampleId;
+    std::atomic<uint64_t> m_bytes;
+    std::atomic<uint64_t> m_packs;
+    std::atomic<uint64_t> m_lostPacks;
+    std::atomic<uint64_t> m_gapSamples;
+    std::atomic<uint64_t> m_broken;
+};
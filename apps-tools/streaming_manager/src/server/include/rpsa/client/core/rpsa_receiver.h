@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RPSA_PROTOCOL_TCP 1
+#define RPSA_PROTOCOL_UDP 2
+
+// Every pack starts with this header, the magic ends with the format version
+#define RPSA_PACK_HEADER_SIZE 64
+#define RPSA_PACK_MAGIC_PREFIX "STREAMpackIDv2."
+#define RPSA_PACK_MAGIC_PREFIX_SIZE 15
+// Header word 13: the SS_BOARD_ID of the server, the payload type and a
+// flag for sample ids counted from the first trigger, see SS_SYNC
+#define RPSA_PACK_BOARD_MASK   0xFFFFu
+#define RPSA_PACK_BOARD_SYNCED 0x80000000u
+#define RPSA_PACK_PAYLOAD_MASK  0x00FF0000u
+#define RPSA_PACK_PAYLOAD_SHIFT 16
+// Samples, also the lock-in outputs and the default of older servers
+#define RPSA_PACK_PAYLOAD_SAMPLES  0
+// Power spectra in dBFS, fft size / 2 float bins per frame from DC up. osc_rate
+// stays the input decimation, so the bin width is 125 MHz / osc_rate / fft size,
+// and sample_id counts bins: frame n starts at n * bins.
+#define RPSA_PACK_PAYLOAD_SPECTRUM 1
+// Complex baseband, float I on ch1 and Q on ch2 in units of the ADC full scale
+#define RPSA_PACK_PAYLOAD_IQ       2
+// Sample id of the first trigger in synchronized packs
+#define RPSA_PACK_SYNC_ORIGIN  (1ULL << 48)
+// Trailer after the channel data: CLOCK_REALTIME ns of the first sample,
+// its error bound and RPSA_PACK_TIME_* flags. Servers before it send none.
+#define RPSA_PACK_TRAILER_SIZE 16
+#define RPSA_PACK_TIME_VALID   0x1u
+#define RPSA_PACK_TIME_SYNCED  0x2u // The board clock is disciplined by NTP or PTP
+
+//!
+//! \brief One stream pack, parsed in place.
+//!
+//! ch1 and ch2 point into the receive buffer and are only valid inside the
+//! pack callback. Compressed channels hold the encoded bytes and packed
+//! 12/14-bit channels the packed bits; rpsa_decode_channel() expands both.
+//!
+typedef struct rpsa_pack {
+    uint64_t       id;
+    uint64_t       lost_rate;   // DMA segments lost on the board before this pack
+    uint64_t       sample_id;   // Absolute index of the first sample
+    uint32_t       osc_rate;
+    uint32_t       resolution;  // 8, 12, 14 or 16 bits, 32 for the float lock-in, spectrum and IQ outputs
+    uint32_t       compressed;
+    uint32_t       samples;     // Samples per channel
+    const uint8_t *ch1;
+    size_t         size_ch1;
+    const uint8_t *ch2;
+    size_t         size_ch2;
+    size_t         size;        // Whole pack with its header
+    uint32_t       board;       // SS_BOARD_ID of the server
+    uint32_t       synced;      // sample_id counts from RPSA_PACK_SYNC_ORIGIN at the first trigger
+    uint32_t       payload;     // RPSA_PACK_PAYLOAD_*
+    int64_t        time_ns;     // Board CLOCK_REALTIME of the first sample, 0 without RPSA_PACK_TIME_VALID
+    uint32_t       time_error_ns;
+    uint32_t       time_flags;
+} rpsa_pack_t;
+
+typedef struct rpsa_receiver_stats {
+    uint64_t bytes;
+    uint64_t packs;
+    uint64_t lost_packs;   // Packs missing from the pack id sequence
+    uint64_t gap_samples;  // Samples missing from the sample_id sequence
+    uint64_t broken;       // Bytes skipped to find the next pack header
+    uint64_t written;      // Bytes in the capture file
+} rpsa_receiver_stats_t;
+
+typedef struct rpsa_aggregator_board_stats {
+    uint32_t board;         // Board id from the packs
+    uint32_t synced;
+    uint64_t packs;
+    uint64_t lost_packs;    // Packs missing from the pack id sequence
+    uint64_t gap_samples;   // Written as zeros, lost on the way or the board stalled
+    uint64_t late_samples;  // Came after their place was written, dropped
+    uint64_t dropped_samples; // Before the first sample of the file, dropped
+    uint64_t mismatched;    // Packs with another rate or resolution than the first, dropped
+    int64_t  lag;           // Samples behind the board furthest ahead
+    double   drift_ppm;     // Samples received against the first board since the file started
+} rpsa_aggregator_board_stats_t;
+
+typedef struct rpsa_aggregator_stats {
+    uint32_t boards;
+    uint32_t channels;      // In the file
+    uint64_t samples;       // Per channel in the file
+    uint64_t segments;
+    uint64_t written;       // Bytes in the file
+} rpsa_aggregator_stats_t;
+
+typedef struct rpsa_receiver rpsa_receiver_t;
+typedef struct rpsa_aggregator rpsa_aggregator_t;
+typedef void (*rpsa_pack_callback_t)(const rpsa_pack_t *pack, void *user);
+
+//! Returns the pack size, or 0 if _buffer does not start with a complete pack
+size_t rpsa_parse_pack(const uint8_t *buffer, size_t size, rpsa_pack_t *pack);
+//! Expands channel 1 or 2 to 8 or 16-bit samples, returns the size written or 0
+size_t rpsa_decode_channel(const rpsa_pack_t *pack, int channel, void *dst, size_t capacity);
+
+//! ring_size 0 takes the default. Returns NULL on bad arguments.
+rpsa_receiver_t *rpsa_receiver_create(const char *host, const char *port, int protocol, size_t ring_size);
+void rpsa_receiver_destroy(rpsa_receiver_t *receiver);
+//! Called on the receiver thread for every pack, set before start
+void rpsa_receiver_set_callback(rpsa_receiver_t *receiver, rpsa_pack_callback_t callback, void *user);
+//! Every pack is appended verbatim to the file, set before start. Returns 0 on success.
+int  rpsa_receiver_set_capture_file(rpsa_receiver_t *receiver, const char *path);
+int  rpsa_receiver_start(rpsa_receiver_t *receiver);
+void rpsa_receiver_stop(rpsa_receiver_t *receiver);
+void rpsa_receiver_get_stats(rpsa_receiver_t *receiver, rpsa_receiver_stats_t *stats);
+
+//! Streams of several boards lined up by sample id in one TDMS file.
+//! block_samples and max_lag 0 take the defaults. Returns NULL on bad arguments.
+rpsa_aggregator_t *rpsa_aggregator_create(const char *path, size_t block_samples, uint64_t max_lag);
+void rpsa_aggregator_destroy(rpsa_aggregator_t *aggregator);
+//! Set before start, returns the index of the board or -1
+int  rpsa_aggregator_add_board(rpsa_aggregator_t *aggregator, const char *host, const char *port, int protocol, size_t ring_size);
+int  rpsa_aggregator_start(rpsa_aggregator_t *aggregator);
+void rpsa_aggregator_stop(rpsa_aggregator_t *aggregator);
+void rpsa_aggregator_get_stats(rpsa_aggregator_t *aggregator, rpsa_aggregator_stats_t *stats);
+//! Returns 0, or -1 for a board index out of range
+int  rpsa_aggregator_get_board_stats(rpsa_aggregator_t *aggregator, size_t board, rpsa_aggregator_board_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,104 +1,133 @@
-#pragma once
-
-#include <stdint.h>
-#include <vector>
-#include <stdexcept>
-#include <string>
-#include <cstring>
-#include <memory>
-#include <iostream>
-
-using namespace std;
-
-namespace TDMS
-{
-	class DataType
-	{
-	public:
-	    struct Raw{
-	        uint8_t *data;
-	        long     size;
-            Raw():
-			data(nullptr),
-			size(0){                
-            }
-
-	        ~Raw(){
-            	delete []  data;
-	        }
-	    };
-
-		static const uint32_t Empty = 0x0000000F;
-		static const uint32_t Void = 0x00000000;
-		static const uint32_t Integer8 = 0x00000001;
-		static const uint32_t Integer16 = 0x00000002;
-		static const uint32_t Integer32 = 0x00000003;
-		static const uint32_t Integer64 = 0x00000004;
-		static const uint32_t UnsignedInteger8 = 0x00000005;
-		static const uint32_t UnsignedInteger16 = 0x00000006;
-		static const uint32_t UnsignedInteger32 = 0x00000007;
-		static const uint32_t UnsignedInteger64 = 0x00000008;
-		static const uint32_t SingleFloat = 0x00000009;
-		static const uint32_t DoubleFloat = 0x0000000A;
-		static const uint32_t ExtendedFloat = 0x0000000B;
-		static const uint32_t SingleFloatWithUnit = 0x00000019;
-		static const uint32_t DoubleFloatWithUnit = 0x0000001A;
-		static const uint32_t ExtendedFloatWithUnit = 0x0000001B;
-		static const uint32_t String = 0x00000020;
-		static const uint32_t Boolean = 0x00000021;
-		static const uint32_t TimeStamp = 0x00000044;
-	
-	protected:
-		uint32_t m_dataType;
-		uint32_t m_dataStringLenght;
-		void *m_rawData;
-        std::vector<std::shared_ptr<DataType::Raw>> m_vectorData;
-	protected:
-
-	public:
-
-		DataType();
-		~DataType();
-        void DestroyVector();
-		DataType(const DataType& tmp);
-		DataType& operator=(const DataType& tmp);
-		DataType(DataType&& tmp);
-		DataType& operator=(DataType&& tmp);
-
-		           void InitDataType(uint32_t dataType, void *rawData);
-                   void InitDataType(uint32_t dataType, std::vector<std::shared_ptr<DataType::Raw>> vec);
-				   void InitStringType(uint32_t length, void *rawData);
-				   void InitRaw(uint32_t dataType,uint64_t count,void *rawData);
-		   	   uint32_t GetDataType();
-           std::string  ToString();
-           std::string  ToTypeString();
-        std::vector<std::shared_ptr<DataType::Raw>> GetRawVector();
-        const  void*    GetRawData();
-		template<typename T>
-					  T GetData() {
-						  T* val = (T*)m_rawData;
-						  return val[0];
-					  };
-
-        template<typename T>
-        static    void* MakeData(T value){
-                        uint8_t *buff = new uint8_t[sizeof(T)];
-                        memcpy(buff,&value,sizeof(T));
-                        return  buff;
-                      };
-
-			std::string GetDataString() {
-						  std::string str = std::string((char*)m_rawData,m_dataStringLenght);
-						  return str;
-					  };
-
-			       void PrintVector(int limitDataSize);
-
-
-		       uint32_t   GetLength();
-		static uint32_t   GetLength(uint32_t dataType);
-		static uint64_t   GetArrayLength(uint32_t dataType, uint64_t size);
-        static uint64_t*  GetRawTimeValue(time_t time_val);
-
-	};
-}
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <memory>
+#include <iostream>
+
+using namespace std;
+
+namespace TDMS
+{
+	class DataType
+	{
+	public:
+	    struct Raw{
+	        uint8_t *data;
+	        long     size;
+            Raw():
+			data(nullptr),
+			size(0){                
+            }
+
+	        ~Raw(){
+            	delete []  data;
+	        }
+	    };
+
+	    //! Bytes owned by a DataType, valid while it is alive and unchanged
+	    struct Span{
+	        const uint8_t *data;
+	        size_t         size;
+	    };
+
+	    //! Scalars up to a TimeStamp and short strings are kept inline
+	    static const size_t InlineSize = 16;
+
+		static const uint32_t Empty = 0x0000000F;
+		static const uint32_t Void = 0x00000000;
+		static const uint32_t Integer8 = 0x00000001;
+		static const uint32_t Integer16 = 0x00000002;
+		static const uint32_t Integer32 = 0x00000003;
+		static const uint32_t Integer64 = 0x00000004;
+		static const uint32_t UnsignedInteger8 = 0x00000005;
+		static const uint32_t UnsignedInteger16 = 0x00000006;
+		static const uint32_t UnsignedInteger32 = 0x00000007;
+		static const uint32_t UnsignedInteger64 = 0x00000008;
+		static const uint32_t SingleFloat = 0x00000009;
+		static const uint32_t DoubleFloat = 0x0000000A;
+		static const uint32_t ExtendedFloat = 0x0000000B;
+		static const uint32_t SingleFloatWithUnit = 0x00000019;
+		static const uint32_t DoubleFloatWithUnit = 0x0000001A;
+		static const uint32_t ExtendedFloatWithUnit = 0x0000001B;
+		static const uint32_t String = 0x00000020;
+		static const uint32_t Boolean = 0x00000021;
+		static const uint32_t TimeStamp = 0x00000044;
+	
+	protected:
+		uint32_t m_dataType;
+		uint32_t m_dataStringLenght;
+		void *m_rawData;          // m_inline or a new[] buffer owned by this object
+		uint8_t m_inline[InlineSize];
+        std::vector<std::shared_ptr<DataType::Raw>> m_vectorData;
+	protected:
+		void ReleaseRaw();
+		void CopyRaw(const void *rawData, uint32_t size);
+		void MoveFrom(DataType &tmp);
+
+	public:
+
+		DataType();
+		~DataType();
+        void DestroyVector();
+		DataType(const DataType& tmp);
+		DataType& operator=(const DataType& tmp);
+		DataType(DataType&& tmp) noexcept;
+		DataType& operator=(DataType&& tmp) noexcept;
+
+		           //! Takes ownership of a new[] buffer
+		           void InitDataType(uint32_t dataType, void *rawData);
+                   void InitDataType(uint32_t dataType, std::vector<std::shared_ptr<DataType::Raw>> vec);
+				   void InitStringType(uint32_t length, void *rawData);
+				   //! Copy the value, no allocation for scalars and short strings
+				   void InitScalar(uint32_t dataType, const void *value);
+				   void InitString(const void *data, uint32_t length);
+				   void InitRaw(uint32_t dataType,uint64_t count,void *rawData);
+		   	   uint32_t GetDataType() const;
+           std::string  ToString();
+           std::string  ToTypeString();
+        const std::vector<std::shared_ptr<DataType::Raw>>& GetRawVector() const;
+        const  void*    GetRawData() const;
+                   Span GetSpan() const;
+                   Span GetRawSpan(size_t index) const;
+                 size_t GetRawCount() const;
+		template<typename T>
+					  T GetData() const {
+						  T val = T();
+						  if (m_rawData != nullptr)
+							  memcpy(&val, m_rawData, sizeof(T));
+						  return val;
+					  };
+
+		template<typename T>
+		static    DataType Make(uint32_t dataType, T value){
+                        DataType data;
+                        data.InitScalar(dataType, &value);
+                        return data;
+                      };
+
+        template<typename T>
+        static    void* MakeData(T value){
+                        uint8_t *buff = new uint8_t[sizeof(T)];
+                        memcpy(buff,&value,sizeof(T));
+                        return  buff;
+                      };
+
+			std::string GetDataString() const {
+						  std::string str = std::string((char*)m_rawData,m_dataStringLenght);
+						  return str;
+					  };
+
+			       void PrintVector(int limitDataSize);
+
+
+		       uint32_t   GetLength() const;
+		static uint32_t   GetLength(uint32_t dataType);
+		static uint64_t   GetArrayLength(uint32_t dataType, uint64_t size);
+        static uint64_t*  GetRawTimeValue(time_t time_val);
+
+	};
+}
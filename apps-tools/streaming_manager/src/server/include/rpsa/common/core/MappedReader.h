@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+#include "DataType.h"
+
+using namespace std;
+
+namespace TDMS
+{
+	//! Samples of one channel stored one after another at a fixed stride
+	struct Chunk
+	{
+		uint64_t Offset;      // File offset of the first sample
+		uint64_t FirstSample; // Index of the first sample in the channel
+		uint64_t Count;
+		uint32_t Stride;      // Bytes from one sample to the next
+	};
+
+	struct ChannelIndex
+	{
+		string   PathStr;
+		uint32_t DataType;
+		uint32_t TypeSize;
+		uint64_t Samples;
+		vector<Chunk> Chunks;
+	};
+
+	//!
+	//! \brief Iterates the samples of a channel range across chunk borders.
+	//!
+	//! Samples are read straight from the mapping. Interleaved or packed data is
+	//! not aligned, so every sample is copied out with memcpy.
+	//!
+	template<typename T>
+	class ChannelIterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef T         value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const T*  pointer;
+		typedef T         reference;
+
+		ChannelIterator():m_base(nullptr),m_chunk(nullptr),m_pos(0),m_left(0){}
+		ChannelIterator(const uint8_t *base, const Chunk *chunk, uint64_t pos, uint64_t left):
+			m_base(base),m_chunk(chunk),m_pos(pos),m_left(left){}
+
+		T operator*() const {
+			T value;
+			memcpy(&value, m_base + m_chunk->Offset + m_pos * m_chunk->Stride, sizeof(T));
+			return value;
+		}
+
+		ChannelIterator& operator++() {
+			if (m_left == 0)
+				return *this;
+			m_left--;
+			if (++m_pos == m_chunk->Count && m_left > 0){
+				m_chunk++;
+				m_pos = 0;
+			}
+			return *this;
+		}
+
+		ChannelIterator operator++(int) {
+			ChannelIterator tmp = *this;
+			++(*this);
+			return tmp;
+		}
+
+		bool operator==(const ChannelIterator &other) const { return m_left == other.m_left; }
+		bool operator!=(const ChannelIterator &other) const { return m_left != other.m_left; }
+
+	private:
+		const uint8_t *m_base;
+		const Chunk   *m_chunk;
+		uint64_t       m_pos;
+		uint64_t       m_left;
+	};
+
+	template<typename T>
+	class ChannelRange
+	{
+	public:
+		ChannelRange():m_begin(),m_size(0){}
+		ChannelRange(ChannelIterator<T> begin, uint64_t size):m_begin(begin),m_size(size){}
+		ChannelIterator<T> begin() const { return m_begin; }
+		ChannelIterator<T> end() const { return ChannelIterator<T>(); }
+		uint64_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+	private:
+		ChannelIterator<T> m_begin;
+		uint64_t           m_size;
+	};
+
+	//!
+	//! \brief Reads TDMS files through a read-only memory mapping.
+	//!
+	//! Open() walks the segments once and records where every channel has its
+	//! samples. Nothing is copied until the caller asks for it, so a range of a
+	//! multi-gigabyte recording costs only the pages it touches. The index can be
+	//! kept next to the file as <file>.tdms_index and is reused while the file
+	//! size and modification time still match. A TDMS index written along with
+	//! the file ("TDSh" segments) is read in place of the segment headers.
+	//!
+	class MappedReader
+	{
+	public:
+		//! The span is only valid while the reader stays open
+		typedef std::function<void(const uint8_t *data, uint64_t firstSample, uint64_t count, uint32_t stride)> SpanHandler;
+
+		MappedReader();
+		~MappedReader();
+
+		bool Open(const string &fileName, bool useIndexFile = false);
+		void Close();
+		bool IsOpen() const;
+		uint64_t GetFileSize() const;
+
+		vector<string> GetChannels() const;
+		const ChannelIndex* GetChannel(const string &path) const;
+
+		//! Calls handler for every contiguous run of samples in [first, first + count).
+		//! Returns the number of samples visited.
+		uint64_t ForEachSpan(const string &path, uint64_t first, uint64_t count, SpanHandler handler) const;
+		//! Copies packed samples into dst, returns the number of samples copied
+		uint64_t Read(const string &path, uint64_t first, uint64_t count, void *dst) const;
+
+		template<typename T>
+		ChannelRange<T> GetRange(const string &path, uint64_t first, uint64_t count) const {
+			auto channel = GetChannel(path);
+			if (channel == nullptr || channel->TypeSize != sizeof(T) || first >= channel->Samples)
+				return ChannelRange<T>();
+			if (count > channel->Samples - first)
+				count = channel->Samples - first;
+			const Chunk *chunk = FindChunk(*channel, first);
+			return ChannelRange<T>(ChannelIterator<T>(m_data, chunk, first - chunk->FirstSample, count), count);
+		}
+
+		//! <name>.tdms_index for <name>.tdms, <file>.tdms_index otherwise
+		static string IndexName(const string &fileName);
+
+		bool SaveIndex(const string &indexName) const;
+		bool LoadIndex(const string &indexName);
+
+	private:
+		MappedReader(const MappedReader &) = delete;
+		MappedReader(MappedReader &&) = delete;
+
+		bool Map(const string &fileName);
+		bool BuildIndex(const vector<uint8_t> &headers);
+		const Chunk* FindChunk(const ChannelIndex &channel, uint64_t sample) const;
+
+		const uint8_t *m_data;
+		uint64_t       m_fileSize;
+		int64_t        m_fileTime;
+#ifdef _WIN32
+		void          *m_file;
+		void          *m_mapping;
+#endif
+		vector<ChannelIndex> m_channels;
+		map<string, size_t>  m_lookup;
+	};
+}
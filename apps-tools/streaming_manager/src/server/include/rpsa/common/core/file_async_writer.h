@@ -4,39 +4,100 @@
 #include <thread>
 #include <vector>
 #include <list>
+#include <chrono>
 #include <asio.hpp>
 #include <fstream>
 #include <iostream>
 #include "thread_cout.h"
 #include "types.h"
+#include "file_block.h"
+#include "thread_sched.h"
 
 
 #define USING_FREE_SPACE 1024 * 1024 * 30 // Left free on disk 30 Mb
+#define FILE_BLOCK_POOL_SIZE 16
+#define FILE_BLOCK_HEADER_RESERVE 4096 // Room for the TDMS segment metadata or WAV header
+#define FILE_BLOCK_SIZE (65536 * 2 + FILE_BLOCK_HEADER_RESERVE)
+#define FILE_WRITE_BEHIND_WINDOW (4 * 1024 * 1024) // Writeback is started per window
+#define FILE_WRITE_BEHIND_DEFAULT_DEPTH 4
+#define FILE_WRITE_BEHIND_MAX_DEPTH 64
+#define FILE_TDMS_SEGMENT_DEFAULT_KB 1024 // Buffers collected into one TDMS segment
+#define FILE_TDMS_SEGMENT_MAX_KB (16 * 1024)
+#define FILE_QUEUE_LOW_WATERMARK_PERCENT 75 // A full queue takes blocks again below this share of the budget
+#define FILE_ROTATE_PREALLOC_DEFAULT (64 * 1024 * 1024) // Next file when rotating by time only
+#define FILE_RAW_HEADER_SIZE 4096
+#define FILE_RAW_BLOCK_KB 256 // Bytes of one channel in a raw block
+#define FILE_RAW_MAGIC "RPSA-RAW"
+#define FILE_RAW_VERSION 1
+#define FILE_RAW_GAP 0x1u // Index flag, samples were lost before the block
 
 
 enum Stream_FileType{
     TDMS_TYPE,
     WAV_TYPE,
+    // Header page, fixed size sample blocks and a trailing index, see FileQueueManager::AddRawData()
+    RAW_TYPE,
 };
 
 class Queue
 {
 public:
     long queueSize();
+    long queuePeakSize();
+    long long int queueBytes();
+    long long int queuePeakBytes();
+    long queueOverflows();
+    long long int queueHighWatermark();
+    long long int queueLowWatermark();
+    void resetQueuePeaks();
 protected:
     Queue();
     ~Queue();
-    void pushQueue(std::iostream* buffer);
-    std::iostream* popQueue();
+    // Memory budget of the queued blocks. Once a block would take the queue
+    // past _high, blocks are refused until it has drained below _low.
+    void setWatermarks(long long int _high, long long int _low);
+    bool pushQueue(CFileBlock* buffer);
+    CFileBlock* popQueue();
+    bool waitQueue(int _timeout_ms);
+    void interruptWait();
+    void clearInterrupt();
     long long int  m_useMemory;    
 private:
-    std::list<std::iostream*> m_queue;
+    std::list<CFileBlock*> m_queue;
     std::mutex mutex_;    
+    std::condition_variable m_cond;
+    bool m_interrupt;
+    long m_peakSize;
+    long long int m_peakMemory;
+    long long int m_highWatermark;
+    long long int m_lowWatermark;
+    bool m_full;
+    long m_overflows;
 };
 
 
+// Group properties of the TDMS segment that starts a triggered capture
+struct TDMSCaptureT{
+    uint64_t triggerSample; // Sample index of the trigger
+    uint64_t preSamples;    // Written before it
+    uint64_t postSamples;   // Written after it, 0 streams on
+    uint8_t  channel;       // 1 or 2, 0 for a software trigger
+    std::chrono::system_clock::time_point triggerTime;
+
+    TDMSCaptureT(): triggerSample(0), preSamples(0), postSamples(0), channel(0), triggerTime() {}
+};
+
+// Calibration of the 16-bit DMA words, volts = (word - offset) * scale
+struct CalibrationT{
+    bool   valid;
+    double scale[2];  // Volts per word, per channel
+    double offset[2]; // DC offset in words
+
+    CalibrationT(): valid(false), scale{0, 0}, offset{0, 0} {}
+};
+
 class FileQueueManager:public Queue{
-    std::fstream fs;
+    int  m_fd;
     std::thread *th;
     std::atomic_flag m_ThreadRun = ATOMIC_FLAG_INIT;
     bool m_threadWork;
@@ -46,21 +107,122 @@ class FileQueueManager:public Queue{
     Stream_FileType  m_fileType; // FLAG for file type TDMS/Wav
     bool m_firstSectionWrite; // Need for detect first section of wav file
     void Task();
+    bool WriteBlock(CFileBlock *block);
+    void WriteBehind();
    ulong m_freeSize;
-   ulong m_hasWriteSize;   
-unsigned long long m_aviablePhyMemory; 
+   std::atomic<ulong> m_hasWriteSize; // Read by the status poller
+    unsigned long long m_memoryBudget;
+    std::vector<CFileBlock*> m_freeBlocks;
+    std::mutex       m_blocksLock;
+    ThreadSchedT     m_threadSched;
+    int              m_writeBehindDepth;
+    uint64_t         m_fileOffset;
+    uint64_t         m_writeBehindIssued;
+    // TDMS segment being filled and the channel layout of the last segment,
+    // raw data in the same layout needs no metadata
+    std::mutex       m_tdmsLock;
+    CFileBlock      *m_tdmsBlock;
+    size_t           m_tdmsSegmentSize;
+    bool             m_tdmsLayoutValid;
+    size_t           m_tdmsSizeCh1;
+    size_t           m_tdmsSizeCh2;
+    int32_t          m_tdmsDataType;
+    bool             m_tdmsInterleaved;
+    bool             m_tdmsCapturePending;
+    TDMSCaptureT     m_tdmsCapture;
+    CalibrationT     m_tdmsCalibration;
+    bool             m_tdmsVolts;
+    // The .tdms_index next to the file, lead-in and metadata of every segment written
+    bool             m_tdmsIndex;
+    int              m_indexFd;
+    std::string      m_fileName;
+    std::string      m_indexName;
+    std::vector<uint8_t> m_indexEntry;
+    void FlushTDMSLocked();
+    void AppendTDMSRaw(CFileBlock *block,const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,size_t sample_size);
+    void OpenIndex();
+    void CloseIndex(bool remove);
+    void WriteIndex(CFileBlock *block);
+    // Raw block being filled and the layout of the file, the producer side
+    std::mutex       m_rawLock;
+    CFileBlock      *m_rawBlock;
+    size_t           m_rawFilled;      // Samples per channel in m_rawBlock
+    bool             m_rawLayoutValid;
+    unsigned short   m_rawResolution;
+    uint32_t         m_rawChannels;    // 1 - ch1, 2 - ch2, 3 - both
+    size_t           m_rawBlockSamples;
+    uint64_t         m_rawNext;        // Sample index after the last one added
+    // Index entries of the blocks in the current file, the writer side
+    std::vector<uint8_t> m_rawIndex;
+    bool QueueRawHeader(uint32_t osc_rate, uint64_t sample_index, bool new_file);
+    void FlushRawLocked();
+    void FinishRawFile();
+    // Rotation, the producer decides which block starts the next file and the
+    // writer switches to it. The next file is created and preallocated ahead.
+    uint64_t         m_rotateBytes;
+    int              m_rotateSeconds;
+    uint64_t         m_rotateQueued;
+    std::chrono::steady_clock::time_point m_rotateStart;
+    std::atomic<bool> m_rotateRequest;
+    bool             m_rotateWait;
+    int              m_filePart;
+    std::string      m_baseName;
+    std::thread     *m_prepareThread;
+    int              m_nextFd;
+    std::string      m_nextName;
+    uint64_t         m_preallocSize;
+    bool RotationEnabled() const { return m_rotateBytes > 0 || m_rotateSeconds > 0; }
+    std::string PartName(int _part);
+    void PrepareNextFile();
+    void DropNextFile();
+    bool RotateFile();
 public:
     FileQueueManager();
     ~FileQueueManager();
     static ulong GetFreeSpaceDisk(std::string _filePath);
     void StartWrite(Stream_FileType _fileType);
+    // Applied by the writer thread, set before StartWrite()
+    void SetThreadSched(const ThreadSchedT &_sched);
+    // Windows of FILE_WRITE_BEHIND_WINDOW bytes in writeback at once, 0 leaves
+    // the writeback to the page cache. Set before StartWrite()
+    void SetWriteBehind(int _depth);
+    // Bytes the write queue may hold, 0 is half of the physical memory.
+    // Set before OpenFile()
+    void SetMemoryBudget(unsigned long long _bytes);
+    // Upper size of a TDMS segment, buffers with the same layout are added to
+    // it as further chunks. 0 writes a segment per buffer. Set before StartWrite()
+    void SetTDMSSegmentSize(size_t _bytes);
+    // Two channels of the same size are written sample by sample, ch1 ch2 ch1 ...
+    // Set before StartWrite()
+    void SetTDMSInterleaved(bool _enable);
+    // Keeps the .tdms_index of the file up to date while writing. Set before StartWrite()
+    void SetTDMSIndex(bool _enable);
+    // Written as channel properties, the float samples are volts with _volts.
+    // Set before StartWrite()
+    void SetTDMSCalibration(const CalibrationT &_calibration, bool _volts);
+    // Continues in <name>_001.<ext>, <name>_002.<ext> ... once a file holds
+    // _bytes or _seconds of data, 0 turns a limit off. Set before StartWrite()
+    void SetRotation(uint64_t _bytes, int _seconds);
+    // Called by the producer with the size of the next block, true when that
+    // block has to start the next file. It then needs its own WAV header or
+    // TDMS metadata and setNewFile().
+    bool CheckRotation(size_t _size);
     void StopWrite(bool waitAllWrite);
     bool IsWork() { return  m_threadWork && !m_hasErrorWrite;};
+    ulong GetWrittenBytes() { return m_hasWriteSize; };
     int  WriteToFile();
-    bool AddBufferToWrite(std::iostream *buffer);
+    bool AddBufferToWrite(CFileBlock *buffer);
+    CFileBlock *AcquireBlock(size_t _size);
+    void ReleaseBlock(CFileBlock *_block);
     void OpenFile(std::string FileName,bool append);
     void CloseFile();
 static int  AvailableSpace(std::string dst, ulong* availableSize);
-    std::iostream *BuildTDMSStream(uint8_t* buffer_ch1,size_t size_ch1,uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution);
+    void BuildTDMSBlock(CFileBlock *block,const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution,uint64_t sample_index,uint64_t gap_samples);
+    bool AddTDMSData(const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution,uint64_t sample_index,uint64_t gap_samples);
+    void FlushTDMS();
+    // The next buffer starts a segment of its own with the capture properties
+    void StartTDMSCapture(const TDMSCaptureT &_capture);
+    bool AddRawData(const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution,uint64_t sample_index,uint32_t osc_rate);
+    void FlushRaw();
     void updateWavFile(int _size);
 };
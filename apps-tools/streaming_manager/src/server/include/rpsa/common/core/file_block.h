@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define FILE_BLOCK_ALIGN 4096
+
+//!
+//! \brief Page aligned memory block written to disk with a single write().
+//!
+//! File writers serialize TDMS segments and WAV frames straight into a block
+//! instead of going through std::stringstream.
+//!
+class CFileBlock
+{
+public:
+    CFileBlock(size_t _capacity);
+    ~CFileBlock();
+
+    bool     reserve(size_t _capacity);
+    void     append(const void *_data, size_t _size);
+    void     appendInt16(int16_t _value);
+    void     appendInt32(int32_t _value);
+    void     appendInt64(int64_t _value);
+    uint8_t *tail();
+    void     commit(size_t _size);
+    void     clear();
+
+    uint8_t *data() { return m_data; }
+    size_t   size() const { return m_size; }
+    size_t   capacity() const { return m_capacity; }
+    // Lead-in and metadata at the start of a TDMS segment, copied to the index file
+    void     setHeaderSize(size_t _size) { m_headerSize = _size; }
+    size_t   headerSize() const { return m_headerSize; }
+    // The block starts the next file of a rotated recording
+    void     setNewFile(bool _newFile) { m_newFile = _newFile; }
+    bool     newFile() const { return m_newFile; }
+    // Samples of a raw recording block, copied to the index of the file
+    void     setSamples(uint64_t _first, uint32_t _count) { m_firstSample = _first; m_samples = _count; }
+    uint64_t firstSample() const { return m_firstSample; }
+    uint32_t samples() const { return m_samples; }
+
+private:
+    CFileBlock(const CFileBlock &) = delete;
+    CFileBlock(CFileBlock &&) = delete;
+
+    uint8_t *m_data;
+    size_t   m_size;
+    size_t   m_capacity;
+    size_t   m_headerSize;
+    bool     m_newFile;
+    uint64_t m_firstSample;
+    uint32_t m_samples;
+};
@@ -2,6 +2,8 @@
 // Created by user on 03.04.19.
 //
 #include <iostream>
+#include <cstdint>
+#include <cstring>
 
 #ifndef PROJECT_NEON_ASM_H
 #define PROJECT_NEON_ASM_H
@@ -55,9 +57,234 @@ namespace {
         "    BGT NEONCopyPLD_8bit%=\n"
         : [dst]"+r"(dst), [src]"+r"(src), [n]"+r"(n) : : "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
 #else
-        memcpy((void*)dst,(void*)src,n);
+        // Keep the high byte of every 16-bit sample, as the VLD2 path does
+        for (size_t i = 0; i < n / 2; i++)
+            ((volatile uint8_t*)dst)[i] = ((volatile const uint8_t*)src)[i * 2 + 1];
+#endif
+    }
+
+    // Interleave two 8-bit channels into L/R frames. n is the size of one channel in bytes.
+    static void memcpy_interleave_8bit_neon(volatile void *dst, volatile const void *src1, volatile const void *src2, size_t n) noexcept
+    {
+#ifdef ARCH_ARM
+        if (n & 15) {
+            for (size_t i = 0; i < n; i++) {
+                ((volatile uint8_t*)dst)[i * 2] = ((volatile const uint8_t*)src1)[i];
+                ((volatile uint8_t*)dst)[i * 2 + 1] = ((volatile const uint8_t*)src2)[i];
+            }
+            return;
+        }
+    asm volatile (
+        "NEONZip_8bit%=:\n"
+        "    PLD [%[src1], #0xC0]\n"
+        "    PLD [%[src2], #0xC0]\n"
+        "    VLD1.8 {d0,d1},[%[src1]]!\n"
+        "    VLD1.8 {d2,d3},[%[src2]]!\n"
+        "    VST2.8 {d0,d1,d2,d3},[%[dst]]!\n"
+        "    SUBS %[n],%[n],#0x10\n"
+        "    BGT NEONZip_8bit%=\n"
+        : [dst]"+r"(dst), [src1]"+r"(src1), [src2]"+r"(src2), [n]"+r"(n) : : "d0", "d1", "d2", "d3", "cc", "memory");
+#else
+        for (size_t i = 0; i < n; i++) {
+            ((volatile uint8_t*)dst)[i * 2] = ((volatile const uint8_t*)src1)[i];
+            ((volatile uint8_t*)dst)[i * 2 + 1] = ((volatile const uint8_t*)src2)[i];
+        }
+#endif
+    }
+
+    // Interleave two 16-bit channels into L/R frames. n is the size of one channel in bytes.
+    static void memcpy_interleave_16bit_neon(volatile void *dst, volatile const void *src1, volatile const void *src2, size_t n) noexcept
+    {
+#ifdef ARCH_ARM
+        if (n & 15) {
+            for (size_t i = 0; i < n / 2; i++) {
+                ((volatile uint16_t*)dst)[i * 2] = ((volatile const uint16_t*)src1)[i];
+                ((volatile uint16_t*)dst)[i * 2 + 1] = ((volatile const uint16_t*)src2)[i];
+            }
+            return;
+        }
+    asm volatile (
+        "NEONZip_16bit%=:\n"
+        "    PLD [%[src1], #0xC0]\n"
+        "    PLD [%[src2], #0xC0]\n"
+        "    VLD1.16 {d0,d1},[%[src1]]!\n"
+        "    VLD1.16 {d2,d3},[%[src2]]!\n"
+        "    VST2.16 {d0,d1,d2,d3},[%[dst]]!\n"
+        "    SUBS %[n],%[n],#0x10\n"
+        "    BGT NEONZip_16bit%=\n"
+        : [dst]"+r"(dst), [src1]"+r"(src1), [src2]"+r"(src2), [n]"+r"(n) : : "d0", "d1", "d2", "d3", "cc", "memory");
+#else
+        for (size_t i = 0; i < n / 2; i++) {
+            ((volatile uint16_t*)dst)[i * 2] = ((volatile const uint16_t*)src1)[i];
+            ((volatile uint16_t*)dst)[i * 2 + 1] = ((volatile const uint16_t*)src2)[i];
+        }
+#endif
+    }
+
+    // Interleave two 32-bit channels into L/R frames. n is the size of one channel in bytes.
+    static void memcpy_interleave_32bit_neon(volatile void *dst, volatile const void *src1, volatile const void *src2, size_t n) noexcept
+    {
+#ifdef ARCH_ARM
+        if (n & 15) {
+            for (size_t i = 0; i < n / 4; i++) {
+                ((volatile uint32_t*)dst)[i * 2] = ((volatile const uint32_t*)src1)[i];
+                ((volatile uint32_t*)dst)[i * 2 + 1] = ((volatile const uint32_t*)src2)[i];
+            }
+            return;
+        }
+    asm volatile (
+        "NEONZip_32bit%=:\n"
+        "    PLD [%[src1], #0xC0]\n"
+        "    PLD [%[src2], #0xC0]\n"
+        "    VLD1.32 {d0,d1},[%[src1]]!\n"
+        "    VLD1.32 {d2,d3},[%[src2]]!\n"
+        "    VST2.32 {d0,d1,d2,d3},[%[dst]]!\n"
+        "    SUBS %[n],%[n],#0x10\n"
+        "    BGT NEONZip_32bit%=\n"
+        : [dst]"+r"(dst), [src1]"+r"(src1), [src2]"+r"(src2), [n]"+r"(n) : : "d0", "d1", "d2", "d3", "cc", "memory");
+#else
+        for (size_t i = 0; i < n / 4; i++) {
+            ((volatile uint32_t*)dst)[i * 2] = ((volatile const uint32_t*)src1)[i];
+            ((volatile uint32_t*)dst)[i * 2 + 1] = ((volatile const uint32_t*)src2)[i];
+        }
 #endif
     }
+
+    // Pack the top 14 bits of every 16-bit sample, 4 samples into 7 bytes.
+    // n is the source size in bytes and must be a multiple of 8. Returns the packed size.
+    // The NEON path stores 8 bytes per group, so dst needs 1 byte of slack.
+    static size_t memcpy_pack_14bit_neon(volatile void *dst, volatile const void *src, size_t n) noexcept
+    {
+        size_t packed = (n / 8) * 7;
+#ifdef ARCH_ARM
+        if ((n & 15) == 0 && n > 0) {
+    asm volatile (
+        "NEONPack_14bit%=:\n"
+        "    PLD [%[src], #0xC0]\n"
+        "    VLD1.16 {d0,d1},[%[src]]!\n"
+        "    VSHR.U16 q0,q0,#2\n"
+        "    VSHR.U32 q1,q0,#16\n"
+        "    VSLI.32 q0,q1,#14\n"
+        "    VSHR.U64 q1,q0,#32\n"
+        "    VSLI.64 q0,q1,#28\n"
+        "    VST1.8 {d0},[%[dst]]\n"
+        "    ADD %[dst],%[dst],#7\n"
+        "    VST1.8 {d1},[%[dst]]\n"
+        "    ADD %[dst],%[dst],#7\n"
+        "    SUBS %[n],%[n],#0x10\n"
+        "    BGT NEONPack_14bit%=\n"
+        : [dst]"+r"(dst), [src]"+r"(src), [n]"+r"(n) : : "d0", "d1", "d2", "d3", "cc", "memory");
+            return packed;
+        }
+#endif
+        for (size_t i = 0; i < n / 8; i++) {
+            const volatile uint16_t *s = ((volatile const uint16_t*)src) + i * 4;
+            uint64_t group = (uint64_t)(s[0] >> 2)
+                           | ((uint64_t)(s[1] >> 2) << 14)
+                           | ((uint64_t)(s[2] >> 2) << 28)
+                           | ((uint64_t)(s[3] >> 2) << 42);
+            for (int j = 0; j < 7; j++)
+                ((volatile uint8_t*)dst)[i * 7 + j] = (uint8_t)(group >> (j * 8));
+        }
+        return packed;
+    }
+
+    // Pack the top 12 bits of every 16-bit sample, 2 samples into 3 bytes.
+    // n is the source size in bytes and must be a multiple of 4. Returns the packed size.
+    // The NEON path stores 8 bytes per 4 samples, so dst needs 2 bytes of slack.
+    static size_t memcpy_pack_12bit_neon(volatile void *dst, volatile const void *src, size_t n) noexcept
+    {
+        size_t packed = (n / 4) * 3;
+#ifdef ARCH_ARM
+        if ((n & 15) == 0 && n > 0) {
+    asm volatile (
+        "NEONPack_12bit%=:\n"
+        "    PLD [%[src], #0xC0]\n"
+        "    VLD1.16 {d0,d1},[%[src]]!\n"
+        "    VSHR.U16 q0,q0,#4\n"
+        "    VSHR.U32 q1,q0,#16\n"
+        "    VSLI.32 q0,q1,#12\n"
+        "    VSHR.U64 q1,q0,#32\n"
+        "    VSLI.64 q0,q1,#24\n"
+        "    VST1.8 {d0},[%[dst]]\n"
+        "    ADD %[dst],%[dst],#6\n"
+        "    VST1.8 {d1},[%[dst]]\n"
+        "    ADD %[dst],%[dst],#6\n"
+        "    SUBS %[n],%[n],#0x10\n"
+        "    BGT NEONPack_12bit%=\n"
+        : [dst]"+r"(dst), [src]"+r"(src), [n]"+r"(n) : : "d0", "d1", "d2", "d3", "cc", "memory");
+            return packed;
+        }
+#endif
+        for (size_t i = 0; i < n / 4; i++) {
+            const volatile uint16_t *s = ((volatile const uint16_t*)src) + i * 2;
+            uint32_t group = (uint32_t)(s[0] >> 4) | ((uint32_t)(s[1] >> 4) << 12);
+            for (int j = 0; j < 3; j++)
+                ((volatile uint8_t*)dst)[i * 3 + j] = (uint8_t)(group >> (j * 8));
+        }
+        return packed;
+    }
+
+    // Convert 16-bit samples to floats, dst = src * scale + bias. n is the source
+    // size in bytes, dst gets 2 * n bytes. Returns the converted size.
+    static size_t convert_16bit_to_float_neon(volatile void *dst, volatile const void *src, size_t n, float scale, float bias) noexcept
+    {
+        size_t converted = (n / 2) * 4;
+#ifdef ARCH_ARM
+        if ((n & 15) == 0 && n > 0) {
+        uint32_t scale_bits;
+        uint32_t bias_bits;
+        memcpy(&scale_bits, &scale, sizeof(scale_bits));
+        memcpy(&bias_bits, &bias, sizeof(bias_bits));
+    asm volatile (
+        "    VDUP.32 q8,%[scale]\n"
+        "    VDUP.32 q9,%[bias]\n"
+        "NEONFloat_16bit%=:\n"
+        "    PLD [%[src], #0xC0]\n"
+        "    VLD1.16 {d0,d1},[%[src]]!\n"
+        "    VMOVL.S16 q1,d0\n"
+        "    VMOVL.S16 q2,d1\n"
+        "    VCVT.F32.S32 q1,q1\n"
+        "    VCVT.F32.S32 q2,q2\n"
+        "    VMOV q3,q9\n"
+        "    VMOV q10,q9\n"
+        "    VMLA.F32 q3,q1,q8\n"
+        "    VMLA.F32 q10,q2,q8\n"
+        "    VST1.32 {d6,d7},[%[dst]]!\n"
+        "    VST1.32 {d20,d21},[%[dst]]!\n"
+        "    SUBS %[n],%[n],#0x10\n"
+        "    BGT NEONFloat_16bit%=\n"
+        : [dst]"+r"(dst), [src]"+r"(src), [n]"+r"(n) : [scale]"r"(scale_bits), [bias]"r"(bias_bits)
+        : "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "d16", "d17", "d18", "d19", "d20", "d21", "cc", "memory");
+        return converted;
+        }
+#endif
+        for (size_t i = 0; i < n / 2; i++)
+            ((volatile float*)dst)[i] = ((volatile const int16_t*)src)[i] * scale + bias;
+        return converted;
+    }
+
+    // Expand packed 14 or 12 bit samples back to left aligned 16-bit words.
+    // n is the packed size in bytes. Returns the unpacked size.
+    static size_t unpack_bits_to_16bit(void *dst, const void *src, size_t n, unsigned bits) noexcept
+    {
+        const uint8_t *s = (const uint8_t*)src;
+        uint16_t *d = (uint16_t*)dst;
+        size_t samples = n * 8 / bits;
+        uint32_t acc = 0;
+        unsigned acc_bits = 0;
+        for (size_t i = 0; i < samples; i++) {
+            while (acc_bits < bits) {
+                acc |= (uint32_t)(*s++) << acc_bits;
+                acc_bits += 8;
+            }
+            d[i] = (uint16_t)((acc & ((1u << bits) - 1)) << (16 - bits));
+            acc >>= bits;
+            acc_bits -= bits;
+        }
+        return samples * 2;
+    }
+
 }
 
 #endif //PROJECT_NEON_ASM_H
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Samples per bit packed block. Every block starts with one byte holding its bit width.
+#define CODEC_BLOCK_SAMPLES 64
+// Each encoded channel starts with the decoded size in bytes
+#define CODEC_STREAM_HEADER sizeof(uint32_t)
+
+enum Stream_Compression{
+    NONE_COMPRESSION  = 0,
+    DELTA_COMPRESSION = 1
+};
+
+//!
+//! \brief Lossless delta + bit packing codec for ADC channel data.
+//!
+//! Samples are delta coded against the previous sample, zigzag mapped and
+//! packed with the smallest bit width that holds every value of a block.
+//! Slowly varying signals and 14-bit samples carried in 16-bit words pack
+//! well below the raw size.
+//!
+class CStreamCodec
+{
+public:
+    // Returns the encoded size, or 0 if the result does not fit in _capacity
+    static size_t Encode(const void *_src, size_t _size, uint32_t _resolution, uint8_t *_dst, size_t _capacity);
+    // Returns the decoded size, or 0 on malformed input or lack of space
+    static size_t Decode(const uint8_t *_src, size_t _size, uint32_t _resolution, void *_dst, size_t _capacity);
+    static size_t DecodedSize(const uint8_t *_src, size_t _size);
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+//!
+//! \brief CPU and scheduling request for one streaming thread.
+//!
+//! cpu < 0 leaves the affinity alone, priority 0 keeps SCHED_OTHER and
+//! 1..99 asks for SCHED_FIFO with that priority.
+//!
+struct ThreadSchedT
+{
+    int cpu;
+    int priority;
+
+    ThreadSchedT(int _cpu = -1, int _priority = 0);
+    bool isDefault() const { return cpu < 0 && priority <= 0; }
+};
+
+//!
+//! \brief Applies _sched to the calling thread and prints the result.
+//!
+//! \return false if the affinity or the priority could not be set,
+//!         SCHED_FIFO needs root or CAP_SYS_NICE.
+//!
+bool SetCurrentThreadSched(const ThreadSchedT &_sched, const std::string &_name);
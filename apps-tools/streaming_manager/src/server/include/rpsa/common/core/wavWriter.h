@@ -9,6 +9,7 @@
 #include <asio.hpp>
 #include <fstream>
 #include <iostream>
+#include "file_block.h"
 
 class CWaveWriter
 {
@@ -29,11 +30,11 @@ public:
 
     CWaveWriter();
     void resetHeaderInit();
-    std::iostream *BuildWAVStream(uint8_t* buffer_ch1,size_t size_ch1,uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution);
+    void BuildWAVBlock(CFileBlock *block,const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution);
 private:
-    void BuildHeader(std::stringstream *memory);
-    void addInt32ToFileData (std::stringstream *memory, int32_t i);
-    void addInt16ToFileData (std::stringstream *memory, int16_t i);
-    void addStringToFileData (std::stringstream *memory, std::string s);
+    void BuildHeader(CFileBlock *memory);
+    void addInt32ToFileData (CFileBlock *memory, int32_t i);
+    void addInt16ToFileData (CFileBlock *memory, int16_t i);
+    void addStringToFileData (CFileBlock *memory, std::string s);
     
 };
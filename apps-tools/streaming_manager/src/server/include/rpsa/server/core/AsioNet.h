@@ -8,15 +8,56 @@
 #include <cstdint>
 #include <memory>
 #include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
 
 #include "neon_asm.h"
 #include "asio.hpp"
 #include "EventHandlers.h"
+#include "PacketPool.h"
+#include "rpsa/common/core/stream_codec.h"
+#include "rpsa/common/core/thread_sched.h"
 //#include "rpsa/common/messaging/message_factory.h"
 //#include "rpsa/common/io/basic_buffer.h"
 
 #define  SOCKET_BUFFER_SIZE 65536
-#define  FIFO_BUFFER_SIZE  SOCKET_BUFFER_SIZE * 3
+// Largest pack a client accepts, the length comes from the pack header
+#define  PACK_MAX_SIZE     (16 * 1024 * 1024)
+#define  PACK_HEADER_SIZE  64
+// After the channel data: int64 CLOCK_REALTIME ns of the first sample,
+// uint32 error bound in ns and uint32 PACK_TIME_* flags. Counted in the
+// pack size, older clients skip it.
+#define  PACK_TRAILER_SIZE 16
+#define  PACK_TIME_VALID   0x1u
+#define  PACK_TIME_SYNCED  0x2u // The kernel clock is disciplined by NTP or PTP
+#define  PACK_POOL_COUNT   16
+#define  PACK_POOL_BUFFER_SIZE (PACK_HEADER_SIZE + SOCKET_BUFFER_SIZE + PACK_TRAILER_SIZE)
+#define  MAX_TCP_CLIENTS   8
+#define  UDP_DEFAULT_MTU   1500
+#define  UDP_IP_HEADERS    28   // IPv4 + UDP header
+#define  UDP_BATCH_MAX     64   // Datagrams per sendmmsg / GSO send
+#define  UDP_SOCKET_BUFFER (4 * 1024 * 1024)
+// Packs queued per TCP client before the backpressure policy kicks in
+#define  PACK_CLIENT_QUEUE_LIMIT 4
+// TCP flow control from the client: 16 byte ID, uint64 bytes of packs
+// received so far and uint64 bytes it can take on top of them. The server
+// drops whole packs past that instead of filling the socket buffers.
+#define  PACK_CREDIT_SIZE      32
+#define  PACK_CREDIT_PERIOD_MS 20
+// Word 13 of the pack header: the board id in the low bits, the payload
+// type and a flag for sample ids counted from the first trigger, which all
+// boards of a daisy chain see at the same sample
+#define  PACK_BOARD_MASK   0xFFFFu
+#define  PACK_BOARD_SYNCED 0x80000000u
+#define  PACK_PAYLOAD_MASK  0x00FF0000u
+#define  PACK_PAYLOAD_SHIFT 16
+// Payload types, older servers leave the bits 0
+#define  PACK_PAYLOAD_SAMPLES  0 // Samples, lock-in or power meter outputs
+#define  PACK_PAYLOAD_SPECTRUM 1 // dBFS frames of the CSpectrum bins, the sample id counts bins
+#define  PACK_PAYLOAD_IQ       2 // Float I on channel 1 and Q on channel 2 of the CDdc
+// Sample id of the first trigger in synchronized packs, the samples before it stay positive
+#define  PACK_SYNC_ORIGIN  (1ULL << 48)
 
 using  namespace std;
 using  namespace asio;
@@ -33,6 +74,12 @@ namespace  asionet {
         NONE
     };
 
+    // What the server does with a TCP client whose send queue is full
+    enum BackpressurePolicy {
+        DROP_OLDEST,
+        DISCONNECT
+    };
+
     class CAsioSocket {
     public:
         typedef uint8_t* send_buffer;
@@ -58,16 +105,73 @@ namespace  asionet {
         bool IsConnected();
         void SendBuffer(const void *_buffer, size_t _size);
         bool SendBuffer(bool async,send_buffer _buffer, size_t _size);
+        bool SendBuffers(const uint8_t *_header, size_t _header_size, const void *_ch1, size_t _size_ch1, const void *_ch2, size_t _size_ch2, const uint8_t *_trailer, size_t _trailer_size);
+        bool SendBatch(send_buffer _buffer, size_t _size);
+        uint64_t GetLostPacks();
         void addHandler(Events _event, std::function<void(string host)> _func);
         void addHandler(Events _event, std::function<void(error_code error)> _func);
         void addHandler(Events _event, std::function<void(error_code error,size_t)> _func);
         void addHandler(Events _event, std::function<void(error_code error,uint8_t*,size_t)> _func);
+        void setPacketPool(CPacketPool::Ptr _pool);
+        void setBackpressurePolicy(BackpressurePolicy _policy);
+        // TCP server only, set before clients connect
+        void setZeroCopy(bool _enable);
+        // TCP client only, set before InitClient(). Returns the bytes the
+        // receiver can still take, sent to the server as its credit.
+        void setCreditSource(std::function<uint64_t()> _source);
+        size_t   GetClientsCount();
+        uint64_t GetDroppedPacks();
+        // Part of the dropped packs, refused for lack of client credit
+        uint64_t GetThrottledPacks();
+        uint64_t GetSentBytes();
+        // Deepest send queue seen, in packs, over every client
+        size_t   GetQueuePeak();
 
     private:
 
         CAsioSocket(const CAsioSocket &) = delete;
         CAsioSocket(CAsioSocket &&) = delete;
 
+        // One subscriber of a TCP server. Every client queues references to
+        // the same pool packet, the packet goes back to the pool once the
+        // last client has sent it.
+        struct TcpClient {
+            using Ptr = shared_ptr<TcpClient>;
+            shared_ptr<asio::ip::tcp::socket> socket;
+            asio::ip::tcp::endpoint endpoint;
+            deque<pair<shared_ptr<uint8_t>,size_t>> queue;
+            bool is_sending;
+            size_t offset; // Bytes of the front pack already sent
+            // MSG_ZEROCOPY sends: the kernel reads the pack after the send
+            // returned, it is held under the id of its sendmsg until the
+            // completion arrives on the error queue
+            bool zerocopy;
+            uint32_t zc_next;
+            deque<pair<uint32_t,shared_ptr<uint8_t>>> zc_pending;
+            // Credit messages from the client. Packs are only queued while
+            // queued_bytes stays within credit_limit, the bytes received
+            // by the client plus its window.
+            vector<uint8_t> rx;
+            size_t rx_size;
+            bool credit_valid;
+            uint64_t credit_limit;
+            uint64_t queued_bytes;
+        };
+
+        void StartAccept();
+        void EnqueueToClient(TcpClient::Ptr _client, shared_ptr<uint8_t> _packet, size_t _size);
+        void StartClientSend(TcpClient::Ptr _client);
+        void HandlerClientSend(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client);
+        void HandlerClientZeroCopySend(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client);
+        void ReapZeroCopy(TcpClient::Ptr _client);
+        void HandlerSendToClient(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client);
+        void CloseClient(TcpClient::Ptr _client);
+        void StartClientReceive(TcpClient::Ptr _client);
+        void HandlerClientReceive(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client);
+        void SendCredit();
+        void HandlerCreditTimer(const asio::error_code &_error);
+        vector<TcpClient::Ptr> GetClients();
+        bool IsTcpServer();
 
         void WaitClient();
         void HandlerReceiveFromClient(const asio::error_code &error);
@@ -76,6 +180,14 @@ namespace  asionet {
         void HandlerSend(const asio::error_code &_error, size_t _bytesTransferred);
         void HandlerSend2(const asio::error_code &_error, size_t _bytesTransferred, uint8_t *buffer);
         void HandlerReceiveFromServer(const asio::error_code &ErrorCode, size_t bytes_transferred);
+        void StartTcpReceive();
+        void HandlerTcpHeader(const asio::error_code &_error, size_t _bytesTransferred);
+        void HandlerTcpBody(const asio::error_code &_error, size_t _bytesTransferred);
+        void StartNextSend();
+        size_t SendDatagrams(const uint8_t *_buffer, size_t _size, asio::error_code &_error);
+        void ReleaseSendBuffer(uint8_t *buffer);
+        void ClearSendQueue();
+        void UpdateQueuePeak(size_t _size);
 
         Mode m_mode;
         Protocol m_protocol;
@@ -93,10 +205,43 @@ namespace  asionet {
         char m_udp_recv_server_buffer[1];
         bool m_is_udp_connected;
         bool m_is_tcp_connected;
-        uint8_t  *m_tcp_fifo_buffer;
-        uint32_t  m_pos_last_in_fifo;
+        // TCP client reassembly: the header is read first, then the body
+        // straight behind it, so every pack arrives contiguous in one read
+        vector<uint8_t> m_tcp_pack;
         uint64_t  m_last_pack_id;
-
+        std::function<uint64_t()> m_credit_source;
+        shared_ptr<asio::steady_timer> m_credit_timer;
+        uint8_t   m_credit_msg[PACK_CREDIT_SIZE];
+        bool      m_credit_sending;
+        uint64_t  m_received_bytes;
+        uint64_t  m_credit_received; // m_received_bytes in the last credit sent
+        uint64_t  m_credit_window;
+
+        CPacketPool::Ptr m_pack_pool;
+        // A batch item holds several packs back to back, each one is sent as its own datagram
+        struct SendItem {
+            send_buffer buffer;
+            size_t      size;
+            bool        batch;
+        };
+        deque<SendItem> m_send_queue; // Accessed only from the asio thread
+        bool      m_is_sending;
+
+        shared_ptr<asio::ip::tcp::socket> m_tcp_accept_socket;
+        asio::ip::tcp::endpoint m_tcp_accept_endpoint;
+        vector<TcpClient::Ptr> m_tcp_clients;
+        std::mutex             m_tcp_clients_mtx;
+        std::atomic<size_t>    m_tcp_clients_count;
+        std::atomic<uint64_t>  m_dropped_packs;
+        std::atomic<uint64_t>  m_throttled_packs;
+        BackpressurePolicy     m_backpressure;
+        bool                   m_zerocopy;
+
+        bool                   m_udp_gso;
+        bool                   m_first_pack;
+        std::atomic<uint64_t>  m_lost_packs;
+        std::atomic<uint64_t>  m_sent_bytes;
+        std::atomic<size_t>    m_queue_peak;
 
         EventList<std::string> m_callback_Str;
         EventList<std::error_code> m_callback_Error;
@@ -128,12 +273,58 @@ namespace  asionet {
         void addCallReceived(function<void(error_code error,uint8_t*,size_t)> _func);
 
         bool SendData(bool async,CAsioSocket::send_buffer _buffer,size_t _size);
+        CAsioSocket::send_buffer BuildPackInPool(
+                uint64_t _id ,
+                uint64_t _lostRate ,
+                uint64_t _sampleId ,
+                uint32_t _oscRate  ,
+                uint32_t _resolution ,
+                const void *_ch1 ,
+                size_t _size_ch1 ,
+                const void  *_ch2 ,
+                size_t _size_ch2 ,
+                Stream_Compression _compression,
+                size_t &_buffer_size);
+        void ReleasePack(CAsioSocket::send_buffer _buffer);
+        CAsioSocket::send_buffer AcquirePack();
+        size_t GetPackCapacity();
+        bool SendBatch(CAsioSocket::send_buffer _buffer, size_t _size);
+        uint64_t GetLostPacks();
+        bool SendPack(
+                uint64_t _id ,
+                uint64_t _lostRate ,
+                uint64_t _sampleId ,
+                uint32_t _oscRate  ,
+                uint32_t _resolution ,
+                const void *_ch1 ,
+                size_t _size_ch1 ,
+                const void  *_ch2 ,
+                size_t _size_ch2);
+        uint64_t GetPoolExhaustedCount();
+        void     SetBackpressurePolicy(BackpressurePolicy _policy);
+        void     SetZeroCopy(bool _enable);
+        void     SetCreditSource(std::function<uint64_t()> _source);
+        void     SetThreadSched(const ThreadSchedT &_sched);
+        size_t   GetClientsCount();
+        uint64_t GetDroppedPacks();
+        uint64_t GetThrottledPacks();
+        uint64_t GetSentBytes();
+        size_t   GetQueuePeak();
     Protocol GetProtocol() { return  m_protocol;};
         bool IsConnected();
 
+        // Stamped into every pack of the process, so an aggregator can tell the boards apart
+        static void SetBoardId(uint16_t _id);
+        static void SetSyncedIds(bool _synced);
+        static void SetPayloadType(uint8_t _type);
+        // Time of sample _sampleId, the packs built by the calling thread
+        // afterwards get their time from it and the rate in their header
+        static void SetPackTime(uint64_t _sampleId, int64_t _timeNs, uint32_t _errorNs, uint32_t _flags);
+
         static uint8_t *BuildPack(
                 uint64_t _id ,
                 uint64_t _lostRate ,
+                uint64_t _sampleId ,
                 uint32_t _oscRate  ,
                 uint32_t _resolution ,
                 const void *_ch1 ,
@@ -146,6 +337,35 @@ namespace  asionet {
                 CAsioSocket::send_buffer buffer ,
                 uint64_t _id ,
                 uint64_t _lostRate ,
+                uint64_t _sampleId ,
+                uint32_t _oscRate  ,
+                uint32_t _resolution ,
+                const void *_ch1 ,
+                size_t _size_ch1 ,
+                const void  *_ch2 ,
+                size_t _size_ch2 ,
+                size_t &_buffer_size);
+
+        static void BuildPackHeader(
+                uint8_t *_header ,
+                uint64_t _id ,
+                uint64_t _lostRate ,
+                uint64_t _sampleId ,
+                uint32_t _oscRate  ,
+                uint32_t _resolution ,
+                size_t _size_ch1 ,
+                size_t _size_ch2);
+
+        static void BuildPackTrailer(
+                uint8_t *_trailer ,
+                uint64_t _sampleId ,
+                uint32_t _oscRate);
+
+        static bool BuildCompressedPack(
+                CAsioSocket::send_buffer buffer ,
+                uint64_t _id ,
+                uint64_t _lostRate ,
+                uint64_t _sampleId ,
                 uint32_t _oscRate  ,
                 uint32_t _resolution ,
                 const void *_ch1 ,
@@ -159,6 +379,7 @@ namespace  asionet {
                 size_t _size ,
                 uint64_t &_id ,
                 uint64_t &_lostRate ,
+                uint64_t &_sampleId ,
                 uint32_t &_oscRate  ,
                 uint32_t &_resolution ,
                 CAsioSocket::send_buffer &_ch1 ,
@@ -180,6 +401,7 @@ namespace  asionet {
         asio::io_service::work m_Work;
         asio::thread *m_asio_th;
         bool m_IsRun;
+        CPacketPool::Ptr m_packPool;
         shared_ptr<CAsioSocket> m_server;
 
     };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#define BUFFER_RING_DEFAULT_DEPTH 8
+
+//!
+//! \brief Single producer / single consumer ring of aligned channel buffers.
+//!
+//! The oscilloscope thread copies every DMA half-buffer into the next free
+//! slot and the send thread drains the slots in order. A late consumer
+//! only fills the ring, the acquisition is dropped only when every slot is
+//! taken. No locks are used, head and tail are only advanced by their owner.
+//!
+class CBufferRing
+{
+public:
+    using Ptr = std::shared_ptr<CBufferRing>;
+
+    struct Slot {
+        void    *ch1;
+        void    *ch2;
+        size_t   size_ch1;
+        size_t   size_ch2;
+        uint64_t lostRate;
+        uint64_t sampleId;
+        uint32_t rate;       // Decimation and resolution of the samples, they may change during a run
+        uint16_t resolution;
+        std::chrono::steady_clock::time_point readyTime;
+        std::chrono::steady_clock::time_point copiedTime;
+    };
+
+    static Ptr Create(size_t _depth, size_t _bufferSize);
+    CBufferRing(size_t _depth, size_t _bufferSize);
+    ~CBufferRing();
+
+    // Producer side. Returns nullptr if the ring is full.
+    Slot    *writeSlot();
+    void     commitWrite();
+    // Frees the oldest slot for the producer. Only while the consumer is
+    // held off, as for the pre-trigger window.
+    void     dropOldest();
+
+    // Consumer side. Returns nullptr if the ring is empty.
+    Slot    *readSlot();
+    void     commitRead();
+
+    size_t   depth() const { return m_slots.size(); }
+    size_t   count() const;
+    size_t   peakCount() const { return m_peak; }
+
+private:
+    CBufferRing(const CBufferRing &) = delete;
+    CBufferRing(CBufferRing &&) = delete;
+
+    std::vector<Slot>   m_slots;
+    std::atomic<size_t> m_head; // Next slot to write, owned by the producer
+    std::atomic<size_t> m_tail; // Next slot to read, owned by the consumer
+    size_t              m_peak;
+};
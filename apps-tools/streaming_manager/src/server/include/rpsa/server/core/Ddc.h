@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Input samples of one oscillator update, recomputed exactly at every block start
+#define DDC_BLOCK 256
+#define DDC_MAX_DECIMATION 8192
+// Upper bound of the filter length, the taps are rounded up to a multiple of 4
+#define DDC_MAX_TAPS 65536
+// I and Q leave the pipeline as 32-bit floats
+#define DDC_RESOLUTION 32
+
+//!
+//! \brief Digital down converter settings.
+//!
+//! The band around \c frequency is shifted to DC and low pass filtered to
+//! \c cutoff of the output Nyquist frequency, so the complex output covers
+//! \c cutoff times the output rate around the center.
+//!
+struct DdcT
+{
+    bool     enable;
+    int      channel;      //!< ADC input, 1 or 2
+    double   frequency;    //!< Center frequency in Hz
+    uint32_t decimation;   //!< Input samples per output sample, 2 to DDC_MAX_DECIMATION
+    uint32_t tapsPerPhase;
+    double   cutoff;       //!< 0 to 1 of the output Nyquist frequency
+
+    DdcT(bool _enable = false, int _channel = 1, double _frequency = 10e6, uint32_t _decimation = 64,
+         uint32_t _tapsPerPhase = 8, double _cutoff = 0.8):
+        enable(_enable), channel(_channel), frequency(_frequency), decimation(_decimation),
+        tapsPerPhase(_tapsPerPhase), cutoff(_cutoff) {}
+};
+
+//!
+//! \brief Software DDC for the DMA stream, an NCO and a decimating FIR.
+//!
+//! Every ADC sample is mixed with exp(-j 2 pi f t), only every
+//! decimation-th output of the windowed sinc low pass is computed. I and Q
+//! are in units of the ADC full scale, a sine at the center frequency gives
+//! |I + jQ| equal to its peak amplitude. The oscillator phase counts from
+//! the first DMA sample, the filter delays the output by (taps - 1) / 2
+//! input samples.
+//!
+class CDdc
+{
+public:
+    using Ptr = std::shared_ptr<CDdc>;
+
+    static Ptr Create(const DdcT &_settings, double _sampleRate);
+    CDdc(const DdcT &_settings, double _sampleRate);
+
+    // Converts _count raw ADC samples into at most _count / decimation + 1 outputs per channel.
+    // Returns the number of outputs.
+    size_t   process(const int16_t *_in, size_t _count, float *_out_i, float *_out_q);
+    // Keeps the oscillator and the output index in step over _count lost samples, the filter starts over
+    void     skip(uint64_t _count);
+    void     reset();
+
+    // Absolute index of the next output sample
+    uint64_t outputIndex() const { return m_outIndex; }
+    double   outputRate() const { return m_sampleRate / m_settings.decimation; }
+    size_t   taps() const { return m_taps.size(); }
+    const DdcT &settings() const { return m_settings; }
+
+private:
+    uint64_t advance(uint64_t _count);
+
+    DdcT     m_settings;
+    double   m_sampleRate;
+    double   m_step;       // Oscillator cycles per sample
+    double   m_cycle;      // Oscillator phase of the next sample in cycles, 0 to 1
+    std::vector<float> m_taps;       // Reversed and zero padded at the front
+    std::vector<float> m_history[2]; // taps - 1 previous mixed samples, then the new ones
+    uint64_t m_next;       // Input samples up to the next output
+    uint64_t m_outIndex;
+};
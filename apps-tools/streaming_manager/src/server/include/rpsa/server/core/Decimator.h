@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Upper bound of the filter length, the taps are rounded up to a multiple of 8
+#define DECIMATOR_MAX_TAPS 4096
+#define DECIMATOR_MAX_FACTOR 1024
+
+//!
+//! \brief Software decimation settings.
+//!
+//! The low pass cuts at \c cutoff of the output Nyquist frequency and has
+//! \c tapsPerPhase taps for every output sample, so its length grows with
+//! the factor. BOXCAR is a plain average over \c factor samples like the
+//! FPGA decimation, the windowed sinc filters trade the width of the
+//! transition band (HAMMING) against the stop band attenuation (BLACKMAN).
+//!
+struct DecimatorT
+{
+    enum Filter { BOXCAR, HAMMING, BLACKMAN };
+
+    bool     enable;
+    uint32_t factor;       //!< Input samples per output sample, 2 to DECIMATOR_MAX_FACTOR
+    Filter   filter;
+    uint32_t tapsPerPhase;
+    double   cutoff;       //!< 0 to 1 of the output Nyquist frequency
+
+    DecimatorT(bool _enable = false, uint32_t _factor = 8, Filter _filter = HAMMING, uint32_t _tapsPerPhase = 16, double _cutoff = 0.8):
+        enable(_enable), factor(_factor), filter(_filter), tapsPerPhase(_tapsPerPhase), cutoff(_cutoff) {}
+};
+
+//!
+//! \brief Polyphase FIR decimator for the raw DMA samples.
+//!
+//! Only every factor-th filter output is computed, each one is a dot
+//! product of Q15 taps with the newest input samples, 16 products per NEON
+//! step into 32-bit sums. The outputs are 16-bit samples again, so every
+//! resolution and sink takes them as they are. The filter delays the
+//! samples by (taps - 1) / 2 input samples.
+//!
+class CDecimator
+{
+public:
+    using Ptr = std::shared_ptr<CDecimator>;
+
+    static Ptr Create(const DecimatorT &_settings);
+    CDecimator(const DecimatorT &_settings);
+
+    // Filters _count raw samples per channel into at most _count / factor + 1 outputs,
+    // a missing channel is nullptr. Returns the number of outputs per channel.
+    size_t   process(const int16_t *_in_ch1, const int16_t *_in_ch2, size_t _count, int16_t *_out_ch1, int16_t *_out_ch2);
+    // Keeps the output index in step over _count lost samples, the filter starts over
+    void     skip(uint64_t _count);
+    void     reset();
+
+    // Absolute index of the next output sample
+    uint64_t outputIndex() const { return m_outIndex; }
+    size_t   taps() const { return m_taps.size(); }
+    const DecimatorT &settings() const { return m_settings; }
+
+private:
+    size_t   filter(std::vector<int16_t> &_history, const int16_t *_in, size_t _count, int16_t *_out);
+    uint64_t advance(uint64_t _count);
+
+    DecimatorT           m_settings;
+    std::vector<int16_t> m_taps;      // Q15, reversed and zero padded at the front
+    std::vector<int16_t> m_history[2]; // taps - 1 previous samples, then the new ones
+    uint64_t             m_next;      // Input samples up to the next output
+    uint64_t             m_outIndex;
+};
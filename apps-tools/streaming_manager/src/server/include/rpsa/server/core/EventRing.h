@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Events kept per thread, a power of two. Older events are overwritten
+#define EVENT_RING_DEFAULT_DEPTH 4096
+// Bytes of a message event, longer text is cut
+#define EVENT_RING_TEXT 16
+
+//!
+//! \brief Binary trace of pipeline events for leaving instrumentation on.
+//!
+//! Every thread that records gets its own ring on its first event, so
+//! recording is a few relaxed stores without locks or system calls. The
+//! rings outlive their threads and are reused by the next thread. Reading
+//! copies the rings while they are written, torn slots are detected by a
+//! sequence number and skipped.
+//!
+class CEventRing
+{
+public:
+    enum Type : uint16_t{
+        MESSAGE = 1,      // text: EVENT_RING_TEXT bytes
+        EXCEPTION,        // text: what() of a caught exception
+        ADC_BUFFER,       // a: samples per channel, b: buffers lost since the last one
+        RING_OVERFLOW,    // a: segments lost so far
+        FILE_QUEUED,      // a: bytes, b: bytes in the write queue
+        FILE_DROPPED,     // a: bytes, b: bytes in the write queue
+        NET_BUFFER,       // a: bytes handed to the network, b: id of the first pack
+        NET_DROPPED,      // a: bytes dropped on an exhausted pack pool
+        TRIGGER,          // a: sample index, b: channel in [7:0] (0 software), pulse width above
+        RECONFIGURED      // a: decimation, b: channel mask in [7:0], resolution above
+    };
+
+#pragma pack(push, 1)
+    struct Event{
+        uint64_t time_ns;  // CLOCK_MONOTONIC
+        uint16_t type;
+        uint16_t thread;   // index of the ring
+        uint32_t reserved;
+        union{
+            struct{
+                uint64_t a;
+                uint64_t b;
+            } value;
+            char text[EVENT_RING_TEXT];
+        };
+    };
+#pragma pack(pop)
+
+    static void SetEnabled(bool _enable);
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    // Depth of the rings created from now on
+    static void SetDepth(size_t _events);
+
+    static void Record(Type _type, uint64_t _a = 0, uint64_t _b = 0);
+    static void Message(Type _type, const char *_text);
+
+    // Events of all rings ordered by time
+    static std::vector<Event> Collect();
+    // Header "RPEVT001", the event size and count as uint32, then the events
+    static bool Write(std::ostream &_out);
+    static bool DumpToFile(const std::string &_path);
+    static void Clear();
+
+    // Storage of one thread
+    struct Slot;
+    class Ring;
+
+private:
+    static Ring *ThreadRing();
+    static uint64_t Now();
+
+    static std::atomic<bool>   s_enabled;
+    static std::atomic<size_t> s_depth;
+};
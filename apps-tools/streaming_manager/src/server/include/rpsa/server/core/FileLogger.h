@@ -11,7 +11,11 @@ public:
         FILESYSTEM_RATE,
         RECIVE_DATE,
         RECIVE_DATA_CH1,
-        RECIVE_DATA_CH2
+        RECIVE_DATA_CH2,
+        QUEUE_DEPTH,
+        QUEUE_BYTES,
+        QUEUE_BUDGET,
+        QUEUE_OVERFLOWS
     };
 
     using Ptr = std::shared_ptr<CFileLogger>;
@@ -40,4 +44,8 @@ private:
     uint64_t    m_reciveData_ch1;
     uint64_t    m_reciveData_ch2;
     uint64_t    m_old_id;
+    uint64_t    m_queueDepthMax;
+    uint64_t    m_queueBytesMax;
+    uint64_t    m_queueBudget;
+    uint64_t    m_queueOverflows;
 };
\ No newline at end of file
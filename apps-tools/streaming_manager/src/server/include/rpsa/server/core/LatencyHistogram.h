@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Bucket n holds latencies below 2^n microseconds
+#define LATENCY_HISTOGRAM_BUCKETS 32
+
+//!
+//! \brief Log2 histogram of stage latencies in microseconds.
+//!
+//! Filled by one thread and read by any other, updates are relaxed atomics
+//! so recording stays cheap enough for the per-buffer path.
+//!
+class CLatencyHistogram
+{
+public:
+    CLatencyHistogram();
+
+    void     add(uint64_t _us);
+    void     reset();
+    uint64_t count() const;
+    uint64_t max() const;
+    double   mean() const;
+    // Upper bound of the bucket that holds the _p quantile, 0 <= _p <= 1
+    uint64_t percentile(double _p) const;
+    void     print(std::ostream &_out, const std::string &_name) const;
+
+private:
+    CLatencyHistogram(const CLatencyHistogram &) = delete;
+    CLatencyHistogram(CLatencyHistogram &&) = delete;
+
+    std::atomic<uint64_t> m_buckets[LATENCY_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// Input samples of one reference update, the oscillator is recomputed
+// exactly at every block start
+#define LOCKIN_BLOCK 256
+#define LOCKIN_MAX_ORDER 4
+// The samples leave the pipeline as 32-bit floats
+#define LOCKIN_RESOLUTION 32
+
+//!
+//! \brief Lock-in settings.
+//!
+//! The reference is a cosine at \c frequency, normally the generator output
+//! that drives the device under test. Its phase counts from the first DMA
+//! sample, so a fixed offset to the generator is trimmed with \c phase.
+//!
+struct LockInT
+{
+    bool     enable;
+    int      channel;      //!< ADC input, 1 or 2
+    double   frequency;    //!< Reference frequency in Hz
+    double   phase;        //!< Reference phase in degrees
+    double   timeConstant; //!< Of every low pass stage, in seconds
+    int      order;        //!< Low pass stages, 1 to LOCKIN_MAX_ORDER, 6 dB/octave each
+    uint32_t decimation;   //!< Input samples per output sample, at least 2
+    bool     polar;        //!< R and theta instead of X and Y
+
+    LockInT(bool _enable = false, int _channel = 1, double _frequency = 1000, double _phase = 0,
+            double _timeConstant = 0.01, int _order = 2, uint32_t _decimation = 1024, bool _polar = false):
+        enable(_enable), channel(_channel), frequency(_frequency), phase(_phase),
+        timeConstant(_timeConstant), order(_order), decimation(_decimation), polar(_polar) {}
+};
+
+//!
+//! \brief Continuous lock-in demodulator for the DMA stream.
+//!
+//! Every ADC sample is mixed with the reference, the products run through
+//! a cascade of RC low pass stages and every decimation-th filter output is
+//! kept. X and Y, or R and theta in degrees, are in units of the ADC full
+//! scale, R is the peak amplitude of the input at the reference.
+//!
+class CLockIn
+{
+public:
+    using Ptr = std::shared_ptr<CLockIn>;
+
+    static Ptr Create(const LockInT &_settings, double _sampleRate);
+    CLockIn(const LockInT &_settings, double _sampleRate);
+
+    // Demodulates _count raw ADC samples into at most _count / decimation + 1 outputs per channel.
+    // Returns the number of outputs.
+    size_t   process(const int16_t *_in, size_t _count, float *_out_ch1, float *_out_ch2);
+    // Keeps the reference and the output index in step over _count lost samples
+    void     skip(uint64_t _count);
+    void     reset();
+
+    // Absolute index of the next output sample
+    uint64_t outputIndex() const { return m_outIndex; }
+    double   outputRate() const { return m_sampleRate / m_settings.decimation; }
+    const LockInT &settings() const { return m_settings; }
+
+private:
+    LockInT  m_settings;
+    double   m_sampleRate;
+    double   m_step;       // Reference cycles per sample
+    double   m_cycle;      // Reference phase of the next sample in cycles, 0 to 1
+    double   m_alpha;      // Low pass coefficient of one stage
+    double   m_x[LOCKIN_MAX_ORDER];
+    double   m_y[LOCKIN_MAX_ORDER];
+    uint32_t m_decCount;   // Input samples since the last output
+    uint64_t m_outIndex;
+};
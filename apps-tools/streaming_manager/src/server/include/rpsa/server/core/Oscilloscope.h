@@ -1,7 +1,12 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <string>
+#include <asio.hpp>
 
 #include <UioParser.h>
 
@@ -13,6 +18,15 @@ constexpr uint32_t osc1_baseaddr = 256;
 constexpr uint32_t osc_buf_size = 65536;
 constexpr uint32_t osc_buf_pre_samp = osc_buf_size / 4;
 constexpr uint32_t osc_buf_post_samp = (osc_buf_size / 4) * 3;
+// The DMA always needs two segments per channel, the rest of the reserved memory is spare
+constexpr uint32_t osc_buf_min_segments = 2;
+// Synthetic source, paced like the ADC and sized like the streaming reserved memory
+constexpr uint32_t osc_adc_rate = 125000000;
+constexpr uint32_t osc_synthetic_segments = 8;
+// DMA direction of the u-dma-buf sync interface, the FPGA only writes the buffer
+constexpr uint32_t osc_dma_from_device = 2;
+// Instance of an oscilloscope that drives both blocks as a pair
+constexpr int osc_instance_pair = -1;
 
 struct OscilloscopeMapT
 {
@@ -49,8 +63,23 @@ class COscilloscope
 {
 public:
     using Ptr = std::shared_ptr<COscilloscope>;
+    //! Gets asio::error::timed_out if no buffer is ready in time
+    typedef std::function<void(const asio::error_code &_error, uint8_t *_buffer1, uint8_t *_buffer2, size_t _size, bool _overFlow1, bool _overFlow2)> NextHandler;
 
-    static Ptr Create(const UioT &_uio, bool _channel1Enable, bool _channel2Enable, uint32_t _dec_factor);
+    //! With _dmaBuf naming a u-dma-buf device (e.g. "udmabuf0") the DMA
+    //! writes into that buffer, which is mapped cached. Each finished
+    //! segment is invalidated before it is handed out and the reader works
+    //! on it in place. Without it, or if the device is missing, the
+    //! uncached reserved memory of the UIO node is used.
+    static Ptr Create(const UioT &_uio, bool _channel1Enable, bool _channel2Enable, uint32_t _dec_factor, const std::string &_dmaBuf = "");
+    //! Ramp data in plain memory, delivered at the rate of _dec_factor. No FPGA needed.
+    static Ptr CreateSynthetic(bool _channel1Enable, bool _channel2Enable, uint32_t _dec_factor);
+    //! Only the block of _instance, 0 for osc0 (channel 1) or 1 for osc1
+    //! (channel 2), with its own event, decimation and half of the DMA
+    //! memory. Two instances of one UIO node run independently, each on
+    //! its own thread. The data comes in the buffer of its channel, the
+    //! other one is always nullptr.
+    static Ptr CreateInstance(const UioT &_uio, unsigned _instance, uint32_t _dec_factor, const std::string &_dmaBuf = "");
 
     COscilloscope(bool _channel1Enable,bool _channel2Enable, int _fd, void *_regset, size_t _regsetSize, void *_buffer, size_t _bufferSize, uintptr_t _bufferPhysAddr,uint32_t _dec_factor);
     COscilloscope(const COscilloscope &) = delete;
@@ -59,14 +88,38 @@ public:
 
     void prepare();
     bool next(uint8_t *&_buffer1,uint8_t *&_buffer2, size_t &_size,bool &_overFlow1 , bool &_overFlow2);
+    void asyncNext(asio::io_service &_ios, int _timeout_ms, NextHandler _handler);
+    void cancelNext();
     bool changeBuffers();
     void stop();
+    //! Takes effect with the next prepare()
+    void setDecimation(uint32_t _dec_factor);
+    //! Takes effect with the next prepare(), the DMA always runs both channels
+    //! of a pair, an instance keeps the other channel disabled
+    void setChannels(bool _channel1Enable, bool _channel2Enable);
+    uint32_t decimation() const { return m_dec_factor; }
+    //! osc_instance_pair, 0 or 1
+    int instance() const { return m_Instance; }
+    size_t segmentCount() const { return m_SegmentCount; }
+    bool cached() const { return m_DmaBufFd != -1; }
+    //! When the DMA finished the buffer last returned by next()
+    std::chrono::steady_clock::time_point readyTime() const { return m_ReadyTime; }
 
 private:
     void setReg(volatile OscilloscopeMapT *_OscMap ,unsigned int _Channel);
+    uint32_t segmentAddr(unsigned _Channel, unsigned _Segment);
+    void retarget(unsigned _Half);
+    bool enableInterrupt();
+    bool drives(unsigned _Channel) const { return m_Instance == osc_instance_pair || m_Instance == (int)_Channel; }
+    int readyHalf();
+    void waitInterrupt(NextHandler _handler);
+    void fetch(uint8_t *&_buffer1,uint8_t *&_buffer2, size_t &_size,bool &_overFlow1 , bool &_overFlow2);
+    void synthesize();
+    bool syncSegment(int _syncFd, unsigned _Channel, unsigned _Segment);
 
     bool m_Channel1;
     bool m_Channel2;
+    int m_Instance;
     int m_Fd;
     void *m_Regset;
     size_t m_RegsetSize;
@@ -79,4 +132,27 @@ private:
     uint8_t *m_OscBuffer2;
     unsigned m_OscBufferNumber;
     uint32_t m_dec_factor;
+    //! Segments per channel in the reserved memory. The DMA has only two
+    //! destination registers, a finished half is pointed at a free segment
+    //! and handed back at once, the filled one stays with the reader.
+    size_t m_SegmentCount;
+    unsigned m_HwSegment[2];
+    bool m_HwPending[2];
+    std::deque<unsigned> m_FreeSegments;
+    std::deque<unsigned> m_HeldSegments;
+    //! The UIO descriptor and wait timer of asyncNext(), bound to the first io_service used
+    std::unique_ptr<asio::posix::stream_descriptor> m_Descriptor;
+    std::unique_ptr<asio::steady_timer> m_WaitTimer;
+    bool m_WaitTimedOut;
+    std::chrono::steady_clock::time_point m_ReadyTime;
+    bool m_Synthetic;
+    std::chrono::steady_clock::duration m_SynthPeriod;
+    std::chrono::steady_clock::time_point m_SynthNext;
+    unsigned m_SynthHalf;
+    //! u-dma-buf descriptor of the cached buffer and its sysfs sync_offset,
+    //! sync_for_cpu and sync_for_device attributes, -1 when uncached
+    int m_DmaBufFd;
+    int m_SyncOffsetFd;
+    int m_SyncForCpuFd;
+    int m_SyncForDeviceFd;
 };
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//!
+//! \brief Fixed-size pool of preallocated network packets.
+//!
+//! All packets live in one contiguous block allocated at construction time,
+//! so the streaming hot path never touches the heap. A packet is taken with
+//! acquire() before BuildPack and returned with release() once the socket
+//! has finished sending it.
+//!
+class CPacketPool
+{
+public:
+    using Ptr = std::shared_ptr<CPacketPool>;
+
+    static Ptr Create(size_t _count, size_t _packetSize);
+    CPacketPool(size_t _count, size_t _packetSize);
+    ~CPacketPool();
+
+    uint8_t *acquire();
+    bool     release(uint8_t *_packet);
+    bool     isOwned(const uint8_t *_packet) const;
+
+    size_t   packetSize() const { return m_packetSize; }
+    size_t   count() const { return m_count; }
+    size_t   freeCount();
+    uint64_t exhaustedCount();
+    void     resetExhaustedCount();
+
+private:
+    CPacketPool(const CPacketPool &) = delete;
+    CPacketPool(CPacketPool &&) = delete;
+
+    size_t                m_count;
+    size_t                m_packetSize;
+    uint8_t              *m_memory;
+    std::vector<uint8_t*> m_free;
+    uint64_t              m_exhausted;
+    std::mutex            m_mutex;
+};
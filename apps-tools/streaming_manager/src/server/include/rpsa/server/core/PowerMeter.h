@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Harmonic groups evaluated per window, IEC 61000-4-7 goes up to the 50th
+#define POWER_HARMONICS 50
+// Points every window is resampled to, synchronous to the fundamental
+#define POWER_FFT_LEN 2048
+// The input is box averaged down to at least this rate before the analysis
+#define POWER_INNER_RATE 256000
+// Windows per published result, 15 give the 150/180 cycle interval of IEC 61000-4-30
+#define POWER_AGGREGATE 15
+
+//!
+//! \brief Power meter settings.
+//!
+//! Voltage is on IN1 and current on IN2, both scaled to physical units with
+//! the value at ADC full scale, probe attenuation included.
+//!
+struct PowerMeterT
+{
+    bool   enable;
+    int    frequency;   //!< Nominal mains frequency, 50 (10 cycle windows) or 60 (12 cycle windows)
+    double uFullScale;  //!< Volts at ADC full scale
+    double iFullScale;  //!< Amperes at ADC full scale
+    int    aggregate;   //!< Windows per published result
+
+    PowerMeterT(bool _enable = false, int _frequency = 50, double _uFullScale = 1,
+                double _iFullScale = 1, int _aggregate = POWER_AGGREGATE):
+        enable(_enable), frequency(_frequency), uFullScale(_uFullScale),
+        iFullScale(_iFullScale), aggregate(_aggregate) {}
+};
+
+//!
+//! \brief Aggregated result of consecutive windows.
+//!
+//! RMS values and harmonic groups are the RMS of the window values, powers
+//! and the frequency their mean. Q is the fundamental reactive power, the
+//! energies count from the start of the stream.
+//!
+struct PowerResultT
+{
+    uint64_t sequence;    //!< Results published so far, 0 before the first
+    uint32_t windows;     //!< Windows in this result
+    bool     synced;      //!< All of them locked on the fundamental
+    uint64_t lostWindows; //!< Windows dropped over DMA overflows since the start
+    double   frequency;
+    double   urms;
+    double   irms;
+    double   p;
+    double   q;
+    double   s;
+    double   pf;
+    double   thdU;        //!< Percent of the fundamental group
+    double   thdI;
+    double   energyP;     //!< Wh
+    double   energyQ;     //!< varh
+    float    harmU[POWER_HARMONICS]; //!< Group RMS of harmonics 1 to POWER_HARMONICS
+    float    harmI[POWER_HARMONICS];
+
+    PowerResultT();
+};
+
+//!
+//! \brief Gapless power measurement on the DMA stream.
+//!
+//! The signal is cut into consecutive windows of 10 (50 Hz) or 12 (60 Hz)
+//! fundamental periods, each ending on the rising zero crossing of U that
+//! starts the next one, so every sample belongs to exactly one window.
+//! A window is resampled to POWER_FFT_LEN points over its exact length and
+//! U and I go through one complex FFT, harmonic h then sits on bin
+//! h * cycles and its group collects the bins around it. Without a valid
+//! crossing a window closes after its nominal length and is marked as not
+//! synced.
+//!
+class CPowerMeter
+{
+public:
+    using Ptr = std::shared_ptr<CPowerMeter>;
+
+    static Ptr Create(const PowerMeterT &_settings, double _sampleRate);
+    CPowerMeter(const PowerMeterT &_settings, double _sampleRate);
+
+    // Measures _count raw ADC samples of both inputs
+    void   process(const int16_t *_u, const int16_t *_i, size_t _count);
+    // Drops the running window after _count lost samples
+    void   skip(uint64_t _count);
+    void   reset();
+
+    // Copies the newest result, any thread. False if there is none yet.
+    bool   result(PowerResultT &_out) const;
+    double innerRate() const { return m_innerRate; }
+    const PowerMeterT &settings() const { return m_settings; }
+
+private:
+    void   addSample(float _u, float _i);
+    void   closeWindow(double _end, bool _synced);
+    void   fft();
+
+    PowerMeterT m_settings;
+    double   m_innerRate;
+    uint32_t m_decimation;  // Input samples per inner sample
+    uint32_t m_decCount;
+    int32_t  m_accU;
+    int32_t  m_accI;
+    int      m_cycles;      // Fundamental periods per window
+    double   m_nominalLen;  // Inner samples of a nominal window
+
+    // Inner samples of the running window, sample 0 is the one at or just before m_start
+    std::vector<float> m_u;
+    std::vector<float> m_i;
+    bool     m_started;
+    double   m_start;       // Window start in samples of m_u
+    bool     m_startSynced; // The window started on a crossing
+    int      m_crossings;   // Rising crossings of U since the start
+    bool     m_armed;
+    float    m_mean;        // DC and hysteresis of U from the last window
+    float    m_hyst;
+
+    // FFT of U + jI, bit reversal and twiddles of POWER_FFT_LEN
+    std::vector<float>    m_re;
+    std::vector<float>    m_im;
+    std::vector<float>    m_cos;
+    std::vector<float>    m_sin;
+    std::vector<uint32_t> m_rev;
+
+    // Running aggregate
+    PowerResultT m_acc;
+    double   m_accTime;
+    double   m_energyP;
+    double   m_energyQ;
+    uint64_t m_lostWindows;
+
+    mutable std::mutex m_resultMutex;
+    PowerResultT m_result;
+};
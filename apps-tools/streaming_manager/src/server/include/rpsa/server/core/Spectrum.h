@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#define SPECTRUM_MIN_FFT 256
+// Every output frame of a segment has to fit the float slot, see CSpectrum::process()
+#define SPECTRUM_MAX_FFT 16384
+// Frames leave the pipeline as 32-bit floats
+#define SPECTRUM_RESOLUTION 32
+
+//!
+//! \brief Power spectrum settings.
+//!
+//! Every frame is the average of as many consecutive windows of \c fftSize
+//! samples as fit into 1 / \c frameRate seconds, at least one.
+//!
+struct SpectrumT
+{
+    enum Window { RECT, HANN, BLACKMAN_HARRIS, FLAT_TOP };
+
+    bool     enable;
+    uint32_t fftSize;   //!< Power of two, SPECTRUM_MIN_FFT to SPECTRUM_MAX_FFT
+    Window   window;
+    double   frameRate; //!< Averaged frames per second
+
+    SpectrumT(bool _enable = false, uint32_t _fftSize = 4096, Window _window = HANN, double _frameRate = 10):
+        enable(_enable), fftSize(_fftSize), window(_window), frameRate(_frameRate) {}
+};
+
+//!
+//! \brief Averaged power spectra of the DMA stream.
+//!
+//! A frame holds fftSize / 2 bins from DC up to just below the Nyquist
+//! frequency, in dB of the ADC full scale. The window gain is compensated,
+//! so a sine on a bin reads its peak amplitude: 0 dBFS at full scale. Both
+//! channels go through one complex FFT of IN1 + j IN2.
+//!
+class CSpectrum
+{
+public:
+    using Ptr = std::shared_ptr<CSpectrum>;
+
+    static Ptr Create(const SpectrumT &_settings, double _sampleRate);
+    CSpectrum(const SpectrumT &_settings, double _sampleRate);
+
+    // Analyses _count raw samples per channel, a missing channel is nullptr. The finished
+    // frames are written one after the other, at most _count / (fftSize * averages) + 1.
+    // Returns the number of frames.
+    size_t   process(const int16_t *_in_ch1, const int16_t *_in_ch2, size_t _count, float *_out_ch1, float *_out_ch2);
+    // Drops the frame in progress over _count lost samples, the next one starts after them
+    void     skip(uint64_t _count);
+    void     reset();
+
+    // Absolute index of the next frame
+    uint64_t outputIndex() const { return m_outIndex; }
+    uint32_t bins() const { return m_settings.fftSize / 2; }
+    uint32_t averages() const { return m_averages; }
+    double   outputRate() const { return m_sampleRate / ((double)m_settings.fftSize * m_averages); }
+    const SpectrumT &settings() const { return m_settings; }
+
+private:
+    void     transform(bool _ch1, bool _ch2);
+    void     fft();
+
+    SpectrumT m_settings;
+    double   m_sampleRate;
+    uint32_t m_averages;
+    float    m_scale[2];   // Power of a bin to squared full scale amplitude, DC and the rest
+    std::vector<float>    m_window;
+    std::vector<float>    m_re;
+    std::vector<float>    m_im;
+    std::vector<float>    m_cos;
+    std::vector<float>    m_sin;
+    std::vector<uint32_t> m_rev;
+    std::vector<double>   m_acc[2]; // Summed bin powers of the frame in progress
+    uint32_t m_fill;       // Samples in m_re / m_im
+    uint32_t m_done;       // Windows summed into m_acc
+    uint64_t m_outIndex;
+};
@@ -9,9 +9,93 @@
 
 #include <Oscilloscope.h>
 #include <StreamingManager.h>
+#include "BufferRing.h"
+#include "Ddc.h"
+#include "Decimator.h"
+#include "LatencyHistogram.h"
+#include "LockIn.h"
+#include "PowerMeter.h"
+#include "Spectrum.h"
+#include "TriggerEngine.h"
 
 //#define DISABLE_OSC
 
+// The acquisition thread wakes up at least this often without DMA interrupts
+#define OSC_WAIT_TIMEOUT_MS 100
+#define OSC_STAT_PERIOD_MS  5000
+// Upper bound of the pre-trigger window, both ring buffers of every slot count
+#define PRETRIGGER_MAX_BYTES (128 * 1024 * 1024)
+// Calibrated samples leave the pipeline as 32-bit floats in volts
+#define VOLTS_RESOLUTION 32
+// Adaptive rate control: losses are checked this often, a step is given
+// this many periods to drain the ring before the next one
+#define ADAPT_PERIOD_MS      1000
+#define ADAPT_SETTLE_PERIODS 2
+#define ADAPT_MAX_RATE       65536
+
+//!
+//! \brief Per-buffer pipeline statistics, collected all the time.
+//!
+struct StreamingStatsT
+{
+    CLatencyHistogram copy;  //!< DMA ready -> copied out of the DMA buffer
+    CLatencyHistogram queue; //!< Copied -> taken by the sender thread
+    CLatencyHistogram send;  //!< Packing and hand over to the socket or the file queue
+    CLatencyHistogram total; //!< DMA ready -> handed over
+    std::atomic<uint64_t> segments;
+    std::atomic<uint64_t> lostSegments; //!< DMA overflows and buffers dropped on a full ring
+    std::atomic<uint64_t> overflows;    //!< DMA overflows only
+    std::atomic<uint64_t> ringPeak;     //!< Most buffers waiting in the ring at once
+    std::atomic<uint64_t> triggers;     //!< Trigger events that started a capture
+    std::atomic<uint64_t> lastTrigger;  //!< Sample index of the newest one
+
+    StreamingStatsT(): segments(0), lostSegments(0), overflows(0), ringPeak(0), triggers(0), lastTrigger(0) {}
+};
+
+//!
+//! \brief What the adaptive rate control chose, read from any thread.
+//!
+//! The packs carry the rate, the resolution and the compression of their
+//! samples in the header, the client follows a step without being told.
+//!
+struct AdaptiveStateT
+{
+    std::atomic<uint32_t> rate;        //!< Decimation of the ADC clock
+    std::atomic<uint32_t> resolution;
+    std::atomic<bool>     compression;
+    std::atomic<uint32_t> steps;
+
+    AdaptiveStateT(): rate(0), resolution(0), compression(false), steps(0) {}
+};
+
+//!
+//! \brief Pre-trigger capture settings.
+//!
+//! With a window the ring keeps the last \c seconds of data and nothing is
+//! passed on until the trigger fires. The window is then written first and
+//! the stream continues live. trigger() fires it from any thread, which is
+//! also the hook for external trigger sources. The other sources scan the
+//! raw samples for \c condition.
+//!
+//! With \c postSeconds the capture is gated: after that time the writer
+//! drains the ring, the window fills again and the next trigger starts the
+//! next capture, so only the data around the events is recorded.
+//!
+struct PreTriggerT
+{
+    enum Source { SOFTWARE, CH1, CH2, ANY };
+
+    double   seconds;     //!< 0 disables the window
+    double   postSeconds; //!< 0 streams on after the trigger
+    Source   source;
+    TriggerT condition;   //!< The channels follow the source
+
+    PreTriggerT(double _seconds = 0, Source _source = SOFTWARE, const TriggerT &_condition = TriggerT(), double _postSeconds = 0):
+        seconds(_seconds), postSeconds(_postSeconds), source(_source), condition(_condition) {}
+
+    bool gated() const { return postSeconds > 0; }
+};
+
 class CStreamingApplication
 {
 public:
@@ -20,38 +104,161 @@ public:
     void run();
     void runNonBlock();
     bool stop();
+    // Number of DMA buffers that may wait for the network, set before run()
+    void setBufferRingDepth(size_t _depth);
+    // CPU and SCHED_FIFO priority of the acquisition thread, set before run()
+    void setOscThreadSched(const ThreadSchedT &_sched);
+    // Set before run()
+    void setPreTrigger(const PreTriggerT &_preTrigger);
+    // Streams the lock-in outputs instead of the samples, set before run()
+    // with the resolution LOCKIN_RESOLUTION
+    void setLockIn(const LockInT &_lockIn);
+    // Streams averaged power spectra of the acquired channels instead of the
+    // samples, set before run() with the resolution SPECTRUM_RESOLUTION
+    void setSpectrum(const SpectrumT &_spectrum);
+    // Streams the complex baseband of one input, I on channel 1 and Q on
+    // channel 2, set before run() with the resolution DDC_RESOLUTION
+    void setDdc(const DdcT &_ddc);
+    // Streams calibrated volts instead of ADC counts, set before run() with
+    // the resolution VOLTS_RESOLUTION. The calibration is a snapshot taken
+    // at the start.
+    void setVolts(bool _enable, const CalibrationT &_calibration);
+    // Low pass filters and decimates the samples before they are passed on,
+    // set before run() with 8 or 16-bit samples or volts
+    void setDecimator(const DecimatorT &_decimator);
+    // Measures power on IN1 (U) and IN2 (I) next to the stream, set before
+    // run() with both channels acquired
+    void setPowerMeter(const PowerMeterT &_power);
+    // Counts the sample ids of the network packs from the first trigger, the
+    // boards of a daisy chain with a shared clock and trigger then agree on
+    // them. Set before run() with a pre-trigger capture of raw samples.
+    void setSync(bool _enable);
+    // Keeps the network stream free of losses by stepping to compression,
+    // 8-bit samples and twice the decimation in turn while segments are
+    // lost or the ring fills up. Set before run(), only for plain 8 or
+    // 16-bit network streams without a capture window.
+    void setAdaptive(bool _enable);
+    const AdaptiveStateT &getAdaptiveState() const { return m_adaptState; }
+    // Changes the decimation, the channel mask and the 8 to 16-bit resolution
+    // of a running stream between two buffers. The DMA is stopped and
+    // restarted, the socket and a TDMS file stay open. The gap counts as one
+    // lost segment and the packs carry the new settings. False for derived
+    // streams, volts, capture windows, the adaptive control, WAV and RAW
+    // files and a switch in or out of scatter-gather, nothing changes then.
+    bool reconfigure(int _oscRate, int _channels, unsigned short _resolution);
+    // Newest aggregated power result, false without one
+    bool getPowerResult(PowerResultT &_result) const;
+    void trigger();
+    bool isTriggered() const { return m_triggered; }
+    const StreamingStatsT &getStats() const { return m_stats; }
 private:
+    //! Plain copy of the DMA samples into the slot, one instance per
+    //! resolution and channel mask, chosen by selectCopy() for the session
+    typedef void (CStreamingApplication::*CopyChFn)(const uint8_t *_src_ch1, const uint8_t *_src_ch2, size_t _size, void *_dst_ch1, void *_dst_ch2, size_t &_size1, size_t &_size2);
     int m_PerformanceCounterPeriod = 10;
 
     COscilloscope::Ptr m_Osc_ch;
     CStreamingManager::Ptr m_StreamingManager;
     std::thread m_OscThread;
     std::thread m_SocketThread;
-    std::mutex mtx;
     std::atomic_flag m_OscThreadRun = ATOMIC_FLAG_INIT;
     std::atomic_flag m_SockThreadRun = ATOMIC_FLAG_INIT;
-    std::atomic_int m_ReadyToPass;
     bool            m_isRun;
     static_assert(ATOMIC_INT_LOCK_FREE == 2,"this implementation does not guarantee that std::atomic<int> is always lock free.");
+    CBufferRing::Ptr m_ring;
+    size_t           m_ringDepth;
+    ThreadSchedT     m_oscSched;
+    PreTriggerT      m_preTrigger;
+    std::atomic<bool> m_triggered;
+    std::atomic<bool> m_softTrigger;
+    CTriggerEngine::Ptr m_trigger;
+    std::vector<TriggerEventT> m_trigEvents;
+    uint64_t         m_trigSample; // Where the last trigger fired
+    size_t           m_preWindow;  // Segments kept before the trigger
+    uint8_t          m_trigChannel; // 0 for the software trigger
+    uint64_t         m_preSamples;  // Kept before and after every trigger
+    uint64_t         m_postSamples;
+    uint64_t         m_captureStart; // Samples [start, end) of the current capture
+    uint64_t         m_captureEnd;
+    TDMSCaptureT     m_capture;
+    uint64_t         m_captureId;
+    uint64_t         m_sentCaptureId; // Sender only
+    std::atomic<bool> m_rearming;   // A gated capture ended, the sender drains the ring
+    LockInT          m_lockInSettings;
+    CLockIn::Ptr     m_lockIn;
+    SpectrumT        m_spectrumSettings;
+    CSpectrum::Ptr   m_spectrum;
+    DdcT             m_ddcSettings;
+    CDdc::Ptr        m_ddc;
+    DecimatorT       m_decimatorSettings;
+    CDecimator::Ptr  m_decimator;
+    std::vector<int16_t> m_decimated[2]; // Filter outputs before they are converted to volts
+    bool             m_voltsEnable;
+    bool             m_volts;
+    CalibrationT     m_calibration;
+    bool             m_syncEnable;
+    bool             m_sync;
+    uint64_t         m_syncOrigin; // Sample of the first trigger since the start
+    // Kernel clock state for the pack times, refreshed once a second by the sending thread
+    std::chrono::steady_clock::time_point m_clockChecked;
+    uint32_t         m_clockFlags;
+    uint32_t         m_clockErrorNs;
+    PowerMeterT      m_powerSettings;
+    CPowerMeter::Ptr m_power;
+    bool             m_adaptEnable;
+    bool             m_adapt;
+    AdaptiveStateT   m_adaptState;
+    uint64_t         m_adaptLoss;   // Losses seen up to the last check
+    unsigned         m_adaptSettle; // Checks left before the next step
+    StreamingStatsT  m_stats;
 
     asio::io_service m_Ios;
+    asio::io_service m_OscIos;
     unsigned short m_Resolution;
 
+    size_t m_bufferSize; // Of the write buffers and the ring slots
     void *m_WriteBuffer_ch1;
     void *m_WriteBuffer_ch2;
+    const void *m_SendBuffer_ch1;
+    const void *m_SendBuffer_ch2;
+    bool  m_PendingChangeBuffers;
     size_t m_size_ch1;
     size_t m_size_ch2;
+    CopyChFn m_copyCh;
 
     uint64_t         m_lostRate;
+    uint64_t         m_sampleId;
     int              m_oscRate;
+    int              m_outRate; // Decimation of the passed samples, includes the lock-in, DDC or software decimation
     int              m_channels;
 
     asio::steady_timer m_Timer;
+    asio::steady_timer m_StatTimer;
+    asio::steady_timer m_AdaptTimer;
     uintmax_t m_BytesCount;
+    uintmax_t m_counter;
+    uintmax_t m_passCounter;
+    int       m_dropFirstNBuffer;
 
     void oscWorker();
-    bool passCh(size_t &_size1,size_t &_size2);
-    int  oscNotify(uint64_t _lostRate, uint32_t _oscRate,const void *_buffer_ch1, size_t _size_ch1,const void *_buffer_ch2, size_t _size_ch2);
+    void armOsc();
+    void oscHandler(const asio::error_code &_error, uint8_t *_buffer_ch1, uint8_t *_buffer_ch2, size_t _size, bool _overFlow1, bool _overFlow2);
+    void passBuffer(uint8_t *_buffer_ch1, uint8_t *_buffer_ch2, size_t _size, bool _overFlow);
+    void statHandler(const asio::error_code &_error);
+    void adaptHandler(const asio::error_code &_error);
+    bool adaptStep();
+    void socketWorker();
+    void startWorkers();
+    void passCh(uint8_t *buffer_ch1, uint8_t *buffer_ch2, size_t size, void *_dst_ch1, void *_dst_ch2, size_t &_size1,size_t &_size2);
+    template<unsigned short Resolution> size_t copyChannel(int _channel, const uint8_t *_src, size_t _size, void *_dst);
+    template<unsigned short Resolution, int Channels> void copyCh(const uint8_t *_src_ch1, const uint8_t *_src_ch2, size_t _size, void *_dst_ch1, void *_dst_ch2, size_t &_size1, size_t &_size2);
+    template<unsigned short Resolution> CopyChFn copyFor(int _channels);
+    CopyChFn selectCopy();
+    void releaseOscBuffers();
+    size_t convertVolts(int _channel, const void *_src, size_t _size, void *_dst);
+    bool checkTrigger(const uint8_t *_buffer_ch1, const uint8_t *_buffer_ch2, size_t _size, uint64_t _first);
+    void stampPackTime(uint64_t _sampleId, std::chrono::steady_clock::time_point _ready, std::chrono::steady_clock::time_point _copied);
+    int  oscNotify(uint64_t _lostRate, uint64_t _sampleId, uint32_t _oscRate, unsigned short _resolution, const void *_buffer_ch1, size_t _size_ch1,const void *_buffer_ch2, size_t _size_ch2);
     void performanceCounterHandler(const asio::error_code &_error);
     void signalHandler(const asio::error_code &_error, int _signalNumber);
 };
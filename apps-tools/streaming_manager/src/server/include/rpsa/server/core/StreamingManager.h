@@ -21,8 +21,13 @@
 //#define FILE_PATH "/opt/redpitaya/www/apps/streaming_manager/upload"
 #define FILE_PATH "/tmp/stream_files"
 
-#define UDP_BUFFER_LIMIT 512
+#define UDP_MIN_MTU 576
+// Longest gap in samples written as silence to a WAV file
+#define WAV_GAP_FILL_LIMIT (1024 * 1024)
+#define WAV_GAP_FILL_CHUNK 65536
 #define TCP_BUFFER_LIMIT 65536/2
+// Bytes of one sample as passed to the writers, packed samples are already expanded
+#define SAMPLE_SIZE(RES) ((RES) == 8 ? 1 : (RES) == 32 ? 4 : 2)
 #define MIN(X,Y) ((X < Y) ? X: Y)
 #define MAX(X,Y) ((X > Y) ? X: Y)
 
@@ -44,6 +49,10 @@ public:
     static Ptr Create(std::string _host, std::string _port, asionet::Protocol _protocol);
     CStreamingManager(std::string _host, std::string _port, asionet::Protocol _protocol);
 
+    // Streams to the network and writes a local copy of the same buffers
+    static Ptr Create(Stream_FileType _fileType, std::string _filePath, std::string _host, std::string _port, asionet::Protocol _protocol);
+    CStreamingManager(Stream_FileType _fileType, std::string _filePath, std::string _host, std::string _port, asionet::Protocol _protocol);
+
     ~CStreamingManager();
     CStreamingManager(const COscilloscope &) = delete;
     CStreamingManager(COscilloscope &&) = delete;
@@ -52,7 +61,49 @@ public:
     void run();
     void stop();
     bool isFileThreadWork();
-    int passBuffers(uint64_t _lostRate, uint32_t _oscRate,const void *_buffer_ch1, uint32_t _size_ch1,const void *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution ,uint64_t _id);
+    bool isNetwork() const { return m_use_network; }
+    bool isLocalFile() const { return m_use_local_file; }
+    Stream_FileType getFileType() const { return m_fileType; }
+    uint64_t getPoolExhaustedCount();
+    uint64_t getDroppedPacks();
+    // Dropped for lack of credit from a TCP client, counted in getDroppedPacks() too
+    uint64_t getThrottledPacks();
+    uint64_t getGapSamples();
+    // Bytes that left through the socket or reached the file
+    uint64_t getSentBytes();
+    // Deepest network send queue or file write queue seen, in packs or blocks
+    uint64_t getQueuePeak();
+    // File write queue: most bytes held and blocks refused at its memory budget
+    uint64_t getQueuePeakBytes();
+    uint64_t getQueueOverflows();
+    // The file sink on its own, also next to the network
+    uint64_t getFileBytes();
+    uint64_t getFileDroppedBytes();
+    // Room left in the file write queue
+    uint64_t getFileFreeBytes();
+    size_t   getClientsCount();
+    void setBackpressurePolicy(asionet::BackpressurePolicy _policy);
+    void setZeroCopy(bool _enable);
+    void setMTU(uint32_t _mtu);
+    void setNetThreadSched(const ThreadSchedT &_sched);
+    ThreadSchedT getNetThreadSched();
+    void setFileThreadSched(const ThreadSchedT &_sched);
+    void setFileWriteBehind(int _depth);
+    void setFileTDMSSegment(int _kb);
+    void setFileTDMSInterleaved(bool _enable);
+    void setFileTDMSIndex(bool _enable);
+    void setFileCalibration(const CalibrationT &_calibration, bool _volts);
+    void setFileRotation(int _mb, int _seconds);
+    void setWavGapFill(bool _enable);
+    void setFileMemoryBudget(int _mb);
+    void setScatterGather(bool _enable);
+    bool isScatterGather();
+    void setCompression(Stream_Compression _compression);
+    Stream_Compression getCompression();
+    // _sampleId is the absolute index of the first sample, _lostRate the number of DMA segments lost before it
+    int passBuffers(uint64_t _lostRate, uint32_t _oscRate,const void *_buffer_ch1, uint32_t _size_ch1,const void *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution ,uint64_t _id, uint64_t _sampleId);
+    // The next passBuffers() starts a triggered capture, same thread
+    void startCapture(const TDMSCaptureT &_capture);
     CStreamingManager::Callback notifyPassData;
     CStreamingManager::Callback notifyStop;
     CStreamingManager::CallbackVoid notifyPassDataReset;
@@ -72,8 +123,27 @@ private:
     std::string       m_file_out;
 
     bool m_use_local_file;
+    bool m_use_network;
+    uint64_t m_file_dropped_bytes;
+    bool m_scatter_gather;
+    Stream_Compression m_compression;
+    asionet::BackpressurePolicy m_backpressure;
+    bool m_zerocopy;
+    uint32_t m_mtu;
+    ThreadSchedT m_net_sched;
+    ThreadSchedT m_file_sched;
+    bool     m_first_sample;
+    bool     m_wav_gap_fill;
+    uint64_t m_next_sample_id;
+    uint64_t m_gap_samples;
     Stream_FileType m_fileType;
     void startServer();
+    uint32_t getSplitSize(unsigned short _resolution, bool _both_channels);
+    void fillWavGap(uint64_t _samples, bool _ch1, bool _ch2, unsigned short _resolution);
+    bool queueWavBlock(const uint8_t *_buffer_ch1, size_t _size_ch1, const uint8_t *_buffer_ch2, size_t _size_ch2, unsigned short _resolution);
+    int passFile(uint64_t _lostRate, uint32_t _oscRate, const uint8_t *_buffer_ch1, uint32_t _size_ch1, const uint8_t *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint64_t _id, uint64_t _sampleId);
+    int passNet(uint64_t _lostRate, uint32_t _oscRate, const uint8_t *_buffer_ch1, uint32_t _size_ch1, const uint8_t *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint64_t _sampleId);
+    int sendUdpBatches(uint64_t _lostRate, uint64_t _sampleId, uint32_t _oscRate, const uint8_t *_buffer_ch1, uint32_t _size_ch1, const uint8_t *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint32_t _split_size);
     void stopServer();
 
     
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+//!
+//! \brief Trigger condition on the raw ADC samples.
+//!
+//! \c rising selects the direction: a rising edge, samples at or above the
+//! level, a positive pulse, or entering the window. Otherwise a falling edge,
+//! samples at or below the level, a negative pulse, or leaving the window.
+//! The level has to be left by \c hysteresis counts before an edge or a
+//! pulse can start again.
+//!
+struct TriggerT
+{
+    enum Mode { EDGE, LEVEL, WINDOW, PULSE };
+    enum Channel { CH1 = 1, CH2 = 2, ANY = 3 };
+
+    Mode     mode;
+    int      channels;   //!< Channel mask
+    bool     rising;
+    int16_t  level;      //!< Raw ADC counts
+    int16_t  hysteresis;
+    int16_t  low;        //!< Window bounds, inclusive
+    int16_t  high;
+    uint32_t minWidth;   //!< Accepted pulse widths in samples, 0 is no upper bound
+    uint32_t maxWidth;
+    uint64_t holdoff;    //!< Samples after an event in which no other one fires
+
+    TriggerT(Mode _mode = EDGE, int _channels = CH1, bool _rising = true, int16_t _level = 0):
+        mode(_mode), channels(_channels), rising(_rising), level(_level), hysteresis(0),
+        low(0), high(0), minWidth(0), maxWidth(0), holdoff(0) {}
+};
+
+struct TriggerEventT
+{
+    uint64_t sample;  //!< Index of the first sample that met the condition, the pulse start for PULSE
+    uint32_t width;   //!< Pulse width in samples, 0 for the other modes
+    uint8_t  channel; //!< TriggerT::CH1 or TriggerT::CH2
+};
+
+//!
+//! \brief Scans the DMA buffers for a trigger condition.
+//!
+//! Each channel waits for a single predicate at a time, the condition that
+//! fires or the one that re-arms it, so the scan is a search for the first
+//! sample inside or outside a range. It runs 32 samples per step with NEON
+//! and only the step that holds a hit is looked at sample by sample. The
+//! state carries over buffer boundaries, a buffer that does not continue
+//! the previous one starts over and needs a fresh edge.
+//!
+class CTriggerEngine
+{
+public:
+    using Ptr = std::shared_ptr<CTriggerEngine>;
+
+    static Ptr Create(const TriggerT &_settings);
+    CTriggerEngine(const TriggerT &_settings);
+
+    // Scans _count samples per channel starting at the sample index _first,
+    // a missing channel is nullptr. Appends the events in sample order and
+    // returns how many were added.
+    size_t scan(const int16_t *_ch1, const int16_t *_ch2, size_t _count, uint64_t _first, std::vector<TriggerEventT> &_events);
+    void   reset();
+    uint64_t eventCount() const { return m_eventCount; }
+    const TriggerT &settings() const { return m_settings; }
+
+    //! Inclusive range of raw samples, or everything outside of it
+    struct Range
+    {
+        int16_t low;
+        int16_t high;
+        bool    inside;
+    };
+
+    // First index in [_from, _count) whose sample matches _range, _count without one
+    static size_t find(const int16_t *_samples, size_t _from, size_t _count, const Range &_range);
+
+private:
+    struct Channel
+    {
+        bool     waitActive; // Waiting for the condition, otherwise for the re-arm
+        bool     inPulse;    // pulseStart is a start seen in this run
+        uint64_t pulseStart;
+        uint64_t holdoffEnd;
+    };
+
+    void scanChannel(Channel &_state, const int16_t *_samples, size_t _count, uint64_t _first, uint8_t _channel, std::vector<TriggerEventT> &_events);
+
+    TriggerT m_settings;
+    Range    m_active;
+    Range    m_rearm;
+    Channel  m_channel[2];
+    bool     m_started;
+    uint64_t m_next;       // Index the next buffer has to start at
+    uint64_t m_holdoffEnd; // Across both channels
+    uint64_t m_eventCount;
+    std::vector<TriggerEventT> m_pending;
+};
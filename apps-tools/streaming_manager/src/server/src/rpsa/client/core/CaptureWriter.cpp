@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include "rpsa/client/core/CaptureWriter.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+CCaptureWriter::Ptr CCaptureWriter::Create(const std::string &_path){
+    return std::make_shared<CCaptureWriter>(_path);
+}
+
+CCaptureWriter::CCaptureWriter(const std::string &_path):
+    m_path(_path),
+    m_fd(-1),
+    m_direct(false),
+    m_memory(),
+    m_free(),
+    m_full(),
+    m_current({nullptr, 0}),
+    m_mutex(),
+    m_cond(),
+    m_thread(),
+    m_run(false),
+    m_error(false),
+    m_written(0)
+{
+    for (int i = 0; i < CAPTURE_BLOCK_COUNT; i++){
+        auto memory = new uint8_t[CAPTURE_BLOCK_SIZE + CAPTURE_BLOCK_ALIGN];
+        auto base = reinterpret_cast<uintptr_t>(memory);
+        base = (base + CAPTURE_BLOCK_ALIGN - 1) & ~(uintptr_t)(CAPTURE_BLOCK_ALIGN - 1);
+        m_memory.push_back(memory);
+        m_free.push_back({reinterpret_cast<uint8_t*>(base), 0});
+    }
+}
+
+CCaptureWriter::~CCaptureWriter(){
+    close();
+    for (auto memory : m_memory){
+        delete [] memory;
+    }
+}
+
+bool CCaptureWriter::open(){
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_BINARY;
+    m_direct = false;
+#ifdef O_DIRECT
+    // tmpfs and some other file systems refuse O_DIRECT, they get the page cache
+    m_fd = ::open(m_path.c_str(), flags | O_DIRECT, 0666);
+    m_direct = m_fd >= 0;
+#endif
+    if (m_fd < 0)
+        m_fd = ::open(m_path.c_str(), flags, 0666);
+    if (m_fd < 0){
+        std::cerr << "[rpsa] Can't open capture file " << m_path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    m_error = false;
+    m_written = 0;
+    m_run = true;
+    m_thread = std::thread(&CCaptureWriter::task, this);
+    return true;
+}
+
+bool CCaptureWriter::write(const void *_data, size_t _size){
+    auto data = static_cast<const uint8_t*>(_data);
+    while (_size > 0){
+        if (m_current.data == nullptr){
+            m_current = acquireBlock();
+            if (m_current.data == nullptr)
+                return false;
+        }
+        size_t size = std::min(_size, (size_t)CAPTURE_BLOCK_SIZE - m_current.size);
+        memcpy(m_current.data + m_current.size, data, size);
+        m_current.size += size;
+        data += size;
+        _size -= size;
+        if (m_current.size == CAPTURE_BLOCK_SIZE){
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_full.push_back(m_current);
+            m_current = {nullptr, 0};
+            m_cond.notify_all();
+        }
+    }
+    return !m_error;
+}
+
+void CCaptureWriter::close(){
+    if (m_fd < 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_current.data != nullptr && m_current.size > 0)
+            m_full.push_back(m_current);
+        else if (m_current.data != nullptr)
+            m_free.push_back(m_current);
+        m_current = {nullptr, 0};
+        m_run = false;
+        m_cond.notify_all();
+    }
+    if (m_thread.joinable())
+        m_thread.join();
+    // The last block went out padded to the alignment
+    if (m_direct && ftruncate(m_fd, m_written) != 0)
+        std::cerr << "[rpsa] Can't trim capture file " << m_path << ": " << strerror(errno) << "\n";
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+CCaptureWriter::Block CCaptureWriter::acquireBlock(){
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]{ return !m_free.empty() || m_error || !m_run; });
+    if (m_free.empty() || m_error)
+        return {nullptr, 0};
+    auto block = m_free.front();
+    m_free.pop_front();
+    block.size = 0;
+    return block;
+}
+
+void CCaptureWriter::task(){
+    while (true){
+        Block block;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]{ return !m_full.empty() || !m_run; });
+            if (m_full.empty())
+                break;
+            block = m_full.front();
+            m_full.pop_front();
+        }
+        if (!m_error && !writeBlock(block))
+            m_error = true;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(block);
+        m_cond.notify_all();
+    }
+}
+
+bool CCaptureWriter::writeBlock(const Block &_block){
+    size_t size = _block.size;
+    if (m_direct){
+        // Only the last block can be short, the padding is cut off in close()
+        size = (size + CAPTURE_BLOCK_ALIGN - 1) & ~(size_t)(CAPTURE_BLOCK_ALIGN - 1);
+        memset(_block.data + _block.size, 0, size - _block.size);
+    }
+    size_t pos = 0;
+    while (pos < size){
+        auto res = ::write(m_fd, _block.data + pos, size - pos);
+        if (res < 0){
+            if (errno == EINTR)
+                continue;
+            std::cerr << "[rpsa] Can't write capture file " << m_path << ": " << strerror(errno) << "\n";
+            return false;
+        }
+        pos += res;
+    }
+    m_written += _block.size;
+    return true;
+}
@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "rpsa/client/core/StreamAggregator.h"
+#include "rpsa/common/core/DataType.h"
+
+namespace {
+    void AppendInt32(std::vector<uint8_t> &_out, int32_t _value){
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&_value);
+        _out.insert(_out.end(), bytes, bytes + sizeof(_value));
+    }
+
+    void AppendInt64(std::vector<uint8_t> &_out, int64_t _value){
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&_value);
+        _out.insert(_out.end(), bytes, bytes + sizeof(_value));
+    }
+
+    void AppendString(std::vector<uint8_t> &_out, const std::string &_value){
+        AppendInt32(_out, _value.size());
+        _out.insert(_out.end(), _value.begin(), _value.end());
+    }
+
+    void AppendProperty(std::vector<uint8_t> &_out, const std::string &_name, uint64_t _value){
+        AppendString(_out, _name);
+        AppendInt32(_out, TDMS::DataType::UnsignedInteger64);
+        AppendInt64(_out, (int64_t)_value);
+    }
+
+    void AppendProperty(std::vector<uint8_t> &_out, const std::string &_name, const std::string &_value){
+        AppendString(_out, _name);
+        AppendInt32(_out, TDMS::DataType::String);
+        AppendString(_out, _value);
+    }
+}
+
+CStreamAggregator::Ptr CStreamAggregator::Create(const std::string &_path, size_t _blockSamples, uint64_t _maxLag){
+    return std::make_shared<CStreamAggregator>(_path, _blockSamples, _maxLag);
+}
+
+CStreamAggregator::CStreamAggregator(const std::string &_path, size_t _blockSamples, uint64_t _maxLag):
+    m_path(_path),
+    m_blockSamples(std::max<size_t>(_blockSamples, 1)),
+    m_maxLag(std::max<uint64_t>(_maxLag, _blockSamples)),
+    m_boards(),
+    m_mutex(),
+    m_file(nullptr),
+    m_formatValid(false),
+    m_oscRate(0),
+    m_resolution(0),
+    m_sampleSize(0),
+    m_running(false),
+    m_next(0),
+    m_lastCount(0),
+    m_segment(),
+    m_stats()
+{
+}
+
+CStreamAggregator::~CStreamAggregator(){
+    stop();
+}
+
+int CStreamAggregator::addBoard(const std::string &_host, const std::string &_port, int _protocol, size_t _ringSize){
+    if (m_file)
+        return -1;
+    std::unique_ptr<Board> board(new Board());
+    board->host = _host + ":" + _port;
+    board->receiver = CStreamReceiver::Create(_host, _port, _protocol, _ringSize);
+    board->started = false;
+    board->channel[0] = false;
+    board->channel[1] = false;
+    board->offset = 0;
+    board->end = 0;
+    board->received = 0;
+    board->base = 0;
+    board->gapInBlock = 0;
+    board->stats = rpsa_aggregator_board_stats_t();
+    size_t index = m_boards.size();
+    board->receiver->setHandler([this, index](const rpsa_pack_t &_pack){ handlePack(index, _pack); });
+    m_boards.push_back(std::move(board));
+    return (int)index;
+}
+
+bool CStreamAggregator::start(){
+    if (m_boards.empty() || m_file)
+        return false;
+    auto file = CCaptureWriter::Create(m_path);
+    if (!file->open()){
+        std::cerr << "[rpsa] Aggregator: can't open " << m_path << "\n";
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_file = file;
+        m_formatValid = false;
+        m_running = false;
+        m_lastCount = 0;
+        m_stats = rpsa_aggregator_stats_t();
+        m_stats.boards = m_boards.size();
+    }
+    for (size_t i = 0; i < m_boards.size(); i++){
+        if (!m_boards[i]->receiver->start()){
+            for (size_t j = 0; j < i; j++)
+                m_boards[j]->receiver->stop();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_file->close();
+            m_file = nullptr;
+            return false;
+        }
+    }
+    return true;
+}
+
+void CStreamAggregator::stop(){
+    // The receiver threads are joined, no pack comes in after this
+    for (auto &board : m_boards)
+        board->receiver->stop();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+    emit(true);
+    m_file->close();
+    m_stats.written = m_file->writtenBytes();
+    m_file = nullptr;
+}
+
+void CStreamAggregator::getStats(rpsa_aggregator_stats_t &_stats){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    _stats = m_stats;
+    if (m_file)
+        _stats.written = m_file->writtenBytes();
+}
+
+bool CStreamAggregator::getBoardStats(size_t _board, rpsa_aggregator_board_stats_t &_stats){
+    if (_board >= m_boards.size())
+        return false;
+    rpsa_receiver_stats_t receiver;
+    m_boards[_board]->receiver->getStats(receiver);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Board &board = *m_boards[_board];
+    const Board &first = *m_boards[0];
+    _stats = board.stats;
+    _stats.lost_packs = receiver.lost_packs;
+    uint64_t newest = 0;
+    for (auto &other : m_boards)
+        newest = std::max(newest, other->received);
+    _stats.lag = board.started ? (int64_t)(newest - board.received) : 0;
+    // On one clock both boards receive the same number of samples
+    int64_t reference = (int64_t)(first.received - first.base);
+    _stats.drift_ppm = m_running && reference > 0 ? ((int64_t)(board.received - board.base) - reference) * 1e6 / reference : 0;
+    return true;
+}
+
+void CStreamAggregator::handlePack(size_t _board, const rpsa_pack_t &_pack){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+    Board &board = *m_boards[_board];
+    auto &stats = board.stats;
+    stats.packs++;
+    if (!m_formatValid){
+        m_formatValid = true;
+        m_oscRate = _pack.osc_rate;
+        m_resolution = _pack.resolution;
+        // Packed 12 and 14 bit samples are expanded to 16-bit words, 32 are floats
+        m_sampleSize = m_resolution == 8 ? 1 : m_resolution == 32 ? 4 : 2;
+    }else if (_pack.osc_rate != m_oscRate || _pack.resolution != m_resolution){
+        stats.mismatched++;
+        return;
+    }
+    if (_pack.samples == 0)
+        return;
+    if (!board.started){
+        board.started = true;
+        board.channel[0] = _pack.size_ch1 > 0;
+        board.channel[1] = _pack.size_ch2 > 0;
+        stats.board = _pack.board;
+        stats.synced = _pack.synced;
+        // The first pack of a board that is not synchronized lines up with the others' first
+        board.offset = _pack.synced ? 0 : _pack.sample_id - RPSA_PACK_SYNC_ORIGIN;
+        board.end = _pack.sample_id - board.offset;
+        board.received = board.end;
+        if (m_running)
+            board.base = board.received;
+    }
+    const uint64_t first = _pack.sample_id - board.offset;
+    uint64_t skip = 0;
+    if (first < board.end){
+        skip = std::min<uint64_t>(board.end - first, _pack.samples);
+        stats.late_samples += skip;
+        if (skip == _pack.samples)
+            return;
+    }else if (first > board.end){
+        stats.gap_samples += first - board.end;
+        queueZeros(board, first - board.end);
+    }
+    Run run;
+    run.first = first + skip;
+    run.count = _pack.samples - skip;
+    run.offset = skip;
+    for (int c = 0; c < 2; c++){
+        if (!board.channel[c])
+            continue;
+        auto &data = run.data[c];
+        if (!board.spare.empty()){
+            data.swap(board.spare.back());
+            board.spare.pop_back();
+        }
+        const size_t size = (size_t)_pack.samples * m_sampleSize;
+        data.resize(size);
+        // A channel missing from this pack is written as zeros
+        size_t decoded = CStreamReceiver::decodeChannel(_pack, c + 1, data.data(), size);
+        if (decoded < size)
+            memset(data.data() + decoded, 0, size - decoded);
+    }
+    board.runs.push_back(std::move(run));
+    board.end = first + _pack.samples;
+    board.received = std::max(board.received, board.end);
+    emit(false);
+}
+
+void CStreamAggregator::queueZeros(Board &_board, uint64_t _count){
+    if (!_board.runs.empty()){
+        Run &last = _board.runs.back();
+        if (last.data[0].empty() && last.data[1].empty()){
+            last.count += _count;
+            _board.end += _count;
+            return;
+        }
+    }
+    Run run;
+    run.first = _board.end;
+    run.count = _count;
+    run.offset = 0;
+    _board.runs.push_back(std::move(run));
+    _board.end += _count;
+}
+
+void CStreamAggregator::trimBefore(Board &_board, uint64_t _id){
+    while (!_board.runs.empty() && _board.runs.front().first < _id){
+        Run &run = _board.runs.front();
+        uint64_t count = std::min(run.count, _id - run.first);
+        _board.stats.dropped_samples += count;
+        run.first += count;
+        run.count -= count;
+        run.offset += count;
+        if (run.count == 0){
+            for (auto &data : run.data)
+                if (data.capacity() > 0)
+                    _board.spare.push_back(std::move(data));
+            _board.runs.pop_front();
+        }
+    }
+    _board.end = std::max(_board.end, _id);
+}
+
+void CStreamAggregator::emit(bool _flush){
+    if (!m_running){
+        uint64_t start = 0;
+        for (auto &board : m_boards){
+            if (!board->started){
+                // Waiting for the rest, the boards already streaming keep the last lag limit
+                for (auto &other : m_boards)
+                    if (other->started && other->end > m_maxLag)
+                        trimBefore(*other, other->end - m_maxLag);
+                return;
+            }
+            start = std::max(start, board->runs.empty() ? board->end : board->runs.front().first);
+        }
+        m_running = true;
+        m_next = start;
+        for (auto &board : m_boards)
+            board->base = board->received;
+    }
+    for (auto &board : m_boards)
+        trimBefore(*board, m_next);
+    uint64_t newest = 0;
+    for (auto &board : m_boards)
+        newest = std::max(newest, board->end);
+    // A stalled board is filled with zeros, the others do not wait longer than the limit
+    if (newest - m_next > m_maxLag){
+        const uint64_t target = newest - m_maxLag;
+        for (auto &board : m_boards){
+            if (board->end < target){
+                board->stats.gap_samples += target - board->end;
+                queueZeros(*board, target - board->end);
+            }
+        }
+    }
+    uint64_t ready = UINT64_MAX;
+    for (auto &board : m_boards)
+        ready = std::min(ready, board->end - m_next);
+    while (ready >= m_blockSamples){
+        if (!writeSegment(m_blockSamples))
+            return;
+        ready -= m_blockSamples;
+    }
+    if (_flush && ready > 0)
+        writeSegment(ready);
+}
+
+// Appends _samples of every channel of the board from m_next on to the segment
+void CStreamAggregator::copyBlock(Board &_board, uint64_t _samples){
+    for (int c = 0; c < 2; c++){
+        if (!_board.channel[c])
+            continue;
+        size_t pos = m_segment.size();
+        m_segment.resize(pos + _samples * m_sampleSize);
+        uint8_t *dst = m_segment.data() + pos;
+        uint64_t left = _samples;
+        for (auto &run : _board.runs){
+            if (left == 0)
+                break;
+            uint64_t take = std::min(left, run.count);
+            if (run.data[c].empty())
+                memset(dst, 0, take * m_sampleSize);
+            else
+                memcpy(dst, run.data[c].data() + run.offset * m_sampleSize, take * m_sampleSize);
+            dst += take * m_sampleSize;
+            left -= take;
+        }
+    }
+    _board.gapInBlock = 0;
+    uint64_t left = _samples;
+    while (left > 0 && !_board.runs.empty()){
+        Run &run = _board.runs.front();
+        uint64_t take = std::min(left, run.count);
+        if (run.data[0].empty() && run.data[1].empty())
+            _board.gapInBlock += take;
+        run.first += take;
+        run.count -= take;
+        run.offset += take;
+        left -= take;
+        if (run.count == 0){
+            for (auto &data : run.data)
+                if (data.capacity() > 0)
+                    _board.spare.push_back(std::move(data));
+            _board.runs.pop_front();
+        }
+    }
+}
+
+// One TDMS segment with _samples of every channel. The metadata is written
+// with the first segment, after zeros were filled in and when the block size
+// changes, the segments in between only add the lead-in.
+bool CStreamAggregator::writeSegment(uint64_t _samples){
+    const std::string group = "/'Aggregate'";
+    const int32_t data_type = m_resolution == 8 ? TDMS::DataType::Integer8 : m_resolution == 32 ? TDMS::DataType::SingleFloat : TDMS::DataType::Integer16;
+    const size_t lead_in = 28;
+    const bool first = m_stats.segments == 0;
+
+    // The gaps of the block are only known once it is copied, the raw data goes after the metadata
+    std::vector<uint8_t> metadata;
+    m_segment.clear();
+    bool gaps = false;
+    for (auto &board : m_boards){
+        copyBlock(*board, _samples);
+        gaps = gaps || board->gapInBlock != 0;
+    }
+    const bool raw_only = !first && !gaps && _samples == m_lastCount;
+    if (!raw_only){
+        bool synced = true;
+        uint32_t channels = 0;
+        for (auto &board : m_boards){
+            synced = synced && board->stats.synced;
+            channels += board->channel[0] + board->channel[1];
+        }
+        m_stats.channels = channels;
+        AppendInt32(metadata, 1 + channels);
+        AppendString(metadata, group);
+        AppendInt32(metadata, -1); // No raw data for the group
+        AppendInt32(metadata, first ? (synced ? 5 : 4) : 1);
+        AppendProperty(metadata, "sample_index", m_next);
+        if (first){
+            AppendProperty(metadata, "osc_rate", m_oscRate);
+            AppendProperty(metadata, "resolution", m_resolution);
+            AppendProperty(metadata, "boards", m_boards.size());
+            if (synced)
+                AppendProperty(metadata, "trigger_sample", RPSA_PACK_SYNC_ORIGIN);
+        }
+        for (size_t i = 0; i < m_boards.size(); i++){
+            const Board &board = *m_boards[i];
+            for (int c = 0; c < 2; c++){
+                if (!board.channel[c])
+                    continue;
+                AppendString(metadata, "/'Aggregate'/'board" + std::to_string(i) + "_ch" + std::to_string(c + 1) + "'");
+                AppendInt32(metadata, 20);
+                AppendInt32(metadata, data_type);
+                AppendInt32(metadata, 1);
+                AppendInt64(metadata, _samples);
+                AppendInt32(metadata, (first ? 2 : 0) + (board.gapInBlock != 0 ? 1 : 0));
+                if (first){
+                    AppendProperty(metadata, "board", board.stats.board);
+                    AppendProperty(metadata, "host", board.host);
+                }
+                if (board.gapInBlock != 0)
+                    AppendProperty(metadata, "gap_samples", board.gapInBlock);
+            }
+        }
+        m_lastCount = _samples;
+    }
+
+    std::vector<uint8_t> header;
+    header.reserve(lead_in);
+    header.insert(header.end(), {'T', 'D', 'S', 'm'});
+    AppendInt32(header, (raw_only ? 0 : 1 << 1) | (1 << 3)); // [HasMetaData |] HasRawData
+    AppendInt32(header, 4713);
+    AppendInt64(header, metadata.size() + m_segment.size()); // Next segment offset
+    AppendInt64(header, metadata.size());                    // Raw data offset
+    bool ok = m_file->write(header.data(), header.size())
+        && (metadata.empty() || m_file->write(metadata.data(), metadata.size()))
+        && m_file->write(m_segment.data(), m_segment.size());
+    // The block left the queues either way, the boards stay lined up
+    m_next += _samples;
+    if (!ok){
+        std::cerr << "[rpsa] Aggregator: write to " << m_path << " failed\n";
+        return false;
+    }
+    m_stats.samples += _samples;
+    m_stats.segments++;
+    return true;
+}
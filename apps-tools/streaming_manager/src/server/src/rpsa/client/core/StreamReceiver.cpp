@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "rpsa/client/core/StreamReceiver.h"
+#include "rpsa/common/core/stream_codec.h"
+#include "rpsa/common/core/neon_asm.h"
+
+namespace {
+    uint32_t ReadU32(const uint8_t *_header, size_t _index){
+        uint32_t value;
+        memcpy(&value, _header + _index * sizeof(uint32_t), sizeof(value));
+        return value;
+    }
+
+    uint64_t ReadU64(const uint8_t *_header, size_t _index){
+        uint64_t value;
+        memcpy(&value, _header + _index * sizeof(uint64_t), sizeof(value));
+        return value;
+    }
+
+    bool IsHeader(const uint8_t *_buffer){
+        return memcmp(_buffer, RPSA_PACK_MAGIC_PREFIX, RPSA_PACK_MAGIC_PREFIX_SIZE) == 0
+            && (_buffer[RPSA_PACK_MAGIC_PREFIX_SIZE] == '0' || _buffer[RPSA_PACK_MAGIC_PREFIX_SIZE] == '1');
+    }
+
+    size_t ChannelSamples(const rpsa_pack_t &_pack, const uint8_t *_data, size_t _size){
+        if (_data == nullptr || _size == 0)
+            return 0;
+        size_t bytes = _pack.compressed ? CStreamCodec::DecodedSize(_data, _size) : _size;
+        if (!_pack.compressed && (_pack.resolution == 12 || _pack.resolution == 14))
+            return bytes * 8 / _pack.resolution;
+        return _pack.resolution == 32 ? bytes / 4 : _pack.resolution > 8 ? bytes / 2 : bytes;
+    }
+}
+
+CStreamReceiver::Ptr CStreamReceiver::Create(const std::string &_host, const std::string &_port, int _protocol, size_t _ringSize){
+    return std::make_shared<CStreamReceiver>(_host, _port, _protocol, _ringSize);
+}
+
+CStreamReceiver::CStreamReceiver(const std::string &_host, const std::string &_port, int _protocol, size_t _ringSize):
+    m_host(_host),
+    m_port(_port),
+    m_protocol(_protocol),
+    m_ios(),
+    m_tcp(m_ios),
+    m_udp(m_ios),
+    m_udpEndpoint(),
+    m_thread(),
+    m_memory(nullptr),
+    m_ring(nullptr),
+    m_ringSize(std::max(_ringSize, (size_t)(4 * RECEIVER_MAX_PACK_SIZE))),
+    m_readPos(0),
+    m_writePos(0),
+    m_handler(nullptr),
+    m_capture(nullptr),
+    m_first(true),
+    m_nextId(0),
+    m_nextSampleId(0),
+    m_bytes(0),
+    m_packs(0),
+    m_lostPacks(0),
+    m_gapSamples(0),
+    m_broken(0)
+{
+    // Cache line aligned like the server buffers
+    m_memory = new uint8_t[m_ringSize + 64];
+    auto base = reinterpret_cast<uintptr_t>(m_memory);
+    m_ring = reinterpret_cast<uint8_t*>((base + 63) & ~(uintptr_t)63);
+}
+
+CStreamReceiver::~CStreamReceiver(){
+    stop();
+    delete [] m_memory;
+}
+
+void CStreamReceiver::setHandler(PackHandler _handler){
+    m_handler = _handler;
+}
+
+bool CStreamReceiver::setCaptureFile(const std::string &_path){
+    auto capture = CCaptureWriter::Create(_path);
+    if (!capture->open())
+        return false;
+    m_capture = capture;
+    return true;
+}
+
+bool CStreamReceiver::start(){
+    asio::error_code error;
+    m_ios.restart();
+    m_readPos = 0;
+    m_writePos = 0;
+    m_first = true;
+    if (m_protocol == RPSA_PROTOCOL_TCP){
+        asio::ip::tcp::resolver resolver(m_ios);
+        auto endpoints = resolver.resolve(asio::ip::tcp::resolver::query(m_host, m_port), error);
+        if (!error)
+            asio::connect(m_tcp, endpoints, error);
+        if (error){
+            std::cerr << "[rpsa] Can't connect to " << m_host << ":" << m_port << ": " << error.message() << "\n";
+            return false;
+        }
+        m_tcp.set_option(asio::socket_base::receive_buffer_size(RECEIVER_MAX_PACK_SIZE * 4), error);
+    }else if (m_protocol == RPSA_PROTOCOL_UDP){
+        asio::ip::udp::resolver resolver(m_ios);
+        auto endpoints = resolver.resolve(asio::ip::udp::resolver::query(asio::ip::udp::v4(), m_host, m_port), error);
+        if (!error){
+            m_udpEndpoint = *endpoints;
+            m_udp.open(asio::ip::udp::v4(), error);
+        }
+        if (!error){
+            m_udp.set_option(asio::socket_base::receive_buffer_size(RECEIVER_UDP_SOCKET_BUFFER), error);
+            // The server streams to whoever sent it the last datagram
+            m_udp.send_to(asio::buffer("\x01", 1), m_udpEndpoint, 0, error);
+        }
+        if (error){
+            std::cerr << "[rpsa] Can't open UDP socket to " << m_host << ":" << m_port << ": " << error.message() << "\n";
+            return false;
+        }
+    }else{
+        return false;
+    }
+    startRead();
+    m_thread = std::thread([this](){ m_ios.run(); });
+    return true;
+}
+
+void CStreamReceiver::stop(){
+    m_ios.stop();
+    if (m_thread.joinable())
+        m_thread.join();
+    asio::error_code error;
+    if (m_tcp.is_open())
+        m_tcp.close(error);
+    if (m_udp.is_open())
+        m_udp.close(error);
+    if (m_capture){
+        m_capture->close();
+        m_capture = nullptr;
+    }
+}
+
+void CStreamReceiver::getStats(rpsa_receiver_stats_t &_stats) const{
+    _stats.bytes = m_bytes;
+    _stats.packs = m_packs;
+    _stats.lost_packs = m_lostPacks;
+    _stats.gap_samples = m_gapSamples;
+    _stats.broken = m_broken;
+    auto capture = m_capture;
+    _stats.written = capture ? capture->writtenBytes() : 0;
+}
+
+void CStreamReceiver::startRead(){
+    if (m_protocol == RPSA_PROTOCOL_UDP){
+        m_udp.async_receive_from(asio::buffer(m_ring, RECEIVER_MAX_PACK_SIZE), m_udpEndpoint,
+                                 std::bind(&CStreamReceiver::handleUdpRead, this, std::placeholders::_1, std::placeholders::_2));
+        return;
+    }
+    if (m_ringSize - m_writePos < RECEIVER_MAX_PACK_SIZE){
+        // Only an unfinished pack is left, it goes back to the front
+        memmove(m_ring, m_ring + m_readPos, m_writePos - m_readPos);
+        m_writePos -= m_readPos;
+        m_readPos = 0;
+    }
+    m_tcp.async_read_some(asio::buffer(m_ring + m_writePos, m_ringSize - m_writePos),
+                          std::bind(&CStreamReceiver::handleTcpRead, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+void CStreamReceiver::handleTcpRead(const asio::error_code &_error, size_t _size){
+    if (_error){
+        if (_error != asio::error::operation_aborted)
+            std::cerr << "[rpsa] Receiver stopped: " << _error.message() << "\n";
+        return;
+    }
+    m_writePos += _size;
+    m_bytes += _size;
+    while (m_writePos - m_readPos >= RPSA_PACK_HEADER_SIZE){
+        const uint8_t *data = m_ring + m_readPos;
+        size_t available = m_writePos - m_readPos;
+        if (!IsHeader(data)){
+            // Lost framing, skip to the next magic
+            size_t skip = 1;
+            while (skip + RPSA_PACK_HEADER_SIZE <= available && !IsHeader(data + skip))
+                skip++;
+            m_readPos += skip;
+            m_broken += skip;
+            continue;
+        }
+        size_t size = ReadU32(data, 9);
+        if (size < RPSA_PACK_HEADER_SIZE || size > RECEIVER_MAX_PACK_SIZE){
+            m_readPos++;
+            m_broken++;
+            continue;
+        }
+        if (available < size)
+            break;
+        rpsa_pack_t pack;
+        if (parsePack(data, size, pack) == 0){
+            m_readPos++;
+            m_broken++;
+            continue;
+        }
+        handlePack(pack);
+        m_readPos += size;
+    }
+    if (m_readPos == m_writePos){
+        m_readPos = 0;
+        m_writePos = 0;
+    }
+    startRead();
+}
+
+void CStreamReceiver::handleUdpRead(const asio::error_code &_error, size_t _size){
+    if (_error){
+        if (_error == asio::error::operation_aborted)
+            return;
+        std::cerr << "[rpsa] Receiver: " << _error.message() << "\n";
+    }else{
+        m_bytes += _size;
+        rpsa_pack_t pack;
+        if (parsePack(m_ring, _size, pack) == _size){
+            handlePack(pack);
+        }else{
+            m_broken += _size;
+        }
+    }
+    startRead();
+}
+
+void CStreamReceiver::handlePack(const rpsa_pack_t &_pack){
+    if (!m_first){
+        // Reordered UDP datagrams are late, they are dropped
+        if (_pack.id < m_nextId && m_protocol == RPSA_PROTOCOL_UDP)
+            return;
+        if (_pack.id > m_nextId)
+            m_lostPacks += _pack.id - m_nextId;
+        if (_pack.sample_id > m_nextSampleId)
+            m_gapSamples += _pack.sample_id - m_nextSampleId;
+    }
+    m_first = false;
+    m_nextId = _pack.id + 1;
+    m_nextSampleId = _pack.sample_id + _pack.samples;
+    m_packs++;
+    if (m_capture)
+        m_capture->write((const uint8_t*)_pack.ch1 - RPSA_PACK_HEADER_SIZE, _pack.size);
+    if (m_handler)
+        m_handler(_pack);
+}
+
+size_t CStreamReceiver::parsePack(const uint8_t *_buffer, size_t _size, rpsa_pack_t &_pack){
+    if (_buffer == nullptr || _size < RPSA_PACK_HEADER_SIZE || !IsHeader(_buffer))
+        return 0;
+    size_t size = ReadU32(_buffer, 9);
+    size_t size_ch1 = ReadU32(_buffer, 10);
+    size_t size_ch2 = ReadU32(_buffer, 11);
+    if (size > _size || RPSA_PACK_HEADER_SIZE + size_ch1 + size_ch2 > size)
+        return 0;
+    _pack.id = ReadU64(_buffer, 2);
+    _pack.lost_rate = ReadU64(_buffer, 3);
+    _pack.sample_id = ReadU64(_buffer, 7);
+    _pack.osc_rate = ReadU32(_buffer, 8);
+    _pack.resolution = ReadU32(_buffer, 12);
+    _pack.compressed = _buffer[RPSA_PACK_MAGIC_PREFIX_SIZE] == '1';
+    _pack.ch1 = _buffer + RPSA_PACK_HEADER_SIZE;
+    _pack.size_ch1 = size_ch1;
+    _pack.ch2 = _buffer + RPSA_PACK_HEADER_SIZE + size_ch1;
+    _pack.size_ch2 = size_ch2;
+    _pack.size = size;
+    _pack.board = ReadU32(_buffer, 13) & RPSA_PACK_BOARD_MASK;
+    _pack.synced = (ReadU32(_buffer, 13) & RPSA_PACK_BOARD_SYNCED) != 0;
+    _pack.payload = (ReadU32(_buffer, 13) & RPSA_PACK_PAYLOAD_MASK) >> RPSA_PACK_PAYLOAD_SHIFT;
+    _pack.samples = (uint32_t)std::max(ChannelSamples(_pack, _pack.ch1, size_ch1), ChannelSamples(_pack, _pack.ch2, size_ch2));
+    _pack.time_ns = 0;
+    _pack.time_error_ns = 0;
+    _pack.time_flags = 0;
+    if (size - RPSA_PACK_HEADER_SIZE - size_ch1 - size_ch2 >= RPSA_PACK_TRAILER_SIZE){
+        const uint8_t *trailer = _buffer + RPSA_PACK_HEADER_SIZE + size_ch1 + size_ch2;
+        memcpy(&_pack.time_ns, trailer, sizeof(_pack.time_ns));
+        memcpy(&_pack.time_error_ns, trailer + 8, sizeof(_pack.time_error_ns));
+        memcpy(&_pack.time_flags, trailer + 12, sizeof(_pack.time_flags));
+    }
+    return size;
+}
+
+size_t CStreamReceiver::decodeChannel(const rpsa_pack_t &_pack, int _channel, void *_dst, size_t _capacity){
+    const uint8_t *data = _channel == 1 ? _pack.ch1 : _channel == 2 ? _pack.ch2 : nullptr;
+    size_t size = _channel == 1 ? _pack.size_ch1 : _channel == 2 ? _pack.size_ch2 : 0;
+    if (data == nullptr || size == 0 || _dst == nullptr)
+        return 0;
+    if (_pack.compressed)
+        return CStreamCodec::Decode(data, size, _pack.resolution, _dst, _capacity);
+    if (_pack.resolution == 12 || _pack.resolution == 14){
+        if (size * 8 / _pack.resolution * 2 > _capacity)
+            return 0;
+        return unpack_bits_to_16bit(_dst, data, size, _pack.resolution);
+    }
+    if (size > _capacity)
+        return 0;
+    memcpy(_dst, data, size);
+    return size;
+}
@@ -0,0 +1,154 @@
+#include <iostream>
+#include "rpsa/client/core/rpsa_receiver.h"
+#include "rpsa/client/core/StreamReceiver.h"
+#include "rpsa/client/core/StreamAggregator.h"
+
+// C entry points, every call catches so no exception crosses the ABI
+
+struct rpsa_receiver {
+    CStreamReceiver::Ptr receiver;
+};
+
+size_t rpsa_parse_pack(const uint8_t *buffer, size_t size, rpsa_pack_t *pack){
+    if (pack == nullptr)
+        return 0;
+    return CStreamReceiver::parsePack(buffer, size, *pack);
+}
+
+size_t rpsa_decode_channel(const rpsa_pack_t *pack, int channel, void *dst, size_t capacity){
+    if (pack == nullptr)
+        return 0;
+    return CStreamReceiver::decodeChannel(*pack, channel, dst, capacity);
+}
+
+rpsa_receiver_t *rpsa_receiver_create(const char *host, const char *port, int protocol, size_t ring_size){
+    if (host == nullptr || port == nullptr || (protocol != RPSA_PROTOCOL_TCP && protocol != RPSA_PROTOCOL_UDP))
+        return nullptr;
+    try{
+        auto receiver = new rpsa_receiver();
+        receiver->receiver = CStreamReceiver::Create(host, port, protocol, ring_size > 0 ? ring_size : RECEIVER_DEFAULT_RING_SIZE);
+        return receiver;
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_receiver_create: " << e.what() << "\n";
+        return nullptr;
+    }
+}
+
+void rpsa_receiver_destroy(rpsa_receiver_t *receiver){
+    delete receiver;
+}
+
+void rpsa_receiver_set_callback(rpsa_receiver_t *receiver, rpsa_pack_callback_t callback, void *user){
+    if (receiver == nullptr)
+        return;
+    if (callback == nullptr){
+        receiver->receiver->setHandler(nullptr);
+        return;
+    }
+    receiver->receiver->setHandler([callback, user](const rpsa_pack_t &_pack){ callback(&_pack, user); });
+}
+
+int rpsa_receiver_set_capture_file(rpsa_receiver_t *receiver, const char *path){
+    if (receiver == nullptr || path == nullptr)
+        return -1;
+    try{
+        return receiver->receiver->setCaptureFile(path) ? 0 : -1;
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_receiver_set_capture_file: " << e.what() << "\n";
+        return -1;
+    }
+}
+
+int rpsa_receiver_start(rpsa_receiver_t *receiver){
+    if (receiver == nullptr)
+        return -1;
+    try{
+        return receiver->receiver->start() ? 0 : -1;
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_receiver_start: " << e.what() << "\n";
+        return -1;
+    }
+}
+
+void rpsa_receiver_stop(rpsa_receiver_t *receiver){
+    if (receiver == nullptr)
+        return;
+    try{
+        receiver->receiver->stop();
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_receiver_stop: " << e.what() << "\n";
+    }
+}
+
+void rpsa_receiver_get_stats(rpsa_receiver_t *receiver, rpsa_receiver_stats_t *stats){
+    if (receiver == nullptr || stats == nullptr)
+        return;
+    receiver->receiver->getStats(*stats);
+}
+
+struct rpsa_aggregator {
+    CStreamAggregator::Ptr aggregator;
+};
+
+rpsa_aggregator_t *rpsa_aggregator_create(const char *path, size_t block_samples, uint64_t max_lag){
+    if (path == nullptr)
+        return nullptr;
+    try{
+        auto aggregator = new rpsa_aggregator();
+        aggregator->aggregator = CStreamAggregator::Create(path,
+            block_samples > 0 ? block_samples : AGGREGATOR_DEFAULT_BLOCK,
+            max_lag > 0 ? max_lag : AGGREGATOR_DEFAULT_MAX_LAG);
+        return aggregator;
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_aggregator_create: " << e.what() << "\n";
+        return nullptr;
+    }
+}
+
+void rpsa_aggregator_destroy(rpsa_aggregator_t *aggregator){
+    delete aggregator;
+}
+
+int rpsa_aggregator_add_board(rpsa_aggregator_t *aggregator, const char *host, const char *port, int protocol, size_t ring_size){
+    if (aggregator == nullptr || host == nullptr || port == nullptr || (protocol != RPSA_PROTOCOL_TCP && protocol != RPSA_PROTOCOL_UDP))
+        return -1;
+    try{
+        return aggregator->aggregator->addBoard(host, port, protocol, ring_size > 0 ? ring_size : RECEIVER_DEFAULT_RING_SIZE);
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_aggregator_add_board: " << e.what() << "\n";
+        return -1;
+    }
+}
+
+int rpsa_aggregator_start(rpsa_aggregator_t *aggregator){
+    if (aggregator == nullptr)
+        return -1;
+    try{
+        return aggregator->aggregator->start() ? 0 : -1;
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_aggregator_start: " << e.what() << "\n";
+        return -1;
+    }
+}
+
+void rpsa_aggregator_stop(rpsa_aggregator_t *aggregator){
+    if (aggregator == nullptr)
+        return;
+    try{
+        aggregator->aggregator->stop();
+    }catch (std::exception &e){
+        std::cerr << "[rpsa] rpsa_aggregator_stop: " << e.what() << "\n";
+    }
+}
+
+void rpsa_aggregator_get_stats(rpsa_aggregator_t *aggregator, rpsa_aggregator_stats_t *stats){
+    if (aggregator == nullptr || stats == nullptr)
+        return;
+    aggregator->aggregator->getStats(*stats);
+}
+
+int rpsa_aggregator_get_board_stats(rpsa_aggregator_t *aggregator, size_t board, rpsa_aggregator_board_stats_t *stats){
+    if (aggregator == nullptr || stats == nullptr)
+        return -1;
+    return aggregator->aggregator->getBoardStats(board, *stats) ? 0 : -1;
+}
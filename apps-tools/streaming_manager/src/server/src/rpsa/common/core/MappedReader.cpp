@@ -0,0 +1,590 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include "rpsa/common/core/MappedReader.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define  SEGMENT_LEAD_IN        28
+#define  TOC_META_DATA          (1 << 1)
+#define  TOC_NEW_OBJ_LIST       (1 << 2)
+#define  TOC_RAW_DATA           (1 << 3)
+#define  TOC_INTERLEAVED        (1 << 5)
+#define  TOC_BIG_ENDIAN         (1 << 6)
+#define  TOC_DAQMX_RAW_DATA     (1 << 7)
+#define  RAW_INDEX_NONE         0xFFFFFFFF
+#define  RAW_INDEX_SAME         0x00000000
+#define  RAW_INDEX_DAQMX_FORMAT 0x00001269
+#define  RAW_INDEX_DAQMX_DIGIT  0x0000126A
+#define  INDEX_FILE_MAGIC       "TDMSidx1"
+
+namespace
+{
+	// Bounds checked reads over the mapping, they stop at the first short field
+	class Cursor
+	{
+	public:
+		Cursor(const uint8_t *data, uint64_t pos, uint64_t end):m_data(data),m_pos(pos),m_end(end),m_ok(true){}
+
+		template<typename T>
+		T Read() {
+			T value = 0;
+			if (!Skip(sizeof(T)))
+				return value;
+			memcpy(&value, m_data + m_pos - sizeof(T), sizeof(T));
+			return value;
+		}
+
+		string ReadString() {
+			uint32_t size = Read<uint32_t>();
+			if (!Skip(size))
+				return string();
+			return string((const char*)m_data + m_pos - size, size);
+		}
+
+		bool Skip(uint64_t size) {
+			if (!m_ok || size > m_end - m_pos){
+				m_ok = false;
+				return false;
+			}
+			m_pos += size;
+			return true;
+		}
+
+		bool Ok() const { return m_ok; }
+
+	private:
+		const uint8_t *m_data;
+		uint64_t       m_pos;
+		uint64_t       m_end;
+		bool           m_ok;
+	};
+
+	// DataType::GetLength() does not report unknown types
+	uint32_t TypeSize(uint32_t dataType) {
+		switch (dataType)
+		{
+			case TDMS::DataType::Void:
+			case TDMS::DataType::Integer8:
+			case TDMS::DataType::UnsignedInteger8:
+			case TDMS::DataType::Boolean: return 1;
+			case TDMS::DataType::Integer16:
+			case TDMS::DataType::UnsignedInteger16: return 2;
+			case TDMS::DataType::Integer32:
+			case TDMS::DataType::UnsignedInteger32:
+			case TDMS::DataType::SingleFloat:
+			case TDMS::DataType::SingleFloatWithUnit: return 4;
+			case TDMS::DataType::Integer64:
+			case TDMS::DataType::UnsignedInteger64:
+			case TDMS::DataType::DoubleFloat:
+			case TDMS::DataType::DoubleFloatWithUnit: return 8;
+			case TDMS::DataType::TimeStamp: return 16;
+			default: return 0;
+		}
+	}
+
+	struct ObjectState
+	{
+		bool     HasRaw = false;
+		uint32_t DataType = 0;
+		uint64_t Count = 0;
+		uint64_t Bytes = 0;        // Raw bytes per chunk
+		size_t   Channel = SIZE_MAX;
+	};
+
+	template<typename T>
+	void WriteValue(FILE *file, T value) {
+		fwrite(&value, sizeof(T), 1, file);
+	}
+
+	template<typename T>
+	bool ReadValue(FILE *file, T &value) {
+		return fread(&value, sizeof(T), 1, file) == 1;
+	}
+
+	// The NI index file, the lead-in ("TDSh") and metadata of every segment
+	bool ReadSegmentIndex(const string &indexName, vector<uint8_t> &headers) {
+		headers.clear();
+		FILE *file = fopen(indexName.c_str(), "rb");
+		if (file == nullptr)
+			return false;
+		char tag[4];
+		bool ok = fread(tag, 4, 1, file) == 1 && memcmp(tag, "TDSh", 4) == 0
+			&& fseek(file, 0, SEEK_END) == 0;
+		long size = ok ? ftell(file) : -1;
+		if (size > 0 && fseek(file, 0, SEEK_SET) == 0){
+			headers.resize(size);
+			ok = fread(headers.data(), 1, size, file) == (size_t)size;
+		}
+		fclose(file);
+		if (!ok || size <= 0)
+			headers.clear();
+		return !headers.empty();
+	}
+}
+
+namespace TDMS
+{
+	MappedReader::MappedReader():
+		m_data(nullptr),
+		m_fileSize(0),
+		m_fileTime(0),
+#ifdef _WIN32
+		m_file(nullptr),
+		m_mapping(nullptr),
+#endif
+		m_channels(),
+		m_lookup()
+	{
+	}
+
+	MappedReader::~MappedReader()
+	{
+		Close();
+	}
+
+	string MappedReader::IndexName(const string &fileName)
+	{
+		const string ext = ".tdms";
+		if (fileName.size() >= ext.size() && fileName.compare(fileName.size() - ext.size(), ext.size(), ext) == 0)
+			return fileName + "_index";
+		return fileName + ".tdms_index";
+	}
+
+	bool MappedReader::Open(const string &fileName, bool useIndexFile)
+	{
+		Close();
+		if (!Map(fileName))
+			return false;
+		string indexName = IndexName(fileName);
+		if (useIndexFile && LoadIndex(indexName))
+			return true;
+		// An index written along with the file is read instead of the
+		// segment headers spread over the file, and is kept as it is
+		vector<uint8_t> headers;
+		bool segmentIndex = useIndexFile && ReadSegmentIndex(indexName, headers);
+		if (!BuildIndex(headers)){
+			Close();
+			return false;
+		}
+		if (useIndexFile && !segmentIndex && !SaveIndex(indexName))
+			cout << "[rpsa] Can't save TDMS index " << indexName << "\n";
+		return true;
+	}
+
+	bool MappedReader::Map(const string &fileName)
+	{
+#ifdef _WIN32
+		struct _stat64 st;
+		if (_stat64(fileName.c_str(), &st) != 0 || st.st_size <= 0){
+			cout << "File " << fileName << " not exist" << std::endl;
+			return false;
+		}
+		HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE){
+			cout << "File " << fileName << " not exist" << std::endl;
+			return false;
+		}
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		const void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (data == nullptr){
+			cout << "[rpsa] Can't map " << fileName << "\n";
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+		m_file = file;
+		m_mapping = mapping;
+#else
+		int fd = open(fileName.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0){
+			cout << "File " << fileName << " not exist" << std::endl;
+			if (fd >= 0)
+				close(fd);
+			return false;
+		}
+		if ((uint64_t)st.st_size > std::numeric_limits<size_t>::max()){
+			cout << "[rpsa] " << fileName << " is too large to map\n";
+			close(fd);
+			return false;
+		}
+		void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED){
+			cout << "[rpsa] Can't map " << fileName << "\n";
+			return false;
+		}
+#endif
+		m_data = static_cast<const uint8_t*>(data);
+		m_fileSize = st.st_size;
+		m_fileTime = st.st_mtime;
+		return true;
+	}
+
+	void MappedReader::Close()
+	{
+		if (m_data != nullptr){
+#ifdef _WIN32
+			UnmapViewOfFile(m_data);
+			CloseHandle(m_mapping);
+			CloseHandle(m_file);
+			m_mapping = nullptr;
+			m_file = nullptr;
+#else
+			munmap(const_cast<uint8_t*>(m_data), m_fileSize);
+#endif
+		}
+		m_data = nullptr;
+		m_fileSize = 0;
+		m_fileTime = 0;
+		m_channels.clear();
+		m_lookup.clear();
+	}
+
+	bool MappedReader::IsOpen() const
+	{
+		return m_data != nullptr;
+	}
+
+	uint64_t MappedReader::GetFileSize() const
+	{
+		return m_fileSize;
+	}
+
+	vector<string> MappedReader::GetChannels() const
+	{
+		vector<string> list;
+		for (auto &channel : m_channels)
+			list.push_back(channel.PathStr);
+		return list;
+	}
+
+	const ChannelIndex* MappedReader::GetChannel(const string &path) const
+	{
+		auto it = m_lookup.find(path);
+		return it != m_lookup.end() ? &m_channels[it->second] : nullptr;
+	}
+
+	// The lead-ins and metadata come from the segment index while it has entries,
+	// the raw data positions always refer to the file. Segments the index does
+	// not cover yet are read from the file.
+	bool MappedReader::BuildIndex(const vector<uint8_t> &headers)
+	{
+		map<string, ObjectState> objects;
+		vector<ObjectState*> active;
+		uint64_t offset = 0;
+		uint64_t header = 0;
+
+		if (!headers.empty() && (m_fileSize < SEGMENT_LEAD_IN || memcmp(m_data, "TDSm", 4) != 0)){
+			cout << "[rpsa] Not a TDMS file\n";
+			return false;
+		}
+
+		while (offset + SEGMENT_LEAD_IN <= m_fileSize)
+		{
+			bool fromIndex = header + SEGMENT_LEAD_IN <= headers.size();
+			const uint8_t *src = fromIndex ? headers.data() : m_data;
+			uint64_t srcPos = fromIndex ? header : offset;
+			uint64_t srcSize = fromIndex ? headers.size() : m_fileSize;
+			Cursor leadIn(src, srcPos, srcSize);
+			if (fromIndex && memcmp(src + srcPos, "TDSh", 4) != 0){
+				cout << "[rpsa] Broken TDMS index at " << header << ", the rest of the file is read from its segments\n";
+				header = headers.size();
+				continue;
+			}
+			if (!fromIndex && memcmp(m_data + offset, "TDSm", 4) != 0){
+				if (offset == 0){
+					cout << "[rpsa] Not a TDMS file\n";
+					return false;
+				}
+				cout << "[rpsa] Broken TDMS segment at " << offset << ", the rest of the file is skipped\n";
+				break;
+			}
+			leadIn.Skip(4);
+			uint32_t toc = leadIn.Read<uint32_t>();
+			leadIn.Read<uint32_t>(); // Version
+			int64_t nextSegment = leadIn.Read<int64_t>();
+			int64_t rawOffset = leadIn.Read<int64_t>();
+
+			// A recording cut short leaves the last segment without its length
+			uint64_t segmentEnd = m_fileSize;
+			if (nextSegment >= 0 && (uint64_t)nextSegment <= m_fileSize - offset - SEGMENT_LEAD_IN)
+				segmentEnd = offset + SEGMENT_LEAD_IN + nextSegment;
+			uint64_t rawStart = offset + SEGMENT_LEAD_IN + (rawOffset > 0 ? rawOffset : 0);
+
+			if (toc & (TOC_BIG_ENDIAN | TOC_DAQMX_RAW_DATA)){
+				cout << "[rpsa] Big endian and DAQmx TDMS data is not supported\n";
+				return false;
+			}
+
+			if (toc & TOC_NEW_OBJ_LIST)
+				active.clear();
+
+			// Segments written without raw data leave the raw data offset at zero
+			uint64_t metaEnd = (toc & TOC_RAW_DATA) && rawOffset > 0 ? std::min(rawStart, segmentEnd) : segmentEnd;
+			if (fromIndex && (toc & TOC_META_DATA) && metaEnd - offset > srcSize - srcPos){
+				// The index ends inside this entry, the file has the whole segment
+				header = headers.size();
+				fromIndex = false;
+				src = m_data;
+				srcPos = offset;
+			}
+			if (toc & TOC_META_DATA){
+				Cursor meta(src, srcPos + SEGMENT_LEAD_IN, srcPos + (metaEnd - offset));
+				uint32_t objectCount = meta.Read<uint32_t>();
+				for (uint32_t x = 0; x < objectCount && meta.Ok(); x++)
+				{
+					string path = meta.ReadString();
+					ObjectState &object = objects[path];
+					uint32_t rawIndex = meta.Read<uint32_t>();
+					if (rawIndex == RAW_INDEX_NONE){
+						object.HasRaw = false;
+					}else if (rawIndex == RAW_INDEX_DAQMX_FORMAT || rawIndex == RAW_INDEX_DAQMX_DIGIT){
+						cout << "[rpsa] DAQmx TDMS data is not supported\n";
+						return false;
+					}else if (rawIndex != RAW_INDEX_SAME){
+						object.DataType = meta.Read<uint32_t>();
+						meta.Read<uint32_t>(); // Dimension, always 1
+						object.Count = meta.Read<uint64_t>();
+						object.Bytes = object.DataType == DataType::String ? meta.Read<uint64_t>() : object.Count * TypeSize(object.DataType);
+						object.HasRaw = true;
+						if (object.DataType != DataType::String && TypeSize(object.DataType) == 0){
+							cout << "[rpsa] Unknown TDMS data type " << object.DataType << " in " << path << "\n";
+							return false;
+						}
+					}
+					if (object.HasRaw && object.Channel == SIZE_MAX){
+						ChannelIndex channel;
+						channel.PathStr = path;
+						channel.DataType = object.DataType;
+						channel.TypeSize = object.DataType == DataType::String ? 0 : TypeSize(object.DataType);
+						channel.Samples = 0;
+						object.Channel = m_channels.size();
+						m_lookup[path] = m_channels.size();
+						m_channels.push_back(channel);
+					}
+					if (std::find(active.begin(), active.end(), &object) == active.end())
+						active.push_back(&object);
+
+					uint32_t propertyCount = meta.Read<uint32_t>();
+					for (uint32_t y = 0; y < propertyCount && meta.Ok(); y++)
+					{
+						meta.ReadString();
+						uint32_t type = meta.Read<uint32_t>();
+						if (type == DataType::String)
+							meta.ReadString();
+						else if (TypeSize(type) > 0)
+							meta.Skip(TypeSize(type));
+						else
+							meta.Skip(m_fileSize);
+					}
+				}
+				if (!meta.Ok()){
+					cout << "[rpsa] Broken TDMS metadata at " << offset << ", the rest of the file is skipped\n";
+					break;
+				}
+			}
+
+			if ((toc & TOC_RAW_DATA) && rawStart < segmentEnd){
+				vector<ObjectState*> raw;
+				uint64_t chunkSize = 0;
+				uint32_t stride = 0;
+				for (auto object : active){
+					if (object->HasRaw && object->Bytes > 0){
+						raw.push_back(object);
+						chunkSize += object->Bytes;
+						stride += TypeSize(object->DataType);
+					}
+				}
+
+				auto addChunk = [this](ObjectState *object, uint64_t pos, uint64_t count, uint32_t stride){
+					ChannelIndex &channel = m_channels[object->Channel];
+					if (channel.TypeSize == 0 || count == 0 || channel.DataType != object->DataType)
+						return;
+					if (!channel.Chunks.empty()){
+						Chunk &last = channel.Chunks.back();
+						if (last.Stride == stride && last.Offset + last.Count * stride == pos){
+							last.Count += count;
+							channel.Samples += count;
+							return;
+						}
+					}
+					channel.Chunks.push_back({pos, channel.Samples, count, stride});
+					channel.Samples += count;
+				};
+
+				if (toc & TOC_INTERLEAVED){
+					uint64_t count = stride > 0 ? (segmentEnd - rawStart) / stride : 0;
+					uint64_t pos = rawStart;
+					for (auto object : raw){
+						addChunk(object, pos, count, stride);
+						pos += TypeSize(object->DataType);
+					}
+				}else if (chunkSize > 0){
+					// The same chunk layout repeats until the end of the segment
+					uint64_t pos = rawStart;
+					while (pos < segmentEnd){
+						for (auto object : raw){
+							uint64_t bytes = std::min(object->Bytes, segmentEnd - pos);
+							uint32_t size = TypeSize(object->DataType);
+							if (size > 0)
+								addChunk(object, pos, bytes / size, size);
+							pos += bytes;
+							if (pos >= segmentEnd)
+								break;
+						}
+					}
+				}
+			}
+
+			if (segmentEnd == m_fileSize)
+				break;
+			if (fromIndex)
+				header += (toc & TOC_META_DATA) ? metaEnd - offset : SEGMENT_LEAD_IN;
+			offset = segmentEnd;
+		}
+		return true;
+	}
+
+	const Chunk* MappedReader::FindChunk(const ChannelIndex &channel, uint64_t sample) const
+	{
+		auto it = std::upper_bound(channel.Chunks.begin(), channel.Chunks.end(), sample,
+								   [](uint64_t value, const Chunk &chunk){ return value < chunk.FirstSample; });
+		return &*(it - 1);
+	}
+
+	uint64_t MappedReader::ForEachSpan(const string &path, uint64_t first, uint64_t count, SpanHandler handler) const
+	{
+		auto channel = GetChannel(path);
+		if (channel == nullptr || channel->TypeSize == 0 || first >= channel->Samples)
+			return 0;
+		if (count > channel->Samples - first)
+			count = channel->Samples - first;
+		const Chunk *chunk = FindChunk(*channel, first);
+		const Chunk *end = channel->Chunks.data() + channel->Chunks.size();
+		uint64_t left = count;
+		uint64_t sample = first;
+		for (; chunk != end && left > 0; chunk++)
+		{
+			uint64_t pos = sample - chunk->FirstSample;
+			uint64_t size = std::min(chunk->Count - pos, left);
+			handler(m_data + chunk->Offset + pos * chunk->Stride, sample, size, chunk->Stride);
+			sample += size;
+			left -= size;
+		}
+		return count;
+	}
+
+	uint64_t MappedReader::Read(const string &path, uint64_t first, uint64_t count, void *dst) const
+	{
+		auto channel = GetChannel(path);
+		if (channel == nullptr || dst == nullptr)
+			return 0;
+		uint32_t typeSize = channel->TypeSize;
+		uint8_t *out = static_cast<uint8_t*>(dst);
+		return ForEachSpan(path, first, count, [&](const uint8_t *data, uint64_t, uint64_t size, uint32_t stride){
+			if (stride == typeSize){
+				memcpy(out, data, size * typeSize);
+				out += size * typeSize;
+				return;
+			}
+			for (uint64_t i = 0; i < size; i++, out += typeSize)
+				memcpy(out, data + i * stride, typeSize);
+		});
+	}
+
+	bool MappedReader::SaveIndex(const string &indexName) const
+	{
+		if (!IsOpen())
+			return false;
+		FILE *file = fopen(indexName.c_str(), "wb");
+		if (file == nullptr)
+			return false;
+		fwrite(INDEX_FILE_MAGIC, 8, 1, file);
+		WriteValue<uint64_t>(file, m_fileSize);
+		WriteValue<int64_t>(file, m_fileTime);
+		WriteValue<uint32_t>(file, m_channels.size());
+		for (auto &channel : m_channels)
+		{
+			WriteValue<uint32_t>(file, channel.PathStr.size());
+			fwrite(channel.PathStr.data(), 1, channel.PathStr.size(), file);
+			WriteValue<uint32_t>(file, channel.DataType);
+			WriteValue<uint32_t>(file, channel.TypeSize);
+			WriteValue<uint64_t>(file, channel.Chunks.size());
+			for (auto &chunk : channel.Chunks)
+			{
+				WriteValue<uint64_t>(file, chunk.Offset);
+				WriteValue<uint64_t>(file, chunk.Count);
+				WriteValue<uint32_t>(file, chunk.Stride);
+			}
+		}
+		bool ok = ferror(file) == 0;
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+			remove(indexName.c_str());
+		return ok;
+	}
+
+	bool MappedReader::LoadIndex(const string &indexName)
+	{
+		if (!IsOpen())
+			return false;
+		FILE *file = fopen(indexName.c_str(), "rb");
+		if (file == nullptr)
+			return false;
+		char magic[8];
+		uint64_t fileSize = 0;
+		int64_t  fileTime = 0;
+		uint32_t channelCount = 0;
+		bool ok = fread(magic, 8, 1, file) == 1 && memcmp(magic, INDEX_FILE_MAGIC, 8) == 0
+			&& ReadValue(file, fileSize) && ReadValue(file, fileTime) && ReadValue(file, channelCount)
+			&& fileSize == m_fileSize && fileTime == m_fileTime;
+
+		vector<ChannelIndex> channels;
+		for (uint32_t x = 0; ok && x < channelCount; x++)
+		{
+			ChannelIndex channel;
+			uint32_t pathSize = 0;
+			uint64_t chunkCount = 0;
+			ok = ReadValue(file, pathSize) && pathSize < 65536;
+			if (ok){
+				channel.PathStr.resize(pathSize);
+				ok = fread(&channel.PathStr[0], 1, pathSize, file) == pathSize
+					&& ReadValue(file, channel.DataType) && ReadValue(file, channel.TypeSize) && ReadValue(file, chunkCount);
+			}
+			channel.Samples = 0;
+			for (uint64_t y = 0; ok && y < chunkCount; y++)
+			{
+				Chunk chunk;
+				ok = ReadValue(file, chunk.Offset) && ReadValue(file, chunk.Count) && ReadValue(file, chunk.Stride);
+				// Stale or damaged indexes must never point outside the mapping
+				ok = ok && chunk.Count > 0 && chunk.Stride >= channel.TypeSize && chunk.Offset < m_fileSize
+					&& (chunk.Count - 1) * chunk.Stride + channel.TypeSize <= m_fileSize - chunk.Offset;
+				chunk.FirstSample = channel.Samples;
+				channel.Samples += chunk.Count;
+				channel.Chunks.push_back(chunk);
+			}
+			channels.push_back(channel);
+		}
+		fclose(file);
+		if (!ok)
+			return false;
+
+		m_channels = channels;
+		m_lookup.clear();
+		for (size_t x = 0; x < m_channels.size(); x++)
+			m_lookup[m_channels[x].PathStr] = x;
+		return true;
+	}
+}
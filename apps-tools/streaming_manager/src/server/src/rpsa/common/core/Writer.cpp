@@ -75,7 +75,7 @@ namespace TDMS {
     }
 
     void   WriterSegment::AddProperties(shared_ptr<Metadata> metadata,string key,DataType value){
-        metadata->Properties[key] = value;
+        metadata->Properties[key] = std::move(value);
     }
 
     void   WriterSegment::AddRaw(shared_ptr<Metadata> metadata,uint32_t type,int64_t count, void *rawData){
@@ -134,7 +134,7 @@ namespace TDMS {
                     int32_t key_len = kv.first.size();
                     m_fileStream->write(reinterpret_cast<char*>(&key_len), sizeof(key_len));
                     m_fileStream->write(kv.first.data(),kv.first.size());
-                    DataType value = kv.second;
+                    const DataType &value = kv.second;
                     uint32_t typeValue =value.GetDataType();
                     m_fileStream->write(reinterpret_cast<char*>(&typeValue), sizeof(typeValue));
                     m_bstream.Write(*m_fileStream,value);
@@ -151,7 +151,7 @@ namespace TDMS {
 
         for(auto &n :nodes) {
             if (n != root) {
-                auto rawVector = n->RawData.DataType.GetRawVector();
+                auto &rawVector = n->RawData.DataType.GetRawVector();
                 for(auto &r: rawVector){
                     m_fileStream->write((const char*)r->data,r->size);
                 }
@@ -169,8 +169,7 @@ namespace TDMS {
             throw std::invalid_argument("[ERROR] Interleaved raw data not implemented!");
 
 
-        auto rawVector = metadata->RawData.DataType.GetRawVector();
-        if (rawVector.size() == 0) {
+        if (metadata->RawData.DataType.GetRawCount() == 0) {
             // Write INDEX of raw header
             int32_t raw_index = -1;
             m_fileStream->write(reinterpret_cast<char *>(&raw_index), sizeof(raw_index));
@@ -8,7 +8,14 @@
 
 #include "rpsa/common/core/file_async_writer.h"
 #include "rpsa/common/core/File.h"
+#include "rpsa/common/core/MappedReader.h"
+#include "rpsa/common/core/neon_asm.h"
 #include <ctime>
+#include <fcntl.h>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <limits>
 
 #ifndef _WIN32
 #include <sys/statvfs.h>
@@ -28,13 +35,54 @@ std::string DirNameOf(const std::string& fname)
 }
 
 FileQueueManager::FileQueueManager():Queue(){
+    m_fd = -1;
+    th = nullptr;
     m_threadWork = false;
     m_waitAllWrite = false;    
     m_hasErrorWrite = false;
+    m_hasWriteSize = 0;
+    m_writeBehindDepth = FILE_WRITE_BEHIND_DEFAULT_DEPTH;
+    m_fileOffset = 0;
+    m_writeBehindIssued = 0;
+    m_memoryBudget = 0;
+    m_tdmsBlock = nullptr;
+    m_tdmsSegmentSize = FILE_TDMS_SEGMENT_DEFAULT_KB * 1024;
+    m_tdmsLayoutValid = false;
+    m_tdmsSizeCh1 = 0;
+    m_tdmsSizeCh2 = 0;
+    m_tdmsDataType = 0;
+    m_tdmsInterleaved = false;
+    m_tdmsCapturePending = false;
+    m_tdmsVolts = false;
+    m_tdmsIndex = true;
+    m_indexFd = -1;
+    m_rawBlock = nullptr;
+    m_rawFilled = 0;
+    m_rawLayoutValid = false;
+    m_rawResolution = 0;
+    m_rawChannels = 0;
+    m_rawBlockSamples = 0;
+    m_rawNext = 0;
+    m_rotateBytes = 0;
+    m_rotateSeconds = 0;
+    m_rotateQueued = 0;
+    m_rotateRequest = false;
+    m_rotateWait = false;
+    m_filePart = 0;
+    m_prepareThread = nullptr;
+    m_nextFd = -1;
+    m_preallocSize = 0;
 }
 
 FileQueueManager::~FileQueueManager(){
     this->StopWrite(false);
+    CloseFile();
+    delete m_tdmsBlock;
+    delete m_rawBlock;
+    for(auto block : m_freeBlocks){
+        delete block;
+    }
+    m_freeBlocks.clear();
 }
 
 unsigned long long getTotalSystemMemory()
@@ -81,19 +129,54 @@ int FileQueueManager::AvailableSpace(std::string dst, ulong* availableSize) {
 #endif
 }
 
-bool FileQueueManager::AddBufferToWrite(std::iostream *buffer){
+bool FileQueueManager::AddBufferToWrite(CFileBlock *buffer){
 
  //   acout() << m_useMemory  << "\n";
-    if (m_threadWork && (m_useMemory < m_aviablePhyMemory)){
-        pushQueue(buffer);
+    if (buffer == nullptr)
+        return false;
+    if (m_threadWork && pushQueue(buffer)){
         return true;
     }
     else{
-        delete buffer;
+        // The next block starts the next file instead
+        if (buffer->newFile())
+            m_rotateRequest = true;
+        ReleaseBlock(buffer);
         return false;
     }
 }
 
+CFileBlock *FileQueueManager::AcquireBlock(size_t _size){
+    CFileBlock *block = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_blocksLock);
+        if (!m_freeBlocks.empty()){
+            block = m_freeBlocks.back();
+            m_freeBlocks.pop_back();
+        }
+    }
+    if (block == nullptr){
+        block = new CFileBlock(std::max<size_t>(_size, FILE_BLOCK_SIZE));
+    }
+    block->clear();
+    if (!block->reserve(_size)){
+        delete block;
+        return nullptr;
+    }
+    return block;
+}
+
+void FileQueueManager::ReleaseBlock(CFileBlock *_block){
+    if (_block == nullptr)
+        return;
+    std::lock_guard<std::mutex> lock(m_blocksLock);
+    if (m_freeBlocks.size() < FILE_BLOCK_POOL_SIZE){
+        m_freeBlocks.push_back(_block);
+    }else{
+        delete _block;
+    }
+}
+
 ulong FileQueueManager::GetFreeSpaceDisk(std::string _filePath){
 
     ulong m_freeSize = 0;
@@ -120,13 +203,16 @@ ulong FileQueueManager::GetFreeSpaceDisk(std::string _filePath){
 }
 
 void FileQueueManager::OpenFile(std::string FileName,bool Append){
-    fs.open(FileName, std::ios::binary | std::ofstream::out| std::ofstream::in | (Append? std::ofstream::binary  : std::ofstream::trunc));
-    if (fs.fail()) {
-        fs.open(FileName, std::ios::binary | std::ofstream::out| std::ofstream::in |  std::ofstream::trunc);
-        if (fs.fail()) {
-            std::cout << "File " << FileName << " not exist" << std::endl;
-            return;
-        }
+    CloseFile();
+    int flags = O_RDWR | O_CREAT | (Append ? O_APPEND : O_TRUNC);
+#ifdef _WIN32
+    flags |= O_BINARY;
+#endif
+    m_fd = open(FileName.c_str(), flags, 0666);
+    m_fileName = FileName;
+    if (m_fd < 0) {
+        std::cout << "File " << FileName << " not exist" << std::endl;
+        return;
     }
 
     auto dirName = DirNameOf(FileName);
@@ -135,16 +221,30 @@ void FileQueueManager::OpenFile(std::string FileName,bool Append){
     }
 
     m_freeSize = GetFreeSpaceDisk(dirName);
-    m_aviablePhyMemory = getTotalSystemMemory();
-    std::cout << "Available physical memory: " << m_aviablePhyMemory / (1024 * 1024) << "Mb\n";
-    m_aviablePhyMemory /= 2;
-    std::cout << "Used physical memory: " << m_aviablePhyMemory / (1024 * 1024) << "Mb\n";
+    unsigned long long budget = m_memoryBudget;
+    if (budget == 0){
+        budget = getTotalSystemMemory();
+        std::cout << "Available physical memory: " << budget / (1024 * 1024) << "Mb\n";
+        budget /= 2;
+    }
+    std::cout << "Used physical memory: " << budget / (1024 * 1024) << "Mb\n";
+    setWatermarks(budget, budget / 100 * FILE_QUEUE_LOW_WATERMARK_PERCENT);
     m_hasWriteSize = 0;
+    auto end = lseek(m_fd, 0, SEEK_END);
+    m_fileOffset = end > 0 ? end : 0;
+    m_writeBehindIssued = m_fileOffset - m_fileOffset % FILE_WRITE_BEHIND_WINDOW;
 }
 
 void FileQueueManager::CloseFile(){
-    if (fs.is_open())
-        fs.close();
+    CloseIndex(false);
+    DropNextFile();
+    if (m_fd >= 0){
+        // Releases preallocated space and a block cut short by a failed write
+        if (ftruncate(m_fd, m_fileOffset) != 0)
+            std::cout << "Can't truncate " << m_fileName << std::endl;
+        close(m_fd);
+        m_fd = -1;
+    }
 }
 
 void FileQueueManager::StartWrite(Stream_FileType _fileType){
@@ -154,23 +254,67 @@ void FileQueueManager::StartWrite(Stream_FileType _fileType){
     m_firstSectionWrite = false;
     m_waitAllWrite = true;
     m_hasErrorWrite = false;
+    clearInterrupt();
+    resetQueuePeaks();
     
     // Clean before start
+    {
+        std::lock_guard<std::mutex> lock(m_tdmsLock);
+        ReleaseBlock(m_tdmsBlock);
+        m_tdmsBlock = nullptr;
+        m_tdmsLayoutValid = false;
+        m_tdmsCapturePending = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_rawLock);
+        ReleaseBlock(m_rawBlock);
+        m_rawBlock = nullptr;
+        m_rawLayoutValid = false;
+    }
+    m_rawIndex.clear();
+    if (m_fileType == Stream_FileType::TDMS_TYPE && m_tdmsIndex && m_fd >= 0){
+        OpenIndex();
+    }else{
+        CloseIndex(false);
+    }
+    m_rotateQueued = 0;
+    m_rotateStart = std::chrono::steady_clock::now();
+    m_rotateRequest = false;
+    m_rotateWait = false;
+    if (RotationEnabled() && m_fd >= 0 && m_prepareThread == nullptr && m_nextFd < 0){
+        m_baseName = m_fileName;
+        m_filePart = 0;
+        m_preallocSize = m_rotateBytes > 0 ? m_rotateBytes : FILE_ROTATE_PREALLOC_DEFAULT;
+#ifdef __linux__
+        fallocate(m_fd, FALLOC_FL_KEEP_SIZE, m_fileOffset, m_preallocSize);
+#endif
+        PrepareNextFile();
+    }
     auto bstream_clean = popQueue();
     while(bstream_clean){
-        delete bstream_clean;
+        ReleaseBlock(bstream_clean);
         bstream_clean = popQueue();
     }
 
+    {
+        std::lock_guard<std::mutex> lock(m_blocksLock);
+        while(m_freeBlocks.size() < FILE_BLOCK_POOL_SIZE){
+            m_freeBlocks.push_back(new CFileBlock(FILE_BLOCK_SIZE));
+        }
+    }
+
     th = new std::thread(&FileQueueManager::Task,this);
 }
 
 void FileQueueManager::StopWrite(bool waitAllWrite){
     if (m_threadWork) {
+        FlushTDMS();
+        FlushRaw();
         m_waitLock.lock();
         m_waitAllWrite = waitAllWrite;
         m_waitLock.unlock();
         m_ThreadRun.clear();
+        interruptWait();
     }
     if (th != nullptr) {
         if (th->joinable())
@@ -180,9 +324,171 @@ void FileQueueManager::StopWrite(bool waitAllWrite){
     }
 }
 
+void FileQueueManager::SetThreadSched(const ThreadSchedT &_sched){
+    m_threadSched = _sched;
+}
+
+void FileQueueManager::SetWriteBehind(int _depth){
+    m_writeBehindDepth = std::min(std::max(_depth, 0), FILE_WRITE_BEHIND_MAX_DEPTH);
+}
+
+void FileQueueManager::SetMemoryBudget(unsigned long long _bytes){
+    m_memoryBudget = _bytes;
+}
+
+void FileQueueManager::SetTDMSSegmentSize(size_t _bytes){
+    m_tdmsSegmentSize = std::min<size_t>(_bytes, FILE_TDMS_SEGMENT_MAX_KB * 1024);
+}
+
+void FileQueueManager::SetTDMSInterleaved(bool _enable){
+    m_tdmsInterleaved = _enable;
+}
+
+void FileQueueManager::SetTDMSIndex(bool _enable){
+    m_tdmsIndex = _enable;
+}
+
+void FileQueueManager::SetTDMSCalibration(const CalibrationT &_calibration, bool _volts){
+    m_tdmsCalibration = _calibration;
+    m_tdmsVolts = _volts && _calibration.valid;
+}
+
+// Segments appended to a file that already has data are only added to an
+// index that exists, a new one would not describe the segments before them.
+void FileQueueManager::OpenIndex(){
+    if (m_indexFd >= 0)
+        return;
+    m_indexName = TDMS::MappedReader::IndexName(m_fileName);
+    int flags = O_WRONLY | (m_fileOffset == 0 ? O_CREAT | O_TRUNC : O_APPEND);
+#ifdef _WIN32
+    flags |= O_BINARY;
+#endif
+    m_indexFd = open(m_indexName.c_str(), flags, 0666);
+    if (m_indexFd < 0) {
+        std::cout << "Can't open TDMS index " << m_indexName << std::endl;
+    }
+}
+
+void FileQueueManager::CloseIndex(bool remove){
+    if (m_indexFd >= 0){
+        close(m_indexFd);
+        m_indexFd = -1;
+        if (remove)
+            unlink(m_indexName.c_str());
+    }
+}
+
+void FileQueueManager::SetRotation(uint64_t _bytes, int _seconds){
+    m_rotateBytes = _bytes;
+    m_rotateSeconds = std::max(_seconds, 0);
+}
+
+bool FileQueueManager::CheckRotation(size_t _size){
+    if (!RotationEnabled())
+        return false;
+    auto now = std::chrono::steady_clock::now();
+    bool rotate = m_rotateRequest.exchange(false);
+    if (m_rotateQueued > 0){
+        if (m_rotateBytes > 0 && m_rotateQueued + _size > m_rotateBytes)
+            rotate = true;
+        if (m_rotateSeconds > 0 && now - m_rotateStart >= std::chrono::seconds(m_rotateSeconds))
+            rotate = true;
+    }
+    if (rotate){
+        m_rotateQueued = 0;
+        m_rotateStart = now;
+    }
+    m_rotateQueued += _size;
+    return rotate;
+}
+
+// data_file_x.tdms -> data_file_x_001.tdms
+std::string FileQueueManager::PartName(int _part){
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%03d", _part);
+    size_t dot = m_baseName.find_last_of('.');
+    size_t slash = m_baseName.find_last_of("\\/");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return m_baseName + suffix;
+    return m_baseName.substr(0, dot) + suffix + m_baseName.substr(dot);
+}
+
+// Creating and allocating a file takes metadata updates the writer should not
+// wait for, the next file is made ready while the current one is written
+void FileQueueManager::PrepareNextFile(){
+    m_nextName = PartName(++m_filePart);
+    std::string name = m_nextName;
+    uint64_t size = m_preallocSize;
+    m_prepareThread = new std::thread([this, name, size](){
+        int flags = O_RDWR | O_CREAT | O_TRUNC;
+#ifdef _WIN32
+        flags |= O_BINARY;
+#endif
+        int fd = open(name.c_str(), flags, 0666);
+#ifdef __linux__
+        if (fd >= 0 && size > 0)
+            fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size);
+#endif
+        m_nextFd = fd;
+    });
+}
+
+void FileQueueManager::DropNextFile(){
+    if (m_prepareThread != nullptr){
+        if (m_prepareThread->joinable())
+            m_prepareThread->join();
+        delete m_prepareThread;
+        m_prepareThread = nullptr;
+    }
+    if (m_nextFd >= 0){
+        close(m_nextFd);
+        m_nextFd = -1;
+        unlink(m_nextName.c_str());
+    }
+}
+
+// Runs on the writer thread at a block that starts the next file
+bool FileQueueManager::RotateFile(){
+    if (m_fileOffset == 0)
+        return true;
+    if (m_prepareThread != nullptr){
+        if (m_prepareThread->joinable())
+            m_prepareThread->join();
+        delete m_prepareThread;
+        m_prepareThread = nullptr;
+    }
+    int fd = m_nextFd;
+    m_nextFd = -1;
+    if (fd < 0){
+        acout() << "Can't create " << m_nextName << "\n";
+        return false;
+    }
+    CloseIndex(false);
+    FinishRawFile();
+    if (ftruncate(m_fd, m_fileOffset) != 0)
+        acout() << "Can't truncate " << m_fileName << "\n";
+    close(m_fd);
+    if (m_rotateBytes == 0)
+        m_preallocSize = std::max<uint64_t>(m_fileOffset, FILE_ROTATE_PREALLOC_DEFAULT);
+    m_fd = fd;
+    m_fileName = m_nextName;
+    m_fileOffset = 0;
+    m_writeBehindIssued = 0;
+    m_firstSectionWrite = false;
+    if (m_fileType == Stream_FileType::TDMS_TYPE && m_tdmsIndex)
+        OpenIndex();
+    PrepareNextFile();
+    acout() << "Next file " << m_fileName << "\n";
+    return true;
+}
+
 void FileQueueManager::Task(){
+    SetCurrentThreadSched(m_threadSched, "File writer");
     while (m_ThreadRun.test_and_set()){
-        WriteToFile();
+        // Sleep until a buffer is queued or StopWrite() wakes us up
+        if (waitQueue(100)){
+            WriteToFile();
+        }
     }
     m_waitLock.lock();
     if (this->m_waitAllWrite) {
@@ -190,15 +496,47 @@ void FileQueueManager::Task(){
     }else{
         auto bstream = popQueue();
         while(bstream){
-            delete bstream;
+            ReleaseBlock(bstream);
             bstream = popQueue();
         }
     }
+    FinishRawFile();
     m_threadWork = false;
     m_waitLock.unlock();
 }
 
 
+static bool WriteAll(int fd, const uint8_t *data, size_t left){
+    while (left > 0){
+        auto ret = write(fd, data, left);
+        if (ret < 0){
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += ret;
+        left -= ret;
+    }
+    return true;
+}
+
+bool FileQueueManager::WriteBlock(CFileBlock *block){
+    return WriteAll(m_fd, block->data(), block->size());
+}
+
+// The index entry of a segment is its lead-in, tagged "TDSh", and metadata.
+// It is added only once the segment is in the file, so the index never points
+// past the data. An index that can't be written is removed, readers then walk
+// the file itself.
+void FileQueueManager::WriteIndex(CFileBlock *block){
+    m_indexEntry.assign(block->data(), block->data() + block->headerSize());
+    memcpy(m_indexEntry.data(), "TDSh", 4);
+    if (!WriteAll(m_indexFd, m_indexEntry.data(), m_indexEntry.size())){
+        acout() << "Can't write TDMS index, it is removed\n";
+        CloseIndex(true);
+    }
+}
+
 int FileQueueManager::WriteToFile(){
     auto bstream = popQueue();
         
@@ -206,17 +544,53 @@ int FileQueueManager::WriteToFile(){
         return -1;
 
     if (m_hasErrorWrite) {
-        delete bstream;
+        ReleaseBlock(bstream);
         return 1;
     }
 
-    if (fs.good() && m_hasWriteSize < m_freeSize) {
+    if (bstream->newFile()){
+        m_rotateWait = false;
+        if (m_fd >= 0 && !RotateFile()){
+            m_hasErrorWrite = true;
+            ReleaseBlock(bstream);
+            return 1;
+        }
+    }else if (m_rotateWait){
+        // The rest of a file that failed, the data continues in the next one
+        ReleaseBlock(bstream);
+        return 0;
+    }
+
+    if (m_fd >= 0 && m_hasWriteSize < m_freeSize && WriteBlock(bstream)) {
         
-        fs << bstream->rdbuf();
-        fs.flush();
-        bstream->seekg(0, std::ios::end);
-        auto Length = bstream->tellg();
+        auto Length = bstream->size();
         m_hasWriteSize += Length;
+        m_fileOffset += Length;
+        WriteBehind();
+
+        if (m_indexFd >= 0 && bstream->headerSize() >= 28){
+            WriteIndex(bstream);
+        }
+
+        if (m_fileType == Stream_FileType::RAW_TYPE && bstream->samples() > 0){
+            // Blocks refused by the queue show up as a jump in the sample index
+            uint32_t flags = 0;
+            size_t entries = m_rawIndex.size();
+            if (entries > 0){
+                uint64_t first;
+                uint32_t samples;
+                memcpy(&first, m_rawIndex.data() + entries - 16, sizeof(first));
+                memcpy(&samples, m_rawIndex.data() + entries - 8, sizeof(samples));
+                if (first + samples != bstream->firstSample())
+                    flags |= FILE_RAW_GAP;
+            }
+            uint64_t first = bstream->firstSample();
+            uint32_t samples = bstream->samples();
+            m_rawIndex.resize(entries + 16);
+            memcpy(m_rawIndex.data() + entries, &first, sizeof(first));
+            memcpy(m_rawIndex.data() + entries + 8, &samples, sizeof(samples));
+            memcpy(m_rawIndex.data() + entries + 12, &flags, sizeof(flags));
+        }
 
         if (m_fileType == Stream_FileType::WAV_TYPE){
             if (m_firstSectionWrite){
@@ -229,6 +603,18 @@ int FileQueueManager::WriteToFile(){
         }
 
     } else{
+        int error = errno;
+        if (m_fd >= 0 && m_hasWriteSize < m_freeSize && error != ENOSPC && RotationEnabled()){
+            // The file is cut back to its last whole block so it stays readable
+            // and the producer starts the next file with its own header
+            acout() << "Write error in " << m_fileName << ", continuing in the next file\n";
+            if (ftruncate(m_fd, m_fileOffset) != 0 || lseek(m_fd, m_fileOffset, SEEK_SET) < 0)
+                acout() << "Can't truncate " << m_fileName << "\n";
+            m_rotateWait = true;
+            m_rotateRequest = true;
+            ReleaseBlock(bstream);
+            return 0;
+        }
 
         m_hasErrorWrite = true;
         if (!(m_hasWriteSize < m_freeSize)){
@@ -236,89 +622,493 @@ int FileQueueManager::WriteToFile(){
         }else {
             acout() << "Disk is full or error state\n";
         }
+        ReleaseBlock(bstream);
         return 1;
     }
-    delete bstream;
+    ReleaseBlock(bstream);
 
     return 0;    
 }
 
+// Bounded write-behind: writeback of every filled window is started right away
+// and the window m_writeBehindDepth windows back is waited for and dropped from
+// the page cache. The device then sees a steady sequential stream instead of
+// large dirty-page flushes, and the cache does not grow for the whole stream.
+// The first window holds the WAV/TDMS header which is patched while writing,
+// it stays cached.
+void FileQueueManager::WriteBehind(){
+#ifdef __linux__
+    if (m_writeBehindDepth <= 0)
+        return;
+    while (m_fileOffset - m_writeBehindIssued >= FILE_WRITE_BEHIND_WINDOW){
+        sync_file_range(m_fd, m_writeBehindIssued, FILE_WRITE_BEHIND_WINDOW, SYNC_FILE_RANGE_WRITE);
+        m_writeBehindIssued += FILE_WRITE_BEHIND_WINDOW;
+        uint64_t lag = (uint64_t)FILE_WRITE_BEHIND_WINDOW * (m_writeBehindDepth + 1);
+        if (m_writeBehindIssued >= lag){
+            uint64_t offset = m_writeBehindIssued - lag;
+            sync_file_range(m_fd, offset, FILE_WRITE_BEHIND_WINDOW,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            if (offset != 0)
+                posix_fadvise(m_fd, offset, FILE_WRITE_BEHIND_WINDOW, POSIX_FADV_DONTNEED);
+        }
+    }
+#endif
+}
+
 void FileQueueManager::updateWavFile(int _size){
     int offset1 = 4;
     int offset2 = 40;
-   
-    auto cur_p = fs.tellp();
-    auto cur_g = fs.tellg();
 
     int32_t size1 = 0;
     int32_t size2 = 0;
-    fs.seekg(offset1, fs.beg);
-    fs.read ((char*)&size1, sizeof(size1));
-    size1 += _size;
-    fs.seekp(offset1, fs.beg);
-    fs.write((char*)&size1, sizeof(size1));
-    fs.seekg(offset2, fs.beg);
-    fs.read ((char*)&size2, sizeof(size2));
-    size2 += _size;
-    fs.seekp(offset2, fs.beg);
-    fs.write((char*)&size2, sizeof(size2));
-
- 
-    fs.seekp(cur_p);
-    fs.seekg(cur_g);
-}
-
-std::iostream *FileQueueManager::BuildTDMSStream(uint8_t* buffer_ch1,size_t size_ch1,uint8_t* buffer_ch2,size_t size_ch2, unsigned short resolution){
-    TDMS::File outFile;
-    TDMS::WriterSegment segment;
-    vector<shared_ptr<TDMS::Metadata>> data;
-//    std::time_t tim_sec = std::time(0);
- //   std::time_t local = std::mktime(std::localtime(&tim_sec));
- //   std::time_t gmt = std::mktime(std::gmtime(&tim_sec));
- //   auto timezone = static_cast<long> (local - gmt);
-
-    auto root = segment.GenerateRoot();
-    root->TableOfContents.HasMetaData = true;
-    root->TableOfContents.HasRawData = true;
-    data.push_back(root);
-    auto group = segment.GenerateGroup("Group");
-    data.push_back(group);
-
-//    auto *time = TDMS::DataType::GetRawTimeValue(tim_sec + timezone);
-//    TDMS::DataType dataprop;
-//    dataprop.InitDataType(TDMS::DataType::TimeStamp,time);
-//    segment.AddProperties(root,"time_stamp_now",dataprop);
+    lseek(m_fd, offset1, SEEK_SET);
+    if (read(m_fd, &size1, sizeof(size1)) == sizeof(size1)){
+        size1 += _size;
+        lseek(m_fd, offset1, SEEK_SET);
+        write(m_fd, &size1, sizeof(size1));
+    }
+    lseek(m_fd, offset2, SEEK_SET);
+    if (read(m_fd, &size2, sizeof(size2)) == sizeof(size2)){
+        size2 += _size;
+        lseek(m_fd, offset2, SEEK_SET);
+        write(m_fd, &size2, sizeof(size2));
+    }
+    lseek(m_fd, 0, SEEK_END);
+}
 
+// Writes one TDMS segment (lead-in, metadata, raw data) into the block. The
+// layout matches what TDMS::Writer produces for a group with one or two channels.
+// A segment that follows lost samples carries the group properties
+// "sample_index" (first sample of the segment) and "gap_samples". The first
+// segment of a triggered capture carries "sample_index", "trigger_sample",
+// "trigger_time", "trigger_channel", "pre_samples" and "post_samples".
+// With a calibration the channels carry "calib_scale" and "calib_offset",
+// volts = (sample - calib_offset) * calib_scale for the integer samples. Float
+// samples in volts carry those of the 16-bit words they were converted from
+// and "unit_string" "V".
+// While the channels keep their sizes and type, the segment has no metadata,
+// readers take the previous segment's, and the lead-in is all it adds.
+// Interleaved segments store two channels of the same size sample by sample.
+void FileQueueManager::BuildTDMSBlock(CFileBlock *block,const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2, unsigned short resolution, uint64_t sample_index, uint64_t gap_samples){
+    const std::string group = "/'Group'";
+    const std::string path_ch1 = "/'Group'/'ch1'";
+    const std::string path_ch2 = "/'Group'/'ch2'";
+    // Packed 12 and 14 bit samples reach the writer already expanded to 16-bit words,
+    // 32 are the float outputs of the lock-in
+    const int32_t data_type = (resolution == 8 ? TDMS::DataType::Integer8 : resolution == 32 ? TDMS::DataType::SingleFloat : TDMS::DataType::Integer16);
+    const size_t sample_size = (resolution == 8 ? 1 : resolution == 32 ? 4 : 2);
+    const size_t lead_in = 28;
+    const bool interleaved = m_tdmsInterleaved && size_ch1 != 0 && size_ch1 == size_ch2;
+    const bool capture = m_tdmsCapturePending;
+    const bool raw_only = m_tdmsLayoutValid && gap_samples == 0 && !capture && size_ch1 == m_tdmsSizeCh1
+                          && size_ch2 == m_tdmsSizeCh2 && data_type == m_tdmsDataType;
+    m_tdmsCapturePending = false;
 
-    if (size_ch1 != 0)
-    {       
-        if (resolution == 16)
-            size_ch1 /= 2;
-        auto channel = segment.GenerateChannel("Group", "ch1");
-        data.push_back(channel);
-        segment.AddRaw(channel, (resolution == 8 ? TDMS::DataType::Integer8 : TDMS::DataType::Integer16), size_ch1 , buffer_ch1);
+    m_tdmsLayoutValid = true;
+    m_tdmsSizeCh1 = size_ch1;
+    m_tdmsSizeCh2 = size_ch2;
+    m_tdmsDataType = data_type;
+
+    block->reserve(block->size() + lead_in + 384 + size_ch1 + size_ch2);
+    size_t begin = block->size();
+
+    // Lead in
+    block->append("TDSm",4);
+    block->appendInt32((raw_only ? 0 : 1 << 1) | (1 << 3) | (interleaved ? 1 << 5 : 0)); // [HasMetaData |] HasRawData [| RawDataIsInterleaved]
+    block->appendInt32(4713);
+    block->appendInt64(-1); // next segment offset, patched below
+    block->appendInt64(0);  // raw data offset, patched below
+
+    if (!raw_only){
+        // Metadata
+        int32_t objects = 1 + (size_ch1 != 0 ? 1 : 0) + (size_ch2 != 0 ? 1 : 0);
+        block->appendInt32(objects);
+        block->appendInt32(group.size());
+        block->append(group.data(),group.size());
+        block->appendInt32(-1); // No raw data for group
+        auto addName = [&](const std::string &name, int32_t type){
+            block->appendInt32(name.size());
+            block->append(name.data(),name.size());
+            block->appendInt32(type);
+        };
+        auto addProperty = [&](const std::string &name, uint64_t value){
+            addName(name, TDMS::DataType::UnsignedInteger64);
+            block->appendInt64((int64_t)value);
+        };
+        block->appendInt32((gap_samples != 0 || capture ? 1 : 0) + (gap_samples != 0 ? 1 : 0) + (capture ? 5 : 0)); // Property count
+        if (gap_samples != 0 || capture)
+            addProperty("sample_index", sample_index);
+        if (gap_samples != 0)
+            addProperty("gap_samples", gap_samples);
+        if (capture){
+            // TDMS time stamps count 2^-64 s fractions and seconds since 1904-01-01 UTC
+            const int64_t epoch_1904 = 2082844800;
+            auto since = m_tdmsCapture.triggerTime.time_since_epoch();
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since);
+            auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(since - seconds).count();
+            addProperty("trigger_sample", m_tdmsCapture.triggerSample);
+            addName("trigger_time", TDMS::DataType::TimeStamp);
+            block->appendInt64((int64_t)(uint64_t)(nanos * 18446744073.709551616)); // 2^64 / 10^9
+            block->appendInt64(seconds.count() + epoch_1904);
+            addProperty("trigger_channel", m_tdmsCapture.channel);
+            addProperty("pre_samples", m_tdmsCapture.preSamples);
+            addProperty("post_samples", m_tdmsCapture.postSamples);
+        }
+
+        // The lock-in floats are no ADC samples
+        const bool calibrated = m_tdmsCalibration.valid && (resolution != 32 || m_tdmsVolts);
+        // 8-bit samples are the high bytes of the words
+        const double word_scale = resolution == 8 ? 256.0 : 1.0;
+        auto addDouble = [&](const std::string &name, double value){
+            addName(name, TDMS::DataType::DoubleFloat);
+            block->append(&value, sizeof(value));
+        };
+        auto addChannel = [&](const std::string &path, size_t size, int channel){
+            block->appendInt32(path.size());
+            block->append(path.data(),path.size());
+            block->appendInt32(20);
+            block->appendInt32(data_type);
+            block->appendInt32(1);
+            block->appendInt64(size / sample_size);
+            block->appendInt32(calibrated ? (m_tdmsVolts && resolution == 32 ? 3 : 2) : 0);
+            if (calibrated){
+                addDouble("calib_scale", m_tdmsCalibration.scale[channel] * word_scale);
+                addDouble("calib_offset", m_tdmsCalibration.offset[channel] / word_scale);
+                if (m_tdmsVolts && resolution == 32){
+                    const std::string unit = "V";
+                    addName("unit_string", TDMS::DataType::String);
+                    block->appendInt32(unit.size());
+                    block->append(unit.data(), unit.size());
+                }
+            }
+        };
+
+        if (size_ch1 != 0)
+            addChannel(path_ch1, size_ch1, 0);
+        if (size_ch2 != 0)
+            addChannel(path_ch2, size_ch2, 1);
     }
 
+    int64_t raw_offset = block->size() - begin - lead_in;
+
+    // The block holds this one segment, its header goes to the index
+    block->setHeaderSize(begin + lead_in + raw_offset);
+
+    AppendTDMSRaw(block, buffer_ch1, size_ch1, buffer_ch2, size_ch2, sample_size);
+
+    int64_t next_segment = block->size() - begin - lead_in;
+    memcpy(block->data() + begin + 12, &next_segment, sizeof(next_segment));
+    memcpy(block->data() + begin + 20, &raw_offset, sizeof(raw_offset));
+}
+
+// One chunk of raw data, interleaved when the writer is set up for it and
+// both channels are present
+void FileQueueManager::AppendTDMSRaw(CFileBlock *block,const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,size_t sample_size){
+    if (m_tdmsInterleaved && size_ch1 != 0 && size_ch1 == size_ch2){
+        if (!block->reserve(block->size() + size_ch1 + size_ch2))
+            return;
+        if (sample_size == 1)
+            memcpy_interleave_8bit_neon(block->tail(), buffer_ch1, buffer_ch2, size_ch1);
+        else if (sample_size == 2)
+            memcpy_interleave_16bit_neon(block->tail(), buffer_ch1, buffer_ch2, size_ch1);
+        else
+            memcpy_interleave_32bit_neon(block->tail(), buffer_ch1, buffer_ch2, size_ch1);
+        block->commit(size_ch1 + size_ch2);
+        return;
+    }
+    if (size_ch1 != 0)
+        block->append(buffer_ch1, size_ch1);
     if (size_ch2 != 0)
-    {       
-        if (resolution == 16)
-            size_ch2 /= 2;
-        auto channel = segment.GenerateChannel("Group", "ch2");
-        data.push_back(channel);
-        segment.AddRaw(channel, (resolution == 8 ? TDMS::DataType::Integer8 : TDMS::DataType::Integer16), size_ch2 , buffer_ch2);
+        block->append(buffer_ch2, size_ch2);
+}
+
+// Adds the buffers to the TDMS segment being filled as one more chunk, or
+// starts a new segment when the layout changed, samples were lost or the
+// segment is full. Segments go to the queue once full, or at FlushTDMS().
+bool FileQueueManager::AddTDMSData(const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution,uint64_t sample_index,uint64_t gap_samples){
+    const int32_t data_type = (resolution == 8 ? TDMS::DataType::Integer8 : resolution == 32 ? TDMS::DataType::SingleFloat : TDMS::DataType::Integer16);
+    const size_t sample_size = (resolution == 8 ? 1 : resolution == 32 ? 4 : 2);
+    const size_t size = size_ch1 + size_ch2;
+    std::lock_guard<std::mutex> lock(m_tdmsLock);
+    const bool new_file = CheckRotation(size);
+
+    if (new_file){
+        // Every file starts with a segment that carries the metadata
+        FlushTDMSLocked();
+        m_tdmsLayoutValid = false;
     }
 
-    segment.LoadMetadata(data);
-    stringstream *memory = new stringstream(ios_base::in | ios_base::out | ios_base::binary);
-    outFile.WriteMemory(*memory,segment);
-    return memory;
+    if (m_tdmsBlock != nullptr){
+        if (gap_samples == 0 && size_ch1 == m_tdmsSizeCh1 && size_ch2 == m_tdmsSizeCh2 && data_type == m_tdmsDataType
+            && m_tdmsBlock->size() + size <= m_tdmsSegmentSize){
+            AppendTDMSRaw(m_tdmsBlock, buffer_ch1, size_ch1, buffer_ch2, size_ch2, sample_size);
+            int64_t next_segment = m_tdmsBlock->size() - 28;
+            memcpy(m_tdmsBlock->data() + 12, &next_segment, sizeof(next_segment));
+            return true;
+        }
+        FlushTDMSLocked();
+    }
+
+    auto block = AcquireBlock(std::max(m_tdmsSegmentSize, size + FILE_BLOCK_HEADER_RESERVE));
+    if (block == nullptr)
+        return false;
+    BuildTDMSBlock(block, buffer_ch1, size_ch1, buffer_ch2, size_ch2, resolution, sample_index, gap_samples);
+    block->setNewFile(new_file);
+    if (block->size() + size > m_tdmsSegmentSize){
+        if (!AddBufferToWrite(block)){
+            // the metadata may have been in the dropped segment
+            m_tdmsLayoutValid = false;
+            return false;
+        }
+        return true;
+    }
+    m_tdmsBlock = block;
+    return true;
+}
+
+void FileQueueManager::FlushTDMSLocked(){
+    if (m_tdmsBlock != nullptr){
+        if (!AddBufferToWrite(m_tdmsBlock))
+            m_tdmsLayoutValid = false;
+        m_tdmsBlock = nullptr;
+    }
+}
+
+void FileQueueManager::StartTDMSCapture(const TDMSCaptureT &_capture){
+    std::lock_guard<std::mutex> lock(m_tdmsLock);
+    FlushTDMSLocked();
+    m_tdmsCapture = _capture;
+    m_tdmsCapturePending = true;
+}
+
+void FileQueueManager::FlushTDMS(){
+    std::lock_guard<std::mutex> lock(m_tdmsLock);
+    FlushTDMSLocked();
+}
+
+// Raw recording, for readers that map the file instead of parsing it.
+// Little endian throughout:
+//
+//   Header, FILE_RAW_HEADER_SIZE bytes
+//     0  char[8]   FILE_RAW_MAGIC
+//     8  uint32    FILE_RAW_VERSION
+//    12  uint32    header size, the offset of the first block
+//    16  uint32    resolution, 8, 16 or 32 for the float outputs
+//    20  uint32    bytes per sample
+//    24  char[8]   NumPy dtype of a sample, "<i1", "<i2" or "<f4"
+//    32  uint32    channels present, 1 - ch1, 2 - ch2, 3 - both
+//    36  uint32    channel count
+//    40  uint32    1 when two channels are interleaved sample by sample
+//    44  uint32    samples per channel in a block
+//    48  uint64    bytes per block, a multiple of the page size
+//    56  uint64    decimation of the 125 MHz ADC clock
+//    64  uint64    sample index of the first sample
+//    72  uint64    block count, 0 while recording
+//    80  uint64    offset of the index, 0 while recording
+//    88  double[2] calibration scale per channel
+//   104  double[2] calibration offset per channel, volts = (sample - offset) * scale
+//   120  uint32    1 - calibration valid, 2 - the float samples are volts
+//
+//   Blocks, each of the same size. Planar blocks hold the samples of one
+//   channel after the other, interleaved ones ch1 ch2 ch1 ... Samples past
+//   the count in the index are zeros.
+//
+//   Index, 16 bytes per block: uint64 first sample index, uint32 samples
+//   per channel, uint32 flags (FILE_RAW_GAP).
+//
+// The blocks are np.memmap(path, dtype, offset=header, shape=(blocks,
+// channels, samples)), or (blocks, samples, channels) interleaved. A file
+// without index, cut short by a power loss, is read as whole blocks.
+// Buffers with another resolution or channel set than the file are refused.
+bool FileQueueManager::AddRawData(const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution,uint64_t sample_index,uint32_t osc_rate){
+    const size_t sample_size = (resolution == 8 ? 1 : resolution == 32 ? 4 : 2);
+    const uint32_t channels = (size_ch1 != 0 ? 1 : 0) | (size_ch2 != 0 ? 2 : 0);
+    if (channels == 0)
+        return true;
+    if (channels == 3 && size_ch1 != size_ch2)
+        return false;
+    const size_t samples = std::max(size_ch1, size_ch2) / sample_size;
+    std::lock_guard<std::mutex> lock(m_rawLock);
+    const bool new_file = CheckRotation(size_ch1 + size_ch2);
+
+    if (!new_file && m_rawLayoutValid && (resolution != m_rawResolution || channels != m_rawChannels))
+        return false;
+
+    if (new_file || !m_rawLayoutValid){
+        FlushRawLocked();
+        m_rawResolution = resolution;
+        m_rawChannels = channels;
+        m_rawBlockSamples = FILE_RAW_BLOCK_KB * 1024 / sample_size;
+        m_rawLayoutValid = QueueRawHeader(osc_rate, sample_index, new_file);
+        if (!m_rawLayoutValid)
+            return false;
+        m_rawNext = sample_index;
+    }
+
+    // Every block covers consecutive samples, the index has the jumps
+    if (sample_index != m_rawNext)
+        FlushRawLocked();
+
+    const bool interleaved = m_tdmsInterleaved && channels == 3;
+    const size_t channel_bytes = m_rawBlockSamples * sample_size;
+    bool queued = true;
+    size_t done = 0;
+    while (done < samples){
+        if (m_rawBlock == nullptr){
+            m_rawBlock = AcquireBlock(channel_bytes * (channels == 3 ? 2 : 1));
+            if (m_rawBlock == nullptr)
+                return false;
+            m_rawFilled = 0;
+            m_rawBlock->setSamples(sample_index + done, 0);
+        }
+        size_t count = std::min(samples - done, m_rawBlockSamples - m_rawFilled);
+        uint8_t *data = m_rawBlock->data();
+        if (interleaved){
+            uint8_t *dst = data + m_rawFilled * sample_size * 2;
+            if (sample_size == 1)
+                memcpy_interleave_8bit_neon(dst, buffer_ch1 + done, buffer_ch2 + done, count);
+            else if (sample_size == 2)
+                memcpy_interleave_16bit_neon(dst, buffer_ch1 + done * 2, buffer_ch2 + done * 2, count * 2);
+            else
+                memcpy_interleave_32bit_neon(dst, buffer_ch1 + done * 4, buffer_ch2 + done * 4, count * 4);
+        }else{
+            size_t offset = m_rawFilled * sample_size;
+            if (size_ch1 != 0){
+                memcpy(data + offset, buffer_ch1 + done * sample_size, count * sample_size);
+                offset += channel_bytes;
+            }
+            if (size_ch2 != 0)
+                memcpy(data + offset, buffer_ch2 + done * sample_size, count * sample_size);
+        }
+        m_rawFilled += count;
+        done += count;
+        if (m_rawFilled == m_rawBlockSamples){
+            m_rawBlock->setSamples(m_rawBlock->firstSample(), m_rawFilled);
+            m_rawBlock->commit(channel_bytes * (channels == 3 ? 2 : 1));
+            queued &= AddBufferToWrite(m_rawBlock);
+            m_rawBlock = nullptr;
+        }
+    }
+    m_rawNext = sample_index + samples;
+    return queued;
+}
+
+bool FileQueueManager::QueueRawHeader(uint32_t osc_rate, uint64_t sample_index, bool new_file){
+    auto block = AcquireBlock(FILE_RAW_HEADER_SIZE);
+    if (block == nullptr)
+        return false;
+    const uint32_t sample_size = (m_rawResolution == 8 ? 1 : m_rawResolution == 32 ? 4 : 2);
+    const uint32_t count = m_rawChannels == 3 ? 2 : 1;
+    const uint32_t interleaved = m_tdmsInterleaved && m_rawChannels == 3 ? 1 : 0;
+    const uint32_t version = FILE_RAW_VERSION;
+    const uint32_t header_size = FILE_RAW_HEADER_SIZE;
+    const uint32_t resolution = m_rawResolution;
+    const uint32_t block_samples = m_rawBlockSamples;
+    const uint64_t block_bytes = (uint64_t)block_samples * sample_size * count;
+    const uint64_t rate = osc_rate;
+    char dtype[8] = {};
+    strncpy(dtype, m_rawResolution == 8 ? "<i1" : m_rawResolution == 32 ? "<f4" : "<i2", sizeof(dtype));
+    // Same meaning as the TDMS channel properties, see BuildTDMSBlock()
+    const bool calibrated = m_tdmsCalibration.valid && (m_rawResolution != 32 || m_tdmsVolts);
+    const double word_scale = m_rawResolution == 8 ? 256.0 : 1.0;
+    double scale[2] = {0, 0};
+    double offset[2] = {0, 0};
+    uint32_t calibration = 0;
+    if (calibrated){
+        for (int i = 0; i < 2; i++){
+            scale[i] = m_tdmsCalibration.scale[i] * word_scale;
+            offset[i] = m_tdmsCalibration.offset[i] / word_scale;
+        }
+        calibration = 1 | (m_tdmsVolts && m_rawResolution == 32 ? 2 : 0);
+    }
+
+    uint8_t *header = block->data();
+    memset(header, 0, FILE_RAW_HEADER_SIZE);
+    memcpy(header, FILE_RAW_MAGIC, 8);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &header_size, 4);
+    memcpy(header + 16, &resolution, 4);
+    memcpy(header + 20, &sample_size, 4);
+    memcpy(header + 24, dtype, 8);
+    memcpy(header + 32, &m_rawChannels, 4);
+    memcpy(header + 36, &count, 4);
+    memcpy(header + 40, &interleaved, 4);
+    memcpy(header + 44, &block_samples, 4);
+    memcpy(header + 48, &block_bytes, 8);
+    memcpy(header + 56, &rate, 8);
+    memcpy(header + 64, &sample_index, 8);
+    memcpy(header + 88, scale, 16);
+    memcpy(header + 104, offset, 16);
+    memcpy(header + 120, &calibration, 4);
+    block->commit(FILE_RAW_HEADER_SIZE);
+    block->setNewFile(new_file);
+    return AddBufferToWrite(block);
+}
+
+// The last block of a file or before a jump is written short, the rest of
+// it stays zero
+void FileQueueManager::FlushRawLocked(){
+    if (m_rawBlock == nullptr)
+        return;
+    if (m_rawFilled == 0){
+        ReleaseBlock(m_rawBlock);
+        m_rawBlock = nullptr;
+        return;
+    }
+    const size_t sample_size = (m_rawResolution == 8 ? 1 : m_rawResolution == 32 ? 4 : 2);
+    const size_t channel_bytes = m_rawBlockSamples * sample_size;
+    const size_t filled = m_rawFilled * sample_size;
+    uint8_t *data = m_rawBlock->data();
+    if (m_rawChannels == 3 && m_tdmsInterleaved){
+        memset(data + filled * 2, 0, (channel_bytes - filled) * 2);
+    }else{
+        memset(data + filled, 0, channel_bytes - filled);
+        if (m_rawChannels == 3)
+            memset(data + channel_bytes + filled, 0, channel_bytes - filled);
+    }
+    m_rawBlock->setSamples(m_rawBlock->firstSample(), m_rawFilled);
+    m_rawBlock->commit(channel_bytes * (m_rawChannels == 3 ? 2 : 1));
+    AddBufferToWrite(m_rawBlock);
+    m_rawBlock = nullptr;
+}
+
+void FileQueueManager::FlushRaw(){
+    std::lock_guard<std::mutex> lock(m_rawLock);
+    FlushRawLocked();
+}
+
+// Runs on the writer thread once a raw file is complete. The index goes
+// behind the last block and the header is pointed at it.
+void FileQueueManager::FinishRawFile(){
+    if (m_fileType == Stream_FileType::RAW_TYPE && m_fd >= 0 && m_fileOffset >= FILE_RAW_HEADER_SIZE){
+        uint64_t offset = m_fileOffset;
+        uint64_t count = m_rawIndex.size() / 16;
+        if (WriteAll(m_fd, m_rawIndex.data(), m_rawIndex.size())){
+            m_fileOffset += m_rawIndex.size();
+            if (lseek(m_fd, 72, SEEK_SET) < 0 || write(m_fd, &count, sizeof(count)) != sizeof(count) || write(m_fd, &offset, sizeof(offset)) != sizeof(offset))
+                acout() << "Can't write the raw index offset to " << m_fileName << "\n";
+        }else{
+            acout() << "Can't write the raw index to " << m_fileName << "\n";
+            if (ftruncate(m_fd, m_fileOffset) != 0)
+                acout() << "Can't truncate " << m_fileName << "\n";
+        }
+        lseek(m_fd, 0, SEEK_END);
+    }
+    m_rawIndex.clear();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
 Queue::Queue():
-m_useMemory(0)
+m_useMemory(0),
+m_interrupt(false),
+m_peakSize(0),
+m_peakMemory(0),
+m_highWatermark(std::numeric_limits<long long int>::max()),
+m_lowWatermark(std::numeric_limits<long long int>::max()),
+m_full(false),
+m_overflows(0)
 {
 
 }
@@ -330,38 +1120,107 @@ Queue::~Queue(){
 
 
 
-void Queue::pushQueue(std::iostream* buffer){
-    mutex_.lock();
-    m_queue.push_back(buffer);
-    buffer->seekg(0, std::ios::end);
-    auto Length = buffer->tellg();
-    m_useMemory += Length;
-    mutex_.unlock();
+void Queue::setWatermarks(long long int _high, long long int _low){
+    std::lock_guard<std::mutex> lock(mutex_);
+    m_highWatermark = _high;
+    m_lowWatermark = std::min(_low, _high);
+    m_full = false;
 }
 
+// Blocks know their size, the budget check is a comparison under the lock
+bool Queue::pushQueue(CFileBlock* buffer){
+    long long int Length = buffer->size();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // a block over the whole budget still goes into an empty queue
+        if (!m_full && !m_queue.empty() && m_useMemory + Length > m_highWatermark){
+            m_full = true;
+            m_overflows++;
+        }
+        if (m_full)
+            return false;
+        m_queue.push_back(buffer);
+        m_useMemory += Length;
+        m_peakSize = std::max(m_peakSize, (long)m_queue.size());
+        m_peakMemory = std::max(m_peakMemory, m_useMemory);
+    }
+    m_cond.notify_one();
+    return true;
+}
 
 
-std::iostream* Queue::popQueue(){
-    mutex_.lock();
-    std::iostream* buffer = m_queue.front();
+
+CFileBlock* Queue::popQueue(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (m_queue.empty())
+        return nullptr;
+    CFileBlock* buffer = m_queue.front();
+    m_queue.pop_front();
     if (buffer != nullptr){
-        m_queue.pop_front();
-        buffer->seekg(0, std::ios::end);
-        auto Length = buffer->tellg();
-        m_useMemory -= Length;
-        buffer->seekg(0, std::ios::beg);
+        m_useMemory -= buffer->size();
     }
-    mutex_.unlock();
-
+    if (m_full && m_useMemory <= m_lowWatermark)
+        m_full = false;
     return buffer;
 }
 
+bool Queue::waitQueue(int _timeout_ms){
+    std::unique_lock<std::mutex> lock(mutex_);
+    m_cond.wait_for(lock, std::chrono::milliseconds(_timeout_ms), [this]{ return !m_queue.empty() || m_interrupt; });
+    return !m_queue.empty();
+}
+
+void Queue::interruptWait(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        m_interrupt = true;
+    }
+    m_cond.notify_all();
+}
+
+void Queue::clearInterrupt(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    m_interrupt = false;
+}
+
 long Queue::queueSize(){
-    mutex_.lock();
-    long size = m_queue.size();
-    mutex_.unlock();
-    return size;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return m_queue.size();
+}
+
+long Queue::queuePeakSize(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return m_peakSize;
+}
+
+long long int Queue::queueBytes(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return m_useMemory;
+}
+
+long long int Queue::queuePeakBytes(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return m_peakMemory;
+}
+
+long Queue::queueOverflows(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return m_overflows;
 }
 
+long long int Queue::queueHighWatermark(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return m_highWatermark;
+}
 
+long long int Queue::queueLowWatermark(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return m_lowWatermark;
+}
 
+void Queue::resetQueuePeaks(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    m_peakSize = m_queue.size();
+    m_peakMemory = m_useMemory;
+    m_overflows = 0;
+}
@@ -0,0 +1,96 @@
+#include <cstdlib>
+#include <cstring>
+#include "rpsa/common/core/file_block.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+    uint8_t *AllocBlock(size_t _size){
+#ifdef _WIN32
+        return static_cast<uint8_t*>(_aligned_malloc(_size, FILE_BLOCK_ALIGN));
+#else
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, FILE_BLOCK_ALIGN, _size) != 0)
+            return nullptr;
+        return static_cast<uint8_t*>(ptr);
+#endif
+    }
+
+    void FreeBlock(uint8_t *_ptr){
+#ifdef _WIN32
+        _aligned_free(_ptr);
+#else
+        free(_ptr);
+#endif
+    }
+}
+
+CFileBlock::CFileBlock(size_t _capacity):
+    m_data(nullptr),
+    m_size(0),
+    m_capacity(0),
+    m_headerSize(0),
+    m_newFile(false),
+    m_firstSample(0),
+    m_samples(0)
+{
+    reserve(_capacity);
+}
+
+CFileBlock::~CFileBlock(){
+    FreeBlock(m_data);
+}
+
+bool CFileBlock::reserve(size_t _capacity){
+    if (_capacity <= m_capacity)
+        return true;
+    auto capacity = (_capacity + FILE_BLOCK_ALIGN - 1) & ~(size_t)(FILE_BLOCK_ALIGN - 1);
+    auto data = AllocBlock(capacity);
+    if (data == nullptr)
+        return false;
+    if (m_data != nullptr){
+        memcpy(data, m_data, m_size);
+        FreeBlock(m_data);
+    }
+    m_data = data;
+    m_capacity = capacity;
+    return true;
+}
+
+void CFileBlock::append(const void *_data, size_t _size){
+    if (m_size + _size > m_capacity && !reserve(m_size + _size))
+        return;
+    memcpy(m_data + m_size, _data, _size);
+    m_size += _size;
+}
+
+// TDMS and WAV are both little endian, as is every target we build for.
+void CFileBlock::appendInt16(int16_t _value){
+    append(&_value, sizeof(_value));
+}
+
+void CFileBlock::appendInt32(int32_t _value){
+    append(&_value, sizeof(_value));
+}
+
+void CFileBlock::appendInt64(int64_t _value){
+    append(&_value, sizeof(_value));
+}
+
+uint8_t *CFileBlock::tail(){
+    return m_data + m_size;
+}
+
+void CFileBlock::commit(size_t _size){
+    m_size += _size;
+}
+
+void CFileBlock::clear(){
+    m_size = 0;
+    m_headerSize = 0;
+    m_newFile = false;
+    m_firstSample = 0;
+    m_samples = 0;
+}
@@ -0,0 +1,119 @@
+#include <cstring>
+#include "rpsa/common/core/stream_codec.h"
+
+namespace {
+    template<typename T>
+    size_t EncodeSamples(const T *_src, size_t _count, uint8_t *_dst, size_t _capacity){
+        const unsigned bits = sizeof(T) * 8;
+        size_t pos = 0;
+        T prev = 0;
+        T zz[CODEC_BLOCK_SAMPLES];
+
+        for (size_t offset = 0; offset < _count; offset += CODEC_BLOCK_SAMPLES){
+            size_t count = _count - offset < CODEC_BLOCK_SAMPLES ? _count - offset : CODEC_BLOCK_SAMPLES;
+            T mask = 0;
+            for (size_t i = 0; i < count; i++){
+                // Wrap-around delta, so the zigzag value always fits in T
+                T delta = (T)(_src[offset + i] - prev);
+                prev = _src[offset + i];
+                zz[i] = (T)((T)(delta << 1) ^ (T)(-(T)(delta >> (bits - 1))));
+                mask |= zz[i];
+            }
+
+            uint8_t width = 0;
+            while (width < bits && (mask >> width) != 0)
+                width++;
+
+            size_t block_size = 1 + (count * width + 7) / 8;
+            if (pos + block_size > _capacity)
+                return 0;
+
+            _dst[pos++] = width;
+            uint32_t acc = 0;
+            unsigned acc_bits = 0;
+            for (size_t i = 0; i < count; i++){
+                acc |= (uint32_t)zz[i] << acc_bits;
+                acc_bits += width;
+                while (acc_bits >= 8){
+                    _dst[pos++] = (uint8_t)acc;
+                    acc >>= 8;
+                    acc_bits -= 8;
+                }
+            }
+            if (acc_bits > 0)
+                _dst[pos++] = (uint8_t)acc;
+        }
+        return pos;
+    }
+
+    template<typename T>
+    bool DecodeSamples(const uint8_t *_src, size_t _size, T *_dst, size_t _count){
+        const unsigned bits = sizeof(T) * 8;
+        size_t pos = 0;
+        T prev = 0;
+
+        for (size_t offset = 0; offset < _count; offset += CODEC_BLOCK_SAMPLES){
+            size_t count = _count - offset < CODEC_BLOCK_SAMPLES ? _count - offset : CODEC_BLOCK_SAMPLES;
+            if (pos >= _size)
+                return false;
+            uint8_t width = _src[pos++];
+            if (width > bits || pos + (count * width + 7) / 8 > _size)
+                return false;
+
+            uint32_t acc = 0;
+            unsigned acc_bits = 0;
+            uint32_t value_mask = (1u << width) - 1;
+            for (size_t i = 0; i < count; i++){
+                while (acc_bits < width){
+                    acc |= (uint32_t)_src[pos++] << acc_bits;
+                    acc_bits += 8;
+                }
+                T zz = (T)(acc & value_mask);
+                acc >>= width;
+                acc_bits -= width;
+                T delta = (T)((T)(zz >> 1) ^ (T)(-(T)(zz & 1)));
+                prev = (T)(prev + delta);
+                _dst[offset + i] = prev;
+            }
+        }
+        return true;
+    }
+}
+
+size_t CStreamCodec::Encode(const void *_src, size_t _size, uint32_t _resolution, uint8_t *_dst, size_t _capacity){
+    // Packed 12 and 14 bit data is already dense, it is always sent as is
+    if (_capacity < CODEC_STREAM_HEADER || (_resolution != 8 && _resolution != 16))
+        return 0;
+    uint32_t decoded = (uint32_t)_size;
+    memcpy(_dst, &decoded, CODEC_STREAM_HEADER);
+    size_t size = 0;
+    if (_resolution == 8){
+        size = EncodeSamples((const uint8_t*)_src, _size, _dst + CODEC_STREAM_HEADER, _capacity - CODEC_STREAM_HEADER);
+    }else{
+        size = EncodeSamples((const uint16_t*)_src, _size / 2, _dst + CODEC_STREAM_HEADER, _capacity - CODEC_STREAM_HEADER);
+    }
+    if (size == 0 && _size != 0)
+        return 0;
+    return size + CODEC_STREAM_HEADER;
+}
+
+size_t CStreamCodec::DecodedSize(const uint8_t *_src, size_t _size){
+    if (_size < CODEC_STREAM_HEADER)
+        return 0;
+    uint32_t decoded = 0;
+    memcpy(&decoded, _src, CODEC_STREAM_HEADER);
+    return decoded;
+}
+
+size_t CStreamCodec::Decode(const uint8_t *_src, size_t _size, uint32_t _resolution, void *_dst, size_t _capacity){
+    size_t decoded = DecodedSize(_src, _size);
+    if (decoded == 0 || decoded > _capacity)
+        return 0;
+    bool ok = false;
+    if (_resolution == 8){
+        ok = DecodeSamples(_src + CODEC_STREAM_HEADER, _size - CODEC_STREAM_HEADER, (uint8_t*)_dst, decoded);
+    }else{
+        ok = DecodeSamples(_src + CODEC_STREAM_HEADER, _size - CODEC_STREAM_HEADER, (uint16_t*)_dst, decoded / 2);
+    }
+    return ok ? decoded : 0;
+}
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <cstring>
+#include "rpsa/common/core/thread_sched.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ThreadSchedT::ThreadSchedT(int _cpu, int _priority):
+    cpu(_cpu),
+    priority(_priority)
+{
+}
+
+bool SetCurrentThreadSched(const ThreadSchedT &_sched, const std::string &_name){
+    if (_sched.isDefault())
+        return true;
+#ifdef __linux__
+    bool ok = true;
+    pthread_t self = pthread_self();
+
+    if (_sched.cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(_sched.cpu, &set);
+        int err = pthread_setaffinity_np(self, sizeof(set), &set);
+        if (err != 0){
+            std::cerr << "[rpsa] " << _name << " thread: can't pin to cpu " << _sched.cpu << ": " << strerror(err) << "\n";
+            ok = false;
+        }
+    }
+
+    if (_sched.priority > 0){
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = _sched.priority;
+        int err = pthread_setschedparam(self, SCHED_FIFO, &param);
+        if (err != 0){
+            std::cerr << "[rpsa] " << _name << " thread: can't set SCHED_FIFO " << _sched.priority << ": " << strerror(err) << "\n";
+            ok = false;
+        }
+    }
+
+    int policy = 0;
+    sched_param param;
+    pthread_getschedparam(self, &policy, &param);
+    std::cout << "[rpsa] " << _name << " thread: cpu " << sched_getcpu()
+              << (_sched.cpu >= 0 ? " (pinned)" : "")
+              << ", " << (policy == SCHED_FIFO ? "SCHED_FIFO " : "SCHED_OTHER ") << param.sched_priority << "\n";
+    return ok;
+#else
+    std::cerr << "[rpsa] " << _name << " thread: scheduling options are only supported on Linux\n";
+    return false;
+#endif
+}
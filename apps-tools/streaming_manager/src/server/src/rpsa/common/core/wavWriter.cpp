@@ -1,4 +1,5 @@
 #include "rpsa/common/core/wavWriter.h"
+#include "neon_asm.h"
 
 
 CWaveWriter::CWaveWriter(){
@@ -16,7 +17,7 @@ void CWaveWriter::resetHeaderInit(){
     m_headerInit = true;
 }
 
-std::iostream *CWaveWriter::BuildWAVStream(uint8_t* buffer_ch1,size_t size_ch1,uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution){
+void CWaveWriter::BuildWAVBlock(CFileBlock *block,const uint8_t* buffer_ch1,size_t size_ch1,const uint8_t* buffer_ch2,size_t size_ch2,unsigned short resolution){
 
     if (size_ch1!=0 && size_ch2 != 0)
         assert(size_ch1 == size_ch2);
@@ -31,100 +32,79 @@ std::iostream *CWaveWriter::BuildWAVStream(uint8_t* buffer_ch1,size_t size_ch1,u
         m_numChannels = 0;
     }
 
-    m_bitDepth = resolution;
+    // Packed 12 and 14 bit samples reach the writer already expanded to 16-bit words,
+    // 32 are the float outputs of the lock-in
+    m_bitDepth = (resolution == 8 ? 8 : resolution == 32 ? 32 : 16);
     if (size_ch1!=0)
-        m_samplesPerChannel = size_ch1 / (m_bitDepth==8 ? 1 : 2);
+        m_samplesPerChannel = size_ch1 / (m_bitDepth / 8);
     else
-        m_samplesPerChannel = size_ch2 / (m_bitDepth==8 ? 1 : 2);
+        m_samplesPerChannel = size_ch2 / (m_bitDepth / 8);
     //////////////////
 
-    std::stringstream *memory = new std::stringstream(std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+    block->reserve(block->size() + 44 + size_ch1 + size_ch2);
     if (m_headerInit)
     {
-        BuildHeader(memory);
+        BuildHeader(block);
         m_headerInit = false;
     }
 
-    
-
+    // Frames are interleaved straight into the block
     if (m_bitDepth == 8)
     {
-        if ((size_ch1 + size_ch2) > 0){
-        uint8_t* cross_buff = new uint8_t[size_ch1 + size_ch2];
-
         if (size_ch2 > 0 && size_ch1 > 0){
-            for (int i = 0; i < m_samplesPerChannel; i++)
-            {
-                cross_buff[i*2] = buffer_ch1[i];
-            }
-
-            for (int i = 0; i < m_samplesPerChannel; i++)
-            {
-                cross_buff[i*2 + 1] = buffer_ch2[i];                            
-            }
+            memcpy_interleave_8bit_neon(block->tail(), buffer_ch1, buffer_ch2, size_ch1);
+            block->commit(size_ch1 + size_ch2);
         }
         else {
             if (size_ch1 > 0){
-                for (int i = 0; i < m_samplesPerChannel; i++) {
-                    cross_buff[i] = buffer_ch1[i];
-                }
+                block->append(buffer_ch1, size_ch1);
             }
 
             if (size_ch2 > 0) {
-                for (int i = 0; i < m_samplesPerChannel; i++) {
-                    cross_buff[i] = buffer_ch2[i];
-                }
+                block->append(buffer_ch2, size_ch2);
             }
         }
-        memory->write((const char*)cross_buff, size_ch1 + size_ch2);
-        delete [] cross_buff;
-        }
     }
 
     if (m_bitDepth == 16)
     {
-        int Bufflen = (size_ch1 > 0 ? m_samplesPerChannel : 0) + (size_ch2 > 0 ? m_samplesPerChannel : 0);
-        if (Bufflen > 0){
-            uint16_t* cross_buff = new uint16_t[Bufflen];
-
+        if (size_ch2 > 0 && size_ch1 > 0){
+            memcpy_interleave_16bit_neon(block->tail(), buffer_ch1, buffer_ch2, size_ch1);
+            block->commit(size_ch1 + size_ch2);
+        }
+        else {
+            if (size_ch1 > 0){
+                block->append(buffer_ch1, size_ch1);
+            }
 
-            if (size_ch2 > 0 && size_ch1 > 0){
-                for (int i = 0; i < m_samplesPerChannel; i++)
-                {
-                    cross_buff[i*2] = ((uint16_t*)buffer_ch1)[i];
-                }
+            if (size_ch2 > 0) {
+                block->append(buffer_ch2, size_ch2);
+            }
+        }
+    }
 
-                for (int i = 0; i < m_samplesPerChannel; i++)
-                {
-                    cross_buff[i*2 + 1] = ((uint16_t*)buffer_ch2)[i];                            
-                }
+    if (m_bitDepth == 32)
+    {
+        if (size_ch2 > 0 && size_ch1 > 0){
+            memcpy_interleave_32bit_neon(block->tail(), buffer_ch1, buffer_ch2, size_ch1);
+            block->commit(size_ch1 + size_ch2);
+        }
+        else {
+            if (size_ch1 > 0){
+                block->append(buffer_ch1, size_ch1);
             }
-            else {
-                if (size_ch1 > 0){
-                    for (int i = 0; i < m_samplesPerChannel; i++)
-                    {
-                        cross_buff[i] = ((uint16_t *) buffer_ch1)[i];
-                    }
-                }
-
-                if (size_ch2 > 0) {
-                    for (int i = 0; i < m_samplesPerChannel; i++) {
-                        cross_buff[i] = ((uint16_t *) buffer_ch2)[i];
-                    }
-                }
+
+            if (size_ch2 > 0) {
+                block->append(buffer_ch2, size_ch2);
             }
-        memory->write((const char*)cross_buff, sizeof(uint16_t)* (Bufflen));
-        delete [] cross_buff;
         }
     }
-
-    return memory;
 }
 
-void CWaveWriter::BuildHeader(std::stringstream *memory){
+void CWaveWriter::BuildHeader(CFileBlock *memory){
 
     int sampleRate = 44100;
-    int32_t dataChunkSize = m_samplesPerChannel * m_numChannels * (m_bitDepth==8 ? 1 : 2);
+    int32_t dataChunkSize = m_samplesPerChannel * m_numChannels * (m_bitDepth / 8);
    
     addStringToFileData(memory,"RIFF");
     
@@ -137,7 +117,7 @@ void CWaveWriter::BuildHeader(std::stringstream *memory){
     // FORMAT CHUNK
     addStringToFileData(memory,"fmt ");
     addInt32ToFileData (memory, 16); // format chunk size (16 for PCM)
-    addInt16ToFileData (memory, 1); // audio format = 1
+    addInt16ToFileData (memory, m_bitDepth == 32 ? 3 : 1); // audio format = 1 PCM, 3 IEEE float
     addInt16ToFileData (memory, (int16_t)m_numChannels); // num channels
     addInt32ToFileData (memory, (int32_t)m_samplesPerChannel); // sample rate
     
@@ -150,19 +130,19 @@ void CWaveWriter::BuildHeader(std::stringstream *memory){
     addInt16ToFileData (memory, (int16_t)m_bitDepth);
     
     // -----------------------------------------------------------
-    memory->write("data",4);
+    memory->append("data",4);
     addInt32ToFileData (memory, dataChunkSize);
 //    std::cout << "BuildHeader: dataChunkSize " << dataChunkSize << "\n";
 }
 
 
-void CWaveWriter::addStringToFileData (std::stringstream *memory, std::string s)
+void CWaveWriter::addStringToFileData (CFileBlock *memory, std::string s)
 {
-    memory->write(s.data(),s.size());
+    memory->append(s.data(),s.size());
 }
 
 
-void CWaveWriter::addInt32ToFileData (std::stringstream *memory, int32_t i)
+void CWaveWriter::addInt32ToFileData (CFileBlock *memory, int32_t i)
 {
     char bytes[4];
     
@@ -180,11 +160,11 @@ void CWaveWriter::addInt32ToFileData (std::stringstream *memory, int32_t i)
         bytes[2] = (i >> 8) & 0xFF;
         bytes[3] = i & 0xFF;
     }
-    memory->write(bytes,4);
+    memory->append(bytes,4);
     
 }
 
-void CWaveWriter::addInt16ToFileData (std::stringstream *memory, int16_t i)
+void CWaveWriter::addInt16ToFileData (CFileBlock *memory, int16_t i)
 {
     char bytes[2];
     
@@ -199,6 +179,6 @@ void CWaveWriter::addInt16ToFileData (std::stringstream *memory, int16_t i)
         bytes[1] = i & 0xFF;
     }
     
-    memory->write(bytes,2);
+    memory->append(bytes,2);
 }
 
@@ -1,14 +1,100 @@
 #include <fstream>
+#include <array>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <cerrno>
+#include <linux/errqueue.h>
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+#endif
 #include "asio.hpp"
 #include "rpsa/server/core/AsioNet.h"
 
-#define ID_PACK "STREAMpackIDv1.0"
+// v2 adds the absolute sample index and counts lost DMA segments in lostRate
+#define ID_PACK "STREAMpackIDv2.0"
+// Same layout as v2.0, channel data is delta + bit packed by CStreamCodec
+#define ID_PACK_COMPRESSED "STREAMpackIDv2.1"
+#define ID_PACK_PREFIX "STREAMpackIDv2."
+#define ID_CREDIT "STREAMcreditv1.0"
 
 namespace  asionet {
 
+    namespace {
+        std::atomic<uint32_t> s_boardStamp(0);
+
+        // The header rate is the decimation of the 125 MHz ADC clock
+        constexpr int64_t ADC_PERIOD_NS = 8;
+
+        struct PackTime {
+            uint64_t sampleId;
+            int64_t  timeNs;
+            uint32_t errorNs;
+            uint32_t flags;
+        };
+        // Packs are built by the thread that sends them, no lock needed
+        thread_local PackTime s_packTime = {0, 0, 0, 0};
+    }
+
+    void CAsioNet::SetBoardId(uint16_t _id){
+        uint32_t stamp = s_boardStamp.load();
+        while (!s_boardStamp.compare_exchange_weak(stamp, (stamp & ~PACK_BOARD_MASK) | _id)) {}
+    }
+
+    void CAsioNet::SetSyncedIds(bool _synced){
+        if (_synced)
+            s_boardStamp |= PACK_BOARD_SYNCED;
+        else
+            s_boardStamp &= ~PACK_BOARD_SYNCED;
+    }
+
+    void CAsioNet::SetPayloadType(uint8_t _type){
+        uint32_t stamp = s_boardStamp.load();
+        while (!s_boardStamp.compare_exchange_weak(stamp, (stamp & ~PACK_PAYLOAD_MASK) | ((uint32_t)_type << PACK_PAYLOAD_SHIFT))) {}
+    }
+
+    void CAsioNet::SetPackTime(uint64_t _sampleId, int64_t _timeNs, uint32_t _errorNs, uint32_t _flags){
+        s_packTime.sampleId = _sampleId;
+        s_packTime.timeNs = _timeNs;
+        s_packTime.errorNs = _errorNs;
+        s_packTime.flags = _flags;
+    }
+
+    void CAsioNet::BuildPackTrailer(
+            uint8_t *_trailer ,
+            uint64_t _sampleId ,
+            uint32_t _oscRate){
+        // The trailer follows channel data of any length, it may be unaligned
+        int64_t time = 0;
+        uint32_t error = 0;
+        uint32_t flags = s_packTime.flags;
+        if (flags & PACK_TIME_VALID){
+            int64_t samples = (int64_t)(_sampleId - s_packTime.sampleId);
+            time = s_packTime.timeNs + samples * (int64_t)_oscRate * ADC_PERIOD_NS;
+            error = s_packTime.errorNs;
+        }
+        memcpy(_trailer, &time, sizeof(time));
+        memcpy(_trailer + 8, &error, sizeof(error));
+        memcpy(_trailer + 12, &flags, sizeof(flags));
+    }
+
     uint8_t *CAsioNet::BuildPack(
             uint64_t _id ,
             uint64_t _lostRate ,
+            uint64_t _sampleId ,
             uint32_t _oscRate  ,
             uint32_t _resolution ,
             const void *_ch1 ,
@@ -24,7 +110,9 @@ namespace  asionet {
         prefix_lenght += sizeof(int32_t);     // pack size (4 byte)
         prefix_lenght += sizeof(int32_t) * 2; // size of channel1 and channel2 (8 byte)
         prefix_lenght += sizeof(int32_t);     // resolution (4 byte)
-        size_t  buffer_size = prefix_lenght + _size_ch1 + _size_ch2;
+        prefix_lenght += sizeof(int32_t);     // reserved (4 byte)
+        prefix_lenght += sizeof(uint64_t);    // sample index (8 byte)
+        size_t  buffer_size = prefix_lenght + _size_ch1 + _size_ch2 + PACK_TRAILER_SIZE;
         auto buffer = new uint8_t[buffer_size];
         memcpy(buffer,ID_PACK,16);
         ((uint64_t*)buffer)[2] = _id;
@@ -34,6 +122,8 @@ namespace  asionet {
         ((uint32_t*)buffer)[10] = (uint32_t)_size_ch1;
         ((uint32_t*)buffer)[11] = (uint32_t)_size_ch2;
         ((uint32_t*)buffer)[12] = _resolution;
+        ((uint32_t*)buffer)[13] = s_boardStamp.load(std::memory_order_relaxed);
+        ((uint64_t*)buffer)[7] = _sampleId;
 
         if (_size_ch1>0){
 
@@ -44,15 +134,39 @@ namespace  asionet {
 
             memcpy_neon((&(*buffer)+prefix_lenght + _size_ch1), _ch2, _size_ch2);
         }
+        BuildPackTrailer(buffer + prefix_lenght + _size_ch1 + _size_ch2, _sampleId, _oscRate);
 
         _buffer_size = buffer_size;
         return buffer;
     }
 
+    void CAsioNet::BuildPackHeader(
+            uint8_t *_header ,
+            uint64_t _id ,
+            uint64_t _lostRate ,
+            uint64_t _sampleId ,
+            uint32_t _oscRate  ,
+            uint32_t _resolution ,
+            size_t _size_ch1 ,
+            size_t _size_ch2){
+        size_t  buffer_size = PACK_HEADER_SIZE + _size_ch1 + _size_ch2 + PACK_TRAILER_SIZE;
+        memcpy(_header,ID_PACK,16);
+        ((uint64_t*)_header)[2] = _id;
+        ((uint64_t*)_header)[3] = _lostRate;
+        ((uint32_t*)_header)[8] = _oscRate;
+        ((uint32_t*)_header)[9] = (uint32_t)buffer_size;
+        ((uint32_t*)_header)[10] = (uint32_t)_size_ch1;
+        ((uint32_t*)_header)[11] = (uint32_t)_size_ch2;
+        ((uint32_t*)_header)[12] = _resolution;
+        ((uint32_t*)_header)[13] = s_boardStamp.load(std::memory_order_relaxed);
+        ((uint64_t*)_header)[7] = _sampleId;
+    }
+
     void CAsioNet::BuildPack(
             CAsioSocket::send_buffer buffer ,
             uint64_t _id ,
             uint64_t _lostRate ,
+            uint64_t _sampleId ,
             uint32_t _oscRate  ,
             uint32_t _resolution ,
             const void *_ch1 ,
@@ -60,35 +174,199 @@ namespace  asionet {
             const void  *_ch2 ,
             size_t _size_ch2 ,
             size_t &_buffer_size){
-        size_t  prefix_lenght = sizeof(int8_t) * 16; // ID of pack (16 byte)
-        prefix_lenght += sizeof(uint64_t);    // Index (8 byte)
-        prefix_lenght += sizeof(uint64_t);    // lostRate  (8 byte)
-        prefix_lenght += sizeof(int32_t);     // _oscRate  (4 byte)
-        prefix_lenght += sizeof(int32_t);     // pack size (4 byte)
-        prefix_lenght += sizeof(int32_t) * 2; // size of channel1 and channel2 (8 byte)
-        prefix_lenght += sizeof(int32_t);     // resolution (4 byte)
-        size_t  buffer_size = prefix_lenght + _size_ch1 + _size_ch2;
-        memcpy(buffer,ID_PACK,16);
-        ((uint64_t*)buffer)[2] = _id;
-        ((uint64_t*)buffer)[3] = _lostRate;
-        ((uint32_t*)buffer)[8] = _oscRate;
-        ((uint32_t*)buffer)[9] = (uint32_t)buffer_size;
-        ((uint32_t*)buffer)[10] = (uint32_t)_size_ch1;
-        ((uint32_t*)buffer)[11] = (uint32_t)_size_ch2;
-        ((uint32_t*)buffer)[12] = _resolution;
+        BuildPackHeader(buffer, _id, _lostRate, _sampleId, _oscRate, _resolution, _size_ch1, _size_ch2);
 
+        // Packed 12 and 14 bit packs are not a multiple of the NEON block size
         if (_size_ch1>0){
-
-            memcpy_neon((&(*buffer)+prefix_lenght), _ch1, _size_ch1);
+            if (_size_ch1 & 63)
+                memcpy((&(*buffer)+PACK_HEADER_SIZE), _ch1, _size_ch1);
+            else
+                memcpy_neon((&(*buffer)+PACK_HEADER_SIZE), _ch1, _size_ch1);
         }
 
         if (_size_ch2>0){
+            if (_size_ch2 & 63)
+                memcpy((&(*buffer)+PACK_HEADER_SIZE + _size_ch1), _ch2, _size_ch2);
+            else
+                memcpy_neon((&(*buffer)+PACK_HEADER_SIZE + _size_ch1), _ch2, _size_ch2);
+        }
 
-            memcpy_neon((&(*buffer)+prefix_lenght + _size_ch1), _ch2, _size_ch2);
+        BuildPackTrailer(buffer + PACK_HEADER_SIZE + _size_ch1 + _size_ch2, _sampleId, _oscRate);
+        _buffer_size = PACK_HEADER_SIZE + _size_ch1 + _size_ch2 + PACK_TRAILER_SIZE;
+
+    }
+
+    bool CAsioNet::BuildCompressedPack(
+            CAsioSocket::send_buffer buffer ,
+            uint64_t _id ,
+            uint64_t _lostRate ,
+            uint64_t _sampleId ,
+            uint32_t _oscRate  ,
+            uint32_t _resolution ,
+            const void *_ch1 ,
+            size_t _size_ch1 ,
+            const void  *_ch2 ,
+            size_t _size_ch2 ,
+            size_t &_buffer_size){
+        // Compressed data may not exceed the raw payload, otherwise the raw pack is sent
+        size_t capacity = _size_ch1 + _size_ch2;
+        size_t enc_ch1 = 0;
+        size_t enc_ch2 = 0;
+        if (_size_ch1 > 0){
+            enc_ch1 = CStreamCodec::Encode(_ch1, _size_ch1, _resolution, buffer + PACK_HEADER_SIZE, capacity);
+            if (enc_ch1 == 0)
+                return false;
         }
+        if (_size_ch2 > 0){
+            enc_ch2 = CStreamCodec::Encode(_ch2, _size_ch2, _resolution, buffer + PACK_HEADER_SIZE + enc_ch1, capacity - enc_ch1);
+            if (enc_ch2 == 0)
+                return false;
+        }
+        BuildPackHeader(buffer, _id, _lostRate, _sampleId, _oscRate, _resolution, enc_ch1, enc_ch2);
+        memcpy(buffer, ID_PACK_COMPRESSED, 16);
+        BuildPackTrailer(buffer + PACK_HEADER_SIZE + enc_ch1 + enc_ch2, _sampleId, _oscRate);
+        _buffer_size = PACK_HEADER_SIZE + enc_ch1 + enc_ch2 + PACK_TRAILER_SIZE;
+        return true;
+    }
 
-        _buffer_size = buffer_size;
+    CAsioSocket::send_buffer CAsioNet::BuildPackInPool(
+            uint64_t _id ,
+            uint64_t _lostRate ,
+            uint64_t _sampleId ,
+            uint32_t _oscRate  ,
+            uint32_t _resolution ,
+            const void *_ch1 ,
+            size_t _size_ch1 ,
+            const void  *_ch2 ,
+            size_t _size_ch2 ,
+            Stream_Compression _compression,
+            size_t &_buffer_size){
+        _buffer_size = 0;
+        if (PACK_HEADER_SIZE + _size_ch1 + _size_ch2 + PACK_TRAILER_SIZE > m_packPool->packetSize()){
+            std::cerr << "[rpsa] Pack does not fit in pool buffer\n";
+            return nullptr;
+        }
+        // Pool exhaustion is counted by the pool itself
+        auto buffer = m_packPool->acquire();
+        if (buffer == nullptr){
+            return nullptr;
+        }
+        if (_compression == DELTA_COMPRESSION &&
+            BuildCompressedPack(buffer, _id, _lostRate, _sampleId, _oscRate, _resolution, _ch1, _size_ch1, _ch2, _size_ch2, _buffer_size)){
+            return buffer;
+        }
+        BuildPack(buffer, _id, _lostRate, _sampleId, _oscRate, _resolution, _ch1, _size_ch1, _ch2, _size_ch2, _buffer_size);
+        return buffer;
+    }
 
+    CAsioSocket::send_buffer CAsioNet::AcquirePack(){
+        return m_packPool->acquire();
+    }
+
+    size_t CAsioNet::GetPackCapacity(){
+        return m_packPool->packetSize();
+    }
+
+    bool CAsioNet::SendBatch(CAsioSocket::send_buffer _buffer, size_t _size){
+        if (m_server){
+            return m_server->SendBatch(_buffer, _size);
+        }
+        return false;
+    }
+
+    uint64_t CAsioNet::GetLostPacks(){
+        if (m_server){
+            return m_server->GetLostPacks();
+        }
+        return 0;
+    }
+
+    void CAsioNet::ReleasePack(CAsioSocket::send_buffer _buffer){
+        if (!m_packPool->release(_buffer)){
+            delete [] _buffer;
+        }
+    }
+
+    bool CAsioNet::SendPack(
+            uint64_t _id ,
+            uint64_t _lostRate ,
+            uint64_t _sampleId ,
+            uint32_t _oscRate  ,
+            uint32_t _resolution ,
+            const void *_ch1 ,
+            size_t _size_ch1 ,
+            const void  *_ch2 ,
+            size_t _size_ch2){
+        alignas(8) uint8_t header[PACK_HEADER_SIZE];
+        uint8_t trailer[PACK_TRAILER_SIZE];
+        BuildPackHeader(header, _id, _lostRate, _sampleId, _oscRate, _resolution, _size_ch1, _size_ch2);
+        BuildPackTrailer(trailer, _sampleId, _oscRate);
+        if (m_server){
+            return m_server->SendBuffers(header, PACK_HEADER_SIZE, _ch1, _size_ch1, _ch2, _size_ch2, trailer, PACK_TRAILER_SIZE);
+        }
+        return false;
+    }
+
+    uint64_t CAsioNet::GetPoolExhaustedCount(){
+        return m_packPool->exhaustedCount();
+    }
+
+    void CAsioNet::SetBackpressurePolicy(BackpressurePolicy _policy){
+        if (m_server){
+            m_server->setBackpressurePolicy(_policy);
+        }
+    }
+
+    void CAsioNet::SetZeroCopy(bool _enable){
+        if (m_server){
+            m_server->setZeroCopy(_enable);
+        }
+    }
+
+    void CAsioNet::SetCreditSource(std::function<uint64_t()> _source){
+        if (m_server){
+            m_server->setCreditSource(_source);
+        }
+    }
+
+    // The io_service thread applies it to itself
+    void CAsioNet::SetThreadSched(const ThreadSchedT &_sched){
+        m_Ios.post([_sched](){ SetCurrentThreadSched(_sched, "Network"); });
+    }
+
+    size_t CAsioNet::GetClientsCount(){
+        if (m_server){
+            return m_server->GetClientsCount();
+        }
+        return 0;
+    }
+
+    uint64_t CAsioNet::GetDroppedPacks(){
+        if (m_server){
+            return m_server->GetDroppedPacks();
+        }
+        return 0;
+    }
+
+    uint64_t CAsioNet::GetThrottledPacks(){
+        if (m_server){
+            return m_server->GetThrottledPacks();
+        }
+        return 0;
+    }
+
+    uint64_t CAsioNet::GetSentBytes(){
+        if (m_server){
+            return m_server->GetSentBytes();
+        }
+        return 0;
+    }
+
+    size_t CAsioNet::GetQueuePeak(){
+        if (m_server){
+            return m_server->GetQueuePeak();
+        }
+        return 0;
     }
 
     bool CAsioNet::ExtractPack(
@@ -96,21 +374,74 @@ namespace  asionet {
                     size_t _size ,
                     uint64_t &_id ,
                     uint64_t &_lostRate ,
+                    uint64_t &_sampleId ,
                     uint32_t &_oscRate  ,
                     uint32_t &_resolution ,
                     CAsioSocket::send_buffer &_ch1 ,
                     size_t &_size_ch1 ,
                     CAsioSocket::send_buffer  &_ch2 ,
                     size_t &_size_ch2){
+        if (strncmp((const char*)_buffer,ID_PACK_COMPRESSED,16) == 0){
+            _id = ((uint64_t*)_buffer)[2];
+            _lostRate = ((uint64_t*)_buffer)[3];
+            _sampleId = ((uint64_t*)_buffer)[7];
+            _oscRate  = ((uint32_t*)_buffer)[8];
+            ASIO_ASSERT(_size == ((uint32_t*)_buffer)[9]);
+            size_t enc_ch1 = ((uint32_t*)_buffer)[10];
+            size_t enc_ch2 = ((uint32_t*)_buffer)[11];
+            _resolution = ((uint32_t*)_buffer)[12];
+            _ch1 = nullptr;
+            _ch2 = nullptr;
+            _size_ch1 = 0;
+            _size_ch2 = 0;
+
+            if (enc_ch1 > 0) {
+                _size_ch1 = CStreamCodec::DecodedSize(_buffer + PACK_HEADER_SIZE, enc_ch1);
+                _ch1 = new uint8_t[_size_ch1];
+                if (CStreamCodec::Decode(_buffer + PACK_HEADER_SIZE, enc_ch1, _resolution, _ch1, _size_ch1) == 0){
+                    std::cerr << "[rpsa] Broken compressed data in channel 1\n";
+                    memset(_ch1, 0, _size_ch1);
+                }
+            }
+
+            if (enc_ch2 > 0) {
+                _size_ch2 = CStreamCodec::DecodedSize(_buffer + PACK_HEADER_SIZE + enc_ch1, enc_ch2);
+                _ch2 = new uint8_t[_size_ch2];
+                if (CStreamCodec::Decode(_buffer + PACK_HEADER_SIZE + enc_ch1, enc_ch2, _resolution, _ch2, _size_ch2) == 0){
+                    std::cerr << "[rpsa] Broken compressed data in channel 2\n";
+                    memset(_ch2, 0, _size_ch2);
+                }
+            }
+            return true;
+        }
+
         if (strncmp((const char*)_buffer,ID_PACK,16) == 0){
             _id = ((uint64_t*)_buffer)[2];
             _lostRate = ((uint64_t*)_buffer)[3];
+            _sampleId = ((uint64_t*)_buffer)[7];
             _oscRate  = ((uint32_t*)_buffer)[8];
             ASIO_ASSERT(_size == ((uint32_t*)_buffer)[9]);
             _size_ch1 = ((uint32_t*)_buffer)[10];
             _size_ch2 = ((uint32_t*)_buffer)[11];
             _resolution = ((uint32_t*)_buffer)[12];
-            uint16_t prefix = 52;
+            uint16_t prefix = PACK_HEADER_SIZE;
+
+            size_t enc_ch1 = _size_ch1;
+
+            if (_resolution == 14 || _resolution == 12) {
+                // Packed samples are handed out as left aligned 16-bit words
+                _ch1 = nullptr;
+                _ch2 = nullptr;
+                if (_size_ch1 > 0) {
+                    _ch1 = new uint8_t[_size_ch1 * 16 / _resolution + 2];
+                    _size_ch1 = unpack_bits_to_16bit(_ch1, _buffer + prefix, _size_ch1, _resolution);
+                }
+                if (_size_ch2 > 0) {
+                    _ch2 = new uint8_t[_size_ch2 * 16 / _resolution + 2];
+                    _size_ch2 = unpack_bits_to_16bit(_ch2, _buffer + prefix + enc_ch1, _size_ch2, _resolution);
+                }
+                return true;
+            }
 
             if (_size_ch1 > 0) {
                 _ch1 = new uint8_t[_size_ch1];
@@ -143,9 +474,11 @@ namespace  asionet {
             m_host(_host),
             m_port(_port),
             m_IsRun(false),
-            m_asio_th(nullptr)
+            m_asio_th(nullptr),
+            m_packPool(CPacketPool::Create(PACK_POOL_COUNT, PACK_POOL_BUFFER_SIZE))
     {
         m_server = CAsioSocket::Create(m_Ios, m_protocol, m_host, m_port);
+        m_server->setPacketPool(m_packPool);
         auto func = std::bind(static_cast<size_t (asio::io_service::*)()>(&asio::io_service::run), &m_Ios);
         m_asio_th = new asio::thread(func);
     }
@@ -256,16 +589,39 @@ namespace  asionet {
             m_tcp_socket(0),
             m_tcp_acceptor(0),
             m_udp_endpoint(),
-            m_last_pack_id(0)
+            m_last_pack_id(0),
+            m_credit_source(),
+            m_credit_timer(nullptr),
+            m_credit_sending(false),
+            m_received_bytes(0),
+            m_credit_received(0),
+            m_credit_window(0),
+            m_pack_pool(nullptr),
+            m_send_queue(),
+            m_is_sending(false),
+            m_tcp_accept_socket(nullptr),
+            m_tcp_accept_endpoint(),
+            m_tcp_clients(),
+            m_tcp_clients_mtx(),
+            m_tcp_clients_count(0),
+            m_dropped_packs(0),
+            m_throttled_packs(0),
+            m_backpressure(BackpressurePolicy::DROP_OLDEST),
+            m_zerocopy(false),
+            m_udp_gso(true),
+            m_first_pack(true),
+            m_lost_packs(0),
+            m_sent_bytes(0),
+            m_queue_peak(0)
     {
         m_SocketReadBuffer = new uint8_t[SOCKET_BUFFER_SIZE];
-        m_tcp_fifo_buffer = new uint8_t[FIFO_BUFFER_SIZE];
+        m_tcp_pack.resize(PACK_HEADER_SIZE + SOCKET_BUFFER_SIZE);
     }
 
     CAsioSocket::~CAsioSocket() {
         CloseSocket();
+        ClearSendQueue();
         delete [] m_SocketReadBuffer;
-        delete [] m_tcp_fifo_buffer;
 
     }
 
@@ -280,23 +636,38 @@ namespace  asionet {
         if (m_protocol == asionet::Protocol::UDP) {
             m_udp_socket = std::make_shared<asio::ip::udp::udp::socket>(m_io_service, asio::ip::udp::udp::endpoint(asio::ip::udp::udp::v4(), std::stoi(m_port)));
             m_udp_socket->set_option(asio::ip::udp::socket::reuse_address(true));
+            asio::error_code error;
+            m_udp_socket->set_option(asio::socket_base::send_buffer_size(UDP_SOCKET_BUFFER), error);
             WaitClient();
         }
 
         if (m_protocol == asionet::Protocol::TCP) {
 
-            m_tcp_socket = std::make_shared<asio::ip::tcp::socket>(m_io_service);
             m_tcp_acceptor = std::make_shared<asio::ip::tcp::acceptor>(m_io_service);
             asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), std::stoi(m_port));
             m_tcp_acceptor->open(endpoint.protocol());
             m_tcp_acceptor->set_option(asio::ip::tcp::acceptor::reuse_address(true));
             m_tcp_acceptor->bind(endpoint);
             m_tcp_acceptor->listen();
-            m_tcp_acceptor->async_accept(*m_tcp_socket,m_tcp_endpoint, std::bind(&CAsioSocket::HandlerAcceptFromClient, this, std::placeholders::_1));
+            StartAccept();
         }
         m_mode = Mode::SERVER;
     }
 
+    void CAsioSocket::StartAccept(){
+        m_tcp_accept_socket = std::make_shared<asio::ip::tcp::socket>(m_io_service);
+        m_tcp_acceptor->async_accept(*m_tcp_accept_socket, m_tcp_accept_endpoint, std::bind(&CAsioSocket::HandlerAcceptFromClient, this, std::placeholders::_1));
+    }
+
+    bool CAsioSocket::IsTcpServer(){
+        return m_protocol == Protocol::TCP && m_mode == Mode::SERVER;
+    }
+
+    vector<CAsioSocket::TcpClient::Ptr> CAsioSocket::GetClients(){
+        std::lock_guard<std::mutex> lock(m_tcp_clients_mtx);
+        return m_tcp_clients;
+    }
+
     void CAsioSocket::CloseSocket(){
 
         if (m_is_udp_connected)
@@ -304,12 +675,26 @@ namespace  asionet {
         if (m_is_tcp_connected)
             m_callback_Str.emitEvent(Events::DISCONNECT_SERVER, m_tcp_endpoint.address().to_string());
 
+        if (m_credit_timer){
+            asio::error_code error;
+            m_credit_timer->cancel(error);
+        }
         if (m_tcp_socket && (*m_tcp_socket).is_open()){
-            (*m_tcp_socket).close();
+            // A handler may already have closed it from the service thread
+            asio::error_code error;
+            (*m_tcp_socket).close(error);
             m_is_tcp_connected = false;
         }
+        if (m_tcp_acceptor && (*m_tcp_acceptor).is_open()){
+            asio::error_code error;
+            (*m_tcp_acceptor).close(error);
+        }
+        for (auto &client : GetClients()){
+            CloseClient(client);
+        }
         if (m_udp_socket && (*m_udp_socket).is_open()) {
-            (*m_udp_socket).close();
+            asio::error_code error;
+            (*m_udp_socket).close(error);
             m_is_udp_connected = false;
         }
     }
@@ -342,112 +727,159 @@ namespace  asionet {
                           std::placeholders::_1));
     }
 
+    // UDP only, TCP packs are reassembled by StartTcpReceive()
     void CAsioSocket::HandlerReceiveFromServer(const asio::error_code &ErrorCode, size_t bytes_transferred){
         if (!ErrorCode) {
-        //    std::cout << "Byte received: " << bytes_transferred << "\n";
-            if (m_protocol == Protocol::TCP) {
-
-                if (bytes_transferred + m_pos_last_in_fifo > FIFO_BUFFER_SIZE) {
-                    std::cerr  << "[rspa] TCP received buffer overflow\n";
-                    exit(5);
-                }
-
-                memcpy(m_tcp_fifo_buffer + m_pos_last_in_fifo,m_SocketReadBuffer,bytes_transferred);
-                m_pos_last_in_fifo += bytes_transferred;
-
-                char *id_str = ID_PACK;
-                uint8_t  size_id = sizeof(ID_PACK) - 1;
-                bool find_all_flag = false;
-//                cout << "Buff size " << m_pos_last_in_fifo << "\n";
-                do{
-
-                for (int i = 0; i < m_pos_last_in_fifo - size_id; ++i) {
-                    bool find_flag = false;
-                    for (int j = 0; j < size_id; ++j) {
-                        if (m_tcp_fifo_buffer[i + j] == id_str[j]) {
-                            find_flag = true;
-                        } else {
-                            find_flag = false;
-                            break;
-                        }
-                    }
- //                   std::cout << i << " pos " <<  m_pos_last_in_fifo << "\n";
-
-                    if (find_flag) {
-                        uint32_t pack_size = ((uint32_t *) (m_tcp_fifo_buffer + i))[9];
-                        if ((pack_size + i) <= m_pos_last_in_fifo) {
-                            m_callbackErrorUInt8Int.emitEvent(Events::RECIVED_DATA_FROM_SERVER, ErrorCode,
-                                                              m_tcp_fifo_buffer + i,
-                                                              (uint32_t) pack_size);
-
-                            memcpy(m_tcp_fifo_buffer, m_tcp_fifo_buffer + i + pack_size,
-                                   m_pos_last_in_fifo - pack_size - i);
-                            m_pos_last_in_fifo = m_pos_last_in_fifo - pack_size - i;
-                            find_all_flag = true;
-                        }
-                        else{
-                            find_all_flag = false;
-//                            std::cout << "Header persent " << i << " size " << m_pos_last_in_fifo <<" \n";
-                        }
-                        break;
-                    } else{
-                        find_all_flag = false;
-                    }
+            if (strncmp((const char*)m_SocketReadBuffer,ID_PACK_PREFIX,sizeof(ID_PACK_PREFIX) - 1) == 0) {
+                uint64_t id_pack = ((uint64_t *) (m_SocketReadBuffer))[2];
+                if (m_first_pack || id_pack > m_last_pack_id)
+                {
+                    // Every datagram carries its own sequence number, gaps are lost datagrams
+                    if (!m_first_pack && id_pack > m_last_pack_id + 1)
+                        m_lost_packs += id_pack - m_last_pack_id - 1;
+                    m_first_pack = false;
+                    m_callbackErrorUInt8Int.emitEvent(Events::RECIVED_DATA_FROM_SERVER, ErrorCode,
+                                                      m_SocketReadBuffer,
+                                                      (uint32_t) bytes_transferred);
+                    m_last_pack_id = id_pack;
                 }
-                if (m_pos_last_in_fifo <= size_id)
-                    break;
-                } while (find_all_flag);
             }
+            m_udp_socket->async_receive_from(
+                    asio::buffer(m_SocketReadBuffer, SOCKET_BUFFER_SIZE), m_udp_endpoint,
+                    std::bind(&CAsioSocket::HandlerReceiveFromServer, this,
+                              std::placeholders::_1, std::placeholders::_2));
+        }else{
+            m_callback_Error.emitEvent(Events::ERROR_CLIENT,ErrorCode);
+            CloseSocket();
+        }
+    }
 
-            if (m_protocol == Protocol::UDP) {
-                if (strncmp((const char*)m_SocketReadBuffer,ID_PACK,16) == 0) {
-                    uint64_t id_pack = ((uint64_t *) (m_SocketReadBuffer))[2];
-                    if (id_pack > m_last_pack_id)
-                    {
-                        m_callbackErrorUInt8Int.emitEvent(Events::RECIVED_DATA_FROM_SERVER, ErrorCode,
-                                                          m_SocketReadBuffer,
-                                                          (uint32_t) bytes_transferred);
-                        m_last_pack_id = id_pack;
-                    }
-                }
-            }
+    void CAsioSocket::StartTcpReceive(){
+        asio::async_read(*m_tcp_socket, asio::buffer(m_tcp_pack.data(), PACK_HEADER_SIZE),
+                         std::bind(&CAsioSocket::HandlerTcpHeader, this,
+                                   std::placeholders::_1, std::placeholders::_2));
+    }
 
+    void CAsioSocket::HandlerTcpHeader(const asio::error_code &_error, size_t){
+        if (_error == asio::error::operation_aborted)
+            return; // Socket closed
+        if (_error){
+            m_callback_Error.emitEvent(Events::ERROR_CLIENT,_error);
+            CloseSocket();
+            return;
+        }
+        // TCP keeps the framing, a bad header means the stream is not ours
+        uint32_t pack_size = ((uint32_t *) m_tcp_pack.data())[9];
+        if (strncmp((const char*)m_tcp_pack.data(),ID_PACK_PREFIX,sizeof(ID_PACK_PREFIX) - 1) != 0
+            || pack_size < PACK_HEADER_SIZE || pack_size > PACK_MAX_SIZE){
+            std::cerr << "[rpsa] Broken pack header from server, disconnect\n";
+            m_callback_Error.emitEvent(Events::ERROR_CLIENT,asio::error::make_error_code(asio::error::invalid_argument));
+            CloseSocket();
+            return;
+        }
+        if (m_tcp_pack.size() < pack_size)
+            m_tcp_pack.resize(pack_size);
+        asio::async_read(*m_tcp_socket, asio::buffer(m_tcp_pack.data() + PACK_HEADER_SIZE, pack_size - PACK_HEADER_SIZE),
+                         std::bind(&CAsioSocket::HandlerTcpBody, this,
+                                   std::placeholders::_1, std::placeholders::_2));
+    }
 
-            if (m_protocol == Protocol::UDP) {
-                m_udp_socket->async_receive_from(
-                        asio::buffer(m_SocketReadBuffer, SOCKET_BUFFER_SIZE), m_udp_endpoint,
-                        std::bind(&CAsioSocket::HandlerReceiveFromServer, this,
-                                  std::placeholders::_1, std::placeholders::_2));
-            }
-            if (m_protocol == Protocol::TCP) {
-                m_tcp_socket->async_receive(asio::buffer(m_SocketReadBuffer, SOCKET_BUFFER_SIZE),
-                                            std::bind(&CAsioSocket::HandlerReceiveFromServer, this,
-                                                      std::placeholders::_1, std::placeholders::_2));
-            }
-        }else{
-            m_callback_Error.emitEvent(Events::ERROR_CLIENT,ErrorCode);
+    void CAsioSocket::HandlerTcpBody(const asio::error_code &_error, size_t _bytesTransferred){
+        if (_error == asio::error::operation_aborted)
+            return; // Socket closed
+        if (_error){
+            m_callback_Error.emitEvent(Events::ERROR_CLIENT,_error);
             CloseSocket();
+            return;
         }
+        m_callbackErrorUInt8Int.emitEvent(Events::RECIVED_DATA_FROM_SERVER, _error,
+                                          m_tcp_pack.data(),
+                                          _bytesTransferred + PACK_HEADER_SIZE);
+        m_received_bytes += _bytesTransferred + PACK_HEADER_SIZE;
+        // Half the window used, the server gets a new one before it has to drop
+        if (m_credit_source && m_received_bytes - m_credit_received >= m_credit_window / 2)
+            SendCredit();
+        StartTcpReceive();
+    }
+
+    // Client side. One credit message in flight at a time, a skipped one
+    // is made up by the next pack or the timer.
+    void CAsioSocket::SendCredit(){
+        if (m_credit_sending || !m_tcp_socket || !m_tcp_socket->is_open())
+            return;
+        uint64_t window = m_credit_source();
+        memcpy(m_credit_msg, ID_CREDIT, 16);
+        memcpy(m_credit_msg + 16, &m_received_bytes, sizeof(uint64_t));
+        memcpy(m_credit_msg + 24, &window, sizeof(uint64_t));
+        m_credit_received = m_received_bytes;
+        m_credit_window = window;
+        m_credit_sending = true;
+        asio::async_write(*m_tcp_socket, asio::buffer(m_credit_msg, PACK_CREDIT_SIZE),
+                          [this](const asio::error_code &, size_t){ m_credit_sending = false; });
+    }
+
+    // A receiver that stopped taking packs gets none, the timer tells the
+    // server once it has room again
+    void CAsioSocket::HandlerCreditTimer(const asio::error_code &_error){
+        if (_error == asio::error::operation_aborted)
+            return;
+        if (!m_is_tcp_connected)
+            return;
+        SendCredit();
+        m_credit_timer->expires_from_now(std::chrono::milliseconds(PACK_CREDIT_PERIOD_MS));
+        m_credit_timer->async_wait(std::bind(&CAsioSocket::HandlerCreditTimer, this, std::placeholders::_1));
     }
 
     bool CAsioSocket::IsConnected(){
-        return m_is_tcp_connected || m_is_udp_connected;
+        return m_is_tcp_connected || m_is_udp_connected || m_tcp_clients_count > 0;
     }
 
     void CAsioSocket::HandlerAcceptFromClient(const asio::error_code &_error)
     {
+        if (_error == asio::error::operation_aborted)
+            return; // Acceptor closed
+
         if (!_error)
         {
-
-            m_callback_Str.emitEvent(Events::CONNECT_SERVER,m_tcp_endpoint.address().to_string());
-            m_is_tcp_connected = true;
+            std::lock_guard<std::mutex> lock(m_tcp_clients_mtx);
+            if (m_tcp_clients.size() < MAX_TCP_CLIENTS){
+                auto client = std::make_shared<TcpClient>();
+                client->socket = m_tcp_accept_socket;
+                client->endpoint = m_tcp_accept_endpoint;
+                client->is_sending = false;
+                client->offset = 0;
+                client->zerocopy = false;
+                client->zc_next = 0;
+#ifdef __linux__
+                if (m_zerocopy){
+                    // Kernels before 4.14 do not have it, their clients get copying sends
+                    int one = 1;
+                    client->zerocopy = setsockopt(client->socket->native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+                    if (!client->zerocopy)
+                        std::cerr << "[rpsa] SO_ZEROCOPY not supported, copying sends to " << client->endpoint.address().to_string() << "\n";
+                }
+#endif
+                client->rx.resize(PACK_CREDIT_SIZE * 4);
+                client->rx_size = 0;
+                client->credit_valid = false;
+                client->credit_limit = 0;
+                client->queued_bytes = 0;
+                m_tcp_clients.push_back(client);
+                m_tcp_clients_count = m_tcp_clients.size();
+                StartClientReceive(client);
+                m_callback_Str.emitEvent(Events::CONNECT_SERVER,client->endpoint.address().to_string());
+            }else{
+                std::cerr << "[rpsa] Too many clients, reject " << m_tcp_accept_endpoint.address().to_string() << "\n";
+                asio::error_code error;
+                m_tcp_accept_socket->close(error);
+            }
         }
-        else if (_error.value() != 1) // Already open connection
+        else
         {
             m_callback_Error.emitEvent(Events::ERROR_SERVER,_error);
-            m_tcp_acceptor->async_accept(*m_tcp_socket, m_tcp_endpoint, std::bind(&CAsioSocket::HandlerAcceptFromClient, this, std::placeholders::_1));
-            m_is_tcp_connected = false;
         }
+        if (m_tcp_acceptor && m_tcp_acceptor->is_open())
+            StartAccept();
     }
 
     void CAsioSocket::HandlerConnectToServer(const asio::error_code &_error, asio::ip::tcp::resolver::iterator endpoint_iterator)
@@ -457,9 +889,13 @@ namespace  asionet {
 			{
 				m_callback_Str.emitEvent(Events::CONNECT_CLIENT, m_tcp_endpoint.address().to_string());
 				m_is_tcp_connected = true;
-				m_tcp_socket->async_receive(asio::buffer(m_SocketReadBuffer, SOCKET_BUFFER_SIZE),
-					std::bind(&CAsioSocket::HandlerReceiveFromServer, this,
-						std::placeholders::_1, std::placeholders::_2));
+				if (m_credit_source){
+					m_received_bytes = 0;
+					SendCredit();
+					m_credit_timer->expires_from_now(std::chrono::milliseconds(PACK_CREDIT_PERIOD_MS));
+					m_credit_timer->async_wait(std::bind(&CAsioSocket::HandlerCreditTimer, this, std::placeholders::_1));
+				}
+				StartTcpReceive();
 			}
 			else if (endpoint_iterator != asio::ip::tcp::resolver::iterator()) {
 				m_tcp_socket->close();
@@ -484,13 +920,16 @@ namespace  asionet {
     void CAsioSocket::InitClient(){
         m_is_udp_connected = false;
         m_is_tcp_connected = false;
-        m_pos_last_in_fifo = 0;
         if (m_protocol == asionet::Protocol::UDP) {
             asio::ip::udp::udp::resolver resolver(m_io_service);
             asio::ip::udp::udp::resolver::query query(asio::ip::udp::udp::v4(), m_host, m_port);
             asio::ip::udp::udp::resolver::iterator iter = resolver.resolve(query);
             m_udp_socket = std::make_shared<asio::ip::udp::udp::socket>(m_io_service, asio::ip::udp::udp::endpoint(asio::ip::udp::udp::v4(), 0));
+            asio::error_code error;
+            m_udp_socket->set_option(asio::socket_base::receive_buffer_size(UDP_SOCKET_BUFFER), error);
             m_udp_endpoint = *iter;
+            m_first_pack = true;
+            m_lost_packs = 0;
             m_udp_socket->send_to(asio::buffer("\x01",1),m_udp_endpoint);
             m_callback_Str.emitEvent(Events::CONNECT_CLIENT,m_udp_endpoint.address().to_string());
             m_udp_socket->async_receive_from(
@@ -503,6 +942,8 @@ namespace  asionet {
         if (m_protocol == asionet::Protocol::TCP) {
 
             m_tcp_socket = std::make_shared<asio::ip::tcp::socket>(m_io_service);
+            if (m_credit_source)
+                m_credit_timer = std::make_shared<asio::steady_timer>(m_io_service);
             asio::ip::tcp::resolver resolver(m_io_service);
             asio::ip::tcp::resolver::query query(m_host, m_port);
             asio::ip::tcp::resolver::iterator iter = resolver.resolve(query);
@@ -528,6 +969,10 @@ namespace  asionet {
         this->m_callbackErrorUInt8Int.addListener(_event,_func);
     }
 
+    void CAsioSocket::setPacketPool(CPacketPool::Ptr _pool){
+        m_pack_pool = _pool;
+    }
+
     void CAsioSocket::SendBuffer(const void *_buffer, size_t _size) {
 		try {
 			if (m_protocol == Protocol::UDP) {
@@ -535,7 +980,7 @@ namespace  asionet {
 					m_udp_socket->send_to(asio::buffer(_buffer, _size), m_udp_endpoint);
 			}
 			if (m_protocol == Protocol::TCP) {
-				if (m_tcp_socket->is_open())
+				if (m_tcp_socket && m_tcp_socket->is_open())
 					m_tcp_socket->send(asio::buffer(_buffer, _size));
 			}
 		}
@@ -556,21 +1001,52 @@ namespace  asionet {
                     m_udp_socket->send_to(asio::buffer(_buffer, _size), m_udp_endpoint, 0, _error);
                     this->HandlerSend(_error,_size);
                 } else {
-                    m_udp_socket->async_send_to(asio::buffer(_buffer,_size),m_udp_endpoint,
-                                            std::bind(&CAsioSocket::HandlerSend2, this, std::placeholders::_1 ,std::placeholders::_2,_buffer ));
+                    m_io_service.post([this,_buffer,_size](){
+                        m_send_queue.push_back({_buffer,_size,false});
+                        UpdateQueuePeak(m_send_queue.size());
+                        if (!m_is_sending)
+                            StartNextSend();
+                    });
                 }
                 return  true;
             }
         }
+        if (IsTcpServer()){
+            if (m_tcp_clients_count == 0)
+                return false;
+            if (!async) {
+                for (auto &client : GetClients()){
+                    asio::write(*client->socket, asio::buffer(_buffer, _size), _error);
+                    HandlerSendToClient(_error, _size, client);
+                }
+                return true;
+            }
+            // All clients share the packet, it is released by the last one
+            auto pool = m_pack_pool;
+            shared_ptr<uint8_t> packet(_buffer, [pool](uint8_t *buffer){
+                if (!(pool && pool->release(buffer))){
+                    delete [] buffer;
+                }
+            });
+            m_io_service.post([this,packet,_size](){
+                for (auto &client : GetClients()){
+                    EnqueueToClient(client, packet, _size);
+                }
+            });
+            return true;
+        }
         if (m_protocol == Protocol::TCP){
             if (m_is_tcp_connected  && m_tcp_socket->is_open()) {
                 if (!async) {
                     m_tcp_socket->send(asio::buffer(_buffer, _size), 0, _error);
                     this->HandlerSend(_error,_size);
                 }else {
-                    m_tcp_socket->async_send(asio::buffer(_buffer,_size),
-                                                std::bind(&CAsioSocket::HandlerSend2, this, std::placeholders::_1 ,std::placeholders::_2,_buffer ));
-
+                    m_io_service.post([this,_buffer,_size](){
+                        m_send_queue.push_back({_buffer,_size,false});
+                        UpdateQueuePeak(m_send_queue.size());
+                        if (!m_is_sending)
+                            StartNextSend();
+                    });
                 }
                 return  true;
             }
@@ -579,15 +1055,463 @@ namespace  asionet {
         return false;
     }
 
+    // Blocking gather send: header, both channels and the trailer go out in
+    // one sendmsg without being copied into a contiguous packet first.
+    bool CAsioSocket::SendBuffers(const uint8_t *_header, size_t _header_size, const void *_ch1, size_t _size_ch1, const void *_ch2, size_t _size_ch2, const uint8_t *_trailer, size_t _trailer_size){
+
+        asio::error_code _error;
+        std::array<asio::const_buffer, 4> buffers = {{
+            asio::buffer(_header, _header_size),
+            asio::buffer(_ch1, _ch1 != nullptr ? _size_ch1 : 0),
+            asio::buffer(_ch2, _ch2 != nullptr ? _size_ch2 : 0),
+            asio::buffer(_trailer, _trailer_size)
+        }};
+        size_t size = _header_size + _size_ch1 + _size_ch2 + _trailer_size;
+
+        if (m_protocol == Protocol::UDP){
+            if (m_is_udp_connected && m_udp_socket->is_open()) {
+                m_udp_socket->send_to(buffers, m_udp_endpoint, 0, _error);
+                this->HandlerSend(_error,size);
+                return true;
+            }
+        }
+        if (IsTcpServer()){
+            // Blocking mode, a slow client slows down every other client here
+            auto clients = GetClients();
+            for (auto &client : clients){
+                asio::write(*client->socket, buffers, _error);
+                HandlerSendToClient(_error, size, client);
+            }
+            return !clients.empty();
+        }
+        if (m_protocol == Protocol::TCP){
+            if (m_is_tcp_connected  && m_tcp_socket->is_open()) {
+                asio::write(*m_tcp_socket, buffers, _error);
+                this->HandlerSend(_error,size);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The buffer holds complete packs back to back. It is released like any
+    // other pool buffer once every datagram of the batch has been sent.
+    bool CAsioSocket::SendBatch(send_buffer _buffer, size_t _size){
+        if (m_protocol != Protocol::UDP || !m_is_udp_connected || !m_udp_socket || !m_udp_socket->is_open())
+            return false;
+        m_io_service.post([this,_buffer,_size](){
+            m_send_queue.push_back({_buffer,_size,true});
+            UpdateQueuePeak(m_send_queue.size());
+            if (!m_is_sending)
+                StartNextSend();
+        });
+        return true;
+    }
+
+    size_t CAsioSocket::SendDatagrams(const uint8_t *_buffer, size_t _size, asio::error_code &_error){
+        size_t sent = 0;
+#ifdef __linux__
+        int fd = m_udp_socket->native_handle();
+        const sockaddr *addr = reinterpret_cast<const sockaddr*>(m_udp_endpoint.data());
+        socklen_t addr_len = (socklen_t)m_udp_endpoint.size();
+
+        while (sent < _size){
+            // Collect up to UDP_BATCH_MAX packs, each pack size is in its own header
+            struct iovec iov[UDP_BATCH_MAX];
+            size_t count = 0;
+            size_t chunk = 0;
+            bool same_size = true;
+            while (count < UDP_BATCH_MAX && sent + chunk < _size){
+                const uint8_t *pack = _buffer + sent + chunk;
+                size_t len = ((const uint32_t*)pack)[9];
+                if (len < PACK_HEADER_SIZE || sent + chunk + len > _size){
+                    _error = asio::error::invalid_argument;
+                    return sent;
+                }
+                if (count > 0 && len != iov[0].iov_len)
+                    same_size = false;
+                iov[count].iov_base = const_cast<uint8_t*>(pack);
+                iov[count].iov_len = len;
+                chunk += len;
+                count++;
+            }
+
+            int result = -1;
+#ifdef UDP_SEGMENT
+            // UDP GSO: one contiguous buffer, the kernel cuts it into equal datagrams
+            if (m_udp_gso && same_size && count > 1 && chunk <= 65000){
+                char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+                struct iovec gso_iov = { const_cast<uint8_t*>(_buffer + sent), chunk };
+                struct msghdr msg = {};
+                msg.msg_name = const_cast<sockaddr*>(addr);
+                msg.msg_namelen = addr_len;
+                msg.msg_iov = &gso_iov;
+                msg.msg_iovlen = 1;
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segment = (uint16_t)iov[0].iov_len;
+                memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+                result = ::sendmsg(fd, &msg, 0);
+                if (result >= 0){
+                    sent += chunk;
+                    continue;
+                }
+                if (errno == EINVAL || errno == ENOPROTOOPT || errno == EIO || errno == EOPNOTSUPP){
+                    // Kernel without UDP GSO, stay on sendmmsg from now on
+                    m_udp_gso = false;
+                }
+            }
+#endif
+            struct mmsghdr msgs[UDP_BATCH_MAX];
+            memset(msgs, 0, sizeof(mmsghdr) * count);
+            for (size_t i = 0; i < count; i++){
+                msgs[i].msg_hdr.msg_name = const_cast<sockaddr*>(addr);
+                msgs[i].msg_hdr.msg_namelen = addr_len;
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            size_t done = 0;
+            while (done < count){
+                result = ::sendmmsg(fd, msgs + done, (unsigned int)(count - done), 0);
+                if (result < 0){
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS){
+                        // asio keeps the descriptor non-blocking, wait for room in the socket buffer
+                        struct pollfd pfd = { fd, POLLOUT, 0 };
+                        ::poll(&pfd, 1, 10);
+                        continue;
+                    }
+                    _error = asio::error_code(errno, asio::error::get_system_category());
+                    return sent;
+                }
+                for (int i = 0; i < result; i++)
+                    sent += iov[done + i].iov_len;
+                done += result;
+            }
+        }
+#else
+        while (sent < _size){
+            const uint8_t *pack = _buffer + sent;
+            size_t len = ((const uint32_t*)pack)[9];
+            if (len < PACK_HEADER_SIZE || sent + len > _size){
+                _error = asio::error::invalid_argument;
+                return sent;
+            }
+            m_udp_socket->send_to(asio::buffer(pack, len), m_udp_endpoint, 0, _error);
+            if (_error)
+                return sent;
+            sent += len;
+        }
+#endif
+        return sent;
+    }
+
+    uint64_t CAsioSocket::GetLostPacks(){
+        return m_lost_packs;
+    }
+
+    // Packets are sent one at a time so TCP writes never interleave
+    void CAsioSocket::StartNextSend(){
+        if (m_send_queue.empty()){
+            m_is_sending = false;
+            return;
+        }
+        auto pack = m_send_queue.front();
+        m_is_sending = true;
+        if (m_protocol == Protocol::UDP && m_udp_socket && m_udp_socket->is_open()){
+            if (pack.batch){
+                // Datagram sends do not block for long, the batch goes out in place
+                m_io_service.post([this,pack](){
+                    asio::error_code error;
+                    size_t size = SendDatagrams(pack.buffer, pack.size, error);
+                    HandlerSend2(error, size, pack.buffer);
+                });
+                return;
+            }
+            m_udp_socket->async_send_to(asio::buffer(pack.buffer,pack.size),m_udp_endpoint,
+                                        std::bind(&CAsioSocket::HandlerSend2, this, std::placeholders::_1 ,std::placeholders::_2,pack.buffer ));
+            return;
+        }
+        if (m_protocol == Protocol::TCP && m_tcp_socket && m_tcp_socket->is_open()){
+            asio::async_write(*m_tcp_socket,asio::buffer(pack.buffer,pack.size),
+                              std::bind(&CAsioSocket::HandlerSend2, this, std::placeholders::_1 ,std::placeholders::_2,pack.buffer ));
+            return;
+        }
+        ClearSendQueue();
+    }
+
+    void CAsioSocket::EnqueueToClient(TcpClient::Ptr _client, shared_ptr<uint8_t> _packet, size_t _size){
+        // Past the credit of the client the pack would only wait in the socket buffers
+        if (_client->credit_valid && _client->queued_bytes + _size > _client->credit_limit){
+            ++m_dropped_packs;
+            ++m_throttled_packs;
+            return;
+        }
+        if (_client->queue.size() >= PACK_CLIENT_QUEUE_LIMIT){
+            if (m_backpressure == BackpressurePolicy::DISCONNECT){
+                std::cerr << "[rpsa] Client " << _client->endpoint.address().to_string() << " is too slow, disconnect\n";
+                CloseClient(_client);
+                return;
+            }
+            // The front pack may be in flight, it must complete to keep the stream framed
+            auto oldest = _client->queue.begin();
+            if (_client->is_sending)
+                ++oldest;
+            if (oldest != _client->queue.end()){
+                _client->queued_bytes -= oldest->second;
+                _client->queue.erase(oldest);
+                ++m_dropped_packs;
+            }
+        }
+        _client->queued_bytes += _size;
+        _client->queue.push_back(std::make_pair(_packet,_size));
+        UpdateQueuePeak(_client->queue.size());
+        if (!_client->is_sending)
+            StartClientSend(_client);
+    }
+
+    void CAsioSocket::StartClientSend(TcpClient::Ptr _client){
+        if (_client->queue.empty() || !_client->socket->is_open()){
+            _client->is_sending = false;
+            return;
+        }
+        auto &pack = _client->queue.front();
+        _client->is_sending = true;
+#ifdef __linux__
+        if (_client->zerocopy){
+            // One sendmsg at a time, a partial send continues from the offset
+            _client->socket->async_send(asio::buffer(pack.first.get() + _client->offset, pack.second - _client->offset), MSG_ZEROCOPY,
+                                        std::bind(&CAsioSocket::HandlerClientZeroCopySend, this, std::placeholders::_1 ,std::placeholders::_2, _client));
+            return;
+        }
+#endif
+        asio::async_write(*_client->socket,asio::buffer(pack.first.get() + _client->offset,pack.second - _client->offset),
+                          std::bind(&CAsioSocket::HandlerClientSend, this, std::placeholders::_1 ,std::placeholders::_2, _client));
+    }
+
+    void CAsioSocket::HandlerClientZeroCopySend(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client){
+        if (_client->queue.empty()){
+            HandlerClientSend(_error, _bytesTransferred, _client);
+            return;
+        }
+        auto &pack = _client->queue.front();
+        if (!_error && _bytesTransferred > 0){
+            // Every sendmsg that took data gets the next completion id
+            _client->zc_pending.push_back(std::make_pair(_client->zc_next++, pack.first));
+            _client->offset += _bytesTransferred;
+        }
+        ReapZeroCopy(_client);
+        if (_error == asio::error::no_buffer_space && _client->socket->is_open()){
+            // Out of socket option memory for the pinned pages, the rest goes out copied
+            _client->zerocopy = false;
+            StartClientSend(_client);
+            return;
+        }
+        if (!_error && _client->offset < pack.second){
+            StartClientSend(_client);
+            return;
+        }
+        HandlerClientSend(_error, _client->offset, _client);
+    }
+
+    // Releases the packs of the completed MSG_ZEROCOPY sends. A completion
+    // covers the ids [ee_info, ee_data]. A client whose sends were copied
+    // anyway, on loopback or a NIC without scatter-gather, goes back to
+    // plain sends.
+    void CAsioSocket::ReapZeroCopy(TcpClient::Ptr _client){
+#ifdef __linux__
+        int fd = _client->socket->native_handle();
+        while (!_client->zc_pending.empty()){
+            char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+            msghdr msg = {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+                break;
+            for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)){
+                if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                    continue;
+                auto err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+                if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                    continue;
+                uint32_t first = err->ee_info;
+                uint32_t range = err->ee_data - first;
+                auto &pending = _client->zc_pending;
+                pending.erase(std::remove_if(pending.begin(), pending.end(), [first,range](const pair<uint32_t,shared_ptr<uint8_t>> &_item){
+                    return (uint32_t)(_item.first - first) <= range;
+                }), pending.end());
+                if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                    _client->zerocopy = false;
+            }
+        }
+#endif
+    }
+
+    void CAsioSocket::HandlerClientSend(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client){
+        if (!_client->queue.empty()){
+            _client->queue.pop_front();
+        }
+        _client->offset = 0;
+        _client->is_sending = false;
+        if (!_client->zc_pending.empty())
+            ReapZeroCopy(_client);
+        HandlerSendToClient(_error, _bytesTransferred, _client);
+        if (!_error){
+            StartClientSend(_client);
+        }
+    }
+
+    void CAsioSocket::HandlerSendToClient(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client){
+        m_callback_ErrorInt.emitEvent(Events::SEND_DATA,_error,_bytesTransferred);
+        if (!_error)
+            m_sent_bytes += _bytesTransferred;
+        if (_error){
+            // Only this client goes away, the others keep streaming
+            if (_error != asio::error::operation_aborted){
+                m_io_service.post([this,_client](){ CloseClient(_client); });
+            }
+        }
+    }
+
+    void CAsioSocket::CloseClient(TcpClient::Ptr _client){
+        {
+            std::lock_guard<std::mutex> lock(m_tcp_clients_mtx);
+            auto it = std::find(m_tcp_clients.begin(), m_tcp_clients.end(), _client);
+            if (it == m_tcp_clients.end())
+                return;
+            m_tcp_clients.erase(it);
+            m_tcp_clients_count = m_tcp_clients.size();
+        }
+        m_callback_Str.emitEvent(Events::DISCONNECT_SERVER, _client->endpoint.address().to_string());
+        asio::error_code error;
+        ReapZeroCopy(_client);
+        if (!_client->zc_pending.empty()){
+            // The reset drops the pinned pages with the unsent data, the packs may go back to the pool
+            _client->socket->set_option(asio::socket_base::linger(true, 0), error);
+            _client->zc_pending.clear();
+        }
+        _client->socket->close(error);
+        // A send still in flight completes with operation_aborted and drops its reference
+        if (_client->is_sending){
+            while (_client->queue.size() > 1)
+                _client->queue.pop_back();
+        }else{
+            _client->queue.clear();
+        }
+    }
+
+    void CAsioSocket::StartClientReceive(TcpClient::Ptr _client){
+        _client->socket->async_read_some(asio::buffer(_client->rx.data() + _client->rx_size, _client->rx.size() - _client->rx_size),
+                                         std::bind(&CAsioSocket::HandlerClientReceive, this, std::placeholders::_1, std::placeholders::_2, _client));
+    }
+
+    // Clients that never send credit are not throttled. Anything that is
+    // not a credit message, like the single byte older clients send on
+    // stop, is skipped.
+    void CAsioSocket::HandlerClientReceive(const asio::error_code &_error, size_t _bytesTransferred, TcpClient::Ptr _client){
+        if (_error == asio::error::operation_aborted)
+            return; // Client closed
+        if (_error){
+            // The client went away, no need to wait for a send to fail
+            CloseClient(_client);
+            return;
+        }
+        _client->rx_size += _bytesTransferred;
+        uint8_t *rx = _client->rx.data();
+        size_t pos = 0;
+        while (_client->rx_size - pos >= PACK_CREDIT_SIZE){
+            if (memcmp(rx + pos, ID_CREDIT, 16) != 0){
+                pos++;
+                continue;
+            }
+            uint64_t received, window;
+            memcpy(&received, rx + pos + 16, sizeof(uint64_t));
+            memcpy(&window, rx + pos + 24, sizeof(uint64_t));
+            _client->credit_valid = true;
+            _client->credit_limit = received + window;
+            pos += PACK_CREDIT_SIZE;
+        }
+        memmove(rx, rx + pos, _client->rx_size - pos);
+        _client->rx_size -= pos;
+        StartClientReceive(_client);
+    }
+
+    void CAsioSocket::setCreditSource(std::function<uint64_t()> _source){
+        m_credit_source = _source;
+    }
+
+    void CAsioSocket::setBackpressurePolicy(BackpressurePolicy _policy){
+        m_backpressure = _policy;
+    }
+
+    // Packs to TCP clients are sent with MSG_ZEROCOPY, the pool buffer is
+    // recycled on the completion from the kernel instead of on the send
+    void CAsioSocket::setZeroCopy(bool _enable){
+        m_zerocopy = _enable;
+    }
+
+    size_t CAsioSocket::GetClientsCount(){
+        return m_tcp_clients_count;
+    }
+
+    uint64_t CAsioSocket::GetDroppedPacks(){
+        return m_dropped_packs;
+    }
+
+    uint64_t CAsioSocket::GetThrottledPacks(){
+        return m_throttled_packs;
+    }
+
+    uint64_t CAsioSocket::GetSentBytes(){
+        return m_sent_bytes;
+    }
+
+    size_t CAsioSocket::GetQueuePeak(){
+        return m_queue_peak;
+    }
+
+    // Queues are only touched from the asio thread, a plain compare is enough
+    void CAsioSocket::UpdateQueuePeak(size_t _size){
+        if (_size > m_queue_peak)
+            m_queue_peak = _size;
+    }
+
+    void CAsioSocket::ReleaseSendBuffer(uint8_t *buffer){
+        if (!(m_pack_pool && m_pack_pool->release(buffer))){
+            delete [] buffer;
+        }
+    }
+
+    void CAsioSocket::ClearSendQueue(){
+        for(auto &pack : m_send_queue){
+            ReleaseSendBuffer(pack.buffer);
+        }
+        m_send_queue.clear();
+        m_is_sending = false;
+    }
+
     void CAsioSocket::HandlerSend2(const asio::error_code &_error, size_t _bytesTransferred, uint8_t *buffer){
+        if (!m_send_queue.empty() && m_send_queue.front().buffer == buffer){
+            m_send_queue.pop_front();
+        }
+        ReleaseSendBuffer(buffer);
         HandlerSend(_error,_bytesTransferred);
-        delete buffer;
+        if (_error){
+            ClearSendQueue();
+        }else{
+            StartNextSend();
+        }
     }
     void CAsioSocket::HandlerSend(const asio::error_code &_error, size_t _bytesTransferred){
 
         m_callback_ErrorInt.emitEvent(Events::SEND_DATA,_error,_bytesTransferred);
         if (!_error){
-            // MODIFY LATER
+            m_sent_bytes += _bytesTransferred;
 
         } else if ((_error == asio::error::eof) || (_error == asio::error::connection_reset) ||
                 _error == asio::error::broken_pipe) {
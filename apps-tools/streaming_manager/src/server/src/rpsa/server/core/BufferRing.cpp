@@ -0,0 +1,75 @@
+#include <cstdlib>
+#include "rpsa/server/core/BufferRing.h"
+
+#ifdef OS_MACOS
+#   include "rpsa/common/core/aligned_alloc.h"
+#endif // OS_MACOS
+
+// Same alignment as the old write buffers, memcpy_neon and the pack kernels rely on it
+#define BUFFER_RING_ALIGN 64
+
+CBufferRing::Ptr CBufferRing::Create(size_t _depth, size_t _bufferSize){
+    return std::make_shared<CBufferRing>(_depth, _bufferSize);
+}
+
+CBufferRing::CBufferRing(size_t _depth, size_t _bufferSize):
+    m_slots(_depth > 0 ? _depth : 1),
+    m_head(0),
+    m_tail(0),
+    m_peak(0)
+{
+    auto size = (_bufferSize + BUFFER_RING_ALIGN - 1) & ~(size_t)(BUFFER_RING_ALIGN - 1);
+    for (auto &slot : m_slots){
+        slot.ch1 = aligned_alloc(BUFFER_RING_ALIGN, size);
+        slot.ch2 = aligned_alloc(BUFFER_RING_ALIGN, size);
+        slot.size_ch1 = 0;
+        slot.size_ch2 = 0;
+        slot.lostRate = 0;
+        slot.sampleId = 0;
+    }
+}
+
+CBufferRing::~CBufferRing(){
+    for (auto &slot : m_slots){
+        free(slot.ch1);
+        free(slot.ch2);
+    }
+}
+
+CBufferRing::Slot *CBufferRing::writeSlot(){
+    auto head = m_head.load(std::memory_order_relaxed);
+    auto tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail >= m_slots.size())
+        return nullptr;
+    return &m_slots[head % m_slots.size()];
+}
+
+void CBufferRing::commitWrite(){
+    auto head = m_head.load(std::memory_order_relaxed) + 1;
+    m_head.store(head, std::memory_order_release);
+    auto used = head - m_tail.load(std::memory_order_acquire);
+    if (used > m_peak)
+        m_peak = used;
+}
+
+void CBufferRing::dropOldest(){
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (m_head.load(std::memory_order_relaxed) != tail)
+        m_tail.store(tail + 1, std::memory_order_release);
+}
+
+CBufferRing::Slot *CBufferRing::readSlot(){
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    auto head = m_head.load(std::memory_order_acquire);
+    if (tail == head)
+        return nullptr;
+    return &m_slots[tail % m_slots.size()];
+}
+
+void CBufferRing::commitRead(){
+    m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+size_t CBufferRing::count() const{
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
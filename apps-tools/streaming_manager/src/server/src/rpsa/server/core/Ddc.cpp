@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "rpsa/server/core/Ddc.h"
+
+#ifdef ARCH_ARM
+#include <arm_neon.h>
+#endif
+
+namespace {
+    // Newest sample last, _length is a multiple of 4
+    inline float Dot(const float *_x, const float *_h, size_t _length){
+#ifdef ARCH_ARM
+        float32x4_t acc0 = vdupq_n_f32(0);
+        float32x4_t acc1 = vdupq_n_f32(0);
+        size_t i = 0;
+        for (; i + 8 <= _length; i += 8){
+            acc0 = vmlaq_f32(acc0, vld1q_f32(_x + i), vld1q_f32(_h + i));
+            acc1 = vmlaq_f32(acc1, vld1q_f32(_x + i + 4), vld1q_f32(_h + i + 4));
+        }
+        if (i < _length)
+            acc0 = vmlaq_f32(acc0, vld1q_f32(_x + i), vld1q_f32(_h + i));
+        float32x4_t sum = vaddq_f32(acc0, acc1);
+        float32x2_t pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+        return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+        float acc = 0;
+        for (size_t i = 0; i < _length; i++)
+            acc += _x[i] * _h[i];
+        return acc;
+#endif
+    }
+}
+
+CDdc::Ptr CDdc::Create(const DdcT &_settings, double _sampleRate){
+    return std::make_shared<CDdc>(_settings, _sampleRate);
+}
+
+CDdc::CDdc(const DdcT &_settings, double _sampleRate):
+    m_settings(_settings),
+    m_sampleRate(_sampleRate),
+    m_step(0),
+    m_cycle(0),
+    m_next(0),
+    m_outIndex(0)
+{
+    m_settings.channel = m_settings.channel == 2 ? 2 : 1;
+    m_settings.decimation = std::min(std::max(m_settings.decimation, (uint32_t)2), (uint32_t)DDC_MAX_DECIMATION);
+    m_settings.tapsPerPhase = std::max(m_settings.tapsPerPhase, (uint32_t)1);
+    m_settings.cutoff = std::min(std::max(m_settings.cutoff, 0.01), 1.0);
+    m_step = m_settings.frequency / m_sampleRate;
+    m_step -= std::floor(m_step);
+
+    // Blackman windowed sinc, the images of strong signals outside the band stay below the 16-bit noise
+    const size_t length = std::min<size_t>((size_t)m_settings.decimation * m_settings.tapsPerPhase + 1, DDC_MAX_TAPS - 3);
+    const double fc = m_settings.cutoff * 0.5 / m_settings.decimation;
+    std::vector<double> h(length);
+    double sum = 0;
+    for (size_t n = 0; n < length; n++){
+        double t = n - (length - 1) / 2.0;
+        double x = length > 1 ? 2 * M_PI * n / (length - 1) : 0;
+        double w = length > 1 ? 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2 * x) : 1;
+        h[n] = (t == 0 ? 2 * fc : std::sin(2 * M_PI * fc * t) / (M_PI * t)) * w;
+        sum += h[n];
+    }
+    // Unity gain at DC, the mixer halves the amplitude and the counts go to full scale
+    const double scale = 2.0 / 32768.0 / sum;
+    size_t padded = (length + 3) / 4 * 4;
+    m_taps.assign(padded, 0.0f);
+    for (size_t n = 0; n < length; n++){
+        m_taps[padded - 1 - n] = (float)(h[n] * scale);
+    }
+    reset();
+}
+
+void CDdc::reset(){
+    for (auto &history : m_history){
+        history.assign(m_taps.size() - 1, 0.0f);
+    }
+    m_cycle = 0;
+    m_next = 0;
+    m_outIndex = 0;
+}
+
+uint64_t CDdc::advance(uint64_t _count){
+    uint64_t outs = 0;
+    if (m_next < _count){
+        outs = (_count - m_next - 1) / m_settings.decimation + 1;
+    }
+    m_next = m_next + outs * m_settings.decimation - _count;
+    m_outIndex += outs;
+    return outs;
+}
+
+void CDdc::skip(uint64_t _count){
+    for (auto &history : m_history){
+        std::fill(history.begin(), history.end(), 0.0f);
+    }
+    double cycles = (double)_count * m_step;
+    m_cycle += cycles - std::floor(cycles);
+    m_cycle -= std::floor(m_cycle);
+    advance(_count);
+}
+
+size_t CDdc::process(const int16_t *_in, size_t _count, float *_out_i, float *_out_q){
+    const size_t length = m_taps.size();
+    const size_t kept = length - 1;
+    const double rot_c = std::cos(2 * M_PI * m_step);
+    const double rot_s = std::sin(2 * M_PI * m_step);
+    auto &hist_i = m_history[0];
+    auto &hist_q = m_history[1];
+    hist_i.resize(kept + _count);
+    hist_q.resize(kept + _count);
+    float *mix_i = hist_i.data() + kept;
+    float *mix_q = hist_q.data() + kept;
+
+    // The phasor runs in double over a block, float would drift within a few thousand steps
+    for (size_t i = 0; i < _count; i += DDC_BLOCK){
+        size_t n = std::min((size_t)DDC_BLOCK, _count - i);
+        double c = std::cos(2 * M_PI * m_cycle);
+        double s = std::sin(2 * M_PI * m_cycle);
+        for (size_t k = 0; k < n; k++){
+            double x = _in[i + k];
+            mix_i[i + k] = (float)(x * c);
+            mix_q[i + k] = (float)(-x * s);
+            double t = c * rot_c - s * rot_s;
+            s = s * rot_c + c * rot_s;
+            c = t;
+        }
+        m_cycle += n * m_step;
+        m_cycle -= std::floor(m_cycle);
+    }
+
+    const float *h = m_taps.data();
+    size_t outs = 0;
+    // The window of the input sample i starts at i in the history
+    for (size_t i = m_next; i < _count; i += m_settings.decimation){
+        _out_i[outs] = Dot(hist_i.data() + i, h, length);
+        _out_q[outs] = Dot(hist_q.data() + i, h, length);
+        outs++;
+    }
+    for (auto &history : m_history){
+        memmove(history.data(), history.data() + _count, kept * sizeof(float));
+        history.resize(kept);
+    }
+    advance(_count);
+    return outs;
+}
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "rpsa/server/core/Decimator.h"
+
+#ifdef ARCH_ARM
+#include <arm_neon.h>
+#endif
+
+namespace {
+    double Window(DecimatorT::Filter _filter, size_t _n, size_t _length){
+        if (_length < 2)
+            return 1;
+        double x = 2 * M_PI * _n / (_length - 1);
+        switch (_filter){
+            case DecimatorT::HAMMING:
+                return 0.54 - 0.46 * std::cos(x);
+            case DecimatorT::BLACKMAN:
+                return 0.42 - 0.5 * std::cos(x) + 0.08 * std::cos(2 * x);
+            default:
+                return 1;
+        }
+    }
+
+    inline int16_t Round(int64_t _acc){
+        int64_t y = (_acc + (1 << 14)) >> 15;
+        return (int16_t)std::min<int64_t>(std::max<int64_t>(y, INT16_MIN), INT16_MAX);
+    }
+
+    // Newest sample last, _length is a multiple of 8
+    inline int16_t Dot(const int16_t *_x, const int16_t *_h, size_t _length){
+#ifdef ARCH_ARM
+        int32x4_t acc0 = vdupq_n_s32(0);
+        int32x4_t acc1 = vdupq_n_s32(0);
+        for (size_t i = 0; i < _length; i += 8){
+            int16x8_t x = vld1q_s16(_x + i);
+            int16x8_t h = vld1q_s16(_h + i);
+            acc0 = vmlal_s16(acc0, vget_low_s16(x), vget_low_s16(h));
+            acc1 = vmlal_s16(acc1, vget_high_s16(x), vget_high_s16(h));
+        }
+        int64x2_t sum = vaddq_s64(vpaddlq_s32(acc0), vpaddlq_s32(acc1));
+        return Round(vgetq_lane_s64(sum, 0) + vgetq_lane_s64(sum, 1));
+#else
+        int64_t acc = 0;
+        for (size_t i = 0; i < _length; i++)
+            acc += (int32_t)_x[i] * _h[i];
+        return Round(acc);
+#endif
+    }
+}
+
+CDecimator::Ptr CDecimator::Create(const DecimatorT &_settings){
+    return std::make_shared<CDecimator>(_settings);
+}
+
+CDecimator::CDecimator(const DecimatorT &_settings):
+    m_settings(_settings),
+    m_next(0),
+    m_outIndex(0)
+{
+    m_settings.factor = std::min(std::max(m_settings.factor, (uint32_t)2), (uint32_t)DECIMATOR_MAX_FACTOR);
+    m_settings.tapsPerPhase = std::max(m_settings.tapsPerPhase, (uint32_t)1);
+    m_settings.cutoff = std::min(std::max(m_settings.cutoff, 0.01), 1.0);
+
+    size_t length = m_settings.factor;
+    if (m_settings.filter != DecimatorT::BOXCAR)
+        length = std::min<size_t>((size_t)m_settings.factor * m_settings.tapsPerPhase + 1, DECIMATOR_MAX_TAPS - 7);
+    // Cutoff in cycles per input sample
+    const double fc = m_settings.cutoff * 0.5 / m_settings.factor;
+    std::vector<double> h(length);
+    double sum = 0;
+    for (size_t n = 0; n < length; n++){
+        if (m_settings.filter == DecimatorT::BOXCAR){
+            h[n] = 1;
+        }else{
+            double t = n - (length - 1) / 2.0;
+            h[n] = (t == 0 ? 2 * fc : std::sin(2 * M_PI * fc * t) / (M_PI * t)) * Window(m_settings.filter, n, length);
+        }
+        sum += h[n];
+    }
+    // Unity gain at DC after the rounding, the rest goes to the largest tap
+    std::vector<int32_t> q(length);
+    int32_t total = 0;
+    size_t peak = 0;
+    for (size_t n = 0; n < length; n++){
+        q[n] = (int32_t)std::lround(h[n] / sum * 32768.0);
+        total += q[n];
+        if (std::abs(q[n]) > std::abs(q[peak]))
+            peak = n;
+    }
+    q[peak] += 32768 - total;
+
+    size_t padded = (length + 7) / 8 * 8;
+    m_taps.assign(padded, 0);
+    for (size_t n = 0; n < length; n++){
+        m_taps[padded - 1 - n] = (int16_t)std::min<int32_t>(std::max<int32_t>(q[n], INT16_MIN), INT16_MAX);
+    }
+    reset();
+}
+
+void CDecimator::reset(){
+    for (auto &history : m_history){
+        history.assign(m_taps.size() - 1, 0);
+    }
+    m_next = 0;
+    m_outIndex = 0;
+}
+
+uint64_t CDecimator::advance(uint64_t _count){
+    uint64_t outs = 0;
+    if (m_next < _count){
+        outs = (_count - m_next - 1) / m_settings.factor + 1;
+    }
+    m_next = m_next + outs * m_settings.factor - _count;
+    m_outIndex += outs;
+    return outs;
+}
+
+void CDecimator::skip(uint64_t _count){
+    for (auto &history : m_history){
+        std::fill(history.begin(), history.end(), 0);
+    }
+    advance(_count);
+}
+
+size_t CDecimator::filter(std::vector<int16_t> &_history, const int16_t *_in, size_t _count, int16_t *_out){
+    const size_t length = m_taps.size();
+    const size_t kept = length - 1;
+    _history.resize(kept + _count);
+    memcpy(_history.data() + kept, _in, _count * sizeof(int16_t));
+    const int16_t *x = _history.data();
+    const int16_t *h = m_taps.data();
+    size_t outs = 0;
+    // The window of the input sample i starts at i in the history
+    for (size_t i = m_next; i < _count; i += m_settings.factor){
+        _out[outs++] = Dot(x + i, h, length);
+    }
+    memmove(_history.data(), _history.data() + _count, kept * sizeof(int16_t));
+    _history.resize(kept);
+    return outs;
+}
+
+size_t CDecimator::process(const int16_t *_in_ch1, const int16_t *_in_ch2, size_t _count, int16_t *_out_ch1, int16_t *_out_ch2){
+    if (_in_ch1 != nullptr)
+        filter(m_history[0], _in_ch1, _count, _out_ch1);
+    if (_in_ch2 != nullptr)
+        filter(m_history[1], _in_ch2, _count, _out_ch2);
+    return advance(_count);
+}
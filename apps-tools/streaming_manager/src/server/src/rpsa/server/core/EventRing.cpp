@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include "rpsa/server/core/EventRing.h"
+
+// A slot is written as four words between two sequence stores. The sequence
+// is odd while the writer is in the slot and 2 * (index + 1) once it is done.
+struct CEventRing::Slot{
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> words[4];
+};
+
+class CEventRing::Ring{
+public:
+    Ring(size_t _depth, uint16_t _index):
+        m_slots(new Slot[_depth]),
+        m_mask(_depth - 1),
+        m_index(_index),
+        m_head(0),
+        m_from(0),
+        m_owned(true)
+    {
+        for (size_t i = 0; i < _depth; i++){
+            m_slots[i].seq.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Owning thread only
+    void push(uint64_t _time, uint16_t _type, uint64_t _a, uint64_t _b){
+        uint64_t index = m_head.load(std::memory_order_relaxed);
+        Slot &slot = m_slots[index & m_mask];
+        slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.words[0].store(_time, std::memory_order_relaxed);
+        slot.words[1].store(((uint64_t)m_index << 16) | _type, std::memory_order_relaxed);
+        slot.words[2].store(_a, std::memory_order_relaxed);
+        slot.words[3].store(_b, std::memory_order_relaxed);
+        slot.seq.store(2 * index + 2, std::memory_order_release);
+        m_head.store(index + 1, std::memory_order_release);
+    }
+
+    void collect(std::vector<Event> &_events){
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t first = head > m_mask + 1 ? head - m_mask - 1 : 0;
+        first = std::max(first, m_from.load(std::memory_order_relaxed));
+        for (uint64_t index = first; index < head; index++){
+            Slot &slot = m_slots[index & m_mask];
+            if (slot.seq.load(std::memory_order_acquire) != 2 * index + 2)
+                continue;
+            uint64_t words[4];
+            for (int i = 0; i < 4; i++)
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // overwritten while it was copied
+            if (slot.seq.load(std::memory_order_relaxed) != 2 * index + 2)
+                continue;
+            Event event;
+            event.time_ns = words[0];
+            event.type = words[1] & 0xFFFF;
+            event.thread = (words[1] >> 16) & 0xFFFF;
+            event.reserved = 0;
+            event.value.a = words[2];
+            event.value.b = words[3];
+            _events.push_back(event);
+        }
+    }
+
+    void clear(){
+        m_from.store(m_head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> &owned() { return m_owned; }
+
+private:
+    std::unique_ptr<Slot[]> m_slots;
+    uint64_t                m_mask;
+    uint16_t                m_index;
+    std::atomic<uint64_t>   m_head;
+    std::atomic<uint64_t>   m_from;
+    std::atomic<bool>       m_owned;
+};
+
+namespace {
+    std::mutex &RegistryLock(){
+        static std::mutex lock;
+        return lock;
+    }
+
+    std::vector<std::unique_ptr<CEventRing::Ring>> &Registry(){
+        static std::vector<std::unique_ptr<CEventRing::Ring>> rings;
+        return rings;
+    }
+
+    // Hands the ring back when the thread ends, its events stay readable
+    struct ThreadSlot{
+        CEventRing::Ring *ring = nullptr;
+        ~ThreadSlot(){
+            if (ring)
+                ring->owned().store(false, std::memory_order_release);
+        }
+    };
+
+    thread_local ThreadSlot t_slot;
+
+    size_t RoundDepth(size_t _events){
+        size_t depth = 16;
+        while (depth < _events && depth < (1u << 24))
+            depth <<= 1;
+        return depth;
+    }
+}
+
+std::atomic<bool>   CEventRing::s_enabled(true);
+std::atomic<size_t> CEventRing::s_depth(EVENT_RING_DEFAULT_DEPTH);
+
+void CEventRing::SetEnabled(bool _enable){
+    s_enabled.store(_enable, std::memory_order_relaxed);
+}
+
+void CEventRing::SetDepth(size_t _events){
+    s_depth.store(RoundDepth(_events), std::memory_order_relaxed);
+}
+
+uint64_t CEventRing::Now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CEventRing::Ring *CEventRing::ThreadRing(){
+    if (t_slot.ring)
+        return t_slot.ring;
+    std::lock_guard<std::mutex> lock(RegistryLock());
+    auto &rings = Registry();
+    for (auto &ring : rings){
+        bool owned = false;
+        if (ring->owned().compare_exchange_strong(owned, true)){
+            t_slot.ring = ring.get();
+            return t_slot.ring;
+        }
+    }
+    if (rings.size() > 0xFFFF)
+        return nullptr;
+    rings.emplace_back(new Ring(s_depth.load(std::memory_order_relaxed), rings.size()));
+    t_slot.ring = rings.back().get();
+    return t_slot.ring;
+}
+
+void CEventRing::Record(Type _type, uint64_t _a, uint64_t _b){
+    if (!IsEnabled())
+        return;
+    Ring *ring = ThreadRing();
+    if (ring)
+        ring->push(Now(), _type, _a, _b);
+}
+
+void CEventRing::Message(Type _type, const char *_text){
+    if (!IsEnabled() || _text == nullptr)
+        return;
+    uint64_t words[2] = {0, 0};
+    memcpy(words, _text, strnlen(_text, EVENT_RING_TEXT));
+    Record(_type, words[0], words[1]);
+}
+
+std::vector<CEventRing::Event> CEventRing::Collect(){
+    std::vector<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(RegistryLock());
+        for (auto &ring : Registry())
+            ring->collect(events);
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Event &_a, const Event &_b){ return _a.time_ns < _b.time_ns; });
+    return events;
+}
+
+bool CEventRing::Write(std::ostream &_out){
+    auto events = Collect();
+    uint32_t header[2] = { sizeof(Event), (uint32_t)events.size() };
+    _out.write("RPEVT001", 8);
+    _out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (!events.empty())
+        _out.write(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(Event));
+    return _out.good();
+}
+
+bool CEventRing::DumpToFile(const std::string &_path){
+    std::ofstream out(_path, std::ios_base::binary | std::ios_base::trunc);
+    return out.is_open() && Write(out);
+}
+
+void CEventRing::Clear(){
+    std::lock_guard<std::mutex> lock(RegistryLock());
+    for (auto &ring : Registry())
+        ring->clear();
+}
@@ -19,7 +19,11 @@ m_fileSystemLostRate(0),
 m_reciveData(0),
 m_reciveData_ch1(0),
 m_reciveData_ch2(0),
-m_old_id(0)
+m_old_id(0),
+m_queueDepthMax(0),
+m_queueBytesMax(0),
+m_queueBudget(0),
+m_queueOverflows(0)
 {
     ResetCounters();
 }
@@ -37,6 +41,10 @@ void CFileLogger::ResetCounters(){
     m_reciveData_ch1 = 0;
     m_reciveData_ch2 = 0;
     m_oscRate = 0;
+    m_queueDepthMax = 0;
+    m_queueBytesMax = 0;
+    m_queueBudget = 0;
+    m_queueOverflows = 0;
 }
 
 void CFileLogger::AddMetric(CFileLogger::Metric _metric, uint64_t _value){
@@ -70,6 +78,24 @@ void CFileLogger::AddMetric(CFileLogger::Metric _metric, uint64_t _value){
             m_reciveData_ch2 += _value;
         break;
 
+        case Metric::QUEUE_DEPTH:
+            if (_value > m_queueDepthMax)
+                m_queueDepthMax = _value;
+        break;
+
+        case Metric::QUEUE_BYTES:
+            if (_value > m_queueBytesMax)
+                m_queueBytesMax = _value;
+        break;
+
+        case Metric::QUEUE_BUDGET:
+            m_queueBudget = _value;
+        break;
+
+        case Metric::QUEUE_OVERFLOWS:
+            m_queueOverflows = _value;
+        break;
+
         default:
         break;
     }
@@ -119,6 +145,11 @@ void CFileLogger::DumpToFile(){
         log << "\t-" << m_reciveData_ch2 << "b \n";
         log << "\t-" << m_reciveData_ch2 / 1024 << "kb \n";
         log << "\t-" << m_reciveData_ch2 / (1024 * 1024) << "Mb \n";
+        log << "\n";
+        log << "Maximum depth of file write queue:\t" << m_queueDepthMax << "\n";
+        log << "Maximum data in file write queue:\t" << m_queueBytesMax / 1024 << "kb \n";
+        log << "Memory budget of file write queue:\t" << m_queueBudget / 1024 << "kb \n";
+        log << "File write queue reached its budget:\t" << m_queueOverflows << " times\n";
     }
     catch (std::exception& e)
 	{
@@ -0,0 +1,75 @@
+#include <iomanip>
+#include "rpsa/server/core/LatencyHistogram.h"
+
+namespace {
+    unsigned BucketOf(uint64_t _us){
+        unsigned bucket = 0;
+        while (_us != 0 && bucket < LATENCY_HISTOGRAM_BUCKETS - 1){
+            _us >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+}
+
+CLatencyHistogram::CLatencyHistogram(){
+    reset();
+}
+
+void CLatencyHistogram::add(uint64_t _us){
+    m_buckets[BucketOf(_us)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(_us, std::memory_order_relaxed);
+    if (_us > m_max.load(std::memory_order_relaxed))
+        m_max.store(_us, std::memory_order_relaxed);
+}
+
+void CLatencyHistogram::reset(){
+    for (auto &bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t CLatencyHistogram::count() const{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t CLatencyHistogram::max() const{
+    return m_max.load(std::memory_order_relaxed);
+}
+
+double CLatencyHistogram::mean() const{
+    auto count = this->count();
+    return count ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / count : 0;
+}
+
+uint64_t CLatencyHistogram::percentile(double _p) const{
+    auto count = this->count();
+    if (count == 0)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(_p * (count - 1));
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++){
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank)
+            return i == 0 ? 0 : (UINT64_C(1) << i) - 1;
+    }
+    return max();
+}
+
+void CLatencyHistogram::print(std::ostream &_out, const std::string &_name) const{
+    _out << std::left << std::setw(24) << _name << std::right
+         << " n " << std::setw(8) << count()
+         << " mean " << std::setw(8) << std::fixed << std::setprecision(1) << mean()
+         << " p50 <" << std::setw(7) << percentile(0.5) + 1
+         << " p99 <" << std::setw(7) << percentile(0.99) + 1
+         << " max " << std::setw(8) << max() << " us\n";
+    for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++){
+        auto n = m_buckets[i].load(std::memory_order_relaxed);
+        if (n == 0)
+            continue;
+        _out << "    < " << std::setw(10) << (UINT64_C(1) << i) << " us " << std::setw(10) << n << "\n";
+    }
+}
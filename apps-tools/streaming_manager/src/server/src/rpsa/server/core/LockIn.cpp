@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cmath>
+#include "rpsa/server/core/LockIn.h"
+
+CLockIn::Ptr CLockIn::Create(const LockInT &_settings, double _sampleRate){
+    return std::make_shared<CLockIn>(_settings, _sampleRate);
+}
+
+CLockIn::CLockIn(const LockInT &_settings, double _sampleRate):
+    m_settings(_settings),
+    m_sampleRate(_sampleRate),
+    m_step(0),
+    m_cycle(0),
+    m_alpha(1),
+    m_decCount(0),
+    m_outIndex(0)
+{
+    m_settings.order = std::min(std::max(m_settings.order, 1), LOCKIN_MAX_ORDER);
+    m_settings.decimation = std::max(m_settings.decimation, (uint32_t)2);
+    m_step = m_settings.frequency / m_sampleRate;
+    m_step -= std::floor(m_step);
+    // Exact step response of an RC stage sampled at the input rate
+    if (m_settings.timeConstant > 0)
+        m_alpha = 1.0 - std::exp(-1.0 / (m_settings.timeConstant * m_sampleRate));
+    reset();
+}
+
+void CLockIn::reset(){
+    std::fill(m_x, m_x + LOCKIN_MAX_ORDER, 0.0);
+    std::fill(m_y, m_y + LOCKIN_MAX_ORDER, 0.0);
+    m_cycle = 0;
+    m_decCount = 0;
+    m_outIndex = 0;
+}
+
+size_t CLockIn::process(const int16_t *_in, size_t _count, float *_out_ch1, float *_out_ch2){
+    // X = 2 * LP(x * cos), Y = -2 * LP(x * sin) gives R * exp(j * theta) for x = R * cos(wt + theta)
+    const double scale = 2.0 / 32768.0;
+    const double phase = m_settings.phase * M_PI / 180.0;
+    const double rot_c = std::cos(2 * M_PI * m_step);
+    const double rot_s = std::sin(2 * M_PI * m_step);
+    const double alpha = m_alpha;
+    const int order = m_settings.order;
+    const uint32_t decimation = m_settings.decimation;
+    size_t outs = 0;
+
+    // The filter state lives in double, with long time constants alpha is
+    // far below the float resolution of the state
+    for (size_t i = 0; i < _count; i += LOCKIN_BLOCK){
+        size_t n = std::min((size_t)LOCKIN_BLOCK, _count - i);
+        double c = std::cos(2 * M_PI * m_cycle + phase);
+        double s = std::sin(2 * M_PI * m_cycle + phase);
+        for (size_t k = 0; k < n; k++){
+            double x = _in[i + k];
+            double xi = x * c;
+            double xq = -x * s;
+            double t = c * rot_c - s * rot_s;
+            s = s * rot_c + c * rot_s;
+            c = t;
+            for (int st = 0; st < order; st++){
+                m_x[st] += alpha * (xi - m_x[st]);
+                m_y[st] += alpha * (xq - m_y[st]);
+                xi = m_x[st];
+                xq = m_y[st];
+            }
+            if (++m_decCount < decimation)
+                continue;
+            m_decCount = 0;
+            double out_x = xi * scale;
+            double out_y = xq * scale;
+            if (m_settings.polar){
+                _out_ch1[outs] = (float)std::hypot(out_x, out_y);
+                _out_ch2[outs] = (float)(std::atan2(out_y, out_x) * 180.0 / M_PI);
+            }else{
+                _out_ch1[outs] = (float)out_x;
+                _out_ch2[outs] = (float)out_y;
+            }
+            outs++;
+        }
+        m_cycle += n * m_step;
+        m_cycle -= std::floor(m_cycle);
+    }
+    m_outIndex += outs;
+    return outs;
+}
+
+void CLockIn::skip(uint64_t _count){
+    double cycles = (double)_count * m_step;
+    m_cycle += cycles - std::floor(cycles);
+    m_cycle -= std::floor(m_cycle);
+    uint64_t total = m_decCount + _count;
+    m_outIndex += total / m_settings.decimation;
+    m_decCount = total % m_settings.decimation;
+}
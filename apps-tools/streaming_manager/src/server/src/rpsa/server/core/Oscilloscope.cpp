@@ -12,6 +12,12 @@
 #include <fstream>
 #include <functional>
 #include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#ifdef OS_MACOS
+#   include "rpsa/common/core/aligned_alloc.h"
+#endif // OS_MACOS
 
 namespace
 {
@@ -27,9 +33,112 @@ void * MmapNumber(int _fd, size_t _size, size_t _number) {
     const size_t offset = _number * getpagesize();
     return mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, offset);
 }
+
+// Two instances on one u-dma-buf share its sync_offset attribute
+std::mutex g_SyncMutex;
+
+//!
+//!@brief A u-dma-buf buffer, mapped cached, with its sync attributes.
+//!
+struct DmaBufT
+{
+    int fd = -1;
+    int offsetFd = -1;
+    int forCpuFd = -1;
+    int forDeviceFd = -1;
+    void *buffer = MAP_FAILED;
+    size_t size = 0;
+    uint64_t physAddr = 0;
+};
+
+bool ReadSysfs(const std::string &_path, uint64_t &_value) {
+    std::ifstream file(_path);
+    std::string text;
+    if (!(file >> text))
+        return false;
+    char *end = nullptr;
+    _value = strtoull(text.c_str(), &end, 0);
+    return end != text.c_str();
+}
+
+// Attributes are parsed as a whole, every write starts at offset 0
+bool WriteSysfs(int _fd, uint64_t _value) {
+    char text[24];
+    int len = snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(_value));
+    return pwrite(_fd, text, len, 0) == len;
+}
+
+bool WriteSysfs(const std::string &_path, uint64_t _value) {
+    int fd = open(_path.c_str(), O_WRONLY);
+    if (fd == -1)
+        return false;
+    bool ok = WriteSysfs(fd, _value);
+    close(fd);
+    return ok;
+}
+
+void CloseDmaBuf(DmaBufT &_buf) {
+    if (_buf.buffer != MAP_FAILED)
+        munmap(_buf.buffer, _buf.size);
+    for (int fd : {_buf.fd, _buf.offsetFd, _buf.forCpuFd, _buf.forDeviceFd})
+        if (fd != -1)
+            close(fd);
+    _buf = DmaBufT();
+}
+
+//!
+//!@brief Opens the u-dma-buf device _name and maps it cached.
+//!
+//! Opened without O_SYNC the driver maps the buffer cacheable, the sync
+//! range is set to one segment read by the CPU, only the offset changes
+//! per call.
+//!
+bool OpenDmaBuf(const std::string &_name, DmaBufT &_buf) {
+    std::string sysfs;
+    for (const char *cls : {"/sys/class/u-dma-buf/", "/sys/class/udmabuf/"}) {
+        if (access((cls + _name).c_str(), F_OK) == 0) {
+            sysfs = cls + _name + "/";
+            break;
+        }
+    }
+    uint64_t size = 0;
+    if (sysfs.empty() || !ReadSysfs(sysfs + "phys_addr", _buf.physAddr) || !ReadSysfs(sysfs + "size", size)) {
+        std::cerr << "Error: u-dma-buf " << _name << " not found." << std::endl;
+        return false;
+    }
+    _buf.size = size;
+
+    if (_buf.size < (osc_buf_size * osc_buf_min_segments * 2) || _buf.physAddr + _buf.size > UINT64_C(0x100000000)) {
+        std::cerr << "Error: u-dma-buf " << _name << " size or address." << std::endl;
+        return false;
+    }
+
+    if (!WriteSysfs(sysfs + "sync_size", osc_buf_size) || !WriteSysfs(sysfs + "sync_direction", osc_dma_from_device)) {
+        std::cerr << "Error: u-dma-buf " << _name << " sync setup." << std::endl;
+        return false;
+    }
+
+    _buf.fd = open(("/dev/" + _name).c_str(), O_RDWR);
+    _buf.offsetFd = open((sysfs + "sync_offset").c_str(), O_WRONLY);
+    _buf.forCpuFd = open((sysfs + "sync_for_cpu").c_str(), O_WRONLY);
+    _buf.forDeviceFd = open((sysfs + "sync_for_device").c_str(), O_WRONLY);
+    if (_buf.fd == -1 || _buf.offsetFd == -1 || _buf.forCpuFd == -1 || _buf.forDeviceFd == -1) {
+        std::cerr << "Error: open u-dma-buf " << _name << "." << std::endl;
+        CloseDmaBuf(_buf);
+        return false;
+    }
+
+    _buf.buffer = mmap(nullptr, _buf.size, PROT_READ | PROT_WRITE, MAP_SHARED, _buf.fd, 0);
+    if (_buf.buffer == MAP_FAILED) {
+        std::cerr << "Error: mmap u-dma-buf " << _name << "." << std::endl;
+        CloseDmaBuf(_buf);
+        return false;
+    }
+    return true;
+}
 }
 
-COscilloscope::Ptr COscilloscope::Create(const UioT &_uio, bool _channel1Enable, bool _channel2Enable,uint32_t _dec_factor)
+COscilloscope::Ptr COscilloscope::Create(const UioT &_uio, bool _channel1Enable, bool _channel2Enable,uint32_t _dec_factor, const std::string &_dmaBuf)
 {
     // Validation
     if (_uio.mapList.size() < 2)
@@ -39,7 +148,7 @@ COscilloscope::Ptr COscilloscope::Create(const UioT &_uio, bool _channel1Enable,
         return COscilloscope::Ptr();
     }
 
-    if (_uio.mapList[1].size < (osc_buf_size * 4))
+    if (_uio.mapList[1].size < (osc_buf_size * osc_buf_min_segments * 2))
     {
         // Error: buffer size.
         std::cerr << "Error: buffer size." << std::endl;
@@ -68,6 +177,18 @@ COscilloscope::Ptr COscilloscope::Create(const UioT &_uio, bool _channel1Enable,
         return COscilloscope::Ptr();
     }
 
+    // Cached buffer, falls back to the reserved memory of the UIO node
+    DmaBufT dmaBuf;
+    if (!_dmaBuf.empty() && OpenDmaBuf(_dmaBuf, dmaBuf))
+    {
+        auto osc = std::make_shared<COscilloscope>(_channel1Enable,_channel2Enable, fd, regset, _uio.mapList[0].size, dmaBuf.buffer, dmaBuf.size, dmaBuf.physAddr,_dec_factor);
+        osc->m_DmaBufFd = dmaBuf.fd;
+        osc->m_SyncOffsetFd = dmaBuf.offsetFd;
+        osc->m_SyncForCpuFd = dmaBuf.forCpuFd;
+        osc->m_SyncForDeviceFd = dmaBuf.forDeviceFd;
+        return osc;
+    }
+
     void *buffer = MmapNumber(fd, _uio.mapList[1].size, 1);
 
     if (buffer == MAP_FAILED)
@@ -83,9 +204,55 @@ COscilloscope::Ptr COscilloscope::Create(const UioT &_uio, bool _channel1Enable,
     return std::make_shared<COscilloscope>(_channel1Enable,_channel2Enable, fd, regset, _uio.mapList[0].size, buffer, _uio.mapList[1].size, _uio.mapList[1].addr,_dec_factor);
 }
 
+COscilloscope::Ptr COscilloscope::CreateInstance(const UioT &_uio, unsigned _instance, uint32_t _dec_factor, const std::string &_dmaBuf)
+{
+    if (_instance > 1)
+    {
+        // Error: validation.
+        std::cerr << "Error: oscilloscope instance." << std::endl;
+        return COscilloscope::Ptr();
+    }
+
+    auto osc = Create(_uio, _instance == 0, _instance == 1, _dec_factor, _dmaBuf);
+    if (osc)
+        osc->m_Instance = _instance;
+    return osc;
+}
+
+COscilloscope::Ptr COscilloscope::CreateSynthetic(bool _channel1Enable, bool _channel2Enable, uint32_t _dec_factor)
+{
+    size_t regsetSize = getpagesize();
+    size_t bufferSize = osc_buf_size * osc_synthetic_segments * 2;
+    void *regset = calloc(1, regsetSize);
+    void *buffer = aligned_alloc(64, bufferSize);
+
+    if (regset == nullptr || buffer == nullptr)
+    {
+        std::cerr << "Error: synthetic oscilloscope memory." << std::endl;
+        free(regset);
+        free(buffer);
+        return COscilloscope::Ptr();
+    }
+
+    // 14-bit ramp, left aligned like the ADC data, channel 2 is inverted
+    auto samples = static_cast<int16_t *>(buffer);
+    size_t count = bufferSize / sizeof(int16_t);
+    for (size_t i = 0; i < count; i++)
+    {
+        int16_t value = static_cast<int16_t>((i & 0x3FFF) << 2);
+        samples[i] = (i < count / 2) ? value : static_cast<int16_t>(-value);
+    }
+
+    auto osc = std::make_shared<COscilloscope>(_channel1Enable, _channel2Enable, -1, regset, regsetSize, buffer, bufferSize, 0, _dec_factor);
+    osc->m_Synthetic = true;
+    osc->setDecimation(_dec_factor);
+    return osc;
+}
+
 COscilloscope::COscilloscope(bool _channel1Enable, bool _channel2Enable, int _fd, void *_regset, size_t _regsetSize, void *_buffer, size_t _bufferSize, uintptr_t _bufferPhysAddr,uint32_t _dec_factor) :
     m_Channel1(_channel1Enable),
     m_Channel2(_channel2Enable),
+    m_Instance(osc_instance_pair),
     m_Fd(_fd),
     m_Regset(_regset),
     m_RegsetSize(_regsetSize),
@@ -97,7 +264,24 @@ COscilloscope::COscilloscope(bool _channel1Enable, bool _channel2Enable, int _fd
     m_OscBuffer1(nullptr),
     m_OscBuffer2(nullptr),
     m_OscBufferNumber(0),
-    m_dec_factor(_dec_factor)
+    m_dec_factor(_dec_factor),
+    m_SegmentCount(_bufferSize / (osc_buf_size * 2)),
+    m_HwSegment{0, 1},
+    m_HwPending{false, false},
+    m_FreeSegments(),
+    m_HeldSegments(),
+    m_Descriptor(nullptr),
+    m_WaitTimer(nullptr),
+    m_WaitTimedOut(false),
+    m_ReadyTime(),
+    m_Synthetic(false),
+    m_SynthPeriod(),
+    m_SynthNext(),
+    m_SynthHalf(1),
+    m_DmaBufFd(-1),
+    m_SyncOffsetFd(-1),
+    m_SyncForCpuFd(-1),
+    m_SyncForDeviceFd(-1)
 {
     uintptr_t oscMap = reinterpret_cast<uintptr_t>(m_Regset) +  osc0_baseaddr ;
     m_OscMap1 = reinterpret_cast<OscilloscopeMapT *>(oscMap);
@@ -105,22 +289,72 @@ COscilloscope::COscilloscope(bool _channel1Enable, bool _channel2Enable, int _fd
     
     oscMap = reinterpret_cast<uintptr_t>(m_Regset) + osc1_baseaddr;
     m_OscMap2 = reinterpret_cast<OscilloscopeMapT *>(oscMap);
-    m_OscBuffer2 = static_cast<uint8_t *>(m_Buffer) + osc_buf_size * 2;
+    m_OscBuffer2 = static_cast<uint8_t *>(m_Buffer) + osc_buf_size * m_SegmentCount;
     
 }
 
 COscilloscope::~COscilloscope()
 {
+    cancelNext();
+    if (m_Synthetic)
+    {
+        free(m_Regset);
+        free(m_Buffer);
+        return;
+    }
     munmap(m_Regset, m_RegsetSize);
     munmap(m_Buffer, m_BufferSize);
     close(m_Fd);
+    for (int fd : {m_DmaBufFd, m_SyncOffsetFd, m_SyncForCpuFd, m_SyncForDeviceFd})
+        if (fd != -1)
+            close(fd);
+}
+
+uint32_t COscilloscope::segmentAddr(unsigned _Channel, unsigned _Segment){
+    return m_BufferPhysAddr + osc_buf_size * (_Channel * m_SegmentCount + _Segment);
+}
+
+// Cache maintenance of one segment of the cached buffer, _syncFd is
+// sync_for_cpu before the CPU reads it or sync_for_device before the DMA
+// writes it again
+bool COscilloscope::syncSegment(int _syncFd, unsigned _Channel, unsigned _Segment){
+    std::lock_guard<std::mutex> lock(g_SyncMutex);
+    return WriteSysfs(m_SyncOffsetFd, osc_buf_size * (_Channel * m_SegmentCount + _Segment)) && WriteSysfs(_syncFd, 1);
+}
+
+// Only called for a half the DMA has finished and waits on, so the
+// destination can be changed before the half is released.
+void COscilloscope::retarget(unsigned _Half){
+    auto segment = m_FreeSegments.front();
+    m_FreeSegments.pop_front();
+    m_HwSegment[_Half] = segment;
+    m_HwPending[_Half] = false;
+
+    for (unsigned channel : {0u, 1u}){
+        if (!drives(channel))
+            continue;
+        auto map = channel == 0 ? m_OscMap1 : m_OscMap2;
+        if (_Half == 0){
+            map->dma_dst_addr1 = segmentAddr(channel, segment);
+        }else{
+            map->dma_dst_addr2 = segmentAddr(channel, segment);
+        }
+    }
+
+    uint32_t clearFlag = (_Half == 0 ? 0x00000004 : 0x00000008);
+    uint32_t resetFlag = 0x00000002;
+
+    if (drives(0))
+        m_OscMap1->dma_ctrl |= (resetFlag | clearFlag);
+    if (drives(1))
+        m_OscMap2->dma_ctrl |= (resetFlag | clearFlag);
 }
 
 void COscilloscope::setReg(volatile OscilloscopeMapT *_OscMap,unsigned int _Channel){
         // Buffer
         _OscMap->dma_buf_size = osc_buf_size;
-        _OscMap->dma_dst_addr1 = m_BufferPhysAddr + osc_buf_size * (_Channel * 2);
-        _OscMap->dma_dst_addr2 = m_BufferPhysAddr + osc_buf_size * (_Channel * 2 + 1);
+        _OscMap->dma_dst_addr1 = segmentAddr(_Channel, m_HwSegment[0]);
+        _OscMap->dma_dst_addr2 = segmentAddr(_Channel, m_HwSegment[1]);
         // Filter bypass
 
        // if (_Channel == 0) 
@@ -128,8 +362,8 @@ void COscilloscope::setReg(volatile OscilloscopeMapT *_OscMap,unsigned int _Chan
             _OscMap->filt_bypass = UINT32_C(0x00000001);
 
             
-            // Event
-            _OscMap->event_sel =  osc0_event_id ;
+            // Event, a pair follows osc0, an instance its own block
+            _OscMap->event_sel = (m_Instance == 1) ? osc1_event_id : osc0_event_id;
 
             // Trigger mask
             _OscMap->trig_mask = UINT32_C(0x00000004);
@@ -164,107 +398,375 @@ void COscilloscope::prepare()
 {
     stop();
 
+    m_HwSegment[0] = 0;
+    m_HwSegment[1] = 1;
+    m_HwPending[0] = m_HwPending[1] = false;
+    m_HeldSegments.clear();
+    m_FreeSegments.clear();
+    for (unsigned i = osc_buf_min_segments; i < m_SegmentCount; i++)
+        m_FreeSegments.push_back(i);
+
+    // Nothing the CPU left in the cache may be written back over the DMA data
+    if (cached()){
+        for (unsigned channel = 0; channel < 2; channel++)
+            if (drives(channel))
+                for (unsigned i = 0; i < m_SegmentCount; i++)
+                    syncSegment(m_SyncForDeviceFd, channel, i);
+    }
+
     // Second channel must init first if present. First channel start both channels synchronously
 
     if (m_OscMap2 != nullptr){
-        setReg(m_OscMap2,1);
+        if (drives(1))
+            setReg(m_OscMap2,1);
     }else{
         std::cerr << "Error: COscilloscope::prepare() can't init second channel" << std::endl;
         exit(-1);
     }
 
     if (m_OscMap1 != nullptr){
-        setReg(m_OscMap1,0);
+        if (drives(0))
+            setReg(m_OscMap1,0);
     }else{
         std::cerr << "Error: COscilloscope::prepare()  can't init first channel" << std::endl;
         exit(-1);
     }
     
     m_OscBufferNumber = 0;
-    m_OscMap1->dma_ctrl  = 0xC;
-    m_OscMap2->dma_ctrl  = 0xC;
+    if (drives(0))
+        m_OscMap1->dma_ctrl  = 0xC;
+    if (drives(1))
+        m_OscMap2->dma_ctrl  = 0xC;
     
-    m_OscMap1->dma_ctrl = UINT32_C(0x00000201);
-    m_OscMap2->dma_ctrl = UINT32_C(0x00000201);
+    if (drives(0))
+        m_OscMap1->dma_ctrl = UINT32_C(0x00000201);
+    if (drives(1))
+        m_OscMap2->dma_ctrl = UINT32_C(0x00000201);
+
+    if (drives(0)){
+        m_OscMap1->event_sts = UINT32_C(0x00000001);
+        m_OscMap1->event_sts = UINT32_C(0x00000002);
+    }
+    if (drives(1)){
+        m_OscMap2->event_sts = UINT32_C(0x00000001);
+        m_OscMap2->event_sts = UINT32_C(0x00000002);
+    }
 
-    m_OscMap1->event_sts = UINT32_C(0x00000001);
-    m_OscMap1->event_sts = UINT32_C(0x00000002);
-    m_OscMap2->event_sts = UINT32_C(0x00000001);
-    m_OscMap2->event_sts = UINT32_C(0x00000002);
+    m_SynthHalf = 1;
+    m_SynthNext = std::chrono::steady_clock::now() + m_SynthPeriod;
   
 }
 
+bool COscilloscope::enableInterrupt()
+{
+    int32_t cnt = 1;
+    constexpr size_t cnt_size = sizeof(cnt);
+    return write(m_Fd, &cnt, cnt_size) == cnt_size;
+}
+
+// Finished half of an instance that is not handed out yet, -1 if none. The
+// instances of one UIO node share its interrupt, a wake-up may be the other one.
+int COscilloscope::readyHalf()
+{
+    auto map = (m_Instance == 1) ? m_OscMap2 : m_OscMap1;
+    uint32_t sts = map->dma_sts_addr;
+    for (unsigned half : {0u, 1u}){
+        if ((sts & (1u << half)) && !m_HwPending[half])
+            return half;
+    }
+    return -1;
+}
+
+// Called once the interrupt was read, takes the DMA half that is ready
+void COscilloscope::fetch(uint8_t *&_buffer1,uint8_t *&_buffer2, size_t &_size,bool &_overFlow1 , bool &_overFlow2)
+{
+    if (!m_Synthetic)
+        m_ReadyTime = std::chrono::steady_clock::now();
+
+    // Interrupt ACQ
+
+    if (m_Instance == osc_instance_pair){
+        if ((m_OscMap1->dma_sts_addr & 0x3) !=  (m_OscMap2->dma_sts_addr & 0x3)) {
+            std::cerr << "Error: COscilloscope::next(): Buffers not synced" << std::endl;
+        } 
+
+        if (m_OscMap1->dma_sts_addr & 0x1){
+            m_OscBufferNumber = 0;
+        }else{
+            m_OscBufferNumber = 1;
+        }
+    }else{
+        int half = readyHalf();
+        auto map = (m_Instance == 1) ? m_OscMap2 : m_OscMap1;
+        if (half >= 0){
+            m_OscBufferNumber = half;
+        }else{
+            m_OscBufferNumber = (map->dma_sts_addr & 0x1) ? 0 : 1;
+        }
+    }
+
+    // The other block of an instance belongs to the other instance
+    _overFlow1 = drives(0) && (m_OscMap1->dma_sts_addr & (m_OscBufferNumber == 0 ? 0x4 : 0x8));
+    _overFlow2 = drives(1) && (m_OscMap2->dma_sts_addr & (m_OscBufferNumber == 0 ? 0x4 : 0x8));
+
+    auto segment = m_HwSegment[m_OscBufferNumber];
+    m_HeldSegments.push_back(segment);
+    if (!m_FreeSegments.empty()){
+        retarget(m_OscBufferNumber);
+    }else{
+        // No spare segment, the half goes back to the DMA in changeBuffers()
+        m_HwPending[m_OscBufferNumber] = true;
+    }
+
+    // Only the finished segment is invalidated, the reader gets it in place
+    if (cached()){
+        if ((m_Channel1 && !syncSegment(m_SyncForCpuFd, 0, segment)) || (m_Channel2 && !syncSegment(m_SyncForCpuFd, 1, segment)))
+            std::cerr << "Error: COscilloscope::fetch(): sync_for_cpu" << std::endl;
+    }
+
+    _buffer1 = m_Channel1 ? ( m_OscBuffer1 + osc_buf_size * segment) : nullptr;
+
+    _buffer2 = m_Channel2 ? ( m_OscBuffer2 + osc_buf_size * segment) : nullptr;
+
+    // if (_overFlow1 ) printf("CH1  %x\n",_overFlow1);
+    // if (_overFlow2 ) printf("CH2  %x\n",_overFlow2);
+
+    if (m_Channel1 || m_Channel2){
+        _size = osc_buf_size;
+    }else {
+        _size = 0;
+    }
+}
+
+// Plays the DMA for the synthetic source: the next half is due at
+// m_SynthNext, a reader more than two halves late gets the overflow flag.
+void COscilloscope::synthesize()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool overFlow = false;
+    if (now - m_SynthNext >= m_SynthPeriod * 2)
+    {
+        m_SynthNext += m_SynthPeriod * ((now - m_SynthNext) / m_SynthPeriod);
+        overFlow = true;
+    }
+    m_ReadyTime = m_SynthNext;
+    m_SynthNext += m_SynthPeriod;
+    m_SynthHalf ^= 1;
+
+    uint32_t sts = (m_SynthHalf == 0 ? 0x1 : 0x2);
+    if (overFlow)
+        sts |= (m_SynthHalf == 0 ? 0x4 : 0x8);
+    m_OscMap1->dma_sts_addr = sts;
+    m_OscMap2->dma_sts_addr = sts;
+}
+
 bool COscilloscope::next(uint8_t *&_buffer1,uint8_t *&_buffer2, size_t &_size,bool &_overFlow1 , bool &_overFlow2)
 {
+    if (m_Synthetic)
+    {
+        std::this_thread::sleep_until(m_SynthNext);
+        synthesize();
+        fetch(_buffer1, _buffer2, _size, _overFlow1, _overFlow2);
+        return true;
+    }
+
+    // An instance may have missed the interrupt while the other one waited on it
+    if (m_Instance != osc_instance_pair && readyHalf() >= 0) {
+        fetch(_buffer1, _buffer2, _size, _overFlow1, _overFlow2);
+        return true;
+    }
+
     // Enable interrupt
     int32_t cnt = 1;
     constexpr size_t cnt_size = sizeof(cnt);
-    ssize_t bytes = write(m_Fd, &cnt, cnt_size);
 
-    if (bytes == cnt_size) {
+    while (enableInterrupt()) {
         // Wait for interrupt
-        bytes = read(m_Fd, &cnt, cnt_size);
+        ssize_t bytes = read(m_Fd, &cnt, cnt_size);
 
-        if (bytes == cnt_size) {
-           
-            // Interrupt ACQ
+        if (bytes != cnt_size)
+            break;
 
-            if ((m_OscMap1->dma_sts_addr & 0x3) !=  (m_OscMap2->dma_sts_addr & 0x3)) {
-                std::cerr << "Error: COscilloscope::next(): Buffers not synced" << std::endl;
-            } 
+        // The interrupt of the other instance
+        if (m_Instance != osc_instance_pair && readyHalf() < 0)
+            continue;
 
-            if (m_OscMap1->dma_sts_addr & 0x1){
-                m_OscBufferNumber = 0;
-            }else{
-                m_OscBufferNumber = 1;
+        fetch(_buffer1, _buffer2, _size, _overFlow1, _overFlow2);
+        return true;
+    }
+    _size = 0;
+    return false;
+}
+
+//!
+//!@brief Waits for the next DMA half without blocking the calling thread.
+//!
+//! The UIO descriptor is watched by _ios, the handler runs from _ios.run()
+//! with the ready buffers, with asio::error::timed_out after _timeout_ms,
+//! or with asio::error::operation_aborted after cancelNext().
+//!
+void COscilloscope::asyncNext(asio::io_service &_ios, int _timeout_ms, NextHandler _handler)
+{
+    if (m_Synthetic){
+        if (!m_WaitTimer)
+            m_WaitTimer.reset(new asio::steady_timer(_ios));
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_timeout_ms);
+        bool ready = m_SynthNext <= deadline;
+        m_WaitTimer->expires_at(ready ? m_SynthNext : deadline);
+        m_WaitTimer->async_wait([this,_handler,ready](const asio::error_code &_error){
+            uint8_t *buffer1 = nullptr;
+            uint8_t *buffer2 = nullptr;
+            size_t size = 0;
+            bool overFlow1 = false;
+            bool overFlow2 = false;
+
+            if (_error || !ready){
+                _handler(_error ? _error : asio::error::timed_out, nullptr, nullptr, 0, false, false);
+                return;
             }
+            synthesize();
+            fetch(buffer1, buffer2, size, overFlow1, overFlow2);
+            _handler(asio::error_code(), buffer1, buffer2, size, overFlow1, overFlow2);
+        });
+        return;
+    }
 
-            _buffer1 = m_Channel1 ? ( m_OscBuffer1 + osc_buf_size * m_OscBufferNumber) : nullptr;
+    if (!m_Descriptor){
+        m_Descriptor.reset(new asio::posix::stream_descriptor(_ios, m_Fd));
+        m_WaitTimer.reset(new asio::steady_timer(_ios));
+    }
 
-            _buffer2 = m_Channel2 ? ( m_OscBuffer2 + osc_buf_size * m_OscBufferNumber) : nullptr;
-            
-            _overFlow1 = m_OscMap1->dma_sts_addr & (m_OscBufferNumber == 0 ? 0x4 : 0x8);
-            _overFlow2 = m_OscMap2->dma_sts_addr & (m_OscBufferNumber == 0 ? 0x4 : 0x8);
+    // An instance may have missed the interrupt while the other one waited on it
+    if (m_Instance != osc_instance_pair && readyHalf() >= 0){
+        _ios.post([this,_handler](){
+            uint8_t *buffer1 = nullptr;
+            uint8_t *buffer2 = nullptr;
+            size_t size = 0;
+            bool overFlow1 = false;
+            bool overFlow2 = false;
+
+            fetch(buffer1, buffer2, size, overFlow1, overFlow2);
+            _handler(asio::error_code(), buffer1, buffer2, size, overFlow1, overFlow2);
+        });
+        return;
+    }
 
-            // if (_overFlow1 ) printf("CH1  %x\n",_overFlow1);
-            // if (_overFlow2 ) printf("CH2  %x\n",_overFlow2);
-            
-            
+    if (!enableInterrupt()){
+        _ios.post([_handler](){ _handler(asio::error::fault, nullptr, nullptr, 0, false, false); });
+        return;
+    }
 
-            if (m_Channel1 || m_Channel2){
-                _size = osc_buf_size;
-            }else {
-                _size = 0;
+    m_WaitTimedOut = false;
+    m_WaitTimer->expires_from_now(std::chrono::milliseconds(_timeout_ms));
+    m_WaitTimer->async_wait([this](const asio::error_code &_error){
+        if (!_error){
+            m_WaitTimedOut = true;
+            m_Descriptor->cancel();
+        }
+    });
+
+    waitInterrupt(_handler);
+}
+
+// Waits on the UIO descriptor for the interrupt of this oscilloscope, one of
+// the other instance of the node only re-arms it
+void COscilloscope::waitInterrupt(NextHandler _handler)
+{
+    m_Descriptor->async_wait(asio::posix::stream_descriptor::wait_read, [this,_handler](const asio::error_code &_error){
+        uint8_t *buffer1 = nullptr;
+        uint8_t *buffer2 = nullptr;
+        size_t size = 0;
+        bool overFlow1 = false;
+        bool overFlow2 = false;
+
+        if (_error){
+            _handler(m_WaitTimedOut ? asio::error::timed_out : _error, nullptr, nullptr, 0, false, false);
+            return;
+        }
+
+        int32_t cnt = 0;
+        if (read(m_Fd, &cnt, sizeof(cnt)) != sizeof(cnt)){
+            m_WaitTimer->cancel();
+            _handler(asio::error::fault, nullptr, nullptr, 0, false, false);
+            return;
+        }
+        // The interrupt of the other instance
+        if (m_Instance != osc_instance_pair && readyHalf() < 0){
+            if (enableInterrupt()){
+                waitInterrupt(_handler);
+                return;
             }
-            return true;
+            m_WaitTimer->cancel();
+            _handler(asio::error::fault, nullptr, nullptr, 0, false, false);
+            return;
         }
+        m_WaitTimer->cancel();
+        fetch(buffer1, buffer2, size, overFlow1, overFlow2);
+        _handler(asio::error_code(), buffer1, buffer2, size, overFlow1, overFlow2);
+    });
+}
+
+// Must run on the io_service thread or after its run() returned. The next
+// asyncNext() may use another io_service.
+void COscilloscope::cancelNext()
+{
+    if (m_WaitTimer){
+        m_WaitTimer->cancel();
+        m_WaitTimer.reset();
+    }
+    if (m_Descriptor){
+        m_Descriptor->cancel();
+        m_Descriptor->release();
+        m_Descriptor.reset();
     }
-    _size = 0;
-    return false;
 }
 
 bool COscilloscope::changeBuffers(){
 
-    uint32_t clearFlag = (m_OscBufferNumber == 0 ? 0x00000004 : 0x00000008);
-    uint32_t resetFlag = 0x00000002;
+    if (m_HeldSegments.empty())
+        return false;
 
-    m_OscMap1->dma_ctrl |= (resetFlag | clearFlag);
-    m_OscMap2->dma_ctrl |= (resetFlag | clearFlag);
+    auto segment = m_HeldSegments.front();
+    m_HeldSegments.pop_front();
+    if (cached()){
+        if ((m_Channel1 && !syncSegment(m_SyncForDeviceFd, 0, segment)) || (m_Channel2 && !syncSegment(m_SyncForDeviceFd, 1, segment)))
+            std::cerr << "Error: COscilloscope::changeBuffers(): sync_for_device" << std::endl;
+    }
+    m_FreeSegments.push_back(segment);
 
+    for (unsigned half : {m_OscBufferNumber, m_OscBufferNumber ^ 1u}){
+        if (m_HwPending[half] && !m_FreeSegments.empty())
+            retarget(half);
+    }
     return true;
 }
 
+void COscilloscope::setDecimation(uint32_t _dec_factor)
+{
+    m_dec_factor = _dec_factor;
+    m_SynthPeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(osc_buf_size / sizeof(int16_t)) * (_dec_factor ? _dec_factor : 1) / osc_adc_rate));
+}
+
+void COscilloscope::setChannels(bool _channel1Enable, bool _channel2Enable)
+{
+    m_Channel1 = _channel1Enable && drives(0);
+    m_Channel2 = _channel2Enable && drives(1);
+}
+
 void COscilloscope::stop()
 {
     // Control stop
     if (m_OscMap1 != nullptr){
-        m_OscMap1->event_sts = UINT32_C(0x00000004);
+        if (drives(0))
+            m_OscMap1->event_sts = UINT32_C(0x00000004);
     }else {
         std::cerr << "Error: COscilloscope::stop()" << std::endl;
         exit(-1);
     }
     if (m_OscMap2 != nullptr){
-        m_OscMap2->event_sts = UINT32_C(0x00000004);
+        if (drives(1))
+            m_OscMap2->event_sts = UINT32_C(0x00000004);
     }else {
         std::cerr << "Error: COscilloscope::stop()" << std::endl;
         exit(-1);
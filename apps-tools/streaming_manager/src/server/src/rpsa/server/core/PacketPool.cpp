@@ -0,0 +1,67 @@
+#include "rpsa/server/core/PacketPool.h"
+
+// Keep every packet on its own cache line so memcpy_neon stays on the fast path
+#define PACKET_POOL_ALIGN 64
+
+CPacketPool::Ptr CPacketPool::Create(size_t _count, size_t _packetSize){
+    return std::make_shared<CPacketPool>(_count, _packetSize);
+}
+
+CPacketPool::CPacketPool(size_t _count, size_t _packetSize):
+    m_count(_count),
+    m_packetSize((_packetSize + PACKET_POOL_ALIGN - 1) & ~(size_t)(PACKET_POOL_ALIGN - 1)),
+    m_memory(nullptr),
+    m_free(),
+    m_exhausted(0),
+    m_mutex()
+{
+    m_memory = new uint8_t[m_count * m_packetSize + PACKET_POOL_ALIGN];
+    auto base = reinterpret_cast<uintptr_t>(m_memory);
+    base = (base + PACKET_POOL_ALIGN - 1) & ~(uintptr_t)(PACKET_POOL_ALIGN - 1);
+    m_free.reserve(m_count);
+    for (size_t i = 0; i < m_count; ++i){
+        m_free.push_back(reinterpret_cast<uint8_t*>(base) + i * m_packetSize);
+    }
+}
+
+CPacketPool::~CPacketPool(){
+    delete [] m_memory;
+}
+
+uint8_t *CPacketPool::acquire(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_free.empty()){
+        ++m_exhausted;
+        return nullptr;
+    }
+    auto packet = m_free.back();
+    m_free.pop_back();
+    return packet;
+}
+
+bool CPacketPool::release(uint8_t *_packet){
+    if (!isOwned(_packet))
+        return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(_packet);
+    return true;
+}
+
+bool CPacketPool::isOwned(const uint8_t *_packet) const{
+    return _packet >= m_memory && _packet < m_memory + m_count * m_packetSize + PACKET_POOL_ALIGN;
+}
+
+size_t CPacketPool::freeCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_free.size();
+}
+
+uint64_t CPacketPool::exhaustedCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_exhausted;
+}
+
+void CPacketPool::resetExhaustedCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_exhausted = 0;
+}
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "rpsa/server/core/PowerMeter.h"
+
+PowerResultT::PowerResultT():
+    sequence(0),
+    windows(0),
+    synced(true),
+    lostWindows(0),
+    frequency(0),
+    urms(0),
+    irms(0),
+    p(0),
+    q(0),
+    s(0),
+    pf(0),
+    thdU(0),
+    thdI(0),
+    energyP(0),
+    energyQ(0)
+{
+    std::fill(harmU, harmU + POWER_HARMONICS, 0.f);
+    std::fill(harmI, harmI + POWER_HARMONICS, 0.f);
+}
+
+CPowerMeter::Ptr CPowerMeter::Create(const PowerMeterT &_settings, double _sampleRate){
+    return std::make_shared<CPowerMeter>(_settings, _sampleRate);
+}
+
+CPowerMeter::CPowerMeter(const PowerMeterT &_settings, double _sampleRate):
+    m_settings(_settings),
+    m_innerRate(_sampleRate),
+    m_decimation(1),
+    m_decCount(0),
+    m_accU(0),
+    m_accI(0),
+    m_cycles(10),
+    m_nominalLen(0),
+    m_started(false),
+    m_start(0),
+    m_startSynced(false),
+    m_crossings(0),
+    m_armed(false),
+    m_mean(0),
+    m_hyst(0),
+    m_re(POWER_FFT_LEN),
+    m_im(POWER_FFT_LEN),
+    m_cos(POWER_FFT_LEN / 2),
+    m_sin(POWER_FFT_LEN / 2),
+    m_rev(POWER_FFT_LEN),
+    m_accTime(0),
+    m_energyP(0),
+    m_energyQ(0),
+    m_lostWindows(0)
+{
+    m_settings.frequency = m_settings.frequency == 60 ? 60 : 50;
+    m_settings.aggregate = std::max(m_settings.aggregate, 1);
+    m_cycles = m_settings.frequency == 60 ? 12 : 10;
+    m_decimation = std::max((uint32_t)(_sampleRate / POWER_INNER_RATE), (uint32_t)1);
+    m_innerRate = _sampleRate / m_decimation;
+    m_nominalLen = m_cycles * m_innerRate / m_settings.frequency;
+
+    int bits = 0;
+    while ((1 << bits) < POWER_FFT_LEN)
+        bits++;
+    for (uint32_t k = 0; k < POWER_FFT_LEN; k++){
+        uint32_t r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        m_rev[k] = r;
+    }
+    for (int k = 0; k < POWER_FFT_LEN / 2; k++){
+        m_cos[k] = (float)std::cos(2 * M_PI * k / POWER_FFT_LEN);
+        m_sin[k] = (float)-std::sin(2 * M_PI * k / POWER_FFT_LEN);
+    }
+    reset();
+}
+
+void CPowerMeter::reset(){
+    m_decCount = 0;
+    m_accU = 0;
+    m_accI = 0;
+    m_u.clear();
+    m_i.clear();
+    m_u.reserve((size_t)(m_nominalLen * 1.5) + 4);
+    m_i.reserve((size_t)(m_nominalLen * 1.5) + 4);
+    m_started = false;
+    m_start = 0;
+    m_startSynced = false;
+    m_crossings = 0;
+    m_armed = false;
+    m_mean = 0;
+    m_hyst = (float)(0.01 * m_settings.uFullScale);
+    m_acc = PowerResultT();
+    m_accTime = 0;
+    m_energyP = 0;
+    m_energyQ = 0;
+    m_lostWindows = 0;
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    m_result = PowerResultT();
+}
+
+void CPowerMeter::process(const int16_t *_u, const int16_t *_i, size_t _count){
+    // Box average of m_decimation samples, folded into the full scale factors
+    const float scale_u = (float)(m_settings.uFullScale / 32768.0 / m_decimation);
+    const float scale_i = (float)(m_settings.iFullScale / 32768.0 / m_decimation);
+
+    for (size_t k = 0; k < _count; k++){
+        m_accU += _u[k];
+        m_accI += _i[k];
+        if (++m_decCount < m_decimation)
+            continue;
+        addSample(m_accU * scale_u, m_accI * scale_i);
+        m_accU = 0;
+        m_accI = 0;
+        m_decCount = 0;
+    }
+}
+
+void CPowerMeter::skip(uint64_t _count){
+    if (m_started || !m_u.empty())
+        m_lostWindows += 1 + (uint64_t)(_count / (m_nominalLen * m_decimation));
+    // The next window waits for a new crossing
+    m_u.clear();
+    m_i.clear();
+    m_started = false;
+    m_crossings = 0;
+    m_armed = false;
+    m_decCount = 0;
+    m_accU = 0;
+    m_accI = 0;
+}
+
+void CPowerMeter::addSample(float _u, float _i){
+    size_t n = m_u.size();
+    m_u.push_back(_u);
+    m_i.push_back(_i);
+
+    // Rising crossing of the DC level, armed below the hysteresis band
+    if (n > 0){
+        if (!m_armed){
+            m_armed = _u < m_mean - m_hyst;
+        }else if (_u >= m_mean){
+            float prev = m_u[n - 1];
+            double t = n - 1 + (m_mean - prev) / (_u - prev);
+            m_armed = false;
+            if (!m_started){
+                size_t drop = (size_t)t;
+                m_u.erase(m_u.begin(), m_u.begin() + drop);
+                m_i.erase(m_i.begin(), m_i.begin() + drop);
+                m_start = t - drop;
+                m_started = true;
+                m_startSynced = true;
+                m_crossings = 0;
+            }else if (++m_crossings == m_cycles){
+                closeWindow(t, m_startSynced);
+            }
+            return;
+        }
+    }
+
+    // No usable fundamental, fall back to the nominal window length
+    if (!m_started){
+        if (m_u.size() > m_nominalLen * 1.5){
+            m_start = 0;
+            m_started = true;
+            m_startSynced = false;
+            m_crossings = 0;
+        }
+    }else if (m_u.size() - m_start > m_nominalLen * 1.5){
+        closeWindow(m_start + m_nominalLen, false);
+    }
+}
+
+void CPowerMeter::closeWindow(double _end, bool _synced){
+    const int M = POWER_FFT_LEN;
+    const double len = _end - m_start;
+    double su = 0, su2 = 0, si2 = 0, sui = 0;
+
+    // Resample the exact window, harmonic h lands on bin h * m_cycles
+    for (int k = 0; k < M; k++){
+        double pos = m_start + k * len / M;
+        size_t idx = (size_t)pos;
+        float f = (float)(pos - idx);
+        float u = m_u[idx] + f * (m_u[idx + 1] - m_u[idx]);
+        float i = m_i[idx] + f * (m_i[idx + 1] - m_i[idx]);
+        su += u;
+        su2 += (double)u * u;
+        si2 += (double)i * i;
+        sui += (double)u * i;
+        m_re[k] = u;
+        m_im[k] = i;
+    }
+    fft();
+
+    // U_k and I_k out of the FFT of U + jI, squared RMS of a bin is 2 |X_k|^2 / M^2
+    auto bin = [&](int k, double &ur, double &ui, double &ir, double &ii){
+        int m = (M - k) % M;
+        ur = (m_re[k] + m_re[m]) / 2;
+        ui = (m_im[k] - m_im[m]) / 2;
+        ir = (m_im[k] + m_im[m]) / 2;
+        ii = -(m_re[k] - m_re[m]) / 2;
+    };
+    const double c2 = 2.0 / ((double)M * M);
+    const int half = m_cycles / 2;
+    double gu[POWER_HARMONICS], gi[POWER_HARMONICS];
+    for (int h = 1; h <= POWER_HARMONICS; h++){
+        double sum_u = 0, sum_i = 0;
+        for (int j = -half; j <= half; j++){
+            int k = h * m_cycles + j;
+            if (k >= M / 2)
+                break;
+            double ur, ui, ir, ii;
+            bin(k, ur, ui, ir, ii);
+            // The bins half way to the neighbour groups are shared with them
+            double w = (j == -half || j == half) ? 0.5 : 1.0;
+            sum_u += w * (ur * ur + ui * ui);
+            sum_i += w * (ir * ir + ii * ii);
+        }
+        gu[h - 1] = sum_u * c2;
+        gi[h - 1] = sum_i * c2;
+    }
+    double ur, ui, ir, ii;
+    bin(m_cycles, ur, ui, ir, ii);
+    // Im(U1 * conj(I1)), positive with the current lagging
+    double q = (ui * ir - ur * ii) * c2;
+
+    double T = len / m_innerRate;
+    double urms2 = su2 / M;
+    double irms2 = si2 / M;
+    double p = sui / M;
+    m_acc.urms += urms2;
+    m_acc.irms += irms2;
+    m_acc.p += p;
+    m_acc.q += q;
+    m_acc.s += std::sqrt(urms2 * irms2);
+    for (int h = 0; h < POWER_HARMONICS; h++){
+        m_acc.harmU[h] += (float)gu[h];
+        m_acc.harmI[h] += (float)gi[h];
+    }
+    m_acc.synced = m_acc.synced && _synced;
+    m_acc.windows++;
+    m_accTime += T;
+    m_energyP += p * T / 3600.0;
+    m_energyQ += q * T / 3600.0;
+
+    if (m_acc.windows >= (uint32_t)m_settings.aggregate){
+        PowerResultT r;
+        double n = m_acc.windows;
+        r.windows = m_acc.windows;
+        r.synced = m_acc.synced;
+        r.lostWindows = m_lostWindows;
+        r.frequency = r.synced ? m_cycles * n / m_accTime : m_settings.frequency;
+        r.urms = std::sqrt(m_acc.urms / n);
+        r.irms = std::sqrt(m_acc.irms / n);
+        r.p = m_acc.p / n;
+        r.q = m_acc.q / n;
+        r.s = m_acc.s / n;
+        r.pf = r.s > 0 ? r.p / r.s : 0;
+        double hu = 0, hi = 0;
+        for (int h = 0; h < POWER_HARMONICS; h++){
+            r.harmU[h] = std::sqrt(m_acc.harmU[h] / n);
+            r.harmI[h] = std::sqrt(m_acc.harmI[h] / n);
+            if (h > 0){
+                hu += m_acc.harmU[h] / n;
+                hi += m_acc.harmI[h] / n;
+            }
+        }
+        r.thdU = r.harmU[0] > 0 ? std::sqrt(hu) / r.harmU[0] * 100 : 0;
+        r.thdI = r.harmI[0] > 0 ? std::sqrt(hi) / r.harmI[0] * 100 : 0;
+        r.energyP = m_energyP;
+        r.energyQ = m_energyQ;
+        m_acc = PowerResultT();
+        m_accTime = 0;
+
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        r.sequence = m_result.sequence + 1;
+        m_result = r;
+    }
+
+    // The crossing, or the nominal end, starts the next window
+    double mean = su / M;
+    double ac = std::sqrt(std::max(urms2 - mean * mean, 0.0));
+    m_mean = (float)mean;
+    m_hyst = (float)std::max(0.1 * M_SQRT2 * ac, 1e-3 * m_settings.uFullScale);
+    size_t drop = (size_t)_end;
+    m_u.erase(m_u.begin(), m_u.begin() + drop);
+    m_i.erase(m_i.begin(), m_i.begin() + drop);
+    m_start = _end - drop;
+    m_startSynced = _synced;
+    m_crossings = 0;
+}
+
+void CPowerMeter::fft(){
+    const int M = POWER_FFT_LEN;
+    for (int k = 0; k < M; k++){
+        uint32_t r = m_rev[k];
+        if (r > (uint32_t)k){
+            std::swap(m_re[k], m_re[r]);
+            std::swap(m_im[k], m_im[r]);
+        }
+    }
+    for (int size = 2; size <= M; size <<= 1){
+        int half = size / 2;
+        int step = M / size;
+        for (int start = 0; start < M; start += size){
+            for (int k = 0; k < half; k++){
+                float wr = m_cos[k * step];
+                float wi = m_sin[k * step];
+                int a = start + k;
+                int b = a + half;
+                float tr = m_re[b] * wr - m_im[b] * wi;
+                float ti = m_re[b] * wi + m_im[b] * wr;
+                m_re[b] = m_re[a] - tr;
+                m_im[b] = m_im[a] - ti;
+                m_re[a] += tr;
+                m_im[a] += ti;
+            }
+        }
+    }
+}
+
+bool CPowerMeter::result(PowerResultT &_out) const{
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    if (m_result.sequence == 0)
+        return false;
+    _out = m_result;
+    return true;
+}
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cmath>
+#include "rpsa/server/core/Spectrum.h"
+
+namespace {
+    // Periodic windows, the spectrum repeats with fftSize
+    double Window(SpectrumT::Window _window, size_t _n, size_t _length){
+        double x = 2 * M_PI * _n / _length;
+        switch (_window){
+            case SpectrumT::HANN:
+                return 0.5 - 0.5 * std::cos(x);
+            case SpectrumT::BLACKMAN_HARRIS:
+                return 0.35875 - 0.48829 * std::cos(x) + 0.14128 * std::cos(2 * x) - 0.01168 * std::cos(3 * x);
+            case SpectrumT::FLAT_TOP:
+                return 0.21557895 - 0.41663158 * std::cos(x) + 0.277263158 * std::cos(2 * x)
+                     - 0.083578947 * std::cos(3 * x) + 0.006947368 * std::cos(4 * x);
+            default:
+                return 1;
+        }
+    }
+}
+
+CSpectrum::Ptr CSpectrum::Create(const SpectrumT &_settings, double _sampleRate){
+    return std::make_shared<CSpectrum>(_settings, _sampleRate);
+}
+
+CSpectrum::CSpectrum(const SpectrumT &_settings, double _sampleRate):
+    m_settings(_settings),
+    m_sampleRate(_sampleRate),
+    m_averages(1),
+    m_fill(0),
+    m_done(0),
+    m_outIndex(0)
+{
+    uint32_t size = SPECTRUM_MIN_FFT;
+    while (size < m_settings.fftSize && size < SPECTRUM_MAX_FFT)
+        size <<= 1;
+    m_settings.fftSize = size;
+    if (m_settings.frameRate > 0)
+        m_averages = (uint32_t)std::max(std::llround(m_sampleRate / (size * m_settings.frameRate)), 1LL);
+    m_settings.frameRate = outputRate();
+
+    const uint32_t M = size;
+    m_window.resize(M);
+    m_re.resize(M);
+    m_im.resize(M);
+    m_cos.resize(M / 2);
+    m_sin.resize(M / 2);
+    m_rev.resize(M);
+    double sum = 0;
+    for (uint32_t n = 0; n < M; n++){
+        m_window[n] = (float)Window(m_settings.window, n, M);
+        sum += m_window[n];
+    }
+    // A sine of amplitude A on bin k > 0 gives |X_k| = A * sum / 2, DC gives A * sum
+    const double fullScale = 32768.0 * sum;
+    m_scale[0] = (float)(1.0 / (fullScale * fullScale));
+    m_scale[1] = (float)(4.0 / (fullScale * fullScale));
+
+    int bits = 0;
+    while ((1u << bits) < M)
+        bits++;
+    for (uint32_t k = 0; k < M; k++){
+        uint32_t r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        m_rev[k] = r;
+    }
+    for (uint32_t k = 0; k < M / 2; k++){
+        m_cos[k] = (float)std::cos(2 * M_PI * k / M);
+        m_sin[k] = (float)-std::sin(2 * M_PI * k / M);
+    }
+    reset();
+}
+
+void CSpectrum::reset(){
+    for (auto &acc : m_acc){
+        acc.assign(bins(), 0.0);
+    }
+    m_fill = 0;
+    m_done = 0;
+    m_outIndex = 0;
+}
+
+void CSpectrum::skip(uint64_t _count){
+    // Every frame the lost samples belong to is gone, the one in progress included
+    const uint64_t period = (uint64_t)m_settings.fftSize * m_averages;
+    const uint64_t lostEnd = (uint64_t)m_done * m_settings.fftSize + m_fill + _count;
+    m_outIndex += (lostEnd + period - 1) / period;
+    for (auto &acc : m_acc){
+        std::fill(acc.begin(), acc.end(), 0.0);
+    }
+    m_fill = 0;
+    m_done = 0;
+}
+
+size_t CSpectrum::process(const int16_t *_in_ch1, const int16_t *_in_ch2, size_t _count, float *_out_ch1, float *_out_ch2){
+    const uint32_t M = m_settings.fftSize;
+    const uint32_t nbins = bins();
+    size_t frames = 0;
+    size_t i = 0;
+    while (i < _count){
+        size_t n = std::min<size_t>(M - m_fill, _count - i);
+        for (size_t k = 0; k < n; k++){
+            const float w = m_window[m_fill + k];
+            m_re[m_fill + k] = _in_ch1 ? _in_ch1[i + k] * w : 0.0f;
+            m_im[m_fill + k] = _in_ch2 ? _in_ch2[i + k] * w : 0.0f;
+        }
+        m_fill += n;
+        i += n;
+        if (m_fill < M)
+            break;
+        transform(_in_ch1 != nullptr, _in_ch2 != nullptr);
+        m_fill = 0;
+        if (++m_done < m_averages)
+            continue;
+        const double norm = 1.0 / m_averages;
+        for (int ch = 0; ch < 2; ch++){
+            float *out = ch == 0 ? _out_ch1 : _out_ch2;
+            if ((ch == 0 ? _in_ch1 : _in_ch2) == nullptr)
+                continue;
+            out += frames * nbins;
+            auto &acc = m_acc[ch];
+            for (uint32_t k = 0; k < nbins; k++){
+                // Floor far below the 16-bit noise, an empty bin is no -inf
+                out[k] = (float)(10.0 * std::log10(acc[k] * norm * m_scale[k == 0 ? 0 : 1] + 1e-30));
+                acc[k] = 0;
+            }
+        }
+        m_done = 0;
+        frames++;
+    }
+    m_outIndex += frames;
+    return frames;
+}
+
+// Adds the bin powers of both channels out of the FFT of IN1 + j IN2
+void CSpectrum::transform(bool _ch1, bool _ch2){
+    const uint32_t M = m_settings.fftSize;
+    fft();
+    for (uint32_t k = 0; k < bins(); k++){
+        uint32_t m = (M - k) % M;
+        if (_ch1){
+            double re = (m_re[k] + m_re[m]) / 2;
+            double im = (m_im[k] - m_im[m]) / 2;
+            m_acc[0][k] += re * re + im * im;
+        }
+        if (_ch2){
+            double re = (m_im[k] + m_im[m]) / 2;
+            double im = (m_re[k] - m_re[m]) / 2;
+            m_acc[1][k] += re * re + im * im;
+        }
+    }
+}
+
+void CSpectrum::fft(){
+    const uint32_t M = m_settings.fftSize;
+    for (uint32_t k = 0; k < M; k++){
+        uint32_t r = m_rev[k];
+        if (r > k){
+            std::swap(m_re[k], m_re[r]);
+            std::swap(m_im[k], m_im[r]);
+        }
+    }
+    for (uint32_t size = 2; size <= M; size <<= 1){
+        uint32_t half = size / 2;
+        uint32_t step = M / size;
+        for (uint32_t start = 0; start < M; start += size){
+            for (uint32_t k = 0; k < half; k++){
+                float wr = m_cos[k * step];
+                float wi = m_sin[k * step];
+                uint32_t a = start + k;
+                uint32_t b = a + half;
+                float tr = m_re[b] * wr - m_im[b] * wi;
+                float ti = m_re[b] * wi + m_im[b] * wr;
+                m_re[b] = m_re[a] - tr;
+                m_im[b] = m_im[a] - ti;
+                m_re[a] += tr;
+                m_im[a] += ti;
+            }
+        }
+    }
+}
@@ -1,59 +1,331 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <functional>
 #include <cstdlib>
+#include <sys/timex.h>
 #include "rpsa/server/core/StreamingApplication.h"
 #include "AsioNet.h"
+#include "rpsa/server/core/EventRing.h"
 
 #define CH1 1
 #define CH2 2
 
+namespace {
+    uint64_t ElapsedUs(std::chrono::steady_clock::time_point _from, std::chrono::steady_clock::time_point _to){
+        return _to > _from ? std::chrono::duration_cast<std::chrono::microseconds>(_to - _from).count() : 0;
+    }
+}
+
 #ifdef OS_MACOS
 #   include "rpsa/common/core/aligned_alloc.h"
 #endif // OS_MACOS
 
 
-#ifdef DEBUG_OUT
-#define PrintDebugInFile(X) PrintDebugLogInFile(X);
-#else
-#define PrintDebugInFile(X)
-#endif
-
-void PrintDebugLogInFile(const char *message){
-	std::time_t result = std::time(nullptr);	
-    std::fstream fs;
-  	fs.open ("/tmp/debug.log", std::fstream::in | std::fstream::out | std::fstream::app);
-	fs << std::asctime(std::localtime(&result)) << " : " << message << "\n";
-	fs.close();
-}
-
 CStreamingApplication::CStreamingApplication(CStreamingManager::Ptr _StreamingManager,COscilloscope::Ptr _osc_ch, unsigned short _resolution,int _oscRate,int _channels) :
     m_StreamingManager(_StreamingManager),
     m_Osc_ch(_osc_ch),
     m_OscThread(),
-    m_ReadyToPass(0),
+    m_SocketThread(),
     m_Ios(),
+    m_OscIos(),
+    m_bufferSize(osc_buf_size),
     m_WriteBuffer_ch1(nullptr),
     m_WriteBuffer_ch2(nullptr),
+    m_SendBuffer_ch1(nullptr),
+    m_SendBuffer_ch2(nullptr),
+    m_PendingChangeBuffers(false),
     m_Timer(m_Ios),
+    m_StatTimer(m_OscIos),
+    m_AdaptTimer(m_OscIos),
     m_BytesCount(0),
+    m_counter(0),
+    m_passCounter(0),
+    m_dropFirstNBuffer(0),
     m_Resolution(_resolution),
+    m_copyCh(nullptr),
+    m_lostRate(0),
+    m_sampleId(0),
     m_isRun(false),
     m_oscRate(_oscRate),
+    m_outRate(_oscRate),
     m_channels(_channels),
-    mtx()
+    m_ring(nullptr),
+    m_ringDepth(BUFFER_RING_DEFAULT_DEPTH),
+    m_oscSched(),
+    m_preTrigger(),
+    m_triggered(true),
+    m_softTrigger(false),
+    m_trigger(nullptr),
+    m_trigEvents(),
+    m_trigSample(0),
+    m_preWindow(0),
+    m_trigChannel(0),
+    m_preSamples(0),
+    m_postSamples(0),
+    m_captureStart(0),
+    m_captureEnd(0),
+    m_capture(),
+    m_captureId(0),
+    m_sentCaptureId(0),
+    m_rearming(false),
+    m_lockInSettings(),
+    m_lockIn(nullptr),
+    m_spectrumSettings(),
+    m_spectrum(nullptr),
+    m_ddcSettings(),
+    m_ddc(nullptr),
+    m_decimatorSettings(),
+    m_decimator(nullptr),
+    m_decimated(),
+    m_voltsEnable(false),
+    m_volts(false),
+    m_calibration(),
+    m_syncEnable(false),
+    m_sync(false),
+    m_syncOrigin(0),
+    m_clockChecked(),
+    m_clockFlags(0),
+    m_clockErrorNs(0),
+    m_powerSettings(),
+    m_power(nullptr),
+    m_adaptEnable(false),
+    m_adapt(false),
+    m_adaptState(),
+    m_adaptLoss(0),
+    m_adaptSettle(0)
 {
     
-    assert(this->m_Resolution == 8 || this->m_Resolution == 16);
+    assert(this->m_Resolution == 8 || this->m_Resolution == 12 || this->m_Resolution == 14 || this->m_Resolution == 16 || this->m_Resolution == LOCKIN_RESOLUTION);
 
     m_size_ch1 = 0;
     m_size_ch2 = 0;
     
-    m_WriteBuffer_ch1 = aligned_alloc(64, osc_buf_size);
-    m_WriteBuffer_ch2 = aligned_alloc(64, osc_buf_size);
+    // Floats take twice the room of the 16-bit DMA samples
+    if (m_Resolution == VOLTS_RESOLUTION)
+        m_bufferSize = 2 * osc_buf_size;
+    m_WriteBuffer_ch1 = aligned_alloc(64, m_bufferSize);
+    m_WriteBuffer_ch2 = aligned_alloc(64, m_bufferSize);
+    m_SendBuffer_ch1 = m_WriteBuffer_ch1;
+    m_SendBuffer_ch2 = m_WriteBuffer_ch2;
 
     m_OscThreadRun.test_and_set();
+    m_SockThreadRun.test_and_set();
+}
+
+void CStreamingApplication::setBufferRingDepth(size_t _depth){
+    if (!m_isRun)
+        m_ringDepth = _depth;
+}
+
+void CStreamingApplication::setOscThreadSched(const ThreadSchedT &_sched){
+    if (!m_isRun)
+        m_oscSched = _sched;
+}
+
+void CStreamingApplication::setPreTrigger(const PreTriggerT &_preTrigger){
+    if (!m_isRun)
+        m_preTrigger = _preTrigger;
+}
+
+void CStreamingApplication::setLockIn(const LockInT &_lockIn){
+    if (!m_isRun)
+        m_lockInSettings = _lockIn;
+}
+
+void CStreamingApplication::setSpectrum(const SpectrumT &_spectrum){
+    if (!m_isRun)
+        m_spectrumSettings = _spectrum;
+}
+
+void CStreamingApplication::setDdc(const DdcT &_ddc){
+    if (!m_isRun)
+        m_ddcSettings = _ddc;
+}
+
+void CStreamingApplication::setVolts(bool _enable, const CalibrationT &_calibration){
+    if (!m_isRun){
+        m_voltsEnable = _enable;
+        m_calibration = _calibration;
+    }
+}
+
+void CStreamingApplication::setDecimator(const DecimatorT &_decimator){
+    if (!m_isRun)
+        m_decimatorSettings = _decimator;
+}
+
+void CStreamingApplication::setSync(bool _enable){
+    if (!m_isRun)
+        m_syncEnable = _enable;
+}
+
+void CStreamingApplication::setPowerMeter(const PowerMeterT &_power){
+    if (!m_isRun)
+        m_powerSettings = _power;
+}
+
+void CStreamingApplication::setAdaptive(bool _enable){
+    if (!m_isRun)
+        m_adaptEnable = _enable;
+}
+
+bool CStreamingApplication::getPowerResult(PowerResultT &_result) const{
+    return m_power ? m_power->result(_result) : false;
+}
+
+void CStreamingApplication::trigger(){
+    m_softTrigger = true;
+}
+
+// The send thread must exist before the first buffer is queued. Zero-copy
+// scatter-gather sends straight from the DMA buffer, so it keeps the
+// synchronous path and needs no ring.
+void CStreamingApplication::startWorkers(){
+    m_ring = nullptr;
+    m_sync = false;
+    m_syncOrigin = 0;
+    m_triggered = true;
+    m_softTrigger = false;
+    m_rearming = false;
+    m_trigger = nullptr;
+    if (m_preTrigger.source != PreTriggerT::SOFTWARE){
+        TriggerT condition = m_preTrigger.condition;
+        condition.channels = m_preTrigger.source;
+        m_trigger = CTriggerEngine::Create(condition);
+    }
+    m_lockIn = nullptr;
+    m_outRate = m_oscRate;
+    if (m_lockInSettings.enable){
+        if (m_Resolution == LOCKIN_RESOLUTION){
+            m_lockIn = CLockIn::Create(m_lockInSettings, (double)osc_adc_rate / m_oscRate);
+            m_outRate = m_oscRate * m_lockIn->settings().decimation;
+            std::cout << "[rpsa] Lock-in on IN" << m_lockInSettings.channel << " at " << m_lockInSettings.frequency
+                      << " Hz, " << m_lockIn->outputRate() << " outputs/s\n";
+        }else{
+            std::cerr << "[rpsa] Lock-in needs the resolution " << LOCKIN_RESOLUTION << ", ignored\n";
+        }
+    }
+    // Both replace the samples in the packs, the header names the payload
+    m_spectrum = nullptr;
+    if (m_spectrumSettings.enable){
+        if (m_lockIn == nullptr && m_Resolution == SPECTRUM_RESOLUTION){
+            m_spectrum = CSpectrum::Create(m_spectrumSettings, (double)osc_adc_rate / m_oscRate);
+            std::cout << "[rpsa] Spectrum, " << m_spectrum->settings().fftSize << " points, " << m_spectrum->averages()
+                      << " averages, " << m_spectrum->outputRate() << " frames/s\n";
+        }else{
+            std::cerr << "[rpsa] Spectrum needs the resolution " << SPECTRUM_RESOLUTION << " without the lock-in, ignored\n";
+        }
+    }
+    m_ddc = nullptr;
+    if (m_ddcSettings.enable){
+        if (m_lockIn == nullptr && m_spectrum == nullptr && m_Resolution == DDC_RESOLUTION){
+            m_ddc = CDdc::Create(m_ddcSettings, (double)osc_adc_rate / m_oscRate);
+            m_outRate = m_oscRate * m_ddc->settings().decimation;
+            std::cout << "[rpsa] DDC on IN" << m_ddc->settings().channel << " at " << m_ddc->settings().frequency
+                      << " Hz, " << m_ddc->taps() << " taps, " << m_ddc->outputRate() << " IQ samples/s\n";
+        }else{
+            std::cerr << "[rpsa] DDC needs the resolution " << DDC_RESOLUTION << " without the lock-in or the spectrum, ignored\n";
+        }
+    }
+    asionet::CAsioNet::SetPayloadType(m_spectrum ? PACK_PAYLOAD_SPECTRUM : (m_ddc ? PACK_PAYLOAD_IQ : PACK_PAYLOAD_SAMPLES));
+    m_volts = false;
+    if (m_voltsEnable){
+        if (m_lockIn == nullptr && m_spectrum == nullptr && m_ddc == nullptr && m_Resolution == VOLTS_RESOLUTION && m_calibration.valid){
+            m_volts = true;
+            std::cout << "[rpsa] Volts, IN1 " << m_calibration.scale[0] << " V per count, offset " << m_calibration.offset[0]
+                      << ", IN2 " << m_calibration.scale[1] << " V per count, offset " << m_calibration.offset[1] << "\n";
+        }else{
+            std::cerr << "[rpsa] Volts need a calibration and the resolution " << VOLTS_RESOLUTION << ", ignored\n";
+        }
+    }
+    m_copyCh = selectCopy();
+    m_decimator = nullptr;
+    if (m_decimatorSettings.enable){
+        if (m_lockIn == nullptr && m_spectrum == nullptr && m_ddc == nullptr && (m_Resolution == 8 || m_Resolution == 16 || m_volts)){
+            m_decimator = CDecimator::Create(m_decimatorSettings);
+            m_outRate = m_oscRate * m_decimator->settings().factor;
+            for (auto &buffer : m_decimated)
+                buffer.resize(m_volts ? osc_buf_size / sizeof(int16_t) : 0);
+            std::cout << "[rpsa] Decimation by " << m_decimator->settings().factor << ", " << m_decimator->taps() << " taps, "
+                      << (double)osc_adc_rate / m_outRate << " samples/s\n";
+        }else{
+            std::cerr << "[rpsa] Decimation needs 8 or 16-bit samples or volts, ignored\n";
+        }
+    }
+    m_power = nullptr;
+    if (m_powerSettings.enable){
+        if (m_channels == 3 && m_lockIn == nullptr){
+            m_power = CPowerMeter::Create(m_powerSettings, (double)osc_adc_rate / m_oscRate);
+            std::cout << "[rpsa] Power meter at " << m_power->settings().frequency << " Hz, "
+                      << m_power->innerRate() << " samples/s analysed\n";
+        }else{
+            std::cerr << "[rpsa] Power meter needs both raw channels, ignored\n";
+        }
+    }
+    // The decimated samples are no longer in the DMA buffer, they go through the ring
+    if (!(m_Resolution == 16 && m_StreamingManager->isScatterGather()) || m_decimator){
+        size_t depth = m_ringDepth;
+        const double sampleRate = (double)osc_adc_rate / m_oscRate;
+        const uint64_t segmentSamples = osc_buf_size / sizeof(int16_t);
+        m_preSamples = std::llround(std::max(m_preTrigger.seconds, 0.0) * sampleRate);
+        m_postSamples = m_preTrigger.gated() ? std::max<uint64_t>(std::llround(m_preTrigger.postSeconds * sampleRate), 1) : 0;
+        m_captureStart = 0;
+        m_captureEnd = UINT64_MAX;
+        m_captureId = 0;
+        m_sentCaptureId = 0;
+        // A synchronized stream waits for the trigger even without samples before it
+        if (m_preTrigger.seconds > 0 || m_preTrigger.gated() || m_syncEnable){
+            // The window is held in the ring itself, one slot per DMA segment.
+            // The trigger can be the first sample of its segment, the sender
+            // cuts the window to the exact sample count.
+            size_t window = (m_preSamples + segmentSamples - 1) / segmentSamples + 1;
+            window = std::min(window, (size_t)(PRETRIGGER_MAX_BYTES / (2 * m_bufferSize)));
+            depth = std::max(depth, window);
+            m_preWindow = window;
+            m_preSamples = std::min<uint64_t>(m_preSamples, (window - 1) * segmentSamples);
+            m_triggered = false;
+            std::cout << "[rpsa] Pre-trigger window: " << m_preSamples << " samples, " << (window * 2 * m_bufferSize) / (1024 * 1024) << " MB\n";
+        }
+        // Only the events are written, the time between them is no loss
+        m_StreamingManager->setWavGapFill(!m_preTrigger.gated());
+        if (m_preTrigger.gated()){
+            std::cout << "[rpsa] Gated capture: " << m_postSamples << " samples after every trigger\n";
+        }
+        // Lock-in, spectrum, DDC and decimator outputs have an index of their own, not the one of the trigger
+        m_sync = m_syncEnable && !m_triggered && m_lockIn == nullptr && m_spectrum == nullptr && m_ddc == nullptr && m_decimator == nullptr;
+        m_ring = CBufferRing::Create(depth, m_bufferSize);
+        m_SocketThread = std::thread(&CStreamingApplication::socketWorker, this);
+    }else if (m_preTrigger.seconds > 0 || m_preTrigger.gated() || m_syncEnable){
+        std::cerr << "[rpsa] Pre-trigger capture needs the buffer ring, ignored with scatter-gather\n";
+    }
+    if (m_syncEnable && !m_sync){
+        std::cerr << "[rpsa] Synchronized sample ids need a pre-trigger capture of raw samples and the buffer ring, ignored\n";
+    }
+    asionet::CAsioNet::SetSyncedIds(m_sync);
+    // The steps change what the ring slots hold, a capture window or a
+    // derived stream would not survive them
+    m_adapt = false;
+    if (m_adaptEnable){
+        if (m_ring && m_triggered && m_StreamingManager->isNetwork() && (m_Resolution == 8 || m_Resolution == 16)
+            && m_lockIn == nullptr && m_spectrum == nullptr && m_ddc == nullptr && m_decimator == nullptr && m_power == nullptr){
+            m_adapt = true;
+            std::cout << "[rpsa] Adaptive rate control\n";
+        }else{
+            std::cerr << "[rpsa] Adaptive rate control needs a plain 8 or 16-bit network stream through the ring, ignored\n";
+        }
+    }
+    m_adaptState.rate = m_oscRate;
+    m_adaptState.resolution = m_Resolution;
+    m_adaptState.compression = m_StreamingManager->getCompression() != NONE_COMPRESSION;
+    m_adaptState.steps = 0;
+    m_adaptLoss = 0;
+    m_adaptSettle = ADAPT_SETTLE_PERIODS;
+    // Restarted here and not in the thread, so an early stop() is not lost
+    m_OscIos.restart();
+    m_OscThread = std::thread(&CStreamingApplication::oscWorker, this);
 }
 
 CStreamingApplication::~CStreamingApplication()
@@ -73,11 +345,11 @@ void CStreamingApplication::run()
     m_size_ch2 = 0;
 
     m_isRun = true;
-    m_OscThread = std::thread(&CStreamingApplication::oscWorker, this);
 
     try {
 
         m_StreamingManager->run();
+        startWorkers();
 
         // OS signal handler
         asio::signal_set signalSet(m_Ios, SIGINT, SIGTERM);
@@ -91,7 +363,7 @@ void CStreamingApplication::run()
     catch (const asio::system_error &e)
     {
         std::cerr << "Error: CStreamingApplication::run(), " << e.what() << std::endl;
-        PrintDebugInFile( e.what());
+        CEventRing::Message(CEventRing::EXCEPTION, e.what());
     }
 
 }
@@ -102,13 +374,13 @@ void CStreamingApplication::runNonBlock(){
     m_isRun = true;    
     try {
         m_StreamingManager->run(); // MUST BE INIT FIRST for thread logic
-        m_OscThread = std::thread(&CStreamingApplication::oscWorker, this);
+        startWorkers();
         
     }
     catch (const asio::system_error &e)
     {
         std::cerr << "Error: CStreamingApplication::run(), " << e.what() << std::endl;
-        PrintDebugInFile( e.what());
+        CEventRing::Message(CEventRing::EXCEPTION, e.what());
     }
 }
 
@@ -116,7 +388,12 @@ bool CStreamingApplication::stop(){
     
     if (m_isRun){
         m_OscThreadRun.clear();
-        m_OscThread.join();
+        m_OscIos.stop();
+        if (m_OscThread.joinable())
+            m_OscThread.join();
+        m_SockThreadRun.clear();
+        if (m_SocketThread.joinable())
+            m_SocketThread.join();
         m_StreamingManager->stop();
         m_Ios.stop();
         m_Osc_ch->stop();
@@ -129,128 +406,396 @@ bool CStreamingApplication::stop(){
 
 void CStreamingApplication::oscWorker()
 {
+    SetCurrentThreadSched(m_oscSched, "Acquisition");
     sleep(1); // The delay is necessary for the web interface of the application to update
     m_Osc_ch->prepare();
-    auto timeNow = std::chrono::system_clock::now();
-    auto curTime = std::chrono::time_point_cast<std::chrono::milliseconds >(timeNow);
-    auto value = curTime.time_since_epoch();
-
-    long long int timeBegin = value.count();
-    uintmax_t counter = 0;
     m_lostRate = 0;
-    uintmax_t passCounter = 0;
-    int dropFirstNBuffer = 2;
+    m_sampleId = 0;
+    m_counter = 0;
+    m_passCounter = 0;
+    m_dropFirstNBuffer = 2;
 try{
-    while (m_OscThreadRun.test_and_set())
-    {
-#ifndef DISABLE_OSC
-        m_size_ch1 = 0;
-        m_size_ch2 = 0;
-        bool overFlow = this->passCh(m_size_ch1,m_size_ch2);
-        if (dropFirstNBuffer > 0 && (m_size_ch1 > 0 || m_size_ch2 > 0)) {
-            m_size_ch1 = 0;
-            m_size_ch2 = 0;
-            dropFirstNBuffer--;
-            continue;
-        }
-        if (overFlow) {
-            m_lostRate = 1;
-            ++passCounter;
-        }
-
-#endif
-        oscNotify(m_lostRate, m_oscRate, m_WriteBuffer_ch1, m_size_ch1, m_WriteBuffer_ch2, m_size_ch2);
-        m_lostRate = 0;
-        ++counter;
-
-        timeNow = std::chrono::system_clock::now();
-        curTime = std::chrono::time_point_cast<std::chrono::milliseconds >(timeNow);
-        value = curTime.time_since_epoch();
-
-          
-        if ((value.count() - timeBegin) >= 5000) {
-            std::cout << "Lost rate: " << passCounter << " / " << counter << " (" << (100. * static_cast<double>(passCounter) / counter) << " %)\n";
-            counter = 0;
-            passCounter = 0;
-            timeBegin = value.count();
-        }
-
-        if (!m_StreamingManager->isFileThreadWork()){
-            if (m_StreamingManager->notifyStop){
-                m_StreamingManager->notifyStop(0);
-                m_StreamingManager->notifyStop = nullptr;                
-            }
-        }
-
-        usleep(10);
+    // Acquisition, statistics and stop requests are all served by m_OscIos,
+    // stop() only has to stop it
+    m_StatTimer.expires_from_now(std::chrono::milliseconds(OSC_STAT_PERIOD_MS));
+    m_StatTimer.async_wait(std::bind(&CStreamingApplication::statHandler, this, std::placeholders::_1));
+    if (m_adapt){
+        m_AdaptTimer.expires_from_now(std::chrono::milliseconds(ADAPT_PERIOD_MS));
+        m_AdaptTimer.async_wait(std::bind(&CStreamingApplication::adaptHandler, this, std::placeholders::_1));
     }
-    
+    armOsc();
+    m_OscIos.run();
 }catch (std::exception& e)
 	{
 		fprintf(stderr, "Error: oscWorker() -> %s\n",e.what());
-        PrintDebugInFile( e.what());
+        CEventRing::Message(CEventRing::EXCEPTION, e.what());
 	}
+    m_StatTimer.cancel();
+    m_AdaptTimer.cancel();
+    m_Osc_ch->cancelNext();
 }
 
+void CStreamingApplication::armOsc()
+{
+#ifndef DISABLE_OSC
+    m_Osc_ch->asyncNext(m_OscIos, OSC_WAIT_TIMEOUT_MS,
+                        std::bind(&CStreamingApplication::oscHandler, this,
+                                  std::placeholders::_1, std::placeholders::_2, std::placeholders::_3,
+                                  std::placeholders::_4, std::placeholders::_5, std::placeholders::_6));
+#else
+    m_OscIos.post(std::bind(&CStreamingApplication::oscHandler, this, asio::error_code(), nullptr, nullptr, 0, false, false));
+#endif
+}
 
- bool CStreamingApplication::passCh(size_t &_size1, size_t &_size2){
-    
-    uint8_t *buffer_ch1 = nullptr;
-    uint8_t *buffer_ch2 = nullptr;
-    size_t   size = 0;
-    bool success = false;
-    bool  overFlow1 = false;
-    bool  overFlow2 = false;
-    
-    success = m_Osc_ch->next(buffer_ch1, buffer_ch2, size , overFlow1 , overFlow2);
+void CStreamingApplication::oscHandler(const asio::error_code &_error, uint8_t *_buffer_ch1, uint8_t *_buffer_ch2, size_t _size, bool _overFlow1, bool _overFlow2)
+{
+    if (_error == asio::error::operation_aborted)
+        return;
 
-    if (!success) {
-        std::cerr << "Error: m_Osc->next()" << std::endl;
-        return false;
+    if (!_error){
+        passBuffer(_buffer_ch1, _buffer_ch2, _size, _overFlow1 | _overFlow2);
+    }else if (_error != asio::error::timed_out){
+        std::cerr << "Error: m_Osc->asyncNext() " << _error.message() << std::endl;
     }
-    // short *wb2 = (short*)buffer;
-    // for(int i = 0 ;i < 40 /2 ;i ++)
-    //     std::cout << std::hex <<  (static_cast<int>(wb2[i]) & 0xFFFF)  << " ";
-    
-    if (buffer_ch1 != nullptr){
-        _size1 = size;
-        switch (m_Resolution)
-        {
-            case 8:
-                memcpy_stride_8bit_neon(((void**)m_WriteBuffer_ch1), buffer_ch1, _size1);
-                _size1 /= 2;
-                break;
-            case 16:
-                memcpy_neon(((void**)m_WriteBuffer_ch1), buffer_ch1, _size1);
-                break;
-            default:
-                break;
+
+    // Checked on timeouts too, so a stopped writer is noticed without data
+    if (!m_StreamingManager->isFileThreadWork()){
+        if (m_StreamingManager->notifyStop){
+            m_StreamingManager->notifyStop(0);
+            m_StreamingManager->notifyStop = nullptr;                
         }
-    }else{
-        _size1 = 0;
     }
-    
-    if (buffer_ch2 != nullptr){
-        _size2 = size;
-        switch (m_Resolution)
-        {
-            case 8:
-                memcpy_stride_8bit_neon(((void**)m_WriteBuffer_ch2), buffer_ch2, _size2);
-                _size2 /= 2;
-                break;
-            case 16:
-                memcpy_neon(((void**)m_WriteBuffer_ch2), buffer_ch2, _size2);
-                break;
-            default:
-                break;
+
+    if (m_OscThreadRun.test_and_set())
+        armOsc();
+}
+
+void CStreamingApplication::passBuffer(uint8_t *_buffer_ch1, uint8_t *_buffer_ch2, size_t _size, bool _overFlow)
+{
+    // The DMA always writes 16-bit samples, the index counts decimated samples per channel
+    const uint64_t segmentSamples = osc_buf_size / sizeof(int16_t);
+    auto copied = std::chrono::steady_clock::now();
+    auto ready = copied;
+    // With the lock-in the index counts its outputs
+    uint64_t sampleId = m_sampleId;
+#ifndef DISABLE_OSC
+    m_size_ch1 = 0;
+    m_size_ch2 = 0;
+    // The sender clears it once the last capture is written, m_triggered is false by then
+    const bool rearming = m_rearming.load();
+    // Checked on the raw samples, the DMA segment is released by passCh()
+    bool fire = !rearming && !m_triggered && checkTrigger(_buffer_ch1, _buffer_ch2, _size, m_sampleId + (_overFlow ? segmentSamples : 0));
+    // With a full ring the buffer still has to leave the DMA, it goes to the scratch buffers and is dropped.
+    // Between two gated captures nothing is written.
+    auto slot = m_ring && !rearming ? m_ring->writeSlot() : nullptr;
+    if (m_ring && !m_triggered && (slot == nullptr || m_ring->count() >= m_preWindow)){
+        // The pre-trigger window slides, the sender does not read yet
+        m_ring->dropOldest();
+        slot = m_ring->writeSlot();
+    }
+    // The reference keeps running over a lost segment
+    if (m_lockIn && _overFlow)
+        m_lockIn->skip(segmentSamples);
+    if (m_decimator && _overFlow)
+        m_decimator->skip(segmentSamples);
+    if (m_spectrum && _overFlow)
+        m_spectrum->skip(segmentSamples);
+    if (m_ddc && _overFlow)
+        m_ddc->skip(segmentSamples);
+    // Spectrum ids count bins, so consecutive packs continue each other like samples
+    uint64_t outputId = m_lockIn ? m_lockIn->outputIndex()
+                      : m_spectrum ? m_spectrum->outputIndex() * m_spectrum->bins()
+                      : m_ddc ? m_ddc->outputIndex()
+                      : (m_decimator ? m_decimator->outputIndex() : 0);
+    // Measured on the raw DMA samples before passCh() releases them, a full ring does not break the windows
+    if (m_power){
+        if (_overFlow)
+            m_power->skip(segmentSamples);
+        if (_buffer_ch1 != nullptr && _buffer_ch2 != nullptr)
+            m_power->process(reinterpret_cast<const int16_t*>(_buffer_ch1), reinterpret_cast<const int16_t*>(_buffer_ch2), _size / sizeof(int16_t));
+    }
+    this->passCh(_buffer_ch1, _buffer_ch2, _size, slot ? slot->ch1 : m_WriteBuffer_ch1, slot ? slot->ch2 : m_WriteBuffer_ch2, m_size_ch1, m_size_ch2);
+    if (m_dropFirstNBuffer > 0 && (m_size_ch1 > 0 || m_size_ch2 > 0)) {
+        m_size_ch1 = 0;
+        m_size_ch2 = 0;
+        m_dropFirstNBuffer--;
+        releaseOscBuffers();
+        return;
+    }
+    copied = std::chrono::steady_clock::now();
+    ready = m_Osc_ch->readyTime();
+    m_stats.copy.add(ElapsedUs(ready, copied));
+    m_stats.segments++;
+    // An overflow flag means the DMA lost one segment before this one
+    if (_overFlow) {
+        m_lostRate++;
+        m_sampleId += segmentSamples;
+        ++m_passCounter;
+        m_stats.lostSegments++;
+        m_stats.overflows++;
+    }
+    if (m_ring && slot == nullptr && !rearming) {
+        m_lostRate++;
+        ++m_passCounter;
+        m_stats.lostSegments++;
+        CEventRing::Record(CEventRing::RING_OVERFLOW, m_stats.lostSegments, 0);
+    }
+    CEventRing::Record(CEventRing::ADC_BUFFER, segmentSamples, m_lostRate);
+    sampleId = m_lockIn || m_spectrum || m_ddc || m_decimator ? outputId : m_sampleId;
+#else
+    CBufferRing::Slot *slot = nullptr;
+    bool fire = false;
+#endif
+    if (m_ring){
+        if (slot != nullptr && (m_size_ch1 > 0 || m_size_ch2 > 0)){
+            slot->size_ch1 = m_size_ch1;
+            slot->size_ch2 = m_size_ch2;
+            slot->lostRate = m_lostRate;
+            slot->sampleId = sampleId;
+            slot->rate = m_outRate;
+            slot->resolution = m_Resolution;
+            slot->readyTime = ready;
+            slot->copiedTime = copied;
+            m_ring->commitWrite();
+            m_lostRate = 0;
+            uint64_t waiting = m_ring->count();
+            if (waiting > m_stats.ringPeak)
+                m_stats.ringPeak = waiting;
+        }
+        if (fire){
+            std::cout << "[rpsa] Triggered at sample " << m_trigSample << ", " << m_ring->count() << " segments captured\n";
+            m_stats.triggers++;
+            m_stats.lastTrigger = m_trigSample;
+            m_captureStart = m_trigSample > m_preSamples ? m_trigSample - m_preSamples : 0;
+            m_captureEnd = m_preTrigger.gated() ? m_trigSample + m_postSamples : UINT64_MAX;
+            m_capture.triggerSample = m_trigSample;
+            m_capture.preSamples = m_trigSample - m_captureStart;
+            m_capture.postSamples = m_postSamples;
+            m_capture.channel = m_trigChannel;
+            if (m_captureId == 0)
+                m_syncOrigin = m_trigSample;
+            // The segment ends about now, the trigger lies that many samples before
+            double behind = (double)(m_sampleId + segmentSamples - m_trigSample) * m_oscRate / osc_adc_rate;
+            m_capture.triggerTime = std::chrono::system_clock::now()
+                - std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double>(behind));
+            m_captureId++;
+            // The sender reads the capture once it sees the flag
+            m_triggered = true;
         }
+        // The segment holds the last sample of a gated capture, the sender drains the ring before the next one
+        if (m_triggered && !rearming && m_sampleId + segmentSamples >= m_captureEnd)
+            m_rearming = true;
+        releaseOscBuffers();
     }else{
-        _size2 = 0;
+        stampPackTime(sampleId, ready, copied);
+        oscNotify(m_lostRate, sampleId, m_outRate, m_Resolution, m_SendBuffer_ch1, m_size_ch1, m_SendBuffer_ch2, m_size_ch2);
+        releaseOscBuffers();
+        m_lostRate = 0;
+        auto sent = std::chrono::steady_clock::now();
+        m_stats.queue.add(0);
+        m_stats.send.add(ElapsedUs(copied, sent));
+        m_stats.total.add(ElapsedUs(ready, sent));
+    }
+    if (m_size_ch1 > 0 || m_size_ch2 > 0)
+        m_sampleId += segmentSamples;
+    ++m_counter;
+}
+
+// Any loss since the last check, a DMA overflow, a full ring, a dropped
+// pack or an exhausted pool, or a ring more than three quarters full
+// takes the next step. Runs on the acquisition thread between two buffers.
+void CStreamingApplication::adaptHandler(const asio::error_code &_error)
+{
+    if (_error)
+        return;
+
+    uint64_t loss = m_stats.lostSegments + m_StreamingManager->getDroppedPacks() + m_StreamingManager->getPoolExhaustedCount();
+    bool pressure = loss != m_adaptLoss || m_ring->count() * 4 > m_ring->depth() * 3;
+    m_adaptLoss = loss;
+    if (m_adaptSettle > 0){
+        m_adaptSettle--;
+    }else if (pressure && adaptStep()){
+        m_adaptState.steps++;
+        m_adaptSettle = ADAPT_SETTLE_PERIODS;
+        // The step itself may count losses, they are not the next reason
+        m_adaptLoss = m_stats.lostSegments + m_StreamingManager->getDroppedPacks() + m_StreamingManager->getPoolExhaustedCount();
+    }
+
+    m_AdaptTimer.expires_from_now(std::chrono::milliseconds(ADAPT_PERIOD_MS));
+    m_AdaptTimer.async_wait(std::bind(&CStreamingApplication::adaptHandler, this, std::placeholders::_1));
+}
+
+// Cheapest first: compression costs CPU only, 8-bit samples halve the
+// data, a higher decimation restarts the DMA and leaves a gap counted as
+// one lost segment. False once nothing is left.
+bool CStreamingApplication::adaptStep()
+{
+    if (!m_adaptState.compression){
+        m_adaptState.compression = true;
+        std::cout << "[rpsa] Adaptive: compression on\n";
+        return true;
+    }
+    if (m_Resolution == 16){
+        m_Resolution = 8;
+        m_copyCh = selectCopy();
+        m_adaptState.resolution = m_Resolution;
+        std::cout << "[rpsa] Adaptive: 8-bit samples\n";
+        return true;
+    }
+    if (m_oscRate < ADAPT_MAX_RATE){
+        m_oscRate = std::min(m_oscRate * 2, ADAPT_MAX_RATE);
+        m_outRate = m_oscRate;
+        m_Osc_ch->setDecimation(m_oscRate);
+        m_Osc_ch->prepare();
+        // The first segments after a start are dropped like at the beginning
+        m_dropFirstNBuffer = 2;
+        m_lostRate++;
+        m_stats.lostSegments++;
+        m_adaptState.rate = m_oscRate;
+        std::cout << "[rpsa] Adaptive: decimation " << m_oscRate << "\n";
+        return true;
+    }
+    return false;
+}
+
+// Checks only what is fixed for the session, the change itself is queued
+// to the acquisition thread like adaptStep() and takes its place between
+// two buffers.
+bool CStreamingApplication::reconfigure(int _oscRate, int _channels, unsigned short _resolution)
+{
+    if (!m_isRun || _oscRate < 1 || _channels < 1 || _channels > 3)
+        return false;
+    bool plain = (_resolution == 8 || _resolution == 12 || _resolution == 14 || _resolution == 16)
+                 && m_lockIn == nullptr && m_spectrum == nullptr && m_ddc == nullptr && m_decimator == nullptr
+                 && m_power == nullptr && !m_volts && !m_adapt && !m_sync
+                 && m_preTrigger.seconds <= 0 && !m_preTrigger.gated();
+    // WAV and RAW headers hold the rate and the layout of the whole file,
+    // TDMS starts a segment with new metadata. Packed samples never reach files.
+    if (m_StreamingManager->isLocalFile())
+        plain = plain && m_StreamingManager->getFileType() == TDMS_TYPE && (_resolution == 8 || _resolution == 16);
+    // The ring is set up at the start, scatter-gather sends 16-bit samples without it
+    plain = plain && (m_ring == nullptr) == (_resolution == 16 && m_StreamingManager->isScatterGather());
+    if (!plain){
+        std::cerr << "[rpsa] Reconfiguration needs a plain 8 to 16-bit stream to the network or a TDMS file, ignored\n";
+        return false;
     }
 
-    if (success){
+    m_OscIos.post([this, _oscRate, _channels, _resolution](){
+        m_Osc_ch->stop();
+        m_oscRate = _oscRate;
+        m_outRate = m_oscRate;
+        m_channels = _channels;
+        m_Resolution = _resolution;
+        m_copyCh = selectCopy();
+        m_Osc_ch->setDecimation(m_oscRate);
+        m_Osc_ch->setChannels(m_channels & 1, m_channels & 2);
+        m_Osc_ch->prepare();
+        // The first segments after a start are dropped like at the beginning
+        m_dropFirstNBuffer = 2;
+        m_lostRate++;
+        m_stats.lostSegments++;
+        m_adaptState.rate = m_oscRate;
+        m_adaptState.resolution = m_Resolution;
+        CEventRing::Record(CEventRing::RECONFIGURED, m_oscRate, ((uint64_t)m_Resolution << 8) | m_channels);
+        std::cout << "[rpsa] Reconfigured: decimation " << m_oscRate << ", channels " << m_channels
+                  << ", " << m_Resolution << "-bit\n";
+    });
+    return true;
+}
+
+void CStreamingApplication::statHandler(const asio::error_code &_error)
+{
+    if (_error)
+        return;
+
+    std::cout << "Lost rate: " << m_passCounter << " / " << m_counter << " (" << (100. * static_cast<double>(m_passCounter) / m_counter) << " %)"
+              << " Pool exhausted: " << m_StreamingManager->getPoolExhaustedCount()
+              << " Clients: " << m_StreamingManager->getClientsCount()
+              << " Client drops: " << m_StreamingManager->getDroppedPacks()
+              << " Ring peak: " << (m_ring ? m_ring->peakCount() : 0) << "\n";
+    m_counter = 0;
+    m_passCounter = 0;
+
+    m_StatTimer.expires_from_now(std::chrono::milliseconds(OSC_STAT_PERIOD_MS));
+    m_StatTimer.async_wait(std::bind(&CStreamingApplication::statHandler, this, std::placeholders::_1));
+}
+
+
+ void CStreamingApplication::passCh(uint8_t *buffer_ch1, uint8_t *buffer_ch2, size_t size, void *_dst_ch1, void *_dst_ch2, size_t &_size1, size_t &_size2){
+
+    if (m_Resolution == 16 && m_StreamingManager->isScatterGather() && m_decimator == nullptr){
+        // Blocking gather send reads straight from the DMA half-buffer, it is
+        // handed back to the DMA only after oscNotify() in releaseOscBuffers()
+        _size1 = buffer_ch1 != nullptr ? size : 0;
+        _size2 = buffer_ch2 != nullptr ? size : 0;
+        m_SendBuffer_ch1 = buffer_ch1;
+        m_SendBuffer_ch2 = buffer_ch2;
+        m_PendingChangeBuffers = true;
+        return;
+    }
+    m_SendBuffer_ch1 = _dst_ch1;
+    m_SendBuffer_ch2 = _dst_ch2;
+
+    if (m_lockIn){
+        // Both outputs come from one input, decimation >= 2 keeps them inside the buffers
+        auto input = m_lockIn->settings().channel == 2 ? buffer_ch2 : buffer_ch1;
+        size_t outs = 0;
+        if (input != nullptr)
+            outs = m_lockIn->process(reinterpret_cast<const int16_t*>(input), size / sizeof(int16_t), (float*)_dst_ch1, (float*)_dst_ch2);
+        _size1 = outs * sizeof(float);
+        _size2 = outs * sizeof(float);
+        m_Osc_ch->changeBuffers();
+        return;
+    }
+    if (m_spectrum){
+        // The float slot holds 32768 values, more than the bins of all frames one segment can finish
+        size_t frames = m_spectrum->process(reinterpret_cast<const int16_t*>(buffer_ch1), reinterpret_cast<const int16_t*>(buffer_ch2),
+                                            size / sizeof(int16_t), (float*)_dst_ch1, (float*)_dst_ch2);
+        const size_t bytes = frames * m_spectrum->bins() * sizeof(float);
+        _size1 = buffer_ch1 != nullptr ? bytes : 0;
+        _size2 = buffer_ch2 != nullptr ? bytes : 0;
+        m_Osc_ch->changeBuffers();
+        return;
+    }
+    if (m_ddc){
+        auto input = m_ddc->settings().channel == 2 ? buffer_ch2 : buffer_ch1;
+        size_t outs = 0;
+        if (input != nullptr)
+            outs = m_ddc->process(reinterpret_cast<const int16_t*>(input), size / sizeof(int16_t), (float*)_dst_ch1, (float*)_dst_ch2);
+        _size1 = outs * sizeof(float);
+        _size2 = outs * sizeof(float);
+        m_Osc_ch->changeBuffers();
+        return;
+    }
+    if (m_decimator){
+        // The filter writes 16-bit samples straight into the slot, 8-bit keeps their high bytes.
+        // The output count varies with the factor, so the NEON copies with their block sizes are not used.
+        // Volts are converted from the filter outputs.
+        auto out_ch1 = m_volts ? m_decimated[0].data() : reinterpret_cast<int16_t*>(_dst_ch1);
+        auto out_ch2 = m_volts ? m_decimated[1].data() : reinterpret_cast<int16_t*>(_dst_ch2);
+        size_t outs = m_decimator->process(reinterpret_cast<const int16_t*>(buffer_ch1), reinterpret_cast<const int16_t*>(buffer_ch2), size / sizeof(int16_t), out_ch1, out_ch2);
+        if (m_volts){
+            if (buffer_ch1 != nullptr)
+                convertVolts(0, out_ch1, outs * sizeof(int16_t), _dst_ch1);
+            if (buffer_ch2 != nullptr)
+                convertVolts(1, out_ch2, outs * sizeof(int16_t), _dst_ch2);
+        }else if (m_Resolution == 8){
+            for (size_t i = 0; i < outs; i++){
+                if (buffer_ch1 != nullptr)
+                    reinterpret_cast<int8_t*>(_dst_ch1)[i] = out_ch1[i] >> 8;
+                if (buffer_ch2 != nullptr)
+                    reinterpret_cast<int8_t*>(_dst_ch2)[i] = out_ch2[i] >> 8;
+            }
+        }
+        const size_t bytes = outs * (m_Resolution / 8);
+        _size1 = buffer_ch1 != nullptr ? bytes : 0;
+        _size2 = buffer_ch2 != nullptr ? bytes : 0;
         m_Osc_ch->changeBuffers();
+        return;
     }
+    (this->*m_copyCh)(buffer_ch1, buffer_ch2, size, _dst_ch1, _dst_ch2, _size1, _size2);
+
+    m_Osc_ch->changeBuffers();
 
     //std::ofstream outfile2;
     //outfile2.open("/tmp/test.txt", std::ios_base::app);  
@@ -260,13 +805,222 @@ try{
     //      std::cout << (static_cast<int>(wb[_bufferIndex][i]) & 0xFF)  << " ";
     //   }
  	// exit(1);
-    return overFlow1 | overFlow2;
 }
 
 
-int CStreamingApplication::oscNotify(uint64_t _lostRate, uint32_t _oscRate,const void *_buffer_ch1, size_t _size_ch1,const void *_buffer_ch2, size_t _size_ch2)
+// Drains the ring into the streaming manager. Network jitter only grows the
+// ring, the oscilloscope thread keeps serving the DMA meanwhile.
+void CStreamingApplication::socketWorker()
+{
+    SetCurrentThreadSched(m_StreamingManager->getNetThreadSched(), "Ring sender");
+    // Lost segments reported by slots outside of a capture
+    uint64_t carried = 0;
+try{
+    while (m_SockThreadRun.test_and_set())
+    {
+        // The acquisition thread owns the ring tail until the trigger fires
+        if (!m_triggered){
+            usleep(100);
+            continue;
+        }
+        // Loaded first, every slot of the capture is committed before it is set
+        bool rearming = m_rearming.load();
+        auto slot = m_ring->readSlot();
+        if (slot == nullptr){
+            if (rearming){
+                // The capture is written, the acquisition thread fills the next window
+                m_triggered = false;
+                m_rearming = false;
+                continue;
+            }
+            usleep(10);
+            continue;
+        }
+        if (m_captureId != m_sentCaptureId){
+            m_StreamingManager->startCapture(m_capture);
+            m_sentCaptureId = m_captureId;
+        }
+        const uint8_t *ch1 = static_cast<const uint8_t*>(slot->ch1);
+        const uint8_t *ch2 = static_cast<const uint8_t*>(slot->ch2);
+        size_t size_ch1 = slot->size_ch1;
+        size_t size_ch2 = slot->size_ch2;
+        uint64_t sampleId = slot->sampleId;
+        uint64_t lostRate = slot->lostRate + carried;
+        // 8, 16-bit and volt slots hold one value per sample, they are cut to the capture.
+        // Packed samples, lock-in, spectrum, DDC and decimator outputs go out as whole segments.
+        if (m_lockIn == nullptr && m_spectrum == nullptr && m_ddc == nullptr && m_decimator == nullptr
+            && (slot->resolution == 8 || slot->resolution == 16 || m_volts)){
+            const size_t bytes = SAMPLE_SIZE(slot->resolution);
+            uint64_t end = sampleId + std::max(size_ch1, size_ch2) / bytes;
+            uint64_t from = std::max(sampleId, m_captureStart);
+            uint64_t to = std::min(end, m_captureEnd);
+            if (from >= to){
+                carried = lostRate;
+                m_ring->commitRead();
+                continue;
+            }
+            size_t offset = (from - sampleId) * bytes;
+            size_t length = (to - from) * bytes;
+            if (size_ch1 > 0){
+                ch1 += offset;
+                size_ch1 = length;
+            }
+            if (size_ch2 > 0){
+                ch2 += offset;
+                size_ch2 = length;
+            }
+            sampleId = from;
+        }
+        uint64_t segmentId = slot->sampleId;
+        // The boards of the chain saw the first trigger at the same sample
+        if (m_sync){
+            sampleId = sampleId - m_syncOrigin + PACK_SYNC_ORIGIN;
+            segmentId = segmentId - m_syncOrigin + PACK_SYNC_ORIGIN;
+        }
+        carried = 0;
+        // Compressed packs name themselves, the switch needs no ordering with the slots
+        if (m_adaptState.compression && m_StreamingManager->getCompression() == NONE_COMPRESSION)
+            m_StreamingManager->setCompression(DELTA_COMPRESSION);
+        stampPackTime(segmentId, slot->readyTime, slot->copiedTime);
+        auto taken = std::chrono::steady_clock::now();
+        oscNotify(lostRate, sampleId, slot->rate, slot->resolution, ch1, size_ch1, ch2, size_ch2);
+        auto sent = std::chrono::steady_clock::now();
+        m_stats.queue.add(ElapsedUs(slot->copiedTime, taken));
+        m_stats.send.add(ElapsedUs(taken, sent));
+        m_stats.total.add(ElapsedUs(slot->readyTime, sent));
+        m_ring->commitRead();
+    }
+}catch (std::exception& e)
+	{
+		fprintf(stderr, "Error: socketWorker() -> %s\n",e.what());
+	}
+}
+
+// _first is the sample index of the buffer, m_trigSample gets the exact one
+bool CStreamingApplication::checkTrigger(const uint8_t *_buffer_ch1, const uint8_t *_buffer_ch2, size_t _size, uint64_t _first){
+    m_trigEvents.clear();
+    if (m_trigger){
+        m_trigger->scan(reinterpret_cast<const int16_t*>(_buffer_ch1), reinterpret_cast<const int16_t*>(_buffer_ch2), _size / sizeof(int16_t), _first, m_trigEvents);
+    }
+    if (m_softTrigger.exchange(false)){
+        m_trigSample = _first;
+        m_trigChannel = 0;
+        CEventRing::Record(CEventRing::TRIGGER, _first, 0);
+        return true;
+    }
+    if (m_trigEvents.empty())
+        return false;
+    const TriggerEventT &event = m_trigEvents.front();
+    m_trigSample = event.sample;
+    m_trigChannel = event.channel;
+    CEventRing::Record(CEventRing::TRIGGER, event.sample, ((uint64_t)event.width << 8) | event.channel);
+    return true;
+}
+
+// Volts of one channel from 16-bit samples, returns the size of the floats
+size_t CStreamingApplication::convertVolts(int _channel, const void *_src, size_t _size, void *_dst){
+    const float scale = m_calibration.scale[_channel];
+    const float bias = -m_calibration.offset[_channel] * m_calibration.scale[_channel];
+    return convert_16bit_to_float_neon(_dst, _src, _size, scale, bias);
+}
+
+// Resolution 0 passes nothing, VOLTS_RESOLUTION converts to volts. The
+// switch is on the template argument and folds away.
+template<unsigned short Resolution>
+size_t CStreamingApplication::copyChannel(int _channel, const uint8_t *_src, size_t _size, void *_dst){
+    switch (Resolution)
+    {
+        case 8:
+            memcpy_stride_8bit_neon(_dst, _src, _size);
+            return _size / 2;
+        case 16:
+            memcpy_neon(_dst, _src, _size);
+            return _size;
+        case 14:
+            return memcpy_pack_14bit_neon(_dst, _src, _size);
+        case 12:
+            return memcpy_pack_12bit_neon(_dst, _src, _size);
+        case VOLTS_RESOLUTION:
+            return convertVolts(_channel, _src, _size, _dst);
+        default:
+            return 0;
+    }
+}
+
+// Channels is the mask of the enabled inputs, the DMA gives nullptr for the others
+template<unsigned short Resolution, int Channels>
+void CStreamingApplication::copyCh(const uint8_t *_src_ch1, const uint8_t *_src_ch2, size_t _size, void *_dst_ch1, void *_dst_ch2, size_t &_size1, size_t &_size2){
+    _size1 = (Channels & 1) ? copyChannel<Resolution>(0, _src_ch1, _size, _dst_ch1) : 0;
+    _size2 = (Channels & 2) ? copyChannel<Resolution>(1, _src_ch2, _size, _dst_ch2) : 0;
+}
+
+template<unsigned short Resolution>
+CStreamingApplication::CopyChFn CStreamingApplication::copyFor(int _channels){
+    switch (_channels)
+    {
+        case 1:
+            return &CStreamingApplication::copyCh<Resolution, 1>;
+        case 2:
+            return &CStreamingApplication::copyCh<Resolution, 2>;
+        case 3:
+            return &CStreamingApplication::copyCh<Resolution, 3>;
+        default:
+            return &CStreamingApplication::copyCh<Resolution, 0>;
+    }
+}
+
+// Called once m_volts is known, the lock-in and the decimator do not copy
+CStreamingApplication::CopyChFn CStreamingApplication::selectCopy(){
+    switch (m_Resolution)
+    {
+        case 8:
+            return copyFor<8>(m_channels);
+        case 12:
+            return copyFor<12>(m_channels);
+        case 14:
+            return copyFor<14>(m_channels);
+        case 16:
+            return copyFor<16>(m_channels);
+        case VOLTS_RESOLUTION:
+            return m_volts ? copyFor<VOLTS_RESOLUTION>(m_channels) : copyFor<0>(m_channels);
+        default:
+            return copyFor<0>(m_channels);
+    }
+}
+
+void CStreamingApplication::releaseOscBuffers(){
+    if (m_PendingChangeBuffers){
+        m_Osc_ch->changeBuffers();
+        m_PendingChangeBuffers = false;
+    }
+}
+
+// The DMA segment starting at _sampleId was complete at _ready, its first
+// sample is one segment earlier. The interrupt is seen with a latency that
+// is not measured, the copy after it is taken as its size.
+void CStreamingApplication::stampPackTime(uint64_t _sampleId, std::chrono::steady_clock::time_point _ready, std::chrono::steady_clock::time_point _copied)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_clockChecked >= std::chrono::seconds(1)){
+        struct timex tx = {};
+        int state = adjtimex(&tx);
+        m_clockFlags = PACK_TIME_VALID;
+        if (state >= 0 && state != TIME_ERROR && !(tx.status & STA_UNSYNC))
+            m_clockFlags |= PACK_TIME_SYNCED;
+        m_clockErrorNs = state >= 0 ? (uint32_t)std::min<uint64_t>((uint64_t)std::max<long>(tx.esterror, 0) * 1000, UINT32_MAX) : UINT32_MAX;
+        m_clockChecked = now;
+    }
+    const uint64_t segmentSamples = osc_buf_size / sizeof(int16_t);
+    int64_t realtime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    int64_t behind = std::chrono::duration_cast<std::chrono::nanoseconds>(now - _ready).count();
+    int64_t segment = (int64_t)(segmentSamples * m_oscRate * 1000000000ULL / osc_adc_rate);
+    uint64_t error = (uint64_t)m_clockErrorNs + ElapsedUs(_ready, _copied) * 1000;
+    asionet::CAsioNet::SetPackTime(_sampleId, realtime - behind - segment, (uint32_t)std::min<uint64_t>(error, UINT32_MAX), m_clockFlags);
+}
+
+int CStreamingApplication::oscNotify(uint64_t _lostRate, uint64_t _sampleId, uint32_t _oscRate, unsigned short _resolution, const void *_buffer_ch1, size_t _size_ch1,const void *_buffer_ch2, size_t _size_ch2)
 {
-    return m_StreamingManager->passBuffers(_lostRate,_oscRate, _buffer_ch1,_size_ch1,_buffer_ch2,_size_ch2,m_Resolution, 0);
+    return m_StreamingManager->passBuffers(_lostRate,_oscRate, _buffer_ch1,_size_ch1,_buffer_ch2,_size_ch2,_resolution, 0, _sampleId);
 }
 
 void CStreamingApplication::performanceCounterHandler(const asio::error_code &_error)
@@ -5,6 +5,7 @@
 #include <functional>
 #include <cstdlib>
 #include "rpsa/server/core/StreamingManager.h"
+#include "rpsa/server/core/EventRing.h"
 
 #ifdef _WIN32
 #include <dir.h>
@@ -52,7 +53,7 @@ std::string getNewFileName(Stream_FileType _fileType,string _filePath)
     time_t now = time(nullptr);
     timenow = gmtime(&now);
     strftime(time_str, sizeof(time_str), "%Y-%m-%d_%H-%M-%S", timenow);
-    std::string filename = _filePath  + "/" + std::string("data_file_") + time_str+"." + (_fileType == Stream_FileType::TDMS_TYPE ? "tdms":"wav");
+    std::string filename = _filePath  + "/" + std::string("data_file_") + time_str+"." + (_fileType == Stream_FileType::TDMS_TYPE ? "tdms" : _fileType == Stream_FileType::RAW_TYPE ? "raw" : "wav");
     return filename;
 }
 
@@ -69,6 +70,17 @@ CStreamingManager::Ptr CStreamingManager::Create(Stream_FileType _fileType,std::
 
 CStreamingManager::CStreamingManager(Stream_FileType _fileType,std::string _filePath) :
     m_use_local_file(true),
+    m_use_network(false),
+    m_file_dropped_bytes(0),
+    m_scatter_gather(false),
+    m_compression(NONE_COMPRESSION),
+    m_backpressure(asionet::BackpressurePolicy::DROP_OLDEST),
+    m_zerocopy(false),
+    m_mtu(UDP_DEFAULT_MTU),
+    m_first_sample(true),
+    m_wav_gap_fill(true),
+    m_next_sample_id(0),
+    m_gap_samples(0),
     notifyPassData(nullptr),
     m_file_manager(nullptr),
     m_fileType(_fileType),
@@ -91,6 +103,17 @@ CStreamingManager::Ptr CStreamingManager::Create(string _host, string _port, asi
 
 CStreamingManager::CStreamingManager(string _host, string _port, asionet::Protocol _protocol):
         m_use_local_file(false),
+        m_use_network(true),
+        m_file_dropped_bytes(0),
+        m_scatter_gather(false),
+        m_compression(NONE_COMPRESSION),
+        m_backpressure(asionet::BackpressurePolicy::DROP_OLDEST),
+        m_zerocopy(false),
+        m_mtu(UDP_DEFAULT_MTU),
+        m_first_sample(true),
+        m_wav_gap_fill(true),
+        m_next_sample_id(0),
+        m_gap_samples(0),
         notifyPassData(nullptr),
         m_file_manager(nullptr),
         m_waveWriter(nullptr),
@@ -105,6 +128,23 @@ CStreamingManager::CStreamingManager(string _host, string _port, asionet::Protoc
 
 }
 
+CStreamingManager::Ptr CStreamingManager::Create(Stream_FileType _fileType, std::string _filePath, std::string _host, std::string _port, asionet::Protocol _protocol){
+    return std::make_shared<CStreamingManager>(_fileType, _filePath, _host, _port, _protocol);
+}
+
+// Both sinks read the same buffer in passBuffers(), each from its own queue
+// afterwards. The file keeps its memory budget, the network its pack pool
+// and backpressure policy, neither waits for the other.
+CStreamingManager::CStreamingManager(Stream_FileType _fileType, std::string _filePath, std::string _host, std::string _port, asionet::Protocol _protocol) :
+    CStreamingManager(_host, _port, _protocol)
+{
+    m_use_local_file = true;
+    m_fileType = _fileType;
+    m_filePath = _filePath;
+    m_file_manager = new FileQueueManager();
+    m_waveWriter = new CWaveWriter();
+}
+
 CStreamingManager::~CStreamingManager()
 {
     this->stop();
@@ -125,6 +165,197 @@ CStreamingManager::~CStreamingManager()
 
 }
 
+// Samples that never reached the file. Packs carry the absolute sample
+// index, a jump in it is a gap.
+uint64_t CStreamingManager::getGapSamples(){
+    return m_gap_samples;
+}
+
+// WAV has no place for metadata, a gap is written as silence so the
+// samples after it keep their position in time.
+void CStreamingManager::fillWavGap(uint64_t _samples, bool _ch1, bool _ch2, unsigned short _resolution){
+    static const std::vector<uint8_t> zeros(WAV_GAP_FILL_CHUNK, 0);
+    const size_t sample_size = SAMPLE_SIZE(_resolution);
+    uint64_t left = MIN(_samples, (uint64_t)WAV_GAP_FILL_LIMIT);
+    while (left > 0){
+        size_t size = MIN(left * sample_size, (uint64_t)WAV_GAP_FILL_CHUNK);
+        size_t size_ch1 = _ch1 ? size : 0;
+        size_t size_ch2 = _ch2 ? size : 0;
+        if (!queueWavBlock(zeros.data(), size_ch1, zeros.data(), size_ch2, _resolution))
+            return;
+        left -= size / sample_size;
+    }
+}
+
+// The block comes from the writer's preallocated pool and is filled directly
+// from the caller's buffers. A block that starts the next file of a rotated
+// recording gets a header of its own.
+bool CStreamingManager::queueWavBlock(const uint8_t *_buffer_ch1, size_t _size_ch1, const uint8_t *_buffer_ch2, size_t _size_ch2, unsigned short _resolution){
+    auto block = m_file_manager->AcquireBlock(_size_ch1 + _size_ch2 + FILE_BLOCK_HEADER_RESERVE);
+    if (block == nullptr)
+        return false;
+    bool new_file = m_file_manager->CheckRotation(_size_ch1 + _size_ch2);
+    if (new_file)
+        m_waveWriter->resetHeaderInit();
+    m_waveWriter->BuildWAVBlock(block, _buffer_ch1, _size_ch1, _buffer_ch2, _size_ch2, _resolution);
+    block->setNewFile(new_file);
+    return m_file_manager->AddBufferToWrite(block);
+}
+
+// Per channel payload of one pack. UDP packs fill one datagram of the
+// configured MTU. Packed samples must not straddle two packs because the
+// client unpacks each pack on its own, and every pack in a UDP batch must
+// start 4 byte aligned.
+uint32_t CStreamingManager::getSplitSize(unsigned short _resolution, bool _both_channels){
+    uint32_t unit = 64;
+    if (_resolution == 14)
+        unit = 56;
+    if (_resolution == 12)
+        unit = 48;
+    uint32_t split_size = TCP_BUFFER_LIMIT;
+    if (m_protocol == asionet::Protocol::UDP){
+        split_size = (m_mtu - UDP_IP_HEADERS - PACK_HEADER_SIZE - PACK_TRAILER_SIZE) / (_both_channels ? 2 : 1);
+    }
+    split_size -= split_size % unit;
+    return MAX(split_size, unit);
+}
+
+// Several packs are built back to back in one pool buffer and sent with a
+// single sendmmsg / GSO call. Every pack keeps its own id, so the client
+// sees exactly which datagrams were lost.
+int CStreamingManager::sendUdpBatches(uint64_t _lostRate, uint64_t _sampleId, uint32_t _oscRate, const uint8_t *_buffer_ch1, uint32_t _size_ch1, const uint8_t *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint32_t _split_size){
+    uint32_t buffer_size = MAX(_size_ch1, _size_ch2);
+    uint32_t frame_offset = 0;
+    size_t capacity = m_asionet->GetPackCapacity();
+    uint8_t *batch = nullptr;
+    size_t batch_size = 0;
+    int sent = 0;
+
+    auto flush = [&](){
+        if (batch == nullptr)
+            return;
+        if (m_asionet->SendBatch(batch, batch_size)) {
+            sent++;
+        } else {
+            m_asionet->ReleasePack(batch);
+        }
+        batch = nullptr;
+        batch_size = 0;
+    };
+
+    while (frame_offset < buffer_size) {
+        uint32_t split_size = MIN(_split_size, buffer_size - frame_offset);
+        size_t size_ch1 = _size_ch1 == 0 ? 0 : split_size;
+        size_t size_ch2 = _size_ch2 == 0 ? 0 : split_size;
+        size_t pack_size = PACK_HEADER_SIZE + size_ch1 + size_ch2 + PACK_TRAILER_SIZE;
+        uint64_t id = m_index_of_message++;
+        uint64_t sample_id = _sampleId + (uint64_t)frame_offset * 8 / _resolution;
+
+        if (batch != nullptr && batch_size + pack_size > capacity)
+            flush();
+        if (batch == nullptr) {
+            batch = m_asionet->AcquirePack();
+            if (batch == nullptr) {
+                // Pool exhausted: the network is slower than the ADC, drop this part
+                frame_offset += split_size;
+                continue;
+            }
+        }
+
+        size_t new_size = 0;
+        const uint8_t *ch1 = _buffer_ch1 + frame_offset;
+        const uint8_t *ch2 = _buffer_ch2 + frame_offset;
+        if (!(m_compression == DELTA_COMPRESSION &&
+              asionet::CAsioNet::BuildCompressedPack(batch + batch_size, id, _lostRate, sample_id, _oscRate, _resolution, ch1, size_ch1, ch2, size_ch2, new_size))) {
+            asionet::CAsioNet::BuildPack(batch + batch_size, id, _lostRate, sample_id, _oscRate, _resolution, ch1, size_ch1, ch2, size_ch2, new_size);
+        }
+        batch_size += new_size;
+        // Headers are written with 64-bit stores, a compressed pack can leave the next one unaligned
+        if (batch_size & 7)
+            flush();
+        _lostRate = 0; // Send rate only first pack
+        frame_offset += split_size;
+    }
+    flush();
+    return sent > 0 ? 1 : 0;
+}
+
+// The network setting covers the asio thread and the sender of the
+// application. Both are applied when the streaming starts.
+void CStreamingManager::setNetThreadSched(const ThreadSchedT &_sched){
+    m_net_sched = _sched;
+}
+
+ThreadSchedT CStreamingManager::getNetThreadSched(){
+    return m_net_sched;
+}
+
+void CStreamingManager::setFileThreadSched(const ThreadSchedT &_sched){
+    m_file_sched = _sched;
+}
+
+// Depth of the write-behind of the file writer, see FileQueueManager::SetWriteBehind()
+void CStreamingManager::setFileWriteBehind(int _depth){
+    if (m_file_manager)
+        m_file_manager->SetWriteBehind(_depth);
+}
+
+// Upper size of the TDMS segments in KiB, see FileQueueManager::SetTDMSSegmentSize()
+void CStreamingManager::setFileTDMSSegment(int _kb){
+    if (m_file_manager)
+        m_file_manager->SetTDMSSegmentSize((size_t)MAX(_kb, 0) * 1024);
+}
+
+// Two channel TDMS data sample by sample, see FileQueueManager::SetTDMSInterleaved()
+void CStreamingManager::setFileTDMSInterleaved(bool _enable){
+    if (m_file_manager)
+        m_file_manager->SetTDMSInterleaved(_enable);
+}
+
+// Writes the .tdms_index next to the TDMS file, see FileQueueManager::SetTDMSIndex()
+void CStreamingManager::setFileTDMSIndex(bool _enable){
+    if (m_file_manager)
+        m_file_manager->SetTDMSIndex(_enable);
+}
+
+// Calibration in the TDMS channel properties, see FileQueueManager::SetTDMSCalibration()
+void CStreamingManager::setFileCalibration(const CalibrationT &_calibration, bool _volts){
+    if (m_file_manager)
+        m_file_manager->SetTDMSCalibration(_calibration, _volts);
+}
+
+// Splits a file recording into parts of _mb MiB or _seconds, 0 turns a limit off.
+// See FileQueueManager::SetRotation()
+void CStreamingManager::setFileRotation(int _mb, int _seconds){
+    if (m_file_manager)
+        m_file_manager->SetRotation((uint64_t)MAX(_mb, 0) * 1024 * 1024, _seconds);
+}
+
+// TDMS files get a segment with the trigger properties, WAV files and the
+// network only see the samples
+void CStreamingManager::startCapture(const TDMSCaptureT &_capture){
+    if (m_file_manager && m_fileType == TDMS_TYPE)
+        m_file_manager->StartTDMSCapture(_capture);
+}
+
+// Caps the memory of the file write queue, 0 takes half of the physical memory.
+// See FileQueueManager::SetMemoryBudget()
+void CStreamingManager::setFileMemoryBudget(int _mb){
+    if (m_file_manager)
+        m_file_manager->SetMemoryBudget((uint64_t)MAX(_mb, 0) * 1024 * 1024);
+}
+
+// Lost samples are written as silence to WAV files. A gated recording leaves
+// the gaps between its events out, set before run()
+void CStreamingManager::setWavGapFill(bool _enable){
+    m_wav_gap_fill = _enable;
+}
+
+// Sets the UDP datagram size. Use 9000 on links with jumbo frames.
+void CStreamingManager::setMTU(uint32_t _mtu){
+    m_mtu = MAX(_mtu, (uint32_t)UDP_MIN_MTU);
+}
+
 void CStreamingManager::startServer(){
     if (m_asionet){
         delete m_asionet;
@@ -134,6 +365,9 @@ void CStreamingManager::startServer(){
     m_SendData = 0 ;
     m_ReadyToPass = 0;
     m_asionet = new asionet::CAsioNet(asionet::Mode::SERVER, m_protocol, m_host, m_port);
+    m_asionet->SetBackpressurePolicy(m_backpressure);
+    m_asionet->SetZeroCopy(m_zerocopy);
+    m_asionet->SetThreadSched(m_net_sched);
     m_asionet->addCallServer_Connect([](std::string host)
                                      {
                                          std::cout << "Connected " << host << '\n';
@@ -165,7 +399,128 @@ void CStreamingManager::stopServer(){
     }
 }
 
+uint64_t CStreamingManager::getPoolExhaustedCount(){
+    if (m_asionet){
+        return m_asionet->GetPoolExhaustedCount();
+    }
+    return 0;
+}
+
+uint64_t CStreamingManager::getDroppedPacks(){
+    if (m_asionet){
+        return m_asionet->GetDroppedPacks();
+    }
+    return 0;
+}
+
+uint64_t CStreamingManager::getThrottledPacks(){
+    if (m_asionet){
+        return m_asionet->GetThrottledPacks();
+    }
+    return 0;
+}
+
+uint64_t CStreamingManager::getSentBytes(){
+    if (m_asionet){
+        return m_asionet->GetSentBytes();
+    }
+    if (m_file_manager){
+        return m_file_manager->GetWrittenBytes();
+    }
+    return 0;
+}
+
+uint64_t CStreamingManager::getFileBytes(){
+    if (m_file_manager){
+        return m_file_manager->GetWrittenBytes();
+    }
+    return 0;
+}
+
+// Bytes the file did not take: refused at its memory budget, or passed
+// after the writer stopped while the network goes on
+uint64_t CStreamingManager::getFileDroppedBytes(){
+    return m_file_dropped_bytes;
+}
+
+// Up to the low watermark, so a reader pacing itself by it never makes the queue refuse blocks
+uint64_t CStreamingManager::getFileFreeBytes(){
+    if (m_file_manager == nullptr || !m_file_manager->IsWork())
+        return 0;
+    long long int used = m_file_manager->queueBytes();
+    long long int limit = m_file_manager->queueLowWatermark();
+    return used < limit ? (uint64_t)(limit - used) : 0;
+}
+
+uint64_t CStreamingManager::getQueuePeak(){
+    if (m_asionet){
+        return m_asionet->GetQueuePeak();
+    }
+    if (m_file_manager){
+        return m_file_manager->queuePeakSize();
+    }
+    return 0;
+}
+
+uint64_t CStreamingManager::getQueuePeakBytes(){
+    if (m_file_manager){
+        return m_file_manager->queuePeakBytes();
+    }
+    return 0;
+}
+
+uint64_t CStreamingManager::getQueueOverflows(){
+    if (m_file_manager){
+        return m_file_manager->queueOverflows();
+    }
+    return 0;
+}
+
+size_t CStreamingManager::getClientsCount(){
+    if (m_asionet){
+        return m_asionet->GetClientsCount();
+    }
+    return 0;
+}
+
+// Applied when the server starts. Every TCP client gets its own send queue,
+// the policy decides what happens when a client cannot keep up.
+void CStreamingManager::setBackpressurePolicy(asionet::BackpressurePolicy _policy){
+    m_backpressure = _policy;
+}
+
+// TCP packs leave the pool with MSG_ZEROCOPY, applied when the server
+// starts. Clients on kernels without it, or whose sends get copied anyway,
+// fall back to plain sends on their own.
+void CStreamingManager::setZeroCopy(bool _enable){
+    m_zerocopy = _enable;
+}
+
+// Scatter-gather mode sends header and channel data with one blocking
+// sendmsg straight from the caller's buffers. Only valid for network streaming
+// without a file copy.
+void CStreamingManager::setScatterGather(bool _enable){
+    m_scatter_gather = _enable && !m_use_local_file;
+}
+
+bool CStreamingManager::isScatterGather(){
+    return m_scatter_gather;
+}
+
+// Compression packs the data into a pool buffer, so it takes precedence
+// over scatter-gather. Files are always written uncompressed.
+void CStreamingManager::setCompression(Stream_Compression _compression){
+    m_compression = m_use_network ? _compression : NONE_COMPRESSION;
+}
+
+Stream_Compression CStreamingManager::getCompression(){
+    return m_compression;
+}
+
+// A file copy next to the network does not stop the streaming
 bool CStreamingManager::isFileThreadWork(){
+    if (m_use_network)
+        return true;
     if (m_use_local_file) {
         if (m_file_manager != nullptr) {
             return m_file_manager->IsWork();
@@ -177,13 +532,17 @@ bool CStreamingManager::isFileThreadWork(){
 void CStreamingManager::run()
 {
     if (m_use_local_file){
+        m_first_sample = true;
+        m_gap_samples = 0;
+        m_file_dropped_bytes = 0;
         m_file_out = getNewFileName(m_fileType, m_filePath);      
         m_fileLogger = CFileLogger::Create(m_file_out + ".log"); 
         std::cout << m_file_out << "\n"; 
         m_file_manager->OpenFile(m_file_out, false);
+        m_file_manager->SetThreadSched(m_file_sched);
         m_file_manager->StartWrite(m_fileType);
     }
-    else
+    if (m_use_network)
         this->startServer();
 }
 
@@ -192,113 +551,151 @@ void CStreamingManager::stop(){
         if (m_file_manager != nullptr) {
             m_file_manager->StopWrite(false);
         }
-    } else{
+    }
+    if (m_use_network){
         this->stopServer();
     }
 }
 
 
-int CStreamingManager::passBuffers(uint64_t _lostRate, uint32_t _oscRate, const void *_buffer_ch1, uint32_t _size_ch1,const void *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint64_t _id){
+int CStreamingManager::passBuffers(uint64_t _lostRate, uint32_t _oscRate, const void *_buffer_ch1, uint32_t _size_ch1,const void *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint64_t _id, uint64_t _sampleId){
 
     ASIO_ASSERT(!(_size_ch1 != _size_ch2 && _size_ch1 != 0 && _size_ch2 != 0));
-    uint8_t *buff_ch1 = nullptr;
-    uint8_t *buff_ch2 = nullptr;
 
-    if (m_use_local_file){
+    if (!m_use_network)
+        return passFile(_lostRate, _oscRate, (const uint8_t*)_buffer_ch1, _size_ch1, (const uint8_t*)_buffer_ch2, _size_ch2, _resolution, _id, _sampleId);
 
-        if (_size_ch1>0){ 
-            buff_ch1 = new uint8_t[_size_ch1];
-            memcpy_neon(buff_ch1, _buffer_ch1, _size_ch1);
+    if (m_use_local_file){
+        if (m_file_manager->IsWork()){
+            passFile(_lostRate, _oscRate, (const uint8_t*)_buffer_ch1, _size_ch1, (const uint8_t*)_buffer_ch2, _size_ch2, _resolution, _id, _sampleId);
+        }else{
+            m_file_dropped_bytes += _size_ch1 + _size_ch2;
         }
+    }
+    return passNet(_lostRate, _oscRate, (const uint8_t*)_buffer_ch1, _size_ch1, (const uint8_t*)_buffer_ch2, _size_ch2, _resolution, _sampleId);
+}
 
-        if (_size_ch2>0){ 
-            buff_ch2 = new uint8_t[_size_ch2];
-            memcpy_neon(buff_ch2, _buffer_ch2, _size_ch2);
+// The writer copies the buffers into its own blocks, the caller may reuse them on return
+int CStreamingManager::passFile(uint64_t _lostRate, uint32_t _oscRate, const uint8_t *_buffer_ch1, uint32_t _size_ch1, const uint8_t *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint64_t _id, uint64_t _sampleId){
+    if (_size_ch1 + _size_ch2 > 0){
+        uint64_t samples = MAX(_size_ch1, _size_ch2) / SAMPLE_SIZE(_resolution);
+        uint64_t gap = 0;
+        if (!m_first_sample && _sampleId > m_next_sample_id)
+            gap = _sampleId - m_next_sample_id;
+        m_first_sample = false;
+        m_next_sample_id = _sampleId + samples;
+        m_gap_samples += gap;
+        if (gap > 0 && m_fileType == WAV_TYPE && m_wav_gap_fill)
+            fillWavGap(gap, _size_ch1 > 0, _size_ch2 > 0, _resolution);
+
+        bool queued;
+        if (m_fileType == TDMS_TYPE){
+            // The writer collects the buffers into TDMS segments
+            queued = m_file_manager->AddTDMSData(_buffer_ch1, _size_ch1, _buffer_ch2, _size_ch2,_resolution, _sampleId, gap);
+        }else if (m_fileType == RAW_TYPE){
+            // Fixed size blocks, the writer finds the gaps from the sample index
+            queued = m_file_manager->AddRawData(_buffer_ch1, _size_ch1, _buffer_ch2, _size_ch2,_resolution, _sampleId, _oscRate);
+        }else{
+            queued = queueWavBlock(_buffer_ch1, _size_ch1, _buffer_ch2, _size_ch2,_resolution);
         }
 
-        if (_size_ch1 + _size_ch2 > 0){
-            if (m_fileType == TDMS_TYPE){
-                auto stream_data = m_file_manager->BuildTDMSStream(buff_ch1, _size_ch1, buff_ch2, _size_ch2,_resolution);
-                if (!m_file_manager->AddBufferToWrite(stream_data))
-                {
-                    m_fileLogger->AddMetric(CFileLogger::Metric::FILESYSTEM_RATE,1);
-                }
-            }
+        uint64_t queueBytes = m_file_manager->queueBytes();
+        if (!queued)
+        {
+            m_file_dropped_bytes += _size_ch1 + _size_ch2;
+            m_fileLogger->AddMetric(CFileLogger::Metric::FILESYSTEM_RATE,1);
+        }
+        CEventRing::Record(queued ? CEventRing::FILE_QUEUED : CEventRing::FILE_DROPPED, _size_ch1 + _size_ch2, queueBytes);
+
+        m_fileLogger->AddMetric(CFileLogger::Metric::RECIVE_DATE, _size_ch1 + _size_ch2);      
+        m_fileLogger->AddMetric(CFileLogger::Metric::RECIVE_DATA_CH1,_size_ch1);
+        m_fileLogger->AddMetric(CFileLogger::Metric::RECIVE_DATA_CH2,_size_ch2);            
+        m_fileLogger->AddMetric(CFileLogger::Metric::OSC_RATE_LOST,_lostRate);        
+        m_fileLogger->AddMetric(CFileLogger::Metric::OSC_RATE,_oscRate);       
+        m_fileLogger->AddMetricId(_id);         
+        m_fileLogger->AddMetric(CFileLogger::Metric::QUEUE_DEPTH,m_file_manager->queueSize());
+        m_fileLogger->AddMetric(CFileLogger::Metric::QUEUE_BYTES,queueBytes);
+        m_fileLogger->AddMetric(CFileLogger::Metric::QUEUE_BUDGET,m_file_manager->queueHighWatermark());
+        m_fileLogger->AddMetric(CFileLogger::Metric::QUEUE_OVERFLOWS,m_file_manager->queueOverflows());
+    }
 
+    // The send callback reports the network side
+    if (notifyPassData && !m_use_network)
+        notifyPassData(_size_ch1 + _size_ch2);
+    return 1;
+}
 
-            if (m_fileType == WAV_TYPE){
-                auto stream_data = m_waveWriter->BuildWAVStream(buff_ch1, _size_ch1, buff_ch2, _size_ch2,_resolution);
-                if (!m_file_manager->AddBufferToWrite(stream_data))
-                {
-                    m_fileLogger->AddMetric(CFileLogger::Metric::FILESYSTEM_RATE,1);
-                }
-                delete [] buff_ch1;
-                delete [] buff_ch2;
+int CStreamingManager::passNet(uint64_t _lostRate, uint32_t _oscRate, const uint8_t *_buffer_ch1, uint32_t _size_ch1, const uint8_t *_buffer_ch2, uint32_t _size_ch2, unsigned short _resolution, uint64_t _sampleId){
+    if (m_asionet){
+        if (m_asionet->IsConnected()) {
+            int m_ReadyToPass = 0;
+            uint32_t frame_offset = 0;
+            uint32_t buffer_size = MAX(_size_ch1, _size_ch2);
+            uint32_t split_size = getSplitSize(_resolution, _size_ch1 > 0 && _size_ch2 > 0);
+            size_t full_send_size = 0;
+            const uint8_t *buff_ch1 = _buffer_ch1;
+            const uint8_t *buff_ch2 = _buffer_ch2;
+            uint32_t counter = 0;
+            CEventRing::Record(CEventRing::NET_BUFFER, _size_ch1 + _size_ch2, m_index_of_message);
+
+            if (m_asionet->GetProtocol() == asionet::Protocol::UDP && !(m_scatter_gather && m_compression == NONE_COMPRESSION)) {
+                return sendUdpBatches(_lostRate, _sampleId, _oscRate, buff_ch1, _size_ch1, buff_ch2, _size_ch2, _resolution, split_size);
             }
-        
-
-        
-            m_fileLogger->AddMetric(CFileLogger::Metric::RECIVE_DATE, _size_ch1 + _size_ch2);      
-            m_fileLogger->AddMetric(CFileLogger::Metric::RECIVE_DATA_CH1,_size_ch1);
-            m_fileLogger->AddMetric(CFileLogger::Metric::RECIVE_DATA_CH2,_size_ch2);            
-            m_fileLogger->AddMetric(CFileLogger::Metric::OSC_RATE_LOST,_lostRate);        
-            m_fileLogger->AddMetric(CFileLogger::Metric::OSC_RATE,_oscRate);       
-            m_fileLogger->AddMetricId(_id);         
-        }
 
-        if (notifyPassData)
-            notifyPassData(_size_ch1 + _size_ch2);
-        return 1;
-    }else{
-        if (m_asionet){
-            if (m_asionet->IsConnected()) {
-                int m_ReadyToPass = 0;
-                uint32_t frame_offset = 0;
-                uint32_t buffer_size = MAX(_size_ch1, _size_ch2);
-                uint32_t split_size = (m_asionet->GetProtocol() == asionet::Protocol::TCP ? TCP_BUFFER_LIMIT
-                                                                                          : UDP_BUFFER_LIMIT);
-                size_t full_send_size = 0;
-                buff_ch1 = (uint8_t *) _buffer_ch1;
-                buff_ch2 = (uint8_t *) _buffer_ch2;
-                uint32_t counter = 0;
-
-                while ((frame_offset + split_size) <= buffer_size) {
-                    if (frame_offset + split_size > buffer_size)
-                        split_size = buffer_size - frame_offset;
-
-                    size_t new_buff_size = 0;
-                    auto buffer = asionet::CAsioNet::BuildPack(m_index_of_message++, _lostRate, _oscRate,  _resolution,
-                                                               (&*buff_ch1 + frame_offset),
-                                                               (_size_ch1 == 0 ? 0 : split_size),
-                                                               (&*buff_ch2 + frame_offset),
-                                                               (_size_ch2 == 0 ? 0 : split_size),
-                                                               new_buff_size);
+            while (frame_offset < buffer_size) {
+                if (frame_offset + split_size > buffer_size)
+                    split_size = buffer_size - frame_offset;
 
+                if (m_scatter_gather && m_compression == NONE_COMPRESSION) {
                     ++m_ReadyToPass;
-                    if(m_ReadyToPass > 0)
-                        _lostRate = 0; // Send rate only first pack
-
-                    if (!m_asionet->SendData(false, buffer, new_buff_size)) {
+                    if (!m_asionet->SendPack(m_index_of_message++, _lostRate, _sampleId + (uint64_t)frame_offset * 8 / _resolution, _oscRate, _resolution,
+                                             (&*buff_ch1 + frame_offset),
+                                             (_size_ch1 == 0 ? 0 : split_size),
+                                             (&*buff_ch2 + frame_offset),
+                                             (_size_ch2 == 0 ? 0 : split_size))) {
                         m_ReadyToPass--;
                     }
-                    delete buffer;
+                    _lostRate = 0; // Send rate only first pack
                     frame_offset += split_size;
                     counter++;
+                    continue;
                 }
 
-                if (m_ReadyToPass > 0)
-                    return 1;
-                else
-                    return 0;
-            }else{
-                return 0;
+                size_t new_buff_size = 0;
+                auto buffer = m_asionet->BuildPackInPool(m_index_of_message++, _lostRate, _sampleId + (uint64_t)frame_offset * 8 / _resolution, _oscRate,  _resolution,
+                                                           (&*buff_ch1 + frame_offset),
+                                                           (_size_ch1 == 0 ? 0 : split_size),
+                                                           (&*buff_ch2 + frame_offset),
+                                                           (_size_ch2 == 0 ? 0 : split_size),
+                                                           m_compression,
+                                                           new_buff_size);
+
+                if (buffer == nullptr) {
+                    // Pool exhausted: the network is slower than the ADC, drop this part
+                    CEventRing::Record(CEventRing::NET_DROPPED, (_size_ch1 == 0 ? 0 : split_size) + (_size_ch2 == 0 ? 0 : split_size));
+                    frame_offset += split_size;
+                    counter++;
+                    continue;
+                }
+
+                ++m_ReadyToPass;
+                if(m_ReadyToPass > 0)
+                    _lostRate = 0; // Send rate only first pack
+
+                // The buffer returns to the pool when the async send completes
+                if (!m_asionet->SendData(true, buffer, new_buff_size)) {
+                    m_ReadyToPass--;
+                    m_asionet->ReleasePack(buffer);
+                }
+                frame_offset += split_size;
+                counter++;
             }
 
+            if (m_ReadyToPass > 0)
+                return 1;
+            else
+                return 0;
         }
     }
-
+    return 0;
 }
-
-
-
-
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <climits>
+#include "rpsa/server/core/TriggerEngine.h"
+
+#ifdef ARCH_ARM
+#include <arm_neon.h>
+#endif
+
+namespace {
+    CTriggerEngine::Range MakeRange(int32_t _low, int32_t _high, bool _inside){
+        _low = std::max(_low, (int32_t)INT16_MIN);
+        _high = std::min(_high, (int32_t)INT16_MAX);
+        if (_low > _high){
+            // Nothing matches, an inside range is empty
+            return CTriggerEngine::Range{ 1, 0, true };
+        }
+        return CTriggerEngine::Range{ (int16_t)_low, (int16_t)_high, _inside };
+    }
+
+    inline bool Match(int16_t _sample, const CTriggerEngine::Range &_range){
+        return (_sample >= _range.low && _sample <= _range.high) == _range.inside;
+    }
+}
+
+CTriggerEngine::Ptr CTriggerEngine::Create(const TriggerT &_settings){
+    return std::make_shared<CTriggerEngine>(_settings);
+}
+
+CTriggerEngine::CTriggerEngine(const TriggerT &_settings):
+    m_settings(_settings),
+    m_eventCount(0)
+{
+    const int32_t level = m_settings.level;
+    const int32_t hysteresis = std::max<int32_t>(m_settings.hysteresis, 0);
+    switch (m_settings.mode){
+        case TriggerT::WINDOW:
+            m_active = MakeRange(m_settings.low, m_settings.high, m_settings.rising);
+            m_rearm = MakeRange(m_settings.low, m_settings.high, !m_settings.rising);
+            break;
+        case TriggerT::LEVEL:
+            m_active = m_settings.rising ? MakeRange(level, INT16_MAX, true) : MakeRange(INT16_MIN, level, true);
+            m_rearm = m_settings.rising ? MakeRange(level, INT16_MAX, false) : MakeRange(INT16_MIN, level, false);
+            break;
+        default:
+            m_active = m_settings.rising ? MakeRange(level, INT16_MAX, true) : MakeRange(INT16_MIN, level, true);
+            m_rearm = m_settings.rising ? MakeRange(INT16_MIN, level - hysteresis - 1, true) : MakeRange(level + hysteresis + 1, INT16_MAX, true);
+            break;
+    }
+    reset();
+}
+
+void CTriggerEngine::reset(){
+    for (auto &channel : m_channel){
+        // A level fires on a signal that is already there, the rest need an edge first
+        channel.waitActive = m_settings.mode == TriggerT::LEVEL;
+        channel.inPulse = false;
+        channel.pulseStart = 0;
+        channel.holdoffEnd = 0;
+    }
+    m_started = false;
+    m_next = 0;
+    m_holdoffEnd = 0;
+}
+
+size_t CTriggerEngine::find(const int16_t *_samples, size_t _from, size_t _count, const Range &_range){
+    size_t i = _from;
+#ifdef ARCH_ARM
+    const int16x8_t low = vdupq_n_s16(_range.low);
+    const int16x8_t high = vdupq_n_s16(_range.high);
+    const uint16x8_t invert = vdupq_n_u16(_range.inside ? 0 : 0xFFFF);
+    for (; i + 32 <= _count; i += 32){
+        const int16_t *p = _samples + i;
+        int16x8_t x0 = vld1q_s16(p);
+        int16x8_t x1 = vld1q_s16(p + 8);
+        int16x8_t x2 = vld1q_s16(p + 16);
+        int16x8_t x3 = vld1q_s16(p + 24);
+        uint16x8_t m0 = vandq_u16(vcgeq_s16(x0, low), vcleq_s16(x0, high));
+        uint16x8_t m1 = vandq_u16(vcgeq_s16(x1, low), vcleq_s16(x1, high));
+        uint16x8_t m2 = vandq_u16(vcgeq_s16(x2, low), vcleq_s16(x2, high));
+        uint16x8_t m3 = vandq_u16(vcgeq_s16(x3, low), vcleq_s16(x3, high));
+        uint16x8_t any = vorrq_u16(vorrq_u16(veorq_u16(m0, invert), veorq_u16(m1, invert)),
+                                   vorrq_u16(veorq_u16(m2, invert), veorq_u16(m3, invert)));
+        uint64x2_t wide = vreinterpretq_u64_u16(any);
+        if ((vgetq_lane_u64(wide, 0) | vgetq_lane_u64(wide, 1)) != 0)
+            break;
+    }
+#endif
+    for (; i < _count; i++){
+        if (Match(_samples[i], _range))
+            return i;
+    }
+    return _count;
+}
+
+void CTriggerEngine::scanChannel(Channel &_state, const int16_t *_samples, size_t _count, uint64_t _first, uint8_t _channel, std::vector<TriggerEventT> &_events){
+    const TriggerT &s = m_settings;
+    size_t pos = 0;
+    while (pos < _count){
+        if (_state.waitActive){
+            size_t i = find(_samples, pos, _count, m_active);
+            if (i == _count)
+                break;
+            uint64_t sample = _first + i;
+            if (s.mode == TriggerT::PULSE){
+                _state.pulseStart = sample;
+                _state.inPulse = true;
+                _state.waitActive = false;
+                pos = i + 1;
+                continue;
+            }
+            if (sample >= _state.holdoffEnd){
+                _events.push_back(TriggerEventT{ sample, 0, _channel });
+                _state.holdoffEnd = sample + s.holdoff;
+            }
+            if (s.mode == TriggerT::LEVEL && s.holdoff > 0){
+                // Fires again after the holdoff while the level holds
+                if (_state.holdoffEnd >= _first + _count)
+                    break;
+                pos = std::max<size_t>(i + 1, _state.holdoffEnd - _first);
+                continue;
+            }
+            _state.waitActive = false;
+            pos = i + 1;
+        }else{
+            size_t i = find(_samples, pos, _count, m_rearm);
+            if (i == _count)
+                break;
+            uint64_t sample = _first + i;
+            if (_state.inPulse){
+                uint64_t width = sample - _state.pulseStart;
+                bool accepted = width >= s.minWidth && (s.maxWidth == 0 || width <= s.maxWidth);
+                if (accepted && _state.pulseStart >= _state.holdoffEnd){
+                    _events.push_back(TriggerEventT{ _state.pulseStart, (uint32_t)std::min<uint64_t>(width, UINT32_MAX), _channel });
+                    _state.holdoffEnd = sample + s.holdoff;
+                }
+                _state.inPulse = false;
+            }
+            _state.waitActive = true;
+            pos = i;
+        }
+    }
+}
+
+size_t CTriggerEngine::scan(const int16_t *_ch1, const int16_t *_ch2, size_t _count, uint64_t _first, std::vector<TriggerEventT> &_events){
+    if (m_started && _first != m_next){
+        // A lost segment, nothing that spans it counts
+        uint64_t holdoffEnd = m_holdoffEnd;
+        reset();
+        m_holdoffEnd = holdoffEnd;
+    }
+    m_pending.clear();
+    if (_ch1 != nullptr && (m_settings.channels & TriggerT::CH1)){
+        scanChannel(m_channel[0], _ch1, _count, _first, TriggerT::CH1, m_pending);
+    }
+    if (_ch2 != nullptr && (m_settings.channels & TriggerT::CH2)){
+        scanChannel(m_channel[1], _ch2, _count, _first, TriggerT::CH2, m_pending);
+    }
+    m_started = true;
+    m_next = _first + _count;
+
+    std::stable_sort(m_pending.begin(), m_pending.end(), [](const TriggerEventT &_a, const TriggerEventT &_b){ return _a.sample < _b.sample; });
+    size_t added = 0;
+    for (const auto &event : m_pending){
+        // One holdoff for both channels
+        if (event.sample < m_holdoffEnd)
+            continue;
+        m_holdoffEnd = event.sample + m_settings.holdoff;
+        _events.push_back(event);
+        added++;
+    }
+    m_eventCount += added;
+    return added;
+}
@@ -0,0 +1,196 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rpsa/server/core/AsioNet.h"
+#include "rpsa/server/core/Oscilloscope.h"
+#include "rpsa/server/core/StreamingApplication.h"
+#include "rpsa/server/core/StreamingManager.h"
+
+// Runs the whole acquisition -> ring -> sender pipeline against a synthetic
+// DMA source and reports throughput, loss and per-stage latencies.
+
+#define BENCH_HOST     "127.0.0.1"
+#define BENCH_PORT     "18910"
+#define BENCH_FILE_DIR "/tmp/rpsa_benchmark"
+// The application waits a second before it arms the oscilloscope
+#define BENCH_WARMUP_MS 1500
+
+namespace {
+    struct ReceiverStatsT{
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> packs;
+        std::atomic<uint64_t> gapPacks;
+        std::atomic<uint64_t> badPacks;
+        uint64_t nextSampleId;
+        bool     first;
+
+        ReceiverStatsT(): bytes(0), packs(0), gapPacks(0), badPacks(0), nextSampleId(0), first(true) {}
+    };
+
+    void Usage(const char *_name){
+        std::cerr << "Usage: " << _name << " [-s tcp|udp|tdms|wav|raw] [-r 8|12|14|16] [-d decimation] [-c 1|2|3] [-t seconds] [-m mtu] [-z]\n"
+                  << "\t-s\tsink, default tcp\n"
+                  << "\t-r\tresolution in bits, default 16 (12 and 14 only for network sinks)\n"
+                  << "\t-d\tdecimation, default 8\n"
+                  << "\t-c\tchannel mask, default 3\n"
+                  << "\t-t\tmeasurement time in seconds, default 5\n"
+                  << "\t-m\tUDP datagram size, default 1500\n"
+                  << "\t-z\tdelta compression on the network\n";
+    }
+
+    uint64_t DirSize(const std::string &_path){
+        uint64_t size = 0;
+        DIR *dir = opendir(_path.c_str());
+        if (!dir)
+            return 0;
+        while (struct dirent *entry = readdir(dir)){
+            struct stat st;
+            std::string file = _path + "/" + entry->d_name;
+            if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                size += st.st_size;
+        }
+        closedir(dir);
+        return size;
+    }
+
+    double Rate(uint64_t _bytes, double _sec){
+        return _sec > 0 ? (double)_bytes / _sec / (1024.0 * 1024.0) : 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string sink = "tcp";
+    int resolution = 16;
+    int decimation = 8;
+    int channels = 3;
+    int seconds = 5;
+    int mtu = 1500;
+    bool compress = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:d:c:t:m:zh")) != -1){
+        switch (opt){
+            case 's': sink = optarg; break;
+            case 'r': resolution = atoi(optarg); break;
+            case 'd': decimation = atoi(optarg); break;
+            case 'c': channels = atoi(optarg); break;
+            case 't': seconds = atoi(optarg); break;
+            case 'm': mtu = atoi(optarg); break;
+            case 'z': compress = true; break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+
+    bool network = sink == "tcp" || sink == "udp";
+    bool file = sink == "tdms" || sink == "wav" || sink == "raw";
+    if ((!network && !file)
+        || (resolution != 8 && resolution != 12 && resolution != 14 && resolution != 16)
+        || (file && resolution != 8 && resolution != 16)
+        || decimation < 1 || channels < 1 || channels > 3 || seconds < 1){
+        Usage(argv[0]);
+        return 1;
+    }
+
+    COscilloscope::Ptr osc = COscilloscope::CreateSynthetic(channels & 0x1, channels & 0x2, decimation);
+    if (!osc){
+        std::cerr << "[rpsa] Can't create the synthetic source" << std::endl;
+        return 1;
+    }
+
+    CStreamingManager::Ptr manager;
+    asionet::CAsioNet::Ptr client;
+    ReceiverStatsT received;
+
+    if (network){
+        auto protocol = sink == "tcp" ? asionet::Protocol::TCP : asionet::Protocol::UDP;
+        manager = CStreamingManager::Create(BENCH_HOST, BENCH_PORT, protocol);
+        manager->setMTU(mtu);
+        manager->setCompression(compress ? DELTA_COMPRESSION : NONE_COMPRESSION);
+        client = asionet::CAsioNet::Create(asionet::Mode::CLIENT, protocol, BENCH_HOST, BENCH_PORT);
+        client->addCallReceived([&received](std::error_code, uint8_t *_buffer, size_t _size){
+            uint64_t id, lostRate, sampleId;
+            uint32_t oscRate, res;
+            uint8_t *ch1 = nullptr;
+            uint8_t *ch2 = nullptr;
+            size_t size1 = 0, size2 = 0;
+            if (!asionet::CAsioNet::ExtractPack(_buffer, _size, id, lostRate, sampleId, oscRate, res, ch1, size1, ch2, size2)){
+                received.badPacks++;
+                return;
+            }
+            size_t size = size1 > size2 ? size1 : size2;
+            if (!received.first && sampleId != received.nextSampleId)
+                received.gapPacks++;
+            received.first = false;
+            received.nextSampleId = sampleId + size * 8 / res;
+            received.bytes += size1 + size2;
+            received.packs++;
+            delete[] ch1;
+            delete[] ch2;
+        });
+    }else{
+        CStreamingManager::MakeEmptyDir(BENCH_FILE_DIR);
+        manager = CStreamingManager::Create(sink == "tdms" ? TDMS_TYPE : sink == "raw" ? RAW_TYPE : WAV_TYPE, BENCH_FILE_DIR);
+    }
+
+    CStreamingApplication app(manager, osc, resolution, decimation, channels);
+    app.runNonBlock();
+    if (client){
+        // The server must listen before a TCP client connects
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        client->Start();
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_WARMUP_MS));
+
+    const StreamingStatsT &stats = app.getStats();
+    auto delivered = [&]() { return network ? received.bytes.load() : DirSize(BENCH_FILE_DIR); };
+    uint64_t startSegments = stats.segments;
+    uint64_t startBytes = delivered();
+    auto start = std::chrono::steady_clock::now();
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    uint64_t segments = stats.segments - startSegments;
+    uint64_t bytes = delivered() - startBytes;
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    app.stop();
+    if (client)
+        client->Stop();
+
+    int active = (channels & 0x1 ? 1 : 0) + (channels & 0x2 ? 1 : 0);
+    uint64_t produced = segments * (osc_buf_size / 2) * active * (resolution > 8 ? 2 : 1);
+    double expected = (double)osc_adc_rate / decimation * active * (resolution > 8 ? 2 : 1);
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "sink " << sink << ", " << resolution << " bit, decimation " << decimation
+              << ", channels " << channels << (compress ? ", compressed" : "") << "\n"
+              << "source rate:    " << Rate(expected, 1.0) << " MB/s expected, "
+              << Rate(produced, sec) << " MB/s acquired\n"
+              << "delivered:      " << Rate(bytes, sec) << " MB/s over " << sec << " s"
+              << (network ? " (decoded payload)" : " (file size)") << "\n"
+              << "segments:       " << stats.segments << ", lost " << stats.lostSegments << "\n";
+    if (network){
+        std::cout << "packs:          " << received.packs << ", gaps " << received.gapPacks
+                  << ", malformed " << received.badPacks << "\n";
+    }
+    std::cout << "dropped packs:  " << manager->getDroppedPacks()
+              << ", pool exhausted " << manager->getPoolExhaustedCount() << "\n";
+
+    stats.copy.print(std::cout, "copy");
+    stats.queue.print(std::cout, "queue");
+    stats.send.print(std::cout, "send");
+    stats.total.print(std::cout, "total");
+    return 0;
+}
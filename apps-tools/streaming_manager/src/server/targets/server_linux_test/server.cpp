@@ -34,40 +34,48 @@ int main()
 
     std::cout.copyfmt(oldState);
 
-    // Search oscilloscope
+    // Search oscilloscope, channel 1 at full rate and channel 2 decimated,
+    // each block on its own instance
     COscilloscope::Ptr osc0 = nullptr;
     COscilloscope::Ptr osc1 = nullptr;
-    int Decimation = 2;
+    int Decimation0 = 1;
+    int Decimation1 = 64;
 
     for (const UioT &uio : uioList)
     {
         if (uio.nodeName == "rp_oscilloscope")
         {
             // TODO start server;
-            osc0 = COscilloscope::Create(uio, true , true , Decimation);
- //           osc1 = COscilloscope::Create(uio, 1 , 1);
+            osc0 = COscilloscope::CreateInstance(uio, 0, Decimation0);
+            osc1 = COscilloscope::CreateInstance(uio, 1, Decimation1);
             break;
         }
     }
 
-    // if (!osc0)
-    // {
-    //     std::cerr << "Error: create osc0" << std::endl;
-    //     return 1;
-    // }
+    if (!osc0)
+    {
+        std::cerr << "Error: create osc0" << std::endl;
+        return 1;
+    }
 
-    // if (!osc1)
-    // {
-    //     std::cerr << "Error: create osc1" << std::endl;
-    //     return 1;
-    // }
+    if (!osc1)
+    {
+        std::cerr << "Error: create osc1" << std::endl;
+        return 1;
+    }
 
-    CStreamingManager::Ptr s_manger = CStreamingManager::Create("127.0.0.1","8900",asionet::Protocol::TCP);
+    CStreamingManager::Ptr s_manger0 = CStreamingManager::Create("127.0.0.1","8900",asionet::Protocol::TCP);
+    s_manger0->setScatterGather(true);
+    CStreamingManager::Ptr s_manger1 = CStreamingManager::Create("127.0.0.1","8901",asionet::Protocol::TCP);
+    s_manger1->setScatterGather(true);
 
 
-    // Run application
-    CStreamingApplication app(s_manger,osc0, 16 , Decimation, 3);
-    app.run();
+    // Run application, one acquisition thread per instance
+    CStreamingApplication app1(s_manger1,osc1, 16 , Decimation1, 2);
+    app1.runNonBlock();
+    CStreamingApplication app0(s_manger0,osc0, 16 , Decimation0, 1);
+    app0.run();
+    app1.stop();
 
     return 0;
 }
@@ -1,4 +1,3 @@
 #!/bin/bash
-cd /tmp/build && unzip build.zip &> /dev/null && rm build.zip &> /dev/null
-
-echo "OK"
+# unzip checks the CRC of every member, a damaged download is not installed
+cd /tmp/build && unzip -o build.zip &> /dev/null && rm build.zip &> /dev/null && echo "OK" || echo "FAIL"
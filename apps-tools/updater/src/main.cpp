@@ -1,6 +1,11 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <cstring>
@@ -30,27 +35,60 @@ void signalHandlerDefault( int signum )
 }
 
 
-void copyFile(const char* _src, const char* _dst)
-{
-    using namespace std;
-    ifstream source(_src, ios::binary);
-    ofstream dest(_dst, ios::binary);
+// Files are copied by a few threads with large writes, nothing is synced until
+// all of them are written, then the whole file system is synced once
+#define COPY_THREADS 4
+#define COPY_BUFFER  (1024 * 1024)
 
-    dest << source.rdbuf();
+struct CopyJob {
+    std::string from;
+    std::string to;
+    mode_t mode;
+};
 
-    source.close();
-    dest.close();
+bool copyFile(const char* _src, const char* _dst, mode_t _mode, char* _buffer)
+{
+    int in = open(_src, O_RDONLY);
+    if (in < 0)
+        return false;
+    int out = open(_dst, O_WRONLY | O_CREAT | O_TRUNC, _mode & 07777);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    bool ok = true;
+    ssize_t n;
+    while (ok && (n = read(in, _buffer, COPY_BUFFER)) > 0) {
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(out, _buffer + done, n - done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                ok = false;
+                break;
+            }
+            done += w;
+        }
+    }
+    ok = ok && n == 0;
+    // an existing file keeps its old mode with O_CREAT
+    fchmod(out, _mode & 07777);
+    close(in);
+    return (close(out) == 0) && ok;
 }
 
-void createDir(const char* dir)
+void createDir(const char* dir, mode_t mode = 0777)
 {
     struct stat st = {0};
     if (stat(dir, &st) == -1) {
-        mkdir(dir, 0777);
+        mkdir(dir, mode & 07777);
     }
 }
 
-void listdir(const char *root, const char *d_name, int level)
+// Creates the directories right away and collects the files to copy
+void listdir(const char *root, const char *d_name, int level, std::vector<CopyJob>& jobs)
 {
     DIR *dir;
     struct dirent *entry;
@@ -61,33 +99,63 @@ void listdir(const char *root, const char *d_name, int level)
 
     if (!(dir = opendir(name)))
         return;
-    if (!(entry = readdir(dir)))
-        return;
-    do {
-        if (entry->d_type == DT_DIR) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-                continue;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
 
+        std::string from(name);
+        from = from + "/" + entry->d_name;
+        struct stat st;
+        if (stat(from.c_str(), &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode)) {
             char path[1024];
             int len = snprintf(path, sizeof(path)-1, "%s/%s", d_name, entry->d_name);
             path[len] = 0;
             std::string dir(DST_ROOT);
             dir = dir + path;
-            createDir(dir.c_str());
-            listdir(root, path, level + 1);
+            createDir(dir.c_str(), st.st_mode);
+            listdir(root, path, level + 1, jobs);
         }
         else
         {
-            std::string from(name);
-            from = from + "/"+ entry->d_name;
             std::string to(DST_ROOT);
             to = to + d_name + "/" + entry->d_name;
-            copyFile(from.c_str(), to.c_str());
+            jobs.push_back(CopyJob{from, to, st.st_mode});
         }
-    } while ((entry = readdir(dir)));
+    }
     closedir(dir);
 }
 
+void copyAll(const std::vector<CopyJob>& jobs)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < COPY_THREADS; t++) {
+        threads.push_back(std::thread([&jobs, &next]() {
+            std::unique_ptr<char[]> buffer(new char[COPY_BUFFER]);
+            size_t i;
+            while ((i = next++) < jobs.size()) {
+                if (!copyFile(jobs[i].from.c_str(), jobs[i].to.c_str(), jobs[i].mode, buffer.get())) {
+                    // a second try before giving up on it
+                    copyFile(jobs[i].from.c_str(), jobs[i].to.c_str(), jobs[i].mode, buffer.get());
+                }
+            }
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+
+    int fd = open(DST_ROOT, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        syncfs(fd);
+        close(fd);
+    }
+    sync();
+}
+
 void StartDaemon()
 {
     pid_t pid;
@@ -126,8 +194,10 @@ int main(int argc, char *argv[])
 
     // If you will use /bin/cp -fr /tmp/build/* /opt/redpitaya
     // These may cause accidental close of cp because it will receive signals
-	createDir(DST_ROOT);
-    listdir(SRC_ROOT, "",0);
+    createDir(DST_ROOT);
+    std::vector<CopyJob> jobs;
+    listdir(SRC_ROOT, "", 0, jobs);
+    copyAll(jobs);
     system("nohup reboot & disown");
     system("reboot");
 
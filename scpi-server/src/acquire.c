@@ -15,17 +15,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "acquire.h"
 #include "common.h"
+#include "scpi-commands.h"
 
 #include "scpi/parser.h"
 #include "scpi/units.h"
 
 #include "redpitaya/rp.h"
 
-rp_scpi_acq_unit_t unit     = RP_SCPI_VOLTS;        // default value
-
 /* These structures are a direct API mirror 
 and should not be altered! */
 const scpi_choice_def_t scpi_RpUnits[] = {
@@ -82,7 +82,7 @@ scpi_result_t RP_AcqSetDataFormat(scpi_t *context) {
     const char * param;
     size_t param_len;
 
-    // read first parameter Format type (BIN, ASCII)
+    // read first parameter Format type (BIN, ASCII, PACK)
     if (!SCPI_ParamCharacters(context, &param, &param_len, true)) {
         RP_LOG(LOG_ERR, "*ACQ:DATA:FORMAT is missing first parameter.\n");
         return SCPI_RES_ERR;
@@ -90,12 +90,20 @@ scpi_result_t RP_AcqSetDataFormat(scpi_t *context) {
 
     if (strncasecmp(param, "BIN", param_len) == 0) {
         context->binary_output = true;
+        RP_CLIENT(context)->packed = false;
         RP_LOG(LOG_INFO, "*ACQ:DATA:FORMAT set to BIN\n");
     }
     else if (strncasecmp(param, "ASCII", param_len) == 0) {
         context->binary_output = false;
+        RP_CLIENT(context)->packed = false;
         RP_LOG(LOG_INFO, "*ACQ:DATA:FORMAT set to ASCII\n");
     }
+    else if (strncasecmp(param, "PACK", param_len) == 0) {
+        // only raw counts are delta coded, volts go as BIN
+        context->binary_output = true;
+        RP_CLIENT(context)->packed = true;
+        RP_LOG(LOG_INFO, "*ACQ:DATA:FORMAT set to PACK\n");
+    }
     else {
         RP_LOG(LOG_ERR, "*ACQ:DATA:FORMAT wrong argument value\n");
         return SCPI_RES_ERR;
@@ -105,6 +113,38 @@ scpi_result_t RP_AcqSetDataFormat(scpi_t *context) {
 }
 
 
+/* Trigger source the stream re-arms with, the last one set with ACQ:TRIG */
+static rp_acq_trig_src_t stream_trig_src = RP_TRIG_SRC_DISABLED;
+static bool stream_armed = false;
+/* Set by ACQ:TRIG, *OPC? and *WAI complete once the FPGA has cleared the source */
+static bool acq_pending = false;
+
+scpi_result_t RP_AcqSetDataEndian(scpi_t *context) {
+    const char * param;
+    size_t param_len;
+
+    // byte order of binary blocks (BIG, LITTLE)
+    if (!SCPI_ParamCharacters(context, &param, &param_len, true)) {
+        RP_LOG(LOG_ERR, "*ACQ:DATA:ENDIAN is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if (strncasecmp(param, "BIG", param_len) == 0) {
+        RP_CLIENT(context)->big_endian = true;
+        RP_LOG(LOG_INFO, "*ACQ:DATA:ENDIAN set to BIG\n");
+    }
+    else if (strncasecmp(param, "LITTLE", param_len) == 0) {
+        RP_CLIENT(context)->big_endian = false;
+        RP_LOG(LOG_INFO, "*ACQ:DATA:ENDIAN set to LITTLE\n");
+    }
+    else {
+        RP_LOG(LOG_ERR, "*ACQ:DATA:ENDIAN wrong argument value\n");
+        return SCPI_RES_ERR;
+    }
+
+    return SCPI_RES_OK;
+}
+
 scpi_result_t RP_AcqStart(scpi_t *context) {
     int result = rp_AcqStart();
 
@@ -125,6 +165,9 @@ scpi_result_t RP_AcqStop(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
+    stream_armed = false;
+    acq_pending = false;
+
     RP_LOG(LOG_INFO, "*ACQ:STOP Successful stopped Red Pitaya acquire.\n");
     return SCPI_RES_OK;
 }
@@ -137,8 +180,13 @@ scpi_result_t RP_AcqReset(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    unit = RP_SCPI_VOLTS;
+    RP_CLIENT(context)->unit = RP_SCPI_VOLTS;
+    RP_CLIENT(context)->big_endian = true;
+    RP_CLIENT(context)->stream = 0;
+    RP_CLIENT(context)->packed = false;
     context->binary_output = false;
+    stream_armed = false;
+    acq_pending = false;
 
     RP_LOG(LOG_INFO, "*ACQ:RST Successful reset  Red Pitaya acquire.\n");
     return SCPI_RES_OK;
@@ -303,6 +351,10 @@ scpi_result_t RP_AcqTriggerSrc(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
+    stream_trig_src = source;
+    stream_armed = source != RP_TRIG_SRC_DISABLED;
+    acq_pending = stream_armed;
+
     RP_LOG(LOG_INFO, "*ACQ:TRIG Successfully set trigger source.\n");
     return SCPI_RES_OK;
 }
@@ -594,7 +646,7 @@ scpi_result_t RP_AcqScpiDataUnits(scpi_t *context) {
     }
 
     /* Set global units for acq scpi */
-    unit = choice;
+    RP_CLIENT(context)->unit = choice;
 
     RP_LOG(LOG_INFO, "*ACQ:DATA:UNITS Successfully set scpi units.\n");
     return SCPI_RES_OK;
@@ -604,7 +656,7 @@ scpi_result_t RP_AcqScpiDataUnitsQ(scpi_t *context){
 
     const char *units;
 
-    if(!SCPI_ChoiceToName(scpi_RpUnits, unit, &units)){
+    if(!SCPI_ChoiceToName(scpi_RpUnits, RP_CLIENT(context)->unit, &units)){
         RP_LOG(LOG_ERR, "*ACQ:DATA:UNITS? Failed to get data units.\n");
         return SCPI_RES_ERR;
     }
@@ -637,9 +689,16 @@ scpi_result_t RP_AcqDataPosQ(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    uint32_t size = end - start;
-    if(unit == RP_SCPI_VOLTS){
-        float buffer[size];
+    // The range may wrap around the end of the buffer
+    uint32_t size;
+    rp_AcqGetBufSize(&size);
+    void *buffer = RP_ScratchBuffer(size * sizeof(float));
+    if(buffer == NULL){
+        RP_LOG(LOG_ERR, "*ACQ:SOUR#:DATA:STA:END? Out of memory.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if(RP_CLIENT(context)->unit == RP_SCPI_VOLTS){
         result = rp_AcqGetDataPosV(channel, start, end, buffer, &size);
         
         if(result != RP_OK){
@@ -647,10 +706,9 @@ scpi_result_t RP_AcqDataPosQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
         
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
-        int16_t buffer[size];
         result = rp_AcqGetDataPosRaw(channel, start, end, buffer, &size);
         
         if(result != RP_OK){
@@ -658,7 +716,7 @@ scpi_result_t RP_AcqDataPosQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR#:DATA:STA:END? Successfully returned data to client.\n");
@@ -690,8 +748,16 @@ scpi_result_t RP_AcqDataQ(scpi_t *context) {
 
     uint32_t size_buff;
     rp_AcqGetBufSize(&size_buff);
-    if(unit == RP_SCPI_VOLTS){
-        float buffer[size_buff - start];
+    if(size > size_buff){
+        size = size_buff;
+    }
+    void *buffer = RP_ScratchBuffer(size_buff * sizeof(float));
+    if(buffer == NULL){
+        RP_LOG(LOG_ERR, "*ACQ:SOUR<n>:DATA:STA:N? Out of memory.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if(RP_CLIENT(context)->unit == RP_SCPI_VOLTS){
         result = rp_AcqGetDataV(channel, start, &size, buffer);
         if(result != RP_OK){
             RP_LOG(LOG_ERR, "*ACQ:SOUR<n>:DATA:STA:N? Failed to get "
@@ -699,10 +765,9 @@ scpi_result_t RP_AcqDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
-        int16_t buffer[size_buff - start];
         result = rp_AcqGetDataRaw(channel, start, &size, buffer);
 
         if(result != RP_OK){
@@ -710,7 +775,7 @@ scpi_result_t RP_AcqDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR<n>:DATA:STA:N? Successfully returned data.\n");
@@ -729,8 +794,13 @@ scpi_result_t RP_AcqDataOldestAllQ(scpi_t *context) {
     }
     
     rp_AcqGetBufSize(&size);
-    if(unit == RP_SCPI_VOLTS){
-        float buffer[size];
+    void *buffer = RP_ScratchBuffer(size * sizeof(float));
+    if(buffer == NULL){
+        RP_LOG(LOG_ERR, "*ACQ:SOUR#:DATA? Out of memory.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if(RP_CLIENT(context)->unit == RP_SCPI_VOLTS){
         result = rp_AcqGetOldestDataV(channel, &size, buffer);
 
         if(result != RP_OK){
@@ -738,23 +808,228 @@ scpi_result_t RP_AcqDataOldestAllQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
-        int16_t buffer[size];
         result = rp_AcqGetOldestDataRaw(channel, &size, buffer);
         if(result != RP_OK){
             RP_LOG(LOG_ERR, "*ACQ:SOUR#:DATA? Failed to get raw data: %s\n", rp_GetError(result));
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR#:DATA? Successfully returned data.\n");
     return SCPI_RES_OK;
 }
 
+scpi_result_t RP_AcqStream(scpi_t *context) {
+    rp_channel_t channel;
+    scpi_bool_t value;
+
+    if (RP_ParseChArgv(context, &channel) != RP_OK){
+        return SCPI_RES_ERR;
+    }
+
+    if (!SCPI_ParamBool(context, &value, true)) {
+        RP_LOG(LOG_ERR, "*ACQ:SOUR#:STREAM is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if (value) {
+        RP_CLIENT(context)->stream |= 1u << channel;
+    } else {
+        RP_CLIENT(context)->stream &= ~(1u << channel);
+    }
+
+    RP_LOG(LOG_INFO, "*ACQ:SOUR#:STREAM Successfully set streaming.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_AcqStreamQ(scpi_t *context) {
+    rp_channel_t channel;
+
+    if (RP_ParseChArgv(context, &channel) != RP_OK){
+        return SCPI_RES_ERR;
+    }
+
+    SCPI_ResultMnemonic(context, (RP_CLIENT(context)->stream & (1u << channel)) ? "ON" : "OFF");
+
+    RP_LOG(LOG_INFO, "*ACQ:SOUR#:STREAM? Successfully returned streaming.\n");
+    return SCPI_RES_OK;
+}
+
+bool RP_AcqStreamCaptured(void) {
+    if (!stream_armed) {
+        return false;
+    }
+
+    // Consumes a pending trigger interrupt and enables the next one
+    rp_AcqWaitTrigger(0);
+
+    // The FPGA clears the source once the trigger delay has elapsed
+    rp_acq_trig_src_t source;
+    if (rp_AcqGetTriggerSrc(&source) != RP_OK || source != RP_TRIG_SRC_DISABLED) {
+        return false;
+    }
+    stream_armed = false;
+    return true;
+}
+
+void RP_AcqStreamPush(scpi_t *context) {
+    uint32_t size;
+    rp_AcqGetBufSize(&size);
+    void *buffer = RP_ScratchBuffer(size * sizeof(float));
+    if (buffer == NULL) {
+        RP_LOG(LOG_ERR, "*ACQ:SOUR#:STREAM Out of memory.\n");
+        return;
+    }
+
+    // One block per channel in channel order, always binary
+    for (rp_channel_t channel = RP_CH_1; channel <= RP_CH_2; channel++) {
+        if (!(RP_CLIENT(context)->stream & (1u << channel))) {
+            continue;
+        }
+        uint32_t count = size;
+        int result;
+        if (RP_CLIENT(context)->unit == RP_SCPI_VOLTS) {
+            result = rp_AcqGetOldestDataV(channel, &count, buffer);
+            if (result == RP_OK) {
+                RP_ResultBlock(context, buffer, count, sizeof(float));
+            }
+        } else {
+            result = rp_AcqGetOldestDataRaw(channel, &count, buffer);
+            if (result == RP_OK && RP_CLIENT(context)->packed) {
+                RP_ResultBlockPacked(context, buffer, count);
+            } else if (result == RP_OK) {
+                RP_ResultBlock(context, buffer, count, sizeof(int16_t));
+            }
+        }
+        if (result != RP_OK) {
+            RP_LOG(LOG_ERR, "*ACQ:SOUR#:STREAM Failed to get data: %s\n", rp_GetError(result));
+            return;
+        }
+        SCPI_Write(context, "\r\n", 2);
+    }
+    RP_OutputFlush(context);
+}
+
+void RP_AcqStreamRearm(void) {
+    int result = rp_AcqStart();
+    if (result == RP_OK) {
+        result = rp_AcqSetTriggerSrc(stream_trig_src);
+    }
+    if (result != RP_OK) {
+        RP_LOG(LOG_ERR, "*ACQ:SOUR#:STREAM Failed to re-arm acquisition: %s\n", rp_GetError(result));
+        return;
+    }
+    stream_armed = true;
+}
+
+static uint64_t monotonicMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/* Also consumes a pending trigger interrupt and enables the next one */
+static bool acqDone(void) {
+    if (!acq_pending) {
+        return true;
+    }
+    rp_AcqWaitTrigger(0);
+
+    rp_acq_trig_src_t source;
+    if (rp_AcqGetTriggerSrc(&source) != RP_OK || source != RP_TRIG_SRC_DISABLED) {
+        return false;
+    }
+    acq_pending = false;
+    return true;
+}
+
+static void waitReply(scpi_t *context, const char *reply) {
+    struct iovec iov[2] = {
+        { .iov_base = (void *)reply, .iov_len = strlen(reply) },
+        { .iov_base = "\r\n", .iov_len = 2 },
+    };
+    RP_OutputWrite(context, iov, 2);
+    RP_OutputFlush(context);
+}
+
+/* Parks the client, the server answers from RP_AcqWaitPoll() */
+static void waitBegin(scpi_t *context, rp_scpi_wait_t wait, uint32_t timeout_ms) {
+    RP_CLIENT(context)->wait = wait;
+    RP_CLIENT(context)->wait_until = timeout_ms ? monotonicMs() + timeout_ms : 0;
+}
+
+scpi_result_t RP_AcqTriggerWaitQ(scpi_t *context) {
+    uint32_t timeout;
+
+    // [ms], 0 only checks the state like ACQ:TRIG:STAT?
+    if (!SCPI_ParamUInt32(context, &timeout, true)) {
+        RP_LOG(LOG_ERR, "*ACQ:TRIG:WAIT? is missing first parameter.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if (acqDone()) {
+        SCPI_ResultMnemonic(context, "TD");
+    } else if (timeout == 0) {
+        SCPI_ResultMnemonic(context, "WAIT");
+    } else {
+        waitBegin(context, RP_SCPI_WAIT_TRIG, timeout);
+    }
+
+    RP_LOG(LOG_INFO, "*ACQ:TRIG:WAIT? Successfully started waiting.\n");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_AcqOpcQ(scpi_t *context) {
+    if (acqDone()) {
+        SCPI_ResultInt32(context, 1);
+    } else {
+        waitBegin(context, RP_SCPI_WAIT_OPC, 0);
+    }
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_AcqWai(scpi_t *context) {
+    if (!acqDone()) {
+        waitBegin(context, RP_SCPI_WAIT_WAI, 0);
+    }
+    return SCPI_RES_OK;
+}
+
+bool RP_AcqTriggerArmed(void) {
+    rp_acq_trig_state_t state;
+    return acq_pending && rp_AcqGetTriggerState(&state) == RP_OK && state == RP_TRIG_STATE_WAITING;
+}
+
+bool RP_AcqWaitPoll(scpi_t *context) {
+    rp_scpi_client_t *client = RP_CLIENT(context);
+    bool done = acqDone();
+
+    if (!done && (client->wait_until == 0 || monotonicMs() < client->wait_until)) {
+        return false;
+    }
+    if (client->wait == RP_SCPI_WAIT_OPC) {
+        waitReply(context, "1");
+    } else if (client->wait == RP_SCPI_WAIT_TRIG) {
+        waitReply(context, done ? "TD" : "WAIT");
+    }
+    client->wait = RP_SCPI_WAIT_NONE;
+    return true;
+}
+
+int RP_AcqWaitLeftMs(scpi_t *context) {
+    uint64_t until = RP_CLIENT(context)->wait_until;
+    if (until == 0) {
+        return -1;
+    }
+    uint64_t now = monotonicMs();
+    return now >= until ? 0 : (until - now > INT32_MAX ? INT32_MAX : (int)(until - now));
+}
+
 scpi_result_t RP_AcqOldestDataQ(scpi_t *context) {
     
     uint32_t size;
@@ -771,8 +1046,18 @@ scpi_result_t RP_AcqOldestDataQ(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    if(unit == RP_SCPI_VOLTS){
-        float buffer[size];
+    uint32_t size_buff;
+    rp_AcqGetBufSize(&size_buff);
+    if(size > size_buff){
+        size = size_buff;
+    }
+    void *buffer = RP_ScratchBuffer(size * sizeof(float));
+    if(buffer == NULL){
+        RP_LOG(LOG_ERR, "*ACQ:SOUR#:DATA:OLD:N? Out of memory.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if(RP_CLIENT(context)->unit == RP_SCPI_VOLTS){
         result = rp_AcqGetOldestDataV(channel, &size, buffer);
 
         if(result != RP_OK){
@@ -782,17 +1067,16 @@ scpi_result_t RP_AcqOldestDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
 
     }else{
-        int16_t buffer[size];
         result = rp_AcqGetOldestDataRaw(channel, &size, buffer);
         if(result != RP_OK){
             RP_LOG(LOG_ERR, "*ACQ:SOUR#:DATA:OLD:N? Failed to get raw data: %s\n", rp_GetError(result));
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR#:DATA:OLD:N? Successfully returned data to client.");
@@ -815,8 +1099,18 @@ scpi_result_t RP_AcqLatestDataQ(scpi_t *context) {
         return SCPI_RES_ERR;
     }
 
-    if(unit == RP_SCPI_VOLTS){
-        float buffer[size];
+    uint32_t size_buff;
+    rp_AcqGetBufSize(&size_buff);
+    if(size > size_buff){
+        size = size_buff;
+    }
+    void *buffer = RP_ScratchBuffer(size * sizeof(float));
+    if(buffer == NULL){
+        RP_LOG(LOG_ERR, "*ACQ:SOUR<n>:DATA:LAT:N? Out of memory.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if(RP_CLIENT(context)->unit == RP_SCPI_VOLTS){
         result = rp_AcqGetLatestDataV(channel, &size, buffer);
 
         if(result != RP_OK){
@@ -825,17 +1119,17 @@ scpi_result_t RP_AcqLatestDataQ(scpi_t *context) {
             return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferFloat(context, buffer, size);
+        RP_ResultBufferFloat(context, buffer, size);
     }else{
-        int16_t buffer[size];
         result = rp_AcqGetLatestDataRaw(channel, &size, buffer);
 
         if(result != RP_OK){
             RP_LOG(LOG_ERR, "*ACQ:SOUR<n>:DATA:LAT:N? Failed to "
                 "get raw data: %s\n", rp_GetError(result));
+            return SCPI_RES_ERR;
         }
 
-        SCPI_ResultBufferInt16(context, buffer, size);
+        RP_ResultBufferInt16(context, buffer, size);
     }
 
     RP_LOG(LOG_INFO, "*ACQ:SOUR<n>:DATA:LAT:N? Successfully returned data to client.\n");
@@ -18,14 +18,12 @@
 
 #include "scpi/types.h"
 #include "redpitaya/rp.h"
+#include "common.h"
 
-typedef enum {
-    RP_SCPI_VOLTS,
-    RP_SCPI_RAW,
-} rp_scpi_acq_unit_t;
 
 int RP_AcqSetDefaultValues();
 scpi_result_t RP_AcqSetDataFormat(scpi_t *context);
+scpi_result_t RP_AcqSetDataEndian(scpi_t *context);
 scpi_result_t RP_AcqStart(scpi_t * context);
 scpi_result_t RP_AcqStop(scpi_t *context);
 scpi_result_t RP_AcqReset(scpi_t * context);
@@ -57,7 +55,22 @@ scpi_result_t RP_AcqDataOldestAllQ(scpi_t * context);
 scpi_result_t RP_AcqOldestDataQ(scpi_t *context);
 scpi_result_t RP_AcqLatestDataQ(scpi_t *context);
 scpi_result_t RP_AcqBufferSizeQ(scpi_t * context);
+scpi_result_t RP_AcqStream(scpi_t *context);
+scpi_result_t RP_AcqStreamQ(scpi_t *context);
+scpi_result_t RP_AcqTriggerWaitQ(scpi_t *context);
+scpi_result_t RP_AcqOpcQ(scpi_t *context);
+scpi_result_t RP_AcqWai(scpi_t *context);
 
 scpi_result_t RP_AcqGetLatestData(rp_channel_t channel, scpi_t * context);
 
+/* Push mode, driven from the server loop */
+bool RP_AcqStreamCaptured(void);
+void RP_AcqStreamPush(scpi_t *context);
+void RP_AcqStreamRearm(void);
+
+/* Parked *OPC?, *WAI and ACQ:TRIG:WAIT?, driven from the server loop */
+bool RP_AcqTriggerArmed(void);
+bool RP_AcqWaitPoll(scpi_t *context);
+int RP_AcqWaitLeftMs(scpi_t *context);
+
 #endif /* ACQUIRE_H_ */
@@ -117,6 +117,8 @@ scpi_result_t RP_FpgaBitStream(scpi_t *context){
         return SCPI_RES_ERR;
     }
 
+    /* The web server would take the old bitstream for still loaded */
+    unlink("/tmp/rp_fpga_loaded");
     if(write(fo, &fi_buff, fpga_s) < 0){
         RP_LOG(LOG_ERR, "*RP:FPGA:BITstr Unable to write fpga "
             "bit stream: %d\n", fo);
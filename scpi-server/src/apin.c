@@ -80,6 +80,29 @@ scpi_result_t RP_AnalogPinValueQ(scpi_t * context) {
     return SCPI_RES_OK;
 }
 
+/**
+ * Returns values of all analog pins in volts, AOUT0 to AOUT3 then AIN0 to AIN3
+ * @param context SCPI context
+ * @return success or failure
+ */
+scpi_result_t RP_AnalogPinValueAllQ(scpi_t * context) {
+
+    float values[RP_AIN3 + 1];
+    int result = rp_ApinGetValueAll(values);
+
+    if (RP_OK != result){
+        RP_LOG(LOG_ERR, "*ANALOG:PIN:ALL? Failed to get pin values: %s\n", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+
+    for (int i = 0; i <= RP_AIN3; i++) {
+        SCPI_ResultDouble(context, values[i]);
+    }
+
+    RP_LOG(LOG_INFO, "*ANALOG:PIN:ALL? Successfully returned port values.\n");
+    return SCPI_RES_OK;
+}
+
 /**
  * Sets Analog Pin value in volts
  * @param context SCPI context
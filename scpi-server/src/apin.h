@@ -19,5 +19,6 @@
 scpi_result_t RP_AnalogPinReset(scpi_t * context);
 scpi_result_t RP_AnalogPinValueQ(scpi_t * context);
 scpi_result_t RP_AnalogPinValue(scpi_t * context);
+scpi_result_t RP_AnalogPinValueAllQ(scpi_t * context);
 
 #endif /* APIN_H_ */
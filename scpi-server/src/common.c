@@ -13,8 +13,26 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 #include "common.h"
+#include "scpi-commands.h"
+
+static void  *scratch      = NULL;
+static size_t scratch_size = 0;
+
+/* Samples per frame of a PACK block, each frame has its own bit width */
+#define PACK_FRAME 64
+
+static uint8_t *pack      = NULL;
+static size_t   pack_size = 0;
 
 /* Parse channel */
 int RP_ParseChArgv(scpi_t *context, rp_channel_t *channel){
@@ -29,3 +47,215 @@ int RP_ParseChArgv(scpi_t *context, rp_channel_t *channel){
     
     return RP_OK;
 }
+
+/* One buffer for all data queries, it grows to the largest request and stays */
+void *RP_ScratchBuffer(size_t size){
+    if (size > scratch_size) {
+        void *buffer = realloc(scratch, size);
+        if (buffer == NULL) {
+            return NULL;
+        }
+        scratch = buffer;
+        scratch_size = size;
+    }
+    return scratch;
+}
+
+/* Sends all of iov, on a short send it continues with the rest */
+static int sendAll(int fd, struct iovec *iov, int count, int flags){
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = count };
+    while (msg.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(fd, &msg, flags);
+        if (sent < 0) {
+            syslog(LOG_ERR, "Failed to write into the socket (%m).");
+            return -1;
+        }
+        while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Queues a response fragment. Fragments are collected in the client's output
+ * buffer and sent together by RP_OutputFlush() at the end of the command.
+ * What does not fit goes out at once in a single send with the pending
+ * bytes in front, flagged MSG_MORE so the kernel keeps a short tail for the
+ * flush. Up to two iov entries.
+ */
+size_t RP_OutputWrite(scpi_t *context, struct iovec *iov, int count){
+    rp_scpi_client_t *client = RP_CLIENT(context);
+    size_t total = 0;
+    if (client == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+
+    if (client->out_len + total <= RP_OUTPUT_SIZE) {
+        for (int i = 0; i < count; i++) {
+            memcpy(client->out + client->out_len, iov[i].iov_base, iov[i].iov_len);
+            client->out_len += iov[i].iov_len;
+        }
+        return total;
+    }
+
+    struct iovec vec[3];
+    int n = 0;
+    if (client->out_len > 0) {
+        vec[n++] = (struct iovec){ .iov_base = client->out, .iov_len = client->out_len };
+    }
+    for (int i = 0; i < count && n < 3; i++) {
+        vec[n++] = iov[i];
+    }
+    client->out_len = 0;
+    if (sendAll(client->fd, vec, n, MSG_MORE) < 0) {
+        return 0;
+    }
+    client->corked = true;
+    return total;
+}
+
+/* Sends the pending output, the end of a response. Returns -1 on failure */
+int RP_OutputFlush(scpi_t *context){
+    rp_scpi_client_t *client = RP_CLIENT(context);
+    int ret = 0;
+    if (client == NULL) {
+        return 0;
+    }
+    if (client->out_len > 0) {
+        struct iovec iov = { .iov_base = client->out, .iov_len = client->out_len };
+        ret = sendAll(client->fd, &iov, 1, 0);
+        client->out_len = 0;
+    } else if (client->corked) {
+        // setting TCP_NODELAY pushes what MSG_MORE held back
+        int one = 1;
+        setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    client->corked = false;
+    return ret;
+}
+
+/*
+ * Writes data as an IEEE 488.2 definite length block. The header and the
+ * data are queued together, the data is byte swapped in place when the
+ * client asked for network order.
+ */
+/* Writes an IEEE 488.2 definite length block, #<digits><length><data> */
+static size_t writeBlock(scpi_t *context, void *data, size_t len){
+    char digits[24];
+    char header[32];
+    int n = snprintf(digits, sizeof(digits), "%zu", len);
+    int header_len = snprintf(header, sizeof(header), "#%d%s", n, digits);
+
+    context->output_count++;
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = header_len },
+        { .iov_base = data,   .iov_len = len        },
+    };
+    if (RP_OutputWrite(context, iov, 2) == 0) {
+        return 0;
+    }
+    return header_len + len;
+}
+
+size_t RP_ResultBlock(scpi_t *context, void *data, size_t count, size_t elem_size){
+    if (RP_CLIENT(context)->big_endian) {
+        if (elem_size == sizeof(uint32_t)) {
+            uint32_t *p = data;
+            for (size_t i = 0; i < count; i++) {
+                p[i] = htonl(p[i]);
+            }
+        } else if (elem_size == sizeof(uint16_t)) {
+            uint16_t *p = data;
+            for (size_t i = 0; i < count; i++) {
+                p[i] = htons(p[i]);
+            }
+        }
+    }
+    return writeBlock(context, data, count * elem_size);
+}
+
+/*
+ * PACK block data, little endian regardless of ACQ:DATA:ENDIAN:
+ *   uint32 sample count
+ *   per frame of PACK_FRAME samples (the last one may be shorter):
+ *     uint8 bit width w (0 - 16)
+ *     the zigzag coded differences to the previous sample (0 before the
+ *     first one) in w bits each, packed from the least significant bit
+ * The differences wrap at 16 bits. Noise of a few counts costs 3 - 5 bits
+ * per sample instead of 16.
+ */
+size_t RP_ResultBlockPacked(scpi_t *context, const int16_t *data, uint32_t count){
+    size_t size = 4 + (count + PACK_FRAME - 1) / PACK_FRAME * (1 + PACK_FRAME * sizeof(int16_t));
+    if (size > pack_size) {
+        uint8_t *buffer = realloc(pack, size);
+        if (buffer == NULL) {
+            syslog(LOG_ERR, "Out of memory for a packed block.");
+            return 0;
+        }
+        pack = buffer;
+        pack_size = size;
+    }
+
+    size_t len = 0;
+    for (int i = 0; i < 4; i++) {
+        pack[len++] = count >> (8 * i);
+    }
+    uint16_t prev = 0;
+    for (uint32_t i = 0; i < count; i += PACK_FRAME) {
+        uint32_t n = count - i < PACK_FRAME ? count - i : PACK_FRAME;
+        uint16_t zz[PACK_FRAME];
+        uint16_t all = 0;
+        for (uint32_t j = 0; j < n; j++) {
+            int16_t d = (int16_t)((uint16_t)data[i + j] - prev);
+            prev = data[i + j];
+            zz[j] = (uint16_t)((d << 1) ^ (d >> 15));
+            all |= zz[j];
+        }
+        int width = 0;
+        while (all >> width) {
+            width++;
+        }
+        pack[len++] = width;
+
+        uint32_t acc = 0;
+        int bits = 0;
+        for (uint32_t j = 0; j < n; j++) {
+            acc |= (uint32_t)zz[j] << bits;
+            for (bits += width; bits >= 8; bits -= 8) {
+                pack[len++] = acc;
+                acc >>= 8;
+            }
+        }
+        if (bits > 0) {
+            pack[len++] = acc;
+        }
+    }
+    return writeBlock(context, pack, len);
+}
+
+size_t RP_ResultBufferFloat(scpi_t *context, float *data, uint32_t size){
+    if (context->binary_output) {
+        return RP_ResultBlock(context, data, size, sizeof(float));
+    }
+    return SCPI_ResultBufferFloat(context, data, size);
+}
+
+size_t RP_ResultBufferInt16(scpi_t *context, int16_t *data, uint32_t size){
+    if (RP_CLIENT(context)->packed) {
+        return RP_ResultBlockPacked(context, data, size);
+    }
+    if (context->binary_output) {
+        return RP_ResultBlock(context, data, size, sizeof(int16_t));
+    }
+    return SCPI_ResultBufferInt16(context, data, size);
+}
@@ -16,6 +16,9 @@
 #define COMMON_H_
 
 #include <syslog.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
 
 #include "scpi/parser.h"
 #include "redpitaya/rp.h"
@@ -31,6 +34,46 @@ syslog(__VA_ARGS__);
 #define RP_LOG(...)
 #endif
 
+typedef enum {
+    RP_SCPI_VOLTS,
+    RP_SCPI_RAW,
+} rp_scpi_acq_unit_t;
+
+/* Operation a client is parked on, its later lines wait in the server */
+typedef enum {
+    RP_SCPI_WAIT_NONE,
+    RP_SCPI_WAIT_WAI,           // *WAI, no reply
+    RP_SCPI_WAIT_OPC,           // *OPC?, replies 1
+    RP_SCPI_WAIT_TRIG,          // ACQ:TRIG:WAIT?, replies TD or WAIT on timeout
+} rp_scpi_wait_t;
+
+// Responses up to this size go out in one send at the end of the command
+#define RP_OUTPUT_SIZE  16384
+
+/* State of one client connection, it is the user context of its parser */
+typedef struct {
+    int                fd;          // Socket, RP_OutputFlush() sends to it
+    rp_scpi_acq_unit_t unit;        // Units of acquired data
+    bool               big_endian;  // Byte order of binary blocks, network order by default
+    bool               packed;      // Raw counts go as delta coded blocks, ACQ:DATA:FORMAT PACK
+    uint32_t           stream;      // Bit per channel pushed after every trigger
+    rp_scpi_wait_t     wait;        // Set by a command that completes with the acquisition
+    uint64_t           wait_until;  // Monotonic deadline of the wait [ms], 0 without one
+    bool               corked;      // Sent with MSG_MORE, the kernel holds the tail
+    size_t             out_len;     // Bytes pending in out
+    char               out[RP_OUTPUT_SIZE];
+} rp_scpi_client_t;
+
+#define RP_CLIENT(context) ((rp_scpi_client_t *)(context)->user_context)
+
 int RP_ParseChArgv(scpi_t *context, rp_channel_t *channel);
 
+void *RP_ScratchBuffer(size_t size);
+size_t RP_OutputWrite(scpi_t *context, struct iovec *iov, int count);
+int RP_OutputFlush(scpi_t *context);
+size_t RP_ResultBlock(scpi_t *context, void *data, size_t count, size_t elem_size);
+size_t RP_ResultBlockPacked(scpi_t *context, const int16_t *data, uint32_t count);
+size_t RP_ResultBufferFloat(scpi_t *context, float *data, uint32_t size);
+size_t RP_ResultBufferInt16(scpi_t *context, int16_t *data, uint32_t size);
+
 #endif /* COMMON_H_ */
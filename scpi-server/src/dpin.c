@@ -210,3 +210,72 @@ scpi_result_t RP_DigitalPinDirectionQ(scpi_t *context){
     RP_LOG(LOG_INFO, "*DIG:PIN:DIR? Successfully returned direction value to the client.");
     return SCPI_RES_OK;
 }
+
+/**
+ * Returns the state of all pins as one number, bit n is the pin with
+ * the n-th DIG:PIN name, LED0 in bit 0 to DIO7_N in bit 23.
+ * @param context SCPI context
+ * @return success or failure
+ */
+scpi_result_t RP_DigitalPinStateAllQ(scpi_t *context) {
+
+    uint32_t state;
+    int result = rp_DpinGetStateAll(&state);
+
+    if (RP_OK != result){
+        RP_LOG(LOG_ERR, "*DIG:PIN:ALL? Failed to get pin states: %s", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+
+    SCPI_ResultUInt32Base(context, state, 10);
+
+    RP_LOG(LOG_INFO, "*DIG:PIN:ALL? Successfully returned port values");
+    return SCPI_RES_OK;
+}
+
+/**
+ * Sets the state of all pins selected by a mask at once
+ * @param context SCPI context
+ * @return success or failure
+ */
+scpi_result_t RP_DigitalPinStateAll(scpi_t *context) {
+
+    uint32_t mask, state;
+
+    if(!SCPI_ParamUInt32(context, &mask, true)){
+        RP_LOG(LOG_ERR, "*DIG:PIN:ALL is missing first parameter.");
+        return SCPI_RES_ERR;
+    }
+
+    if(!SCPI_ParamUInt32(context, &state, true)){
+        RP_LOG(LOG_ERR, "*DIG:PIN:ALL is missing second parameter.");
+        return SCPI_RES_ERR;
+    }
+
+    int result = rp_DpinSetStateMask(mask, state);
+
+    if (RP_OK != result){
+        RP_LOG(LOG_ERR, "*DIG:PIN:ALL Failed to set pin states: %s", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+
+    RP_LOG(LOG_INFO, "*DIG:PIN:ALL Successfully set port values");
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_DigitalPinDirectionAllQ(scpi_t *context) {
+
+    uint32_t direction;
+    int result = rp_DpinGetDirectionAll(&direction);
+
+    if (RP_OK != result){
+        RP_LOG(LOG_ERR, "*DIG:PIN:DIR:ALL? Failed to get pin directions: %s", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+
+    SCPI_ResultUInt32Base(context, direction, 10);
+
+    RP_LOG(LOG_INFO, "*DIG:PIN:DIR:ALL? Successfully returned directions to the client.");
+    return SCPI_RES_OK;
+}
+
@@ -21,5 +21,8 @@ scpi_result_t RP_DigitalPinStateQ(scpi_t * context);
 scpi_result_t RP_DigitalPinState(scpi_t * context);
 scpi_result_t RP_DigitalPinDirection(scpi_t * context);
 scpi_result_t RP_DigitalPinDirectionQ(scpi_t *context);
+scpi_result_t RP_DigitalPinStateAllQ(scpi_t *context);
+scpi_result_t RP_DigitalPinStateAll(scpi_t *context);
+scpi_result_t RP_DigitalPinDirectionAllQ(scpi_t *context);
 
 #endif /* DPIN_H_ */
@@ -444,6 +444,47 @@ scpi_result_t RP_GenArbitraryWaveForm(scpi_t *context) {
     return SCPI_RES_OK;
 }
 
+/**
+ * Takes the waveform as a definite length block of little endian 16 bit DAC
+ * counts, e.g. #532768<bytes>, and hands it to the library without parsing
+ * numbers or converting floats.
+ */
+scpi_result_t RP_GenArbitraryWaveFormRaw(scpi_t *context) {
+
+    rp_channel_t channel;
+    int16_t buffer[BUFFER_LENGTH];
+    const char *block;
+    size_t len;
+    int result;
+
+    if (RP_ParseChArgv(context, &channel) != RP_OK){
+        return SCPI_RES_ERR;
+    }
+
+    if(!SCPI_ParamArbitraryBlock(context, &block, &len, true)){
+        RP_LOG(LOG_ERR, "*SOUR#:TRAC:DATA:RAW Failed to "
+            "get arbitrary waveform block.\n");
+        return SCPI_RES_ERR;
+    }
+
+    if(len % sizeof(int16_t) != 0 || len > sizeof(buffer)){
+        RP_LOG(LOG_ERR, "*SOUR#:TRAC:DATA:RAW Invalid block size %zu.\n", len);
+        return SCPI_RES_ERR;
+    }
+
+    // The block is not aligned
+    memcpy(buffer, block, len);
+    result = rp_GenArbWaveformRaw(channel, buffer, len / sizeof(int16_t));
+    if(result != RP_OK){
+        RP_LOG(LOG_ERR, "*SOUR#:TRAC:DATA:RAW Failed to "
+            "set arbitrary waveform data: %s\n", rp_GetError(result));
+        return SCPI_RES_ERR;
+    }
+
+    RP_LOG(LOG_INFO, "*SOUR#:TRAC:DATA:RAW Successfully set arbitrary waveform data.\n");
+    return SCPI_RES_OK;
+}
+
 scpi_result_t RP_GenArbitraryWaveFormQ(scpi_t *context) {
     
     rp_channel_t channel;
@@ -35,6 +35,7 @@ scpi_result_t RP_GenDutyCycle(scpi_t * context);
 scpi_result_t RP_GenDutyCycleQ(scpi_t * context);
 scpi_result_t RP_GenArbitraryWaveForm(scpi_t * context);
 scpi_result_t RP_GenArbitraryWaveFormQ(scpi_t * context);
+scpi_result_t RP_GenArbitraryWaveFormRaw(scpi_t * context);
 scpi_result_t RP_GenGenerateMode(scpi_t * context);
 scpi_result_t RP_GenGenerateModeQ(scpi_t * context);
 scpi_result_t RP_GenBurstCount(scpi_t * context);
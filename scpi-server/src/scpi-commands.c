@@ -15,6 +15,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
 #include <syslog.h>
 
 #include "api_cmd.h"
@@ -28,6 +30,7 @@
 #include "scpi/minimal.h"
 #include "scpi/units.h"
 #include "scpi/parser.h"
+#include "scpi-commands.h"
 
 bool RST_executed = FALSE;
 
@@ -35,29 +38,12 @@ bool RST_executed = FALSE;
  * Interface general commands
  */
 size_t SCPI_Write(scpi_t * context, const char * data, size_t len) {
-
-    size_t total = 0;
-
-    if (context->user_context != NULL) {
-        int fd = *(int *)(context->user_context);
-        while (len > 0) {
-            size_t written =  write(fd, data, len);
-            if (written < 0) {
-                syslog(LOG_ERR,
-                    "Failed to write into the socket. Should send %zu bytes. Could send only %zu bytes",
-                    len, written);
-                return total;
-            }
-            len -= written;
-            data += written;
-            total += written;
-        }
-    }
-    return total;
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+    return RP_OutputWrite(context, &iov, 1);
 }
 
 scpi_result_t SCPI_Flush(scpi_t * context) {
-    return SCPI_RES_OK;
+    return RP_OutputFlush(context) == 0 ? SCPI_RES_OK : SCPI_RES_ERR;
 }
 
 int SCPI_Error(scpi_t * context, int_fast16_t err) {
@@ -101,13 +87,13 @@ static const scpi_command_t scpi_commands[] = {
     { .pattern = "*ESR?", .callback = SCPI_CoreEsrQ,},
     { .pattern = "*IDN?", .callback = SCPI_CoreIdnQ,},
     { .pattern = "*OPC" , .callback = SCPI_CoreOpc,},
-    { .pattern = "*OPC?", .callback = SCPI_CoreOpcQ,},
+    { .pattern = "*OPC?", .callback = RP_AcqOpcQ,},
     { .pattern = "*RST" , .callback = SCPI_CoreRst,},
     { .pattern = "*SRE" , .callback = SCPI_CoreSre,},
     { .pattern = "*SRE?", .callback = SCPI_CoreSreQ,},
     { .pattern = "*STB?", .callback = SCPI_CoreStbQ,},
     { .pattern = "*TST?", .callback = SCPI_CoreTstQ,},
-    { .pattern = "*WAI" , .callback = SCPI_CoreWai,},
+    { .pattern = "*WAI" , .callback = RP_AcqWai,},
 
     /* Required SCPI commands (SCPI std V1999.0 4.2.1) */
     {.pattern = "SYSTem:ERRor[:NEXT]?", .callback = SCPI_SystemErrorNextQ,},
@@ -120,6 +106,8 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "STATus:PRESet",                .callback = SCPI_StatusPreset,},
 
     {.pattern = "SYSTem:COMMunication:TCPIP:CONTROL?", .callback = SCPI_SystemCommTcpipControlQ,},
+    {.pattern = "SYSTem:PERF?",         .callback = RP_SystemPerfQ,},
+    {.pattern = "SYSTem:PERF:RST",      .callback = RP_SystemPerfReset,},
 
     /* RedPitaya */
 
@@ -135,10 +123,14 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "DIG:PIN?", .callback                   = RP_DigitalPinStateQ,},
     {.pattern = "DIG:PIN:DIR", .callback                = RP_DigitalPinDirection,},
     {.pattern = "DIG:PIN:DIR?", .callback               = RP_DigitalPinDirectionQ,},
+    {.pattern = "DIG:PIN:ALL", .callback                = RP_DigitalPinStateAll,},
+    {.pattern = "DIG:PIN:ALL?", .callback               = RP_DigitalPinStateAllQ,},
+    {.pattern = "DIG:PIN:DIR:ALL?", .callback           = RP_DigitalPinDirectionAllQ,},
 
     {.pattern = "ANALOG:RST", .callback                 = RP_AnalogPinReset,},
     {.pattern = "ANALOG:PIN", .callback                 = RP_AnalogPinValue,},
     {.pattern = "ANALOG:PIN?", .callback                = RP_AnalogPinValueQ,},
+    {.pattern = "ANALOG:PIN:ALL?", .callback            = RP_AnalogPinValueAllQ,},
 
     /* Acquire */
     {.pattern = "ACQ:START", .callback                  = RP_AcqStart,},
@@ -151,6 +143,7 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "ACQ:AVG?", .callback                   = RP_AcqAveragingQ,},
     {.pattern = "ACQ:TRIG", .callback                   = RP_AcqTriggerSrc,},
     {.pattern = "ACQ:TRIG:STAT?", .callback             = RP_AcqTriggerSrcQ,},
+    {.pattern = "ACQ:TRIG:WAIT?", .callback             = RP_AcqTriggerWaitQ,},
     {.pattern = "ACQ:TRIG:DLY", .callback               = RP_AcqTriggerDelay,},
     {.pattern = "ACQ:TRIG:DLY?", .callback              = RP_AcqTriggerDelayQ,},
     {.pattern = "ACQ:TRIG:DLY:NS", .callback            = RP_AcqTriggerDelayNs,},
@@ -166,12 +159,15 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "ACQ:DATA:UNITS", .callback             = RP_AcqScpiDataUnits,},
     {.pattern = "ACQ:DATA:UNITS?", .callback            = RP_AcqScpiDataUnitsQ,},
     {.pattern = "ACQ:DATA:FORMAT", .callback            = RP_AcqSetDataFormat,},
+    {.pattern = "ACQ:DATA:ENDIAN", .callback            = RP_AcqSetDataEndian,},
     {.pattern = "ACQ:SOUR#:DATA:STA:END?", .callback    = RP_AcqDataPosQ,},
     {.pattern = "ACQ:SOUR#:DATA:STA:N?", .callback      = RP_AcqDataQ,},
     {.pattern = "ACQ:SOUR#:DATA:OLD:N?", .callback      = RP_AcqOldestDataQ,},
     {.pattern = "ACQ:SOUR#:DATA?", .callback            = RP_AcqDataOldestAllQ,},
     {.pattern = "ACQ:SOUR#:DATA:LAT:N?", .callback      = RP_AcqLatestDataQ,},
     {.pattern = "ACQ:BUF:SIZE?", .callback              = RP_AcqBufferSizeQ,},
+    {.pattern = "ACQ:SOUR#:STREAM", .callback           = RP_AcqStream,},
+    {.pattern = "ACQ:SOUR#:STREAM?", .callback          = RP_AcqStreamQ,},
 
     /* Generate */
     {.pattern = "GEN:RST", .callback                    = RP_GenReset,},
@@ -191,6 +187,7 @@ static const scpi_command_t scpi_commands[] = {
     {.pattern = "SOUR#:DCYC?", .callback                = RP_GenDutyCycleQ,},
     {.pattern = "SOUR#:TRAC:DATA:DATA", .callback       = RP_GenArbitraryWaveForm,},
     {.pattern = "SOUR#:TRAC:DATA:DATA?", .callback      = RP_GenArbitraryWaveFormQ,},
+    {.pattern = "SOUR#:TRAC:DATA:RAW", .callback        = RP_GenArbitraryWaveFormRaw,},
     {.pattern = "SOUR#:BURS:STAT", .callback            = RP_GenGenerateMode,},
     {.pattern = "SOUR#:BURS:STAT?", .callback           = RP_GenGenerateModeQ,},
     {.pattern = "SOUR#:BURS:NCYC", .callback            = RP_GenBurstCount,},
@@ -232,3 +229,276 @@ scpi_t scpi_context = {
     .idn = {"REDPITAYA", "INSTR2014", NULL, "01-02"},
 };
 
+
+/**
+ * Every connection gets its own parser with its own input buffer and
+ * registers, set up from scpi_context. The hardware behind it is shared.
+ */
+scpi_t *RP_ScpiContextCreate(rp_scpi_client_t *client) {
+    scpi_t *context = malloc(sizeof(scpi_t));
+    char *buffer = malloc(SCPI_INPUT_BUFFER_LENGTH);
+    scpi_reg_val_t *regs = calloc(SCPI_REG_COUNT, sizeof(scpi_reg_val_t));
+    if (context == NULL || buffer == NULL || regs == NULL) {
+        free(context);
+        free(buffer);
+        free(regs);
+        return NULL;
+    }
+    *context = scpi_context;
+    context->buffer.data = buffer;
+    context->registers = regs;
+    context->user_context = client;
+    context->binary_output = false;
+    SCPI_Init(context);
+    return context;
+}
+
+void RP_ScpiContextDestroy(scpi_t *context) {
+    if (context == NULL) {
+        return;
+    }
+    free(context->buffer.data);
+    free(context->registers);
+    free(context);
+}
+
+/*
+ * The parser matches a line against the patterns one by one. Commands are
+ * grouped by their root keyword once at startup, and a line whose root is
+ * known is parsed against its group only, which holds every pattern that
+ * can match it in table order. Anything else gets the whole table.
+ */
+#define COMMAND_COUNT (sizeof(scpi_commands) / sizeof(scpi_commands[0]) - 1)
+#define DISPATCH_SLOTS 64
+#define DISPATCH_KEY_LEN 16
+
+typedef struct {
+    scpi_command_t *commands;   // NULL terminated
+    uint16_t       *index;      // Position of each command in scpi_commands
+} dispatch_group_t;
+
+typedef struct {
+    char              key[DISPATCH_KEY_LEN];
+    dispatch_group_t *group;
+} dispatch_slot_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} command_perf_t;
+
+static bool dispatch_ready = false;
+static dispatch_group_t dispatch_groups[COMMAND_COUNT];
+static dispatch_slot_t dispatch_slots[DISPATCH_SLOTS];
+static command_perf_t command_perf[COMMAND_COUNT];
+
+static uint32_t keyHash(const char *key) {
+    uint32_t hash = 2166136261u;
+    while (*key) {
+        hash = (hash ^ (uint8_t)*key++) * 16777619u;
+    }
+    return hash;
+}
+
+static dispatch_slot_t *findSlot(const char *key) {
+    uint32_t i = keyHash(key);
+    for (int n = 0; n < DISPATCH_SLOTS; n++, i++) {
+        dispatch_slot_t *slot = &dispatch_slots[i % DISPATCH_SLOTS];
+        if (slot->group == NULL || strcmp(slot->key, key) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/* Root keyword of a pattern, either the long form or only its upper case short form */
+static bool patternRoot(const char *pattern, char *key, bool short_form) {
+    size_t n = 0;
+    for (; *pattern && !strchr(":?#[", *pattern); pattern++) {
+        if (short_form && islower((unsigned char)*pattern)) {
+            continue;
+        }
+        if (n + 1 >= DISPATCH_KEY_LEN) {
+            return false;
+        }
+        key[n++] = toupper((unsigned char)*pattern);
+    }
+    key[n] = '\0';
+    return n > 0;
+}
+
+/* Root keyword of an input line without its numeric suffix */
+static bool inputRoot(const char *data, size_t len, char *key) {
+    size_t i = 0;
+    while (i < len && isspace((unsigned char)data[i])) {
+        i++;
+    }
+    if (i < len && data[i] == ':') {
+        i++;
+    }
+    size_t n = 0;
+    for (; i < len && !strchr(":?; \t\r\n", data[i]); i++) {
+        if (n + 1 >= DISPATCH_KEY_LEN) {
+            return false;
+        }
+        key[n++] = toupper((unsigned char)data[i]);
+    }
+    // Further commands of the line are relative to this one, leave them to the full table
+    if (memchr(data + i, ';', len - i) != NULL) {
+        return false;
+    }
+    while (n > 0 && isdigit((unsigned char)key[n - 1])) {
+        n--;
+    }
+    key[n] = '\0';
+    return n > 0;
+}
+
+static bool addKey(const char *key, dispatch_group_t *group) {
+    dispatch_slot_t *slot = findSlot(key);
+    if (slot == NULL) {
+        return false;
+    }
+    if (slot->group == NULL) {
+        strcpy(slot->key, key);
+        slot->group = group;
+    }
+    return slot->group == group;
+}
+
+int RP_ScpiDispatchInit(void) {
+    size_t sizes[COMMAND_COUNT] = { 0 };
+    size_t groups = 0;
+    char key[DISPATCH_KEY_LEN];
+
+    // Size the groups first, one per distinct long root keyword
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        if (!patternRoot(scpi_commands[i].pattern, key, false)) {
+            return -1;
+        }
+        dispatch_slot_t *slot = findSlot(key);
+        if (slot == NULL) {
+            return -1;
+        }
+        if (slot->group == NULL) {
+            strcpy(slot->key, key);
+            slot->group = &dispatch_groups[groups++];
+        }
+        sizes[slot->group - dispatch_groups]++;
+    }
+
+    for (size_t g = 0; g < groups; g++) {
+        dispatch_groups[g].commands = calloc(sizes[g] + 1, sizeof(scpi_command_t));
+        dispatch_groups[g].index = calloc(sizes[g], sizeof(uint16_t));
+        if (dispatch_groups[g].commands == NULL || dispatch_groups[g].index == NULL) {
+            return -1;
+        }
+        sizes[g] = 0;
+    }
+
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        patternRoot(scpi_commands[i].pattern, key, false);
+        dispatch_group_t *group = findSlot(key)->group;
+        size_t g = group - dispatch_groups;
+        group->commands[sizes[g]] = scpi_commands[i];
+        group->index[sizes[g]] = i;
+        sizes[g]++;
+
+        // The short form reaches the same group
+        patternRoot(scpi_commands[i].pattern, key, true);
+        if (!addKey(key, group)) {
+            syslog(LOG_ERR, "Ambiguous SCPI root keyword %s", key);
+            return -1;
+        }
+    }
+    dispatch_ready = true;
+    return 0;
+}
+
+static uint64_t monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Parses and executes one line of input and accounts its time to the
+ * command it ran. A line with several commands counts for the last one.
+ */
+int RP_ScpiInput(scpi_t *context, const char *data, size_t len) {
+    dispatch_group_t *group = NULL;
+    char key[DISPATCH_KEY_LEN];
+    if (dispatch_ready && inputRoot(data, len, key)) {
+        dispatch_slot_t *slot = findSlot(key);
+        if (slot != NULL) {
+            group = slot->group;
+        }
+    }
+
+    context->cmdlist = group != NULL ? group->commands : scpi_commands;
+    context->param_list.cmd = NULL;
+    uint64_t start = monotonicNs();
+    int result = SCPI_Input(context, data, len);
+    uint64_t elapsed = monotonicNs() - start;
+    // the parser flushes after each command with a result, errors and
+    // commands without one leave their output here
+    RP_OutputFlush(context);
+
+    const scpi_command_t *cmd = context->param_list.cmd;
+    if (cmd != NULL) {
+        size_t i = group != NULL ? group->index[cmd - group->commands] : (size_t)(cmd - scpi_commands);
+        command_perf[i].count++;
+        command_perf[i].total_ns += elapsed;
+        if (elapsed > command_perf[i].max_ns) {
+            command_perf[i].max_ns = elapsed;
+        }
+    }
+    context->cmdlist = scpi_commands;
+    return result;
+}
+
+#define REG_STATS_MAX 256
+
+/**
+ * Returns pattern, count, mean and maximum time in microseconds of
+ * every command executed since start or SYST:PERF:RST. A librp built
+ * with register statistics adds function name, register reads, writes
+ * and total time in microseconds of every function that accessed them.
+ */
+scpi_result_t RP_SystemPerfQ(scpi_t *context) {
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        const command_perf_t *perf = &command_perf[i];
+        if (perf->count == 0) {
+            continue;
+        }
+        SCPI_ResultMnemonic(context, scpi_commands[i].pattern);
+        SCPI_ResultInt32(context, perf->count);
+        SCPI_ResultInt32(context, perf->total_ns / perf->count / 1000);
+        SCPI_ResultInt32(context, perf->max_ns / 1000);
+    }
+
+    static rp_reg_stats_t stats[REG_STATS_MAX];
+    uint32_t count = REG_STATS_MAX;
+    int result = rp_RegStatsGet(stats, &count);
+    if (result != RP_OK && result != RP_BTS) {
+        return SCPI_RES_OK;
+    }
+    for (uint32_t i = 0; i < count && i < REG_STATS_MAX; i++) {
+        if (stats[i].reads == 0 && stats[i].writes == 0) {
+            continue;
+        }
+        SCPI_ResultMnemonic(context, stats[i].function);
+        SCPI_ResultInt32(context, stats[i].reads);
+        SCPI_ResultInt32(context, stats[i].writes);
+        SCPI_ResultInt32(context, stats[i].time_ns / 1000);
+    }
+    return SCPI_RES_OK;
+}
+
+scpi_result_t RP_SystemPerfReset(scpi_t *context) {
+    memset(command_perf, 0, sizeof(command_perf));
+    rp_RegStatsReset();
+    return SCPI_RES_OK;
+}
+
@@ -16,8 +16,20 @@
 #define SCPI_COMMANDS_H_
 
 #include "scpi/scpi.h"
+#include "common.h"
 
 extern scpi_t scpi_context;
 
+size_t SCPI_Write(scpi_t * context, const char * data, size_t len);
+
+scpi_t *RP_ScpiContextCreate(rp_scpi_client_t *client);
+void RP_ScpiContextDestroy(scpi_t *context);
+
+int RP_ScpiDispatchInit(void);
+int RP_ScpiInput(scpi_t *context, const char *data, size_t len);
+
+scpi_result_t RP_SystemPerfQ(scpi_t *context);
+scpi_result_t RP_SystemPerfReset(scpi_t *context);
+
 
 #endif /* SCPI_COMMANDS_H_ */
@@ -18,7 +18,8 @@
 #include <string.h>
 
 #include <netinet/in.h>
-#include <sys/prctl.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
 #include <errno.h>
 #include <arpa/inet.h>
 #include <signal.h>
@@ -27,6 +28,7 @@
 
 #include "scpi-commands.h"
 #include "common.h"
+#include "acquire.h"
 
 #include "scpi/parser.h"
 #include "redpitaya/rp.h"
@@ -37,21 +39,30 @@
 #define LISTEN_BACKLOG 50
 #define LISTEN_PORT 5000
 #define MAX_BUFF_SIZE 1024
+#define MAX_CONNECTIONS 16
+#define MAX_EVENTS 16
+// Capture completion is polled this often while a client streams
+#define STREAM_POLL_MS 1
+
+/* A client connection with its own parser and unparsed input */
+typedef struct client {
+    rp_scpi_client_t state;
+    scpi_t          *context;
+    char            *message_buff;
+    size_t           message_len;
+    size_t           msg_end;
+    struct in_addr   addr;
+    struct client   *next;
+} client_t;
 
 static bool app_exit = false;
+static bool log_commands = false;
+static client_t *clients = NULL;
+// Epoll tag of the acquisition trigger interrupt
+static int trigger_tag;
 static char delimiter[] = "\r\n";
 
 
-static void handleCloseChildEvents()
-{
-    struct sigaction sigchld_action = {
-            .sa_handler = SIG_DFL,
-            .sa_flags = SA_NOCLDWAIT
-    };
-    sigaction(SIGCHLD, &sigchld_action, NULL);
-}
-
-
 static void termSignalHandler(int signum)
 {
     app_exit = true;
@@ -103,6 +114,10 @@ static size_t getNextCommand(const char* buffer, size_t bufferLen)
 }
 
 void LogMessage(char *m, size_t len) {
+    if (!log_commands) {
+        return;
+    }
+
     const size_t buff_len = 50;
     char buff[buff_len];
 
@@ -110,92 +125,195 @@ void LogMessage(char *m, size_t len) {
     strncpy(buff, m, len);
     buff[len - 1] = '\0';
 
-    RP_LOG(LOG_INFO, "Processing command: %s\n", buff);
+    syslog(LOG_INFO, "Processing command: %s\n", buff);
 }
 
-/**
- * This is main method of every child process. Here communication with client is handled.
- * @param connfd The communication port
- * @return
- */
-static int handleConnection(int connfd) {
-    int read_size;
+static client_t *createClient(int connfd, struct in_addr addr) {
+    client_t *client = calloc(1, sizeof(client_t));
+    if (client == NULL) {
+        return NULL;
+    }
+    client->state.fd = connfd;
+    // responses are coalesced by RP_OutputFlush(), Nagle would only delay them
+    int one = 1;
+    setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    client->state.unit = RP_SCPI_VOLTS;
+    client->state.big_endian = true;
+    client->addr = addr;
+    client->message_len = MAX_BUFF_SIZE;
+    client->message_buff = malloc(client->message_len);
+    client->context = RP_ScpiContextCreate(&client->state);
+    if (client->message_buff == NULL || client->context == NULL) {
+        free(client->message_buff);
+        RP_ScpiContextDestroy(client->context);
+        free(client);
+        return NULL;
+    }
+    client->next = clients;
+    clients = client;
+    return client;
+}
 
-    size_t message_len = MAX_BUFF_SIZE;
-    char *message_buff = malloc(message_len);
-    char buffer[MAX_BUFF_SIZE];
-    size_t msg_end = 0;
+static void destroyClient(client_t *client) {
+    for (client_t **p = &clients; *p != NULL; p = &(*p)->next) {
+        if (*p == client) {
+            *p = client->next;
+            break;
+        }
+    }
+    close(client->state.fd);
+    RP_ScpiContextDestroy(client->context);
+    free(client->message_buff);
+    free(client);
+}
 
-    installTermSignalHandler();
+/**
+ * Runs the complete commands in the message buffer. A command that waits
+ * for the acquisition parks the client, the rest of its input stays in the
+ * buffer until serveWaits() resumes it.
+ * @param client The client connection
+ */
+static void runCommands(client_t *client) {
+    char *m = client->message_buff;
+    size_t pos = -1;
+    while (client->state.wait == RP_SCPI_WAIT_NONE &&
+           (pos = getNextCommand(m, client->msg_end)) != -1) {
+
+        // Log out message
+        LogMessage(m, pos);
+
+        //Parse the message and return response
+        RP_ScpiInput(client->context, m, pos);
+        m += pos;
+        client->msg_end -= pos;
+    }
 
-    prctl( 1, SIGTERM );
+    // Move the rest of the message to the beginning of the buffer
+    if (client->message_buff != m && client->msg_end > 0) {
+        memmove(client->message_buff, m, client->msg_end);
+    }
+}
 
-    RP_LOG(LOG_INFO, "Waiting for first client request.");
+/**
+ * Reads what the client sent and runs every complete command in it.
+ * Called when the socket is readable, so the single recv does not block.
+ * @param client The client connection
+ * @return 0 while the connection stays open, 1 when it is closed or failed
+ */
+static int handleClientData(client_t *client) {
+    char buffer[MAX_BUFF_SIZE];
 
-    //Receive a message from client
-    while( (read_size = recv(connfd , buffer , MAX_BUFF_SIZE , 0)) > 0 )
-    {
-        if (app_exit) {
-            break;
+    int read_size = recv(client->state.fd, buffer, MAX_BUFF_SIZE, 0);
+    if (read_size == 0) {
+        RP_LOG(LOG_INFO, "Client is disconnected");
+        return 1;
+    }
+    if (read_size < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            return 0;
         }
+        RP_LOG(LOG_ERR, "Receive message failed (%s)", strerror(errno));
+        return 1;
+    }
 
-        // First make sure that message buffer is large enough
-        while (msg_end + read_size >= message_len) {
-            message_len *= 2;
-            message_buff = realloc(message_buff, message_len);
+    // First make sure that message buffer is large enough
+    while (client->msg_end + read_size >= client->message_len) {
+        char *message_buff = realloc(client->message_buff, client->message_len * 2);
+        if (message_buff == NULL) {
+            RP_LOG(LOG_ERR, "Out of memory for client message");
+            return 1;
         }
+        client->message_buff = message_buff;
+        client->message_len *= 2;
+    }
 
-        // Copy read buffer into message buffer
-        memcpy(message_buff + msg_end, buffer, read_size);
-        msg_end += read_size;
-
-        // Now try to parse each command out
-        char *m = message_buff;
-        size_t pos = -1;
-        while ((pos = getNextCommand(m, msg_end)) != -1) {
+    // Copy read buffer into message buffer
+    memcpy(client->message_buff + client->msg_end, buffer, read_size);
+    client->msg_end += read_size;
 
-            // Log out message
-            LogMessage(m, pos);
+    runCommands(client);
+    return 0;
+}
 
-            //Parse the message and return response
-            SCPI_Input(&scpi_context, m, pos);
-            m += pos;
-            msg_end -= pos;
+static bool isWaiting() {
+    for (client_t *client = clients; client != NULL; client = client->next) {
+        if (client->state.wait != RP_SCPI_WAIT_NONE) {
+            return true;
         }
+    }
+    return false;
+}
 
-        // Move the rest of the message to the beginning of the buffer
-        if (message_buff != m && msg_end > 0) {
-            memmove(message_buff, m, msg_end);
+static bool isStreaming() {
+    for (client_t *client = clients; client != NULL; client = client->next) {
+        if (client->state.stream) {
+            return true;
         }
-
-        RP_LOG(LOG_INFO, "Waiting for next client request.\n");
     }
+    return false;
+}
 
-    free(message_buff);
-
-    RP_LOG(LOG_INFO, "Closing client connection...");
+/**
+ * Pushes the finished capture to every streaming client and re-arms.
+ * The trigger interrupt only wakes the loop early, completion of the
+ * trigger delay is checked on every pass.
+ */
+static void serveStreams() {
+    if (!RP_AcqStreamCaptured()) {
+        return;
+    }
+    for (client_t *client = clients; client != NULL; client = client->next) {
+        if (client->state.stream) {
+            RP_AcqStreamPush(client->context);
+        }
+    }
+    RP_AcqStreamRearm();
+}
 
-    if(read_size == 0)
-    {
-        RP_LOG(LOG_INFO, "Client is disconnected");
-        return 0;
+/**
+ * Time until the loop has to look at the waiting clients again, -1 when it
+ * can sleep until an event. Before the trigger the interrupt wakes the loop,
+ * the end of the trigger delay and waits without an interrupt are polled.
+ */
+static int waitTimeout(int trigger_fd) {
+    int timeout = -1;
+    if (!isWaiting()) {
+        return timeout;
     }
-    else if(read_size == -1)
-    {
-        RP_LOG(LOG_ERR, "Receive message failed (%s)", strerror(errno));
-        perror("Receive message failed");
-        return 1;
+    for (client_t *client = clients; client != NULL; client = client->next) {
+        if (client->state.wait != RP_SCPI_WAIT_NONE) {
+            int left = RP_AcqWaitLeftMs(client->context);
+            if (left >= 0 && (timeout < 0 || left < timeout)) {
+                timeout = left;
+            }
+        }
     }
-    return 0;
+    if (trigger_fd < 0 || !RP_AcqTriggerArmed()) {
+        timeout = timeout < 0 ? STREAM_POLL_MS : MIN(timeout, STREAM_POLL_MS);
+    }
+    return timeout;
 }
 
+/**
+ * Answers the waits that completed or timed out and runs the commands
+ * their clients sent in the meantime.
+ */
+static void serveWaits() {
+    for (client_t *client = clients; client != NULL; client = client->next) {
+        if (client->state.wait != RP_SCPI_WAIT_NONE && RP_AcqWaitPoll(client->context)) {
+            runCommands(client);
+        }
+    }
+}
 
 /**
  * Main daemon entrance point. Opens a socket and listens for any incoming connection.
- * When client connects, if forks the conversation into a new socket and the daemon (parent process)
- * waits for another connection. It can handle multiple connections simultaneously.
- * @param argc  not used
- * @param argv  not used
+ * All connections are served by one process from an epoll loop, each with its own
+ * parser, so they share one hardware context and commands of different clients
+ * never run at the same time.
+ * @param argc  argument count
+ * @param argv  -m <count> limits the number of simultaneous connections,
+ *              -l logs every received command to syslog
  * @return
  */
 int main(int argc, char *argv[])
@@ -207,15 +325,27 @@ int main(int argc, char *argv[])
 
     RP_LOG (LOG_NOTICE, "scpi-server started");
 
+    int max_connections = MAX_CONNECTIONS;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:l")) != -1) {
+        if (opt == 'm' && atoi(optarg) > 0) {
+            max_connections = atoi(optarg);
+        } else if (opt == 'l') {
+            log_commands = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-m max_connections] [-l]\n", argv[0]);
+            return (EXIT_FAILURE);
+        }
+    }
+
     installTermSignalHandler();
 
+    // A client that went away must not kill the server on write
+    signal(SIGPIPE, SIG_IGN);
+
     int listenfd = 0, connfd = 0;
     struct sockaddr_in serv_addr;
 
-    // Handle close child events
-    handleCloseChildEvents();
-
-
     int result = rp_Init();
     if (result != RP_OK) {
         RP_LOG(LOG_ERR, "Failed to initialize RP APP library: %s", rp_GetError(result));
@@ -228,10 +358,10 @@ int main(int argc, char *argv[])
         return (EXIT_FAILURE);
     }
 
-    // user_context will be pointer to socket
-    scpi_context.user_context = NULL;
-    scpi_context.binary_output = false;
-    SCPI_Init(&scpi_context);
+    // Without the lookup every line is matched against the whole table
+    if (RP_ScpiDispatchInit() != 0) {
+        RP_LOG(LOG_ERR, "Failed to build SCPI command lookup");
+    }
 
     // Create a socket
     listenfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -262,54 +392,113 @@ int main(int argc, char *argv[])
         return (EXIT_FAILURE);
     }
 
+    int epollfd = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epollfd == -1 || epoll_ctl(epollfd, EPOLL_CTL_ADD, listenfd, &ev) == -1)
+    {
+        RP_LOG(LOG_ERR, "Failed to set up epoll (%s)", strerror(errno));
+        perror("Failed to set up epoll");
+        return (EXIT_FAILURE);
+    }
+
     RP_LOG(LOG_INFO, "Server is listening on port %d\n", LISTEN_PORT);
 
     // Socket is opened and listening on port. Now we can accept connections
-    while(1)
+    int connections = 0;
+    int trigger_fd = -1;
+    if (rp_AcqGetTriggerFd(&trigger_fd) != RP_OK) {
+        trigger_fd = -1;
+    }
+    bool trigger_watched = false;
+    struct epoll_event events[MAX_EVENTS];
+    while(!app_exit)
     {
-        struct sockaddr_in cliaddr;
-        socklen_t clilen;
-        clilen = sizeof(cliaddr);
-
-        connfd = accept(listenfd, (struct sockaddr *)&cliaddr, &clilen);
+        bool streaming = isStreaming();
+        int timeout = waitTimeout(trigger_fd);
+        bool watch = streaming || isWaiting();
+        if (trigger_fd >= 0 && watch != trigger_watched) {
+            struct epoll_event tev = { .events = EPOLLIN, .data.ptr = &trigger_tag };
+            epoll_ctl(epollfd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, trigger_fd, &tev);
+            trigger_watched = watch;
+        }
+        if (streaming) {
+            timeout = timeout < 0 ? STREAM_POLL_MS : MIN(timeout, STREAM_POLL_MS);
+        }
 
-        if (app_exit == true) {
+        int count = epoll_wait(epollfd, events, MAX_EVENTS, timeout);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            RP_LOG(LOG_ERR, "Failed to wait for events (%s)", strerror(errno));
             break;
         }
 
-        if (connfd == -1) {
-            RP_LOG(LOG_ERR, "Failed to accept connection (%s)", strerror(errno));
-            perror("Failed to accept connection\n");
-            return (EXIT_FAILURE);
-        }
+        for (int i = 0; i < count; i++) {
+            client_t *client = events[i].data.ptr;
 
-        // Fork a child process, which will talk to the client
-        if (!fork()) {
+            // Consumed by serveWaits() and serveStreams() below
+            if (events[i].data.ptr == &trigger_tag) {
+                continue;
+            }
 
-            RP_LOG(LOG_INFO, "Connection with client ip %s established.", inet_ntoa(cliaddr.sin_addr));
+            if (client == NULL) {
+                struct sockaddr_in cliaddr;
+                socklen_t clilen;
+                clilen = sizeof(cliaddr);
 
-            // this is the child process
-            close(listenfd); // child doesn't need the listener
+                connfd = accept(listenfd, (struct sockaddr *)&cliaddr, &clilen);
+                if (connfd == -1) {
+                    RP_LOG(LOG_ERR, "Failed to accept connection (%s)", strerror(errno));
+                    continue;
+                }
 
-            scpi_context.user_context = &connfd;
+                if (connections >= max_connections) {
+                    RP_LOG(LOG_ERR, "Refusing client ip %s, %d connections are open.", inet_ntoa(cliaddr.sin_addr), connections);
+                    close(connfd);
+                    continue;
+                }
 
-            result = handleConnection(connfd);
+                client = createClient(connfd, cliaddr.sin_addr);
+                if (client == NULL) {
+                    RP_LOG(LOG_ERR, "Failed to create client state");
+                    close(connfd);
+                    continue;
+                }
 
-            close(connfd);
+                struct epoll_event cev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = client };
+                if (epoll_ctl(epollfd, EPOLL_CTL_ADD, connfd, &cev) == -1) {
+                    RP_LOG(LOG_ERR, "Failed to watch connection (%s)", strerror(errno));
+                    destroyClient(client);
+                    continue;
+                }
 
-            RP_LOG(LOG_INFO, "Closing connection with client ip %s.", inet_ntoa(cliaddr.sin_addr));
+                connections++;
+                RP_LOG(LOG_INFO, "Connection with client ip %s established.", inet_ntoa(cliaddr.sin_addr));
+                continue;
+            }
 
-            if (result == 0) {
-                return(EXIT_SUCCESS);
+            // Data that arrived before a hang up is still processed
+            int closed = 0;
+            if (events[i].events & EPOLLIN) {
+                closed = handleClientData(client);
             }
-            else {
-                return(EXIT_FAILURE);
+            if (closed || (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))) {
+                RP_LOG(LOG_INFO, "Closing connection with client ip %s.", inet_ntoa(client->addr));
+                epoll_ctl(epollfd, EPOLL_CTL_DEL, client->state.fd, NULL);
+                destroyClient(client);
+                connections--;
             }
         }
 
-        close(connfd);
+        // Before the stream re-arms, so the waits see the finished capture
+        serveWaits();
+        if (streaming) {
+            serveStreams();
+        }
     }
 
+    close(epollfd);
     close(listenfd);
 
     result = rp_Release();